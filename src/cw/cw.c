@@ -29,6 +29,14 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h> /* FreeBSD 12.1 */
@@ -42,6 +50,7 @@
 
 #include <libcw.h>
 #include <libcw_debug.h>
+#include <libcw2.h>
 
 #include <cwutils/i18n.h>
 #include <cwutils/cw_cmdline.h>
@@ -65,10 +74,68 @@ static void write_to_cw_sender (const char *format, ...)
 
 static void signal_handler(int signal_number);
 static void cw_atexit(void);
+static void startup_timing_keying_callback(void *arg, int key_value);
+
+static void sender_output (FILE *stream, const char *text, size_t length);
+static void sender_print_due (void);
+static void wait_for_cw_sender (void);
 
 static cw_config_t *config; /* program-specific configuration */
 static bool generator = false;     /* have we created a generator? */
 static bool g_is_running = false;
+static bool g_is_quit_requested = false;  /* Quit command received in server mode. */
+
+/* Streams for echo and for messages; a client's socket in server mode. */
+static FILE *g_echo_stream;
+static FILE *g_message_stream;
+
+
+/*
+ * State of CW sender.
+ *
+ * Input is parsed in blocks, and characters of a block are enqueued in the
+ * generator one after another, without waiting for each of them to be
+ * sounded.  Every sounded character gets a token that the generator completes
+ * when the character has been played.  Echo of a character is delayed until
+ * the character starts to sound: echoed text waits on a list of pending
+ * items, each tagged with the token of the character enqueued before it.  A
+ * separate thread watches completion of tokens and prints the items that are
+ * due.
+ *
+ * Without read-ahead (-r option) cw waits at the end of each block of input,
+ * and before each embedded command, until the tone queue drains to its last
+ * tone.  With read-ahead, characters are enqueued for as long as duration of
+ * sound waiting in the tone queue doesn't exceed the configured time.
+ */
+typedef struct
+{
+  FILE *stream;
+  uint64_t token;  /* Print when this token is completed; 0: print right away. */
+  char c;
+} output_item_t;
+
+static struct
+{
+  cw_gen_t *gen;             /* NULL when sender is not started. */
+  bool is_read_ahead;
+  uint64_t duration;         /* Max. duration of queued sound [microseconds]. */
+
+  pthread_mutex_t mutex;
+  pthread_cond_t queue_low;  /* Signalled when the queue drops to 'duration'. */
+
+  uint64_t last_token;       /* Token of the last enqueued character. */
+
+  output_item_t *items;      /* Pending output, items[head] to items[tail - 1]. */
+  size_t head;
+  size_t tail;
+  size_t capacity;
+
+  pthread_t echo_thread;
+  bool is_echo_thread_running;
+} sender = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .queue_low = PTHREAD_COND_INITIALIZER
+};
 
 
 
@@ -87,7 +154,8 @@ extern cw_debug_t cw_debug_object;
  * write_to_message_stream()
  *
  * Local fprintf functions that suppress output to if the appropriate flag
- * is not set; writes are synchronously flushed.
+ * is not set; writes are synchronously flushed.  Echo is printed after
+ * characters enqueued so far start to sound.
  */
 static void
 write_to_echo_stream (const char *format, ...)
@@ -95,11 +163,20 @@ write_to_echo_stream (const char *format, ...)
   if (config->do_echo)
     {
       va_list ap;
+      char buffer[128];
+      int length;
 
       va_start (ap, format);
-      vfprintf (stdout, format, ap);
-      fflush (stdout);
+      length = vsnprintf (buffer, sizeof (buffer), format, ap);
       va_end (ap);
+
+      if (length > 0)
+        {
+          sender_output (g_echo_stream, buffer,
+                         (size_t) length < sizeof (buffer) ? (size_t) length
+                                                           : sizeof (buffer) - 1);
+          sender_print_due ();
+        }
     }
 }
 
@@ -110,9 +187,12 @@ write_to_message_stream (const char *format, ...)
     {
       va_list ap;
 
+      /* Don't let the message overtake echo that is already due. */
+      sender_print_due ();
+
       va_start (ap, format);
-      vfprintf (stderr, format, ap);
-      fflush (stderr);
+      vfprintf (g_message_stream, format, ap);
+      fflush (g_message_stream);
       va_end (ap);
     }
 }
@@ -129,6 +209,7 @@ write_to_cw_sender (const char *format, ...)
 {
   va_list ap;
   char buffer[128];
+  uint64_t token;
 
   /*
    * Format the CW send buffer using vsnprintf.  Formatted strings longer than
@@ -139,13 +220,350 @@ write_to_cw_sender (const char *format, ...)
   va_end (ap);
 
   /* Sound the buffer, and wait for the send to complete. */
-  if (!cw_send_string (buffer))
+  pthread_mutex_lock (&sender.mutex);
+  if (!cw_gen_enqueue_string_with_token (sender.gen, buffer, &token))
     {
-      perror ("cw_send_string");
+      perror ("cw_gen_enqueue_string_with_token");
       cw_flush_tone_queue ();
       abort ();
     }
-  if (!cw_wait_for_tone_queue_critical (1))
+  sender.last_token = token;
+  pthread_mutex_unlock (&sender.mutex);
+
+  wait_for_cw_sender ();
+}
+
+
+/*---------------------------------------------------------------------*/
+/*  CW sender                                                          */
+/*---------------------------------------------------------------------*/
+
+/*
+ * sender_write_items()
+ *
+ * Print items[from] to items[to - 1], in runs of consecutive items going to
+ * the same stream.
+ */
+static void
+sender_write_items (size_t from, size_t to)
+{
+  char buffer[256];
+  size_t length = 0;
+  FILE *stream = NULL;
+
+  for (size_t i = from; i < to; i++)
+    {
+      if (sender.items[i].stream != stream || length == sizeof (buffer))
+        {
+          if (length > 0)
+            {
+              fwrite (buffer, 1, length, stream);
+              fflush (stream);
+            }
+          stream = sender.items[i].stream;
+          length = 0;
+        }
+      buffer[length++] = sender.items[i].c;
+    }
+  if (length > 0)
+    {
+      fwrite (buffer, 1, length, stream);
+      fflush (stream);
+    }
+}
+
+
+/*
+ * sender_print_due_locked()
+ *
+ * Print pending output whose tokens have been completed.  Tokens are
+ * completed in order, so only the first token of every run of items needs
+ * to be checked.  The caller must hold sender.mutex.
+ */
+static void
+sender_print_due_locked (void)
+{
+  uint64_t completed = 0;
+  size_t due = sender.head;
+
+  while (due != sender.tail)
+    {
+      const uint64_t token = sender.items[due].token;
+      if (token > completed)
+        {
+          if (!cw_gen_is_token_completed (sender.gen, token))
+            break;
+          completed = token;
+        }
+      due++;
+    }
+
+  sender_write_items (sender.head, due);
+  sender.head = due;
+  if (sender.head == sender.tail)
+    sender.head = sender.tail = 0;
+}
+
+
+/*
+ * sender_print_due()
+ *
+ * Print pending output whose characters have started sounding.
+ */
+static void
+sender_print_due (void)
+{
+  if (!sender.gen)
+    return;
+
+  pthread_mutex_lock (&sender.mutex);
+  sender_print_due_locked ();
+  pthread_mutex_unlock (&sender.mutex);
+}
+
+
+/*
+ * sender_append_locked()
+ *
+ * Put the text on list of pending output, to be printed when given token
+ * is completed.  The caller must hold sender.mutex.
+ */
+static void
+sender_append_locked (FILE *stream, uint64_t token, const char *text,
+                      size_t length)
+{
+  if (sender.tail + length > sender.capacity)
+    {
+      if (sender.head > 0)
+        {
+          memmove (sender.items, sender.items + sender.head,
+                   (sender.tail - sender.head) * sizeof (output_item_t));
+          sender.tail -= sender.head;
+          sender.head = 0;
+        }
+      if (sender.tail + length > sender.capacity)
+        {
+          size_t capacity = sender.capacity ? sender.capacity : 256;
+          while (sender.tail + length > capacity)
+            capacity *= 2;
+
+          output_item_t *items = realloc (sender.items, capacity * sizeof (output_item_t));
+          if (!items)
+            {
+              perror ("realloc");
+              cw_flush_tone_queue ();
+              abort ();
+            }
+          sender.items = items;
+          sender.capacity = capacity;
+        }
+    }
+
+  for (size_t i = 0; i < length; i++)
+    {
+      sender.items[sender.tail].stream = stream;
+      sender.items[sender.tail].token = token;
+      sender.items[sender.tail].c = text[i];
+      sender.tail++;
+    }
+}
+
+
+/*
+ * sender_output()
+ *
+ * Put the text on list of pending output.  The text is printed when all
+ * characters enqueued so far have started sounding, that is together with
+ * the next sounded character, or when the tone queue runs out of tones.
+ */
+static void
+sender_output (FILE *stream, const char *text, size_t length)
+{
+  if (!sender.gen)
+    {
+      fwrite (text, 1, length, stream);
+      fflush (stream);
+      return;
+    }
+
+  pthread_mutex_lock (&sender.mutex);
+  sender_append_locked (stream, sender.last_token, text, length);
+  pthread_mutex_unlock (&sender.mutex);
+}
+
+
+/*
+ * sender_discard()
+ *
+ * Discard all pending output, e.g. before flushing the tone queue.
+ */
+static void
+sender_discard (void)
+{
+  pthread_mutex_lock (&sender.mutex);
+  sender.head = sender.tail = 0;
+  pthread_mutex_unlock (&sender.mutex);
+}
+
+
+/*
+ * sender_release_stream()
+ *
+ * Print right away all pending output to the stream, and remove it from the
+ * list, e.g. before the stream is closed.
+ */
+static void
+sender_release_stream (FILE *stream)
+{
+  size_t kept;
+
+  pthread_mutex_lock (&sender.mutex);
+  kept = sender.head;
+  for (size_t i = sender.head; i < sender.tail; i++)
+    {
+      if (sender.items[i].stream == stream)
+        {
+          fputc (sender.items[i].c, stream);
+          continue;
+        }
+      sender.items[kept++] = sender.items[i];
+    }
+  sender.tail = kept;
+  fflush (stream);
+  pthread_mutex_unlock (&sender.mutex);
+}
+
+
+/*
+ * sender_queue_low()
+ *
+ * Callback called by generator when duration of sound in tone queue drops
+ * to the configured read-ahead time.
+ */
+static void
+sender_queue_low (void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock (&sender.mutex);
+  pthread_cond_signal (&sender.queue_low);
+  pthread_mutex_unlock (&sender.mutex);
+}
+
+
+/*
+ * sender_echo_thread()
+ *
+ * Thread function printing pending output as tokens are completed.
+ */
+static void *
+sender_echo_thread (void *arg)
+{
+  struct pollfd fd = { .fd = cw_gen_get_queue_event_fd (sender.gen),
+                       .events = POLLIN };
+  (void) arg;
+
+  pthread_mutex_lock (&sender.mutex);
+  while (sender.is_echo_thread_running)
+    {
+      pthread_mutex_unlock (&sender.mutex);
+
+      /* The timeout lets the thread notice a request to stop. */
+      poll (&fd, 1, 100);
+      cw_gen_clear_queue_event (sender.gen);
+
+      pthread_mutex_lock (&sender.mutex);
+      sender_print_due_locked ();
+    }
+  pthread_mutex_unlock (&sender.mutex);
+
+  return NULL;
+}
+
+
+/*
+ * sender_start()
+ *
+ * Start the CW sender, with given time of sound queued ahead (0 if
+ * read-ahead is not enabled).
+ */
+static void
+sender_start (int milliseconds)
+{
+  sender.gen = cw_generator_get ();
+  sender.last_token = 0;
+
+  if (milliseconds > 0)
+    {
+      sender.duration = (uint64_t) milliseconds * 1000;
+      if (!cw_gen_register_low_duration_callback (sender.gen, sender_queue_low,
+                                                  NULL, sender.duration))
+        {
+          perror ("cw_gen_register_low_duration_callback");
+          abort ();
+        }
+      sender.is_read_ahead = true;
+    }
+
+  sender.is_echo_thread_running = true;
+  if (0 != pthread_create (&sender.echo_thread, NULL, sender_echo_thread, NULL))
+    {
+      perror ("pthread_create");
+      abort ();
+    }
+}
+
+
+/*
+ * sender_stop()
+ *
+ * Stop the CW sender.  Pending output is either printed or discarded.
+ */
+static void
+sender_stop (bool print_pending)
+{
+  if (!sender.gen)
+    return;
+
+  pthread_mutex_lock (&sender.mutex);
+  sender.is_echo_thread_running = false;
+  pthread_mutex_unlock (&sender.mutex);
+  pthread_join (sender.echo_thread, NULL);
+
+  if (sender.is_read_ahead)
+    {
+      cw_gen_register_low_duration_callback (sender.gen, NULL, NULL, 0);
+      sender.is_read_ahead = false;
+    }
+
+  if (print_pending)
+    sender_write_items (sender.head, sender.tail);
+  free (sender.items);
+  sender.items = NULL;
+  sender.head = sender.tail = sender.capacity = 0;
+  sender.gen = NULL;
+}
+
+
+/*
+ * wait_for_cw_sender()
+ *
+ * Wait until the CW sender is ready to accept more input: until the tone
+ * queue drains to its last tone, or with read-ahead, until duration of sound
+ * in the tone queue drops to the read-ahead time.
+ */
+static void
+wait_for_cw_sender (void)
+{
+  if (sender.is_read_ahead)
+    {
+      pthread_mutex_lock (&sender.mutex);
+      while (g_is_running
+             && cw_gen_get_queue_duration (sender.gen) > sender.duration)
+        pthread_cond_wait (&sender.queue_low, &sender.mutex);
+      pthread_mutex_unlock (&sender.mutex);
+    }
+  else if (!cw_wait_for_tone_queue_critical (1))
     {
       perror ("cw_wait_for_tone_queue_critical");
       cw_flush_tone_queue ();
@@ -154,6 +572,7 @@ write_to_cw_sender (const char *format, ...)
 }
 
 
+
 /*---------------------------------------------------------------------*/
 /*  Embedded commands handling                                         */
 /*---------------------------------------------------------------------*/
@@ -162,19 +581,16 @@ write_to_cw_sender (const char *format, ...)
  * parse_stream_query()
  *
  * Handle a query received in the input stream.  The command escape character
- * and the query character have already been read and recognized.
+ * and the query character have already been read and recognized, and the
+ * character of queried parameter is passed in as the argument.
  */
 static void
-parse_stream_query (FILE *stream)
+parse_stream_query (int c)
 {
-  int c;
   int value;
 
-  c = toupper (getc_unlocked (stream));
   switch (c)
     {
-    case EOF:
-      return;
     default:
       write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_QUERY, c);
       return;
@@ -219,20 +635,17 @@ parse_stream_query (FILE *stream)
  * parse_stream_cwquery()
  *
  * Handle a cwquery received in the input stream.  The command escape
- * character and the cwquery character have already been read and recognized.
+ * character and the cwquery character have already been read and recognized,
+ * and the character of queried parameter is passed in as the argument.
  */
 static void
-parse_stream_cwquery (FILE *stream)
+parse_stream_cwquery (int c)
 {
-  int c;
   int value;
   const char *format;
 
-  c = toupper (getc_unlocked (stream));
   switch (c)
     {
-    case EOF:
-      return;
     default:
       write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_CWQUERY, c);
       return;
@@ -302,27 +715,32 @@ parse_stream_cwquery (FILE *stream)
  * parse_stream_parameter()
  *
  * Handle a parameter setting command received in the input stream.  The
- * command type character has already been read from the stream, and is passed
- * in as the first argument.
+ * command type character and text of the new value have already been read
+ * from the stream, and are passed in as arguments.
  */
 static void
-parse_stream_parameter (int c, FILE *stream)
+parse_stream_parameter (int c, const char *number)
 {
+  long number_value;
+  char *end;
   int value;
   int (*value_handler) (int);
 
   /* Parse and check the new parameter value. */
-  if (fscanf (stream, "%d;", &value) != 1)
+  errno = 0;
+  number_value = strtol (number, &end, 10);
+  if (end == number || *end != '\0' || errno == ERANGE
+      || number_value < INT_MIN || number_value > INT_MAX)
     {
       write_to_message_stream ("%c%c", CW_STATUS_ERR, c);
       return;
     }
+  value = (int) number_value;
 
   /* Either assign a handler, or update the local flag, as appropriate. */
   value_handler = NULL;
   switch (c)
     {
-    case EOF:
     default:
       return;
     case CW_CMDV_FREQUENCY:
@@ -375,194 +793,1139 @@ parse_stream_parameter (int c, FILE *stream)
 }
 
 
+/*---------------------------------------------------------------------*/
+/*  Input stream handling                                              */
+/*---------------------------------------------------------------------*/
+
+/* Size of block of input read from stream in one go. */
+#define PARSER_BLOCK_SIZE 4096
+
+/* Max. length of value of a parameter setting command, e.g. "-100". */
+#define PARSER_NUMBER_MAX 11
+
 /*
- * parse_stream_command()
- *
- * Handle a command received in the input stream.  The command escape
- * character has already been read and recognized.
+ * State of parser of input.  The state is kept between blocks of input, so
+ * combinations, comments and embedded commands may be split across blocks.
  */
-static void
-parse_stream_command (FILE *stream)
+typedef struct
 {
-  int c;
+  enum { NONE, COMBINATION, COMMENT, NESTED_COMMENT } state;
 
-  c = toupper (getc_unlocked (stream));
-  switch (c)
-    {
-    case EOF:
-      return;
-    default:
-      write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_ESCAPE, c);
-      return;
-    case CW_CMDV_FREQUENCY:
-    case CW_CMDV_VOLUME:
-    case CW_CMDV_SPEED:
-    case CW_CMDV_GAP:
-    case CW_CMDV_WEIGHTING:
-    case CW_CMDV_ECHO:
-    case CW_CMDV_ERRORS:
-    case CW_CMDV_COMMANDS:
-    case CW_CMDV_COMBINATIONS:
-    case CW_CMDV_COMMENTS:
-      parse_stream_parameter (c, stream);
-      break;
-    case CW_CMD_QUERY:
-      parse_stream_query (stream);
-      break;
-    case CW_CMD_CWQUERY:
-      parse_stream_cwquery (stream);
-      break;
-    case CW_CMDV_QUIT:
-      cw_flush_tone_queue ();
-      write_to_echo_stream ("%c", '\n');
-      exit (EXIT_SUCCESS);
-    }
-}
+  /* Embedded command being read: command character (0 if the command
+     escape has just been read), and value of parameter setting command. */
+  bool is_in_command;
+  int command;
+  char number[PARSER_NUMBER_MAX + 1];
+  size_t number_length;
+  bool is_number_too_long;
 
+  /* Character of combination waiting for the next input character, or
+     EOF if there is none. */
+  int combination_char;
+} parser_t;
 
-/*---------------------------------------------------------------------*/
-/*  Input stream handling                                              */
-/*---------------------------------------------------------------------*/
 
 /*
  * send_cw_character()
  *
- * Sends the given character to the CW sender, and waits for it to complete
- * sounding the tones.  The character to send may be a partial or a complete
- * character.
+ * Sends the given character to the CW sender.  The character to send may be
+ * a partial or a complete character.  Unless the read-ahead limit is reached,
+ * the function doesn't wait for the character to be sounded.
  */
 static void
-send_cw_character (int c, int is_partial)
+send_cw_character (int c, bool is_partial)
 {
-  int character;
+  const char string[2] = { isspace (c) ? ' ' : (char) c, '\0' };
+  uint64_t token = 0;
   int status;
 
-  /* Convert all whitespace into a single space. */
-  character = isspace (c) ? ' ' : c;
-
-  /* Send the character to the CW sender. */
-  status = is_partial ? cw_send_character_partial (character)
-                      : cw_send_character (character);
+  /*
+   * Send the character (converted from whitespace into a single space) to
+   * the CW sender.  The tone queue may be full, so wait for a tone to
+   * complete and try again.  A single character is enqueued either fully or
+   * not at all.
+   */
+  for (;;)
+    {
+      status = is_partial ? cw_send_character_partial (string[0])
+                          : cw_gen_enqueue_string_with_token (sender.gen, string, &token);
+      if (status || errno != EAGAIN || !cw_wait_for_tone ())
+        break;
+    }
   if (!status)
     {
       if (errno != ENOENT)
         {
-          perror ("cw_send_character[_partial]");
+          perror ("cw_send_character_partial/cw_gen_enqueue_string_with_token");
           cw_flush_tone_queue ();
           abort ();
         }
-      else
+      if (config->do_errors)
         {
-          write_to_message_stream ("%c%c", CW_STATUS_ERR, character);
-          return;
+          const char message[2] = { CW_STATUS_ERR, string[0] };
+          sender_output (g_message_stream, message, sizeof (message));
         }
+      return;
     }
 
-  /* Echo the original character while sending it. */
-  write_to_echo_stream ("%c", c);
+  /*
+   * Echo the original character when it starts to sound, that is when the
+   * character enqueued before it has been played.  A partial character
+   * doesn't have its own token, so the next character of combination is
+   * echoed together with it.
+   */
+  pthread_mutex_lock (&sender.mutex);
+  if (config->do_echo)
+    {
+      const char text = (char) c;
+      sender_append_locked (g_echo_stream, sender.last_token, &text, 1);
+    }
+  if (!is_partial)
+    sender.last_token = token;
+  pthread_mutex_unlock (&sender.mutex);
+
+  /* Wait for room in read-ahead. */
+  if (sender.is_read_ahead)
+    wait_for_cw_sender ();
+}
+
 
-  /* Wait for the character to complete. */
-  if (!cw_wait_for_tone_queue_critical (1))
+/*
+ * parser_echo()
+ *
+ * Echo an input character that isn't sounded: a comment, or a start or end
+ * of combination.
+ */
+static void
+parser_echo (int c)
+{
+  if (config->do_echo)
     {
-      perror ("cw_wait_for_tone_queue_critical");
-      cw_flush_tone_queue ();
-      abort ();
+      const char text = (char) c;
+      sender_output (g_echo_stream, &text, 1);
     }
 }
 
 
 /*
- * parse_stream()
+ * parser_end_command()
  *
- * Read characters from a file stream, and either sound them, or interpret
- * controls in them.  Returns on end of file.
+ * Execute a parameter setting command that has been completely read, or
+ * report invalid value of the parameter.
  */
 static void
-parse_stream (FILE *stream)
+parser_end_command (parser_t *parser)
 {
-  int c;
-  enum { NONE, COMBINATION, COMMENT, NESTED_COMMENT } state = NONE;
+  parser->is_in_command = false;
+  parser->number[parser->number_length] = '\0';
 
-  /*
-   * Cycle round states depending on input characters.  Comments may be
-   * nested inside combinations, but not the other way around; that is,
-   * combination starts and ends are not special within comments.
-   *
-   * We need an _unlocked variant of fgetc because otherwise attempt to close
-   * stdin in signal handler (to signal termination of the loop) won't be
-   * possible: fclose() will just hang because stdin will be locked.
-   */
-  for (c = getc_unlocked (stream); g_is_running && !feof (stream); c = getc_unlocked (stream))
+  wait_for_cw_sender ();
+  parse_stream_parameter (parser->command,
+                          parser->is_number_too_long ? "" : parser->number);
+}
+
+
+/*
+ * parser_command()
+ *
+ * Handle a character of embedded command.  The command escape character has
+ * already been read and recognized.  Returns false if the character doesn't
+ * belong to the command, and needs to be handled as regular input; the
+ * command is then complete.
+ */
+static bool
+parser_command (parser_t *parser, int c)
+{
+  if (parser->command == 0)
     {
-      switch (state)
+      parser->command = toupper (c);
+      parser->number_length = 0;
+      parser->is_number_too_long = false;
+
+      switch (parser->command)
         {
-        case NONE:
-          /*
-           * Start a comment or combination, handle a command escape, or send
-           * the character if none of these checks apply.
-           */
-          if (config->do_comments && c == CW_COMMENT_START)
-            {
-              state = COMMENT;
-              write_to_echo_stream ("%c", c);
-            }
-          else if (config->do_combinations && c == CW_COMBINATION_START)
+        default:
+          parser->is_in_command = false;
+          write_to_message_stream ("%c%c%c", CW_STATUS_ERR, CW_CMD_ESCAPE,
+                                   parser->command);
+          break;
+        case CW_CMDV_FREQUENCY:
+        case CW_CMDV_VOLUME:
+        case CW_CMDV_SPEED:
+        case CW_CMDV_GAP:
+        case CW_CMDV_WEIGHTING:
+        case CW_CMDV_ECHO:
+        case CW_CMDV_ERRORS:
+        case CW_CMDV_COMMANDS:
+        case CW_CMDV_COMBINATIONS:
+        case CW_CMDV_COMMENTS:
+        case CW_CMD_QUERY:
+        case CW_CMD_CWQUERY:
+          /* Wait for value of parameter, or for the queried parameter. */
+          break;
+        case CW_CMDV_QUIT:
+          parser->is_in_command = false;
+          /* Only characters queued ahead (-r option) are discarded. */
+          if (!sender.is_read_ahead)
+            wait_for_cw_sender ();
+          sender_print_due ();
+          sender_discard ();
+          cw_flush_tone_queue ();
+          write_to_echo_stream ("%c", '\n');
+          if (config->listen_address)
             {
-              state = COMBINATION;
-              write_to_echo_stream ("%c", c);
+              /* Only the client that sent the command is disconnected. */
+              g_is_quit_requested = true;
+              break;
             }
-          else if (config->do_commands && c == CW_CMD_ESCAPE)
-            parse_stream_command (stream);
-          else
-            send_cw_character (c, false);
+          exit (EXIT_SUCCESS);
+        }
+      return true;
+    }
+
+  switch (parser->command)
+    {
+    case CW_CMD_QUERY:
+      parser->is_in_command = false;
+      wait_for_cw_sender ();
+      parse_stream_query (toupper (c));
+      return true;
+    case CW_CMD_CWQUERY:
+      parser->is_in_command = false;
+      wait_for_cw_sender ();
+      parse_stream_cwquery (toupper (c));
+      return true;
+    default:
+      break;
+    }
+
+  /*
+   * Value of parameter: optional whitespace, optional sign, digits, and
+   * optional ';' ending the command.  A character that can't be a part of
+   * the value ends the command, and is handled as regular input.
+   */
+  if (isdigit (c)
+      || ((c == '-' || c == '+') && parser->number_length == 0))
+    {
+      if (parser->number_length < PARSER_NUMBER_MAX)
+        parser->number[parser->number_length++] = (char) c;
+      else
+        parser->is_number_too_long = true;
+      return true;
+    }
+  if (isspace (c) && parser->number_length == 0)
+    return true;
+
+  /* ';' ends only a valid value. */
+  const bool is_valid = parser->number_length > 0
+                        && isdigit ((unsigned char) parser->number[parser->number_length - 1]);
+  parser_end_command (parser);
+  return c == ';' && is_valid;
+}
+
+
+/*
+ * parser_init()
+ *
+ * Prepare the parser for a new input stream.
+ */
+static void
+parser_init (parser_t *parser)
+{
+  parser->state = NONE;
+  parser->is_in_command = false;
+  parser->command = 0;
+  parser->number_length = 0;
+  parser->is_number_too_long = false;
+  parser->combination_char = EOF;
+}
+
+
+/*
+ * parser_character()
+ *
+ * Handle one character of input: either sound it, or interpret controls in
+ * it.
+ */
+static void
+parser_character (parser_t *parser, int c)
+{
+  /*
+   * If the previous character was the final character in a combination, do
+   * not suppress the end of character delay.  To do this, look at the
+   * current character, and suppress unless combination end.
+   */
+  if (parser->combination_char != EOF)
+    {
+      send_cw_character (parser->combination_char, c != CW_COMBINATION_END);
+      parser->combination_char = EOF;
+    }
+
+  if (parser->is_in_command && parser_command (parser, c))
+    return;
+
+  switch (parser->state)
+    {
+    case NONE:
+      /*
+       * Start a comment or combination, handle a command escape, or send
+       * the character if none of these checks apply.
+       */
+      if (config->do_comments && c == CW_COMMENT_START)
+        {
+          parser->state = COMMENT;
+          parser_echo (c);
+        }
+      else if (config->do_combinations && c == CW_COMBINATION_START)
+        {
+          parser->state = COMBINATION;
+          parser_echo (c);
+        }
+      else if (config->do_commands && c == CW_CMD_ESCAPE)
+        {
+          parser->is_in_command = true;
+          parser->command = 0;
+        }
+      else
+        send_cw_character (c, false);
+      break;
+
+    case COMBINATION:
+      /*
+       * Start a comment nested in a combination, end a combination,
+       * handle a command escape, or send the character (when the next
+       * character is known) if none of these checks apply.
+       */
+      if (config->do_comments && c == CW_COMMENT_START)
+        {
+          parser->state = NESTED_COMMENT;
+          parser_echo (c);
+        }
+      else if (c == CW_COMBINATION_END)
+        {
+          parser->state = NONE;
+          parser_echo (c);
+        }
+      else if (config->do_commands && c == CW_CMD_ESCAPE)
+        {
+          parser->is_in_command = true;
+          parser->command = 0;
+        }
+      else
+        parser->combination_char = c;
+      break;
+
+    case COMMENT:
+    case NESTED_COMMENT:
+      /*
+       * If in a comment nested in a combination and comment end seen,
+       * revert state to reflect in combination only.  If in an unnested
+       * comment and comment end seen, reset state.
+       */
+      if (c == CW_COMMENT_END)
+        parser->state = (parser->state == NESTED_COMMENT) ? COMBINATION : NONE;
+      parser_echo (c);
+      break;
+    }
+}
+
+
+/*
+ * parse_block()
+ *
+ * Parse a block of input.  Characters of the block are enqueued in the
+ * generator without waiting for each of them to be sounded.
+ */
+static void
+parse_block (parser_t *parser, const char *block, size_t length)
+{
+  /*
+   * Cycle round states depending on input characters.  Comments may be
+   * nested inside combinations, but not the other way around; that is,
+   * combination starts and ends are not special within comments.
+   */
+  for (size_t i = 0; i < length && g_is_running && !g_is_quit_requested; i++)
+    parser_character (parser, (unsigned char) block[i]);
+
+  sender_print_due ();
+}
+
+
+/*
+ * parse_end()
+ *
+ * Handle end of input stream: send a pending character of combination, and
+ * complete a parameter setting command.
+ */
+static void
+parse_end (parser_t *parser)
+{
+  if (!g_is_running || g_is_quit_requested)
+    return;
+
+  if (parser->combination_char != EOF)
+    {
+      send_cw_character (parser->combination_char, true);
+      parser->combination_char = EOF;
+    }
+
+  if (parser->is_in_command)
+    {
+      parser->is_in_command = false;
+      switch (parser->command)
+        {
+        case 0:
+        case CW_CMD_QUERY:
+        case CW_CMD_CWQUERY:
           break;
+        default:
+          parser_end_command (parser);
+          break;
+        }
+    }
+
+  sender_print_due ();
+}
+
+
+/*
+ * parse_stream()
+ *
+ * Read blocks of characters from a file stream, and either sound them, or
+ * interpret controls in them.  Returns on end of file.
+ */
+static void
+parse_stream (FILE *stream)
+{
+  char block[PARSER_BLOCK_SIZE];
+  const int fd = fileno (stream);
+  parser_t parser;
+
+  parser_init (&parser);
+
+  /*
+   * Read the stream's descriptor directly.  Closing stdin in signal handler
+   * (to signal termination of the loop) makes a pending read() fail.
+   */
+  while (g_is_running && !g_is_quit_requested)
+    {
+      const ssize_t n = read (fd, block, sizeof (block));
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+
+      parse_block (&parser, block, (size_t) n);
+      wait_for_cw_sender ();
+    }
+
+  parse_end (&parser);
+}
+
+
+
+
+
+/*---------------------------------------------------------------------*/
+/*  Server mode                                                        */
+/*---------------------------------------------------------------------*/
+
+/*
+ * In server mode (-l option) cw accepts connections on a UNIX or TCP socket
+ * instead of reading stdin.  Every client sends the same stream of text,
+ * commands, combinations and comments as cw reads from stdin, and receives
+ * echo and messages through its connection.  All clients share one
+ * generator.  Input of each client is queued in its own buffer, and clients
+ * take turns: on each turn a client sends one line (or one full buffer) of
+ * its input, so messages from different clients don't get mixed in the
+ * middle of a line.  Settings changed by a client's embedded commands
+ * (speed, tone, echo etc.) apply only to that client.
+ *
+ * With -M option cw also answers HTTP requests on a second socket with its
+ * metrics in OpenMetrics text format: metrics of the generator exported by
+ * libcw, and counters of clients ("sessions") kept by the server.  The
+ * counters are touched only by the server's loop, and metrics of the
+ * generator are read without locks, so scraping doesn't disturb sending.
+ * Sockets of HTTP clients are non-blocking and are polled by the same loop
+ * as sockets of other clients, so a slow HTTP client can't stall sending.
+ */
+
+#define SERVER_MAX_CLIENTS 16
+#define SERVER_BUFFER_SIZE 4096
+#define SERVER_MAX_METRICS_CLIENTS 4
+#define SERVER_METRICS_REQUEST_SIZE 1024
+
+typedef struct
+{
+  int fd;                 /* -1 if the slot is free. */
+  unsigned int id;        /* Number of session, unique since start of server. */
+  FILE *stream;           /* Echo and messages sent to the client. */
+
+  char buffer[SERVER_BUFFER_SIZE];  /* Input waiting to be sent. */
+  size_t length;
+  bool is_eof;
+
+  /* Client's settings, applied to generator and config on client's turn. */
+  int speed;
+  int frequency;
+  int volume;
+  int gap;
+  int weighting;
+  bool do_echo;
+  bool do_errors;
+  bool do_commands;
+  bool do_combinations;
+  bool do_comments;
+
+  /* Counters of session, exported as metrics. */
+  uint64_t n_messages;
+  uint64_t n_bytes;
+} server_client_t;
+
+static server_client_t server_clients[SERVER_MAX_CLIENTS];
+
+typedef struct
+{
+  int fd;                 /* -1 if the slot is free. */
+  unsigned int id;        /* Order of connection, the oldest client has the lowest. */
+
+  char request[SERVER_METRICS_REQUEST_SIZE];  /* Head of request received so far. */
+  size_t request_length;
+
+  char *response;         /* NULL until the head of request has arrived. */
+  size_t response_length;
+  size_t n_sent;
+} server_metrics_client_t;
+
+static server_metrics_client_t server_metrics_clients[SERVER_MAX_METRICS_CLIENTS];
+static unsigned int server_n_metrics_accepted = 0;
+
+/* Counters of server, exported as metrics. */
+static unsigned int server_n_accepted = 0;
+static unsigned int server_n_rejected = 0;
 
-        case COMBINATION:
-          /*
-           * Start a comment nested in a combination, end a combination,
-           * handle a command escape, or send the character if none of these
-           * checks apply.
-           */
-          if (config->do_comments && c == CW_COMMENT_START)
+
+/*
+ * server_listen()
+ *
+ * Create a socket listening on given address.  An address containing '/' is
+ * a path of UNIX socket, any other is [HOST:]PORT of TCP socket.  Returns
+ * the socket, or -1 on error.
+ */
+static int
+server_listen (const char *address)
+{
+  int fd;
+
+  if (strchr (address, '/'))
+    {
+      struct sockaddr_un sun;
+      struct stat st;
+
+      memset (&sun, 0, sizeof (sun));
+      sun.sun_family = AF_UNIX;
+      if (strlen (address) >= sizeof (sun.sun_path))
+        {
+          fprintf (stderr, _("%s: path of socket is too long: %s\n"),
+                   config->program_name, address);
+          return -1;
+        }
+      strcpy (sun.sun_path, address);
+
+      /* Remove socket left by a server that hasn't exited cleanly. */
+      if (0 == stat (address, &st) && S_ISSOCK (st.st_mode))
+        unlink (address);
+
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd == -1
+          || -1 == bind (fd, (struct sockaddr *) &sun, sizeof (sun))
+          || -1 == listen (fd, SOMAXCONN))
+        {
+          fprintf (stderr, _("%s: can't listen on %s: %s\n"),
+                   config->program_name, address, strerror (errno));
+          if (fd != -1)
+            close (fd);
+          return -1;
+        }
+      return fd;
+    }
+  else
+    {
+      char host[256];
+      const char *port;
+      const char *colon = strrchr (address, ':');
+      struct addrinfo hints, *result, *ai;
+      int rv;
+
+      if (colon)
+        {
+          snprintf (host, sizeof (host), "%.*s", (int) (colon - address), address);
+          port = colon + 1;
+        }
+      else
+        {
+          host[0] = '\0';
+          port = address;
+        }
+
+      memset (&hints, 0, sizeof (hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_PASSIVE;
+      rv = getaddrinfo (host[0] ? host : NULL, port, &hints, &result);
+      if (rv != 0)
+        {
+          fprintf (stderr, _("%s: invalid address %s: %s\n"),
+                   config->program_name, address, gai_strerror (rv));
+          return -1;
+        }
+
+      fd = -1;
+      for (ai = result; ai && fd == -1; ai = ai->ai_next)
+        {
+          const int yes = 1;
+
+          fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+          if (fd == -1)
+            continue;
+          setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof (yes));
+          if (-1 == bind (fd, ai->ai_addr, ai->ai_addrlen)
+              || -1 == listen (fd, SOMAXCONN))
             {
-              state = NESTED_COMMENT;
-              write_to_echo_stream ("%c", c);
+              close (fd);
+              fd = -1;
             }
-          else if (c == CW_COMBINATION_END)
+        }
+      freeaddrinfo (result);
+
+      if (fd == -1)
+        fprintf (stderr, _("%s: can't listen on %s: %s\n"),
+                 config->program_name, address, strerror (errno));
+      return fd;
+    }
+}
+
+
+/*
+ * server_accept()
+ *
+ * Accept a new client, with settings taken from command line.
+ */
+static void
+server_accept (int listen_fd)
+{
+  int fd;
+  int i;
+
+  fd = accept (listen_fd, NULL, NULL);
+  if (fd == -1)
+    return;
+
+  for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    if (server_clients[i].fd == -1)
+      break;
+  if (i == SERVER_MAX_CLIENTS)
+    {
+      fprintf (stderr, _("%s: too many clients, rejecting connection\n"),
+               config->program_name);
+      close (fd);
+      server_n_rejected++;
+      return;
+    }
+
+  server_client_t *client = &server_clients[i];
+  client->stream = fdopen (fd, "w");
+  if (!client->stream)
+    {
+      close (fd);
+      return;
+    }
+  client->fd = fd;
+  client->id = ++server_n_accepted;
+  client->length = 0;
+  client->is_eof = false;
+  client->n_messages = 0;
+  client->n_bytes = 0;
+
+  client->speed = config->send_speed;
+  client->frequency = config->frequency;
+  client->volume = config->volume;
+  client->gap = config->gap;
+  client->weighting = config->weighting;
+  client->do_echo = config->do_echo;
+  client->do_errors = config->do_errors;
+  client->do_commands = config->do_commands;
+  client->do_combinations = config->do_combinations;
+  client->do_comments = config->do_comments;
+}
+
+
+/*
+ * server_close()
+ *
+ * Disconnect the client, and free its slot.
+ */
+static void
+server_close (server_client_t *client)
+{
+  sender_release_stream (client->stream);
+  fclose (client->stream);  /* Closes client->fd too. */
+  client->stream = NULL;
+  client->fd = -1;
+  client->length = 0;
+}
+
+
+/*
+ * server_read()
+ *
+ * Append data received from the client to the client's buffer.
+ */
+static void
+server_read (server_client_t *client)
+{
+  ssize_t n;
+
+  if (client->length == SERVER_BUFFER_SIZE)
+    return;
+
+  n = read (client->fd, client->buffer + client->length,
+            SERVER_BUFFER_SIZE - client->length);
+  if (n > 0)
+    client->length += (size_t) n;
+  else if (n == 0 || errno != EINTR)
+    client->is_eof = true;
+}
+
+
+/*
+ * server_get_message_length()
+ *
+ * Get length of the client's input that is ready to be sent on client's
+ * turn: one line, or whatever is left when the buffer is full or when the
+ * client has disconnected.  Returns 0 if no input is ready.
+ */
+static size_t
+server_get_message_length (const server_client_t *client)
+{
+  const char *newline;
+
+  if (client->fd == -1 || client->length == 0)
+    return 0;
+
+  newline = memchr (client->buffer, '\n', client->length);
+  if (newline)
+    return (size_t) (newline - client->buffer) + 1;
+  if (client->is_eof || client->length == SERVER_BUFFER_SIZE)
+    return client->length;
+  return 0;
+}
+
+
+/*
+ * server_send()
+ *
+ * Send one message of the client, with the client's settings.
+ */
+static void
+server_send (server_client_t *client, size_t length)
+{
+  parser_t parser;
+  cw_gen_t *gen = cw_generator_get ();
+  cw_gen_parameters_t parameters;
+
+  /* Switch to the client's settings in one step, so that a switch
+     between clients doesn't recalculate timing five times. */
+  parameters.speed = client->speed;
+  parameters.frequency = client->frequency;
+  parameters.volume = client->volume;
+  parameters.gap = client->gap;
+  parameters.weighting = client->weighting;
+  cw_gen_set_parameters (gen, &parameters);
+  config->do_echo = client->do_echo;
+  config->do_errors = client->do_errors;
+  config->do_commands = client->do_commands;
+  config->do_combinations = client->do_combinations;
+  config->do_comments = client->do_comments;
+
+  g_echo_stream = client->stream;
+  g_message_stream = client->stream;
+
+  parser_init (&parser);
+  parse_block (&parser, client->buffer, length);
+  parse_end (&parser);
+  wait_for_cw_sender ();
+
+  g_echo_stream = stdout;
+  g_message_stream = stderr;
+
+  /* Settings may still be pending if the message had no text. */
+  cw_gen_get_parameters (gen, &parameters);
+  client->speed = parameters.speed;
+  client->frequency = parameters.frequency;
+  client->volume = parameters.volume;
+  client->gap = parameters.gap;
+  client->weighting = parameters.weighting;
+  client->do_echo = config->do_echo;
+  client->do_errors = config->do_errors;
+  client->do_commands = config->do_commands;
+  client->do_combinations = config->do_combinations;
+  client->do_comments = config->do_comments;
+
+  client->n_messages++;
+  client->n_bytes += length;
+  client->length -= length;
+  memmove (client->buffer, client->buffer + length, client->length);
+}
+
+
+/*
+ * server_write_metrics_text()
+ *
+ * Callback of cw_gen_export_metrics(), writing text of metrics to stream.
+ */
+static void
+server_write_metrics_text (void *stream, const char *text, size_t length)
+{
+  fwrite (text, 1, length, (FILE *) stream);
+}
+
+
+/*
+ * server_write_metrics()
+ *
+ * Write metrics of generator and of server's sessions in OpenMetrics text
+ * format.
+ */
+static void
+server_write_metrics (FILE *stream)
+{
+  unsigned int n_active = 0;
+
+  cw_gen_export_metrics (cw_generator_get (), NULL,
+                         server_write_metrics_text, stream);
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+    if (server_clients[i].fd != -1)
+      n_active++;
+  fprintf (stream, "# TYPE cw_server_sessions_accepted counter\n"
+           "# HELP cw_server_sessions_accepted Clients accepted by server.\n"
+           "cw_server_sessions_accepted_total %u\n", server_n_accepted);
+  fprintf (stream, "# TYPE cw_server_sessions_rejected counter\n"
+           "# HELP cw_server_sessions_rejected Clients rejected because of limit of clients.\n"
+           "cw_server_sessions_rejected_total %u\n", server_n_rejected);
+  fprintf (stream, "# TYPE cw_server_sessions_active gauge\n"
+           "# HELP cw_server_sessions_active Clients connected to server.\n"
+           "cw_server_sessions_active %u\n", n_active);
+
+  fprintf (stream, "# TYPE cw_server_session_messages counter\n"
+           "# HELP cw_server_session_messages Lines of input sent by client.\n");
+  for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+    if (server_clients[i].fd != -1)
+      fprintf (stream, "cw_server_session_messages_total{session=\"%u\"} %llu\n",
+               server_clients[i].id, (unsigned long long) server_clients[i].n_messages);
+  fprintf (stream, "# TYPE cw_server_session_bytes counter\n"
+           "# HELP cw_server_session_bytes Bytes of input sent by client.\n");
+  for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+    if (server_clients[i].fd != -1)
+      fprintf (stream, "cw_server_session_bytes_total{session=\"%u\"} %llu\n",
+               server_clients[i].id, (unsigned long long) server_clients[i].n_bytes);
+
+  fprintf (stream, "# EOF\n");
+}
+
+
+/*
+ * server_metrics_close()
+ *
+ * Disconnect the HTTP client, and free its slot.
+ */
+static void
+server_metrics_close (server_metrics_client_t *client)
+{
+  close (client->fd);
+  free (client->response);
+  client->response = NULL;
+  client->fd = -1;
+}
+
+
+/*
+ * server_metrics_accept()
+ *
+ * Accept a connection on metrics socket.  If all slots are taken, the
+ * oldest client is disconnected, so that clients that never send their
+ * request can't lock out the others.
+ */
+static void
+server_metrics_accept (int metrics_fd)
+{
+  server_metrics_client_t *client = NULL;
+  int fd;
+
+  fd = accept (metrics_fd, NULL, NULL);
+  if (fd == -1)
+    return;
+  if (-1 == fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK))
+    {
+      close (fd);
+      return;
+    }
+
+  for (int i = 0; i < SERVER_MAX_METRICS_CLIENTS; i++)
+    {
+      server_metrics_client_t *c = &server_metrics_clients[i];
+
+      if (c->fd == -1)
+        {
+          client = c;
+          break;
+        }
+      if (!client || c->id < client->id)
+        client = c;
+    }
+  if (client->fd != -1)
+    server_metrics_close (client);
+
+  client->fd = fd;
+  client->id = ++server_n_metrics_accepted;
+  client->request_length = 0;
+  client->response = NULL;
+  client->response_length = 0;
+  client->n_sent = 0;
+}
+
+
+/*
+ * server_metrics_respond()
+ *
+ * Prepare answer to the client's request.  Any GET request gets the
+ * metrics, regardless of its path and headers.  The connection is closed
+ * after the answer.
+ */
+static void
+server_metrics_respond (server_metrics_client_t *client, bool is_complete)
+{
+  FILE *stream;
+
+  stream = open_memstream (&client->response, &client->response_length);
+  if (!stream)
+    {
+      server_metrics_close (client);
+      return;
+    }
+  if (is_complete && 0 == strncmp (client->request, "GET ", 4))
+    {
+      fprintf (stream, "HTTP/1.0 200 OK\r\n"
+               "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+               "Connection: close\r\n\r\n");
+      server_write_metrics (stream);
+    }
+  else if (is_complete)
+    fprintf (stream, "HTTP/1.0 405 Method Not Allowed\r\n"
+             "Connection: close\r\n\r\n");
+  else
+    fprintf (stream, "HTTP/1.0 400 Bad Request\r\n"
+             "Connection: close\r\n\r\n");
+  if (0 != fclose (stream))
+    server_metrics_close (client);
+}
+
+
+/*
+ * server_metrics_read()
+ *
+ * Append data received from the HTTP client to its request.  Once the full
+ * head of the request has arrived, prepare the answer.  The head isn't
+ * answered earlier, so that the connection isn't closed while the client
+ * is still sending it.
+ */
+static void
+server_metrics_read (server_metrics_client_t *client)
+{
+  ssize_t n;
+  bool has_request_line;
+
+  n = read (client->fd, client->request + client->request_length,
+            sizeof (client->request) - 1 - client->request_length);
+  if (n == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (n > 0)
+    {
+      client->request_length += (size_t) n;
+      client->request[client->request_length] = '\0';
+    }
+
+  has_request_line = NULL != memchr (client->request, '\n', client->request_length);
+  if (n <= 0)
+    {
+      /* The client won't send more. */
+      if (has_request_line)
+        server_metrics_respond (client, true);
+      else
+        server_metrics_close (client);
+    }
+  else if (strstr (client->request, "\n\r\n") || strstr (client->request, "\n\n"))
+    server_metrics_respond (client, true);
+  else if (client->request_length == sizeof (client->request) - 1)
+    /* Headers that don't fit are not needed, the request line is. */
+    server_metrics_respond (client, has_request_line);
+}
+
+
+/*
+ * server_metrics_write()
+ *
+ * Send as much of the answer as the HTTP client's socket accepts, and
+ * disconnect the client when all of it has been sent.
+ */
+static void
+server_metrics_write (server_metrics_client_t *client)
+{
+  ssize_t n;
+
+  n = write (client->fd, client->response + client->n_sent,
+             client->response_length - client->n_sent);
+  if (n == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (n == -1)
+    {
+      server_metrics_close (client);
+      return;
+    }
+  client->n_sent += (size_t) n;
+  if (client->n_sent == client->response_length)
+    server_metrics_close (client);
+}
+
+
+/*
+ * run_server()
+ *
+ * Accept clients on given address and sound their input, until a signal is
+ * received.  If metrics_address is not NULL, serve metrics on that address.
+ * Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int
+run_server (const char *address, const char *metrics_address)
+{
+  struct pollfd fds[SERVER_MAX_CLIENTS + 2 + SERVER_MAX_METRICS_CLIENTS];
+  const int metrics_first = SERVER_MAX_CLIENTS + 2;
+  int listen_fd;
+  int metrics_fd = -1;
+  int next = 0;  /* Client whose turn comes first in next round. */
+  bool has_pending = false;
+
+  listen_fd = server_listen (address);
+  if (listen_fd == -1)
+    return EXIT_FAILURE;
+  if (metrics_address)
+    {
+      metrics_fd = server_listen (metrics_address);
+      if (metrics_fd == -1)
+        {
+          close (listen_fd);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+    server_clients[i].fd = -1;
+  for (int i = 0; i < SERVER_MAX_METRICS_CLIENTS; i++)
+    server_metrics_clients[i].fd = -1;
+
+  while (g_is_running)
+    {
+      fds[0].fd = listen_fd;
+      fds[0].events = POLLIN;
+      for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+        {
+          /* Negative descriptor is ignored by poll(). */
+          fds[i + 1].fd = server_clients[i].is_eof ? -1 : server_clients[i].fd;
+          fds[i + 1].events = POLLIN;
+          fds[i + 1].revents = 0;
+        }
+      fds[SERVER_MAX_CLIENTS + 1].fd = metrics_fd;
+      fds[SERVER_MAX_CLIENTS + 1].events = POLLIN;
+      fds[SERVER_MAX_CLIENTS + 1].revents = 0;
+      for (int i = 0; i < SERVER_MAX_METRICS_CLIENTS; i++)
+        {
+          const server_metrics_client_t *client = &server_metrics_clients[i];
+
+          fds[metrics_first + i].fd = client->fd;
+          fds[metrics_first + i].events = client->response ? POLLOUT : POLLIN;
+          fds[metrics_first + i].revents = 0;
+        }
+
+      /* Don't block if some input is already waiting for its turn. */
+      if (poll (fds, metrics_first + SERVER_MAX_METRICS_CLIENTS, has_pending ? 0 : -1) == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          perror ("poll");
+          break;
+        }
+
+      if (fds[0].revents & POLLIN)
+        server_accept (listen_fd);
+      for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+        if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+          server_read (&server_clients[i]);
+      for (int i = 0; i < SERVER_MAX_METRICS_CLIENTS; i++)
+        {
+          server_metrics_client_t *client = &server_metrics_clients[i];
+
+          if (!(fds[metrics_first + i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)))
+            continue;
+          if (!client->response)
+            server_metrics_read (client);
+          if (client->fd != -1 && client->response)
+            server_metrics_write (client);
+        }
+      /* Accept after serving, so that slots polled above aren't reused. */
+      if (fds[SERVER_MAX_CLIENTS + 1].revents & POLLIN)
+        server_metrics_accept (metrics_fd);
+
+      /* One round: each client with input ready sends one message. */
+      has_pending = false;
+      for (int n = 0; n < SERVER_MAX_CLIENTS && g_is_running; n++)
+        {
+          server_client_t *client = &server_clients[(next + n) % SERVER_MAX_CLIENTS];
+          const size_t length = server_get_message_length (client);
+
+          if (length > 0)
             {
-              state = NONE;
-              write_to_echo_stream ("%c", c);
+              server_send (client, length);
+              has_pending = has_pending || server_get_message_length (client) > 0;
             }
-          else if (config->do_commands && c == CW_CMD_ESCAPE)
-            parse_stream_command (stream);
-          else
+          if (g_is_quit_requested)
             {
-              /*
-               * If this is the final character in the combination, do not
-               * suppress the end of character delay.  To do this, look ahead
-               * the next character, and suppress unless combination end.
-               */
-              int lookahead;
-
-              lookahead = getc_unlocked (stream);
-              ungetc (lookahead, stream);
-              send_cw_character (c, lookahead != CW_COMBINATION_END);
+              g_is_quit_requested = false;
+              server_close (client);
             }
-          break;
-
-        case COMMENT:
-        case NESTED_COMMENT:
-          /*
-           * If in a comment nested in a combination and comment end seen,
-           * revert state to reflect in combination only.  If in an unnested
-           * comment and comment end seen, reset state.
-           */
-          if (c == CW_COMMENT_END)
-            state = (state == NESTED_COMMENT) ? COMBINATION : NONE;
-          write_to_echo_stream ("%c", c);
-          break;
+          else if (client->fd != -1 && client->is_eof && client->length == 0)
+            server_close (client);
         }
+      next = (next + 1) % SERVER_MAX_CLIENTS;
+    }
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; i++)
+    if (server_clients[i].fd != -1)
+      server_close (&server_clients[i]);
+  for (int i = 0; i < SERVER_MAX_METRICS_CLIENTS; i++)
+    if (server_metrics_clients[i].fd != -1)
+      server_metrics_close (&server_metrics_clients[i]);
+  close (listen_fd);
+  if (strchr (address, '/'))
+    unlink (address);
+  if (metrics_fd != -1)
+    {
+      close (metrics_fd);
+      if (strchr (metrics_address, '/'))
+        unlink (metrics_address);
     }
+
+  return EXIT_SUCCESS;
 }
 
 
@@ -576,17 +1939,34 @@ static void signal_handler(int signal_number)
 	   loop. Ultimately this will lead to exiting of program. */
 	g_is_running = false;
 
-	/* This is needed because if initially there are no characters
-	   available to consume by fgetc() in parse_stream(), the
-	   'for' loop in that function will be stuck at initial
-	   fgetc(). We need to force attempt at first iteration of the
-	   'for' loop. */
+	/* This is needed because if there are no characters available
+	   to consume by read() in parse_stream(), the loop in that
+	   function will be stuck in read(). Closing the descriptor
+	   makes the restarted read() fail. */
 	fclose(stdin);
 }
 
 
 
 
+/**
+   \brief Report time of first tone of the program
+
+   Keying callback registered when -P option is used. It is called
+   in generator's thread when the generator starts playing a tone.
+*/
+static void startup_timing_keying_callback(__attribute__((unused)) void *arg, int key_value)
+{
+	static bool is_first_tone = true;
+	if (key_value && is_first_tone) {
+		is_first_tone = false;
+		cw_startup_timing_mark(config, "first tone");
+	}
+}
+
+
+
+
 /**
    \brief Parse command line args, then produce CW output until end of file
 
@@ -600,6 +1980,9 @@ int main (int argc, char *const argv[])
 
 	atexit(cw_atexit);
 
+	g_echo_stream = stdout;
+	g_message_stream = stderr;
+
 	/* Set locale and message catalogs. */
 	i18n_initialize();
 
@@ -626,6 +2009,7 @@ int main (int argc, char *const argv[])
 		fprintf(stderr, _("%s: inconsistent command line arguments\n"), config->program_name);
 		return EXIT_FAILURE;
 	}
+	cw_startup_timing_mark(config, "arguments");
 
 	if (config->input_file) {
 		if (!freopen(config->input_file, "r", stdin)) {
@@ -650,10 +2034,19 @@ int main (int argc, char *const argv[])
 		//fprintf(stderr, "%s: failed to create generator with device '%s'\n", config->program_name, config->audio_device);
 		return EXIT_FAILURE;
 	}
+	cw_startup_timing_mark(config, "generator created");
+	if (config->startup_timing) {
+		cw_register_keying_callback(startup_timing_keying_callback, NULL);
+	}
 
 	/* Set up signal handlers to exit on a range of signals. */
 	static const int SIGNALS[] = { SIGHUP, SIGINT, SIGQUIT, SIGPIPE, SIGTERM, 0 };
 	for (int i = 0; SIGNALS[i]; i++) {
+		if (SIGNALS[i] == SIGPIPE && config->listen_address) {
+			/* Disconnecting client must not terminate the server. */
+			signal(SIGPIPE, SIG_IGN);
+			continue;
+		}
 		if (!cw_register_signal_handler(SIGNALS[i], signal_handler)) {
 			fprintf(stderr, _("%s: can't register signal: %s\n"), config->program_name, strerror(errno));
 			return EXIT_FAILURE;
@@ -663,13 +2056,22 @@ int main (int argc, char *const argv[])
 	/* Start producing sine wave (amplitude of the wave will be
 	   zero as long as there are no characters to process). */
 	cw_generator_start();
+	cw_startup_timing_mark(config, "generator started");
 	g_is_running = true;
+	sender_start(config->read_ahead);
+
+	if (config->listen_address) {
+		const int rv = run_server(config->listen_address, config->metrics_address);
+		cw_wait_for_tone_queue();
+		return rv;
+	}
 
 	/* Send stdin stream to CW parsing. */
 	parse_stream(stdin);
 
 	/* Await final tone completion before exiting. */
 	cw_wait_for_tone_queue();
+	sender_stop(true);
 
 	return EXIT_SUCCESS;
 }
@@ -681,6 +2083,7 @@ int main (int argc, char *const argv[])
 void cw_atexit(void)
 {
 	if (generator) {
+		sender_stop(false);
 		cw_generator_stop();
 		//cw_complete_reset();
 		cw_generator_delete();
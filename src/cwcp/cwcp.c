@@ -19,7 +19,6 @@
 
 #include "config.h"
 
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <signal.h>
@@ -30,6 +29,7 @@
 #include <ctype.h>
 #include <curses.h>
 #include <errno.h>
+#include <poll.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -40,11 +40,13 @@
 #endif
 
 #include <libcw.h>
+#include <libcw2.h>
 
 #include <cwutils/i18n.h>
 #include <cwutils/cw_cmdline.h>
 #include <cwutils/cw_copyright.h>
 #include <cwutils/dictionary.h>
+#include <cwutils/lib/practice_text.h>
 #include <cwutils/memory.h>
 
 
@@ -109,6 +111,7 @@ static int  mode_get_count(void);
 static const char *mode_get_description(int index);
 static bool mode_current_is_type(mode_type_t type);
 static bool mode_is_sending_active(void);
+static int  mode_generate_group(const void *dict, cw_random_t *rng, char *group, size_t size);
 
 
 
@@ -130,14 +133,19 @@ static moderef_t modes = NULL,
                  g_current_mode = NULL;
 static int modes_count = 0;
 
+/* Groups of text of dictionary modes, prepared in background. */
+static cw_practice_text_t *g_practice_text = NULL;
+
 static int queue_get_length(void);
+static int queue_get_unsent_length(void);
 static int queue_next_index(int index);
 static int queue_prior_index(int index);
 static void queue_display_add_character(void);
 static void queue_display_delete_character(void);
 static void queue_display_highlight_character(bool is_highlight);
 static void queue_discard_contents(void);
-static void queue_dequeue_character(void);
+static bool queue_send_character(void);
+static void queue_update_playback(void);
 static void queue_enqueue_string(const char *word);
 static void queue_enqueue_character(char c);
 static void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning_of_buffer);
@@ -147,7 +155,7 @@ static void queue_delete_character(void);
 static void ui_refresh_main_window(void);
 static void ui_display_state(const char *state);
 static void ui_clear_main_window(void);
-static void ui_poll_user_input(int fd, int usecs);
+static void ui_poll_user_input(int fd);
 static void ui_update_mode_selection(int old_mode, int current_mode);
 static void ui_handle_event(int c);
 
@@ -171,15 +179,33 @@ static void state_change_to_idle(void);
 /*---------------------------------------------------------------------*/
 
 /* Characters awaiting send are stored in a circular buffer,
-   implemented as an array with tail and head indexes that wrap. */
+   implemented as an array with tail and head indexes that wrap.
+
+   Characters from head to tail are shown in text display. Character
+   at head is the one being played (it's highlighted), characters up
+   to and including 'sent' are already in libcw's tone queue, the
+   rest waits to be sent. */
 enum { QUEUE_CAPACITY = 256 };
 static volatile char queue_data[QUEUE_CAPACITY];
 static volatile int queue_tail = 0,
-                    queue_head = 0;
+                    queue_head = 0,
+                    queue_sent = 0;
+
+/* How much of sound to keep in libcw's tone queue [microseconds].
+   Sending ahead prevents gaps in Morse code when redrawing of the
+   screen (e.g. on slow serial console) delays cwcp, but changes of
+   speed or tone affect only characters sent after the change. */
+enum { QUEUE_AHEAD_DURATION = 1000000 };
 
-/* There are times where we have no data to send.  For these cases,
-   record as idle, so that we know when to wake the sender. */
-static volatile bool is_queue_idle = true;
+/* Count of non-space characters sent to libcw, and for each sent
+   character: count of characters that must have started playing
+   before the character is highlighted as being played. Spaces are not
+   counted as characters by libcw's queue, they are passed together
+   with next character. */
+static size_t queue_n_sent_characters = 0;
+static size_t queue_ordinal[QUEUE_CAPACITY];
+
+static bool is_queue_head_highlighted = false;
 
 
 
@@ -197,6 +223,19 @@ int queue_get_length(void)
 
 
 
+/**
+   \brief Return the count of characters that haven't been sent to libcw yet
+*/
+int queue_get_unsent_length(void)
+{
+	return queue_tail >= queue_sent
+		? queue_tail - queue_sent : queue_tail - queue_sent + QUEUE_CAPACITY;
+}
+
+
+
+
+
 /**
    \brief Advance a tone queue index, including circular wrapping
 */
@@ -229,7 +268,7 @@ void queue_display_add_character(void)
 	/* Append the last queued character to the text display. */
 	if (queue_get_length() > 0) {
 		waddch(text_subwindow, toupper((int) queue_data[queue_tail]));
-		wrefresh(text_subwindow);
+		wnoutrefresh(text_subwindow);
 	}
 
 	return;
@@ -265,7 +304,7 @@ void queue_display_delete_character(void)
 		wmove(text_subwindow, y, x);
 		waddch(text_subwindow, ' ');
 		wmove(text_subwindow, y, x);
-		wrefresh(text_subwindow);
+		wnoutrefresh(text_subwindow);
 	}
 
 	return;
@@ -309,7 +348,7 @@ void queue_display_highlight_character(bool is_highlight)
 		       is_highlight ? winch(text_subwindow) | A_REVERSE
 			: winch(text_subwindow) & ~A_REVERSE);
 		wmove(text_subwindow, saved_y, saved_x);
-		wrefresh(text_subwindow);
+		wnoutrefresh(text_subwindow);
 	}
 
 	return;
@@ -320,15 +359,19 @@ void queue_display_highlight_character(bool is_highlight)
 
 
 /**
-   \brief Forcibly empty the queue, if not already idle
+   \brief Forcibly empty the queue
+
+   Characters already sent to libcw are removed from libcw's tone queue
+   too.
 */
 void queue_discard_contents(void)
 {
-	if (!is_queue_idle) {
+	if (is_queue_head_highlighted) {
 		queue_display_highlight_character(false);
-		queue_head = queue_tail;
-		is_queue_idle = true;
+		is_queue_head_highlighted = false;
 	}
+	queue_head = queue_sent = queue_tail;
+	cw_flush_tone_queue();
 
 	return;
 }
@@ -338,36 +381,76 @@ void queue_discard_contents(void)
 
 
 /**
-   \brief Dequeue a character
+   \brief Send next character from the queue to libcw
+
+   We don't expect sending to fail because only sendable characters
+   are queued.
 
-   Called when the CW send buffer is empty.  If the queue is not idle,
-   take the next character from the queue and send it.  If there are
-   no more queued characters, set the queue to idle.
+   \return true if a character has been sent
+   \return false if there are no characters to send
 */
-void queue_dequeue_character(void)
+bool queue_send_character(void)
 {
-	if (!is_queue_idle) {
-		/* Unhighlight any previous highlighting, and see if
-		   we can dequeue. */
-		queue_display_highlight_character(false);
-		if (queue_get_length() > 0) {
-			char c;
-
-			/* Take the next character off the queue,
-			   highlight, and send it.  We don't expect
-			   sending to fail because only sendable
-			   characters are queued. */
-			queue_head = queue_next_index(queue_head);
-			c = queue_data[queue_head];
-			queue_display_highlight_character(true);
-
-			if (!cw_send_character(c)) {
-				perror("cw_send_character");
-				abort();
-			}
-		} else {
-			is_queue_idle = true;
+	if (queue_get_unsent_length() == 0) {
+		return false;
+	}
+
+	queue_sent = queue_next_index(queue_sent);
+	const char c = queue_data[queue_sent];
+	if (!cw_send_character(c)) {
+		perror("cw_send_character");
+		abort();
+	}
+
+	if (c == ' ') {
+		queue_ordinal[queue_sent] = queue_n_sent_characters + 1;
+	} else {
+		queue_n_sent_characters++;
+		queue_ordinal[queue_sent] = queue_n_sent_characters;
+	}
+
+	return true;
+}
+
+
+
+
+
+/**
+   \brief Highlight the character that is being played by libcw
+
+   Move queue's head to the last sent character that has started
+   playing, and move the highlight in text display with it. Space
+   starts "playing" together with next character, or when libcw's
+   queue runs out of tones.
+*/
+void queue_update_playback(void)
+{
+	const size_t n_waiting = cw_gen_get_queue_n_characters(cw_generator_get());
+	const size_t n_started = queue_n_sent_characters > n_waiting ? queue_n_sent_characters - n_waiting : 0;
+	const bool is_libcw_idle = cw_get_tone_queue_length() == 0;
+
+	bool is_moved = false;
+	while (queue_head != queue_sent) {
+		const int next = queue_next_index(queue_head);
+		if (!is_libcw_idle && queue_ordinal[next] > n_started) {
+			break;
 		}
+		if (is_queue_head_highlighted) {
+			queue_display_highlight_character(false);
+			is_queue_head_highlighted = false;
+		}
+		queue_head = next;
+		is_moved = true;
+	}
+
+	if (is_moved && !is_libcw_idle) {
+		queue_display_highlight_character(true);
+		is_queue_head_highlighted = true;
+	} else if (is_libcw_idle && queue_head == queue_tail && is_queue_head_highlighted) {
+		/* Last character is ending, nothing more to play. */
+		queue_display_highlight_character(false);
+		is_queue_head_highlighted = false;
 	}
 
 	return;
@@ -388,7 +471,6 @@ void queue_dequeue_character(void)
 */
 void queue_enqueue_string(const char *word)
 {
-	bool is_queue_notify = false;
 	for (int i = 0; word[i] != '\0'; i++) {
 
 		char c = toupper((int) word[i]);
@@ -401,19 +483,10 @@ void queue_enqueue_string(const char *word)
 				queue_tail = queue_next_index(queue_tail);
 				queue_data[queue_tail] = c;
 				queue_display_add_character();
-
-				if (is_queue_idle) {
-					is_queue_notify = true;
-				}
 			}
 		}
 	}
 
-	/* If we queued any character, mark the queue as not idle. */
-	if (is_queue_notify) {
-		is_queue_idle = false;
-	}
-
 	return;
 }
 
@@ -449,13 +522,13 @@ void queue_enqueue_character(char c)
    \brief Delete the most recently added character from the queue
 
    Remove the most recently added character from the queue, provided
-   that the dequeue hasn't yet reached it.  If there's nothing
+   that it hasn't been sent to libcw yet.  If there's nothing
    available to delete, fail silently.
 */
 void queue_delete_character(void)
 {
 	/* If data is queued, regress tail and delete one display character. */
-	if (queue_get_length() > 0) {
+	if (queue_get_unsent_length() > 0) {
 		queue_tail = queue_prior_index(queue_tail);
 		queue_display_delete_character();
 	}
@@ -488,6 +561,15 @@ void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning)
 		queue_enqueue_character(' ');
 	}
 
+	/* Group prepared in background, if there is one. */
+	char group[4 * CW_PRACTICE_TEXT_GROUP_SIZE];
+	if (g_practice_text
+	    && cw_practice_text_get_group(g_practice_text, mode->dict, group, sizeof (group)) >= 0) {
+
+		queue_enqueue_string(group);
+		return;
+	}
+
 	/* Size of group of letters that will be printed together
 	   to main window of cwcp. '1' for dictionaries consisting
 	   of multi-character words (so you get single words separated
@@ -496,7 +578,7 @@ void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning)
 	int group_size = cw_dictionary_get_group_size(mode->dict);
 
 	/* Select and buffer N random elements selected from dictionary. */
-	for (int group = 0; group < group_size; group++) {
+	for (int i = 0; i < group_size; i++) {
 		/* For dictionaries with size of word in dictionary == 1
 		   this returns single letters. */
 		queue_enqueue_string(cw_dictionary_get_random_word(mode->dict));
@@ -512,43 +594,54 @@ void queue_enqueue_random_dictionary_text(moderef_t mode, bool beginning)
 /**
    Check the libcw's tone queue, and if it is getting low, arrange for
    more data to be passed in to the libcw's tone queue.
+
+   Characters are passed until libcw's queue holds
+   QUEUE_AHEAD_DURATION of sound.
 */
 void queue_transfer_character_to_libcw(void)
 {
-	if (cw_get_tone_queue_length() > 1) {
-		return;
-	}
+	queue_update_playback();
 
 	if (!is_sending_active) {
 		return;
 	}
 
-	/* Arrange more data for libcw.  The source for this data is
-	   dependent on the mode.  If in dictionary modes, update and
-	   check the timer, then add more random data if the queue is
-	   empty.  If in keyboard mode, just dequeue anything
-	   currently on the character queue. */
-
-	if (g_current_mode->type == M_DICTIONARY) {
-		if (timer_is_expired()) {
-			state_change_to_idle();
-			return;
-		}
+	cw_gen_t * gen = cw_generator_get();
+	while (cw_gen_get_queue_duration(gen) < QUEUE_AHEAD_DURATION) {
+
+		/* Arrange more data for libcw.  The source for this data
+		   is dependent on the mode.  If in dictionary modes, update
+		   and check the timer, then add more random data if the
+		   queue is empty.  If in keyboard mode, just send anything
+		   currently on the character queue. */
+		if (g_current_mode->type == M_DICTIONARY && queue_get_unsent_length() == 0) {
+			if (timer_is_expired()) {
+				/* Let libcw finish playing what has been
+				   sent, don't cut the last group short. */
+				if (cw_get_tone_queue_length() == 0) {
+					state_change_to_idle();
+				}
+				return;
+			}
 
-		if (queue_get_length() == 0) {
 			queue_enqueue_random_dictionary_text(g_current_mode, beginning_of_buffer);
 			if (beginning_of_buffer) {
 				beginning_of_buffer = false;
 			}
 		}
-	}
-
-	if (g_current_mode->type == M_DICTIONARY
-	    || g_current_mode->type == M_KEYBOARD) {
 
-		queue_dequeue_character();
+		if (g_current_mode->type != M_DICTIONARY
+		    && g_current_mode->type != M_KEYBOARD) {
+			break;
+		}
+		if (!queue_send_character()) {
+			break;
+		}
 	}
 
+	/* Newly sent character may be already playing. */
+	queue_update_playback();
+
 	return;
 }
 
@@ -718,6 +811,11 @@ void mode_initialize(void)
 	g_current_mode = modes;
 	modes_count = count;
 
+	/* On failure groups are generated by
+	   queue_enqueue_random_dictionary_text() itself. */
+	cw_practice_text_delete(&g_practice_text);
+	g_practice_text = cw_practice_text_new(mode_generate_group, 0);
+
 	return;
 }
 
@@ -725,6 +823,20 @@ void mode_initialize(void)
 
 
 
+/**
+   \brief Generate group of text of dictionary mode
+
+   Generator passed to cw_practice_text_new().
+*/
+int mode_generate_group(const void *dict, cw_random_t *rng, char *group, size_t size)
+{
+	return cw_dictionary_get_random_group_r((const cw_dictionary_t *) dict, rng, group, size);
+}
+
+
+
+
+
 /**
    \brief Free data structures relates to modes
 
@@ -732,6 +844,9 @@ void mode_initialize(void)
 */
 void mode_clean(void)
 {
+	/* Stop the background thread before dictionaries are unloaded. */
+	cw_practice_text_delete(&g_practice_text);
+
 	free(modes);
 	modes = NULL;
 
@@ -1546,44 +1661,59 @@ void ui_handle_event(int c)
 /**
    \brief Check for keyboard input from user
 
-   Calls our sender polling function at regular intervals, and returns only
-   when data is available to getch(), so that it will not block.
+   Wait for keyboard input and for events in libcw's tone queue, and
+   return only when data is available to getch(), so that it will not
+   block. The function also returns when a signal stops the program.
 
-   Opportunistically on every poll check if we need to update queue
-   of elements to play/display, and if so, do update the queue.
+   Descriptor of libcw's tone queue becomes readable when a tone is
+   dequeued (or enqueued, or when the queue is flushed), so cwcp checks
+   if more characters should be passed to libcw only when something has
+   changed in libcw's queue, instead of polling the queue at fixed
+   intervals. When nothing is being played, the function sleeps until
+   user presses a key. The practice timer is checked on the same
+   occasions: while practice is in progress, the queue changes with
+   every tone.
 
-   \param fd - file to pool for new keys from the user
-   \param usecs - pooling interval
+   \param fd - file to poll for new keys from the user
 */
-void ui_poll_user_input(int fd, int usecs)
+void ui_poll_user_input(int fd)
 {
-	int fd_count;
-
-	/* Poll until the select indicates data on the file descriptor. */
-	do {
-		fd_set read_set;
-		struct timeval timeout;
-
-		/* Set up a the file descriptor set and timeout information. */
-		FD_ZERO(&read_set); // NOLINT(readability-isolate-declaration) // NOLINT because I can't fix problem in sys/select.h
-		FD_SET(fd, &read_set);
-		timeout.tv_sec = usecs / 1000000;
-		timeout.tv_usec = usecs % 1000000;
-
-		/* Wait until timeout, data, or a signal.
-		   If a signal interrupts select, we can just treat it as
-		   another timeout. */
-		fd_count = select(fd + 1, &read_set, NULL, NULL, &timeout);
+	cw_gen_t * gen = cw_generator_get();
+	struct pollfd fds[2] = {
+		{ .fd = fd,                               .events = POLLIN },
+		{ .fd = cw_gen_get_queue_event_fd(gen),   .events = POLLIN },
+	};
+
+	/* Key handled by caller may have added a character to cwcp's
+	   queue, or may have started sending. */
+	queue_transfer_character_to_libcw();
+
+	while (g_is_running) {
+		/* Changes of text display are sent to terminal once per
+		   iteration, not once per character. */
+		doupdate();
+
+		/* Negative descriptor (libcw failed to create it) is
+		   ignored by poll(), so fall back to polling libcw's
+		   queue every 10ms. At 60WPM, a dot is 20ms. */
+		const int timeout = -1 == fds[1].fd ? 10 : -1;
+
+		/* If a signal interrupts poll, we can just treat it as
+		   another event. */
+		const int fd_count = poll(fds, 2, timeout);
 		if (fd_count == -1 && errno != EINTR) {
-			perror("select");
+			perror("poll");
 			exit(EXIT_FAILURE);
 		}
 
-		/* Make this call on timeouts and on reads; it's just easier. */
-		queue_transfer_character_to_libcw();
-	} while (fd_count != 1);
-
-	return;
+		if (fd_count <= 0 || (fds[1].revents & POLLIN)) {
+			cw_gen_clear_queue_event(gen);
+			queue_transfer_character_to_libcw();
+		}
+		if (fd_count > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+			return;
+		}
+	}
 }
 
 
@@ -1714,6 +1844,7 @@ int main(int argc, char **argv)
 		fprintf(stderr, _("%s: inconsistent arguments\n"), config->program_name);
 		return EXIT_FAILURE;
 	}
+	cw_startup_timing_mark(config, "arguments");
 
 	if (config->input_file) {
 		if (!cw_dictionaries_read(config->input_file)) {
@@ -1746,6 +1877,7 @@ int main(int argc, char **argv)
 		fprintf(stderr, "%s: failed to create generator\n", config->program_name);
 		return EXIT_FAILURE;
 	}
+	cw_startup_timing_mark(config, "generator created");
 	timer_set_total_practice_time(config->practice_time);
 
 
@@ -1762,16 +1894,21 @@ int main(int argc, char **argv)
 	   keyboard and any other local modes. */
 	mode_initialize();
 
-	/* Initialize the curses user interface, then catch and action
-	   every keypress we see.  Before calling getch, wait until
-	   data is available on stdin, polling the libcw sender.  At
-	   60WPM, a dot is 20ms, so polling for the maximum library
-	   speed needs a 10ms (10,000usec) timeout. */
-	ui_initialize();
+	/* Start the generator before initializing the curses user
+	   interface, so that sound device is ready for first tone as soon
+	   as possible (and so that start-up timings are printed before
+	   curses take over the terminal). Then catch and action every
+	   keypress we see.  Before calling getch, wait until data is
+	   available on stdin, feeding the libcw sender on events in its
+	   tone queue. */
 	cw_generator_start();
+	cw_startup_timing_mark(config, "generator started");
+	ui_initialize();
 	while (g_is_running) {
-		ui_poll_user_input(fileno(stdin), 10000);
-		ui_handle_event(getch());
+		ui_poll_user_input(fileno(stdin));
+		if (g_is_running) {
+			ui_handle_event(getch());
+		}
 	}
 
 	cw_wait_for_tone_queue();
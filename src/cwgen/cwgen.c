@@ -21,7 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h> /* gettimeofday() */
+#include <unistd.h>
 #include <errno.h>
 #include <assert.h>
 #include <stdint.h>
@@ -35,10 +35,13 @@
 # include <strings.h>
 #endif
 
+#include "libcw2.h"
+
 #include <cwutils/i18n.h>
 #include <cwutils/cw_cmdline.h>
 #include <cwutils/cw_copyright.h>
 #include <cwutils/memory.h>
+#include <cwutils/lib/random.h>
 
 
 
@@ -52,6 +55,13 @@
 #define MIN_LIMIT              0   /* Lowest character count limit allowed. */
 #define INITIAL_LIMIT          0   /* Default character count limit. */
 
+#define BATCH_BUFFER_SIZE  (64 * 1024)  /* Size of buffer for output in batch mode [bytes]. */
+
+/* Level of generator's tone queue (in tones) below which cwgen adds more
+   characters to the queue when rendering audio. Default capacity of the
+   queue is 3000 tones. */
+#define AUDIO_QUEUE_LEVEL   1000
+
 
 static const char *const DEFAULT_CHARSET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
@@ -66,6 +76,13 @@ struct cwgen_config {
 	uint64_t n_chars_max;  /* Maximal number of characters (excluding spaces) to generate in whole set of groups; may be zero - no limit. */
 
 	char *charset;         /* Set of chars to be used to generate groups. */
+
+	uint64_t seed;         /* Seed of random number generator; zero: pick a seed automatically. */
+	cw_random_t rng;       /* Random number generator used to generate groups. */
+
+	bool batch;            /* Write output in large blocks instead of flushing every character. */
+	char *audio_file;      /* Path to file with audio rendered from the groups; NULL: no audio. */
+	int audio_speed;       /* Speed of rendered audio [wpm]. */
 } g_config = {
 	.program_name   = (char *) NULL,
 
@@ -75,13 +92,36 @@ struct cwgen_config {
         .n_repeats      = INITIAL_REPEAT,
         .n_chars_max    = INITIAL_LIMIT,
 
-	.charset        = (char *) NULL
+	.charset        = (char *) NULL,
+
+	.seed           = 0,
+
+	.batch          = false,
+	.audio_file     = (char *) NULL,
+	.audio_speed    = CW_SPEED_INITIAL
 };
 
 
-static const char *all_options = "g:|groups,n:|groupsize,r:|repeat,x:|limit,c:|charset,h|help,v|version";
+
+
+/* Destination of generated characters. */
+struct cwgen_output {
+	const struct cwgen_config *config;
+
+	char *buffer;          /* Buffer for output in batch mode. */
+	size_t buffer_used;
+
+	cw_gen_t *gen;         /* Generator rendering characters to audio file; NULL: no audio. */
+};
+
+
+static const char *all_options = "g:|groups,n:|groupsize,r:|repeat,x:|limit,c:|charset,s:|seed,b|batch,a:|audio,w:|wpm,h|help,v|version";
 
 static void cwgen_generate_characters(struct cwgen_config *config);
+static void cwgen_output_open(struct cwgen_output *output, const struct cwgen_config *config);
+static void cwgen_output_put(struct cwgen_output *output, char character);
+static void cwgen_output_close(struct cwgen_output *output);
+static void cwgen_write_all(const struct cwgen_config *config, const char *data, size_t size);
 static void cwgen_print_usage(const char *program_name);
 static void cwgen_print_help(const char *program_name);
 static void cwgen_parse_command_line(int argc, char **argv, struct cwgen_config *config);
@@ -101,43 +141,36 @@ static void cwgen_free_config(struct cwgen_config *config);
 */
 void cwgen_generate_characters(struct cwgen_config *config)
 {
-	static bool is_initialized = false;
-
-	/* On first (usually only) call, seed the random number generator. */
-	if (!is_initialized) {
-
-		/* Previously the initializator used value returned by
-		time(). Consecutive calls of the program within one
-		second resulted in the same generated string - not
-		very random. To improve randomness, I've switched to
-		gettimeofday(). */
-		struct timeval t;
-		gettimeofday(&t, NULL);
-
-		/* TODO acerion 2023.10.01 use API from src/cwutils/lib/random.h. */
-		srandom(t.tv_usec);
-		is_initialized = true;
-	}
+	/* Same non-zero seed results in the same groups, which is useful
+	   for repeatable runs (e.g. in benchmarks). */
+	cw_random_init(&config->rng, config->seed);
 
-	/* Allocate the buffer for repeating groups. */
+	struct cwgen_output output;
+	cwgen_output_open(&output, config);
+
+	/* Allocate the buffer for repeating groups, and for indices of
+	   characters in charset. */
 	char *buffer = (char *) malloc(config->group_size_max);
-	if (!buffer) {
+	uint32_t *indices = (uint32_t *) malloc(config->group_size_max * sizeof (uint32_t));
+	if (!buffer || !indices) {
 		fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
 		exit(EXIT_FAILURE);
 	}
 
 	/* Generate groups up to the number requested or to the character limit. */
-	int charset_length = strlen(config->charset);
+	const uint32_t charset_length = (uint32_t) strlen(config->charset);
+	const uint32_t group_sizes_count = (uint32_t) (config->group_size_max - config->group_size_min + 1);
 	uint64_t chars = 0;
 
 	for (int group = 0; group < config->n_groups; group++) {
 
 		/* Randomize the group size between min and max inclusive. */
-		int group_size = config->group_size_min + random() % (config->group_size_max - config->group_size_min + 1);
+		int group_size = config->group_size_min + (int) cw_random_get_bounded(&config->rng, group_sizes_count);
 
 		/* Create random group. */
+		cw_random_fill_bounded(&config->rng, charset_length, indices, (size_t) group_size);
 		for (int i = 0; i < group_size; i++) {
-			buffer[i] = config->charset[random() % charset_length];
+			buffer[i] = config->charset[indices[i]];
 		}
 
 		/* Repeatedly print the group as requested.
@@ -148,8 +181,7 @@ void cwgen_generate_characters(struct cwgen_config *config)
 		do {
 			for (int i = 0; i < group_size; i++) {
 
-				putchar(buffer[i]);
-				fflush(stdout);
+				cwgen_output_put(&output, buffer[i]);
 
 				chars++;
 
@@ -158,8 +190,7 @@ void cwgen_generate_characters(struct cwgen_config *config)
 				}
 			}
 
-			putchar(' ');
-			fflush(stdout);
+			cwgen_output_put(&output, ' ');
 
 			if (config->n_chars_max && chars >= config->n_chars_max) {
 				break;
@@ -172,6 +203,10 @@ void cwgen_generate_characters(struct cwgen_config *config)
 		}
 	}
 
+	cwgen_output_put(&output, '\n');
+	cwgen_output_close(&output);
+
+	free(indices);
 	free(buffer);
 
 	return;
@@ -180,6 +215,157 @@ void cwgen_generate_characters(struct cwgen_config *config)
 
 
 
+/**
+   \brief Prepare destination of generated characters
+
+   In batch mode a large buffer is allocated. If audio file has been
+   requested, a generator writing to the file is created and started.
+
+   Function exits the program on errors.
+
+   \param output - output to prepare
+   \param config - program's configuration variable
+*/
+void cwgen_output_open(struct cwgen_output *output, const struct cwgen_config *config)
+{
+	output->config = config;
+	output->buffer = (char *) NULL;
+	output->buffer_used = 0;
+	output->gen = (cw_gen_t *) NULL;
+
+	if (config->batch) {
+		output->buffer = (char *) malloc(BATCH_BUFFER_SIZE);
+		if (!output->buffer) {
+			fprintf(stderr, "%s: failed to allocate memory\n", config->program_name);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (config->audio_file) {
+		/* File sound system doesn't pace the generator, so the audio
+		   is rendered as fast as samples can be calculated. */
+		cw_gen_config_t gen_conf;
+		memset(&gen_conf, 0, sizeof (gen_conf));
+		gen_conf.sound_system = CW_AUDIO_FILE;
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", config->audio_file);
+
+		output->gen = cw_gen_new(&gen_conf);
+		if (!output->gen) {
+			fprintf(stderr, _("%s: failed to open audio file '%s'\n"), config->program_name, config->audio_file);
+			exit(EXIT_FAILURE);
+		}
+		if (CW_SUCCESS != cw_gen_set_speed(output->gen, config->audio_speed)
+		    || CW_SUCCESS != cw_gen_start(output->gen)) {
+
+			fprintf(stderr, _("%s: failed to start rendering of audio\n"), config->program_name);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Put one character into output
+
+   In default mode the character is flushed immediately, so that a
+   program reading cwgen's output through a pipe (e.g. cw) gets the
+   characters without delay. In batch mode the character is only
+   appended to a buffer that is written when it gets full.
+
+   \param output - output to put the character to
+   \param character - character to put
+*/
+void cwgen_output_put(struct cwgen_output *output, char character)
+{
+	if (output->buffer) {
+		output->buffer[output->buffer_used++] = character;
+		if (output->buffer_used == BATCH_BUFFER_SIZE) {
+			cwgen_write_all(output->config, output->buffer, output->buffer_used);
+			output->buffer_used = 0;
+		}
+	} else {
+		putchar(character);
+		fflush(stdout);
+	}
+
+	if (output->gen && '\n' != character) {
+		/* Groups may be longer than capacity of tone queue, so add
+		   characters one by one, and let the generator drain the queue
+		   when necessary. */
+		cw_gen_wait_for_queue_level(output->gen, AUDIO_QUEUE_LEVEL);
+		if (CW_SUCCESS != cw_gen_enqueue_character(output->gen, character)) {
+			fprintf(stderr, _("%s: failed to render character '%c' to audio\n"), output->config->program_name, character);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Flush and close destination of generated characters
+
+   \param output - output to close
+*/
+void cwgen_output_close(struct cwgen_output *output)
+{
+	if (output->buffer) {
+		cwgen_write_all(output->config, output->buffer, output->buffer_used);
+		free(output->buffer);
+		output->buffer = (char *) NULL;
+		output->buffer_used = 0;
+	}
+
+	if (output->gen) {
+		/* Wait for all characters to be written to the file. */
+		cw_gen_wait_for_queue_level(output->gen, 0);
+		cw_gen_stop(output->gen);
+		cw_gen_delete(&output->gen);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   \brief Write whole block of data to stdout
+
+   Function exits the program on errors.
+
+   \param config - program's configuration variable
+   \param data - data to write
+   \param size - size of data
+*/
+void cwgen_write_all(const struct cwgen_config *config, const char *data, size_t size)
+{
+	while (size > 0) {
+		const ssize_t n = write(STDOUT_FILENO, data, size);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			fprintf(stderr, _("%s: failed to write output: %s\n"), config->program_name, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		data += n;
+		size -= (size_t) n;
+	}
+
+	return;
+}
+
+
+
+
 
 /**
    \brief Print out a brief message directing the user to the help function
@@ -225,6 +411,14 @@ static void cwgen_print_help(const char *program_name)
 	printf(_("                         [default %s]\n"), DEFAULT_CHARSET);
 	printf(_("  -x, --limit=LIMIT      stop after LIMIT characters [default %d]\n"), INITIAL_LIMIT);
 	printf("%s", _("                         a LIMIT of zero indicates no set limit\n"));
+	printf("%s", _("  -s, --seed=SEED        seed random number generator with SEED\n"));
+	printf("%s", _("                         the same SEED generates the same groups\n"));
+	printf("%s", _("                         [default 0: seed is picked automatically]\n"));
+	printf("%s", _("  -b, --batch            write output in large blocks, without flushing\n"));
+	printf("%s", _("                         after every character\n"));
+	printf("%s", _("  -a, --audio=FILE       also render the groups as Morse code audio to FILE\n"));
+	printf("%s", _("                         ('.wav' extension selects WAV file, raw samples otherwise)\n"));
+	printf(_("  -w, --wpm=WPM          speed of rendered audio [default %d]\n"), CW_SPEED_INITIAL);
 	printf("%s", _("  -h, --help             print this message\n"));
 	printf("%s", _("  -v, --version          output version information and exit\n\n"));
 
@@ -319,6 +513,42 @@ void cwgen_parse_command_line(int argc, char **argv, struct cwgen_config *config
 			}
 			break;
 
+		case 's':
+			if (sscanf(argument, "%" SCNu64, &(config->seed)) != 1
+			    || strstr(argument, "-")) {
+
+				fprintf(stderr, _("%s: invalid seed value: %s\n"), config->program_name, argument);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'b':
+			config->batch = true;
+			break;
+
+		case 'a':
+			if (strlen(argument) == 0) {
+				fprintf(stderr, _("%s: audio file name cannot be empty\n"), config->program_name);
+				exit(EXIT_FAILURE);
+			}
+			free(config->audio_file);
+			config->audio_file = strdup(argument);
+			if (!config->audio_file) {
+				fprintf(stderr, _("%s: failed to allocate memory\n"), config->program_name);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
+		case 'w':
+			if (sscanf(argument, "%d", &(config->audio_speed)) != 1
+			    || config->audio_speed < CW_SPEED_MIN
+			    || config->audio_speed > CW_SPEED_MAX) {
+
+				fprintf(stderr, _("%s: invalid wpm value: '%s'\n"), config->program_name, argument);
+				exit(EXIT_FAILURE);
+			}
+			break;
+
 		case 'h':
 			cwgen_print_help(config->program_name);
 			/* Fallthrough. */
@@ -373,9 +603,17 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (g_config.audio_file) {
+		for (const char *c = g_config.charset; *c; c++) {
+			if (!cw_character_is_valid(*c)) {
+				fprintf(stderr, _("%s: character '%c' from charset can't be rendered to audio\n"), argv[0], *c);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
 	/* Generate the character groups as requested. */
 	cwgen_generate_characters(&g_config);
-	putchar('\n');
 
 	cwgen_free_config(&g_config);
 
@@ -400,6 +638,11 @@ void cwgen_free_config(struct cwgen_config *config)
 		config->charset = (char *) NULL;
 	}
 
+	if (config->audio_file) {
+		free(config->audio_file);
+		config->audio_file = (char *) NULL;
+	}
+
 	if (config->program_name) {
 		free(config->program_name);
 		config->program_name = (char *) NULL;
@@ -394,7 +394,7 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("Sound system options:\n"));
 			fprintf(stderr, "%s", _("  -s, --system=SYSTEM\n"));
 			fprintf(stderr, "%s", _("        generate sound using SYSTEM sound system\n"));
-			fprintf(stderr, "%s", _("        SYSTEM: {null|console|oss|alsa|pulseaudio|soundcard}\n"));
+			fprintf(stderr, "%s", _("        SYSTEM: {null|console|oss|alsa|pulseaudio|soundcard|file|jack|pipewire|rtp}\n"));
 			fprintf(stderr, "%s", _("        'null': don't use any sound output\n"));
 			fprintf(stderr, "%s", _("        'console': use system console/buzzer\n"));
 			fprintf(stderr, "%s", _("               this output may require root privileges\n"));
@@ -402,6 +402,12 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("        'alsa' use ALSA output\n"));
 			fprintf(stderr, "%s", _("        'pulseaudio' use PulseAudio output\n"));
 			fprintf(stderr, "%s", _("        'soundcard': use either PulseAudio, OSS or ALSA\n"));
+			fprintf(stderr, "%s", _("        'file': write samples to file given with -d, as fast as possible\n"));
+			fprintf(stderr, "%s", _("               (WAV file for '.wav' extension, raw samples otherwise, '-' is stdout)\n"));
+			fprintf(stderr, "%s", _("        'jack': use JACK output\n"));
+			fprintf(stderr, "%s", _("        'pipewire': use native PipeWire output\n"));
+			fprintf(stderr, "%s", _("        'rtp': stream RTP packets to host:port given with -d\n"));
+			fprintf(stderr, "%s", _("               (Opus when libopus is available, uncompressed L16 otherwise)\n"));
 			fprintf(stderr, "%s", _("        default sound system: 'pulseaudio'->'oss'->'alsa'\n"));
 		}
 		fprintf(stderr, "%s", _("  -d, --device=DEVICE\n"));
@@ -412,6 +418,10 @@ void cw_print_help(cw_config_t *config)
 		fprintf(stderr,       _("        'oss': \"%s\"\n"), CW_DEFAULT_OSS_DEVICE);
 		fprintf(stderr,       _("        'alsa': \"%s\"\n"), CW_DEFAULT_ALSA_DEVICE);
 		fprintf(stderr,       _("        'pulseaudio': %s\n"), CW_DEFAULT_PA_DEVICE);
+		fprintf(stderr,       _("        'file': \"%s\"\n"), CW_DEFAULT_FILE_DEVICE);
+		fprintf(stderr,       _("        'jack': %s (physical playback ports)\n"), CW_DEFAULT_JACK_DEVICE);
+		fprintf(stderr,       _("        'pipewire': %s\n"), CW_DEFAULT_PIPEWIRE_DEVICE);
+		fprintf(stderr,       _("        'rtp': \"%s\"\n"), CW_DEFAULT_RTP_DEVICE);
 
 		if (config->has_feature_libcw_test_specific) {
 			fprintf(stderr, "%s", _("  -X, --test-alsa-device=device\n"));
@@ -431,6 +441,7 @@ void cw_print_help(cw_config_t *config)
 		fprintf(stderr, "%s", _("  -v, --volume=PERCENT   set initial volume to PERCENT\n"));
 		fprintf(stderr,       _("                         valid values: %d - %d\n"), CW_VOLUME_MIN, CW_VOLUME_MAX);
 		fprintf(stderr,       _("                         default value: %d\n"), CW_VOLUME_INITIAL);
+		fprintf(stderr, "%s", _("  -P, --startup-timing   print durations of start-up phases to stderr\n"));
 		fprintf(stderr, "\n");
 
 		fprintf(stderr, "%s", _("Options specific to sound systems (unstable):\n"));
@@ -462,6 +473,11 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("  -c, --nocommands       disable executing embedded commands\n"));
 			fprintf(stderr, "%s", _("  -o, --nocombinations   disallow [...] combinations\n"));
 			fprintf(stderr, "%s", _("  -p, --nocomments       disallow {...} comments\n"));
+			fprintf(stderr, "%s", _("  -r, --read-ahead=TIME  keep TIME milliseconds of sound queued ahead\n"));
+			fprintf(stderr, "%s", _("                         default value: 0 (send characters one by one)\n"));
+			fprintf(stderr, "%s", _("  -l, --listen=ADDRESS   accept input from clients connecting to socket\n"));
+			fprintf(stderr, "%s", _("                         ADDRESS is a path of UNIX socket, or [HOST:]PORT\n"));
+			fprintf(stderr, "%s", _("  -M, --metrics=ADDRESS  serve metrics over HTTP on socket (with -l only)\n"));
 		}
 		if (config->has_feature_practice_time) {
 			fprintf(stderr, "%s", _("  -T, --time=TIME        set initial practice time (in minutes)\n"));
@@ -498,6 +514,18 @@ void cw_print_help(cw_config_t *config)
 			fprintf(stderr, "%s", _("        r - receiver\n"));
 			fprintf(stderr, "%s", _("        o - other\n"));
 			fprintf(stderr, "%s", _("  If this option is not specified, the program will attempt to test all test areas\n\n"));
+			fprintf(stderr, "%s", _("  -J, --test-jobs=N\n"));
+			fprintf(stderr, "%s", _("        execute independent test sets in N parallel worker processes\n"));
+			fprintf(stderr, "%s", _("        tests of sound systems other than Null are still executed one at a time\n"));
+			fprintf(stderr, "%s", _("  -C, --test-virtual-clock\n"));
+			fprintf(stderr, "%s", _("        don't sleep in Null sound system, advance virtual clock of generator instead\n"));
+			fprintf(stderr, "%s", _("  -B, --test-baseline=FILE\n"));
+			fprintf(stderr, "%s", _("        compare results of benchmarks with baseline from FILE\n"));
+			fprintf(stderr, "%s", _("        results worse than baseline by more than tolerance are test failures\n"));
+			fprintf(stderr, "%s", _("  -W, --test-write-baseline=FILE\n"));
+			fprintf(stderr, "%s", _("        write results of benchmarks to FILE, to be used as new baseline\n"));
+			fprintf(stderr, "%s", _("  -O, --test-tolerance=PERCENT\n"));
+			fprintf(stderr, "%s", _("        allowed difference from baseline, overrides tolerances from baseline\n\n"));
 		}
 		if (config->has_feature_test_loops) {
 			fprintf(stderr, "%s", _("  -L, --test-loops=N\n"));
@@ -557,6 +585,7 @@ char * cw_config_get_supported_feature_cmdline_options(const cw_config_t * confi
 		append_option(buffer, size, &n, "t:|tone");
 		append_option(buffer, size, &n, "v:|volume");
 		append_option(buffer, size, &n, "1:|alsa-period-size");
+		append_option(buffer, size, &n, "P|startup-timing");
 	}
 	if (config->has_feature_dot_dash_params) {
 		append_option(buffer, size, &n, "g:|gap");
@@ -573,7 +602,7 @@ char * cw_config_get_supported_feature_cmdline_options(const cw_config_t * confi
 	}
 
 	if (config->has_feature_cw_specific) {
-		append_option(buffer, size, &n, "e|noecho,m|nomessages,c|nocommands,o|nocombinations,p|nocomments");
+		append_option(buffer, size, &n, "e|noecho,m|nomessages,c|nocommands,o|nocombinations,p|nocomments,r:|read-ahead,l:|listen,M:|metrics");
 	}
 	if (config->has_feature_ui_colors) {
 		append_option(buffer, size, &n, "c:|colours,c:|colors,m|mono");
@@ -583,6 +612,11 @@ char * cw_config_get_supported_feature_cmdline_options(const cw_config_t * confi
 		append_option(buffer, size, &n, "S:|test-systems");
 		append_option(buffer, size, &n, "A:|test-areas");
 		append_option(buffer, size, &n, "X:|test-alsa-device");
+		append_option(buffer, size, &n, "J:|test-jobs");
+		append_option(buffer, size, &n, "C|test-virtual-clock");
+		append_option(buffer, size, &n, "B:|test-baseline");
+		append_option(buffer, size, &n, "W:|test-write-baseline");
+		append_option(buffer, size, &n, "O:|test-tolerance");
 	}
 	if (config->has_feature_test_loops) {
 		append_option(buffer, size, &n, "L:|test-loops");
@@ -670,6 +704,22 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 			   || !strcmp(optarg, "s")) {
 
 			config->gen_conf.sound_system = CW_AUDIO_SOUNDCARD;
+		} else if (!strcmp(optarg, "file")
+			   || !strcmp(optarg, "f")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_FILE;
+		} else if (!strcmp(optarg, "jack")
+			   || !strcmp(optarg, "j")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_JACK;
+		} else if (!strcmp(optarg, "pipewire")
+			   || !strcmp(optarg, "w")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_PIPEWIRE;
+		} else if (!strcmp(optarg, "rtp")
+			   || !strcmp(optarg, "r")) {
+
+			config->gen_conf.sound_system = CW_AUDIO_RTP;
 		} else {
 			fprintf(stderr, "%s: invalid sound system (option 's'): %s\n", config->program_name, optarg);
 			return CW_FAILURE;
@@ -809,10 +859,44 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 		config->do_comments = false;
 		break;
 
+	case 'r':
+		{
+			int read_ahead = atoi(optarg);
+			if (read_ahead < 0) {
+				fprintf(stderr, "%s: read-ahead time is negative\n", config->program_name);
+				return CW_FAILURE;
+			} else {
+				config->read_ahead = read_ahead;
+			}
+			break;
+		}
+
+	case 'l':
+		if (optarg && strlen(optarg)) {
+			config->listen_address = strdup(optarg);
+		} else {
+			fprintf(stderr, "%s: no address specified for option -l\n", config->program_name);
+			return CW_FAILURE;
+		}
+		break;
+
+	case 'M':
+		if (optarg && strlen(optarg)) {
+			config->metrics_address = strdup(optarg);
+		} else {
+			fprintf(stderr, "%s: no address specified for option -M\n", config->program_name);
+			return CW_FAILURE;
+		}
+		break;
+
 	case '1':
 		config->gen_conf.alsa_period_size = strtoul(optarg, NULL, 10);
 		break;
 
+	case 'P':
+		config->startup_timing = true;
+		break;
+
 	case 'h':
 	case '?':
 		cw_print_help(config);
@@ -947,6 +1031,37 @@ int cw_process_option(int opt, const char *optarg, cw_config_t *config)
 		config->test_random_seed = (uint32_t) atol(optarg);
 		break;
 
+	case 'J':
+		config->test_jobs = atoi(optarg);
+		if (config->test_jobs < 0) {
+			fprintf(stderr, "Invalid count of test jobs: '%s'\n", optarg);
+			goto help_and_error;
+		}
+		break;
+
+	case 'C':
+		config->gen_conf.null_virtual_clock = true;
+		break;
+
+	case 'B':
+		snprintf(config->test_baseline_path, sizeof (config->test_baseline_path), "%s", optarg);
+		break;
+
+	case 'W':
+		snprintf(config->test_baseline_output_path, sizeof (config->test_baseline_output_path), "%s", optarg);
+		break;
+
+	case 'O':
+		{
+			char * end = NULL;
+			config->test_tolerance = strtod(optarg, &end);
+			if (end == optarg || '\0' != *end || config->test_tolerance < 0.0) {
+				fprintf(stderr, "Invalid tolerance: '%s'\n", optarg);
+				goto help_and_error;
+			}
+		}
+		break;
+
 	default: /* '?' */
 		cw_print_usage(config->program_name);
 		return CW_FAILURE;
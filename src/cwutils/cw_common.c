@@ -52,6 +52,7 @@
 
 
 static int cw_generator_apply_config(cw_config_t * config);
+static double cw_timespec_diff_ms(const struct timespec * earlier, const struct timespec * later);
 
 
 
@@ -96,10 +97,38 @@ int cw_generator_new_from_config(cw_config_t *config)
 	}
 
 
+	/* The library probes PulseAudio, OSS and ALSA in parallel, and
+	   first tries sound system that has been successfully used last
+	   time, so don't probe them here one by one. */
+	bool soundcard_probed = false;
 	if (config->gen_conf.sound_system == CW_AUDIO_NONE
-	    || config->gen_conf.sound_system == CW_AUDIO_PA
 	    || config->gen_conf.sound_system == CW_AUDIO_SOUNDCARD) {
 
+		cw_gen_config_t gen_conf = config->gen_conf;
+		gen_conf.sound_system = CW_AUDIO_SOUNDCARD;
+		if (cw_generator_new_internal(&gen_conf)) {
+			const int sound_systems[] = { CW_AUDIO_PA, CW_AUDIO_OSS, CW_AUDIO_ALSA };
+			for (size_t i = 0; i < sizeof (sound_systems) / sizeof (sound_systems[0]); i++) {
+				if (0 == strcmp(cw_generator_get_audio_system_label(), cw_get_audio_system_label(sound_systems[i]))) {
+					config->gen_conf.sound_system = sound_systems[i];
+				}
+			}
+			if (cw_generator_apply_config(config)) {
+				return CW_SUCCESS;
+			} else {
+				fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+				return CW_FAILURE;
+			}
+		} else {
+			fprintf(stderr, "%s: PulseAudio, OSS and ALSA outputs are not available\n", config->program_name);
+		}
+		soundcard_probed = true;
+		/* fall through to try with next sound system type */
+	}
+
+
+	if (!soundcard_probed && config->gen_conf.sound_system == CW_AUDIO_PA) {
+
 		/* For PulseAudio 'picked_device_name' may be empty, which
 		   will indicate "use default device". */
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_PA,
@@ -130,9 +159,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 		/* fall through to try with next sound system type */
 	}
 
-	if (config->gen_conf.sound_system == CW_AUDIO_NONE
-	    || config->gen_conf.sound_system == CW_AUDIO_OSS
-	    || config->gen_conf.sound_system == CW_AUDIO_SOUNDCARD) {
+	if (!soundcard_probed && config->gen_conf.sound_system == CW_AUDIO_OSS) {
 
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_OSS,
 						 picked_device_name, sizeof (picked_device_name));
@@ -161,9 +188,7 @@ int cw_generator_new_from_config(cw_config_t *config)
 	}
 
 
-	if (config->gen_conf.sound_system == CW_AUDIO_NONE
-	    || config->gen_conf.sound_system == CW_AUDIO_ALSA
-	    || config->gen_conf.sound_system == CW_AUDIO_SOUNDCARD) {
+	if (!soundcard_probed && config->gen_conf.sound_system == CW_AUDIO_ALSA) {
 
 		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_ALSA,
 						 picked_device_name, sizeof (picked_device_name));
@@ -192,6 +217,122 @@ int cw_generator_new_from_config(cw_config_t *config)
 	}
 
 
+	if (config->gen_conf.sound_system == CW_AUDIO_FILE) {
+
+		/* File sound system is never picked automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_FILE,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_file_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open file output with file '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: file output is not available with file '%s'\n",
+				config->program_name, picked_device_name);
+		}
+		/* fall through to try with next sound system type */
+	}
+
+
+	if (config->gen_conf.sound_system == CW_AUDIO_JACK) {
+
+		/* JACK sound system is never picked automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_JACK,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_jack_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open JACK output with device '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: JACK output is not available with device '%s'\n",
+				config->program_name, picked_device_name);
+		}
+		/* fall through to try with next sound system type */
+	}
+
+
+	if (config->gen_conf.sound_system == CW_AUDIO_PIPEWIRE) {
+
+		/* PipeWire sound system is never picked automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_PIPEWIRE,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_pipewire_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open PipeWire output with device '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: PipeWire output is not available with device '%s'\n",
+				config->program_name, picked_device_name);
+		}
+		/* fall through to try with next sound system type */
+	}
+
+
+	if (config->gen_conf.sound_system == CW_AUDIO_RTP) {
+
+		/* RTP sound system is never picked automatically. */
+		cw_gen_pick_device_name_internal(config->gen_conf.sound_device, CW_AUDIO_RTP,
+						 picked_device_name, sizeof (picked_device_name));
+
+		if (cw_is_rtp_possible(picked_device_name)) {
+
+			snprintf(config->gen_conf.sound_device, sizeof (config->gen_conf.sound_device), "%s", picked_device_name);
+
+			if (cw_generator_new_internal(&config->gen_conf)) {
+				if (cw_generator_apply_config(config)) {
+					return CW_SUCCESS;
+				} else {
+					fprintf(stderr, "%s: failed to apply configuration\n", config->program_name);
+					return CW_FAILURE;
+				}
+			} else {
+				fprintf(stderr, "%s: failed to open RTP output with device '%s'\n",
+					config->program_name, picked_device_name);
+			}
+		} else {
+			fprintf(stderr, "%s: RTP output is not available with device '%s'\n",
+				config->program_name, picked_device_name);
+		}
+		/* fall through to try with next sound system type */
+	}
+
+
 	if (config->gen_conf.sound_system == CW_AUDIO_NONE
 	    || config->gen_conf.sound_system == CW_AUDIO_CONSOLE) {
 
@@ -269,6 +410,52 @@ int cw_generator_apply_config(cw_config_t *config)
 
 
 
+/**
+   \brief Print duration of a phase of program's start-up
+
+   If printing of start-up timings has been requested with -P option,
+   the function prints to stderr how long it took since previous call
+   of the function (or since start of the program), and how long it
+   took since start of the program.
+
+   The function can be called from generator's thread, e.g. from
+   keying callback that detects first tone.
+
+   \param config - current configuration
+   \param phase - name of phase of start-up that has just ended
+*/
+void cw_startup_timing_mark(cw_config_t *config, const char *phase)
+{
+	if (!config->startup_timing) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "%s: startup: %-20s %8.3f ms (total %8.3f ms)\n",
+		config->program_name, phase,
+		cw_timespec_diff_ms(&config->startup_last_mark, &now),
+		cw_timespec_diff_ms(&config->startup_time, &now));
+	config->startup_last_mark = now;
+
+	return;
+}
+
+
+
+
+/**
+   \brief Calculate difference between two points in time, in milliseconds
+*/
+static double cw_timespec_diff_ms(const struct timespec * earlier, const struct timespec * later)
+{
+	return (double) (later->tv_sec - earlier->tv_sec) * 1000.0
+		+ (double) (later->tv_nsec - earlier->tv_nsec) / 1000000.0;
+}
+
+
+
+
 /**
    \brief Generate a tone that indicates a start
 */
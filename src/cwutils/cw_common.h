@@ -40,6 +40,7 @@ extern "C" {
 extern void cw_print_help(cw_config_t *config);
 
 extern int cw_generator_new_from_config(cw_config_t *config);
+extern void cw_startup_timing_mark(cw_config_t *config, const char *phase);
 
 extern void cw_start_beep(void);
 extern void cw_end_beep(void);
@@ -81,8 +81,15 @@ cw_config_t * cw_config_new(const char * program_name)
 	config->do_commands = true;
 	config->do_combinations = true;
 	config->do_comments = true;
+	config->read_ahead = 0;
+	config->listen_address = NULL;
+	config->metrics_address = NULL;
 
-	/* All sound systems should be tested by default. May be overriden by
+	config->startup_timing = false;
+	clock_gettime(CLOCK_MONOTONIC, &config->startup_time);
+	config->startup_last_mark = config->startup_time;
+
+	/* All sound systems should be tested by default. May be overridden by
 	   '-S' command line option. */
 	int s = 0;
 	config->tested_sound_systems[s++] = CW_AUDIO_NULL;
@@ -91,7 +98,7 @@ cw_config_t * cw_config_new(const char * program_name)
 	config->tested_sound_systems[s++] = CW_AUDIO_ALSA;
 	config->tested_sound_systems[s++] = CW_AUDIO_PA;
 	config->tested_sound_systems[s++] = CW_AUDIO_NONE;
-	/* All topics should be tested by default. May be overriden by '-A'
+	/* All topics should be tested by default. May be overridden by '-A'
 	   command line option. */
 	int t = 0;
 	config->tested_areas[t++] = LIBCW_TEST_TOPIC_TQ;
@@ -101,6 +108,9 @@ cw_config_t * cw_config_new(const char * program_name)
 	config->tested_areas[t++] = LIBCW_TEST_TOPIC_DATA;
 	config->tested_areas[t++] = LIBCW_TEST_TOPIC_OTHER;
 	config->tested_areas[t++] = LIBCW_TEST_TOPIC_MAX; /* Guard element. */
+	/* Use tolerances from baseline. May be overridden by '-O'
+	   command line option. */
+	config->test_tolerance = -1.0;
 	/* TODO acerion 2023.09.30: remove test-related options from cw_config_t.
 	   Production code and test code should not be mixed like this. */
 
@@ -126,6 +136,14 @@ void cw_config_delete(cw_config_t ** config)
 			free((*config)->output_file);
 			(*config)->output_file = NULL;
 		}
+		if ((*config)->listen_address) {
+			free((*config)->listen_address);
+			(*config)->listen_address = NULL;
+		}
+		if ((*config)->metrics_address) {
+			free((*config)->metrics_address);
+			(*config)->metrics_address = NULL;
+		}
 		free(*config);
 		*config = NULL;
 	}
@@ -156,5 +174,15 @@ int cw_config_is_valid(cw_config_t * config)
 		; /* no custom "sound device" specified, a default will be used */
 	}
 
+	if (config->listen_address && config->read_ahead > 0) {
+		fprintf(stderr, "%s: read-ahead can't be used when listening on a socket\n", config->program_name);
+		return false;
+	}
+
+	if (config->metrics_address && !config->listen_address) {
+		fprintf(stderr, "%s: metrics can be served only when listening on a socket\n", config->program_name);
+		return false;
+	}
+
 	return true;
 }
@@ -33,6 +33,7 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 
 
@@ -115,6 +116,15 @@ typedef struct cw_config_t {
 	bool do_commands;       /* Execute embedded commands */
 	bool do_combinations;   /* Execute [...] combinations */
 	bool do_comments;       /* Allow {...} as comments */
+	int read_ahead;         /* How much of sound to keep queued ahead of playback [milliseconds]. Zero: send characters one by one. */
+	char *listen_address;   /* Socket on which to accept clients, instead of reading stdin. NULL: read stdin. */
+	char *metrics_address;  /* Socket on which to serve metrics over HTTP in server mode. NULL: don't serve metrics. */
+
+	/* Print durations of phases of program's start-up to stderr
+	   (-P option), see cw_startup_timing_mark(). */
+	bool startup_timing;
+	struct timespec startup_time;       /* When configuration was created, i.e. when the program started. */
+	struct timespec startup_last_mark;  /* When previous phase of start-up ended. */
 
 
 	/* These fields are used in libcw tests only. */
@@ -123,6 +133,16 @@ typedef struct cw_config_t {
 	char test_function_name[128];    /* Execute only a test function with this name. */
 	int test_loops;                  /* How many times tested function should be executed in a a single test function? */
 	bool test_quick_only;            /* Execute tests that are flagged as 'quick enough to make <make check> target run in short time'. */
+	int test_jobs;                   /* Count of worker processes executing test sets in parallel. Zero or one: execute tests sequentially in main process. */
+
+	/* Results of benchmarks are compared with baseline read from
+	   ::test_baseline_path, and are written as a new baseline to
+	   ::test_baseline_output_path. Empty strings: don't read or
+	   write baseline. ::test_tolerance [percents] overrides
+	   tolerances from the baseline if it's not negative. */
+	char test_baseline_path[256];
+	char test_baseline_output_path[256];
+	double test_tolerance;
 
 	/* Some tests poll random values from pseudo-random-number generator. By
 	   default the generator is seeded with some random value, but you can
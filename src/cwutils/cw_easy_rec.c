@@ -31,6 +31,7 @@
 
 #include <libcw.h>
 #include <libcw_rec.h>
+#include <libcw_utils.h>
 
 #include "sleep.h"
 #include "cw_easy_rec.h"
@@ -47,11 +48,25 @@
    This file is different from cw_easy_legacy_receiver.c in that it is a wrapper around
    modern (non-legacy) receiver API. With this API we can have more than one
    easy receiver at a time, in a single process.
+
+   Data received by the polling thread is either passed to a receive
+   callback (called in the polling thread), or, if no callback is
+   registered, put into a bounded single-producer/single-consumer queue.
+   The queue is lock-free: the polling thread only writes queue's tail,
+   and the consumer (e.g. UI thread calling cw_easy_rec_pop_data()) only
+   writes queue's head, so the consumer never waits for the polling thread
+   or for the keying callback.
 */
 
 
 
 
+/* Capacity of queue of received data. Must be a power of two. */
+#define CW_EASY_REC_QUEUE_CAPACITY 64
+
+
+
+
 
 struct cw_easy_rec_t {
 
@@ -87,6 +102,14 @@ struct cw_easy_rec_t {
 	pthread_t thread;
 	bool run_thread;
 
+	/* Queue of received data, used when no receive callback is
+	   registered. Indices grow without wrapping to the capacity, slot
+	   of an index is (index % CW_EASY_REC_QUEUE_CAPACITY). */
+	cw_easy_rec_data_t queue[CW_EASY_REC_QUEUE_CAPACITY];
+	size_t queue_head;     /* Index of oldest item. Written only by consumer. */
+	size_t queue_tail;     /* Index of next free slot. Written only by polling thread. */
+	size_t queue_dropped;  /* Count of items dropped because the queue was full. */
+
 	/* This is a callback registered by application using the easy receiver.
 	   It will be called on each successful receive. */
 	cw_easy_rec_receive_callback_t receive_callback;
@@ -102,6 +125,7 @@ struct cw_easy_rec_t {
 static bool cw_easy_rec_poll_data_internal(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd);
 static bool cw_easy_rec_poll_character_internal(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd);
 static bool cw_easy_rec_poll_iws_internal(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd);
+static bool cw_easy_rec_push_data_internal(cw_easy_rec_t * easy_rec, const cw_easy_rec_data_t * erd);
 
 
 
@@ -165,61 +189,21 @@ void cw_easy_rec_handle_libcw_keying_event(void * easy_receiver, int key_state)
 		easy_rec->tracked_key_state = key_state;
 	}
 
-	/* If this is a tone start and we're awaiting an inter-word
-	   space, cancel that wait and clear the receive buffer. */
-	if (key_state && easy_rec->is_pending_iws) {
-		/* Tell receiver to prepare (to make space) for
-		   receiving new character. */
-		cw_rec_reset_state(easy_rec->rec);
-
-		/* The tone start means that we're seeing the next
-		   incoming character within the same word, so no
-		   inter-word space is possible at this point in
-		   time. The space that we were observing/waiting for,
-		   was just inter-character space. */
-		easy_rec->is_pending_iws = false;
-	}
-
-	//fprintf(stderr, "calling callback, stage 2\n");
+	/* This function is called in libcw's thread, and the receiver is
+	   polled in easy receiver's thread, so the tone state is only
+	   queued in the receiver. Polling thread passes it to the
+	   receiver, with timestamp taken here. If this is a tone start
+	   after a character, receiver is reset by polling thread. */
 	gettimeofday(&easy_rec->main_timer, NULL);
-
-	/* Pass tone state on to the library.  For tone end, check to
-	   see if the library has registered any receive error. */
-	if (key_state) {
-		/* Key down. */
-		//fprintf(stderr, "start receive tone: %10ld . %10ld\n", easy_rec->main_timer->tv_sec, easy_rec->main_timer->tv_usec);
-		if (CW_SUCCESS != cw_rec_mark_begin(easy_rec->rec, &easy_rec->main_timer)) {
-			// TODO: Perhaps this should be counted as test error
-			perror("cw_rec_mark_begin");
-			return;
-		}
-	} else {
-		/* Key up. */
-		//fprintf(stderr, "end receive tone:   %10ld . %10ld\n", easy_rec->main_timer->tv_sec, easy_rec->main_timer->tv_usec);
-		if (CW_SUCCESS != cw_rec_mark_end(easy_rec->rec, &easy_rec->main_timer)) {
-			/* Handle receive error detected on tone end.
-			   For ENOMEM and ENOENT we set the error in a
-			   class flag, and display the appropriate
-			   message on the next receive poll. */
-			switch (errno) {
-			case EAGAIN:
-				/* libcw treated the tone as noise (it
-				   was shorter than noise threshold).
-				   No problem, not an error. */
-				break;
-			case ENOMEM:
-			case ERANGE:
-			case EINVAL:
-			case ENOENT:
-				easy_rec->libcw_receive_errno = errno;
-				cw_rec_reset_state(easy_rec->rec);
-				break;
-			default:
-				perror("cw_rec_mark_end");
-				// TODO: Perhaps this should be counted as test error
-				return;
-			}
-		}
+	const int64_t timestamp = (int64_t) easy_rec->main_timer.tv_sec * CW_USECS_PER_SEC + easy_rec->main_timer.tv_usec;
+
+	const cw_ret_t cwret = key_state
+		? cw_rec_push_mark_begin(easy_rec->rec, timestamp)
+		: cw_rec_push_mark_end(easy_rec->rec, timestamp);
+	if (CW_SUCCESS != cwret) {
+		/* Polling thread doesn't keep up. Report the error on
+		   next receive poll. */
+		__atomic_store_n(&easy_rec->libcw_receive_errno, errno, __ATOMIC_RELAXED);
 	}
 
 	return;
@@ -232,7 +216,8 @@ void cw_easy_rec_handle_libcw_keying_event(void * easy_receiver, int key_state)
    @brief Main polling loop of a receiver
 
    The loop tries to periodically poll data from easy receiver. On successful
-   poll, a call to cw_easy_rec_t::callback is performed.
+   poll, a call to cw_easy_rec_t::callback is performed, or the data is put
+   into easy receiver's queue if there is no callback.
 
    The loop is running as long as cw_easy_rec_t::run_thread is true.
 
@@ -254,6 +239,8 @@ static void * thread_fn(void * arg)
 				/* This may pass the data to application that is using the
 				   receiver. */
 				easy_rec->receive_callback(easy_rec->receive_callback_data, &erd);
+			} else {
+				cw_easy_rec_push_data_internal(easy_rec, &erd);
 			}
 		}
 	}
@@ -264,6 +251,71 @@ static void * thread_fn(void * arg)
 
 
 
+/**
+   @brief Put received data into queue of easy receiver
+
+   Called only by polling thread (the single producer).
+
+   @param[in/out] easy_rec Easy receiver
+   @param[in] erd Data to put into the queue
+
+   @return true if the data has been put into the queue
+   @return false if the queue is full (the data is dropped)
+*/
+static bool cw_easy_rec_push_data_internal(cw_easy_rec_t * easy_rec, const cw_easy_rec_data_t * erd)
+{
+	const size_t tail = easy_rec->queue_tail;
+	const size_t head = __atomic_load_n(&easy_rec->queue_head, __ATOMIC_ACQUIRE);
+	if (tail - head == CW_EASY_REC_QUEUE_CAPACITY) {
+		__atomic_add_fetch(&easy_rec->queue_dropped, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	easy_rec->queue[tail % CW_EASY_REC_QUEUE_CAPACITY] = *erd;
+	/* Publish the slot only after it has been written. */
+	__atomic_store_n(&easy_rec->queue_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+
+
+bool cw_easy_rec_pop_data(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd)
+{
+	if (NULL == easy_rec || NULL == erd) {
+		fprintf(stderr, "[ERROR] %s:%d: NULL argument\n", __func__, __LINE__);
+		return false;
+	}
+
+	const size_t head = easy_rec->queue_head;
+	const size_t tail = __atomic_load_n(&easy_rec->queue_tail, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return false;
+	}
+
+	*erd = easy_rec->queue[head % CW_EASY_REC_QUEUE_CAPACITY];
+	/* Give the slot back to producer only after it has been read. */
+	__atomic_store_n(&easy_rec->queue_head, head + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+
+
+size_t cw_easy_rec_get_dropped_count(const cw_easy_rec_t * easy_rec)
+{
+	if (NULL == easy_rec) {
+		fprintf(stderr, "[ERROR] %s:%d: NULL argument\n", __func__, __LINE__);
+		return 0;
+	}
+	return __atomic_load_n(&easy_rec->queue_dropped, __ATOMIC_RELAXED);
+}
+
+
+
+
 void cw_easy_rec_start(cw_easy_rec_t * easy_rec)
 {
 	if (NULL == easy_rec) {
@@ -304,13 +356,11 @@ void cw_easy_rec_stop(cw_easy_rec_t * easy_rec)
 */
 static bool cw_easy_rec_poll_data_internal(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd)
 {
-	easy_rec->libcw_receive_errno = 0;
+	__atomic_store_n(&easy_rec->libcw_receive_errno, 0, __ATOMIC_RELAXED);
 
-	if (easy_rec->is_pending_iws) {
+	if (__atomic_load_n(&easy_rec->is_pending_iws, __ATOMIC_ACQUIRE)) {
 		/* Check if receiver received the pending inter-word-space. */
-		cw_easy_rec_poll_iws_internal(easy_rec, erd);
-
-		if (!easy_rec->is_pending_iws) {
+		if (cw_easy_rec_poll_iws_internal(easy_rec, erd)) {
 			/*
 			  We received the pending space. After it the receiver may have
 			  received another character. Try to get it too.
@@ -383,7 +433,7 @@ static bool cw_easy_rec_poll_character_internal(cw_easy_rec_t * easy_rec, cw_eas
 
 		   Set a flag indicating that next poll may result in
 		   inter-word space. */
-		easy_rec->is_pending_iws = true;
+		__atomic_store_n(&easy_rec->is_pending_iws, true, __ATOMIC_RELEASE);
 
 		//fprintf(stderr, "[DD] Received character '%c'\n", erd->character);
 
@@ -465,13 +515,19 @@ static bool cw_easy_rec_poll_iws_internal(cw_easy_rec_t * easy_rec, cw_easy_rec_
 	//fprintf(stderr, "poll_iws(): %10ld : %10ld\n", timer.tv_sec, timer.tv_usec);
 
 	if (CW_SUCCESS != cw_rec_poll_character(easy_rec->rec, &timer, &erd->character, &erd->is_iws, NULL)) {
+		if (ERANGE == errno) {
+			/* Receiver has taken from its queue a tone start
+			   that began next character within the same word,
+			   so the space was just inter-character space. */
+			__atomic_store_n(&easy_rec->is_pending_iws, false, __ATOMIC_RELEASE);
+		}
 		return false;
 	}
 	if (erd->is_iws) {
 		//fprintf(stderr, "[DD] Character at inter-word-space: '%c'\n", erd->character);
 
 		cw_rec_reset_state(easy_rec->rec);
-		easy_rec->is_pending_iws = false;
+		__atomic_store_n(&easy_rec->is_pending_iws, false, __ATOMIC_RELEASE);
 		return true; /* Inter-word-space has been polled. */
 	} else {
 		/* We don't reset easy_rec->is_pending_iws. The
@@ -524,9 +580,13 @@ void cw_easy_rec_clear(cw_easy_rec_t * easy_rec)
 		return;
 	}
 	cw_rec_reset_state(easy_rec->rec);
-	easy_rec->is_pending_iws = false;
-	easy_rec->libcw_receive_errno = 0;
+	__atomic_store_n(&easy_rec->is_pending_iws, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&easy_rec->libcw_receive_errno, 0, __ATOMIC_RELAXED);
 	easy_rec->tracked_key_state = false;
+
+	/* Discard data waiting in the queue. This is done on consumer's side
+	   of the queue, so it's safe while polling thread is running. */
+	__atomic_store_n(&easy_rec->queue_head, __atomic_load_n(&easy_rec->queue_tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
 }
 
 
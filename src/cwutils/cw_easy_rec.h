@@ -93,9 +93,10 @@ void cw_easy_rec_delete(cw_easy_rec_t ** easy_rec);
    Let the receiver start receiving.
 
    Notice that without calling
-   cw_gen_register_value_tracking_callback_internal() and
-   cw_easy_rec_register_receive_callback() the receiver won't be doing anything
-   useful.
+   cw_gen_register_value_tracking_callback_internal() the receiver won't be
+   doing anything useful. Received data is passed to callback registered
+   with cw_easy_rec_register_receive_callback(), or, if there is no such
+   callback, it can be taken with cw_easy_rec_pop_data().
 
    @reviewedon 2023.08.12
 
@@ -210,6 +211,43 @@ void cw_easy_rec_register_receive_callback(cw_easy_rec_t * easy_rec, cw_easy_rec
 
 
 
+/**
+   @brief Get data received by easy receiver
+
+   If no receive callback is registered with
+   cw_easy_rec_register_receive_callback(), data received by easy receiver
+   is put into a bounded queue. Use this function to get the data from the
+   queue, e.g. in a timer of UI thread.
+
+   The queue is lock-free, with easy receiver's polling thread as the only
+   producer. The function must be called from only one thread at a time
+   (single consumer), and it never blocks.
+
+   @param[in/out] easy_rec Easy receiver from which to get the data
+   @param[out] erd Received data
+
+   @return true if data has been taken from the queue
+   @return false if the queue is empty
+*/
+bool cw_easy_rec_pop_data(cw_easy_rec_t * easy_rec, cw_easy_rec_data_t * erd);
+
+
+
+
+/**
+   @brief Get count of received data that has been dropped because queue was full
+
+   The count grows if cw_easy_rec_pop_data() is not called often enough.
+
+   @param[in] easy_rec Easy receiver
+
+   @return count of dropped items of data
+*/
+size_t cw_easy_rec_get_dropped_count(const cw_easy_rec_t * easy_rec);
+
+
+
+
 /**
    \brief Handler for the keying callback from the CW library
    indicating that the state of a key has changed
@@ -1,6 +1,10 @@
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <sys/time.h>
 
 
 
@@ -12,6 +16,7 @@
 
 
 #include "cw_rec_tester.h"
+#include "lib/scoring.h"
 
 
 
@@ -31,6 +36,18 @@
 
 
 
+/* Short text for occasions where I need a quick test. */
+#define BASIC_SET_SHORT "one two three four paris"
+
+/* Long text for longer tests. */
+#define BASIC_SET_LONG \
+	"the quick brown fox jumps over the lazy dog. 01234567890 paris paris paris "    \
+	"abcdefghijklmnopqrstuvwxyz0123456789\"'$()+,-./:;=?_@<>!&^~ paris paris paris " \
+	"one two three four five six seven eight nine ten eleven paris paris paris "
+
+
+
+
 static bool cw_rec_tester_input_and_received_match(cw_rec_tester_t * tester);
 static void cw_rec_tester_normalize_input_and_received(cw_rec_tester_t * tester);
 
@@ -41,6 +58,12 @@ static void * cw_rec_tester_play_string(void * arg_tester);
 
 static void cw_rec_tester_display_differences(const cw_rec_tester_t * tester);
 
+typedef struct cw_rec_tester_stress_keying_t cw_rec_tester_stress_keying_t;
+static void * cw_rec_tester_stress_thread_fn(void * arg);
+static int cw_rec_tester_stress_run_config(cw_rec_tester_stress_keying_t * keying, const cw_rec_tester_stress_params_t * params, cw_rec_tester_stress_result_t * result);
+static void cw_rec_tester_stress_value_tracking_fn(void * arg, int key_state);
+static int cw_rec_tester_stress_distort_keying(const cw_rec_tester_stress_params_t * params, int dot_duration, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_edge_t ** distorted, size_t * n_distorted, size_t * n_spikes);
+
 
 
 
@@ -102,15 +125,10 @@ void cw_rec_tester_init_text_buffers(cw_rec_tester_t * tester, bool make_short)
 
 	if (make_short) {
 		/* Short text for occasions where I need a quick test. */
-#define BASIC_SET_SHORT "one two three four paris"
 		const char input[REC_TEST_INPUT_BUFFER_SIZE] = BASIC_SET_SHORT;
 		snprintf(tester->input_string, sizeof (tester->input_string), "%s", input);
 	} else {
 		/* Long text for longer tests. */
-#define BASIC_SET_LONG \
-	"the quick brown fox jumps over the lazy dog. 01234567890 paris paris paris "    \
-	"abcdefghijklmnopqrstuvwxyz0123456789\"'$()+,-./:;=?_@<>!&^~ paris paris paris " \
-	"one two three four five six seven eight nine ten eleven paris paris paris "
 		const char input[REC_TEST_INPUT_BUFFER_SIZE] = BASIC_SET_LONG BASIC_SET_LONG;
 		snprintf(tester->input_string, sizeof (tester->input_string), "%s", input);
 	}
@@ -244,6 +262,9 @@ static void string_trim_end(char * string)
 	size_t i = len - 1;
 	while (string[i] == ' ') {
 		string[i] = '\0';
+		if (0 == i) {
+			break;
+		}
 		i--;
 	}
 }
@@ -642,3 +663,429 @@ int cw_rec_tester_on_space(cw_rec_tester_t * tester, cw_rec_data_t * erd, struct
 
 
 
+
+
+
+
+/* Duration of noise spike added to keying in stress test. Default
+   noise spike threshold of receiver is 10000 microseconds. */
+#define STRESS_SPIKE_DURATION 5000 /* [microseconds] */
+
+/* Capacity of helper generator's queue in stress test: whole text is
+   enqueued at once. With virtual clock the generator would drain a
+   short queue faster than it could be refilled. */
+#define STRESS_QUEUE_CAPACITY 65536
+
+
+
+
+/**
+   Configurations of stress test, shared by all threads running the test.
+*/
+typedef struct {
+	const cw_rec_tester_stress_params_t * params;
+	cw_rec_tester_stress_result_t * results;
+	size_t n_configs;
+	size_t next_config;    /* Index of next configuration to test, incremented atomically. */
+	int retval;
+} cw_rec_tester_stress_t;
+
+
+
+
+/**
+   Keying of helper generator recorded during stress test: Marks and
+   Spaces with durations measured with generator's virtual clock.
+*/
+struct cw_rec_tester_stress_keying_t {
+	pthread_mutex_t mutex; /* Protects recorded keying from generator's thread. */
+	cw_gen_t * gen;
+	cw_rec_edge_t * edges;
+	size_t n_edges;
+	size_t capacity;
+	struct timeval prev_timestamp;
+	int prev_key_state;
+	bool started;         /* Whether first Mark has started. */
+	bool failed;          /* Whether memory allocation has failed. */
+};
+
+
+
+
+void cw_rec_tester_stress_randomize_params(cw_random_t * rng, cw_rec_tester_stress_params_t * params)
+{
+	params->speed = CW_SPEED_MIN + (int) cw_random_get_bounded(rng, CW_SPEED_MAX - CW_SPEED_MIN + 1);
+	/* Below 20% the ranges of Dots and Dashes are too narrow even for
+	   perfect keying, above 80% they start to overlap. */
+	params->tolerance = 20 + (int) cw_random_get_bounded(rng, 61);
+	params->jitter_percent = (int) cw_random_get_bounded(rng, 51);
+	params->spikes_per_mille = (int) cw_random_get_bounded(rng, 51);
+	params->seed = cw_random_next(rng);
+}
+
+
+
+
+int cw_rec_tester_stress_run(const cw_rec_tester_stress_params_t * params, cw_rec_tester_stress_result_t * results, size_t n_configs, unsigned int n_threads)
+{
+	if (0 == n_threads) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = n_cpus > 0 ? (unsigned int) n_cpus : 1;
+	}
+	if (n_threads > n_configs) {
+		n_threads = (unsigned int) n_configs;
+	}
+
+	cw_rec_tester_stress_t stress = {
+		.params = params,
+		.results = results,
+		.n_configs = n_configs,
+		.next_config = 0,
+		.retval = 0,
+	};
+
+	pthread_t * threads = (pthread_t *) calloc(n_threads, sizeof (pthread_t));
+	if (NULL == threads && n_threads > 0) {
+		fprintf(stderr, "[EE] Failed to allocate threads of stress test\n");
+		return -1;
+	}
+
+	unsigned int n_started = 0;
+	for (; n_started < n_threads; n_started++) {
+		if (0 != pthread_create(&threads[n_started], NULL, cw_rec_tester_stress_thread_fn, &stress)) {
+			fprintf(stderr, "[EE] Failed to start thread %u of stress test\n", n_started);
+			break;
+		}
+	}
+	if (0 == n_started && n_configs > 0) {
+		/* Test at least in this thread. */
+		cw_rec_tester_stress_thread_fn(&stress);
+	}
+	for (unsigned int i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	return stress.retval;
+}
+
+
+
+
+void cw_rec_tester_stress_print_results(FILE * file, const cw_rec_tester_stress_result_t * results, size_t n_configs)
+{
+	fprintf(file, "speed  tol  jitter  spikes     sent  decoded  errors  error rate       chars/s\n");
+	for (size_t i = 0; i < n_configs; i++) {
+		const cw_rec_tester_stress_result_t * result = &results[i];
+		if (!result->success) {
+			fprintf(file, "%5d  %3d  %5d%%  %4d%%o  (failed)\n",
+				result->params.speed, result->params.tolerance,
+				result->params.jitter_percent, result->params.spikes_per_mille);
+			continue;
+		}
+		fprintf(file, "%5d  %3d  %5d%%  %4d%%o  %7zu  %7zu  %6zu  %9.3f%%  %12.0f\n",
+			result->params.speed, result->params.tolerance,
+			result->params.jitter_percent, result->params.spikes_per_mille,
+			result->n_sent, result->n_decoded, result->n_errors,
+			(double) result->error_rate_percent, result->characters_per_second);
+	}
+}
+
+
+
+
+/**
+   @brief Thread function of stress test
+
+   Take configurations from shared pool until all configurations have
+   been tested.
+
+   @param[in/out] arg Configurations of stress test (cw_rec_tester_stress_t)
+
+   @return NULL
+*/
+static void * cw_rec_tester_stress_thread_fn(void * arg)
+{
+	cw_rec_tester_stress_t * stress = (cw_rec_tester_stress_t *) arg;
+
+	/* One helper generator is used for all configurations tested by
+	   this thread: stopping a generator takes a second of real time. */
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .null_virtual_clock = true };
+	cw_rec_tester_stress_keying_t keying = { 0 };
+	keying.gen = cw_gen_new(&gen_conf);
+	if (NULL == keying.gen) {
+		fprintf(stderr, "[EE] Failed to create helper generator\n");
+		__atomic_store_n(&stress->retval, -1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	if (CW_SUCCESS != cw_gen_set_queue_capacity(keying.gen, STRESS_QUEUE_CAPACITY, STRESS_QUEUE_CAPACITY)) {
+		fprintf(stderr, "[EE] Failed to set capacity of queue of helper generator\n");
+		cw_gen_delete(&keying.gen);
+		__atomic_store_n(&stress->retval, -1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	pthread_mutex_init(&keying.mutex, NULL);
+	cw_gen_register_value_tracking_callback_internal(keying.gen, cw_rec_tester_stress_value_tracking_fn, &keying);
+	cw_gen_start(keying.gen);
+
+	while (true) {
+		const size_t i = __atomic_fetch_add(&stress->next_config, 1, __ATOMIC_RELAXED);
+		if (i >= stress->n_configs) {
+			break;
+		}
+		if (0 != cw_rec_tester_stress_run_config(&keying, &stress->params[i], &stress->results[i])) {
+			__atomic_store_n(&stress->retval, -1, __ATOMIC_RELAXED);
+		}
+	}
+
+	cw_gen_stop(keying.gen);
+	cw_gen_delete(&keying.gen);
+	pthread_mutex_destroy(&keying.mutex);
+	free(keying.edges);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Test receiver in one configuration of stress test
+
+   Play the long test text with helper generator, record its keying,
+   distort the keying and pass it to receiver. Compare received text
+   with played text.
+
+   @param[in/out] keying Started helper generator and its recorded keying
+   @param[in] params Configuration of stress test
+   @param[out] result Result of the test
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_rec_tester_stress_run_config(cw_rec_tester_stress_keying_t * keying, const cw_rec_tester_stress_params_t * params, cw_rec_tester_stress_result_t * result)
+{
+	memset(result, 0, sizeof (cw_rec_tester_stress_result_t));
+	result->params = *params;
+
+	char input[REC_TEST_INPUT_BUFFER_SIZE] = BASIC_SET_LONG BASIC_SET_LONG;
+
+	struct timeval start = { 0 };
+	gettimeofday(&start, NULL);
+
+	/* Play the text in virtual time and record the keying. */
+	cw_gen_set_speed(keying->gen, params->speed);
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(keying->gen, &durations);
+
+	pthread_mutex_lock(&keying->mutex);
+	keying->n_edges = 0;
+	keying->started = false;
+	keying->failed = false;
+	pthread_mutex_unlock(&keying->mutex);
+
+	if (CW_SUCCESS != cw_gen_enqueue_string(keying->gen, input)) {
+		fprintf(stderr, "[EE] Failed to enqueue text in helper generator\n");
+		return -1;
+	}
+	cw_gen_wait_for_queue_level(keying->gen, 0);
+	cw_gen_wait_for_end_of_current_tone(keying->gen);
+
+	pthread_mutex_lock(&keying->mutex);
+	const bool recorded = !keying->failed && 0 != keying->n_edges;
+	pthread_mutex_unlock(&keying->mutex);
+	if (!recorded) {
+		fprintf(stderr, "[EE] Failed to record keying of helper generator\n");
+		return -1;
+	}
+
+	cw_rec_edge_t * edges = NULL;
+	size_t n_edges = 0;
+	pthread_mutex_lock(&keying->mutex);
+	const int distort_retv = cw_rec_tester_stress_distort_keying(params, durations.dot_duration, keying->edges, keying->n_edges, &edges, &n_edges, &result->n_spikes);
+	pthread_mutex_unlock(&keying->mutex);
+	if (0 != distort_retv) {
+		return -1;
+	}
+	for (size_t i = 0; i < n_edges; i++) {
+		result->keying_duration += edges[i].timespan / CW_USECS_PER_SEC;
+	}
+
+	/* Receive the keying. Each Space can end at most one character
+	   and one word. */
+	cw_rec_t * rec = cw_rec_new();
+	const size_t capacity = 2 * n_edges;
+	cw_rec_decoded_t * decoded = (cw_rec_decoded_t *) calloc(capacity, sizeof (cw_rec_decoded_t));
+	char * received = (char *) calloc(capacity + 1, sizeof (char));
+	if (NULL == rec || NULL == decoded || NULL == received) {
+		fprintf(stderr, "[EE] Failed to create receiver\n");
+		cw_rec_delete(&rec);
+		free(received);
+		free(decoded);
+		free(edges);
+		return -1;
+	}
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_set_speed(rec, params->speed);
+	cw_rec_set_tolerance(rec, params->tolerance);
+
+	size_t n_decoded = 0;
+	const cw_ret_t cwret = cw_rec_receive_edges(rec, 0, edges, n_edges, decoded, capacity, &n_decoded);
+	cw_rec_delete(&rec);
+	free(edges);
+	if (CW_SUCCESS != cwret) {
+		fprintf(stderr, "[EE] Receiver failed to receive keying\n");
+		free(received);
+		free(decoded);
+		return -1;
+	}
+
+	for (size_t i = 0; i < n_decoded; i++) {
+		received[i] = (char) tolower((int) decoded[i].character);
+	}
+	free(decoded);
+	string_trim_end(received);
+
+	struct timeval end = { 0 };
+	gettimeofday(&end, NULL);
+
+	string_trim_end(input);
+	result->n_sent = strlen(input);
+	result->n_decoded = n_decoded;
+	result->n_errors = cw_score_edit_distance(input, received);
+	free(received);
+
+	result->duration = cw_timestamp_compare_internal(&start, &end) / (double) CW_USECS_PER_SEC;
+	if (result->duration > 0.0) {
+		result->characters_per_second = (double) result->n_decoded / result->duration;
+	}
+	result->error_rate_percent = 100.0F * (float) result->n_errors / (float) result->n_sent;
+	result->success = true;
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Record keying of helper generator of stress test
+
+   Called by helper generator on each change of its state. Duration of
+   Mark or Space that has just ended is measured with virtual clock of
+   the generator.
+
+   @param[in/out] arg Recorded keying (cw_rec_tester_stress_keying_t)
+   @param[in] key_state Current state of helper generator: mark or space
+*/
+static void cw_rec_tester_stress_value_tracking_fn(void * arg, int key_state)
+{
+	cw_rec_tester_stress_keying_t * keying = (cw_rec_tester_stress_keying_t *) arg;
+
+	struct timeval now = { 0 };
+	cw_gen_get_timestamp(keying->gen, &now);
+
+	pthread_mutex_lock(&keying->mutex);
+
+	if (!keying->started) {
+		/* Silence before first Mark is not part of keying. */
+		if (CW_KEY_VALUE_CLOSED == key_state) {
+			keying->started = true;
+			keying->prev_timestamp = now;
+			keying->prev_key_state = key_state;
+		}
+		pthread_mutex_unlock(&keying->mutex);
+		return;
+	}
+
+	if (keying->n_edges == keying->capacity && !keying->failed) {
+		const size_t new_capacity = 0 == keying->capacity ? 1024 : 2 * keying->capacity;
+		cw_rec_edge_t * new_edges = (cw_rec_edge_t *) realloc(keying->edges, new_capacity * sizeof (cw_rec_edge_t));
+		if (NULL == new_edges) {
+			keying->failed = true;
+		} else {
+			keying->edges = new_edges;
+			keying->capacity = new_capacity;
+		}
+	}
+
+	if (!keying->failed) {
+		cw_rec_edge_t * edge = &keying->edges[keying->n_edges++];
+		edge->timespan = cw_timestamp_compare_internal(&keying->prev_timestamp, &now);
+		edge->is_mark = CW_KEY_VALUE_CLOSED == keying->prev_key_state;
+	}
+
+	keying->prev_timestamp = now;
+	keying->prev_key_state = key_state;
+
+	pthread_mutex_unlock(&keying->mutex);
+}
+
+
+
+
+/**
+   @brief Distort recorded keying with jitter and noise spikes
+
+   Duration of each Mark and Space is changed by random value from range
+   +/- params::jitter_percent of Dot duration. Some Spaces are split into
+   two halves by a noise spike. Keying is ended with a long Space, so
+   that receiver can recognize last character and last word.
+
+   @param[in] params Configuration of stress test
+   @param[in] dot_duration Duration of Dot of helper generator [microseconds]
+   @param[in] edges Recorded keying
+   @param[in] n_edges Count of items in @p edges
+   @param[out] distorted Distorted keying, to be deallocated by caller with free()
+   @param[out] n_distorted Count of items in @p distorted
+   @param[out] n_spikes Count of noise spikes added to keying
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_rec_tester_stress_distort_keying(const cw_rec_tester_stress_params_t * params, int dot_duration, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_edge_t ** distorted, size_t * n_distorted, size_t * n_spikes)
+{
+	/* Each Space may become Space + spike + Space, plus final Space. */
+	cw_rec_edge_t * out = (cw_rec_edge_t *) calloc(3 * n_edges + 1, sizeof (cw_rec_edge_t));
+	if (NULL == out) {
+		fprintf(stderr, "[EE] Failed to allocate distorted keying\n");
+		return -1;
+	}
+
+	cw_random_t rng;
+	cw_random_init(&rng, params->seed);
+
+	const double max_jitter = dot_duration * params->jitter_percent / 100.0;
+	size_t n_out = 0;
+	*n_spikes = 0;
+
+	for (size_t i = 0; i < n_edges; i++) {
+		/* Uniform value from range [-1.0, 1.0]. */
+		const double r = (double) cw_random_get_bounded(&rng, 2001) / 1000.0 - 1.0;
+		double timespan = edges[i].timespan + r * max_jitter;
+		if (timespan < 1.0) {
+			timespan = 1.0;
+		}
+
+		const bool add_spike = !edges[i].is_mark
+			&& cw_random_get_bounded(&rng, 1000) < (uint32_t) params->spikes_per_mille
+			&& timespan > 3 * STRESS_SPIKE_DURATION;
+		if (add_spike) {
+			const double half = (timespan - STRESS_SPIKE_DURATION) / 2;
+			out[n_out++] = (cw_rec_edge_t) { .timespan = half, .is_mark = false };
+			out[n_out++] = (cw_rec_edge_t) { .timespan = STRESS_SPIKE_DURATION, .is_mark = true };
+			out[n_out++] = (cw_rec_edge_t) { .timespan = half, .is_mark = false };
+			(*n_spikes)++;
+		} else {
+			out[n_out++] = (cw_rec_edge_t) { .timespan = timespan, .is_mark = edges[i].is_mark };
+		}
+	}
+
+	/* Last Space recorded from generator may be cut short. Space of
+	   few inter-word-spaces is enough to recognize last word. */
+	out[n_out++] = (cw_rec_edge_t) { .timespan = 20.0 * dot_duration, .is_mark = false };
+
+	*distorted = out;
+	*n_distorted = n_out;
+	return 0;
+}
@@ -5,11 +5,13 @@
 
 
 #include <stdint.h>
+#include <stdio.h>
 #include "../libcw/libcw_key.h"
 #include <test_framework/basic_utils/param_ranger.h>
 #include <test_framework/basic_utils/test_result.h>
 
 #include "cw_easy_legacy_receiver.h"
+#include "lib/random.h"
 
 
 
@@ -232,6 +234,100 @@ void cw_rec_tester_init_text_buffers(cw_rec_tester_t * tester, bool make_short);
 
 
 
+/**
+   Parameters of one configuration of stress test of receiver.
+
+   Helper generator plays the text with @p speed, and a receiver
+   working with the same fixed speed and with @p tolerance receives it.
+   Before the keying is passed to receiver, durations of all Marks and
+   Spaces are randomly distorted by up to +/- @p jitter_percent of Dot
+   duration, and some Spaces are interrupted by noise spikes: Marks
+   shorter than receiver's noise spike threshold.
+*/
+typedef struct cw_rec_tester_stress_params_t {
+	int speed;                  /* [wpm] */
+	int tolerance;              /* [percents] */
+	int jitter_percent;         /* [percents of Dot duration] */
+	int spikes_per_mille;       /* Count of noise spikes per thousand Spaces. */
+	uint64_t seed;              /* Seed of generator of jitter and spikes. */
+} cw_rec_tester_stress_params_t;
+
+
+
+
+/**
+   Results of stress test of receiver in one configuration.
+*/
+typedef struct cw_rec_tester_stress_result_t {
+	cw_rec_tester_stress_params_t params;
+
+	size_t n_sent;               /* Count of characters (including spaces) played by helper generator. */
+	size_t n_decoded;            /* Count of characters (including spaces) decoded by receiver. */
+	size_t n_errors;             /* Edit distance between sent and decoded text. */
+	size_t n_spikes;             /* Count of noise spikes added to keying. */
+
+	double keying_duration;      /* Duration of keying in virtual time [seconds]. */
+	double duration;             /* Duration of test in real time [seconds]. */
+	double characters_per_second; /* Decoded characters per second of real time. */
+	float error_rate_percent;    /* n_errors / n_sent [percents]. */
+
+	bool success;                /* Whether the test was carried out without interruptions. */
+} cw_rec_tester_stress_result_t;
+
+
+
+
+/**
+   @brief Draw random parameters of stress test
+
+   Speed is drawn from full range of allowed speeds, tolerance from
+   range in which receiver is usable, jitter from 0 to 50 percent of
+   Dot and count of noise spikes from 0 to 50 per thousand Spaces.
+
+   @param[in/out] rng Generator of random numbers
+   @param[out] params Parameters of stress test
+*/
+void cw_rec_tester_stress_randomize_params(cw_random_t * rng, cw_rec_tester_stress_params_t * params);
+
+
+
+
+/**
+   @brief Run stress test of receiver in many configurations in parallel
+
+   Each configuration is tested with its own helper generator and
+   receiver. The helper generator uses Null sound system with virtual
+   clock, so the text is played and received at CPU speed instead of
+   in real time. Configurations are distributed among @p n_threads
+   threads (zero: one thread per online CPU).
+
+   Results depend only on @p params, not on count of threads.
+
+   @param[in] params Array of configurations to test
+   @param[out] results Array of results, one for each configuration
+   @param[in] n_configs Count of items in @p params and @p results
+   @param[in] n_threads Count of threads running the tests
+
+   @return 0 if all configurations have been tested
+   @return -1 otherwise
+*/
+int cw_rec_tester_stress_run(const cw_rec_tester_stress_params_t * params, cw_rec_tester_stress_result_t * results, size_t n_configs, unsigned int n_threads);
+
+
+
+
+/**
+   @brief Print results of stress test as a table
+
+   @param[out] file File to print to
+   @param[in] results Results of stress test
+   @param[in] n_configs Count of items in @p results
+*/
+void cw_rec_tester_stress_print_results(FILE * file, const cw_rec_tester_stress_result_t * results, size_t n_configs);
+
+
+
+
 #if defined(__cplusplus)
 }
 #endif
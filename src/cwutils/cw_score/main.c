@@ -0,0 +1,355 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cwutils/lib/scoring.h>
+
+
+
+
+/**
+   \file main.c
+
+   @brief Score recordings of keying against expected text
+
+   Headless program that decodes recordings of keying and tells how
+   accurately, and with what timing, the expected text has been keyed.
+   Recordings are scored in parallel.
+
+   A recording is either a wav file, or a text file with recorded key
+   edges: each line has a timestamp [microseconds] and a new state of key
+   (1 for key down, 0 for key up).
+
+   Usage:
+
+       ./cw_score [-w speed] [-c channel] [-j threads] [-v] -e expected.txt recording ...
+       ./cw_score [-w speed] [-c channel] [-j threads] [-v] -l corpus.txt
+
+   With -e all recordings are compared with the same expected text. With
+   -l each line of corpus file has a path to a recording and a path to
+   file with its expected text, separated by white space. Empty lines and
+   lines starting with '#' are ignored.
+
+   Receiver works with fixed speed given with -w, or in adaptive mode if
+   -w is not given. Elements of wav files are detected in channel given
+   with -c (default: 0). Recordings are scored by threads (-j, default:
+   one per online CPU). With -v the decoded text of each recording is
+   printed to stderr.
+
+   Table with results is printed to stdout. The program exits with failure
+   if any of recordings couldn't be scored.
+*/
+
+
+
+
+/* A corpus: recordings with their expected texts. */
+typedef struct corpus_t {
+	cw_score_job_t * jobs;
+	size_t n_jobs;
+	size_t capacity;
+	char ** strings;     /* Memory owned by corpus: paths and texts used by jobs. */
+	size_t n_strings;
+	size_t strings_capacity;
+} corpus_t;
+
+
+
+
+static char * read_text_file(const char * path);
+static char * corpus_keep_string(corpus_t * corpus, char * string);
+static int corpus_add_job(corpus_t * corpus, const char * recording_path, const char * expected_text);
+static int corpus_read_list(corpus_t * corpus, const char * list_path);
+static void corpus_free(corpus_t * corpus);
+
+
+
+
+int main(int argc, char * argv[])
+{
+	cw_score_config_t config = { 0 };
+	unsigned int n_threads = 0;
+	const char * expected_path = NULL;
+	const char * list_path = NULL;
+	bool verbose = false;
+
+	int opt = 0;
+	while (-1 != (opt = getopt(argc, argv, "c:e:j:l:vw:"))) {
+		switch (opt) {
+		case 'c':
+			config.channel = (unsigned int) atoi(optarg);
+			break;
+		case 'e':
+			expected_path = optarg;
+			break;
+		case 'j':
+			n_threads = (unsigned int) atoi(optarg);
+			break;
+		case 'l':
+			list_path = optarg;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'w':
+			config.speed = atoi(optarg);
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if ((NULL == expected_path) == (NULL == list_path)
+	    || (NULL != expected_path && optind == argc)
+	    || (NULL != list_path && optind != argc)) {
+		fprintf(stderr, "[ERROR] Missing or conflicting arguments\n");
+		fprintf(stderr, "[INFO ] Run this program like this: '%s [-w speed] [-c channel] [-j threads] [-v] -e expected.txt recording ...'\n", argv[0]);
+		fprintf(stderr, "[INFO ] or like this: '%s [-w speed] [-c channel] [-j threads] [-v] -l corpus.txt'\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	corpus_t corpus = { 0 };
+	int retval = 0;
+	if (NULL != list_path) {
+		retval = corpus_read_list(&corpus, list_path);
+	} else {
+		char * expected_text = corpus_keep_string(&corpus, read_text_file(expected_path));
+		for (int i = optind; 0 == retval && i < argc; i++) {
+			retval = NULL == expected_text ? -1 : corpus_add_job(&corpus, argv[i], expected_text);
+		}
+	}
+	if (0 != retval) {
+		corpus_free(&corpus);
+		exit(EXIT_FAILURE);
+	}
+
+	cw_score_result_t * results = (cw_score_result_t *) calloc(corpus.n_jobs, sizeof (cw_score_result_t));
+	if (NULL == results) {
+		fprintf(stderr, "[ERROR] Failed to allocate results\n");
+		corpus_free(&corpus);
+		exit(EXIT_FAILURE);
+	}
+
+	retval = cw_score_run(corpus.jobs, results, corpus.n_jobs, &config, n_threads);
+
+	if (verbose) {
+		for (size_t i = 0; i < corpus.n_jobs; i++) {
+			if (results[i].success) {
+				fprintf(stderr, "[INFO ] '%s': \"%s\"\n", corpus.jobs[i].recording_path, results[i].decoded_text);
+			}
+		}
+	}
+	cw_score_print_results(stdout, corpus.jobs, results, corpus.n_jobs);
+
+	for (size_t i = 0; i < corpus.n_jobs; i++) {
+		cw_score_result_free(&results[i]);
+	}
+	free(results);
+	corpus_free(&corpus);
+
+	exit(0 == retval ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+
+
+
+/**
+   @brief Read whole text file into memory
+
+   @param[in] path Path to file
+
+   @return contents of file, to be freed with free()
+   @return NULL on failure
+*/
+static char * read_text_file(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		fprintf(stderr, "[ERROR] Can't open text file '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	char * text = NULL;
+	size_t size = 0;
+	size_t len = 0;
+	char buffer[4096];
+	size_t n = 0;
+	while (0 != (n = fread(buffer, 1, sizeof (buffer), file))) {
+		if (len + n + 1 > size) {
+			size = 2 * (len + n + 1);
+			char * new_text = (char *) realloc(text, size);
+			if (NULL == new_text) {
+				fprintf(stderr, "[ERROR] Failed to allocate memory for text file '%s'\n", path);
+				free(text);
+				fclose(file);
+				return NULL;
+			}
+			text = new_text;
+		}
+		memcpy(text + len, buffer, n);
+		len += n;
+	}
+	fclose(file);
+
+	if (NULL == text) {
+		/* Empty file. */
+		return strdup("");
+	}
+	text[len] = '\0';
+	return text;
+}
+
+
+
+
+/**
+   @brief Make the corpus responsible for freeing a string
+
+   @param[in/out] corpus Corpus
+   @param[in] string String allocated with malloc(), may be NULL
+
+   @return @p string, or NULL on failure (the string is freed then)
+*/
+static char * corpus_keep_string(corpus_t * corpus, char * string)
+{
+	if (NULL == string) {
+		return NULL;
+	}
+	if (corpus->n_strings == corpus->strings_capacity) {
+		const size_t capacity = 0 == corpus->strings_capacity ? 64 : 2 * corpus->strings_capacity;
+		char ** strings = (char **) realloc(corpus->strings, capacity * sizeof (char *));
+		if (NULL == strings) {
+			fprintf(stderr, "[ERROR] Failed to allocate memory for corpus\n");
+			free(string);
+			return NULL;
+		}
+		corpus->strings = strings;
+		corpus->strings_capacity = capacity;
+	}
+	corpus->strings[corpus->n_strings++] = string;
+	return string;
+}
+
+
+
+
+/**
+   @brief Add recording to corpus
+
+   @param[in/out] corpus Corpus
+   @param[in] recording_path Path to recording, must be valid as long as corpus
+   @param[in] expected_text Expected text, must be valid as long as corpus
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int corpus_add_job(corpus_t * corpus, const char * recording_path, const char * expected_text)
+{
+	if (corpus->n_jobs == corpus->capacity) {
+		const size_t capacity = 0 == corpus->capacity ? 64 : 2 * corpus->capacity;
+		cw_score_job_t * jobs = (cw_score_job_t *) realloc(corpus->jobs, capacity * sizeof (cw_score_job_t));
+		if (NULL == jobs) {
+			fprintf(stderr, "[ERROR] Failed to allocate memory for corpus\n");
+			return -1;
+		}
+		corpus->jobs = jobs;
+		corpus->capacity = capacity;
+	}
+	corpus->jobs[corpus->n_jobs].recording_path = recording_path;
+	corpus->jobs[corpus->n_jobs].expected_text = expected_text;
+	corpus->n_jobs++;
+	return 0;
+}
+
+
+
+
+/**
+   @brief Read list of recordings and their expected texts into corpus
+
+   @param[in/out] corpus Corpus
+   @param[in] list_path Path to file with list of recordings
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int corpus_read_list(corpus_t * corpus, const char * list_path)
+{
+	FILE * file = fopen(list_path, "r");
+	if (NULL == file) {
+		fprintf(stderr, "[ERROR] Can't open corpus file '%s': %s\n", list_path, strerror(errno));
+		return -1;
+	}
+
+	char * line = NULL;
+	size_t line_size = 0;
+	size_t line_number = 0;
+	int retval = 0;
+	while (0 == retval && -1 != getline(&line, &line_size, file)) {
+		line_number++;
+
+		char * recording = strtok(line, " \t\r\n");
+		if (NULL == recording || '#' == recording[0]) {
+			continue;
+		}
+		char * expected = strtok(NULL, " \t\r\n");
+		if (NULL == expected) {
+			fprintf(stderr, "[ERROR] Missing path to expected text in line %zu of '%s'\n", line_number, list_path);
+			retval = -1;
+			break;
+		}
+
+		const char * recording_path = corpus_keep_string(corpus, strdup(recording));
+		const char * expected_text = corpus_keep_string(corpus, read_text_file(expected));
+		if (NULL == recording_path || NULL == expected_text) {
+			retval = -1;
+			break;
+		}
+		retval = corpus_add_job(corpus, recording_path, expected_text);
+	}
+	free(line);
+	fclose(file);
+
+	return retval;
+}
+
+
+
+
+/**
+   @brief Free memory owned by corpus
+
+   @param[in/out] corpus Corpus
+*/
+static void corpus_free(corpus_t * corpus)
+{
+	for (size_t i = 0; i < corpus->n_strings; i++) {
+		free(corpus->strings[i]);
+	}
+	free(corpus->strings);
+	free(corpus->jobs);
+	memset(corpus, 0, sizeof (corpus_t));
+}
@@ -22,8 +22,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
-#include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -80,9 +85,27 @@
    Comments in file are allowed (and skipped): lines starting with ';'
    or '#' characters are considered to be comments.
 
+   A word may be followed by '*' and a weight: a positive integer telling
+   how often the word should be selected, relative to other words in the
+   same dictionary. Words without weight have weight of 1. E.g. in a
+   dictionary with words "THE*20 CAT DOG*4", word "THE" is selected twenty
+   times more often than "CAT". For dictionaries with weights an alias
+   table (Vose's alias method) is built when the dictionary is loaded, so
+   selecting a random word takes constant time regardless of count of
+   words.
+
    Usually an application uses several dictionaries, and a file can also
    store few dictionaries.
 
+   Large lists of words can be stored in a compiled file instead (written
+   by cw_dictionaries_write() to a file with ".cwd" extension). The file
+   contains a table of dictionaries, a table of offsets of words, and a
+   pool of NUL-terminated strings. cw_dictionaries_read() recognizes the
+   compiled file by its magic bytes and maps it into memory: words are
+   accessed directly in the mapping, without parsing and without
+   allocating memory for each word, and pages of the mapping are shared by
+   all processes that read the same file.
+
    The module has its own, internal, default list of cw dictionaries.
    If application doesn't read any dictionaries from text file, the
    module loads its own dictionaries to memory on first call to
@@ -95,12 +118,30 @@
    \li iterating over list of dictionaries in memory,
    \li getting description of a specified dictionary,
    \li getting 'group size' information about given dictionary,
-   \li getting a random word from given dictionary.
+   \li getting a random word from given dictionary,
+   \li looking up words that start with given text, or that may have
+   been received as given text (see "Index of words" below).
 */
 
 
 
 
+/* Weight of a word, and item of alias table for sampling of weighted
+   words. The same layout is used in memory and in compiled dictionary
+   file. */
+typedef struct {
+	uint32_t weight;              /* Weight of the word, as given in dictionary file */
+	uint32_t threshold;           /* Word (not its alias) is selected if 32-bit random value is below threshold */
+	uint32_t alias;               /* Index of word selected if random value is at or above threshold */
+} cw_dictionary_weight_t;
+
+typedef struct cw_dictionary_index_s cw_dictionary_index_t;
+typedef struct cw_dictionary_trie_node_s cw_dictionary_trie_node_t;
+typedef struct cw_dictionary_index_results_s cw_dictionary_index_results_t;
+
+
+
+
 static void cw_dictionary_trim(char *buffer);
 static bool cw_dictionary_parse_is_comment(const char *line);
 static bool cw_dictionary_parse_is_section(const char *line, char **name_ptr);
@@ -110,6 +151,23 @@ static cw_dictionary_t *cw_dictionaries_create_default(void);
 
 static char *cw_dictionary_check_line(const char *line);
 
+static const char *cw_dictionary_get_word(const cw_dictionary_t *dict, int index);
+static uint32_t cw_dictionary_get_weight(const cw_dictionary_t *dict, int index);
+static void cw_dictionary_build_alias_table(cw_dictionary_weight_t *weights, int n_words);
+static cw_dictionary_t *cw_dictionaries_create_from_compiled(const char *file, void **map, size_t *map_size);
+static bool cw_dictionaries_write_compiled(FILE *stream, const char *file);
+static bool cw_dictionary_file_is_compiled(FILE *stream);
+
+static int cw_dictionary_index_key_compare(const void *a, const void *b);
+static cw_dictionary_index_t *cw_dictionary_build_index(const cw_dictionary_t *dict);
+static const cw_dictionary_index_t *cw_dictionary_get_index(const cw_dictionary_t *dict);
+static void cw_dictionary_delete_index(cw_dictionary_index_t *index);
+static const cw_dictionary_trie_node_t *cw_dictionary_index_find_child(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, char c);
+static const cw_dictionary_trie_node_t *cw_dictionary_index_find(const cw_dictionary_index_t *index, const char *text);
+static bool cw_dictionary_index_results_add(cw_dictionary_index_results_t *results, int32_t word);
+static bool cw_dictionary_index_collect(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, cw_dictionary_index_results_t *results);
+static bool cw_dictionary_index_match(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, const char *text, int n_edits, cw_dictionary_index_results_t *results);
+
 
 
 /*---------------------------------------------------------------------*/
@@ -121,13 +179,22 @@ enum { MAX_LINE = 8192 };
 /* Aggregate dictionary data into a structure. */
 struct cw_dictionary_s {
 	const char *description;      /* Dictionary description */
-	const char *const *wordlist;  /* Dictionary word list */
+	const char *const *wordlist;  /* Dictionary word list; NULL for dictionary from compiled file */
 	int wordlist_length;          /* Length of word list */
 	int group_size;               /* Size of a group */
 
+	const uint32_t *word_offsets; /* Offsets of words in word_pool (dictionary from compiled file) */
+	const char *word_pool;        /* Pool of NUL-terminated strings (dictionary from compiled file) */
+	uint32_t word_pool_size;      /* Size of word_pool [bytes] */
+
+	const cw_dictionary_weight_t *weights; /* Weights of words, with alias table; NULL if all words have the same weight */
+
+	cw_dictionary_index_t *index; /* Index of words; NULL until dictionary is queried for the first time */
+
 	void *mutable_description;    /* Freeable (aliased) description string */
 	void *mutable_wordlist;       /* Freeable (aliased) word list */
 	void *mutable_wordlist_data;  /* Freeable bulk word list data */
+	void *mutable_weights;        /* Freeable (aliased) weights */
 
 	dictionary *next;             /* List pointer */
 };
@@ -135,6 +202,48 @@ struct cw_dictionary_s {
 /* Head of a list storing currently loaded dictionaries. */
 static cw_dictionary_t *dictionaries_head = NULL;
 
+/* Mapping of compiled dictionary file from which current dictionaries
+   have been read; NULL if they haven't been read from compiled file. */
+static void *dictionaries_map = NULL;
+static size_t dictionaries_map_size = 0;
+
+
+
+
+/*
+  Compiled dictionary file, written in native byte order:
+
+  header                   cw_dictionary_file_header_t
+  table of dictionaries    cw_dictionary_file_entry_t[n_dictionaries]
+  table of words           uint32_t[n_words], offsets of words in pool
+  table of weights         cw_dictionary_weight_t[n_weights], weights and alias tables of weighted dictionaries
+  pool of strings          char[pool_size], NUL-terminated descriptions and words
+
+  All items are 4-byte aligned, so the tables can be accessed directly in
+  mapping of the file.
+*/
+#define CW_DICTIONARY_FILE_MAGIC "CWDICT\0"  /* Followed by one byte of version. */
+#define CW_DICTIONARY_FILE_VERSION 2
+#define CW_DICTIONARY_FILE_BYTE_ORDER 0x01020304U
+#define CW_DICTIONARY_FILE_NO_WEIGHTS UINT32_MAX
+
+typedef struct {
+	char magic[8];             /* CW_DICTIONARY_FILE_MAGIC + CW_DICTIONARY_FILE_VERSION */
+	uint32_t byte_order;       /* CW_DICTIONARY_FILE_BYTE_ORDER, written in byte order of writer */
+	uint32_t n_dictionaries;
+	uint32_t n_words;          /* Total count of words in all dictionaries. */
+	uint32_t pool_size;        /* Size of pool of strings [bytes]. */
+	uint32_t n_weights;        /* Total count of words in weighted dictionaries. */
+} cw_dictionary_file_header_t;
+
+typedef struct {
+	uint32_t description;      /* Offset of description in pool of strings. */
+	uint32_t first_word;       /* Index of dictionary's first word in table of words. */
+	uint32_t n_words;
+	uint32_t group_size;
+	uint32_t first_weight;     /* Index of dictionary's first weight in table of weights; CW_DICTIONARY_FILE_NO_WEIGHTS if not weighted. */
+} cw_dictionary_file_entry_t;
+
 
 /*---------------------------------------------------------------------*/
 /*  Dictionary implementation                                          */
@@ -161,7 +270,7 @@ static dictionary *dictionary_new(dictionary *tail,
 	   entries. */
 	int words = 0;
 	bool is_multicharacter = false;
-	for (int word = 0; wordlist[word]; word++) {
+	for (int word = 0; wordlist && wordlist[word]; word++) {
 		is_multicharacter |= strlen(wordlist[word]) > 1;
 		words++;
 	}
@@ -174,12 +283,18 @@ static dictionary *dictionary_new(dictionary *tail,
 	dict->wordlist = wordlist;
 	dict->wordlist_length = words;
 	dict->group_size = is_multicharacter ? 1 : 5;
+	dict->word_offsets = NULL;
+	dict->word_pool = NULL;
+	dict->word_pool_size = 0;
+	dict->weights = NULL;
+	dict->index = NULL;
 	dict->next = NULL;
 
 	/* Add mutable pointers passed in. */
 	dict->mutable_description = mutable_description;
 	dict->mutable_wordlist = mutable_wordlist;
 	dict->mutable_wordlist_data = mutable_wordlist_data;
+	dict->mutable_weights = NULL;
 
 	/* Add to the list tail passed in, if any. */
 	if (tail) {
@@ -217,6 +332,35 @@ static dictionary *dictionary_new_mutable(dictionary *tail,
 
 
 
+/*
+ * dictionary_new_compiled()
+ *
+ * Create a new dictionary with words in mapping of compiled dictionary
+ * file.  Nothing is counted or copied, the group size has been calculated
+ * when the file was written.
+ */
+static dictionary *dictionary_new_compiled(dictionary *tail,
+					   const char *description,
+					   const uint32_t *word_offsets,
+					   int words,
+					   const char *word_pool,
+					   uint32_t word_pool_size,
+					   int group_size)
+{
+	dictionary *dict = dictionary_new_const(tail, description, NULL);
+	dict->wordlist_length = words;
+	dict->group_size = group_size;
+	dict->word_offsets = word_offsets;
+	dict->word_pool = word_pool;
+	dict->word_pool_size = word_pool_size;
+
+	return dict;
+}
+
+
+
+
+
 /**
    \brief Reset dictionaries state
 
@@ -236,6 +380,8 @@ void cw_dictionaries_unload(void)
 		free(entry->mutable_wordlist);
 		free(entry->mutable_description);
 		free(entry->mutable_wordlist_data);
+		free(entry->mutable_weights);
+		cw_dictionary_delete_index(entry->index);
 
 		/* Free the dictionary itself. */
 		free(entry);
@@ -243,6 +389,12 @@ void cw_dictionaries_unload(void)
 
 	dictionaries_head = NULL;
 
+	if (dictionaries_map) {
+		munmap(dictionaries_map, dictionaries_map_size);
+		dictionaries_map = NULL;
+		dictionaries_map_size = 0;
+	}
+
 	return;
 }
 
@@ -329,25 +481,52 @@ bool cw_dictionary_parse_is_section(const char *line, char **name_ptr)
  * dictionary_build_wordlist()
  *
  * Build and return a wordlist from a string of space-separated words.  The
- * wordlist_data is changed by this function.
+ * wordlist_data is changed by this function: weights ("*N" suffixes) are
+ * cut off the words.  If any word has a weight, the weights are returned
+ * through weights_ptr, otherwise *weights_ptr is set to NULL.
  */
 static const char **
-dictionary_build_wordlist (char *wordlist_data)
+dictionary_build_wordlist (char *wordlist_data, cw_dictionary_weight_t **weights_ptr)
 {
   const char **wordlist;
-  const char *word;
+  cw_dictionary_weight_t *weights;
+  char *word;
   int size;
   int allocation;
+  bool is_weighted;
 
   /* Split contents into a wordlist, and store each word retrieved. */
   size = allocation = 0;
   wordlist = NULL;
+  weights = NULL;
+  is_weighted = false;
   for (word = strtok (wordlist_data, " \t"); word; word = strtok (NULL, " \t"))
     {
       if (size == allocation)
         {
           allocation = allocation == 0 ? 1 : allocation << 1;
           wordlist = safe_realloc (wordlist, sizeof (*wordlist) * allocation);
+          weights = safe_realloc (weights, sizeof (*weights) * allocation);
+        }
+
+      weights[size].weight = 1;
+      char *star = strchr (word, '*');
+      if (star && star != word)
+        {
+          char *end;
+          errno = 0;
+          unsigned long weight = strtoul (star + 1, &end, 10);
+          if (errno || end == star + 1 || *end != '\0'
+              || weight == 0 || weight > UINT32_MAX)
+            {
+              fprintf (stderr, "invalid weight of word '%s', using weight 1\n", word);
+            }
+          else
+            {
+              weights[size].weight = (uint32_t) weight;
+              is_weighted = true;
+            }
+          *star = '\0';
         }
 
       wordlist[size++] = word;
@@ -359,7 +538,18 @@ dictionary_build_wordlist (char *wordlist_data)
       allocation++;
       wordlist = safe_realloc (wordlist, sizeof (*wordlist) * allocation);
     }
-  wordlist[size++] = NULL;
+  wordlist[size] = NULL;
+
+  if (is_weighted)
+    {
+      cw_dictionary_build_alias_table (weights, size);
+      *weights_ptr = weights;
+    }
+  else
+    {
+      free (weights);
+      *weights_ptr = NULL;
+    }
 
   return wordlist;
 }
@@ -368,6 +558,79 @@ dictionary_build_wordlist (char *wordlist_data)
 
 
 
+/**
+   \brief Build alias table for sampling of weighted words
+
+   Vose's alias method: every word gets a "column" of the same height
+   (probability of 1/n). A column of word with smaller-than-average weight
+   is filled up with part of column of a word with larger-than-average
+   weight (the alias). Selecting a word requires selecting a column, and
+   comparing a random value with column's threshold.
+
+   \param weights - weights of words, threshold and alias of each item are set by the function
+   \param n_words - count of items in \p weights
+*/
+void cw_dictionary_build_alias_table(cw_dictionary_weight_t *weights, int n_words)
+{
+	double total = 0.0;
+	for (int i = 0; i < n_words; i++) {
+		total += weights[i].weight;
+	}
+
+	/* Scaled probabilities: average of them is 1.0. */
+	double *scaled = safe_malloc(sizeof (double) * (size_t) n_words);
+	int *small = safe_malloc(sizeof (int) * (size_t) n_words);
+	int *large = safe_malloc(sizeof (int) * (size_t) n_words);
+	int n_small = 0;
+	int n_large = 0;
+	for (int i = 0; i < n_words; i++) {
+		scaled[i] = weights[i].weight * (double) n_words / total;
+		if (scaled[i] < 1.0) {
+			small[n_small++] = i;
+		} else {
+			large[n_large++] = i;
+		}
+	}
+
+	while (n_small > 0 && n_large > 0) {
+		const int s = small[--n_small];
+		const int l = large[--n_large];
+
+		weights[s].threshold = (uint32_t) (scaled[s] * 4294967296.0);
+		weights[s].alias = (uint32_t) l;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		if (scaled[l] < 1.0) {
+			small[n_small++] = l;
+		} else {
+			large[n_large++] = l;
+		}
+	}
+
+	/* Remaining columns are full (up to rounding errors): the word is
+	   always selected. */
+	while (n_large > 0) {
+		const int l = large[--n_large];
+		weights[l].threshold = UINT32_MAX;
+		weights[l].alias = (uint32_t) l;
+	}
+	while (n_small > 0) {
+		const int s = small[--n_small];
+		weights[s].threshold = UINT32_MAX;
+		weights[s].alias = (uint32_t) s;
+	}
+
+	free(large);
+	free(small);
+	free(scaled);
+
+	return;
+}
+
+
+
+
+
 /**
    \brief Trim a line
 
@@ -406,6 +669,9 @@ void cw_dictionary_trim(char *buffer)
    '^' characters in error positions and with spaces in all other positions.
    Return NULL if all characters in \p line are valid (sendable).
 
+   Weights of words ('*' followed by digits at the end of a word) are not
+   sent, so they are not treated as invalid characters.
+
    Returned pointer is managed by caller.
 
    \param line - line to check
@@ -420,6 +686,16 @@ char *cw_dictionary_check_line(const char *line)
 	int count = 0;
 	int i = 0;
 	for (i = 0; line[i] != '\0'; i++) {
+		if (line[i] == '*' && i > 0 && !isspace(line[i - 1])) {
+			const size_t n_digits = strspn(line + i + 1, "0123456789");
+			const char after = line[i + 1 + n_digits];
+			if (n_digits > 0 && (after == '\0' || isspace(after))) {
+				/* Skip the weight. */
+				memset(errors + i, ' ', n_digits + 1);
+				i += n_digits;
+				continue;
+			}
+		}
 		errors[i] = cw_character_is_valid(line[i]) ? ' ' : '^';
 		if (errors[i] == '^') {
 			count++;
@@ -463,6 +739,7 @@ char *cw_dictionary_check_line(const char *line)
 cw_dictionary_t *cw_dictionaries_create_from_stream(FILE *stream, const char *file)
 {
 	const char **wordlist;
+	cw_dictionary_weight_t *weights;
 
 	/* Clear the variables used to accumulate stream data. */
 	char *line = safe_malloc(MAX_LINE);
@@ -484,8 +761,9 @@ cw_dictionary_t *cw_dictionaries_create_from_stream(FILE *stream, const char *fi
 			/* New section, so handle data accumulated so far.
 			   Or if no data accumulated, forget it. */
 			if (content) {
-				wordlist = dictionary_build_wordlist(content);
+				wordlist = dictionary_build_wordlist(content, &weights);
 				tail = dictionary_new_mutable(tail, name, wordlist, content);
+				tail->weights = tail->mutable_weights = weights;
 				head = head ? head : tail;
 			} else {
 				free(name);
@@ -526,8 +804,9 @@ cw_dictionary_t *cw_dictionaries_create_from_stream(FILE *stream, const char *fi
 
 	/* Handle any final accumulated data. */
 	if (content) {
-		wordlist = dictionary_build_wordlist(content);
+		wordlist = dictionary_build_wordlist(content, &weights);
 		tail = dictionary_new_mutable(tail, name, wordlist, content);
+		tail->weights = tail->mutable_weights = weights;
 		head = head ? head : tail;
 	}
 
@@ -612,7 +891,9 @@ cw_dictionary_t *cw_dictionaries_create_default(void)
 /**
    \brief Read dictionaries from given file
 
-   Set the main dictionary list to data read from a file.
+   Set the main dictionary list to data read from a file. The file may
+   be either a text file, or a compiled dictionary file (see
+   cw_dictionaries_write()).
 
    \param file - open file to read from
 
@@ -631,10 +912,19 @@ bool cw_dictionaries_read(const char *file)
 	/* If we can generate a dictionary list, free any currently
 	   allocated one and store the details of what we loaded into
 	   module variables. */
-	cw_dictionary_t *head = cw_dictionaries_create_from_stream(stream, file);
+	void *map = NULL;
+	size_t map_size = 0;
+	cw_dictionary_t *head = NULL;
+	if (cw_dictionary_file_is_compiled(stream)) {
+		head = cw_dictionaries_create_from_compiled(file, &map, &map_size);
+	} else {
+		head = cw_dictionaries_create_from_stream(stream, file);
+	}
 	if (head) {
 		cw_dictionaries_unload();
 		dictionaries_head = head;
+		dictionaries_map = map;
+		dictionaries_map_size = map_size;
 	}
 
 	/* Close stream and return true if we loaded a dictionary. */
@@ -646,6 +936,152 @@ bool cw_dictionaries_read(const char *file)
 
 
 
+/**
+   \brief Check if a stream contains compiled dictionary file
+
+   The check is made by looking at magic bytes at the beginning of the
+   stream. Position in the stream is reset to the beginning.
+
+   \param stream - stream to check
+
+   \return true if the stream contains compiled dictionary file
+   \return false otherwise
+*/
+bool cw_dictionary_file_is_compiled(FILE *stream)
+{
+	char magic[sizeof (CW_DICTIONARY_FILE_MAGIC) - 1];
+	const bool is_compiled = sizeof (magic) == fread(magic, 1, sizeof (magic), stream)
+		&& 0 == memcmp(magic, CW_DICTIONARY_FILE_MAGIC, sizeof (magic));
+	rewind(stream);
+
+	return is_compiled;
+}
+
+
+
+
+
+/**
+   \brief Create a dictionary list from compiled dictionary file
+
+   The file is mapped into memory, and the dictionaries point directly
+   into the mapping. The time needed to load the file doesn't depend on
+   count of words in the file.
+
+   On success the mapping is returned through \p map and \p map_size.
+   The caller must unmap it when the dictionaries are unloaded.
+
+   \param file - path to compiled dictionary file
+   \param map - output, mapping of the file
+   \param map_size - output, size of the mapping
+
+   \return head of list of loaded dictionaries on success
+   \return NULL if loading fails.
+*/
+cw_dictionary_t *cw_dictionaries_create_from_compiled(const char *file, void **map, size_t *map_size)
+{
+	int fd = open(file, O_RDONLY);
+	if (-1 == fd) {
+		fprintf(stderr, "%s: open error: %s\n", file, strerror(errno));
+		return NULL;
+	}
+	struct stat st;
+	if (0 != fstat(fd, &st)) {
+		fprintf(stderr, "%s: stat error: %s\n", file, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	if ((uint64_t) st.st_size < sizeof (cw_dictionary_file_header_t) || (uint64_t) st.st_size > SIZE_MAX) {
+		fprintf(stderr, "%s: invalid size of compiled dictionary file\n", file);
+		close(fd);
+		return NULL;
+	}
+	const size_t size = (size_t) st.st_size;
+
+	/* Read-only shared mapping: pages are shared by all processes
+	   using the same file. */
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == mapping) {
+		fprintf(stderr, "%s: mmap error: %s\n", file, strerror(errno));
+		return NULL;
+	}
+
+	/* Validate layout of the file. Offsets of individual words are
+	   checked when the words are accessed, so that the loading doesn't
+	   have to touch all pages of the file. */
+	const cw_dictionary_file_header_t *header = mapping;
+	const uint64_t tables_size = sizeof (cw_dictionary_file_header_t)
+		+ (uint64_t) header->n_dictionaries * sizeof (cw_dictionary_file_entry_t)
+		+ (uint64_t) header->n_words * sizeof (uint32_t)
+		+ (uint64_t) header->n_weights * sizeof (cw_dictionary_weight_t);
+	if (CW_DICTIONARY_FILE_VERSION != header->magic[sizeof (CW_DICTIONARY_FILE_MAGIC) - 1]) {
+		fprintf(stderr, "%s: unsupported version of compiled dictionary file: %d\n", file, header->magic[sizeof (CW_DICTIONARY_FILE_MAGIC) - 1]);
+		munmap(mapping, size);
+		return NULL;
+	}
+	if (CW_DICTIONARY_FILE_BYTE_ORDER != header->byte_order) {
+		fprintf(stderr, "%s: compiled dictionary file has been written on machine with different byte order\n", file);
+		munmap(mapping, size);
+		return NULL;
+	}
+	if (tables_size + header->pool_size != size
+	    || 0 == header->pool_size
+	    || '\0' != ((const char *) mapping)[size - 1]) {
+
+		fprintf(stderr, "%s: invalid layout of compiled dictionary file\n", file);
+		munmap(mapping, size);
+		return NULL;
+	}
+
+	const cw_dictionary_file_entry_t *entries = (const cw_dictionary_file_entry_t *) (header + 1);
+	const uint32_t *word_offsets = (const uint32_t *) (entries + header->n_dictionaries);
+	const cw_dictionary_weight_t *weights = (const cw_dictionary_weight_t *) (word_offsets + header->n_words);
+	const char *pool = (const char *) mapping + tables_size;
+
+	cw_dictionary_t *head = NULL;
+	cw_dictionary_t *tail = NULL;
+	for (uint32_t i = 0; i < header->n_dictionaries; i++) {
+		const cw_dictionary_file_entry_t *entry = &entries[i];
+		if (entry->description >= header->pool_size
+		    || entry->n_words == 0
+		    || entry->n_words > INT32_MAX
+		    || entry->first_word > header->n_words
+		    || entry->n_words > header->n_words - entry->first_word
+		    || (entry->first_weight != CW_DICTIONARY_FILE_NO_WEIGHTS
+			&& (entry->first_weight > header->n_weights
+			    || entry->n_words > header->n_weights - entry->first_weight))) {
+
+			fprintf(stderr, "%s: invalid dictionary #%u in compiled dictionary file\n", file, i);
+			continue;
+		}
+
+		tail = dictionary_new_compiled(tail, pool + entry->description,
+					       word_offsets + entry->first_word, (int) entry->n_words,
+					       pool, header->pool_size, (int) entry->group_size);
+		if (entry->first_weight != CW_DICTIONARY_FILE_NO_WEIGHTS) {
+			/* Alias table has been built when the file was written. */
+			tail->weights = weights + entry->first_weight;
+		}
+		head = head ? head : tail;
+	}
+
+	if (!head) {
+		fprintf(stderr, "%s: no usable dictionary data found in the file\n", file);
+		munmap(mapping, size);
+		return NULL;
+	}
+
+	*map = mapping;
+	*map_size = size;
+
+	return head;
+}
+
+
+
+
+
 int dictionary_load(const char *file)
 {
 	return cw_dictionaries_read(file);
@@ -704,6 +1140,11 @@ const dictionary *dictionary_iterate(const dictionary *current)
 
    Write the currently loaded (or default) dictionaries out to a given file.
 
+   If name of the \p file has ".cwd" extension, compiled dictionary file
+   is written. Such file can be read by cw_dictionaries_read() much faster
+   than a text file, which is useful for large lists of words. Otherwise
+   a text file is written.
+
    \param file - file to write to
 
    \return true on success
@@ -724,13 +1165,28 @@ bool cw_dictionaries_write(const char *file)
 		dictionaries_head = cw_dictionaries_create_default();
 	}
 
+	const size_t len = strlen(file);
+	if (len > 4 && 0 == strcmp(file + len - 4, ".cwd")) {
+		const bool success = cw_dictionaries_write_compiled(stream, file);
+		if (0 != fclose(stream)) {
+			fprintf(stderr, "%s: write error: %s\n", file, strerror(errno));
+			return false;
+		}
+		return success;
+	}
+
 	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
 		fprintf(stream, "[ %s ]\n\n", dict->description);
 
 		int chars = 0;
 		for (int i = 0; i < dict->wordlist_length; i++) {
-			fprintf(stream, " %s", dict->wordlist[i]);
-			chars += strlen(dict->wordlist[i]) + 1;
+			const char *word = cw_dictionary_get_word(dict, i);
+			const uint32_t weight = cw_dictionary_get_weight(dict, i);
+			if (weight != 1) {
+				chars += fprintf(stream, " %s*%" PRIu32, word, weight);
+			} else {
+				chars += fprintf(stream, " %s", word);
+			}
 			if (chars > 72) {
 				fprintf(stream, "\n");
 				chars = 0;
@@ -747,6 +1203,113 @@ bool cw_dictionaries_write(const char *file)
 
 
 
+/**
+   \brief Write current dictionaries to stream as compiled dictionary file
+
+   Helper function for cw_dictionaries_write(). See comment at
+   cw_dictionary_file_header_t for format of the file.
+
+   \param stream - stream to write to
+   \param file - human-readable name of the stream
+
+   \return true on success
+   \return false if writing fails
+*/
+bool cw_dictionaries_write_compiled(FILE *stream, const char *file)
+{
+	/* First pass: calculate sizes of tables and of pool of strings. */
+	uint64_t n_dictionaries = 0;
+	uint64_t n_words = 0;
+	uint64_t n_weights = 0;
+	uint64_t pool_size = 0;
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		n_dictionaries++;
+		if (dict->weights) {
+			n_weights += (uint64_t) dict->wordlist_length;
+		}
+		pool_size += strlen(dict->description) + 1;
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			pool_size += strlen(cw_dictionary_get_word(dict, i)) + 1;
+		}
+		n_words += (uint64_t) dict->wordlist_length;
+	}
+	if (n_words > UINT32_MAX || n_weights > UINT32_MAX || pool_size > UINT32_MAX) {
+		fprintf(stderr, "%s: dictionaries are too large for compiled dictionary file\n", file);
+		return false;
+	}
+
+	cw_dictionary_file_header_t header;
+	memset(&header, 0, sizeof (header));
+	memcpy(header.magic, CW_DICTIONARY_FILE_MAGIC, sizeof (CW_DICTIONARY_FILE_MAGIC) - 1);
+	header.magic[sizeof (CW_DICTIONARY_FILE_MAGIC) - 1] = CW_DICTIONARY_FILE_VERSION;
+	header.byte_order = CW_DICTIONARY_FILE_BYTE_ORDER;
+	header.n_dictionaries = (uint32_t) n_dictionaries;
+	header.n_words = (uint32_t) n_words;
+	header.n_weights = (uint32_t) n_weights;
+	/* Pool is padded so that the size of file is a multiple of 4. */
+	header.pool_size = (uint32_t) ((pool_size + 3) & ~(uint64_t) 3);
+	fwrite(&header, sizeof (header), 1, stream);
+
+	/* Second pass: tables. Descriptions are put at the beginning of
+	   pool, words follow them. */
+	uint32_t description_offset = 0;
+	uint32_t first_word = 0;
+	uint32_t first_weight = 0;
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		cw_dictionary_file_entry_t entry;
+		entry.description = description_offset;
+		entry.first_word = first_word;
+		entry.n_words = (uint32_t) dict->wordlist_length;
+		entry.group_size = (uint32_t) dict->group_size;
+		entry.first_weight = dict->weights ? first_weight : CW_DICTIONARY_FILE_NO_WEIGHTS;
+		fwrite(&entry, sizeof (entry), 1, stream);
+
+		description_offset += (uint32_t) strlen(dict->description) + 1;
+		first_word += entry.n_words;
+		if (dict->weights) {
+			first_weight += entry.n_words;
+		}
+	}
+
+	uint32_t word_offset = description_offset;
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			fwrite(&word_offset, sizeof (word_offset), 1, stream);
+			word_offset += (uint32_t) strlen(cw_dictionary_get_word(dict, i)) + 1;
+		}
+	}
+
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		if (dict->weights) {
+			fwrite(dict->weights, sizeof (cw_dictionary_weight_t), (size_t) dict->wordlist_length, stream);
+		}
+	}
+
+	/* Third pass: pool of strings. */
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		fwrite(dict->description, strlen(dict->description) + 1, 1, stream);
+	}
+	for (const cw_dictionary_t *dict = dictionaries_head; dict; dict = dict->next) {
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			const char *word = cw_dictionary_get_word(dict, i);
+			fwrite(word, strlen(word) + 1, 1, stream);
+		}
+	}
+	const char padding[4] = { 0 };
+	fwrite(padding, header.pool_size - pool_size, 1, stream);
+
+	if (ferror(stream)) {
+		fprintf(stderr, "%s: write error: %s\n", file, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+
 int dictionary_write(const char *file)
 {
 	return cw_dictionaries_write(file);
@@ -811,92 +1374,703 @@ int get_dictionary_group_size(const dictionary *dict)
 /**
    \brief Get a random word from given dictionary
 
+   Each thread uses its own random number generator, seeded on first
+   call in the thread.
+
    \param dict - dictionary to query
 
    \return a string
 */
 const char *cw_dictionary_get_random_word(const cw_dictionary_t *dict)
 {
-	static bool is_initialized = false;
+	static __thread cw_random_t rng;
+	static __thread bool is_initialized = false;
 
 	/* On the first call, seed the random number generator. */
 	if (!is_initialized) {
-		/* TODO acerion 2023.10.01 use API from src/cwutils/lib/random.h. */
-		srand(time(NULL));
+		cw_random_init(&rng, 0);
 		is_initialized = true;
 	}
 
-	return dict->wordlist[rand() % dict->wordlist_length];
+	return cw_dictionary_get_random_word_r(dict, &rng);
 }
 
 
 
 
 
-/*
- * get_dictionary_random_word()
- *
- * Return a random word from the given dictionary.
- */
-const char *get_dictionary_random_word(const dictionary *dict)
+/**
+   \brief Get a random word from given dictionary, using given generator
+
+   Use this function to get reproducible sequence of words (by
+   initializing \p rng with specific seed), or to avoid sharing of
+   generator's state between threads.
+
+   \param dict - dictionary to query
+   \param rng - initialized random number generator
+
+   \return a string
+*/
+const char *cw_dictionary_get_random_word_r(const cw_dictionary_t *dict, cw_random_t *rng)
 {
-	return cw_dictionary_get_random_word(dict);
+	const uint32_t n_words = (uint32_t) dict->wordlist_length;
+	uint32_t index = cw_random_get_bounded(rng, n_words);
+	if (dict->weights) {
+		/* Alias method: either the selected word or its alias. */
+		const cw_dictionary_weight_t *column = &dict->weights[index];
+		const uint32_t value = (uint32_t) (cw_random_next(rng) >> 32);
+		if (value >= column->threshold && column->alias < n_words) {
+			index = column->alias;
+		}
+	}
+	return cw_dictionary_get_word(dict, (int) index);
 }
 
 
 
 
 
-#ifdef CW_DICTIONARY_UNIT_TESTS
+/**
+   \brief Get a random group of words from given dictionary, using given generator
 
+   Group consists of as many random words as is the group size of the
+   dictionary (e.g. 5 single-letter words, or 1 multi-letter word),
+   concatenated without separators.
 
+   \param dict - dictionary to query
+   \param rng - initialized random number generator
+   \param group - buffer for NUL-terminated group
+   \param size - size of \p group
 
+   \return length of group
+   \return -1 if the group doesn't fit in \p group
+*/
+int cw_dictionary_get_random_group_r(const cw_dictionary_t *dict, cw_random_t *rng, char *group, size_t size)
+{
+	size_t length = 0;
+	for (int i = 0; i < dict->group_size; i++) {
+		const char *word = cw_dictionary_get_random_word_r(dict, rng);
+		const size_t word_length = strlen(word);
+		if (length + word_length >= size) {
+			return -1;
+		}
+		memcpy(group + length, word, word_length);
+		length += word_length;
+	}
+	if (length >= size) {
+		return -1;
+	}
+	group[length] = '\0';
 
-static unsigned int test_cw_dictionary_check_line(void);
+	return (int) length;
+}
 
 
-typedef unsigned int (*cw_dict_test_function_t)(void);
 
-static cw_dict_test_function_t cw_dict_unit_tests[] = {
-	test_cw_dictionary_check_line,
-	NULL
-};
 
 
+/**
+   \brief Get word with given index from dictionary
 
-int main(void)
-{
-	fprintf(stderr, "unit tests for \"dictionary\" functions\n\n");
+   \param dict - dictionary to query
+   \param index - index of word, smaller than length of word list
 
-	int i = 0;
-	while (cw_dict_unit_tests[i]) {
-		cw_dict_unit_tests[i]();
-		i++;
+   \return a string
+*/
+const char *cw_dictionary_get_word(const cw_dictionary_t *dict, int index)
+{
+	if (dict->wordlist) {
+		return dict->wordlist[index];
 	}
 
-	/* "make check" facility requires this message to be
-	   printed on stdout; don't localize it */
-	fprintf(stdout, "\ndictionary: test result: success\n\n");
-
-	return 0;
+	/* Offset read from compiled file may be invalid. Pool of strings
+	   ends with NUL, so any valid offset points to NUL-terminated
+	   string. */
+	const uint32_t offset = dict->word_offsets[index];
+	return offset < dict->word_pool_size ? dict->word_pool + offset : "";
 }
 
 
 
 
 
-unsigned int test_cw_dictionary_check_line(void)
-{
-	fprintf(stderr, "dictionary: cw_dictionary_check_line():");
+/**
+   \brief Get weight of word with given index from dictionary
 
-	/* First test the function giving it strings with some invalid
-	   characters. */
-	{
-		struct {
-			const char *in;
-			const char *expected_out;
-		} invalid_test_data[] = {
-			/* See src/libcw/libcw.c for list of valid characters. */
+   \param dict - dictionary to query
+   \param index - index of word, smaller than length of word list
+
+   \return weight of the word
+*/
+uint32_t cw_dictionary_get_weight(const cw_dictionary_t *dict, int index)
+{
+	return dict->weights ? dict->weights[index].weight : 1;
+}
+
+
+
+
+
+/*
+ * get_dictionary_random_word()
+ *
+ * Return a random word from the given dictionary.
+ */
+const char *get_dictionary_random_word(const dictionary *dict)
+{
+	return cw_dictionary_get_random_word(dict);
+}
+
+
+
+
+
+/*---------------------------------------------------------------------*/
+/*  Index of words                                                     */
+/*---------------------------------------------------------------------*/
+
+/*
+  Index of words of a dictionary is a trie of upper-cased words, used for
+  lookups of words as characters are received: prefix queries
+  (completions) and queries for words at edit distance of at most one
+  (corrections). Cost of both queries depends on length of queried text,
+  and not on count of words in dictionary.
+
+  All nodes are in one array, root is the first node. Children of a node
+  are stored next to each other, sorted by character, so a child is found
+  with binary search, and walking children in order gives words in
+  alphabetical order.
+
+  The index is built on first query of a dictionary, so programs that
+  only draw random words from dictionaries don't pay for it. Building of
+  the index is not thread-safe.
+*/
+struct cw_dictionary_trie_node_s {
+	uint32_t first_child;  /* Index of first child node */
+	uint32_t n_children;
+	int32_t word;          /* Index of word that ends at this node; -1 if none */
+	char character;        /* Upper-cased character on the edge leading to this node */
+};
+
+struct cw_dictionary_index_s {
+	cw_dictionary_trie_node_t *nodes;
+	uint32_t n_nodes;
+};
+
+/* Word being put into index. */
+typedef struct {
+	const char *key;       /* Upper-cased word */
+	int32_t word;          /* Index of word in dictionary */
+} cw_dictionary_index_key_t;
+
+/* Range of sorted keys under a node of index that is being built; all
+   keys in the range share prefix of the length equal to depth of the
+   node. */
+typedef struct {
+	int first;
+	int last;              /* One past the last key */
+	size_t depth;
+} cw_dictionary_index_range_t;
+
+/* Results of query of index. */
+struct cw_dictionary_index_results_s {
+	const cw_dictionary_t *dict;
+	const char **words;
+	int n_words;
+	int max_words;
+};
+
+
+
+
+
+int cw_dictionary_index_key_compare(const void *a, const void *b)
+{
+	const cw_dictionary_index_key_t *key_a = (const cw_dictionary_index_key_t *) a;
+	const cw_dictionary_index_key_t *key_b = (const cw_dictionary_index_key_t *) b;
+	const int result = strcmp(key_a->key, key_b->key);
+	if (result) {
+		return result;
+	}
+	/* Of words that differ only in case the first one wins. */
+	return (key_a->word > key_b->word) - (key_a->word < key_b->word);
+}
+
+
+
+
+
+/**
+   \brief Build index of words of given dictionary
+
+   \param dict - dictionary to index
+
+   \return index of dictionary
+*/
+cw_dictionary_index_t *cw_dictionary_build_index(const cw_dictionary_t *dict)
+{
+	const int n_words = dict->wordlist_length;
+
+	/* Upper-cased copies of all words, in one pool. */
+	size_t pool_size = 0;
+	for (int i = 0; i < n_words; i++) {
+		pool_size += strlen(cw_dictionary_get_word(dict, i)) + 1;
+	}
+	char *pool = safe_malloc(pool_size ? pool_size : 1);
+	cw_dictionary_index_key_t *keys = safe_malloc((n_words ? n_words : 1) * sizeof (cw_dictionary_index_key_t));
+	char *cursor = pool;
+	for (int i = 0; i < n_words; i++) {
+		const char *word = cw_dictionary_get_word(dict, i);
+		keys[i].key = cursor;
+		keys[i].word = i;
+		while (*word) {
+			*cursor++ = (char) toupper((unsigned char) *word++);
+		}
+		*cursor++ = '\0';
+	}
+	qsort(keys, (size_t) n_words, sizeof (cw_dictionary_index_key_t), cw_dictionary_index_key_compare);
+
+	/* Each character of each word adds at most one node. */
+	const size_t max_nodes = pool_size - (size_t) n_words + 1;
+	cw_dictionary_index_t *index = safe_malloc(sizeof (cw_dictionary_index_t));
+	index->nodes = safe_malloc(max_nodes * sizeof (cw_dictionary_trie_node_t));
+
+	/* Range of sorted keys under each node. */
+	cw_dictionary_index_range_t *ranges = safe_malloc(max_nodes * sizeof (cw_dictionary_index_range_t));
+
+	index->nodes[0].character = '\0';
+	ranges[0].first = 0;
+	ranges[0].last = n_words;
+	ranges[0].depth = 0;
+	index->n_nodes = 1;
+
+	/* Nodes are created breadth-first, so children of every node
+	   are created together, next to each other. */
+	for (uint32_t n = 0; n < index->n_nodes; n++) {
+		cw_dictionary_trie_node_t *node = &index->nodes[n];
+		int first = ranges[n].first;
+		const int last = ranges[n].last;
+		const size_t depth = ranges[n].depth;
+
+		/* Shorter keys are sorted first, and the key that ends here
+		   is the one with the lowest index of word. */
+		node->word = -1;
+		while (first < last && keys[first].key[depth] == '\0') {
+			if (node->word == -1) {
+				node->word = keys[first].word;
+			}
+			first++;
+		}
+
+		node->first_child = index->n_nodes;
+		node->n_children = 0;
+		while (first < last) {
+			const char c = keys[first].key[depth];
+			int end = first + 1;
+			while (end < last && keys[end].key[depth] == c) {
+				end++;
+			}
+
+			cw_dictionary_trie_node_t *child = &index->nodes[index->n_nodes];
+			child->character = c;
+			ranges[index->n_nodes].first = first;
+			ranges[index->n_nodes].last = end;
+			ranges[index->n_nodes].depth = depth + 1;
+			index->n_nodes++;
+			node->n_children++;
+
+			first = end;
+		}
+	}
+
+	free(ranges);
+	free(keys);
+	free(pool);
+
+	return index;
+}
+
+
+
+
+
+/**
+   \brief Get index of words of given dictionary, build it if necessary
+
+   \param dict - dictionary to query
+
+   \return index of dictionary
+   \return NULL if the dictionary is not on list of current dictionaries
+*/
+const cw_dictionary_index_t *cw_dictionary_get_index(const cw_dictionary_t *dict)
+{
+	if (dict->index) {
+		return dict->index;
+	}
+
+	/* Callers get const pointers to dictionaries owned by this
+	   module; the index is stored in the module's own entry. */
+	for (cw_dictionary_t *entry = dictionaries_head; entry; entry = entry->next) {
+		if (entry == dict) {
+			entry->index = cw_dictionary_build_index(entry);
+			return entry->index;
+		}
+	}
+	return NULL;
+}
+
+
+
+
+
+/**
+   \brief Free index of words
+
+   \param index - index to free, may be NULL
+*/
+void cw_dictionary_delete_index(cw_dictionary_index_t *index)
+{
+	if (index) {
+		free(index->nodes);
+		free(index);
+	}
+}
+
+
+
+
+
+/**
+   \brief Find child of node with given character
+
+   \param index - index of dictionary
+   \param node - node to search
+   \param c - character to find, upper-cased
+
+   \return child node
+   \return NULL if there is no such child
+*/
+const cw_dictionary_trie_node_t *cw_dictionary_index_find_child(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, char c)
+{
+	const cw_dictionary_trie_node_t *children = index->nodes + node->first_child;
+	uint32_t low = 0;
+	uint32_t high = node->n_children;
+	while (low < high) {
+		const uint32_t middle = low + (high - low) / 2;
+		if (children[middle].character < c) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return (low < node->n_children && children[low].character == c) ? &children[low] : NULL;
+}
+
+
+
+
+
+/**
+   \brief Find node at the end of path given by text
+
+   \param index - index of dictionary
+   \param text - text to follow, compared case-insensitively
+
+   \return node
+   \return NULL if there is no such path in index
+*/
+const cw_dictionary_trie_node_t *cw_dictionary_index_find(const cw_dictionary_index_t *index, const char *text)
+{
+	const cw_dictionary_trie_node_t *node = &index->nodes[0];
+	for (; node && *text; text++) {
+		node = cw_dictionary_index_find_child(index, node, (char) toupper((unsigned char) *text));
+	}
+	return node;
+}
+
+
+
+
+
+/**
+   \brief Add word to results of query, unless it's already there
+
+   \return false if there is no more room for results
+   \return true otherwise
+*/
+bool cw_dictionary_index_results_add(cw_dictionary_index_results_t *results, int32_t word)
+{
+	if (results->n_words == results->max_words) {
+		return false;
+	}
+	const char *text = cw_dictionary_get_word(results->dict, word);
+	for (int i = 0; i < results->n_words; i++) {
+		if (results->words[i] == text) {
+			return true;
+		}
+	}
+	results->words[results->n_words++] = text;
+	return results->n_words < results->max_words;
+}
+
+
+
+
+
+/**
+   \brief Collect words in subtree of given node, in alphabetical order
+
+   \return false if there is no more room for results
+   \return true otherwise
+*/
+bool cw_dictionary_index_collect(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, cw_dictionary_index_results_t *results)
+{
+	if (node->word != -1 && !cw_dictionary_index_results_add(results, node->word)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < node->n_children; i++) {
+		if (!cw_dictionary_index_collect(index, &index->nodes[node->first_child + i], results)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+/**
+   \brief Collect words that match rest of text with at most given count of edits
+
+   \param index - index of dictionary
+   \param node - node reached so far
+   \param text - rest of queried text, upper-cased
+   \param n_edits - count of edits that may still be made
+   \param results - results of query
+
+   \return false if there is no more room for results
+   \return true otherwise
+*/
+bool cw_dictionary_index_match(const cw_dictionary_index_t *index, const cw_dictionary_trie_node_t *node, const char *text, int n_edits, cw_dictionary_index_results_t *results)
+{
+	if (*text == '\0' && node->word != -1) {
+		if (!cw_dictionary_index_results_add(results, node->word)) {
+			return false;
+		}
+	}
+
+	if (*text != '\0') {
+		const cw_dictionary_trie_node_t *child = cw_dictionary_index_find_child(index, node, *text);
+		if (child && !cw_dictionary_index_match(index, child, text + 1, n_edits, results)) {
+			return false;
+		}
+	}
+
+	if (n_edits == 0) {
+		return true;
+	}
+
+	/* Character of text is missing in word. */
+	if (*text != '\0' && !cw_dictionary_index_match(index, node, text + 1, n_edits - 1, results)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < node->n_children; i++) {
+		const cw_dictionary_trie_node_t *child = &index->nodes[node->first_child + i];
+
+		/* Word has an extra character. */
+		if (!cw_dictionary_index_match(index, child, text, n_edits - 1, results)) {
+			return false;
+		}
+
+		/* Character of text has been replaced with other character. */
+		if (*text != '\0' && child->character != *text
+		    && !cw_dictionary_index_match(index, child, text + 1, n_edits - 1, results)) {
+			return false;
+		}
+	}
+
+	/* Two adjacent characters of text have been swapped. */
+	if (*text != '\0' && text[1] != '\0' && text[0] != text[1]) {
+		const cw_dictionary_trie_node_t *child = cw_dictionary_index_find_child(index, node, text[1]);
+		if (child) {
+			child = cw_dictionary_index_find_child(index, child, text[0]);
+		}
+		if (child && !cw_dictionary_index_match(index, child, text + 2, n_edits - 1, results)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+
+
+/**
+   \brief Check if given word is in dictionary
+
+   Words are compared case-insensitively.
+
+   \param dict - dictionary to query
+   \param word - word to look for
+
+   \return true if the word is in dictionary
+   \return false otherwise
+*/
+bool cw_dictionary_has_word(const cw_dictionary_t *dict, const char *word)
+{
+	const cw_dictionary_index_t *index = cw_dictionary_get_index(dict);
+	if (!index) {
+		return false;
+	}
+	const cw_dictionary_trie_node_t *node = cw_dictionary_index_find(index, word);
+	return node && node->word != -1;
+}
+
+
+
+
+
+/**
+   \brief Get words of dictionary that start with given prefix
+
+   Words are compared case-insensitively, and are returned in
+   alphabetical order. The function can be called after every received
+   character, to get words that the received text may be a beginning of.
+
+   \param dict - dictionary to query
+   \param prefix - beginning of words
+   \param words - buffer for found words
+   \param max_words - size of \p words
+
+   \return count of found words, at most \p max_words
+*/
+int cw_dictionary_get_completions(const cw_dictionary_t *dict, const char *prefix, const char **words, int max_words)
+{
+	cw_dictionary_index_results_t results = { .dict = dict, .words = words, .n_words = 0, .max_words = max_words };
+	if (max_words <= 0) {
+		return 0;
+	}
+
+	const cw_dictionary_index_t *index = cw_dictionary_get_index(dict);
+	const cw_dictionary_trie_node_t *node = index ? cw_dictionary_index_find(index, prefix) : NULL;
+	if (node) {
+		cw_dictionary_index_collect(index, node, &results);
+	}
+	return results.n_words;
+}
+
+
+
+
+
+/**
+   \brief Get words of dictionary that may have been received as given text
+
+   Find words at edit distance of at most one from \p text: the word
+   itself, and words that differ from it by one substituted, inserted or
+   deleted character, or by two swapped adjacent characters. Words are
+   compared case-insensitively. The word equal to \p text (if any) is
+   returned first, order of other words is unspecified.
+
+   \param dict - dictionary to query
+   \param text - received text
+   \param words - buffer for found words
+   \param max_words - size of \p words
+
+   \return count of found words, at most \p max_words
+*/
+int cw_dictionary_get_corrections(const cw_dictionary_t *dict, const char *text, const char **words, int max_words)
+{
+	cw_dictionary_index_results_t results = { .dict = dict, .words = words, .n_words = 0, .max_words = max_words };
+	if (max_words <= 0) {
+		return 0;
+	}
+
+	char upper[MAX_LINE];
+	size_t length = 0;
+	for (; text[length] && length < sizeof (upper) - 1; length++) {
+		upper[length] = (char) toupper((unsigned char) text[length]);
+	}
+	upper[length] = '\0';
+
+	const cw_dictionary_index_t *index = cw_dictionary_get_index(dict);
+	if (!index) {
+		return 0;
+	}
+	const cw_dictionary_trie_node_t *node = cw_dictionary_index_find(index, upper);
+	if (node && node->word != -1 && !cw_dictionary_index_results_add(&results, node->word)) {
+		return results.n_words;
+	}
+	cw_dictionary_index_match(index, &index->nodes[0], upper, 1, &results);
+
+	return results.n_words;
+}
+
+
+
+
+
+#ifdef CW_DICTIONARY_UNIT_TESTS
+
+
+
+
+static unsigned int test_cw_dictionary_check_line(void);
+static unsigned int test_cw_dictionaries_compiled(void);
+static unsigned int test_cw_dictionary_weighted(void);
+static unsigned int test_cw_dictionary_index(void);
+static void test_cw_dictionary_weighted_count(const cw_dictionary_t *dict, uint64_t seed, int counts[3]);
+
+
+typedef unsigned int (*cw_dict_test_function_t)(void);
+
+static cw_dict_test_function_t cw_dict_unit_tests[] = {
+	test_cw_dictionary_check_line,
+	test_cw_dictionaries_compiled,
+	test_cw_dictionary_weighted,
+	test_cw_dictionary_index,
+	NULL
+};
+
+
+
+int main(void)
+{
+	fprintf(stderr, "unit tests for \"dictionary\" functions\n\n");
+
+	int i = 0;
+	while (cw_dict_unit_tests[i]) {
+		cw_dict_unit_tests[i]();
+		i++;
+	}
+
+	/* "make check" facility requires this message to be
+	   printed on stdout; don't localize it */
+	fprintf(stdout, "\ndictionary: test result: success\n\n");
+
+	return 0;
+}
+
+
+
+
+
+unsigned int test_cw_dictionary_check_line(void)
+{
+	fprintf(stderr, "dictionary: cw_dictionary_check_line():");
+
+	/* First test the function giving it strings with some invalid
+	   characters. */
+	{
+		struct {
+			const char *in;
+			const char *expected_out;
+		} invalid_test_data[] = {
+			/* See src/libcw/libcw.c for list of valid characters. */
 
 			/* The '^' marks in "out" strings point
 			   invalid characters. These "out" strings
@@ -964,4 +2138,217 @@ unsigned int test_cw_dictionary_check_line(void)
 
 
 
+
+
+unsigned int test_cw_dictionaries_compiled(void)
+{
+	fprintf(stderr, "\ndictionary: compiled dictionary file:");
+
+	char path[64];
+	snprintf(path, sizeof (path), "/tmp/cw_dictionary_tests_%ld.cwd", (long) getpid());
+
+	/* Write default dictionaries to compiled file, and read them back. */
+	cw_dictionaries_unload();
+	cw_assert (cw_dictionaries_write(path), "failed to write compiled file");
+	cw_assert (cw_dictionaries_read(path), "failed to read compiled file");
+	unlink(path);
+	cw_assert (dictionaries_map, "dictionaries have not been read from mapping");
+
+	/* The dictionaries must be the same as default dictionaries. */
+	cw_dictionary_t *expected_head = cw_dictionaries_create_default();
+	const cw_dictionary_t *expected = expected_head;
+	const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	for (; expected && dict; expected = expected->next, dict = cw_dictionaries_iterate(dict)) {
+		cw_assert (!strcmp(expected->description, dict->description),
+			   "different descriptions: \"%s\" / \"%s\"", expected->description, dict->description);
+		cw_assert (expected->group_size == dict->group_size,
+			   "different group sizes in \"%s\"", dict->description);
+		cw_assert (expected->wordlist_length == dict->wordlist_length,
+			   "different lengths of word lists in \"%s\"", dict->description);
+		for (int i = 0; i < dict->wordlist_length; i++) {
+			cw_assert (!strcmp(cw_dictionary_get_word(expected, i), cw_dictionary_get_word(dict, i)),
+				   "different word #%d in \"%s\"", i, dict->description);
+		}
+	}
+	cw_assert (!expected && !dict, "different counts of dictionaries");
+
+	/* Dictionaries from mapping must be unloaded as others. */
+	cw_dictionaries_unload();
+	cw_assert (!dictionaries_map, "mapping has not been unloaded");
+
+	/* The default dictionaries created above are not on module's list,
+	   free them here. */
+	for (cw_dictionary_t *next = NULL; expected_head; expected_head = next) {
+		next = expected_head->next;
+		free(expected_head);
+	}
+
+	fprintf(stderr, "dictionary: compiled dictionary file passed\n");
+
+	return 0;
+}
+
+
+
+
+
+#define TEST_WEIGHTED_DRAWS 100000
+
+unsigned int test_cw_dictionary_weighted(void)
+{
+	fprintf(stderr, "dictionary: weighted words:");
+
+	char text_path[64];
+	char compiled_path[64];
+	snprintf(text_path, sizeof (text_path), "/tmp/cw_dictionary_tests_%ld.txt", (long) getpid());
+	snprintf(compiled_path, sizeof (compiled_path), "/tmp/cw_dictionary_tests_%ld.cwd", (long) getpid());
+
+	FILE *stream = fopen(text_path, "w");
+	cw_assert (stream, "failed to create text file");
+	fprintf(stream, "[ Weighted ]\nA*60 B*30\nC*10\n[ Uniform ]\nX Y Z\n");
+	fclose(stream);
+
+	cw_assert (cw_dictionaries_read(text_path), "failed to read text file");
+	const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	cw_assert (dict->wordlist_length == 3 && !strcmp(cw_dictionary_get_word(dict, 2), "C"),
+		   "weights have not been removed from words");
+	cw_assert (cw_dictionary_get_weight(dict, 1) == 30, "unexpected weight of word");
+	cw_assert (!cw_dictionaries_iterate(dict)->weights, "dictionary without weights has weights");
+
+	/* Frequencies of words follow the weights. */
+	int counts[3] = { 0 };
+	test_cw_dictionary_weighted_count(dict, 1234, counts);
+	cw_assert (abs(counts[0] - 60000) < 2000 && abs(counts[1] - 30000) < 2000 && abs(counts[2] - 10000) < 2000,
+		   "unexpected frequencies of words: %d/%d/%d", counts[0], counts[1], counts[2]);
+
+	/* Compiled file keeps the weights and the alias table: the same seed
+	   gives the same words. */
+	cw_assert (cw_dictionaries_write(compiled_path), "failed to write compiled file");
+	cw_assert (cw_dictionaries_read(compiled_path), "failed to read compiled file");
+	unlink(compiled_path);
+	int compiled_counts[3] = { 0 };
+	test_cw_dictionary_weighted_count(cw_dictionaries_iterate(NULL), 1234, compiled_counts);
+	cw_assert (!memcmp(counts, compiled_counts, sizeof (counts)), "different frequencies of words from compiled file");
+
+	/* Text file keeps the weights too. */
+	cw_assert (cw_dictionaries_write(text_path), "failed to write text file");
+	cw_assert (cw_dictionaries_read(text_path), "failed to read text file written back");
+	unlink(text_path);
+	cw_assert (cw_dictionary_get_weight(cw_dictionaries_iterate(NULL), 0) == 60, "weight has not been written to text file");
+
+	cw_dictionaries_unload();
+
+	fprintf(stderr, "dictionary: weighted words passed\n");
+
+	return 0;
+}
+
+
+
+
+
+void test_cw_dictionary_weighted_count(const cw_dictionary_t *dict, uint64_t seed, int counts[3])
+{
+	cw_random_t rng;
+	cw_random_init(&rng, seed);
+	for (int i = 0; i < TEST_WEIGHTED_DRAWS; i++) {
+		const char *word = cw_dictionary_get_random_word_r(dict, &rng);
+		counts[word[0] - 'A']++;
+	}
+}
+
+
+
+
+
+static bool test_cw_dictionary_index_contains(const char **words, int n_words, const char *word)
+{
+	for (int i = 0; i < n_words; i++) {
+		if (!strcmp(words[i], word)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+
+unsigned int test_cw_dictionary_index(void)
+{
+	fprintf(stderr, "dictionary: index of words:");
+
+	char text_path[64];
+	char compiled_path[64];
+	snprintf(text_path, sizeof (text_path), "/tmp/cw_dictionary_tests_%ld.txt", (long) getpid());
+	snprintf(compiled_path, sizeof (compiled_path), "/tmp/cw_dictionary_tests_%ld.cwd", (long) getpid());
+
+	FILE *stream = fopen(text_path, "w");
+	cw_assert (stream, "failed to create text file");
+	fprintf(stream, "[ Calls ]\nCQ DE K1ABC W1AW K1ABD test TEST Paris\n");
+	fclose(stream);
+
+	cw_assert (cw_dictionaries_read(text_path), "failed to read text file");
+	unlink(text_path);
+
+	/* The same queries are made on dictionary read from text file, and
+	   on the dictionary written to compiled file and read back. */
+	for (int pass = 0; pass < 2; pass++) {
+		const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+		const char *words[8];
+		int n;
+
+		cw_assert (cw_dictionary_has_word(dict, "k1abc"), "word has not been found");
+		cw_assert (!cw_dictionary_has_word(dict, "K1AB"), "prefix has been found as word");
+		cw_assert (!cw_dictionary_has_word(dict, "K1ABCD"), "too long word has been found");
+
+		/* Completions, in alphabetical order. */
+		n = cw_dictionary_get_completions(dict, "k1ab", words, 8);
+		cw_assert (n == 2 && !strcmp(words[0], "K1ABC") && !strcmp(words[1], "K1ABD"),
+			   "unexpected completions of prefix (%d)", n);
+		n = cw_dictionary_get_completions(dict, "", words, 3);
+		cw_assert (n == 3 && !strcmp(words[0], "CQ") && !strcmp(words[1], "DE") && !strcmp(words[2], "K1ABC"),
+			   "unexpected completions of empty prefix (%d)", n);
+		n = cw_dictionary_get_completions(dict, "X", words, 8);
+		cw_assert (n == 0, "unexpected completions of unknown prefix (%d)", n);
+
+		/* Words differing only in case are one word. */
+		n = cw_dictionary_get_completions(dict, "TE", words, 8);
+		cw_assert (n == 1 && !strcmp(words[0], "test"), "unexpected completions of duplicated word (%d)", n);
+
+		/* Corrections: exact word first, then words with one edit. */
+		n = cw_dictionary_get_corrections(dict, "K1ABC", words, 8);
+		cw_assert (n == 2 && !strcmp(words[0], "K1ABC") && !strcmp(words[1], "K1ABD"),
+			   "unexpected corrections of known word (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "K1ABX", words, 8);
+		cw_assert (n == 2 && test_cw_dictionary_index_contains(words, n, "K1ABC") && test_cw_dictionary_index_contains(words, n, "K1ABD"),
+			   "unexpected corrections of substitution (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "PRAIS", words, 8);
+		cw_assert (n == 1 && !strcmp(words[0], "Paris"), "unexpected corrections of transposition (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "CQQ", words, 8);
+		cw_assert (n == 1 && !strcmp(words[0], "CQ"), "unexpected corrections of extra character (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "W1A", words, 8);
+		cw_assert (n == 1 && !strcmp(words[0], "W1AW"), "unexpected corrections of missing character (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "K1ABX", words, 1);
+		cw_assert (n == 1, "too many corrections (%d)", n);
+		n = cw_dictionary_get_corrections(dict, "QRZ", words, 8);
+		cw_assert (n == 0, "unexpected corrections of unknown word (%d)", n);
+
+		if (pass == 0) {
+			cw_assert (cw_dictionaries_write(compiled_path), "failed to write compiled file");
+			cw_assert (cw_dictionaries_read(compiled_path), "failed to read compiled file");
+			unlink(compiled_path);
+		}
+	}
+
+	cw_dictionaries_unload();
+
+	fprintf(stderr, "dictionary: index of words passed\n");
+
+	return 0;
+}
+
+
+
 #endif /* #ifdef CW_DICTIONARY_UNIT_TESTS */
@@ -25,6 +25,9 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "lib/random.h"
 
 
 typedef struct cw_dictionary_s cw_dictionary_t;
@@ -38,6 +41,12 @@ extern const cw_dictionary_t *cw_dictionaries_iterate(const cw_dictionary_t *dic
 extern const char *cw_dictionary_get_description(const cw_dictionary_t *dict);
 extern int         cw_dictionary_get_group_size(const cw_dictionary_t *dict);
 extern const char *cw_dictionary_get_random_word(const cw_dictionary_t *dict);
+extern const char *cw_dictionary_get_random_word_r(const cw_dictionary_t *dict, cw_random_t *rng);
+extern int         cw_dictionary_get_random_group_r(const cw_dictionary_t *dict, cw_random_t *rng, char *group, size_t size);
+
+extern bool cw_dictionary_has_word(const cw_dictionary_t *dict, const char *word);
+extern int  cw_dictionary_get_completions(const cw_dictionary_t *dict, const char *prefix, const char **words, int max_words);
+extern int  cw_dictionary_get_corrections(const cw_dictionary_t *dict, const char *text, const char **words, int max_words);
 
 
 
@@ -0,0 +1,593 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/**
+   \file corpus.c
+
+   Generator of synthetic keying: elements with timespans of imperfect
+   human operator, for benchmarking and tuning of receivers.
+
+   Speed drifts as a random walk. Speeds at boundaries of blocks of text
+   are found first, in one quick sequential pass. Inside of a block the
+   speed follows a Brownian bridge between speeds at its boundaries, so
+   blocks can be generated independently of each other, and the drift is
+   still continuous across boundaries of blocks.
+*/
+
+
+
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libcw.h>
+#include <libcw_data.h>
+
+#include "corpus.h"
+#include "random.h"
+
+
+
+
+/* Nominal count of characters in a block of text. Blocks end at
+   beginning of a word, so they are usually a bit longer. */
+#define CORPUS_BLOCK_N_CHARACTERS 256
+
+/* Texts with fewer blocks per thread are not worth a separate thread. */
+#define CORPUS_MIN_BLOCKS_PER_THREAD 16
+
+/* Upper limit of count of threads generating corpus. */
+#define CORPUS_MAX_THREADS 64
+
+/* Duration of dot at 1 wpm [microseconds]. */
+#define CORPUS_DOT_CALIBRATION 1200000.0
+
+/* No element is shorter than this part of duration of dot. */
+#define CORPUS_TIMESPAN_MIN_RATIO 0.05
+
+#define CORPUS_TWO_PI 6.28318530717958647692
+
+
+
+
+/* Block of text, generated with its own random number generator. */
+typedef struct corpus_block_t {
+	size_t first;          /* Index of first character of block in text. */
+	size_t last;           /* Index of character past the last character of block. */
+	double speed_first;    /* [wpm] Speed at beginning of block. */
+	double speed_last;     /* [wpm] Speed at end of block. */
+} corpus_block_t;
+
+
+
+
+/* Random number generator with spare value of normal distribution. */
+typedef struct corpus_rng_t {
+	cw_random_t rng;
+	bool has_spare;
+	double spare;
+} corpus_rng_t;
+
+
+
+
+/* Ideal timespans of elements at given speed [microseconds]. */
+typedef struct corpus_durations_t {
+	double unit;
+	double dot;
+	double dash;
+	double ims;
+	double ics;   /* Whole space after last mark of character. */
+	double iws;   /* Whole space after last mark of word. */
+} corpus_durations_t;
+
+
+
+
+/* State of generation of one block. */
+typedef struct corpus_generator_t {
+	const cw_corpus_params_t * params;
+	corpus_rng_t rng;
+	corpus_durations_t durations;
+	cw_elements_t * elements;
+} corpus_generator_t;
+
+
+
+
+/* Range of blocks generated by one thread. */
+typedef struct corpus_partition_t {
+	const cw_corpus_params_t * params;
+	const char * text;
+	const corpus_block_t * blocks;
+	size_t first_block;
+	size_t last_block;
+	cw_elements_t * elements;
+	int result;
+} corpus_partition_t;
+
+
+
+
+static int corpus_validate(const cw_corpus_params_t * params, const char * text, size_t len);
+static corpus_block_t * corpus_split_into_blocks(const cw_corpus_params_t * params, const char * text, size_t len, size_t * n_blocks);
+static void * corpus_partition_thread_fn(void * arg);
+static int corpus_generate_block(const cw_corpus_params_t * params, const char * text, const corpus_block_t * block, size_t block_index, cw_elements_t * elements);
+static void corpus_calculate_durations(const cw_corpus_params_t * params, double speed, corpus_durations_t * durations);
+static int corpus_append_element(corpus_generator_t * generator, cw_element_type_t type, cw_state_t state, double ideal);
+static double corpus_clamp_speed(double speed);
+static uint64_t corpus_seed(uint64_t seed, uint64_t stream);
+static double corpus_uniform(corpus_rng_t * rng);
+static double corpus_normal(corpus_rng_t * rng);
+static double corpus_jitter(corpus_rng_t * rng, cw_corpus_jitter_t distribution);
+
+
+
+
+void cw_corpus_params_init(cw_corpus_params_t * params)
+{
+	memset(params, 0, sizeof (cw_corpus_params_t));
+	params->speed = CW_SPEED_INITIAL;
+	params->weighting = CW_WEIGHTING_INITIAL;
+	params->jitter_distribution = cw_corpus_jitter_gaussian;
+}
+
+
+
+
+int cw_corpus_generate(const cw_corpus_params_t * params, const char * text, unsigned int n_threads, cw_elements_t * elements)
+{
+	if (NULL == params || NULL == text || NULL == elements) {
+		return -1;
+	}
+	const size_t len = strlen(text);
+	if (0 != corpus_validate(params, text, len)) {
+		return -1;
+	}
+
+	size_t n_blocks = 0;
+	corpus_block_t * blocks = corpus_split_into_blocks(params, text, len, &n_blocks);
+	if (NULL == blocks) {
+		fprintf(stderr, "[ERROR] Failed to allocate blocks of corpus\n");
+		return -1;
+	}
+
+	if (0 == n_threads) {
+		const long n_processors = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = n_processors > 0 ? (unsigned int) n_processors : 1;
+	}
+	if (n_threads > CORPUS_MAX_THREADS) {
+		n_threads = CORPUS_MAX_THREADS;
+	}
+	const size_t n_useful = n_blocks / CORPUS_MIN_BLOCKS_PER_THREAD;
+	if (n_threads > n_useful) {
+		n_threads = n_useful > 0 ? (unsigned int) n_useful : 1;
+	}
+
+	/* First partition is generated by calling thread directly into
+	   output. Other partitions are generated into their own elements,
+	   and are appended to output in order. */
+	corpus_partition_t partitions[CORPUS_MAX_THREADS];
+	pthread_t threads[CORPUS_MAX_THREADS];
+	memset(partitions, 0, sizeof (partitions));
+	int result = 0;
+	for (unsigned int p = 0; p < n_threads; p++) {
+		partitions[p].params = params;
+		partitions[p].text = text;
+		partitions[p].blocks = blocks;
+		partitions[p].first_block = n_blocks * p / n_threads;
+		partitions[p].last_block = n_blocks * (p + 1) / n_threads;
+		if (0 == p) {
+			partitions[p].elements = elements;
+		} else {
+			partitions[p].elements = cw_elements_new(1);
+			if (NULL == partitions[p].elements) {
+				result = -1;
+			}
+		}
+	}
+
+	unsigned int n_started = 0;
+	for (unsigned int p = 1; p < n_threads && 0 == result; p++) {
+		if (0 != pthread_create(&threads[p], NULL, corpus_partition_thread_fn, &partitions[p])) {
+			fprintf(stderr, "[ERROR] Failed to create thread generating corpus\n");
+			result = -1;
+			break;
+		}
+		n_started = p;
+	}
+	if (0 == result) {
+		corpus_partition_thread_fn(&partitions[0]);
+		result = partitions[0].result;
+	}
+	for (unsigned int p = 1; p <= n_started; p++) {
+		pthread_join(threads[p], NULL);
+		if (0 != partitions[p].result) {
+			result = -1;
+		}
+	}
+
+	for (unsigned int p = 1; p < n_threads; p++) {
+		if (0 == result && 0 != cw_elements_append_elements(elements, partitions[p].elements)) {
+			result = -1;
+		}
+		cw_elements_delete(&partitions[p].elements);
+	}
+
+	free(blocks);
+	return result;
+}
+
+
+
+
+/**
+   @brief Check parameters of corpus and characters of text
+
+   @return 0 if corpus can be generated
+   @return -1 otherwise
+*/
+static int corpus_validate(const cw_corpus_params_t * params, const char * text, size_t len)
+{
+	if (params->speed < CW_SPEED_MIN || params->speed > CW_SPEED_MAX
+	    || params->weighting < CW_WEIGHTING_MIN || params->weighting > CW_WEIGHTING_MAX) {
+		fprintf(stderr, "[ERROR] Speed %d or weighting %d of corpus is out of range\n", params->speed, params->weighting);
+		return -1;
+	}
+	if (!(params->speed_drift >= 0.0) || !(params->jitter >= 0.0)
+	    || !(params->spike_rate >= 0.0) || !(params->spike_timespan_max >= 0.0)
+	    || !(params->dropout_rate >= 0.0) || !(params->dropout_timespan_max >= 0.0)) {
+		fprintf(stderr, "[ERROR] Negative parameter of corpus\n");
+		return -1;
+	}
+	if (params->jitter_distribution != cw_corpus_jitter_gaussian && params->jitter_distribution != cw_corpus_jitter_heavy_tailed) {
+		fprintf(stderr, "[ERROR] Invalid distribution of jitter %d\n", params->jitter_distribution);
+		return -1;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (' ' != text[i] && NULL == cw_character_to_representation_internal((unsigned char) text[i])) {
+			fprintf(stderr, "[ERROR] Character '%c' at position %zu of text of corpus is not supported\n", text[i], i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Split text into blocks, and find speeds at boundaries of blocks
+
+   A block ends before first character of a word, so that inter-word-space
+   is never split between two blocks.
+
+   @param[in] params Parameters of corpus
+   @param[in] text Text of corpus
+   @param[in] len Length of @p text
+   @param[out] n_blocks Count of blocks
+
+   @return Blocks allocated by the function on success
+   @return NULL on failure
+*/
+static corpus_block_t * corpus_split_into_blocks(const cw_corpus_params_t * params, const char * text, size_t len, size_t * n_blocks)
+{
+	/* Every block has at least CORPUS_BLOCK_N_CHARACTERS characters,
+	   except for the last one. */
+	const size_t capacity = len / CORPUS_BLOCK_N_CHARACTERS + 1;
+	corpus_block_t * blocks = (corpus_block_t *) malloc(capacity * sizeof (corpus_block_t));
+	if (NULL == blocks) {
+		return NULL;
+	}
+
+	corpus_rng_t rng = { .has_spare = false };
+	cw_random_init(&rng.rng, corpus_seed(params->seed, 0));
+
+	size_t n = 0;
+	size_t first = 0;
+	double speed = params->speed;
+	while (first < len || 0 == n) {
+		size_t last = first + CORPUS_BLOCK_N_CHARACTERS;
+		while (last < len && !(' ' == text[last - 1] && ' ' != text[last])) {
+			last++;
+		}
+		if (last > len) {
+			last = len;
+		}
+
+		blocks[n].first = first;
+		blocks[n].last = last;
+		blocks[n].speed_first = speed;
+		if (params->speed_drift > 0.0) {
+			speed = corpus_clamp_speed(speed + params->speed_drift * sqrt((double) (last - first)) * corpus_normal(&rng));
+		}
+		blocks[n].speed_last = speed;
+
+		n++;
+		first = last;
+	}
+
+	*n_blocks = n;
+	return blocks;
+}
+
+
+
+
+/**
+   @brief Generate all blocks of partition, one after another
+*/
+static void * corpus_partition_thread_fn(void * arg)
+{
+	corpus_partition_t * partition = (corpus_partition_t *) arg;
+	partition->result = 0;
+	for (size_t b = partition->first_block; b < partition->last_block; b++) {
+		if (0 != corpus_generate_block(partition->params, partition->text, &partition->blocks[b], b, partition->elements)) {
+			partition->result = -1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Generate elements of one block of text
+
+   Space after last mark of a character is appended only when next
+   character is known, because a ' ' turns the space into
+   inter-word-space.
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int corpus_generate_block(const cw_corpus_params_t * params, const char * text, const corpus_block_t * block, size_t block_index, cw_elements_t * elements)
+{
+	corpus_generator_t generator = { .params = params, .elements = elements };
+	generator.rng.has_spare = false;
+	cw_random_init(&generator.rng.rng, corpus_seed(params->seed, block_index + 1));
+
+	const size_t n = block->last - block->first;
+	double speed = block->speed_first;
+	cw_element_type_t pending = cw_element_type_none;
+
+	for (size_t k = 0; k < n; k++) {
+		corpus_calculate_durations(params, speed, &generator.durations);
+
+		const char character = text[block->first + k];
+		if (' ' == character) {
+			/* Two spaces in a row give two inter-word-spaces, as in
+			   cw_elements_detect_from_string(). */
+			if (cw_element_type_iws == pending
+			    && 0 != corpus_append_element(&generator, cw_element_type_iws, cw_state_space, generator.durations.iws)) {
+				return -1;
+			}
+			pending = cw_element_type_iws;
+		} else {
+			if (cw_element_type_none != pending
+			    && 0 != corpus_append_element(&generator, pending, cw_state_space, cw_element_type_iws == pending ? generator.durations.iws : generator.durations.ics)) {
+				return -1;
+			}
+			const char * representation = cw_character_to_representation_internal((unsigned char) character);
+			for (const char * mark = representation; '\0' != *mark; mark++) {
+				if (mark != representation
+				    && 0 != corpus_append_element(&generator, cw_element_type_ims, cw_state_space, generator.durations.ims)) {
+					return -1;
+				}
+				const bool is_dot = CW_DOT_REPRESENTATION == *mark;
+				if (0 != corpus_append_element(&generator, is_dot ? cw_element_type_dot : cw_element_type_dash, cw_state_mark, is_dot ? generator.durations.dot : generator.durations.dash)) {
+					return -1;
+				}
+			}
+			pending = cw_element_type_ics;
+		}
+
+		/* Next step of Brownian bridge from speed at beginning of
+		   block to speed at its end. */
+		const double remaining = (double) (n - k);
+		speed += (block->speed_last - speed) / remaining;
+		if (params->speed_drift > 0.0 && remaining > 1.0) {
+			speed += params->speed_drift * sqrt((remaining - 1.0) / remaining) * corpus_normal(&generator.rng);
+		}
+	}
+
+	if (cw_element_type_none != pending) {
+		corpus_calculate_durations(params, speed, &generator.durations);
+		if (0 != corpus_append_element(&generator, pending, cw_state_space, cw_element_type_iws == pending ? generator.durations.iws : generator.durations.ics)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Calculate ideal timespans of elements at given speed
+
+   Weighting is applied as in libcw's generator: marks are longer (or
+   shorter) by weighting adjustment, and spaces are adjusted so that
+   duration of word "PARIS" doesn't depend on weighting.
+*/
+static void corpus_calculate_durations(const cw_corpus_params_t * params, double speed, corpus_durations_t * durations)
+{
+	const double unit = CORPUS_DOT_CALIBRATION / corpus_clamp_speed(speed);
+	const double weighting = (2.0 * (params->weighting - 50) * unit) / 100.0;
+	const double w = (28.0 * weighting) / 22.0;
+
+	durations->unit = unit;
+	durations->dot = unit + weighting;
+	durations->dash = 3.0 * durations->dot;
+	durations->ims = unit - w;
+	durations->ics = 3.0 * unit + w;
+	durations->iws = 7.0 * unit - w;
+}
+
+
+
+
+/**
+   @brief Append element with jitter, and possibly with spike or dropout
+
+   A noise spike splits a space into two spaces with a short mark between
+   them. A dropout splits a mark into two marks with a short space between
+   them. Probability of a spike (dropout) in a space (mark) is
+   proportional to timespan of the space (mark).
+
+   @param[in/out] generator State of generation of block
+   @param[in] type Type of element
+   @param[in] state State of element
+   @param[in] ideal Ideal timespan of element [microseconds]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int corpus_append_element(corpus_generator_t * generator, cw_element_type_t type, cw_state_t state, double ideal)
+{
+	const cw_corpus_params_t * params = generator->params;
+	const double unit = generator->durations.unit;
+
+	double timespan = ideal;
+	if (params->jitter > 0.0) {
+		timespan += unit * (params->jitter / 100.0) * corpus_jitter(&generator->rng, params->jitter_distribution);
+	}
+	if (timespan < CORPUS_TIMESPAN_MIN_RATIO * unit) {
+		timespan = CORPUS_TIMESPAN_MIN_RATIO * unit;
+	}
+
+	const double rate = cw_state_mark == state ? params->dropout_rate : params->spike_rate;
+	if (rate > 0.0 && corpus_uniform(&generator->rng) < rate * timespan / 1000000.0) {
+		const double timespan_max = cw_state_mark == state ? params->dropout_timespan_max : params->spike_timespan_max;
+		double disturbance = corpus_uniform(&generator->rng) * timespan_max;
+		if (disturbance > timespan / 2.0) {
+			disturbance = timespan / 2.0;
+		}
+		const double before = corpus_uniform(&generator->rng) * (timespan - disturbance);
+		const cw_state_t other = cw_state_mark == state ? cw_state_space : cw_state_mark;
+		if (0 != cw_elements_append_typed_element(generator->elements, type, state, before)
+		    || 0 != cw_elements_append_typed_element(generator->elements, cw_element_type_none, other, disturbance)) {
+			return -1;
+		}
+		timespan -= before + disturbance;
+	}
+
+	return cw_elements_append_typed_element(generator->elements, type, state, timespan);
+}
+
+
+
+
+static double corpus_clamp_speed(double speed)
+{
+	if (speed < CW_SPEED_MIN) {
+		return CW_SPEED_MIN;
+	}
+	if (speed > CW_SPEED_MAX) {
+		return CW_SPEED_MAX;
+	}
+	return speed;
+}
+
+
+
+
+/**
+   @brief Derive seed of one stream of random numbers from seed of corpus
+
+   Stream zero is used for speeds at boundaries of blocks, stream N+1 for
+   block N. Mixing function is the finalizer of splitmix64, so seeds of
+   neighbouring streams are not correlated.
+*/
+static uint64_t corpus_seed(uint64_t seed, uint64_t stream)
+{
+	uint64_t z = seed + (stream + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z = z ^ (z >> 31);
+	/* Zero seed would make cw_random_init() pick a random seed. */
+	return 0 == z ? 1 : z;
+}
+
+
+
+
+/**
+   @brief Get random value in range [0, 1)
+*/
+static double corpus_uniform(corpus_rng_t * rng)
+{
+	return (double) (cw_random_next(&rng->rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+
+/**
+   @brief Get random value of standard normal distribution
+
+   Values are generated in pairs with Box-Muller transform.
+*/
+static double corpus_normal(corpus_rng_t * rng)
+{
+	if (rng->has_spare) {
+		rng->has_spare = false;
+		return rng->spare;
+	}
+
+	const double u1 = 1.0 - corpus_uniform(rng); /* (0, 1], valid argument of log(). */
+	const double u2 = corpus_uniform(rng);
+	const double r = sqrt(-2.0 * log(u1));
+	const double theta = CORPUS_TWO_PI * u2;
+	rng->spare = r * sin(theta);
+	rng->has_spare = true;
+	return r * cos(theta);
+}
+
+
+
+
+/**
+   @brief Get random value of jitter with zero mean and unit variance
+*/
+static double corpus_jitter(corpus_rng_t * rng, cw_corpus_jitter_t distribution)
+{
+	const double z = corpus_normal(rng);
+	if (cw_corpus_jitter_gaussian == distribution) {
+		return z;
+	}
+
+	/* Student's t with 3 degrees of freedom has variance 3. */
+	const double a = corpus_normal(rng);
+	const double b = corpus_normal(rng);
+	const double c = corpus_normal(rng);
+	const double chi_squared = a * a + b * b + c * c;
+	return z / sqrt(chi_squared / 3.0) / sqrt(3.0);
+}
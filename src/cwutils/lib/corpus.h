@@ -0,0 +1,107 @@
+#ifndef UNIXCW_CWUTILS_LIB_CORPUS_H
+#define UNIXCW_CWUTILS_LIB_CORPUS_H
+
+
+
+
+#include <stdint.h>
+
+#include "elements.h"
+
+
+
+
+/*
+  Synthetic corpus of keying.
+
+  Text is converted into elements (marks and spaces) with timespans of a
+  human operator: speed slowly drifts, each element is longer or shorter
+  than its ideal duration, marks may be consistently heavier or lighter
+  than spaces, and the signal may be disturbed by noise spikes (short
+  marks inside of spaces) and dropouts (short spaces inside of marks).
+
+  Each element has a type of its ideal counterpart (dot, dash, ims, ics,
+  iws), so the corpus can be used to measure accuracy of receivers. Marks
+  of noise spikes and spaces of dropouts have type cw_element_type_none.
+
+  Text is split into blocks of a few hundred characters, and each block
+  has its own random number generator seeded from the seed of corpus and
+  index of block. The corpus is therefore the same for given seed and
+  text, regardless of count of threads generating it.
+*/
+
+
+
+
+/* Distribution of jitter of timespans of elements. */
+typedef enum cw_corpus_jitter_t {
+	cw_corpus_jitter_gaussian = 0,  /**< Normal distribution. */
+	cw_corpus_jitter_heavy_tailed   /**< Student's t-distribution with 3 degrees of freedom: mostly small errors, and occasional large ones. */
+} cw_corpus_jitter_t;
+
+
+
+
+/**
+   @brief Parameters of synthetic keying
+
+   Use cw_corpus_params_init() to get parameters of ideal keying, and
+   modify selected fields.
+*/
+typedef struct cw_corpus_params_t {
+	int speed;                         /**< Initial speed [wpm]. */
+	double speed_drift;                /**< Standard deviation of change of speed between consecutive characters [wpm]. */
+	int weighting;                     /**< Weighting of marks as in libcw, 50 is neutral [percents]. */
+
+	cw_corpus_jitter_t jitter_distribution;
+	double jitter;                     /**< Standard deviation of jitter of each element, relative to current duration of dot [percents]. */
+
+	double spike_rate;                 /**< Mean count of noise spikes per second of spaces [1/s]. */
+	cw_element_time_t spike_timespan_max;    /**< Timespans of spikes are uniformly distributed up to this value [microseconds]. */
+	double dropout_rate;               /**< Mean count of dropouts per second of marks [1/s]. */
+	cw_element_time_t dropout_timespan_max;  /**< Timespans of dropouts are uniformly distributed up to this value [microseconds]. */
+
+	uint64_t seed;                     /**< Seed of random number generators. Every value, including zero, gives a reproducible corpus. */
+} cw_corpus_params_t;
+
+
+
+
+/**
+   @brief Initialize parameters of keying without any imperfections
+
+   Speed is set to CW_SPEED_INITIAL, weighting to CW_WEIGHTING_INITIAL,
+   and all other fields to zero.
+
+   @param[out] params Parameters to initialize
+*/
+void cw_corpus_params_init(cw_corpus_params_t * params);
+
+
+
+
+/**
+   @brief Generate elements of synthetic keying of text
+
+   Elements of @p text are appended to @p elements. Text is split into
+   blocks that are generated by @p n_threads threads. Pass zero as @p
+   n_threads to use as many threads as there are online processors.
+   Short texts are generated in calling thread regardless of @p n_threads.
+
+   Speed stays in range of speeds supported by libcw, and no element is
+   shorter than 5% of duration of dot.
+
+   @param[in] params Parameters of keying
+   @param[in] text Text to convert, with characters supported by libcw
+   @param[in] n_threads Count of threads to use
+   @param[out] elements Elements structure to which to append elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_corpus_generate(const cw_corpus_params_t * params, const char * text, unsigned int n_threads, cw_elements_t * elements);
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_CORPUS_H */
@@ -18,13 +18,70 @@
 
 
 
+#include <float.h>
 #include <limits.h> /* INT_MIN/MAX */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "element_stats.h"
 
 
 
 
+/* Count of types of elements, for indexing arrays with cw_element_type_t. */
+#define N_TYPES (cw_element_type_iws + 1)
+
+/* Partitions smaller than this are not worth a separate thread. */
+#define BATCH_MIN_ELEMENTS_PER_THREAD (16 * CW_ELEMENTS_CHUNK_SIZE)
+
+/* Upper limit of count of threads used by batch functions. */
+#define BATCH_MAX_THREADS 64
+
+
+
+
+/* Partial results of batch calculation of statistics, accumulated over
+   one partition of elements. */
+typedef struct batch_partial_t {
+	size_t count[N_TYPES];
+	double sum[N_TYPES];
+	double sum_sq_dev[N_TYPES];   /* Sum of squared deviations from mean, calculated in second pass. */
+	cw_element_time_t min[N_TYPES];
+	cw_element_time_t max[N_TYPES];
+	size_t histogram[N_TYPES][CW_ELEMENT_BATCH_STATS_BINS];
+} batch_partial_t;
+
+
+
+
+/* Partition of elements processed by one thread. Elements are either in
+   plain array, or in chunked elements structure. */
+typedef struct batch_partition_t {
+	const cw_element_t * array;
+	const cw_elements_t * store;
+	size_t first;     /* Index of first element in partition. */
+	size_t last;      /* Index of element past the last element in partition. */
+
+	cw_element_time_t bin_width;
+	const double * means;    /* Non-NULL in second pass. Indexed by cw_element_type_t. */
+
+	batch_partial_t partial;
+} batch_partition_t;
+
+
+
+
+static int cw_element_stats_batch_internal(const cw_element_t * array, const cw_elements_t * store, size_t count, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats);
+static int cw_element_stats_batch_run_internal(batch_partition_t * partitions, unsigned int n_partitions);
+static void * cw_element_stats_batch_thread_fn(void * arg);
+static void cw_element_stats_batch_sum(const cw_element_time_t * timespans, const uint8_t * types, size_t count, cw_element_time_t bin_width, batch_partial_t * partial);
+static void cw_element_stats_batch_sum_sq_dev(const cw_element_time_t * timespans, const uint8_t * types, size_t count, const double * means, batch_partial_t * partial);
+
+
+
+
 void cw_element_stats_update(cw_element_stats_t * stats, int element_duration)
 {
 	/* TODO (acerion) 2023.08.12: check for possible overflow. */
@@ -63,3 +120,290 @@ void cw_element_stats_init(cw_element_stats_t * stats)
 	stats->count = 0;
 }
 
+
+
+
+
+int cw_element_stats_calculate_batch(const cw_element_t * elements, size_t count, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats)
+{
+	if (NULL == elements && 0 != count) {
+		return -1;
+	}
+	return cw_element_stats_batch_internal(elements, NULL, count, bin_width, n_threads, stats);
+}
+
+
+
+
+int cw_elements_stats_calculate_batch(const cw_elements_t * elements, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats)
+{
+	if (NULL == elements) {
+		return -1;
+	}
+	return cw_element_stats_batch_internal(NULL, elements, elements->curr_count, bin_width, n_threads, stats);
+}
+
+
+
+
+/**
+   @brief Calculate statistics of elements from either array or elements structure
+
+   Mean is calculated in first pass over elements, and variance is
+   calculated from deviations from the mean in second pass. This is more
+   accurate than calculating variance from sum of squares in one pass:
+   squares of timespans of millions of elements lose precision.
+
+   Partitions of elements are aligned to chunks of cw_elements_t, so that
+   each thread works on its own chunks.
+*/
+static int cw_element_stats_batch_internal(const cw_element_t * array, const cw_elements_t * store, size_t count, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats)
+{
+	if (NULL == stats || !(bin_width > 0.0)) {
+		return -1;
+	}
+
+	if (0 == n_threads) {
+		const long n_processors = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = n_processors > 0 ? (unsigned int) n_processors : 1;
+	}
+	if (n_threads > BATCH_MAX_THREADS) {
+		n_threads = BATCH_MAX_THREADS;
+	}
+	const size_t n_useful = count / BATCH_MIN_ELEMENTS_PER_THREAD;
+	if (n_threads > n_useful) {
+		n_threads = n_useful > 0 ? (unsigned int) n_useful : 1;
+	}
+
+	batch_partition_t * partitions = calloc(n_threads, sizeof (batch_partition_t));
+	if (NULL == partitions) {
+		return -1;
+	}
+	const size_t n_chunks = (count + CW_ELEMENTS_CHUNK_SIZE - 1) / CW_ELEMENTS_CHUNK_SIZE;
+	for (unsigned int p = 0; p < n_threads; p++) {
+		size_t first = (n_chunks * p / n_threads) * CW_ELEMENTS_CHUNK_SIZE;
+		size_t last = (n_chunks * (p + 1) / n_threads) * CW_ELEMENTS_CHUNK_SIZE;
+		partitions[p].array = array;
+		partitions[p].store = store;
+		partitions[p].first = first < count ? first : count;
+		partitions[p].last = last < count ? last : count;
+		partitions[p].bin_width = bin_width;
+	}
+
+	/* First pass: counts, sums, extremes and histograms. */
+	if (0 != cw_element_stats_batch_run_internal(partitions, n_threads)) {
+		free(partitions);
+		return -1;
+	}
+
+	memset(stats, 0, N_TYPES * sizeof (cw_element_batch_stats_t));
+	double sums[N_TYPES] = { 0 };
+	double means[N_TYPES] = { 0 };
+	for (int t = 0; t < N_TYPES; t++) {
+		stats[t].min = DBL_MAX;
+		stats[t].max = -DBL_MAX;
+	}
+	for (unsigned int p = 0; p < n_threads; p++) {
+		const batch_partial_t * partial = &partitions[p].partial;
+		for (int t = 0; t < N_TYPES; t++) {
+			stats[t].count += partial->count[t];
+			sums[t] += partial->sum[t];
+			if (partial->min[t] < stats[t].min) {
+				stats[t].min = partial->min[t];
+			}
+			if (partial->max[t] > stats[t].max) {
+				stats[t].max = partial->max[t];
+			}
+			for (int b = 0; b < CW_ELEMENT_BATCH_STATS_BINS; b++) {
+				stats[t].histogram[b] += partial->histogram[t][b];
+			}
+		}
+	}
+	for (int t = 0; t < N_TYPES; t++) {
+		if (0 == stats[t].count) {
+			stats[t].min = 0.0;
+			stats[t].max = 0.0;
+		} else {
+			means[t] = sums[t] / (double) stats[t].count;
+			stats[t].mean = means[t];
+		}
+	}
+
+	/* Second pass: deviations from the mean. */
+	for (unsigned int p = 0; p < n_threads; p++) {
+		partitions[p].means = means;
+	}
+	if (0 != cw_element_stats_batch_run_internal(partitions, n_threads)) {
+		free(partitions);
+		return -1;
+	}
+	for (int t = 0; t < N_TYPES; t++) {
+		if (0 == stats[t].count) {
+			continue;
+		}
+		double sum_sq_dev = 0.0;
+		for (unsigned int p = 0; p < n_threads; p++) {
+			sum_sq_dev += partitions[p].partial.sum_sq_dev[t];
+		}
+		stats[t].variance = sum_sq_dev / (double) stats[t].count;
+	}
+
+	free(partitions);
+	return 0;
+}
+
+
+
+
+/**
+   @brief Process partitions of elements, each partition in its own thread
+
+   First partition is processed in calling thread.
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_element_stats_batch_run_internal(batch_partition_t * partitions, unsigned int n_partitions)
+{
+	pthread_t threads[BATCH_MAX_THREADS];
+	unsigned int n_started = 0;
+	int result = 0;
+	for (unsigned int p = 1; p < n_partitions; p++) {
+		if (0 != pthread_create(&threads[p], NULL, cw_element_stats_batch_thread_fn, &partitions[p])) {
+			result = -1;
+			break;
+		}
+		n_started = p;
+	}
+
+	if (0 == result) {
+		cw_element_stats_batch_thread_fn(&partitions[0]);
+	}
+
+	for (unsigned int p = 1; p <= n_started; p++) {
+		pthread_join(threads[p], NULL);
+	}
+
+	return result;
+}
+
+
+
+
+/**
+   @brief Process one partition of elements
+
+   In first pass (batch_partition_t::means is NULL) the function resets
+   partial results of the partition and accumulates counts, sums,
+   extremes and histograms. In second pass the function accumulates
+   squared deviations from means.
+*/
+static void * cw_element_stats_batch_thread_fn(void * arg)
+{
+	batch_partition_t * partition = (batch_partition_t *) arg;
+	batch_partial_t * partial = &partition->partial;
+
+	if (NULL == partition->means) {
+		memset(partial, 0, sizeof (batch_partial_t));
+		for (int t = 0; t < N_TYPES; t++) {
+			partial->min[t] = DBL_MAX;
+			partial->max[t] = -DBL_MAX;
+		}
+	}
+
+	/* Elements are processed in slices of at most one chunk. For elements
+	   structure a slice is a part of chunk's arrays. For plain array the
+	   slice is first copied into the same layout, so that one function
+	   can process both. */
+	cw_element_time_t timespans[CW_ELEMENTS_CHUNK_SIZE];
+	uint8_t types[CW_ELEMENTS_CHUNK_SIZE];
+
+	size_t i = partition->first;
+	while (i < partition->last) {
+		const size_t offset = i % CW_ELEMENTS_CHUNK_SIZE;
+		size_t n = CW_ELEMENTS_CHUNK_SIZE - offset;
+		if (n > partition->last - i) {
+			n = partition->last - i;
+		}
+
+		const cw_element_time_t * slice_timespans = NULL;
+		const uint8_t * slice_types = NULL;
+		if (NULL != partition->store) {
+			const cw_elements_chunk_t * chunk = partition->store->chunks[i / CW_ELEMENTS_CHUNK_SIZE];
+			for (size_t k = 0; k < n; k++) {
+				types[k] = chunk->attributes[offset + k] & CW_ELEMENTS_ATTRIBUTE_TYPE_MASK;
+			}
+			slice_timespans = chunk->timespans + offset;
+			slice_types = types;
+		} else {
+			for (size_t k = 0; k < n; k++) {
+				timespans[k] = partition->array[i + k].timespan;
+				types[k] = (uint8_t) partition->array[i + k].type;
+			}
+			slice_timespans = timespans;
+			slice_types = types;
+		}
+
+		if (NULL == partition->means) {
+			cw_element_stats_batch_sum(slice_timespans, slice_types, n, partition->bin_width, partial);
+		} else {
+			cw_element_stats_batch_sum_sq_dev(slice_timespans, slice_types, n, partition->means, partial);
+		}
+		i += n;
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Accumulate counts, sums, extremes and histograms of slice of elements
+
+   Indices of bins are calculated for whole slice in a separate loop
+   without branches, which compiler can vectorize.
+*/
+static void cw_element_stats_batch_sum(const cw_element_time_t * timespans, const uint8_t * types, size_t count, cw_element_time_t bin_width, batch_partial_t * partial)
+{
+	const double bin_scale = 1.0 / bin_width;
+	const double last_bin = CW_ELEMENT_BATCH_STATS_BINS - 1;
+	uint8_t bins[CW_ELEMENTS_CHUNK_SIZE];
+	for (size_t k = 0; k < count; k++) {
+		double bin = timespans[k] * bin_scale;
+		bin = bin < 0.0 ? 0.0 : bin;
+		bin = bin > last_bin ? last_bin : bin;
+		bins[k] = (uint8_t) bin;
+	}
+
+	for (size_t k = 0; k < count; k++) {
+		const uint8_t t = types[k];
+		if (t >= N_TYPES) {
+			continue;
+		}
+		const cw_element_time_t timespan = timespans[k];
+		partial->count[t]++;
+		partial->sum[t] += timespan;
+		partial->min[t] = timespan < partial->min[t] ? timespan : partial->min[t];
+		partial->max[t] = timespan > partial->max[t] ? timespan : partial->max[t];
+		partial->histogram[t][bins[k]]++;
+	}
+}
+
+
+
+
+/**
+   @brief Accumulate squared deviations of timespans of slice of elements from means
+*/
+static void cw_element_stats_batch_sum_sq_dev(const cw_element_time_t * timespans, const uint8_t * types, size_t count, const double * means, batch_partial_t * partial)
+{
+	for (size_t k = 0; k < count; k++) {
+		const uint8_t t = types[k];
+		if (t >= N_TYPES) {
+			continue;
+		}
+		const double deviation = timespans[k] - means[t];
+		partial->sum_sq_dev[t] += deviation * deviation;
+	}
+}
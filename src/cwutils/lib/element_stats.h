@@ -44,6 +44,79 @@ typedef struct cw_element_stats_divergences_t {
 
 
 
+/* Count of bins in histogram of cw_element_batch_stats_t. */
+#define CW_ELEMENT_BATCH_STATS_BINS 64
+
+
+
+
+/**
+   @brief Statistics of durations of one type of elements, calculated in batch
+
+   Unlike cw_element_stats_t, the statistics are calculated from all
+   elements at once, with floating point precision of element's timespan.
+*/
+typedef struct cw_element_batch_stats_t {
+	size_t count;                    /**< Count of elements of given type. */
+	cw_element_time_t min;           /**< The shortest timespan. Zero if count is zero. [microseconds] */
+	cw_element_time_t max;           /**< The longest timespan. Zero if count is zero. [microseconds] */
+	cw_element_time_t mean;          /**< Mean timespan. [microseconds] */
+	double variance;                 /**< Population variance of timespans. [microseconds^2] */
+
+	/* Bin i counts elements with timespan in range [i * bin_width, (i + 1) * bin_width).
+	   First bin also counts negative timespans, last bin also counts
+	   timespans that are too long for other bins. */
+	size_t histogram[CW_ELEMENT_BATCH_STATS_BINS];
+} cw_element_batch_stats_t;
+
+
+
+
+/**
+   @brief Calculate statistics of elements stored in array
+
+   Calculate statistics of timespans of @p count elements, separately for
+   each type of element. @p stats is indexed by cw_element_type_t, so it
+   must have (cw_element_type_iws + 1) items.
+
+   The elements are split into @p n_threads partitions, each partition is
+   processed by separate thread. Pass zero as @p n_threads to use as many
+   threads as there are online processors. Small arrays are processed in
+   calling thread regardless of @p n_threads.
+
+   @param[in] elements Array of elements
+   @param[in] count Count of items in @p elements
+   @param[in] bin_width Width of bin of histogram, must be positive [microseconds]
+   @param[in] n_threads Count of threads to use
+   @param[out] stats Statistics of durations, indexed by type of element
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_element_stats_calculate_batch(const cw_element_t * elements, size_t count, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats);
+
+
+
+
+/**
+   @brief Calculate statistics of elements stored in elements structure
+
+   Like cw_element_stats_calculate_batch(), but works directly on chunks of
+   @p elements, without making a copy of elements.
+
+   @param[in] elements Elements structure
+   @param[in] bin_width Width of bin of histogram, must be positive [microseconds]
+   @param[in] n_threads Count of threads to use
+   @param[out] stats Statistics of durations, indexed by type of element
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_stats_calculate_batch(const cw_elements_t * elements, cw_element_time_t bin_width, unsigned int n_threads, cw_element_batch_stats_t * stats);
+
+
+
+
 /**
    @brief Initialize element stats value
 
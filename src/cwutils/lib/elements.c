@@ -19,6 +19,7 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "elements.h"
 
@@ -28,7 +29,7 @@
 /**
    \file elements.c
 
-   A linear collection of CW elements (dots and dashes).
+   A linear, growable collection of CW elements (dots and dashes).
 
    The elements may have been detected in a wav file or in a string - you can
    use functions from elements_detect.c file for that purpose.
@@ -37,13 +38,20 @@
 
 
 
+static int cw_elements_grow(cw_elements_t * elements);
+
+
+
+
 void cw_elements_print_to_file(FILE * file, const cw_elements_t * elements)
 {
 	for (size_t i = 0; i < elements->curr_count; i++) {
-		if (cw_state_mark == elements->array[i].state) {
-			fprintf(file, "mark:   %11.2fus, '%c'\n", elements->array[i].timespan, cw_element_type_get_representation(elements->array[i].type));
+		cw_element_t element;
+		cw_elements_get_element(elements, i, &element);
+		if (cw_state_mark == element.state) {
+			fprintf(file, "mark:   %11.2fus, '%c'\n", element.timespan, cw_element_type_get_representation(element.type));
 		} else {
-			fprintf(file, "space:  %11.2fus, '%c'\n", elements->array[i].timespan, cw_element_type_get_representation(elements->array[i].type));
+			fprintf(file, "space:  %11.2fus, '%c'\n", element.timespan, cw_element_type_get_representation(element.type));
 		}
 	}
 }
@@ -53,24 +61,114 @@ void cw_elements_print_to_file(FILE * file, const cw_elements_t * elements)
 
 int cw_elements_append_element(cw_elements_t * elements, cw_state_t state, cw_element_time_t timespan)
 {
-	if (elements->curr_count >= elements->max_count) {
-		fprintf(stderr, "[ERROR] Reached limit of items in elements, can't add another item\n");
-		return -1;
+	if (state != cw_state_mark && state != cw_state_space) {
+		return 0; /* Not strictly an error, so return success. */
 	}
+	return cw_elements_append_typed_element(elements, cw_element_type_none, state, timespan);
+}
 
-	if (state == cw_state_mark) {
-		elements->array[elements->curr_count].state = cw_state_mark;
-		elements->array[elements->curr_count].timespan = timespan;
-		elements->curr_count++;
-		return 0;
-	} else if (state == cw_state_space) {
-		elements->array[elements->curr_count].state = cw_state_space;
-		elements->array[elements->curr_count].timespan = timespan;
-		elements->curr_count++;
-		return 0;
-	} else {
-		return 0; /* Not strictly an error, so return success. */
+
+
+
+int cw_elements_append_typed_element(cw_elements_t * elements, cw_element_type_t type, cw_state_t state, cw_element_time_t timespan)
+{
+	if (elements->curr_count == elements->chunks_count * CW_ELEMENTS_CHUNK_SIZE) {
+		if (0 != cw_elements_grow(elements)) {
+			fprintf(stderr, "[ERROR] Failed to grow elements, can't add another item\n");
+			return -1;
+		}
 	}
+
+	elements->curr_count++;
+	cw_elements_set_timespan(elements, elements->curr_count - 1, timespan);
+	cw_elements_set_type_and_state(elements, elements->curr_count - 1, type, state);
+	return 0;
+}
+
+
+
+
+int cw_elements_append_elements(cw_elements_t * elements, const cw_elements_t * source)
+{
+	size_t i = 0;
+	while (i < source->curr_count) {
+		if (elements->curr_count == elements->chunks_count * CW_ELEMENTS_CHUNK_SIZE) {
+			if (0 != cw_elements_grow(elements)) {
+				fprintf(stderr, "[ERROR] Failed to grow elements, can't add more items\n");
+				return -1;
+			}
+		}
+
+		/* Copy the longest run that fits in current chunks of both
+		   structures. */
+		const size_t source_offset = i % CW_ELEMENTS_CHUNK_SIZE;
+		const size_t offset = elements->curr_count % CW_ELEMENTS_CHUNK_SIZE;
+		size_t n = CW_ELEMENTS_CHUNK_SIZE - (source_offset > offset ? source_offset : offset);
+		if (n > source->curr_count - i) {
+			n = source->curr_count - i;
+		}
+		const cw_elements_chunk_t * from = source->chunks[i / CW_ELEMENTS_CHUNK_SIZE];
+		cw_elements_chunk_t * to = elements->chunks[elements->curr_count / CW_ELEMENTS_CHUNK_SIZE];
+		memcpy(to->timespans + offset, from->timespans + source_offset, n * sizeof (cw_element_time_t));
+		memcpy(to->attributes + offset, from->attributes + source_offset, n);
+
+		elements->curr_count += n;
+		i += n;
+	}
+	return 0;
+}
+
+
+
+
+void cw_elements_get_element(const cw_elements_t * elements, size_t i, cw_element_t * element)
+{
+	element->timespan = cw_elements_get_timespan(elements, i);
+	element->type = cw_elements_get_type(elements, i);
+	element->state = cw_elements_get_state(elements, i);
+}
+
+
+
+
+cw_element_time_t cw_elements_get_timespan(const cw_elements_t * elements, size_t i)
+{
+	return elements->chunks[i / CW_ELEMENTS_CHUNK_SIZE]->timespans[i % CW_ELEMENTS_CHUNK_SIZE];
+}
+
+
+
+
+cw_element_type_t cw_elements_get_type(const cw_elements_t * elements, size_t i)
+{
+	const uint8_t attributes = elements->chunks[i / CW_ELEMENTS_CHUNK_SIZE]->attributes[i % CW_ELEMENTS_CHUNK_SIZE];
+	return (cw_element_type_t) (attributes & CW_ELEMENTS_ATTRIBUTE_TYPE_MASK);
+}
+
+
+
+
+cw_state_t cw_elements_get_state(const cw_elements_t * elements, size_t i)
+{
+	const uint8_t attributes = elements->chunks[i / CW_ELEMENTS_CHUNK_SIZE]->attributes[i % CW_ELEMENTS_CHUNK_SIZE];
+	return (attributes & CW_ELEMENTS_ATTRIBUTE_STATE_MARK) ? cw_state_mark : cw_state_space;
+}
+
+
+
+
+void cw_elements_set_timespan(cw_elements_t * elements, size_t i, cw_element_time_t timespan)
+{
+	elements->chunks[i / CW_ELEMENTS_CHUNK_SIZE]->timespans[i % CW_ELEMENTS_CHUNK_SIZE] = timespan;
+}
+
+
+
+
+void cw_elements_set_type_and_state(cw_elements_t * elements, size_t i, cw_element_type_t type, cw_state_t state)
+{
+	const uint8_t attributes = (uint8_t) ((type & CW_ELEMENTS_ATTRIBUTE_TYPE_MASK) | (cw_state_mark == state ? CW_ELEMENTS_ATTRIBUTE_STATE_MARK : 0));
+	elements->chunks[i / CW_ELEMENTS_CHUNK_SIZE]->attributes[i % CW_ELEMENTS_CHUNK_SIZE] = attributes;
 }
 
 
@@ -84,14 +182,17 @@ cw_elements_t * cw_elements_new(size_t count)
 		return NULL;
 	}
 
-	elements->array = (cw_element_t *) calloc(count, sizeof (cw_element_t));
-	if (NULL == elements->array) {
+	elements->chunks_capacity = (count + CW_ELEMENTS_CHUNK_SIZE - 1) / CW_ELEMENTS_CHUNK_SIZE;
+	if (0 == elements->chunks_capacity) {
+		elements->chunks_capacity = 1;
+	}
+	elements->chunks = (cw_elements_chunk_t **) calloc(elements->chunks_capacity, sizeof (cw_elements_chunk_t *));
+	if (NULL == elements->chunks) {
 		free(elements);
-		fprintf(stderr, "[ERROR] Failed to allocate elements array\n");
+		fprintf(stderr, "[ERROR] Failed to allocate table of chunks of elements\n");
 		return NULL;
 	}
 
-	elements->max_count = count;
 	return elements;
 }
 
@@ -103,9 +204,12 @@ void cw_elements_delete(cw_elements_t ** elements)
 	if (NULL == elements || NULL == *elements) {
 		return;
 	}
-	if ((*elements)->array) {
-		free((*elements)->array);
-		(*elements)->array = NULL;
+	if ((*elements)->chunks) {
+		for (size_t c = 0; c < (*elements)->chunks_count; c++) {
+			free((*elements)->chunks[c]);
+		}
+		free((*elements)->chunks);
+		(*elements)->chunks = NULL;
 	}
 	free(*elements);
 	*elements = NULL;
@@ -114,6 +218,38 @@ void cw_elements_delete(cw_elements_t ** elements)
 
 
 
+/**
+   @brief Add one chunk of storage to elements structure
+
+   @param[in/out] elements Elements structure to grow
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_elements_grow(cw_elements_t * elements)
+{
+	if (elements->chunks_count == elements->chunks_capacity) {
+		const size_t new_capacity = 2 * elements->chunks_capacity;
+		cw_elements_chunk_t ** new_chunks = (cw_elements_chunk_t **) realloc(elements->chunks, new_capacity * sizeof (cw_elements_chunk_t *));
+		if (NULL == new_chunks) {
+			return -1;
+		}
+		elements->chunks = new_chunks;
+		elements->chunks_capacity = new_capacity;
+	}
+
+	cw_elements_chunk_t * chunk = (cw_elements_chunk_t *) malloc(sizeof (cw_elements_chunk_t));
+	if (NULL == chunk) {
+		return -1;
+	}
+	elements->chunks[elements->chunks_count] = chunk;
+	elements->chunks_count++;
+	return 0;
+}
+
+
+
+
 char cw_element_type_get_representation(cw_element_type_t type)
 {
 	switch (type) {
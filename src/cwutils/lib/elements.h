@@ -4,6 +4,7 @@
 
 
 
+#include <stdint.h>
 #include <stdio.h>
 
 
@@ -64,6 +65,8 @@ typedef double cw_element_time_t;  /* microseconds */
 
 
 
+/* A single element. Elements aren't stored in cw_elements_t in this form,
+   use cw_elements_get_element() to get a copy of element. */
 typedef struct cw_element_t {
 	cw_element_time_t timespan;   /* [microseconds]. Duration of element, with float type. The name of the field is chosen to be different than "duration" which has integer type. */
 	cw_element_type_t type;
@@ -73,10 +76,49 @@ typedef struct cw_element_t {
 
 
 
+/* Count of elements in one chunk of cw_elements_t. */
+#define CW_ELEMENTS_CHUNK_SIZE 1024
+
+/* Packing of type and state of element into one byte of
+   cw_elements_chunk_t::attributes. */
+#define CW_ELEMENTS_ATTRIBUTE_STATE_MARK 0x80
+#define CW_ELEMENTS_ATTRIBUTE_TYPE_MASK  0x7f
+
+
+
+
+/*
+  Chunk of storage of elements.
+
+  Elements are stored as structure of arrays: timespans in one array, types
+  and states packed into one byte per element in another array. This takes
+  9 bytes per element instead of 16 bytes of cw_element_t.
+*/
+typedef struct cw_elements_chunk_t {
+	cw_element_time_t timespans[CW_ELEMENTS_CHUNK_SIZE];
+	uint8_t attributes[CW_ELEMENTS_CHUNK_SIZE];    /* Type of element in lower bits, state in highest bit. */
+} cw_elements_chunk_t;
+
+
+
+
+/*
+  Growable collection of elements.
+
+  Elements are stored in chunks of fixed size. New chunk is allocated when
+  existing chunks are full, so appending elements never fails because of
+  lack of pre-allocated space, and elements are never moved in memory when
+  the collection grows. Only the small table of pointers to chunks is
+  re-allocated.
+
+  Access the elements only through cw_elements_get_*() and
+  cw_elements_set_*() functions.
+*/
 typedef struct cw_elements_t {
-	cw_element_t * array;
-	size_t max_count;
-	size_t curr_count;
+	cw_elements_chunk_t ** chunks;
+	size_t chunks_count;      /* Count of allocated chunks. */
+	size_t chunks_capacity;   /* Size of 'chunks' table. */
+	size_t curr_count;        /* Count of elements in the collection. Read-only for users of the collection. */
 } cw_elements_t;
 
 
@@ -86,10 +128,9 @@ typedef struct cw_elements_t {
    @brief Append new element to structure of elements
 
    Create new element that has given @p state and given @p duration. Add it
-   to end of @p elements.
+   to end of @p elements. Type of the new element is cw_element_type_none.
 
-   Function may fail if there is not enough space in @p elements for new
-   element.
+   Function may fail if memory for new chunk of elements can't be allocated.
 
    @reviewedon 2023.08.12
 
@@ -105,18 +146,84 @@ int cw_elements_append_element(cw_elements_t * elements, cw_state_t state, cw_el
 
 
 
+/**
+   @brief Append new element of given type to structure of elements
+
+   @param[in/out] elements Elements structure to which to append new element
+   @param[in] type Type of the new element
+   @param[in] state State of the new element
+   @param[in] timespan Duration of the new element
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_append_typed_element(cw_elements_t * elements, cw_element_type_t type, cw_state_t state, cw_element_time_t timespan);
+
+
+
+
+/**
+   @brief Append copies of all elements of one structure to another one
+
+   @param[in/out] elements Elements structure to which to append elements
+   @param[in] source Elements structure from which to copy elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_append_elements(cw_elements_t * elements, const cw_elements_t * source);
+
+
+
+
+/**
+   @brief Get copy of element at given position
+
+   @param[in] elements Elements structure
+   @param[in] i Index of element, smaller than cw_elements_t::curr_count
+   @param[out] element Copy of element
+*/
+void cw_elements_get_element(const cw_elements_t * elements, size_t i, cw_element_t * element);
+
+cw_element_time_t cw_elements_get_timespan(const cw_elements_t * elements, size_t i);
+cw_element_type_t cw_elements_get_type(const cw_elements_t * elements, size_t i);
+cw_state_t cw_elements_get_state(const cw_elements_t * elements, size_t i);
+
+/**
+   @brief Modify duration of element at given position
+
+   @param[in/out] elements Elements structure
+   @param[in] i Index of element, smaller than cw_elements_t::curr_count
+   @param[in] timespan New duration of element
+*/
+void cw_elements_set_timespan(cw_elements_t * elements, size_t i, cw_element_time_t timespan);
+
+/**
+   @brief Modify type and state of element at given position
+
+   @param[in/out] elements Elements structure
+   @param[in] i Index of element, smaller than cw_elements_t::curr_count
+   @param[in] type New type of element
+   @param[in] state New state of element
+*/
+void cw_elements_set_type_and_state(cw_elements_t * elements, size_t i, cw_element_type_t type, cw_state_t state);
+
+
+
+
 /**
    @brief Constructor of new elements structure
 
-   The structure will have pre-allocated space for @p count elements.
+   The structure will have pre-allocated space for pointers to chunks
+   holding at least @p count elements. The structure grows as needed when
+   more elements are appended, so @p count is only a hint.
 
    Use cw_elements_delete() to de-allocate the structure returned by this
    function.
 
    @reviewedon 2023.08.12
 
-   @param[in] count Count of elements that the allocated structure will be able
-   to hold.
+   @param[in] count Expected count of elements in the structure
 
    @return Newly allocated elements structure on success
    @return NULL on failure
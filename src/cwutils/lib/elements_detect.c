@@ -18,10 +18,12 @@
 
 
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <libcw.h>
@@ -29,6 +31,7 @@
 
 #include "elements.h"
 #include "elements_detect.h"
+#include "wav_reader.h"
 
 
 
@@ -50,100 +53,133 @@
   luck). Anything in between is "can't decide".
 */
 #define STATE_MEMORY_SIZE 4
-typedef struct state_memory_t {
-	/* int32_t allows me to use INT32_MAX as "sample not initialized yet"
-	   value. Samples are int16_t, so INT32_MAX can't occur as a valid value
-	   of sample. */
-	int32_t samples[STATE_MEMORY_SIZE];
 
-	/* How many samples to consider when detecting state? This value could be
-	   dynamically changed in the future: could be larger at the beginning,
-	   and later decreased. */
-	int compare_count;
-} state_memory_t;
+/* Samples are classified in chunks of 64 samples: one bit of 64-bit mask
+   per sample. */
+#define CHUNK_N_SAMPLES 64
 
+/* Samples are read from file in blocks of this size (a multiple of
+   CHUNK_N_SAMPLES), instead of one sample per read(). */
+#define BLOCK_N_SAMPLES (CHUNK_N_SAMPLES * 256)
 
 
 
-static bool state_detect(state_memory_t * memory, cw_sample_t sample, cw_state_t * state);
-static void state_init_memory(state_memory_t * memory);
 
+/* State of detection of elements, carried over from one chunk of samples
+   to next one. */
+typedef struct detector_t {
+	/* Masks of zero and non-zero samples in previous chunk. Zero-initialized
+	   masks at the beginning of file mean that there is no history of
+	   samples, so first STATE_MEMORY_SIZE-1 samples don't detect any
+	   state. */
+	uint64_t prev_zeros;
+	uint64_t prev_non_zeros;
 
+	/* Index of first sample of current chunk in file. */
+	size_t sample_i;
 
+	cw_element_time_t sample_spacing;
+	bool beginning_of_file;
 
-
-int cw_elements_detect_from_wav(int input_fd, cw_elements_t * elements, cw_element_time_t sample_spacing)
-{
 	/* Time stamp of start of previous element. Zero time stamp is at the
 	   beginning of pcm file. */
-	cw_element_time_t prev_element_start_ts = 0.0;
-
-	cw_state_t prev_state = cw_state_space;
-	cw_state_t current_state = cw_state_space;
-
-	size_t sample_i = 0;
-	cw_sample_t sample = 0;
-	bool beginning_of_file = true;
-
-	state_memory_t state_memory;
-	state_init_memory(&state_memory);
-
-	while (0 != read(input_fd, &sample, sizeof (sample))) {
-		bool detected = state_detect(&state_memory, sample, &current_state);
-		if (!detected) {
-			/* Current state of wave in samples can't be detected. Either we
-			   are at the beginning of file, or wave is in transition between
-			   mark/space. */
-			sample_i++;
-			continue;
-		}
+	cw_element_time_t prev_element_start_ts;
+	cw_state_t prev_state;
 
-		if (beginning_of_file) {
-			/* Special case for beginning of file. */
-			fprintf(stderr, "[DEBUG] Detected initial state %s\n", current_state == cw_state_mark ? "mark" : "space");
+	/* Where to put detected elements. */
+	cw_elements_sink_t sink;
+	void * sink_arg;
+} detector_t;
 
-			beginning_of_file = false;
-			const cw_element_time_t current_timestamp = sample_i * sample_spacing;
 
-			prev_element_start_ts = current_timestamp;
-			prev_state = current_state;
-		} else {
-			if (current_state != prev_state) {
-				fprintf(stderr, "[DEBUG] Detected transition to %s\n", current_state == cw_state_mark ? "mark" : "space");
-
-				/* We have just detected change of state. We now know how
-				   long the previous state lasted, and we need to save
-				   the duration of the previous state, and the previous
-				   state itself. Therefore we pass 'prev_state' to
-				   cw_elements_append_element() below. */
-				const cw_element_time_t current_timestamp = sample_i * sample_spacing;
-				const cw_element_time_t prev_duration = current_timestamp - prev_element_start_ts;
-				if (0 != cw_elements_append_element(elements, prev_state, prev_duration)) {
-					fprintf(stderr, "[ERROR] Failed to append element from wav\n");
-					return -1;
-				}
 
-				prev_element_start_ts = current_timestamp;
-				prev_state = current_state;
+
+static uint64_t runs_mask(uint64_t mask, uint64_t prev_mask);
+static void detector_init(detector_t * detector, cw_element_time_t sample_spacing, cw_elements_sink_t sink, void * sink_arg);
+static int detector_finish(detector_t * detector);
+static int detect_in_chunk(detector_t * detector, uint64_t zeros, size_t n_samples);
+static int append_transition(detector_t * detector, cw_state_t state, size_t sample_i);
+static int append_to_elements(void * sink_arg, cw_state_t state, cw_element_time_t timespan);
+
+
+
+
+
+int cw_elements_detect_from_wav(int input_fd, cw_elements_t * elements, cw_element_time_t sample_spacing)
+{
+	detector_t detector;
+	detector_init(&detector, sample_spacing, append_to_elements, elements);
+
+	cw_sample_t block[BLOCK_N_SAMPLES];
+	size_t n_bytes = 0; /* Count of bytes in block, waiting to be processed. */
+	bool end_of_file = false;
+
+	while (!end_of_file) {
+		const ssize_t n_read = read(input_fd, ((char *) block) + n_bytes, sizeof (block) - n_bytes);
+		if (n_read < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			fprintf(stderr, "[ERROR] Failed to read samples from wav: %s\n", strerror(errno));
+			return -1;
+		}
+		end_of_file = 0 == n_read;
+		n_bytes += (size_t) n_read;
+
+		/* Only full chunks are processed, unless this is the end of
+		   file. Incomplete trailing sample is ignored. */
+		const size_t n_samples = n_bytes / sizeof (cw_sample_t);
+		const size_t n_to_process = end_of_file ? n_samples : n_samples - (n_samples % CHUNK_N_SAMPLES);
+		for (size_t i = 0; i < n_to_process; i += CHUNK_N_SAMPLES) {
+			const size_t n = n_to_process - i < CHUNK_N_SAMPLES ? n_to_process - i : CHUNK_N_SAMPLES;
+			uint64_t zeros = 0;
+			for (size_t s = 0; s < n; s++) {
+				zeros |= ((uint64_t) (0 == block[i + s])) << s;
+			}
+			if (0 != detect_in_chunk(&detector, zeros, n)) {
+				return -1;
 			}
 		}
-		sample_i++;
+
+		const size_t n_processed_bytes = n_to_process * sizeof (cw_sample_t);
+		memmove(block, ((char *) block) + n_processed_bytes, n_bytes - n_processed_bytes);
+		n_bytes -= n_processed_bytes;
 	}
 
-	/* Special case for end of file. Current state and its duration was never
-	   saved (because in the loop we always saved previous state). Now we
-	   have to save the last element found in file - the current state and
-	   its duration. The file has just ended, and so the current element
-	   ends. This ending of current element must be reflected in
-	   'elements'. */
-	const cw_element_time_t current_timestamp = sample_i * sample_spacing; /* TODO: "sample_i" or "sample_i - 1"? */
-	const cw_element_time_t current_timespan = current_timestamp - prev_element_start_ts;
-	if (0 != cw_elements_append_element(elements, current_state, current_timespan)) {
-		fprintf(stderr, "[ERROR] Failed to append last element from wav\n");
-		return -1;
+	return detector_finish(&detector);
+}
+
+
+
+
+int cw_elements_detect_from_wav_reader(const wav_reader_t * reader, unsigned int channel, cw_elements_t * elements)
+{
+	return cw_elements_detect_from_wav_reader_to_sink(reader, channel, append_to_elements, elements);
+}
+
+
+
+
+int cw_elements_detect_from_wav_reader_to_sink(const wav_reader_t * reader, unsigned int channel, cw_elements_sink_t sink, void * sink_arg)
+{
+	detector_t detector;
+	detector_init(&detector, (1000.0 * 1000.0) / reader->sample_rate, sink, sink_arg);
+
+	for (uint64_t frame = 0; frame < reader->n_frames; frame += CHUNK_N_SAMPLES) {
+		wav_span_t span;
+		if (0 != wav_reader_get_span(reader, frame, CHUNK_N_SAMPLES, channel, &span)) {
+			return -1;
+		}
+		uint64_t zeros = 0;
+		for (size_t s = 0; s < span.n_samples; s++) {
+			zeros |= ((uint64_t) wav_span_sample_is_zero(&span, s)) << s;
+		}
+		if (0 != detect_in_chunk(&detector, zeros, span.n_samples)) {
+			return -1;
+		}
 	}
 
-	return 0;
+	return detector_finish(&detector);
 }
 
 
@@ -151,25 +187,23 @@ int cw_elements_detect_from_wav(int input_fd, cw_elements_t * elements, cw_eleme
 
 int cw_elements_detect_from_string(const char * string, cw_elements_t * elements)
 {
-	size_t e = 0;
-
 	int s = 0;
 	while (string[s] != '\0') {
+		const size_t e = elements->curr_count;
 
 		if (string[s] == ' ') {
 			/* ' ' character is represented by iws. This is a special case
 			   because this character doesn't have its "natural"
 			   representation in form of dots and dashes. */
-			if (e > 0 && (elements->array[e - 1].type == cw_element_type_ims || elements->array[e - 1].type == cw_element_type_ics)) {
+			if (e > 0 && (cw_elements_get_type(elements, e - 1) == cw_element_type_ims || cw_elements_get_type(elements, e - 1) == cw_element_type_ics)) {
 				/* Overwrite last end-of-element: space changes its type to
 				   iws */
-				elements->array[e - 1].type = cw_element_type_iws;
-				elements->array[e - 1].state = cw_state_space;
-				/* No need to increment 'e' as we are not adding new element. */
+				cw_elements_set_type_and_state(elements, e - 1, cw_element_type_iws, cw_state_space);
+				/* No need to append new element. */
 			} else {
-				elements->array[e].type = cw_element_type_iws;
-				elements->array[e].state = cw_state_space;
-				e++;
+				if (0 != cw_elements_append_typed_element(elements, cw_element_type_iws, cw_state_space, 0.0)) {
+					return -1;
+				}
 			}
 		} else {
 			/* Regular (non-space) character has its Morse representation.
@@ -178,41 +212,24 @@ int cw_elements_detect_from_string(const char * string, cw_elements_t * elements
 			const char * representation = cw_character_to_representation_internal(string[s]);
 			int r = 0;
 			while (representation[r] != '\0') {
-				switch (representation[r]) {
-				case '.':
-					elements->array[e].type = cw_element_type_dot;
-					elements->array[e].state = cw_state_mark;
-					break;
-				case '-':
-					elements->array[e].type = cw_element_type_dash;
-					elements->array[e].state = cw_state_mark;
-					break;
-				default:
-					break;
-				};
+				const cw_element_type_t type = representation[r] == '.' ? cw_element_type_dot : cw_element_type_dash;
+				if (0 != cw_elements_append_typed_element(elements, type, cw_state_mark, 0.0)) {
+					return -1;
+				}
+				if (0 != cw_elements_append_typed_element(elements, cw_element_type_ims, cw_state_space, 0.0)) {
+					return -1;
+				}
 				r++;
-				e++;
-				elements->array[e].type = cw_element_type_ims;
-				elements->array[e].state = cw_state_space;
-				e++;
-
 			}
 			/* Turn ims after last mark (the last mark in character) into ics. */
-			elements->array[e - 1].type = cw_element_type_ics;
-			elements->array[e - 1].state = cw_state_space;
+			cw_elements_set_type_and_state(elements, elements->curr_count - 1, cw_element_type_ics, cw_state_space);
 		}
 		s++;
 	}
 
-	if (e > elements->max_count) {
-		fprintf(stderr, "[ERROR] Count of elements (%zu) exceeds available space (%zu)\n", e, elements->max_count);
-		return -1;
-	}
-	elements->curr_count = e;
-
 #if 0 /* For debugging only. */
 	for (size_t i = 0; i < elements->curr_count; i++) {
-		fprintf(stderr, "[DEBUG] Initialized element %3zd with type '%c'\n", i, cw_element_type_get_representation(elements->array[i].type));
+		fprintf(stderr, "[DEBUG] Initialized element %3zd with type '%c'\n", i, cw_element_type_get_representation(cw_elements_get_type(elements, i)));
 	}
 #endif
 
@@ -223,89 +240,193 @@ int cw_elements_detect_from_string(const char * string, cw_elements_t * elements
 
 
 /**
-   @brief Detect current state of sound in set of samples
+   @brief Initialize state of detection, before first sample is processed
 
-   Look at current @p sample, look at past samples saved in @p memory, and
-   decide if there is no sound (@p state will be set cw_state_space) or a
-   sound (@p will be set to CW_SPACE_MARK).
+   @param[out] detector state of detection
+   @param[in] sample_spacing Time span between consecutive samples
+   @param[in] sink Function to be called for each detected element
+   @param[in] sink_arg Argument to be passed to @p sink
+*/
+static void detector_init(detector_t * detector, cw_element_time_t sample_spacing, cw_elements_sink_t sink, void * sink_arg)
+{
+	memset(detector, 0, sizeof (detector_t));
+	detector->sample_spacing = sample_spacing;
+	detector->beginning_of_file = true;
+	detector->prev_element_start_ts = 0.0;
+	detector->prev_state = cw_state_space;
+	detector->sink = sink;
+	detector->sink_arg = sink_arg;
+}
 
-   Function may be unable to detect either mark or space - this can happen if
-   @p memory didn't accumulate enough data, or if @p memory together with @p
-   sample indicate that a samples are transitioning between silence and
-   sound.
 
-   @reviewedon 2023.08.12
 
-   @param[in/out] memory memory of past samples, updated by this function
-   @param[in] sample current sample to be used together with @p memory in evaluation of sound in samples
-   @param[out] state state of sound, will be set if function will detect a mark or space.
 
-   @return true if some state has been detected (@p state is updated accordingly)
-   @return false otherwise (@p state is not updated)
+/**
+   @brief Append last element, after last sample has been processed
+
+   @param[in] detector state of detection
+
+   @return 0 on success
+   @return -1 on failure
 */
-static bool state_detect(state_memory_t * memory, cw_sample_t sample, cw_state_t * state)
+static int detector_finish(detector_t * detector)
 {
-	/* Update set of samples used for detection. Put latest sample on the
-	   front (from the left).
-
-	   Always update all STATE_MEMORY_SIZE samples, regardless of value of
-	   state_memory_t::compare_count. */
-	int i = 0;
-	for (i = STATE_MEMORY_SIZE - 1; i > 0; i--) {
-		memory->samples[i] = memory->samples[i - 1];
+	/* Special case for end of file. Current state and its duration was never
+	   saved (because in the loop we always saved previous state). Now we
+	   have to save the last element found in file - the current state and
+	   its duration. The file has just ended, and so the current element
+	   ends. This ending of current element must be reflected in
+	   'elements'. */
+	const cw_element_time_t current_timestamp = detector->sample_i * detector->sample_spacing; /* TODO: "sample_i" or "sample_i - 1"? */
+	const cw_element_time_t current_timespan = current_timestamp - detector->prev_element_start_ts;
+	if (0 != detector->sink(detector->sink_arg, detector->prev_state, current_timespan)) {
+		fprintf(stderr, "[ERROR] Failed to append last element from wav\n");
+		return -1;
 	}
-	memory->samples[i] = sample;
 
+	return 0;
+}
 
-	/* See if we have enough data to detect state. */
-	for (i = 0; i < memory->compare_count; i++) {
-		if (INT32_MAX == memory->samples[i]) {
-			/* We are still in the initial state. There is not enough valid
-			   accumulated samples to decide if state is 'mark' or
-			   'space'. */
-			return false;
-		}
+
+
+
+/**
+   @brief Find samples that end a run of STATE_MEMORY_SIZE samples of a kind
+
+   Bit N of @p mask is set if sample N of current chunk is of given kind
+   (zero or non-zero). Bit N of returned mask is set if sample N and
+   STATE_MEMORY_SIZE-1 samples preceding it are all of the kind. Samples
+   preceding the chunk are taken from @p prev_mask.
+
+   @param[in] mask mask of samples in current chunk
+   @param[in] prev_mask mask of samples in previous chunk
+
+   @return mask of samples at which state of the kind is detected
+*/
+static uint64_t runs_mask(uint64_t mask, uint64_t prev_mask)
+{
+	uint64_t result = mask;
+	for (int i = 1; i < STATE_MEMORY_SIZE; i++) {
+		result &= (mask << i) | (prev_mask >> (CHUNK_N_SAMPLES - i));
 	}
+	return result;
+}
+
+
+
+
+/**
+   @brief Detect transitions between mark and space in a chunk of samples
+
+   N consecutive zero samples mean space, N consecutive non-zero samples
+   mean mark, where N is STATE_MEMORY_SIZE. Anything else doesn't change
+   current state.
 
-	int zeros = 0;
-	int non_zeros = 0;
-	for (i = 0; i <memory->compare_count; i++) {
-		if (0 == memory->samples[i]) {
-			zeros++;
+   Caller classifies samples of the chunk into a mask of zero samples
+   (with a branch-free loop that the compiler can vectorize), and
+   transitions are then found with bit operations on the masks, without
+   visiting each sample again.
+
+   @param[in/out] detector state of detection
+   @param[in] zeros mask of zero samples in the chunk: bit N is set if sample N is zero
+   @param[in] n_samples count of samples in the chunk, not larger than CHUNK_N_SAMPLES
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int detect_in_chunk(detector_t * detector, uint64_t zeros, size_t n_samples)
+{
+	const uint64_t valid = CHUNK_N_SAMPLES == n_samples ? UINT64_MAX : (((uint64_t) 1) << n_samples) - 1;
+	const uint64_t non_zeros = ~zeros & valid;
+
+	const uint64_t spaces = runs_mask(zeros, detector->prev_zeros);
+	const uint64_t marks = runs_mask(non_zeros, detector->prev_non_zeros);
+	detector->prev_zeros = zeros;
+	detector->prev_non_zeros = non_zeros;
+
+	/* Samples before 'position' have been already checked. */
+	int position = 0;
+	while (position < (int) n_samples) {
+		const uint64_t not_checked = ~((((uint64_t) 1) << position) - 1);
+		uint64_t candidates;
+		if (detector->beginning_of_file) {
+			candidates = (spaces | marks) & not_checked;
+		} else if (cw_state_mark == detector->prev_state) {
+			candidates = spaces & not_checked;
 		} else {
-			non_zeros++;
+			candidates = marks & not_checked;
+		}
+		if (0 == candidates) {
+			break;
 		}
-	}
 
-	if (memory->compare_count == zeros) {
-		*state = cw_state_space; /* N consecutive zeros mean a space. */
-		return true;
-	}
-	if (memory->compare_count == non_zeros) {
-		*state = cw_state_mark; /* N consecutive non-zeros mean a mark. */
-		return true;
+		const int bit = __builtin_ctzll(candidates);
+		const cw_state_t state = (spaces >> bit) & 1 ? cw_state_space : cw_state_mark;
+		if (0 != append_transition(detector, state, detector->sample_i + (size_t) bit)) {
+			return -1;
+		}
+		position = bit + 1;
 	}
 
-	return false; /* mark/space state was not recognized. */
+	detector->sample_i += n_samples;
+	return 0;
 }
 
 
 
 
 /**
-   @brief Initialize 'state memory' data structure
+   @brief Handle detection of initial state, or of change of state
 
-   Initialize the structure that will be later passed to
-   state_detect() in a loop.
+   @param[in/out] detector state of detection
+   @param[in] state detected state
+   @param[in] sample_i index of sample at which the state has been detected
 
-   @param[in/out] memory data structure to initialize
+   @return 0 on success
+   @return -1 on failure
 */
-static void state_init_memory(state_memory_t * memory)
+static int append_transition(detector_t * detector, cw_state_t state, size_t sample_i)
 {
-	for (int i = 0; i < STATE_MEMORY_SIZE; i++) {
-		memory->samples[i] = INT32_MAX;
+	const cw_element_time_t current_timestamp = sample_i * detector->sample_spacing;
+
+	if (detector->beginning_of_file) {
+		/* Special case for beginning of file. */
+		fprintf(stderr, "[DEBUG] Detected initial state %s\n", state == cw_state_mark ? "mark" : "space");
+		detector->beginning_of_file = false;
+	} else {
+		fprintf(stderr, "[DEBUG] Detected transition to %s\n", state == cw_state_mark ? "mark" : "space");
+
+		/* We have just detected change of state. We now know how
+		   long the previous state lasted, and we need to save
+		   the duration of the previous state, and the previous
+		   state itself. Therefore we pass 'prev_state' to
+		   the sink below. */
+		const cw_element_time_t prev_duration = current_timestamp - detector->prev_element_start_ts;
+		if (0 != detector->sink(detector->sink_arg, detector->prev_state, prev_duration)) {
+			fprintf(stderr, "[ERROR] Failed to append element from wav\n");
+			return -1;
+		}
 	}
 
-	memory->compare_count = STATE_MEMORY_SIZE;
+	detector->prev_element_start_ts = current_timestamp;
+	detector->prev_state = state;
+	return 0;
 }
 
+
+
+
+/**
+   @brief Sink of detected elements that appends the elements to cw_elements_t
+
+   @param[in/out] sink_arg elements structure (cw_elements_t *)
+   @param[in] state state of detected element
+   @param[in] timespan duration of detected element
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int append_to_elements(void * sink_arg, cw_state_t state, cw_element_time_t timespan)
+{
+	return cw_elements_append_element((cw_elements_t *) sink_arg, state, timespan);
+}
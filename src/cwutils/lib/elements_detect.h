@@ -5,6 +5,24 @@
 
 
 #include "elements.h"
+#include "wav_reader.h"
+
+
+
+
+/**
+   @brief Function receiving elements detected in wav file
+
+   Called once for each detected element, in order of the elements.
+
+   @param[in] sink_arg Argument passed by caller of detection function
+   @param[in] state State of detected element
+   @param[in] timespan Duration of detected element
+
+   @return 0 on success
+   @return -1 on failure (detection is then stopped)
+*/
+typedef int (* cw_elements_sink_t)(void * sink_arg, cw_state_t state, cw_element_time_t timespan);
 
 
 
@@ -18,14 +36,13 @@
 
    Each new element is set on each detected change between mark and space.
 
-   @p elements is a preallocated array of elements. Size of the array must be
-   somehow guessed in advance, before this function is called (it's ok to
-   over-estimate the size).
+   Elements are appended to @p elements, which grows as needed, so
+   recordings of any length can be processed.
 
    @reviewedon 2023.08.12
 
    @param[in] input_fd File descriptor from which to read samples
-   @param[out] elements Pre-allocated elements structure into which to save elements
+   @param[out] elements Elements structure to which to append elements
    @param[in] sample_spacing Time span between consecutive samples
 
    @return 0 on success
@@ -36,6 +53,46 @@ int cw_elements_detect_from_wav(int input_fd, cw_elements_t * elements, cw_eleme
 
 
 
+/**
+   @brief Detect elements in one channel of wav file opened with wav reader
+
+   Function works like cw_elements_detect_from_wav(), but gets samples from
+   memory-mapped file, so it can process recordings with any format of
+   samples supported by the reader, with any count of channels, and of any
+   size. Spacing of samples is taken from sample rate of the file.
+
+   @param[in] reader Opened reader of wav file
+   @param[in] channel Index of channel in which to detect elements
+   @param[out] elements Elements structure to which to append elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_detect_from_wav_reader(const wav_reader_t * reader, unsigned int channel, cw_elements_t * elements);
+
+
+
+
+/**
+   @brief Detect elements in one channel of wav file, pass them to a sink
+
+   Function works like cw_elements_detect_from_wav_reader(), but each
+   element is passed to @p sink as soon as it's detected instead of being
+   collected in memory.
+
+   @param[in] reader Opened reader of wav file
+   @param[in] channel Index of channel in which to detect elements
+   @param[in] sink Function to be called for each detected element
+   @param[in] sink_arg Argument to be passed to @p sink
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_detect_from_wav_reader_to_sink(const wav_reader_t * reader, unsigned int channel, cw_elements_sink_t sink, void * sink_arg);
+
+
+
+
 /**
    @brief Detect elements in given string
 
@@ -0,0 +1,449 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elements_log.h"
+
+
+
+
+/**
+   \file elements_log.c
+
+   Compact binary log of elements, see elements_log.h for description of
+   format.
+
+   Text written by cw_elements_print_to_file() takes ~30 bytes per element
+   and must be parsed with scanf-like functions. A binary log takes 2-4
+   bytes per element for typical durations, and can be decoded straight
+   from memory mapping of file.
+*/
+
+
+
+
+#define LOG_MAGIC "CWEL"
+#define LOG_VERSION 1
+
+
+
+
+static void put_le16(uint8_t * p, uint16_t value);
+static void put_le32(uint8_t * p, uint32_t value);
+static uint16_t get_le16(const uint8_t * p);
+static uint32_t get_le32(const uint8_t * p);
+static int cw_elements_log_writer_flush_chunk(cw_elements_log_writer_t * writer);
+static int cw_elements_log_reader_parse_header(cw_elements_log_reader_t * reader);
+
+
+
+
+int cw_elements_log_writer_open(cw_elements_log_writer_t * writer, FILE * file, uint32_t sample_rate)
+{
+	if (0 == sample_rate) {
+		fprintf(stderr, "[ERROR] Invalid sample rate of elements log: %u\n", sample_rate);
+		return -1;
+	}
+
+	writer->file = file;
+	writer->sample_rate = sample_rate;
+	writer->samples_per_microsecond = sample_rate / (1000.0 * 1000.0);
+	writer->count = 0;
+	writer->size = 0;
+	writer->error = 0;
+
+	uint8_t header[CW_ELEMENTS_LOG_HEADER_SIZE] = { 0 };
+	memcpy(header, LOG_MAGIC, 4);
+	put_le16(header + 4, LOG_VERSION);
+	put_le16(header + 6, 0);
+	put_le32(header + 8, sample_rate);
+	put_le32(header + 12, 0);
+	if (1 != fwrite(header, sizeof (header), 1, file)) {
+		fprintf(stderr, "[ERROR] Failed to write header of elements log: %s\n", strerror(errno));
+		writer->error = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
+int cw_elements_log_writer_append(cw_elements_log_writer_t * writer, cw_element_type_t type, cw_state_t state, cw_element_time_t timespan)
+{
+	if (writer->error) {
+		return -1;
+	}
+
+	uint64_t samples = 0;
+	if (timespan > 0.0) {
+		samples = (uint64_t) llround(timespan * writer->samples_per_microsecond);
+	}
+
+	uint8_t * p = writer->payload + writer->size;
+	*p++ = (uint8_t) ((type & CW_ELEMENTS_ATTRIBUTE_TYPE_MASK) | (cw_state_mark == state ? CW_ELEMENTS_ATTRIBUTE_STATE_MARK : 0));
+	while (samples >= 0x80) {
+		*p++ = (uint8_t) (samples | 0x80);
+		samples >>= 7;
+	}
+	*p++ = (uint8_t) samples;
+
+	writer->size = (size_t) (p - writer->payload);
+	writer->count++;
+
+	if (CW_ELEMENTS_LOG_CHUNK_SIZE == writer->count) {
+		return cw_elements_log_writer_flush_chunk(writer);
+	}
+	return 0;
+}
+
+
+
+
+int cw_elements_log_writer_close(cw_elements_log_writer_t * writer)
+{
+	if (0 != cw_elements_log_writer_flush_chunk(writer)) {
+		return -1;
+	}
+	if (0 != fflush(writer->file)) {
+		fprintf(stderr, "[ERROR] Failed to flush elements log: %s\n", strerror(errno));
+		writer->error = -1;
+		return -1;
+	}
+	return 0;
+}
+
+
+
+
+int cw_elements_log_write(FILE * file, const cw_elements_t * elements, uint32_t sample_rate)
+{
+	cw_elements_log_writer_t * writer = (cw_elements_log_writer_t *) malloc(sizeof (cw_elements_log_writer_t));
+	if (NULL == writer) {
+		fprintf(stderr, "[ERROR] Failed to allocate writer of elements log\n");
+		return -1;
+	}
+
+	int retval = cw_elements_log_writer_open(writer, file, sample_rate);
+	for (size_t i = 0; 0 == retval && i < elements->curr_count; i++) {
+		cw_element_t element;
+		cw_elements_get_element(elements, i, &element);
+		retval = cw_elements_log_writer_append(writer, element.type, element.state, element.timespan);
+	}
+	if (0 == retval) {
+		retval = cw_elements_log_writer_close(writer);
+	}
+
+	free(writer);
+	return retval;
+}
+
+
+
+
+int cw_elements_log_reader_open(cw_elements_log_reader_t * reader, const char * path)
+{
+	memset(reader, 0, sizeof (cw_elements_log_reader_t));
+	reader->fd = -1;
+
+	reader->fd = open(path, O_RDONLY);
+	if (-1 == reader->fd) {
+		fprintf(stderr, "[ERROR] Can't open elements log '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (0 != fstat(reader->fd, &st)) {
+		fprintf(stderr, "[ERROR] Can't get size of elements log '%s': %s\n", path, strerror(errno));
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+	if (st.st_size < CW_ELEMENTS_LOG_HEADER_SIZE) {
+		fprintf(stderr, "[ERROR] Elements log '%s' is too short: %jd bytes\n", path, (intmax_t) st.st_size);
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+	if ((uint64_t) st.st_size > SIZE_MAX) {
+		fprintf(stderr, "[ERROR] Elements log '%s' is too large to be mapped into memory\n", path);
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+
+	void * map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "[ERROR] Can't map elements log '%s': %s\n", path, strerror(errno));
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+	reader->map = map;
+	reader->map_size = (size_t) st.st_size;
+
+	/* Elements are decoded from beginning to end of file. */
+	madvise(map, reader->map_size, MADV_SEQUENTIAL);
+
+	reader->data = (const uint8_t *) map;
+	reader->size = reader->map_size;
+	if (0 != cw_elements_log_reader_parse_header(reader)) {
+		fprintf(stderr, "[ERROR] Invalid header of elements log '%s'\n", path);
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
+int cw_elements_log_reader_open_memory(cw_elements_log_reader_t * reader, const void * data, size_t size)
+{
+	memset(reader, 0, sizeof (cw_elements_log_reader_t));
+	reader->fd = -1;
+	reader->data = (const uint8_t *) data;
+	reader->size = size;
+
+	if (NULL == data || 0 != cw_elements_log_reader_parse_header(reader)) {
+		fprintf(stderr, "[ERROR] Invalid header of elements log\n");
+		cw_elements_log_reader_close(reader);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
+void cw_elements_log_reader_close(cw_elements_log_reader_t * reader)
+{
+	if (NULL != reader->map) {
+		munmap(reader->map, reader->map_size);
+		reader->map = NULL;
+		reader->map_size = 0;
+	}
+	if (-1 != reader->fd) {
+		close(reader->fd);
+		reader->fd = -1;
+	}
+	reader->data = NULL;
+	reader->size = 0;
+	reader->next_chunk = 0;
+	reader->cursor = NULL;
+	reader->chunk_end = NULL;
+	reader->chunk_remaining = 0;
+}
+
+
+
+
+int cw_elements_log_reader_next(cw_elements_log_reader_t * reader, cw_element_t * element)
+{
+	while (0 == reader->chunk_remaining) {
+		if (reader->next_chunk == reader->size) {
+			return 0;
+		}
+		if (reader->size - reader->next_chunk < CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE) {
+			fprintf(stderr, "[ERROR] Truncated header of chunk in elements log at offset %zu\n", reader->next_chunk);
+			return -1;
+		}
+		const uint8_t * header = reader->data + reader->next_chunk;
+		const uint32_t count = get_le32(header);
+		const uint32_t payload_size = get_le32(header + 4);
+		const size_t available = reader->size - reader->next_chunk - CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE;
+		if (count > CW_ELEMENTS_LOG_CHUNK_SIZE || payload_size > available) {
+			fprintf(stderr, "[ERROR] Invalid chunk in elements log at offset %zu: %u elements, %u bytes\n",
+				reader->next_chunk, count, payload_size);
+			return -1;
+		}
+		reader->cursor = header + CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE;
+		reader->chunk_end = reader->cursor + payload_size;
+		reader->chunk_remaining = count;
+		reader->next_chunk += CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE + payload_size;
+	}
+
+	const uint8_t * p = reader->cursor;
+	if (p == reader->chunk_end) {
+		fprintf(stderr, "[ERROR] Payload of chunk in elements log is too short\n");
+		return -1;
+	}
+	const uint8_t attributes = *p++;
+
+	uint64_t samples = 0;
+	unsigned int shift = 0;
+	for (;;) {
+		if (p == reader->chunk_end || shift > 63) {
+			fprintf(stderr, "[ERROR] Invalid duration in elements log\n");
+			return -1;
+		}
+		const uint8_t byte = *p++;
+		samples |= (uint64_t) (byte & 0x7f) << shift;
+		if (0 == (byte & 0x80)) {
+			break;
+		}
+		shift += 7;
+	}
+
+	reader->cursor = p;
+	reader->chunk_remaining--;
+	if (0 == reader->chunk_remaining && reader->cursor != reader->chunk_end) {
+		fprintf(stderr, "[ERROR] Payload of chunk in elements log is too long\n");
+		return -1;
+	}
+
+	element->type = (cw_element_type_t) (attributes & CW_ELEMENTS_ATTRIBUTE_TYPE_MASK);
+	element->state = (attributes & CW_ELEMENTS_ATTRIBUTE_STATE_MARK) ? cw_state_mark : cw_state_space;
+	element->timespan = (cw_element_time_t) samples * reader->sample_spacing;
+
+	return 1;
+}
+
+
+
+
+int cw_elements_log_reader_read_all(cw_elements_log_reader_t * reader, cw_elements_t * elements)
+{
+	cw_element_t element;
+	int retval = 0;
+	while (1 == (retval = cw_elements_log_reader_next(reader, &element))) {
+		if (0 != cw_elements_append_typed_element(elements, element.type, element.state, element.timespan)) {
+			fprintf(stderr, "[ERROR] Failed to append element read from elements log\n");
+			return -1;
+		}
+	}
+	return retval;
+}
+
+
+
+
+/**
+   @brief Write current chunk to file, start new chunk
+
+   Empty chunk is not written.
+
+   @param[in/out] writer Opened writer
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_elements_log_writer_flush_chunk(cw_elements_log_writer_t * writer)
+{
+	if (writer->error) {
+		return -1;
+	}
+	if (0 == writer->count) {
+		return 0;
+	}
+
+	uint8_t header[CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE];
+	put_le32(header, writer->count);
+	put_le32(header + 4, (uint32_t) writer->size);
+	if (1 != fwrite(header, sizeof (header), 1, writer->file)
+	    || 1 != fwrite(writer->payload, writer->size, 1, writer->file)) {
+		fprintf(stderr, "[ERROR] Failed to write chunk of elements log: %s\n", strerror(errno));
+		writer->error = -1;
+		return -1;
+	}
+
+	writer->count = 0;
+	writer->size = 0;
+	return 0;
+}
+
+
+
+
+/**
+   @brief Validate header of log, prepare reader for reading first chunk
+
+   @param[in/out] reader Reader with cw_elements_log_reader_t::data and cw_elements_log_reader_t::size set
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int cw_elements_log_reader_parse_header(cw_elements_log_reader_t * reader)
+{
+	if (reader->size < CW_ELEMENTS_LOG_HEADER_SIZE) {
+		return -1;
+	}
+	if (0 != memcmp(reader->data, LOG_MAGIC, 4)) {
+		return -1;
+	}
+	const uint16_t version = get_le16(reader->data + 4);
+	if (LOG_VERSION != version) {
+		fprintf(stderr, "[ERROR] Unsupported version of elements log: %u\n", version);
+		return -1;
+	}
+	reader->sample_rate = get_le32(reader->data + 8);
+	if (0 == reader->sample_rate) {
+		return -1;
+	}
+	reader->sample_spacing = (1000.0 * 1000.0) / reader->sample_rate;
+	reader->next_chunk = CW_ELEMENTS_LOG_HEADER_SIZE;
+
+	return 0;
+}
+
+
+
+
+static void put_le16(uint8_t * p, uint16_t value)
+{
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+}
+
+
+
+
+static void put_le32(uint8_t * p, uint32_t value)
+{
+	p[0] = (uint8_t) value;
+	p[1] = (uint8_t) (value >> 8);
+	p[2] = (uint8_t) (value >> 16);
+	p[3] = (uint8_t) (value >> 24);
+}
+
+
+
+
+static uint16_t get_le16(const uint8_t * p)
+{
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+
+
+
+static uint32_t get_le32(const uint8_t * p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
@@ -0,0 +1,241 @@
+#ifndef UNIXCW_CWUTILS_LIB_ELEMENTS_LOG_H
+#define UNIXCW_CWUTILS_LIB_ELEMENTS_LOG_H
+
+
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "elements.h"
+
+
+
+
+/*
+  Binary log of elements.
+
+  The log is a compact alternative to text written by
+  cw_elements_print_to_file(). All integers are little-endian.
+
+  Header of log (16 bytes):
+    - magic "CWEL" (4 bytes),
+    - version of format (2 bytes), currently 1,
+    - flags (2 bytes), currently zero,
+    - sample rate [Hz] (4 bytes),
+    - reserved (4 bytes), zero.
+
+  Header is followed by chunks. Each chunk has:
+    - count of elements in chunk (4 bytes), at most CW_ELEMENTS_LOG_CHUNK_SIZE,
+    - size of payload of chunk [bytes] (4 bytes),
+    - payload: for each element one byte with type and state of element,
+      packed as in cw_elements_chunk_t::attributes, followed by duration of
+      element in samples, as unsigned LEB128 varint.
+
+  Durations are stored in units of samples, so timespans of elements are
+  rounded to nearest sample. For elements detected in wav file with the
+  same sample rate, this is lossless.
+*/
+
+
+
+
+/* Max count of elements in one chunk of log. */
+#define CW_ELEMENTS_LOG_CHUNK_SIZE CW_ELEMENTS_CHUNK_SIZE
+
+/* Max size of one element in payload of chunk: attributes + 64-bit varint. [bytes] */
+#define CW_ELEMENTS_LOG_ELEMENT_SIZE_MAX (1 + 10)
+
+#define CW_ELEMENTS_LOG_HEADER_SIZE 16
+#define CW_ELEMENTS_LOG_CHUNK_HEADER_SIZE 8
+
+
+
+
+/**
+   @brief Streaming writer of binary log of elements
+
+   Elements are collected in a chunk, and the chunk is written to file when
+   it is full, or when the writer is closed.
+*/
+typedef struct cw_elements_log_writer_t {
+	FILE * file;
+	uint32_t sample_rate;
+	double samples_per_microsecond;
+	uint32_t count;              /* Count of elements in current chunk. */
+	size_t size;                 /* Size of payload of current chunk [bytes]. */
+	int error;                   /* Non-zero if writing to file has failed. */
+	uint8_t payload[CW_ELEMENTS_LOG_CHUNK_SIZE * CW_ELEMENTS_LOG_ELEMENT_SIZE_MAX];
+} cw_elements_log_writer_t;
+
+
+
+
+/**
+   @brief Reader of binary log of elements
+
+   The log is either mapped into memory from file, or is given as buffer in
+   memory. Elements are decoded directly from the mapping or the buffer,
+   without copying the log.
+*/
+typedef struct cw_elements_log_reader_t {
+	int fd;
+	void * map;                     /* Whole file mapped into memory. NULL for log in memory buffer. */
+	size_t map_size;
+
+	const uint8_t * data;           /* Whole log. */
+	size_t size;                    /* Size of log [bytes]. */
+
+	uint32_t sample_rate;
+	cw_element_time_t sample_spacing;  /* [microseconds] */
+
+	size_t next_chunk;              /* Offset of header of next chunk in log. */
+	const uint8_t * cursor;         /* Next element in payload of current chunk. */
+	const uint8_t * chunk_end;      /* End of payload of current chunk. */
+	uint32_t chunk_remaining;       /* Count of elements remaining in current chunk. */
+} cw_elements_log_reader_t;
+
+
+
+
+/**
+   @brief Start writing binary log of elements to file
+
+   Header of log is written to @p file. The file must be opened for
+   writing, and must be positioned where the log should start.
+
+   @param[out] writer Writer to initialize
+   @param[in] file File to write to
+   @param[in] sample_rate Sample rate that determines unit of durations [Hz]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_writer_open(cw_elements_log_writer_t * writer, FILE * file, uint32_t sample_rate);
+
+
+
+
+/**
+   @brief Append an element to binary log
+
+   Negative timespans are saved as zero.
+
+   @param[in/out] writer Opened writer
+   @param[in] type Type of element
+   @param[in] state State of element
+   @param[in] timespan Duration of element [microseconds]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_writer_append(cw_elements_log_writer_t * writer, cw_element_type_t type, cw_state_t state, cw_element_time_t timespan);
+
+
+
+
+/**
+   @brief Finish writing binary log of elements
+
+   Last chunk is written to file, and the file is flushed. The file is not
+   closed.
+
+   @param[in/out] writer Opened writer
+
+   @return 0 if all elements have been written to file
+   @return -1 otherwise
+*/
+int cw_elements_log_writer_close(cw_elements_log_writer_t * writer);
+
+
+
+
+/**
+   @brief Write all elements to file as binary log
+
+   @param[out] file File to write to
+   @param[in] elements Elements to write
+   @param[in] sample_rate Sample rate that determines unit of durations [Hz]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_write(FILE * file, const cw_elements_t * elements, uint32_t sample_rate);
+
+
+
+
+/**
+   @brief Open binary log of elements and map it into memory
+
+   Header of the log is validated.
+
+   @param[out] reader Reader to initialize
+   @param[in] path Path to file with log
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_reader_open(cw_elements_log_reader_t * reader, const char * path);
+
+
+
+
+/**
+   @brief Open binary log of elements stored in memory
+
+   The buffer is not copied, and must stay valid until the reader is closed.
+
+   @param[out] reader Reader to initialize
+   @param[in] data Buffer with log
+   @param[in] size Size of @p data [bytes]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_reader_open_memory(cw_elements_log_reader_t * reader, const void * data, size_t size);
+
+
+
+
+/**
+   @brief Close reader of binary log of elements
+
+   @param[in/out] reader Reader to close
+*/
+void cw_elements_log_reader_close(cw_elements_log_reader_t * reader);
+
+
+
+
+/**
+   @brief Get next element from binary log
+
+   @param[in/out] reader Opened reader
+   @param[out] element Next element
+
+   @return 1 if @p element has been read
+   @return 0 at the end of log
+   @return -1 if log is malformed
+*/
+int cw_elements_log_reader_next(cw_elements_log_reader_t * reader, cw_element_t * element);
+
+
+
+
+/**
+   @brief Append all remaining elements of binary log to elements structure
+
+   @param[in/out] reader Opened reader
+   @param[out] elements Elements structure to append to
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_log_reader_read_all(cw_elements_log_reader_t * reader, cw_elements_t * elements);
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_ELEMENTS_LOG_H */
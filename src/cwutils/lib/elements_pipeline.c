@@ -0,0 +1,598 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libcw2.h>
+
+#include "elements_detect.h"
+#include "elements_pipeline.h"
+#include "misc.h"
+
+
+
+
+/**
+   \file elements_pipeline.c
+
+   Pipeline that takes elements detected in wav file straight to receiver.
+
+   The elements aren't collected in cw_elements_t and aren't written to
+   intermediate files: detector stage pushes each detected element into a
+   queue of bounded size, and receiver stage pops the elements from the
+   queue in batches. Each stage works in its own thread.
+*/
+
+
+
+
+/* Default count of elements that can wait in queue between stages. */
+#define QUEUE_CAPACITY_DEFAULT 4096
+
+/* Max count of elements passed to receiver in one call. */
+#define BATCH_SIZE 256
+
+/* Duration of space added after last element of file. The space lets the
+   receiver recognize the last character. [microseconds] */
+#define FINAL_SPACE_DURATION (60.0 * 1000.0 * 1000.0)
+
+/* From PARIS calibration, 1 Dot duration [us] = 1200000 / speed [wpm]. */
+#define DOT_CALIBRATION 1200000.0
+
+
+
+
+/* Bounded queue of elements between detector stage and receiver stage. */
+typedef struct edges_queue_t {
+	cw_rec_edge_t * edges;
+	size_t capacity;
+	size_t head;        /* Index of oldest element in queue. */
+	size_t count;       /* Count of elements in queue. */
+
+	bool finished;      /* Detector stage won't push any more elements. */
+	bool cancelled;     /* Receiver stage won't pop any more elements. */
+
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} edges_queue_t;
+
+
+
+
+/* Elements that have been collected before receiving. */
+typedef struct edges_array_t {
+	const cw_rec_edge_t * edges;
+	size_t count;
+	size_t next;        /* Index of next element to pass to receiver. */
+} edges_array_t;
+
+
+
+
+/* Elements read from binary log of elements. */
+typedef struct edges_log_t {
+	cw_elements_log_reader_t * reader;
+	int retval;         /* -1 if log is malformed. */
+} edges_log_t;
+
+
+
+
+/* Function giving receiver stage next elements to receive. Returns count
+   of elements put into 'edges'; zero when there will be no more elements. */
+typedef size_t (* edges_source_t)(void * source_arg, cw_rec_edge_t * edges, size_t max_count);
+
+
+
+
+/* Arguments and result of detector stage. */
+typedef struct detector_stage_t {
+	const wav_reader_t * reader;
+	unsigned int channel;
+	edges_queue_t * queue;
+	int retval;
+} detector_stage_t;
+
+
+
+
+static void * detector_stage_fn(void * arg);
+static int edges_queue_push(void * sink_arg, cw_state_t state, cw_element_time_t timespan);
+static size_t edges_queue_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count);
+static void edges_queue_cancel(edges_queue_t * queue);
+static size_t edges_array_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count);
+static size_t edges_log_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count);
+static cw_rec_t * receiver_new(const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result);
+static int receiver_stage(cw_rec_t * rec, edges_source_t source, void * source_arg, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result);
+static cw_element_type_t classify_edge(const cw_rec_edge_t * edge, float speed);
+static int receive_batch(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t count, FILE * text_file, size_t * characters_count);
+
+
+
+
+int cw_elements_pipeline_run(const wav_reader_t * reader, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result)
+{
+	cw_rec_t * rec = receiver_new(config, result);
+	if (NULL == rec) {
+		return -1;
+	}
+
+	edges_queue_t queue = { 0 };
+	queue.capacity = 0 == config->queue_capacity ? QUEUE_CAPACITY_DEFAULT : config->queue_capacity;
+	queue.edges = (cw_rec_edge_t *) calloc(queue.capacity, sizeof (cw_rec_edge_t));
+	if (NULL == queue.edges) {
+		fprintf(stderr, "[ERROR] Failed to allocate queue of elements\n");
+		cw_rec_delete(&rec);
+		return -1;
+	}
+	pthread_mutex_init(&queue.mutex, NULL);
+	pthread_cond_init(&queue.not_empty, NULL);
+	pthread_cond_init(&queue.not_full, NULL);
+
+	detector_stage_t detector_stage = { .reader = reader, .channel = config->channel, .queue = &queue, .retval = 0 };
+	pthread_t detector_thread;
+	if (0 != pthread_create(&detector_thread, NULL, detector_stage_fn, &detector_stage)) {
+		fprintf(stderr, "[ERROR] Failed to start detector stage\n");
+		free(queue.edges);
+		cw_rec_delete(&rec);
+		return -1;
+	}
+
+	int retval = receiver_stage(rec, edges_queue_pop, &queue, config, result);
+	if (0 != retval) {
+		edges_queue_cancel(&queue);
+	}
+
+	pthread_join(detector_thread, NULL);
+	if (0 != detector_stage.retval) {
+		fprintf(stderr, "[ERROR] Detector stage has failed\n");
+		retval = -1;
+	}
+
+	result->speed = cw_rec_get_speed(rec);
+
+	pthread_cond_destroy(&queue.not_full);
+	pthread_cond_destroy(&queue.not_empty);
+	pthread_mutex_destroy(&queue.mutex);
+	free(queue.edges);
+	cw_rec_delete(&rec);
+
+	return retval;
+}
+
+
+
+
+int cw_elements_pipeline_run_edges(const cw_rec_edge_t * edges, size_t n_edges, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result)
+{
+	cw_rec_t * rec = receiver_new(config, result);
+	if (NULL == rec) {
+		return -1;
+	}
+
+	edges_array_t array = { .edges = edges, .count = n_edges, .next = 0 };
+	const int retval = receiver_stage(rec, edges_array_pop, &array, config, result);
+
+	result->speed = cw_rec_get_speed(rec);
+	cw_rec_delete(&rec);
+
+	return retval;
+}
+
+
+
+
+int cw_elements_pipeline_run_log(cw_elements_log_reader_t * reader, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result)
+{
+	cw_rec_t * rec = receiver_new(config, result);
+	if (NULL == rec) {
+		return -1;
+	}
+
+	edges_log_t log = { .reader = reader, .retval = 0 };
+	int retval = receiver_stage(rec, edges_log_pop, &log, config, result);
+	if (0 != log.retval) {
+		fprintf(stderr, "[ERROR] Failed to read elements log\n");
+		retval = -1;
+	}
+
+	result->speed = cw_rec_get_speed(rec);
+	cw_rec_delete(&rec);
+
+	return retval;
+}
+
+
+
+
+void cw_elements_pipeline_print_divergences(FILE * file, const cw_elements_pipeline_result_t * result, float speed)
+{
+	const int dot_duration = (int) lround(DOT_CALIBRATION / (double) speed);
+	const cw_gen_durations_t durations = {
+		.dot_duration = dot_duration,
+		.dash_duration = 3 * dot_duration,
+		.ims_duration = dot_duration,
+		.ics_duration = 3 * dot_duration,
+		.iws_duration = 7 * dot_duration,
+	};
+
+	fprintf(file, "[INFO ] elements: %zu, characters: %zu, speed: %.2f WPM\n",
+	        result->elements_count, result->characters_count, (double) speed);
+	for (int t = cw_element_type_dot; t <= cw_element_type_iws; t++) {
+		const cw_element_stats_t * stats = &result->stats[t];
+		if (0 == stats->count) {
+			continue;
+		}
+		int duration_expected = 0;
+		cw_element_type_to_duration((cw_element_type_t) t, &durations, &duration_expected);
+		cw_element_stats_divergences_t divergences = { 0 };
+		cw_element_stats_calculate_divergences(stats, &divergences, duration_expected);
+		fprintf(file, "[INFO ] duration of '%c' (%6d): min/avg/max = %7d/%7d/%7d, expected = %7d, divergence min/avg/max = %8.3f%%/%8.3f%%/%8.3f%%\n",
+		        cw_element_type_get_representation((cw_element_type_t) t),
+		        stats->count,
+		        stats->duration_min, stats->duration_avg, stats->duration_max,
+		        duration_expected,
+		        divergences.min, divergences.avg, divergences.max);
+	}
+}
+
+
+
+
+/**
+   @brief Create receiver configured for pipeline, initialize results
+
+   @param[in] config Configuration of pipeline
+   @param[out] result Results of pipeline to initialize
+
+   @return receiver on success
+   @return NULL on failure
+*/
+static cw_rec_t * receiver_new(const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result)
+{
+	memset(result, 0, sizeof (cw_elements_pipeline_result_t));
+	for (int t = 0; t <= cw_element_type_iws; t++) {
+		cw_element_stats_init(&result->stats[t]);
+	}
+
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == rec) {
+		fprintf(stderr, "[ERROR] Failed to create receiver\n");
+		return NULL;
+	}
+	if (0 == config->speed) {
+		cw_rec_enable_adaptive_mode(rec);
+	} else {
+		cw_rec_disable_adaptive_mode(rec);
+		if (CW_SUCCESS != cw_rec_set_speed(rec, config->speed)) {
+			fprintf(stderr, "[ERROR] Failed to set speed of receiver to %d\n", config->speed);
+			cw_rec_delete(&rec);
+			return NULL;
+		}
+	}
+
+	return rec;
+}
+
+
+
+
+/**
+   @brief Receiver stage: pass elements from source to receiver
+
+   Elements are taken from @p source in batches and passed to receiver.
+   Durations of elements are added to statistics in @p result. After last
+   element a long space is passed to receiver, so that the receiver
+   recognizes the last character.
+
+   @param[in/out] rec Receiver
+   @param[in] source Source of elements
+   @param[in/out] source_arg Argument of @p source
+   @param[in] config Configuration of pipeline
+   @param[in/out] result Results of pipeline
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int receiver_stage(cw_rec_t * rec, edges_source_t source, void * source_arg, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result)
+{
+	double now = 0.0; /* Beginning of current batch, from beginning of file [microseconds]. */
+	cw_rec_edge_t batch[BATCH_SIZE];
+	cw_rec_edge_t prev_edge = { 0 };
+	size_t next_report = config->report_interval;
+
+	size_t count = 0;
+	while (0 != (count = source(source_arg, batch, BATCH_SIZE))) {
+		if (0 != receive_batch(rec, (int64_t) llround(now), batch, count, config->text_file, &result->characters_count)) {
+			return -1;
+		}
+
+		/* Elements are classified with speed that receiver has after
+		   receiving them, so that in adaptive mode the speed has been
+		   adjusted to the elements. Duration of an element is registered
+		   when next element arrives: first and last elements of file are
+		   just silence, or are cut at edge of recording. */
+		const float speed = cw_rec_get_speed(rec);
+		for (size_t i = 0; i < count; i++) {
+			if (result->elements_count > 1) {
+				const cw_element_type_t type = classify_edge(&prev_edge, speed);
+				cw_element_stats_update(&result->stats[type], (int) lround(prev_edge.timespan));
+			}
+			prev_edge = batch[i];
+			result->elements_count++;
+			now += batch[i].timespan;
+
+			if (NULL != config->elements_log) {
+				const cw_state_t state = batch[i].is_mark ? cw_state_mark : cw_state_space;
+				if (0 != cw_elements_log_writer_append(config->elements_log, classify_edge(&batch[i], speed), state, batch[i].timespan)) {
+					return -1;
+				}
+			}
+		}
+
+		if (config->report_interval && result->elements_count >= next_report) {
+			cw_elements_pipeline_print_divergences(config->report_file, result, cw_rec_get_speed(rec));
+			next_report += config->report_interval;
+		}
+	}
+
+	const cw_rec_edge_t final_space = { .timespan = FINAL_SPACE_DURATION, .is_mark = false };
+	return receive_batch(rec, (int64_t) llround(now), &final_space, 1, config->text_file, &result->characters_count);
+}
+
+
+
+
+/**
+   @brief Thread function of detector stage
+
+   @param[in/out] arg detector stage (detector_stage_t *)
+
+   @return NULL
+*/
+static void * detector_stage_fn(void * arg)
+{
+	detector_stage_t * stage = (detector_stage_t *) arg;
+	stage->retval = cw_elements_detect_from_wav_reader_to_sink(stage->reader, stage->channel, edges_queue_push, stage->queue);
+
+	pthread_mutex_lock(&stage->queue->mutex);
+	stage->queue->finished = true;
+	pthread_cond_broadcast(&stage->queue->not_empty);
+	pthread_mutex_unlock(&stage->queue->mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Push detected element to queue
+
+   Function blocks while the queue is full. This is a sink function for
+   cw_elements_detect_from_wav_reader_to_sink().
+
+   @param[in/out] sink_arg queue (edges_queue_t *)
+   @param[in] state state of detected element
+   @param[in] timespan duration of detected element
+
+   @return 0 on success
+   @return -1 if receiver stage doesn't accept elements anymore
+*/
+static int edges_queue_push(void * sink_arg, cw_state_t state, cw_element_time_t timespan)
+{
+	edges_queue_t * queue = (edges_queue_t *) sink_arg;
+
+	pthread_mutex_lock(&queue->mutex);
+	while (queue->count == queue->capacity && !queue->cancelled) {
+		pthread_cond_wait(&queue->not_full, &queue->mutex);
+	}
+	if (queue->cancelled) {
+		pthread_mutex_unlock(&queue->mutex);
+		return -1;
+	}
+
+	cw_rec_edge_t * edge = &queue->edges[(queue->head + queue->count) % queue->capacity];
+	edge->timespan = timespan;
+	edge->is_mark = cw_state_mark == state;
+	queue->count++;
+
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->mutex);
+	return 0;
+}
+
+
+
+
+/**
+   @brief Pop elements from queue
+
+   Function blocks while the queue is empty and detector stage still
+   works.
+
+   @param[in/out] source_arg queue of elements (edges_queue_t *)
+   @param[out] edges buffer for popped elements
+   @param[in] max_count size of @p edges
+
+   @return count of popped elements; zero when there will be no more elements
+*/
+static size_t edges_queue_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count)
+{
+	edges_queue_t * queue = (edges_queue_t *) source_arg;
+
+	pthread_mutex_lock(&queue->mutex);
+	while (0 == queue->count && !queue->finished) {
+		pthread_cond_wait(&queue->not_empty, &queue->mutex);
+	}
+
+	const size_t count = queue->count < max_count ? queue->count : max_count;
+	for (size_t i = 0; i < count; i++) {
+		edges[i] = queue->edges[(queue->head + i) % queue->capacity];
+	}
+	queue->head = (queue->head + count) % queue->capacity;
+	queue->count -= count;
+
+	pthread_cond_signal(&queue->not_full);
+	pthread_mutex_unlock(&queue->mutex);
+	return count;
+}
+
+
+
+
+/**
+   @brief Tell detector stage that receiver stage has stopped popping elements
+
+   @param[in/out] queue queue of elements
+*/
+static void edges_queue_cancel(edges_queue_t * queue)
+{
+	pthread_mutex_lock(&queue->mutex);
+	queue->cancelled = true;
+	pthread_cond_broadcast(&queue->not_full);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+
+
+
+/**
+   @brief Take next elements from array of collected elements
+
+   @param[in/out] source_arg array of elements (edges_array_t *)
+   @param[out] edges buffer for elements
+   @param[in] max_count size of @p edges
+
+   @return count of elements put into @p edges; zero when there are no more elements
+*/
+static size_t edges_array_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count)
+{
+	edges_array_t * array = (edges_array_t *) source_arg;
+
+	const size_t remaining = array->count - array->next;
+	const size_t count = remaining < max_count ? remaining : max_count;
+	memcpy(edges, array->edges + array->next, count * sizeof (cw_rec_edge_t));
+	array->next += count;
+
+	return count;
+}
+
+
+
+
+/**
+   @brief Take next elements from binary log of elements
+
+   @param[in/out] source_arg log of elements (edges_log_t *)
+   @param[out] edges buffer for elements
+   @param[in] max_count size of @p edges
+
+   @return count of elements put into @p edges; zero when there are no more elements
+*/
+static size_t edges_log_pop(void * source_arg, cw_rec_edge_t * edges, size_t max_count)
+{
+	edges_log_t * log = (edges_log_t *) source_arg;
+
+	size_t count = 0;
+	cw_element_t element;
+	while (count < max_count) {
+		const int retval = cw_elements_log_reader_next(log->reader, &element);
+		if (1 != retval) {
+			if (-1 == retval) {
+				log->retval = -1;
+			}
+			break;
+		}
+		edges[count].timespan = element.timespan;
+		edges[count].is_mark = cw_state_mark == element.state;
+		count++;
+	}
+
+	return count;
+}
+
+
+
+
+/**
+   @brief Guess type of element from its duration
+
+   @param[in] edge element
+   @param[in] speed current speed of receiver [wpm]
+
+   @return type of element
+*/
+static cw_element_type_t classify_edge(const cw_rec_edge_t * edge, float speed)
+{
+	const double dot_duration = DOT_CALIBRATION / (double) speed;
+	if (edge->is_mark) {
+		return edge->timespan < 2.0 * dot_duration ? cw_element_type_dot : cw_element_type_dash;
+	} else {
+		if (edge->timespan < 2.0 * dot_duration) {
+			return cw_element_type_ims;
+		} else if (edge->timespan < 5.0 * dot_duration) {
+			return cw_element_type_ics;
+		} else {
+			return cw_element_type_iws;
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Pass batch of elements to receiver, print decoded characters
+
+   @param[in/out] rec receiver
+   @param[in] timestamp beginning of first element in batch [microseconds]
+   @param[in] edges batch of elements
+   @param[in] count count of elements in @p edges
+   @param[out] text_file file to which to print decoded characters
+   @param[in/out] characters_count counter of decoded characters
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int receive_batch(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t count, FILE * text_file, size_t * characters_count)
+{
+	/* Each element can end at most one character and one word. */
+	cw_rec_decoded_t decoded[2 * (BATCH_SIZE + 1)];
+	size_t n_decoded = 0;
+	if (CW_SUCCESS != cw_rec_receive_edges(rec, timestamp, edges, count, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded)) {
+		fprintf(stderr, "[ERROR] Receiver failed to receive batch of elements\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < n_decoded; i++) {
+		fputc(decoded[i].character, text_file);
+	}
+	if (n_decoded) {
+		fflush(text_file);
+	}
+	*characters_count += n_decoded;
+	return 0;
+}
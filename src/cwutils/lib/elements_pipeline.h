@@ -0,0 +1,130 @@
+#ifndef UNIXCW_CWUTILS_LIB_ELEMENTS_PIPELINE_H
+#define UNIXCW_CWUTILS_LIB_ELEMENTS_PIPELINE_H
+
+
+
+
+#include <stdio.h>
+
+#include <libcw/libcw2.h>
+
+#include "element_stats.h"
+#include "elements.h"
+#include "elements_log.h"
+#include "wav_reader.h"
+
+
+
+
+/**
+   @brief Configuration of elements pipeline
+*/
+typedef struct cw_elements_pipeline_config_t {
+	unsigned int channel;      /**< Channel of wav file in which to detect elements. */
+	int speed;                 /**< Speed of receiver [wpm]. Zero: receiver works in adaptive mode. */
+	size_t queue_capacity;     /**< Count of elements that can wait between detector and receiver. Zero: default capacity. */
+	size_t report_interval;    /**< Print divergences after every N elements. Zero: print divergences only at the end. */
+	FILE * text_file;          /**< File to which to print decoded text as it is received. */
+	FILE * report_file;        /**< File to which to print divergences of durations of elements. */
+	cw_elements_log_writer_t * elements_log;  /**< Opened writer to which to append received elements. NULL: elements are not logged. */
+} cw_elements_pipeline_config_t;
+
+
+
+
+/**
+   @brief Results of elements pipeline
+*/
+typedef struct cw_elements_pipeline_result_t {
+	size_t elements_count;      /**< Count of elements detected in wav file. */
+	size_t characters_count;    /**< Count of decoded characters, including spaces between words. */
+	float speed;                /**< Speed of receiver at the end of processing [wpm]. */
+
+	/* Statistics of durations of elements, indexed by cw_element_type_t. */
+	cw_element_stats_t stats[cw_element_type_iws + 1];
+} cw_elements_pipeline_result_t;
+
+
+
+
+/**
+   @brief Detect elements in wav file and decode them, without intermediate files
+
+   Elements are detected in one thread, and passed through a queue of
+   bounded size to a receiver working in the calling thread. Receiver
+   receives the elements in batches through cw_rec_receive_edges(). The
+   decoded text is printed to cw_elements_pipeline_config_t::text_file as
+   soon as it's decoded, and divergences of durations of elements from
+   ideal durations are printed periodically to
+   cw_elements_pipeline_config_t::report_file.
+
+   Memory usage doesn't depend on size of wav file: the file is mapped into
+   memory, and only a fixed count of elements is kept in memory.
+
+   @param[in] reader Opened reader of wav file
+   @param[in] config Configuration of pipeline
+   @param[out] result Results of processing of the file
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_pipeline_run(const wav_reader_t * reader, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result);
+
+
+
+
+/**
+   @brief Decode elements that have already been collected
+
+   Like cw_elements_pipeline_run(), but the elements come from @p edges
+   instead of from a wav file, e.g. from recorded key edges. There is no
+   detector stage: elements are passed in batches to a receiver working in
+   the calling thread. cw_elements_pipeline_config_t::channel and
+   cw_elements_pipeline_config_t::queue_capacity are not used.
+
+   @param[in] edges Marks and Spaces to decode, starting with a Mark
+   @param[in] n_edges Count of items in @p edges
+   @param[in] config Configuration of pipeline
+   @param[out] result Results of processing of the elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_pipeline_run_edges(const cw_rec_edge_t * edges, size_t n_edges, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result);
+
+
+
+
+/**
+   @brief Decode elements from binary log of elements
+
+   Like cw_elements_pipeline_run_edges(), but the elements are decoded
+   from @p reader in batches, without reading whole log into memory.
+
+   @param[in/out] reader Opened reader of elements log
+   @param[in] config Configuration of pipeline
+   @param[out] result Results of processing of the elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_elements_pipeline_run_log(cw_elements_log_reader_t * reader, const cw_elements_pipeline_config_t * config, cw_elements_pipeline_result_t * result);
+
+
+
+
+/**
+   @brief Print divergences of durations of elements
+
+   Expected durations of elements are calculated from @p speed.
+
+   @param[out] file File to print to
+   @param[in] result Results of elements pipeline
+   @param[in] speed Speed from which to calculate expected durations [wpm]
+*/
+void cw_elements_pipeline_print_divergences(FILE * file, const cw_elements_pipeline_result_t * result, float speed);
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_ELEMENTS_PIPELINE_H */
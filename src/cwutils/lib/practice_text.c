@@ -0,0 +1,243 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/**
+   \file practice_text.c
+
+   Pools of groups of practice text, refilled by a background thread.
+
+   Each pool is a ring buffer of groups. Thread getting groups takes
+   them from the beginning of a ring, and the background thread appends
+   them at the end. Both threads access the ring only with the mutex
+   locked, and the background thread generates groups with the mutex
+   unlocked, so the thread getting groups waits at most for a copy of
+   one group.
+*/
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "practice_text.h"
+
+
+
+
+/* Pool of groups of text from one source. */
+typedef struct cw_practice_text_pool_t {
+	const void * source;
+	char groups[CW_PRACTICE_TEXT_POOL_CAPACITY][CW_PRACTICE_TEXT_GROUP_SIZE];
+	size_t lengths[CW_PRACTICE_TEXT_POOL_CAPACITY];
+	size_t first;       /* Index of first group in ring. */
+	size_t count;       /* Count of groups in ring. */
+	bool refilling;     /* Background thread should append groups until the ring is full. */
+	bool oversized;     /* Groups of the source don't fit in ring, don't try to refill. */
+} cw_practice_text_pool_t;
+
+
+
+
+struct cw_practice_text_t {
+	cw_practice_text_generator_t generator;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;   /* Signalled when a pool needs refilling, or when the thread should stop. */
+	pthread_t thread;
+	bool thread_running;
+	bool stop;
+
+	cw_random_t rng;         /* Used only by thread getting groups. */
+	cw_random_t thread_rng;  /* Used only by background thread. */
+
+	cw_practice_text_pool_t pools[CW_PRACTICE_TEXT_MAX_POOLS];
+	size_t n_pools;
+};
+
+
+
+
+static void * cw_practice_text_thread_fn(void * arg);
+static cw_practice_text_pool_t * cw_practice_text_get_pool(cw_practice_text_t * text, const void * source);
+
+
+
+
+cw_practice_text_t * cw_practice_text_new(cw_practice_text_generator_t generator, uint64_t seed)
+{
+	cw_practice_text_t * text = (cw_practice_text_t *) calloc(1, sizeof (cw_practice_text_t));
+	if (NULL == text) {
+		return NULL;
+	}
+
+	text->generator = generator;
+	seed = cw_random_init(&text->rng, seed);
+	/* Different, but still reproducible, sequence for background thread. */
+	cw_random_init(&text->thread_rng, seed ^ UINT64_C(0x9e3779b97f4a7c15));
+
+	pthread_mutex_init(&text->mutex, NULL);
+	pthread_cond_init(&text->cond, NULL);
+
+	/* Without the thread all groups are generated synchronously,
+	   which is slower but still correct. */
+	text->thread_running = 0 == pthread_create(&text->thread, NULL, cw_practice_text_thread_fn, text);
+
+	return text;
+}
+
+
+
+
+void cw_practice_text_delete(cw_practice_text_t ** text)
+{
+	if (NULL == text || NULL == *text) {
+		return;
+	}
+
+	if ((*text)->thread_running) {
+		pthread_mutex_lock(&(*text)->mutex);
+		(*text)->stop = true;
+		pthread_cond_signal(&(*text)->cond);
+		pthread_mutex_unlock(&(*text)->mutex);
+
+		pthread_join((*text)->thread, NULL);
+	}
+
+	pthread_cond_destroy(&(*text)->cond);
+	pthread_mutex_destroy(&(*text)->mutex);
+
+	free(*text);
+	*text = NULL;
+}
+
+
+
+
+int cw_practice_text_get_group(cw_practice_text_t * text, const void * source, char * group, size_t size)
+{
+	int length = -1;
+
+	pthread_mutex_lock(&text->mutex);
+	cw_practice_text_pool_t * pool = cw_practice_text_get_pool(text, source);
+	if (NULL != pool) {
+		if (pool->count > 0 && pool->lengths[pool->first] < size) {
+			memcpy(group, pool->groups[pool->first], pool->lengths[pool->first] + 1);
+			length = (int) pool->lengths[pool->first];
+			pool->first = (pool->first + 1) % CW_PRACTICE_TEXT_POOL_CAPACITY;
+			pool->count--;
+		}
+		if (text->thread_running
+		    && !pool->refilling
+		    && !pool->oversized
+		    && pool->count < CW_PRACTICE_TEXT_POOL_CAPACITY / 2) {
+
+			pool->refilling = true;
+			pthread_cond_signal(&text->cond);
+		}
+	}
+	pthread_mutex_unlock(&text->mutex);
+
+	if (length < 0) {
+		length = text->generator(source, &text->rng, group, size);
+	}
+
+	return length;
+}
+
+
+
+
+/**
+   @brief Get pool of given source, create the pool if necessary
+
+   Call the function with mutex locked.
+
+   @return pool
+   @return NULL if there is no pool for @p source and no more pools can be created
+*/
+static cw_practice_text_pool_t * cw_practice_text_get_pool(cw_practice_text_t * text, const void * source)
+{
+	for (size_t i = 0; i < text->n_pools; i++) {
+		if (text->pools[i].source == source) {
+			return &text->pools[i];
+		}
+	}
+	if (text->n_pools == CW_PRACTICE_TEXT_MAX_POOLS) {
+		return NULL;
+	}
+
+	/* Unused pools are zeroed by calloc(). */
+	cw_practice_text_pool_t * pool = &text->pools[text->n_pools++];
+	pool->source = source;
+	return pool;
+}
+
+
+
+
+/**
+   @brief Background thread appending groups to pools that need refilling
+*/
+static void * cw_practice_text_thread_fn(void * arg)
+{
+	cw_practice_text_t * text = (cw_practice_text_t *) arg;
+	char group[CW_PRACTICE_TEXT_GROUP_SIZE];
+
+	pthread_mutex_lock(&text->mutex);
+	while (!text->stop) {
+		cw_practice_text_pool_t * pool = NULL;
+		for (size_t i = 0; i < text->n_pools; i++) {
+			if (text->pools[i].refilling) {
+				pool = &text->pools[i];
+				break;
+			}
+		}
+		if (NULL == pool) {
+			pthread_cond_wait(&text->cond, &text->mutex);
+			continue;
+		}
+
+		/* Pools are never removed, and source of a pool never changes. */
+		const void * source = pool->source;
+		pthread_mutex_unlock(&text->mutex);
+		const int length = text->generator(source, &text->thread_rng, group, sizeof (group));
+		pthread_mutex_lock(&text->mutex);
+
+		if (length < 0) {
+			pool->oversized = true;
+			pool->refilling = false;
+			continue;
+		}
+
+		const size_t last = (pool->first + pool->count) % CW_PRACTICE_TEXT_POOL_CAPACITY;
+		memcpy(pool->groups[last], group, (size_t) length + 1);
+		pool->lengths[last] = (size_t) length;
+		pool->count++;
+		if (CW_PRACTICE_TEXT_POOL_CAPACITY == pool->count) {
+			pool->refilling = false;
+		}
+	}
+	pthread_mutex_unlock(&text->mutex);
+
+	return NULL;
+}
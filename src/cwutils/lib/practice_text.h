@@ -0,0 +1,132 @@
+#ifndef UNIXCW_CWUTILS_LIB_PRACTICE_TEXT_H
+#define UNIXCW_CWUTILS_LIB_PRACTICE_TEXT_H
+
+
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "random.h"
+
+
+
+
+/*
+  Prefetcher of practice text.
+
+  Groups of practice text (random groups of characters, or random words)
+  are generated by a background thread and kept in pools, one pool per
+  source of text (e.g. per dictionary). Getting a group from a pool is a
+  copy of a short string, so a program playing practice text doesn't
+  have to generate the text in its user interface thread. The pool is
+  refilled by the background thread when it gets half empty.
+
+  If a pool is empty (e.g. right after first request for given source),
+  or the background thread couldn't be started, the group is generated
+  synchronously in the calling thread.
+*/
+
+
+
+
+/* Max size of a group kept in a pool, including terminating NUL. Groups
+   that are longer are always generated synchronously. */
+#define CW_PRACTICE_TEXT_GROUP_SIZE 64
+
+/* Count of groups in one pool. */
+#define CW_PRACTICE_TEXT_POOL_CAPACITY 64
+
+/* Count of sources for which pools can be created. Groups of other
+   sources are always generated synchronously. */
+#define CW_PRACTICE_TEXT_MAX_POOLS 16
+
+
+
+
+/**
+   @brief Function generating one group of practice text
+
+   The function is called both by background thread and by thread
+   getting groups, each time with a different @p rng, so it must not
+   modify @p source.
+
+   @param[in] source Source of text, as passed to cw_practice_text_get_group()
+   @param[in/out] rng Random number generator to use
+   @param[out] group Buffer for NUL-terminated group
+   @param[in] size Size of @p group
+
+   @return length of group on success
+   @return -1 if the group doesn't fit in @p group
+*/
+typedef int (* cw_practice_text_generator_t)(const void * source, cw_random_t * rng, char * group, size_t size);
+
+
+
+
+typedef struct cw_practice_text_t cw_practice_text_t;
+
+
+
+
+/**
+   @brief Create prefetcher of practice text and start its background thread
+
+   @param[in] generator Function generating groups of text
+   @param[in] seed Seed of random number generators, or zero
+
+   @return new prefetcher on success
+   @return NULL on failure to allocate memory
+*/
+cw_practice_text_t * cw_practice_text_new(cw_practice_text_generator_t generator, uint64_t seed);
+
+
+
+
+/**
+   @brief Stop background thread and delete prefetcher
+
+   Function sets @p text to NULL.
+
+   @param[in/out] text Prefetcher to delete
+*/
+void cw_practice_text_delete(cw_practice_text_t ** text);
+
+
+
+
+/**
+   @brief Get next group of practice text from given source
+
+   The function may be called by only one thread at a time. @p source
+   must stay valid until @p text is deleted.
+
+   @param[in] text Prefetcher
+   @param[in] source Source of text, passed to generator
+   @param[out] group Buffer for NUL-terminated group
+   @param[in] size Size of @p group
+
+   @return length of group on success
+   @return -1 if generator failed
+*/
+int cw_practice_text_get_group(cw_practice_text_t * text, const void * source, char * group, size_t size);
+
+
+
+
+#if defined(__cplusplus)
+}
+#endif
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_PRACTICE_TEXT_H */
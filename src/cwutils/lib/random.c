@@ -48,6 +48,17 @@
 
    Further pointers:
    1. getauxval + AT_RANDOM (https://man7.org/linux/man-pages/man3/getauxval.3.html)
+
+   The generator itself is xoshiro256** (https://prng.di.unimi.it/), with
+   state initialized from the seed by splitmix64. It is independent of
+   libc's generator, so sequences for given seed are the same on all
+   platforms (OpenBSD's srand48() ignores seed unless
+   srand48_deterministic() is used), and each cw_random_t instance can be
+   used by its own thread without locking.
+
+   Bounded values are generated with Lemire's multiply-and-reject method
+   ("Fast Random Integer Generation in an Interval", 2019), which avoids
+   both the bias and the division of "value % bound".
 */
 
 
@@ -69,6 +80,16 @@
 
 
 static uint32_t cw_random_get_seed(void);
+static uint64_t cw_random_splitmix64(uint64_t * x);
+static uint64_t cw_random_rotl(uint64_t x, int k);
+static cw_random_t * cw_random_get_global(void);
+
+
+
+
+/* Generator used by functions that don't take cw_random_t argument. */
+static cw_random_t g_rng;
+static bool g_rng_initialized = false;
 
 
 
@@ -160,6 +181,133 @@ static uint32_t cw_random_get_seed(void)
 
 
 
+static uint64_t cw_random_splitmix64(uint64_t * x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+
+
+static uint64_t cw_random_rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+
+
+
+uint64_t cw_random_init(cw_random_t * rng, uint64_t seed)
+{
+	if (0 == seed) {
+		/* Generators initialized by different threads (or processes)
+		   at the same moment should still get different seeds. */
+		seed = cw_random_get_seed();
+		seed ^= (uint64_t) getpid() << 32;
+		seed ^= (uint64_t) (uintptr_t) rng * 0x9e3779b97f4a7c15ULL;
+		if (0 == seed) {
+			seed = 1;
+		}
+	}
+
+	/* splitmix64 output is never all-zero for four consecutive calls, so
+	   the state is valid for xoshiro. */
+	uint64_t x = seed;
+	for (int i = 0; i < 4; i++) {
+		rng->s[i] = cw_random_splitmix64(&x);
+	}
+
+	return seed;
+}
+
+
+
+
+uint64_t cw_random_next(cw_random_t * rng)
+{
+	uint64_t * s = rng->s;
+	const uint64_t result = cw_random_rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+
+	s[2] ^= t;
+	s[3] = cw_random_rotl(s[3], 45);
+
+	return result;
+}
+
+
+
+
+uint32_t cw_random_get_bounded(cw_random_t * rng, uint32_t bound)
+{
+	uint64_t m = (cw_random_next(rng) >> 32) * bound;
+	uint32_t low = (uint32_t) m;
+	if (low < bound) {
+		/* Rare case: reject values from the incomplete last interval. */
+		const uint32_t threshold = -bound % bound;
+		while (low < threshold) {
+			m = (cw_random_next(rng) >> 32) * bound;
+			low = (uint32_t) m;
+		}
+	}
+	return (uint32_t) (m >> 32);
+}
+
+
+
+
+void cw_random_fill_bounded(cw_random_t * rng, uint32_t bound, uint32_t * values, size_t count)
+{
+	/* Calculate the threshold once, and use both halves of each 64-bit
+	   output of generator. */
+	const uint32_t threshold = -bound % bound;
+	uint64_t bits = 0;
+	int n_halves = 0;
+
+	size_t i = 0;
+	while (i < count) {
+		if (0 == n_halves) {
+			bits = cw_random_next(rng);
+			n_halves = 2;
+		}
+		const uint64_t m = (bits >> 32) * bound;
+		bits <<= 32;
+		n_halves--;
+
+		if ((uint32_t) m < threshold) {
+			continue;
+		}
+		values[i++] = (uint32_t) (m >> 32);
+	}
+}
+
+
+
+
+/**
+   @brief Get global generator, initialize it if necessary
+
+   @return global generator
+*/
+static cw_random_t * cw_random_get_global(void)
+{
+	if (!g_rng_initialized) {
+		cw_random_srand(0);
+	}
+	return &g_rng;
+}
+
+
+
+
 uint32_t cw_random_srand(uint32_t seed)
 {
 	uint32_t value = 0;
@@ -169,22 +317,8 @@ uint32_t cw_random_srand(uint32_t seed)
 		value = seed;
 	}
 
-#ifdef __OpenBSD__
-	/*
-	  OpenBSD's implementation of srand48() ignores seed, which doesn't
-	  allow for *deterministic* pseudorandom sequences. See
-	  https://man.openbsd.org/srand48 for more info.
-
-	  I need to have deterministic sequences to be able to repeat a bug that
-	  happened when a test was executed with specific seed.
-
-	  unixcw doesn't do cryptography, so non-deterministic sequences are not
-	  required.
-	*/
-	srand48_deterministic((long int) value);
-#else
-	srand48((long int) value);
-#endif
+	cw_random_init(&g_rng, value);
+	g_rng_initialized = true;
 
 	return value;
 }
@@ -206,14 +340,8 @@ int cw_random_get_int(int lower, int upper, int * result)
 		fprintf(stderr, "[ERROR] %s:%d: Invalid pointer arg\n", __func__, __LINE__);
 		return -1;
 	}
-	/* FIXME acerion 2023.10.01: lrand48() returns value in range 0-MAX, so
-	   think twice about this casting before implementing support for
-	   negative 'upper' and/or 'lower' values. */
-	const int initial = (int) lrand48();
-	/* FIXME acerion 2023.10.01: the arithmetic operations are not tested if
-	   'upper' and/or 'lower' is negative. */
-	const int value = lower + (initial % (upper + 1 - lower));
-	*result = value;
+	const uint32_t bound = (uint32_t) upper + 1 - (uint32_t) lower;
+	*result = lower + (int) cw_random_get_bounded(cw_random_get_global(), bound);
 	return 0;
 }
 
@@ -231,19 +359,13 @@ int cw_random_get_uint32(uint32_t lower, uint32_t upper, uint32_t * result)
 		return -1;
 	}
 
-	/*
-	  The lrand48() function returns 'long' value, but man page says that
-	  generated values are in range "0 to 2^31 - 1". So if on my machine the
-	  'long' type has 8 bytes, then not all bits in long values would be
-	  random.
-
-	  To avoid confusion about how many random values are actually possible
-	  to pull from this function, I can't return long, and I have to
-	  return uint32_t.
-	*/
-	const uint32_t initial = (uint32_t) lrand48();
-	const uint32_t value = lower + (initial % (upper + 1 - lower));
-	*result = value;
+	const uint32_t bound = upper + 1 - lower;
+	if (0 == bound) {
+		/* Full range of uint32_t. */
+		*result = (uint32_t) (cw_random_next(cw_random_get_global()) >> 32);
+	} else {
+		*result = lower + cw_random_get_bounded(cw_random_get_global(), bound);
+	}
 	return 0;
 }
 
@@ -257,14 +379,8 @@ int cw_random_get_bool(bool * result)
 		return -1;
 	}
 
-	const uint32_t value = (uint32_t) lrand48();
-	const uint32_t val = value / 10;
-	*result = val % 2;
-#if 0 /* Debug. */
-	fprintf(stderr, "%s:%d: bool = %-5s (from 0x%08x / %12u / %12u integer)\n",
-	        __func__, __LINE__,
-	        *result ? "true" : "false", value, value, val);
-#endif
+	/* High bits of xoshiro256** output are the best ones. */
+	*result = cw_random_next(cw_random_get_global()) >> 63;
 	return 0;
 }
 
@@ -4,16 +4,99 @@
 
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
 
 
 /**
-   @brief Initialize random number generator
+   @brief State of pseudo-random number generator
 
-   Pass @p seed value to some internal seed() function. The seed is used to
-   initialize (pseudo-)random number generator.
+   xoshiro256** generator: fast, with small state, and good enough
+   statistical properties for generating random groups, words and test
+   data. Each instance has its own state, so instances used by different
+   threads don't have to be synchronized.
+
+   Initialize the state with cw_random_init() before using it.
+*/
+typedef struct cw_random_t {
+	uint64_t s[4];
+} cw_random_t;
+
+
+
+
+/**
+   @brief Initialize state of random number generator with a seed
+
+   The same non-zero @p seed always results in the same sequence of
+   values returned by the generator, so a run of a program can be
+   repeated by passing the seed used in that run.
+
+   If @p seed is zero, the function will generate a seed itself internally.
+
+   @param[out] rng State of generator to initialize
+   @param[in] seed Seed value, or zero
+
+   @return value of seed that was used to initialize the generator (never zero)
+*/
+uint64_t cw_random_init(cw_random_t * rng, uint64_t seed);
+
+
+
+
+/**
+   @brief Get next 64 random bits from generator
+
+   @param[in/out] rng Initialized state of generator
+
+   @return random value
+*/
+uint64_t cw_random_next(cw_random_t * rng);
+
+
+
+
+/**
+   @brief Get random integer in range [0, @p bound)
+
+   All values from the range are equally probable: the function doesn't
+   have the bias of "random() % bound".
+
+   @param[in/out] rng Initialized state of generator
+   @param[in] bound Upper bound of range (exclusive), must be non-zero
+
+   @return random value
+*/
+uint32_t cw_random_get_bounded(cw_random_t * rng, uint32_t bound);
+
+
+
+
+/**
+   @brief Fill array with random integers in range [0, @p bound)
+
+   Equivalent of calling cw_random_get_bounded() @p count times, but
+   faster when many values are needed at once.
+
+   @param[in/out] rng Initialized state of generator
+   @param[in] bound Upper bound of range (exclusive), must be non-zero
+   @param[out] values Array to fill
+   @param[in] count Count of items in @p values
+*/
+void cw_random_fill_bounded(cw_random_t * rng, uint32_t bound, uint32_t * values, size_t count);
+
+
+
+
+/**
+   @brief Initialize global random number generator
+
+   The seed is used to initialize (pseudo-)random number generator used by
+   cw_random_get_int(), cw_random_get_uint32() and cw_random_get_bool().
+   Code that may run in many threads at once should use its own
+   cw_random_t instead of the global generator.
 
    If @p seed is not zero, it will be used to seed the generator, per above description.
    If @p seed is zero, the function will generate a seed itself internally.
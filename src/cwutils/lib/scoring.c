@@ -0,0 +1,485 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "scoring.h"
+#include "wav_reader.h"
+
+
+
+
+/**
+   \file scoring.c
+
+   Headless scoring of recordings of keying.
+
+   A recording (wav file or recorded key edges) is decoded with cw_rec_t,
+   decoded text is compared with expected text, and durations of elements
+   are collected in statistics. Nothing here depends on UI, so many
+   recordings can be scored in parallel.
+*/
+
+
+
+
+/* From PARIS calibration, 1 Dot duration [us] = 1200000 / speed [wpm]. */
+#define DOT_CALIBRATION 1200000.0
+
+
+
+
+/* Shared state of threads scoring recordings. */
+typedef struct cw_score_pool_t {
+	const cw_score_job_t * jobs;
+	cw_score_result_t * results;
+	size_t n_jobs;
+	const cw_score_config_t * config;
+	size_t next_job;     /* Index of next job to take by a thread. */
+	int retval;
+} cw_score_pool_t;
+
+
+
+
+static void * cw_score_thread_fn(void * arg);
+static bool is_wav_file(const char * path);
+static int decode_recording(const cw_score_job_t * job, const cw_score_config_t * config, cw_elements_pipeline_result_t * elements, char ** decoded_text);
+
+
+
+
+size_t cw_score_edit_distance(const char * a, const char * b)
+{
+	const size_t len_a = strlen(a);
+	const size_t len_b = strlen(b);
+
+	/* Two rows of the matrix of distances. */
+	size_t * prev = (size_t *) calloc(2 * (len_b + 1), sizeof (size_t));
+	if (NULL == prev) {
+		return len_a > len_b ? len_a : len_b;
+	}
+	size_t * row = prev + len_b + 1;
+
+	for (size_t j = 0; j <= len_b; j++) {
+		prev[j] = j;
+	}
+	for (size_t i = 1; i <= len_a; i++) {
+		row[0] = i;
+		for (size_t j = 1; j <= len_b; j++) {
+			const size_t substitution = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+			const size_t deletion = prev[j] + 1;
+			const size_t insertion = row[j - 1] + 1;
+			size_t distance = substitution < deletion ? substitution : deletion;
+			distance = distance < insertion ? distance : insertion;
+			row[j] = distance;
+		}
+		size_t * tmp = prev;
+		prev = row;
+		row = tmp;
+	}
+
+	const size_t distance = prev[len_b];
+	free(prev < row ? prev : row);
+	return distance;
+}
+
+
+
+
+void cw_score_normalize_text(char * text)
+{
+	size_t out = 0;
+	bool pending_space = false;
+	for (size_t in = 0; '\0' != text[in]; in++) {
+		const int c = (unsigned char) text[in];
+		if (isspace(c)) {
+			/* Leading spaces are dropped, other runs of spaces become one space. */
+			pending_space = out > 0;
+			continue;
+		}
+		if (pending_space) {
+			text[out++] = ' ';
+			pending_space = false;
+		}
+		text[out++] = (char) tolower(c);
+	}
+	text[out] = '\0';
+}
+
+
+
+
+int cw_score_read_key_edges(const char * path, cw_rec_edge_t ** edges, size_t * n_edges)
+{
+	*edges = NULL;
+	*n_edges = 0;
+
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		fprintf(stderr, "[ERROR] Can't open file with key edges '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	cw_rec_edge_t * out = NULL;
+	size_t n_out = 0;
+	size_t capacity = 0;
+
+	bool started = false;        /* Whether first key down has been read. */
+	int prev_state = 0;
+	double prev_timestamp = 0.0;
+
+	char * line = NULL;
+	size_t line_size = 0;
+	size_t line_number = 0;
+	int retval = 0;
+	while (-1 != getline(&line, &line_size, file)) {
+		line_number++;
+
+		const char * p = line;
+		while (isspace((unsigned char) *p)) {
+			p++;
+		}
+		if ('\0' == *p || '#' == *p) {
+			continue;
+		}
+
+		double timestamp = 0.0;
+		int state = 0;
+		if (2 != sscanf(p, "%lf %d", &timestamp, &state) || (0 != state && 1 != state)) {
+			fprintf(stderr, "[ERROR] Invalid key edge in line %zu of '%s'\n", line_number, path);
+			retval = -1;
+			break;
+		}
+		if (started && timestamp < prev_timestamp) {
+			fprintf(stderr, "[ERROR] Timestamp in line %zu of '%s' is earlier than previous one\n", line_number, path);
+			retval = -1;
+			break;
+		}
+
+		if (!started) {
+			if (1 == state) {
+				started = true;
+				prev_state = state;
+				prev_timestamp = timestamp;
+			}
+			continue;
+		}
+		if (state == prev_state) {
+			continue;
+		}
+
+		if (n_out == capacity) {
+			capacity = 0 == capacity ? 1024 : 2 * capacity;
+			cw_rec_edge_t * new_out = (cw_rec_edge_t *) realloc(out, capacity * sizeof (cw_rec_edge_t));
+			if (NULL == new_out) {
+				fprintf(stderr, "[ERROR] Failed to allocate key edges of '%s'\n", path);
+				retval = -1;
+				break;
+			}
+			out = new_out;
+		}
+		/* Duration of Mark or Space that has just ended. */
+		out[n_out].timespan = timestamp - prev_timestamp;
+		out[n_out].is_mark = 1 == prev_state;
+		n_out++;
+
+		prev_state = state;
+		prev_timestamp = timestamp;
+	}
+	free(line);
+	fclose(file);
+
+	if (0 != retval) {
+		free(out);
+		return -1;
+	}
+
+	/* Last item is a Space that has been cut short by end of recording:
+	   receiver will get its own long Space after the last Mark. */
+	if (n_out > 0 && !out[n_out - 1].is_mark) {
+		n_out--;
+	}
+
+	*edges = out;
+	*n_edges = n_out;
+	return 0;
+}
+
+
+
+
+int cw_score_recording(const cw_score_job_t * job, const cw_score_config_t * config, cw_score_result_t * result)
+{
+	memset(result, 0, sizeof (cw_score_result_t));
+
+	if (0 != decode_recording(job, config, &result->elements, &result->decoded_text)) {
+		fprintf(stderr, "[ERROR] Failed to decode recording '%s'\n", job->recording_path);
+		return -1;
+	}
+
+	char * expected = strdup(job->expected_text);
+	if (NULL == expected) {
+		fprintf(stderr, "[ERROR] Failed to copy expected text\n");
+		return -1;
+	}
+	cw_score_normalize_text(expected);
+	cw_score_normalize_text(result->decoded_text);
+
+	result->n_expected = strlen(expected);
+	result->n_decoded = strlen(result->decoded_text);
+	result->n_errors = cw_score_edit_distance(expected, result->decoded_text);
+	free(expected);
+
+	if (0 == result->n_expected) {
+		result->accuracy_percent = 0 == result->n_errors ? 100.0F : 0.0F;
+	} else if (result->n_errors >= result->n_expected) {
+		result->accuracy_percent = 0.0F;
+	} else {
+		result->accuracy_percent = 100.0F - 100.0F * (float) result->n_errors / (float) result->n_expected;
+	}
+	result->success = true;
+
+	return 0;
+}
+
+
+
+
+int cw_score_run(const cw_score_job_t * jobs, cw_score_result_t * results, size_t n_jobs, const cw_score_config_t * config, unsigned int n_threads)
+{
+	if (0 == n_threads) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = n_cpus > 0 ? (unsigned int) n_cpus : 1;
+	}
+	if (n_threads > n_jobs) {
+		n_threads = (unsigned int) n_jobs;
+	}
+
+	/* Results of jobs that won't be taken by any thread are still valid. */
+	memset(results, 0, n_jobs * sizeof (cw_score_result_t));
+
+	cw_score_pool_t pool = {
+		.jobs = jobs,
+		.results = results,
+		.n_jobs = n_jobs,
+		.config = config,
+		.next_job = 0,
+		.retval = 0,
+	};
+
+	pthread_t * threads = (pthread_t *) calloc(n_threads, sizeof (pthread_t));
+	if (NULL == threads && n_threads > 0) {
+		fprintf(stderr, "[ERROR] Failed to allocate threads of scoring\n");
+		return -1;
+	}
+
+	unsigned int n_started = 0;
+	for (; n_started < n_threads; n_started++) {
+		if (0 != pthread_create(&threads[n_started], NULL, cw_score_thread_fn, &pool)) {
+			fprintf(stderr, "[ERROR] Failed to start thread %u of scoring\n", n_started);
+			break;
+		}
+	}
+	if (0 == n_started && n_jobs > 0) {
+		/* Score at least in this thread. */
+		cw_score_thread_fn(&pool);
+	}
+	for (unsigned int i = 0; i < n_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	return pool.retval;
+}
+
+
+
+
+void cw_score_result_free(cw_score_result_t * result)
+{
+	free(result->decoded_text);
+	result->decoded_text = NULL;
+}
+
+
+
+
+void cw_score_print_results(FILE * file, const cw_score_job_t * jobs, const cw_score_result_t * results, size_t n_jobs)
+{
+	fprintf(file, "expected  decoded  errors  accuracy    speed   dot avg  dash avg  dash/dot  ims diverg.  recording\n");
+
+	size_t n_scored = 0;
+	double accuracy_total = 0.0;
+	for (size_t i = 0; i < n_jobs; i++) {
+		const cw_score_result_t * result = &results[i];
+		if (!result->success) {
+			fprintf(file, "(failed)                                                                                %s\n", jobs[i].recording_path);
+			continue;
+		}
+		n_scored++;
+		accuracy_total += (double) result->accuracy_percent;
+
+		const cw_element_stats_t * dots = &result->elements.stats[cw_element_type_dot];
+		const cw_element_stats_t * dashes = &result->elements.stats[cw_element_type_dash];
+		const cw_element_stats_t * ims = &result->elements.stats[cw_element_type_ims];
+		const double ratio = dots->count && dashes->count ? (double) dashes->duration_avg / (double) dots->duration_avg : 0.0;
+
+		cw_element_stats_divergences_t ims_divergences = { 0 };
+		if (ims->count && result->elements.speed > 0.0F) {
+			const int dot_duration = (int) lround(DOT_CALIBRATION / (double) result->elements.speed);
+			cw_element_stats_calculate_divergences(ims, &ims_divergences, dot_duration);
+		}
+
+		fprintf(file, "%8zu  %7zu  %6zu  %7.2f%%  %7.2f  %8d  %8d  %8.2f  %10.2f%%  %s\n",
+			result->n_expected, result->n_decoded, result->n_errors,
+			(double) result->accuracy_percent,
+			(double) result->elements.speed,
+			dots->duration_avg, dashes->duration_avg, ratio,
+			ims_divergences.avg,
+			jobs[i].recording_path);
+	}
+
+	fprintf(file, "scored %zu of %zu recordings", n_scored, n_jobs);
+	if (n_scored) {
+		fprintf(file, ", average accuracy %.2f%%", accuracy_total / (double) n_scored);
+	}
+	fprintf(file, "\n");
+}
+
+
+
+
+/**
+   @brief Thread function of scoring
+
+   Take jobs from shared pool until all jobs have been taken.
+
+   @param[in/out] arg Pool of jobs (cw_score_pool_t)
+
+   @return NULL
+*/
+static void * cw_score_thread_fn(void * arg)
+{
+	cw_score_pool_t * pool = (cw_score_pool_t *) arg;
+
+	while (true) {
+		const size_t i = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED);
+		if (i >= pool->n_jobs) {
+			break;
+		}
+		if (0 != cw_score_recording(&pool->jobs[i], pool->config, &pool->results[i])) {
+			__atomic_store_n(&pool->retval, -1, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Check if file is a wav file
+
+   @param[in] path Path to file
+
+   @return true if file starts with RIFF or RF64 header
+   @return false otherwise
+*/
+static bool is_wav_file(const char * path)
+{
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		return false;
+	}
+	char header[4] = { 0 };
+	const size_t n = fread(header, 1, sizeof (header), file);
+	fclose(file);
+
+	return sizeof (header) == n && (0 == memcmp(header, "RIFF", 4) || 0 == memcmp(header, "RF64", 4));
+}
+
+
+
+
+/**
+   @brief Decode text and collect statistics of elements of a recording
+
+   @param[in] job Recording to decode
+   @param[in] config Configuration of scoring
+   @param[out] elements Statistics of elements of recording
+   @param[out] decoded_text Decoded text, allocated by the function. Free with free().
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int decode_recording(const cw_score_job_t * job, const cw_score_config_t * config, cw_elements_pipeline_result_t * elements, char ** decoded_text)
+{
+	/* Decoded characters are collected in memory of this thread. */
+	size_t text_size = 0;
+	FILE * text_file = open_memstream(decoded_text, &text_size);
+	if (NULL == text_file) {
+		fprintf(stderr, "[ERROR] Failed to open buffer for decoded text: %s\n", strerror(errno));
+		return -1;
+	}
+
+	const cw_elements_pipeline_config_t pipeline_config = {
+		.channel = config->channel,
+		.speed = config->speed,
+		.text_file = text_file,
+		.report_file = stderr,
+	};
+
+	int retval = 0;
+	if (is_wav_file(job->recording_path)) {
+		wav_reader_t reader;
+		if (0 != wav_reader_open(&reader, job->recording_path)) {
+			retval = -1;
+		} else {
+			retval = cw_elements_pipeline_run(&reader, &pipeline_config, elements);
+			wav_reader_close(&reader);
+		}
+	} else {
+		cw_rec_edge_t * edges = NULL;
+		size_t n_edges = 0;
+		retval = cw_score_read_key_edges(job->recording_path, &edges, &n_edges);
+		if (0 == retval) {
+			retval = cw_elements_pipeline_run_edges(edges, n_edges, &pipeline_config, elements);
+		}
+		free(edges);
+	}
+
+	/* The buffer is allocated by open_memstream() even if nothing
+	   has been written. */
+	fclose(text_file);
+	if (NULL == *decoded_text) {
+		return -1;
+	}
+
+	return retval;
+}
@@ -0,0 +1,184 @@
+#ifndef UNIXCW_CWUTILS_LIB_SCORING_H
+#define UNIXCW_CWUTILS_LIB_SCORING_H
+
+
+
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <libcw/libcw2.h>
+
+#include "elements_pipeline.h"
+
+
+
+
+/**
+   @brief Configuration of scoring of recordings
+*/
+typedef struct cw_score_config_t {
+	int speed;                 /**< Speed of receiver [wpm]. Zero: receiver works in adaptive mode. */
+	unsigned int channel;      /**< Channel of wav files in which to detect elements. */
+} cw_score_config_t;
+
+
+
+
+/**
+   @brief One recording to score
+*/
+typedef struct cw_score_job_t {
+	const char * recording_path;  /**< wav file, or text file with recorded key edges. */
+	const char * expected_text;   /**< Text that should have been keyed. */
+} cw_score_job_t;
+
+
+
+
+/**
+   @brief Score of one recording
+*/
+typedef struct cw_score_result_t {
+	char * decoded_text;         /**< Normalized text decoded from recording. Owned by result. */
+
+	size_t n_expected;           /**< Count of characters (including spaces) of normalized expected text. */
+	size_t n_decoded;            /**< Count of characters (including spaces) of normalized decoded text. */
+	size_t n_errors;             /**< Edit distance between expected and decoded text. */
+	float accuracy_percent;      /**< 100% minus n_errors / n_expected, not less than zero [percents]. */
+
+	/* Timing of keying: count of elements, speed of receiver at the end
+	   of recording, and statistics of durations of elements. */
+	cw_elements_pipeline_result_t elements;
+
+	bool success;                /**< Whether the recording could be read and decoded. */
+} cw_score_result_t;
+
+
+
+
+/**
+   @brief Calculate edit (Levenshtein) distance between two strings
+
+   Unlike comparison of characters at the same positions, edit distance
+   counts a character that was missed or that was received twice as one
+   error, and doesn't count all following characters as errors.
+
+   @param[in] a First string
+   @param[in] b Second string
+
+   @return count of insertions, deletions and substitutions that transform @p a into @p b
+*/
+size_t cw_score_edit_distance(const char * a, const char * b);
+
+
+
+
+/**
+   @brief Remove non-consequential differences from text
+
+   Convert text to lower case, replace every run of white space characters
+   with single space, and remove white space from beginning and end of
+   text. The text is modified in place.
+
+   @param[in/out] text Text to normalize
+*/
+void cw_score_normalize_text(char * text);
+
+
+
+
+/**
+   @brief Read recorded key edges from text file
+
+   Each line of the file has a timestamp of a change of state of key
+   [microseconds] and the new state of key: 1 for key down, 0 for key
+   up. Timestamps must not decrease. Empty lines and lines starting with
+   '#' are ignored.
+
+   Edges before first key down and repeated states are ignored. A Mark
+   that is still lasting at the end of the file is ignored too.
+
+   @param[in] path Path to file with key edges
+   @param[out] edges Marks and Spaces read from file, starting with a Mark. Free with free().
+   @param[out] n_edges Count of items in @p edges
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_score_read_key_edges(const char * path, cw_rec_edge_t ** edges, size_t * n_edges);
+
+
+
+
+/**
+   @brief Decode a recording and compare it with expected text
+
+   wav files (recognized by RIFF or RF64 header) are decoded with
+   elements pipeline. Other files are read with cw_score_read_key_edges().
+
+   Call cw_score_result_free() on @p result when it's no longer needed,
+   also when the function fails.
+
+   @param[in] job Recording to score and its expected text
+   @param[in] config Configuration of scoring
+   @param[out] result Score of the recording
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int cw_score_recording(const cw_score_job_t * job, const cw_score_config_t * config, cw_score_result_t * result);
+
+
+
+
+/**
+   @brief Score many recordings in parallel
+
+   Recordings are distributed among @p n_threads threads (zero: one thread
+   per online CPU). Each recording is decoded with its own receiver, so
+   results depend only on recordings, not on count of threads.
+
+   @param[in] jobs Array of recordings to score
+   @param[out] results Array of results, one for each job. Free each item with cw_score_result_free().
+   @param[in] n_jobs Count of items in @p jobs and @p results
+   @param[in] config Configuration of scoring
+   @param[in] n_threads Count of threads scoring the recordings
+
+   @return 0 if all recordings have been scored
+   @return -1 otherwise
+*/
+int cw_score_run(const cw_score_job_t * jobs, cw_score_result_t * results, size_t n_jobs, const cw_score_config_t * config, unsigned int n_threads);
+
+
+
+
+/**
+   @brief Free resources owned by result of scoring
+
+   @param[in/out] result Result of scoring
+*/
+void cw_score_result_free(cw_score_result_t * result);
+
+
+
+
+/**
+   @brief Print results of scoring as a table
+
+   Besides accuracy, for each recording the table shows speed of
+   receiver, average durations of Dots and Dashes and their ratio (ideal
+   keying has ratio 3.0), and divergence of average inter-mark-space from
+   its ideal duration at receiver's speed.
+
+   @param[out] file File to print to
+   @param[in] jobs Scored recordings
+   @param[in] results Results of scoring
+   @param[in] n_jobs Count of items in @p jobs and @p results
+*/
+void cw_score_print_results(FILE * file, const cw_score_job_t * jobs, const cw_score_result_t * results, size_t n_jobs);
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_SCORING_H */
@@ -0,0 +1,358 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wav_reader.h"
+
+
+
+
+/**
+   \file wav_reader.c
+
+   Reader of wav files that maps the file into memory.
+
+   wav.c can only read the fixed 44-byte header of files produced by libcw.
+   Recordings made by other programs may have additional chunks, may use
+   other sample formats, may have more than one channel, and may be larger
+   than 4GB (RF64). This reader handles such files, and gives access to
+   samples without copying them.
+*/
+
+
+
+
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_IEEE_FLOAT   0x0003
+#define WAV_FORMAT_EXTENSIBLE   0xfffe
+
+/* Size of chunk's header: 4 bytes of id + 4 bytes of size. */
+#define CHUNK_HEADER_SIZE 8
+
+/* Size field of RIFF and "data" chunks in RF64 file: real size is in "ds64" chunk. */
+#define RF64_SIZE_IN_DS64 0xffffffffU
+
+
+
+
+static uint16_t get_le16(const uint8_t * p);
+static uint32_t get_le32(const uint8_t * p);
+static uint64_t get_le64(const uint8_t * p);
+static int parse_fmt_chunk(wav_reader_t * reader, const uint8_t * chunk, uint64_t chunk_size);
+static int parse_chunks(wav_reader_t * reader);
+
+
+
+
+int wav_reader_open(wav_reader_t * reader, const char * path)
+{
+	memset(reader, 0, sizeof (wav_reader_t));
+	reader->fd = -1;
+
+	reader->fd = open(path, O_RDONLY);
+	if (-1 == reader->fd) {
+		fprintf(stderr, "[ERROR] Can't open wav file '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (0 != fstat(reader->fd, &st)) {
+		fprintf(stderr, "[ERROR] Can't get size of wav file '%s': %s\n", path, strerror(errno));
+		wav_reader_close(reader);
+		return -1;
+	}
+	if (st.st_size < 12) {
+		fprintf(stderr, "[ERROR] wav file '%s' is too short: %jd bytes\n", path, (intmax_t) st.st_size);
+		wav_reader_close(reader);
+		return -1;
+	}
+	if ((uint64_t) st.st_size > SIZE_MAX) {
+		fprintf(stderr, "[ERROR] wav file '%s' is too large to be mapped into memory\n", path);
+		wav_reader_close(reader);
+		return -1;
+	}
+
+	void * map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "[ERROR] Can't map wav file '%s': %s\n", path, strerror(errno));
+		wav_reader_close(reader);
+		return -1;
+	}
+	reader->map = map;
+	reader->map_size = (size_t) st.st_size;
+
+	/* Samples are usually processed from beginning to end of file. */
+	madvise(map, reader->map_size, MADV_SEQUENTIAL);
+
+	if (0 != parse_chunks(reader)) {
+		fprintf(stderr, "[ERROR] Can't parse header of wav file '%s'\n", path);
+		wav_reader_close(reader);
+		return -1;
+	}
+
+	fprintf(stderr, "[INFO ] Audio file '%s':\n", path);
+	fprintf(stderr, "[INFO ]     number of channels: %8u\n", reader->n_channels);
+	fprintf(stderr, "[INFO ]     sample rate:        %8u\n", reader->sample_rate);
+	fprintf(stderr, "[INFO ]     bits per sample:    %8u%s\n", reader->bytes_per_sample * 8,
+		wav_sample_format_float32 == reader->sample_format ? " (float)" : "");
+	fprintf(stderr, "[INFO ]     count of frames:    %8ju\n", (uintmax_t) reader->n_frames);
+
+	return 0;
+}
+
+
+
+
+void wav_reader_close(wav_reader_t * reader)
+{
+	if (NULL != reader->map) {
+		munmap(reader->map, reader->map_size);
+		reader->map = NULL;
+		reader->map_size = 0;
+	}
+	if (-1 != reader->fd) {
+		close(reader->fd);
+		reader->fd = -1;
+	}
+	reader->data = NULL;
+	reader->n_frames = 0;
+}
+
+
+
+
+int wav_reader_get_span(const wav_reader_t * reader, uint64_t first_frame, size_t n_samples, unsigned int channel, wav_span_t * span)
+{
+	if (channel >= reader->n_channels) {
+		fprintf(stderr, "[ERROR] Invalid channel %u, count of channels is %u\n", channel, reader->n_channels);
+		return -1;
+	}
+
+	if (first_frame >= reader->n_frames) {
+		n_samples = 0;
+		first_frame = reader->n_frames;
+	} else if (n_samples > reader->n_frames - first_frame) {
+		n_samples = (size_t) (reader->n_frames - first_frame);
+	}
+
+	span->data = reader->data + first_frame * reader->block_align + channel * reader->bytes_per_sample;
+	span->n_samples = n_samples;
+	span->stride = reader->block_align;
+	span->sample_format = reader->sample_format;
+
+	return 0;
+}
+
+
+
+
+float wav_span_get_sample(const wav_span_t * span, size_t i)
+{
+	const uint8_t * sample = span->data + i * span->stride;
+	switch (span->sample_format) {
+	case wav_sample_format_int16:
+		return (int16_t) get_le16(sample) / 32768.0f;
+	case wav_sample_format_int24: {
+		/* Put 24 bits in upper part of 32-bit integer to get sign right. */
+		const int32_t value = (int32_t) ((uint32_t) sample[0] << 8 | (uint32_t) sample[1] << 16 | (uint32_t) sample[2] << 24);
+		return (value >> 8) / 8388608.0f;
+	}
+	case wav_sample_format_float32:
+	default: {
+		const uint32_t bits = get_le32(sample);
+		float value = 0.0f;
+		memcpy(&value, &bits, sizeof (value));
+		return value;
+	}
+	}
+}
+
+
+
+
+/**
+   @brief Parse chunks of mapped wav file
+
+   Find "fmt " and "data" chunks (and "ds64" chunk in RF64 file), and set
+   fields of @p reader accordingly. Other chunks are skipped.
+
+   @param[in/out] reader Reader with mapped file
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int parse_chunks(wav_reader_t * reader)
+{
+	const uint8_t * map = reader->map;
+	const uint64_t map_size = reader->map_size;
+
+	const bool is_rf64 = 0 == memcmp(map, "RF64", 4);
+	if ((!is_rf64 && 0 != memcmp(map, "RIFF", 4)) || 0 != memcmp(map + 8, "WAVE", 4)) {
+		fprintf(stderr, "[ERROR] File is not a RIFF/RF64 WAVE file\n");
+		return -1;
+	}
+
+	uint64_t ds64_data_size = 0;
+	bool fmt_found = false;
+	uint64_t offset = 12;
+
+	while (offset + CHUNK_HEADER_SIZE <= map_size) {
+		const uint8_t * chunk = map + offset;
+		uint64_t chunk_size = get_le32(chunk + 4);
+		const uint64_t body_offset = offset + CHUNK_HEADER_SIZE;
+
+		if (0 == memcmp(chunk, "ds64", 4)) {
+			if (chunk_size < 24 || body_offset + 24 > map_size) {
+				fprintf(stderr, "[ERROR] ds64 chunk is too short: %ju\n", (uintmax_t) chunk_size);
+				return -1;
+			}
+			/* riffSize (8 bytes), dataSize (8 bytes), sampleCount (8 bytes), ... */
+			ds64_data_size = get_le64(map + body_offset + 8);
+
+		} else if (0 == memcmp(chunk, "fmt ", 4)) {
+			if (body_offset + chunk_size > map_size) {
+				fprintf(stderr, "[ERROR] fmt chunk extends past end of file\n");
+				return -1;
+			}
+			if (0 != parse_fmt_chunk(reader, map + body_offset, chunk_size)) {
+				return -1;
+			}
+			fmt_found = true;
+
+		} else if (0 == memcmp(chunk, "data", 4)) {
+			if (!fmt_found) {
+				fprintf(stderr, "[ERROR] data chunk found before fmt chunk\n");
+				return -1;
+			}
+			if (is_rf64 && RF64_SIZE_IN_DS64 == chunk_size) {
+				chunk_size = ds64_data_size;
+			}
+			/* Recordings that have been interrupted may have too large (or
+			   zero) size of data chunk. Use whatever is in the file. */
+			if (0 == chunk_size || body_offset + chunk_size > map_size) {
+				chunk_size = map_size - body_offset;
+			}
+			reader->data = map + body_offset;
+			reader->n_frames = chunk_size / reader->block_align;
+			return 0;
+		}
+
+		/* Chunks are aligned to even offsets. */
+		offset = body_offset + chunk_size + (chunk_size & 1);
+	}
+
+	fprintf(stderr, "[ERROR] data chunk not found\n");
+	return -1;
+}
+
+
+
+
+/**
+   @brief Parse body of "fmt " chunk
+
+   @param[in/out] reader Reader to configure with the format
+   @param[in] chunk Beginning of body of the chunk
+   @param[in] chunk_size Size of body of the chunk
+
+   @return 0 on success
+   @return -1 on failure (e.g. unsupported format)
+*/
+static int parse_fmt_chunk(wav_reader_t * reader, const uint8_t * chunk, uint64_t chunk_size)
+{
+	if (chunk_size < 16) {
+		fprintf(stderr, "[ERROR] fmt chunk is too short: %ju\n", (uintmax_t) chunk_size);
+		return -1;
+	}
+
+	uint16_t audio_format = get_le16(chunk + 0);
+	reader->n_channels = get_le16(chunk + 2);
+	reader->sample_rate = get_le32(chunk + 4);
+	reader->block_align = get_le16(chunk + 12);
+	const uint16_t bits_per_sample = get_le16(chunk + 14);
+
+	if (WAV_FORMAT_EXTENSIBLE == audio_format) {
+		/* cbSize (2), validBitsPerSample (2), channelMask (4), SubFormat
+		   GUID (16). First two bytes of GUID are the format code. */
+		if (chunk_size < 40) {
+			fprintf(stderr, "[ERROR] fmt chunk of extensible format is too short: %ju\n", (uintmax_t) chunk_size);
+			return -1;
+		}
+		audio_format = get_le16(chunk + 24);
+	}
+
+	if (WAV_FORMAT_PCM == audio_format && 16 == bits_per_sample) {
+		reader->sample_format = wav_sample_format_int16;
+	} else if (WAV_FORMAT_PCM == audio_format && 24 == bits_per_sample) {
+		reader->sample_format = wav_sample_format_int24;
+	} else if (WAV_FORMAT_IEEE_FLOAT == audio_format && 32 == bits_per_sample) {
+		reader->sample_format = wav_sample_format_float32;
+	} else {
+		fprintf(stderr, "[ERROR] Unsupported format of samples: format %#x, %u bits per sample\n",
+			audio_format, bits_per_sample);
+		return -1;
+	}
+	reader->bytes_per_sample = bits_per_sample / 8;
+
+	if (0 == reader->n_channels || 0 == reader->sample_rate) {
+		fprintf(stderr, "[ERROR] Invalid count of channels (%u) or sample rate (%u)\n",
+			reader->n_channels, reader->sample_rate);
+		return -1;
+	}
+	if (reader->block_align != reader->n_channels * reader->bytes_per_sample) {
+		fprintf(stderr, "[ERROR] Invalid block align %u, expected %u\n",
+			reader->block_align, reader->n_channels * reader->bytes_per_sample);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
+static uint16_t get_le16(const uint8_t * p)
+{
+	return (uint16_t) (p[0] | p[1] << 8);
+}
+
+
+
+
+static uint32_t get_le32(const uint8_t * p)
+{
+	return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+
+
+
+static uint64_t get_le64(const uint8_t * p)
+{
+	return (uint64_t) get_le32(p) | (uint64_t) get_le32(p + 4) << 32;
+}
@@ -0,0 +1,161 @@
+#ifndef UNIXCW_CWUTILS_LIB_WAV_READER_H
+#define UNIXCW_CWUTILS_LIB_WAV_READER_H
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+/**
+   @brief Format of samples in data chunk of wav file
+*/
+typedef enum wav_sample_format_t {
+	wav_sample_format_int16,     /* Signed 16-bit little-endian integer PCM. */
+	wav_sample_format_int24,     /* Signed 24-bit little-endian integer PCM, packed in 3 bytes. */
+	wav_sample_format_float32,   /* 32-bit little-endian IEEE float. */
+} wav_sample_format_t;
+
+
+
+
+/**
+   @brief Reader of wav file mapped into memory
+
+   The whole file is mapped with mmap(), and samples are accessed directly
+   in the mapping, so files larger than available memory can be processed.
+
+   Both RIFF and RF64 files are supported. Format of samples is taken from
+   "fmt " chunk (including WAVE_FORMAT_EXTENSIBLE format), position and
+   size of samples is taken from "data" chunk (and from "ds64" chunk for
+   RF64).
+*/
+typedef struct wav_reader_t {
+	int fd;
+	void * map;                  /* Whole file mapped into memory. */
+	size_t map_size;
+
+	const uint8_t * data;        /* Beginning of data chunk's samples in the mapping. */
+	uint64_t n_frames;           /* Count of frames (sets of samples from all channels) in data chunk. */
+
+	wav_sample_format_t sample_format;
+	uint16_t n_channels;
+	uint32_t sample_rate;
+	uint16_t bytes_per_sample;
+	uint16_t block_align;        /* Size of one frame [bytes]. */
+} wav_reader_t;
+
+
+
+
+/**
+   @brief Span of consecutive samples of one channel
+
+   The samples aren't copied: the span points into mapping of wav file. In
+   multi-channel file samples of a channel are interleaved with samples of
+   other channels, so consecutive samples of the span are @p stride bytes
+   apart.
+*/
+typedef struct wav_span_t {
+	const uint8_t * data;        /* First byte of first sample in span. */
+	size_t n_samples;
+	size_t stride;               /* Distance between consecutive samples [bytes]. */
+	wav_sample_format_t sample_format;
+} wav_span_t;
+
+
+
+
+/**
+   @brief Open a wav file and map it into memory
+
+   Header of the file is parsed and validated. On success the @p reader is
+   ready to be used with wav_reader_get_span().
+
+   @param[out] reader Reader to initialize
+   @param[in] path Path to wav file
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int wav_reader_open(wav_reader_t * reader, const char * path);
+
+
+
+
+/**
+   @brief Unmap and close a wav file opened with wav_reader_open()
+
+   @param[in/out] reader Reader to close
+*/
+void wav_reader_close(wav_reader_t * reader);
+
+
+
+
+/**
+   @brief Get span of samples of one channel
+
+   The span is truncated if it would extend past end of data chunk, so @p
+   span may contain less than @p n_samples samples (or none at all, at the
+   end of data).
+
+   @param[in] reader Opened reader
+   @param[in] first_frame Index of frame with first sample of span
+   @param[in] n_samples Requested count of samples in span
+   @param[in] channel Index of channel from which to get samples
+   @param[out] span Span of samples
+
+   @return 0 on success
+   @return -1 on invalid channel
+*/
+int wav_reader_get_span(const wav_reader_t * reader, uint64_t first_frame, size_t n_samples, unsigned int channel, wav_span_t * span);
+
+
+
+
+/**
+   @brief Get value of sample from span, scaled to range [-1.0, 1.0)
+
+   @param[in] span Span of samples
+   @param[in] i Index of sample in span
+
+   @return value of sample
+*/
+float wav_span_get_sample(const wav_span_t * span, size_t i);
+
+
+
+
+/**
+   @brief Check if sample in span has value of zero
+
+   @param[in] span Span of samples
+   @param[in] i Index of sample in span
+
+   @return true if value of the sample is zero
+   @return false otherwise
+*/
+static inline bool wav_span_sample_is_zero(const wav_span_t * span, size_t i)
+{
+	const uint8_t * sample = span->data + i * span->stride;
+	switch (span->sample_format) {
+	case wav_sample_format_int16:
+		return 0 == (sample[0] | sample[1]);
+	case wav_sample_format_int24:
+		return 0 == (sample[0] | sample[1] | sample[2]);
+	case wav_sample_format_float32:
+	default:
+		/* Either positive or negative zero. */
+		return 0 == (sample[0] | sample[1] | sample[2] | (sample[3] & 0x7f));
+	}
+}
+
+
+
+
+#endif /* #ifndef UNIXCW_CWUTILS_LIB_WAV_READER_H */
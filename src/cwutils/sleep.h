@@ -7,13 +7,12 @@
 /**
    @brief Sleep for given amount of milliseconds
 
-   The function uses nanosleep(), and can handle incoming SIGALRM signals
-   that cause regular nanosleep() to return. The function calls nanosleep()
-   until all time specified by @p msecs has elapsed.
+   The function sleeps until a deadline on CLOCK_MONOTONIC clock (see
+   cw_usleep_internal()), so incoming signals (e.g. SIGALRM) neither
+   shorten nor restart the sleep.
 
    The function may sleep a little longer than specified by @param
-   msecs if it needs to spend some time handling SIGALRM signal. Other
-   restrictions from nanosleep()'s man page also apply.
+   msecs if it needs to spend some time handling the signals.
 
    @reviewed 2023-08-27
 */
@@ -0,0 +1,380 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cwutils/lib/corpus.h>
+#include <cwutils/lib/elements.h>
+#include <cwutils/lib/elements_detect.h>
+
+#include "corpus.h"
+
+
+
+
+/* Word repeated in long texts of tests. */
+#define TEST_WORD "cq de sp5 paris? "
+
+/* Count of repetitions of the word: enough for text to be split between
+   a few threads. */
+#define TEST_N_WORDS 2000
+
+#define TEST_SPEED 20
+
+
+
+
+static int test_corpus_ideal(void);
+static int test_corpus_reproducible(const char * text);
+static int test_corpus_jitter(const char * text);
+static int test_corpus_disturbances(const char * text);
+static cw_elements_t * test_corpus_generate(const cw_corpus_params_t * params, const char * text, unsigned int n_threads);
+static double test_corpus_dot_deviation(const cw_elements_t * elements, double limit, size_t * n_outliers);
+
+
+
+
+int test_corpus(void)
+{
+	int errors = 0;
+
+	char * text = malloc(TEST_N_WORDS * strlen(TEST_WORD) + 1);
+	if (NULL == text) {
+		fprintf(stderr, "[ERROR] Failed to allocate text of corpus\n");
+		return -1;
+	}
+	for (int i = 0; i < TEST_N_WORDS; i++) {
+		memcpy(text + i * strlen(TEST_WORD), TEST_WORD, strlen(TEST_WORD));
+	}
+	text[TEST_N_WORDS * strlen(TEST_WORD)] = '\0';
+
+	errors += test_corpus_ideal();
+	errors += test_corpus_reproducible(text);
+	errors += test_corpus_jitter(text);
+	errors += test_corpus_disturbances(text);
+
+	free(text);
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
+/**
+   Without imperfections the corpus has the same elements as
+   cw_elements_detect_from_string(), with ideal timespans.
+*/
+static int test_corpus_ideal(void)
+{
+	const char * text = "paris 73 ";
+	cw_corpus_params_t params;
+	cw_corpus_params_init(&params);
+	params.speed = TEST_SPEED;
+
+	cw_elements_t * expected = cw_elements_new(1);
+	cw_elements_t * received = test_corpus_generate(&params, text, 1);
+	if (NULL == expected || NULL == received || 0 != cw_elements_detect_from_string(text, expected)) {
+		fprintf(stderr, "[ERROR] Failed to prepare elements of ideal corpus\n");
+		cw_elements_delete(&expected);
+		cw_elements_delete(&received);
+		return 1;
+	}
+
+	int errors = 0;
+	const double unit = 1200000.0 / TEST_SPEED;
+	if (expected->curr_count != received->curr_count) {
+		fprintf(stderr, "[ERROR] Unexpected count of elements of ideal corpus: %zu != %zu\n", received->curr_count, expected->curr_count);
+		errors++;
+	}
+	for (size_t i = 0; i < expected->curr_count && i < received->curr_count && 0 == errors; i++) {
+		const cw_element_type_t type = cw_elements_get_type(expected, i);
+		double units = 0.0;
+		switch (type) {
+		case cw_element_type_dot:
+		case cw_element_type_ims:
+			units = 1.0;
+			break;
+		case cw_element_type_dash:
+		case cw_element_type_ics:
+			units = 3.0;
+			break;
+		case cw_element_type_iws:
+			units = 7.0;
+			break;
+		case cw_element_type_none:
+		default:
+			break;
+		}
+		if (type != cw_elements_get_type(received, i)
+		    || cw_elements_get_state(expected, i) != cw_elements_get_state(received, i)
+		    || fabs(units * unit - cw_elements_get_timespan(received, i)) > 1e-6) {
+			fprintf(stderr, "[ERROR] Unexpected element %zu of ideal corpus: type %d, timespan %f\n",
+				i, cw_elements_get_type(received, i), cw_elements_get_timespan(received, i));
+			errors++;
+		}
+	}
+
+	/* Invalid input. */
+	cw_elements_t * elements = cw_elements_new(1);
+	if (0 == cw_corpus_generate(&params, "paris%", 1, elements) || 0 != elements->curr_count) {
+		fprintf(stderr, "[ERROR] Corpus of text with invalid character has been generated\n");
+		errors++;
+	}
+	params.speed = CW_SPEED_MAX + 1;
+	if (0 == cw_corpus_generate(&params, "paris", 1, elements)) {
+		fprintf(stderr, "[ERROR] Corpus with invalid speed has been generated\n");
+		errors++;
+	}
+	cw_elements_delete(&elements);
+
+	cw_elements_delete(&expected);
+	cw_elements_delete(&received);
+	return errors;
+}
+
+
+
+
+/**
+   Corpus depends only on seed, not on count of threads.
+*/
+static int test_corpus_reproducible(const char * text)
+{
+	cw_corpus_params_t params;
+	cw_corpus_params_init(&params);
+	params.speed = TEST_SPEED;
+	params.speed_drift = 0.2;
+	params.jitter = 10.0;
+	params.jitter_distribution = cw_corpus_jitter_heavy_tailed;
+	params.spike_rate = 0.5;
+	params.spike_timespan_max = 5000.0;
+	params.dropout_rate = 0.5;
+	params.dropout_timespan_max = 5000.0;
+	params.seed = 12345;
+
+	int errors = 0;
+	cw_elements_t * reference = test_corpus_generate(&params, text, 1);
+	const unsigned int threads[] = { 3, 0 };
+	for (size_t n = 0; n < sizeof (threads) / sizeof (threads[0]) && NULL != reference; n++) {
+		cw_elements_t * received = test_corpus_generate(&params, text, threads[n]);
+		if (NULL == received) {
+			errors++;
+			continue;
+		}
+		bool equal = received->curr_count == reference->curr_count;
+		for (size_t i = 0; i < reference->curr_count && equal; i++) {
+			equal = cw_elements_get_timespan(reference, i) == cw_elements_get_timespan(received, i)
+				&& cw_elements_get_type(reference, i) == cw_elements_get_type(received, i)
+				&& cw_elements_get_state(reference, i) == cw_elements_get_state(received, i);
+		}
+		if (!equal) {
+			fprintf(stderr, "[ERROR] Corpus generated with %u threads differs from corpus generated with 1 thread\n", threads[n]);
+			errors++;
+		}
+		cw_elements_delete(&received);
+	}
+
+	/* Other seed, other corpus. */
+	params.seed = 0;
+	cw_elements_t * other = test_corpus_generate(&params, text, 0);
+	if (NULL == reference || NULL == other) {
+		errors++;
+	} else if (other->curr_count == reference->curr_count
+		   && cw_elements_get_timespan(other, 0) == cw_elements_get_timespan(reference, 0)) {
+		fprintf(stderr, "[ERROR] Corpora generated with different seeds are the same\n");
+		errors++;
+	}
+
+	cw_elements_delete(&reference);
+	cw_elements_delete(&other);
+	return errors;
+}
+
+
+
+
+/**
+   Jitter of dots has expected deviation, and heavy-tailed jitter has
+   more outliers than Gaussian jitter.
+*/
+static int test_corpus_jitter(const char * text)
+{
+	cw_corpus_params_t params;
+	cw_corpus_params_init(&params);
+	params.speed = TEST_SPEED;
+	params.jitter = 10.0;
+	params.seed = 1;
+
+	const double unit = 1200000.0 / TEST_SPEED;
+	int errors = 0;
+
+	cw_elements_t * gaussian = test_corpus_generate(&params, text, 0);
+	params.jitter_distribution = cw_corpus_jitter_heavy_tailed;
+	cw_elements_t * heavy_tailed = test_corpus_generate(&params, text, 0);
+	if (NULL == gaussian || NULL == heavy_tailed) {
+		cw_elements_delete(&gaussian);
+		cw_elements_delete(&heavy_tailed);
+		return 1;
+	}
+
+	size_t n_gaussian_outliers = 0;
+	size_t n_heavy_tailed_outliers = 0;
+	const double deviation = test_corpus_dot_deviation(gaussian, 0.4 * unit, &n_gaussian_outliers);
+	test_corpus_dot_deviation(heavy_tailed, 0.4 * unit, &n_heavy_tailed_outliers);
+	if (fabs(deviation - 0.1 * unit) > 0.01 * unit) {
+		fprintf(stderr, "[ERROR] Unexpected standard deviation of dots: %f us\n", deviation);
+		errors++;
+	}
+	if (n_heavy_tailed_outliers <= n_gaussian_outliers) {
+		fprintf(stderr, "[ERROR] Heavy-tailed jitter has no more outliers than Gaussian jitter: %zu <= %zu\n", n_heavy_tailed_outliers, n_gaussian_outliers);
+		errors++;
+	}
+
+	cw_elements_delete(&gaussian);
+	cw_elements_delete(&heavy_tailed);
+	return errors;
+}
+
+
+
+
+/**
+   Spikes and dropouts are inserted at requested rate, and timespan of
+   keying doesn't change.
+*/
+static int test_corpus_disturbances(const char * text)
+{
+	cw_corpus_params_t params;
+	cw_corpus_params_init(&params);
+	params.speed = TEST_SPEED;
+	params.seed = 2;
+
+	int errors = 0;
+	cw_elements_t * clean = test_corpus_generate(&params, text, 0);
+	params.spike_rate = 0.2;
+	params.spike_timespan_max = 10000.0;
+	params.dropout_rate = 0.1;
+	params.dropout_timespan_max = 10000.0;
+	cw_elements_t * disturbed = test_corpus_generate(&params, text, 0);
+	if (NULL == clean || NULL == disturbed) {
+		cw_elements_delete(&clean);
+		cw_elements_delete(&disturbed);
+		return 1;
+	}
+
+	double total[2] = { 0.0, 0.0 };   /* [microseconds] Total timespan of spaces and marks of clean corpus. */
+	double clean_total = 0.0;
+	for (size_t i = 0; i < clean->curr_count; i++) {
+		total[cw_elements_get_state(clean, i)] += cw_elements_get_timespan(clean, i);
+		clean_total += cw_elements_get_timespan(clean, i);
+	}
+	size_t n_spikes = 0;
+	size_t n_dropouts = 0;
+	double disturbed_total = 0.0;
+	for (size_t i = 0; i < disturbed->curr_count; i++) {
+		disturbed_total += cw_elements_get_timespan(disturbed, i);
+		if (cw_element_type_none == cw_elements_get_type(disturbed, i)) {
+			if (cw_state_mark == cw_elements_get_state(disturbed, i)) {
+				n_spikes++;
+			} else {
+				n_dropouts++;
+			}
+		}
+	}
+	if (disturbed->curr_count != clean->curr_count + 2 * (n_spikes + n_dropouts)) {
+		fprintf(stderr, "[ERROR] Unexpected count of elements of disturbed corpus: %zu\n", disturbed->curr_count);
+		errors++;
+	}
+	if (fabs(disturbed_total - clean_total) > 1e-6 * clean_total) {
+		fprintf(stderr, "[ERROR] Disturbances have changed duration of corpus: %f != %f\n", disturbed_total, clean_total);
+		errors++;
+	}
+
+	/* Counts are from Poisson distributions, allow for 30% difference. */
+	const double expected_spikes = params.spike_rate * total[cw_state_space] / 1000000.0;
+	const double expected_dropouts = params.dropout_rate * total[cw_state_mark] / 1000000.0;
+	if (fabs((double) n_spikes - expected_spikes) > 0.3 * expected_spikes
+	    || fabs((double) n_dropouts - expected_dropouts) > 0.3 * expected_dropouts) {
+		fprintf(stderr, "[ERROR] Unexpected count of spikes/dropouts: %zu/%zu, expected %.1f/%.1f\n", n_spikes, n_dropouts, expected_spikes, expected_dropouts);
+		errors++;
+	}
+
+	cw_elements_delete(&clean);
+	cw_elements_delete(&disturbed);
+	return errors;
+}
+
+
+
+
+static cw_elements_t * test_corpus_generate(const cw_corpus_params_t * params, const char * text, unsigned int n_threads)
+{
+	cw_elements_t * elements = cw_elements_new(1);
+	if (NULL == elements) {
+		fprintf(stderr, "[ERROR] Failed to allocate elements of corpus\n");
+		return NULL;
+	}
+	if (0 != cw_corpus_generate(params, text, n_threads, elements)) {
+		fprintf(stderr, "[ERROR] Failed to generate corpus with %u threads\n", n_threads);
+		cw_elements_delete(&elements);
+		return NULL;
+	}
+	return elements;
+}
+
+
+
+
+/**
+   @brief Get standard deviation of timespans of dots from ideal dot
+
+   @param[in] elements Elements of corpus generated at TEST_SPEED
+   @param[in] limit Deviation above which a dot is an outlier [microseconds]
+   @param[out] n_outliers Count of outliers
+
+   @return standard deviation [microseconds]
+*/
+static double test_corpus_dot_deviation(const cw_elements_t * elements, double limit, size_t * n_outliers)
+{
+	const double unit = 1200000.0 / TEST_SPEED;
+	double sum_sq = 0.0;
+	size_t count = 0;
+	*n_outliers = 0;
+	for (size_t i = 0; i < elements->curr_count; i++) {
+		if (cw_element_type_dot != cw_elements_get_type(elements, i)) {
+			continue;
+		}
+		const double deviation = cw_elements_get_timespan(elements, i) - unit;
+		sum_sq += deviation * deviation;
+		count++;
+		if (fabs(deviation) > limit) {
+			(*n_outliers)++;
+		}
+	}
+	return count ? sqrt(sum_sq / (double) count) : 0.0;
+}
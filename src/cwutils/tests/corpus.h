@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_CORPUS_H
+#define CWUTILS_TESTS_CORPUS_H
+
+
+
+
+/**
+   @brief Tests of generator of synthetic keying from cwutils/lib/corpus.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_corpus(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_CORPUS_H */
@@ -0,0 +1,189 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cwutils/lib/element_stats.h>
+#include <cwutils/lib/elements.h>
+
+#include "element_stats.h"
+
+
+
+
+/* Count of elements in test: enough to be split between threads, and not
+   a multiple of size of chunk. */
+#define TEST_ELEMENTS_COUNT (100 * CW_ELEMENTS_CHUNK_SIZE + 13)
+
+#define TEST_BIN_WIDTH 20000.0
+
+
+
+
+static int test_element_stats_compare(const cw_element_batch_stats_t * expected, const cw_element_batch_stats_t * received, const char * label);
+
+
+
+
+int test_element_stats(void)
+{
+	int errors = 0;
+
+	cw_element_t * array = calloc(TEST_ELEMENTS_COUNT, sizeof (cw_element_t));
+	cw_elements_t * store = cw_elements_new(1);
+	if (NULL == array || NULL == store) {
+		fprintf(stderr, "[ERROR] Failed to allocate elements\n");
+		free(array);
+		cw_elements_delete(&store);
+		return -1;
+	}
+
+	/* Reference statistics, calculated in straightforward way. */
+	cw_element_batch_stats_t expected[cw_element_type_iws + 1] = { 0 };
+	double sums[cw_element_type_iws + 1] = { 0 };
+
+	for (size_t i = 0; i < TEST_ELEMENTS_COUNT; i++) {
+		const cw_element_type_t type = (cw_element_type_t) (1 + (i * 7) % cw_element_type_iws);
+		const cw_state_t state = (cw_element_type_dot == type || cw_element_type_dash == type) ? cw_state_mark : cw_state_space;
+		/* Durations vary around a base value, and some are out of range of histogram. */
+		const cw_element_time_t timespan = 60000.0 * type + (double) ((i * 7919) % 4001) - 2000.0 + ((0 == i % 1000) ? 1000000.0 : 0.0);
+
+		array[i].timespan = timespan;
+		array[i].type = type;
+		array[i].state = state;
+		if (0 != cw_elements_append_typed_element(store, type, state, timespan)) {
+			fprintf(stderr, "[ERROR] Failed to append element #%zu\n", i);
+			errors++;
+			break;
+		}
+
+		cw_element_batch_stats_t * e = &expected[type];
+		if (0 == e->count || timespan < e->min) {
+			e->min = timespan;
+		}
+		if (0 == e->count || timespan > e->max) {
+			e->max = timespan;
+		}
+		e->count++;
+		sums[type] += timespan;
+		int bin = (int) (timespan / TEST_BIN_WIDTH);
+		if (bin >= CW_ELEMENT_BATCH_STATS_BINS) {
+			bin = CW_ELEMENT_BATCH_STATS_BINS - 1;
+		}
+		e->histogram[bin]++;
+	}
+	for (int t = 0; t <= cw_element_type_iws; t++) {
+		if (expected[t].count) {
+			expected[t].mean = sums[t] / (double) expected[t].count;
+		}
+	}
+	for (size_t i = 0; i < TEST_ELEMENTS_COUNT; i++) {
+		const double deviation = array[i].timespan - expected[array[i].type].mean;
+		expected[array[i].type].variance += deviation * deviation;
+	}
+	for (int t = 0; t <= cw_element_type_iws; t++) {
+		if (expected[t].count) {
+			expected[t].variance /= (double) expected[t].count;
+		}
+	}
+
+
+	const unsigned int threads[] = { 1, 4, 0 };
+	for (size_t n = 0; n < sizeof (threads) / sizeof (threads[0]); n++) {
+		cw_element_batch_stats_t received[cw_element_type_iws + 1];
+
+		if (0 != cw_element_stats_calculate_batch(array, TEST_ELEMENTS_COUNT, TEST_BIN_WIDTH, threads[n], received)) {
+			fprintf(stderr, "[ERROR] Failed to calculate stats of array with %u threads\n", threads[n]);
+			errors++;
+		} else {
+			errors += test_element_stats_compare(expected, received, "array");
+		}
+
+		if (0 != cw_elements_stats_calculate_batch(store, TEST_BIN_WIDTH, threads[n], received)) {
+			fprintf(stderr, "[ERROR] Failed to calculate stats of elements with %u threads\n", threads[n]);
+			errors++;
+		} else {
+			errors += test_element_stats_compare(expected, received, "elements");
+		}
+	}
+
+
+	/* Invalid arguments. */
+	cw_element_batch_stats_t received[cw_element_type_iws + 1];
+	if (0 == cw_elements_stats_calculate_batch(store, 0.0, 1, received)) {
+		fprintf(stderr, "[ERROR] Calculating stats with zero bin width has succeeded\n");
+		errors++;
+	}
+	if (0 == cw_elements_stats_calculate_batch(NULL, TEST_BIN_WIDTH, 1, received)) {
+		fprintf(stderr, "[ERROR] Calculating stats of NULL elements has succeeded\n");
+		errors++;
+	}
+
+	/* Empty input gives zero stats. */
+	if (0 != cw_element_stats_calculate_batch(NULL, 0, TEST_BIN_WIDTH, 0, received)) {
+		fprintf(stderr, "[ERROR] Failed to calculate stats of empty array\n");
+		errors++;
+	} else {
+		for (int t = 0; t <= cw_element_type_iws; t++) {
+			if (0 != received[t].count || 0.0 != received[t].min || 0.0 != received[t].max) {
+				fprintf(stderr, "[ERROR] Unexpected stats of type %d of empty array\n", t);
+				errors++;
+			}
+		}
+	}
+
+	free(array);
+	cw_elements_delete(&store);
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
+static int test_element_stats_compare(const cw_element_batch_stats_t * expected, const cw_element_batch_stats_t * received, const char * label)
+{
+	for (int t = 0; t <= cw_element_type_iws; t++) {
+		const cw_element_batch_stats_t * e = &expected[t];
+		const cw_element_batch_stats_t * r = &received[t];
+		if (e->count != r->count || e->min != r->min || e->max != r->max) {
+			fprintf(stderr, "[ERROR] %s: unexpected count/min/max of type %d: %zu/%f/%f\n", label, t, r->count, r->min, r->max);
+			return 1;
+		}
+		/* Partial sums are added in different order. */
+		if (fabs(e->mean - r->mean) > 1e-6 * fabs(e->mean) || fabs(e->variance - r->variance) > 1e-6 * e->variance) {
+			fprintf(stderr, "[ERROR] %s: unexpected mean/variance of type %d: %f/%f\n", label, t, r->mean, r->variance);
+			return 1;
+		}
+		for (int b = 0; b < CW_ELEMENT_BATCH_STATS_BINS; b++) {
+			if (e->histogram[b] != r->histogram[b]) {
+				fprintf(stderr, "[ERROR] %s: unexpected bin %d of type %d: %zu\n", label, b, t, r->histogram[b]);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
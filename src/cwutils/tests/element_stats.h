@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_ELEMENT_STATS_H
+#define CWUTILS_TESTS_ELEMENT_STATS_H
+
+
+
+
+/**
+   @brief Tests of batch statistics of elements from cwutils/lib/element_stats.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_element_stats(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_ELEMENT_STATS_H */
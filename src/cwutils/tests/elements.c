@@ -0,0 +1,98 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <stdio.h>
+
+#include <cwutils/lib/elements.h>
+
+#include "elements.h"
+
+
+
+
+/* Count of elements appended in test: more than fits in initial
+   allocation, and not a multiple of size of chunk. */
+#define TEST_ELEMENTS_COUNT (10 * CW_ELEMENTS_CHUNK_SIZE + 7)
+
+
+
+
+int test_elements(void)
+{
+	int errors = 0;
+
+	/* Initial size is just a hint, the elements must grow. */
+	cw_elements_t * elements = cw_elements_new(1);
+	if (NULL == elements) {
+		fprintf(stderr, "[ERROR] Failed to allocate elements\n");
+		return -1;
+	}
+
+	for (size_t i = 0; i < TEST_ELEMENTS_COUNT; i++) {
+		const cw_element_type_t type = (cw_element_type_t) (i % (cw_element_type_iws + 1));
+		const cw_state_t state = (i % 3) ? cw_state_mark : cw_state_space;
+		if (0 != cw_elements_append_typed_element(elements, type, state, (cw_element_time_t) i)) {
+			fprintf(stderr, "[ERROR] Failed to append element #%zu\n", i);
+			errors++;
+			break;
+		}
+	}
+	if (TEST_ELEMENTS_COUNT != elements->curr_count) {
+		fprintf(stderr, "[ERROR] Unexpected count of elements: %zu\n", elements->curr_count);
+		errors++;
+	}
+
+	/* Modify some elements to see that modification doesn't leak into
+	   neighbours. */
+	cw_elements_set_timespan(elements, CW_ELEMENTS_CHUNK_SIZE, -1.0);
+	cw_elements_set_type_and_state(elements, CW_ELEMENTS_CHUNK_SIZE + 1, cw_element_type_iws, cw_state_space);
+
+	for (size_t i = 0; i < elements->curr_count; i++) {
+		cw_element_time_t expected_timespan = (cw_element_time_t) i;
+		cw_element_type_t expected_type = (cw_element_type_t) (i % (cw_element_type_iws + 1));
+		cw_state_t expected_state = (i % 3) ? cw_state_mark : cw_state_space;
+		if (CW_ELEMENTS_CHUNK_SIZE == i) {
+			expected_timespan = -1.0;
+		} else if (CW_ELEMENTS_CHUNK_SIZE + 1 == i) {
+			expected_type = cw_element_type_iws;
+			expected_state = cw_state_space;
+		}
+
+		cw_element_t element;
+		cw_elements_get_element(elements, i, &element);
+		if (element.timespan != expected_timespan || element.type != expected_type || element.state != expected_state) {
+			fprintf(stderr, "[ERROR] Unexpected element #%zu: %f/%d/%d\n", i, element.timespan, element.type, element.state);
+			errors++;
+			break;
+		}
+	}
+
+	cw_elements_delete(&elements);
+	if (NULL != elements) {
+		fprintf(stderr, "[ERROR] Elements pointer not reset by delete\n");
+		errors++;
+	}
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
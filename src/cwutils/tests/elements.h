@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_ELEMENTS_H
+#define CWUTILS_TESTS_ELEMENTS_H
+
+
+
+
+/**
+   @brief Tests of growable collection of elements from cwutils/lib/elements.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_elements(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_ELEMENTS_H */
@@ -0,0 +1,213 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cwutils/lib/elements.h>
+#include <cwutils/lib/elements_log.h>
+
+#include "elements_log.h"
+
+
+
+
+/* Count of elements in test: more than one chunk of log, and not a
+   multiple of size of chunk. */
+#define TEST_ELEMENTS_COUNT (3 * CW_ELEMENTS_LOG_CHUNK_SIZE + 5)
+
+#define TEST_SAMPLE_RATE 44100
+
+
+
+
+static int test_elements_log_compare(const cw_elements_t * expected, const cw_elements_t * received, const char * label);
+
+
+
+
+int test_elements_log(void)
+{
+	int errors = 0;
+	const double sample_spacing = (1000.0 * 1000.0) / TEST_SAMPLE_RATE;
+
+	cw_elements_t * elements = cw_elements_new(1);
+	cw_elements_t * received = cw_elements_new(1);
+	if (NULL == elements || NULL == received) {
+		fprintf(stderr, "[ERROR] Failed to allocate elements\n");
+		cw_elements_delete(&elements);
+		cw_elements_delete(&received);
+		return -1;
+	}
+
+	/* Durations are whole numbers of samples, as in elements detected in
+	   wav file, and some of them need long varints. */
+	for (size_t i = 0; i < TEST_ELEMENTS_COUNT; i++) {
+		const cw_element_type_t type = (cw_element_type_t) (i % (cw_element_type_iws + 1));
+		const cw_state_t state = (i % 2) ? cw_state_mark : cw_state_space;
+		size_t samples = (i * 7919) % 3000;
+		if (0 == i % 100) {
+			samples = (size_t) 1 << (i % 40);
+		}
+		cw_elements_append_typed_element(elements, type, state, (cw_element_time_t) samples * sample_spacing);
+	}
+
+
+	/* Round trip through file mapped into memory. */
+	char path[] = "/tmp/cwutils_tests_elements_log_XXXXXX";
+	const int fd = mkstemp(path);
+	FILE * file = -1 == fd ? NULL : fdopen(fd, "wb");
+	if (NULL == file) {
+		fprintf(stderr, "[ERROR] Failed to open temporary file\n");
+		errors++;
+	} else {
+		if (0 != cw_elements_log_write(file, elements, TEST_SAMPLE_RATE)) {
+			fprintf(stderr, "[ERROR] Failed to write elements log\n");
+			errors++;
+		}
+		const long size = ftell(file);
+		fclose(file);
+		/* Typical durations take two bytes. */
+		if (size > CW_ELEMENTS_LOG_HEADER_SIZE + 4 * TEST_ELEMENTS_COUNT) {
+			fprintf(stderr, "[ERROR] Elements log is too large: %ld bytes\n", size);
+			errors++;
+		}
+
+		cw_elements_log_reader_t reader;
+		if (0 != cw_elements_log_reader_open(&reader, path)) {
+			fprintf(stderr, "[ERROR] Failed to open elements log\n");
+			errors++;
+		} else {
+			if (TEST_SAMPLE_RATE != reader.sample_rate) {
+				fprintf(stderr, "[ERROR] Unexpected sample rate of elements log: %u\n", reader.sample_rate);
+				errors++;
+			}
+			if (0 != cw_elements_log_reader_read_all(&reader, received)) {
+				fprintf(stderr, "[ERROR] Failed to read elements log\n");
+				errors++;
+			}
+			errors += test_elements_log_compare(elements, received, "file");
+			cw_elements_log_reader_close(&reader);
+		}
+		unlink(path);
+	}
+
+
+	/* Streaming writer and reader of log in memory. */
+	char * buffer = NULL;
+	size_t buffer_size = 0;
+	FILE * stream = open_memstream(&buffer, &buffer_size);
+	cw_elements_log_writer_t * writer = malloc(sizeof (cw_elements_log_writer_t));
+	if (NULL == stream || NULL == writer || 0 != cw_elements_log_writer_open(writer, stream, TEST_SAMPLE_RATE)) {
+		fprintf(stderr, "[ERROR] Failed to open writer of elements log\n");
+		errors++;
+	} else {
+		for (size_t i = 0; i < elements->curr_count; i++) {
+			cw_element_t element;
+			cw_elements_get_element(elements, i, &element);
+			if (0 != cw_elements_log_writer_append(writer, element.type, element.state, element.timespan)) {
+				fprintf(stderr, "[ERROR] Failed to append element #%zu to elements log\n", i);
+				errors++;
+				break;
+			}
+		}
+		if (0 != cw_elements_log_writer_close(writer)) {
+			fprintf(stderr, "[ERROR] Failed to close writer of elements log\n");
+			errors++;
+		}
+
+		cw_elements_log_reader_t reader;
+		if (0 != cw_elements_log_reader_open_memory(&reader, buffer, buffer_size)) {
+			fprintf(stderr, "[ERROR] Failed to open elements log in memory\n");
+			errors++;
+		} else {
+			size_t count = 0;
+			cw_element_t element;
+			int retval = 0;
+			while (1 == (retval = cw_elements_log_reader_next(&reader, &element))) {
+				count++;
+			}
+			if (0 != retval || TEST_ELEMENTS_COUNT != count) {
+				fprintf(stderr, "[ERROR] Unexpected result of reading elements log in memory: %d, %zu\n", retval, count);
+				errors++;
+			}
+			cw_elements_log_reader_close(&reader);
+		}
+
+		/* Truncated log must be detected. */
+		if (0 == cw_elements_log_reader_open_memory(&reader, buffer, buffer_size - 1)) {
+			cw_elements_delete(&received);
+			received = cw_elements_new(1);
+			if (0 == cw_elements_log_reader_read_all(&reader, received)) {
+				fprintf(stderr, "[ERROR] Truncated elements log has been read\n");
+				errors++;
+			}
+			cw_elements_log_reader_close(&reader);
+		}
+
+		/* Invalid header must be detected. */
+		buffer[0] = 'X';
+		if (0 == cw_elements_log_reader_open_memory(&reader, buffer, buffer_size)) {
+			fprintf(stderr, "[ERROR] Elements log with invalid header has been opened\n");
+			errors++;
+			cw_elements_log_reader_close(&reader);
+		}
+	}
+	if (NULL != stream) {
+		fclose(stream);
+	}
+	free(buffer);
+	free(writer);
+
+	cw_elements_delete(&elements);
+	cw_elements_delete(&received);
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
+static int test_elements_log_compare(const cw_elements_t * expected, const cw_elements_t * received, const char * label)
+{
+	if (expected->curr_count != received->curr_count) {
+		fprintf(stderr, "[ERROR] %s: unexpected count of elements: %zu\n", label, received->curr_count);
+		return 1;
+	}
+	for (size_t i = 0; i < expected->curr_count; i++) {
+		cw_element_t e;
+		cw_element_t r;
+		cw_elements_get_element(expected, i, &e);
+		cw_elements_get_element(received, i, &r);
+		/* Durations go through conversion to samples and back. */
+		if (e.type != r.type || e.state != r.state || fabs(e.timespan - r.timespan) > 1e-6 * (1.0 + e.timespan)) {
+			fprintf(stderr, "[ERROR] %s: unexpected element #%zu: %f/%d/%d\n", label, i, r.timespan, r.type, r.state);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_ELEMENTS_LOG_H
+#define CWUTILS_TESTS_ELEMENTS_LOG_H
+
+
+
+
+/**
+   @brief Tests of binary log of elements from cwutils/lib/elements_log.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_elements_log(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_ELEMENTS_LOG_H */
@@ -30,6 +30,14 @@
 #include <stdio.h>
 
 #include "cmdline_combine_arguments.h"
+#include "corpus.h"
+#include "elements.h"
+#include "element_stats.h"
+#include "elements_log.h"
+#include "practice_text.h"
+#include "random.h"
+#include "scoring.h"
+#include "wav_reader.h"
 
 
 
@@ -38,6 +46,14 @@ int main(void)
 {
 	int ret = 0;
 	ret += test_combine_arguments();
+	ret += test_elements();
+	ret += test_element_stats();
+	ret += test_elements_log();
+	ret += test_wav_reader();
+	ret += test_random();
+	ret += test_scoring();
+	ret += test_corpus();
+	ret += test_practice_text();
 	return ret;
 }
 
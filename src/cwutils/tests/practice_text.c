@@ -0,0 +1,287 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cwutils/lib/practice_text.h>
+
+#include "practice_text.h"
+
+
+
+
+/* Count of characters in groups of test generator. */
+#define TEST_GROUP_LENGTH 5
+
+/* Length of groups of source that doesn't fit in pools. */
+#define TEST_LONG_GROUP_LENGTH (2 * CW_PRACTICE_TEXT_GROUP_SIZE)
+
+/* How long to wait for background thread to fill a pool [microseconds]. */
+#define TEST_FILL_TIMEOUT 5000000
+#define TEST_FILL_POLL_INTERVAL 1000
+
+
+
+
+/* Source of text of test generator. */
+typedef struct test_source_t {
+	char character;  /* Groups consist of this character... */
+	size_t length;   /* ...repeated this many times. */
+} test_source_t;
+
+
+
+
+/* Counts of calls of test generator. */
+static pthread_mutex_t g_calls_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t g_main_thread;
+static int g_main_thread_calls;
+static int g_background_calls;
+
+
+
+
+static int test_practice_text_generator(const void * source, cw_random_t * rng, char * group, size_t size);
+static void test_practice_text_reset_calls(void);
+static void test_practice_text_get_calls(int * main_thread_calls, int * background_calls);
+static int test_practice_text_check_group(const test_source_t * source, const char * group, int length);
+static int test_practice_text_prefetch(void);
+static int test_practice_text_sources(void);
+static int test_practice_text_long_groups(void);
+
+
+
+
+int test_practice_text(void)
+{
+	int errors = 0;
+
+	g_main_thread = pthread_self();
+
+	errors += test_practice_text_prefetch();
+	errors += test_practice_text_sources();
+	errors += test_practice_text_long_groups();
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
+/**
+   After the pool gets filled in background, groups are taken from the
+   pool, without calling generator in thread getting the groups.
+*/
+static int test_practice_text_prefetch(void)
+{
+	const test_source_t source = { 'A', TEST_GROUP_LENGTH };
+	cw_practice_text_t * text = cw_practice_text_new(test_practice_text_generator, 1);
+	if (NULL == text) {
+		fprintf(stderr, "[ERROR] Failed to create prefetcher of practice text\n");
+		return 1;
+	}
+	test_practice_text_reset_calls();
+
+	int errors = 0;
+	char group[CW_PRACTICE_TEXT_GROUP_SIZE];
+
+	/* First request for the source: the pool is empty, so the group
+	   is generated synchronously, and the pool starts being filled. */
+	int length = cw_practice_text_get_group(text, &source, group, sizeof (group));
+	errors += test_practice_text_check_group(&source, group, length);
+
+	int main_thread_calls = 0;
+	int background_calls = 0;
+	for (int waited = 0; waited < TEST_FILL_TIMEOUT; waited += TEST_FILL_POLL_INTERVAL) {
+		test_practice_text_get_calls(&main_thread_calls, &background_calls);
+		if (background_calls >= CW_PRACTICE_TEXT_POOL_CAPACITY) {
+			break;
+		}
+		usleep(TEST_FILL_POLL_INTERVAL);
+	}
+	if (1 != main_thread_calls || background_calls < CW_PRACTICE_TEXT_POOL_CAPACITY) {
+		fprintf(stderr, "[ERROR] Pool of practice text not filled in background: %d calls in main thread, %d in background\n",
+			main_thread_calls, background_calls);
+		errors++;
+	}
+
+	/* Groups come from the pool. */
+	for (int i = 0; i < CW_PRACTICE_TEXT_POOL_CAPACITY / 2; i++) {
+		length = cw_practice_text_get_group(text, &source, group, sizeof (group));
+		errors += test_practice_text_check_group(&source, group, length);
+	}
+	test_practice_text_get_calls(&main_thread_calls, &background_calls);
+	if (1 != main_thread_calls) {
+		fprintf(stderr, "[ERROR] Groups of practice text generated in main thread despite full pool: %d calls\n", main_thread_calls);
+		errors++;
+	}
+
+	cw_practice_text_delete(&text);
+	if (NULL != text) {
+		fprintf(stderr, "[ERROR] Prefetcher of practice text not NULL after deletion\n");
+		errors++;
+	}
+
+	return errors ? 1 : 0;
+}
+
+
+
+
+/**
+   Groups of different sources don't get mixed, also when there are more
+   sources than pools.
+*/
+static int test_practice_text_sources(void)
+{
+	test_source_t sources[CW_PRACTICE_TEXT_MAX_POOLS + 4];
+	const size_t n_sources = sizeof (sources) / sizeof (sources[0]);
+	for (size_t i = 0; i < n_sources; i++) {
+		sources[i].character = (char) ('A' + i);
+		sources[i].length = 1 + i % TEST_GROUP_LENGTH;
+	}
+
+	cw_practice_text_t * text = cw_practice_text_new(test_practice_text_generator, 2);
+	if (NULL == text) {
+		fprintf(stderr, "[ERROR] Failed to create prefetcher of practice text\n");
+		return 1;
+	}
+
+	int errors = 0;
+	for (int i = 0; i < 5000 && 0 == errors; i++) {
+		const test_source_t * source = &sources[(size_t) i % n_sources];
+		char group[CW_PRACTICE_TEXT_GROUP_SIZE];
+		const int length = cw_practice_text_get_group(text, source, group, sizeof (group));
+		errors += test_practice_text_check_group(source, group, length);
+	}
+
+	cw_practice_text_delete(&text);
+
+	return errors ? 1 : 0;
+}
+
+
+
+
+/**
+   Groups that don't fit in pools are generated synchronously, and groups
+   that don't fit in caller's buffer are reported as failure.
+*/
+static int test_practice_text_long_groups(void)
+{
+	const test_source_t source = { 'L', TEST_LONG_GROUP_LENGTH };
+	cw_practice_text_t * text = cw_practice_text_new(test_practice_text_generator, 3);
+	if (NULL == text) {
+		fprintf(stderr, "[ERROR] Failed to create prefetcher of practice text\n");
+		return 1;
+	}
+
+	int errors = 0;
+	for (int i = 0; i < 100 && 0 == errors; i++) {
+		char group[2 * TEST_LONG_GROUP_LENGTH];
+		const int length = cw_practice_text_get_group(text, &source, group, sizeof (group));
+		errors += test_practice_text_check_group(&source, group, length);
+	}
+
+	char short_group[TEST_GROUP_LENGTH];
+	if (-1 != cw_practice_text_get_group(text, &source, short_group, sizeof (short_group))) {
+		fprintf(stderr, "[ERROR] Long group of practice text returned in too short buffer\n");
+		errors++;
+	}
+
+	cw_practice_text_delete(&text);
+
+	return errors ? 1 : 0;
+}
+
+
+
+
+static int test_practice_text_generator(const void * source, cw_random_t * rng, char * group, size_t size)
+{
+	const test_source_t * test_source = (const test_source_t *) source;
+
+	pthread_mutex_lock(&g_calls_mutex);
+	if (pthread_equal(g_main_thread, pthread_self())) {
+		g_main_thread_calls++;
+	} else {
+		g_background_calls++;
+	}
+	pthread_mutex_unlock(&g_calls_mutex);
+
+	/* Consume some random values, as a real generator would. */
+	cw_random_next(rng);
+
+	if (test_source->length >= size) {
+		return -1;
+	}
+	memset(group, test_source->character, test_source->length);
+	group[test_source->length] = '\0';
+
+	return (int) test_source->length;
+}
+
+
+
+
+static void test_practice_text_reset_calls(void)
+{
+	pthread_mutex_lock(&g_calls_mutex);
+	g_main_thread_calls = 0;
+	g_background_calls = 0;
+	pthread_mutex_unlock(&g_calls_mutex);
+}
+
+
+
+
+static void test_practice_text_get_calls(int * main_thread_calls, int * background_calls)
+{
+	pthread_mutex_lock(&g_calls_mutex);
+	*main_thread_calls = g_main_thread_calls;
+	*background_calls = g_background_calls;
+	pthread_mutex_unlock(&g_calls_mutex);
+}
+
+
+
+
+static int test_practice_text_check_group(const test_source_t * source, const char * group, int length)
+{
+	if (length < 0 || (size_t) length != source->length || strlen(group) != source->length) {
+		fprintf(stderr, "[ERROR] Unexpected length of group of practice text of source '%c': %d\n", source->character, length);
+		return 1;
+	}
+	for (size_t i = 0; i < source->length; i++) {
+		if (group[i] != source->character) {
+			fprintf(stderr, "[ERROR] Unexpected group of practice text of source '%c': '%s'\n", source->character, group);
+			return 1;
+		}
+	}
+	return 0;
+}
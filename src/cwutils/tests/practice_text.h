@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_PRACTICE_TEXT_H
+#define CWUTILS_TESTS_PRACTICE_TEXT_H
+
+
+
+
+/**
+   @brief Tests of prefetcher of practice text from cwutils/lib/practice_text.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_practice_text(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_PRACTICE_TEXT_H */
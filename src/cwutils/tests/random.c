@@ -0,0 +1,106 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <stdio.h>
+
+#include <cwutils/lib/random.h>
+
+#include "random.h"
+
+
+
+
+#define TEST_RANDOM_COUNT 10000
+#define TEST_RANDOM_BOUND 7
+
+
+
+
+int test_random(void)
+{
+	int errors = 0;
+
+	/* The same seed must give the same sequence. */
+	cw_random_t rng1;
+	cw_random_t rng2;
+	if (1234 != cw_random_init(&rng1, 1234) || 1234 != cw_random_init(&rng2, 1234)) {
+		fprintf(stderr, "[ERROR] Unexpected seed returned by cw_random_init()\n");
+		errors++;
+	}
+	for (int i = 0; i < TEST_RANDOM_COUNT; i++) {
+		if (cw_random_next(&rng1) != cw_random_next(&rng2)) {
+			fprintf(stderr, "[ERROR] Sequences with the same seed diverged at #%d\n", i);
+			errors++;
+			break;
+		}
+	}
+
+	/* Automatically picked seed is returned so that the run can be repeated. */
+	if (0 == cw_random_init(&rng1, 0)) {
+		fprintf(stderr, "[ERROR] Automatically picked seed is zero\n");
+		errors++;
+	}
+
+	/* All values generated in bulk are in range. */
+	static uint32_t values[TEST_RANDOM_COUNT];
+	cw_random_init(&rng1, 5678);
+	cw_random_fill_bounded(&rng1, TEST_RANDOM_BOUND, values, TEST_RANDOM_COUNT);
+
+	unsigned int histogram[TEST_RANDOM_BOUND] = { 0 };
+	for (int i = 0; i < TEST_RANDOM_COUNT; i++) {
+		if (values[i] >= TEST_RANDOM_BOUND) {
+			fprintf(stderr, "[ERROR] Value #%d out of range: %u\n", i, values[i]);
+			errors++;
+			break;
+		}
+		histogram[values[i]]++;
+	}
+	/* Very loose check of uniformity: each value should appear about
+	   TEST_RANDOM_COUNT / TEST_RANDOM_BOUND = ~1428 times. */
+	for (int i = 0; i < TEST_RANDOM_BOUND; i++) {
+		if (histogram[i] < 1200 || histogram[i] > 1700) {
+			fprintf(stderr, "[ERROR] Value %d appeared %u times\n", i, histogram[i]);
+			errors++;
+		}
+	}
+
+	for (int i = 0; i < TEST_RANDOM_COUNT; i++) {
+		const uint32_t bound = (uint32_t) i + 1;
+		if (cw_random_get_bounded(&rng1, bound) >= bound) {
+			fprintf(stderr, "[ERROR] Value out of range [0, %u)\n", bound);
+			errors++;
+			break;
+		}
+	}
+
+	/* Global generator keeps its interface. */
+	cw_random_srand(42);
+	int value = 0;
+	if (0 != cw_random_get_int(3, 5, &value) || value < 3 || value > 5) {
+		fprintf(stderr, "[ERROR] cw_random_get_int() failed or returned %d\n", value);
+		errors++;
+	}
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_RANDOM_H
+#define CWUTILS_TESTS_RANDOM_H
+
+
+
+
+/**
+   @brief Tests of random number generator from cwutils/lib/random.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_random(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_RANDOM_H */
@@ -0,0 +1,172 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cwutils/lib/scoring.h>
+
+#include "scoring.h"
+
+
+
+
+/* Speed of keying in test recordings [wpm]. */
+#define TEST_SCORING_SPEED 20
+
+/* Dot duration at TEST_SCORING_SPEED [us]. */
+#define TEST_SCORING_DOT (1200000 / TEST_SCORING_SPEED)
+
+
+
+
+/* Recordings of key edges to be created and then scored. Representations
+   of characters are separated with single spaces, words with '/'. */
+static const struct {
+	const char * keying;
+	size_t n_errors;
+} test_data[] = {
+	{ ".--. .- .-. .. ... / -.-. --.-",  0 },  /* "paris cq" */
+	{ ".--. .- .-. . ... / -.-. --.-",   1 },  /* "pares cq" */
+	{ ".--. .- .-. .. ...",              3 },  /* "paris" */
+};
+
+
+
+
+static int write_key_edges(const char * path, const char * keying);
+
+
+
+
+int test_scoring(void)
+{
+	int errors = 0;
+
+	if (3 != cw_score_edit_distance("kitten", "sitting")
+	    || 0 != cw_score_edit_distance("", "")
+	    || 2 != cw_score_edit_distance("ab", "")) {
+		fprintf(stderr, "[ERROR] Unexpected edit distance\n");
+		errors++;
+	}
+
+	char text[] = "  Paris \n\tCQ  de\n";
+	cw_score_normalize_text(text);
+	if (0 != strcmp(text, "paris cq de")) {
+		fprintf(stderr, "[ERROR] Unexpected normalized text: '%s'\n", text);
+		errors++;
+	}
+
+	const size_t n_jobs = sizeof (test_data) / sizeof (test_data[0]);
+	char paths[sizeof (test_data) / sizeof (test_data[0])][64];
+	cw_score_job_t jobs[sizeof (test_data) / sizeof (test_data[0])];
+	for (size_t i = 0; i < n_jobs; i++) {
+		snprintf(paths[i], sizeof (paths[i]), "/tmp/cwutils_test_scoring_%ld_%zu.txt", (long) getpid(), i);
+		jobs[i].recording_path = paths[i];
+		jobs[i].expected_text = "PARIS CQ";
+		if (0 != write_key_edges(paths[i], test_data[i].keying)) {
+			fprintf(stderr, "[ERROR] Failed to write test recording '%s'\n", paths[i]);
+			errors++;
+		}
+	}
+
+	/* Results mustn't depend on count of threads. */
+	const cw_score_config_t config = { .speed = TEST_SCORING_SPEED };
+	cw_score_result_t results[sizeof (test_data) / sizeof (test_data[0])];
+	if (0 != cw_score_run(jobs, results, n_jobs, &config, 2)) {
+		fprintf(stderr, "[ERROR] Failed to score test recordings\n");
+		errors++;
+	}
+
+	for (size_t i = 0; i < n_jobs; i++) {
+		if (!results[i].success || results[i].n_errors != test_data[i].n_errors) {
+			fprintf(stderr, "[ERROR] Recording #%zu: success = %d, errors = %zu (expected %zu), decoded text '%s'\n",
+				i, results[i].success, results[i].n_errors, test_data[i].n_errors,
+				results[i].decoded_text ? results[i].decoded_text : "");
+			errors++;
+		}
+		/* A Dash is three Dots long. */
+		const cw_element_stats_t * dots = &results[i].elements.stats[cw_element_type_dot];
+		const cw_element_stats_t * dashes = &results[i].elements.stats[cw_element_type_dash];
+		if (dots->duration_avg != TEST_SCORING_DOT || dashes->duration_avg != 3 * TEST_SCORING_DOT) {
+			fprintf(stderr, "[ERROR] Recording #%zu: unexpected durations of Dot/Dash: %d/%d\n",
+				i, dots->duration_avg, dashes->duration_avg);
+			errors++;
+		}
+		cw_score_result_free(&results[i]);
+		unlink(paths[i]);
+	}
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
+
+
+
+
+/**
+   @brief Write ideal keying of given representations as key edges
+
+   @param[in] path Path to file to write
+   @param[in] keying Representations of characters, separated with ' ' (inter-character-space) or '/' (inter-word-space)
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int write_key_edges(const char * path, const char * keying)
+{
+	FILE * file = fopen(path, "w");
+	if (NULL == file) {
+		return -1;
+	}
+
+	fprintf(file, "# Test recording\n0 0\n");
+	long timestamp = 10 * TEST_SCORING_DOT;
+	for (const char * k = keying; '\0' != *k; k++) {
+		switch (*k) {
+		case '.':
+		case '-':
+			fprintf(file, "%ld 1\n", timestamp);
+			timestamp += ('.' == *k ? 1 : 3) * TEST_SCORING_DOT;
+			fprintf(file, "%ld 0\n", timestamp);
+			/* Inter-mark-space. */
+			timestamp += TEST_SCORING_DOT;
+			break;
+		case ' ':
+			/* Complete inter-character-space. */
+			timestamp += 2 * TEST_SCORING_DOT;
+			break;
+		case '/':
+			/* Complete inter-word-space: there is a space before and after the '/'. */
+			timestamp += 6 * TEST_SCORING_DOT - 2 * 2 * TEST_SCORING_DOT;
+			break;
+		default:
+			break;
+		}
+	}
+
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_SCORING_H
+#define CWUTILS_TESTS_SCORING_H
+
+
+
+
+/**
+   @brief Tests of scoring of recordings from cwutils/lib/scoring.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_scoring(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_SCORING_H */
@@ -0,0 +1,268 @@
+/*
+  Copyright (C) 2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cwutils/lib/elements.h>
+#include <cwutils/lib/elements_detect.h>
+#include <cwutils/lib/wav_reader.h>
+
+#include "wav_reader.h"
+
+
+
+
+#define N_FRAMES 1000
+
+
+
+
+/* Description of test wav file to be created and then read by reader. */
+// NOLINTNEXTLINE(clang-analyzer-optin.performance.Padding) // disable clang-tidy's specific test
+static const struct {
+	const char * name;
+	bool rf64;                             /**< Write RF64 file with "ds64" chunk. */
+	bool extensible;                       /**< Use WAVE_FORMAT_EXTENSIBLE in "fmt " chunk. */
+	wav_sample_format_t sample_format;
+	uint16_t n_channels;
+} test_data[] = {
+	{ "int16 stereo",         false, false, wav_sample_format_int16,   2 },
+	{ "int24 mono",           false, true,  wav_sample_format_int24,   1 },
+	{ "float32 3ch RF64",     true,  false, wav_sample_format_float32, 3 },
+};
+
+
+
+
+/* First frame of mark in given channel. Each channel has one mark, and
+   the marks start at different frames so that selection of channel can be
+   verified. */
+#define MARK_START(channel) (N_FRAMES / 4 + 50 * (channel))
+#define MARK_END (3 * N_FRAMES / 4)
+
+/* Sample spacing of test files [us]. */
+#define SAMPLE_SPACING (1000.0 * 1000.0 / 8000)
+
+
+
+
+/* Value of test sample in given frame and channel. */
+static float test_sample_value(size_t frame, unsigned int channel)
+{
+	if (frame < MARK_START(channel) || frame >= MARK_END) {
+		return 0.0f;
+	}
+	return (frame % 2 ? 0.5f : -0.25f) / (float) (channel + 1);
+}
+
+
+
+
+static void put_le(FILE * file, uint64_t value, int n_bytes)
+{
+	for (int i = 0; i < n_bytes; i++) {
+		fputc((int) ((value >> (8 * i)) & 0xff), file);
+	}
+}
+
+
+
+
+static int write_test_file(FILE * file, size_t test)
+{
+	const uint16_t bytes_per_sample = wav_sample_format_int16 == test_data[test].sample_format ? 2
+		: wav_sample_format_int24 == test_data[test].sample_format ? 3 : 4;
+	const uint16_t n_channels = test_data[test].n_channels;
+	const uint32_t data_size = N_FRAMES * n_channels * bytes_per_sample;
+
+	fwrite(test_data[test].rf64 ? "RF64" : "RIFF", 1, 4, file);
+	put_le(file, test_data[test].rf64 ? 0xffffffff : 0, 4); /* Not used by reader. */
+	fwrite("WAVE", 1, 4, file);
+
+	if (test_data[test].rf64) {
+		fwrite("ds64", 1, 4, file);
+		put_le(file, 28, 4);
+		put_le(file, 0, 8);
+		put_le(file, data_size, 8);
+		put_le(file, N_FRAMES, 8);
+		put_le(file, 0, 4);
+	}
+
+	/* Chunk that should be skipped by reader. Odd size tests padding. */
+	fwrite("LIST", 1, 4, file);
+	put_le(file, 3, 4);
+	fwrite("abc\0", 1, 4, file);
+
+	const uint16_t format = wav_sample_format_float32 == test_data[test].sample_format ? 3 : 1;
+	fwrite("fmt ", 1, 4, file);
+	put_le(file, test_data[test].extensible ? 40 : 16, 4);
+	put_le(file, test_data[test].extensible ? 0xfffe : format, 2);
+	put_le(file, n_channels, 2);
+	put_le(file, 8000, 4);
+	put_le(file, 8000 * n_channels * bytes_per_sample, 4);
+	put_le(file, n_channels * bytes_per_sample, 2);
+	put_le(file, bytes_per_sample * 8, 2);
+	if (test_data[test].extensible) {
+		put_le(file, 22, 2);
+		put_le(file, bytes_per_sample * 8, 2);
+		put_le(file, 0, 4);
+		put_le(file, format, 2);
+		fwrite("\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 1, 14, file);
+	}
+
+	fwrite("data", 1, 4, file);
+	put_le(file, test_data[test].rf64 ? 0xffffffff : data_size, 4);
+	for (size_t frame = 0; frame < N_FRAMES; frame++) {
+		for (unsigned int channel = 0; channel < n_channels; channel++) {
+			const float value = test_sample_value(frame, channel);
+			switch (test_data[test].sample_format) {
+			case wav_sample_format_int16:
+				put_le(file, (uint16_t) (int16_t) lrintf(value * 32768.0f), 2);
+				break;
+			case wav_sample_format_int24:
+				put_le(file, (uint32_t) (int32_t) lrintf(value * 8388608.0f), 3);
+				break;
+			case wav_sample_format_float32:
+			default: {
+				uint32_t bits = 0;
+				memcpy(&bits, &value, sizeof (bits));
+				put_le(file, bits, 4);
+				break;
+			}
+			}
+		}
+	}
+
+	return 0 == fflush(file) ? 0 : -1;
+}
+
+
+
+
+static int check_test_file(const char * path, size_t test)
+{
+	wav_reader_t reader;
+	if (0 != wav_reader_open(&reader, path)) {
+		fprintf(stderr, "[ERROR] Test %s: failed to open test file\n", test_data[test].name);
+		return -1;
+	}
+
+	int errors = 0;
+	if (reader.sample_format != test_data[test].sample_format
+	    || reader.n_channels != test_data[test].n_channels
+	    || reader.sample_rate != 8000
+	    || reader.n_frames != N_FRAMES) {
+		fprintf(stderr, "[ERROR] Test %s: unexpected format: %d/%u/%u/%ju\n", test_data[test].name,
+		        reader.sample_format, reader.n_channels, reader.sample_rate, (uintmax_t) reader.n_frames);
+		errors++;
+		goto CLEANUP;
+	}
+
+	/* Get samples in spans of odd size to also test truncation of last span. */
+	for (unsigned int channel = 0; channel < reader.n_channels; channel++) {
+		for (uint64_t frame = 0; frame < reader.n_frames; frame += 77) {
+			wav_span_t span;
+			if (0 != wav_reader_get_span(&reader, frame, 77, channel, &span)) {
+				fprintf(stderr, "[ERROR] Test %s: failed to get span\n", test_data[test].name);
+				errors++;
+				goto CLEANUP;
+			}
+			for (size_t i = 0; i < span.n_samples; i++) {
+				const float expected = test_sample_value(frame + i, channel);
+				const float value = wav_span_get_sample(&span, i);
+				if (fabsf(value - expected) > 1.0f / 32768.0f
+				    || wav_span_sample_is_zero(&span, i) != (0.0f == expected)) {
+					fprintf(stderr, "[ERROR] Test %s: channel %u, frame %ju: value = %f, expected = %f\n",
+					        test_data[test].name, channel, (uintmax_t) (frame + i), (double) value, (double) expected);
+					errors++;
+					goto CLEANUP;
+				}
+			}
+		}
+	}
+
+	wav_span_t span;
+	if (0 != wav_reader_get_span(&reader, 0, 1, reader.n_channels, &span)) {
+		/* Expected failure for invalid channel. */
+	} else {
+		fprintf(stderr, "[ERROR] Test %s: invalid channel was accepted\n", test_data[test].name);
+		errors++;
+		goto CLEANUP;
+	}
+
+	for (unsigned int channel = 0; channel < reader.n_channels; channel++) {
+		/* Each channel has space, mark, space. */
+		cw_elements_t * elements = cw_elements_new(10);
+		const int retval = cw_elements_detect_from_wav_reader(&reader, channel, elements);
+		if (0 != retval
+		    || 3 != elements->curr_count
+		    || cw_state_mark != cw_elements_get_state(elements, 1)
+		    || fabs(cw_elements_get_timespan(elements, 0) - MARK_START(channel) * SAMPLE_SPACING) > 0.001
+		    || fabs(cw_elements_get_timespan(elements, 1) - (MARK_END - MARK_START(channel)) * SAMPLE_SPACING) > 0.001) {
+			fprintf(stderr, "[ERROR] Test %s: unexpected elements detected in channel %u\n",
+			        test_data[test].name, channel);
+			errors++;
+		}
+		cw_elements_delete(&elements);
+	}
+
+	CLEANUP:
+	wav_reader_close(&reader);
+	return errors;
+}
+
+
+
+
+int test_wav_reader(void)
+{
+	const size_t n_tests = sizeof (test_data) / sizeof (test_data[0]);
+	int errors = 0;
+	for (size_t test = 0; test < n_tests; test++) {
+		char path[] = "/tmp/cwutils_tests_wav_reader_XXXXXX";
+		const int fd = mkstemp(path);
+		if (-1 == fd) {
+			fprintf(stderr, "[ERROR] Failed to create test file: %s\n", strerror(errno));
+			errors++;
+			continue;
+		}
+		FILE * file = fdopen(fd, "wb");
+		if (0 != write_test_file(file, test)) {
+			fprintf(stderr, "[ERROR] Test %s: failed to write test file\n", test_data[test].name);
+			errors++;
+		} else {
+			errors += check_test_file(path, test);
+		}
+		fclose(file);
+		unlink(path);
+	}
+
+	if (errors) {
+		return -1;
+	} else {
+		return 0;
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef CWUTILS_TESTS_WAV_READER_H
+#define CWUTILS_TESTS_WAV_READER_H
+
+
+
+
+/**
+   @brief Tests of wav reader from cwutils/lib/wav_reader.c
+
+   @return 0 if tests passed
+   @return -1 otherwise
+*/
+int test_wav_reader(void);
+
+
+
+
+#endif /* #ifndef CWUTILS_TESTS_WAV_READER_H */
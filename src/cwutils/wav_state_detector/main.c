@@ -17,7 +17,9 @@
 
 #include <cwutils/lib/elements.h>
 #include <cwutils/lib/elements_detect.h>
-#include <cwutils/lib/wav.h>
+#include <cwutils/lib/elements_log.h>
+#include <cwutils/lib/elements_pipeline.h>
+#include <cwutils/lib/wav_reader.h>
 
 
 
@@ -37,7 +39,9 @@
 
 
   The input file for this program is a wav file because it's possible to get
-  parameters of file from the wav header. I could achieve the same by passing
+  parameters of file from the wav header. The file is mapped into memory, so
+  it may be large. Samples may be 16-bit or 24-bit integers or 32-bit
+  floats, and the file may have more than one channel. I could achieve the same by passing
   information about a raw file through command-line arguments to this
   program, but that would be cumbersome.
 
@@ -67,7 +71,9 @@
 
   4. Call the program on the wav file like this:
 
-         ./wav_state_detector /path/to/file.wav
+         ./wav_state_detector [-c channel] /path/to/file.wav
+
+    Elements are detected in channel 0, unless other channel is given.
 
     The program will analyse the wav file, detect states (mark/space) and
     their durations, and will generate another raw file, this time with
@@ -75,13 +81,32 @@
     file.
 
     If input wav file is /path/to/file.wav, then the output raw file will be
-    /path/to/file.wav_states.raw.
+    /path/to/file.wav_states.raw. The detected elements are also saved in
+    compact binary log of elements (see cwutils/lib/elements_log.h) in
+    /path/to/file.wav_elements.cwel.
 
   5. Open the input wav file and the output raw file in e.g. Audacity and
      compare both files.
 
      Confirm that square wave saved to raw file corresponds with what is
      present in input wav file.
+
+
+  Pipelined mode:
+
+      ./wav_state_detector -p [-c channel] [-w speed] [-r N] [-l] file.wav [file2.wav ...]
+
+  In this mode the elements detected in wav file are passed straight to
+  libcw receiver, without any intermediate files. Decoded text is printed
+  to stdout as it's received, and divergences of durations of elements are
+  printed to stderr every N elements (-r) and at the end of each file.
+  Receiver works with fixed speed given with -w, or in adaptive mode if -w
+  is not given. Memory usage doesn't depend on size of files.
+
+  With -l the received elements of file.wav are also saved in binary log of
+  elements file.wav.cwel. Input files with .cwel extension are read as
+  binary logs of elements instead of as wav files, so elements detected
+  once can be decoded again without detecting them in wav file.
 */
 
 
@@ -120,9 +145,11 @@ static void write_elements_to_file(int fd, cw_elements_t * elements, cw_element_
 
 	for (size_t e = 0; e < elements->curr_count; e++) {
 		cw_element_time_t this_element_span = 0.0;
-		while (this_element_span < elements->array[e].timespan) {
+		cw_element_t element;
+		cw_elements_get_element(elements, e, &element);
+		while (this_element_span < element.timespan) {
 			ssize_t n = 0;
-			if (elements->array[e].state == cw_state_mark) {
+			if (element.state == cw_state_mark) {
 				n = write(fd, &high, sizeof (high));
 			} else {
 				n = write(fd, &low, sizeof (low));
@@ -146,49 +173,37 @@ static void write_elements_to_file(int fd, cw_elements_t * elements, cw_element_
 
 
 /**
+   @brief Detect states in wav file, write them as square wave to raw file
+
    @reviewedon 2023.08.12
-*/
-int main(int argc, char * argv[])
-{
-	if (argc != 2) {
-		fprintf(stderr, "[ERROR] Missing argument with path to input wav audio file\n");
-		fprintf(stderr, "[INFO ] Run this program like this: '%s path_to_file.wav'\n", argv[0]);
-		exit(EXIT_FAILURE);
-	}
 
-	const char * wav_path = argv[1];
-	int input_fd = open(wav_path, O_RDONLY);
-	if (-1 == input_fd) {
-		fprintf(stderr, "[ERROR] Can't open input wav file '%s': %s\n", wav_path, strerror(errno));
-		exit(EXIT_FAILURE);
-	}
+   @param[in] wav_path Path to input wav file
+   @param[in] channel Channel of wav file in which to detect states
 
-	wav_header_t header = { 0 };
-	if (0 != wav_read_header(input_fd, &header)) {
-		fprintf(stderr, "[ERROR] Failed to read header of input wav file '%s'\n", wav_path);
-		close(input_fd);
+   @return 0 on success
+   @return -1 on failure
+*/
+static int detect_states(const char * wav_path, unsigned int channel)
+{
+	wav_reader_t reader;
+	if (0 != wav_reader_open(&reader, wav_path)) {
+		fprintf(stderr, "[ERROR] Failed to open input wav file '%s'\n", wav_path);
 		return -1;
 	}
 
-	bool valid = false;
-	wav_validate_header(&header, &valid);
-	if (!valid) {
-		fprintf(stderr, "[ERROR] Header of wav file doesn't seem to be valid\n");
-		close(input_fd);
-		exit(EXIT_FAILURE);
-	}
-
-	const cw_element_time_t sample_spacing = (1000.0 * 1000.0) / header.sample_rate; // [us]
-	fprintf(stderr, "[INFO ] Sample rate    = %u Hz\n", header.sample_rate);
+	const uint32_t reader_sample_rate = reader.sample_rate;
+	const cw_element_time_t sample_spacing = (1000.0 * 1000.0) / reader.sample_rate; // [us]
+	fprintf(stderr, "[INFO ] Sample rate    = %u Hz\n", reader.sample_rate);
 	fprintf(stderr, "[INFO ] Sample spacing = %.4f us\n", sample_spacing);
+	fprintf(stderr, "[INFO ] Channel        = %u\n", channel);
 
 	cw_elements_t * wav_elements = cw_elements_new(1000);
-	const int retval = cw_elements_detect_from_wav(input_fd, wav_elements, sample_spacing);
-	close(input_fd);
+	const int retval = cw_elements_detect_from_wav_reader(&reader, channel, wav_elements);
+	wav_reader_close(&reader);
 	if (0 != retval) {
 		fprintf(stderr, "[ERROR] Failed to detect elements in wav\n");
 		cw_elements_delete(&wav_elements);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 	fprintf(stderr, "[INFO ] Detected %zu elements in wav file\n", wav_elements->curr_count);
 	/* Debug. */
@@ -205,13 +220,153 @@ int main(int argc, char * argv[])
 	if (-1 == states_fd) {
 		fprintf(stderr, "[ERROR] Failed to open output raw file '%s': %s\n", states_path, strerror(errno));
 		cw_elements_delete(&wav_elements);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 	write_elements_to_file(states_fd, wav_elements, sample_spacing);
 	close(states_fd);
 
+	char log_path[1024] = { 0 };
+	snprintf(log_path, sizeof (log_path), "%s_elements.cwel", wav_path);
+	FILE * log_file = fopen(log_path, "wb");
+	if (NULL == log_file) {
+		fprintf(stderr, "[ERROR] Failed to open output elements log '%s': %s\n", log_path, strerror(errno));
+		cw_elements_delete(&wav_elements);
+		return -1;
+	}
+	const int log_retval = cw_elements_log_write(log_file, wav_elements, reader_sample_rate);
+	fclose(log_file);
+
 	cw_elements_delete(&wav_elements);
-	exit(EXIT_SUCCESS);
+	return log_retval;
 }
 
 
+
+
+/**
+   @brief Decode text from wav file with elements pipeline
+
+   @param[in] wav_path Path to input wav file, or to binary log of elements
+   @param[in] config Configuration of pipeline
+   @param[in] save_log Whether to save elements detected in wav file to binary log
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int decode_text(const char * wav_path, const cw_elements_pipeline_config_t * config, bool save_log)
+{
+	cw_elements_pipeline_result_t result;
+	int retval = 0;
+
+	const size_t len = strlen(wav_path);
+	if (len > 5 && 0 == strcmp(wav_path + len - 5, ".cwel")) {
+		cw_elements_log_reader_t log_reader;
+		if (0 != cw_elements_log_reader_open(&log_reader, wav_path)) {
+			fprintf(stderr, "[ERROR] Failed to open input elements log '%s'\n", wav_path);
+			return -1;
+		}
+		retval = cw_elements_pipeline_run_log(&log_reader, config, &result);
+		cw_elements_log_reader_close(&log_reader);
+
+	} else {
+		wav_reader_t reader;
+		if (0 != wav_reader_open(&reader, wav_path)) {
+			fprintf(stderr, "[ERROR] Failed to open input wav file '%s'\n", wav_path);
+			return -1;
+		}
+
+		cw_elements_pipeline_config_t file_config = *config;
+		FILE * log_file = NULL;
+		if (save_log) {
+			char log_path[1024] = { 0 };
+			snprintf(log_path, sizeof (log_path), "%s.cwel", wav_path);
+			log_file = fopen(log_path, "wb");
+			file_config.elements_log = (cw_elements_log_writer_t *) malloc(sizeof (cw_elements_log_writer_t));
+			if (NULL == log_file || NULL == file_config.elements_log
+			    || 0 != cw_elements_log_writer_open(file_config.elements_log, log_file, reader.sample_rate)) {
+				fprintf(stderr, "[ERROR] Failed to open output elements log '%s'\n", log_path);
+				free(file_config.elements_log);
+				if (NULL != log_file) {
+					fclose(log_file);
+				}
+				wav_reader_close(&reader);
+				return -1;
+			}
+		}
+
+		retval = cw_elements_pipeline_run(&reader, &file_config, &result);
+		wav_reader_close(&reader);
+
+		if (save_log) {
+			if (0 != cw_elements_log_writer_close(file_config.elements_log)) {
+				retval = -1;
+			}
+			free(file_config.elements_log);
+			fclose(log_file);
+		}
+	}
+	fputc('\n', config->text_file);
+	if (0 != retval) {
+		fprintf(stderr, "[ERROR] Failed to decode text from '%s'\n", wav_path);
+		return -1;
+	}
+
+	fprintf(stderr, "[INFO ] Summary for '%s':\n", wav_path);
+	cw_elements_pipeline_print_divergences(config->report_file, &result, 0 == config->speed ? result.speed : (float) config->speed);
+	return 0;
+}
+
+
+
+
+/**
+   @reviewedon 2023.08.12
+*/
+int main(int argc, char * argv[])
+{
+	bool pipeline = false;
+	bool save_log = false;
+	cw_elements_pipeline_config_t config = { .text_file = stdout, .report_file = stderr };
+
+	int opt = 0;
+	while (-1 != (opt = getopt(argc, argv, "c:pw:r:l"))) {
+		switch (opt) {
+		case 'c':
+			config.channel = (unsigned int) atoi(optarg);
+			break;
+		case 'p':
+			pipeline = true;
+			break;
+		case 'w':
+			config.speed = atoi(optarg);
+			break;
+		case 'r':
+			config.report_interval = (size_t) atol(optarg);
+			break;
+		case 'l':
+			save_log = true;
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind == argc || (!pipeline && optind + 1 != argc)) {
+		fprintf(stderr, "[ERROR] Missing argument with path to input wav audio file\n");
+		fprintf(stderr, "[INFO ] Run this program like this: '%s [-c channel] path_to_file.wav'\n", argv[0]);
+		fprintf(stderr, "[INFO ] or like this: '%s -p [-c channel] [-w speed] [-r N] [-l] path_to_file.wav ...'\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!pipeline) {
+		exit(0 == detect_states(argv[optind], config.channel) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	int failures = 0;
+	for (int i = optind; i < argc; i++) {
+		if (0 != decode_text(argv[i], &config, save_log)) {
+			failures++;
+		}
+	}
+	exit(0 == failures ? EXIT_SUCCESS : EXIT_FAILURE);
+}
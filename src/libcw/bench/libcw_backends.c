@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_backends.c
+
+   Throughput and latency of sound systems for different period sizes.
+
+   For each sound system and each requested period size the program
+   plays text for a given time and measures:
+   - period size and latency (duration of samples held by device's
+     buffer) negotiated with the device;
+   - distribution of durations of calls writing samples to the device
+     (for Console and Null sound systems: calls "writing" tones);
+   - CPU time of the process and of generator's thread per second of
+     audio;
+   - count of underruns (xruns) of the device.
+
+   Period size is a setting of ALSA (cw_gen_config_t::alsa_period_size)
+   and of OSS, where it is requested through latency of two periods at
+   48 kHz (cw_gen_config_t::oss_latency). Other sound systems are
+   measured once, with their default settings. A sound system whose
+   device can't be opened is skipped.
+
+   Results are printed to stdout as tab-separated values, one run per
+   line:
+
+   <sound system> <requested period> <period> <latency [us]> <writes> <min> <median> <p90> <p99> <max [us]> <process CPU [ms/s]> <generator CPU [ms/s]> <xruns> <time [s]>
+
+   Lines starting with '#' are comments. The table can be used to
+   choose settings of generator for given hardware.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+
+#include "test_framework/basic_utils/resource_meas.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Upper limit of count of measured write calls in single run. */
+#define BACKENDS_MAX_WRITES (1 << 18)
+
+#define BACKENDS_SYSTEMS_DEFAULT "caop"
+#define BACKENDS_PERIODS_DEFAULT "64,128,256,512,1024,2048"
+#define BACKENDS_DURATION_DEFAULT_S 10
+#define BACKENDS_MAX_SETTINGS 16
+
+/* Sample rate at which period size is converted to latency of OSS
+   device. */
+#define BACKENDS_OSS_NOMINAL_RATE 48000
+
+#define BACKENDS_TEXT "PARIS CQ DE TEST 599 "
+#define BACKENDS_SPEED 30
+
+/* Interval of measurements of CPU usage. */
+#define BACKENDS_MEAS_INTERVAL_MSECS 100
+
+
+
+
+/* Durations of write calls collected during one run, written only by
+   generator's thread. */
+typedef struct {
+	int64_t durations[BACKENDS_MAX_WRITES]; /* [microseconds] */
+	int n_writes;
+
+	/* Original functions of sound system, called by hooks. */
+	cw_ret_t (* write_buffer_to_sound_device)(cw_gen_t * gen);
+	cw_ret_t (* write_tone_to_sound_device)(cw_gen_t * gen, const cw_tone_t * tone);
+} backends_run_t;
+
+
+typedef struct {
+	const char * device;
+	int duration_s;
+	long unsigned int periods[BACKENDS_MAX_SETTINGS];
+	int n_periods;
+} backends_config_t;
+
+
+
+
+/* Hooks installed in generator don't get any user pointer, so state of
+   current run is global. */
+static backends_run_t g_run;
+
+
+
+
+static uint64_t backends_now_ns(void);
+static int backends_parse_list(const char * string, long * values, int capacity);
+static int backends_run(const backends_config_t * config, cw_sound_system_t sound_system, long unsigned int period);
+static int backends_play(cw_gen_t * gen, int duration_s);
+static int backends_compare(const void * a, const void * b);
+static void backends_record(uint64_t begin);
+
+static cw_ret_t backends_write_buffer_hook(cw_gen_t * gen);
+static cw_ret_t backends_write_tone_hook(cw_gen_t * gen, const cw_tone_t * tone);
+
+
+
+
+static void print_help(const char * program)
+{
+	fprintf(stdout, "Usage: %s [-s <sound systems>] [-d <device>] [-p <periods>] [-t <seconds>]\n", program);
+	fprintf(stdout, "  -s <sound systems>  letters of sound systems to measure (default \"%s\"):\n", BACKENDS_SYSTEMS_DEFAULT);
+	fprintf(stdout, "                      n (null), c (console), o (OSS), a (ALSA), p (PulseAudio)\n");
+	fprintf(stdout, "  -d <device>         name of sound device\n");
+	fprintf(stdout, "  -p <periods>        comma-separated list of period sizes of ALSA and OSS, 0 for default (default %s)\n", BACKENDS_PERIODS_DEFAULT);
+	fprintf(stdout, "  -t <seconds>        duration of playing with each setting (default %d)\n", BACKENDS_DURATION_DEFAULT_S);
+}
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	backends_config_t config;
+	memset(&config, 0, sizeof (config));
+	config.duration_s = BACKENDS_DURATION_DEFAULT_S;
+
+	const char * systems = BACKENDS_SYSTEMS_DEFAULT;
+	const char * periods = BACKENDS_PERIODS_DEFAULT;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:d:p:t:h"))) {
+		switch (opt) {
+		case 's':
+			systems = optarg;
+			break;
+		case 'd':
+			config.device = optarg;
+			break;
+		case 'p':
+			periods = optarg;
+			break;
+		case 't':
+			config.duration_s = atoi(optarg);
+			if (config.duration_s <= 0) {
+				fprintf(stderr, "Invalid duration '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	long values[BACKENDS_MAX_SETTINGS];
+	config.n_periods = backends_parse_list(periods, values, BACKENDS_MAX_SETTINGS);
+	for (int i = 0; i < config.n_periods; i++) {
+		if (values[i] < 0) {
+			config.n_periods = -1;
+			break;
+		}
+		config.periods[i] = (long unsigned int) values[i];
+	}
+	if (config.n_periods <= 0) {
+		fprintf(stderr, "Invalid list of period sizes '%s'\n", periods);
+		return EXIT_FAILURE;
+	}
+
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	fprintf(stdout, "# sound system\trequested period\tperiod\tlatency [us]\twrites\tmin\tmedian\tp90\tp99\tmax [us]\tprocess cpu [ms/s]\tgenerator cpu [ms/s]\txruns\ttime [s]\n");
+
+	int n_errors = 0;
+	for (const char * s = systems; '\0' != *s; s++) {
+		cw_sound_system_t sound_system;
+		switch (*s) {
+		case 'n': sound_system = CW_AUDIO_NULL; break;
+		case 'c': sound_system = CW_AUDIO_CONSOLE; break;
+		case 'o': sound_system = CW_AUDIO_OSS; break;
+		case 'a': sound_system = CW_AUDIO_ALSA; break;
+		case 'p': sound_system = CW_AUDIO_PA; break;
+		default:
+			fprintf(stderr, "Invalid sound system '%c'\n", *s);
+			return EXIT_FAILURE;
+		}
+
+		if (CW_AUDIO_ALSA == sound_system || CW_AUDIO_OSS == sound_system) {
+			for (int p = 0; p < config.n_periods; p++) {
+				n_errors += 0 != backends_run(&config, sound_system, config.periods[p]);
+			}
+		} else {
+			n_errors += 0 != backends_run(&config, sound_system, 0);
+		}
+	}
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock
+
+   @return current time, in nanoseconds
+*/
+static uint64_t backends_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Parse comma-separated list of non-negative integers
+
+   @param[in] string string to parse
+   @param[out] values parsed values
+   @param[in] capacity size of @p values
+
+   @return count of parsed values
+   @return -1 if @p string is invalid or has too many values
+*/
+static int backends_parse_list(const char * string, long * values, int capacity)
+{
+	int n = 0;
+	const char * cursor = string;
+	while ('\0' != *cursor) {
+		if (n == capacity) {
+			return -1;
+		}
+		char * end = NULL;
+		errno = 0;
+		values[n] = strtol(cursor, &end, 10);
+		if (0 != errno || end == cursor || ('\0' != *end && ',' != *end)) {
+			return -1;
+		}
+		n++;
+		cursor = ',' == *end ? end + 1 : end;
+	}
+	return n;
+}
+
+
+
+
+/**
+   @brief Play text with given sound system and period size, print results of measurements
+
+   @param[in] config configuration of program
+   @param[in] sound_system sound system to measure
+   @param[in] period period size, zero for default
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int backends_run(const backends_config_t * config, cw_sound_system_t sound_system, long unsigned int period)
+{
+	memset(&g_run, 0, sizeof (g_run));
+	const char * label = cw_get_audio_system_label(sound_system);
+
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = sound_system;
+	if (NULL != config->device) {
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", config->device);
+	}
+	if (CW_AUDIO_ALSA == sound_system) {
+		gen_conf.alsa_period_size = period;
+	} else if (CW_AUDIO_OSS == sound_system && 0 != period) {
+		gen_conf.oss_latency = (int) (2 * period * 1000000 / BACKENDS_OSS_NOMINAL_RATE);
+	}
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		/* Sound system may be unavailable, or its device may not
+		   accept the period size. */
+		fprintf(stdout, "# %s: can't open device with period size %lu\n", label, period);
+		return 0;
+	}
+	cw_gen_set_speed(gen, BACKENDS_SPEED);
+
+	/* Sound sink has been opened by cw_gen_new(), so functions of
+	   sound system are known and can be wrapped with hooks. */
+	if (NULL != gen->write_buffer_to_sound_device) {
+		g_run.write_buffer_to_sound_device = gen->write_buffer_to_sound_device;
+		gen->write_buffer_to_sound_device = backends_write_buffer_hook;
+	}
+	if (NULL != gen->write_tone_to_sound_device) {
+		g_run.write_tone_to_sound_device = gen->write_tone_to_sound_device;
+		gen->write_tone_to_sound_device = backends_write_tone_hook;
+	}
+
+	cw_gen_metrics_t before;
+	cw_gen_metrics_t after;
+	cw_gen_get_metrics(gen, &before);
+
+	resource_meas meas;
+	bool is_meas_started = false;
+	uint64_t elapsed = 0;
+	int result = -1;
+	if (CW_SUCCESS == cw_gen_start(gen)) {
+		if (0 == resource_meas_start(&meas, BACKENDS_MEAS_INTERVAL_MSECS)) {
+			is_meas_started = true;
+			resource_meas_add_thread(&meas, gen->thread.id, "gen");
+		}
+		const uint64_t begin = backends_now_ns();
+		result = backends_play(gen, config->duration_s);
+		elapsed = backends_now_ns() - begin;
+		if (is_meas_started) {
+			resource_meas_stop(&meas);
+		}
+		cw_gen_get_metrics(gen, &after);
+		cw_gen_stop(gen);
+	} else {
+		fprintf(stderr, "Failed to start generator of sound system %s\n", label);
+	}
+	cw_gen_delete(&gen);
+
+	if (0 != result) {
+		return -1;
+	}
+
+	const double seconds = (double) elapsed / 1e9;
+	double process_cpu = 0.0;
+	double gen_cpu = 0.0;
+	if (is_meas_started) {
+		const long cpu_time = (meas.rusage_curr.ru_utime.tv_sec - meas.rusage_start.ru_utime.tv_sec
+				       + meas.rusage_curr.ru_stime.tv_sec - meas.rusage_start.ru_stime.tv_sec) * 1000000L
+			+ (meas.rusage_curr.ru_utime.tv_usec - meas.rusage_start.ru_utime.tv_usec)
+			+ (meas.rusage_curr.ru_stime.tv_usec - meas.rusage_start.ru_stime.tv_usec);
+		process_cpu = (double) cpu_time / 1000.0 / seconds;
+
+		resource_meas_thread thread;
+		if (0 == resource_meas_get_thread(&meas, 0, &thread)) {
+			gen_cpu = (double) resource_meas_get_thread_cpu_time(&thread) / 1000.0 / seconds;
+		}
+	}
+
+	const int n = g_run.n_writes;
+	qsort(g_run.durations, (size_t) n, sizeof (g_run.durations[0]), backends_compare);
+
+	fprintf(stdout, "%s\t%lu\t%d\t%d\t%d", label, period, after.period_n_samples, after.device_latency, n);
+	if (0 == n) {
+		fprintf(stdout, "\t-\t-\t-\t-\t-");
+	} else {
+		fprintf(stdout, "\t%lld\t%lld\t%lld\t%lld\t%lld",
+			(long long) g_run.durations[0],
+			(long long) g_run.durations[n / 2],
+			(long long) g_run.durations[(n * 9) / 10],
+			(long long) g_run.durations[(n * 99) / 100],
+			(long long) g_run.durations[n - 1]);
+	}
+	fprintf(stdout, "\t%.2f\t%.2f\t%llu\t%.3f\n",
+		process_cpu, gen_cpu,
+		(unsigned long long) (after.n_underruns - before.n_underruns),
+		seconds);
+	fflush(stdout);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Keep generator's queue filled with text for given time
+
+   @param[in] gen started generator
+   @param[in] duration_s how long to play, in seconds
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int backends_play(cw_gen_t * gen, int duration_s)
+{
+	const size_t low_level = cw_tq_capacity_internal(gen->tq) / 4;
+	const uint64_t end = backends_now_ns() + (uint64_t) duration_s * 1000000000;
+
+	while (backends_now_ns() < end) {
+		if (cw_gen_get_queue_length(gen) < low_level) {
+			if (CW_SUCCESS != cw_gen_enqueue_string(gen, BACKENDS_TEXT)
+			    && EAGAIN != errno) {
+				fprintf(stderr, "Failed to enqueue text\n");
+				return -1;
+			}
+		}
+		usleep(20000);
+	}
+
+	return 0;
+}
+
+
+
+
+static int backends_compare(const void * a, const void * b)
+{
+	const int64_t x = *(const int64_t *) a;
+	const int64_t y = *(const int64_t *) b;
+	return (x > y) - (x < y);
+}
+
+
+
+
+/**
+   @brief Record duration of a write call that has begun at @p begin
+
+   @param[in] begin beginning of the call, in nanoseconds
+*/
+static void backends_record(uint64_t begin)
+{
+	if (g_run.n_writes < BACKENDS_MAX_WRITES) {
+		g_run.durations[g_run.n_writes++] = (int64_t) (backends_now_ns() - begin) / 1000;
+	}
+}
+
+
+
+
+/**
+   @brief Hook around function writing buffer of samples to sound device
+*/
+static cw_ret_t backends_write_buffer_hook(cw_gen_t * gen)
+{
+	const uint64_t begin = backends_now_ns();
+	const cw_ret_t cwret = g_run.write_buffer_to_sound_device(gen);
+	backends_record(begin);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Hook around function "writing" tones of Null and Console sound systems
+*/
+static cw_ret_t backends_write_tone_hook(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	const uint64_t begin = backends_now_ns();
+	const cw_ret_t cwret = g_run.write_tone_to_sound_device(gen, tone);
+	backends_record(begin);
+
+	return cwret;
+}
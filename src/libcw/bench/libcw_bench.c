@@ -0,0 +1,698 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_bench.c
+
+   Micro-benchmarks of hot paths of libcw.
+
+   Each benchmark repeats an operation for a given time and reports rate
+   of the operation. Results are printed to stdout as tab-separated
+   values, one benchmark per line:
+
+   <name> <unit> <rate> <count of operations> <time [s]>
+
+   Lines starting with '#' are comments. The format is meant to be
+   consumed by scripts tracking performance regressions.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "libcw_rec.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Size of generator's buffer used in generator's benchmarks. */
+#define BENCH_BUFFER_N_SAMPLES 512
+
+/* Default time of running a single benchmark. */
+#define BENCH_DURATION_DEFAULT_MS 500
+
+
+
+
+typedef struct {
+	const char * name;
+	const char * unit;
+
+	/* Execute one batch of operations, return count of operations
+	   executed in the batch, or negative value on errors. */
+	int64_t (* run_batch)(void * state);
+
+	/* Prepare state of benchmark. Return NULL on errors. */
+	void * (* setup)(const void * arg);
+	void (* teardown)(void * state);
+	const void * arg;
+} bench_t;
+
+
+
+
+static uint64_t bench_now_ns(void);
+static int bench_run(const bench_t * bench, int duration_ms);
+
+static void * bench_gen_setup(const void * arg);
+static void bench_gen_teardown(void * state);
+static int64_t bench_sine_wave_batch(void * state);
+static int64_t bench_write_loop_batch(void * state);
+static cw_ret_t bench_write_buffer_to_nowhere(cw_gen_t * gen);
+
+static void * bench_tq_setup(const void * arg);
+static void bench_tq_teardown(void * state);
+static int64_t bench_tq_batch(void * state);
+
+static void * bench_data_setup(const void * arg);
+static void bench_data_teardown(void * state);
+static int64_t bench_data_batch(void * state);
+
+static void * bench_rec_setup(const void * arg);
+static void bench_rec_teardown(void * state);
+static int64_t bench_rec_batch(void * state);
+
+static void * bench_loopback_setup(const void * arg);
+static void bench_loopback_teardown(void * state);
+static int64_t bench_loopback_batch(void * state);
+
+
+
+
+static const cw_gen_oscillator_t g_oscillator_sinf = CW_GEN_OSCILLATOR_SINF;
+static const cw_gen_oscillator_t g_oscillator_phasor = CW_GEN_OSCILLATOR_PHASOR;
+static const cw_gen_oscillator_t g_oscillator_table = CW_GEN_OSCILLATOR_TABLE;
+static const cw_gen_oscillator_t g_oscillator_fixed_point = CW_GEN_OSCILLATOR_FIXED_POINT;
+
+
+
+
+static const bench_t g_benchmarks[] = {
+	{ "gen_sine_wave_sinf",        "samples/s",    bench_sine_wave_batch,  bench_gen_setup,  bench_gen_teardown,  &g_oscillator_sinf },
+	{ "gen_sine_wave_phasor",      "samples/s",    bench_sine_wave_batch,  bench_gen_setup,  bench_gen_teardown,  &g_oscillator_phasor },
+	{ "gen_sine_wave_table",       "samples/s",    bench_sine_wave_batch,  bench_gen_setup,  bench_gen_teardown,  &g_oscillator_table },
+	{ "gen_sine_wave_fixed_point", "samples/s",    bench_sine_wave_batch,  bench_gen_setup,  bench_gen_teardown,  &g_oscillator_fixed_point },
+	{ "gen_write_loop",            "samples/s",    bench_write_loop_batch, bench_gen_setup,  bench_gen_teardown,  &g_oscillator_sinf },
+	{ "tq_enqueue_dequeue",        "tones/s",      bench_tq_batch,         bench_tq_setup,   bench_tq_teardown,   NULL },
+	{ "data_representation_lookup", "lookups/s",   bench_data_batch,       bench_data_setup, bench_data_teardown, NULL },
+	{ "rec_marks",                 "marks/s",      bench_rec_batch,        bench_rec_setup,  bench_rec_teardown,  NULL },
+	{ "gen_rec_loopback",          "chars/s",      bench_loopback_batch,   bench_loopback_setup, bench_loopback_teardown, NULL },
+};
+
+
+
+
+static void print_help(const char * program)
+{
+	fprintf(stdout, "Usage: %s [-d <duration>] [-b <name>] [-l]\n", program);
+	fprintf(stdout, "  -d <duration>  run each benchmark for <duration> milliseconds (default %d)\n", BENCH_DURATION_DEFAULT_MS);
+	fprintf(stdout, "  -b <name>      run only benchmarks with names starting with <name>\n");
+	fprintf(stdout, "  -l             list names of benchmarks\n");
+}
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	int duration_ms = BENCH_DURATION_DEFAULT_MS;
+	const char * name_prefix = "";
+	bool list_only = false;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "d:b:lh"))) {
+		switch (opt) {
+		case 'd':
+			duration_ms = atoi(optarg);
+			if (duration_ms <= 0) {
+				fprintf(stderr, "Invalid duration '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			name_prefix = optarg;
+			break;
+		case 'l':
+			list_only = true;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	if (!list_only) {
+		fprintf(stdout, "# name\tunit\trate\tcount\ttime [s]\n");
+	}
+
+	int n_errors = 0;
+	for (size_t i = 0; i < sizeof (g_benchmarks) / sizeof (g_benchmarks[0]); i++) {
+		const bench_t * bench = &g_benchmarks[i];
+		if (0 != strncmp(bench->name, name_prefix, strlen(name_prefix))) {
+			continue;
+		}
+		if (list_only) {
+			fprintf(stdout, "%s\n", bench->name);
+			continue;
+		}
+		if (0 != bench_run(bench, duration_ms)) {
+			fprintf(stderr, "Benchmark %s has failed\n", bench->name);
+			n_errors++;
+		}
+	}
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock
+
+   @return current time, in nanoseconds
+*/
+static uint64_t bench_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Run a benchmark for given time and print its result
+
+   @param[in] bench benchmark to run
+   @param[in] duration_ms how long to run the benchmark, in milliseconds
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int bench_run(const bench_t * bench, int duration_ms)
+{
+	void * state = bench->setup(bench->arg);
+	if (NULL == state) {
+		return -1;
+	}
+
+	/* Warm up caches (of CPU and of libcw). */
+	if (bench->run_batch(state) < 0) {
+		bench->teardown(state);
+		return -1;
+	}
+
+	const uint64_t duration_ns = (uint64_t) duration_ms * 1000000;
+	int64_t count = 0;
+	const uint64_t begin = bench_now_ns();
+	uint64_t elapsed = 0;
+	do {
+		const int64_t n = bench->run_batch(state);
+		if (n < 0) {
+			bench->teardown(state);
+			return -1;
+		}
+		count += n;
+		elapsed = bench_now_ns() - begin;
+	} while (elapsed < duration_ns);
+
+	bench->teardown(state);
+
+	const double seconds = (double) elapsed / 1e9;
+	fprintf(stdout, "%s\t%s\t%.0f\t%lld\t%.3f\n", bench->name, bench->unit, (double) count / seconds, (long long) count, seconds);
+	fflush(stdout);
+
+	return 0;
+}
+
+
+
+
+/* State of generator's benchmarks. */
+typedef struct {
+	cw_gen_t * gen;
+	cw_sample_t buffer[BENCH_BUFFER_N_SAMPLES];
+	cw_sample_t * original_buffer;
+	int original_buffer_n_samples;
+} bench_gen_state_t;
+
+
+
+
+/**
+   @brief Create generator with Null sound system and with buffer of samples
+
+   @param[in] arg pointer to cw_gen_oscillator_t: oscillator engine of generator
+
+   @return state of benchmark on success
+   @return NULL on failure
+*/
+static void * bench_gen_setup(const void * arg)
+{
+	bench_gen_state_t * state = calloc(1, sizeof (bench_gen_state_t));
+	if (NULL == state) {
+		return NULL;
+	}
+
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.oscillator = *(const cw_gen_oscillator_t *) arg;
+
+	state->gen = cw_gen_new(&gen_conf);
+	if (NULL == state->gen) {
+		free(state);
+		return NULL;
+	}
+
+	/* Null sound system doesn't need generator's buffer, so the
+	   benchmark provides its own buffer. */
+	state->original_buffer = state->gen->buffer;
+	state->original_buffer_n_samples = state->gen->buffer_n_samples;
+	state->gen->buffer = state->buffer;
+	state->gen->buffer_n_samples = BENCH_BUFFER_N_SAMPLES;
+	state->gen->write_buffer_to_sound_device = bench_write_buffer_to_nowhere;
+
+	return state;
+}
+
+
+
+
+static void bench_gen_teardown(void * arg)
+{
+	bench_gen_state_t * state = (bench_gen_state_t *) arg;
+	state->gen->buffer = state->original_buffer;
+	state->gen->buffer_n_samples = state->original_buffer_n_samples;
+	cw_gen_delete(&state->gen);
+	free(state);
+}
+
+
+
+
+/**
+   @brief Calculate samples of a tone, buffer after buffer
+
+   @return count of calculated samples
+*/
+static int64_t bench_sine_wave_batch(void * arg)
+{
+	bench_gen_state_t * state = (bench_gen_state_t *) arg;
+	cw_gen_t * gen = state->gen;
+
+	/* Plateau of a tone: samples are calculated without slopes. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 800, 0, CW_SLOPE_MODE_NO_SLOPES);
+	tone.n_samples = 100 * BENCH_BUFFER_N_SAMPLES;
+
+	int64_t n = 0;
+	while (n < tone.n_samples) {
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = BENCH_BUFFER_N_SAMPLES - 1;
+		n += cw_gen_calculate_sine_wave_internal(gen, &tone);
+	}
+
+	return n;
+}
+
+
+
+
+/**
+   @brief Write a one-second tone with slopes through generator's write loop
+
+   The samples go to a sound sink that discards them, so only work done
+   by generator is measured. Caches of generator (of tones and of
+   slopes) are used as in real generator, so after first batch the
+   benchmark mostly measures copying of samples from caches.
+
+   @return count of written samples
+*/
+static int64_t bench_write_loop_batch(void * arg)
+{
+	bench_gen_state_t * state = (bench_gen_state_t *) arg;
+	cw_gen_t * gen = state->gen;
+
+	if (CW_SUCCESS != cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000)) {
+		return -1;
+	}
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 800, CW_USECS_PER_SEC, CW_SLOPE_MODE_STANDARD_SLOPES);
+	tone.n_samples = gen->sample_rate;
+	tone.rising_slope_n_samples = gen->tone_slope.n_amplitudes;
+	tone.falling_slope_n_samples = gen->tone_slope.n_amplitudes;
+
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+	cw_gen_write_to_soundcard_internal(gen, &tone);
+
+	return (int64_t) gen->sample_rate;
+}
+
+
+
+
+static cw_ret_t bench_write_buffer_to_nowhere(__attribute__((unused)) cw_gen_t * gen)
+{
+	return CW_SUCCESS;
+}
+
+
+
+
+static void * bench_tq_setup(__attribute__((unused)) const void * arg)
+{
+	return cw_tq_new_internal();
+}
+
+
+
+
+static void bench_tq_teardown(void * state)
+{
+	cw_tone_queue_t * tq = (cw_tone_queue_t *) state;
+	cw_tq_delete_internal(&tq);
+}
+
+
+
+
+/**
+   @brief Fill tone queue, and then drain it
+
+   @return count of tones that have been enqueued and dequeued
+*/
+static int64_t bench_tq_batch(void * state)
+{
+	cw_tone_queue_t * tq = (cw_tone_queue_t *) state;
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 800, 1000, CW_SLOPE_MODE_STANDARD_SLOPES);
+
+	int64_t n_enqueued = 0;
+	while (CW_SUCCESS == cw_tq_enqueue_internal(tq, &tone)) {
+		n_enqueued++;
+	}
+
+	int64_t n_dequeued = 0;
+	cw_tone_t dequeued;
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(tq, &dequeued)) {
+		n_dequeued++;
+	}
+
+	if (n_enqueued != n_dequeued) {
+		fprintf(stderr, "Enqueued %lld tones, dequeued %lld tones\n", (long long) n_enqueued, (long long) n_dequeued);
+		return -1;
+	}
+
+	return n_enqueued;
+}
+
+
+
+
+/* State of benchmark of lookups of representations. */
+typedef struct {
+	const char * representations[128];
+	int n_representations;
+} bench_data_state_t;
+
+
+
+
+static void * bench_data_setup(__attribute__((unused)) const void * arg)
+{
+	bench_data_state_t * state = calloc(1, sizeof (bench_data_state_t));
+	if (NULL == state) {
+		return NULL;
+	}
+
+	/* Representations of all ASCII characters known to libcw. */
+	for (int c = 0; c < 128; c++) {
+		const char * representation = cw_character_to_representation_internal(c);
+		if (NULL != representation) {
+			state->representations[state->n_representations++] = representation;
+		}
+	}
+
+	return state;
+}
+
+
+
+
+static void bench_data_teardown(void * state)
+{
+	free(state);
+}
+
+
+
+
+/**
+   @brief Look up characters by their representations
+
+   @return count of lookups
+*/
+static int64_t bench_data_batch(void * arg)
+{
+	bench_data_state_t * state = (bench_data_state_t *) arg;
+
+	int64_t n = 0;
+	for (int r = 0; r < 100; r++) {
+		for (int i = 0; i < state->n_representations; i++) {
+			if (0 == cw_representation_to_character_internal(state->representations[i])) {
+				return -1;
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+
+
+
+/* State of receiver's benchmark. */
+typedef struct {
+	cw_rec_t * rec;
+	int64_t timestamp; /* [microseconds] */
+} bench_rec_state_t;
+
+
+
+
+static void * bench_rec_setup(__attribute__((unused)) const void * arg)
+{
+	bench_rec_state_t * state = calloc(1, sizeof (bench_rec_state_t));
+	if (NULL == state) {
+		return NULL;
+	}
+	state->rec = cw_rec_new();
+	if (NULL == state->rec) {
+		free(state);
+		return NULL;
+	}
+	cw_rec_set_speed(state->rec, 20);
+	cw_rec_disable_adaptive_mode(state->rec);
+	state->timestamp = 1000000;
+
+	return state;
+}
+
+
+
+
+static void bench_rec_teardown(void * arg)
+{
+	bench_rec_state_t * state = (bench_rec_state_t *) arg;
+	cw_rec_delete(&state->rec);
+	free(state);
+}
+
+
+
+
+/**
+   @brief Receive word "PARIS" on receiver's own timeline
+
+   @return count of received Marks
+*/
+static int64_t bench_rec_batch(void * arg)
+{
+	bench_rec_state_t * state = (bench_rec_state_t *) arg;
+	cw_rec_t * rec = state->rec;
+	const int dot = CW_DOT_CALIBRATION / 20;
+	const char * word = "PARIS";
+
+	int64_t n_marks = 0;
+	for (const char * c = word; '\0' != *c; c++) {
+		const char * representation = cw_character_to_representation_internal(*c);
+		for (const char * mark = representation; '\0' != *mark; mark++) {
+			const int duration = CW_DOT_REPRESENTATION == *mark ? dot : 3 * dot;
+			if (CW_SUCCESS != cw_rec_mark_begin_usecs(rec, state->timestamp)) {
+				return -1;
+			}
+			state->timestamp += duration;
+			if (CW_SUCCESS != cw_rec_mark_end_usecs(rec, state->timestamp)) {
+				return -1;
+			}
+			state->timestamp += dot;
+			n_marks++;
+		}
+		state->timestamp += 2 * dot;
+		char character = 0;
+		if (CW_SUCCESS != cw_rec_poll_character_usecs(rec, state->timestamp, &character, NULL, NULL)
+		    || character != *c) {
+			return -1;
+		}
+		/* Polled character has been taken from receiver, prepare
+		   the receiver for next character. */
+		cw_rec_reset_state(rec);
+	}
+	state->timestamp += 4 * dot;
+
+	return n_marks;
+}
+
+
+
+
+/* Text sent in loopback benchmark, and text expected from receiver. */
+#define BENCH_LOOPBACK_TEXT "paris paris paris paris paris paris paris paris "
+#define BENCH_LOOPBACK_EXPECTED "PARIS PARIS PARIS PARIS PARIS PARIS PARIS PARIS "
+
+
+
+
+/* State of loopback benchmark. */
+typedef struct {
+	cw_gen_t * gen;
+	cw_rec_t * rec;
+	cw_rec_decoded_t decoded[sizeof (BENCH_LOOPBACK_EXPECTED)];
+} bench_loopback_state_t;
+
+
+
+
+static void * bench_loopback_setup(__attribute__((unused)) const void * arg)
+{
+	bench_loopback_state_t * state = calloc(1, sizeof (bench_loopback_state_t));
+	if (NULL == state) {
+		return NULL;
+	}
+
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	state->gen = cw_gen_new(&gen_conf);
+	state->rec = cw_rec_new();
+	if (NULL == state->gen || NULL == state->rec) {
+		bench_loopback_teardown(state);
+		return NULL;
+	}
+	cw_gen_set_speed(state->gen, 20);
+	cw_rec_set_speed(state->rec, 20);
+	cw_rec_disable_adaptive_mode(state->rec);
+
+	return state;
+}
+
+
+
+
+static void bench_loopback_teardown(void * arg)
+{
+	bench_loopback_state_t * state = (bench_loopback_state_t *) arg;
+	if (NULL != state->gen) {
+		cw_gen_delete(&state->gen);
+	}
+	if (NULL != state->rec) {
+		cw_rec_delete(&state->rec);
+	}
+	free(state);
+}
+
+
+
+
+/**
+   @brief Send text from generator to receiver with cw_gen_loopback_string()
+
+   @return count of received characters (including inter-word-spaces)
+*/
+static int64_t bench_loopback_batch(void * arg)
+{
+	bench_loopback_state_t * state = (bench_loopback_state_t *) arg;
+	const size_t len = sizeof (BENCH_LOOPBACK_EXPECTED) - 1;
+
+	size_t n_decoded = 0;
+	if (CW_SUCCESS != cw_gen_loopback_string(state->gen, state->rec, BENCH_LOOPBACK_TEXT, state->decoded, len, &n_decoded)
+	    || len != n_decoded) {
+		return -1;
+	}
+	for (size_t i = 0; i < n_decoded; i++) {
+		if (BENCH_LOOPBACK_EXPECTED[i] != state->decoded[i].character) {
+			return -1;
+		}
+	}
+
+	return (int64_t) n_decoded;
+}
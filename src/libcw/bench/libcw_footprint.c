@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_footprint.c
+
+   Memory footprint of libcw's objects: generator, tone queue, receiver
+   and key.
+
+   The program reports:
+   - sizeof of every type;
+   - heap memory allocated by constructor of every type, and count of
+     allocations;
+   - count of allocations done by common operations on the objects;
+   - growth of resident set size of the process with 1, 100 and 1000
+     instances of every type.
+
+   Allocations are counted by wrappers of malloc(), calloc(), realloc(),
+   strdup() and free(), linked with "-Wl,--wrap=<function>". Library is
+   linked statically with the program, so calls made by libcw are
+   wrapped too. Memory mapped by libcw with mmap() isn't counted as
+   heap memory, but it is a part of resident set size.
+
+   Results are printed to stdout as tab-separated values, one value
+   per line:
+
+   <name> <unit> <value>
+
+   Lines starting with '#' are comments. The format is meant to be
+   consumed by scripts tracking footprint regressions.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_key.h"
+#include "libcw_rec.h"
+#include "libcw_tq.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Count of repetitions of operation whose allocations are counted. */
+#define FOOTPRINT_N_OPERATIONS 1000
+
+
+
+
+/* Counters of wrapped allocator. Objects may be created or used in
+   threads of libcw, so the counters are atomic. */
+static int64_t g_n_allocations;
+static int64_t g_live_bytes;
+
+
+
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t n_members, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+int __real_posix_memalign(void ** ptr, size_t alignment, size_t size);
+char * __real_strdup(const char * string);
+void __real_free(void * ptr);
+
+void * __wrap_malloc(size_t size);
+void * __wrap_calloc(size_t n_members, size_t size);
+void * __wrap_realloc(void * ptr, size_t size);
+int __wrap_posix_memalign(void ** ptr, size_t alignment, size_t size);
+char * __wrap_strdup(const char * string);
+void __wrap_free(void * ptr);
+
+
+
+
+typedef struct {
+	int64_t n_allocations;
+	int64_t live_bytes;
+} footprint_snapshot_t;
+
+
+
+
+static void footprint_snapshot(footprint_snapshot_t * snapshot);
+static int64_t footprint_rss_bytes(void);
+static void footprint_print(const char * name, const char * unit, double value);
+static int footprint_objects(void);
+static int footprint_operations(void);
+static int footprint_instances(int n_instances);
+
+static cw_gen_t * footprint_gen_new(void);
+
+
+
+
+int main(void)
+{
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	fprintf(stdout, "# name\tunit\tvalue\n");
+
+	fprintf(stdout, "# sizes of types\n");
+	footprint_print("sizeof_gen", "bytes", (double) sizeof (cw_gen_t));
+	footprint_print("sizeof_tq", "bytes", (double) sizeof (cw_tone_queue_t));
+	footprint_print("sizeof_rec", "bytes", (double) sizeof (cw_rec_t));
+	footprint_print("sizeof_key", "bytes", (double) sizeof (cw_key_t));
+
+	int n_errors = 0;
+	n_errors += footprint_objects();
+	n_errors += footprint_operations();
+	const int counts[] = { 1, 100, 1000 };
+	for (size_t i = 0; i < sizeof (counts) / sizeof (counts[0]); i++) {
+		n_errors += footprint_instances(counts[i]);
+	}
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+void * __wrap_malloc(size_t size)
+{
+	void * ptr = __real_malloc(size);
+	if (NULL != ptr) {
+		__atomic_add_fetch(&g_n_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_live_bytes, (int64_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+	return ptr;
+}
+
+
+
+
+void * __wrap_calloc(size_t n_members, size_t size)
+{
+	void * ptr = __real_calloc(n_members, size);
+	if (NULL != ptr) {
+		__atomic_add_fetch(&g_n_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_live_bytes, (int64_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+	return ptr;
+}
+
+
+
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+	const int64_t old_size = (int64_t) malloc_usable_size(ptr);
+	void * new_ptr = __real_realloc(ptr, size);
+	if (NULL != new_ptr) {
+		__atomic_add_fetch(&g_n_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_live_bytes, (int64_t) malloc_usable_size(new_ptr) - old_size, __ATOMIC_RELAXED);
+	}
+	return new_ptr;
+}
+
+
+
+
+int __wrap_posix_memalign(void ** ptr, size_t alignment, size_t size)
+{
+	const int err = __real_posix_memalign(ptr, alignment, size);
+	if (0 == err) {
+		__atomic_add_fetch(&g_n_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_live_bytes, (int64_t) malloc_usable_size(*ptr), __ATOMIC_RELAXED);
+	}
+	return err;
+}
+
+
+
+
+char * __wrap_strdup(const char * string)
+{
+	char * ptr = __real_strdup(string);
+	if (NULL != ptr) {
+		__atomic_add_fetch(&g_n_allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&g_live_bytes, (int64_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+	return ptr;
+}
+
+
+
+
+void __wrap_free(void * ptr)
+{
+	__atomic_sub_fetch(&g_live_bytes, (int64_t) malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	__real_free(ptr);
+}
+
+
+
+
+static void footprint_snapshot(footprint_snapshot_t * snapshot)
+{
+	snapshot->n_allocations = __atomic_load_n(&g_n_allocations, __ATOMIC_RELAXED);
+	snapshot->live_bytes = __atomic_load_n(&g_live_bytes, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Get resident set size of the process
+
+   @return resident set size, in bytes
+   @return -1 on failure
+*/
+static int64_t footprint_rss_bytes(void)
+{
+	FILE * file = fopen("/proc/self/statm", "r");
+	if (NULL == file) {
+		return -1;
+	}
+	long size = 0;
+	long resident = 0;
+	const int n = fscanf(file, "%ld %ld", &size, &resident);
+	fclose(file);
+	if (2 != n) {
+		return -1;
+	}
+	return (int64_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+
+
+
+static void footprint_print(const char * name, const char * unit, double value)
+{
+	fprintf(stdout, "%s\t%s\t%.2f\n", name, unit, value);
+	fflush(stdout);
+}
+
+
+
+
+static cw_gen_t * footprint_gen_new(void)
+{
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	return cw_gen_new(&gen_conf);
+}
+
+
+
+
+/**
+   @brief Report heap memory and allocations of constructors
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int footprint_objects(void)
+{
+	fprintf(stdout, "# heap memory allocated by constructors\n");
+
+	footprint_snapshot_t before;
+	footprint_snapshot_t after;
+
+	footprint_snapshot(&before);
+	cw_gen_t * gen = footprint_gen_new();
+	footprint_snapshot(&after);
+	if (NULL == gen) {
+		return 1;
+	}
+	footprint_print("heap_gen", "bytes", (double) (after.live_bytes - before.live_bytes));
+	footprint_print("allocations_gen_new", "allocations", (double) (after.n_allocations - before.n_allocations));
+	cw_gen_delete(&gen);
+
+	footprint_snapshot(&before);
+	cw_tone_queue_t * tq = cw_tq_new_internal();
+	footprint_snapshot(&after);
+	if (NULL == tq) {
+		return 1;
+	}
+	footprint_print("heap_tq", "bytes", (double) (after.live_bytes - before.live_bytes));
+	footprint_print("allocations_tq_new", "allocations", (double) (after.n_allocations - before.n_allocations));
+	cw_tq_delete_internal(&tq);
+
+	footprint_snapshot(&before);
+	cw_rec_t * rec = cw_rec_new();
+	footprint_snapshot(&after);
+	if (NULL == rec) {
+		return 1;
+	}
+	footprint_print("heap_rec", "bytes", (double) (after.live_bytes - before.live_bytes));
+	footprint_print("allocations_rec_new", "allocations", (double) (after.n_allocations - before.n_allocations));
+	cw_rec_delete(&rec);
+
+	footprint_snapshot(&before);
+	cw_key_t * key = cw_key_new();
+	footprint_snapshot(&after);
+	if (NULL == key) {
+		return 1;
+	}
+	footprint_print("heap_key", "bytes", (double) (after.live_bytes - before.live_bytes));
+	footprint_print("allocations_key_new", "allocations", (double) (after.n_allocations - before.n_allocations));
+	cw_key_delete(&key);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Report average count of allocations done by common operations
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int footprint_operations(void)
+{
+	fprintf(stdout, "# allocations per operation\n");
+
+	cw_gen_t * gen = footprint_gen_new();
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == gen || NULL == rec) {
+		cw_gen_delete(&gen);
+		cw_rec_delete(&rec);
+		return 1;
+	}
+
+	footprint_snapshot_t before;
+	footprint_snapshot_t after;
+
+	/* Enqueueing. Generator isn't started, so the queue is flushed
+	   every few characters (outside of measurement). */
+	int64_t n_allocations = 0;
+	for (int i = 0; i < FOOTPRINT_N_OPERATIONS; i++) {
+		if (0 == i % 100) {
+			cw_tq_flush_internal(gen->tq);
+		}
+		footprint_snapshot(&before);
+		cw_gen_enqueue_character(gen, 'E');
+		footprint_snapshot(&after);
+		n_allocations += after.n_allocations - before.n_allocations;
+	}
+	footprint_print("allocations_gen_enqueue_character", "allocations/op", (double) n_allocations / FOOTPRINT_N_OPERATIONS);
+
+	footprint_snapshot(&before);
+	for (int i = 0; i < FOOTPRINT_N_OPERATIONS; i++) {
+		cw_gen_set_speed(gen, 20 + i % 2);
+	}
+	footprint_snapshot(&after);
+	footprint_print("allocations_gen_set_speed", "allocations/op", (double) (after.n_allocations - before.n_allocations) / FOOTPRINT_N_OPERATIONS);
+
+	footprint_snapshot(&before);
+	for (int i = 0; i < FOOTPRINT_N_OPERATIONS; i++) {
+		cw_rec_set_speed(rec, 20 + i % 2);
+	}
+	footprint_snapshot(&after);
+	footprint_print("allocations_rec_set_speed", "allocations/op", (double) (after.n_allocations - before.n_allocations) / FOOTPRINT_N_OPERATIONS);
+
+	/* Receiving of 'E' on receiver's own timeline. */
+	cw_rec_set_speed(rec, 20);
+	cw_rec_disable_adaptive_mode(rec);
+	const int dot = CW_DOT_CALIBRATION / 20;
+	int64_t timestamp = 1000000;
+	int64_t n_mark_allocations = 0;
+	int64_t n_poll_allocations = 0;
+	for (int i = 0; i < FOOTPRINT_N_OPERATIONS; i++) {
+		footprint_snapshot(&before);
+		cw_rec_mark_begin_usecs(rec, timestamp);
+		timestamp += dot;
+		cw_rec_mark_end_usecs(rec, timestamp);
+		footprint_snapshot(&after);
+		n_mark_allocations += after.n_allocations - before.n_allocations;
+
+		timestamp += 3 * dot;
+		char character = 0;
+		footprint_snapshot(&before);
+		cw_rec_poll_character_usecs(rec, timestamp, &character, NULL, NULL);
+		footprint_snapshot(&after);
+		n_poll_allocations += after.n_allocations - before.n_allocations;
+
+		cw_rec_reset_state(rec);
+		timestamp += 4 * dot;
+	}
+	footprint_print("allocations_rec_mark", "allocations/op", (double) n_mark_allocations / FOOTPRINT_N_OPERATIONS);
+	footprint_print("allocations_rec_poll_character", "allocations/op", (double) n_poll_allocations / FOOTPRINT_N_OPERATIONS);
+
+	cw_gen_delete(&gen);
+	cw_rec_delete(&rec);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Report growth of resident set size with given count of instances of every type
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int footprint_instances(int n_instances)
+{
+	fprintf(stdout, "# resident set size with %d instances\n", n_instances);
+
+	void ** objects = calloc((size_t) n_instances, sizeof (void *));
+	if (NULL == objects) {
+		return 1;
+	}
+
+	const char * names[] = { "gen", "rec", "key" };
+	int n_errors = 0;
+	for (int type = 0; type < 3; type++) {
+		const int64_t before = footprint_rss_bytes();
+		int n = 0;
+		for (; n < n_instances; n++) {
+			switch (type) {
+			case 0:
+				objects[n] = footprint_gen_new();
+				break;
+			case 1:
+				objects[n] = cw_rec_new();
+				break;
+			default:
+				objects[n] = cw_key_new();
+				break;
+			}
+			if (NULL == objects[n]) {
+				n_errors++;
+				break;
+			}
+		}
+		const int64_t after = footprint_rss_bytes();
+
+		if (n == n_instances && before >= 0 && after >= 0) {
+			char name[64] = { 0 };
+			snprintf(name, sizeof (name), "rss_%s_x%d", names[type], n_instances);
+			footprint_print(name, "bytes/instance", (double) (after - before) / n_instances);
+		}
+
+		for (int i = 0; i < n; i++) {
+			switch (type) {
+			case 0:
+				cw_gen_delete((cw_gen_t **) &objects[i]);
+				break;
+			case 1:
+				cw_rec_delete((cw_rec_t **) &objects[i]);
+				break;
+			default:
+				cw_key_delete((cw_key_t **) &objects[i]);
+				break;
+			}
+		}
+	}
+
+	free(objects);
+
+	return 0 == n_errors ? 0 : 1;
+}
@@ -0,0 +1,722 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_latency.c
+
+   End-to-end latency of keying with straight key.
+
+   The program operates a straight key according to a schedule of
+   Marks and Spaces of given text. The key is connected to a generator
+   (sidetone) and to a receiver (direct receiving). For each Mark the
+   program measures time from closing the key to:
+
+   - dequeueing of the Mark by generator ("dequeue"),
+   - handing first non-silent samples of the Mark to sound system
+     ("audio"),
+
+   and for each character it measures time from:
+
+   - closing the key for first Mark of the character to receiving the
+     character from receiver's callback ("decode"),
+   - opening the key after last Mark of the character to receiving the
+     character ("eoc"). This is the delay of recognizing
+     inter-character-space.
+
+   Measurements are repeated for each combination of speed and (for
+   ALSA) period size. Distributions of latencies are printed to stdout
+   as tab-separated values, one metric per line:
+
+   <sound system> <period size> <speed> <metric> <count> <min> <median> <p90> <max>
+
+   Times are in microseconds. Lines starting with '#' are comments.
+
+   Each measurement is followed by CPU usage of threads taking part in
+   it: generator's thread ("gen") and the thread operating the key
+   ("key"), and by CPU usage and context switches of whole process:
+
+   <sound system> <period size> <speed> cpu <thread> <CPU time [us]> <max CPU usage [%]> <voluntary switches> <involuntary switches>
+
+   Counts of context switches are given only for the process.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ctype.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_rec.h"
+
+#include "test_framework/basic_utils/resource_meas.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Upper limit of count of Marks (and of characters) keyed in single run. */
+#define LATENCY_MAX_EVENTS 4096
+
+/* Count of consecutive zero samples that are treated as silence
+   preceding beginning of a Mark, in milliseconds. Single zero samples
+   occur in sine wave of a Mark too. */
+#define LATENCY_SILENCE_MS 1
+
+#define LATENCY_TEXT_DEFAULT "paris paris"
+#define LATENCY_SPEEDS_DEFAULT "12,24,36"
+#define LATENCY_PERIODS_DEFAULT "0"
+#define LATENCY_MAX_SETTINGS 16
+
+/* Interval of measurements of CPU usage. */
+#define LATENCY_MEAS_INTERVAL_MSECS 100
+
+
+
+
+/* Timestamps collected during one run. Timestamps of key are written
+   by main thread, the other ones by threads of generator and of
+   receiver. */
+typedef struct {
+	uint64_t key_down_ns[LATENCY_MAX_EVENTS];
+	int n_key_downs;
+
+	uint64_t dequeue_ns[LATENCY_MAX_EVENTS];
+	int n_dequeues;
+
+	uint64_t audio_ns[LATENCY_MAX_EVENTS];
+	int n_audios;
+
+	uint64_t char_first_down_ns[LATENCY_MAX_EVENTS];
+	uint64_t char_last_up_ns[LATENCY_MAX_EVENTS];
+	int n_keyed_chars;
+
+	uint64_t decoded_ns[LATENCY_MAX_EVENTS];
+	int n_decoded_chars;
+
+	/* Original functions of sound system, called by hooks. */
+	cw_ret_t (* write_buffer_to_sound_device)(cw_gen_t * gen);
+	cw_ret_t (* write_tone_to_sound_device)(cw_gen_t * gen, const cw_tone_t * tone);
+
+	/* State of detector of beginning of a Mark in samples or in
+	   tones sent to sound system. */
+	int n_silent_samples;
+	int n_silent_samples_threshold;
+	bool previous_tone_is_silent;
+} latency_run_t;
+
+
+typedef struct {
+	cw_sound_system_t sound_system;
+	const char * device;
+	const char * text;
+	bool sidetone_low_latency;
+	int speeds[LATENCY_MAX_SETTINGS];
+	int n_speeds;
+	long unsigned int periods[LATENCY_MAX_SETTINGS];
+	int n_periods;
+} latency_config_t;
+
+
+
+
+/* Hooks installed in generator don't get any user pointer, so state of
+   current run is global. */
+static latency_run_t g_run;
+
+
+
+
+static uint64_t latency_now_ns(void);
+static void latency_sleep_until_ns(uint64_t deadline);
+static int latency_parse_list(const char * string, long * values, int capacity);
+static int latency_run(const latency_config_t * config, int speed, long unsigned int period);
+static int latency_key_text(volatile cw_key_t * key, const char * text, int speed);
+static void latency_print_metric(const latency_config_t * config, int speed, long unsigned int period, const char * metric, const uint64_t * begins, int n_begins, const uint64_t * ends, int n_ends);
+static int latency_compare(const void * a, const void * b);
+static void latency_print_resources(const latency_config_t * config, int speed, long unsigned int period, resource_meas * meas);
+
+static cw_ret_t latency_write_buffer_hook(cw_gen_t * gen);
+static cw_ret_t latency_write_tone_hook(cw_gen_t * gen, const cw_tone_t * tone);
+static void latency_value_tracking_callback(void * arg, int value);
+static void latency_character_callback(void * arg, char character, bool is_end_of_word, bool is_error);
+static void latency_record(uint64_t * timestamps, int * count, uint64_t timestamp);
+
+
+
+
+static void print_help(const char * program)
+{
+	fprintf(stdout, "Usage: %s [-s <sound system>] [-d <device>] [-w <speeds>] [-p <periods>] [-t <text>] [-l]\n", program);
+	fprintf(stdout, "  -s <sound system>  n (null, default), c (console), o (OSS), a (ALSA), p (PulseAudio), j (JACK), w (PipeWire)\n");
+	fprintf(stdout, "  -d <device>        name of sound device\n");
+	fprintf(stdout, "  -w <speeds>        comma-separated list of speeds [wpm] (default %s)\n", LATENCY_SPEEDS_DEFAULT);
+	fprintf(stdout, "  -p <periods>       comma-separated list of ALSA period sizes, 0 for default (default %s)\n", LATENCY_PERIODS_DEFAULT);
+	fprintf(stdout, "  -t <text>          text to key (default \"%s\")\n", LATENCY_TEXT_DEFAULT);
+	fprintf(stdout, "  -l                 discard queued silence when key goes down (sidetone_low_latency)\n");
+}
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	latency_config_t config;
+	memset(&config, 0, sizeof (config));
+	config.sound_system = CW_AUDIO_NULL;
+	config.text = LATENCY_TEXT_DEFAULT;
+
+	const char * speeds = LATENCY_SPEEDS_DEFAULT;
+	const char * periods = LATENCY_PERIODS_DEFAULT;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:d:w:p:t:lh"))) {
+		switch (opt) {
+		case 's':
+			switch (optarg[0]) {
+			case 'n': config.sound_system = CW_AUDIO_NULL; break;
+			case 'c': config.sound_system = CW_AUDIO_CONSOLE; break;
+			case 'o': config.sound_system = CW_AUDIO_OSS; break;
+			case 'a': config.sound_system = CW_AUDIO_ALSA; break;
+			case 'p': config.sound_system = CW_AUDIO_PA; break;
+			case 'j': config.sound_system = CW_AUDIO_JACK; break;
+			case 'w': config.sound_system = CW_AUDIO_PIPEWIRE; break;
+			default:
+				fprintf(stderr, "Invalid sound system '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'd':
+			config.device = optarg;
+			break;
+		case 'w':
+			speeds = optarg;
+			break;
+		case 'p':
+			periods = optarg;
+			break;
+		case 't':
+			config.text = optarg;
+			break;
+		case 'l':
+			config.sidetone_low_latency = true;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	long values[LATENCY_MAX_SETTINGS];
+	config.n_speeds = latency_parse_list(speeds, values, LATENCY_MAX_SETTINGS);
+	for (int i = 0; i < config.n_speeds; i++) {
+		if (values[i] < CW_SPEED_MIN || values[i] > CW_SPEED_MAX) {
+			config.n_speeds = -1;
+			break;
+		}
+		config.speeds[i] = (int) values[i];
+	}
+	if (config.n_speeds <= 0) {
+		fprintf(stderr, "Invalid list of speeds '%s'\n", speeds);
+		return EXIT_FAILURE;
+	}
+
+	config.n_periods = latency_parse_list(periods, values, LATENCY_MAX_SETTINGS);
+	for (int i = 0; i < config.n_periods; i++) {
+		if (values[i] < 0) {
+			config.n_periods = -1;
+			break;
+		}
+		config.periods[i] = (long unsigned int) values[i];
+	}
+	if (config.n_periods <= 0) {
+		fprintf(stderr, "Invalid list of period sizes '%s'\n", periods);
+		return EXIT_FAILURE;
+	}
+	if (CW_AUDIO_ALSA != config.sound_system) {
+		/* Period size is a setting of ALSA only. */
+		config.n_periods = 1;
+		config.periods[0] = 0;
+	}
+
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	fprintf(stdout, "# sound system\tperiod\tspeed\tmetric\tcount\tmin\tmedian\tp90\tmax [us]\n");
+	fprintf(stdout, "# sound system\tperiod\tspeed\tcpu\tthread\tcpu time [us]\tmax cpu usage [%%]\tvoluntary switches\tinvoluntary switches\n");
+
+	int n_errors = 0;
+	for (int p = 0; p < config.n_periods; p++) {
+		for (int s = 0; s < config.n_speeds; s++) {
+			if (0 != latency_run(&config, config.speeds[s], config.periods[p])) {
+				fprintf(stderr, "Measurement at %d wpm, period %lu has failed\n", config.speeds[s], config.periods[p]);
+				n_errors++;
+			}
+		}
+	}
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock
+
+   @return current time, in nanoseconds
+*/
+static uint64_t latency_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Sleep until given point of monotonic clock
+
+   @param[in] deadline time to wake up at, in nanoseconds
+*/
+static void latency_sleep_until_ns(uint64_t deadline)
+{
+	struct timespec ts;
+	ts.tv_sec = (time_t) (deadline / 1000000000);
+	ts.tv_nsec = (long) (deadline % 1000000000);
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+		;
+	}
+}
+
+
+
+
+/**
+   @brief Parse comma-separated list of non-negative integers
+
+   @param[in] string string to parse
+   @param[out] values parsed values
+   @param[in] capacity size of @p values
+
+   @return count of parsed values
+   @return -1 if @p string is invalid or has too many values
+*/
+static int latency_parse_list(const char * string, long * values, int capacity)
+{
+	int n = 0;
+	const char * cursor = string;
+	while ('\0' != *cursor) {
+		if (n == capacity) {
+			return -1;
+		}
+		char * end = NULL;
+		errno = 0;
+		values[n] = strtol(cursor, &end, 10);
+		if (0 != errno || end == cursor || ('\0' != *end && ',' != *end)) {
+			return -1;
+		}
+		n++;
+		cursor = ',' == *end ? end + 1 : end;
+	}
+	return n;
+}
+
+
+
+
+/**
+   @brief Key text with given settings and print distributions of latencies
+
+   @param[in] config configuration of program
+   @param[in] speed speed of keying and of receiver [wpm]
+   @param[in] period ALSA period size, zero for default
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int latency_run(const latency_config_t * config, int speed, long unsigned int period)
+{
+	memset(&g_run, 0, sizeof (g_run));
+
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = config->sound_system;
+	if (NULL != config->device) {
+		snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", config->device);
+	}
+	gen_conf.alsa_period_size = period;
+	gen_conf.sidetone_low_latency = config->sidetone_low_latency;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		fprintf(stderr, "Failed to create generator for sound system %s\n", cw_get_audio_system_label(config->sound_system));
+		return -1;
+	}
+
+	/* Sound sink has been opened by cw_gen_new(), so functions of
+	   sound system are known and can be wrapped with hooks. */
+	g_run.n_silent_samples_threshold = (int) (gen->sample_rate / 1000 * LATENCY_SILENCE_MS);
+	g_run.n_silent_samples = g_run.n_silent_samples_threshold;
+	g_run.previous_tone_is_silent = true;
+	if (NULL != gen->write_buffer_to_sound_device) {
+		g_run.write_buffer_to_sound_device = gen->write_buffer_to_sound_device;
+		gen->write_buffer_to_sound_device = latency_write_buffer_hook;
+	}
+	if (NULL != gen->write_tone_to_sound_device) {
+		g_run.write_tone_to_sound_device = gen->write_tone_to_sound_device;
+		gen->write_tone_to_sound_device = latency_write_tone_hook;
+	}
+	cw_gen_register_value_tracking_callback_internal(gen, latency_value_tracking_callback, NULL);
+
+	cw_rec_t * rec = cw_rec_new();
+	cw_key_t * key = cw_key_new();
+	if (NULL == rec || NULL == key) {
+		fprintf(stderr, "Failed to create receiver or key\n");
+		cw_key_delete(&key);
+		cw_rec_delete(&rec);
+		cw_gen_delete(&gen);
+		return -1;
+	}
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_rec_register_character_callback(rec, latency_character_callback, NULL);
+
+	cw_key_register_generator(key, gen);
+	cw_key_register_receiver(key, rec);
+	cw_key_sk_enable_direct_receiving(key);
+
+	resource_meas meas;
+	bool is_meas_started = false;
+
+	int result = -1;
+	if (CW_SUCCESS == cw_gen_start(gen)) {
+		if (0 == resource_meas_start(&meas, LATENCY_MEAS_INTERVAL_MSECS)) {
+			is_meas_started = true;
+			resource_meas_add_thread(&meas, gen->thread.id, "gen");
+			resource_meas_add_thread(&meas, pthread_self(), "key");
+		}
+		result = latency_key_text(key, config->text, speed);
+		if (is_meas_started) {
+			resource_meas_stop(&meas);
+		}
+		cw_gen_stop(gen);
+	} else {
+		fprintf(stderr, "Failed to start generator\n");
+	}
+
+	cw_rec_register_character_callback(rec, NULL, NULL);
+	cw_key_delete(&key);
+	cw_rec_delete(&rec);
+	cw_gen_delete(&gen);
+
+	if (0 != result) {
+		return -1;
+	}
+
+	const int n_keyed_chars = __atomic_load_n(&g_run.n_keyed_chars, __ATOMIC_ACQUIRE);
+	latency_print_metric(config, speed, period, "dequeue",
+			     g_run.key_down_ns, g_run.n_key_downs,
+			     g_run.dequeue_ns, __atomic_load_n(&g_run.n_dequeues, __ATOMIC_ACQUIRE));
+	latency_print_metric(config, speed, period, "audio",
+			     g_run.key_down_ns, g_run.n_key_downs,
+			     g_run.audio_ns, __atomic_load_n(&g_run.n_audios, __ATOMIC_ACQUIRE));
+	latency_print_metric(config, speed, period, "decode",
+			     g_run.char_first_down_ns, n_keyed_chars,
+			     g_run.decoded_ns, __atomic_load_n(&g_run.n_decoded_chars, __ATOMIC_ACQUIRE));
+	latency_print_metric(config, speed, period, "eoc",
+			     g_run.char_last_up_ns, n_keyed_chars,
+			     g_run.decoded_ns, __atomic_load_n(&g_run.n_decoded_chars, __ATOMIC_ACQUIRE));
+	if (is_meas_started) {
+		latency_print_resources(config, speed, period, &meas);
+	}
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Operate straight key according to Marks and Spaces of text
+
+   Key is closed and opened at absolute points of monotonic clock, so
+   delays of the program don't accumulate.
+
+   @param[in] key straight key
+   @param[in] text text to key
+   @param[in] speed speed of keying [wpm]
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int latency_key_text(volatile cw_key_t * key, const char * text, int speed)
+{
+	const uint64_t dot_ns = (uint64_t) CW_DOT_CALIBRATION / (uint64_t) speed * 1000;
+
+	/* Give generator and sound system time to settle. */
+	uint64_t t = latency_now_ns() + 200 * 1000000;
+
+	for (const char * c = text; '\0' != *c; c++) {
+		if (' ' == *c) {
+			/* Inter-character-space of 3 dots has been
+			   already added after previous character. */
+			t += 4 * dot_ns;
+			continue;
+		}
+		const char * representation = cw_character_to_representation_internal(toupper((unsigned char) *c));
+		if (NULL == representation) {
+			fprintf(stderr, "Character '%c' can't be keyed\n", *c);
+			return -1;
+		}
+
+		for (const char * mark = representation; '\0' != *mark; mark++) {
+			if (g_run.n_key_downs == LATENCY_MAX_EVENTS || g_run.n_keyed_chars == LATENCY_MAX_EVENTS) {
+				fprintf(stderr, "Text is too long\n");
+				return -1;
+			}
+
+			latency_sleep_until_ns(t);
+			const uint64_t down = latency_now_ns();
+			g_run.key_down_ns[g_run.n_key_downs++] = down;
+			if (mark == representation) {
+				g_run.char_first_down_ns[g_run.n_keyed_chars] = down;
+			}
+			cw_key_sk_set_value(key, CW_KEY_VALUE_CLOSED);
+			t += (CW_DASH_REPRESENTATION == *mark ? 3 : 1) * dot_ns;
+
+			latency_sleep_until_ns(t);
+			g_run.char_last_up_ns[g_run.n_keyed_chars] = latency_now_ns();
+			cw_key_sk_set_value(key, CW_KEY_VALUE_OPEN);
+			t += dot_ns;
+		}
+		/* Receiver's thread may already read timestamps of this
+		   character. */
+		__atomic_store_n(&g_run.n_keyed_chars, g_run.n_keyed_chars + 1, __ATOMIC_RELEASE);
+		t += 2 * dot_ns;
+	}
+
+	/* Wait for recognition of last character and for end of
+	   sidetone. */
+	latency_sleep_until_ns(t + 10 * dot_ns + 300 * 1000000);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Print distribution of latencies between pairs of timestamps
+
+   i-th latency is a difference between i-th timestamp in @p ends and
+   i-th timestamp in @p begins.
+
+   @param[in] config configuration of program
+   @param[in] speed speed of keying [wpm]
+   @param[in] period ALSA period size
+   @param[in] metric name of metric
+   @param[in] begins timestamps of beginnings of intervals
+   @param[in] n_begins count of items in @p begins
+   @param[in] ends timestamps of ends of intervals
+   @param[in] n_ends count of items in @p ends
+*/
+static void latency_print_metric(const latency_config_t * config, int speed, long unsigned int period, const char * metric, const uint64_t * begins, int n_begins, const uint64_t * ends, int n_ends)
+{
+	if (n_begins != n_ends) {
+		fprintf(stderr, "Metric %s at %d wpm: %d events for %d keyings, distribution may be skewed\n",
+			metric, speed, n_ends, n_begins);
+	}
+	const int n = n_begins < n_ends ? n_begins : n_ends;
+
+	static int64_t latencies[LATENCY_MAX_EVENTS];
+	for (int i = 0; i < n; i++) {
+		latencies[i] = ((int64_t) ends[i] - (int64_t) begins[i]) / 1000;
+	}
+	qsort(latencies, (size_t) n, sizeof (latencies[0]), latency_compare);
+
+	fprintf(stdout, "%s\t%lu\t%d\t%s\t%d", cw_get_audio_system_label(config->sound_system), period, speed, metric, n);
+	if (0 == n) {
+		fprintf(stdout, "\t-\t-\t-\t-\n");
+	} else {
+		fprintf(stdout, "\t%lld\t%lld\t%lld\t%lld\n",
+			(long long) latencies[0],
+			(long long) latencies[n / 2],
+			(long long) latencies[(n * 9) / 10],
+			(long long) latencies[n - 1]);
+	}
+}
+
+
+
+
+/**
+   @brief Print CPU usage of threads and of process, and context switches of process
+
+   @param[in] config configuration of program
+   @param[in] speed speed of keying [wpm]
+   @param[in] period ALSA period size
+   @param[in] meas stopped measurement of resources
+*/
+static void latency_print_resources(const latency_config_t * config, int speed, long unsigned int period, resource_meas * meas)
+{
+	const char * label = cw_get_audio_system_label(config->sound_system);
+
+	resource_meas_thread thread;
+	for (int i = 0; 0 == resource_meas_get_thread(meas, i, &thread); i++) {
+		fprintf(stdout, "%s\t%lu\t%d\tcpu\t%s\t%ld\t%.1f\t-\t-\n",
+			label, period, speed, thread.name,
+			resource_meas_get_thread_cpu_time(&thread), (double) thread.maximal_cpu_usage);
+	}
+
+	long n_voluntary = 0;
+	long n_involuntary = 0;
+	resource_meas_get_context_switches(meas, &n_voluntary, &n_involuntary);
+	const long cpu_time = (meas->rusage_curr.ru_utime.tv_sec - meas->rusage_start.ru_utime.tv_sec
+			       + meas->rusage_curr.ru_stime.tv_sec - meas->rusage_start.ru_stime.tv_sec) * 1000000L
+		+ (meas->rusage_curr.ru_utime.tv_usec - meas->rusage_start.ru_utime.tv_usec)
+		+ (meas->rusage_curr.ru_stime.tv_usec - meas->rusage_start.ru_stime.tv_usec);
+	fprintf(stdout, "%s\t%lu\t%d\tcpu\tprocess\t%ld\t%.1f\t%ld\t%ld\n",
+		label, period, speed, cpu_time,
+		(double) resource_meas_get_maximal_cpu_usage(meas), n_voluntary, n_involuntary);
+}
+
+
+
+
+static int latency_compare(const void * a, const void * b)
+{
+	const int64_t x = *(const int64_t *) a;
+	const int64_t y = *(const int64_t *) b;
+	return (x > y) - (x < y);
+}
+
+
+
+
+/**
+   @brief Hook around function writing buffer of samples to sound device
+
+   Beginning of a Mark is a non-zero sample that follows a run of
+   silent samples. Timestamp of a buffer with beginning of a Mark is
+   taken before the buffer is handed to sound system.
+*/
+static cw_ret_t latency_write_buffer_hook(cw_gen_t * gen)
+{
+	bool has_mark_begin = false;
+	for (int i = 0; i < gen->buffer_n_samples; i++) {
+		if (0 == gen->buffer[i]) {
+			g_run.n_silent_samples++;
+		} else {
+			if (g_run.n_silent_samples >= g_run.n_silent_samples_threshold) {
+				has_mark_begin = true;
+			}
+			g_run.n_silent_samples = 0;
+		}
+	}
+	if (has_mark_begin) {
+		latency_record(g_run.audio_ns, &g_run.n_audios, latency_now_ns());
+	}
+
+	return g_run.write_buffer_to_sound_device(gen);
+}
+
+
+
+
+/**
+   @brief Hook around function "writing" tones of Null and Console sound systems
+*/
+static cw_ret_t latency_write_tone_hook(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	const bool is_silent = 0 == tone->frequency;
+	if (!is_silent && g_run.previous_tone_is_silent) {
+		latency_record(g_run.audio_ns, &g_run.n_audios, latency_now_ns());
+	}
+	g_run.previous_tone_is_silent = is_silent;
+
+	return g_run.write_tone_to_sound_device(gen, tone);
+}
+
+
+
+
+static void latency_value_tracking_callback(__attribute__((unused)) void * arg, int value)
+{
+	if (CW_KEY_VALUE_CLOSED == value) {
+		latency_record(g_run.dequeue_ns, &g_run.n_dequeues, latency_now_ns());
+	}
+}
+
+
+
+
+static void latency_character_callback(__attribute__((unused)) void * arg, __attribute__((unused)) char character, bool is_end_of_word, __attribute__((unused)) bool is_error)
+{
+	if (is_end_of_word) {
+		return;
+	}
+	latency_record(g_run.decoded_ns, &g_run.n_decoded_chars, latency_now_ns());
+}
+
+
+
+
+/**
+   @brief Append timestamp to array of timestamps
+
+   Timestamps that don't fit into the array are dropped.
+*/
+static void latency_record(uint64_t * timestamps, int * count, uint64_t timestamp)
+{
+	const int i = *count;
+	if (i < LATENCY_MAX_EVENTS) {
+		timestamps[i] = timestamp;
+		__atomic_store_n(count, i + 1, __ATOMIC_RELEASE);
+	}
+}
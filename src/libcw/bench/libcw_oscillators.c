@@ -0,0 +1,640 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_oscillators.c
+
+   Speed and quality of generator's oscillator engines (see
+   cw_gen_oscillator_t).
+
+   For every engine, sample rate and frequency the program calculates
+   plateau of a tone with cw_gen_calculate_sine_wave_internal() and
+   reports:
+
+   - time of calculating one sample;
+   - THD+N: power of everything that isn't the ideal sine wave (fitted
+     to the samples), relative to power of the sine wave;
+   - SFDR: level of strongest spurious component of spectrum, relative
+     to the tone;
+   - largest difference between phases of consecutive fragments of the
+     wave. The wave is calculated in fragments of random sizes, as
+     generator does it for subareas of its buffer, so discontinuity of
+     phase at boundary of fragments shows up here. Error of frequency
+     shows up here too, as small phase difference between every two
+     fragments.
+
+   Results are printed to stdout as tab-separated values, one
+   combination of engine, sample rate and frequency per line. Lines
+   starting with '#' are comments.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "libcw_tq.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Size of generator's buffer, and the largest fragment of wave. */
+#define OSC_BUFFER_N_SAMPLES 512
+
+/* Count of analyzed samples, power of two for FFT. */
+#define OSC_ANALYSIS_N_SAMPLES 16384
+
+/* Phase is estimated only for fragments with at least this count of
+   samples, shorter fragments give too noisy estimates. */
+#define OSC_PHASE_FRAGMENT_MIN_N_SAMPLES 64
+
+/* Bins of spectrum around the tone (and around DC) that belong to
+   main lobe of window, not to spurious components. */
+#define OSC_MAIN_LOBE_N_BINS 8
+
+/* Default time of measuring speed of a single combination. */
+#define OSC_DURATION_DEFAULT_MS 100
+
+#define OSC_PI 3.14159265358979323846
+
+
+
+
+typedef struct {
+	const char * name;
+	cw_gen_oscillator_t oscillator;
+} osc_engine_t;
+
+
+
+
+typedef struct {
+	double ns_per_sample;
+	double thd_n;          /* [dB] */
+	double sfdr;           /* [dBc] */
+	double phase_jump_max; /* [degrees] */
+} osc_result_t;
+
+
+
+
+static uint64_t osc_now_ns(void);
+static cw_gen_t * osc_gen_new(cw_gen_oscillator_t oscillator, unsigned int sample_rate, cw_sample_t * buffer, cw_sample_t ** original_buffer);
+static void osc_gen_delete(cw_gen_t ** gen, cw_sample_t * original_buffer);
+static int osc_calculate_fragment(cw_gen_t * gen, cw_tone_t * tone, int n_samples);
+static double osc_measure_speed(cw_gen_t * gen, int frequency, int duration_ms);
+static void osc_render_fragments(cw_gen_t * gen, int frequency, double * samples, int * fragments, int * n_fragments);
+static void osc_fit_sine(const double * samples, int n_samples, double omega, double * c, double * s, double * dc);
+static double osc_thd_n(const double * samples, double omega);
+static double osc_sfdr(const double * samples, double frequency, unsigned int sample_rate);
+static double osc_phase_jump_max(const double * samples, const int * fragments, int n_fragments, double omega);
+static void osc_fft(double * re, double * im, int n);
+static int osc_run(const osc_engine_t * engine, unsigned int sample_rate, int frequency, int duration_ms, osc_result_t * result);
+
+
+
+
+static const osc_engine_t g_engines[] = {
+	{ "sinf",        CW_GEN_OSCILLATOR_SINF },
+	{ "phasor",      CW_GEN_OSCILLATOR_PHASOR },
+	{ "table",       CW_GEN_OSCILLATOR_TABLE },
+	{ "fixed_point", CW_GEN_OSCILLATOR_FIXED_POINT },
+};
+
+static const unsigned int g_sample_rates[] = { 8000, 22050, 44100, 48000, 96000 };
+static const int g_frequencies[] = { 300, 800, 1234, 2500 };
+
+
+
+
+static void print_help(const char * program)
+{
+	fprintf(stdout, "Usage: %s [-d <duration>] [-e <name>]\n", program);
+	fprintf(stdout, "  -d <duration>  measure speed of each combination for <duration> milliseconds (default %d)\n", OSC_DURATION_DEFAULT_MS);
+	fprintf(stdout, "  -e <name>      test only engines with names starting with <name>\n");
+}
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	int duration_ms = OSC_DURATION_DEFAULT_MS;
+	const char * name_prefix = "";
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "d:e:h"))) {
+		switch (opt) {
+		case 'd':
+			duration_ms = atoi(optarg);
+			if (duration_ms <= 0) {
+				fprintf(stderr, "Invalid duration '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'e':
+			name_prefix = optarg;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	fprintf(stdout, "# engine\tsample rate\tfrequency\tns/sample\tTHD+N [dB]\tSFDR [dBc]\tphase jump [deg]\n");
+
+	int n_errors = 0;
+	for (size_t e = 0; e < sizeof (g_engines) / sizeof (g_engines[0]); e++) {
+		const osc_engine_t * engine = &g_engines[e];
+		if (0 != strncmp(engine->name, name_prefix, strlen(name_prefix))) {
+			continue;
+		}
+		for (size_t r = 0; r < sizeof (g_sample_rates) / sizeof (g_sample_rates[0]); r++) {
+			for (size_t f = 0; f < sizeof (g_frequencies) / sizeof (g_frequencies[0]); f++) {
+				osc_result_t result;
+				if (0 != osc_run(engine, g_sample_rates[r], g_frequencies[f], duration_ms, &result)) {
+					fprintf(stderr, "Engine %s has failed\n", engine->name);
+					n_errors++;
+					continue;
+				}
+				fprintf(stdout, "%s\t%u\t%d\t%.2f\t%.1f\t%.1f\t%.4f\n",
+					engine->name, g_sample_rates[r], g_frequencies[f],
+					result.ns_per_sample, result.thd_n, result.sfdr, result.phase_jump_max);
+				fflush(stdout);
+			}
+		}
+	}
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Measure speed and quality of one engine at given sample rate and frequency
+
+   @param[in] engine oscillator engine
+   @param[in] sample_rate sample rate of generator
+   @param[in] frequency frequency of tone
+   @param[in] duration_ms how long to measure speed, in milliseconds
+   @param[out] result results of measurements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int osc_run(const osc_engine_t * engine, unsigned int sample_rate, int frequency, int duration_ms, osc_result_t * result)
+{
+	cw_sample_t buffer[OSC_BUFFER_N_SAMPLES];
+	cw_sample_t * original_buffer = NULL;
+	double * samples = calloc(OSC_ANALYSIS_N_SAMPLES, sizeof (double));
+	int * fragments = calloc(OSC_ANALYSIS_N_SAMPLES, sizeof (int));
+	cw_gen_t * gen = osc_gen_new(engine->oscillator, sample_rate, buffer, &original_buffer);
+	if (NULL == samples || NULL == fragments || NULL == gen) {
+		free(samples);
+		free(fragments);
+		osc_gen_delete(&gen, original_buffer);
+		return -1;
+	}
+
+	result->ns_per_sample = osc_measure_speed(gen, frequency, duration_ms);
+
+	/* Quality is measured with fresh phase of generator. */
+	osc_gen_delete(&gen, original_buffer);
+	gen = osc_gen_new(engine->oscillator, sample_rate, buffer, &original_buffer);
+	if (NULL == gen) {
+		free(samples);
+		free(fragments);
+		return -1;
+	}
+
+	int n_fragments = 0;
+	osc_render_fragments(gen, frequency, samples, fragments, &n_fragments);
+
+	const double omega = 2.0 * OSC_PI * frequency / sample_rate;
+	result->thd_n = osc_thd_n(samples, omega);
+	result->sfdr = osc_sfdr(samples, frequency, sample_rate);
+	result->phase_jump_max = osc_phase_jump_max(samples, fragments, n_fragments, omega);
+
+	osc_gen_delete(&gen, original_buffer);
+	free(samples);
+	free(fragments);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock
+
+   @return current time, in nanoseconds
+*/
+static uint64_t osc_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Create generator with Null sound system, calculating samples into given buffer
+
+   @param[in] oscillator oscillator engine of generator
+   @param[in] sample_rate sample rate of generator
+   @param[in] buffer buffer of OSC_BUFFER_N_SAMPLES samples
+   @param[out] original_buffer generator's own buffer, to be restored by osc_gen_delete()
+
+   @return generator on success
+   @return NULL on failure
+*/
+static cw_gen_t * osc_gen_new(cw_gen_oscillator_t oscillator, unsigned int sample_rate, cw_sample_t * buffer, cw_sample_t ** original_buffer)
+{
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.oscillator = oscillator;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		return NULL;
+	}
+
+	/* Null sound system doesn't use sample rate nor buffer, so they
+	   can be replaced. */
+	gen->sample_rate = sample_rate;
+	*original_buffer = gen->buffer;
+	gen->buffer = buffer;
+	gen->buffer_n_samples = OSC_BUFFER_N_SAMPLES;
+
+	return gen;
+}
+
+
+
+
+static void osc_gen_delete(cw_gen_t ** gen, cw_sample_t * original_buffer)
+{
+	if (NULL == *gen) {
+		return;
+	}
+	(*gen)->buffer = original_buffer;
+	cw_gen_delete(gen);
+}
+
+
+
+
+/**
+   @brief Calculate fragment of plateau of tone at the beginning of generator's buffer
+
+   @return count of calculated samples
+*/
+static int osc_calculate_fragment(cw_gen_t * gen, cw_tone_t * tone, int n_samples)
+{
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = n_samples - 1;
+	return cw_gen_calculate_sine_wave_internal(gen, tone);
+}
+
+
+
+
+/**
+   @brief Measure time of calculating a sample of tone, in full buffers
+
+   @return time of calculating one sample, in nanoseconds
+*/
+static double osc_measure_speed(cw_gen_t * gen, int frequency, int duration_ms)
+{
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, frequency, 0, CW_SLOPE_MODE_NO_SLOPES);
+	tone.n_samples = INT32_MAX;
+
+	/* Warm up caches. */
+	osc_calculate_fragment(gen, &tone, OSC_BUFFER_N_SAMPLES);
+
+	const uint64_t duration_ns = (uint64_t) duration_ms * 1000000;
+	int64_t count = 0;
+	const uint64_t begin = osc_now_ns();
+	uint64_t elapsed = 0;
+	do {
+		for (int i = 0; i < 100; i++) {
+			count += osc_calculate_fragment(gen, &tone, OSC_BUFFER_N_SAMPLES);
+		}
+		if (tone.sample_iterator > INT32_MAX / 2) {
+			tone.sample_iterator = 0;
+		}
+		elapsed = osc_now_ns() - begin;
+	} while (elapsed < duration_ns);
+
+	return (double) elapsed / (double) count;
+}
+
+
+
+
+/**
+   @brief Calculate samples of tone in fragments of pseudo-random sizes
+
+   @param[in] gen generator
+   @param[in] frequency frequency of tone
+   @param[out] samples OSC_ANALYSIS_N_SAMPLES calculated samples
+   @param[out] fragments sizes of consecutive fragments
+   @param[out] n_fragments count of fragments
+*/
+static void osc_render_fragments(cw_gen_t * gen, int frequency, double * samples, int * fragments, int * n_fragments)
+{
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, frequency, 0, CW_SLOPE_MODE_NO_SLOPES);
+	tone.n_samples = INT32_MAX;
+
+	/* Fixed seed: every engine gets the same fragments. */
+	uint32_t random = 12345;
+	int n = 0;
+	*n_fragments = 0;
+	while (n < OSC_ANALYSIS_N_SAMPLES) {
+		random = random * 1103515245 + 12345;
+		int size = 1 + (int) ((random >> 16) % OSC_BUFFER_N_SAMPLES);
+		if (size > OSC_ANALYSIS_N_SAMPLES - n) {
+			size = OSC_ANALYSIS_N_SAMPLES - n;
+		}
+		osc_calculate_fragment(gen, &tone, size);
+		for (int i = 0; i < size; i++) {
+			samples[n + i] = gen->buffer[i];
+		}
+		fragments[(*n_fragments)++] = size;
+		n += size;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Fit c*cos(omega*n) + s*sin(omega*n) + dc to samples with least squares
+*/
+static void osc_fit_sine(const double * samples, int n_samples, double omega, double * c, double * s, double * dc)
+{
+	/* Normal equations of three regressors. */
+	double m[3][4] = { { 0 } };
+	for (int n = 0; n < n_samples; n++) {
+		const double x[3] = { cos(omega * n), sin(omega * n), 1.0 };
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				m[i][j] += x[i] * x[j];
+			}
+			m[i][3] += x[i] * samples[n];
+		}
+	}
+
+	/* Gaussian elimination, the matrix is positive definite. */
+	for (int k = 0; k < 3; k++) {
+		for (int i = k + 1; i < 3; i++) {
+			const double factor = m[i][k] / m[k][k];
+			for (int j = k; j < 4; j++) {
+				m[i][j] -= factor * m[k][j];
+			}
+		}
+	}
+	double solution[3] = { 0 };
+	for (int i = 2; i >= 0; i--) {
+		double sum = m[i][3];
+		for (int j = i + 1; j < 3; j++) {
+			sum -= m[i][j] * solution[j];
+		}
+		solution[i] = sum / m[i][i];
+	}
+
+	*c = solution[0];
+	*s = solution[1];
+	*dc = solution[2];
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate THD+N of samples of sine wave with given frequency
+
+   @return power of residual after subtracting fitted sine wave, relative to power of the sine wave [dB]
+*/
+static double osc_thd_n(const double * samples, double omega)
+{
+	double c = 0.0;
+	double s = 0.0;
+	double dc = 0.0;
+	osc_fit_sine(samples, OSC_ANALYSIS_N_SAMPLES, omega, &c, &s, &dc);
+
+	double residual_power = 0.0;
+	for (int n = 0; n < OSC_ANALYSIS_N_SAMPLES; n++) {
+		const double residual = samples[n] - (c * cos(omega * n) + s * sin(omega * n) + dc);
+		residual_power += residual * residual;
+	}
+	residual_power /= OSC_ANALYSIS_N_SAMPLES;
+	const double tone_power = (c * c + s * s) / 2.0;
+
+	return 10.0 * log10(residual_power / tone_power);
+}
+
+
+
+
+/**
+   @brief Calculate spurious-free dynamic range of samples of sine wave
+
+   Spectrum is calculated with 4-term Blackman-Harris window, which
+   has side lobes below -92 dB.
+
+   @return level of strongest component outside of main lobes of the tone and of DC, relative to the tone [dBc]
+*/
+static double osc_sfdr(const double * samples, double frequency, unsigned int sample_rate)
+{
+	const int n_samples = OSC_ANALYSIS_N_SAMPLES;
+	double * re = calloc((size_t) n_samples, sizeof (double));
+	double * im = calloc((size_t) n_samples, sizeof (double));
+	if (NULL == re || NULL == im) {
+		free(re);
+		free(im);
+		return NAN;
+	}
+
+	for (int n = 0; n < n_samples; n++) {
+		const double x = 2.0 * OSC_PI * n / (n_samples - 1);
+		const double window = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+		re[n] = samples[n] * window;
+	}
+	osc_fft(re, im, n_samples);
+
+	const int tone_bin = (int) lround(frequency * n_samples / sample_rate);
+	double tone_power = 0.0;
+	double spur_power = 0.0;
+	for (int k = 0; k <= n_samples / 2; k++) {
+		const double power = re[k] * re[k] + im[k] * im[k];
+		if (abs(k - tone_bin) <= OSC_MAIN_LOBE_N_BINS) {
+			if (power > tone_power) {
+				tone_power = power;
+			}
+		} else if (k > OSC_MAIN_LOBE_N_BINS) {
+			if (power > spur_power) {
+				spur_power = power;
+			}
+		}
+	}
+
+	free(re);
+	free(im);
+
+	return 10.0 * log10(spur_power / tone_power);
+}
+
+
+
+
+/**
+   @brief Find largest difference between phases of consecutive fragments of sine wave
+
+   Phase of every fragment is estimated by correlating samples of the
+   fragment with sine wave of ideal frequency, on timeline common to
+   all fragments. For continuous wave of exact frequency the phases
+   are equal.
+
+   @return largest difference of phases [degrees]
+*/
+static double osc_phase_jump_max(const double * samples, const int * fragments, int n_fragments, double omega)
+{
+	double jump_max = 0.0;
+	bool has_previous = false;
+	double previous = 0.0;
+
+	int start = 0;
+	for (int f = 0; f < n_fragments; f++) {
+		const int size = fragments[f];
+		if (size < OSC_PHASE_FRAGMENT_MIN_N_SAMPLES) {
+			/* Fragment is skipped, and so is its boundary. */
+			has_previous = false;
+			start += size;
+			continue;
+		}
+
+		double c = 0.0;
+		double s = 0.0;
+		double dc = 0.0;
+		/* Timeline of fitted wave starts at the fragment, so the
+		   phase is corrected by phase of the fragment's start. */
+		osc_fit_sine(samples + start, size, omega, &c, &s, &dc);
+		const double phase = atan2(c, s) - fmod(omega * start, 2.0 * OSC_PI);
+
+		if (has_previous) {
+			double jump = fabs(remainder(phase - previous, 2.0 * OSC_PI));
+			jump = jump * 180.0 / OSC_PI;
+			if (jump > jump_max) {
+				jump_max = jump;
+			}
+		}
+		previous = phase;
+		has_previous = true;
+		start += size;
+	}
+
+	return jump_max;
+}
+
+
+
+
+/**
+   @brief In-place radix-2 FFT
+
+   @param[in,out] re real parts
+   @param[in,out] im imaginary parts
+   @param[in] n count of points, power of two
+*/
+static void osc_fft(double * re, double * im, int n)
+{
+	for (int i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			double tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+			tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+		}
+	}
+
+	for (int len = 2; len <= n; len <<= 1) {
+		const double angle = -2.0 * OSC_PI / len;
+		for (int i = 0; i < n; i += len) {
+			for (int k = 0; k < len / 2; k++) {
+				const double w_re = cos(angle * k);
+				const double w_im = sin(angle * k);
+				const int a = i + k;
+				const int b = i + k + len / 2;
+				const double t_re = re[b] * w_re - im[b] * w_im;
+				const double t_im = re[b] * w_im + im[b] * w_re;
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+			}
+		}
+	}
+
+	return;
+}
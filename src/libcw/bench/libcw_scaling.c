@@ -0,0 +1,856 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file libcw_scaling.c
+
+   Scaling of libcw across CPU cores: many generators and receivers
+   working at the same time.
+
+   The program runs these scenarios, each with a sweep of count of
+   instances or of count of threads:
+   - "gen_render": N generators with Null sound system, each in its own
+     thread that enqueues text and renders its samples with
+     cw_gen_render();
+   - "gen_producer_consumer": N generators, each with a producer thread
+     enqueueing text and a consumer thread rendering samples, so that
+     producer waits for space in tone queue;
+   - "gen_render_string": one long text rendered with
+     cw_gen_render_string() by a given count of worker threads;
+   - "rec_edges": M receivers, each in its own thread, decoding edges
+     with cw_rec_receive_edges();
+   - "rec_pool": M channels decoded by cw_rec_pool_t with a given count
+     of worker threads.
+
+   For every run the program reports aggregate rate (samples/s for
+   generators, edges/s for receivers), rate of characters, count of
+   voluntary and involuntary context switches of the process, and
+   contention of mutex of tone queues that is used by waiting functions
+   (count of contended locks and total time of waiting for the mutex).
+
+   Results are printed to stdout as tab-separated values, one run per
+   line:
+
+   <name> <instances> <threads> <unit> <rate> <chars/s> <voluntary cs> <involuntary cs> <contended locks> <contended time [us]> <time [s]>
+
+   Lines starting with '#' are comments. The format is meant to be
+   consumed by scripts tracking scalability regressions.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_rec.h"
+#include "libcw_tq.h"
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Default count of characters sent or received by one instance. */
+#define SCALING_N_CHARACTERS_DEFAULT 20000
+
+/* Largest count of instances (generators, receivers) in one run. */
+#define SCALING_N_INSTANCES_MAX 64
+
+/* Speed of generators and receivers. Higher speed means fewer samples
+   per character, so that runs are short. */
+#define SCALING_SPEED 60
+
+/* Count of samples rendered by one call to cw_gen_render(). */
+#define SCALING_RENDER_N_SAMPLES 512
+
+/* Count of edges passed to receiver in one call. */
+#define SCALING_EDGES_CHUNK 256
+
+/* Text sent by generators and received by receivers. */
+static const char * g_scaling_text = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG 0123456789 ";
+
+
+
+
+/* Result of one run of a scenario. */
+typedef struct {
+	uint64_t n_items;      /* Count of samples or edges. */
+	uint64_t n_characters;
+	uint64_t n_contended;  /* Contended locks of mutexes of tone queues. */
+	uint64_t contended_ns; /* Time of waiting for contended mutexes. */
+} scaling_result_t;
+
+
+
+
+/* State of one generator in generator's scenarios. */
+typedef struct {
+	cw_gen_t * gen;
+	int n_characters;        /* Count of characters to enqueue. */
+	bool producer_done;      /* Accessed with atomic operations. */
+	uint64_t n_samples;      /* Samples rendered while queue wasn't empty. */
+	uint64_t n_enqueued;     /* Characters enqueued (without spaces). */
+	bool failed;
+} scaling_gen_t;
+
+
+
+
+/* State of one receiver in receiver's scenario. */
+typedef struct {
+	cw_rec_t * rec;
+	const cw_rec_edge_t * edges;
+	size_t n_edges;
+	uint64_t n_characters;
+	bool failed;
+} scaling_rec_t;
+
+
+
+
+static void print_help(const char * program);
+static uint64_t scaling_now_ns(void);
+static void scaling_print(const char * name, int n_instances, int n_threads, const char * unit, const scaling_result_t * result, const struct rusage * before, uint64_t elapsed_ns);
+
+static cw_gen_t * scaling_gen_new(void);
+static bool scaling_gen_enqueue_word(scaling_gen_t * state, const char * word);
+static void * scaling_gen_render_thread(void * arg);
+static void * scaling_gen_producer_thread(void * arg);
+static void * scaling_gen_consumer_thread(void * arg);
+static int scaling_run_gen(const char * name, int n_generators, int n_characters, bool producer_consumer);
+static int scaling_run_gen_render_string(int n_workers, int n_characters);
+
+static cw_rec_edge_t * scaling_build_edges(int n_characters, size_t * n_edges, uint64_t * n_expected);
+static void * scaling_rec_thread(void * arg);
+static int scaling_run_rec(const cw_rec_edge_t * edges, size_t n_edges, uint64_t n_expected, int n_receivers);
+static int scaling_run_rec_pool(const cw_rec_edge_t * edges, size_t n_edges, uint64_t n_expected, int n_channels, int n_workers);
+
+
+
+
+static void print_help(const char * program)
+{
+	fprintf(stderr, "Usage: %s [-c <characters>] [-n <instances>] [-h]\n", program);
+	fprintf(stderr, "    -c <characters>: count of characters sent or received by one instance (default %d)\n", SCALING_N_CHARACTERS_DEFAULT);
+	fprintf(stderr, "    -n <instances>: largest count of instances or threads in sweeps (default: 4 * count of CPUs, at least 8)\n");
+	fprintf(stderr, "    -h: print this help\n");
+}
+
+
+
+
+int main(int argc, char * const argv[])
+{
+	int n_characters = SCALING_N_CHARACTERS_DEFAULT;
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1) {
+		n_cpus = 1;
+	}
+	int n_max = n_cpus * 4 < 8 ? 8 : (int) n_cpus * 4;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "c:n:h"))) {
+		switch (opt) {
+		case 'c':
+			n_characters = atoi(optarg);
+			if (n_characters <= 0) {
+				fprintf(stderr, "Invalid count of characters '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n':
+			n_max = atoi(optarg);
+			if (n_max <= 0 || n_max > SCALING_N_INSTANCES_MAX) {
+				fprintf(stderr, "Invalid count of instances '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (n_max > SCALING_N_INSTANCES_MAX) {
+		n_max = SCALING_N_INSTANCES_MAX;
+	}
+
+	/* Debug messages would only disturb measurements. */
+	cw_debug_set_flags(&cw_debug_object, 0);
+
+	fprintf(stdout, "# CPUs: %ld, characters per instance: %d\n", n_cpus, n_characters);
+	fprintf(stdout, "# name\tinstances\tthreads\tunit\trate\tchars/s\tvoluntary cs\tinvoluntary cs\tcontended locks\tcontended time [us]\ttime [s]\n");
+
+	int n_errors = 0;
+	for (int n = 1; n <= n_max; n *= 2) {
+		n_errors += scaling_run_gen("gen_render", n, n_characters, false);
+	}
+	for (int n = 1; n <= n_max; n *= 2) {
+		n_errors += scaling_run_gen("gen_producer_consumer", n, n_characters, true);
+	}
+	for (int n = 1; n <= n_max; n *= 2) {
+		n_errors += scaling_run_gen_render_string(n, n_characters);
+	}
+
+	size_t n_edges = 0;
+	uint64_t n_expected = 0;
+	cw_rec_edge_t * edges = scaling_build_edges(n_characters, &n_edges, &n_expected);
+	if (NULL == edges) {
+		fprintf(stderr, "Failed to build edges of receivers\n");
+		return EXIT_FAILURE;
+	}
+	for (int n = 1; n <= n_max; n *= 2) {
+		n_errors += scaling_run_rec(edges, n_edges, n_expected, n);
+	}
+	for (int n = 1; n <= n_max; n *= 2) {
+		n_errors += scaling_run_rec_pool(edges, n_edges, n_expected, n_max * 4, n);
+	}
+	free(edges);
+
+	return 0 == n_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock
+
+   @return current time, in nanoseconds
+*/
+static uint64_t scaling_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Print result of one run
+
+   @param[in] name name of scenario
+   @param[in] n_instances count of generators, receivers or channels
+   @param[in] n_threads count of threads doing the work
+   @param[in] unit unit of rate of items
+   @param[in] result result of the run
+   @param[in] before resource usage of process before the run
+   @param[in] elapsed_ns duration of the run
+*/
+static void scaling_print(const char * name, int n_instances, int n_threads, const char * unit, const scaling_result_t * result, const struct rusage * before, uint64_t elapsed_ns)
+{
+	struct rusage after;
+	getrusage(RUSAGE_SELF, &after);
+
+	const double seconds = (double) elapsed_ns / 1e9;
+	fprintf(stdout, "%s\t%d\t%d\t%s\t%.0f\t%.0f\t%ld\t%ld\t%llu\t%.0f\t%.3f\n",
+		name, n_instances, n_threads, unit,
+		(double) result->n_items / seconds,
+		(double) result->n_characters / seconds,
+		after.ru_nvcsw - before->ru_nvcsw,
+		after.ru_nivcsw - before->ru_nivcsw,
+		(unsigned long long) result->n_contended,
+		(double) result->contended_ns / 1000.0,
+		seconds);
+	fflush(stdout);
+}
+
+
+
+
+/**
+   @brief Create generator with Null sound system, for rendering of samples
+
+   @return generator on success
+   @return NULL on failure
+*/
+static cw_gen_t * scaling_gen_new(void)
+{
+	cw_gen_config_t gen_conf;
+	memset(&gen_conf, 0, sizeof (gen_conf));
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		return NULL;
+	}
+	cw_gen_set_speed(gen, SCALING_SPEED);
+
+	return gen;
+}
+
+
+
+
+/**
+   @brief Enqueue one word in generator, waiting for space in its queue
+
+   The wait needs another thread rendering samples of the generator.
+
+   @param[in] state state of generator
+   @param[in] word word to enqueue
+
+   @return true on success
+   @return false on failure
+*/
+static bool scaling_gen_enqueue_word(scaling_gen_t * state, const char * word)
+{
+	const size_t low_level = cw_tq_capacity_internal(state->gen->tq) / 2;
+	while (CW_SUCCESS != cw_gen_enqueue_string(state->gen, word)) {
+		if (EAGAIN != errno) {
+			return false;
+		}
+		cw_gen_wait_for_queue_level(state->gen, low_level);
+	}
+	for (const char * c = word; '\0' != *c; c++) {
+		state->n_enqueued += ' ' != *c;
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Thread enqueueing text in generator and rendering its samples
+
+   Each word is enqueued in empty queue and rendered completely before
+   next word is enqueued, so the thread never waits.
+
+   @param[in] arg scaling_gen_t state of generator
+*/
+static void * scaling_gen_render_thread(void * arg)
+{
+	scaling_gen_t * state = (scaling_gen_t *) arg;
+	cw_sample_t samples[SCALING_RENDER_N_SAMPLES];
+	char word[64];
+
+	const char * c = g_scaling_text;
+	while (state->n_enqueued < (uint64_t) state->n_characters) {
+		/* Next word of text, together with space after it. */
+		size_t len = 0;
+		do {
+			word[len++] = *c;
+			c++;
+			if ('\0' == *c) {
+				c = g_scaling_text;
+			}
+		} while (' ' != word[len - 1]);
+		word[len] = '\0';
+
+		if (!scaling_gen_enqueue_word(state, word)) {
+			state->failed = true;
+			return NULL;
+		}
+		while (0 != cw_tq_length_internal(state->gen->tq)) {
+			cw_gen_render(state->gen, samples, SCALING_RENDER_N_SAMPLES);
+			state->n_samples += SCALING_RENDER_N_SAMPLES;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Thread enqueueing text in generator
+
+   The thread waits for space in generator's queue when the queue is
+   full. Samples are rendered by scaling_gen_consumer_thread().
+
+   @param[in] arg scaling_gen_t state of generator
+*/
+static void * scaling_gen_producer_thread(void * arg)
+{
+	scaling_gen_t * state = (scaling_gen_t *) arg;
+	char word[64];
+
+	const char * c = g_scaling_text;
+	while (state->n_enqueued < (uint64_t) state->n_characters) {
+		size_t len = 0;
+		do {
+			word[len++] = *c;
+			c++;
+			if ('\0' == *c) {
+				c = g_scaling_text;
+			}
+		} while (' ' != word[len - 1]);
+		word[len] = '\0';
+
+		if (!scaling_gen_enqueue_word(state, word)) {
+			state->failed = true;
+			break;
+		}
+	}
+	__atomic_store_n(&state->producer_done, true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Thread rendering samples of generator until producer is done and queue is empty
+
+   @param[in] arg scaling_gen_t state of generator
+*/
+static void * scaling_gen_consumer_thread(void * arg)
+{
+	scaling_gen_t * state = (scaling_gen_t *) arg;
+	cw_sample_t samples[SCALING_RENDER_N_SAMPLES];
+
+	while (true) {
+		if (0 == cw_tq_length_internal(state->gen->tq)) {
+			if (__atomic_load_n(&state->producer_done, __ATOMIC_ACQUIRE)
+			    && 0 == cw_tq_length_internal(state->gen->tq)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		cw_gen_render(state->gen, samples, SCALING_RENDER_N_SAMPLES);
+		state->n_samples += SCALING_RENDER_N_SAMPLES;
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Run scenario with many generators rendering samples at the same time
+
+   @param[in] name name of scenario
+   @param[in] n_generators count of generators
+   @param[in] n_characters count of characters enqueued in every generator
+   @param[in] producer_consumer whether every generator has separate producer and consumer thread
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int scaling_run_gen(const char * name, int n_generators, int n_characters, bool producer_consumer)
+{
+	scaling_gen_t states[SCALING_N_INSTANCES_MAX];
+	pthread_t threads[2 * SCALING_N_INSTANCES_MAX];
+	memset(states, 0, sizeof (states));
+
+	int n_created = 0;
+	for (int i = 0; i < n_generators; i++) {
+		states[i].gen = scaling_gen_new();
+		if (NULL == states[i].gen) {
+			break;
+		}
+		states[i].n_characters = n_characters;
+		n_created++;
+	}
+	if (n_created != n_generators) {
+		for (int i = 0; i < n_created; i++) {
+			cw_gen_delete(&states[i].gen);
+		}
+		return 1;
+	}
+
+	struct rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	const uint64_t begin = scaling_now_ns();
+
+	int n_threads = 0;
+	for (int i = 0; i < n_generators; i++) {
+		if (producer_consumer) {
+			pthread_create(&threads[n_threads++], NULL, scaling_gen_producer_thread, &states[i]);
+			pthread_create(&threads[n_threads++], NULL, scaling_gen_consumer_thread, &states[i]);
+		} else {
+			pthread_create(&threads[n_threads++], NULL, scaling_gen_render_thread, &states[i]);
+		}
+	}
+	for (int i = 0; i < n_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	const uint64_t elapsed = scaling_now_ns() - begin;
+
+	scaling_result_t result;
+	memset(&result, 0, sizeof (result));
+	int retv = 0;
+	for (int i = 0; i < n_generators; i++) {
+		uint64_t n_contended = 0;
+		uint64_t contended_ns = 0;
+		cw_tq_get_wait_contention_internal(states[i].gen->tq, &n_contended, &contended_ns);
+		result.n_items += states[i].n_samples;
+		result.n_characters += states[i].n_enqueued;
+		result.n_contended += n_contended;
+		result.contended_ns += contended_ns;
+		if (states[i].failed) {
+			retv = 1;
+		}
+		cw_gen_delete(&states[i].gen);
+	}
+	if (0 != retv) {
+		fprintf(stderr, "Scenario %s with %d generators has failed\n", name, n_generators);
+		return retv;
+	}
+
+	scaling_print(name, n_generators, n_threads, "samples/s", &result, &before, elapsed);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Run scenario with one long text rendered by pool of threads
+
+   @param[in] n_workers count of threads rendering samples
+   @param[in] n_characters count of characters of text
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int scaling_run_gen_render_string(int n_workers, int n_characters)
+{
+	const size_t text_len = strlen(g_scaling_text);
+	char * text = malloc((size_t) n_characters * 2 + text_len + 1);
+	cw_gen_t * gen = scaling_gen_new();
+	if (NULL == text || NULL == gen) {
+		free(text);
+		cw_gen_delete(&gen);
+		return 1;
+	}
+
+	/* Repeat text until it has required count of characters (spaces
+	   are not counted). */
+	size_t len = 0;
+	uint64_t n_text_characters = 0;
+	while (n_text_characters < (uint64_t) n_characters) {
+		memcpy(text + len, g_scaling_text, text_len);
+		for (size_t i = 0; i < text_len; i++) {
+			n_text_characters += ' ' != g_scaling_text[i];
+		}
+		len += text_len;
+	}
+	text[len] = '\0';
+
+	struct rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	const uint64_t begin = scaling_now_ns();
+
+	cw_sample_t * samples = NULL;
+	size_t n_samples = 0;
+	const cw_ret_t cwret = cw_gen_render_string(gen, text, n_workers, &samples, &n_samples);
+
+	const uint64_t elapsed = scaling_now_ns() - begin;
+
+	free(samples);
+	free(text);
+	cw_gen_delete(&gen);
+	if (CW_SUCCESS != cwret) {
+		fprintf(stderr, "Scenario gen_render_string with %d workers has failed\n", n_workers);
+		return 1;
+	}
+
+	scaling_result_t result;
+	memset(&result, 0, sizeof (result));
+	result.n_items = n_samples;
+	result.n_characters = n_text_characters;
+	scaling_print("gen_render_string", 1, n_workers, "samples/s", &result, &before, elapsed);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Build Marks and Spaces of text, as keyed with ideal timing
+
+   @param[in] n_characters count of characters in edges (spaces are not counted)
+   @param[out] n_edges count of returned edges
+   @param[out] n_expected count of characters that receiver should decode from the edges
+
+   @return edges allocated by the function on success, to be freed by caller
+   @return NULL on failure
+*/
+static cw_rec_edge_t * scaling_build_edges(int n_characters, size_t * n_edges, uint64_t * n_expected)
+{
+	/* A character has at most 7 Marks and 7 Spaces. */
+	const size_t capacity = (size_t) n_characters * 14 + 1;
+	cw_rec_edge_t * edges = calloc(capacity, sizeof (cw_rec_edge_t));
+	if (NULL == edges) {
+		return NULL;
+	}
+
+	const double dot = CW_DOT_CALIBRATION / SCALING_SPEED;
+	size_t n = 0;
+	int count = 0;
+	const char * c = g_scaling_text;
+	while (count < n_characters) {
+		if (' ' == *c) {
+			/* Inter-word-space extends inter-character-space of
+			   previous character. */
+			edges[n - 1].timespan = 7 * dot;
+		} else {
+			const char * representation = cw_character_to_representation_internal(*c);
+			if (NULL == representation) {
+				free(edges);
+				return NULL;
+			}
+			for (const char * mark = representation; '\0' != *mark; mark++) {
+				edges[n].timespan = CW_DOT_REPRESENTATION == *mark ? dot : 3 * dot;
+				edges[n].is_mark = true;
+				n++;
+				edges[n].timespan = '\0' == *(mark + 1) ? 3 * dot : dot;
+				edges[n].is_mark = false;
+				n++;
+			}
+			count++;
+		}
+		c++;
+		if ('\0' == *c) {
+			c = g_scaling_text;
+		}
+	}
+
+	*n_edges = n;
+	*n_expected = (uint64_t) count;
+	return edges;
+}
+
+
+
+
+/**
+   @brief Thread decoding edges with its own receiver
+
+   @param[in] arg scaling_rec_t state of receiver
+*/
+static void * scaling_rec_thread(void * arg)
+{
+	scaling_rec_t * state = (scaling_rec_t *) arg;
+	cw_rec_decoded_t decoded[SCALING_EDGES_CHUNK];
+
+	int64_t timestamp = 1000000;
+	for (size_t i = 0; i < state->n_edges; i += SCALING_EDGES_CHUNK) {
+		const size_t n = state->n_edges - i < SCALING_EDGES_CHUNK ? state->n_edges - i : SCALING_EDGES_CHUNK;
+		size_t n_decoded = 0;
+		if (CW_SUCCESS != cw_rec_receive_edges(state->rec, timestamp, state->edges + i, n, decoded, SCALING_EDGES_CHUNK, &n_decoded)) {
+			state->failed = true;
+			return NULL;
+		}
+		for (size_t d = 0; d < n_decoded; d++) {
+			state->n_characters += ' ' != decoded[d].character;
+		}
+		for (size_t e = i; e < i + n; e++) {
+			timestamp += (int64_t) state->edges[e].timespan;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Run scenario with many receivers, each decoding edges in its own thread
+
+   @param[in] edges edges received by every receiver
+   @param[in] n_edges count of @p edges
+   @param[in] n_expected count of characters in @p edges
+   @param[in] n_receivers count of receivers
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int scaling_run_rec(const cw_rec_edge_t * edges, size_t n_edges, uint64_t n_expected, int n_receivers)
+{
+	scaling_rec_t states[SCALING_N_INSTANCES_MAX];
+	pthread_t threads[SCALING_N_INSTANCES_MAX];
+	memset(states, 0, sizeof (states));
+
+	int n_created = 0;
+	for (int i = 0; i < n_receivers; i++) {
+		states[i].rec = cw_rec_new();
+		if (NULL == states[i].rec) {
+			break;
+		}
+		cw_rec_set_speed(states[i].rec, SCALING_SPEED);
+		cw_rec_disable_adaptive_mode(states[i].rec);
+		states[i].edges = edges;
+		states[i].n_edges = n_edges;
+		n_created++;
+	}
+	if (n_created != n_receivers) {
+		for (int i = 0; i < n_created; i++) {
+			cw_rec_delete(&states[i].rec);
+		}
+		return 1;
+	}
+
+	struct rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	const uint64_t begin = scaling_now_ns();
+
+	for (int i = 0; i < n_receivers; i++) {
+		pthread_create(&threads[i], NULL, scaling_rec_thread, &states[i]);
+	}
+	for (int i = 0; i < n_receivers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	const uint64_t elapsed = scaling_now_ns() - begin;
+
+	scaling_result_t result;
+	memset(&result, 0, sizeof (result));
+	int retv = 0;
+	for (int i = 0; i < n_receivers; i++) {
+		result.n_items += n_edges;
+		result.n_characters += states[i].n_characters;
+		if (states[i].failed || n_expected != states[i].n_characters) {
+			retv = 1;
+		}
+		cw_rec_delete(&states[i].rec);
+	}
+	if (0 != retv) {
+		fprintf(stderr, "Scenario rec_edges with %d receivers has failed\n", n_receivers);
+		return retv;
+	}
+
+	scaling_print("rec_edges", n_receivers, n_receivers, "edges/s", &result, &before, elapsed);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Run scenario with many channels decoded by pool of receivers
+
+   All edges are pushed by calling thread, channel after channel, in
+   chunks of SCALING_EDGES_CHUNK edges. Decoded characters are read
+   after every round of chunks.
+
+   @param[in] edges edges received on every channel
+   @param[in] n_edges count of @p edges
+   @param[in] n_expected count of characters in @p edges
+   @param[in] n_channels count of channels of pool
+   @param[in] n_workers count of worker threads of pool
+
+   @return 0 on success
+   @return 1 on failure
+*/
+static int scaling_run_rec_pool(const cw_rec_edge_t * edges, size_t n_edges, uint64_t n_expected, int n_channels, int n_workers)
+{
+	cw_rec_pool_t * pool = cw_rec_pool_new(n_channels, n_workers);
+	const size_t capacity = (size_t) n_channels * SCALING_EDGES_CHUNK;
+	cw_rec_pool_decoded_t * decoded = malloc(capacity * sizeof (cw_rec_pool_decoded_t));
+	if (NULL == pool || NULL == decoded) {
+		cw_rec_pool_delete(&pool);
+		free(decoded);
+		return 1;
+	}
+	for (int ch = 0; ch < n_channels; ch++) {
+		cw_rec_t * rec = cw_rec_pool_get_receiver(pool, ch);
+		cw_rec_set_speed(rec, SCALING_SPEED);
+		cw_rec_disable_adaptive_mode(rec);
+	}
+
+	struct rusage before;
+	getrusage(RUSAGE_SELF, &before);
+	const uint64_t begin = scaling_now_ns();
+
+	scaling_result_t result;
+	memset(&result, 0, sizeof (result));
+	int retv = 0;
+	int64_t timestamp = 1000000;
+	for (size_t i = 0; i < n_edges && 0 == retv; i += SCALING_EDGES_CHUNK) {
+		const size_t n = n_edges - i < SCALING_EDGES_CHUNK ? n_edges - i : SCALING_EDGES_CHUNK;
+		for (int ch = 0; ch < n_channels; ch++) {
+			if (CW_SUCCESS != cw_rec_pool_push_edges(pool, ch, timestamp, edges + i, n)) {
+				retv = 1;
+				break;
+			}
+		}
+		for (size_t e = i; e < i + n; e++) {
+			timestamp += (int64_t) edges[e].timespan;
+		}
+
+		size_t n_decoded = 0;
+		do {
+			if (CW_SUCCESS != cw_rec_pool_read(pool, decoded, capacity, &n_decoded)) {
+				retv = 1;
+				break;
+			}
+			for (size_t d = 0; d < n_decoded; d++) {
+				result.n_characters += ' ' != decoded[d].character;
+			}
+		} while (n_decoded == capacity);
+	}
+
+	const uint64_t elapsed = scaling_now_ns() - begin;
+
+	cw_rec_pool_delete(&pool);
+	free(decoded);
+	if (0 != retv || n_expected * (uint64_t) n_channels != result.n_characters) {
+		fprintf(stderr, "Scenario rec_pool with %d workers has failed\n", n_workers);
+		return 1;
+	}
+
+	result.n_items = n_edges * (size_t) n_channels;
+	scaling_print("rec_pool", n_channels, n_workers, "edges/s", &result, &before, elapsed);
+
+	return 0;
+}
@@ -25,7 +25,13 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <errno.h> /* EINVAL on FreeBSD */
+#include <stdlib.h>
 #include <string.h>
 
 #include "libcw.h"
@@ -33,17 +39,13 @@
 #include "libcw_gen.h"
 #include "libcw_key.h"
 #include "libcw_rec.h"
+#include "libcw_scheduler.h"
+#include "libcw_signal.h"
 #include "libcw_utils.h"
 
 
 
 
-/* Main container for data related to generating audible Morse code.
-   This is a global variable in legacy library. New library code
-   (with API declared in libcw2.h) will not use global generator
-   variable. */
-cw_gen_t *cw_generator = NULL;
-
 
 
 
@@ -119,6 +121,262 @@ CW_STATIC_FUNC volatile cw_key_t cw_key = {
 
 
 
+/* Generator, receiver and key used by functions of legacy API.
+
+   Objects of global context are global variables of the library. A
+   thread that has made other context current (cw_context_make_current())
+   uses objects of that context instead, so many threads can use legacy
+   API at the same time, each with its own objects. */
+struct cw_context_struct {
+	/* Main container for data related to generating audible Morse
+	   code. */
+	cw_gen_t * gen;
+	cw_rec_t * rec;
+	volatile cw_key_t * key;
+
+	/* Receiver and key allocated for this context. NULL for global
+	   context. */
+	cw_rec_t * own_rec;
+	cw_key_t * own_key;
+
+	/* Timer of timer service (see libcw_signal.c). Timer handlers
+	   called at its deadline run with this context made current. */
+	cw_scheduler_entry_t timer;
+};
+
+static void cw_context_timer_callback_internal(void * arg);
+
+static cw_context_t cw_global_context = {
+	.gen = NULL,
+	.rec = &cw_receiver,
+	.key = &cw_key,
+	.own_rec = NULL,
+	.own_key = NULL,
+	.timer = {
+		.deadline = 0,
+		.callback = cw_context_timer_callback_internal,
+		.callback_arg = &cw_global_context,
+		.heap_idx = -1,
+	},
+};
+
+/* Context made current in calling thread. NULL for global context. */
+static __thread cw_context_t * cw_current_context = NULL;
+
+static cw_context_t * cw_context_current_internal(void);
+
+/* Objects of context that is current in calling thread. */
+#define CW_CONTEXT_GEN (cw_context_current_internal()->gen)
+#define CW_CONTEXT_REC (cw_context_current_internal()->rec)
+#define CW_CONTEXT_KEY (cw_context_current_internal()->key)
+
+
+
+
+
+/* ******************************************************************** */
+/*                               Context                                */
+/* ******************************************************************** */
+
+
+
+
+
+/**
+   \brief Create new context of legacy API
+
+   Context has its own generator, receiver and key, so functions of
+   legacy API called in a thread that has made the context current
+   (see cw_context_make_current()) don't touch global objects of the
+   library, nor objects of other contexts.
+
+   Receiver and key are created by this function. Generator is not
+   created: create it with cw_generator_new(), called when the context
+   is current.
+
+   \return new context on success
+   \return NULL on failure
+*/
+cw_context_t * cw_context_new(void)
+{
+	cw_context_t * context = (cw_context_t *) calloc(1, sizeof (cw_context_t));
+	if (NULL == context) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      "libcw: can't allocate context");
+		return NULL;
+	}
+
+	context->own_rec = cw_rec_new();
+	context->own_key = cw_key_new();
+	if (NULL == context->own_rec || NULL == context->own_key) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      "libcw: can't create receiver or key of context");
+		cw_context_delete(&context);
+		return NULL;
+	}
+	cw_rec_set_label(context->own_rec, "context rec");
+	cw_key_set_label(context->own_key, "context key");
+
+	cw_scheduler_entry_init_internal(&context->timer, cw_context_timer_callback_internal, context);
+
+	context->gen = NULL;
+	context->rec = context->own_rec;
+	context->key = context->own_key;
+	cw_key_register_receiver(context->key, context->rec);
+
+	return context;
+}
+
+
+
+
+/**
+   \brief Delete context of legacy API
+
+   Generator of the context (if it has been created) is deleted
+   together with receiver and key of the context. The context must not
+   be current in any thread.
+
+   \param context - pointer to context to delete; the pointer is set to NULL
+*/
+void cw_context_delete(cw_context_t ** context)
+{
+	if (NULL == context || NULL == *context) {
+		return;
+	}
+
+	cw_scheduler_cancel_internal(&(*context)->timer);
+	if (NULL != (*context)->gen) {
+		cw_gen_delete(&(*context)->gen);
+	}
+	cw_key_delete(&(*context)->own_key);
+	cw_rec_delete(&(*context)->own_rec);
+
+	free(*context);
+	*context = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   \brief Make a context current in calling thread
+
+   All functions of legacy API called afterwards in calling thread
+   use generator, receiver and key of \p context. Pass NULL to go
+   back to global objects of the library.
+
+   A context should be current in at most one thread at a time, unless
+   the threads synchronize their calls to legacy API.
+
+   \param context - context to make current, or NULL
+
+   \return context that was current in calling thread before the call (NULL for global context)
+*/
+cw_context_t * cw_context_make_current(cw_context_t * context)
+{
+	cw_context_t * previous = cw_current_context;
+	cw_current_context = context;
+	return previous;
+}
+
+
+
+
+/**
+   \brief Get context that is current in calling thread
+
+   \return current context, or NULL if calling thread uses global objects of the library
+*/
+cw_context_t * cw_context_get_current(void)
+{
+	return cw_current_context;
+}
+
+
+
+
+/**
+   \brief Get generator created with cw_generator_new()
+
+   The returned pointer can be passed to functions from libcw2.h that
+   operate on a generator (e.g. cw_gen_get_queue_event_fd()), so that
+   a program using legacy API can use them without creating a second
+   generator. The generator remains owned by the library: don't pass
+   it to cw_gen_delete(), use cw_generator_delete() instead.
+
+   \return generator of calling thread's current context
+   \return NULL if cw_generator_new() hasn't been called (or generator has been deleted)
+*/
+cw_gen_t * cw_generator_get(void)
+{
+	return CW_CONTEXT_GEN;
+}
+
+
+
+
+/**
+   \brief Get generator of legacy API used by calling thread
+
+   \return generator of calling thread's current context (may be NULL)
+*/
+cw_gen_t * cw_generator_get_internal(void)
+{
+	return CW_CONTEXT_GEN;
+}
+
+
+
+
+/**
+   \brief Get timer of context used by calling thread
+
+   \return timer of calling thread's current context
+*/
+cw_scheduler_entry_t * cw_context_timer_get_internal(void)
+{
+	return &cw_context_current_internal()->timer;
+}
+
+
+
+
+/**
+   \brief Call timer handlers at deadline of context's timer
+
+   Function is called by scheduler thread. The context is made current
+   in scheduler thread for the duration of the call, so that handlers
+   operate on objects of context that has requested the timeout.
+
+   \param arg - context owning the timer
+*/
+static void cw_context_timer_callback_internal(void * arg)
+{
+	cw_context_t * context = (cw_context_t *) arg;
+	cw_context_t * previous = cw_context_make_current(context == &cw_global_context ? NULL : context);
+	cw_timer_handlers_call_internal();
+	cw_context_make_current(previous);
+}
+
+
+
+
+/**
+   \brief Get context used by legacy API functions called in calling thread
+
+   \return current context of calling thread, or global context
+*/
+static cw_context_t * cw_context_current_internal(void)
+{
+	return NULL != cw_current_context ? cw_current_context : &cw_global_context;
+}
+
+
+
+
 
 /* ******************************************************************** */
 /*                              Generator                               */
@@ -179,17 +437,17 @@ int cw_generator_new(int audio_system, const char *device)
 */
 int cw_generator_new_internal(const cw_gen_config_t * gen_conf)
 {
-	cw_generator = cw_gen_new(gen_conf);
-	if (NULL == cw_generator) {
+	CW_CONTEXT_GEN = cw_gen_new(gen_conf);
+	if (NULL == CW_CONTEXT_GEN) {
 		cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
 			      "libcw: can't create generator");
 		return CW_FAILURE;
 	} else {
-		cw_gen_set_label(cw_generator, "global gen"); /* Single global generator available in libcw library, used by legacy API. */
+		cw_gen_set_label(CW_CONTEXT_GEN, "global gen"); /* Single global generator available in libcw library, used by legacy API. */
 
 		/* For some (all?) applications a key needs to have
 		   some generator associated with it. */
-		cw_key_register_generator(&cw_key, cw_generator);
+		cw_key_register_generator(CW_CONTEXT_KEY, CW_CONTEXT_GEN);
 
 		return CW_SUCCESS;
 	}
@@ -208,7 +466,7 @@ int cw_generator_new_internal(const cw_gen_config_t * gen_conf)
 */
 void cw_generator_delete(void)
 {
-	cw_gen_delete(&cw_generator);
+	cw_gen_delete(&CW_CONTEXT_GEN);
 
 	return;
 }
@@ -230,7 +488,7 @@ void cw_generator_delete(void)
 */
 int cw_generator_start(void)
 {
-	return cw_gen_start(cw_generator);
+	return cw_gen_start(CW_CONTEXT_GEN);
 }
 
 
@@ -250,7 +508,7 @@ int cw_generator_start(void)
 */
 void cw_generator_stop(void)
 {
-	cw_gen_stop(cw_generator);
+	cw_gen_stop(CW_CONTEXT_GEN);
 
 	return;
 }
@@ -264,8 +522,8 @@ void cw_generator_stop(void)
 */
 void cw_generator_delete_internal(void)
 {
-	if (cw_generator) {
-		cw_gen_delete(&cw_generator);
+	if (CW_CONTEXT_GEN) {
+		cw_gen_delete(&CW_CONTEXT_GEN);
 	}
 
 	return;
@@ -294,7 +552,7 @@ void cw_generator_delete_internal(void)
 */
 int cw_set_send_speed(int new_value)
 {
-	int rv = cw_gen_set_speed(cw_generator, new_value);
+	int rv = cw_gen_set_speed(CW_CONTEXT_GEN, new_value);
 	return rv;
 }
 
@@ -321,7 +579,7 @@ int cw_set_send_speed(int new_value)
 */
 int cw_set_frequency(int new_value)
 {
-	int rv = cw_gen_set_frequency(cw_generator, new_value);
+	int rv = cw_gen_set_frequency(CW_CONTEXT_GEN, new_value);
 	return rv;
 }
 
@@ -351,7 +609,7 @@ int cw_set_frequency(int new_value)
 */
 int cw_set_volume(int new_value)
 {
-	int rv = cw_gen_set_volume(cw_generator, new_value);
+	int rv = cw_gen_set_volume(CW_CONTEXT_GEN, new_value);
 	return rv;
 }
 
@@ -376,13 +634,13 @@ int cw_set_volume(int new_value)
 */
 int cw_set_gap(int new_value)
 {
-	int rv = cw_gen_set_gap(cw_generator, new_value);
+	int rv = cw_gen_set_gap(CW_CONTEXT_GEN, new_value);
 	if (rv != CW_FAILURE) {
 		/* Ideally generator and receiver should have their
 		   own, separate cw_set_gap() functions. Unfortunately
 		   this is not the case so gap should be set
 		   here for receiver as well. */
-		rv = cw_rec_set_gap(&cw_receiver, new_value);
+		rv = cw_rec_set_gap(CW_CONTEXT_REC, new_value);
 	}
 	return rv;
 }
@@ -405,7 +663,7 @@ int cw_set_gap(int new_value)
 */
 int cw_set_weighting(int new_value)
 {
-	int rv = cw_gen_set_weighting(cw_generator, new_value);
+	int rv = cw_gen_set_weighting(CW_CONTEXT_GEN, new_value);
 	return rv;
 }
 
@@ -420,7 +678,7 @@ int cw_set_weighting(int new_value)
 */
 int cw_get_send_speed(void)
 {
-	return cw_gen_get_speed(cw_generator);
+	return cw_gen_get_speed(CW_CONTEXT_GEN);
 }
 
 
@@ -437,7 +695,7 @@ int cw_get_send_speed(void)
 */
 int cw_get_frequency(void)
 {
-	return cw_gen_get_frequency(cw_generator);
+	return cw_gen_get_frequency(CW_CONTEXT_GEN);
 }
 
 
@@ -454,7 +712,7 @@ int cw_get_frequency(void)
 */
 int cw_get_volume(void)
 {
-	return cw_gen_get_volume(cw_generator);
+	return cw_gen_get_volume(CW_CONTEXT_GEN);
 }
 
 
@@ -468,7 +726,7 @@ int cw_get_volume(void)
 */
 int cw_get_gap(void)
 {
-	return cw_gen_get_gap(cw_generator);
+	return cw_gen_get_gap(CW_CONTEXT_GEN);
 }
 
 
@@ -482,7 +740,7 @@ int cw_get_gap(void)
 */
 int cw_get_weighting(void)
 {
-	return cw_gen_get_weighting(cw_generator);
+	return cw_gen_get_weighting(CW_CONTEXT_GEN);
 }
 
 
@@ -511,7 +769,7 @@ void cw_get_send_parameters(int *dot_usecs, int *dash_usecs,
 			    int *end_of_character_usecs, int *end_of_word_usecs,
 			    int *additional_usecs, int *adjustment_usecs)
 {
-	cw_gen_get_timing_parameters_internal(cw_generator,
+	cw_gen_get_timing_parameters_internal(CW_CONTEXT_GEN,
 					      dot_usecs, dash_usecs,
 					      end_of_element_usecs,
 					      end_of_character_usecs, end_of_word_usecs,
@@ -537,7 +795,7 @@ void cw_get_send_parameters(int *dot_usecs, int *dash_usecs,
 int cw_send_dot(void)
 {
 	const bool is_first_mark = false; /* cw_send_dot() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
-	return cw_gen_enqueue_mark_internal(cw_generator, CW_DOT_REPRESENTATION, is_first_mark);
+	return cw_gen_enqueue_mark_internal(CW_CONTEXT_GEN, CW_DOT_REPRESENTATION, is_first_mark);
 }
 
 
@@ -557,7 +815,7 @@ int cw_send_dot(void)
 int cw_send_dash(void)
 {
 	const bool is_first_mark = false; /* cw_send_dash() doesn't accept 'is first mark' argument, so we have to assume that it's not a first mark. */
-	return cw_gen_enqueue_mark_internal(cw_generator, CW_DASH_REPRESENTATION, is_first_mark);
+	return cw_gen_enqueue_mark_internal(CW_CONTEXT_GEN, CW_DASH_REPRESENTATION, is_first_mark);
 }
 
 
@@ -574,7 +832,7 @@ int cw_send_dash(void)
 */
 int cw_send_character_space(void)
 {
-	return cw_gen_enqueue_ics_internal(cw_generator);
+	return cw_gen_enqueue_ics_internal(CW_CONTEXT_GEN);
 }
 
 
@@ -592,7 +850,7 @@ int cw_send_character_space(void)
 */
 int cw_send_word_space(void)
 {
-	return cw_gen_enqueue_iws_internal(cw_generator);
+	return cw_gen_enqueue_iws_internal(CW_CONTEXT_GEN);
 }
 
 
@@ -620,7 +878,7 @@ int cw_send_word_space(void)
 */
 int cw_send_representation(const char *representation)
 {
-	return cw_gen_enqueue_representation(cw_generator, representation);
+	return cw_gen_enqueue_representation(CW_CONTEXT_GEN, representation);
 }
 
 
@@ -643,7 +901,7 @@ int cw_send_representation(const char *representation)
 */
 int cw_send_representation_partial(const char *representation)
 {
-	return cw_gen_enqueue_representation_no_ics(cw_generator, representation);
+	return cw_gen_enqueue_representation_no_ics(CW_CONTEXT_GEN, representation);
 }
 
 
@@ -677,7 +935,7 @@ int cw_send_representation_partial(const char *representation)
 */
 int cw_send_character(char c)
 {
-	return cw_gen_enqueue_character(cw_generator, c);
+	return cw_gen_enqueue_character(CW_CONTEXT_GEN, c);
 }
 
 
@@ -711,7 +969,7 @@ int cw_send_character(char c)
 */
 int cw_send_character_partial(char c)
 {
-	return cw_gen_enqueue_character_no_ics(cw_generator, c);
+	return cw_gen_enqueue_character_no_ics(CW_CONTEXT_GEN, c);
 }
 
 
@@ -747,7 +1005,7 @@ int cw_send_character_partial(char c)
 */
 int cw_send_string(const char *string)
 {
-	return cw_gen_enqueue_string(cw_generator, string);
+	return cw_gen_enqueue_string(CW_CONTEXT_GEN, string);
 }
 
 
@@ -764,12 +1022,12 @@ int cw_send_string(const char *string)
 */
 void cw_reset_send_receive_parameters(void)
 {
-	cw_gen_reset_parameters_internal(cw_generator);
-	cw_rec_reset_parameters_internal(&cw_receiver);
+	cw_gen_reset_parameters_internal(CW_CONTEXT_GEN);
+	cw_rec_reset_parameters_internal(CW_CONTEXT_REC);
 
 	/* Reset requires resynchronization. */
-	cw_gen_sync_parameters_internal(cw_generator);
-	cw_rec_sync_parameters_internal(&cw_receiver);
+	cw_gen_sync_parameters_internal(CW_CONTEXT_GEN);
+	cw_rec_sync_parameters_internal(CW_CONTEXT_REC);
 
 	return;
 }
@@ -787,7 +1045,7 @@ void cw_reset_send_receive_parameters(void)
 */
 const char *cw_get_console_device(void)
 {
-	return cw_generator->picked_device_name;
+	return CW_CONTEXT_GEN->picked_device_name;
 }
 
 
@@ -803,7 +1061,7 @@ const char *cw_get_console_device(void)
 */
 const char *cw_get_soundcard_device(void)
 {
-	return cw_generator->picked_device_name;
+	return CW_CONTEXT_GEN->picked_device_name;
 }
 
 
@@ -820,7 +1078,7 @@ const char *cw_get_soundcard_device(void)
 */
 const char *cw_generator_get_audio_system_label(void)
 {
-	return cw_get_audio_system_label(cw_generator->sound_system);
+	return cw_get_audio_system_label(CW_CONTEXT_GEN->sound_system);
 }
 
 
@@ -847,7 +1105,7 @@ const char *cw_generator_get_audio_system_label(void)
 */
 int cw_generator_remove_last_character(void)
 {
-	return cw_gen_remove_last_character(cw_generator);
+	return cw_gen_remove_last_character(CW_CONTEXT_GEN);
 }
 
 
@@ -896,7 +1154,7 @@ int cw_register_tone_queue_low_callback(void (*callback_func)(void*), void *call
 		errno = EINVAL; /* cw_tq_register_low_level_callback_internal() won't recognize negative level. */
 		return CW_FAILURE;
 	}
-	return cw_tq_register_low_level_callback_internal(cw_generator->tq, callback_func, callback_arg, level);
+	return cw_tq_register_low_level_callback_internal(CW_CONTEXT_GEN->tq, callback_func, callback_arg, level);
 }
 
 
@@ -917,7 +1175,7 @@ int cw_register_tone_queue_low_callback(void (*callback_func)(void*), void *call
 */
 bool cw_is_tone_busy(void)
 {
-	return cw_tq_is_nonempty_internal(cw_generator->tq);
+	return cw_tq_is_nonempty_internal(CW_CONTEXT_GEN->tq);
 }
 
 
@@ -932,7 +1190,7 @@ bool cw_is_tone_busy(void)
 */
 int cw_wait_for_tone(void)
 {
-	return cw_tq_wait_for_end_of_current_tone_internal(cw_generator->tq);
+	return cw_tq_wait_for_end_of_current_tone_internal(CW_CONTEXT_GEN->tq);
 }
 
 
@@ -952,7 +1210,7 @@ int cw_wait_for_tone(void)
 */
 int cw_wait_for_tone_queue(void)
 {
-	return cw_tq_wait_for_level_internal(cw_generator->tq, 0);
+	return cw_tq_wait_for_level_internal(CW_CONTEXT_GEN->tq, 0);
 }
 
 
@@ -986,7 +1244,7 @@ int cw_wait_for_tone_queue_critical(int level)
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
-	return cw_tq_wait_for_level_internal(cw_generator->tq, (size_t) level);
+	return cw_tq_wait_for_level_internal(CW_CONTEXT_GEN->tq, (size_t) level);
 }
 
 
@@ -1001,7 +1259,7 @@ int cw_wait_for_tone_queue_critical(int level)
 */
 bool cw_is_tone_queue_full(void)
 {
-	return cw_tq_is_full_internal(cw_generator->tq);
+	return cw_tq_is_full_internal(CW_CONTEXT_GEN->tq);
 }
 
 
@@ -1013,7 +1271,7 @@ bool cw_is_tone_queue_full(void)
 */
 int cw_get_tone_queue_capacity(void)
 {
-	return (int) cw_tq_capacity_internal(cw_generator->tq);
+	return (int) cw_tq_capacity_internal(CW_CONTEXT_GEN->tq);
 }
 
 
@@ -1025,7 +1283,7 @@ int cw_get_tone_queue_capacity(void)
 */
 int cw_get_tone_queue_length(void)
 {
-	return (int) cw_tq_length_internal(cw_generator->tq);
+	return (int) cw_tq_length_internal(CW_CONTEXT_GEN->tq);
 }
 
 
@@ -1041,11 +1299,11 @@ int cw_get_tone_queue_length(void)
 void cw_flush_tone_queue(void)
 {
 	/* This function locks and unlocks mutex. */
-	cw_tq_flush_internal(cw_generator->tq);
+	cw_tq_flush_internal(CW_CONTEXT_GEN->tq);
 
 	/* Force silence on the speaker anyway, and stop any background
 	   soundcard tone generation. */
-	cw_gen_silence_internal(cw_generator);
+	cw_gen_silence_internal(CW_CONTEXT_GEN);
 	//cw_finalization_schedule_internal();
 
 	return;
@@ -1062,10 +1320,10 @@ void cw_flush_tone_queue(void)
 */
 void cw_reset_tone_queue(void)
 {
-	cw_tq_flush_internal(cw_generator->tq);
+	cw_tq_flush_internal(CW_CONTEXT_GEN->tq);
 
 	/* Silence sound and stop any background soundcard tone generation. */
-	cw_gen_silence_internal(cw_generator);
+	cw_gen_silence_internal(CW_CONTEXT_GEN);
 	//cw_finalization_schedule_internal();
 
 	cw_debug_msg ((&cw_debug_object), CW_DEBUG_TONE_QUEUE, CW_DEBUG_INFO,
@@ -1108,11 +1366,11 @@ int cw_queue_tone(int usecs, int frequency)
 
 	cw_tone_t tone;
 	CW_TONE_INIT(&tone, frequency, usecs, CW_SLOPE_MODE_STANDARD_SLOPES);
-	int rv = cw_tq_enqueue_internal(cw_generator->tq, &tone);
+	int rv = cw_tq_enqueue_internal(CW_CONTEXT_GEN->tq, &tone);
 
 	if (frequency > 0) {
 		/* Enqueueing a mark must reset counter of spaces. */
-		cw_generator->space_units_count = 0;
+		CW_CONTEXT_GEN->space_units_count = 0;
 	} else {
 		/* This function doesn't allow us to recognize whether an ims, ics or
 		   iws space has been enqueued, so we can't tell what value to assign
@@ -1151,7 +1409,7 @@ int cw_queue_tone(int usecs, int frequency)
 */
 int cw_set_receive_speed(int new_value)
 {
-	return cw_rec_set_speed(&cw_receiver, new_value);
+	return cw_rec_set_speed(CW_CONTEXT_REC, new_value);
 }
 
 
@@ -1165,7 +1423,7 @@ int cw_set_receive_speed(int new_value)
 */
 int cw_get_receive_speed(void)
 {
-	return (int) cw_rec_get_speed(&cw_receiver);
+	return (int) cw_rec_get_speed(CW_CONTEXT_REC);
 }
 
 
@@ -1186,7 +1444,7 @@ int cw_get_receive_speed(void)
 */
 int cw_set_tolerance(int new_value)
 {
-	return cw_rec_set_tolerance(&cw_receiver, new_value);
+	return cw_rec_set_tolerance(CW_CONTEXT_REC, new_value);
 }
 
 
@@ -1200,7 +1458,7 @@ int cw_set_tolerance(int new_value)
 */
 int cw_get_tolerance(void)
 {
-	return cw_rec_get_tolerance(&cw_receiver);
+	return cw_rec_get_tolerance(CW_CONTEXT_REC);
 }
 
 
@@ -1241,7 +1499,7 @@ void cw_get_receive_parameters(int *dot_usecs, int *dash_usecs,
 			       int *end_of_character_ideal_usecs,
 			       int *adaptive_threshold)
 {
-	cw_rec_get_parameters_internal(&cw_receiver,
+	cw_rec_get_parameters_internal(CW_CONTEXT_REC,
 				       dot_usecs, dash_usecs,
 				       dot_min_usecs, dot_max_usecs,
 				       dash_min_usecs, dash_max_usecs,
@@ -1281,7 +1539,7 @@ void cw_get_receive_parameters(int *dot_usecs, int *dash_usecs,
 */
 int cw_set_noise_spike_threshold(int new_value)
 {
-	return cw_rec_set_noise_spike_threshold(&cw_receiver, new_value);
+	return cw_rec_set_noise_spike_threshold(CW_CONTEXT_REC, new_value);
 }
 
 
@@ -1297,7 +1555,7 @@ int cw_set_noise_spike_threshold(int new_value)
 */
 int cw_get_noise_spike_threshold(void)
 {
-	return cw_rec_get_noise_spike_threshold(&cw_receiver);
+	return cw_rec_get_noise_spike_threshold(CW_CONTEXT_REC);
 }
 
 
@@ -1329,7 +1587,7 @@ void cw_get_receive_statistics(double *dot_sd, double *dash_sd,
 	float element_end_sd_f = 0.0F;
 	float character_end_sd_f = 0.0F;
 
-	cw_rec_get_statistics_internal(&cw_receiver,
+	cw_rec_get_statistics_internal(CW_CONTEXT_REC,
 				       &dot_sd_f,
 				       &dash_sd_f,
 				       &element_end_sd_f,
@@ -1354,7 +1612,7 @@ void cw_get_receive_statistics(double *dot_sd, double *dash_sd,
 */
 void cw_reset_receive_statistics(void)
 {
-	cw_rec_reset_statistics(&cw_receiver);
+	cw_rec_reset_statistics(CW_CONTEXT_REC);
 
 	return;
 }
@@ -1378,7 +1636,7 @@ void cw_reset_receive_statistics(void)
 */
 void cw_enable_adaptive_receive(void)
 {
-	cw_rec_set_adaptive_mode_internal(&cw_receiver, true);
+	cw_rec_set_adaptive_mode_internal(CW_CONTEXT_REC, true);
 	return;
 }
 
@@ -1393,7 +1651,7 @@ void cw_enable_adaptive_receive(void)
 */
 void cw_disable_adaptive_receive(void)
 {
-	cw_rec_set_adaptive_mode_internal(&cw_receiver, false);
+	cw_rec_set_adaptive_mode_internal(CW_CONTEXT_REC, false);
 	return;
 }
 
@@ -1412,7 +1670,7 @@ void cw_disable_adaptive_receive(void)
 */
 bool cw_get_adaptive_receive_state(void)
 {
-	return cw_rec_get_adaptive_mode(&cw_receiver);
+	return cw_rec_get_adaptive_mode(CW_CONTEXT_REC);
 }
 
 
@@ -1441,7 +1699,7 @@ bool cw_get_adaptive_receive_state(void)
 */
 int cw_start_receive_tone(const struct timeval *timestamp)
 {
-	return cw_rec_mark_begin(&cw_receiver, timestamp);
+	return cw_rec_mark_begin(CW_CONTEXT_REC, timestamp);
 }
 
 
@@ -1475,7 +1733,7 @@ int cw_start_receive_tone(const struct timeval *timestamp)
 */
 int cw_end_receive_tone(const struct timeval *timestamp)
 {
-	return cw_rec_mark_end(&cw_receiver, timestamp);
+	return cw_rec_mark_end(CW_CONTEXT_REC, timestamp);
 }
 
 
@@ -1513,7 +1771,7 @@ int cw_end_receive_tone(const struct timeval *timestamp)
 */
 int cw_receive_buffer_dot(const struct timeval *timestamp)
 {
-	return cw_rec_add_mark(&cw_receiver, timestamp, CW_DOT_REPRESENTATION);
+	return cw_rec_add_mark(CW_CONTEXT_REC, timestamp, CW_DOT_REPRESENTATION);
 }
 
 
@@ -1532,7 +1790,7 @@ int cw_receive_buffer_dot(const struct timeval *timestamp)
 */
 int cw_receive_buffer_dash(const struct timeval *timestamp)
 {
-	return cw_rec_add_mark(&cw_receiver, timestamp, CW_DASH_REPRESENTATION);
+	return cw_rec_add_mark(CW_CONTEXT_REC, timestamp, CW_DASH_REPRESENTATION);
 }
 
 
@@ -1586,7 +1844,7 @@ int cw_receive_representation(const struct timeval *timestamp,
 			      /* out */ bool *is_end_of_word,
 			      /* out */ bool *is_error)
 {
-	int rv = cw_rec_poll_representation(&cw_receiver,
+	int rv = cw_rec_poll_representation(CW_CONTEXT_REC,
 					  timestamp,
 					  representation,
 					  is_end_of_word,
@@ -1640,7 +1898,7 @@ int cw_receive_character(const struct timeval *timestamp,
 			 /* out */ bool *is_end_of_word,
 			 /* out */ bool *is_error)
 {
-	cw_ret_t cwret = cw_rec_poll_character(&cw_receiver, timestamp, c, is_end_of_word, is_error);
+	cw_ret_t cwret = cw_rec_poll_character(CW_CONTEXT_REC, timestamp, c, is_end_of_word, is_error);
 	return (int) cwret;
 }
 
@@ -1667,10 +1925,10 @@ void cw_clear_receive_buffer(void)
 	/* In 3.5.1 this was implemented by cw_rec_clear_buffer_internal() (now
 	   cw_rec_reset_state()) like this: */
 
-	memset(cw_receiver.representation, 0, sizeof (cw_receiver.representation));
-	cw_receiver.representation_ind = 0;
+	memset(CW_CONTEXT_REC->representation, 0, sizeof (CW_CONTEXT_REC->representation));
+	CW_CONTEXT_REC->representation_ind = 0;
 
-	cw_rec_set_state_internal(&cw_receiver, RS_IDLE);
+	cw_rec_set_state_internal(CW_CONTEXT_REC, RS_IDLE);
 
 	return;
 }
@@ -1704,7 +1962,7 @@ int cw_get_receive_buffer_capacity(void)
 */
 int cw_get_receive_buffer_length(void)
 {
-	return cw_rec_get_buffer_length_internal(&cw_receiver);
+	return cw_rec_get_buffer_length_internal(CW_CONTEXT_REC);
 }
 
 
@@ -1725,11 +1983,11 @@ void cw_reset_receive(void)
 {
 	/* In 3.5.1 this was implemented by cw_rec_reset_internal() like this: */
 
-	memset(cw_receiver.representation, 0, sizeof (cw_receiver.representation));
-	cw_receiver.representation_ind = 0;
-	cw_rec_set_state_internal(&cw_receiver, RS_IDLE);
+	memset(CW_CONTEXT_REC->representation, 0, sizeof (CW_CONTEXT_REC->representation));
+	CW_CONTEXT_REC->representation_ind = 0;
+	cw_rec_set_state_internal(CW_CONTEXT_REC, RS_IDLE);
 
-	cw_rec_reset_statistics(&cw_receiver);
+	cw_rec_reset_statistics(CW_CONTEXT_REC);
 
 	return;
 }
@@ -1767,7 +2025,7 @@ void cw_reset_receive(void)
 */
 void cw_register_keying_callback(void (*callback_func)(void*, int), void *callback_arg)
 {
-	cw_gen_register_value_tracking_callback_internal(cw_generator, callback_func, callback_arg);
+	cw_gen_register_value_tracking_callback_internal(CW_CONTEXT_GEN, callback_func, callback_arg);
 	return;
 }
 
@@ -1790,7 +2048,7 @@ void cw_register_keying_callback(void (*callback_func)(void*, int), void *callba
 */
 void cw_iambic_keyer_register_timer(struct timeval *timer)
 {
-	cw_key_ik_register_timer_internal(&cw_key, timer);
+	cw_key_ik_register_timer_internal(CW_CONTEXT_KEY, timer);
 	return;
 }
 
@@ -1811,7 +2069,7 @@ void cw_iambic_keyer_register_timer(struct timeval *timer)
 */
 void cw_enable_iambic_curtis_mode_b(void)
 {
-	cw_key_ik_enable_curtis_mode_b(&cw_key);
+	cw_key_ik_enable_curtis_mode_b(CW_CONTEXT_KEY);
 	return;
 }
 
@@ -1824,7 +2082,7 @@ void cw_enable_iambic_curtis_mode_b(void)
 */
 void cw_disable_iambic_curtis_mode_b(void)
 {
-	cw_key_ik_disable_curtis_mode_b(&cw_key);
+	cw_key_ik_disable_curtis_mode_b(CW_CONTEXT_KEY);
 	return;
 }
 
@@ -1837,7 +2095,7 @@ void cw_disable_iambic_curtis_mode_b(void)
 */
 int cw_get_iambic_curtis_mode_b_state(void)
 {
-	return (int) cw_key_ik_get_curtis_mode_b(&cw_key);
+	return (int) cw_key_ik_get_curtis_mode_b(CW_CONTEXT_KEY);
 }
 
 
@@ -1869,7 +2127,7 @@ int cw_get_iambic_curtis_mode_b_state(void)
 */
 int cw_notify_keyer_paddle_event(int dot_paddle_state, int dash_paddle_state)
 {
-	return cw_key_ik_notify_paddle_event(&cw_key, dot_paddle_state, dash_paddle_state);
+	return cw_key_ik_notify_paddle_event(CW_CONTEXT_KEY, dot_paddle_state, dash_paddle_state);
 }
 
 
@@ -1889,7 +2147,7 @@ int cw_notify_keyer_paddle_event(int dot_paddle_state, int dash_paddle_state)
 */
 int cw_notify_keyer_dot_paddle_event(int dot_paddle_state)
 {
-	return cw_notify_keyer_paddle_event(dot_paddle_state, cw_key.ik.dash_paddle_value);
+	return cw_notify_keyer_paddle_event(dot_paddle_state, CW_CONTEXT_KEY->ik.dash_paddle_value);
 }
 
 
@@ -1901,7 +2159,7 @@ int cw_notify_keyer_dot_paddle_event(int dot_paddle_state)
 */
 int cw_notify_keyer_dash_paddle_event(int dash_paddle_state)
 {
-	return cw_notify_keyer_paddle_event(cw_key.ik.dot_paddle_value, dash_paddle_state);
+	return cw_notify_keyer_paddle_event(CW_CONTEXT_KEY->ik.dot_paddle_value, dash_paddle_state);
 }
 
 
@@ -1916,7 +2174,7 @@ int cw_notify_keyer_dash_paddle_event(int dash_paddle_state)
 */
 void cw_get_keyer_paddles(int *dot_paddle_state, int *dash_paddle_state)
 {
-	cw_key_ik_get_paddles(&cw_key, (cw_key_value_t *) dot_paddle_state, (cw_key_value_t *) dash_paddle_state);
+	cw_key_ik_get_paddles(CW_CONTEXT_KEY, (cw_key_value_t *) dot_paddle_state, (cw_key_value_t *) dash_paddle_state);
 	return;
 }
 
@@ -1937,7 +2195,7 @@ void cw_get_keyer_paddles(int *dot_paddle_state, int *dash_paddle_state)
 */
 void cw_get_keyer_paddle_latches(int *dot_paddle_latch_state, int *dash_paddle_latch_state)
 {
-	cw_key_ik_get_paddle_latches_internal(&cw_key, dot_paddle_latch_state, dash_paddle_latch_state);
+	cw_key_ik_get_paddle_latches_internal(CW_CONTEXT_KEY, dot_paddle_latch_state, dash_paddle_latch_state);
 	return;
 }
 
@@ -1953,7 +2211,7 @@ void cw_get_keyer_paddle_latches(int *dot_paddle_latch_state, int *dash_paddle_l
 */
 bool cw_is_keyer_busy(void)
 {
-	return cw_key_ik_is_busy_internal(&cw_key);
+	return cw_key_ik_is_busy_internal(CW_CONTEXT_KEY);
 }
 
 
@@ -1971,7 +2229,7 @@ bool cw_is_keyer_busy(void)
 int cw_wait_for_keyer_element(void)
 {
 	/* TODO: update function description: errno and return values. */
-	return cw_key_ik_wait_for_end_of_current_element(&cw_key);
+	return cw_key_ik_wait_for_end_of_current_element(CW_CONTEXT_KEY);
 }
 
 
@@ -1986,7 +2244,7 @@ int cw_wait_for_keyer_element(void)
 */
 int cw_wait_for_keyer(void)
 {
-	return cw_key_ik_wait_for_keyer(&cw_key);
+	return cw_key_ik_wait_for_keyer(CW_CONTEXT_KEY);
 }
 
 
@@ -2002,7 +2260,7 @@ int cw_wait_for_keyer(void)
 */
 void cw_reset_keyer(void)
 {
-	cw_key_ik_reset_internal(&cw_key);
+	cw_key_ik_reset_internal(CW_CONTEXT_KEY);
 	return;
 }
 
@@ -2060,7 +2318,7 @@ void cw_straight_key_clock_internal(void)
 */
 int cw_notify_straight_key_event(int key_state)
 {
-	return cw_key_sk_set_value(&cw_key, key_state);
+	return cw_key_sk_set_value(CW_CONTEXT_KEY, key_state);
 }
 
 
@@ -2078,7 +2336,7 @@ int cw_notify_straight_key_event(int key_state)
 int cw_get_straight_key_state(void)
 {
 	cw_key_value_t key_value = CW_KEY_VALUE_OPEN;
-	cw_key_sk_get_value(&cw_key, &key_value);
+	cw_key_sk_get_value(CW_CONTEXT_KEY, &key_value);
 	return (int) key_value;
 }
 
@@ -2111,6 +2369,6 @@ bool cw_is_straight_key_busy(void)
 */
 void cw_reset_straight_key(void)
 {
-	cw_key_sk_reset_internal(&cw_key);
+	cw_key_sk_reset_internal(CW_CONTEXT_KEY);
 	return;
 }
@@ -48,7 +48,11 @@ enum cw_audio_systems {
 	CW_AUDIO_OSS,
 	CW_AUDIO_ALSA,
 	CW_AUDIO_PA,        /* PulseAudio */
-	CW_AUDIO_SOUNDCARD  /* OSS, ALSA or PulseAudio (PA) */
+	CW_AUDIO_SOUNDCARD, /* OSS, ALSA or PulseAudio (PA) */
+	CW_AUDIO_FILE,      /* samples written to disc file (offline rendering) */
+	CW_AUDIO_JACK,      /* JACK Audio Connection Kit */
+	CW_AUDIO_PIPEWIRE,  /* PipeWire (native API) */
+	CW_AUDIO_RTP        /* samples streamed over RTP/UDP (Opus or L16) */
 };
 
 enum {
@@ -68,6 +72,10 @@ typedef int16_t cw_sample_t;
 #define CW_DEFAULT_OSS_DEVICE       "/dev/audio"
 #define CW_DEFAULT_ALSA_DEVICE      "default"
 #define CW_DEFAULT_PA_DEVICE        "( default )"
+#define CW_DEFAULT_FILE_DEVICE      "cw.wav"
+#define CW_DEFAULT_JACK_DEVICE      "( default )"
+#define CW_DEFAULT_PIPEWIRE_DEVICE  "( default )"
+#define CW_DEFAULT_RTP_DEVICE       "localhost:5004"
 
 
 /* Limits on values of CW send and timing parameters */
@@ -221,6 +229,9 @@ enum {
 
 typedef struct cw_gen_struct cw_gen_t;
 
+/* Generator, receiver and key used by legacy API in a thread. */
+typedef struct cw_context_struct cw_context_t;
+
 
 /* Functions handling library meta data */
 extern int  cw_version(void);
@@ -229,12 +240,21 @@ extern const char *cw_get_audio_system_label(int sound_system);
 
 
 
+/* Functions handling contexts of legacy API */
+extern cw_context_t *cw_context_new(void);
+extern void cw_context_delete(cw_context_t **context);
+extern cw_context_t *cw_context_make_current(cw_context_t *context);
+extern cw_context_t *cw_context_get_current(void);
+
+
+
 /* Functions handling 'generator' */
 extern int  cw_generator_new(int audio_system, const char *device);
 extern void cw_generator_delete(void);
 extern int  cw_generator_start(void);
 extern void cw_generator_stop(void);
 extern const char *cw_generator_get_audio_system_label(void);
+extern cw_gen_t   *cw_generator_get(void);
 extern int  cw_generator_set_tone_slope(cw_gen_t *gen, int slope_shape, int slope_duration) __attribute__ ((deprecated)); /* You actually can't use this function since you don't have access to any gen variable. */
 
 /* Core Morse code data and lookup */
@@ -315,6 +335,10 @@ extern bool cw_is_console_possible(const char *device_name);
 extern bool cw_is_oss_possible(const char *device_name);
 extern bool cw_is_alsa_possible(const char *device_name);
 extern bool cw_is_pa_possible(const char *device_name);
+extern bool cw_is_file_possible(const char *device_name);
+extern bool cw_is_jack_possible(const char *device_name);
+extern bool cw_is_pipewire_possible(const char *device_name);
+extern bool cw_is_rtp_possible(const char *device_name);
 
 
 
@@ -62,14 +62,422 @@ typedef struct cw_key_struct cw_key_t;
 struct cw_rec_struct;
 typedef struct cw_rec_struct cw_rec_t;
 
+struct cw_mixer_struct;
+typedef struct cw_mixer_struct cw_mixer_t;
+
+struct cw_seq_struct;
+typedef struct cw_seq_struct cw_seq_t;
+
+struct cw_shm_ring_struct;
+typedef struct cw_shm_ring_struct cw_shm_ring_t;
+
+struct cw_batch_struct;
+typedef struct cw_batch_struct cw_batch_t;
+
+struct cw_rec_timing_struct;
+typedef struct cw_rec_timing_struct cw_rec_timing_t;
+
+struct cw_rec_pool_struct;
+typedef struct cw_rec_pool_struct cw_rec_pool_t;
+
+struct cw_rec_spec_struct;
+typedef struct cw_rec_spec_struct cw_rec_spec_t;
+
+struct cw_detector_struct;
+typedef struct cw_detector_struct cw_detector_t;
+
+struct cw_skimmer_struct;
+typedef struct cw_skimmer_struct cw_skimmer_t;
+
+struct cw_alphabet_struct;
+typedef struct cw_alphabet_struct cw_alphabet_t;
+
+struct cw_key_input_struct;
+typedef struct cw_key_input_struct cw_key_input_t;
+
+struct cw_netkey_sender_struct;
+typedef struct cw_netkey_sender_struct cw_netkey_sender_t;
+
+struct cw_netkey_receiver_struct;
+typedef struct cw_netkey_receiver_struct cw_netkey_receiver_t;
+
 typedef enum cw_audio_systems cw_sound_system_t;
 
+/**
+   @brief Engine used by generator to calculate samples of sine wave
+
+   All engines keep phase of sine wave continuous between consecutive
+   fragments of samples. The engines differ in precision and in CPU cost
+   of calculating a single sample.
+
+   CW_GEN_OSCILLATOR_SINF has value of zero, so zero-initialized generator
+   config selects the default engine.
+*/
+typedef enum cw_gen_oscillator_t {
+	/* sinf() is called for every sample. Most precise, most expensive. */
+	CW_GEN_OSCILLATOR_SINF = 0,
+
+	/* Recursive oscillator: a complex phasor is rotated by constant step
+	   for every sample. Only one sinf()/cosf() pair per fragment. */
+	CW_GEN_OSCILLATOR_PHASOR,
+
+	/* Phase accumulator indexing a precalculated table of sine values,
+	   with linear interpolation between table cells. */
+	CW_GEN_OSCILLATOR_TABLE,
+
+	/* Like CW_GEN_OSCILLATOR_TABLE, but with integer (Q15) table of
+	   sine values, integer slope amplitudes and integer phase. No
+	   floating point operations are done per sample, which is useful
+	   on targets without FPU. */
+	CW_GEN_OSCILLATOR_FIXED_POINT
+} cw_gen_oscillator_t;
+
+/**
+   @brief Format of samples sent by generator to sound device
+
+   Sound systems that can't accept requested format use
+   CW_SAMPLE_FORMAT_S16. CW_SAMPLE_FORMAT_S16 has value of zero, so
+   zero-initialized generator config selects the default format.
+*/
+typedef enum cw_sample_format_t {
+	CW_SAMPLE_FORMAT_S16 = 0,  /* Signed 16 bit, native byte order. */
+	CW_SAMPLE_FORMAT_S32,      /* Signed 32 bit, native byte order. */
+	CW_SAMPLE_FORMAT_FLOAT32   /* 32 bit float in range <-1.0; 1.0>, native byte order. */
+} cw_sample_format_t;
+
 typedef struct cw_gen_config_t {
 	cw_sound_system_t sound_system;
 	char sound_device[LIBCW_SOUND_DEVICE_NAME_SIZE];
 	long unsigned int alsa_period_size; /* "long unsigned" follows type of snd_pcm_uframes_t. */
+	bool alsa_mmap; /* Calculate samples directly in ring buffer of ALSA device, if the device supports mmap access. */
+	bool alsa_low_latency; /* Use smallest stable period size of ALSA device and start playback after first period. */
+	int oss_latency; /* [microseconds] Requested duration of samples held by buffer of OSS device. Fragments of the buffer are sized with SNDCTL_DSP_SETFRAGMENT, or, if the driver doesn't accept the size, with SNDCTL_DSP_POLICY. Zero: default fragments of 64 samples. See cw_gen_metrics_t::device_latency. */
+	bool sound_nonblocking; /* Don't block in writes to ALSA/OSS device, poll the device instead, so that generator can be stopped without waiting for a blocked write. */
+	bool pa_async; /* Use asynchronous PulseAudio stream that pulls samples from generator, with latency of tens of milliseconds (instead of pa_simple API). */
+	cw_gen_oscillator_t oscillator;
+	cw_sample_format_t sample_format; /* Requested format of samples sent to ALSA, PulseAudio or PipeWire device. */
+	int n_channels; /* Requested count of interleaved channels (1 or 2, zero means 1), all channels carry the same signal. */
+	unsigned int sample_rate; /* Sample rate of ALSA or OSS device to try before standard rates, e.g. 96000 or 192000. Zero for standard rates only. */
+	bool device_pool; /* Take configured ALSA, OSS or PulseAudio (simple API) device from library-wide pool, and put it there when generator is deleted. */
+	bool console_timeline; /* Switch console buzzer on and off at points of absolute CLOCK_MONOTONIC timeline, so that delays of generator thread don't accumulate over long transmissions. */
+	bool null_virtual_clock; /* Don't sleep in Null sound system, instantly advance virtual clock of generator (see cw_gen_get_timestamp()) by duration of each tone. */
+	bool sidetone_low_latency; /* When key used with generator goes down, discard silence waiting to be played by generator and by ALSA or OSS device, so that sidetone starts immediately. */
+	bool standby_on_stop; /* Let cw_gen_stop() only flush tone queue and silence generator, keeping generator's thread parked on empty tone queue and sound device running, so that next cw_gen_start() resumes within one period of sound device. Generator is fully stopped by cw_gen_delete(). */
+	int thread_sched_policy; /* Scheduling policy of generator's thread: SCHED_FIFO or SCHED_RR. Other values: default policy. When realtime policy can't be set (e.g. without CAP_SYS_NICE or RLIMIT_RTPRIO), the thread keeps running with default policy. */
+	int thread_sched_priority; /* Priority of generator's thread with SCHED_FIFO or SCHED_RR policy, from sched_get_priority_min() to sched_get_priority_max(). */
+	unsigned long long thread_cpu_affinity; /* Bit N set: generator's thread may run on CPU N. Zero: no affinity. Linux only. */
+	bool lock_memory; /* Lock current and future memory of the process (mlockall()), and pre-fault generator's buffers and stack of generator's thread, so that page faults don't delay generation of samples. */
+	bool preallocate; /* Allocate in cw_gen_new() all memory needed to generate tones, so that generator doesn't allocate memory while it works. See cw_gen_new(). */
+	int pipeline_n_buffers; /* Count of buffers of samples (2 or 3) in pipeline, in which generator calculates next buffer while a separate thread writes previous buffer to OSS, ALSA (without mmap), PulseAudio (simple API) or file. Adds up to (count - 1) buffers of latency. Zero or one: samples are calculated and written by the same thread, one buffer at a time. Ignored with low-latency sidetone. */
+	bool flush_on_empty_queue; /* When tone queue becomes empty, write samples from partially filled buffer to ALSA, OSS, PulseAudio (simple API) or file right away, instead of keeping them until next tones fill the buffer. See cw_gen_get_end_of_sound_time(). */
+	bool drift_compensation; /* Measure real rate of sample clock of ALSA, OSS or PulseAudio (simple API) device from delay reported by the device, and lengthen or shorten Spaces by the accumulated difference (and by fractions of samples lost in rounding durations of tones), so that long transmissions stay locked to system time. Durations of Marks are not changed. See cw_gen_metrics_t::sample_clock_drift_ppb. */
+	bool multi_producer_queue; /* Let many threads call cw_gen_enqueue_tones() at the same time without waiting for each other on a lock of tone queue. Tones of each call stay contiguous in the queue. */
+	bool adaptive_period; /* Write samples to ALSA device in quarters of period (and wake up on a quarter of period of free space) while key or paddle is used, and in full periods while generator plays queued text or silence. Ignored when pipeline is used. */
+	int idle_timeout; /* [ms] When tone queue has been empty, or generator has been playing only silent 'forever' tone of straight key, for this long: stop calculating silence and pause OSS device (ALSA device is drained and stopped already when queue becomes empty). Writing is resumed when next tone is enqueued. Zero: never. Sound systems pulling samples from generator (asynchronous PulseAudio, JACK, PipeWire) are not affected. */
 } cw_gen_config_t;
 
+/* Tone enqueued in generator with cw_gen_enqueue_tones(). */
+typedef struct cw_gen_tone_t {
+	int frequency; /* [Hz], zero for silence. */
+	int duration;  /* [microseconds] */
+} cw_gen_tone_t;
+
+/* Basic parameters of generator, set together with
+   cw_gen_set_parameters(). */
+typedef struct cw_gen_parameters_t {
+	int speed;      /* [wpm] */
+	int frequency;  /* [Hz] */
+	int volume;     /* [percents] */
+	int gap;        /* [number of Dot durations] */
+	int weighting;
+} cw_gen_parameters_t;
+
+/* Runtime metrics of generator, see cw_gen_get_metrics(). Counters
+   are cumulative since generator has been created. Times are in
+   microseconds. */
+typedef struct cw_gen_metrics_t {
+	uint64_t n_buffers_written;   /* Count of buffers of samples successfully written to sound device. */
+	uint64_t n_underruns;         /* Count of underruns (xruns) of sound device that have been recovered from. */
+	uint64_t n_wakeups;           /* Count of wakeups of generator's thread waiting for tones in empty queue. */
+	uint64_t write_time_min;      /* [microseconds] Shortest time spent on writing (blocked on) a buffer. */
+	uint64_t write_time_avg;      /* [microseconds] Average time spent on writing a buffer. */
+	uint64_t write_time_max;      /* [microseconds] Longest time spent on writing a buffer. */
+	uint64_t synthesis_time_avg;  /* [microseconds] Average time of calculating samples of a buffer, including post-processing (see cw_gen_add_dsp_bandpass()). */
+	uint64_t synthesis_time_max;  /* [microseconds] Longest time of calculating samples of a buffer, including post-processing. */
+	size_t queue_length_peak;     /* Largest count of tones that has been in generator's queue. */
+	int64_t sample_clock_drift_ppb; /* [parts per billion] Measured deviation of rate of sample clock of sound device from nominal rate, see cw_gen_config_t::drift_compensation. Zero if not measured. */
+	int device_latency;           /* [microseconds] Duration of samples that buffer of ALSA or OSS device can hold, as negotiated when the device has been opened. Zero if unknown. */
+	int period_n_samples;         /* Count of samples written to sound device at once (e.g. ALSA period or OSS fragment). */
+	uint64_t n_tone_ends;         /* Count of ends of tones that have been reported to cw_gen_wait_for_end_of_current_tone(). */
+} cw_gen_metrics_t;
+
+/* Types of Marks and Spaces watched by timing monitor of generator,
+   see cw_gen_enable_timing_monitor(). */
+typedef enum cw_gen_timing_element_t {
+	CW_GEN_TIMING_DOT = 0,  /* Dot. */
+	CW_GEN_TIMING_DASH,     /* Dash. */
+	CW_GEN_TIMING_IMS,      /* Inter-mark-space. */
+	CW_GEN_TIMING_ICS,      /* Inter-character-space (with additional space, if any). */
+	CW_GEN_TIMING_IWS,      /* Inter-word-space (with additional and adjustment spaces, if any). */
+
+	CW_GEN_TIMING_N_ELEMENTS
+} cw_gen_timing_element_t;
+
+/* Errors of durations of one type of Marks or Spaces played by
+   generator, see cw_gen_get_timing_statistics(). Error is the
+   difference between duration measured on generator's playback
+   timeline and ideal duration. */
+typedef struct cw_gen_timing_error_statistics_t {
+	uint64_t count;      /* Count of measured Marks or Spaces of this type. */
+	uint64_t n_alarms;   /* Count of Marks or Spaces whose error exceeded threshold of timing monitor. */
+	int32_t error_min;   /* [microseconds] Smallest (most negative) error. */
+	int32_t error_max;   /* [microseconds] Largest error. */
+	float error_mean;    /* [microseconds] Mean error. */
+	float jitter;        /* [microseconds] Standard deviation of error. */
+} cw_gen_timing_error_statistics_t;
+
+/* Timing statistics of generator, indexed with cw_gen_timing_element_t. */
+typedef struct cw_gen_timing_statistics_t {
+	cw_gen_timing_error_statistics_t elements[CW_GEN_TIMING_N_ELEMENTS];
+} cw_gen_timing_statistics_t;
+
+/* Function called by timing monitor of generator when error of
+   duration of a Mark or Space exceeds threshold, see
+   cw_gen_enable_timing_monitor(). Durations are in microseconds. */
+typedef void (* cw_gen_timing_alarm_callback_t)(void * callback_arg, cw_gen_timing_element_t element, int ideal_duration, int actual_duration);
+
+/* Quality of synthesis of generator, lowered and restored by quality
+   scaling, see cw_gen_enable_quality_scaling(). Each level includes
+   reductions of previous levels. */
+typedef enum cw_gen_quality_t {
+	CW_GEN_QUALITY_FULL = 0,  /* Configured oscillator engine and post-processing. */
+	CW_GEN_QUALITY_REDUCED,   /* CW_GEN_OSCILLATOR_TABLE engine is used instead of CW_GEN_OSCILLATOR_SINF and CW_GEN_OSCILLATOR_PHASOR. */
+	CW_GEN_QUALITY_MINIMAL    /* Stages of post-processing (band-pass filter, noise, fading) are bypassed. */
+} cw_gen_quality_t;
+
+/* Policy of quality scaling of generator, see
+   cw_gen_enable_quality_scaling(). Load is time of calculating
+   samples of a buffer (see cw_gen_metrics_t::synthesis_time_avg)
+   relative to duration of the samples. */
+typedef struct cw_gen_quality_policy_t {
+	int degrade_load;  /* [percents] Quality is lowered when mean load is above this value. */
+	int restore_load;  /* [percents] Quality is restored when mean load is below this value. Smaller than ::degrade_load. */
+	int n_buffers;     /* Count of buffers over which load is averaged before each decision. */
+} cw_gen_quality_policy_t;
+
+/* Function called by generator when quality scaling changes quality
+   of synthesis, see cw_gen_enable_quality_scaling(). @p load is mean
+   load that has caused the change [percents]. */
+typedef void (* cw_gen_quality_callback_t)(void * callback_arg, cw_gen_quality_t quality, int load);
+
+/* Function receiving text of metrics exported with
+   cw_gen_export_metrics() or cw_rec_export_metrics(). The text is
+   passed in pieces of one or more complete lines, not terminated with
+   NUL. */
+typedef void (* cw_metrics_write_callback_t)(void * callback_arg, const char * text, size_t length);
+
+/* Function receiving samples of generator, see cw_gen_add_sink().
+   Samples are mono. They are valid only until the function returns. */
+typedef void (* cw_gen_sink_callback_t)(void * callback_arg, const cw_sample_t * samples, int n_samples, int sample_rate);
+
+/* Statistics of sink of generator, see cw_gen_get_sink_statistics(). */
+typedef struct cw_gen_sink_statistics_t {
+	unsigned int n_buffers;   /* Count of buffers passed to sink's callback. */
+	unsigned int n_dropped;   /* Count of buffers dropped because sink didn't keep up with generator. */
+	unsigned int n_queued;    /* Count of buffers currently waiting for (or being processed by) sink's callback. */
+} cw_gen_sink_statistics_t;
+
+/* Count of most recent samples kept by tap of generator, see
+   cw_gen_enable_tap(). */
+#define CW_GEN_TAP_CAPACITY 65536
+
+/* Largest decimation of samples kept by tap of generator. */
+#define CW_GEN_TAP_DECIMATION_MAX 4096
+
+/* Decimation of samples kept by tap of generator, see
+   cw_gen_enable_tap(). */
+typedef enum cw_gen_tap_mode_t {
+	CW_GEN_TAP_SAMPLE = 0,  /* First sample of each group of samples (waveform, for oscilloscope). */
+	CW_GEN_TAP_PEAK         /* Largest absolute value in each group of samples (envelope, for display of keying). */
+} cw_gen_tap_mode_t;
+
+/* Values of cw_shm_ring_header_t::magic and
+   cw_shm_ring_header_t::version. */
+#define CW_SHM_RING_MAGIC   0x52535743u  /* "CWSR" on little-endian machine. */
+#define CW_SHM_RING_VERSION 1
+
+/* Header at the beginning of shared memory object of ring of samples,
+   see cw_shm_ring_new(). Layout of the header is fixed within given
+   ::version, so readers don't have to link with libcw. All fields
+   are in native byte order. Fields modified by writer after creation
+   of the ring (::sample_rate, ::futex, ::reserve_position,
+   ::write_position) must be
+   read with atomic loads. */
+typedef struct cw_shm_ring_header_t {
+	uint32_t magic;           /* CW_SHM_RING_MAGIC, set as the last field of a new ring. */
+	uint32_t version;         /* CW_SHM_RING_VERSION. */
+	uint32_t header_size;     /* [bytes] Offset of first sample from beginning of shared memory object. */
+	uint32_t capacity;        /* [samples] Size of ring, power of two. */
+	uint32_t sample_rate;     /* [Hz] Sample rate of recently written samples, zero before first write. */
+	uint32_t sample_size;     /* [bytes] Size of sample: sizeof (cw_sample_t), signed mono samples. */
+	uint32_t futex;           /* Incremented after every write. Readers without new samples sleep on this word with FUTEX_WAIT. */
+	uint32_t n_waiters;       /* Count of readers sleeping on ::futex. Writer calls FUTEX_WAKE only when it's non-zero. */
+	uint64_t reserve_position; /* [samples] Position up to which writer is writing samples. Stored before the samples are written. */
+	uint64_t write_position;  /* [samples] Count of all samples written to ring. Sample at position p is at index (p % capacity). */
+} cw_shm_ring_header_t;
+
+/* Mark or Space produced by sequencer, see cw_seq_send_string(). */
+typedef struct cw_seq_event_t {
+	bool is_mark;
+	int64_t start;    /* [microseconds] On sequencer's timeline, see cw_seq_get_time(). */
+	int64_t duration; /* [microseconds] */
+} cw_seq_event_t;
+
+/* Function receiving events of sequencer. */
+typedef void (* cw_seq_event_callback_t)(void * callback_arg, const cw_seq_event_t * event);
+
+/* Mark or Space of recorded keying, passed to cw_rec_receive_edges().
+   Same shape as element of recording made with cwutils. */
+typedef struct cw_rec_edge_t {
+	double timespan; /* [microseconds] Duration of Mark or Space. */
+	bool is_mark;
+} cw_rec_edge_t;
+
+/* Estimators of durations of Dots and Dashes used by receiver in adaptive
+   mode, see cw_rec_set_averaging(). */
+typedef enum cw_rec_averaging_mode_t {
+	CW_REC_AVERAGING_MOVING = 0,  /* Moving average of last N Marks (default). */
+	CW_REC_AVERAGING_EXPONENTIAL, /* Exponentially weighted moving average, with weight 2/(N+1). */
+	CW_REC_AVERAGING_MEDIAN       /* Median of last N Marks, robust against single Marks distorted by QSB or noise. */
+} cw_rec_averaging_mode_t;
+
+/* Deviations of durations of one type of Marks or Spaces received by
+   receiver from ideal durations, see cw_rec_get_statistics(). */
+typedef struct cw_rec_duration_statistics_t {
+	int count;        /* Count of received Marks or Spaces of this type. */
+	float mean_delta; /* [microseconds] Mean difference between received and ideal duration. */
+	float sd;         /* [microseconds] Root mean square of differences between received and ideal duration. */
+} cw_rec_duration_statistics_t;
+
+/* Timing statistics of receiver, calculated over last 256 received
+   Marks and Spaces. */
+typedef struct cw_rec_statistics_t {
+	cw_rec_duration_statistics_t dot;
+	cw_rec_duration_statistics_t dash;
+	cw_rec_duration_statistics_t inter_mark_space;
+	cw_rec_duration_statistics_t inter_character_space;
+} cw_rec_statistics_t;
+
+/* Timing of keying of a station ("fist"), see cw_rec_get_profile()
+   and cw_rec_set_profile(). Ratios of durations describe weighting
+   and spacing of the station. Members have fixed sizes, so that
+   arrays of profiles can be stored in files as they are. */
+typedef struct cw_rec_profile_t {
+	int32_t dot_duration;  /* [microseconds] Average duration of Dot. */
+	int32_t dash_duration; /* [microseconds] Average duration of Dash. */
+	int32_t ims_duration;  /* [microseconds] Average duration of inter-mark-space. */
+	int32_t ics_duration;  /* [microseconds] Average duration of inter-character-space. */
+	int32_t tolerance;     /* [percents] Tolerance of fixed speed receiving mode. */
+} cw_rec_profile_t;
+
+/* Count of bins of histogram of decode latency in cw_rec_metrics_t. Bin
+   0 counts latencies shorter than 25 ms, each next bin counts latencies
+   up to twice as long as the previous one (bin 1: 25-50 ms, bin 2:
+   50-100 ms, etc.), last bin counts latencies of 1.6 s and longer. */
+#define CW_REC_LATENCY_HISTOGRAM_N_BINS 8
+
+/* Runtime metrics of receiver, see cw_rec_get_metrics(). Counters are
+   cumulative since receiver has been created. */
+typedef struct cw_rec_metrics_t {
+	uint64_t n_marks_accepted;              /* Count of Marks identified as Dots or Dashes and added to representation. */
+	uint64_t n_spikes_rejected;             /* Count of Marks rejected as noise spikes (see cw_rec_set_noise_spike_threshold()). */
+	uint64_t n_marks_unrecognized;          /* Count of Marks that were neither Dots nor Dashes. */
+	uint64_t n_representations_unrecognized; /* Count of complete representations that didn't match any character. */
+	uint64_t n_buffer_overflows;            /* Count of representations that didn't fit in receiver's buffer. */
+	uint64_t n_speed_changes;               /* Count of changes of speed (in whole WPM) made in adaptive mode. */
+	uint64_t n_characters;                  /* Count of characters whose end has been recognized. */
+
+	/* Histogram of end-of-character decode latency: time from end of
+	   last Mark of a character to the moment when receiver, polled
+	   by client code, has recognized the end of the character. */
+	uint64_t decode_latency[CW_REC_LATENCY_HISTOGRAM_N_BINS];
+} cw_rec_metrics_t;
+
+/* Character of alphabet, see cw_alphabet_new(). */
+typedef struct cw_alphabet_entry_t {
+	uint32_t code_point;          /* Unicode code point of the character. */
+	const char * representation;  /* Dots and Dashes, up to 7 marks. */
+} cw_alphabet_entry_t;
+
+/* Alphabets built into libcw, see cw_alphabet_new_builtin(). */
+typedef enum cw_alphabet_id_t {
+	CW_ALPHABET_LATIN = 0,  /* Accented Latin letters of main table of characters. */
+	CW_ALPHABET_CYRILLIC,   /* Russian Morse code. */
+	CW_ALPHABET_GREEK,      /* Greek Morse code. */
+	CW_ALPHABET_WABUN       /* Japanese Wabun code (katakana). */
+} cw_alphabet_id_t;
+
+/* Callback receiving characters from receiver, see
+   cw_rec_register_character_callback(). @p character is ' ' when
+   @p is_end_of_word is true. */
+typedef void (* cw_rec_character_callback_t)(void * callback_arg, char character, bool is_end_of_word, bool is_error);
+
+/* Character decoded by cw_rec_receive_edges() or cw_rec_poll_batch(). */
+typedef struct cw_rec_decoded_t {
+	char character;    /* Received character, or ' ' for inter-word-space. */
+	int64_t timestamp; /* [microseconds] Beginning of the character's first Mark, or of the inter-word-space. */
+} cw_rec_decoded_t;
+
+/* Compact receiver, see cw_rec_compact_init(). Members are private to
+   libcw: the type is defined here only so that client code can keep
+   thousands of receivers in one contiguous array. */
+typedef struct cw_rec_compact_t {
+	int64_t mark_start;          /* [microseconds] */
+	int64_t mark_end;            /* [microseconds] */
+	int32_t unit_average;        /* [microseconds] */
+	uint8_t representation_bits; /* Dash is 1, Dot is 0, last Mark in lowest bit. */
+	uint8_t n_marks;
+	uint8_t state;
+	uint8_t speed;               /* [wpm] */
+	bool is_adaptive;
+} cw_rec_compact_t;
+
+/* Event passed to compact receiver by cw_rec_compact_update(). */
+typedef enum {
+	CW_REC_COMPACT_POLL = 0,     /* No change of key, only passing of time. */
+	CW_REC_COMPACT_MARK_BEGIN,
+	CW_REC_COMPACT_MARK_END
+} cw_rec_compact_event_t;
+
+typedef struct cw_rec_compact_input_t {
+	int64_t timestamp;           /* [microseconds] */
+	cw_rec_compact_event_t event;
+} cw_rec_compact_input_t;
+
+/* Result of one update of compact receiver. Every character and
+   every inter-word-space is reported only once. */
+typedef struct cw_rec_compact_output_t {
+	char character;              /* Received character, or '\0' if no character has been completed. */
+	bool is_end_of_word;         /* Inter-word-space has been recognized. */
+	bool is_error;               /* Received Marks didn't form a valid character. */
+} cw_rec_compact_output_t;
+
+/* Running totals of deviations of durations received by compact
+   receivers from ideal durations, see cw_rec_compact_get_statistics().
+   Indexed by type: Dot, Dash, inter-mark-space, inter-character-space. */
+typedef struct cw_rec_compact_stats_t {
+	int64_t sum[4];              /* [microseconds] */
+	int64_t sum_of_squares[4];   /* [microseconds^2] */
+	int count[4];
+} cw_rec_compact_stats_t;
+
+/* Character decoded by receiver of a pool, see cw_rec_pool_read(). */
+typedef struct cw_rec_pool_decoded_t {
+	int channel;       /* Index of channel (receiver) in the pool. */
+	char character;    /* Received character, or ' ' for inter-word-space. */
+	int64_t timestamp; /* [microseconds] Beginning of the character's first Mark, or of the inter-word-space. */
+} cw_rec_pool_decoded_t;
+
 
 
 
@@ -89,6 +497,240 @@ cw_ret_t cw_get_package_version(int * major, int * minor, int * maintenance);
 
 
 
+/* **************** Data **************** */
+
+
+
+
+/* Value of translated ' ' character, see cw_translate_string(). */
+#define CW_TRANSLATED_SPACE 0
+
+
+
+
+/**
+   @brief Get representation of a character
+
+   Unlike cw_character_to_representation(), the function doesn't copy
+   the representation. Returned string is owned by library and is valid
+   for life of the program.
+
+   Lower case and upper case letters have the same representation.
+
+   @exception ENOENT @p character is not a valid Morse character
+
+   @param[in] character character to look up
+
+   @return representation of the character (Dots and Dashes) on success
+   @return NULL on failure
+*/
+const char * cw_character_get_representation(int character);
+
+
+
+
+/**
+   @brief Get representation of a character packed into bits
+
+   Marks of the representation are returned in @p n_marks least
+   significant bits of @p bits, first mark in the most significant of
+   these bits. Dash is 1, Dot is 0. This is the value returned by
+   cw_translate_string() without the start bit.
+
+   @exception ENOENT @p character is not a valid Morse character
+
+   @param[in] character character to look up
+   @param[out] n_marks count of marks in representation
+   @param[out] bits marks of representation
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_character_get_packed_representation(int character, unsigned int * n_marks, unsigned int * bits);
+
+
+
+
+/**
+   @brief Get expansion of a procedural signal character
+
+   Unlike cw_lookup_procedural_character(), the function doesn't copy the
+   expansion. Returned string is owned by library and is valid for life
+   of the program.
+
+   @exception ENOENT @p character is not a procedural signal character
+
+   @param[in] character character to look up
+   @param[out] is_usually_expanded display hint (may be NULL)
+
+   @return expansion of the character on success
+   @return NULL on failure
+*/
+const char * cw_character_get_procedural_expansion(int character, bool * is_usually_expanded);
+
+
+
+
+/**
+   @brief Get phonetic of a letter
+
+   Unlike cw_lookup_phonetic(), the function doesn't copy the phonetic.
+   Returned string is owned by library and is valid for life of the
+   program.
+
+   @exception ENOENT @p character is not a letter
+
+   @param[in] character letter to look up
+
+   @return phonetic of the letter on success
+   @return NULL on failure
+*/
+const char * cw_character_get_phonetic(int character);
+
+
+
+
+/**
+   @brief Validate a string and translate it into packed representations of its characters
+
+   Each character of @p string is translated into one byte of @p
+   translated: representation of the character packed into bits of the
+   byte (Dash is 1, Dot is 0, preceded by a single start bit), or
+   CW_TRANSLATED_SPACE for ' ' character. The string is validated and
+   translated in a single pass. The translated string can be enqueued in
+   generator with cw_gen_enqueue_translated_string().
+
+   Lower case and upper case letters are translated into the same
+   value.
+
+   @exception EINVAL @p string or @p translated is NULL
+
+   @exception ENOENT @p string contains a character that is not a valid
+   Morse character. Index of the character is returned through @p
+   n_translated.
+
+   @exception ENOSPC @p capacity of @p translated is smaller than length of
+   @p string
+
+   @param[in] string string to translate
+   @param[out] translated buffer for translated characters
+   @param[in] capacity count of bytes in @p translated
+   @param[out] n_translated count of translated characters
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_translate_string(const char * string, uint8_t * translated, size_t capacity, size_t * n_translated);
+
+
+
+
+
+/* **************** Alphabet **************** */
+
+
+
+
+/**
+   @brief Create new alphabet
+
+   Alphabet maps Unicode code points of characters to their
+   representations. Entries are copied, @p entries can be discarded
+   after the call. Representations of different characters may be
+   the same, but code points must be unique.
+
+   Code points of ASCII characters that are not present in alphabet are
+   looked up in library's main table of characters.
+
+   Returned pointer is owned by caller. Delete the allocated alphabet
+   with cw_alphabet_delete().
+
+   @exception EINVAL @p entries is NULL or empty, or one of entries has
+   invalid or duplicate code point, or invalid representation
+
+   @param[in] entries characters of alphabet
+   @param[in] n_entries count of entries in @p entries
+
+   @return pointer to new alphabet on success
+   @return NULL on failure
+*/
+cw_alphabet_t * cw_alphabet_new(const cw_alphabet_entry_t * entries, size_t n_entries);
+
+
+
+
+/**
+   @brief Create new alphabet from one of alphabets built into libcw
+
+   Built-in alphabets have both upper case and lower case forms of
+   letters.
+
+   @exception EINVAL @p id is invalid
+
+   @param[in] id identifier of alphabet
+
+   @return pointer to new alphabet on success
+   @return NULL on failure
+*/
+cw_alphabet_t * cw_alphabet_new_builtin(cw_alphabet_id_t id);
+
+
+
+
+/**
+   @brief Delete an alphabet
+
+   @param[in,out] alphabet pointer to alphabet to delete
+*/
+void cw_alphabet_delete(cw_alphabet_t ** alphabet);
+
+
+
+
+/**
+   @brief Get representation of a character of alphabet
+
+   @exception EINVAL @p alphabet is NULL
+
+   @exception ENOENT there is no character with @p code_point in @p
+   alphabet or in main table of characters
+
+   @param[in] alphabet alphabet
+   @param[in] code_point Unicode code point of character
+
+   @return representation of the character on success
+   @return NULL on failure
+*/
+const char * cw_alphabet_code_point_to_representation(const cw_alphabet_t * alphabet, uint32_t code_point);
+
+
+
+
+/**
+   @brief Get character of alphabet with given representation
+
+   Use the function to decode representations received with
+   cw_rec_poll_representation(). If more than one character of @p
+   alphabet has the same representation, the first of them is
+   returned.
+
+   @exception EINVAL @p alphabet or @p representation is NULL, or @p
+   representation is invalid
+
+   @exception ENOENT there is no character with @p representation in @p
+   alphabet or among ASCII characters of main table of characters
+
+   @param[in] alphabet alphabet
+   @param[in] representation representation of character
+
+   @return Unicode code point of the character on success
+   @return zero on failure
+*/
+uint32_t cw_alphabet_representation_to_code_point(const cw_alphabet_t * alphabet, const char * representation);
+
+
+
+
 /* **************** Generator **************** */
 
 
@@ -104,6 +746,22 @@ cw_ret_t cw_get_package_version(int * major, int * minor, int * maintenance);
    Returned pointer is owned by caller. Delete the allocated generator with
    cw_gen_delete().
 
+   With cw_gen_config_t::preallocate set, the function also allocates
+   all memory that the generator needs to generate tones: slots of tone
+   queue for its whole capacity, tables of slopes up to 50 ms, cache of pre-rendered tones and
+   loop of plateau of long tones. After that, the generator and its
+   tone queue don't allocate memory while tones are enqueued, dequeued
+   and generated, also when speed, frequency, volume, gap, weighting
+   or shape of slopes are changed, as long as:
+   @li strings are not longer than 256 characters,
+   @li tones are enqueued with cw_gen_enqueue_tones() in batches not
+       larger than 32 tones.
+
+   Receiver (cw_rec_t) doesn't allocate memory after cw_rec_new(). Use
+   cw_character_get_representation() instead of
+   cw_character_to_representation(), which returns a copy of
+   representation.
+
    @internal
    @reviewed 2020-10-21
    @endinternal
@@ -183,6 +841,121 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen);
 
 
 
+/**
+   @brief Render samples of generator's tones on demand
+
+   Instead of starting a generator with cw_gen_start() and letting
+   generator's thread write samples to a sound device, client code can
+   request exactly @p n_samples samples calculated from tones enqueued in
+   @p gen. This is useful when samples are needed by a realtime callback
+   of an external sound engine. No thread is created and the function
+   never waits: if there are too few tones in the queue, @p samples are
+   padded with silence.
+
+   The generator should be created with CW_AUDIO_NULL sound system, and
+   it must not be started with cw_gen_start(). Samples are calculated for
+   generator's sample rate.
+
+   @param[in] gen generator from which to render samples
+   @param[out] samples array for samples
+   @param[in] n_samples count of samples to render
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid arguments or for started generator
+*/
+cw_ret_t cw_gen_render(cw_gen_t * gen, cw_sample_t * samples, size_t n_samples);
+
+
+
+
+/**
+   @brief Render samples of a string using a few threads
+
+   Calculate all samples of @p string, as if the string was enqueued
+   in @p gen with cw_gen_enqueue_string() and samples of all its tones
+   were calculated with one call to cw_gen_render(). Samples are
+   identical to the ones calculated that way, and phase of sine wave of
+   @p gen continues from the end of the string, but the work is split
+   between @p n_workers threads. This is useful for offline rendering
+   of long texts (e.g. lessons lasting hours).
+
+   The string is split into segments at spaces between words, and each
+   segment is rendered by its own thread with a copy of @p gen,
+   directly into its place in the returned samples. Phase of sine wave
+   and state of modulation at the beginning of each segment are found
+   first in a quick pass through tones of the string. With generator's
+   cache of tones the pass calculates almost no samples, but tones with
+   gain or chirp modulation are calculated twice.
+
+   The generator must not be started with cw_gen_start(), and its tone
+   queue must be empty. Samples are calculated for generator's sample
+   rate. Speed, frequency, volume, gap, weighting, slopes and modulation
+   of @p gen are used.
+
+   Samples are returned in memory allocated by the function. The caller
+   must free() it.
+
+   @exception EINVAL @p gen, @p string, @p samples or @p n_samples is NULL, @p n_workers is out of range, @p gen is started, or its tone queue isn't empty
+   @exception ENOENT @p string contains invalid characters
+   @exception ENOMEM memory for samples can't be allocated
+   @exception EAGAIN threads can't be created
+
+   @param[in] gen generator from which to render samples
+   @param[in] string string to render
+   @param[in] n_workers count of threads rendering samples, including calling thread (0-64). Zero means count of CPUs.
+   @param[out] samples pointer to samples of @p string
+   @param[out] n_samples count of samples in @p samples
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_render_string(cw_gen_t * gen, const char * string, int n_workers, cw_sample_t ** samples, size_t * n_samples);
+
+
+
+
+/**
+   @brief Send a string from generator straight to receiver, in virtual time
+
+   Tones of @p string are enqueued in @p gen and taken from its tone
+   queue in calling thread, but their samples are not calculated: only
+   counts of samples are. Each change of generator's value (beginning
+   of Mark, beginning of Space) is passed to @p rec, with timestamps
+   derived from counts of samples played so far, as if the generator
+   played the tones to a sound device and the receiver listened to
+   it. Characters recognized by @p rec are stored in @p decoded, in
+   the same way as by cw_rec_receive_edges().
+
+   No thread is created and the function never waits, so round trips
+   of long texts between generator and receiver can be validated (and
+   benchmarked) much faster than in real time.
+
+   The generator should be created with CW_AUDIO_NULL sound system, and
+   it must not be started with cw_gen_start(). Tones that are already
+   in generator's queue are sent before @p string. Virtual time starts
+   at zero when generator is created, and continues in next call of
+   the function. The last Space of @p string ends the call, so the last
+   character of @p string is always recognized.
+
+   @exception EINVAL @p gen, @p rec, @p string, @p decoded or @p n_decoded is NULL, or @p gen is started
+   @exception ENOENT @p string contains invalid characters
+   @exception ENOMEM more characters were received than @p capacity
+
+   @param[in] gen generator sending the string
+   @param[in,out] rec receiver receiving the string
+   @param[in] string string to send
+   @param[out] decoded received characters
+   @param[in] capacity count of items that fit into @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_loopback_string(cw_gen_t * gen, cw_rec_t * rec, const char * string, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
+
+
+
+
 /**
    @brief Set label (name) of given generator instance
 
@@ -381,6 +1154,113 @@ cw_ret_t cw_gen_set_weighting(cw_gen_t * gen, int new_value);
 
 
 
+/**
+   @brief Set speed, frequency, volume, gap and weighting of generator at once
+
+   All values in @p parameters are validated first, and if any of them
+   is out of range, none of them is set.
+
+   The values are not applied immediately. They are stored in generator
+   and applied together, with one recalculation of durations of Marks
+   and Spaces and (if volume changes) one recalculation of amplitudes of
+   slopes, when the generator needs them: by generator's thread at the
+   beginning of next tone, or by the next call that enqueues tones. A
+   series of calls made in quick succession (e.g. by a spin box being
+   dragged in UI) results in only one recalculation, with the values
+   from the last call.
+
+   Tones that are already in generator's queue keep their durations and
+   frequencies.
+
+   cw_gen_get_speed() and other single-parameter getters return values
+   that have been applied. Use cw_gen_get_parameters() to get the values
+   that will be applied.
+
+   @exception EINVAL a value in @p parameters is out of range.
+
+   @param[in] gen generator for which to set parameters
+   @param[in] parameters new values of parameters
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_parameters(cw_gen_t * gen, const cw_gen_parameters_t * parameters);
+
+
+
+
+/**
+   @brief Get speed, frequency, volume, gap and weighting of generator
+
+   If parameters set with cw_gen_set_parameters() are still waiting to
+   be applied, these are the parameters that are returned.
+
+   @param[in] gen generator from which to get parameters
+   @param[out] parameters current values of parameters
+*/
+void cw_gen_get_parameters(cw_gen_t * gen, cw_gen_parameters_t * parameters);
+
+
+
+
+/**
+   @brief Change gain of generator gradually
+
+   Gain scales amplitude of Marks on top of generator's volume. It
+   changes linearly, sample by sample, from its current value to @p
+   gain over @p duration microseconds, and the change goes on through
+   Spaces between Marks. This can be used to simulate fading (QSB)
+   without enqueueing many short tones or changing volume, which
+   recalculates slopes of tones.
+
+   The change starts with next fragment of samples calculated by
+   generator. Call the function again to change direction of fading; a
+   new change starts from the gain reached by the previous one.
+
+   Initial gain is 100 (full volume). As long as gain is lower than
+   that, samples of tones are calculated for every tone instead of
+   being reused.
+
+   @exception EINVAL @p gain is out of range 0-100, or @p duration is negative.
+
+   @param[in] gen generator
+   @param[in] gain target gain [percents of volume]
+   @param[in] duration duration of change [microseconds], zero: change at once
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_gain(cw_gen_t * gen, int gain, int duration);
+
+
+
+
+/**
+   @brief Set chirp of Marks
+
+   With chirp, frequency of the first sample of every Mark is shifted by
+   @p offset Hz, and the shift decreases linearly to zero over @p
+   duration microseconds (like in transmitter with unstable oscillator).
+   Frequency is interpolated for every sample in synthesis loop.
+
+   New chirp is applied from the beginning of next Mark. Zero @p offset
+   or zero @p duration turns chirp off.
+
+   @exception EINVAL @p offset is out of range -CW_FREQUENCY_MAX to
+   CW_FREQUENCY_MAX, or @p duration is out of range 0-1000000.
+
+   @param[in] gen generator
+   @param[in] offset shift of frequency at the beginning of Mark [Hz]
+   @param[in] duration duration of chirp [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_chirp(cw_gen_t * gen, int offset, int duration);
+
+
+
+
 /**
    @brief Get sending speed from generator
 
@@ -652,34 +1532,398 @@ cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string);
 
 
 /**
-   @brief Wait for generator's tone queue to drain until only as many tones as given in @p level remain queued
+   @brief Enqueue a string in generator, to be started at given time
 
-   This function is for use by programs that want to optimize
-   themselves to avoid the cleanup that happens when generator's tone
-   queue drains completely. Such programs have a short time in which
-   to add more tones to the queue.
+   Function works as cw_gen_enqueue_string(), but first Mark of the
+   string starts to play at @p timestamp (see cw_gen_get_timestamp()),
+   e.g. on a given second of synchronized clock.
 
-   @internal
-   TODO: in current implementation of library most of the cleanup has been removed.
-   @endinternal
+   The string is preceded by silence. Duration of the silence is
+   calculated by generator when generator gets to the silence in its
+   tone queue, from delay of samples waiting in generator's buffers and
+   in sound device. The accuracy is then limited by accuracy of delay
+   reported by sound system, not by duration of tones that are already
+   in tone queue.
 
-   The function returns when queue's level is equal to or lower than @p
-   level.  If at the time of function call the level of queue is already
-   equal to or lower than @p level, function returns immediately.
+   If tones that are in tone queue end after @p timestamp, the string
+   is played right after them.
 
-   Notice that generator must be running (started with cw_gen_start())
-   when this function is called, otherwise it will be waiting forever
-   for a change of tone queue's level that will never happen.
+   Only one start may be scheduled at a time: the function fails with
+   EBUSY until generator gets to the silence preceding previously
+   scheduled string, or until tone queue is flushed.
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
+   @exception EINVAL @p gen or @p timestamp is NULL, or @p timestamp
+   is not in the future, or is too far (more than INT_MAX
+   microseconds) in the future
 
-   @param[in] gen generator on which to wait
-   @param[in] level level in queue, at which to return
+   @exception ENOENT @p string argument is invalid. No tones are enqueued.
 
-   @return CW_SUCCESS
-*/
+   @exception EBUSY start of another string is already scheduled
+
+   @exception EAGAIN generator's tone queue is full, see cw_gen_enqueue_string()
+
+   @param[in] gen generator to use
+   @param[in] timestamp time at which first Mark of the string should start
+   @param[in] string string to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_at(cw_gen_t * gen, const struct timeval * timestamp, const char * string);
+
+
+
+
+/**
+   @brief Enqueue a translated string in generator, to be sent using Morse code
+
+   Function works as cw_gen_enqueue_string(), but characters are already
+   validated and translated with cw_translate_string(). Use it when the
+   same text is sent more than once, or when the text has been
+   validated anyway.
+
+   @exception EINVAL @p gen is NULL, or @p translated is NULL while @p
+   n_translated is non-zero, or @p translated contains a value that is
+   not a translated character. No tones are enqueued.
+
+   @exception EAGAIN generator's tone queue is full. An indeterminate
+   number of the characters will have already been queued.
+
+   @param[in] gen generator to use
+   @param[in] translated characters translated with cw_translate_string()
+   @param[in] n_translated count of characters in @p translated
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_translated_string(cw_gen_t * gen, const uint8_t * translated, size_t n_translated);
+
+
+
+
+typedef void (* cw_gen_token_callback_t)(void * arg, uint64_t token);
+/**
+   @brief Enqueue a string in generator, get a token completed when the string has been played
+
+   Function works as cw_gen_enqueue_string(), and additionally returns
+   through @p token a number identifying the string. Last tone of the
+   string is marked in generator's tone queue, and the token is
+   completed when generator has played that tone. Use
+   cw_gen_is_token_completed(), cw_gen_wait_for_token() or callback
+   registered with cw_gen_register_token_callback() to learn when the
+   string has been played, instead of polling length of tone queue.
+
+   Tokens are increasing numbers, starting with 1. Tokens are completed
+   in the order in which their strings have been enqueued, so completion
+   of a token means that all strings with lower tokens have been played
+   too. Token of an empty string is completed right away.
+
+   Flushing generator's queue (cw_gen_flush_queue(), cw_gen_stop())
+   completes all tokens. If last character of a string is removed with
+   cw_gen_remove_last_character(), the string's token is completed
+   together with token of previous string, or right away if there is no
+   such token waiting for completion.
+
+   Strings enqueued with the function from many threads at the same time
+   are serialized.
+
+   @exception ENOENT @p string is invalid. No tones are enqueued.
+
+   @exception EINVAL @p gen or @p token is NULL
+
+   @exception EAGAIN generator's tone queue is full, see cw_gen_enqueue_string()
+
+   @param[in] gen generator to use
+   @param[in] string string to enqueue
+   @param[out] token token of the string
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure, no token is returned then
+*/
+cw_ret_t cw_gen_enqueue_string_with_token(cw_gen_t * gen, const char * string, uint64_t * token);
+
+
+
+
+/**
+   @brief Check if given token has been completed
+
+   @param[in] gen generator
+   @param[in] token token returned by cw_gen_enqueue_string_with_token()
+
+   @return true if string of the token has been played (or discarded)
+   @return false otherwise
+*/
+bool cw_gen_is_token_completed(cw_gen_t * gen, uint64_t token);
+
+
+
+
+/**
+   @brief Wait until given token is completed
+
+   The function returns right away if the token is already completed.
+
+   A token is completed before callback registered with
+   cw_gen_register_token_callback() is called for it, so the callback
+   may still be running, or may not have been called yet, when this
+   function returns.
+
+   Notice that generator must be running (started with cw_gen_start())
+   when this function is called, otherwise it will be waiting forever
+   for tones that will never be played.
+
+   @exception EINVAL @p token has not been returned by generator yet
+
+   @param[in] gen generator on which to wait
+   @param[in] token token returned by cw_gen_enqueue_string_with_token()
+
+   @return CW_SUCCESS when the token is completed
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_wait_for_token(cw_gen_t * gen, uint64_t token);
+
+
+
+
+/**
+   @brief Register a callback called when a token is completed
+
+   The callback is called once for every completed token, with @p
+   callback_arg and the token as arguments. The callback is usually
+   called from generator's thread, right after last tone of the token's
+   string has been played, but it is also called from a thread that
+   flushes generator's queue or removes a character from the queue.
+   Tokens completed at once are passed to the callback in order of
+   tokens, but calls from different threads may overlap. The callback
+   shouldn't block.
+
+   The callback is called after the token has been completed: at the
+   time of the call cw_gen_is_token_completed() already returns true
+   for the token, and cw_gen_wait_for_token() may have already
+   returned. Clients that need to know that the callback has run must
+   synchronize with the callback themselves.
+
+   Descriptor returned by cw_gen_get_queue_event_fd() becomes readable
+   when a token is completed by generator's thread, so clients that
+   watch the descriptor can check tokens with
+   cw_gen_is_token_completed() instead of registering the callback.
+
+   If @p callback_func is NULL, a callback registered earlier is
+   unregistered.
+
+   @param[in,out] gen generator
+   @param[in] callback_func callback function to be registered
+   @param[in] callback_arg pointer to be passed to the callback when the callback is called
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_gen_register_token_callback(cw_gen_t * gen, cw_gen_token_callback_t callback_func, void * callback_arg);
+
+
+
+
+
+/**
+   @brief Enqueue a given UTF-8 string in generator, to be sent using Morse code
+
+   Characters of @p string are looked up in @p alphabet (see
+   cw_alphabet_code_point_to_representation()). ' ' character is
+   enqueued as inter-word-space.
+
+   @exception EINVAL @p gen, @p alphabet or @p string is NULL
+
+   @exception EILSEQ @p string is not a valid UTF-8 string. No tones are
+   enqueued.
+
+   @exception ENOENT @p string contains a character that is not present
+   in @p alphabet. No tones are enqueued.
+
+   @exception EAGAIN generator's tone queue is full. An indeterminate
+   number of the characters will have already been queued.
+
+   @param[in] gen generator to use
+   @param[in] alphabet alphabet of characters of @p string
+   @param[in] string UTF-8 string to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_utf8_string(cw_gen_t * gen, const cw_alphabet_t * alphabet, const char * string);
+
+
+
+
+/**
+   @brief Enqueue a string in generator's priority lane
+
+   Characters of @p string are played ahead of tones already queued in
+   generator, without flushing them. Generator switches to the string at
+   the nearest boundary of characters: a character being played is
+   completed first, and then the whole @p string is played before
+   generator returns to the remaining queued characters.
+
+   Use this function for short, urgent messages (e.g. a correction of
+   callsign sent in the middle of long CQ). Priority lane can hold only
+   512 tones, and it is not governed by
+   generator's high water mark or low water callbacks. Tones in the
+   lane are counted by cw_gen_get_queue_length().
+
+   @exception EINVAL @p gen or @p string is NULL
+
+   @exception ENOENT @p string contains invalid character. None of the
+   characters is enqueued.
+
+   @exception EAGAIN priority lane is full. An indeterminate number of
+   the characters from the string will have already been queued.
+
+   @param[in] gen generator to use
+   @param[in] string string to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_priority_string(cw_gen_t * gen, const char * string);
+
+
+
+
+/**
+   @brief Enqueue many tones in generator at once
+
+   All @p n_tones tones from @p tones are added to generator's tone queue
+   at once. This is much cheaper than enqueueing the tones one by one,
+   and generator is notified about new tones only once.
+
+   Either all tones are enqueued, or none of them. Tones with duration
+   equal to zero are ignored.
+
+   The tones are played with standard slopes, as tones enqueued with
+   cw_queue_tone().
+
+   Generator created with cw_gen_config_t::multi_producer_queue accepts
+   tones from many threads calling this function at the same time.
+   Tones from each call are played one after another, they are not
+   interleaved with tones from other calls.
+
+   @exception EINVAL frequency or duration of one of tones is invalid
+   (frequency out of range of CW_FREQUENCY_MIN-CW_FREQUENCY_MAX, negative
+   duration), or @p tones is NULL. None of the tones is enqueued.
+
+   @exception EAGAIN high water mark of generator's tone queue would be
+   exceeded by the tones. None of the tones is enqueued.
+
+   @param[in] gen generator to use
+   @param[in] tones tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_tones(cw_gen_t * gen, const cw_gen_tone_t * tones, size_t n_tones);
+
+
+
+
+/**
+   @brief Set contents of generator's memory
+
+   A memory of generator holds a string that is sent many times, e.g. a
+   message of contest keyer ("CQ TEST", "5NN"). Samples of the string
+   are rendered once, at current parameters of generator (sample rate,
+   speed, frequency, volume, gap, weighting, slopes), and the memory is
+   then played with cw_gen_enqueue_memory() without calculating its
+   samples.
+
+   Generator has 16 memories, indexed from zero. Each memory can hold
+   up to 1024 characters. Setting a memory replaces its previous
+   contents. NULL @p string clears the memory. Memories are deleted
+   together with generator.
+
+   @exception EINVAL @p gen is NULL, @p memory is out of range, or @p string is empty or too long
+   @exception ENOENT @p string contains invalid characters
+   @exception ENOMEM memory for samples can't be allocated
+   @exception EAGAIN too many previous renditions of memories wait for end of their playback
+
+   @param[in] gen generator
+   @param[in] memory index of memory
+   @param[in] string string to store in the memory, or NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_memory(cw_gen_t * gen, int memory, const char * string);
+
+
+
+
+/**
+   @brief Enqueue contents of generator's memory
+
+   String set with cw_gen_set_memory() is enqueued in generator, and
+   its pre-rendered samples are copied to generator's sound device as
+   they are. If parameters of generator have changed since the memory
+   has been rendered, the memory is first rendered again.
+
+   Each character of the memory (with space that follows it) is a
+   separate item in tone queue, so cw_gen_remove_last_character() removes
+   last character of the memory, and flushing of tone queue stops the
+   memory at boundary of character. For the same reason tone queue
+   callbacks and generator's value tracking see a whole character as a
+   single Mark.
+
+   Gain and chirp modulation (see cw_gen_set_gain(), cw_gen_set_chirp())
+   don't apply to memories: requests of modulation wait for first tone
+   after the memory.
+
+   Either all characters of the memory are enqueued, or none.
+
+   @exception EINVAL @p gen is NULL or @p memory is out of range
+   @exception ENOENT the memory is empty
+   @exception ENOMEM memory for samples can't be allocated
+   @exception EAGAIN high water mark of generator's tone queue would be exceeded
+
+   @param[in] gen generator
+   @param[in] memory index of memory
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_memory(cw_gen_t * gen, int memory);
+
+
+
+
+/**
+   @brief Wait for generator's tone queue to drain until only as many tones as given in @p level remain queued
+
+   This function is for use by programs that want to optimize
+   themselves to avoid the cleanup that happens when generator's tone
+   queue drains completely. Such programs have a short time in which
+   to add more tones to the queue.
+
+   @internal
+   TODO: in current implementation of library most of the cleanup has been removed.
+   @endinternal
+
+   The function returns when queue's level is equal to or lower than @p
+   level.  If at the time of function call the level of queue is already
+   equal to or lower than @p level, function returns immediately.
+
+   Notice that generator must be running (started with cw_gen_start())
+   when this function is called, otherwise it will be waiting forever
+   for a change of tone queue's level that will never happen.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator on which to wait
+   @param[in] level level in queue, at which to return
+
+   @return CW_SUCCESS
+*/
 cw_ret_t cw_gen_wait_for_queue_level(cw_gen_t * gen, size_t level);
 
 
@@ -756,360 +2000,2509 @@ cw_ret_t cw_gen_get_sound_device(cw_gen_t const * gen, char * buffer, size_t siz
 
 
 /**
-   @brief Get id of sound system used by given generator (one of enum cw_audio_system values)
+   @brief Get id of sound system used by given generator (one of enum cw_audio_system values)
+
+   You can use cw_get_audio_system_label() to get string corresponding
+   to value returned by this function.
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @param[in] gen generator from which to get sound system id
+
+   @return sound system's id
+*/
+int cw_gen_get_sound_system(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get current time of generator
+
+   For generator using Null sound system with
+   cw_gen_config_t::null_virtual_clock, this is the time of virtual
+   clock: it starts at the time of opening of the sound system, and is
+   advanced by duration of each tone played by the generator, without
+   waiting for the tone to be played. Value tracking callback of such
+   generator can pass the timestamp to cw_rec_mark_begin() and
+   cw_rec_mark_end(), so that simulations of sending and receiving
+   run at CPU speed.
+
+   For other generators this is current wall clock time.
+
+   @param[in] gen generator
+   @param[out] timestamp current time of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_timestamp(cw_gen_t * gen, struct timeval * timestamp);
+
+
+
+
+/**
+   @brief Get time at which generator's sound ends
+
+   The time is recorded by generator each time its tone queue becomes
+   empty: it is the time (see cw_gen_get_timestamp()) at which the last
+   samples written to sound device will have been played. It includes
+   latency of sound device, if the sound system can tell it.
+
+   The time is exact only for generator configured with
+   cw_gen_config_t::flush_on_empty_queue. Without it up to one buffer
+   of last samples is kept by generator until next tones are enqueued,
+   and these samples are not included.
+
+   @exception EINVAL @p gen or @p timestamp is NULL
+   @exception ENODATA tone queue hasn't become empty since generator has been created
+
+   @param[in] gen generator
+   @param[out] timestamp time of end of sound
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_end_of_sound_time(const cw_gen_t * gen, struct timeval * timestamp);
+
+
+
+
+/**
+   @brief Get length of tone queue of the generator
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @param[in] gen generator from which to get tone queue length
+
+   @return length of tone queue
+*/
+size_t cw_gen_get_queue_length(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get count of characters in tone queue of the generator
+
+   Function returns count of characters enqueued with
+   cw_gen_enqueue_character(), cw_gen_enqueue_string() and similar
+   functions, that haven't been played yet. A character whose first
+   Mark is already being played is not counted.
+
+   @param[in] gen generator from which to get count of characters
+
+   @return count of characters in tone queue
+*/
+size_t cw_gen_get_queue_n_characters(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get duration of tones in tone queue of the generator
+
+   Function returns sum of durations of all tones (Marks and Spaces)
+   that are waiting in generator's queue, i.e. time after which the
+   queue will be drained if no new tones are enqueued. Tone that is
+   being played at the moment is not included.
+
+   @param[in] gen generator from which to get duration of queue
+
+   @return duration of tones in tone queue, in microseconds
+*/
+uint64_t cw_gen_get_queue_duration(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get latency of sound output of the generator
+
+   Latency is the longest time between the moment when generator
+   starts calculating samples of a tone and the moment when the samples
+   are played by sound device. It consists of duration of generator's
+   own buffer and of latency of sound device (e.g. size of ring buffer
+   of ALSA device). Sound systems that can't tell the latency of a
+   sound device (or have no device buffer at all) contribute zero.
+
+   The value is known after the generator has been created, and
+   reflects configuration that has been negotiated with sound device
+   (see cw_gen_config_t::alsa_low_latency).
+
+   @exception EINVAL @p gen or @p latency is NULL
+
+   @param[in] gen generator
+   @param[out] latency latency of sound output, in microseconds
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_sound_latency(const cw_gen_t * gen, int * latency);
+
+
+
+
+/**
+   @brief Get format of samples sent by generator to its sound device
+
+   The format is a result of negotiation between format requested
+   with cw_gen_config_t::sample_format and cw_gen_config_t::n_channels,
+   and formats accepted by sound device. Sound systems that don't
+   negotiate the format (Null, Console, OSS, File) use
+   CW_SAMPLE_FORMAT_S16 and one channel. JACK always uses
+   CW_SAMPLE_FORMAT_FLOAT32 and one channel.
+
+   @exception EINVAL @p gen, @p sample_format or @p n_channels is NULL
+
+   @param[in] gen generator
+   @param[out] sample_format format of samples
+   @param[out] n_channels count of interleaved channels
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_sample_format(const cw_gen_t * gen, cw_sample_format_t * sample_format, int * n_channels);
+
+
+
+
+/**
+   @brief Get runtime metrics of generator
+
+   Metrics tell how healthy a running generator is: whether its sound
+   device has underruns, how long the generator is blocked on writes
+   to the device and how much CPU time it takes to calculate samples.
+   Reading metrics doesn't disturb the generator, so the function may
+   be called periodically from any thread. Values of different fields
+   may be read at slightly different moments.
+
+   Write and synthesis times are measured only for sound systems that
+   write buffers of samples (all sound systems except for Null and
+   Console). Underruns are detected only by ALSA sound system.
+
+   @exception EINVAL @p gen or @p metrics is NULL
+
+   @param[in] gen generator
+   @param[out] metrics metrics of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_metrics(cw_gen_t * gen, cw_gen_metrics_t * metrics);
+
+
+
+
+/**
+   @brief Export metrics of generator in OpenMetrics text format
+
+   Current metrics of generator (see cw_gen_get_metrics()) and current
+   state of its queue (count of tones, count of characters and duration
+   of queued tones) are formatted as metric families of OpenMetrics
+   (Prometheus) text exposition format, with names starting with
+   "cw_gen_". Text is passed to @p callback_func, which may e.g. write
+   it to a socket of HTTP server that is scraped by Prometheus.
+
+   @p labels are put in braces of every sample, e.g. 'session="3"'. Pass
+   NULL or empty string for no labels. Caller is responsible for
+   escaping of values of labels. Labels should be shorter than 256
+   characters, samples with longer labels are not written.
+
+   The text doesn't end with "# EOF" line, so that metrics of many
+   objects and of caller itself can be written to one exposition. Names
+   of metric families are the same for all generators, so metrics of
+   two generators can't be put into one exposition.
+
+   Like cw_gen_get_metrics(), the function only reads counters of
+   generator, and doesn't lock any mutex used by generator's thread.
+
+   @exception EINVAL @p gen or @p callback_func is NULL
+
+   @param[in] gen generator
+   @param[in] labels labels of samples of metrics, may be NULL
+   @param[in] callback_func function receiving text of metrics
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_export_metrics(cw_gen_t * gen, const char * labels, cw_metrics_write_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Start monitoring timing of Marks and Spaces played by generator
+
+   Monitor measures durations of Marks and Spaces between changes of
+   generator's value, on the same device-correlated timeline as
+   timestamps passed to callbacks registered with
+   cw_gen_register_timed_value_tracking_callback_internal(): the time
+   at which a change will be heard, calculated from samples waiting in
+   generator's buffers and from delay reported by sound device.
+
+   Each measured Mark is compared with the nearest of ideal durations
+   of Dot and Dash, and each Space with the nearest of ideal durations
+   of inter-mark-space, inter-character-space and inter-word-space (see
+   cw_gen_get_durations_internal()). Statistics of errors are collected
+   separately for each type (see cw_gen_get_timing_statistics()).
+   Marks longer than two Dashes and Spaces longer than two
+   inter-word-spaces (e.g. when tone queue is empty, or a straight key
+   is held down) are not measured.
+
+   When absolute error of a Mark or Space is larger than @p threshold,
+   @p callback_func (if not NULL) is called. The callback is called by
+   generator's thread, so it should return quickly. It must not call
+   functions of timing monitor.
+
+   Ideal durations are taken at the moment of measurement, so Marks
+   and Spaces enqueued before a change of speed or weighting may be
+   reported as errors when they are played after the change.
+
+   Calling the function again replaces threshold and callback, and
+   doesn't reset statistics.
+
+   @exception EINVAL @p gen is NULL or @p threshold is negative
+   @exception ENOMEM failed to allocate monitor
+
+   @param[in] gen generator
+   @param[in] threshold [microseconds] largest allowed absolute error of duration
+   @param[in] callback_func function called when error exceeds @p threshold, may be NULL
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enable_timing_monitor(cw_gen_t * gen, int threshold, cw_gen_timing_alarm_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Stop monitoring timing of Marks and Spaces played by generator
+
+   Statistics collected so far are kept and can still be read with
+   cw_gen_get_timing_statistics(). After the function returns, alarm
+   callback of the monitor is not called anymore.
+
+   @param[in] gen generator
+*/
+void cw_gen_disable_timing_monitor(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get timing statistics of generator
+
+   Statistics are cumulative since the monitor has been enabled for
+   the first time (see cw_gen_enable_timing_monitor()), or since last
+   call to cw_gen_reset_timing_statistics(). Statistics of generator
+   whose monitor has never been enabled are all zero.
+
+   @exception EINVAL @p gen or @p statistics is NULL
+
+   @param[in] gen generator
+   @param[out] statistics timing statistics of generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_timing_statistics(cw_gen_t * gen, cw_gen_timing_statistics_t * statistics);
+
+
+
+
+/**
+   @brief Clear timing statistics of generator
+
+   The next Mark or Space is measured from the next change of
+   generator's value.
+
+   @param[in] gen generator
+*/
+void cw_gen_reset_timing_statistics(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Let generator lower quality of synthesis when CPU can't keep up
+
+   On overloaded host it's better to play slightly worse signal than
+   to let sound device run out of samples. Generator measures load of
+   its thread: time spent on calculating (and post-processing) samples
+   of each buffer, relative to duration of the buffer. Load is
+   averaged over @p policy->n_buffers buffers. When mean load exceeds
+   @p policy->degrade_load, quality is lowered by one level (see
+   cw_gen_quality_t); when it drops below @p policy->restore_load,
+   quality is raised by one level. Changes of oscillator engine keep
+   the sine wave continuous.
+
+   @p callback_func (if not NULL) is called on every change of
+   quality. The callback is called by generator's thread, so it should
+   return quickly. It must not call functions of quality scaling.
+
+   Load is measured only for sound systems to which generator writes
+   buffers of samples (see cw_gen_add_sink()).
+
+   Calling the function again replaces policy and callback, and starts
+   new measurement of load. Current quality is kept.
+
+   @exception EINVAL @p gen or @p policy is NULL, @p policy->restore_load is not positive or not smaller than @p policy->degrade_load, or @p policy->n_buffers is not positive
+   @exception ENOMEM failed to allocate quality scaling
+
+   @param[in] gen generator
+   @param[in] policy policy of quality scaling
+   @param[in] callback_func function called on change of quality, may be NULL
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enable_quality_scaling(cw_gen_t * gen, const cw_gen_quality_policy_t * policy, cw_gen_quality_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Stop scaling quality of synthesis of generator
+
+   Full quality is restored. After the function returns, callback of
+   quality scaling is not called anymore.
+
+   @param[in] gen generator
+*/
+void cw_gen_disable_quality_scaling(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get current quality of synthesis of generator
+
+   @param[in] gen generator
+
+   @return quality of synthesis, CW_GEN_QUALITY_FULL if @p gen is NULL
+*/
+cw_gen_quality_t cw_gen_get_quality(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Add a sink receiving samples written by generator to its sound device
+
+   Every buffer of samples written by @p gen to its sound device is
+   also passed to @p callback_func, so that the same signal can be
+   e.g. played, recorded and streamed without calculating it a few
+   times. The callback is called in a separate thread of the sink, in
+   order of buffers, after the buffer has been written to the sound
+   device.
+
+   When generator calculates samples in its own memory, buffers are
+   passed to sinks without copying. Otherwise (pipeline of buffers,
+   ALSA with mmap) each buffer is copied once for all sinks.
+
+   A sink never blocks generator. When a sink's callback doesn't keep up,
+   the oldest of buffers waiting for the sink is dropped (see
+   cw_gen_get_sink_statistics()). Other sinks are not affected.
+
+   Sinks can be added and removed while generator is running. Only
+   sound systems writing buffers of samples (all except for Null,
+   Console, and PulseAudio with asynchronous stream) can have sinks.
+
+   @exception EINVAL @p gen or @p callback_func is NULL, sound system of @p gen doesn't write buffers of samples, the sink is already added, or there are too many sinks
+   @exception ENOMEM memory for the sink can't be allocated
+
+   @param[in] gen generator
+   @param[in] callback_func function receiving samples
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_add_sink(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Remove sink of generator
+
+   Buffers waiting for the sink are passed to @p callback_func before
+   the function returns. Sinks that are still added to generator are
+   removed by cw_gen_delete().
+
+   @exception EINVAL @p gen or @p callback_func is NULL
+   @exception ENOENT there is no such sink
+
+   @param[in] gen generator
+   @param[in] callback_func function given to cw_gen_add_sink()
+   @param[in] callback_arg argument given to cw_gen_add_sink()
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_remove_sink(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg);
+
+
+
+
+/**
+   @brief Get statistics of sink of generator
+
+   @exception EINVAL @p gen, @p callback_func or @p statistics is NULL
+   @exception ENOENT there is no such sink
+
+   @param[in] gen generator
+   @param[in] callback_func function given to cw_gen_add_sink()
+   @param[in] callback_arg argument given to cw_gen_add_sink()
+   @param[out] statistics statistics of the sink
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_sink_statistics(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg, cw_gen_sink_statistics_t * statistics);
+
+
+
+
+/**
+   @brief Start copying samples played by generator to its tap
+
+   Tap keeps CW_GEN_TAP_CAPACITY most recent samples played by
+   generator, for displays (oscilloscope, waterfall, keying monitor)
+   that sample the signal at their own rate. Samples are copied to the
+   tap by the thread that passes them to sound device, after they have
+   been post-processed. Unlike with sinks (see cw_gen_add_sink()),
+   there is no additional thread, no lock and no queue: the tap is a
+   ring overwritten by generator, and readers that don't keep up
+   simply lose the oldest samples (see cw_gen_read_tap()). Reading the
+   tap never delays generator. The tap also works with sound systems
+   that pull samples from generator in callbacks of sound server (JACK,
+   PipeWire).
+
+   Only one of each @p decimation samples is kept. With
+   CW_GEN_TAP_SAMPLE the first sample of each group of @p decimation
+   samples is kept. With CW_GEN_TAP_PEAK the largest absolute value
+   in the group is kept, which gives envelope of the signal,
+   independent of frequency of tone. Higher decimation makes the tap
+   cheaper and makes it cover more time.
+
+   Tap is allocated when it is enabled for the first time, and is
+   freed by cw_gen_delete(). Calling the function again changes
+   decimation and mode; samples already in the tap are kept.
+
+   @exception EINVAL @p gen is NULL, @p decimation is not in range 1 - CW_GEN_TAP_DECIMATION_MAX, or @p mode is invalid
+   @exception ENOMEM failed to allocate tap
+
+   @param[in] gen generator
+   @param[in] decimation count of samples of generator per one sample of tap
+   @param[in] mode decimation mode
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enable_tap(cw_gen_t * gen, int decimation, cw_gen_tap_mode_t mode);
+
+
+
+
+/**
+   @brief Stop copying samples played by generator to its tap
+
+   Samples that are already in the tap can still be read.
+
+   @param[in] gen generator
+*/
+void cw_gen_disable_tap(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Get current position of end of tap of generator
+
+   Positions are sequence numbers of samples of the tap, counted from
+   the first sample copied to the tap. A reader interested in the
+   most recent N samples reads from (@p position - N). @p sample_rate
+   is the sample rate of generator divided by current decimation of
+   the tap.
+
+   @exception EINVAL @p gen or @p position is NULL
+   @exception ENOENT tap of @p gen has never been enabled
+
+   @param[in] gen generator
+   @param[out] position position just after the last sample in the tap
+   @param[out] sample_rate sample rate of samples in the tap, may be NULL
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_get_tap_position(cw_gen_t * gen, uint64_t * position, int * sample_rate);
+
+
+
+
+/**
+   @brief Read samples from tap of generator
+
+   Up to @p n_samples samples, starting at @p position, are copied to
+   @p samples, and @p position is moved past them. If samples at @p
+   position have already been overwritten by generator, reading starts
+   at the oldest sample still in the tap, so the reader can detect
+   that it has lost samples by comparing @p position before and after
+   the call with the returned count.
+
+   The function never blocks, neither the reader nor the generator.
+   Many threads may read the tap at once, each with its own position.
+
+   @exception EINVAL @p gen, @p position or @p samples is NULL, or @p n_samples is not positive
+   @exception ENOENT tap of @p gen has never been enabled
+
+   @param[in] gen generator
+   @param[in,out] position position of first sample to read
+   @param[out] samples array for samples
+   @param[in] n_samples size of @p samples
+
+   @return count of samples copied to @p samples, zero if there are no new samples
+   @return -1 on failure
+*/
+int cw_gen_read_tap(cw_gen_t * gen, uint64_t * position, cw_sample_t * samples, int n_samples);
+
+
+
+
+/**
+   @brief Add band-pass filter to post-processing of generator's samples
+
+   Samples written by generator to its sound device (and passed to its
+   sinks) can go through a chain of up to 8 stages of post-processing
+   that simulate conditions on the band: band-pass filter of receiver,
+   band noise, and fading. Stages are applied in order in which they
+   have been added. Samples calculated by cw_gen_render() and
+   cw_gen_render_string() are not processed.
+
+   The filter is a two-pole filter with peak gain of 0 dB at @p
+   frequency. Narrow filter makes marks ring, as in a receiver with CW
+   filter.
+
+   Stages can be added while generator is running. Null and Console
+   sound systems don't write samples, so there is nothing to process.
+
+   @exception EINVAL @p gen is NULL, sound device of @p gen is not open, @p frequency or @p bandwidth is out of range, or there are too many stages
+   @exception ENOMEM memory for the chain can't be allocated
+
+   @param[in] gen generator
+   @param[in] frequency center frequency of filter [Hz], lower than half of sample rate
+   @param[in] bandwidth bandwidth of filter [Hz]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_add_dsp_bandpass(cw_gen_t * gen, int frequency, int bandwidth);
+
+
+
+
+/**
+   @brief Add noise to post-processing of generator's samples
+
+   See cw_gen_add_dsp_bandpass() for description of post-processing.
+   Noise is added to marks and to spaces, but only while generator
+   writes samples (i.e. not when generator's tone queue is empty).
+   Noise followed by band-pass filter sounds like band noise heard
+   through receiver's filter.
+
+   @exception EINVAL @p gen is NULL, @p level is out of range, or there are too many stages
+   @exception ENOMEM memory for the chain can't be allocated
+
+   @param[in] gen generator
+   @param[in] level RMS level of noise, in percents of full scale (1-100)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_add_dsp_noise(cw_gen_t * gen, int level);
+
+
+
+
+/**
+   @brief Add fading (QSB) to post-processing of generator's samples
+
+   See cw_gen_add_dsp_bandpass() for description of post-processing.
+   Gain of samples changes smoothly between full gain and (100 - @p
+   depth) percent of full gain, with period @p period.
+
+   @exception EINVAL @p gen is NULL, sound device of @p gen is not open, @p depth or @p period is out of range, or there are too many stages
+   @exception ENOMEM memory for the chain can't be allocated
+
+   @param[in] gen generator
+   @param[in] depth depth of fading, in percents (1-100)
+   @param[in] period period of fading [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_add_dsp_fading(cw_gen_t * gen, int depth, int period);
+
+
+
+
+/**
+   @brief Remove all stages of post-processing of generator's samples
+
+   @exception EINVAL @p gen is NULL
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_clear_dsp(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Enable or disable dither in post-processing of generator's samples
+
+   See cw_gen_add_dsp_bandpass() for description of post-processing.
+   Stages of post-processing work on float samples. At the end of the
+   chain the samples are converted to cw_sample_t (for sinks, and for
+   sound devices using CW_SAMPLE_FORMAT_S16), and, for sound devices
+   using CW_SAMPLE_FORMAT_S32 or CW_SAMPLE_FORMAT_FLOAT32, directly to
+   format of the device.
+
+   With dither enabled, TPDF dither of +/- 1 least significant bit is
+   added to samples converted to cw_sample_t. Dither is not used when
+   the chain has no stages.
+
+   Dither is disabled by default.
+
+   @exception EINVAL @p gen is NULL
+   @exception ENOMEM memory for the chain can't be allocated
+
+   @param[in] gen generator
+   @param[in] dither whether to add dither
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_dsp_dither(cw_gen_t * gen, bool dither);
+
+
+
+
+/**
+   @brief Set capacity and high water mark of tone queue of the generator
+
+   By default tone queue of a generator can hold 3000 tones (roughly 5
+   minutes of Morse code at 12 WPM). Use this function to allow
+   enqueueing longer texts, e.g. QRSS or beacon scripts. Memory for
+   tones is allocated as the tones are enqueued, so large @p capacity
+   doesn't cost anything until the queue is actually filled.
+
+   Generator will refuse to enqueue new characters when count of tones
+   in its queue would exceed @p high_water_mark.
+
+   @p capacity must be larger than zero, and no larger than 1048576.
+   @p high_water_mark must be larger than zero, and no larger than @p capacity.
+   @p capacity must be no smaller than current length of tone queue.
+
+   @exception EINVAL invalid value of @p capacity or @p high_water_mark
+   @exception ENOMEM failed to allocate memory for tones
+
+   @param[in] gen generator
+   @param[in] capacity maximal count of tones in tone queue
+   @param[in] high_water_mark high water mark of tone queue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_set_queue_capacity(cw_gen_t * gen, size_t capacity, size_t high_water_mark);
+
+
+
+
+/**
+   @brief Close idle sound devices kept in library-wide pool
+
+   Generators created with cw_gen_config_t::device_pool set to true
+   don't close their ALSA, OSS or PulseAudio device when they are
+   deleted. The configured device is kept in a pool, and a generator
+   created later with the same sound system, sound device and format
+   of samples uses it without opening and configuring the device
+   again. Devices in the pool are kept open (and e.g. an ALSA hw device
+   can't be used by other programs) until this function is called.
+
+   Devices used by existing generators are not affected.
+*/
+void cw_gen_close_pooled_devices(void);
+
+
+
+
+typedef void (* cw_queue_low_callback_t)(void *);
+/**
+   @brief Register a 'low level in tone queue' callback for given generator
+
+   @internal
+   See also cw_tq_register_low_level_callback_internal()
+   @endinternal
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @param[in,out] gen generator
+   @param[in] callback_func callback function to be registered
+   @param[in] callback_arg pointer to be passed to the callback when the callback is called
+   @param[in] level level of tone queue at which the callback will be called.
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level);
+
+
+
+
+/**
+   @brief Register a 'low duration of tone queue' callback for given generator
+
+   The callback is called by generator when duration of tones remaining
+   in generator's queue (see cw_gen_get_queue_duration()) drops to or
+   below @p duration. Use it to refill the queue just in time, keeping
+   as little sound queued as necessary, regardless of speed of Morse
+   code.
+
+   If @p callback_func is NULL, a callback registered earlier is
+   unregistered. The callback is independent of the callback registered
+   with cw_gen_register_low_level_callback().
+
+   @param[in,out] gen generator
+   @param[in] callback_func callback function to be registered
+   @param[in] callback_arg pointer to be passed to the callback when the callback is called
+   @param[in] duration duration of tones in queue at which the callback will be called [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_gen_register_low_duration_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, uint64_t duration);
+
+
+
+
+/**
+   @brief Get file descriptor notifying about events in generator's tone queue
+
+   The descriptor becomes readable when a tone is enqueued in or
+   dequeued from generator's queue (the latter means that the previous
+   tone has ended), or when the queue is flushed. Watch the descriptor
+   with select(), poll() or epoll (or with QSocketNotifier) to wait
+   for changes of queue's level or for end of a tone without blocking
+   a thread in cw_gen_wait_for_queue_level() or
+   cw_gen_wait_for_end_of_current_tone().
+
+   After the descriptor becomes readable, call cw_gen_clear_queue_event(),
+   and then check the queue with e.g. cw_gen_get_queue_length().
+
+   The descriptor is owned by generator, don't close it.
+
+   @param[in] gen generator
+
+   @return file descriptor on success
+   @return -1 on failure
+*/
+int cw_gen_get_queue_event_fd(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Make descriptor returned by cw_gen_get_queue_event_fd() non-readable
+
+   @param[in] gen generator
+*/
+void cw_gen_clear_queue_event(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Wait for the current tone to complete
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @param[in] gen generator to wait on
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief See if generator's tone queue is full
+
+   @internal
+   @reviewed 2020-08-07
+   @endinternal
+
+   @return true if the queue is full
+   @return false otherwise
+*/
+bool cw_gen_is_queue_full(cw_gen_t const * gen);
+
+
+
+
+typedef void (* cw_gen_value_tracking_callback_t)(void * callback_arg, int state);
+void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_value_tracking_callback_t callback_func, void * callback_arg);
+typedef void (* cw_gen_timed_value_tracking_callback_t)(void * callback_arg, int state, const struct timeval * playback_time);
+void cw_gen_register_timed_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_timed_value_tracking_callback_t callback_func, void * callback_arg);
+
+
+
+
+/* **************** Mixer **************** */
+
+
+
+
+/**
+   @brief Create new mixer
+
+   A mixer plays tones from many generators through one sound sink, using
+   one thread (plus optional pool of threads rendering samples, see
+   cw_mixer_set_n_workers()). Sound sink of the mixer is opened according to @p gen_conf.
+   Console sound system can't be used by mixer.
+
+   Returned pointer is owned by caller. Delete the allocated mixer with
+   cw_mixer_delete().
+
+   @param[in] gen_conf configuration of mixer's sound sink
+
+   @return pointer to new mixer on success
+   @return NULL on failure
+*/
+cw_mixer_t * cw_mixer_new(const cw_gen_config_t * gen_conf);
+
+
+
+
+/**
+   @brief Delete a mixer
+
+   Stop the mixer (if it is started) and delete it. Generators registered
+   in the mixer are not deleted.
+
+   @param[in,out] mixer pointer to mixer to delete
+*/
+void cw_mixer_delete(cw_mixer_t ** mixer);
+
+
+
+
+/**
+   @brief Register a generator in mixer
+
+   Tones enqueued in @p gen will be played through mixer's sound sink.
+   The generator should be created with CW_AUDIO_NULL sound system, and it
+   must not be started with cw_gen_start(): mixer's thread dequeues the
+   tones. Sample rate of the generator is changed to sample rate of mixer's
+   sound sink.
+
+   Calling the function for already registered generator changes its
+   gain.
+
+   @param[in] mixer mixer
+   @param[in] gen generator to register
+   @param[in] gain gain of the generator in mixer, in percents (0-100)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid arguments, for started generator, or when
+   there are too many generators in the mixer
+*/
+cw_ret_t cw_mixer_add_generator(cw_mixer_t * mixer, cw_gen_t * gen, int gain);
+
+
+
+
+/**
+   @brief Remove a generator from mixer
+
+   @param[in] mixer mixer
+   @param[in] gen generator to remove
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if @p gen is not registered in @p mixer
+*/
+cw_ret_t cw_mixer_remove_generator(cw_mixer_t * mixer, cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Set count of threads rendering samples of generators of mixer
+
+   By default mixer's thread renders samples of all registered
+   generators one after another. With many generators this may take
+   more time than duration of block of samples. With @p n_workers larger
+   than one, the generators are rendered in parallel by mixer's thread
+   and by (@p n_workers - 1) worker threads. Workers that are done with
+   their share of generators take over generators not yet rendered by
+   other workers.
+
+   Zero @p n_workers means one worker per online CPU. One means no
+   worker threads.
+
+   The function can be called for started mixer.
+
+   @param[in] mixer mixer
+   @param[in] n_workers count of threads rendering samples, including mixer's thread (0-64)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid arguments, or if worker threads can't be created
+*/
+cw_ret_t cw_mixer_set_n_workers(cw_mixer_t * mixer, int n_workers);
+
+
+
+
+/**
+   @brief Start a mixer
+
+   Start mixer's thread that plays tones of registered generators.
+
+   @param[in] mixer mixer to start
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on errors
+*/
+cw_ret_t cw_mixer_start(cw_mixer_t * mixer);
+
+
+
+
+/**
+   @brief Stop a mixer
+
+   Stop mixer's thread. Tones remaining in queues of registered generators
+   are not removed.
+
+   @param[in] mixer mixer to stop
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on errors
+*/
+cw_ret_t cw_mixer_stop(cw_mixer_t * mixer);
+
+
+
+
+/* **************** Shared memory ring **************** */
+
+
+
+
+/**
+   @brief Create ring of samples in POSIX shared memory
+
+   The ring is written by cw_shm_ring_write(), which is a sink of
+   generator:
+
+   cw_gen_add_sink(gen, cw_shm_ring_write, ring);
+
+   Other processes open the ring with cw_shm_ring_open() and read
+   samples directly from shared memory, without copying them through
+   kernel and without system calls per buffer. Readers that don't use
+   libcw can map the object themselves; its layout is described by
+   cw_shm_ring_header_t, and samples follow the header:
+
+   1. read cw_shm_ring_header_t::futex, then ::write_position (both
+      with acquire semantics);
+   2. if ::write_position is larger than reader's position, read the
+      samples; if it is larger by more than ::capacity, the oldest of
+      them have been overwritten, so skip them;
+   3. after reading, issue acquire fence and load ::reserve_position:
+      samples at positions lower than (::reserve_position - ::capacity)
+      may have been overwritten while they were being read and must be
+      discarded;
+   4. when there are no new samples, increment ::n_waiters, call
+      FUTEX_WAIT (not FUTEX_WAIT_PRIVATE) on ::futex with value read in
+      step 1, decrement ::n_waiters, and go back to step 1.
+
+   Writer never waits for readers. A reader that doesn't keep up loses
+   samples.
+
+   The shared memory object is created with permissions of owner only,
+   and it is removed by cw_shm_ring_delete().
+
+   @exception EINVAL @p name doesn't start with '/', contains another '/', or is too long
+   @exception EINVAL @p capacity is not a power of two in range 256 - 2^26
+   @exception EEXIST shared memory object with given name already exists
+   @exception other errno values set by shm_open(), ftruncate() or mmap()
+
+   @param[in] name name of shared memory object, e.g. "/cw_samples"
+   @param[in] capacity size of ring [samples]
+
+   @return new ring on success
+   @return NULL on failure
+*/
+cw_shm_ring_t * cw_shm_ring_new(const char * name, int capacity);
+
+
+
+
+/**
+   @brief Open ring of samples created by another process
+
+   @exception EINVAL @p name is invalid (see cw_shm_ring_new())
+   @exception EPROTO the object is not a ring of samples of supported version, or it is not initialized yet
+   @exception other errno values set by shm_open(), fstat() or mmap()
+
+   @param[in] name name of shared memory object given to cw_shm_ring_new()
+
+   @return ring on success
+   @return NULL on failure
+*/
+cw_shm_ring_t * cw_shm_ring_open(const char * name);
+
+
+
+
+/**
+   @brief Close ring of samples
+
+   Writer's ring (created with cw_shm_ring_new()) is also removed from
+   shared memory, readers that still have it open can read the samples
+   left in it. Remove writer's ring from generator (cw_gen_remove_sink())
+   before deleting the ring.
+
+   @param[in,out] ring pointer to ring
+*/
+void cw_shm_ring_delete(cw_shm_ring_t ** ring);
+
+
+
+
+/**
+   @brief Write samples to ring
+
+   The function has type cw_gen_sink_callback_t, so it can be passed
+   to cw_gen_add_sink() with ring as callback argument. When
+   @p n_samples is larger than capacity of ring, only the newest
+   samples are stored.
+
+   @param[in] ring ring created with cw_shm_ring_new() (cw_shm_ring_t *)
+   @param[in] samples samples to write
+   @param[in] n_samples count of samples in @p samples
+   @param[in] sample_rate sample rate of @p samples
+*/
+void cw_shm_ring_write(void * ring, const cw_sample_t * samples, int n_samples, int sample_rate);
+
+
+
+
+/**
+   @brief Read samples from ring
+
+   Copy samples starting at @p position to @p samples. When the
+   samples at @p position have already been overwritten, reading
+   starts at the oldest samples available, and @p position is moved
+   forward accordingly: a reader can detect lost samples by comparing
+   @p position before and after the call. Initialize @p position with
+   zero to read the oldest samples available, or with
+   cw_shm_ring_header_t::write_position of cw_shm_ring_get_header() to
+   read only new samples.
+
+   When there are no new samples, the function sleeps until the writer
+   writes some, or until @p timeout_ms passes.
+
+   Readers that want to avoid copying can read samples in place, see
+   cw_shm_ring_get_header().
+
+   @exception EINVAL @p ring, @p position or @p samples is NULL, or @p n_samples is not positive
+
+   @param[in] ring ring
+   @param[in,out] position position of first sample to read, on return: position of next sample to read
+   @param[out] samples buffer for samples
+   @param[in] n_samples size of @p samples
+   @param[in] timeout_ms maximal time of waiting for new samples [milliseconds]: 0 - don't wait, negative - wait without limit
+
+   @return count of samples read (zero on timeout)
+   @return -1 on errors
+*/
+int cw_shm_ring_read(cw_shm_ring_t * ring, uint64_t * position, cw_sample_t * samples, int n_samples, int timeout_ms);
+
+
+
+
+/**
+   @brief Get header of ring
+
+   Samples of ring follow the header in shared memory, at offset
+   cw_shm_ring_header_t::header_size from beginning of the header.
+   See cw_shm_ring_new() for protocol of reading them in place.
+
+   @param[in] ring ring
+
+   @return header of ring
+   @return NULL if @p ring is NULL
+*/
+const cw_shm_ring_header_t * cw_shm_ring_get_header(const cw_shm_ring_t * ring);
+
+
+
+
+/* **************** Batch rendering **************** */
+
+
+
+
+/**
+   @brief Create renderer of many strings into many WAV files
+
+   A batch renderer renders strings added with cw_batch_add() into
+   WAV files, in @p n_workers threads. Each thread uses its own copy
+   of @p gen for all its files, so generator is configured once, not
+   once per file. Files are rendered into pool of buffers that are
+   reused between files, and rendered buffers are written by separate
+   threads (with io_uring on Linux, when it is available), so
+   rendering doesn't wait for writing.
+
+   Files have sample rate, speed, frequency, volume, gap, weighting,
+   slopes and modulation of @p gen at the time of the call. Every file
+   starts with phase and modulation that @p gen has at the time of the
+   call. @p gen itself is not used by batch renderer, and it can be
+   deleted after the call.
+
+   Returned pointer is owned by caller. Delete the batch renderer with
+   cw_batch_delete().
+
+   @exception EINVAL @p gen is NULL, or @p n_workers is out of range
+   @exception ENOMEM memory can't be allocated
+   @exception EAGAIN threads can't be created
+
+   @param[in] gen generator with parameters of rendered files
+   @param[in] n_workers count of rendering threads (0-64). Zero means count of CPUs.
+
+   @return new batch renderer on success
+   @return NULL on failure
+*/
+cw_batch_t * cw_batch_new(cw_gen_t * gen, int n_workers);
+
+
+
+
+/**
+   @brief Delete batch renderer
+
+   Files that are being rendered or written are completed. Strings
+   added with cw_batch_add() that haven't been rendered yet are
+   discarded: call cw_batch_wait() first to render all of them.
+
+   @param[in,out] batch pointer to batch renderer to delete
+*/
+void cw_batch_delete(cw_batch_t ** batch);
+
+
+
+
+/**
+   @brief Add job of rendering string into WAV file
+
+   The string is rendered in background by one of threads of @p batch,
+   and written to file at @p path. Existing file is overwritten. The
+   function doesn't wait for rendering.
+
+   Invalid characters in @p string, or errors of writing the file, are
+   reported by cw_batch_wait().
+
+   @exception EINVAL @p batch, @p string or @p path is NULL
+   @exception ENOMEM memory can't be allocated
+
+   @param[in] batch batch renderer
+   @param[in] string string to render
+   @param[in] path path to WAV file
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_batch_add(cw_batch_t * batch, const char * string, const char * path);
+
+
+
+
+/**
+   @brief Wait until all added strings are rendered and written
+
+   @exception EINVAL @p batch is NULL
+   @exception EIO some of jobs have failed
+
+   @param[in] batch batch renderer
+   @param[out] n_failed count of jobs that have failed since previous call (may be NULL)
+
+   @return CW_SUCCESS if all jobs added since previous call have succeeded
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_batch_wait(cw_batch_t * batch, unsigned int * n_failed);
+
+
+
+
+/* **************** Sequencer **************** */
+
+
+
+
+/**
+   @brief Create new sequencer
+
+   A sequencer converts text into timed Marks and Spaces, with the same
+   timing that a generator with the same parameters would use. It has no
+   tone queue, thread or sound sink, so applications can simulate
+   thousands of stations at the cost of a few dozen bytes each.
+
+   Sequencer starts with default speed, gap and weighting, and its time
+   starts at zero.
+
+   Returned pointer is owned by caller. Delete the allocated sequencer
+   with cw_seq_delete().
+
+   @return pointer to new sequencer on success
+   @return NULL on failure
+*/
+cw_seq_t * cw_seq_new(void);
+
+
+
+
+/**
+   @brief Delete a sequencer
+
+   @param[in,out] seq pointer to sequencer to delete
+*/
+void cw_seq_delete(cw_seq_t ** seq);
+
+
+
+
+/**
+   @brief Set speed, gap and weighting of sequencer
+
+   Frequency and volume in @p parameters are ignored. New parameters
+   are used by next call to cw_seq_send_string().
+
+   @exception EINVAL @p seq or @p parameters is NULL, or speed, gap or
+   weighting is out of range
+
+   @param[in] seq sequencer
+   @param[in] parameters new parameters
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_seq_set_parameters(cw_seq_t * seq, const cw_gen_parameters_t * parameters);
+
+
+
+
+/**
+   @brief Convert string into Marks and Spaces
+
+   Each Mark and Space of characters of @p string is passed to @p
+   callback before the function returns. Spaces between Marks (including
+   inter-character-spaces and inter-word-spaces) are passed as one
+   Space; the last event is the Space following last character of @p
+   string. Each event starts when previous one ends, and time of
+   sequencer is advanced by durations of all events.
+
+   @exception EINVAL @p seq, @p string or @p callback is NULL
+   @exception ENOENT @p string contains invalid character
+
+   @param[in] seq sequencer
+   @param[in] string string to convert
+   @param[in] callback function receiving Marks and Spaces
+   @param[in] callback_arg argument passed to @p callback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_seq_send_string(cw_seq_t * seq, const char * string, cw_seq_event_callback_t callback, void * callback_arg);
+
+
+
+
+/**
+   @brief Get time of sequencer
+
+   @param[in] seq sequencer
+
+   @return end of last event produced by the sequencer [microseconds]
+*/
+int64_t cw_seq_get_time(const cw_seq_t * seq);
+
+
+
+
+/* **************** Key **************** */
+
+
+
+
+/*
+  For straight key this is a value of a single (and the only) element of a
+  key.
+
+  For a iambic keyer and other key types this a value of one of two paddles.
+
+  A state of key's internal graph (state machine) can have values that have
+  _STATE_ in their names. I'm making here a distinction between "value" and
+  "state", reserving word "state" for state of the internal graph (state
+  machine).
+*/
+typedef enum {
+	CW_KEY_VALUE_OPEN = CW_KEY_STATE_OPEN,      /* Space, no sound. */
+	CW_KEY_VALUE_CLOSED = CW_KEY_STATE_CLOSED,  /* Mark, sound. */
+} cw_key_value_t;
+
+/* Function called on each change of value of key, see
+   cw_key_register_value_callback(). @p timestamp is on CLOCK_MONOTONIC
+   timeline [microseconds]. */
+typedef void (* cw_key_value_callback_t)(void * callback_arg, cw_key_value_t key_value, int64_t timestamp);
+
+
+
+
+cw_key_t * cw_key_new(void);
+void cw_key_delete(cw_key_t ** key);
+
+
+
+
+/**
+   @brief Set label (name) of given key instance
+
+   The label can be used by client code to distinguish different
+   instances of keys. The label is used in library's debug
+   messages.
+
+   @p key can't be NULL.
+
+   @p label can't be NULL.
+
+   @p label can be an empty string: key's label will become empty
+   string.
+
+   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
+   be truncated and
+   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
+   logged. This is not treated as error: function will not return
+   `CW_FAILURE` because of that.
+
+   @param[in] key key for which to set label
+   @param[in] label new label to set for given @p key
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise (e.g. @p key or @p label is NULL)
+*/
+cw_ret_t cw_key_set_label(cw_key_t * key, const char * label);
+
+
+
+
+/**
+   @brief Get label (name) of given key instance
+
+   @p key and @p label can't be NULL.
+
+   @p label should be a buffer of size at least
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
+
+   @p size should have value equal to size of @p label char buffer.
+
+   @p size is not validated: it could be smaller than
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
+   get only as many characters of key's label as he asked for.
+
+   @param[in] key key from which to get label
+   @param[out] label output buffer
+   @param[in] size total size of output buffer @p label
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (e.g. @p key or @p label is NULL)
+*/
+cw_ret_t cw_key_get_label(const cw_key_t * key, char * label, size_t size);
+
+
+
+
+void cw_key_register_generator(volatile cw_key_t * key, cw_gen_t * gen);
+void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec);
+void cw_key_register_value_callback(volatile cw_key_t * key, cw_key_value_callback_t callback_func, void * callback_arg);
+
+void cw_key_ik_enable_curtis_mode_b(volatile cw_key_t * key);
+void cw_key_ik_disable_curtis_mode_b(volatile cw_key_t * key);
+bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t * key);
+cw_ret_t cw_key_ik_enable_timed_mode(volatile cw_key_t * key);
+cw_ret_t cw_key_ik_disable_timed_mode(volatile cw_key_t * key);
+bool cw_key_ik_get_timed_mode(const volatile cw_key_t * key);
+cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value);
+cw_ret_t cw_key_ik_notify_dash_paddle_event(volatile cw_key_t * key, cw_key_value_t dash_paddle_value);
+cw_ret_t cw_key_ik_notify_dot_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value);
+void cw_key_ik_get_paddles(const volatile cw_key_t * key, cw_key_value_t * dot_paddle_value, cw_key_value_t * dash_paddle_value);
+cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key);
+cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key);
+cw_ret_t cw_key_ik_start_paddle_events(cw_key_t * key);
+cw_ret_t cw_key_ik_stop_paddle_events(cw_key_t * key);
+cw_ret_t cw_key_ik_post_paddle_event(cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value);
+
+cw_ret_t cw_key_sk_get_value(const volatile cw_key_t * key, cw_key_value_t * key_value);
+cw_ret_t cw_key_sk_set_value(volatile cw_key_t * key, cw_key_value_t key_value);
+void cw_key_sk_enable_direct_receiving(volatile cw_key_t * key);
+void cw_key_sk_disable_direct_receiving(volatile cw_key_t * key);
+bool cw_key_sk_get_direct_receiving(const volatile cw_key_t * key);
+
+
+
+
+/* **************** Key input **************** */
+
+
+
+
+#define LIBCW_KEY_INPUT_DEVICE_NAME_SIZE 128
+
+/**
+   @brief Type of device read by key input
+
+   Meaning of lines in cw_key_input_config_t depends on the type.
+*/
+typedef enum cw_key_input_type_t {
+	CW_KEY_INPUT_EVDEV = 0, /* Linux input device (e.g. /dev/input/event3). Lines are key codes, e.g. KEY_LEFTCTRL from linux/input-event-codes.h. */
+	CW_KEY_INPUT_GPIO,      /* Linux GPIO character device (e.g. /dev/gpiochip0). Lines are offsets of lines of the chip. */
+	CW_KEY_INPUT_SERIAL     /* Serial port (e.g. /dev/ttyS0). Lines are modem status bits: TIOCM_CTS, TIOCM_DSR, TIOCM_CD or TIOCM_RI. */
+} cw_key_input_type_t;
+
+typedef struct cw_key_input_config_t {
+	cw_key_input_type_t type;
+	char device[LIBCW_KEY_INPUT_DEVICE_NAME_SIZE];
+	bool is_iambic;         /* Read paddles of iambic keyer (two lines) instead of straight key (one line). */
+	unsigned int dot_line;  /* Line of straight key, or line of Dot paddle. */
+	unsigned int dash_line; /* Line of Dash paddle. Not used for straight key. */
+	bool active_low;        /* Line closed by key has low value (e.g. GPIO line with pull-up resistor, or modem line with inverted logic). */
+} cw_key_input_config_t;
+
+
+
+
+/**
+   @brief Create new input feeding a key with values of lines of a device
+
+   The input opens the device described by @p config and starts a
+   thread that waits for changes of values of the lines in the kernel,
+   and passes the changes to @p key with cw_key_sk_set_value(), or to
+   iambic keyer of @p key. Client code doesn't have to read the device,
+   and doesn't add latency of its event loop to keying.
+
+   Changes of paddles are passed to iambic keyer with timestamps taken
+   by kernel when the change happened (evdev events, GPIO line events),
+   so in timed mode of the keyer (see cw_key_ik_enable_timed_mode())
+   the delay of input thread under load doesn't change timing of
+   elements. Kernel doesn't timestamp changes of modem lines of serial
+   port: they timestamped when the input thread wakes up.
+
+   Key inputs are available only on Linux.
+
+   Returned pointer is owned by caller. Delete the input with
+   cw_key_input_delete() before deleting @p key.
+
+   @exception EINVAL @p key or @p config is NULL, or @p config is invalid
+   @exception ENOTSUP type of input is not supported on this platform
+   @exception other errno values set by open() or ioctl() on the device
+
+   @param[in] key key to be fed by input (not owned by input)
+   @param[in] config configuration of input
+
+   @return pointer to new input on success
+   @return NULL on failure
+*/
+cw_key_input_t * cw_key_input_new(cw_key_t * key, const cw_key_input_config_t * config);
+
+
+
+
+/**
+   @brief Delete a key input
+
+   Input thread is stopped and the device is closed. Key fed by the
+   input is left open (not keyed).
+
+   @param[in,out] input pointer to input to delete
+*/
+void cw_key_input_delete(cw_key_input_t ** input);
+
+
+
+
+/* **************** Network keying **************** */
+
+
+
+
+/* Statistics of receiver of network keying, see
+   cw_netkey_receiver_get_statistics(). */
+typedef struct cw_netkey_statistics_t {
+	unsigned int n_packets;   /* Count of received packets. */
+	unsigned int n_recovered; /* Count of changes of key value received only in copies carried by later packets. */
+	unsigned int n_lost;      /* Count of changes of key value that were lost. */
+	unsigned int n_late;      /* Count of changes that arrived after their time of playout and were played immediately. */
+	int delay;                /* [microseconds] Delay currently added by jitter buffer above the smallest delay of network. */
+} cw_netkey_statistics_t;
+
+
+
+
+/**
+   @brief Create sender of changes of value of a key to remote receiver
+
+   Each change of value of @p key (straight key, or output of iambic
+   keyer) is sent with its timestamp over UDP to receiver created with
+   cw_netkey_receiver_new() on @p host. The sender registers itself as
+   value callback of @p key (see cw_key_register_value_callback()).
+
+   Each packet carries also a few previous changes, so that a change
+   lost with its packet is recovered from next packet. Last packet is
+   repeated while the key doesn't change.
+
+   Returned pointer is owned by caller. Delete the sender with
+   cw_netkey_sender_delete() before deleting @p key.
+
+   @exception EINVAL @p key or @p host is NULL, @p port is out of range, or @p host can't be resolved
+   @exception other errno values set by socket() or connect()
+
+   @param[in] key key whose changes are sent (not owned by sender)
+   @param[in] host name or address of host of receiver
+   @param[in] port UDP port of receiver
+
+   @return pointer to new sender on success
+   @return NULL on failure
+*/
+cw_netkey_sender_t * cw_netkey_sender_new(cw_key_t * key, const char * host, int port);
+
+
+
+
+/**
+   @brief Delete sender of changes of value of a key
+
+   @param[in,out] sender pointer to sender to delete
+*/
+void cw_netkey_sender_delete(cw_netkey_sender_t ** sender);
+
+
+
+
+/**
+   @brief Create receiver keying a key with changes received from network
+
+   Receiver listens on UDP @p port (IPv6 and IPv4) for packets of
+   cw_netkey_sender_t, and plays received changes on @p key as on
+   straight key (see cw_key_sk_set_value()), so that generator of @p
+   key (if any) produces the sound and receiver of @p key (if any, in
+   direct receiving mode) decodes the keying.
+
+   Changes are played with the same intervals as on sender's key,
+   delayed by jitter buffer. The delay adapts to jitter of network, but
+   never exceeds smallest delay of network plus @p delay_max. Change
+   that arrives later than that is played immediately. Key is opened
+   when no packets arrive from sender for half a second.
+
+   Returned pointer is owned by caller. Delete the receiver with
+   cw_netkey_receiver_delete() before deleting @p key.
+
+   @exception EINVAL @p key is NULL, or @p port or @p delay_max is out of range
+   @exception other errno values set by socket() or bind()
+
+   @param[in] key key to be keyed (not owned by receiver)
+   @param[in] port UDP port to listen on, or zero for port chosen by system (see cw_netkey_receiver_get_port())
+   @param[in] delay_max largest delay added by jitter buffer, up to one second [microseconds]
+
+   @return pointer to new receiver on success
+   @return NULL on failure
+*/
+cw_netkey_receiver_t * cw_netkey_receiver_new(cw_key_t * key, int port, int delay_max);
+
+
+
+
+/**
+   @brief Delete receiver of network keying
+
+   Receiving thread is stopped, and key keyed by the receiver is left
+   open.
+
+   @param[in,out] receiver pointer to receiver to delete
+*/
+void cw_netkey_receiver_delete(cw_netkey_receiver_t ** receiver);
+
+
+
+
+/**
+   @brief Get UDP port on which receiver listens
+
+   @param[in] receiver receiver
+
+   @return port number
+*/
+int cw_netkey_receiver_get_port(const cw_netkey_receiver_t * receiver);
+
+
+
+
+/**
+   @brief Get statistics of receiver of network keying
+
+   @exception EINVAL @p receiver or @p statistics is NULL
+
+   @param[in] receiver receiver
+   @param[out] statistics statistics
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_netkey_receiver_get_statistics(cw_netkey_receiver_t * receiver, cw_netkey_statistics_t * statistics);
+
+
+
+
+/* **************** Receiver **************** */
+
+
+
+
+/* Creator and destructor. */
+cw_rec_t * cw_rec_new(void);
+void       cw_rec_delete(cw_rec_t ** rec);
+
+
+
+
+/**
+   @brief Set label (name) of given receiver instance
+
+   The label can be used by client code to distinguish different
+   instances of receivers. The label is used in library's debug
+   messages.
+
+   @p rec can't be NULL.
+
+   @p label can't be NULL.
+
+   @p label can be an empty string: receiver's label will become empty
+   string.
+
+   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
+   be truncated and
+   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
+   logged. This is not treated as error: function will not return
+   `CW_FAILURE` because of that.
+
+   @param[in,out] rec receiver for which to set label
+   @param[in] label new label to set for given @p rec
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise (e.g. @p rec or @p label is NULL)
+*/
+int cw_rec_set_label(cw_rec_t * rec, const char * label);
+
+
+
+
+/**
+   @brief Get label (name) of given receiver instance
+
+   @p rec and @p label can't be NULL.
+
+   @p label should be a buffer of size at least
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
+
+   @p size should have value equal to size of @p label char buffer.
+
+   @p size is not validated: it could be smaller than
+   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
+   get only as many characters of receiver's label as he asked for.
+
+   @param[in] rec receiver from which to get label
+   @param[out] label output buffer
+   @param[in] size total size of output buffer @p label
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (e.g. @p rec or @p label is NULL)
+*/
+int cw_rec_get_label(const cw_rec_t * rec, char * label, size_t size);
+
+
+
+
+/* Helper receive functions. */
+cw_ret_t cw_rec_poll_character(cw_rec_t * rec, const struct timeval * timestamp, char * character, bool * is_end_of_word, bool * is_error);
+cw_ret_t cw_rec_poll_character_usecs(cw_rec_t * rec, int64_t timestamp, char * character, bool * is_end_of_word, bool * is_error);
+
+
+/* Setters of receiver's essential parameters. */
+
+/**
+   @brief Set receive speed of given receiver
+
+   If a receiver is working in non-adaptive mode, it needs to have its
+   receive speed set to specific value (to the value of source (sender) of
+   Morse code data). Otherwise there will be a mismatch between speeds of
+   sender and receiver, and the receiving will fail.
+
+   Range of valid speeds is the same as for generator (CW_SPEED_MIN to
+   CW_SPEED_MAX, inclusive).
+
+   By default a receiver works in non-adaptive mode.
+
+   @param[in] rec Receiver for which to set the speed
+   @param[in] speed New value of speed
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if function failed to set speed in receiver
+*/
+cw_ret_t cw_rec_set_speed(cw_rec_t * rec, int new_value);
+cw_ret_t cw_rec_set_tolerance(cw_rec_t * rec, int new_value);
+cw_ret_t cw_rec_set_gap(cw_rec_t * rec, int new_value);
+cw_ret_t cw_rec_set_noise_spike_threshold(cw_rec_t * rec, int new_value);
+cw_ret_t cw_rec_set_averaging(cw_rec_t * rec, cw_rec_averaging_mode_t mode, int window);
+void cw_rec_set_soft_decision(cw_rec_t * rec, bool soft_decision);
+cw_ret_t cw_rec_set_profile(cw_rec_t * rec, const cw_rec_profile_t * profile);
+void cw_rec_set_adaptive_mode_internal(cw_rec_t * rec, bool adaptive);
+
+/* Getters of receiver's essential parameters. */
+float cw_rec_get_speed(const cw_rec_t * rec);
+int   cw_rec_get_tolerance(const cw_rec_t * rec);
+/* int   cw_rec_get_gap_internal(cw_rec_t * rec); */
+int   cw_rec_get_noise_spike_threshold(const cw_rec_t * rec);
+bool  cw_rec_get_adaptive_mode(const cw_rec_t * rec);
+cw_ret_t cw_rec_get_profile(const cw_rec_t * rec, cw_rec_profile_t * profile);
+
+
+
+
+/**
+   @brief Reset receiver's state machine to initial state
+
+   The state includes, but is not limited to, state graph and
+   representation buffer.
+
+   Receiver's parameters and statistics are not reset by this function.
+   To reset statistics use cw_rec_reset_statistics().
+
+   @param[in,out] rec receiver to reset
+*/
+void cw_rec_reset_state(cw_rec_t * rec);
+
+
+
+
+/**
+   @brief Reset receiver's statistics
+
+   Reset the receiver's statistics by removing all records from it and
+   returning it to its initial default state.
+
+   #reviewed 2017-02-02
+
+   @param[in,out] rec receiver for which to reset statistics
+*/
+void cw_rec_reset_statistics(cw_rec_t * rec);
+cw_ret_t cw_rec_get_statistics(const cw_rec_t * rec, cw_rec_statistics_t * statistics);
+
+
+
+
+/**
+   @brief Get runtime metrics of receiver
+
+   Metrics are cumulative counters of events in receiver (accepted
+   and rejected Marks, unrecognized representations, etc.) that tell
+   about quality and throughput of decoding. Unlike statistics (see
+   cw_rec_get_statistics()), metrics are not reset by
+   cw_rec_reset_statistics() or cw_rec_reset_state(). Metrics may be
+   read by a thread other than the one that feeds the receiver.
+
+   @exception EINVAL @p rec or @p metrics is NULL
+
+   @param[in] rec receiver
+   @param[out] metrics metrics of receiver
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_get_metrics(const cw_rec_t * rec, cw_rec_metrics_t * metrics);
+
+
+
+
+/**
+   @brief Export metrics of receiver in OpenMetrics text format
+
+   Metrics of receiver (see cw_rec_get_metrics()) are formatted as
+   metric families of OpenMetrics (Prometheus) text exposition format,
+   with names starting with "cw_rec_". Decode latency is exported as
+   histogram "cw_rec_decode_latency_seconds" with the same bins as in
+   cw_rec_metrics_t::decode_latency.
+
+   @p labels and format of the text are the same as in
+   cw_gen_export_metrics().
+
+   @exception EINVAL @p rec or @p callback_func is NULL
+
+   @param[in] rec receiver
+   @param[in] labels labels of samples of metrics, may be NULL
+   @param[in] callback_func function receiving text of metrics
+   @param[in] callback_arg argument passed to @p callback_func
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_export_metrics(const cw_rec_t * rec, const char * labels, cw_metrics_write_callback_t callback_func, void * callback_arg);
+
+
+
+
+/* Main receive functions. */
+cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp);
+cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp);
+cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char mark);
+cw_ret_t cw_rec_mark_begin_usecs(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_mark_end_usecs(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_add_mark_usecs(cw_rec_t * rec, int64_t timestamp, char mark);
+cw_ret_t cw_rec_push_mark_begin(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_push_mark_end(cw_rec_t * rec, int64_t timestamp);
+cw_ret_t cw_rec_receive_edges(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
+cw_ret_t cw_rec_register_character_callback(cw_rec_t * rec, cw_rec_character_callback_t callback, void * callback_arg);
+
+
+/* Helper receive functions. */
+cw_ret_t cw_rec_poll_representation(cw_rec_t * rec, const struct timeval * timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+cw_ret_t cw_rec_poll_representation_usecs(cw_rec_t * rec, int64_t timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+cw_ret_t cw_rec_poll_batch(cw_rec_t * rec, int64_t timestamp, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
+
+void cw_rec_enable_adaptive_mode(cw_rec_t * rec);
+void cw_rec_disable_adaptive_mode(cw_rec_t * rec);
+
+
+
+
+/* **************** Compact receiver **************** */
+
+
+
+
+/**
+   @brief Create timing table shared by compact receivers
+
+   Compact receivers don't keep their own low level timing parameters.
+   The table holds parameters for all integer speeds in range
+   CW_SPEED_MIN - CW_SPEED_MAX, for fixed and adaptive receiving mode,
+   and all receivers at the same speed use the same read-only entry.
+   The table is not modified after it is created, so it can be used by
+   many threads at once.
+
+   Returned pointer is owned by caller. Delete the table with
+   cw_rec_timing_delete().
+
+   @exception EINVAL @p tolerance or @p gap is out of range
+
+   @param[in] tolerance tolerance of fixed speed receiving mode [percents]
+   @param[in] gap inter-character-gap, as in generator
+
+   @return pointer to new table on success
+   @return NULL on failure
+*/
+cw_rec_timing_t * cw_rec_timing_new(int tolerance, int gap);
+
+
+
+
+/**
+   @brief Delete timing table of compact receivers
+
+   @param[in,out] timing pointer to table to delete
+*/
+void cw_rec_timing_delete(cw_rec_timing_t ** timing);
+
+
+
+
+/**
+   @brief Initialize compact receiver
+
+   Compact receiver is an alternative to cw_rec_t for applications
+   decoding thousands of signals at once. It takes 32 bytes, doesn't
+   allocate memory, and has no label, statistics or callbacks of its
+   own. Representation of received character is kept as bits, and
+   adaptive tracking of speed uses one exponential average of duration
+   of Unit instead of buffers of durations of Dots and Dashes.
+   Receivers are updated in batches with cw_rec_compact_update().
+
+   @exception EINVAL @p rec is NULL or @p speed is out of range
+
+   @param[out] rec receiver to initialize
+   @param[in] speed initial receive speed [wpm]
+   @param[in] is_adaptive whether receiver tracks speed of received signal
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_compact_init(cw_rec_compact_t * rec, int speed, bool is_adaptive);
+
+
+
+
+/**
+   @brief Get current receive speed of compact receiver
+
+   @param[in] rec receiver
+
+   @return receive speed [wpm]
+*/
+int cw_rec_compact_get_speed(const cw_rec_compact_t * rec);
+
+
+
+
+/**
+   @brief Seed compact receiver with timing of a station
+
+   Speed of @p rec is set from @p profile (see cw_rec_profile_t), so
+   that receiver in adaptive mode decodes first character of a
+   transmission of known station without having to converge on its
+   speed first. State of receiver is not changed.
+
+   @exception EINVAL @p rec or @p profile is NULL, or durations in @p profile are invalid
+
+   @param[in,out] rec receiver
+   @param[in] profile timing of station
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_compact_set_profile(cw_rec_compact_t * rec, const cw_rec_profile_t * profile);
+
+
+
+
+/**
+   @brief Update many compact receivers at once
+
+   Pass @p inputs[i] to @p recs[i] and store result in @p outputs[i],
+   for each of @p n receivers. Timestamps of events of one receiver must
+   not decrease between calls. Receiver that has received a character
+   reports it on first event after inter-character-space has elapsed:
+   either on beginning of next Mark, or on poll. Inter-word-space is
+   reported on poll.
+
+   Beginning of Mark after a completed character starts a new
+   character, so receivers never have to be reset by client code.
+
+   Receivers may be updated by many threads at once as long as each
+   receiver is updated by only one thread. The same applies to @p
+   stats.
+
+   @param[in] timing timing table of receivers
+   @param[in,out] recs receivers to update
+   @param[in] inputs events for receivers
+   @param[out] outputs results of update of receivers
+   @param[in] n count of items in @p recs, @p inputs and @p outputs
+   @param[in,out] stats statistics of durations of Marks and Spaces received by receivers (may be NULL)
+
+   @return count of receivers that have reported a character, an error or an inter-word-space
+*/
+size_t cw_rec_compact_update(const cw_rec_timing_t * timing, cw_rec_compact_t * recs, const cw_rec_compact_input_t * inputs, cw_rec_compact_output_t * outputs, size_t n, cw_rec_compact_stats_t * stats);
+
+
+
+
+/**
+   @brief Get timing statistics gathered by compact receivers
+
+   Result is the same as that of cw_rec_get_statistics(), but
+   calculated over all durations added to @p stats.
+
+   @exception EINVAL @p stats or @p statistics is NULL
+
+   @param[in] stats statistics passed to cw_rec_compact_update()
+   @param[out] statistics timing statistics
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_compact_get_statistics(const cw_rec_compact_stats_t * stats, cw_rec_statistics_t * statistics);
+
+
+
+
+/* **************** Receiver pool **************** */
+
+
+
+
+/**
+   @brief Create pool of receivers decoding many channels in parallel
 
-   You can use cw_get_audio_system_label() to get string corresponding
-   to value returned by this function.
+   The pool has @p n_channels receivers (cw_rec_t), one per channel,
+   split into shards between @p n_workers worker threads: channel @c
+   c belongs to shard @c c % @p n_workers. Edges of a channel are
+   pushed to queue of its shard with cw_rec_pool_push_edges(), and
+   worker of the shard passes them to the channel's receiver. Decoded
+   characters of all channels are read with cw_rec_pool_read().
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   Pass zero as @p n_workers to have one worker per CPU.
 
-   @param[in] gen generator from which to get sound system id
+   Returned pointer is owned by caller. Delete the allocated pool with
+   cw_rec_pool_delete().
 
-   @return sound system's id
+   @exception EINVAL @p n_channels or @p n_workers is out of range
+
+   @param[in] n_channels count of channels (receivers) in pool
+   @param[in] n_workers count of worker threads, or zero
+
+   @return pointer to new pool on success
+   @return NULL on failure
 */
-int cw_gen_get_sound_system(const cw_gen_t * gen);
+cw_rec_pool_t * cw_rec_pool_new(int n_channels, int n_workers);
 
 
 
 
 /**
-   @brief Get length of tone queue of the generator
-
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   @brief Delete pool of receivers
 
-   @param[in] gen generator from which to get tone queue length
+   Worker threads are stopped. Edges that haven't been processed yet
+   are discarded.
 
-   @return length of tone queue
+   @param[in,out] pool pointer to pool to delete
 */
-size_t cw_gen_get_queue_length(const cw_gen_t * gen);
+void cw_rec_pool_delete(cw_rec_pool_t ** pool);
 
 
 
 
-typedef void (* cw_queue_low_callback_t)(void *);
 /**
-   @brief Register a 'low level in tone queue' callback for given generator
+   @brief Get receiver of a channel of pool
 
-   @internal
-   See also cw_tq_register_low_level_callback_internal()
-   @endinternal
+   Use the receiver to configure receiving of the channel (speed,
+   tolerance, adaptive mode etc.) before first edges of the channel
+   are pushed to pool. Receiver is owned by pool.
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   @exception EINVAL @p pool is NULL or @p channel is out of range
 
-   @param[in,out] gen generator
-   @param[in] callback_func callback function to be registered
-   @param[in] callback_arg pointer to be passed to the callback when the callback is called
-   @param[in] level level of tone queue at which the callback will be called.
+   @param[in] pool pool of receivers
+   @param[in] channel index of channel
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE otherwise
+   @return receiver on success
+   @return NULL on failure
 */
-cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level);
+cw_rec_t * cw_rec_pool_get_receiver(cw_rec_pool_t * pool, int channel);
 
 
 
 
 /**
-   @brief Wait for the current tone to complete
+   @brief Push edges of a channel to pool
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   Edges are copied to lock-free queue of the channel's shard, and are
+   decoded later by the shard's worker. The function waits only when
+   the queue is full. Consecutive calls for the same channel continue
+   the channel's keying: a character can span edges of many calls.
 
-   @param[in] gen generator to wait on
+   Edges of one shard may be pushed by only one thread at a time.
 
-   @return CW_SUCCESS
+   @exception EINVAL @p pool or @p edges is NULL, or @p channel is out of range
+
+   @param[in] pool pool of receivers
+   @param[in] channel index of channel
+   @param[in] timestamp beginning of first edge [microseconds]
+   @param[in] edges Marks and Spaces, as in cw_rec_receive_edges()
+   @param[in] n_edges count of items in @p edges
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_wait_for_end_of_current_tone(cw_gen_t * gen);
+cw_ret_t cw_rec_pool_push_edges(cw_rec_pool_t * pool, int channel, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges);
 
 
 
 
 /**
-   @brief See if generator's tone queue is full
+   @brief Read characters decoded by receivers of pool
 
-   @internal
-   @reviewed 2020-08-07
-   @endinternal
+   The function waits until workers have processed all edges pushed so
+   far, and then returns decoded characters of all channels as one
+   stream, ordered by timestamps (and by channels for equal
+   timestamps). Characters that don't fit into @p decoded are kept for
+   next call.
 
-   @return true if the queue is full
-   @return false otherwise
+   A character is decoded when its inter-character-space has been
+   received, so a character that is still incomplete when the function
+   is called may be returned later than characters of other channels
+   with later timestamps.
+
+   @exception EINVAL @p pool, @p decoded or @p n_decoded is NULL
+
+   @param[in] pool pool of receivers
+   @param[out] decoded decoded characters
+   @param[in] capacity count of items in @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-bool cw_gen_is_queue_full(cw_gen_t const * gen);
+cw_ret_t cw_rec_pool_read(cw_rec_pool_t * pool, cw_rec_pool_decoded_t * decoded, size_t capacity, size_t * n_decoded);
 
 
 
 
-typedef void (* cw_gen_value_tracking_callback_t)(void * callback_arg, int state);
-void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_value_tracking_callback_t callback_func, void * callback_arg);
+/* **************** Speculative receiver **************** */
 
 
 
 
-/* **************** Key **************** */
+/**
+   @brief Create receiver decoding signal of unknown speed
 
+   The receiver runs @p n_hypotheses compact receivers in fixed speed
+   mode (see cw_rec_compact_init()) on the same Marks and Spaces. Their
+   speeds are spread evenly on logarithmic scale between @p speed_min
+   and @p speed_max. Hypotheses get points for received characters with
+   valid representation and for words found in dictionary (see
+   cw_rec_spec_set_dictionary()), and lose points for invalid
+   representations. Characters of best scoring hypothesis are passed
+   to client code.
 
+   Neighbouring hypotheses should not differ by more than 30% of
+   speed, e.g. use 11 hypotheses for range of 5 - 50 wpm.
 
+   Returned pointer is owned by caller. Delete the allocated receiver
+   with cw_rec_spec_delete().
 
-/*
-  For straight key this is a value of a single (and the only) element of a
-  key.
+   @exception EINVAL @p speed_min, @p speed_max or @p n_hypotheses is out of range
 
-  For a iambic keyer and other key types this a value of one of two paddles.
+   @param[in] speed_min speed of slowest hypothesis [wpm]
+   @param[in] speed_max speed of fastest hypothesis [wpm]
+   @param[in] n_hypotheses count of hypotheses
 
-  A state of key's internal graph (state machine) can have values that have
-  _STATE_ in their names. I'm making here a distinction between "value" and
-  "state", reserving word "state" for state of the internal graph (state
-  machine).
+   @return pointer to new receiver on success
+   @return NULL on failure
 */
-typedef enum {
-	CW_KEY_VALUE_OPEN = CW_KEY_STATE_OPEN,      /* Space, no sound. */
-	CW_KEY_VALUE_CLOSED = CW_KEY_STATE_CLOSED,  /* Mark, sound. */
-} cw_key_value_t;
+cw_rec_spec_t * cw_rec_spec_new(int speed_min, int speed_max, int n_hypotheses);
 
 
 
 
-cw_key_t * cw_key_new(void);
-void cw_key_delete(cw_key_t ** key);
+/**
+   @brief Delete speculative receiver
+
+   @param[in,out] spec pointer to receiver to delete
+*/
+void cw_rec_spec_delete(cw_rec_spec_t ** spec);
 
 
 
 
 /**
-   @brief Set label (name) of given key instance
+   @brief Set dictionary of words expected in received text
 
-   The label can be used by client code to distinguish different
-   instances of keys. The label is used in library's debug
-   messages.
+   Word decoded by a hypothesis and found in dictionary gets additional
+   points, which helps to choose between hypotheses that all decode
+   valid characters. Words are compared without regard to case. The
+   words are copied. Pass zero @p n_words to remove dictionary.
 
-   @p key can't be NULL.
+   @exception EINVAL @p spec is NULL, or a word is empty or longer than 15 characters
 
-   @p label can't be NULL.
+   @param[in,out] spec speculative receiver
+   @param[in] words words of dictionary
+   @param[in] n_words count of items in @p words
 
-   @p label can be an empty string: key's label will become empty
-   string.
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_spec_set_dictionary(cw_rec_spec_t * spec, const char * const * words, size_t n_words);
 
-   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
-   be truncated and
-   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
-   logged. This is not treated as error: function will not return
-   `CW_FAILURE` because of that.
 
-   @param[in] key key for which to set label
-   @param[in] label new label to set for given @p key
+
+
+/**
+   @brief Receive recorded sequence of Marks and Spaces
+
+   Works as cw_rec_receive_edges(), except that characters are stored
+   in @p decoded only when best scoring hypothesis recognizes
+   inter-word-space: @p decoded gets the whole word at once, followed
+   by ' '. Recording should therefore end with Space long enough to be
+   recognized as inter-word-space.
+
+   @exception EINVAL @p spec, @p decoded or @p n_decoded is NULL
+   @exception ENOMEM decoded characters don't fit into @p decoded
+
+   @param[in,out] spec speculative receiver
+   @param[in] timestamp time of beginning of first edge [microseconds]
+   @param[in] edges Marks and Spaces
+   @param[in] n_edges count of items in @p edges
+   @param[out] decoded buffer for decoded characters
+   @param[in] capacity count of items in @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
 
    @return CW_SUCCESS on success
-   @return CW_FAILURE otherwise (e.g. @p key or @p label is NULL)
+   @return CW_FAILURE on failure
 */
-cw_ret_t cw_key_set_label(cw_key_t * key, const char * label);
+cw_ret_t cw_rec_spec_receive_edges(cw_rec_spec_t * spec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
 
 
 
 
 /**
-   @brief Get label (name) of given key instance
+   @brief Get speed of hypothesis whose characters were passed to client code most recently
 
-   @p key and @p label can't be NULL.
+   @param[in] spec speculative receiver
 
-   @p label should be a buffer of size at least
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
+   @return speed [wpm]
+*/
+int cw_rec_spec_get_speed(const cw_rec_spec_t * spec);
 
-   @p size should have value equal to size of @p label char buffer.
 
-   @p size is not validated: it could be smaller than
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
-   get only as many characters of key's label as he asked for.
 
-   @param[in] key key from which to get label
-   @param[out] label output buffer
-   @param[in] size total size of output buffer @p label
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure (e.g. @p key or @p label is NULL)
-*/
-cw_ret_t cw_key_get_label(const cw_key_t * key, char * label, size_t size);
+/* **************** Tone detector **************** */
 
 
 
 
-void cw_key_register_generator(volatile cw_key_t * key, cw_gen_t * gen);
-void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec);
+/**
+   @brief Create new detector of tone in stream of sound samples
 
-void cw_key_ik_enable_curtis_mode_b(volatile cw_key_t * key);
-void cw_key_ik_disable_curtis_mode_b(volatile cw_key_t * key);
-bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t * key);
-cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value);
-cw_ret_t cw_key_ik_notify_dash_paddle_event(volatile cw_key_t * key, cw_key_value_t dash_paddle_value);
-cw_ret_t cw_key_ik_notify_dot_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value);
-void cw_key_ik_get_paddles(const volatile cw_key_t * key, cw_key_value_t * dot_paddle_value, cw_key_value_t * dash_paddle_value);
-cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key);
-cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key);
+   The detector measures magnitude of tone with frequency @p frequency
+   in samples passed to cw_detector_process(), and calls
+   cw_rec_mark_begin() and cw_rec_mark_end() for @p rec when the tone
+   appears and disappears. Level of detection follows levels of signal
+   and noise.
 
-cw_ret_t cw_key_sk_get_value(const volatile cw_key_t * key, cw_key_value_t * key_value);
-cw_ret_t cw_key_sk_set_value(volatile cw_key_t * key, cw_key_value_t key_value);
+   Detector doesn't create threads, so one thread can process samples
+   of many channels with many detectors (and receivers).
 
+   Returned pointer is owned by caller. Delete the allocated detector
+   with cw_detector_delete().
 
+   @param[in] rec receiver to be driven by detector (not owned by detector)
+   @param[in] sample_rate sample rate of input samples [Hz]
+   @param[in] frequency frequency of tone to detect [Hz]
 
+   @return pointer to new detector on success
+   @return NULL on failure
+*/
+cw_detector_t * cw_detector_new(cw_rec_t * rec, int sample_rate, int frequency);
 
-/* **************** Receiver **************** */
 
 
 
+/**
+   @brief Delete a detector
 
-/* Creator and destructor. */
-cw_rec_t * cw_rec_new(void);
-void       cw_rec_delete(cw_rec_t ** rec);
+   Receiver used by the detector is not deleted.
+
+   @param[in,out] detector pointer to detector to delete
+*/
+void cw_detector_delete(cw_detector_t ** detector);
 
 
 
 
 /**
-   @brief Set label (name) of given receiver instance
+   @brief Process block of sound samples
 
-   The label can be used by client code to distinguish different
-   instances of receivers. The label is used in library's debug
-   messages.
+   Blocks may have any size: samples are accumulated internally until
+   there is enough of them for detection.
 
-   @p rec can't be NULL.
+   Timestamps passed to receiver are calculated from position of
+   samples in stream. If @p timestamp is not NULL, it is a timestamp of
+   first sample in @p samples. If @p timestamp is NULL, samples
+   are assumed to directly follow samples from previous call (and for
+   first call they are assumed to start now).
 
-   @p label can't be NULL.
+   @param[in] detector detector
+   @param[in] timestamp timestamp of first sample in @p samples (may be NULL)
+   @param[in] samples samples (mono, sample rate given to cw_detector_new())
+   @param[in] n_samples count of samples in @p samples
 
-   @p label can be an empty string: receiver's label will become empty
-   string.
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid arguments
+*/
+cw_ret_t cw_detector_process(cw_detector_t * detector, const struct timeval * timestamp, const cw_sample_t * samples, size_t n_samples);
 
-   @p label longer than (LIBCW_OBJECT_INSTANCE_LABEL_SIZE-1) characters will
-   be truncated and
-   `cw_debug_object:CW_DEBUG_CLIENT_CODE:CW_DEBUG_WARNING` will be
-   logged. This is not treated as error: function will not return
-   `CW_FAILURE` because of that.
 
-   @param[in,out] rec receiver for which to set label
-   @param[in] label new label to set for given @p rec
+
+
+/**
+   @brief Get timestamp of end of samples processed by detector
+
+   The timestamp should be passed to cw_rec_poll_character() or
+   cw_rec_poll_representation() of receiver driven by detector, so that
+   the receiver measures spaces on the same timeline as marks.
+
+   @param[in] detector detector
+   @param[out] timestamp timestamp of end of last processed sample
 
    @return CW_SUCCESS on success
-   @return CW_FAILURE otherwise (e.g. @p rec or @p label is NULL)
+   @return CW_FAILURE if no samples have been processed yet
 */
-int cw_rec_set_label(cw_rec_t * rec, const char * label);
+cw_ret_t cw_detector_get_timestamp(const cw_detector_t * detector, struct timeval * timestamp);
 
 
 
 
-/**
-   @brief Get label (name) of given receiver instance
+/* **************** Skimmer **************** */
 
-   @p rec and @p label can't be NULL.
 
-   @p label should be a buffer of size at least
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE.
 
-   @p size should have value equal to size of @p label char buffer.
 
-   @p size is not validated: it could be smaller than
-   LIBCW_OBJECT_INSTANCE_LABEL_SIZE, it could be zero. Function's caller will
-   get only as many characters of receiver's label as he asked for.
+/**
+   @brief Callback receiving characters decoded by skimmer
 
-   @param[in] rec receiver from which to get label
-   @param[out] label output buffer
-   @param[in] size total size of output buffer @p label
+   @p character is a decoded character, or a space at the end of a word
+   (then @p is_end_of_word is true).
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure (e.g. @p rec or @p label is NULL)
+   @param[in] callback_arg argument registered with cw_skimmer_register_callback()
+   @param[in] frequency frequency of carrier on which the character was received [Hz]
+   @param[in] character decoded character
+   @param[in] is_end_of_word is this a space at the end of word?
 */
-int cw_rec_get_label(const cw_rec_t * rec, char * label, size_t size);
+typedef void (* cw_skimmer_callback_t)(void * callback_arg, int frequency, char character, bool is_end_of_word);
 
 
 
 
-/* Helper receive functions. */
-cw_ret_t cw_rec_poll_character(cw_rec_t * rec, const struct timeval * timestamp, char * character, bool * is_end_of_word, bool * is_error);
+/**
+   @brief Create new skimmer
 
+   A skimmer decodes all CW signals in passband from @p frequency_low
+   to @p frequency_high in one stream of samples. Every carrier found
+   in the passband gets its own receiver working in adaptive mode.
 
-/* Setters of receiver's essential parameters. */
+   Samples are processed by @p n_threads threads (the thread calling
+   cw_skimmer_process() is one of them).
 
-/**
-   @brief Set receive speed of given receiver
+   Returned pointer is owned by caller. Delete the allocated skimmer
+   with cw_skimmer_delete().
 
-   If a receiver is working in non-adaptive mode, it needs to have its
-   receive speed set to specific value (to the value of source (sender) of
-   Morse code data). Otherwise there will be a mismatch between speeds of
-   sender and receiver, and the receiving will fail.
+   @param[in] sample_rate sample rate of input samples [Hz]
+   @param[in] frequency_low lower edge of passband [Hz]
+   @param[in] frequency_high upper edge of passband [Hz]
+   @param[in] n_threads count of threads processing samples
 
-   Range of valid speeds is the same as for generator (CW_SPEED_MIN to
-   CW_SPEED_MAX, inclusive).
+   @return pointer to new skimmer on success
+   @return NULL on failure
+*/
+cw_skimmer_t * cw_skimmer_new(int sample_rate, int frequency_low, int frequency_high, int n_threads);
 
-   By default a receiver works in non-adaptive mode.
 
-   @param[in] rec Receiver for which to set the speed
-   @param[in] speed New value of speed
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE if function failed to set speed in receiver
+
+/**
+   @brief Delete a skimmer
+
+   @param[in,out] skimmer pointer to skimmer to delete
 */
-cw_ret_t cw_rec_set_speed(cw_rec_t * rec, int new_value);
-cw_ret_t cw_rec_set_tolerance(cw_rec_t * rec, int new_value);
-cw_ret_t cw_rec_set_gap(cw_rec_t * rec, int new_value);
-cw_ret_t cw_rec_set_noise_spike_threshold(cw_rec_t * rec, int new_value);
-void cw_rec_set_adaptive_mode_internal(cw_rec_t * rec, bool adaptive);
+void cw_skimmer_delete(cw_skimmer_t ** skimmer);
 
-/* Getters of receiver's essential parameters. */
-float cw_rec_get_speed(const cw_rec_t * rec);
-int   cw_rec_get_tolerance(const cw_rec_t * rec);
-/* int   cw_rec_get_gap_internal(cw_rec_t * rec); */
-int   cw_rec_get_noise_spike_threshold(const cw_rec_t * rec);
-bool  cw_rec_get_adaptive_mode(const cw_rec_t * rec);
+
+
+
+/**
+   @brief Register callback receiving characters decoded by skimmer
+
+   The callback is called from cw_skimmer_process(), in thread calling
+   the function.
+
+   @param[in] skimmer skimmer
+   @param[in] callback_func callback (NULL to unregister)
+   @param[in] callback_arg first argument of callback
+*/
+void cw_skimmer_register_callback(cw_skimmer_t * skimmer, cw_skimmer_callback_t callback_func, void * callback_arg);
 
 
 
 
 /**
-   @brief Reset receiver's state machine to initial state
+   @brief Process block of sound samples
 
-   The state includes, but is not limited to, state graph and
-   representation buffer.
+   Timestamps of samples are calculated in the same way as in
+   cw_detector_process().
 
-   Receiver's parameters and statistics are not reset by this function.
-   To reset statistics use cw_rec_reset_statistics().
+   @param[in] skimmer skimmer
+   @param[in] timestamp timestamp of first sample in @p samples (may be NULL)
+   @param[in] samples samples (mono, sample rate given to cw_skimmer_new())
+   @param[in] n_samples count of samples in @p samples
 
-   @param[in,out] rec receiver to reset
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on invalid arguments or allocation errors
 */
-void cw_rec_reset_state(cw_rec_t * rec);
+cw_ret_t cw_skimmer_process(cw_skimmer_t * skimmer, const struct timeval * timestamp, const cw_sample_t * samples, size_t n_samples);
 
 
 
 
 /**
-   @brief Reset receiver's statistics
-
-   Reset the receiver's statistics by removing all records from it and
-   returning it to its initial default state.
+   @brief Get count of carriers currently decoded by skimmer
 
-   #reviewed 2017-02-02
+   @param[in] skimmer skimmer
 
-   @param[in,out] rec receiver for which to reset statistics
+   @return count of open channels
 */
-void cw_rec_reset_statistics(cw_rec_t * rec);
+int cw_skimmer_get_n_channels(const cw_skimmer_t * skimmer);
 
 
 
 
-/* Main receive functions. */
-cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp);
-cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp);
-cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char mark);
+/**
+   @brief Load timing profiles of stations expected at given frequencies
 
+   When skimmer opens a channel for a carrier at or near
+   @p frequencies[i] (within a few bins of channelizer), receiver of
+   the channel is seeded with @p profiles[i] (see
+   cw_rec_compact_set_profile()) instead of starting from default
+   speed, so the first characters of known stations are decoded
+   correctly. Profiles replace all profiles loaded earlier, and are
+   used for channels opened after the call. Pass zero @p n to remove
+   profiles.
 
-/* Helper receive functions. */
-cw_ret_t cw_rec_poll_representation(cw_rec_t * rec, const struct timeval * timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+   @exception EINVAL a frequency is outside of skimmer's passband, or a profile is invalid
 
-void cw_rec_enable_adaptive_mode(cw_rec_t * rec);
-void cw_rec_disable_adaptive_mode(cw_rec_t * rec);
+   @param[in,out] skimmer skimmer
+   @param[in] frequencies frequencies of stations [Hz]
+   @param[in] profiles timing profiles of stations
+   @param[in] n count of items in @p frequencies and @p profiles
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_skimmer_set_profiles(cw_skimmer_t * skimmer, const int * frequencies, const cw_rec_profile_t * profiles, size_t n);
 
 
 
@@ -0,0 +1,516 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW2_HPP
+#define H_LIBCW2_HPP
+
+
+
+
+/*
+  C++ wrappers of libcw's generator, receiver and key.
+
+  Wrappers own libcw's objects: they are move-only, and the objects
+  are deleted by destructors of wrappers.
+
+  Operations waiting for events (level of generator's queue, end of
+  tone, completion of token, character received by receiver) don't
+  block. They take a handler that is called when the event happens.
+  Event loop of application watches descriptor returned by event_fd()
+  of a wrapper (e.g. with QSocketNotifier, GSource or poll()), and
+  calls process_events() of the wrapper when the descriptor becomes
+  readable. Handlers are called only by process_events(), or by the
+  function starting a wait if the event has happened already, so they
+  are always called in the event loop's thread, never in library's
+  threads.
+
+  With C++20 coroutines the same operations are available as
+  awaitables, e.g.:
+
+	co_await generator.wait_for_queue_level(0);
+	const cw::Receiver::Character c = co_await receiver.next_character();
+
+  Coroutine is resumed by process_events().
+*/
+
+
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define LIBCW2_HPP_HAS_COROUTINES 1
+#endif
+#endif
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+namespace cw {
+
+
+
+
+#if defined(LIBCW2_HPP_HAS_COROUTINES)
+namespace detail {
+
+	/* Awaitable started by function that takes a handler. If the
+	   handler is called before the function returns, the coroutine
+	   isn't suspended at all. */
+	template <typename Result>
+	class Awaitable {
+	public:
+		typedef std::function<void(std::function<void(const Result &)>)> Initiate;
+
+		explicit Awaitable(Initiate initiate) : initiate(std::move(initiate)) {}
+
+		bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			std::shared_ptr<int> state = std::make_shared<int>(STARTING);
+			this->initiate([this, state, handle](const Result & result) {
+				this->result = result;
+				if (STARTING == *state) {
+					*state = DONE;
+				} else {
+					handle.resume();
+				}
+			});
+			if (DONE == *state) {
+				return false;
+			}
+			*state = SUSPENDED;
+			return true;
+		}
+
+		Result await_resume() const { return this->result; }
+
+	private:
+		enum { STARTING, SUSPENDED, DONE };
+		Initiate initiate;
+		Result result = Result();
+	};
+
+} /* namespace detail */
+#endif
+
+
+
+
+/* Generator, see cw_gen_new(). */
+class Generator {
+public:
+	Generator() {}
+	explicit Generator(const cw_gen_config_t & config) : gen(cw_gen_new(&config)) {}
+	~Generator() { this->reset(); }
+
+	Generator(Generator && other) noexcept : gen(other.gen), waits(std::move(other.waits)) { other.gen = nullptr; }
+	Generator & operator=(Generator && other) noexcept
+	{
+		if (this != &other) {
+			this->reset();
+			this->gen = other.gen;
+			this->waits = std::move(other.waits);
+			other.gen = nullptr;
+		}
+		return *this;
+	}
+	Generator(const Generator &) = delete;
+	Generator & operator=(const Generator &) = delete;
+
+	/* False if generator couldn't be created. */
+	explicit operator bool() const { return nullptr != this->gen; }
+
+	/* Use the pointer with functions of libcw2.h that don't have
+	   wrappers here. */
+	cw_gen_t * get() const { return this->gen; }
+
+	/* Delete generator. Pending handlers are not called. */
+	void reset()
+	{
+		this->waits.clear();
+		if (nullptr != this->gen) {
+			cw_gen_stop(this->gen);
+			cw_gen_delete(&this->gen);
+		}
+	}
+
+	bool start() { return CW_SUCCESS == cw_gen_start(this->gen); }
+	bool stop() { return CW_SUCCESS == cw_gen_stop(this->gen); }
+	bool enqueue_string(const char * string) { return CW_SUCCESS == cw_gen_enqueue_string(this->gen, string); }
+	bool enqueue_string(const char * string, uint64_t & token) { return CW_SUCCESS == cw_gen_enqueue_string_with_token(this->gen, string, &token); }
+	void flush_queue() { cw_gen_flush_queue(this->gen); }
+
+	/* Descriptor to be watched by event loop, see
+	   cw_gen_get_queue_event_fd(). -1 on failure. */
+	int event_fd() { return cw_gen_get_queue_event_fd(this->gen); }
+
+	/* Call @p handler when length of queue drops to @p level or
+	   below. */
+	void async_wait_for_queue_level(size_t level, std::function<void()> handler)
+	{
+		this->add_wait(Wait::QUEUE_LEVEL, level, std::move(handler));
+	}
+
+	/* Call @p handler at the end of tone that is played now (or of
+	   next tone, if generator is idle). */
+	void async_wait_for_end_of_tone(std::function<void()> handler)
+	{
+		this->add_wait(Wait::END_OF_TONE, this->n_tone_ends(), std::move(handler));
+	}
+
+	/* Call @p handler when token returned by enqueue_string() is
+	   completed. */
+	void async_wait_for_token(uint64_t token, std::function<void()> handler)
+	{
+		this->add_wait(Wait::TOKEN, token, std::move(handler));
+	}
+
+	/* Call handlers of waits that are over. Call when descriptor
+	   returned by event_fd() is readable. */
+	void process_events()
+	{
+		if (nullptr == this->gen) {
+			return;
+		}
+		cw_gen_clear_queue_event(this->gen);
+
+		/* Handlers may start new waits. */
+		std::vector<std::function<void()>> ready;
+		for (size_t i = 0; i < this->waits.size(); ) {
+			if (this->is_over(this->waits[i])) {
+				ready.push_back(std::move(this->waits[i].handler));
+				this->waits.erase(this->waits.begin() + (std::ptrdiff_t) i);
+			} else {
+				i++;
+			}
+		}
+		for (size_t i = 0; i < ready.size(); i++) {
+			ready[i]();
+		}
+	}
+
+#if defined(LIBCW2_HPP_HAS_COROUTINES)
+	struct Done {};
+	detail::Awaitable<Done> wait_for_queue_level(size_t level)
+	{
+		return detail::Awaitable<Done>([this, level](std::function<void(const Done &)> resume) {
+			this->async_wait_for_queue_level(level, [resume]() { resume(Done()); });
+		});
+	}
+	detail::Awaitable<Done> wait_for_end_of_tone()
+	{
+		return detail::Awaitable<Done>([this](std::function<void(const Done &)> resume) {
+			this->async_wait_for_end_of_tone([resume]() { resume(Done()); });
+		});
+	}
+	detail::Awaitable<Done> wait_for_token(uint64_t token)
+	{
+		return detail::Awaitable<Done>([this, token](std::function<void(const Done &)> resume) {
+			this->async_wait_for_token(token, [resume]() { resume(Done()); });
+		});
+	}
+#endif
+
+private:
+	struct Wait {
+		enum Kind { QUEUE_LEVEL, END_OF_TONE, TOKEN } kind;
+		uint64_t value;
+		std::function<void()> handler;
+	};
+
+	void add_wait(Wait::Kind kind, uint64_t value, std::function<void()> handler)
+	{
+		Wait wait = { kind, value, std::move(handler) };
+		/* Make sure that the descriptor exists before the
+		   condition is checked, so that no event is missed. */
+		this->event_fd();
+		if (this->is_over(wait)) {
+			wait.handler();
+		} else {
+			this->waits.push_back(std::move(wait));
+		}
+	}
+
+	bool is_over(const Wait & wait) const
+	{
+		switch (wait.kind) {
+		case Wait::QUEUE_LEVEL:
+			return cw_gen_get_queue_length(this->gen) <= wait.value;
+		case Wait::END_OF_TONE:
+			return this->n_tone_ends() > wait.value;
+		case Wait::TOKEN:
+		default:
+			return cw_gen_is_token_completed(this->gen, wait.value);
+		}
+	}
+
+	uint64_t n_tone_ends() const
+	{
+		cw_gen_metrics_t metrics;
+		cw_gen_get_metrics(this->gen, &metrics);
+		return metrics.n_tone_ends;
+	}
+
+	cw_gen_t * gen = nullptr;
+	std::vector<Wait> waits;
+};
+
+
+
+
+/* Receiver, see cw_rec_new(). Characters received by receiver are
+   passed from library's scheduler thread (see
+   cw_rec_register_character_callback()) to event loop through a
+   pipe. */
+class Receiver {
+public:
+	struct Character {
+		char character;       /* ' ' for end of word. */
+		bool is_end_of_word;
+		bool is_error;
+	};
+
+	Receiver() : rec(cw_rec_new())
+	{
+		if (nullptr == this->rec) {
+			return;
+		}
+		this->shared.reset(new Shared());
+		if (0 != pipe(this->shared->fds)) {
+			this->reset();
+			return;
+		}
+		for (int i = 0; i < 2; i++) {
+			fcntl(this->shared->fds[i], F_SETFL, fcntl(this->shared->fds[i], F_GETFL) | O_NONBLOCK);
+			fcntl(this->shared->fds[i], F_SETFD, FD_CLOEXEC);
+		}
+		cw_rec_register_character_callback(this->rec, Receiver::character_callback, this->shared.get());
+	}
+	~Receiver() { this->reset(); }
+
+	Receiver(Receiver && other) noexcept
+		: rec(other.rec), shared(std::move(other.shared)),
+		  received(std::move(other.received)), handlers(std::move(other.handlers)) { other.rec = nullptr; }
+	Receiver & operator=(Receiver && other) noexcept
+	{
+		if (this != &other) {
+			this->reset();
+			this->rec = other.rec;
+			this->shared = std::move(other.shared);
+			this->received = std::move(other.received);
+			this->handlers = std::move(other.handlers);
+			other.rec = nullptr;
+		}
+		return *this;
+	}
+	Receiver(const Receiver &) = delete;
+	Receiver & operator=(const Receiver &) = delete;
+
+	explicit operator bool() const { return nullptr != this->rec && nullptr != this->shared; }
+
+	/* Use the pointer with functions of libcw2.h that don't have
+	   wrappers here. Don't poll the receiver and don't register
+	   another character callback. */
+	cw_rec_t * get() const { return this->rec; }
+
+	/* Delete receiver. Pending handlers are not called. */
+	void reset()
+	{
+		this->handlers.clear();
+		this->received.clear();
+		if (nullptr != this->rec) {
+			/* Unregisters the callback too. */
+			cw_rec_delete(&this->rec);
+		}
+		if (nullptr != this->shared) {
+			for (int i = 0; i < 2; i++) {
+				if (-1 != this->shared->fds[i]) {
+					close(this->shared->fds[i]);
+				}
+			}
+			this->shared.reset();
+		}
+	}
+
+	/* Descriptor to be watched by event loop. */
+	int event_fd() const { return nullptr == this->shared ? -1 : this->shared->fds[0]; }
+
+	/* Call @p handler with next received character. Characters
+	   received while no handler is waiting are kept for next calls. */
+	void async_next_character(std::function<void(const Character &)> handler)
+	{
+		if (!this->received.empty()) {
+			const Character character = this->received.front();
+			this->received.pop_front();
+			handler(character);
+		} else {
+			this->handlers.push_back(std::move(handler));
+		}
+	}
+
+	/* Pass received characters to handlers. Call when descriptor
+	   returned by event_fd() is readable. */
+	void process_events()
+	{
+		if (nullptr == this->shared) {
+			return;
+		}
+		char buffer[64];
+		while (read(this->shared->fds[0], buffer, sizeof (buffer)) > 0) {
+			;
+		}
+
+		std::deque<Character> characters;
+		{
+			std::lock_guard<std::mutex> lock(this->shared->mutex);
+			characters.swap(this->shared->characters);
+		}
+		this->received.insert(this->received.end(), characters.begin(), characters.end());
+
+		while (!this->received.empty() && !this->handlers.empty()) {
+			const Character character = this->received.front();
+			this->received.pop_front();
+			std::function<void(const Character &)> handler = std::move(this->handlers.front());
+			this->handlers.pop_front();
+			handler(character);
+		}
+	}
+
+#if defined(LIBCW2_HPP_HAS_COROUTINES)
+	detail::Awaitable<Character> next_character()
+	{
+		return detail::Awaitable<Character>([this](std::function<void(const Character &)> resume) {
+			this->async_next_character(std::move(resume));
+		});
+	}
+#endif
+
+private:
+	/* State shared with scheduler thread. Kept on heap, so that its
+	   address (argument of callback) doesn't change when the
+	   wrapper is moved. */
+	struct Shared {
+		std::mutex mutex;
+		std::deque<Character> characters;
+		int fds[2] = { -1, -1 };
+	};
+
+	static void character_callback(void * callback_arg, char character, bool is_end_of_word, bool is_error)
+	{
+		Shared * shared = static_cast<Shared *>(callback_arg);
+		std::lock_guard<std::mutex> lock(shared->mutex);
+		const Character received = { character, is_end_of_word, is_error };
+		shared->characters.push_back(received);
+		if (1 == shared->characters.size()) {
+			/* Pipe is non-blocking. If it is full, it is
+			   readable anyway. */
+			const char value = 1;
+			const ssize_t rv = write(shared->fds[1], &value, sizeof (value));
+			(void) rv;
+		}
+	}
+
+	cw_rec_t * rec = nullptr;
+	std::unique_ptr<Shared> shared;
+	std::deque<Character> received;
+	std::deque<std::function<void(const Character &)>> handlers;
+};
+
+
+
+
+/* Key, see cw_key_new(). Generator and receiver registered with the
+   key must outlive the key. */
+class Key {
+public:
+	/* Called on each change of value of key, in thread that changes
+	   the value (for iambic keyer: in generator's thread). */
+	typedef std::function<void(cw_key_value_t value, int64_t timestamp)> ValueCallback;
+
+	Key() : key(cw_key_new()) {}
+	~Key() { this->reset(); }
+
+	Key(Key && other) noexcept : key(other.key), callback(std::move(other.callback)) { other.key = nullptr; }
+	Key & operator=(Key && other) noexcept
+	{
+		if (this != &other) {
+			this->reset();
+			this->key = other.key;
+			this->callback = std::move(other.callback);
+			other.key = nullptr;
+		}
+		return *this;
+	}
+	Key(const Key &) = delete;
+	Key & operator=(const Key &) = delete;
+
+	explicit operator bool() const { return nullptr != this->key; }
+	cw_key_t * get() const { return this->key; }
+
+	void reset()
+	{
+		if (nullptr != this->key) {
+			cw_key_delete(&this->key);
+		}
+		this->callback.reset();
+	}
+
+	void register_generator(Generator & generator) { cw_key_register_generator(this->key, generator.get()); }
+	void register_receiver(Receiver & receiver) { cw_key_register_receiver(this->key, receiver.get()); }
+
+	/* Empty @p value_callback unregisters the callback. */
+	void register_value_callback(ValueCallback value_callback)
+	{
+		if (!value_callback) {
+			cw_key_register_value_callback(this->key, nullptr, nullptr);
+			this->callback.reset();
+			return;
+		}
+		/* Kept on heap, so that its address doesn't change when
+		   the wrapper is moved. */
+		std::unique_ptr<ValueCallback> new_callback(new ValueCallback(std::move(value_callback)));
+		cw_key_register_value_callback(this->key, Key::value_callback_trampoline, new_callback.get());
+		this->callback = std::move(new_callback);
+	}
+
+private:
+	static void value_callback_trampoline(void * callback_arg, cw_key_value_t value, int64_t timestamp)
+	{
+		(*static_cast<ValueCallback *>(callback_arg))(value, timestamp);
+	}
+
+	cw_key_t * key = nullptr;
+	std::unique_ptr<ValueCallback> callback;
+};
+
+
+
+
+} /* namespace cw */
+
+
+
+
+#endif /* #ifndef H_LIBCW2_HPP */
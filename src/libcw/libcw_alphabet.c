@@ -0,0 +1,531 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+/**
+   @file libcw_alphabet.c
+
+   @brief Alphabets of characters identified by Unicode code points.
+
+   Main table of characters in libcw_data.c is indexed by single-byte
+   characters, so it can't hold non-Latin alphabets. An alphabet maps
+   Unicode code points to representations. Code points are looked up
+   in a two-level table (page of 256 code points, then entry in the
+   page), and representations are looked up by their hash (see
+   cw_representation_to_hash_internal()), so both lookups are O(1).
+
+   Code points of ASCII characters that are not present in an alphabet
+   are looked up in main table of characters, so that digits and
+   punctuation can be used with any alphabet.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_alphabet.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+
+
+
+
+#define MSG_PREFIX "libcw/alphabet: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Accented Latin letters. Letters of ISO 8859-1 and ISO 8859-2 present in
+   main table of characters, with their lower case forms. */
+static const cw_alphabet_entry_t g_alphabet_latin[] = {
+	{ 0x00DC, "..--"    },   /* Latin capital letter u with diaeresis */
+	{ 0x00FC, "..--"    },   /* Latin small letter u with diaeresis */
+	{ 0x00C4, ".-.-"    },   /* Latin capital letter a with diaeresis */
+	{ 0x00E4, ".-.-"    },   /* Latin small letter a with diaeresis */
+	{ 0x00C7, "-.-.."   },   /* Latin capital letter c with cedilla */
+	{ 0x00E7, "-.-.."   },   /* Latin small letter c with cedilla */
+	{ 0x00D6, "---."    },   /* Latin capital letter o with diaeresis */
+	{ 0x00F6, "---."    },   /* Latin small letter o with diaeresis */
+	{ 0x00C9, "..-.."   },   /* Latin capital letter e with acute */
+	{ 0x00E9, "..-.."   },   /* Latin small letter e with acute */
+	{ 0x00C8, ".-..-"   },   /* Latin capital letter e with grave */
+	{ 0x00E8, ".-..-"   },   /* Latin small letter e with grave */
+	{ 0x00C0, ".--.-"   },   /* Latin capital letter a with grave */
+	{ 0x00E0, ".--.-"   },   /* Latin small letter a with grave */
+	{ 0x00D1, "--.--"   },   /* Latin capital letter n with tilde */
+	{ 0x00F1, "--.--"   },   /* Latin small letter n with tilde */
+	{ 0x015E, "----"    },   /* Latin capital letter s with cedilla */
+	{ 0x015F, "----"    },   /* Latin small letter s with cedilla */
+	{ 0x017B, "--..-"   },   /* Latin capital letter z with dot above */
+	{ 0x017C, "--..-"   },   /* Latin small letter z with dot above */
+};
+
+
+
+
+/* Russian Morse code. */
+static const cw_alphabet_entry_t g_alphabet_cyrillic[] = {
+	{ 0x0410, ".-"      },   /* Cyrillic capital letter a */
+	{ 0x0430, ".-"      },   /* Cyrillic small letter a */
+	{ 0x0411, "-..."    },   /* Cyrillic capital letter be */
+	{ 0x0431, "-..."    },   /* Cyrillic small letter be */
+	{ 0x0412, ".--"     },   /* Cyrillic capital letter ve */
+	{ 0x0432, ".--"     },   /* Cyrillic small letter ve */
+	{ 0x0413, "--."     },   /* Cyrillic capital letter ghe */
+	{ 0x0433, "--."     },   /* Cyrillic small letter ghe */
+	{ 0x0414, "-.."     },   /* Cyrillic capital letter de */
+	{ 0x0434, "-.."     },   /* Cyrillic small letter de */
+	{ 0x0415, "."       },   /* Cyrillic capital letter ie */
+	{ 0x0435, "."       },   /* Cyrillic small letter ie */
+	{ 0x0416, "...-"    },   /* Cyrillic capital letter zhe */
+	{ 0x0436, "...-"    },   /* Cyrillic small letter zhe */
+	{ 0x0417, "--.."    },   /* Cyrillic capital letter ze */
+	{ 0x0437, "--.."    },   /* Cyrillic small letter ze */
+	{ 0x0418, ".."      },   /* Cyrillic capital letter i */
+	{ 0x0438, ".."      },   /* Cyrillic small letter i */
+	{ 0x0419, ".---"    },   /* Cyrillic capital letter short i */
+	{ 0x0439, ".---"    },   /* Cyrillic small letter short i */
+	{ 0x041A, "-.-"     },   /* Cyrillic capital letter ka */
+	{ 0x043A, "-.-"     },   /* Cyrillic small letter ka */
+	{ 0x041B, ".-.."    },   /* Cyrillic capital letter el */
+	{ 0x043B, ".-.."    },   /* Cyrillic small letter el */
+	{ 0x041C, "--"      },   /* Cyrillic capital letter em */
+	{ 0x043C, "--"      },   /* Cyrillic small letter em */
+	{ 0x041D, "-."      },   /* Cyrillic capital letter en */
+	{ 0x043D, "-."      },   /* Cyrillic small letter en */
+	{ 0x041E, "---"     },   /* Cyrillic capital letter o */
+	{ 0x043E, "---"     },   /* Cyrillic small letter o */
+	{ 0x041F, ".--."    },   /* Cyrillic capital letter pe */
+	{ 0x043F, ".--."    },   /* Cyrillic small letter pe */
+	{ 0x0420, ".-."     },   /* Cyrillic capital letter er */
+	{ 0x0440, ".-."     },   /* Cyrillic small letter er */
+	{ 0x0421, "..."     },   /* Cyrillic capital letter es */
+	{ 0x0441, "..."     },   /* Cyrillic small letter es */
+	{ 0x0422, "-"       },   /* Cyrillic capital letter te */
+	{ 0x0442, "-"       },   /* Cyrillic small letter te */
+	{ 0x0423, "..-"     },   /* Cyrillic capital letter u */
+	{ 0x0443, "..-"     },   /* Cyrillic small letter u */
+	{ 0x0424, "..-."    },   /* Cyrillic capital letter ef */
+	{ 0x0444, "..-."    },   /* Cyrillic small letter ef */
+	{ 0x0425, "...."    },   /* Cyrillic capital letter ha */
+	{ 0x0445, "...."    },   /* Cyrillic small letter ha */
+	{ 0x0426, "-.-."    },   /* Cyrillic capital letter tse */
+	{ 0x0446, "-.-."    },   /* Cyrillic small letter tse */
+	{ 0x0427, "---."    },   /* Cyrillic capital letter che */
+	{ 0x0447, "---."    },   /* Cyrillic small letter che */
+	{ 0x0428, "----"    },   /* Cyrillic capital letter sha */
+	{ 0x0448, "----"    },   /* Cyrillic small letter sha */
+	{ 0x0429, "--.-"    },   /* Cyrillic capital letter shcha */
+	{ 0x0449, "--.-"    },   /* Cyrillic small letter shcha */
+	{ 0x042A, "--.--"   },   /* Cyrillic capital letter hard sign */
+	{ 0x044A, "--.--"   },   /* Cyrillic small letter hard sign */
+	{ 0x042B, "-.--"    },   /* Cyrillic capital letter yeru */
+	{ 0x044B, "-.--"    },   /* Cyrillic small letter yeru */
+	{ 0x042C, "-..-"    },   /* Cyrillic capital letter soft sign */
+	{ 0x044C, "-..-"    },   /* Cyrillic small letter soft sign */
+	{ 0x042D, "..-.."   },   /* Cyrillic capital letter e */
+	{ 0x044D, "..-.."   },   /* Cyrillic small letter e */
+	{ 0x042E, "..--"    },   /* Cyrillic capital letter yu */
+	{ 0x044E, "..--"    },   /* Cyrillic small letter yu */
+	{ 0x042F, ".-.-"    },   /* Cyrillic capital letter ya */
+	{ 0x044F, ".-.-"    },   /* Cyrillic small letter ya */
+	{ 0x0401, "."       },   /* Cyrillic capital letter io */
+	{ 0x0451, "."       },   /* Cyrillic small letter io */
+};
+
+
+
+
+/* Greek Morse code. */
+static const cw_alphabet_entry_t g_alphabet_greek[] = {
+	{ 0x0391, ".-"      },   /* Greek capital letter alpha */
+	{ 0x03B1, ".-"      },   /* Greek small letter alpha */
+	{ 0x0392, "-..."    },   /* Greek capital letter beta */
+	{ 0x03B2, "-..."    },   /* Greek small letter beta */
+	{ 0x0393, "--."     },   /* Greek capital letter gamma */
+	{ 0x03B3, "--."     },   /* Greek small letter gamma */
+	{ 0x0394, "-.."     },   /* Greek capital letter delta */
+	{ 0x03B4, "-.."     },   /* Greek small letter delta */
+	{ 0x0395, "."       },   /* Greek capital letter epsilon */
+	{ 0x03B5, "."       },   /* Greek small letter epsilon */
+	{ 0x0396, "--.."    },   /* Greek capital letter zeta */
+	{ 0x03B6, "--.."    },   /* Greek small letter zeta */
+	{ 0x0397, "...."    },   /* Greek capital letter eta */
+	{ 0x03B7, "...."    },   /* Greek small letter eta */
+	{ 0x0398, "-.-."    },   /* Greek capital letter theta */
+	{ 0x03B8, "-.-."    },   /* Greek small letter theta */
+	{ 0x0399, ".."      },   /* Greek capital letter iota */
+	{ 0x03B9, ".."      },   /* Greek small letter iota */
+	{ 0x039A, "-.-"     },   /* Greek capital letter kappa */
+	{ 0x03BA, "-.-"     },   /* Greek small letter kappa */
+	{ 0x039B, ".-.."    },   /* Greek capital letter lamda */
+	{ 0x03BB, ".-.."    },   /* Greek small letter lamda */
+	{ 0x039C, "--"      },   /* Greek capital letter mu */
+	{ 0x03BC, "--"      },   /* Greek small letter mu */
+	{ 0x039D, "-."      },   /* Greek capital letter nu */
+	{ 0x03BD, "-."      },   /* Greek small letter nu */
+	{ 0x039E, "-..-"    },   /* Greek capital letter xi */
+	{ 0x03BE, "-..-"    },   /* Greek small letter xi */
+	{ 0x039F, "---"     },   /* Greek capital letter omicron */
+	{ 0x03BF, "---"     },   /* Greek small letter omicron */
+	{ 0x03A0, ".--."    },   /* Greek capital letter pi */
+	{ 0x03C0, ".--."    },   /* Greek small letter pi */
+	{ 0x03A1, ".-."     },   /* Greek capital letter rho */
+	{ 0x03C1, ".-."     },   /* Greek small letter rho */
+	{ 0x03A3, "..."     },   /* Greek capital letter sigma */
+	{ 0x03C3, "..."     },   /* Greek small letter sigma */
+	{ 0x03A4, "-"       },   /* Greek capital letter tau */
+	{ 0x03C4, "-"       },   /* Greek small letter tau */
+	{ 0x03A5, "-.--"    },   /* Greek capital letter upsilon */
+	{ 0x03C5, "-.--"    },   /* Greek small letter upsilon */
+	{ 0x03A6, "..-."    },   /* Greek capital letter phi */
+	{ 0x03C6, "..-."    },   /* Greek small letter phi */
+	{ 0x03A7, "----"    },   /* Greek capital letter chi */
+	{ 0x03C7, "----"    },   /* Greek small letter chi */
+	{ 0x03A8, "--.-"    },   /* Greek capital letter psi */
+	{ 0x03C8, "--.-"    },   /* Greek small letter psi */
+	{ 0x03A9, ".--"     },   /* Greek capital letter omega */
+	{ 0x03C9, ".--"     },   /* Greek small letter omega */
+};
+
+
+
+
+/* Japanese Wabun code (katakana). */
+static const cw_alphabet_entry_t g_alphabet_wabun[] = {
+	{ 0x30A2, "--.--"   },   /* Katakana letter a */
+	{ 0x30A4, ".-"      },   /* Katakana letter i */
+	{ 0x30A6, "..-"     },   /* Katakana letter u */
+	{ 0x30A8, "-.---"   },   /* Katakana letter e */
+	{ 0x30AA, ".-..."   },   /* Katakana letter o */
+	{ 0x30AB, ".-.."    },   /* Katakana letter ka */
+	{ 0x30AD, "-.-.."   },   /* Katakana letter ki */
+	{ 0x30AF, "...-"    },   /* Katakana letter ku */
+	{ 0x30B1, "-.--"    },   /* Katakana letter ke */
+	{ 0x30B3, "----"    },   /* Katakana letter ko */
+	{ 0x30B5, "-.-.-"   },   /* Katakana letter sa */
+	{ 0x30B7, "--.-."   },   /* Katakana letter si */
+	{ 0x30B9, "---.-"   },   /* Katakana letter su */
+	{ 0x30BB, ".---."   },   /* Katakana letter se */
+	{ 0x30BD, "---."    },   /* Katakana letter so */
+	{ 0x30BF, "-."      },   /* Katakana letter ta */
+	{ 0x30C1, "..-."    },   /* Katakana letter ti */
+	{ 0x30C4, ".--."    },   /* Katakana letter tu */
+	{ 0x30C6, ".-.--"   },   /* Katakana letter te */
+	{ 0x30C8, "..-.."   },   /* Katakana letter to */
+	{ 0x30CA, ".-."     },   /* Katakana letter na */
+	{ 0x30CB, "-.-."    },   /* Katakana letter ni */
+	{ 0x30CC, "...."    },   /* Katakana letter nu */
+	{ 0x30CD, "--.-"    },   /* Katakana letter ne */
+	{ 0x30CE, "..--"    },   /* Katakana letter no */
+	{ 0x30CF, "-..."    },   /* Katakana letter ha */
+	{ 0x30D2, "--..-"   },   /* Katakana letter hi */
+	{ 0x30D5, "--.."    },   /* Katakana letter hu */
+	{ 0x30D8, "."       },   /* Katakana letter he */
+	{ 0x30DB, "-.."     },   /* Katakana letter ho */
+	{ 0x30DE, "-..-"    },   /* Katakana letter ma */
+	{ 0x30DF, "..-.-"   },   /* Katakana letter mi */
+	{ 0x30E0, "-"       },   /* Katakana letter mu */
+	{ 0x30E1, "-...-"   },   /* Katakana letter me */
+	{ 0x30E2, "-..-."   },   /* Katakana letter mo */
+	{ 0x30E4, ".--"     },   /* Katakana letter ya */
+	{ 0x30E6, "-..--"   },   /* Katakana letter yu */
+	{ 0x30E8, "--"      },   /* Katakana letter yo */
+	{ 0x30E9, "..."     },   /* Katakana letter ra */
+	{ 0x30EA, "--."     },   /* Katakana letter ri */
+	{ 0x30EB, "-.--."   },   /* Katakana letter ru */
+	{ 0x30EC, "---"     },   /* Katakana letter re */
+	{ 0x30ED, ".-.-"    },   /* Katakana letter ro */
+	{ 0x30EF, "-.-"     },   /* Katakana letter wa */
+	{ 0x30F0, ".-..-"   },   /* Katakana letter wi */
+	{ 0x30F1, ".--.."   },   /* Katakana letter we */
+	{ 0x30F2, ".---"    },   /* Katakana letter wo */
+	{ 0x30F3, ".-.-."   },   /* Katakana letter n */
+	{ 0x309B, ".."      },   /* Katakana-hiragana voiced sound mark */
+	{ 0x309C, "..--."   },   /* Katakana-hiragana semi-voiced sound mark */
+	{ 0x30FC, ".--.-"   },   /* Katakana-hiragana prolonged sound mark */
+};
+
+
+
+
+cw_alphabet_t * cw_alphabet_new(const cw_alphabet_entry_t * entries, size_t n_entries)
+{
+	if (NULL == entries || 0 == n_entries || n_entries > CW_ALPHABET_N_ENTRIES_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	for (size_t i = 0; i < n_entries; i++) {
+		const uint32_t code_point = entries[i].code_point;
+		if (0 == code_point || code_point > CW_ALPHABET_CODE_POINT_MAX
+		    || NULL == entries[i].representation
+		    || 0 == cw_representation_to_hash_internal(entries[i].representation)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_ERROR,
+				      MSG_PREFIX "invalid entry #%zu of alphabet (code point U+%04X)", i, (unsigned int) code_point);
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	cw_alphabet_t * alphabet = calloc(1, sizeof (cw_alphabet_t));
+	if (NULL == alphabet) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	/* Pages of code points used by the entries. */
+	for (size_t i = 0; i < n_entries; i++) {
+		const uint32_t page = entries[i].code_point >> CW_ALPHABET_PAGE_BITS;
+		if (0 == alphabet->page_index[page]) {
+			alphabet->page_index[page] = (uint16_t) ++alphabet->n_pages;
+		}
+	}
+
+	alphabet->characters = calloc(n_entries, sizeof (cw_alphabet_character_t));
+	alphabet->pages = calloc(alphabet->n_pages, sizeof (alphabet->pages[0]));
+	if (NULL == alphabet->characters || NULL == alphabet->pages) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_alphabet_delete(&alphabet);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < n_entries; i++) {
+		const uint32_t code_point = entries[i].code_point;
+		uint16_t * slot = &alphabet->pages[alphabet->page_index[code_point >> CW_ALPHABET_PAGE_BITS] - 1][code_point & (CW_ALPHABET_PAGE_SIZE - 1)];
+		if (0 != *slot) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_ERROR,
+				      MSG_PREFIX "duplicate code point U+%04X in alphabet", (unsigned int) code_point);
+			cw_alphabet_delete(&alphabet);
+			errno = EINVAL;
+			return NULL;
+		}
+
+		cw_alphabet_character_t * character = &alphabet->characters[alphabet->n_characters++];
+		character->code_point = code_point;
+		strncpy(character->representation, entries[i].representation, CW_DATA_MAX_REPRESENTATION_LENGTH);
+		*slot = (uint16_t) alphabet->n_characters;
+
+		const unsigned int hash = cw_representation_to_hash_internal(character->representation);
+		if (0 == alphabet->by_hash[hash]) {
+			alphabet->by_hash[hash] = (uint16_t) alphabet->n_characters;
+		}
+	}
+
+	return alphabet;
+}
+
+
+
+
+cw_alphabet_t * cw_alphabet_new_builtin(cw_alphabet_id_t id)
+{
+	switch (id) {
+	case CW_ALPHABET_LATIN:
+		return cw_alphabet_new(g_alphabet_latin, sizeof (g_alphabet_latin) / sizeof (g_alphabet_latin[0]));
+	case CW_ALPHABET_CYRILLIC:
+		return cw_alphabet_new(g_alphabet_cyrillic, sizeof (g_alphabet_cyrillic) / sizeof (g_alphabet_cyrillic[0]));
+	case CW_ALPHABET_GREEK:
+		return cw_alphabet_new(g_alphabet_greek, sizeof (g_alphabet_greek) / sizeof (g_alphabet_greek[0]));
+	case CW_ALPHABET_WABUN:
+		return cw_alphabet_new(g_alphabet_wabun, sizeof (g_alphabet_wabun) / sizeof (g_alphabet_wabun[0]));
+	default:
+		errno = EINVAL;
+		return NULL;
+	}
+}
+
+
+
+
+void cw_alphabet_delete(cw_alphabet_t ** alphabet)
+{
+	if (NULL == alphabet || NULL == *alphabet) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_LOOKUPS, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL alphabet");
+		return;
+	}
+
+	free((*alphabet)->characters);
+	free((*alphabet)->pages);
+	free(*alphabet);
+	*alphabet = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Look up representation of a code point in alphabet
+
+   Main table of characters is not searched.
+
+   @param[in] alphabet alphabet
+   @param[in] code_point code point to look up
+
+   @return representation of character on success
+   @return NULL if there is no such character in @p alphabet
+*/
+const char * cw_alphabet_lookup_internal(const cw_alphabet_t * alphabet, uint32_t code_point)
+{
+	if (code_point > CW_ALPHABET_CODE_POINT_MAX) {
+		return NULL;
+	}
+	const uint16_t page = alphabet->page_index[code_point >> CW_ALPHABET_PAGE_BITS];
+	if (0 == page) {
+		return NULL;
+	}
+	const uint16_t index = alphabet->pages[page - 1][code_point & (CW_ALPHABET_PAGE_SIZE - 1)];
+	if (0 == index) {
+		return NULL;
+	}
+
+	return alphabet->characters[index - 1].representation;
+}
+
+
+
+
+const char * cw_alphabet_code_point_to_representation(const cw_alphabet_t * alphabet, uint32_t code_point)
+{
+	if (NULL == alphabet) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	const char * representation = cw_alphabet_lookup_internal(alphabet, code_point);
+	if (NULL == representation && code_point < 0x80) {
+		representation = cw_character_to_representation_internal((int) code_point);
+	}
+	if (NULL == representation) {
+		errno = ENOENT;
+	}
+
+	return representation;
+}
+
+
+
+
+uint32_t cw_alphabet_representation_to_code_point(const cw_alphabet_t * alphabet, const char * representation)
+{
+	if (NULL == alphabet || NULL == representation) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const unsigned int hash = cw_representation_to_hash_internal(representation);
+	if (0 == hash) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	const uint16_t index = alphabet->by_hash[hash];
+	if (0 != index) {
+		return alphabet->characters[index - 1].code_point;
+	}
+
+	/* Only ASCII characters of main table are code points. */
+	const int character = cw_representation_hash_to_character_internal(hash);
+	if (character > 0 && character < 0x80) {
+		return (uint32_t) character;
+	}
+
+	errno = ENOENT;
+	return 0;
+}
+
+
+
+
+/**
+   @brief Decode one character from UTF-8 string
+
+   Overlong encodings, surrogates and code points beyond
+   CW_ALPHABET_CODE_POINT_MAX are treated as invalid sequences.
+
+   @param[in] string UTF-8 string, not at its terminating NUL
+   @param[out] code_point decoded code point
+
+   @return count of bytes of decoded character (1-4)
+   @return zero if @p string doesn't begin with a valid UTF-8 sequence
+*/
+size_t cw_utf8_decode_internal(const char * string, uint32_t * code_point)
+{
+	const unsigned char * s = (const unsigned char *) string;
+
+	size_t n_bytes = 0;
+	uint32_t value = 0;
+	uint32_t min_value = 0;
+	if (s[0] < 0x80) {
+		*code_point = s[0];
+		return 1;
+	} else if ((s[0] & 0xE0) == 0xC0) {
+		n_bytes = 2;
+		value = s[0] & 0x1F;
+		min_value = 0x80;
+	} else if ((s[0] & 0xF0) == 0xE0) {
+		n_bytes = 3;
+		value = s[0] & 0x0F;
+		min_value = 0x800;
+	} else if ((s[0] & 0xF8) == 0xF0) {
+		n_bytes = 4;
+		value = s[0] & 0x07;
+		min_value = 0x10000;
+	} else {
+		return 0;
+	}
+
+	for (size_t i = 1; i < n_bytes; i++) {
+		/* Terminating NUL is not a continuation byte either. */
+		if ((s[i] & 0xC0) != 0x80) {
+			return 0;
+		}
+		value = (value << 6) | (s[i] & 0x3F);
+	}
+
+	if (value < min_value || value > CW_ALPHABET_CODE_POINT_MAX || (value >= 0xD800 && value <= 0xDFFF)) {
+		return 0;
+	}
+
+	*code_point = value;
+	return n_bytes;
+}
@@ -0,0 +1,79 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_ALPHABET
+#define H_LIBCW_ALPHABET
+
+
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_data.h"
+
+
+
+
+/* Largest Unicode code point. */
+#define CW_ALPHABET_CODE_POINT_MAX 0x10FFFF
+
+/* Code points are looked up in two levels: high bits of code point
+   select a page, low CW_ALPHABET_PAGE_BITS bits select an entry in the
+   page. */
+#define CW_ALPHABET_PAGE_BITS 8
+#define CW_ALPHABET_PAGE_SIZE (1 << CW_ALPHABET_PAGE_BITS)
+#define CW_ALPHABET_N_PAGES ((CW_ALPHABET_CODE_POINT_MAX >> CW_ALPHABET_PAGE_BITS) + 1)
+
+/* Maximal count of entries in alphabet. Entries are referred to by
+   16-bit indexes, zero means "no entry". */
+#define CW_ALPHABET_N_ENTRIES_MAX (UINT16_MAX - 1)
+
+
+
+
+typedef struct {
+	uint32_t code_point;
+	char representation[CW_DATA_MAX_REPRESENTATION_LENGTH + 1];
+} cw_alphabet_character_t;
+
+
+
+
+struct cw_alphabet_struct {
+	/* Copy of client's entries. */
+	cw_alphabet_character_t * characters;
+	size_t n_characters;
+
+	/* First level of lookup: page number + 1 for each page of code
+	   points, zero for pages without characters. */
+	uint16_t page_index[CW_ALPHABET_N_PAGES];
+
+	/* Second level of lookup: index of character + 1 for each code
+	   point in a page, zero for code points without characters. */
+	uint16_t (* pages)[CW_ALPHABET_PAGE_SIZE];
+	size_t n_pages;
+
+	/* Reverse lookup: index of character + 1 for each hash of
+	   representation (see cw_representation_to_hash_internal()), zero
+	   for representations without characters. First entry with given
+	   representation wins. */
+	uint16_t by_hash[CW_DATA_MAX_REPRESENTATION_HASH + 1];
+};
+
+
+
+
+size_t cw_utf8_decode_internal(const char * string, uint32_t * code_point);
+const char * cw_alphabet_lookup_internal(const cw_alphabet_t * alphabet, uint32_t code_point);
+
+
+
+
+#endif /* #ifndef H_LIBCW_ALPHABET */
@@ -27,8 +27,14 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
 
 
 
@@ -42,7 +48,11 @@
 
 
 #define MSG_PREFIX "libcw/alsa: "
-#define CW_ALSA_SW_PARAMS_CONFIG  0
+
+/* Low-latency profile (cw_gen_config_t::alsa_low_latency). Periods
+   shorter than this are not considered stable: generator's thread
+   would have to be woken up too often to keep the buffer filled. */
+#define CW_ALSA_LOW_LATENCY_PERIOD_DURATION_MIN  2000 /* [us] */
 
 
 
@@ -70,6 +80,9 @@ extern const unsigned int cw_supported_sample_rates[];
 
 #include <alsa/asoundlib.h>
 #include <dlfcn.h> /* dlopen() and related symbols */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 
 
 
@@ -82,21 +95,15 @@ extern const unsigned int cw_supported_sample_rates[];
 
 
 /*
-  FIXME: verify how this data structure is handled when there are
-  many generators.
-  How many times the structure is set?
-  How many times it's closed?
-  Is it closed for all generators when first of these generators is destroyed?
-  Do we need a reference counter for this structure?
+  There is only one instance of this data structure in the process,
+  shared by all generators. It is filled once, by
+  cw_alsa_load_library_internal(), and is never cleared.
 */
 struct cw_alsa_handle_t {
 
 	/* For pointer returned by dlopen(). This is the only non-function-pointer variable.
 
-	   TODO: In the future it should be set with dlopen() only once (only
-	   on first call to cw_is_alsa_possible()), and then it should only
-	   be checked for NULLness. It should be protected with mutex to
-	   avoid race conditions during checking of NULLness. */
+	   Set only once, by cw_alsa_load_library_internal(). */
 	void * lib_handle;
 
 
@@ -107,6 +114,25 @@ struct cw_alsa_handle_t {
 	int (* snd_pcm_drop)(snd_pcm_t * pcm);
 	int (* snd_pcm_drain)(snd_pcm_t * pcm);
 	snd_pcm_sframes_t (* snd_pcm_writei)(snd_pcm_t * pcm, const void * buffer, snd_pcm_uframes_t size);
+
+	/* Optional, see cw_alsa_get_sound_device_delay_internal(). */
+	int (* snd_pcm_delay)(snd_pcm_t * pcm, snd_pcm_sframes_t * delay);
+
+	/* Functions for mmap access. They are optional: if any of them
+	   can't be loaded, mmap access is not used. */
+	snd_pcm_sframes_t (* snd_pcm_avail_update)(snd_pcm_t * pcm);
+	int (* snd_pcm_mmap_begin)(snd_pcm_t * pcm, const snd_pcm_channel_area_t ** areas, snd_pcm_uframes_t * offset, snd_pcm_uframes_t * frames);
+	snd_pcm_sframes_t (* snd_pcm_mmap_commit)(snd_pcm_t * pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+	int (* snd_pcm_wait)(snd_pcm_t * pcm, int timeout);
+	int (* snd_pcm_start)(snd_pcm_t * pcm);
+	snd_pcm_state_t (* snd_pcm_state)(snd_pcm_t * pcm);
+
+	/* Functions for non-blocking mode. They are optional: if any of
+	   them can't be loaded, device is opened in blocking mode. */
+	int (* snd_pcm_nonblock)(snd_pcm_t * pcm, int nonblock);
+	int (* snd_pcm_poll_descriptors_count)(snd_pcm_t * pcm);
+	int (* snd_pcm_poll_descriptors)(snd_pcm_t * pcm, struct pollfd * pfds, unsigned int space);
+	int (* snd_pcm_poll_descriptors_revents)(snd_pcm_t * pcm, struct pollfd * pfds, unsigned int nfds, unsigned short * revents);
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
 	int (* snd_config_update_free_global)(void);
 #endif
@@ -182,13 +208,12 @@ struct cw_alsa_handle_t {
 
 
 	int (* snd_pcm_hw_params_set_rate_near)(snd_pcm_t * pcm, snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
-	int (* snd_pcm_hw_params_get_rate)(snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
+	int (* snd_pcm_hw_params_get_rate)(const snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
 	int (* snd_pcm_hw_params_get_rate_min)(const snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
 	int (* snd_pcm_hw_params_get_rate_max)(const snd_pcm_hw_params_t * params, unsigned int * val, int * dir);
 
 
 
-#if CW_ALSA_SW_PARAMS_CONFIG
 	/* Get current SW configuration. */
 	int (* snd_pcm_sw_params_current)(snd_pcm_t * pcm, snd_pcm_sw_params_t * params);
 
@@ -196,33 +221,22 @@ struct cw_alsa_handle_t {
 	   set our values of SW parameters. */
 	int (* snd_pcm_sw_params)(snd_pcm_t * pcm, snd_pcm_sw_params_t * params);
 
-	/* Allocate 'sw params' variable. */
+	/* Allocate and free 'sw params' variable. */
 	int (* snd_pcm_sw_params_malloc)(snd_pcm_sw_params_t **ptr);
+	void (* snd_pcm_sw_params_free)(snd_pcm_sw_params_t * params);
 
+	/* Count of frames in buffer after which playback is started.
+	   Used in low-latency profile to start playback as soon as
+	   first period has been written. */
+	int (* snd_pcm_sw_params_set_start_threshold)(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val);
 
-	/* This source:
-	   http://equalarea.com/paul/alsa-audio.html#interruptex
-	   is using the function in "interrupt-driven program".
-
-	   Also this source
-	   https://alsa.opensrc.org/Asynchronous_Playback_(Howto)
-	   is using the function in program with "asynchronous
-	   notification".
-
-	   We don't do that here, so don't use the function. */
-	//int (* snd_pcm_sw_params_set_start_threshold)(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val);
-
-	/* This source:
-	   https://users.suse.com/~mana/alsa090_howto.html
-	   suggests that this function can be used for playback using
-	   poll(). We don't do poll().
+	/* Count of free frames in buffer after which a blocked write
+	   returns. Used in low-latency profile to wake up generator's
+	   thread once per period.
 
 	   See also
-	   http://equalarea.com/paul/alsa-audio.html#interruptex,
-	   where the function is used for "interrupt-driven
-	   program. */
-	// int (* snd_pcm_sw_params_set_avail_min)(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val);
-#endif
+	   http://equalarea.com/paul/alsa-audio.html#interruptex */
+	int (* snd_pcm_sw_params_set_avail_min)(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val);
 };
 typedef struct cw_alsa_handle_t cw_alsa_handle_t;
 
@@ -232,31 +246,119 @@ typedef struct cw_alsa_handle_t cw_alsa_handle_t;
 /* Constants specific to ALSA sound system configuration */
 static const snd_pcm_format_t CW_ALSA_SAMPLE_FORMAT = SND_PCM_FORMAT_S16; /* "Signed 16 bit CPU endian"; I'm guessing that "CPU endian" == "native endianess" */
 
-static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t config_period_size);
-static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params);
+static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t config_period_size, unsigned int config_sample_rate);
+static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, unsigned int config_sample_rate);
 static cw_ret_t cw_alsa_set_hw_params_period_size_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t intended_period_size, snd_pcm_uframes_t * actual_period_size);
 static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t actual_period_size);
 static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, const char * where);
-static void cw_alsa_test_hw_period_sizes(cw_gen_t * gen);
 static void cw_alsa_get_intended_period_size_internal(const cw_gen_t * gen, snd_pcm_uframes_t config_period_size, snd_pcm_uframes_t * intended_period_size);
+static void cw_alsa_get_low_latency_period_size_internal(const cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t * intended_period_size);
 
-#if CW_ALSA_SW_PARAMS_CONFIG
 static cw_ret_t cw_alsa_set_sw_params_internal(cw_gen_t * gen, snd_pcm_sw_params_t * sw_params);
-static void cw_alsa_print_sw_params_internal(snd_pcm_sw_params_t * sw_params, const char * where);
-#endif
+static cw_ret_t cw_alsa_set_sound_device_write_size_internal(cw_gen_t * gen, int n_samples);
 
+static bool     cw_alsa_load_library_internal(void);
 static int      cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle);
 static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_alsa_acquire_buffer_from_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_alsa_mmap_begin_internal(cw_gen_t * gen, snd_pcm_uframes_t n_frames, cw_sample_t ** samples, snd_pcm_uframes_t * offset, snd_pcm_uframes_t * frames);
+static int      cw_alsa_mmap_commit_internal(cw_gen_t * gen, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames);
+static bool     cw_alsa_mmap_is_loaded_internal(const cw_alsa_handle_t * alsa_handle);
+static bool     cw_alsa_nonblock_is_loaded_internal(const cw_alsa_handle_t * alsa_handle);
+static cw_ret_t cw_alsa_wait_for_device_internal(cw_gen_t * gen);
+static int      cw_alsa_writei_nonblocking_internal(cw_gen_t * gen);
 static cw_ret_t cw_alsa_debug_evaluate_write_internal(cw_gen_t * gen, int snd_rv);
 static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void     cw_alsa_close_sound_device_internal(cw_gen_t * gen);
 static cw_ret_t cw_alsa_on_empty_queue(cw_gen_t * gen);
+static cw_ret_t cw_alsa_drop_silence_from_sound_device_internal(cw_gen_t * gen, int64_t n_silent_samples);
+static cw_ret_t cw_alsa_get_sound_device_delay_internal(cw_gen_t * gen, int * delay);
 
 
 
 
 static cw_alsa_handle_t cw_alsa;
 
+/* Protects loading of library into cw_alsa. Set to true (with
+   release semantics) once all symbols have been resolved. */
+static pthread_mutex_t cw_alsa_load_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool cw_alsa_loaded = false;
+
+/* With direct linking (--enable-direct-linking) calls to ALSA
+   functions are resolved at build time and can be optimized by
+   compiler and linker. cw_alsa is still filled, with addresses of the
+   linked functions, for the code that checks presence of optional
+   symbols. */
+#if LIBCW_ALSA_DIRECT_LINK
+#define CW_ALSA(symbol) symbol
+#define CW_ALSA_RESOLVE(alsa_handle, symbol) (alsa_handle)->symbol = symbol
+#else
+#define CW_ALSA(symbol) cw_alsa.symbol
+#define CW_ALSA_RESOLVE(alsa_handle, symbol) *(void **) &((alsa_handle)->symbol) = dlsym((alsa_handle)->lib_handle, #symbol)
+#endif
+
+
+
+
+/**
+   @brief Load ALSA library and resolve its symbols
+
+   The library is loaded and its symbols are resolved only once, on
+   first call of the function. The library stays loaded until the end
+   of the process, so all generators (in all threads) share one set
+   of resolved symbols, and probing or opening of a device doesn't
+   repeat dlopen()/dlsym().
+
+   With direct linking of ALSA library the function doesn't call
+   dlopen(), it only fills the table with addresses of linked
+   functions.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_alsa_load_library_internal(void)
+{
+	if (__atomic_load_n(&cw_alsa_loaded, __ATOMIC_ACQUIRE)) {
+		return true;
+	}
+
+	pthread_mutex_lock(&cw_alsa_load_mutex);
+#if LIBCW_ALSA_DIRECT_LINK
+	if (!cw_alsa_loaded) {
+		/* Nothing to open, symbols are only copied. */
+		const int rv = cw_alsa_handle_load_internal(&cw_alsa);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "missing ALSA symbol #%d in linked ALSA library", rv);
+		} else {
+			__atomic_store_n(&cw_alsa_loaded, true, __ATOMIC_RELEASE);
+		}
+	}
+#else
+	if (!cw_alsa_loaded) {
+		const char * library_name = "libasound.so.2";
+		if (CW_SUCCESS != cw_dlopen_internal(library_name, &cw_alsa.lib_handle)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "can't access ALSA library '%s'", library_name);
+		} else {
+			const int rv = cw_alsa_handle_load_internal(&cw_alsa);
+			if (0 != rv) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to resolve ALSA symbol #%d, can't correctly load ALSA library", rv);
+				dlclose(cw_alsa.lib_handle);
+				cw_alsa.lib_handle = NULL;
+			} else {
+				__atomic_store_n(&cw_alsa_loaded, true, __ATOMIC_RELEASE);
+			}
+		}
+	}
+#endif
+	const bool loaded = cw_alsa_loaded;
+	pthread_mutex_unlock(&cw_alsa_load_mutex);
+
+	return loaded;
+}
+
 
 
 
@@ -267,9 +369,8 @@ static cw_alsa_handle_t cw_alsa;
    -# whether it's possible to load ALSA shared library,
    -# whether it's possible to open ALSA device specified by @p device_name
 
-   If it's possible to use ALSA with given device name, the function leaves
-   library handle (returned by dlopen()) open and some library function
-   symbols loaded, but does not leave any ALSA PCM handle open.
+   The library is loaded only once, see cw_alsa_load_library_internal().
+   The function does not leave any ALSA PCM handle open.
 
    @internal TODO: the function does too much. It a) checks if ALSA output is possible, and b) loads library symbols into global variable for the rest of the code to use. The function should have its own copy of cw_alsa_handle_t object, and the global object should go away (there should be per-generator cw_alsa_handle_t object). See FIXME/TODO notes in definition of struct cw_alsa_handle_t type. @endinternal
 
@@ -288,18 +389,7 @@ bool cw_is_alsa_possible(const char * device_name)
 	   accessible on this machine, and this should not be logged as
 	   error. */
 
-	const char * library_name = "libasound.so.2";
-	if (CW_SUCCESS != cw_dlopen_internal(library_name, &cw_alsa.lib_handle)) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: can't access ALSA library '%s'", library_name);
-		return false;
-	}
-
-	int rv = cw_alsa_handle_load_internal(&cw_alsa);
-	if (0 != rv) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: failed to resolve ALSA symbol #%d, can't correctly load ALSA library", rv);
-		dlclose(cw_alsa.lib_handle);
+	if (!cw_alsa_load_library_internal()) {
 		return false;
 	}
 
@@ -308,30 +398,29 @@ bool cw_is_alsa_possible(const char * device_name)
 					 picked_device_name, sizeof (picked_device_name));
 
 	snd_pcm_t * pcm = NULL;
-	int snd_rv = cw_alsa.snd_pcm_open(&pcm,
+	int snd_rv = CW_ALSA(snd_pcm_open)(&pcm,
 					  picked_device_name,      /* name */
 					  SND_PCM_STREAM_PLAYBACK, /* stream (playback/capture) */
 					  0);                      /* mode, 0 | SND_PCM_NONBLOCK | SND_PCM_ASYNC */
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: can't open ALSA device '%s': %s", picked_device_name, cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "is possible: can't open ALSA device '%s': %s", picked_device_name, CW_ALSA(snd_strerror)(snd_rv));
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
 		/* This is needed even after failed snd_pcm_open(). */
-		cw_alsa.snd_config_update_free_global();
+		CW_ALSA(snd_config_update_free_global)();
 #endif
-		dlclose(cw_alsa.lib_handle);
 		return false;
 	} else {
 		/*
 		  Close pcm handle. A generator using ALSA sink will open its
 		  own ALSA handle used for playback by the generator.
 
-		  Don't call dlclose(). Don't un-resolve library symbols. The
-		  symbols will be used by library code in this file.
+		  The library stays loaded, its symbols will be used by
+		  library code in this file.
 		*/
-		cw_alsa.snd_pcm_close(pcm);
+		CW_ALSA(snd_pcm_close)(pcm);
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
-		cw_alsa.snd_config_update_free_global();
+		CW_ALSA(snd_config_update_free_global)();
 #endif
 		return true;
 	}
@@ -359,6 +448,12 @@ cw_ret_t cw_alsa_init_gen_internal(cw_gen_t * gen)
 	gen->close_sound_device              = cw_alsa_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_alsa_write_buffer_to_sound_device_internal;
 	gen->on_empty_queue                  = cw_alsa_on_empty_queue;
+	gen->drop_silence_from_sound_device  = cw_alsa_drop_silence_from_sound_device_internal;
+	gen->get_sound_device_delay          = cw_alsa_get_sound_device_delay_internal;
+	gen->set_sound_device_write_size     = cw_alsa_set_sound_device_write_size_internal;
+
+	/* Will be set if device gets configured for mmap access. */
+	gen->acquire_buffer_from_sound_device = NULL;
 
 	return CW_SUCCESS;
 }
@@ -381,18 +476,65 @@ static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_ALSA);
 
-	/* Send sound buffer to ALSA.
+	int snd_rv = 0;
+	if (gen->alsa_data.mmap_acquired) {
+		/* Samples have been calculated in place, in ring buffer
+		   of sound device. Just let ALSA know about them. */
+		gen->alsa_data.mmap_acquired = false;
+		snd_rv = cw_alsa_mmap_commit_internal(gen, gen->alsa_data.mmap_offset, (snd_pcm_uframes_t) gen->out_n_samples);
+
+	} else if (gen->alsa_data.mmap) {
+		/* Samples are in generator's own buffer, e.g. because
+		   free space of ring buffer was wrapping around end of
+		   ring buffer. Copy them, in as many parts as necessary. */
+		snd_pcm_uframes_t n_written = 0;
+		while (n_written < (snd_pcm_uframes_t) gen->out_n_samples) {
+			cw_sample_t * samples = NULL;
+			snd_pcm_uframes_t offset = 0;
+			snd_pcm_uframes_t frames = 0;
+			errno = 0;
+			if (CW_SUCCESS != cw_alsa_mmap_begin_internal(gen, (snd_pcm_uframes_t) gen->out_n_samples - n_written, &samples, &offset, &frames)) {
+				if (ECANCELED == errno) {
+					snd_rv = -ECANCELED;
+				}
+				break;
+			}
+			memcpy(samples, gen->out_buffer + n_written, frames * sizeof (cw_sample_t));
+			const int rv = cw_alsa_mmap_commit_internal(gen, offset, frames);
+			if (rv < 0) {
+				snd_rv = rv;
+				break;
+			}
+			n_written += (snd_pcm_uframes_t) rv;
+			snd_rv = (int) n_written;
+		}
 
-	   Size of correct and current data in the buffer is the same as
-	   ALSA's period, so there should be no underruns. TODO: write a
-	   check for this in this function. */
-	const int snd_rv = cw_alsa.snd_pcm_writei(gen->alsa_data.pcm_handle, gen->buffer, gen->buffer_n_samples);
+	} else {
+		/* Send sound buffer to ALSA.
+
+		   Size of correct and current data in the buffer is the same as
+		   ALSA's period, so there should be no underruns. TODO: write a
+		   check for this in this function. */
+		if (gen->alsa_data.nonblocking) {
+			snd_rv = cw_alsa_writei_nonblocking_internal(gen);
+		} else {
+			snd_rv = CW_ALSA(snd_pcm_writei)(gen->alsa_data.pcm_handle, cw_gen_get_device_samples_internal(gen, NULL), gen->out_n_samples);
+		}
+	}
+	if (-ECANCELED == snd_rv) {
+		/* Generator is being stopped, or the samples are silence
+		   that would delay sidetone. Nobody is interested in rest
+		   of the samples. */
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "write: abandoned");
+		return CW_FAILURE;
+	}
 	const cw_ret_t cw_ret = cw_alsa_debug_evaluate_write_internal(gen, snd_rv);
 
 #if 0
 	/* Verbose debug code. */
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
-		      MSG_PREFIX "write: written %d/%d samples", snd_rv, gen->buffer_n_samples);
+		      MSG_PREFIX "write: written %d/%d samples", snd_rv, gen->out_n_samples);
 #endif
 	return cw_ret;
 }
@@ -400,6 +542,237 @@ static cw_ret_t cw_alsa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Point generator's buffer at ring buffer of ALSA device configured for mmap access
+
+   If free space at current position of ring buffer can take whole
+   buffer of generator, gen->buffer is set to point to the free space,
+   and generator calculates its samples in place.  Otherwise gen->buffer
+   is set to generator's own buffer, and samples are copied to ring
+   buffer by cw_alsa_write_buffer_to_sound_device_internal().
+
+   The function blocks until there is free space in ring buffer, just
+   like snd_pcm_writei() would block.
+
+   @param[in] gen generator that will calculate samples
+
+   @return CW_SUCCESS if gen->buffer points to ring buffer
+   @return CW_FAILURE if gen->buffer points to generator's own buffer
+*/
+static cw_ret_t cw_alsa_acquire_buffer_from_sound_device_internal(cw_gen_t * gen)
+{
+	gen->buffer = gen->own_buffer;
+	gen->alsa_data.mmap_acquired = false;
+
+	cw_sample_t * samples = NULL;
+	snd_pcm_uframes_t offset = 0;
+	snd_pcm_uframes_t frames = 0;
+	if (CW_SUCCESS != cw_alsa_mmap_begin_internal(gen, (snd_pcm_uframes_t) gen->buffer_n_samples, &samples, &offset, &frames)) {
+		return CW_FAILURE;
+	}
+	if (frames < (snd_pcm_uframes_t) gen->buffer_n_samples) {
+		/* Free space wraps around end of ring buffer. Nothing is
+		   committed when we give back the area. */
+		return CW_FAILURE;
+	}
+
+	gen->buffer = samples;
+	gen->alsa_data.mmap_offset = offset;
+	gen->alsa_data.mmap_acquired = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get contiguous free area of ring buffer of ALSA device configured for mmap access
+
+   Wait until there are at least @p n_frames free frames in ring buffer
+   (or ring buffer is full and device has not been started yet), and get
+   pointer to the first of them.  Count of contiguous frames available
+   at @p samples (not larger than @p n_frames) is returned through @p
+   frames, and their position in ring buffer through @p offset.
+
+   @param[in] gen generator with ALSA PCM handle
+   @param[in] n_frames count of frames that caller would like to write
+   @param[out] samples pointer to free area of ring buffer
+   @param[out] offset offset of free area, to be passed to cw_alsa_mmap_commit_internal()
+   @param[out] frames count of contiguous frames in the area
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_mmap_begin_internal(cw_gen_t * gen, snd_pcm_uframes_t n_frames, cw_sample_t ** samples, snd_pcm_uframes_t * offset, snd_pcm_uframes_t * frames)
+{
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+	bool recovered = false;
+
+	while (true) {
+		const snd_pcm_sframes_t avail = CW_ALSA(snd_pcm_avail_update)(pcm);
+		if (avail < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "mmap: avail update: %s / %ld", CW_ALSA(snd_strerror)((int) avail), (long) avail);
+			if (recovered) {
+				return CW_FAILURE;
+			}
+			CW_ALSA(snd_pcm_prepare)(pcm); /* Reset sound sink. */
+			if (-EPIPE == avail) {
+				cw_gen_metrics_underrun_internal(gen);
+			}
+			recovered = true;
+			continue;
+		}
+		if ((snd_pcm_uframes_t) avail >= n_frames) {
+			break;
+		}
+		if (SND_PCM_STATE_PREPARED == CW_ALSA(snd_pcm_state)(pcm)) {
+			/* Ring buffer is full, but playback hasn't been
+			   started yet: nothing would free the space. */
+			CW_ALSA(snd_pcm_start)(pcm);
+		}
+		if (gen->alsa_data.nonblocking) {
+			if (CW_SUCCESS != cw_alsa_wait_for_device_internal(gen)) {
+				return CW_FAILURE;
+			}
+			continue;
+		}
+		const int snd_rv = CW_ALSA(snd_pcm_wait)(pcm, 1000);
+		if (snd_rv < 0 && !recovered) {
+			CW_ALSA(snd_pcm_prepare)(pcm); /* Reset sound sink. */
+			recovered = true;
+		}
+	}
+
+	const snd_pcm_channel_area_t * areas = NULL;
+	*frames = n_frames;
+	const int snd_rv = CW_ALSA(snd_pcm_mmap_begin)(pcm, &areas, offset, frames);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "mmap: begin: %s / %d", CW_ALSA(snd_strerror)(snd_rv), snd_rv);
+		return CW_FAILURE;
+	}
+
+	/* Device has been configured for interleaved mono samples in
+	   our format, so areas[0] describes contiguous samples. */
+	*samples = (cw_sample_t *) ((char *) areas[0].addr + (areas[0].first + *offset * areas[0].step) / 8);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Wait until ALSA device opened in non-blocking mode can accept samples
+
+   @exception ECANCELED generator is being stopped
+
+   @param[in] gen generator with ALSA PCM handle
+
+   @return CW_SUCCESS when device can accept samples, or when it is in error state (next write will report the error)
+   @return CW_FAILURE when generator is being stopped or on errors
+*/
+static cw_ret_t cw_alsa_wait_for_device_internal(cw_gen_t * gen)
+{
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+
+	struct pollfd fds[CW_GEN_SOUND_POLL_FDS_MAX];
+	int n_fds = CW_ALSA(snd_pcm_poll_descriptors_count)(pcm);
+	if (n_fds <= 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "wait: invalid count of poll descriptors: %d", n_fds);
+		return CW_FAILURE;
+	}
+	if (n_fds > CW_GEN_SOUND_POLL_FDS_MAX) {
+		n_fds = CW_GEN_SOUND_POLL_FDS_MAX;
+	}
+	n_fds = CW_ALSA(snd_pcm_poll_descriptors)(pcm, fds, (unsigned int) n_fds);
+
+	while (true) {
+		if (CW_SUCCESS != cw_gen_wait_for_sound_device_internal(gen, fds, n_fds)) {
+			return CW_FAILURE;
+		}
+
+		/* Descriptors of some plugins signal events that don't
+		   mean free space in buffer. Let ALSA translate them. */
+		unsigned short revents = 0;
+		CW_ALSA(snd_pcm_poll_descriptors_revents)(pcm, fds, (unsigned int) n_fds, &revents);
+		if (revents & (POLLOUT | POLLERR)) {
+			return CW_SUCCESS;
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Write generator's buffer to ALSA device opened in non-blocking mode
+
+   @param[in] gen generator with ALSA PCM handle
+
+   @return count of written frames
+   @return negative ALSA error code on errors
+   @return -ECANCELED if writing has been abandoned because generator is being stopped
+*/
+static int cw_alsa_writei_nonblocking_internal(cw_gen_t * gen)
+{
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+	snd_pcm_uframes_t n_written = 0;
+	const char * samples = (const char *) cw_gen_get_device_samples_internal(gen, NULL);
+	const size_t frame_size = cw_gen_frame_size_internal(gen);
+
+	while (n_written < (snd_pcm_uframes_t) gen->out_n_samples) {
+		const snd_pcm_sframes_t rv = CW_ALSA(snd_pcm_writei)(pcm, samples + n_written * frame_size, (snd_pcm_uframes_t) gen->out_n_samples - n_written);
+		if (rv >= 0) {
+			n_written += (snd_pcm_uframes_t) rv;
+			continue;
+		}
+		if (-EAGAIN != rv) {
+			return (int) rv;
+		}
+		if (CW_SUCCESS != cw_alsa_wait_for_device_internal(gen)) {
+			return ECANCELED == errno ? -ECANCELED : (int) rv;
+		}
+	}
+
+	return (int) n_written;
+}
+
+
+
+
+/**
+   @brief Commit frames written to area of ring buffer of ALSA device
+
+   Counterpart of cw_alsa_mmap_begin_internal(). Playback is started if
+   this was the first commit after device was prepared.
+
+   @param[in] gen generator with ALSA PCM handle
+   @param[in] offset offset returned by cw_alsa_mmap_begin_internal()
+   @param[in] frames count of frames written to the area
+
+   @return count of committed frames, or negative ALSA error code
+*/
+static int cw_alsa_mmap_commit_internal(cw_gen_t * gen, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+{
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+
+	const snd_pcm_sframes_t committed = CW_ALSA(snd_pcm_mmap_commit)(pcm, offset, frames);
+	if (committed >= 0 && SND_PCM_STATE_PREPARED == CW_ALSA(snd_pcm_state)(pcm)) {
+		/* snd_pcm_writei() starts playback automatically, with
+		   mmap access we have to do it ourselves. */
+		CW_ALSA(snd_pcm_start)(pcm);
+	}
+
+	return (int) committed;
+}
+
+
+
+
 /**
    @brief Open and configure ALSA handle stored in given generator
 
@@ -421,13 +794,27 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
 					 gen->picked_device_name, sizeof (gen->picked_device_name));
 
-	int snd_rv = cw_alsa.snd_pcm_open(&gen->alsa_data.pcm_handle,
+	/* Just a request. cw_alsa_set_hw_params_internal() will reset the
+	   flag if device doesn't support mmap access. */
+	cw_gen_get_requested_sample_format_internal(gen_conf, &gen->sample_format, &gen->n_channels);
+	/* Samples are calculated in place, in ring buffer of device,
+	   only if device uses generator's own format of samples. */
+	gen->alsa_data.mmap = gen_conf->alsa_mmap && cw_alsa_mmap_is_loaded_internal(&cw_alsa)
+		&& CW_SAMPLE_FORMAT_S16 == gen->sample_format && 1 == gen->n_channels;
+	gen->alsa_data.mmap_acquired = false;
+	gen->alsa_data.low_latency = gen_conf->alsa_low_latency;
+	gen->alsa_data.nonblocking = gen->sound_nonblocking && cw_alsa_nonblock_is_loaded_internal(&cw_alsa);
+	gen->alsa_data.period_size = 0;
+	gen->alsa_data.buffer_size = 0;
+	gen->alsa_data.sw_params = NULL;
+
+	int snd_rv = CW_ALSA(snd_pcm_open)(&gen->alsa_data.pcm_handle,
 					  gen->picked_device_name, /* name */
 					  SND_PCM_STREAM_PLAYBACK, /* stream (playback/capture) */
-					  0);                      /* mode, 0 | SND_PCM_NONBLOCK | SND_PCM_ASYNC */
+					  gen->alsa_data.nonblocking ? SND_PCM_NONBLOCK : 0); /* mode, 0 | SND_PCM_NONBLOCK | SND_PCM_ASYNC */
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open: can't open ALSA device '%s': %s", gen->picked_device_name, cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "open: can't open ALSA device '%s': %s", gen->picked_device_name, CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 	/* This is commented because blocking mode is probably already
@@ -440,45 +827,63 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 	*/
 
 	snd_pcm_hw_params_t * hw_params = NULL;
-	snd_rv = cw_alsa.snd_pcm_hw_params_malloc(&hw_params);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_malloc)(&hw_params);
 	if (0 != snd_rv || NULL == hw_params) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open: can't allocate memory for ALSA hw params: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "open: can't allocate memory for ALSA hw params: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
-	if (CW_SUCCESS != cw_alsa_set_hw_params_internal(gen, hw_params, gen_conf->alsa_period_size)) {
+	if (CW_SUCCESS != cw_alsa_set_hw_params_internal(gen, hw_params, gen_conf->alsa_period_size, cw_gen_get_requested_sample_rate_internal(gen_conf))) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: can't set ALSA hw params");
-		cw_alsa.snd_pcm_hw_params_free(hw_params);
+		CW_ALSA(snd_pcm_hw_params_free)(hw_params);
 		return CW_FAILURE;
 	}
 
-#if CW_ALSA_SW_PARAMS_CONFIG
-	snd_pcm_sw_params_t * sw_params = NULL;
-	cw_alsa.snd_pcm_sw_params_malloc(&sw_params);
-	if (CW_SUCCESS != cw_alsa_set_sw_params_internal(gen, sw_params)) {
-		cw_alsa.snd_pcm_hw_params_free(hw_params);
-		return CW_FAILURE;
+	if (gen->alsa_data.low_latency) {
+		snd_pcm_sw_params_t * sw_params = NULL;
+		snd_rv = CW_ALSA(snd_pcm_sw_params_malloc)(&sw_params);
+		if (0 != snd_rv || NULL == sw_params) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: can't allocate memory for ALSA sw params: %s", CW_ALSA(snd_strerror)(snd_rv));
+			CW_ALSA(snd_pcm_hw_params_free)(hw_params);
+			return CW_FAILURE;
+		}
+		const cw_ret_t cwret = cw_alsa_set_sw_params_internal(gen, sw_params);
+		CW_ALSA(snd_pcm_sw_params_free)(sw_params);
+		if (CW_SUCCESS != cwret) {
+			CW_ALSA(snd_pcm_hw_params_free)(hw_params);
+			return CW_FAILURE;
+		}
 	}
-#endif
 
-	snd_rv = cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+	snd_rv = CW_ALSA(snd_pcm_prepare)(gen->alsa_data.pcm_handle);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open: can't prepare ALSA handler: %s", cw_alsa.snd_strerror(snd_rv));
-		cw_alsa.snd_pcm_hw_params_free(hw_params);
+			      MSG_PREFIX "open: can't prepare ALSA handler: %s", CW_ALSA(snd_strerror)(snd_rv));
+		CW_ALSA(snd_pcm_hw_params_free)(hw_params);
 		return CW_FAILURE;
 	}
 
+	if (gen_conf->adaptive_period) {
+		snd_rv = CW_ALSA(snd_pcm_sw_params_malloc)(&gen->alsa_data.sw_params);
+		if (0 != snd_rv) {
+			/* Not fatal, device will be used with fixed size of writes. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "open: can't allocate memory for ALSA sw params: %s", CW_ALSA(snd_strerror)(snd_rv));
+			gen->alsa_data.sw_params = NULL;
+		}
+	}
+
 	/* Get size for generator's data buffer */
 	snd_pcm_uframes_t period_size = 0; /* period size in frames */
 	int dir = 1; /* TODO: why 1? Shouldn't it be zero? */
-	snd_rv = cw_alsa.snd_pcm_hw_params_get_period_size(hw_params, &period_size, &dir);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_get_period_size)(hw_params, &period_size, &dir);
 	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
-		      MSG_PREFIX "open: rv = %d/%s, ALSA period size is %u frames", snd_rv, cw_alsa.snd_strerror(snd_rv), (unsigned int) period_size);
+		      MSG_PREFIX "open: rv = %d/%s, ALSA period size is %u frames", snd_rv, CW_ALSA(snd_strerror)(snd_rv), (unsigned int) period_size);
 
-	cw_alsa.snd_pcm_hw_params_free(hw_params);
+	CW_ALSA(snd_pcm_hw_params_free)(hw_params);
 
 	/* The linker (?) that I use on Debian links libcw against
 	   old version of get_period_size(), which returns
@@ -489,6 +894,17 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 		gen->buffer_n_samples = period_size;
 	}
 
+	if (gen->alsa_data.mmap) {
+		gen->acquire_buffer_from_sound_device = cw_alsa_acquire_buffer_from_sound_device_internal;
+	}
+
+	/* Samples written to device may wait in its whole ring buffer
+	   before they are played. */
+	gen->sound_device_latency = (int) (((uint64_t) gen->alsa_data.buffer_size * CW_USECS_PER_SEC) / gen->sample_rate);
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "open: period size = %lu, buffer size = %lu, device latency = %d [us]",
+		      gen->alsa_data.period_size, gen->alsa_data.buffer_size, gen->sound_device_latency);
+
 #ifdef ENABLE_DEV_PCM_SAMPLES_FILE
 	cw_dev_debug_raw_sink_open_internal(gen);
 #endif
@@ -510,18 +926,26 @@ static cw_ret_t cw_alsa_open_and_configure_sound_device_internal(cw_gen_t * gen,
 */
 static void cw_alsa_close_sound_device_internal(cw_gen_t * gen)
 {
+	/* Don't leave generator's buffer pointing to memory that is
+	   about to be unmapped. */
+	gen->buffer = gen->own_buffer;
+	gen->alsa_data.mmap_acquired = false;
+	gen->acquire_buffer_from_sound_device = NULL;
+
 	/* "Stop a PCM dropping pending frames. " */
-	cw_alsa.snd_pcm_drop(gen->alsa_data.pcm_handle);
-	cw_alsa.snd_pcm_close(gen->alsa_data.pcm_handle);
+	CW_ALSA(snd_pcm_drop)(gen->alsa_data.pcm_handle);
+	CW_ALSA(snd_pcm_close)(gen->alsa_data.pcm_handle);
+	if (NULL != gen->alsa_data.sw_params) {
+		CW_ALSA(snd_pcm_sw_params_free)(gen->alsa_data.sw_params);
+		gen->alsa_data.sw_params = NULL;
+	}
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
-	cw_alsa.snd_config_update_free_global();
+	CW_ALSA(snd_config_update_free_global)();
 #endif
 
 	gen->sound_device_is_open = false;
 
-	if (cw_alsa.lib_handle) { /* FIXME: this closing of global handle won't work well for multi-generator library. */
-		dlclose(cw_alsa.lib_handle);
-	}
+	/* Don't close the library: other generators may be using it. */
 
 #ifdef ENABLE_DEV_PCM_SAMPLES_FILE
 	cw_dev_debug_raw_sink_close_internal(gen);
@@ -549,20 +973,39 @@ static cw_ret_t cw_alsa_on_empty_queue(cw_gen_t * gen)
 {
 	int snd_rv = 0;
 
-	snd_rv = cw_alsa.snd_pcm_drain(gen->alsa_data.pcm_handle);
+	if (gen->alsa_data.mmap_acquired) {
+		/* The acquired area will become invalid after
+		   snd_pcm_prepare() below. Keep partially calculated
+		   buffer in generator's own buffer, it will be copied
+		   to ring buffer when it's full. */
+		memcpy(gen->own_buffer, gen->buffer, (size_t) gen->buffer_sub_start * sizeof (cw_sample_t));
+		gen->buffer = gen->own_buffer;
+		gen->alsa_data.mmap_acquired = false;
+	}
+
+	/* In non-blocking mode drain() would return immediately, and
+	   prepare() called below would drop samples that are still
+	   waiting to be played. */
+	if (gen->alsa_data.nonblocking) {
+		CW_ALSA(snd_pcm_nonblock)(gen->alsa_data.pcm_handle, 0);
+	}
+	snd_rv = CW_ALSA(snd_pcm_drain)(gen->alsa_data.pcm_handle);
+	if (gen->alsa_data.nonblocking) {
+		CW_ALSA(snd_pcm_nonblock)(gen->alsa_data.pcm_handle, 1);
+	}
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "drain() returns error: %s/%d",
-			      cw_alsa.snd_strerror(snd_rv), snd_rv);
+			      CW_ALSA(snd_strerror)(snd_rv), snd_rv);
 		/* Don't return error, try to prepare PCM handle anyway
 		   (especially now, when drain() failed). */
 	}
 
-	snd_rv = cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle);
+	snd_rv = CW_ALSA(snd_pcm_prepare)(gen->alsa_data.pcm_handle);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "prepare() returns error: %s/%d",
-			      cw_alsa.snd_strerror(snd_rv), snd_rv);
+			      CW_ALSA(snd_strerror)(snd_rv), snd_rv);
 		return CW_FAILURE;
 	}
 
@@ -593,18 +1036,19 @@ static cw_ret_t cw_alsa_debug_evaluate_write_internal(cw_gen_t * gen, int snd_rv
 	if (snd_rv == -EPIPE) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "write: underrun");
-		cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+		CW_ALSA(snd_pcm_prepare)(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+		cw_gen_metrics_underrun_internal(gen);
 		return CW_FAILURE;
 
 	} else if (snd_rv < 0) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
-			      MSG_PREFIX "write: writei: %s / %d", cw_alsa.snd_strerror(snd_rv), snd_rv);
-		cw_alsa.snd_pcm_prepare(gen->alsa_data.pcm_handle); /* Reset sound sink. */
+			      MSG_PREFIX "write: writei: %s / %d", CW_ALSA(snd_strerror)(snd_rv), snd_rv);
+		CW_ALSA(snd_pcm_prepare)(gen->alsa_data.pcm_handle); /* Reset sound sink. */
 		return CW_FAILURE;
 
-	} else if (snd_rv != gen->buffer_n_samples) {
+	} else if (snd_rv != gen->out_n_samples) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
-			      MSG_PREFIX "short write, expected to write %d bytes, written %d bytes", gen->buffer_n_samples, snd_rv);
+			      MSG_PREFIX "short write, expected to write %d bytes, written %d bytes", gen->out_n_samples, snd_rv);
 		return CW_FAILURE;
 	} else {
 		return CW_SUCCESS;
@@ -629,43 +1073,69 @@ static cw_ret_t cw_alsa_debug_evaluate_write_internal(cw_gen_t * gen, int snd_rv
    @return CW_FAILURE on errors
    @return CW_SUCCESS on success
 */
-static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t config_period_size)
+static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t config_period_size, unsigned int config_sample_rate)
 {
 	/* Get full configuration space. */
-	int snd_rv = cw_alsa.snd_pcm_hw_params_any(gen->alsa_data.pcm_handle, hw_params);
+	int snd_rv = CW_ALSA(snd_pcm_hw_params_any)(gen->alsa_data.pcm_handle, hw_params);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't get current hw params: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't get current hw params: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
 
-	// cw_alsa_test_hw_period_sizes(gen); /* This function is only for tests. */
 	cw_alsa_print_hw_params_internal(hw_params, "before limiting configuration space");
 
 
 	/* Set the sample format */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_format(gen->alsa_data.pcm_handle, hw_params, CW_ALSA_SAMPLE_FORMAT);
+	if (CW_SAMPLE_FORMAT_S16 != gen->sample_format) {
+		const snd_pcm_format_t format = CW_SAMPLE_FORMAT_S32 == gen->sample_format ? SND_PCM_FORMAT_S32 : SND_PCM_FORMAT_FLOAT;
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_format)(gen->alsa_data.pcm_handle, hw_params, format);
+		if (0 != snd_rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "set hw params: can't set requested sample format, falling back to S16: %s", CW_ALSA(snd_strerror)(snd_rv));
+			gen->sample_format = CW_SAMPLE_FORMAT_S16;
+		}
+	}
+	if (CW_SAMPLE_FORMAT_S16 == gen->sample_format) {
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_format)(gen->alsa_data.pcm_handle, hw_params, CW_ALSA_SAMPLE_FORMAT);
+	}
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't set sample format: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't set sample format: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
 
 	/* Set PCM access type */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_access(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (gen->alsa_data.mmap) {
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_access)(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+		if (0 != snd_rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "set hw params: can't set mmap access type, falling back to read/write: %s", CW_ALSA(snd_strerror)(snd_rv));
+			gen->alsa_data.mmap = false;
+		}
+	}
+	if (!gen->alsa_data.mmap) {
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_access)(gen->alsa_data.pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	}
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't set access type: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't set access type: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
 	/* Set number of channels */
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_channels(gen->alsa_data.pcm_handle, hw_params, CW_AUDIO_CHANNELS);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_set_channels)(gen->alsa_data.pcm_handle, hw_params, (unsigned int) gen->n_channels);
+	if (0 != snd_rv && CW_AUDIO_CHANNELS != gen->n_channels) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "set hw params: can't set %d channels, falling back to mono: %s", gen->n_channels, CW_ALSA(snd_strerror)(snd_rv));
+		gen->n_channels = CW_AUDIO_CHANNELS;
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_channels)(gen->alsa_data.pcm_handle, hw_params, CW_AUDIO_CHANNELS);
+	}
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't set number of channels: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't set number of channels: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
@@ -734,13 +1204,17 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 
 
 	/* Set the sample rate. */
-	if (CW_SUCCESS != cw_alsa_set_hw_params_sample_rate_internal(gen, hw_params)) {
+	if (CW_SUCCESS != cw_alsa_set_hw_params_sample_rate_internal(gen, hw_params, config_sample_rate)) {
 		return CW_FAILURE;
 	}
 
 	/* Set period size. */
 	snd_pcm_uframes_t intended_period_size = 0; /* What we would like the period size to be. */
-	cw_alsa_get_intended_period_size_internal(gen, config_period_size, &intended_period_size);
+	if (gen->alsa_data.low_latency && 0 == config_period_size) {
+		cw_alsa_get_low_latency_period_size_internal(gen, hw_params, &intended_period_size);
+	} else {
+		cw_alsa_get_intended_period_size_internal(gen, config_period_size, &intended_period_size);
+	}
 	snd_pcm_uframes_t actual_period_size = 0;   /* What it really is (what is allowed by HW). */
 	if (CW_SUCCESS != cw_alsa_set_hw_params_period_size_internal(gen, hw_params, intended_period_size, &actual_period_size)) {
 		return CW_FAILURE;
@@ -754,13 +1228,19 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 	cw_alsa_print_hw_params_internal(hw_params, "after setting hw params");
 
 	/* Save hw parameters to device */
-	snd_rv = cw_alsa.snd_pcm_hw_params(gen->alsa_data.pcm_handle, hw_params);
+	snd_rv = CW_ALSA(snd_pcm_hw_params)(gen->alsa_data.pcm_handle, hw_params);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't save hw parameters: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't save hw parameters: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
+	/* Remember what has been negotiated. Needed for sw params and
+	   for calculation of latency. */
+	int dir = 0;
+	CW_ALSA(snd_pcm_hw_params_get_period_size)(hw_params, &gen->alsa_data.period_size, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_buffer_size)(hw_params, &gen->alsa_data.buffer_size);
+
 	return CW_SUCCESS;
 }
 
@@ -775,16 +1255,20 @@ static cw_ret_t cw_alsa_set_hw_params_internal(cw_gen_t * gen, snd_pcm_hw_params
 
    @param[in] gen generator with opened ALSA PCM handle, for which HW parameters should be configured
    @param[in] hw_params allocated hw params data structure to be used by this function
+   @param[in] config_sample_rate sample rate to try before standard rates (zero if none)
 
    @reviewed 2020-07-09
 
    @return CW_FAILURE on errors
    @return CW_SUCCESS on success
 */
-static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params)
+static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, unsigned int config_sample_rate)
 {
 	/* Set the sample rate. This influences range of available
-	   period sizes (see cw_alsa_test_hw_period_sizes()). */
+	   period sizes, e.g. on one PC the range was 940-941 at 44100 Hz,
+	   1024 at 48000 Hz and 170-171 at 8000 Hz. Period sizes accepted
+	   by a device can be checked with "make backends" in
+	   src/libcw/bench. */
 	bool success = false;
 	int snd_rv = 0;
 
@@ -794,15 +1278,19 @@ static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_p
 	    - test_cw_gen_forever_internal
 
 	   On the other hand lower sample rates seems to mean wider range of
-	   supported period sizes. */
-	for (int i = 0; cw_supported_sample_rates[i]; i++) {
-		unsigned int rate = cw_supported_sample_rates[i];
+	   supported period sizes.
+
+	   Rate requested in generator's configuration (index -1) is tried
+	   before the standard rates. */
+	for (int i = config_sample_rate ? -1 : 0; i < 0 || cw_supported_sample_rates[i]; i++) {
+		const unsigned int asked = i < 0 ? config_sample_rate : cw_supported_sample_rates[i];
+		unsigned int rate = asked;
 		int dir = 0; /* Reset to zero before each ALSA API call. */
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_near(gen->alsa_data.pcm_handle, hw_params, &rate, &dir);
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_rate_near)(gen->alsa_data.pcm_handle, hw_params, &rate, &dir);
 		if (0 == snd_rv) {
-			if (rate != cw_supported_sample_rates[i]) {
+			if (rate != asked) {
 				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "imprecise sample rate:");
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "asked for: %u", cw_supported_sample_rates[i]);
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "asked for: %u", asked);
 				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "got:       %u", rate);
 			}
 			success = true;
@@ -813,7 +1301,7 @@ static cw_ret_t cw_alsa_set_hw_params_sample_rate_internal(cw_gen_t * gen, snd_p
 
 	if (!success) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "set hw params: can't set sample rate: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "set hw params: can't set sample rate: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	} else {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
@@ -851,8 +1339,8 @@ static cw_ret_t cw_alsa_set_hw_params_period_size_internal(cw_gen_t * gen, snd_p
 	/* See if the intended period is within range of values supported by HW. */
 	snd_pcm_uframes_t period_size_min = 0;
 	snd_pcm_uframes_t period_size_max = 0;
-	cw_alsa.snd_pcm_hw_params_get_period_size_min(hw_params, &period_size_min, &dir);
-	cw_alsa.snd_pcm_hw_params_get_period_size_max(hw_params, &period_size_max, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_min)(hw_params, &period_size_min, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_max)(hw_params, &period_size_max, &dir);
 
 	if (intended_period_size < period_size_min) {
 		/* Unfortunately at current sample rate the HW
@@ -864,10 +1352,10 @@ static cw_ret_t cw_alsa_set_hw_params_period_size_internal(cw_gen_t * gen, snd_p
 
 		intended_period_size = period_size_min;
 
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_period_size(gen->alsa_data.pcm_handle, hw_params, intended_period_size, 1);
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_period_size)(gen->alsa_data.pcm_handle, hw_params, intended_period_size, 1);
 		if (0 != snd_rv) {
 			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-				      MSG_PREFIX "Unable to set intended exact period size %lu for playback: %s", intended_period_size, cw_alsa.snd_strerror(snd_rv));
+				      MSG_PREFIX "Unable to set intended exact period size %lu for playback: %s", intended_period_size, CW_ALSA(snd_strerror)(snd_rv));
 			return CW_FAILURE;
 		}
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_DEBUG,
@@ -877,10 +1365,10 @@ static cw_ret_t cw_alsa_set_hw_params_period_size_internal(cw_gen_t * gen, snd_p
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_DEBUG,
 			      MSG_PREFIX "Will try to set intended near period size %lu for playback, dir = %d", intended_period_size, dir);
 
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_period_size_near(gen->alsa_data.pcm_handle, hw_params, &intended_period_size, &dir);
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_period_size_near)(gen->alsa_data.pcm_handle, hw_params, &intended_period_size, &dir);
 		if (0 != snd_rv) {
 			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-				      MSG_PREFIX "Unable to set intended near period size %lu for playback: %s", intended_period_size, cw_alsa.snd_strerror(snd_rv));
+				      MSG_PREFIX "Unable to set intended near period size %lu for playback: %s", intended_period_size, CW_ALSA(snd_strerror)(snd_rv));
 			return CW_FAILURE;
 		}
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_DEBUG,
@@ -888,26 +1376,26 @@ static cw_ret_t cw_alsa_set_hw_params_period_size_internal(cw_gen_t * gen, snd_p
 	}
 
 
-	cw_alsa.snd_pcm_hw_params_get_period_size_min(hw_params, &period_size_min, &dir);
-	cw_alsa.snd_pcm_hw_params_get_period_size_max(hw_params, &period_size_max, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_min)(hw_params, &period_size_min, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_max)(hw_params, &period_size_max, &dir);
 	if (period_size_min != period_size_max) {
 		/* Sometimes, for some reason, these two values can be different.
 		   On my PC max = min+1 */
 		dir = -1;
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_period_size_max(gen->alsa_data.pcm_handle, hw_params, &period_size_max, &dir);
+		snd_rv = CW_ALSA(snd_pcm_hw_params_set_period_size_max)(gen->alsa_data.pcm_handle, hw_params, &period_size_max, &dir);
 		if (0 != snd_rv) {
 			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 				      MSG_PREFIX "Unable to set period_size_max = %lu: %s",
 				      period_size_max,
-				      cw_alsa.snd_strerror(snd_rv));
+				      CW_ALSA(snd_strerror)(snd_rv));
 		}
 	}
 
 
-	snd_rv = cw_alsa.snd_pcm_hw_params_get_period_size(hw_params, actual_period_size, &dir);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_get_period_size)(hw_params, actual_period_size, &dir);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "Unable to get period size for playback: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "Unable to get period size for playback: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
@@ -951,10 +1439,10 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 	snd_pcm_uframes_t intended_buffer_size = actual_period_size * n_periods;
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "Will try to set intended buffer size %lu", intended_buffer_size);
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_buffer_size_near(gen->alsa_data.pcm_handle, hw_params, &intended_buffer_size);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_set_buffer_size_near)(gen->alsa_data.pcm_handle, hw_params, &intended_buffer_size);
 	if (0 != snd_rv) {
 		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "Unable to set buffer size %lu for playback: %s", intended_buffer_size, cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "Unable to set buffer size %lu for playback: %s", intended_buffer_size, CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
@@ -962,10 +1450,10 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 	   parameter to be zero in final configuration space. Better set it
 	   explicitly. */
 	int dir = 0;
-	snd_rv = cw_alsa.snd_pcm_hw_params_set_periods(gen->alsa_data.pcm_handle, hw_params, n_periods, dir);
+	snd_rv = CW_ALSA(snd_pcm_hw_params_set_periods)(gen->alsa_data.pcm_handle, hw_params, n_periods, dir);
 	if (0 != snd_rv) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-		              MSG_PREFIX "set hw params: can't set %d periods: [%s]", n_periods, cw_alsa.snd_strerror(snd_rv));
+		              MSG_PREFIX "set hw params: can't set %d periods: [%s]", n_periods, CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
@@ -975,77 +1463,6 @@ static cw_ret_t cw_alsa_set_hw_params_buffer_size_internal(cw_gen_t * gen, snd_p
 
 
 
-/**
-   Test/example function, not to be used in production code.
-
-   Test relationship between selected sample rate and available range
-   of period sizes.
-
-   Example output on my old-ish PC (sample rate 4000 added for tests):
-   Sample rate vs. period size range:
-   sample rate = 44100, period size range = 940 - 941
-   sample rate = 48000, period size range = 1024 - 1024
-   sample rate = 32000, period size range = 682 - 683
-   sample rate = 22050, period size range = 470 - 471
-   sample rate = 16000, period size range = 341 - 342
-   sample rate = 11025, period size range = 235 - 236
-   sample rate = 8000, period size range = 170 - 171
-   sample rate = 4000, period size range = 85 - 86
-
-   On one hand we want to have small buffer, so that ALSA write()
-   operation is blocking even for the shortest tones. So we want to
-   have rather small sample rates. But on the other hand we need to be
-   able to play tones with CW_FREQUENCY_MAX without
-   distortion. Therefore minimal sample rate should be 8000.
-
-   @reviewed 2020-07-10
-
-   @param[in] gen generator variable with opened ALSA PCM handle, for which the period sizes should be tested
-*/
-__attribute__((unused))
-static void cw_alsa_test_hw_period_sizes(cw_gen_t * gen)
-{
-	snd_pcm_hw_params_t * hw_params = NULL;
-	int snd_rv = 0;
-
-	snd_rv = cw_alsa.snd_pcm_hw_params_malloc(&hw_params);
-	if (0 != snd_rv || NULL == hw_params) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open: can't allocate memory for ALSA hw params: %s", cw_alsa.snd_strerror(snd_rv));
-		return;
-	}
-
-
-	fprintf(stderr, "[II] Sample rate vs. period size range:\n");
-	for (int i = 0; 0 != cw_supported_sample_rates[i]; i++) {
-		unsigned int rate = cw_supported_sample_rates[i];
-
-		snd_rv = cw_alsa.snd_pcm_hw_params_any(gen->alsa_data.pcm_handle, hw_params);
-		if (0 != snd_rv) {
-			continue;
-		}
-
-		int dir = 0;
-		snd_rv = cw_alsa.snd_pcm_hw_params_set_rate_near(gen->alsa_data.pcm_handle, hw_params, &rate, &dir);
-		if (0 != snd_rv) {
-			continue;
-		}
-
-		snd_pcm_uframes_t period_size_min = 0;
-		snd_pcm_uframes_t period_size_max = 0;
-		cw_alsa.snd_pcm_hw_params_get_period_size_min(hw_params, &period_size_min, &dir);
-		cw_alsa.snd_pcm_hw_params_get_period_size_max(hw_params, &period_size_max, &dir);
-
-		fprintf(stderr, "[II]     sample rate = %7u, period size range = %lu - %lu\n",
-			cw_supported_sample_rates[i], period_size_min, period_size_max);
-	}
-
-	cw_alsa.snd_pcm_hw_params_free(hw_params);
-}
-
-
-
-
 /**
    @brief Print most important fields of @p hw_params structure
 
@@ -1067,30 +1484,30 @@ static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, co
 	snd_pcm_uframes_t period_size_min = 0;
 	snd_pcm_uframes_t period_size_max = 0;
 	dir = 0;
-	cw_alsa.snd_pcm_hw_params_get_period_size_min(hw_params, &period_size_min, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_min)(hw_params, &period_size_min, &dir);
 	dir = 0;
-	cw_alsa.snd_pcm_hw_params_get_period_size_max(hw_params, &period_size_max, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_max)(hw_params, &period_size_max, &dir);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Range of period sizes: %lu - %lu", period_size_min, period_size_max);
 
 
 	snd_pcm_uframes_t current_period_size = 0;
 	dir = 0;
-	cw_alsa.snd_pcm_hw_params_get_period_size(hw_params, &current_period_size, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size)(hw_params, &current_period_size, &dir);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Current period size: %lu, dir = %d", current_period_size, dir);
 
 
 	snd_pcm_uframes_t buffer_size_min = 0;
 	snd_pcm_uframes_t buffer_size_max = 0;
-	cw_alsa.snd_pcm_hw_params_get_buffer_size_min(hw_params, &buffer_size_min);
-	cw_alsa.snd_pcm_hw_params_get_buffer_size_max(hw_params, &buffer_size_max);
+	CW_ALSA(snd_pcm_hw_params_get_buffer_size_min)(hw_params, &buffer_size_min);
+	CW_ALSA(snd_pcm_hw_params_get_buffer_size_max)(hw_params, &buffer_size_max);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Range of buffer sizes: %lu - %lu", buffer_size_min, buffer_size_max);
 
 
 	snd_pcm_uframes_t current_buffer_size = 0;
-	cw_alsa.snd_pcm_hw_params_get_buffer_size(hw_params, &current_buffer_size);
+	CW_ALSA(snd_pcm_hw_params_get_buffer_size)(hw_params, &current_buffer_size);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Current buffer size: %lu", current_buffer_size);
 
@@ -1100,9 +1517,9 @@ static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, co
 	unsigned int n_periods_min = 0;
 	unsigned int n_periods_max = 0;
 	dir = 0;
-	cw_alsa.snd_pcm_hw_params_get_periods(hw_params, &n_periods, &dir);
-	cw_alsa.snd_pcm_hw_params_get_periods_min(hw_params, &n_periods_min, &dir);
-	cw_alsa.snd_pcm_hw_params_get_periods_max(hw_params, &n_periods_max, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_periods)(hw_params, &n_periods, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_periods_min)(hw_params, &n_periods_min, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_periods_max)(hw_params, &n_periods_max, &dir);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Count of periods in buffer: %u (min = %u, max = %u)", n_periods, n_periods_min, n_periods_max);
 	/* The ratio should be a value with zero fractional part. TODO: write a test for it. */
@@ -1115,8 +1532,8 @@ static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, co
 	dir_max = 0;
 	unsigned int rate_min = 0;
 	unsigned int rate_max = 0;
-	cw_alsa.snd_pcm_hw_params_get_rate_min(hw_params, &rate_min, &dir_min);
-	cw_alsa.snd_pcm_hw_params_get_rate_max(hw_params, &rate_max, &dir_max);
+	CW_ALSA(snd_pcm_hw_params_get_rate_min)(hw_params, &rate_min, &dir_min);
+	CW_ALSA(snd_pcm_hw_params_get_rate_max)(hw_params, &rate_max, &dir_max);
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "    Range of sample rates: %u - %u (dir min = %d, dir max = %d)",
 		      rate_min, rate_max, dir_min, dir_max);
@@ -1125,45 +1542,104 @@ static void cw_alsa_print_hw_params_internal(snd_pcm_hw_params_t * hw_params, co
 
 
 
-#if CW_ALSA_SW_PARAMS_CONFIG
+/**
+   @brief Configure software parameters of ALSA PCM for low latency
+
+   Playback is started as soon as first period is written to device
+   (by default ALSA waits until whole buffer is filled), and blocked
+   write returns as soon as there is room for one period.
+
+   Function must be called after hw params have been installed with
+   cw_alsa_set_hw_params_internal().
+
+   @param[in] gen generator with opened and configured ALSA PCM handle
+   @param[in] sw_params allocated sw params data structure to be used by this function
+
+   @return CW_FAILURE on errors
+   @return CW_SUCCESS on success
+*/
 static cw_ret_t cw_alsa_set_sw_params_internal(cw_gen_t * gen, snd_pcm_sw_params_t * sw_params)
 {
-	snd_pcm_t *handle = gen->alsa_data.handle;
-
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
 
-	int snd_rv;
 	/* Get the current sw_params. */
-	snd_rv = cw_alsa.snd_pcm_sw_params_current(handle, sw_params);
+	int snd_rv = CW_ALSA(snd_pcm_sw_params_current)(pcm, sw_params);
 	if (0 != snd_rv) {
 		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "Unable to determine current sw_params for playback: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "Unable to determine current sw_params for playback: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
+	snd_rv = CW_ALSA(snd_pcm_sw_params_set_start_threshold)(pcm, sw_params, gen->alsa_data.period_size);
+	if (0 != snd_rv) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "Unable to set start threshold %lu for playback: %s", gen->alsa_data.period_size, CW_ALSA(snd_strerror)(snd_rv));
+		return CW_FAILURE;
+	}
 
+	snd_rv = CW_ALSA(snd_pcm_sw_params_set_avail_min)(pcm, sw_params, gen->alsa_data.period_size);
+	if (0 != snd_rv) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "Unable to set avail min %lu for playback: %s", gen->alsa_data.period_size, CW_ALSA(snd_strerror)(snd_rv));
+		return CW_FAILURE;
+	}
 
 	/* write the parameters to the playback device */
-	snd_rv = cw_alsa.snd_pcm_sw_params(handle, sw_params);
+	snd_rv = CW_ALSA(snd_pcm_sw_params)(pcm, sw_params);
 	if (0 != snd_rv) {
 		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "Unable to set sw params for playback: %s", cw_alsa.snd_strerror(snd_rv));
+			      MSG_PREFIX "Unable to set sw params for playback: %s", CW_ALSA(snd_strerror)(snd_rv));
 		return CW_FAILURE;
 	}
 
+	cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "Configured start threshold and avail min for playback: %lu", gen->alsa_data.period_size);
+
 	return CW_SUCCESS;
 }
 
 
 
 
-static void cw_alsa_print_sw_params_internal(snd_pcm_sw_params_t * sw_params, const char * where)
-{
-}
+/**
+   @brief Set avail min of ALSA device to given count of samples
 
+   Blocked write to device (or poll of non-blocking device) returns
+   as soon as there is free space for @p n_samples samples in ring
+   buffer of the device.
 
+   Avail min can't be changed if device has been opened without
+   cw_gen_config_t::adaptive_period.
 
+   @param[in] gen generator with opened and configured ALSA PCM handle
+   @param[in] n_samples count of samples
 
-#endif
+   @return CW_FAILURE on errors
+   @return CW_SUCCESS on success
+*/
+static cw_ret_t cw_alsa_set_sound_device_write_size_internal(cw_gen_t * gen, int n_samples)
+{
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+	snd_pcm_sw_params_t * sw_params = gen->alsa_data.sw_params;
+	if (NULL == sw_params) {
+		return CW_FAILURE;
+	}
+
+	int snd_rv = CW_ALSA(snd_pcm_sw_params_current)(pcm, sw_params);
+	if (0 == snd_rv) {
+		snd_rv = CW_ALSA(snd_pcm_sw_params_set_avail_min)(pcm, sw_params, (snd_pcm_uframes_t) n_samples);
+	}
+	if (0 == snd_rv) {
+		snd_rv = CW_ALSA(snd_pcm_sw_params)(pcm, sw_params);
+	}
+	if (0 != snd_rv) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "Unable to set avail min %d for playback: %s", n_samples, CW_ALSA(snd_strerror)(snd_rv));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
 
 
 
@@ -1187,93 +1663,113 @@ static void cw_alsa_print_sw_params_internal(snd_pcm_sw_params_t * sw_params, co
 */
 static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 {
-	*(void **) &(alsa_handle->snd_pcm_open)    = dlsym(alsa_handle->lib_handle, "snd_pcm_open");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_open);
 	if (!alsa_handle->snd_pcm_open)            return -1;
-	*(void **) &(alsa_handle->snd_pcm_close)   = dlsym(alsa_handle->lib_handle, "snd_pcm_close");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_close);
 	if (!alsa_handle->snd_pcm_close)           return -2;
-	*(void **) &(alsa_handle->snd_pcm_prepare) = dlsym(alsa_handle->lib_handle, "snd_pcm_prepare");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_prepare);
 	if (!alsa_handle->snd_pcm_prepare)         return -3;
-	*(void **) &(alsa_handle->snd_pcm_drop)    = dlsym(alsa_handle->lib_handle, "snd_pcm_drop");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_drop);
 	if (!alsa_handle->snd_pcm_drop)            return -4;
-	*(void **) &(alsa_handle->snd_pcm_drain)   = dlsym(alsa_handle->lib_handle, "snd_pcm_drain");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_drain);
 	if (!alsa_handle->snd_pcm_drain)           return -(__LINE__);
-	*(void **) &(alsa_handle->snd_pcm_writei)  = dlsym(alsa_handle->lib_handle, "snd_pcm_writei");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_writei);
 	if (!alsa_handle->snd_pcm_writei)          return -5;
+
+	/* Optional, see cw_alsa_get_sound_device_delay_internal(). */
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_delay);
+
+	/* Optional, see cw_alsa_mmap_is_loaded_internal(). */
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_avail_update);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_mmap_begin);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_mmap_commit);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_wait);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_start);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_state);
+	/* Optional, see cw_alsa_nonblock_is_loaded_internal(). */
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_nonblock);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_poll_descriptors_count);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_poll_descriptors);
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_poll_descriptors_revents);
 #if WITH_ALSA_FREE_GLOBAL_CONFIG
-	*(void **) &(alsa_handle->snd_config_update_free_global)  = dlsym(alsa_handle->lib_handle, "snd_config_update_free_global");
+	CW_ALSA_RESOLVE(alsa_handle, snd_config_update_free_global);
 	if (!alsa_handle->snd_config_update_free_global)          return -6;
 #endif
 
-	*(void **) &(alsa_handle->snd_strerror) = dlsym(alsa_handle->lib_handle, "snd_strerror");
+	CW_ALSA_RESOLVE(alsa_handle, snd_strerror);
 	if (!alsa_handle->snd_strerror)         return -10;
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_malloc) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_malloc");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_malloc);
 	if (!alsa_handle->snd_pcm_hw_params_malloc)         return -20;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_free)   = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_free");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_free);
 	if (!alsa_handle->snd_pcm_hw_params_free)           return -21;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_any)    = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_any");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_any);
 	if (!alsa_handle->snd_pcm_hw_params_any)            return -22;
-	*(void **) &(alsa_handle->snd_pcm_hw_params)        = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params);
 	if (!alsa_handle->snd_pcm_hw_params)                return -23;
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_format)   = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_format");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_format);
 	if (!alsa_handle->snd_pcm_hw_params_set_format)           return -31;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_access)   = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_access");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_access);
 	if (!alsa_handle->snd_pcm_hw_params_set_access)           return -32;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_channels) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_channels");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_channels);
 	if (!alsa_handle->snd_pcm_hw_params_set_channels)         return -33;
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_periods)          = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_periods");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_periods);
 	if (!alsa_handle->snd_pcm_hw_params_get_periods)                  return -(__LINE__);
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_periods_min)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_periods_min");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_periods_min);
 	if (!alsa_handle->snd_pcm_hw_params_get_periods_min)              return -(__LINE__);
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_periods_max)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_periods_max");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_periods_max);
 	if (!alsa_handle->snd_pcm_hw_params_get_periods_max)              return -(__LINE__);
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_periods)          = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_periods");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_periods);
 	if (!alsa_handle->snd_pcm_hw_params_set_periods)                  return -(__LINE__);
 
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_period_size_min)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_period_size_min");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_period_size_min);
 	if (!alsa_handle->snd_pcm_hw_params_get_period_size_min)          return -41;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_period_size_max)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_period_size_max");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_period_size_max);
 	if (!alsa_handle->snd_pcm_hw_params_get_period_size_max)          return -42;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_period_size_near) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_period_size_near");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_period_size_near);
 	if (!alsa_handle->snd_pcm_hw_params_set_period_size_near)         return -43;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_period_size)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_period_size");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_period_size);
 	if (!alsa_handle->snd_pcm_hw_params_set_period_size)              return -44;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_period_size_max)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_period_size_max");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_period_size_max);
 	if (!alsa_handle->snd_pcm_hw_params_set_period_size_max)          return -45;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_period_size)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_period_size");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_period_size);
 	if (!alsa_handle->snd_pcm_hw_params_get_period_size)              return -46;
 
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_buffer_size_min)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_buffer_size_min");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_buffer_size_min);
 	if (!alsa_handle->snd_pcm_hw_params_get_buffer_size_min)          return -50;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_buffer_size_max)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_buffer_size_max");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_buffer_size_max);
 	if (!alsa_handle->snd_pcm_hw_params_get_buffer_size_max)          return -51;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_buffer_size_near) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_buffer_size_near");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_buffer_size_near);
 	if (!alsa_handle->snd_pcm_hw_params_set_buffer_size_near)         return -52;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_buffer_size)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_buffer_size");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_buffer_size);
 	if (!alsa_handle->snd_pcm_hw_params_get_buffer_size)              return -53;
 
-	*(void **) &(alsa_handle->snd_pcm_hw_params_set_rate_near) = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_set_rate_near");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_set_rate_near);
 	if (!alsa_handle->snd_pcm_hw_params_set_rate_near)         return -60;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_rate)      = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_rate");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_rate);
 	if (!alsa_handle->snd_pcm_hw_params_get_rate)              return -61;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_rate_min)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_rate_min");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_rate_min);
 	if (!alsa_handle->snd_pcm_hw_params_get_rate_min)          return -62;
-	*(void **) &(alsa_handle->snd_pcm_hw_params_get_rate_max)  = dlsym(alsa_handle->lib_handle, "snd_pcm_hw_params_get_rate_max");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_hw_params_get_rate_max);
 	if (!alsa_handle->snd_pcm_hw_params_get_rate_max)          return -63;
 
 
-#if CW_ALSA_SW_PARAMS_CONFIG
-	*(void **) &(alsa_handle->snd_pcm_sw_params_current) = dlsym(alsa_handle->lib_handle, "snd_pcm_sw_params_current");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params_current);
 	if (!alsa_handle->snd_pcm_sw_params_current)         return -101;
-	*(void **) &(alsa_handle->snd_pcm_sw_params)         = dlsym(alsa_handle->lib_handle, "snd_pcm_sw_params");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params);
 	if (!alsa_handle->snd_pcm_sw_params)                 return -102;
-	*(void **) &(alsa_handle->snd_pcm_sw_params_malloc)  = dlsym(alsa_handle->lib_handle, "snd_pcm_sw_params_malloc");
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params_malloc);
 	if (!alsa_handle->snd_pcm_sw_params_malloc)          return -103;
-#endif
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params_free);
+	if (!alsa_handle->snd_pcm_sw_params_free)            return -104;
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params_set_start_threshold);
+	if (!alsa_handle->snd_pcm_sw_params_set_start_threshold)         return -105;
+	CW_ALSA_RESOLVE(alsa_handle, snd_pcm_sw_params_set_avail_min);
+	if (!alsa_handle->snd_pcm_sw_params_set_avail_min)               return -106;
 
 	return 0;
 }
@@ -1282,6 +1778,46 @@ static int cw_alsa_handle_load_internal(cw_alsa_handle_t * alsa_handle)
 
 
 
+/**
+   @brief Check if all functions needed for mmap access have been loaded
+
+   @param[in] alsa_handle structure with function pointers
+
+   @return true if mmap access can be used
+   @return false otherwise
+*/
+static bool cw_alsa_mmap_is_loaded_internal(const cw_alsa_handle_t * alsa_handle)
+{
+	return NULL != alsa_handle->snd_pcm_avail_update
+		&& NULL != alsa_handle->snd_pcm_mmap_begin
+		&& NULL != alsa_handle->snd_pcm_mmap_commit
+		&& NULL != alsa_handle->snd_pcm_wait
+		&& NULL != alsa_handle->snd_pcm_start
+		&& NULL != alsa_handle->snd_pcm_state;
+}
+
+
+
+
+/**
+   @brief Check if all functions needed for non-blocking mode have been loaded
+
+   @param[in] alsa_handle structure with function pointers
+
+   @return true if non-blocking mode can be used
+   @return false otherwise
+*/
+static bool cw_alsa_nonblock_is_loaded_internal(const cw_alsa_handle_t * alsa_handle)
+{
+	return NULL != alsa_handle->snd_pcm_nonblock
+		&& NULL != alsa_handle->snd_pcm_poll_descriptors_count
+		&& NULL != alsa_handle->snd_pcm_poll_descriptors
+		&& NULL != alsa_handle->snd_pcm_poll_descriptors_revents;
+}
+
+
+
+
 /**
    @brief Call ALSA's snd_pcm_drop() function for given generator
 
@@ -1299,7 +1835,111 @@ void cw_alsa_drop_internal(cw_gen_t * gen)
 
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
 		      MSG_PREFIX "PCM drop");
-	cw_alsa.snd_pcm_drop(gen->alsa_data.pcm_handle);
+	CW_ALSA(snd_pcm_drop)(gen->alsa_data.pcm_handle);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Drop silence waiting to be played by ALSA device
+
+   Frames are dropped only if all frames waiting in ring buffer of
+   device are silent, i.e. if there are no more than @p n_silent_samples
+   of them. Dropping part of them (e.g. with snd_pcm_rewind()) is not
+   reliable with all plugins.
+
+   @param[in] gen generator with ALSA PCM handle
+   @param[in] n_silent_samples count of most recently written frames that are silent
+
+   @return CW_SUCCESS if frames have been dropped
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_drop_silence_from_sound_device_internal(cw_gen_t * gen, int64_t n_silent_samples)
+{
+	if (NULL == cw_alsa.snd_pcm_avail_update || NULL == cw_alsa.snd_pcm_state) {
+		return CW_FAILURE;
+	}
+
+	snd_pcm_t * pcm = gen->alsa_data.pcm_handle;
+	if (SND_PCM_STATE_RUNNING != CW_ALSA(snd_pcm_state)(pcm)) {
+		/* Nothing is being played (or there was an underrun
+		   that will be handled by next write). */
+		return CW_FAILURE;
+	}
+
+	const snd_pcm_sframes_t avail = CW_ALSA(snd_pcm_avail_update)(pcm);
+	if (avail < 0 || (snd_pcm_uframes_t) avail > gen->alsa_data.buffer_size) {
+		return CW_FAILURE;
+	}
+	const int64_t n_pending = (int64_t) (gen->alsa_data.buffer_size - (snd_pcm_uframes_t) avail);
+	if (n_pending > n_silent_samples) {
+		/* Tail of previous Mark hasn't been played yet. */
+		return CW_FAILURE;
+	}
+
+	/* Drop the frames, and prepare device for the new Mark. */
+	cw_alsa_reset_internal(gen);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get duration of frames waiting to be played by ALSA device
+
+   snd_pcm_delay() tells how many frames written now would wait before
+   they are played, which includes delay of hardware and of plugins.
+
+   @param[in] gen generator with ALSA PCM handle
+   @param[out] delay duration of waiting frames [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_alsa_get_sound_device_delay_internal(cw_gen_t * gen, int * delay)
+{
+	if (NULL == cw_alsa.snd_pcm_delay || 0 == gen->sample_rate) {
+		return CW_FAILURE;
+	}
+
+	snd_pcm_sframes_t n_frames = 0;
+	if (0 != CW_ALSA(snd_pcm_delay)(gen->alsa_data.pcm_handle, &n_frames) || n_frames < 0) {
+		return CW_FAILURE;
+	}
+	*delay = (int) (((int64_t) n_frames * CW_USECS_PER_SEC) / gen->sample_rate);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Drop pending frames and prepare ALSA PCM handle for new writes
+
+   Used when configured PCM handle is passed from one generator to
+   another (see libcw_device_pool.c).
+
+   @param[in] gen generator with ALSA PCM handle
+*/
+void cw_alsa_reset_internal(cw_gen_t * gen)
+{
+	if (gen->alsa_data.mmap_acquired) {
+		gen->buffer = gen->own_buffer;
+		gen->alsa_data.mmap_acquired = false;
+	}
+	CW_ALSA(snd_pcm_drop)(gen->alsa_data.pcm_handle);
+	const int snd_rv = CW_ALSA(snd_pcm_prepare)(gen->alsa_data.pcm_handle);
+	if (0 != snd_rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reset: prepare() returns error: %s/%d",
+			      CW_ALSA(snd_strerror)(snd_rv), snd_rv);
+	}
 
 	return;
 }
@@ -1366,6 +2006,53 @@ static void cw_alsa_get_intended_period_size_internal(const cw_gen_t * gen, snd_
 
 
 
+/**
+   @brief Get period size for low-latency profile
+
+   Probe range of period sizes supported by HW at current sample rate,
+   and pick the smallest one that is still stable, i.e. no shorter than
+   CW_ALSA_LOW_LATENCY_PERIOD_DURATION_MIN. The period is never larger
+   than the one calculated by cw_alsa_get_intended_period_size_internal()
+   for default profile.
+
+   @param[in] gen generator with current sample rate
+   @param[in] hw_params configuration space with sample rate already set
+   @param[out] intended_period_size period size that we would like to have configured in ALSA
+*/
+static void cw_alsa_get_low_latency_period_size_internal(const cw_gen_t * gen, snd_pcm_hw_params_t * hw_params, snd_pcm_uframes_t * intended_period_size)
+{
+	snd_pcm_uframes_t default_period_size = 0;
+	cw_alsa_get_intended_period_size_internal(gen, 0, &default_period_size);
+
+	int dir = 0;
+	snd_pcm_uframes_t period_size_min = 0;
+	snd_pcm_uframes_t period_size_max = 0;
+	CW_ALSA(snd_pcm_hw_params_get_period_size_min)(hw_params, &period_size_min, &dir);
+	CW_ALSA(snd_pcm_hw_params_get_period_size_max)(hw_params, &period_size_max, &dir);
+
+	const snd_pcm_uframes_t stable_period_size = ((uint64_t) gen->sample_rate * CW_ALSA_LOW_LATENCY_PERIOD_DURATION_MIN) / CW_USECS_PER_SEC;
+
+	snd_pcm_uframes_t period_size = period_size_min;
+	if (period_size < stable_period_size) {
+		period_size = stable_period_size;
+	}
+	if (period_size > default_period_size) {
+		period_size = default_period_size;
+	}
+	if (period_size > period_size_max) {
+		period_size = period_size_max;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "low latency: HW period size range = %lu - %lu, stable = %lu, default = %lu, picked = %lu [samples]",
+		      period_size_min, period_size_max, stable_period_size, default_period_size, period_size);
+
+	*intended_period_size = period_size;
+}
+
+
+
+
 #else /* #ifdef LIBCW_WITH_ALSA */
 
 
@@ -1400,4 +2087,13 @@ void cw_alsa_drop_internal(__attribute__((unused)) cw_gen_t * gen)
 
 
 
+void cw_alsa_reset_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	/* Don't log anything. */
+	return;
+}
+
+
+
+
 #endif /* #ifdef LIBCW_WITH_ALSA */
@@ -20,9 +20,37 @@
 
 
 #include <alsa/asoundlib.h>
+#include <stdbool.h>
 
 typedef struct cw_alsa_data_struct {
 	snd_pcm_t * pcm_handle; /* Output handle for sound data. */
+
+	/* Device has been configured for mmap access. Samples are
+	   calculated by generator directly in ring buffer of the device
+	   when possible, and copied to the ring buffer otherwise. */
+	bool mmap;
+
+	/* Area of ring buffer acquired with snd_pcm_mmap_begin(), to
+	   which gen->buffer points, and which is not committed yet. */
+	bool mmap_acquired;
+	snd_pcm_uframes_t mmap_offset;
+
+	/* Low-latency profile has been requested: smallest stable
+	   period size, and playback started after first period. */
+	bool low_latency;
+
+	/* Device has been opened with SND_PCM_NONBLOCK
+	   (cw_gen_config_t::sound_nonblocking). */
+	bool nonblocking;
+
+	/* Configuration negotiated with device. [frames] */
+	snd_pcm_uframes_t period_size;
+	snd_pcm_uframes_t buffer_size;
+
+	/* Allocated when device is opened, so that avail min can be
+	   changed by generator's thread without allocating memory
+	   (cw_gen_config_t::adaptive_period). */
+	snd_pcm_sw_params_t * sw_params;
 } cw_alsa_data_t;
 
 
@@ -41,6 +69,7 @@ typedef struct cw_alsa_data_struct {
 
 cw_ret_t cw_alsa_init_gen_internal(cw_gen_t * gen);
 void cw_alsa_drop_internal(cw_gen_t * gen);
+void cw_alsa_reset_internal(cw_gen_t * gen);
 
 
 
@@ -0,0 +1,863 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_batch.c
+
+   @brief Rendering of many strings into many WAV files.
+
+   Jobs (string + path) are taken from a queue by a pool of rendering
+   threads. Each thread has its own generator, configured once when
+   the batch is created, and renders a job into a buffer taken from a
+   pool of buffers. Rendered buffers are written to files by writing
+   threads, so rendering threads don't wait for disc.
+
+   On Linux the buffers are written with io_uring: one thread submits
+   writes of many files, and kernel performs them in parallel. When
+   io_uring is not available (old kernel, or forbidden by seccomp
+   filter), a few threads call write().
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_batch.h"
+#include "libcw_debug.h"
+#include "libcw_file.h"
+#include "libcw_gen.h"
+#include "libcw_gen_render.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/batch: "
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define CW_BATCH_WITH_IO_URING 1
+#endif
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static void * cw_batch_worker_thread_internal(void * arg);
+static cw_ret_t cw_batch_render_job_internal(cw_batch_worker_t * worker, const cw_batch_job_t * job, cw_batch_buffer_t * buffer);
+static cw_ret_t cw_batch_buffer_reserve_internal(cw_batch_buffer_t * buffer, size_t n_bytes);
+static void cw_batch_finish_buffer_internal(cw_batch_t * batch, cw_batch_buffer_t * buffer, bool success);
+static void * cw_batch_writer_thread_internal(void * arg);
+static cw_ret_t cw_batch_uring_open_internal(cw_batch_uring_t * uring);
+static void cw_batch_uring_close_internal(cw_batch_uring_t * uring);
+#ifdef CW_BATCH_WITH_IO_URING
+static void * cw_batch_uring_thread_internal(void * arg);
+static void cw_batch_uring_queue_write_internal(cw_batch_uring_t * uring, cw_batch_buffer_t * buffer);
+#endif
+
+
+
+
+cw_batch_t * cw_batch_new(cw_gen_t * gen, int n_workers)
+{
+	return cw_batch_new_internal(gen, n_workers, true);
+}
+
+
+
+
+/**
+   @brief Create batch renderer
+
+   See cw_batch_new().
+
+   @param[in] gen generator with parameters of rendered files
+   @param[in] n_workers count of rendering threads (0-64), zero means count of CPUs
+   @param[in] try_io_uring whether to write files with io_uring (if it is available)
+
+   @return new batch renderer on success
+   @return NULL on failure
+*/
+cw_batch_t * cw_batch_new_internal(cw_gen_t * gen, int n_workers, bool try_io_uring)
+{
+	if (NULL == gen || n_workers < 0 || n_workers > CW_BATCH_N_WORKERS_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (0 == n_workers) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_workers = n_cpus < 1 ? 1 : (n_cpus > CW_BATCH_N_WORKERS_MAX ? CW_BATCH_N_WORKERS_MAX : (int) n_cpus);
+	}
+
+	cw_batch_t * batch = (cw_batch_t *) calloc(1, sizeof (cw_batch_t));
+	if (NULL == batch) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		errno = ENOMEM;
+		return NULL;
+	}
+	pthread_mutex_init(&batch->mutex, NULL);
+	pthread_cond_init(&batch->job_available, NULL);
+	pthread_cond_init(&batch->buffer_available, NULL);
+	pthread_cond_init(&batch->write_available, NULL);
+	pthread_cond_init(&batch->all_done, NULL);
+	batch->do_render = true;
+	batch->do_write = true;
+	batch->uring.fd = -1;
+
+	batch->template_gen = cw_gen_render_copy_gen_internal(gen);
+	batch->n_buffers = n_workers * CW_BATCH_N_BUFFERS_PER_WORKER;
+	batch->buffers = (cw_batch_buffer_t *) calloc((size_t) batch->n_buffers, sizeof (cw_batch_buffer_t));
+	if (NULL == batch->template_gen || NULL == batch->buffers) {
+		cw_batch_delete(&batch);
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (int i = 0; i < batch->n_buffers; i++) {
+		batch->buffers[i].fd = -1;
+		batch->buffers[i].next = batch->free_buffers;
+		batch->free_buffers = &batch->buffers[i];
+	}
+
+	if (try_io_uring && CW_SUCCESS == cw_batch_uring_open_internal(&batch->uring)) {
+		batch->use_io_uring = true;
+	}
+	const int n_writers = batch->use_io_uring ? 1 : CW_BATCH_N_WRITERS;
+	for (int i = 0; i < n_writers; i++) {
+		void * (* thread_fn)(void *) = cw_batch_writer_thread_internal;
+#ifdef CW_BATCH_WITH_IO_URING
+		if (batch->use_io_uring) {
+			thread_fn = cw_batch_uring_thread_internal;
+		}
+#endif
+		const int rv = pthread_create(&batch->writer_ids[i], NULL, thread_fn, (void *) batch);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create writing thread: '%s'", strerror(rv));
+			cw_batch_delete(&batch);
+			errno = EAGAIN;
+			return NULL;
+		}
+		batch->n_writers++;
+	}
+
+	for (int w = 0; w < n_workers; w++) {
+		cw_batch_worker_t * worker = &batch->workers[w];
+		worker->batch = batch;
+		worker->gen = cw_gen_render_copy_gen_internal(gen);
+		if (NULL == worker->gen) {
+			cw_batch_delete(&batch);
+			errno = ENOMEM;
+			return NULL;
+		}
+		const int rv = pthread_create(&worker->thread_id, NULL, cw_batch_worker_thread_internal, (void *) worker);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create rendering thread: '%s'", strerror(rv));
+			cw_batch_delete(&batch);
+			errno = EAGAIN;
+			return NULL;
+		}
+		batch->n_workers++;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "%d rendering threads, writing with %s", batch->n_workers, batch->use_io_uring ? "io_uring" : "write()");
+
+	return batch;
+}
+
+
+
+
+void cw_batch_delete(cw_batch_t ** batch)
+{
+	if (NULL == batch || NULL == *batch) {
+		return;
+	}
+	cw_batch_t * b = *batch;
+
+	/* Rendering threads stop first, so that writing threads can
+	   write all buffers that have been rendered. */
+	pthread_mutex_lock(&b->mutex);
+	b->do_render = false;
+	pthread_cond_broadcast(&b->job_available);
+	pthread_cond_broadcast(&b->buffer_available);
+	pthread_mutex_unlock(&b->mutex);
+	for (int w = 0; w < b->n_workers; w++) {
+		pthread_join(b->workers[w].thread_id, NULL);
+	}
+
+	pthread_mutex_lock(&b->mutex);
+	b->do_write = false;
+	pthread_cond_broadcast(&b->write_available);
+	pthread_mutex_unlock(&b->mutex);
+	for (int i = 0; i < b->n_writers; i++) {
+		pthread_join(b->writer_ids[i], NULL);
+	}
+	cw_batch_uring_close_internal(&b->uring);
+
+	while (NULL != b->jobs_head) {
+		cw_batch_job_t * job = b->jobs_head;
+		b->jobs_head = job->next;
+		free(job);
+	}
+	for (int i = 0; i < b->n_buffers; i++) {
+		free(b->buffers[i].data);
+	}
+	free(b->buffers);
+	for (int w = 0; w < CW_BATCH_N_WORKERS_MAX; w++) {
+		cw_gen_delete(&b->workers[w].gen);
+		free(b->workers[w].translated);
+	}
+	cw_gen_delete(&b->template_gen);
+
+	pthread_cond_destroy(&b->all_done);
+	pthread_cond_destroy(&b->write_available);
+	pthread_cond_destroy(&b->buffer_available);
+	pthread_cond_destroy(&b->job_available);
+	pthread_mutex_destroy(&b->mutex);
+
+	free(b);
+	*batch = NULL;
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_batch_add(cw_batch_t * batch, const char * string, const char * path)
+{
+	if (NULL == batch || NULL == string || NULL == path) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Job and its strings are in one allocation. */
+	const size_t string_size = strlen(string) + 1;
+	const size_t path_size = strlen(path) + 1;
+	cw_batch_job_t * job = (cw_batch_job_t *) malloc(sizeof (cw_batch_job_t) + string_size + path_size);
+	if (NULL == job) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "malloc()");
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	job->next = NULL;
+	job->string = (char *) (job + 1);
+	memcpy(job->string, string, string_size);
+	job->path = job->string + string_size;
+	memcpy(job->path, path, path_size);
+
+	pthread_mutex_lock(&batch->mutex);
+	if (NULL == batch->jobs_tail) {
+		batch->jobs_head = job;
+	} else {
+		batch->jobs_tail->next = job;
+	}
+	batch->jobs_tail = job;
+	batch->n_added++;
+	pthread_cond_signal(&batch->job_available);
+	pthread_mutex_unlock(&batch->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_batch_wait(cw_batch_t * batch, unsigned int * n_failed)
+{
+	if (NULL == batch) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&batch->mutex);
+	while (batch->n_done != batch->n_added) {
+		pthread_cond_wait(&batch->all_done, &batch->mutex);
+	}
+	const unsigned int n = batch->n_failed - batch->n_failed_reported;
+	batch->n_failed_reported = batch->n_failed;
+	pthread_mutex_unlock(&batch->mutex);
+
+	if (NULL != n_failed) {
+		*n_failed = n;
+	}
+	if (n > 0) {
+		errno = EIO;
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Thread function of rendering thread
+
+   @param[in] arg worker (cw_batch_worker_t *)
+
+   @return NULL
+*/
+static void * cw_batch_worker_thread_internal(void * arg)
+{
+	cw_batch_worker_t * worker = (cw_batch_worker_t *) arg;
+	cw_batch_t * batch = worker->batch;
+
+	pthread_mutex_lock(&batch->mutex);
+	while (true) {
+		while (batch->do_render && (NULL == batch->jobs_head || NULL == batch->free_buffers)) {
+			if (NULL == batch->jobs_head) {
+				pthread_cond_wait(&batch->job_available, &batch->mutex);
+			} else {
+				pthread_cond_wait(&batch->buffer_available, &batch->mutex);
+			}
+		}
+		if (!batch->do_render) {
+			break;
+		}
+
+		cw_batch_job_t * job = batch->jobs_head;
+		batch->jobs_head = job->next;
+		if (NULL == batch->jobs_head) {
+			batch->jobs_tail = NULL;
+		}
+		cw_batch_buffer_t * buffer = batch->free_buffers;
+		batch->free_buffers = buffer->next;
+		pthread_mutex_unlock(&batch->mutex);
+
+		const cw_ret_t cwret = cw_batch_render_job_internal(worker, job, buffer);
+		free(job);
+		if (CW_SUCCESS != cwret) {
+			cw_batch_finish_buffer_internal(batch, buffer, false);
+			pthread_mutex_lock(&batch->mutex);
+			continue;
+		}
+
+		pthread_mutex_lock(&batch->mutex);
+		buffer->next = NULL;
+		if (NULL == batch->writes_tail) {
+			batch->writes_head = buffer;
+		} else {
+			batch->writes_tail->next = buffer;
+		}
+		batch->writes_tail = buffer;
+		pthread_cond_signal(&batch->write_available);
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Render string of job into buffer, and open file of job
+
+   The string is rendered word by word, so that tone queue of
+   generator doesn't have to hold tones of long strings. On success
+   @p buffer contains WAV header and samples, and its file descriptor
+   is set.
+
+   @param[in,out] worker rendering thread
+   @param[in] job job to render
+   @param[in,out] buffer buffer for contents of file
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_batch_render_job_internal(cw_batch_worker_t * worker, const cw_batch_job_t * job, cw_batch_buffer_t * buffer)
+{
+	cw_gen_t * gen = worker->gen;
+
+	const size_t len = strlen(job->string);
+	if (len + 1 > worker->translated_capacity) {
+		uint8_t * translated = (uint8_t *) realloc(worker->translated, len + 1);
+		if (NULL == translated) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc()");
+			return CW_FAILURE;
+		}
+		worker->translated = translated;
+		worker->translated_capacity = len + 1;
+	}
+	size_t n_translated = 0;
+	if (CW_SUCCESS != cw_translate_string(job->string, worker->translated, len, &n_translated)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "string for '%s' contains invalid characters", job->path);
+		return CW_FAILURE;
+	}
+
+	/* Every file starts with the same phase and modulation, also
+	   after failed job. */
+	gen->render.has_tone = false;
+	gen->phase_offset = worker->batch->template_gen->phase_offset;
+	gen->phase_acc = worker->batch->template_gen->phase_acc;
+	gen->modulation = worker->batch->template_gen->modulation;
+
+	const uint8_t * translated = worker->translated;
+	size_t n_samples = 0;
+	size_t start = 0;
+	while (start < n_translated) {
+		size_t end = start;
+		while (end < n_translated && CW_TRANSLATED_SPACE != translated[end]) {
+			end++;
+		}
+		while (end < n_translated && CW_TRANSLATED_SPACE == translated[end]) {
+			end++;
+		}
+		if (CW_SUCCESS != cw_gen_enqueue_translated_string(gen, translated + start, end - start)) {
+			cw_tq_flush_internal(gen->tq);
+			return CW_FAILURE;
+		}
+
+		const int n_max = cw_gen_render_n_samples_max_internal(gen);
+		if (CW_SUCCESS != cw_batch_buffer_reserve_internal(buffer, CW_FILE_WAV_HEADER_SIZE + sizeof (cw_sample_t) * (n_samples + (size_t) n_max))) {
+			cw_tq_flush_internal(gen->tq);
+			return CW_FAILURE;
+		}
+		cw_sample_t * samples = (cw_sample_t *) (buffer->data + CW_FILE_WAV_HEADER_SIZE);
+		const int n = cw_gen_render_internal(gen, samples + n_samples, n_max);
+		if (n < 0 || n == n_max) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to render word of '%s'", job->path);
+			cw_tq_flush_internal(gen->tq);
+			return CW_FAILURE;
+		}
+		n_samples += (size_t) n;
+		start = end;
+	}
+
+	const size_t n_data_bytes = sizeof (cw_sample_t) * n_samples;
+	if (n_data_bytes > UINT32_MAX - CW_FILE_WAV_HEADER_SIZE) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s' is too long for WAV file", job->path);
+		return CW_FAILURE;
+	}
+	if (CW_SUCCESS != cw_batch_buffer_reserve_internal(buffer, CW_FILE_WAV_HEADER_SIZE)) {
+		return CW_FAILURE;
+	}
+	if (!cw_file_host_is_little_endian_internal()) {
+		cw_sample_t * samples = (cw_sample_t *) (buffer->data + CW_FILE_WAV_HEADER_SIZE);
+		for (size_t i = 0; i < n_samples; i++) {
+			const uint16_t s = (uint16_t) samples[i];
+			samples[i] = (cw_sample_t) (uint16_t) ((s << 8) | (s >> 8));
+		}
+	}
+	cw_file_fill_wav_header_internal(buffer->data, (uint32_t) gen->sample_rate, (uint32_t) n_data_bytes);
+	buffer->n_bytes = CW_FILE_WAV_HEADER_SIZE + n_data_bytes;
+	buffer->n_written = 0;
+
+	buffer->fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (-1 == buffer->fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to open file '%s': '%s'", job->path, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Make sure that buffer can hold given count of bytes
+
+   Buffer grows at least twice, so that files of similar sizes stop
+   causing reallocations after a few jobs.
+
+   @param[in,out] buffer buffer
+   @param[in] n_bytes required capacity of buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_batch_buffer_reserve_internal(cw_batch_buffer_t * buffer, size_t n_bytes)
+{
+	if (n_bytes <= buffer->capacity) {
+		return CW_SUCCESS;
+	}
+	const size_t capacity = n_bytes > 2 * buffer->capacity ? n_bytes : 2 * buffer->capacity;
+	uint8_t * data = (uint8_t *) realloc(buffer->data, capacity);
+	if (NULL == data) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to allocate buffer of %zu bytes", capacity);
+		return CW_FAILURE;
+	}
+	buffer->data = data;
+	buffer->capacity = capacity;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close file of buffer, and return the buffer to pool
+
+   @param[in,out] batch batch
+   @param[in,out] buffer buffer of finished job
+   @param[in] success whether the job has been rendered and written
+*/
+static void cw_batch_finish_buffer_internal(cw_batch_t * batch, cw_batch_buffer_t * buffer, bool success)
+{
+	if (-1 != buffer->fd) {
+		if (0 != close(buffer->fd)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "close(): '%s'", strerror(errno));
+			success = false;
+		}
+		buffer->fd = -1;
+	}
+
+	pthread_mutex_lock(&batch->mutex);
+	buffer->next = batch->free_buffers;
+	batch->free_buffers = buffer;
+	batch->n_done++;
+	if (!success) {
+		batch->n_failed++;
+	}
+	pthread_cond_signal(&batch->buffer_available);
+	if (batch->n_done == batch->n_added) {
+		pthread_cond_broadcast(&batch->all_done);
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread function of writing thread using write()
+
+   @param[in] arg batch (cw_batch_t *)
+
+   @return NULL
+*/
+static void * cw_batch_writer_thread_internal(void * arg)
+{
+	cw_batch_t * batch = (cw_batch_t *) arg;
+
+	while (true) {
+		pthread_mutex_lock(&batch->mutex);
+		while (batch->do_write && NULL == batch->writes_head) {
+			pthread_cond_wait(&batch->write_available, &batch->mutex);
+		}
+		cw_batch_buffer_t * buffer = batch->writes_head;
+		if (NULL != buffer) {
+			batch->writes_head = buffer->next;
+			if (NULL == batch->writes_head) {
+				batch->writes_tail = NULL;
+			}
+		}
+		pthread_mutex_unlock(&batch->mutex);
+
+		if (NULL == buffer) {
+			/* Queue is empty and batch is being deleted. */
+			break;
+		}
+
+		const cw_ret_t cwret = cw_file_write_internal(buffer->fd, buffer->data, buffer->n_bytes);
+		if (CW_SUCCESS != cwret) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write(): '%s'", strerror(errno));
+		}
+		cw_batch_finish_buffer_internal(batch, buffer, CW_SUCCESS == cwret);
+	}
+
+	return NULL;
+}
+
+
+
+
+#ifdef CW_BATCH_WITH_IO_URING
+
+
+
+
+/**
+   @brief Thread function of writing thread using io_uring
+
+   The thread moves buffers from batch's queue to submission queue of
+   io_uring, and handles completions: short writes are submitted
+   again with remaining bytes, complete files are closed.
+
+   @param[in] arg batch (cw_batch_t *)
+
+   @return NULL
+*/
+static void * cw_batch_uring_thread_internal(void * arg)
+{
+	cw_batch_t * batch = (cw_batch_t *) arg;
+	cw_batch_uring_t * uring = &batch->uring;
+
+	unsigned int n_in_flight = 0;   /* Writes in submission queue or in kernel. */
+	unsigned int n_to_submit = 0;   /* Writes in submission queue, not yet taken by kernel. */
+
+	while (true) {
+		pthread_mutex_lock(&batch->mutex);
+		while (batch->do_write && NULL == batch->writes_head && 0 == n_in_flight) {
+			pthread_cond_wait(&batch->write_available, &batch->mutex);
+		}
+		if (NULL == batch->writes_head && 0 == n_in_flight) {
+			/* Queue is empty and batch is being deleted. */
+			pthread_mutex_unlock(&batch->mutex);
+			break;
+		}
+		while (NULL != batch->writes_head && n_in_flight < uring->sq_n_entries) {
+			cw_batch_buffer_t * buffer = batch->writes_head;
+			batch->writes_head = buffer->next;
+			if (NULL == batch->writes_head) {
+				batch->writes_tail = NULL;
+			}
+			cw_batch_uring_queue_write_internal(uring, buffer);
+			n_in_flight++;
+			n_to_submit++;
+		}
+		pthread_mutex_unlock(&batch->mutex);
+
+		/* Wait for completions only when there is nothing new to
+		   submit. New buffers that arrive in the meantime are
+		   picked up after next completion. */
+		const unsigned int min_complete = 0 == n_to_submit ? 1 : 0;
+		const long rv = syscall(__NR_io_uring_enter, uring->fd, n_to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rv < 0) {
+			if (EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "io_uring_enter(): '%s'", strerror(errno));
+				usleep(1000);
+			}
+		} else {
+			n_to_submit -= (unsigned int) rv;
+		}
+
+		unsigned int head = *uring->cq_head;
+		const unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			const struct io_uring_cqe * cqe = &((struct io_uring_cqe *) uring->cqes)[head & *uring->cq_mask];
+			cw_batch_buffer_t * buffer = (cw_batch_buffer_t *) (uintptr_t) cqe->user_data;
+			const int res = cqe->res;
+			head++;
+			n_in_flight--;
+
+			if (-EINTR == res || -EAGAIN == res) {
+				cw_batch_uring_queue_write_internal(uring, buffer);
+				n_in_flight++;
+				n_to_submit++;
+			} else if (res <= 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "write with io_uring: '%s'", 0 == res ? "no space" : strerror(-res));
+				cw_batch_finish_buffer_internal(batch, buffer, false);
+			} else {
+				buffer->n_written += (size_t) res;
+				if (buffer->n_written < buffer->n_bytes) {
+					cw_batch_uring_queue_write_internal(uring, buffer);
+					n_in_flight++;
+					n_to_submit++;
+				} else {
+					cw_batch_finish_buffer_internal(batch, buffer, true);
+				}
+			}
+		}
+		__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Put write of remaining bytes of buffer in submission queue
+
+   Caller must make sure that there is a free entry in the queue.
+
+   @param[in,out] uring io_uring
+   @param[in,out] buffer buffer to write
+*/
+static void cw_batch_uring_queue_write_internal(cw_batch_uring_t * uring, cw_batch_buffer_t * buffer)
+{
+	buffer->iov.iov_base = buffer->data + buffer->n_written;
+	buffer->iov.iov_len = buffer->n_bytes - buffer->n_written;
+
+	const unsigned int tail = *uring->sq_tail;
+	const unsigned int index = tail & *uring->sq_mask;
+	struct io_uring_sqe * sqe = &((struct io_uring_sqe *) uring->sqes)[index];
+	memset(sqe, 0, sizeof (struct io_uring_sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = buffer->fd;
+	sqe->addr = (uint64_t) (uintptr_t) &buffer->iov;
+	sqe->len = 1;
+	sqe->off = (uint64_t) buffer->n_written;
+	sqe->user_data = (uint64_t) (uintptr_t) buffer;
+	uring->sq_array[index] = index;
+
+	/* Kernel reads the entry after it sees new tail. */
+	__atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+#endif /* #ifdef CW_BATCH_WITH_IO_URING */
+
+
+
+
+/**
+   @brief Set up io_uring and map its queues
+
+   @param[out] uring io_uring to set up
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if io_uring is not available
+*/
+static cw_ret_t cw_batch_uring_open_internal(cw_batch_uring_t * uring)
+{
+#ifdef CW_BATCH_WITH_IO_URING
+	struct io_uring_params params;
+	memset(&params, 0, sizeof (params));
+	const long fd = syscall(__NR_io_uring_setup, CW_BATCH_URING_N_ENTRIES, &params);
+	if (fd < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_INFO,
+			      MSG_PREFIX "io_uring is not available: '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+	uring->fd = (int) fd;
+
+	uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+	uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+	const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		if (uring->cq_ring_size > uring->sq_ring_size) {
+			uring->sq_ring_size = uring->cq_ring_size;
+		}
+		uring->cq_ring_size = uring->sq_ring_size;
+	}
+
+	uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (MAP_FAILED == uring->sq_ring) {
+		uring->sq_ring = NULL;
+	} else if (single_mmap) {
+		uring->cq_ring = uring->sq_ring;
+	} else {
+		uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+		if (MAP_FAILED == uring->cq_ring) {
+			uring->cq_ring = NULL;
+		}
+	}
+	uring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+	if (MAP_FAILED == uring->sqes) {
+		uring->sqes = NULL;
+	}
+	if (NULL == uring->sq_ring || NULL == uring->cq_ring || NULL == uring->sqes) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to map queues of io_uring: '%s'", strerror(errno));
+		cw_batch_uring_close_internal(uring);
+		return CW_FAILURE;
+	}
+
+	uint8_t * sq = (uint8_t *) uring->sq_ring;
+	uint8_t * cq = (uint8_t *) uring->cq_ring;
+	uring->sq_n_entries = params.sq_entries;
+	uring->sq_head = (unsigned int *) (sq + params.sq_off.head);
+	uring->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+	uring->sq_mask = (unsigned int *) (sq + params.sq_off.ring_mask);
+	uring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+	uring->cq_head = (unsigned int *) (cq + params.cq_off.head);
+	uring->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+	uring->cq_mask = (unsigned int *) (cq + params.cq_off.ring_mask);
+	uring->cqes = cq + params.cq_off.cqes;
+
+	return CW_SUCCESS;
+#else
+	(void) uring;
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_INFO,
+		      MSG_PREFIX "io_uring is not supported by this build");
+	return CW_FAILURE;
+#endif
+}
+
+
+
+
+/**
+   @brief Unmap queues of io_uring, and close it
+
+   @param[in,out] uring io_uring to close
+*/
+static void cw_batch_uring_close_internal(cw_batch_uring_t * uring)
+{
+	if (NULL != uring->sqes) {
+		munmap(uring->sqes, uring->sqes_size);
+		uring->sqes = NULL;
+	}
+	if (NULL != uring->cq_ring && uring->cq_ring != uring->sq_ring) {
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	}
+	uring->cq_ring = NULL;
+	if (NULL != uring->sq_ring) {
+		munmap(uring->sq_ring, uring->sq_ring_size);
+		uring->sq_ring = NULL;
+	}
+	if (-1 != uring->fd) {
+		close(uring->fd);
+		uring->fd = -1;
+	}
+
+	return;
+}
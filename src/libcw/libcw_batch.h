@@ -0,0 +1,176 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_BATCH
+#define H_LIBCW_BATCH
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+/* Maximal count of threads rendering files of one batch. */
+#define CW_BATCH_N_WORKERS_MAX 64
+
+/* Count of threads writing files when io_uring is not available. */
+#define CW_BATCH_N_WRITERS 4
+
+/* Count of buffers of samples per rendering thread. A thread can
+   render next file while previous files are being written. */
+#define CW_BATCH_N_BUFFERS_PER_WORKER 2
+
+/* Count of entries in io_uring's submission queue: maximal count of
+   writes in progress. */
+#define CW_BATCH_URING_N_ENTRIES 64
+
+
+
+
+/* Request to render a string into a file. */
+typedef struct cw_batch_job_struct {
+	struct cw_batch_job_struct * next;
+	char * string;
+	char * path;
+} cw_batch_job_t;
+
+
+
+
+/* Buffer with contents of one file: WAV header and samples. Buffers
+   are allocated once and reused; a buffer is reallocated only when a
+   file doesn't fit in it. */
+typedef struct cw_batch_buffer_struct {
+	/* Next buffer in list of free buffers, or in queue of buffers
+	   to write. */
+	struct cw_batch_buffer_struct * next;
+
+	uint8_t * data;
+	size_t capacity;     /* [bytes] */
+
+	int fd;              /* File to which the buffer is written. */
+	size_t n_bytes;      /* Count of bytes to write. */
+	size_t n_written;    /* Count of bytes already written. */
+	struct iovec iov;    /* Remaining bytes, used by io_uring. */
+} cw_batch_buffer_t;
+
+
+
+
+/* Thread rendering files. */
+typedef struct {
+	cw_batch_t * batch;
+
+	/* Generator with parameters of batch's generator, used for all
+	   files rendered by the thread. */
+	cw_gen_t * gen;
+
+	/* Translated characters of string of current job. */
+	uint8_t * translated;
+	size_t translated_capacity;
+
+	pthread_t thread_id;
+} cw_batch_worker_t;
+
+
+
+
+/* Submission and completion queues of io_uring, mapped from kernel. */
+typedef struct {
+	int fd;
+
+	unsigned int sq_n_entries;
+	unsigned int * sq_head;
+	unsigned int * sq_tail;
+	unsigned int * sq_mask;
+	unsigned int * sq_array;
+	unsigned int * cq_head;
+	unsigned int * cq_tail;
+	unsigned int * cq_mask;
+	void * sqes;                /* struct io_uring_sqe[sq_n_entries] */
+	void * cqes;                /* struct io_uring_cqe[] */
+
+	void * sq_ring;
+	size_t sq_ring_size;
+	void * cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+} cw_batch_uring_t;
+
+
+
+
+struct cw_batch_struct {
+	/* Copy of generator passed to cw_batch_new(). Every file starts
+	   with phase and modulation of this generator. It is not used for
+	   rendering. */
+	cw_gen_t * template_gen;
+
+	cw_batch_worker_t workers[CW_BATCH_N_WORKERS_MAX];
+	int n_workers;
+
+	cw_batch_buffer_t * buffers;
+	int n_buffers;
+
+	/* Threads writing buffers: one thread submitting writes to
+	   io_uring, or CW_BATCH_N_WRITERS threads calling write(). */
+	bool use_io_uring;
+	cw_batch_uring_t uring;
+	pthread_t writer_ids[CW_BATCH_N_WRITERS];
+	int n_writers;
+
+	/* All fields below are protected by ::mutex. */
+	pthread_mutex_t mutex;
+
+	/* Queue of jobs waiting for rendering thread. */
+	cw_batch_job_t * jobs_head;
+	cw_batch_job_t * jobs_tail;
+	pthread_cond_t job_available;
+
+	/* Buffers that can be used by rendering threads. */
+	cw_batch_buffer_t * free_buffers;
+	pthread_cond_t buffer_available;
+
+	/* Queue of rendered buffers waiting for writer. */
+	cw_batch_buffer_t * writes_head;
+	cw_batch_buffer_t * writes_tail;
+	pthread_cond_t write_available;
+
+	/* Counts of jobs, and count of failed jobs already reported by
+	   cw_batch_wait(). */
+	unsigned int n_added;
+	unsigned int n_done;
+	unsigned int n_failed;
+	unsigned int n_failed_reported;
+	pthread_cond_t all_done;
+
+	/* Set to false to ask rendering threads / writing threads to
+	   return. */
+	bool do_render;
+	bool do_write;
+};
+
+
+
+
+/* Exposed to unit tests. */
+cw_batch_t * cw_batch_new_internal(cw_gen_t * gen, int n_workers, bool try_io_uring);
+
+
+
+
+#endif /* #ifndef H_LIBCW_BATCH */
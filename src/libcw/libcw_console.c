@@ -117,6 +117,7 @@ static cw_ret_t cw_console_write_with_spkrtone_internal(cw_gen_t * gen, const cw
 #else
 static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const cw_tone_t * tone);
 static cw_ret_t cw_console_kiocsound_wrapper_internal(cw_gen_t * gen, cw_key_value_t cw_value);
+static void cw_console_wait_for_end_of_tone_internal(cw_gen_t * gen, const cw_tone_t * tone);
 #endif
 
 
@@ -236,6 +237,10 @@ static cw_ret_t cw_console_open_and_configure_sound_device_internal(cw_gen_t * g
 	   on non-zero value of sample rate. */
 	gen->sample_rate = 44100;
 
+	gen->console.use_timeline = gen_conf->console_timeline;
+	gen->console.timeline.tv_sec = 0;
+	gen->console.timeline.tv_nsec = 0;
+
 	gen->sound_device_is_open = true;
 
 	return CW_SUCCESS;
@@ -405,7 +410,7 @@ static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const c
 
 	if (cw_value == gen->console.cw_value) {
 		/* Simulate blocking write() and let buzzer keep doing what it is doing. */
-		cw_usleep_internal(tone->duration);
+		cw_console_wait_for_end_of_tone_internal(gen, tone);
 		return CW_SUCCESS;
 	} else {
 		gen->console.cw_value = cw_value;
@@ -413,7 +418,7 @@ static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const c
 
 	const int rv = cw_console_kiocsound_wrapper_internal(gen, gen->console.cw_value);
 	/* Simulate blocking write() because cw_console_kiocsound_wrapper_internal() is not blocking. */
-	cw_usleep_internal(tone->duration);
+	cw_console_wait_for_end_of_tone_internal(gen, tone);
 
 	cw_ret_t cwret = CW_SUCCESS;
 	switch (tone->slope_mode) {
@@ -448,6 +453,28 @@ static cw_ret_t cw_console_write_with_kiocsound_internal(cw_gen_t * gen, const c
 
 
 
+/**
+   @brief Wait until end of tone played on console buzzer
+
+   With cw_gen_config_t::console_timeline the end of tone is a point on
+   absolute timeline, calculated from end of previous tone. Otherwise
+   the function just sleeps for duration of the tone.
+
+   @param[in] gen generator
+   @param[in] tone tone being played
+*/
+static void cw_console_wait_for_end_of_tone_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (gen->console.use_timeline) {
+		cw_sleep_on_timeline_internal(&gen->console.timeline, tone->duration);
+	} else {
+		cw_usleep_internal(tone->duration);
+	}
+}
+
+
+
+
 /**
    @brief Wrapper for KIOCSOUND ioctl
 
@@ -9,6 +9,12 @@
 
 
 
+#include <stdbool.h>
+#include <time.h>
+
+
+
+
 #include "libcw2.h"
 
 
@@ -17,6 +23,12 @@
 typedef struct {
 	int sound_sink_fd;
 	cw_key_value_t cw_value;
+
+	/* Tones are timed against absolute timeline instead of
+	   sleeping for duration of each tone. */
+	bool use_timeline;
+	/* End of most recent tone on CLOCK_MONOTONIC clock. */
+	struct timespec timeline;
 } cw_console_data_t;
 
 
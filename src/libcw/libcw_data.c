@@ -38,6 +38,11 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h> /* UCHAR_MAX */
@@ -67,7 +72,6 @@ extern cw_debug_t cw_debug_object_dev;
 
 
 
-static __attribute__((constructor)) void cw_data_constructor_internal(void);
 
 
 
@@ -80,9 +84,6 @@ static __attribute__((constructor)) void cw_data_constructor_internal(void);
 
   Notice that ASCII characters are stored as uppercase characters.
 */
-static size_t g_main_table_maximum_representation_length;
-static int g_main_table_characters_count;
-static const cw_entry_t * g_main_table_fast_lookup[UCHAR_MAX];  /* Fast lookup table */
 const cw_entry_t CW_TABLE[] = { /* TODO: make it accessible through function only, and add static keyword. */
 	/* ASCII 7bit letters */
 	{'A', ".-"  },  {'B', "-..."},  {'C', "-.-."},
@@ -134,6 +135,57 @@ const cw_entry_t CW_TABLE[] = { /* TODO: make it accessible through function onl
 	{0, NULL} /* Guard. */
 };
 
+/* Tables and values below are derived from CW_TABLE at build time,
+   so there is no work to be done when the library is loaded or on
+   first lookup. Keep them in sync with CW_TABLE when modifying it;
+   test_data_precomputed_tables() verifies them. */
+
+static const int g_main_table_characters_count = (int) (sizeof (CW_TABLE) / sizeof (CW_TABLE[0])) - 1; /* Without guard. */
+static const size_t g_main_table_maximum_representation_length = 7;
+
+/* Fast lookup table: character -> table entry. */
+static const cw_entry_t * const g_main_table_fast_lookup[UCHAR_MAX + 1] = {
+	['A'] = &CW_TABLE[0], ['B'] = &CW_TABLE[1], ['C'] = &CW_TABLE[2], ['D'] = &CW_TABLE[3],
+	['E'] = &CW_TABLE[4], ['F'] = &CW_TABLE[5], ['G'] = &CW_TABLE[6], ['H'] = &CW_TABLE[7],
+	['I'] = &CW_TABLE[8], ['J'] = &CW_TABLE[9], ['K'] = &CW_TABLE[10], ['L'] = &CW_TABLE[11],
+	['M'] = &CW_TABLE[12], ['N'] = &CW_TABLE[13], ['O'] = &CW_TABLE[14], ['P'] = &CW_TABLE[15],
+	['Q'] = &CW_TABLE[16], ['R'] = &CW_TABLE[17], ['S'] = &CW_TABLE[18], ['T'] = &CW_TABLE[19],
+	['U'] = &CW_TABLE[20], ['V'] = &CW_TABLE[21], ['W'] = &CW_TABLE[22], ['X'] = &CW_TABLE[23],
+	['Y'] = &CW_TABLE[24], ['Z'] = &CW_TABLE[25], ['0'] = &CW_TABLE[26], ['1'] = &CW_TABLE[27],
+	['2'] = &CW_TABLE[28], ['3'] = &CW_TABLE[29], ['4'] = &CW_TABLE[30], ['5'] = &CW_TABLE[31],
+	['6'] = &CW_TABLE[32], ['7'] = &CW_TABLE[33], ['8'] = &CW_TABLE[34], ['9'] = &CW_TABLE[35],
+	['"'] = &CW_TABLE[36], ['\''] = &CW_TABLE[37], ['$'] = &CW_TABLE[38], ['('] = &CW_TABLE[39],
+	[')'] = &CW_TABLE[40], ['+'] = &CW_TABLE[41], [','] = &CW_TABLE[42], ['-'] = &CW_TABLE[43],
+	['.'] = &CW_TABLE[44], ['/'] = &CW_TABLE[45], [':'] = &CW_TABLE[46], [';'] = &CW_TABLE[47],
+	['='] = &CW_TABLE[48], ['?'] = &CW_TABLE[49], ['_'] = &CW_TABLE[50], ['@'] = &CW_TABLE[51],
+	[(unsigned char) '\334'] = &CW_TABLE[52], [(unsigned char) '\304'] = &CW_TABLE[53], [(unsigned char) '\307'] = &CW_TABLE[54], [(unsigned char) '\326'] = &CW_TABLE[55],
+	[(unsigned char) '\311'] = &CW_TABLE[56], [(unsigned char) '\310'] = &CW_TABLE[57], [(unsigned char) '\300'] = &CW_TABLE[58], [(unsigned char) '\321'] = &CW_TABLE[59],
+	[(unsigned char) '\252'] = &CW_TABLE[60], [(unsigned char) '\256'] = &CW_TABLE[61], ['<'] = &CW_TABLE[62], ['>'] = &CW_TABLE[63],
+	['!'] = &CW_TABLE[64], ['&'] = &CW_TABLE[65], ['^'] = &CW_TABLE[66], ['~'] = &CW_TABLE[67],
+};
+
+/* Fast lookup table: hash of representation (see
+   cw_representation_to_hash_internal()) -> table entry. */
+static const cw_entry_t * const g_r2c_hash_table[CW_DATA_MAX_REPRESENTATION_HASH + 1] = {
+	[0x02] = &CW_TABLE[4], [0x03] = &CW_TABLE[19], [0x04] = &CW_TABLE[8], [0x05] = &CW_TABLE[0],
+	[0x06] = &CW_TABLE[13], [0x07] = &CW_TABLE[12], [0x08] = &CW_TABLE[18], [0x09] = &CW_TABLE[20],
+	[0x0a] = &CW_TABLE[17], [0x0b] = &CW_TABLE[22], [0x0c] = &CW_TABLE[3], [0x0d] = &CW_TABLE[10],
+	[0x0e] = &CW_TABLE[6], [0x0f] = &CW_TABLE[14], [0x10] = &CW_TABLE[7], [0x11] = &CW_TABLE[21],
+	[0x12] = &CW_TABLE[5], [0x13] = &CW_TABLE[52], [0x14] = &CW_TABLE[11], [0x15] = &CW_TABLE[53],
+	[0x16] = &CW_TABLE[15], [0x17] = &CW_TABLE[9], [0x18] = &CW_TABLE[1], [0x19] = &CW_TABLE[23],
+	[0x1a] = &CW_TABLE[2], [0x1b] = &CW_TABLE[24], [0x1c] = &CW_TABLE[25], [0x1d] = &CW_TABLE[16],
+	[0x1e] = &CW_TABLE[55], [0x1f] = &CW_TABLE[60], [0x20] = &CW_TABLE[31], [0x21] = &CW_TABLE[30],
+	[0x22] = &CW_TABLE[64], [0x23] = &CW_TABLE[29], [0x24] = &CW_TABLE[56], [0x27] = &CW_TABLE[28],
+	[0x28] = &CW_TABLE[65], [0x29] = &CW_TABLE[57], [0x2a] = &CW_TABLE[41], [0x2d] = &CW_TABLE[58],
+	[0x2f] = &CW_TABLE[27], [0x30] = &CW_TABLE[32], [0x31] = &CW_TABLE[48], [0x32] = &CW_TABLE[45],
+	[0x34] = &CW_TABLE[54], [0x35] = &CW_TABLE[66], [0x36] = &CW_TABLE[39], [0x38] = &CW_TABLE[33],
+	[0x39] = &CW_TABLE[61], [0x3b] = &CW_TABLE[59], [0x3c] = &CW_TABLE[34], [0x3e] = &CW_TABLE[35],
+	[0x3f] = &CW_TABLE[26], [0x45] = &CW_TABLE[62], [0x4c] = &CW_TABLE[49], [0x4d] = &CW_TABLE[50],
+	[0x52] = &CW_TABLE[36], [0x54] = &CW_TABLE[67], [0x55] = &CW_TABLE[44], [0x5a] = &CW_TABLE[51],
+	[0x5e] = &CW_TABLE[37], [0x61] = &CW_TABLE[43], [0x6a] = &CW_TABLE[47], [0x6d] = &CW_TABLE[40],
+	[0x73] = &CW_TABLE[42], [0x78] = &CW_TABLE[46], [0x89] = &CW_TABLE[38], [0xc5] = &CW_TABLE[63],
+};
+
 
 
 
@@ -157,14 +209,6 @@ const cw_entry_t CW_TABLE[] = { /* TODO: make it accessible through function onl
 */
 int cw_get_character_count(void)
 {
-#if 0   /* Disabled on 2020-07-25. Moved to library constructor. */
-	static int g_main_table_characters_count = 0;
-	if (0 == g_main_table_characters_count) {
-		for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-			g_main_table_characters_count++;
-		}
-	}
-#endif
 	return g_main_table_characters_count;
 }
 
@@ -230,18 +274,6 @@ void cw_list_characters(char * list)
 */
 int cw_get_maximum_representation_length(void)
 {
-#if 0   /* Disabled on 2020-07-25. Code moved to library constructor. */
-	static size_t g_main_table_maximum_representation_length = 0;
-	if (0 == g_main_table_maximum_representation_length) {
-		/* Traverse the main lookup table, finding the longest representation. */
-		for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-			size_t length = strlen(cw_entry->representation);
-			if (length > g_main_table_maximum_representation_length) {
-				g_main_table_maximum_representation_length = length;
-			}
-		}
-	}
-#endif
 	return (int) g_main_table_maximum_representation_length;
 }
 
@@ -269,23 +301,6 @@ int cw_get_maximum_representation_length(void)
 */
 const char * cw_character_to_representation_internal(int character)
 {
-#if 0   /* Disabled on 2020-07-25. Moved to library constructor. */
-	static const cw_entry_t * g_main_table_fast_lookup[UCHAR_MAX];  /* Fast lookup table */
-	static bool is_initialized = false;
-	/* If this is the first call, set up the fast lookup table to give
-	   direct access to the CW table for a given character. */
-	if (!is_initialized) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-			      MSG_PREFIX "initializing fast lookup table");
-
-		for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-			g_main_table_fast_lookup[(unsigned char) cw_entry->character] = cw_entry;
-		}
-
-		is_initialized = true;
-	}
-#endif
-
 	/* There is no differentiation in the lookup and
 	   representation table between upper and lower case
 	   characters; everything is held as uppercase.  So before we
@@ -373,6 +388,9 @@ int cw_lookup_character(char character, char * representation)
    On success return representation of a given character.
    Returned pointer is owned by caller of the function.
 
+   cw_character_get_representation() returns the same representation
+   without making a copy of it.
+
    On failure function returns NULL and sets errno.
 
    @exception ENOENT the character could not be found.
@@ -409,6 +427,39 @@ char * cw_character_to_representation(int character)
 
 
 
+const char * cw_character_get_representation(int character)
+{
+	const char * representation = cw_character_to_representation_internal(character);
+	if (NULL == representation) {
+		errno = ENOENT;
+	}
+	return representation;
+}
+
+
+
+
+cw_ret_t cw_character_get_packed_representation(int character, unsigned int * n_marks, unsigned int * bits)
+{
+	const char * representation = cw_character_to_representation_internal(character);
+	if (NULL == representation) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	/* Representations in main table are valid, so the hash is
+	   never zero. */
+	const unsigned int length = (unsigned int) strlen(representation);
+	const unsigned int hash = cw_representation_to_hash_internal(representation);
+	*n_marks = length;
+	*bits = hash & ~(1U << length); /* Without start bit. */
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Return a hash value of a character representation
 
@@ -511,65 +562,15 @@ unsigned int cw_representation_to_hash_internal(const char * representation)
 */
 int cw_representation_to_character_internal(const char * representation)
 {
-	static const cw_entry_t * lookup[UCHAR_MAX];  /* Fast lookup table */
-	static bool is_complete = true;               /* Set to false if there are any
-							 lookup table entries not in
-							 the fast lookup table */
-	static bool is_initialized = false;
-
-	/* If this is the first call, set up the fast lookup table to give direct
-	   access to the CW table for a hashed representation. */
-	if (!is_initialized) {
-		/* TODO: move the initialization to cw_data_constructor_internal(). */
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-			      MSG_PREFIX "initialize hash lookup table");
-		is_complete = CW_SUCCESS == cw_data_init_r2c_hash_table_internal(lookup);
-		is_initialized = true;
-	}
-
 	/* Hash the representation to get an index for the fast lookup. */
 	/* TODO: shouldn't this be uint8_t? */
 	unsigned int hash = cw_representation_to_hash_internal(representation);
 
-	const cw_entry_t * cw_entry = NULL;
-	/* If the hashed lookup table is complete, we can simply believe any
-	   hash value that came back.  That is, we just use what is at the index
-	   "hash", since this is either the entry we want, or NULL. */
-	if (is_complete) {
-		cw_entry = lookup[hash];
-	} else {
-		/* Impossible, since test_cw_representation_to_hash_internal()
-		   passes without problems for all valid representations.
-
-		   Debug message is already displayed in
-		   cw_data_init_r2c_hash_table_internal(). */
-
-		/* The lookup table is incomplete, but it doesn't have
-		   to be that we are missing entry for this particular
-		   hash.
-
-		   Try to find the entry in lookup table anyway, maybe
-		   it exists.
-
-		   TODO: create tests to find situation where lookup
-		   table is incomplete. */
-		if (hash && lookup[hash] && lookup[hash]->representation
-		    && strcmp(lookup[hash]->representation, representation) == 0) {
-			/* Found it in an incomplete table. */
-			cw_entry = lookup[hash];
-		} else {
-			/* We have no choice but to search the table entry
-			   by entry, sequentially, from top to bottom. */
-			for (cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-				if (0 == strcmp(cw_entry->representation, representation)) {
-					break;
-				}
-			}
-
-			/* If we got to the end of the table, prepare to return zero. */
-			cw_entry = cw_entry->character ? cw_entry : NULL;
-		}
-	}
+	/* Hash table is complete, so we can simply believe any hash value
+	   that came back.  That is, we just use what is at the index
+	   "hash", since this is either the entry we want, or NULL (also
+	   for invalid representation with zero hash). */
+	const cw_entry_t * cw_entry = g_r2c_hash_table[hash];
 
 
 	/* Lookups code may be called frequently, so first do a rough
@@ -593,6 +594,35 @@ int cw_representation_to_character_internal(const char * representation)
 
 
 
+/**
+   @brief Return character corresponding to given hash of representation
+
+   Look up a character by hash of its representation, as returned by
+   cw_representation_to_hash_internal(). Receiver builds the hash
+   directly from received Marks, so it can skip building and
+   re-parsing a representation string.
+
+   @internal
+   @reviewed 2020-07-26
+   @endinternal
+
+   @param[in] hash hash of representation of a character to look up
+
+   @return zero if there is no character for given hash
+   @return non-zero character corresponding to given hash otherwise
+*/
+int cw_representation_hash_to_character_internal(unsigned int hash)
+{
+	if (hash < CW_DATA_MIN_REPRESENTATION_HASH || hash > CW_DATA_MAX_REPRESENTATION_HASH) {
+		return 0;
+	}
+
+	return g_r2c_hash_table[hash] ? g_r2c_hash_table[hash]->character : 0;
+}
+
+
+
+
 /**
    @brief Return character corresponding to given representation
 
@@ -650,6 +680,9 @@ int cw_representation_to_character_direct_internal(const char * representation)
    @p table must be large enough to store all entries, caller must
    make sure that the condition is met.
 
+   Library itself uses lookup table precomputed at build time. The
+   function is used by tests to verify the precomputed table.
+
    On failure function returns CW_FAILURE.
    On success the function returns CW_SUCCESS. Successful execution of
    the function is when all representations from CW_TABLE have valid
@@ -906,8 +939,6 @@ typedef struct {
 
 
 
-static int g_prosign_table_characters_count;
-static size_t g_prosign_table_maximum_expansion_length;
 static const cw_prosign_entry_t g_prosign_table[] = {
 	/* Standard procedural signals */
 	{ '"', false, "AF"  },   { '\'', false,  "WG"  },  { '$', false, "SX"  },
@@ -928,7 +959,18 @@ static const cw_prosign_entry_t g_prosign_table[] = {
 	{  0,  false,  NULL } /* Guard. */
 };
 
-static const cw_prosign_entry_t * g_prosign_table_fast_lookup[UCHAR_MAX];  /* Fast lookup table. */
+/* Derived from g_prosign_table at build time, see comment above
+   g_main_table_fast_lookup. */
+static const int g_prosign_table_characters_count = (int) (sizeof (g_prosign_table) / sizeof (g_prosign_table[0])) - 1; /* Without guard. */
+static const size_t g_prosign_table_maximum_expansion_length = 3;
+static const cw_prosign_entry_t * const g_prosign_table_fast_lookup[UCHAR_MAX + 1] = {
+	['"'] = &g_prosign_table[0], ['\''] = &g_prosign_table[1], ['$'] = &g_prosign_table[2], ['('] = &g_prosign_table[3],
+	[')'] = &g_prosign_table[4], ['+'] = &g_prosign_table[5], [','] = &g_prosign_table[6], ['-'] = &g_prosign_table[7],
+	['.'] = &g_prosign_table[8], ['/'] = &g_prosign_table[9], [':'] = &g_prosign_table[10], [';'] = &g_prosign_table[11],
+	['='] = &g_prosign_table[12], ['?'] = &g_prosign_table[13], ['_'] = &g_prosign_table[14], ['@'] = &g_prosign_table[15],
+	['<'] = &g_prosign_table[16], ['>'] = &g_prosign_table[17], ['!'] = &g_prosign_table[18], ['&'] = &g_prosign_table[19],
+	['^'] = &g_prosign_table[20], ['~'] = &g_prosign_table[21],
+};
 
 
 
@@ -944,15 +986,6 @@ static const cw_prosign_entry_t * g_prosign_table_fast_lookup[UCHAR_MAX];  /* Fa
 */
 int cw_get_procedural_character_count(void)
 {
-#if 0   /* Disabled on 2020-07-25. Moved to library constructor. */
-	static int g_prosign_table_characters_count = 0;
-	if (0 == g_prosign_table_characters_count) {
-		for (const cw_prosign_entry_t *e = g_prosign_table; e->character; e++) {
-			g_prosign_table_characters_count++;
-		}
-	}
-#endif
-
 	return g_prosign_table_characters_count;
 }
 
@@ -1007,18 +1040,6 @@ void cw_list_procedural_characters(char * list)
 */
 int cw_get_maximum_procedural_expansion_length(void)
 {
-#if 0   /* Disabled on 2020-07-25. Moved to library constructor. */
-	static size_t g_prosign_table_maximum_expansion_length = 0;
-	if (0 == g_prosign_table_maximum_expansion_length) {
-		/* Traverse the prosign table, finding the longest expansion. */
-		for (const cw_prosign_entry_t *e = g_prosign_table; e->character; e++) {
-			size_t length = strlen(e->expansion);
-			if (length > g_prosign_table_maximum_expansion_length) {
-				g_prosign_table_maximum_expansion_length = length;
-			}
-		}
-	}
-#endif
 	return (int) g_prosign_table_maximum_expansion_length;
 }
 
@@ -1047,22 +1068,6 @@ int cw_get_maximum_procedural_expansion_length(void)
 */
 const char * cw_lookup_procedural_character_internal(int character, bool * is_usually_expanded)
 {
-#if 0   /* Disabled on 2020-07-25. Code moved to library constructor. */
-	/* If this is the first call, set up the fast lookup table to
-	   give direct access to the procedural expansions table for
-	   a given character. */
-	static bool is_initialized = false;
-	if (!is_initialized) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-			      MSG_PREFIX "initialize prosign fast lookup table");
-
-		for (const cw_prosign_entry_t *e = g_prosign_table; e->character; e++) {
-			g_prosign_table_fast_lookup[(unsigned char) e->character] = e;
-		}
-		is_initialized = true;
-	}
-#endif
-
 	/* Lookup the procedural signal table entry.  Unknown characters
 	   return NULL.  All procedural signals are non-alphabetical, so no
 	   need to use any uppercase coercion here. */
@@ -1152,6 +1157,23 @@ int cw_lookup_procedural_character(char character, char *expansion, int * is_usu
 
 
 
+const char * cw_character_get_procedural_expansion(int character, bool * is_usually_expanded)
+{
+	bool is_expanded = false;
+	const char * expansion = cw_lookup_procedural_character_internal(character, &is_expanded);
+	if (NULL == expansion) {
+		errno = ENOENT;
+		return NULL;
+	}
+	if (is_usually_expanded) {
+		*is_usually_expanded = is_expanded;
+	}
+	return expansion;
+}
+
+
+
+
 /* ******************************************************************** */
 /*                     Section:Phonetic alphabet                        */
 /* ******************************************************************** */
@@ -1161,7 +1183,6 @@ int cw_lookup_procedural_character(char character, char *expansion, int * is_usu
 
 /* Phonetics table.  Not really CW, but it might be handy to have.
    The table contains ITU/NATO phonetics. */
-static size_t g_phonetics_table_maximum_phonetic_length;
 static const char * const g_phonetics_table[] = {
 	"Alfa",
 	"Bravo",
@@ -1191,6 +1212,7 @@ static const char * const g_phonetics_table[] = {
 	"Zulu",
 	NULL /* guard */
 };
+static const size_t g_phonetics_table_maximum_phonetic_length = 8; /* Derived at build time, see comment above g_main_table_fast_lookup. */
 
 
 
@@ -1206,19 +1228,6 @@ static const char * const g_phonetics_table[] = {
 */
 int cw_get_maximum_phonetic_length(void)
 {
-#if 0   /* Disabled on 2020-07-25. Moved to library constructor. */
-	static size_t g_phonetics_table_maximum_phonetic_length = 0;
-	if (0 == g_phonetics_table_maximum_phonetic_length) {
-		/* Traverse the phonetics table, finding the longest phonetic string. */
-		for (int phonetic = 0; g_phonetics_table[phonetic]; phonetic++) {
-			size_t length = strlen(g_phonetics_table[phonetic]);
-			if (length > g_phonetics_table_maximum_phonetic_length) {
-				g_phonetics_table_maximum_phonetic_length = length;
-			}
-		}
-	}
-#endif
-
 	return (int) g_phonetics_table_maximum_phonetic_length;
 }
 
@@ -1273,6 +1282,19 @@ int cw_lookup_phonetic(char character, char * phonetic)
 
 
 
+const char * cw_character_get_phonetic(int character)
+{
+	character = toupper(character);
+	if (character >= 'A' && character <= 'Z') {
+		return g_phonetics_table[character - 'A'];
+	}
+	errno = ENOENT;
+	return NULL;
+}
+
+
+
+
 /**
    @brief Check if given character is valid
 
@@ -1382,76 +1404,37 @@ int cw_check_string(const char * string)
 
 
 
-// @cond LIBCW_INTERNAL
-
-/**
-   @brief Constructor for 'data' module of libcw
-
-   Since we may have multiple gen/rec/key objects per application, it's
-   better to initialize library's data structures before the multiple objects
-   start calling library functions that have internal static 'is_initialized'
-   flags.
-
-   @internal
-   @reviewed 2020-07-25
-   @endinternal
-*/
-void cw_data_constructor_internal(void)
+cw_ret_t cw_translate_string(const char * string, uint8_t * translated, size_t capacity, size_t * n_translated)
 {
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_INFO,
-		      MSG_PREFIX "constructor for 'data' module started");
-
-
-
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-		      MSG_PREFIX "initializing main fast lookup table");
-	for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
-
-		/* Initialize lookup table for main characters. */
-		g_main_table_fast_lookup[(unsigned char) cw_entry->character] = cw_entry;
-
-		/* Calculate the length of the longest representation in main lookup table. */
-		const size_t length = strlen(cw_entry->representation);
-		if (length > g_main_table_maximum_representation_length) {
-			g_main_table_maximum_representation_length = length;
-		}
-
-		/* Calculate count of characters in main lookup table. */
-		g_main_table_characters_count++;
+	if (NULL == string || NULL == translated || NULL == n_translated) {
+		errno = EINVAL;
+		return CW_FAILURE;
 	}
 
-
-
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_LOOKUPS, CW_DEBUG_INFO,
-		      MSG_PREFIX "initialize prosign fast lookup table");
-	for (const cw_prosign_entry_t * entry = g_prosign_table; entry->character; entry++) {
-
-		/* Initialize lookup table for procedural characters. */
-		g_prosign_table_fast_lookup[(unsigned char) entry->character] = entry;
-
-		/* Calculate the length of the longest expansion of prosign. */
-		const size_t length = strlen(entry->expansion);
-		if (length > g_prosign_table_maximum_expansion_length) {
-		        g_prosign_table_maximum_expansion_length = length;
+	size_t i = 0;
+	for (; string[i] != '\0'; i++) {
+		if (i >= capacity) {
+			*n_translated = i;
+			errno = ENOSPC;
+			return CW_FAILURE;
 		}
 
-		/* Calculate the count of procedural characters. */
-		g_prosign_table_characters_count++;
-	}
-
-
+		if (' ' == string[i]) {
+			translated[i] = CW_TRANSLATED_SPACE;
+			continue;
+		}
 
-	/* Calculate the length of the longest phonetic. */
-	for (int phonetic = 0; g_phonetics_table[phonetic]; phonetic++) {
-		const size_t length = strlen(g_phonetics_table[phonetic]);
-		if (length > g_phonetics_table_maximum_phonetic_length) {
-			g_phonetics_table_maximum_phonetic_length = length;
+		/* The same lookup as in cw_character_to_representation_internal(),
+		   without debug messages. */
+		const cw_entry_t * cw_entry = g_main_table_fast_lookup[(unsigned char) toupper((unsigned char) string[i])];
+		if (NULL == cw_entry) {
+			*n_translated = i;
+			errno = ENOENT;
+			return CW_FAILURE;
 		}
+		translated[i] = (uint8_t) cw_representation_to_hash_internal(cw_entry->representation);
 	}
 
-
-
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_INTERNAL, CW_DEBUG_INFO,
-		      MSG_PREFIX "constructor for 'data' module completed");
+	*n_translated = i;
+	return CW_SUCCESS;
 }
-//@endcond
@@ -43,6 +43,7 @@ typedef struct cw_entry_struct {
    Representation looks like this: ".-" for "a", "--.." for "z", etc. */
 cw_ret_t cw_data_init_r2c_hash_table_internal(const cw_entry_t * table[]);
 int cw_representation_to_character_internal(const char * representation);
+int cw_representation_hash_to_character_internal(unsigned int hash);
 int cw_representation_to_character_direct_internal(const char * representation);
 unsigned int cw_representation_to_hash_internal(const char * representation); /* TODO: uint8_t return value (or maybe uint16_t?). */
 const char * cw_character_to_representation_internal(int character);
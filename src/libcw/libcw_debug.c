@@ -24,6 +24,16 @@
    @file libcw_debug.c
 
    @brief Debugging facility to libcw and applications using the library.
+
+   Messages of cw_debug_msg() are formatted by the calling thread, and
+   are written to stderr.
+
+   After cw_debug_start_writer() the messages are put into a lock-free
+   queue instead. Writer thread takes the messages from the queue and
+   writes them to stderr, so threads generating sound and handling keys
+   don't block on stderr. When the queue is full, new messages are
+   dropped and counted. Child process of fork() gets an empty queue and
+   its own writer thread.
 */
 
 
@@ -37,12 +47,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/time.h>
 #include <unistd.h>
 
 
@@ -62,22 +76,6 @@
 
 
 
-static struct {
-	int flag;
-	const char * message;
-} event_logging_strings[] = {
-	{ CW_DEBUG_EVENT_TONE_LOW,        "CW_DEBUG_EVENT_TONE_LOW"        },
-	{ CW_DEBUG_EVENT_TONE_MID,        "CW_DEBUG_EVENT_TONE_MID"        },
-	{ CW_DEBUG_EVENT_TONE_HIGH,       "CW_DEBUG_EVENT_TONE_HIGH"       },
-
-	{ CW_DEBUG_EVENT_TQ_JUST_EMPTIED, "CW_DEBUG_EVENT_TQ_JUST_EMPTIED" },
-	{ CW_DEBUG_EVENT_TQ_NONEMPTY,     "CW_DEBUG_EVENT_TQ_NONEMPTY"     },
-	{ CW_DEBUG_EVENT_TQ_STILL_EMPTY,  "CW_DEBUG_EVENT_TQ_STILL_EMPTY"  }
-};
-
-
-
-
 /* Human-readable labels for debug levels.
    Other modules can access the table only through pointer in debug
    object. I don't expose this table (by making it globally visible)
@@ -89,24 +87,18 @@ static const char * cw_debug_level_labels[] = { "[DD]", "[II]", "[WW]", "[EE]" }
 
 cw_debug_t cw_debug_object = {
 	.flags = CW_DEBUG_STDLIB | CW_DEBUG_SOUND_SYSTEM,
-	.n = 0,
-	.n_max = 1,
 	.level = CW_DEBUG_NONE,
 	.level_labels = cw_debug_level_labels
 };
 
 cw_debug_t cw_debug_object_dev = {
 	.flags = CW_DEBUG_SOUND_SYSTEM,
-	.n = 0,
-	.n_max = 1,
 	.level = CW_DEBUG_NONE,
 	.level_labels = cw_debug_level_labels
 };
 
 cw_debug_t cw_debug_object_ev = {
 	.flags = 0,
-	.n = 0,
-	.n_max = CW_DEBUG_N_EVENTS_MAX,
 	.level = CW_DEBUG_NONE,
 	.level_labels = cw_debug_level_labels
 };
@@ -114,50 +106,51 @@ cw_debug_t cw_debug_object_ev = {
 
 
 
-static void cw_event_debugging_flush_internal(cw_debug_t * debug_object) __attribute__((unused));
-
+/* Capacity of queue of messages. Must be a power of two. */
+enum { CW_DEBUG_LOG_CAPACITY = 256 };
+/* Max length of single message, including terminating NUL. */
+enum { CW_DEBUG_LOG_MESSAGE_SIZE = 256 };
 
 
 
-/**
-   @brief Write all events from the debug object to a file
-
-   Function writes all events stored in the @p debug_object to file
-   associated with the object, and removes the events.
 
-   List of events is preceded with "FLUSH START\n" line, and
-   followed by "FLUSH END\n" line.
+/* Bounded queue with many producers and one consumer (writer thread).
+   Producers claim a slot by incrementing 'head', and publish the
+   message by setting sequence number of the slot. */
+static struct {
+	struct {
+		size_t seq;
+		char message[CW_DEBUG_LOG_MESSAGE_SIZE];
+	} slots[CW_DEBUG_LOG_CAPACITY];
+
+	size_t head;
+	size_t tail;   /* Written only by writer thread. */
+
+	/* Count of messages dropped because the queue was full. */
+	uint64_t n_dropped;
+
+	/* Posted on each message. */
+	sem_t sem;
+
+	pthread_once_t once;
+	/* Has writer thread been started? If not, messages are written
+	   to stderr directly. */
+	bool is_async;
+} cw_debug_log = {
+	.head = 0,
+	.tail = 0,
+	.n_dropped = 0,
+	.once = PTHREAD_ONCE_INIT,
+	.is_async = false,
+};
 
-   Function is used only in advanced debugging of events in library.
 
-   @internal
-   @reviewed 2020-08-01
-   @endinternal
 
-   @param[in] debug_object debug object from which to flush events
-*/
-void cw_event_debugging_flush_internal(cw_debug_t * debug_object)
-{
-	if (debug_object->n <= 0) {
-		return;
-	}
 
-	long long int diff = debug_object->events[debug_object->n - 1].sec - debug_object->events[0].sec;
-	diff = debug_object->events[debug_object->n - 1].sec - diff - 1;
-
-	fprintf(stderr, "FLUSH START\n");
-	for (int i = 0; i < debug_object->n; i++) {
-		fprintf(stderr, "libcwevent:\t%06lld%06lld\t%s\n",
-			debug_object->events[i].sec - diff, debug_object->events[i].usec,
-			event_logging_strings[debug_object->events[i].event].message);
-	}
-	debug_object->n = 0;
-	fprintf(stderr, "FLUSH END\n");
-
-	fflush(stderr);
-
-	return;
-}
+static void cw_debug_log_init_internal(void);
+static bool cw_debug_log_start_internal(void);
+static void cw_debug_log_atfork_child_internal(void);
+static void * cw_debug_log_writer_thread_fn(void * arg);
 
 
 
@@ -303,6 +296,270 @@ bool cw_debug_has_flag(const cw_debug_t * debug_object, uint32_t flag)
 
 
 
+/**
+   @brief Log debug message
+
+   Don't call this function directly, use cw_debug_msg() macro.
+
+   The message is formatted in calling thread. If writer thread has
+   been started with cw_debug_start_writer(), the message is queued for
+   writing to stderr by writer thread, and the function doesn't block.
+   Otherwise the message is written to stderr by calling thread.
+
+   @internal
+   @reviewed 2026-10-15
+   @endinternal
+
+   @param[in] debug_object debug object with labels of levels
+   @param[in] debug_level level of the message
+   @param[in] func name of function logging the message
+   @param[in] line line in which the message is logged
+   @param[in] format printf-like format of message
+*/
+void cw_debug_msg_internal(const cw_debug_t * debug_object, int debug_level, const char * func, int line, const char * format, ...)
+{
+	char message[CW_DEBUG_LOG_MESSAGE_SIZE];
+	int n = 0;
+	if (debug_level == CW_DEBUG_DEBUG || debug_level == CW_DEBUG_ERROR) {
+		n = snprintf(message, sizeof (message), "%s %s: %d: ", debug_object->level_labels[debug_level], func, line);
+	} else {
+		n = snprintf(message, sizeof (message), "%s ", debug_object->level_labels[debug_level]);
+	}
+	if (n >= 0 && (size_t) n < sizeof (message)) {
+		va_list ap;
+		va_start(ap, format);
+		vsnprintf(message + n, sizeof (message) - (size_t) n, format, ap);
+		va_end(ap);
+	}
+
+	if (!__atomic_load_n(&cw_debug_log.is_async, __ATOMIC_ACQUIRE)) {
+		fprintf(stderr, "%s\n", message);
+		return;
+	}
+
+	size_t pos = __atomic_load_n(&cw_debug_log.head, __ATOMIC_RELAXED);
+	while (true) {
+		const size_t seq = __atomic_load_n(&cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			/* Slot is free. Try to claim it. */
+			if (__atomic_compare_exchange_n(&cw_debug_log.head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if ((ptrdiff_t) (seq - pos) < 0) {
+			/* Queue is full. */
+			__atomic_add_fetch(&cw_debug_log.n_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			/* Another producer has claimed the slot. */
+			pos = __atomic_load_n(&cw_debug_log.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].message, message, sizeof (message));
+	__atomic_store_n(&cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&cw_debug_log.sem);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write debug messages to stderr in background thread
+
+   By default cw_debug_msg() writes messages to stderr in calling
+   thread, which may block e.g. generator's thread and cause underruns
+   of sound. After this function succeeds, messages are queued and are
+   written by a writer thread of the library. The writer thread runs
+   until end of program, and calling the function again has no effect.
+
+   In child process of fork() messages that were queued before fork()
+   are discarded, and a new writer thread is started.
+
+   @reviewed 2026-10-15
+
+   @return CW_SUCCESS if writer thread is running
+   @return CW_FAILURE if writer thread couldn't be started (messages are then written by calling threads)
+*/
+int cw_debug_start_writer(void)
+{
+	pthread_once(&cw_debug_log.once, cw_debug_log_init_internal);
+
+	return __atomic_load_n(&cw_debug_log.is_async, __ATOMIC_ACQUIRE) ? CW_SUCCESS : CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Wait until all queued debug messages have been written
+
+   The function is called automatically at exit of program and on
+   failed cw_assert(). It returns immediately if writer thread hasn't
+   been started with cw_debug_start_writer(). Call it
+   before writing to stderr if debug messages should appear before
+   your output.
+
+   The function waits no longer than a second.
+
+   @reviewed 2026-10-15
+*/
+void cw_debug_flush(void)
+{
+	if (!__atomic_load_n(&cw_debug_log.is_async, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	const size_t head = __atomic_load_n(&cw_debug_log.head, __ATOMIC_ACQUIRE);
+	for (int i = 0; i < 1000; i++) {
+		if (__atomic_load_n(&cw_debug_log.tail, __ATOMIC_ACQUIRE) >= head) {
+			break;
+		}
+		usleep(1000);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Initialize queue of debug messages and start writer thread
+
+   If the thread can't be started, messages are written to stderr
+   directly by callers of cw_debug_msg().
+*/
+static void cw_debug_log_init_internal(void)
+{
+	if (!cw_debug_log_start_internal()) {
+		return;
+	}
+
+	atexit(cw_debug_flush);
+	/* Child process of fork() has only the thread that called
+	   fork(), so it needs its own writer thread. */
+	pthread_atfork(NULL, NULL, cw_debug_log_atfork_child_internal);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Reset queue of debug messages and start writer thread
+
+   On success the function sets cw_debug_log::is_async.
+
+   @return true if writer thread has been started
+   @return false otherwise
+*/
+static bool cw_debug_log_start_internal(void)
+{
+	for (size_t i = 0; i < CW_DEBUG_LOG_CAPACITY; i++) {
+		cw_debug_log.slots[i].seq = i;
+	}
+	cw_debug_log.head = 0;
+	cw_debug_log.tail = 0;
+	cw_debug_log.n_dropped = 0;
+	if (0 != sem_init(&cw_debug_log.sem, 0, 0)) {
+		return false;
+	}
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_t thread;
+	const int rv = pthread_create(&thread, &attr, cw_debug_log_writer_thread_fn, NULL);
+	pthread_attr_destroy(&attr);
+	if (0 != rv) {
+		sem_destroy(&cw_debug_log.sem);
+		return false;
+	}
+
+	__atomic_store_n(&cw_debug_log.is_async, true, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Restart writing of debug messages in child process of fork()
+
+   Messages that were in the queue at the time of fork() are written
+   by writer thread of parent process. They are discarded in the child,
+   together with slots that the parent's threads may have been filling
+   during fork().
+
+   If writer thread can't be started in the child, messages of the
+   child are written to stderr directly.
+*/
+static void cw_debug_log_atfork_child_internal(void)
+{
+	if (!__atomic_load_n(&cw_debug_log.is_async, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	__atomic_store_n(&cw_debug_log.is_async, false, __ATOMIC_RELEASE);
+
+	/* There are no waiters on the semaphore in the child. */
+	sem_destroy(&cw_debug_log.sem);
+	cw_debug_log_start_internal();
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread function of writer of debug messages
+
+   @param arg unused
+
+   @return NULL (the thread never returns)
+*/
+static void * cw_debug_log_writer_thread_fn(__attribute__((unused)) void * arg)
+{
+	uint64_t n_dropped_reported = 0;
+
+	while (true) {
+		while (0 != sem_wait(&cw_debug_log.sem)) {
+			/* EINTR. */
+			;
+		}
+
+		/* The semaphore may have been posted by producer of a
+		   later slot. Producer of this slot has already claimed
+		   it, and is about to publish the message. */
+		const size_t pos = cw_debug_log.tail;
+		while (__atomic_load_n(&cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].seq, __ATOMIC_ACQUIRE) != pos + 1) {
+			sched_yield();
+		}
+
+		const uint64_t n_dropped = __atomic_load_n(&cw_debug_log.n_dropped, __ATOMIC_RELAXED);
+		if (n_dropped != n_dropped_reported) {
+			fprintf(stderr, "%s " MSG_PREFIX "%llu messages dropped\n", cw_debug_level_labels[CW_DEBUG_WARNING],
+				(unsigned long long int) (n_dropped - n_dropped_reported));
+			n_dropped_reported = n_dropped;
+		}
+
+		fprintf(stderr, "%s\n", cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].message);
+
+		/* Free the slot for the producer of next lap. */
+		__atomic_store_n(&cw_debug_log.slots[pos & (CW_DEBUG_LOG_CAPACITY - 1)].seq, pos + CW_DEBUG_LOG_CAPACITY, __ATOMIC_RELEASE);
+		__atomic_store_n(&cw_debug_log.tail, pos + 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+
+
+
 #ifdef ENABLE_DEV_LIBCW_DEBUGGING
 
 
@@ -391,50 +648,6 @@ void cw_dev_debug_print_generator_setup_internal(const cw_gen_t * gen)
 
 
 
-/**
-   @brief Add debug event to debug object
-
-   Function is used only in advanced debugging of events in library.
-
-   @internal
-   @reviewed 2020-08-01
-   @endinternal
-
-   @param[in] debug_object debug object
-   @param[in] flag one of CW_DEBUG_* flags from libcw.h
-   @param[in] event one of CW_DEBUG_EVENT_* flags from libcw_debug.h
-   @param[in] func function where the event occurred
-   @param[in] line file line in which the event occurred
-*/
-void cw_debug_event_internal(cw_debug_t * debug_object, uint32_t flag, uint32_t event, const char * func __attribute__((unused)), int line __attribute__((unused)))
-{
-	if (NULL == debug_object) {
-		return;
-	}
-
-	if (!cw_debug_has_flag(debug_object, flag)) {
-		return;
-	}
-
-	struct timeval now;
-	gettimeofday(&now, NULL);
-
-	debug_object->events[debug_object->n].event = event;
-	debug_object->events[debug_object->n].sec = (long long int) now.tv_sec;
-	debug_object->events[debug_object->n].usec = (long long int) now.tv_usec;
-
-	debug_object->n++;
-
-	if (debug_object->n >= debug_object->n_max) {
-		cw_event_debugging_flush_internal(debug_object);
-	}
-
-	return;
-}
-
-
-
-
 #endif /* #ifdef ENABLE_DEV_LIBCW_DEBUGGING */
 
 
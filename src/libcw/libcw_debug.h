@@ -46,30 +46,14 @@ extern "C"
 
 
 
-#define CW_DEBUG_N_EVENTS_MAX (1024 * 128)
-
-
-
-
 typedef struct {
 	uint32_t flags; /* See libcw.h, enum with CW_DEBUG_* values. */
 
-	int n;       /* Event counter. */
-	int n_max;   /* Flush threshold. */
-
 	/* Current debug level. */
 	int level;
 
 	/* Human-readable labels for debug levels. */
 	const char ** level_labels;
-
-	/* This is used only by utilities declared in section "Stuff used for
-	   advanced logging of events in library.". */
-	struct {
-		uint32_t event;   /* Event ID. One of CW_DEBUG_EVENT_* values. */
-		long long sec;    /* Time of registering the event - second. */
-		long long usec;   /* Time of registering the event - microsecond. */
-	} events[CW_DEBUG_N_EVENTS_MAX] __attribute__((deprecated));
 } cw_debug_t;
 
 
@@ -82,21 +66,41 @@ bool     cw_debug_has_flag(const cw_debug_t * debug_object, uint32_t flag);
 
 
 
+/* Tracing of events in library. See libcw_trace.c. */
+int      cw_trace_start(int fd);
+void     cw_trace_stop(void);
+
+
+
+
 void     cw_set_debug_flags(uint32_t flags)    __attribute__ ((deprecated));
 uint32_t cw_get_debug_flags(void)              __attribute__ ((deprecated));
 
 
 
 
+/* Debug messages with level lower than this are removed at compile
+   time. Library's value is set with configure's
+   --enable-debug-level-min option. */
+#ifndef CW_DEBUG_LEVEL_MIN
+#define CW_DEBUG_LEVEL_MIN CW_DEBUG_DEBUG
+#endif
+
+
+
+
+void     cw_debug_msg_internal(const cw_debug_t * debug_object, int debug_level, const char * func, int line, const char * format, ...) __attribute__ ((format (printf, 5, 6)));
+int      cw_debug_start_writer(void);
+void     cw_debug_flush(void);
+
+
+
+
 #define cw_debug_msg(debug_object, flag, debug_level, ...) {	\
-	if ((debug_level) >= (debug_object)->level) {		\
+	if ((debug_level) >= CW_DEBUG_LEVEL_MIN			\
+	    && (debug_level) >= (debug_object)->level) {		\
 		if ((debug_object)->flags & (uint32_t) (flag)) {		\
-			fprintf(stderr, "%s ", (debug_object)->level_labels[(debug_level)]); \
-			if ((debug_level) == CW_DEBUG_DEBUG || (debug_level) == CW_DEBUG_ERROR) { \
-				fprintf(stderr, "%s: %d: ", __func__, __LINE__); \
-			}						\
-			fprintf(stderr, __VA_ARGS__);			\
-			fprintf(stderr, "\n");				\
+			cw_debug_msg_internal((debug_object), (debug_level), __func__, __LINE__, __VA_ARGS__); \
 		}							\
 	}								\
 }
@@ -144,35 +148,6 @@ uint32_t cw_get_debug_flags(void)              __attribute__ ((deprecated));
 
 
 
-/* ***************************************************** */
-/* Stuff used for advanced logging of events in library. */
-/* ***************************************************** */
-
-/*
-  Code in this section is considered deprecated. Don't use it in client code.
-
-  Code in this section is marked as deprecated because it should be used only
-  during development of libcw, and should not be used by client code.
-*/
-
-void cw_debug_event_internal(cw_debug_t *debug_object, uint32_t flag, uint32_t event, const char *func, int line) __attribute__ ((deprecated));
-#define cw_debug_ev(debug_object, flag, event)				\
-	{								\
-		cw_debug_event_internal((debug_object), flag, event, __func__, __LINE__); \
-	}
-
-enum {
-	CW_DEBUG_EVENT_TONE_LOW  = 0,         /* Tone with non-zero frequency. */
-	CW_DEBUG_EVENT_TONE_MID,              /* A state between LOW and HIGH, probably unused. */
-	CW_DEBUG_EVENT_TONE_HIGH,             /* Tone with zero frequency. */
-	CW_DEBUG_EVENT_TQ_JUST_EMPTIED,       /* A last tone from libcw's queue of tones has been dequeued, making the queue empty. */
-	CW_DEBUG_EVENT_TQ_NONEMPTY,           /* A tone from libcw's queue of tones has been dequeued, but the queue is still non-empty. */
-	CW_DEBUG_EVENT_TQ_STILL_EMPTY         /* libcw's queue of tones has been asked for tone, but there were no tones on the queue. */
-} __attribute__ ((deprecated));
-
-
-
-
 /* ********** */
 /* Assertions */
 /* ********** */
@@ -190,6 +165,7 @@ enum {
 #ifndef NDEBUG
 #define cw_assert(expr, ...)					\
 	if (! (expr)) {						\
+		cw_debug_flush();				\
 		fprintf(stderr, "\n\nassertion failed in:\n");	\
 		fprintf(stderr, "file %s\n", __FILE__);		\
 		fprintf(stderr, "line %d\n", __LINE__);		\
@@ -0,0 +1,373 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+/**
+   @file libcw_detector.c
+
+   @brief Detector of tone in stream of samples, driving a receiver.
+
+   Receiver accepts only timestamps of beginnings and ends of marks. The
+   detector consumes blocks of sound samples, measures magnitude of tone
+   of given frequency with Goertzel algorithm, and calls
+   cw_rec_mark_begin_usecs() and cw_rec_mark_end_usecs() with timestamps
+   calculated from position of samples in the stream.
+
+   Threshold of detection follows level of received signal and level of
+   noise (automatic gain control), and has a hysteresis, so that a signal
+   fading in and out or a noisy signal doesn't produce spurious marks.
+
+   Detector doesn't create any threads and doesn't wait for anything, so
+   one thread can run many detectors, each of them for one channel.
+*/
+
+
+
+
+#include "config.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_detector.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/detector: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static int64_t cw_detector_get_sample_timestamp_internal(const cw_detector_t * detector, uint64_t sample_idx);
+
+
+
+
+cw_detector_t * cw_detector_new(cw_rec_t * rec, int sample_rate, int frequency)
+{
+	if (NULL == rec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "NULL receiver");
+		return NULL;
+	}
+	/* Block must contain at least few periods of the tone. */
+	if (sample_rate <= 0 || frequency <= 0 || frequency >= sample_rate / 2) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid sample rate %d Hz or frequency %d Hz", sample_rate, frequency);
+		return NULL;
+	}
+
+	cw_detector_t * detector = calloc(1, sizeof (cw_detector_t));
+	if (NULL == detector) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	detector->rec = rec;
+	detector->sample_rate = sample_rate;
+	detector->frequency = frequency;
+
+	detector->block_n_samples = (int) (((int64_t) sample_rate * CW_DETECTOR_BLOCK_DURATION) / CW_USECS_PER_SEC);
+	if (detector->block_n_samples < 16) {
+		detector->block_n_samples = 16;
+	}
+	detector->block = calloc((size_t) detector->block_n_samples, sizeof (float));
+	detector->window = calloc((size_t) detector->block_n_samples, sizeof (float));
+	if (NULL == detector->block || NULL == detector->window) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_detector_delete(&detector);
+		return NULL;
+	}
+
+	const double pi = 3.14159265358979323846;
+	float window_sum = 0.0F;
+	for (int i = 0; i < detector->block_n_samples; i++) {
+		detector->window[i] = (float) (0.5 - 0.5 * cos(2.0 * pi * i / (detector->block_n_samples - 1)));
+		window_sum += detector->window[i];
+	}
+	detector->coeff = (float) (2.0 * cos(2.0 * pi * frequency / sample_rate));
+	detector->scale = 2.0F / window_sum;
+
+	const double block_duration = (double) detector->block_n_samples * CW_USECS_PER_SEC / sample_rate;
+	cw_envelope_get_coefficients_internal(block_duration, &detector->coefficients);
+
+	return detector;
+}
+
+
+
+
+void cw_detector_delete(cw_detector_t ** detector)
+{
+	if (NULL == detector || NULL == *detector) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL detector");
+		return;
+	}
+
+	/* Receiver is owned by caller. */
+	free((*detector)->block);
+	free((*detector)->window);
+
+	free(*detector);
+	*detector = NULL;
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_detector_process(cw_detector_t * detector, const struct timeval * timestamp, const cw_sample_t * samples, size_t n_samples)
+{
+	if (NULL == detector || (NULL == samples && n_samples > 0)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "NULL detector or samples");
+		return CW_FAILURE;
+	}
+
+	if (NULL != timestamp) {
+		/* Client code has its own timeline, e.g. timestamps of
+		   buffers of sound card. */
+		detector->origin = (int64_t) timestamp->tv_sec * CW_USECS_PER_SEC + timestamp->tv_usec;
+		detector->n_samples = 0;
+		detector->origin_valid = true;
+	} else if (!detector->origin_valid) {
+		struct timeval now = { 0 };
+		if (CW_SUCCESS != cw_timestamp_validate_internal(&now, NULL)) {
+			return CW_FAILURE;
+		}
+		detector->origin = (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec;
+		detector->n_samples = 0;
+		detector->origin_valid = true;
+	} else {
+		; /* Continue existing timeline. */
+	}
+
+	size_t i = 0;
+	while (i < n_samples) {
+		/* Copy as much of input as will fit into current
+		   block. The conversion loop is trivial for compiler to
+		   vectorize. */
+		size_t n = (size_t) (detector->block_n_samples - detector->block_fill);
+		if (n > n_samples - i) {
+			n = n_samples - i;
+		}
+		float * dest = detector->block + detector->block_fill;
+		const cw_sample_t * src = samples + i;
+		for (size_t j = 0; j < n; j++) {
+			dest[j] = (float) src[j];
+		}
+		detector->block_fill += (int) n;
+		i += n;
+
+		if (detector->block_fill < detector->block_n_samples) {
+			break;
+		}
+
+		/* Edges are attributed to beginning of block in which
+		   they are detected. This adds the same delay to begin
+		   and end of mark, so durations of marks are not
+		   affected. */
+		const uint64_t block_start_idx = detector->n_samples + i - (size_t) detector->block_n_samples;
+		const float magnitude = cw_detector_process_block_internal(detector);
+		detector->block_fill = 0;
+
+		const cw_envelope_event_t event = cw_envelope_update_internal(&detector->envelope, magnitude, &detector->coefficients);
+		if (CW_ENVELOPE_NONE == event) {
+			continue;
+		}
+
+		const int64_t edge = cw_detector_get_sample_timestamp_internal(detector, block_start_idx);
+		if (CW_ENVELOPE_MARK_BEGIN == event) {
+			if (CW_SUCCESS != cw_rec_mark_begin_usecs(detector->rec, edge)) {
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+					      MSG_PREFIX "receiver rejected begin of mark");
+			}
+		} else {
+			if (CW_SUCCESS != cw_rec_mark_end_usecs(detector->rec, edge)) {
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+					      MSG_PREFIX "receiver rejected end of mark");
+			}
+		}
+	}
+	detector->n_samples += n_samples;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_detector_get_timestamp(const cw_detector_t * detector, struct timeval * timestamp)
+{
+	if (NULL == detector || NULL == timestamp || !detector->origin_valid) {
+		return CW_FAILURE;
+	}
+	const int64_t usecs = cw_detector_get_sample_timestamp_internal(detector, detector->n_samples);
+	timestamp->tv_sec = (time_t) (usecs / CW_USECS_PER_SEC);
+	timestamp->tv_usec = (suseconds_t) (usecs % CW_USECS_PER_SEC);
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Calculate magnitude of detector's tone in full block of samples
+
+   Samples are multiplied by window, and then passed through Goertzel
+   filter.
+
+   @param[in] detector detector with full block of samples
+
+   @return amplitude of the tone, in units of samples
+*/
+float cw_detector_process_block_internal(cw_detector_t * detector)
+{
+	float * block = detector->block;
+	const float * window = detector->window;
+	const int n = detector->block_n_samples;
+	for (int i = 0; i < n; i++) {
+		block[i] *= window[i];
+	}
+
+	const float coeff = detector->coeff;
+	float s1 = 0.0F;
+	float s2 = 0.0F;
+	for (int i = 0; i < n; i++) {
+		const float s0 = block[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+
+	float power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+	if (power < 0.0F) {
+		/* Rounding errors. */
+		power = 0.0F;
+	}
+	return sqrtf(power) * detector->scale;
+}
+
+
+
+
+/**
+   @brief Calculate coefficients of envelopes updated at given interval
+
+   @param[in] update_interval interval between consecutive magnitudes passed to cw_envelope_update_internal() [us]
+   @param[out] coefficients coefficients of envelopes
+*/
+void cw_envelope_get_coefficients_internal(double update_interval, cw_envelope_coefficients_t * coefficients)
+{
+	coefficients->peak_decay = (float) exp(-update_interval / CW_DETECTOR_PEAK_DECAY_TIME);
+	coefficients->floor_space = (float) (1.0 - exp(-update_interval / CW_DETECTOR_FLOOR_SPACE_TIME));
+	coefficients->floor_mark = (float) (1.0 - exp(-update_interval / CW_DETECTOR_FLOOR_MARK_TIME));
+}
+
+
+
+
+/**
+   @brief Update envelopes with new magnitude of tone, detect begin or end of mark
+
+   @param[in,out] envelope envelope to update
+   @param[in] magnitude magnitude of tone
+   @param[in] coefficients coefficients of envelopes
+
+   @return CW_ENVELOPE_MARK_BEGIN or CW_ENVELOPE_MARK_END if the magnitude crossed a threshold
+   @return CW_ENVELOPE_NONE otherwise
+*/
+cw_envelope_event_t cw_envelope_update_internal(cw_envelope_t * envelope, float magnitude, const cw_envelope_coefficients_t * coefficients)
+{
+	if (!envelope->is_primed) {
+		/* Envelope of noise would need some time to rise
+		   from zero to level of noise, and noise would be
+		   detected as marks. */
+		envelope->peak = magnitude;
+		envelope->floor = magnitude;
+		envelope->is_primed = true;
+		return CW_ENVELOPE_NONE;
+	}
+
+	if (magnitude > envelope->peak) {
+		envelope->peak = magnitude;
+	} else {
+		envelope->peak *= coefficients->peak_decay;
+	}
+	if (envelope->is_mark) {
+		envelope->floor += (magnitude - envelope->floor) * coefficients->floor_mark;
+	} else {
+		envelope->floor += (magnitude - envelope->floor) * coefficients->floor_space;
+	}
+
+	const bool has_signal = envelope->peak > CW_DETECTOR_SNR_MIN * envelope->floor
+		&& envelope->peak > CW_DETECTOR_MAGNITUDE_MIN;
+	const float range = envelope->peak - envelope->floor;
+
+	if (!envelope->is_mark) {
+		if (has_signal && magnitude > envelope->floor + CW_DETECTOR_THRESHOLD_ON * range) {
+			envelope->is_mark = true;
+			return CW_ENVELOPE_MARK_BEGIN;
+		}
+	} else {
+		if (!has_signal || magnitude < envelope->floor + CW_DETECTOR_THRESHOLD_OFF * range) {
+			envelope->is_mark = false;
+			return CW_ENVELOPE_MARK_END;
+		}
+	}
+	return CW_ENVELOPE_NONE;
+}
+
+
+
+
+/**
+   @brief Get timestamp of sample with given index on detector's timeline
+
+   @param[in] detector detector
+   @param[in] sample_idx index of sample since origin of timeline
+
+   @return timestamp of the sample [microseconds]
+*/
+static int64_t cw_detector_get_sample_timestamp_internal(const cw_detector_t * detector, uint64_t sample_idx)
+{
+	return detector->origin + (int64_t) ((sample_idx * CW_USECS_PER_SEC) / (uint64_t) detector->sample_rate);
+}
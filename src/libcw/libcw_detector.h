@@ -0,0 +1,126 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_DETECTOR
+#define H_LIBCW_DETECTOR
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Duration of block of samples analyzed by one run of Goertzel
+   algorithm. Bandwidth of the detector is roughly 2 / duration of
+   block, i.e. ~400 Hz. Dot at CW_SPEED_MAX is four blocks long. [us] */
+#define CW_DETECTOR_BLOCK_DURATION 5000
+
+/* Time constants of envelopes of marks and of noise. Between marks
+   envelope of noise follows average level of input. During marks it
+   follows the input very slowly, so that it doesn't rise to level of
+   marks during long dashes, but does rise for a carrier that never
+   stops. [us] */
+#define CW_DETECTOR_PEAK_DECAY_TIME  (2 * 1000 * 1000)
+#define CW_DETECTOR_FLOOR_SPACE_TIME (200 * 1000)
+#define CW_DETECTOR_FLOOR_MARK_TIME  (5 * 1000 * 1000)
+
+/* Mark begins when magnitude rises above ON threshold, and ends when
+   magnitude drops below OFF threshold. Thresholds are fractions of
+   distance between noise envelope and marks envelope. */
+#define CW_DETECTOR_THRESHOLD_ON  0.6F
+#define CW_DETECTOR_THRESHOLD_OFF 0.4F
+
+/* Marks are detected only if envelope of marks is this many times
+   above envelope of noise (~10 dB), and above absolute
+   minimum. Otherwise the detector would decode noise after loss of
+   signal. */
+#define CW_DETECTOR_SNR_MIN       3.0F
+#define CW_DETECTOR_MAGNITUDE_MIN 30.0F
+
+
+
+
+/* Envelopes of marks and of noise at output of a tone filter, with
+   state of mark/space decision. Used by detector, and by skimmer for
+   every frequency bin. */
+typedef struct {
+	/* Envelope of marks: fast attack, slow decay. */
+	float peak;
+	/* Envelope of noise. */
+	float floor;
+	/* Is the input between begin and end of a mark? */
+	bool is_mark;
+	/* Have envelopes been initialized with first magnitude? */
+	bool is_primed;
+} cw_envelope_t;
+
+/* Per-update coefficients of envelopes, depending on interval between
+   updates. */
+typedef struct {
+	float peak_decay;
+	float floor_space;
+	float floor_mark;
+} cw_envelope_coefficients_t;
+
+/* Event detected by cw_envelope_update_internal(). */
+typedef enum {
+	CW_ENVELOPE_NONE = 0,
+	CW_ENVELOPE_MARK_BEGIN,
+	CW_ENVELOPE_MARK_END
+} cw_envelope_event_t;
+
+
+
+
+struct cw_detector_struct {
+	/* Receiver to which key-down/key-up events are sent. Not owned
+	   by detector. */
+	cw_rec_t * rec;
+
+	int sample_rate;  /* [Hz] */
+	int frequency;    /* [Hz] */
+
+	/* Samples of block in progress, converted to float. */
+	float * block;
+	/* Hann window applied to every block. */
+	float * window;
+	int block_n_samples;
+	int block_fill;
+	/* Goertzel coefficient: 2 * cos(2 * pi * frequency / sample_rate). */
+	float coeff;
+	/* Scale converting Goertzel magnitude to amplitude of tone. */
+	float scale;
+
+	/* Automatic gain control. */
+	cw_envelope_t envelope;
+	cw_envelope_coefficients_t coefficients;
+
+	/* Timeline of input samples: time of sample at index zero
+	   [microseconds], and count of samples processed since then. */
+	int64_t origin;
+	uint64_t n_samples;
+	bool origin_valid;
+};
+
+
+
+
+float cw_detector_process_block_internal(cw_detector_t * detector);
+void cw_envelope_get_coefficients_internal(double update_interval, cw_envelope_coefficients_t * coefficients);
+cw_envelope_event_t cw_envelope_update_internal(cw_envelope_t * envelope, float magnitude, const cw_envelope_coefficients_t * coefficients);
+
+
+
+
+#endif /* #ifndef H_LIBCW_DETECTOR */
@@ -0,0 +1,434 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_device_pool.c
+
+   @brief Pool of configured sound devices shared by generators of a process.
+
+   Opening and configuring ALSA or PulseAudio device can take hundreds
+   of milliseconds. Generators created with
+   cw_gen_config_t::device_pool don't close their sound device when
+   they are deleted. The device is put into library-wide pool
+   instead, and a generator created later with the same sound system,
+   sound device and format of samples takes the already configured
+   device from the pool.
+
+   The pool is keyed on parts of generator's configuration that
+   influence opening and configuration of the device. Every entry
+   counts generators using its device. The devices can't be written
+   to by two generators at the same time (use mixer for this), so an
+   entry is either idle (no users) or used by one generator.
+
+   Only devices that aren't associated with a specific generator are
+   pooled: ALSA, OSS, and PulseAudio's simple API. Asynchronous
+   PulseAudio stream, JACK and PipeWire call their callbacks with
+   pointer to generator, and Null, Console and File sinks are cheap to
+   open.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw_alsa.h"
+#include "libcw_debug.h"
+#include "libcw_device_pool.h"
+#include "libcw_gen.h"
+#include "libcw_oss.h"
+#include "libcw_pa.h"
+
+
+
+
+#define MSG_PREFIX "libcw/pool: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Configured sound device, with generator's parameters that have been
+   set during configuration of the device. */
+typedef struct {
+	/* Entry holds an open sound device. */
+	bool occupied;
+
+	/* Count of generators using the device (0 or 1). */
+	int n_users;
+
+	/* Configuration of generator with which the device has been
+	   opened. */
+	cw_gen_config_t key;
+	bool sound_nonblocking;
+
+	int sound_system;
+	char picked_device_name[LIBCW_SOUND_DEVICE_NAME_SIZE];
+	unsigned int sample_rate;
+	int buffer_n_samples;
+	cw_sample_format_t sample_format;
+	int n_channels;
+	int sound_device_latency;
+	cw_ret_t (* acquire_buffer_from_sound_device)(cw_gen_t * gen);
+
+#ifdef LIBCW_WITH_OSS
+	cw_oss_data_t oss_data;
+#endif
+#ifdef LIBCW_WITH_ALSA
+	cw_alsa_data_t alsa_data;
+#endif
+#ifdef LIBCW_WITH_PULSEAUDIO
+	cw_pa_data_t pa_data;
+#endif
+} cw_device_pool_entry_t;
+
+
+
+
+static cw_device_pool_entry_t g_cw_device_pool[CW_DEVICE_POOL_N_ENTRIES];
+static pthread_mutex_t g_cw_device_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+static bool cw_device_pool_key_matches_internal(const cw_device_pool_entry_t * entry, const cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static bool cw_device_pool_is_poolable_internal(const cw_gen_t * gen);
+static void cw_device_pool_init_gen_internal(cw_gen_t * gen, int sound_system);
+static void cw_device_pool_save_internal(cw_device_pool_entry_t * entry, const cw_gen_t * gen);
+static void cw_device_pool_restore_internal(const cw_device_pool_entry_t * entry, cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Take configured sound device from pool
+
+   On success the generator has its sound system initialized and its
+   sound device opened, exactly as if the device has been opened by
+   gen->open_and_configure_sound_device().
+
+   @param[in,out] gen generator that needs a sound device
+   @param[in] gen_conf configuration of the generator
+
+   @return true if a device has been taken from pool
+   @return false if there is no matching device in pool
+*/
+bool cw_device_pool_acquire_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	gen->device_pool.slot = -1;
+	gen->device_pool.enabled = gen_conf->device_pool;
+	if (!gen->device_pool.enabled) {
+		return false;
+	}
+	gen->device_pool.key = *gen_conf;
+
+	bool found = false;
+	pthread_mutex_lock(&g_cw_device_pool_mutex);
+	for (int i = 0; i < CW_DEVICE_POOL_N_ENTRIES; i++) {
+		cw_device_pool_entry_t * entry = &g_cw_device_pool[i];
+		if (entry->occupied && 0 == entry->n_users
+		    && cw_device_pool_key_matches_internal(entry, gen, gen_conf)) {
+
+			cw_device_pool_init_gen_internal(gen, entry->sound_system);
+			cw_device_pool_restore_internal(entry, gen);
+			entry->n_users++;
+			gen->device_pool.slot = i;
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_cw_device_pool_mutex);
+
+	if (found) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "reusing %s device '%s' from slot %d",
+			      cw_get_audio_system_label(gen->sound_system), gen->picked_device_name, gen->device_pool.slot);
+	}
+	return found;
+}
+
+
+
+
+/**
+   @brief Put sound device of generator into pool
+
+   The function should be called when generator is being deleted,
+   instead of closing generator's sound device. If the function
+   returns false, the device has to be closed by caller.
+
+   @param[in,out] gen generator that doesn't need its sound device anymore
+
+   @return true if the device has been put into pool
+   @return false otherwise
+*/
+bool cw_device_pool_release_internal(cw_gen_t * gen)
+{
+	if (!gen->device_pool.enabled || !gen->sound_device_is_open || !cw_device_pool_is_poolable_internal(gen)) {
+		return false;
+	}
+
+	/* Pending samples belong to the deleted generator. */
+	if (CW_AUDIO_ALSA == gen->sound_system) {
+		cw_alsa_reset_internal(gen);
+	}
+
+	bool released = false;
+	pthread_mutex_lock(&g_cw_device_pool_mutex);
+	int slot = gen->device_pool.slot;
+	if (slot < 0) {
+		/* Device has been opened by the generator, find a place for it. */
+		for (int i = 0; i < CW_DEVICE_POOL_N_ENTRIES; i++) {
+			if (!g_cw_device_pool[i].occupied) {
+				slot = i;
+				break;
+			}
+		}
+	}
+	if (slot >= 0) {
+		cw_device_pool_entry_t * entry = &g_cw_device_pool[slot];
+		cw_device_pool_save_internal(entry, gen);
+		entry->key = gen->device_pool.key;
+		entry->occupied = true;
+		entry->n_users = 0;
+		released = true;
+	}
+	pthread_mutex_unlock(&g_cw_device_pool_mutex);
+
+	if (released) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "keeping %s device '%s' in slot %d",
+			      cw_get_audio_system_label(gen->sound_system), gen->picked_device_name, slot);
+		gen->device_pool.slot = -1;
+		gen->sound_device_is_open = false;
+	}
+	return released;
+}
+
+
+
+
+void cw_gen_close_pooled_devices(void)
+{
+	pthread_mutex_lock(&g_cw_device_pool_mutex);
+	for (int i = 0; i < CW_DEVICE_POOL_N_ENTRIES; i++) {
+		cw_device_pool_entry_t * entry = &g_cw_device_pool[i];
+		if (!entry->occupied || 0 != entry->n_users) {
+			continue;
+		}
+
+		/* Functions closing sound devices need a generator. */
+		cw_gen_t * gen = (cw_gen_t *) cw_calloc_aligned_internal(sizeof (cw_gen_t));
+		if (NULL == gen) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "posix_memalign()");
+			break;
+		}
+#ifdef ENABLE_DEV_PCM_SAMPLES_FILE
+		gen->dev_raw_sink = -1;
+#endif
+		cw_device_pool_init_gen_internal(gen, entry->sound_system);
+		cw_device_pool_restore_internal(entry, gen);
+		gen->close_sound_device(gen);
+		free(gen);
+
+		entry->occupied = false;
+	}
+	pthread_mutex_unlock(&g_cw_device_pool_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if device in pool's entry can be used by generator with given configuration
+
+   @param[in] entry occupied entry of pool
+   @param[in] gen generator that needs a sound device
+   @param[in] gen_conf configuration of the generator
+
+   @return true if the device matches the configuration
+   @return false otherwise
+*/
+static bool cw_device_pool_key_matches_internal(const cw_device_pool_entry_t * entry, const cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	const cw_gen_config_t * key = &entry->key;
+
+	return key->sound_system == gen_conf->sound_system
+		&& 0 == strcmp(key->sound_device, gen_conf->sound_device)
+		&& key->sample_format == gen_conf->sample_format
+		&& key->n_channels == gen_conf->n_channels
+		&& key->sample_rate == gen_conf->sample_rate
+		&& key->alsa_period_size == gen_conf->alsa_period_size
+		&& key->alsa_mmap == gen_conf->alsa_mmap
+		&& key->alsa_low_latency == gen_conf->alsa_low_latency
+		&& key->oss_latency == gen_conf->oss_latency
+		&& key->adaptive_period == gen_conf->adaptive_period
+		&& key->pa_async == gen_conf->pa_async
+		&& entry->sound_nonblocking == gen->sound_nonblocking;
+}
+
+
+
+
+/**
+   @brief Check if sound device of generator can be put into pool
+
+   @param[in] gen generator with opened sound device
+
+   @return true if the device can be pooled
+   @return false otherwise
+*/
+static bool cw_device_pool_is_poolable_internal(const cw_gen_t * gen)
+{
+	switch (gen->sound_system) {
+#ifdef LIBCW_WITH_OSS
+	case CW_AUDIO_OSS:
+		return true;
+#endif
+#ifdef LIBCW_WITH_ALSA
+	case CW_AUDIO_ALSA:
+		return true;
+#endif
+#ifdef LIBCW_WITH_PULSEAUDIO
+	case CW_AUDIO_PA:
+		return NULL != gen->pa_data.simple;
+#endif
+	default:
+		return false;
+	}
+}
+
+
+
+
+/**
+   @brief Set generator's sound system and its functions
+
+   @param[in,out] gen generator
+   @param[in] sound_system one of sound systems accepted by cw_device_pool_is_poolable_internal()
+*/
+static void cw_device_pool_init_gen_internal(cw_gen_t * gen, int sound_system)
+{
+	switch (sound_system) {
+	case CW_AUDIO_OSS:
+		cw_oss_init_gen_internal(gen);
+		break;
+	case CW_AUDIO_ALSA:
+		cw_alsa_init_gen_internal(gen);
+		break;
+	case CW_AUDIO_PA:
+		cw_pa_init_gen_internal(gen);
+		break;
+	default:
+		break;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Copy parameters of generator's sound device into pool's entry
+
+   @param[out] entry entry of pool
+   @param[in] gen generator with opened sound device
+*/
+static void cw_device_pool_save_internal(cw_device_pool_entry_t * entry, const cw_gen_t * gen)
+{
+	entry->sound_nonblocking = gen->sound_nonblocking;
+	entry->sound_system = gen->sound_system;
+	snprintf(entry->picked_device_name, sizeof (entry->picked_device_name), "%s", gen->picked_device_name);
+	entry->sample_rate = gen->sample_rate;
+	entry->buffer_n_samples = gen->buffer_n_samples;
+	entry->sample_format = gen->sample_format;
+	entry->n_channels = gen->n_channels;
+	entry->sound_device_latency = gen->sound_device_latency;
+	entry->acquire_buffer_from_sound_device = gen->acquire_buffer_from_sound_device;
+
+#ifdef LIBCW_WITH_OSS
+	entry->oss_data = gen->oss_data;
+#endif
+#ifdef LIBCW_WITH_ALSA
+	entry->alsa_data = gen->alsa_data;
+	entry->alsa_data.mmap_acquired = false;
+#endif
+#ifdef LIBCW_WITH_PULSEAUDIO
+	entry->pa_data = gen->pa_data;
+#endif
+
+	return;
+}
+
+
+
+
+/**
+   @brief Copy parameters of sound device from pool's entry into generator
+
+   @param[in] entry occupied entry of pool
+   @param[out] gen generator
+*/
+static void cw_device_pool_restore_internal(const cw_device_pool_entry_t * entry, cw_gen_t * gen)
+{
+	snprintf(gen->picked_device_name, sizeof (gen->picked_device_name), "%s", entry->picked_device_name);
+	gen->sample_rate = entry->sample_rate;
+	gen->buffer_n_samples = entry->buffer_n_samples;
+	gen->sample_format = entry->sample_format;
+	gen->n_channels = entry->n_channels;
+	gen->sound_device_latency = entry->sound_device_latency;
+	gen->acquire_buffer_from_sound_device = entry->acquire_buffer_from_sound_device;
+
+#ifdef LIBCW_WITH_OSS
+	gen->oss_data = entry->oss_data;
+#endif
+#ifdef LIBCW_WITH_ALSA
+	gen->alsa_data = entry->alsa_data;
+#endif
+#ifdef LIBCW_WITH_PULSEAUDIO
+	gen->pa_data = entry->pa_data;
+#endif
+
+	gen->sound_device_is_open = true;
+
+	return;
+}
@@ -0,0 +1,36 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_DEVICE_POOL
+#define H_LIBCW_DEVICE_POOL
+
+
+
+
+#include <stdbool.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+/* Count of configured sound devices that can be kept in library-wide
+   pool. */
+#define CW_DEVICE_POOL_N_ENTRIES 4
+
+
+
+
+bool cw_device_pool_acquire_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+bool cw_device_pool_release_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_DEVICE_POOL */
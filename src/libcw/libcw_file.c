@@ -0,0 +1,430 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_file.c
+
+   @brief File sound sink.
+
+   Samples are written to a disc file (or to standard output) instead of a
+   sound device. Writing to a file never blocks for the duration of the
+   samples, so tones are rendered as fast as they can be calculated. This
+   is useful for offline generation of recordings.
+
+   Name of "device" is a path to output file, "-" is standard output. Files
+   with ".wav" extension get a WAV header, all other files contain raw
+   samples: mono, signed 16 bit, native byte order.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_debug.h"
+#include "libcw_file.h"
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/file: "
+
+/* Sample rate of samples written to file. */
+#define CW_FILE_SAMPLE_RATE 48000
+
+/* Size of generator's buffer, 100 ms at CW_FILE_SAMPLE_RATE. */
+#define CW_FILE_BUFFER_N_SAMPLES 4800
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static cw_ret_t cw_file_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_file_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_file_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_file_write_wav_header_internal(cw_gen_t * gen);
+static bool     cw_file_is_wav_path_internal(const char * path);
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with File sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with sound system (doesn't try to open or configure it).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_file_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_FILE;
+	gen->open_and_configure_sound_device = cw_file_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_file_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_file_write_buffer_to_sound_device_internal;
+
+	gen->sample_rate = CW_FILE_SAMPLE_RATE;
+
+	gen->file_data.sound_sink_fd = -1;
+	gen->file_data.close_fd = false;
+	gen->file_data.is_wav = false;
+	gen->file_data.n_data_bytes = 0;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if it is possible to open File sound output
+
+   @param[in] device_name path to output file, "-" for standard output, or
+   NULL/empty string for default file
+
+   @return true if the file can be created or written
+   @return false otherwise
+*/
+bool cw_is_file_possible(const char * device_name)
+{
+	if (NULL == device_name || '\0' == device_name[0] || 0 == strcmp(device_name, "-")) {
+		return true;
+	}
+
+	if (0 == access(device_name, F_OK)) {
+		return 0 == access(device_name, W_OK);
+	}
+
+	/* The file doesn't exist yet: it can be created if its
+	   directory is writable. */
+	char dir[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(dir, sizeof (dir), "%s", device_name);
+	char * slash = strrchr(dir, '/');
+	if (NULL == slash) {
+		return 0 == access(".", W_OK);
+	} else if (slash == dir) {
+		return 0 == access("/", W_OK);
+	} else {
+		*slash = '\0';
+		return 0 == access(dir, W_OK);
+	}
+}
+
+
+
+
+/**
+   @brief Open and configure File sound system handle stored in given generator
+
+   @param[in,out] gen generator for which to open and configure sound system handle
+   @param[in] gen_conf
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_file_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (gen->sound_device_is_open) {
+		/* Ignore the call if the device is already open. */
+		return CW_SUCCESS;
+	}
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	if (0 == strcmp(gen->picked_device_name, "-")) {
+		gen->file_data.sound_sink_fd = STDOUT_FILENO;
+		gen->file_data.close_fd = false;
+		gen->file_data.is_wav = false;
+	} else {
+		gen->file_data.sound_sink_fd = open(gen->picked_device_name,
+						    O_WRONLY | O_CREAT | O_TRUNC,
+						    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (-1 == gen->file_data.sound_sink_fd) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "open: failed to open file '%s': '%s'", gen->picked_device_name, strerror(errno));
+			return CW_FAILURE;
+		}
+		gen->file_data.close_fd = true;
+		gen->file_data.is_wav = cw_file_is_wav_path_internal(gen->picked_device_name);
+	}
+	gen->file_data.n_data_bytes = 0;
+
+	if (gen->file_data.is_wav) {
+		/* Sizes in the header will be updated when the file is
+		   closed. */
+		if (CW_SUCCESS != cw_file_write_wav_header_internal(gen)) {
+			cw_file_close_sound_device_internal(gen);
+			return CW_FAILURE;
+		}
+	}
+
+	gen->buffer_n_samples = CW_FILE_BUFFER_N_SAMPLES;
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close File sound device stored in given generator
+
+   Header of WAV file is updated with final sizes.
+
+   @param[in] gen generator for which to close its sound device
+*/
+static void cw_file_close_sound_device_internal(cw_gen_t * gen)
+{
+	if (-1 == gen->file_data.sound_sink_fd) {
+		gen->sound_device_is_open = false;
+		return;
+	}
+
+	if (gen->file_data.is_wav) {
+		if (0 == lseek(gen->file_data.sound_sink_fd, 0, SEEK_SET)) {
+			cw_file_write_wav_header_internal(gen);
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "close: can't update header of WAV file: '%s'", strerror(errno));
+		}
+	}
+
+	if (gen->file_data.close_fd) {
+		close(gen->file_data.sound_sink_fd);
+	}
+	gen->file_data.sound_sink_fd = -1;
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write generator's buffer to file
+
+   @param[in] gen generator with full buffer of samples
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_file_write_buffer_to_sound_device_internal(cw_gen_t * gen)
+{
+	assert (gen);
+	assert (gen->sound_system == CW_AUDIO_FILE);
+
+	const size_t n_bytes = sizeof (gen->out_buffer[0]) * (size_t) gen->out_n_samples;
+
+	if (gen->file_data.is_wav && !cw_file_host_is_little_endian_internal()) {
+		/* Samples in WAV file are little-endian. Samples in the
+		   buffer will be overwritten with new ones, so they can be
+		   swapped in place. */
+		for (int i = 0; i < gen->out_n_samples; i++) {
+			const uint16_t s = (uint16_t) gen->out_buffer[i];
+			gen->out_buffer[i] = (cw_sample_t) (uint16_t) ((s << 8) | (s >> 8));
+		}
+	}
+
+	if (CW_SUCCESS != cw_file_write_internal(gen->file_data.sound_sink_fd, gen->out_buffer, n_bytes)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "write: failed to write samples: '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+	gen->file_data.n_data_bytes += (uint32_t) n_bytes;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Write all bytes to file descriptor
+
+   @param[in] fd file descriptor
+   @param[in] data data to write
+   @param[in] n_bytes count of bytes to write
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_file_write_internal(int fd, const void * data, size_t n_bytes)
+{
+	const uint8_t * bytes = data;
+	while (n_bytes > 0) {
+		const ssize_t rv = write(fd, bytes, n_bytes);
+		if (-1 == rv) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return CW_FAILURE;
+		}
+		bytes += rv;
+		n_bytes -= (size_t) rv;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Fill header of WAV file
+
+   The header describes mono, 16-bit PCM samples.
+
+   @param[out] header buffer for header, CW_FILE_WAV_HEADER_SIZE bytes
+   @param[in] sample_rate sample rate of samples
+   @param[in] n_data_bytes count of bytes of samples following the header
+*/
+void cw_file_fill_wav_header_internal(uint8_t * header, uint32_t sample_rate, uint32_t n_data_bytes)
+{
+	const uint16_t n_channels = 1;
+	const uint16_t bits_per_sample = 8 * sizeof (cw_sample_t);
+	const uint16_t block_align = n_channels * sizeof (cw_sample_t);
+	const uint32_t byte_rate = sample_rate * block_align;
+	const uint32_t riff_size = CW_FILE_WAV_HEADER_SIZE - 8 + n_data_bytes;
+
+	uint8_t * h = header;
+
+	/* All integers in WAV header are little-endian. */
+#define CW_FILE_PUT_TAG(tag) { memcpy(h, (tag), 4); h += 4; }
+#define CW_FILE_PUT_U16(v) { *h++ = (uint8_t) ((v) & 0xff); *h++ = (uint8_t) (((v) >> 8) & 0xff); }
+#define CW_FILE_PUT_U32(v) { CW_FILE_PUT_U16((v) & 0xffff); CW_FILE_PUT_U16(((v) >> 16) & 0xffff); }
+
+	CW_FILE_PUT_TAG("RIFF");
+	CW_FILE_PUT_U32(riff_size);
+	CW_FILE_PUT_TAG("WAVE");
+	CW_FILE_PUT_TAG("fmt ");
+	CW_FILE_PUT_U32(16U);                /* Size of "fmt " chunk. */
+	CW_FILE_PUT_U16(1U);                 /* PCM. */
+	CW_FILE_PUT_U16(n_channels);
+	CW_FILE_PUT_U32(sample_rate);
+	CW_FILE_PUT_U32(byte_rate);
+	CW_FILE_PUT_U16(block_align);
+	CW_FILE_PUT_U16(bits_per_sample);
+	CW_FILE_PUT_TAG("data");
+	CW_FILE_PUT_U32(n_data_bytes);
+
+#undef CW_FILE_PUT_TAG
+#undef CW_FILE_PUT_U16
+#undef CW_FILE_PUT_U32
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write header of WAV file at current position in file
+
+   The header describes mono, 16-bit PCM samples, with size of data equal
+   to count of bytes of samples written so far.
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_file_write_wav_header_internal(cw_gen_t * gen)
+{
+	uint8_t header[CW_FILE_WAV_HEADER_SIZE] = { 0 };
+	cw_file_fill_wav_header_internal(header, (uint32_t) gen->sample_rate, gen->file_data.n_data_bytes);
+
+	if (CW_SUCCESS != cw_file_write_internal(gen->file_data.sound_sink_fd, header, sizeof (header))) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to write WAV header: '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if path has ".wav" extension
+
+   @param[in] path path to check
+
+   @return true if extension of file in @p path is ".wav" (case insensitive)
+   @return false otherwise
+*/
+static bool cw_file_is_wav_path_internal(const char * path)
+{
+	const char extension[] = ".wav";
+	const size_t len = strlen(path);
+	const size_t ext_len = sizeof (extension) - 1;
+
+	return len > ext_len && 0 == strcasecmp(path + len - ext_len, extension);
+}
+
+
+
+
+/**
+   @brief Check byte order of host
+
+   @return true if host is little-endian
+   @return false otherwise
+*/
+bool cw_file_host_is_little_endian_internal(void)
+{
+	const uint16_t probe = 1;
+	uint8_t first = 0;
+	memcpy(&first, &probe, 1);
+
+	return 1 == first;
+}
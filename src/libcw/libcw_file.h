@@ -0,0 +1,52 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_FILE
+#define H_LIBCW_FILE
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Size of header of WAV file with PCM samples. */
+#define CW_FILE_WAV_HEADER_SIZE 44
+
+
+
+
+typedef struct {
+	int sound_sink_fd;
+	bool close_fd;          /* Don't close standard output. */
+	bool is_wav;            /* Write WAV header in front of samples? */
+	uint32_t n_data_bytes;  /* Count of bytes of samples written to file. */
+} cw_file_data_t;
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_file_init_gen_internal(cw_gen_t * gen);
+cw_ret_t cw_file_write_internal(int fd, const void * data, size_t n_bytes);
+void cw_file_fill_wav_header_internal(uint8_t * header, uint32_t sample_rate, uint32_t n_data_bytes);
+bool cw_file_host_is_little_endian_internal(void);
+
+
+
+
+#endif /* #ifndef H_LIBCW_FILE */
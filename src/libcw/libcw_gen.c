@@ -66,11 +66,16 @@
 #include "config.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h> /* uint32_t */
+#include <limits.h> /* INT_MAX */
 #include <math.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #if defined(HAVE_STRING_H)
@@ -81,6 +86,12 @@
 # include <strings.h>
 #endif
 
+#if defined(HAVE_SYS_EVENTFD_H)
+# include <sys/eventfd.h>
+#endif
+
+#include <sys/mman.h> /* mlockall() */
+
 #if defined(__linux__)
 #include <sys/prctl.h> /* prctl() */
 #elif defined(__FreeBSD__)
@@ -91,17 +102,30 @@
 
 
 #include "libcw2.h"
+#include "libcw_alphabet.h"
 #include "libcw_alsa.h"
 #include "libcw_console.h"
 #include "libcw_data.h"
 #include "libcw_debug.h"
 #include "libcw_debug_internal.h"
+#include "libcw_device_pool.h"
+#include "libcw_file.h"
 #include "libcw_gen.h"
 #include "libcw_gen_internal.h"
+#include "libcw_gen_dsp.h"
+#include "libcw_gen_memory.h"
+#include "libcw_gen_sink.h"
+#include "libcw_gen_monitor.h"
+#include "libcw_gen_tap.h"
+#include "libcw_gen_quality.h"
 #include "libcw_null.h"
 #include "libcw_oss.h"
+#include "libcw_probe.h"
 #include "libcw_rec.h"
 #include "libcw_signal.h"
+#include "libcw_prof.h"
+#include "libcw_timing.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -115,6 +139,54 @@
 /* Our own definition, to have it as a float. */
 static const float CW_PI = 3.14159265358979323846F;
 
+/* Recursive (phasor) oscillator: magnitude of phasor is corrected every
+   this many samples. */
+#define CW_GEN_PHASOR_RENORMALIZATION_PERIOD 64
+
+/* Table oscillator: table of sine values has 2^CW_GEN_SINE_TABLE_BITS
+   cells (plus one guard cell). With linear interpolation between cells
+   the error of 1024-cell table is below 0.2 of LSB of 16-bit sample. */
+#define CW_GEN_SINE_TABLE_BITS 10
+#define CW_GEN_SINE_TABLE_SIZE (1 << CW_GEN_SINE_TABLE_BITS)
+static float g_sine_table[CW_GEN_SINE_TABLE_SIZE + 1];
+
+/* Fixed-point oscillator: the same table, with values in Q15 format. */
+#define CW_GEN_Q15_ONE (1 << 15)
+static int32_t g_sine_table_q15[CW_GEN_SINE_TABLE_SIZE + 1];
+
+/* Sine wave is calculated in blocks of this many samples. Intermediate
+   values (sine wave and amplitudes) of a block are kept in arrays on
+   stack. */
+#define CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES 256
+
+/* Final stage of floating-point oscillator engines, for amplitude of
+   j-th sample given by AMPLITUDE. Kernels specialized for different
+   sources of amplitude are generated from this one loop, see
+   cw_gen_apply_amplitudes_internal(). */
+#define CW_GEN_APPLY_AMPLITUDES_LOOP(AMPLITUDE)				\
+	cw_sample_t block[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES];		\
+	for (int j = 0; j < CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES; j++) {	\
+		float value = (AMPLITUDE) * wave[j];			\
+		value = value > CW_GEN_SAMPLE_VALUE_MAX ? CW_GEN_SAMPLE_VALUE_MAX : value; \
+		value = value < CW_GEN_SAMPLE_VALUE_MIN ? CW_GEN_SAMPLE_VALUE_MIN : value; \
+		block[j] = (cw_sample_t) value;				\
+	}								\
+	memcpy(samples, block, (size_t) n * sizeof (cw_sample_t));
+
+/* Long arrays of samples are calculated in fragments of at most this
+   many samples, as if they were calculated into generator's buffer. */
+#define CW_GEN_RENDER_FRAGMENT_N_SAMPLES 1024
+
+/* Longest chirp accepted by cw_gen_set_chirp() [us]. */
+#define CW_GEN_CHIRP_DURATION_MAX 1000000
+
+/* With cw_gen_config_t::adaptive_period, samples are written to sound
+   device in 1/CW_GEN_ADAPTIVE_PERIOD_DIVISOR of period while key is
+   used, and for CW_GEN_ADAPTIVE_PERIOD_HOLD_NS after last use of key
+   (so that writes don't change size between Marks of keyed text). */
+#define CW_GEN_ADAPTIVE_PERIOD_DIVISOR 4
+#define CW_GEN_ADAPTIVE_PERIOD_HOLD_NS 1000000000ULL
+
 
 
 
@@ -149,6 +221,28 @@ const unsigned int cw_supported_sample_rates[] = {
 
 	    0 /* guard */
 };
+/* Other rates (e.g. 96 kHz or 192 kHz, up to CW_GEN_SAMPLE_RATE_MAX)
+   can be requested with cw_gen_config_t::sample_rate. */
+
+
+
+
+/* Library-wide cache of slope shapes of unit amplitude. Calculation
+   of a sine or raised cosine slope at high sample rate means
+   thousands of calls to sinf()/cosf(), and generators are created
+   and reconfigured with the same few (rate, shape, duration)
+   combinations. Entries are replaced in round-robin order. */
+typedef struct {
+	unsigned int sample_rate;
+	int shape;
+	int duration; /* [us] */
+	int n_amplitudes;
+	float * amplitudes; /* From 0.0 to 1.0. */
+} cw_slope_cache_entry_t;
+
+static cw_slope_cache_entry_t g_cw_slope_cache[CW_GEN_SLOPE_CACHE_N_ENTRIES];
+static int g_cw_slope_cache_next = 0;
+static pthread_mutex_t g_cw_slope_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 
@@ -158,6 +252,85 @@ static void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, volatile cw
 static void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
 static void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
 static void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
+static int  cw_gen_calculate_silence_internal(cw_gen_t * gen, cw_tone_t * tone);
+static cw_ret_t cw_gen_enqueue_tone_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static cw_ret_t cw_gen_enqueue_space_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static int  cw_gen_calculate_sine_wave_sinf_internal(cw_gen_t * gen, cw_tone_t * tone);
+static int  cw_gen_calculate_sine_wave_phasor_internal(cw_gen_t * gen, cw_tone_t * tone);
+static int  cw_gen_calculate_sine_wave_table_internal(cw_gen_t * gen, cw_tone_t * tone);
+static int  cw_gen_calculate_sine_wave_fixed_internal(cw_gen_t * gen, cw_tone_t * tone);
+static int  cw_gen_calculate_sine_wave_chirp_internal(cw_gen_t * gen, cw_tone_t * tone);
+static bool cw_gen_modulation_is_active_internal(const cw_gen_t * gen);
+static void cw_gen_advance_gain_internal(cw_gen_t * gen, cw_sample_iter_t n);
+static void cw_gen_apply_gain_internal(cw_gen_t * gen, float * amplitudes, int n);
+static void cw_gen_apply_gain_fixed_internal(cw_gen_t * gen, int32_t * amplitudes, int n);
+static void cw_gen_update_phase_offset_internal(cw_gen_t * gen, const cw_tone_t * tone, int n_samples);
+static uint32_t cw_gen_phase_offset_to_acc_internal(float phase_offset);
+static int  cw_gen_synthesis_block_n_samples_internal(const cw_gen_t * gen, int i);
+static void cw_gen_render_samples_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * samples, int n_samples);
+static bool cw_gen_render_start_tone_internal(cw_gen_t * gen);
+static void cw_gen_render_end_tone_internal(cw_gen_t * gen);
+static uint32_t cw_gen_phase_acc_step_internal(const cw_gen_t * gen, int frequency);
+static cw_ret_t cw_gen_new_open_soundcard_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static float cw_gen_slope_unit_amplitude_internal(int shape, int i, int n_amplitudes);
+static const float * cw_gen_slope_cache_get_internal(unsigned int sample_rate, int shape, int duration, int n_amplitudes);
+static bool cw_gen_plateau_loop_is_usable_internal(const cw_gen_t * gen, const cw_tone_t * tone);
+static bool cw_gen_plateau_loop_covers_subarea_internal(const cw_tone_t * tone, int n_samples);
+static cw_ret_t cw_gen_plateau_loop_prepare_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static void cw_gen_plateau_loop_copy_internal(cw_gen_t * gen, cw_tone_t * tone, int n_samples);
+static void cw_gen_plateau_loop_finish_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static int  cw_gen_tone_cache_phase_bucket_internal(const cw_gen_t * gen);
+static void cw_gen_tone_cache_set_phase_bucket_internal(cw_gen_t * gen, int phase_bucket);
+static void cw_gen_tone_cache_invalidate_internal(cw_gen_t * gen);
+static void cw_gen_get_amplitude_spans_internal(const cw_tone_t * tone, cw_sample_iter_t first, int n, cw_sample_iter_t * plateau_start, cw_sample_iter_t * falling_start);
+static void cw_gen_calculate_amplitudes_fixed_internal(cw_gen_t * gen, cw_tone_t * tone, int32_t * amplitudes, int n);
+static void cw_gen_apply_amplitudes_internal(cw_sample_t * restrict samples, const float * restrict wave, const float * restrict amplitudes, int n);
+static void cw_gen_apply_plateau_internal(cw_sample_t * restrict samples, const float * restrict wave, float amplitude, int n);
+static bool cw_gen_block_is_plateau_internal(const cw_gen_t * gen, const cw_tone_t * tone, int n);
+static void cw_gen_synthesize_block_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * samples, const float * wave, float * amplitudes, int n);
+static __attribute__((constructor)) void cw_gen_constructor_internal(void);
+static cw_ret_t cw_gen_new_wakeup_internal(cw_gen_t * gen);
+static void cw_gen_wakeup_internal(cw_gen_t * gen);
+static void cw_gen_clear_wakeup_internal(cw_gen_t * gen);
+static void cw_gen_sync_tone_programs_internal(cw_gen_t * gen);
+static bool cw_gen_has_tone_program_internal(cw_gen_t * gen, char character);
+static void cw_gen_thread_setup_realtime_internal(cw_gen_t * gen);
+static void cw_gen_prefault_internal(void * memory, size_t size);
+static cw_ret_t cw_gen_reserve_slope_amplitudes_internal(cw_gen_t * gen, int n_amplitudes);
+static cw_ret_t cw_gen_preallocate_internal(cw_gen_t * gen);
+static cw_ret_t cw_gen_enqueue_tone_program_internal(cw_gen_t * gen, char character, bool with_ics);
+static void cw_gen_sidetone_request_cut_internal(cw_gen_t * gen);
+static void cw_gen_sidetone_cut_internal(cw_gen_t * gen);
+static uint64_t cw_gen_metrics_now_internal(void);
+static void cw_gen_metrics_buffer_written_internal(cw_gen_t * gen, cw_ret_t write_cwret, int n_samples);
+static cw_ret_t cw_gen_pipeline_new_internal(cw_gen_t * gen, int n_buffers);
+static void cw_gen_pipeline_start_internal(cw_gen_t * gen);
+static void cw_gen_pipeline_stop_internal(cw_gen_t * gen);
+static void cw_gen_pipeline_submit_internal(cw_gen_t * gen, int n_samples);
+static void cw_gen_pipeline_collect_internal(cw_gen_t * gen, int i);
+static void * cw_gen_pipeline_write_internal(void * arg);
+static void cw_gen_pipeline_drain_internal(cw_gen_t * gen);
+static void cw_gen_flush_buffer_internal(cw_gen_t * gen);
+static bool cw_gen_idle_retire_silence_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static void cw_gen_idle_wait_for_tone_internal(cw_gen_t * gen);
+static void cw_gen_adaptive_period_new_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void cw_gen_adaptive_period_keying_internal(cw_gen_t * gen);
+static void cw_gen_adaptive_period_update_internal(cw_gen_t * gen, const cw_tone_t * tone);
+static void cw_gen_record_end_of_sound_internal(cw_gen_t * gen, bool device_drained);
+static void cw_gen_device_clock_update_internal(cw_gen_t * gen);
+static void cw_gen_drift_measure_internal(cw_gen_t * gen, int64_t now, int delay);
+static void cw_gen_drift_correct_internal(cw_gen_t * gen, cw_tone_t * tone);
+static void cw_gen_get_playback_time_internal(cw_gen_t * gen, struct timeval * playback_time);
+static void cw_gen_scheduled_tone_calculate_duration_internal(cw_gen_t * gen, cw_tone_t * tone);
+static cw_ret_t cw_gen_enqueue_string_internal(cw_gen_t * gen, const char * string, const struct timeval * start, bool mark);
+static cw_ret_t cw_gen_enqueue_scheduled_silence_internal(cw_gen_t * gen, const struct timeval * start);
+static cw_ret_t cw_gen_enqueue_translated_string_internal(cw_gen_t * gen, const uint8_t * translated, size_t n_translated, bool mark);
+static void cw_gen_flush_tone_queue_internal(cw_gen_t * gen);
+static cw_ret_t cw_gen_tokens_push_internal(cw_gen_t * gen, uint64_t * token);
+static void cw_gen_tokens_drop_newest_internal(cw_gen_t * gen);
+static void cw_gen_tokens_update_internal(cw_gen_t * gen, bool played, size_t n_orphaned, bool flushed, uint64_t * first, uint64_t * last);
+static void cw_gen_tokens_notify_internal(cw_gen_t * gen, uint64_t first, uint64_t last);
+static void cw_gen_tokens_mark_played_internal(cw_gen_t * gen);
 
 
 
@@ -172,7 +345,11 @@ static const char * default_sound_devices[] = {
 	CW_DEFAULT_OSS_DEVICE,
 	CW_DEFAULT_ALSA_DEVICE,
 	CW_DEFAULT_PA_DEVICE,
-	(char *) NULL }; /* just in case someone decided to index the table with CW_AUDIO_SOUNDCARD */
+	(char *) NULL,  /* just in case someone decided to index the table with CW_AUDIO_SOUNDCARD */
+	CW_DEFAULT_FILE_DEVICE,
+	CW_DEFAULT_JACK_DEVICE,
+	CW_DEFAULT_PIPEWIRE_DEVICE,
+	CW_DEFAULT_RTP_DEVICE };
 
 
 
@@ -220,7 +397,7 @@ static const int CW_AUDIO_QUANTUM_DURATION_INITIAL = 500;  /* [us] */
    with given @p gen.
 
    The function returns through @p buffer one of following strings: "None",
-   "Null", "Console", "OSS", "ALSA", "PulseAudio", "Soundcard".
+   "Null", "Console", "OSS", "ALSA", "PulseAudio", "Soundcard", "File".
 
    @internal
    @reviewed 2020-08-04
@@ -250,7 +427,16 @@ char * cw_gen_get_sound_system_label_internal(const cw_gen_t * gen, char * buffe
 */
 cw_ret_t cw_gen_start(cw_gen_t * gen)
 {
+	if (gen->standby) {
+		/* Thread function is parked on empty tone queue, sound
+		   device is open and running. Next enqueued tone will be
+		   played within one period of the device. */
+		gen->standby = false;
+		return CW_SUCCESS;
+	}
+
 	gen->phase_offset = 0.0F;
+	gen->phase_acc = 0;
 
 #ifdef GENERATOR_CLIENT_THREAD
 	/* This generator exists in client's application thread.
@@ -262,7 +448,11 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 	    && gen->sound_system != CW_AUDIO_CONSOLE
 	    && gen->sound_system != CW_AUDIO_OSS
 	    && gen->sound_system != CW_AUDIO_ALSA
-	    && gen->sound_system != CW_AUDIO_PA) {
+	    && gen->sound_system != CW_AUDIO_PA
+	    && gen->sound_system != CW_AUDIO_FILE
+	    && gen->sound_system != CW_AUDIO_JACK
+	    && gen->sound_system != CW_AUDIO_PIPEWIRE
+	    && gen->sound_system != CW_AUDIO_RTP) {
 
 		gen->do_dequeue_and_generate = false;
 
@@ -274,6 +464,20 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 	   cw_gen_dequeue_and_generate_internal(), because loop in the
 	   function run only when the flag is set. */
 	gen->do_dequeue_and_generate = true;
+	cw_gen_clear_wakeup_internal(gen);
+	__atomic_store_n(&gen->sound_wait_cancelled, false, __ATOMIC_SEQ_CST);
+
+	if (gen->start_sound_device) {
+		/* Sound device will pull samples from generator in its
+		   own thread, generator's thread is not needed. */
+		if (CW_SUCCESS != gen->start_sound_device(gen)) {
+			gen->do_dequeue_and_generate = false;
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to start %s sound device", cw_get_audio_system_label(gen->sound_system));
+			return CW_FAILURE;
+		}
+		return CW_SUCCESS;
+	}
 
 
 #if LIBCW_GEN_DEBUG_THREAD_TIMING
@@ -287,6 +491,7 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 	/* cw_gen_dequeue_and_generate_internal() is THE
 	   function that does the main job of generating
 	   tones. */
+	gen->thread.ready = false;
 	int rv = pthread_create(&gen->thread.id, &gen->thread.attr,
 				cw_gen_dequeue_and_generate_internal,
 				(void *) gen);
@@ -313,10 +518,14 @@ cw_ret_t cw_gen_start(cw_gen_t * gen)
 #endif
 
 
-		/* FIXME: For some yet unknown reason we have to put
-		   usleep() here, otherwise a generator may
-		   work incorrectly */
-		usleep(100000);
+		/* Return only when the thread function is ready to
+		   dequeue tones, so that tones enqueued right after this
+		   call don't race with start-up of the thread. */
+		pthread_mutex_lock(&gen->thread.mutex);
+		while (!gen->thread.ready) {
+			pthread_cond_wait(&gen->thread.cond, &gen->thread.mutex);
+		}
+		pthread_mutex_unlock(&gen->thread.mutex);
 #ifdef ENABLE_DEV_LIBCW_DEBUGGING
 		cw_dev_debug_print_generator_setup_internal(gen);
 #endif
@@ -370,7 +579,6 @@ cw_ret_t cw_gen_silence_internal(cw_gen_t * gen)
 		return CW_SUCCESS;
 	}
 
-#if 1
 	/* Tell 'dequeue and generate' thread function to go silent.
 
 	   TODO: What if the last tone on queue is a Very Long Tone,
@@ -408,70 +616,6 @@ cw_ret_t cw_gen_silence_internal(cw_gen_t * gen)
 	}
 
 	return cwret;
-
-#else
-
-	/* TODO: Tone queue may have e.g. 10 tones enqueued at this
-	   moment. To have a "gentle" silencing of generator, we shouldn't
-	   interrupt in the middle of current tone. What we should do is:
-	   - remove all tones ahead of current tone (perhaps starting from
-	   the end).
-	   - see how long the current tone is. If it's relatively short, let
-	   it play to the end, but if it's long tone, interrupt it.
-	   - see if the current tone is "forever" tone. If it is, end the
-	   "forever" tone using method suitable for such tone.
-	   - only after all this you can enqueue a tone silent that will
-	     ensure that a key is not in "down" state.
-
-	   What if the last tone on queue is a Very Long Tone, and silencing
-	   the generator will take a long time?
-	*/
-
-	/* Somewhere there may be a key in "down" state and we need to make
-	   it go "up", regardless of sound sink (even for CW_AUDIO_NULL,
-	   because that sound system can also be used with a key).  Otherwise
-	   the key may stay in "down" state forever and the sound will be
-	   played after "silencing" of the generator. */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
-	cw_ret_t status = cw_tq_enqueue_internal(gen->tq, &tone);
-	/* Reset on stopping of the generator. */
-	gen->space_units_count = 0;
-
-	if (gen->sound_system == CW_AUDIO_NULL
-	    || gen->sound_system == CW_AUDIO_OSS
-	    || gen->sound_system == CW_AUDIO_ALSA
-	    || gen->sound_system == CW_AUDIO_PA) {
-
-		/* Allow some time for playing the last tone. */
-		usleep(2 * tone.duration);
-
-	} else if (gen->sound_system == CW_AUDIO_CONSOLE) {
-		/* Sine wave generation should have been stopped
-		   by a code generating dots/dashes, but
-		   just in case...
-
-		   TODO: is it still necessary after adding the
-		   quantum of silence above? */
-		cw_console_silence_internal(gen);
-	} else {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-			      MSG_PREFIX "called silence() function for generator without sound system specified");
-	}
-
-	if (gen->sound_system == CW_AUDIO_ALSA) {
-		/* "Stop a PCM dropping pending frames. " */
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
-			      MSG_PREFIX "asking ALSA to drop frames on silence()");
-		cw_alsa_drop_internal(gen);
-	}
-
-	/* TODO: we just want to silence the generator, right? So we don't stop it.
-	   This line of code has been disabled some time before 2017-01-26. */
-	//gen->do_dequeue_and_generate = false;
-
-	return status;
-#endif
 }
 
 
@@ -485,11 +629,22 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 	cw_assert (gen_conf->sound_system != CW_AUDIO_NONE, MSG_PREFIX "can't create generator with sound system '%s'", cw_get_audio_system_label(gen_conf->sound_system));
 
-	cw_gen_t * gen = (cw_gen_t *) calloc(1, sizeof (cw_gen_t));
+	/* Groups of fields of generator are aligned to cache lines. */
+	cw_gen_t * gen = (cw_gen_t *) cw_calloc_aligned_internal(sizeof (cw_gen_t));
 	if (NULL == gen) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "calloc()");
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR, MSG_PREFIX "posix_memalign()");
 		return (cw_gen_t *) NULL;
 	}
+	pthread_mutex_init(&gen->pending_parameters.mutex, NULL);
+	pthread_mutex_init(&gen->thread.mutex, NULL);
+	pthread_cond_init(&gen->thread.cond, NULL);
+	pthread_mutex_init(&gen->pipeline.mutex, NULL);
+	pthread_cond_init(&gen->pipeline.cond, NULL);
+	pthread_mutex_init(&gen->tokens.enqueue_mutex, NULL);
+	pthread_mutex_init(&gen->tokens.mutex, NULL);
+	pthread_cond_init(&gen->tokens.cond, NULL);
+	gen->modulation.gain = CW_GEN_GAIN_ONE;
+	gen->modulation.gain_target = CW_GEN_GAIN_ONE;
 
 
 
@@ -503,6 +658,13 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 			/* Sometimes tq needs to access a key associated with generator. */
 			gen->tq->gen = gen;
 		}
+
+		if (gen_conf->multi_producer_queue && CW_SUCCESS != cw_tq_set_multi_producer_internal(gen->tq, true)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to set multi-producer mode of tone queue");
+			cw_gen_delete(&gen);
+			return (cw_gen_t *) NULL;
+		}
 	}
 
 
@@ -518,14 +680,11 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		gen->weighting = CW_WEIGHTING_INITIAL;
 
 
-		/* Generator's timing parameters. */
-		gen->durations.dot_duration = 0;
-		gen->durations.dash_duration = 0;
-		gen->durations.ims_duration = 0;
-		gen->durations.ics_duration = 0;
-		gen->durations.iws_duration = 0;
-		gen->durations.additional_space_duration = 0;
-		gen->durations.adjustment_space_duration = 0;
+		/* Generator's timing parameters. Timing block is
+		   taken on first synchronization of parameters. */
+		gen->timing = NULL;
+		memset(&gen->own_durations, 0, sizeof (gen->own_durations));
+		gen->durations = &gen->own_durations;
 
 
 		/* Generator's misc parameters. */
@@ -541,19 +700,53 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 	{
 		/* Sound buffer and related items. */
 		gen->buffer = NULL;
+		gen->own_buffer = NULL;
+		gen->sinks = NULL;
+		gen->timing_monitor = NULL;
+		gen->tap = NULL;
+		gen->quality_scaling = NULL;
+		gen->quality = CW_GEN_QUALITY_FULL;
+		gen->memories = NULL;
+		gen->dsp = NULL;
+		gen->out_buffer = NULL;
+		gen->out_n_samples = 0;
 		gen->buffer_n_samples = -1;
+		gen->sample_format = CW_SAMPLE_FORMAT_S16;
+		gen->n_channels = 1;
+		gen->device_buffer = NULL;
+		gen->device_buffer_filled = false;
 		gen->buffer_sub_start = 0;
 		gen->buffer_sub_stop  = 0;
 
 		gen->sample_rate = 0;
 		gen->phase_offset = -1;
+		gen->phase_acc = 0;
+
+		switch (gen_conf->oscillator) {
+		case CW_GEN_OSCILLATOR_SINF:
+		case CW_GEN_OSCILLATOR_PHASOR:
+		case CW_GEN_OSCILLATOR_TABLE:
+		case CW_GEN_OSCILLATOR_FIXED_POINT:
+			gen->oscillator = gen_conf->oscillator;
+			break;
+		default:
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "unsupported oscillator %d, falling back to default", gen_conf->oscillator);
+			gen->oscillator = CW_GEN_OSCILLATOR_SINF;
+			break;
+		}
 
 
 		/* Tone parameters. */
 		gen->tone_slope.duration = CW_AUDIO_SLOPE_DURATION;
 		gen->tone_slope.shape = CW_TONE_SLOPE_SHAPE_RAISED_COSINE;
 		gen->tone_slope.amplitudes = NULL;
+		gen->tone_slope.amplitudes_fixed = NULL;
 		gen->tone_slope.n_amplitudes = 0;
+		gen->tone_slope.capacity = 0;
+		gen->tone_slope.calculated_sample_rate = 0;
+		gen->tone_slope.calculated_shape = -1;
+		gen->tone_slope.calculated_n_amplitudes = -1;
 
 
 		/* Library's client. */
@@ -587,6 +780,49 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 	/* Sound system. */
 	{
 		/* gen->sound_system = sound_system; */ /* We handle this field below. */
+		gen->sound_device_latency = 0;
+
+		gen->sound_nonblocking = false;
+		gen->wakeup_fds[0] = -1;
+		gen->wakeup_fds[1] = -1;
+		gen->sound_wait_cancelled = false;
+		gen->device_pool.enabled = false;
+		gen->device_pool.slot = -1;
+
+		gen->sidetone.enabled = gen_conf->sidetone_low_latency;
+		gen->sidetone.cut_requested = false;
+		gen->sidetone.silent_run = 0;
+		gen->sidetone.writing_silence = false;
+
+		gen->standby_on_stop = gen_conf->standby_on_stop;
+		gen->standby = false;
+		gen->preallocated = false;
+		gen->flush_on_empty_queue = gen_conf->flush_on_empty_queue;
+		gen->end_of_sound_time = -1;
+		gen->scheduled_start = 0;
+		gen->device_clock.drift_compensation = gen_conf->drift_compensation;
+
+		gen->thread.sched_policy = gen_conf->thread_sched_policy;
+		gen->thread.sched_priority = gen_conf->thread_sched_priority;
+		gen->thread.cpu_affinity = gen_conf->thread_cpu_affinity;
+		gen->thread.lock_memory = gen_conf->lock_memory;
+
+		/* Set by sound systems that pull samples from generator. */
+		gen->start_sound_device = NULL;
+		gen->stop_sound_device = NULL;
+		/* Set by sound systems that can change size of writes. */
+		gen->set_sound_device_write_size = NULL;
+		/* Set by sound systems that can be paused when generator is idle. */
+		gen->pause_sound_device = NULL;
+		gen->resume_sound_device = NULL;
+		gen->idle.timeout = gen_conf->idle_timeout > 0 ? (int64_t) gen_conf->idle_timeout * 1000 : 0;
+		gen->idle.silence_duration = 0;
+		gen->idle.paused = false;
+		if (gen_conf->sound_nonblocking) {
+			/* Without the descriptor sound systems will use
+			   blocking writes. */
+			gen->sound_nonblocking = CW_SUCCESS == cw_gen_new_wakeup_internal(gen);
+		}
 
 #ifdef ENABLE_DEV_PCM_SAMPLES_FILE
 		gen->dev_raw_sink = -1;
@@ -612,6 +848,24 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		/* Sound system - PulseAudio. */
 #ifdef LIBCW_WITH_PULSEAUDIO
 		gen->pa_data.simple = NULL;
+		gen->pa_data.mainloop = NULL;
+		gen->pa_data.context = NULL;
+		gen->pa_data.stream = NULL;
+		gen->pa_data.rendering = false;
+#endif
+
+		/* Sound system - JACK. */
+#ifdef LIBCW_WITH_JACK
+		gen->jack_data.client = NULL;
+		gen->jack_data.port = NULL;
+		gen->jack_data.rendering = false;
+#endif
+
+		/* Sound system - PipeWire. */
+#ifdef LIBCW_WITH_PIPEWIRE
+		gen->pipewire_data.loop = NULL;
+		gen->pipewire_data.stream = NULL;
+		gen->pipewire_data.rendering = false;
 #endif
 
 		cw_ret_t cwret = cw_gen_new_open_internal(gen, gen_conf);
@@ -629,13 +883,33 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 
 			; /* The two types of sound output don't require audio buffer. */
 		} else {
-			gen->buffer = (cw_sample_t *) calloc(gen->buffer_n_samples, sizeof (cw_sample_t));
+			gen->own_buffer = (cw_sample_t *) calloc(gen->buffer_n_samples, sizeof (cw_sample_t));
+			gen->buffer = gen->own_buffer;
 			if (!gen->buffer) {
 				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
 					      MSG_PREFIX "calloc()");
 				cw_gen_delete(&gen);
 				return (cw_gen_t *) NULL;
 			}
+
+			/* Sound sink has negotiated format of samples
+			   other than format of ::buffer. */
+			if (CW_SAMPLE_FORMAT_S16 != gen->sample_format || 1 != gen->n_channels) {
+				gen->device_buffer = calloc((size_t) gen->buffer_n_samples, cw_gen_frame_size_internal(gen));
+				if (!gen->device_buffer) {
+					cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+						      MSG_PREFIX "calloc()");
+					cw_gen_delete(&gen);
+					return (cw_gen_t *) NULL;
+				}
+			}
+
+			if (CW_SUCCESS != cw_gen_pipeline_new_internal(gen, gen_conf->pipeline_n_buffers)) {
+				cw_gen_delete(&gen);
+				return (cw_gen_t *) NULL;
+			}
+
+			cw_gen_adaptive_period_new_internal(gen, gen_conf);
 		}
 
 		/* Set slope that late, because it uses value of sample rate.
@@ -648,6 +922,13 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 			cw_gen_delete(&gen);
 			return (cw_gen_t *) NULL;
 		}
+
+		if (gen_conf->preallocate && CW_SUCCESS != cw_gen_preallocate_internal(gen)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to preallocate memory of generator");
+			cw_gen_delete(&gen);
+			return (cw_gen_t *) NULL;
+		}
 	}
 
 	/* Tracking of generator's value. */
@@ -655,6 +936,8 @@ cw_gen_t * cw_gen_new(const cw_gen_config_t * gen_conf)
 		gen->value_tracking.value = CW_KEY_VALUE_OPEN;
 		gen->value_tracking.value_tracking_callback_func = NULL;
 		gen->value_tracking.value_tracking_callback_arg = NULL;
+		gen->value_tracking.timed_callback_func = NULL;
+		gen->value_tracking.timed_callback_arg = NULL;
 	}
 #if 0
 	/* Part of old inter-thread comm. Disabled on 2020-09-01. */
@@ -675,23 +958,50 @@ void cw_gen_delete(cw_gen_t **gen)
 	}
 
 	if ((*gen)->do_dequeue_and_generate) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
-			      MSG_PREFIX "you forgot to call cw_gen_stop()");
+		if (!(*gen)->standby) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+				      MSG_PREFIX "you forgot to call cw_gen_stop()");
+		}
+		/* Stop for real: thread has to be joined before
+		   generator's resources are freed. */
+		(*gen)->standby_on_stop = false;
+		(*gen)->standby = false;
 		cw_gen_stop(*gen);
 	}
 
-	/* Wait for "write" thread to end accessing output
-	   file descriptor. I have come up with value 500
-	   after doing some experiments.
-
-	   FIXME: magic number. I think that we can come up
-	   with algorithm for calculating the value. */
-	usleep(500);
-
-	free((*gen)->buffer);
+	/* Generator's thread (if any) has been joined by
+	   cw_gen_stop(), so nothing is writing to sound device
+	   anymore. */
+
+	cw_gen_sinks_delete_internal(*gen);
+	cw_gen_timing_monitor_delete_internal(*gen);
+	cw_timing_release_internal(&(*gen)->timing);
+	cw_gen_tap_delete_internal(*gen);
+	cw_gen_quality_delete_internal(*gen);
+	cw_gen_memories_delete_internal(*gen);
+	cw_gen_dsp_delete_internal(*gen);
+
+	for (int i = 1; i < (*gen)->pipeline.n_buffers; i++) {
+		free((*gen)->pipeline.buffers[i]);
+		(*gen)->pipeline.buffers[i] = NULL;
+	}
+	(*gen)->pipeline.n_buffers = 0;
+	free((*gen)->own_buffer);
+	(*gen)->own_buffer = NULL;
+	free((*gen)->device_buffer);
+	(*gen)->device_buffer = NULL;
+
+	if (-1 != (*gen)->wakeup_fds[0]) {
+		close((*gen)->wakeup_fds[0]);
+		if ((*gen)->wakeup_fds[1] != (*gen)->wakeup_fds[0]) {
+			close((*gen)->wakeup_fds[1]);
+		}
+	}
 	(*gen)->buffer = NULL;
 
-	if ((*gen)->close_sound_device) {
+	if (cw_device_pool_release_internal(*gen)) {
+		/* Device will be used by another generator. */
+	} else if ((*gen)->close_sound_device) {
 		(*gen)->close_sound_device(*gen);
 	} else {
 		/* This may happen e.g. when generator was not created properly
@@ -717,9 +1027,29 @@ void cw_gen_delete(cw_gen_t **gen)
 
 	free((*gen)->tone_slope.amplitudes);
 	(*gen)->tone_slope.amplitudes = NULL;
+	free((*gen)->tone_slope.amplitudes_fixed);
+	(*gen)->tone_slope.amplitudes_fixed = NULL;
+
+	for (int i = 0; i < CW_GEN_TONE_CACHE_N_ENTRIES; i++) {
+		free((*gen)->tone_cache.entries[i].samples);
+		(*gen)->tone_cache.entries[i].samples = NULL;
+	}
+	free((*gen)->plateau_loop.samples);
+	(*gen)->plateau_loop.samples = NULL;
 
 	cw_tq_delete_internal(&(*gen)->tq);
 
+	pthread_mutex_destroy(&(*gen)->pending_parameters.mutex);
+	pthread_cond_destroy(&(*gen)->thread.cond);
+	pthread_mutex_destroy(&(*gen)->thread.mutex);
+	pthread_cond_destroy(&(*gen)->pipeline.cond);
+	pthread_mutex_destroy(&(*gen)->pipeline.mutex);
+	free((*gen)->tokens.pending);
+	(*gen)->tokens.pending = NULL;
+	pthread_cond_destroy(&(*gen)->tokens.cond);
+	pthread_mutex_destroy(&(*gen)->tokens.mutex);
+	pthread_mutex_destroy(&(*gen)->tokens.enqueue_mutex);
+
 	(*gen)->sound_system = CW_AUDIO_NONE;
 
 	free(*gen);
@@ -771,17 +1101,49 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 #13 main (argc=<optimized out>, argv=<optimized out>) at cw.c:652
 	*/
 
-	cw_tq_flush_internal(gen->tq);
+	cw_gen_flush_tone_queue_internal(gen);
 
 	if (CW_SUCCESS != cw_gen_silence_internal(gen)) {
 		return CW_FAILURE;
 	}
 
+	if (gen->standby_on_stop && gen->do_dequeue_and_generate) {
+		/* Warm standby: don't join the thread and don't stop
+		   sound device. With empty tone queue the thread waits
+		   for next tone, and pull-model sound device renders
+		   silence. */
+		if (gen->key) {
+			cw_key_ik_reset_state_internal(gen->key);
+			cw_key_sk_reset_state_internal(gen->key);
+		}
+		gen->standby = true;
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+			      MSG_PREFIX "generator is in standby");
+		return CW_SUCCESS;
+	}
+
 	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
 		      MSG_PREFIX "setting gen->do_dequeue_and_generate to false");
 
 	gen->do_dequeue_and_generate = false;
 
+	/* Thread function may be waiting for non-blocking sound device.
+	   Let it abandon the write. */
+	__atomic_store_n(&gen->sound_wait_cancelled, true, __ATOMIC_SEQ_CST);
+	cw_gen_wakeup_internal(gen);
+
+	if (gen->stop_sound_device) {
+		/* There is no generator's thread to join. Samples that
+		   are buffered in sound device are dropped. */
+		gen->stop_sound_device(gen);
+		cw_tq_wake_all_internal(gen->tq);
+		if (gen->key) {
+			cw_key_ik_reset_state_internal(gen->key);
+			cw_key_sk_reset_state_internal(gen->key);
+		}
+		return CW_SUCCESS;
+	}
+
 	if (!gen->thread.running) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_INFO, MSG_PREFIX "EXIT: seems that thread function was not started at all");
 
@@ -804,9 +1166,7 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 	  that gen->do_dequeue_and_generate is false, and to get the thread
 	  function to return (and thus to end the thread).
 	*/
-	pthread_mutex_lock(&gen->tq->wait_mutex);
-	pthread_cond_broadcast(&gen->tq->wait_var);
-	pthread_mutex_unlock(&gen->tq->wait_mutex);
+	cw_tq_wake_all_internal(gen->tq);
 #if 0
 	/* Original implementation using signals. */
 	/* This was disabled some time before 2017-01-19. */
@@ -851,24 +1211,11 @@ cw_ret_t cw_gen_stop(cw_gen_t * gen)
 */
 cw_ret_t cw_gen_join_thread_internal(cw_gen_t * gen)
 {
-	/* TODO: this comment may no longer be true and necessary.
-	   Sleep a bit to postpone closing a device.  This way we can
-	   avoid a situation when "do_dequeue_and_generate" is set to false
-	   and device is being closed while a new buffer is being
-	   prepared, and while write() tries to write this new buffer
-	   to already closed device.
-
-	   Without this sleep(), writei() from ALSA library may
-	   return "File descriptor in bad state" error - this
-	   happened when writei() tried to write to closed ALSA
-	   handle.
-
-	   The delay also allows the generator function thread to stop
-	   generating tone (or for tone queue to get out of CW_TQ_EMPTY state
-	   (TODO: verify this comment, does it describe correct tq state?)
-	   and exit before we resort to killing generator function thread. */
-	cw_usleep_internal(1 * CW_USECS_PER_SEC);
-
+	/* No sleep is needed before joining. The thread has been woken
+	   up (from waiting on tone queue or on non-blocking sound
+	   device) by caller, and pthread_join() returns only after the
+	   thread's last write to sound device has completed. Sound
+	   device is closed only after that, by cw_gen_delete(). */
 
 #if LIBCW_GEN_DEBUG_THREAD_TIMING
 	/* Debug code to measure how long it takes to join threads. */
@@ -902,6 +1249,173 @@ cw_ret_t cw_gen_join_thread_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Create descriptor used to wake up generator waiting for non-blocking sound device
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_new_wakeup_internal(cw_gen_t * gen)
+{
+	int fds[2] = { -1, -1 };
+#if defined(HAVE_SYS_EVENTFD_H)
+	fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	fds[1] = fds[0];
+#else
+	if (0 == pipe(fds)) {
+		for (int i = 0; i < 2; i++) {
+			fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+			fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+#endif
+	if (-1 == fds[0]) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to create wakeup descriptor, sound device will be blocking");
+		return CW_FAILURE;
+	}
+
+	gen->wakeup_fds[0] = fds[0];
+	gen->wakeup_fds[1] = fds[1];
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Make wakeup descriptor of generator readable
+
+   @param[in] gen generator
+*/
+static void cw_gen_wakeup_internal(cw_gen_t * gen)
+{
+	if (-1 == gen->wakeup_fds[1]) {
+		return;
+	}
+	/* Descriptor is non-blocking. If it is already full, it is
+	   readable anyway, so result of write is ignored. */
+#if defined(HAVE_SYS_EVENTFD_H)
+	const uint64_t value = 1;
+#else
+	const char value = 1;
+#endif
+	const ssize_t rv = write(gen->wakeup_fds[1], &value, sizeof (value));
+	(void) rv;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Make wakeup descriptor of generator non-readable
+
+   @param[in] gen generator
+*/
+static void cw_gen_clear_wakeup_internal(cw_gen_t * gen)
+{
+	if (-1 == gen->wakeup_fds[0]) {
+		return;
+	}
+#if defined(HAVE_SYS_EVENTFD_H)
+	uint64_t value = 0;
+#else
+	char value[16];
+#endif
+	while (read(gen->wakeup_fds[0], &value, sizeof (value)) > 0) {
+		;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait until non-blocking sound device can accept more samples
+
+   To be used by sound systems in non-blocking mode
+   (gen->sound_nonblocking) instead of blocking in write. The function
+   waits with poll() for events on sound device's descriptors @p fds, and
+   for wakeup of the generator by cw_gen_stop().
+
+   On success, revents of @p fds are set, and the caller should check
+   them. The function gives up when generator is being stopped, so
+   that the caller can abandon writing of current buffer instead of
+   waiting for the device to accept it. The function also gives up when
+   the buffer contains only silence, and key has just gone down (see
+   cw_gen_t::sidetone).
+
+   @exception ECANCELED generator is being stopped, or silence is abandoned for sidetone
+
+   @param[in] gen generator
+   @param[in/out] fds descriptors of sound device, with events to wait for
+   @param[in] n_fds count of descriptors in @p fds, no larger than CW_GEN_SOUND_POLL_FDS_MAX
+
+   @return CW_SUCCESS when there is an event on at least one of @p fds
+   @return CW_FAILURE when generator is being stopped or on errors
+*/
+cw_ret_t cw_gen_wait_for_sound_device_internal(cw_gen_t * gen, struct pollfd * fds, int n_fds)
+{
+	struct pollfd all_fds[CW_GEN_SOUND_POLL_FDS_MAX + 1];
+	if (n_fds > CW_GEN_SOUND_POLL_FDS_MAX) {
+		n_fds = CW_GEN_SOUND_POLL_FDS_MAX;
+	}
+	memcpy(all_fds, fds, sizeof (all_fds[0]) * (size_t) n_fds);
+	all_fds[n_fds].fd = gen->wakeup_fds[0];
+	all_fds[n_fds].events = POLLIN;
+	all_fds[n_fds].revents = 0;
+
+	while (true) {
+		if (__atomic_load_n(&gen->sound_wait_cancelled, __ATOMIC_SEQ_CST)) {
+			errno = ECANCELED;
+			return CW_FAILURE;
+		}
+		if (gen->sidetone.writing_silence
+		    && __atomic_load_n(&gen->sidetone.cut_requested, __ATOMIC_SEQ_CST)) {
+			/* Nobody will miss this buffer. */
+			errno = ECANCELED;
+			return CW_FAILURE;
+		}
+
+		const int rv = poll(all_fds, (nfds_t) n_fds + 1, -1);
+		if (-1 == rv) {
+			if (EINTR == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "wait for sound device: poll(): '%s'", strerror(errno));
+			return CW_FAILURE;
+		}
+
+		if (all_fds[n_fds].revents) {
+			/* Cancellation is checked at the beginning of
+			   next iteration. */
+			cw_gen_clear_wakeup_internal(gen);
+		}
+
+		bool device_event = false;
+		for (int i = 0; i < n_fds; i++) {
+			fds[i].revents = all_fds[i].revents;
+			if (all_fds[i].revents) {
+				device_event = true;
+			}
+		}
+		if (device_event) {
+			return CW_SUCCESS;
+		}
+	}
+}
+
+
+
+
 /**
    @brief Open sound system
 
@@ -929,10 +1443,16 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 	/* This function deliberately checks all possible values of
 	   sound system name in separate 'if' clauses before it gives
 	   up and returns CW_FAILURE. PA/OSS/ALSA are combined with
-	   SOUNDCARD, so I have to check all three of them (because @p
-	   sound_system may be set to SOUNDCARD). And since I check
-	   the three in separate 'if' clauses, I can check all other
-	   values of sound system as well. */
+	   SOUNDCARD, which is resolved to one of the three by
+	   cw_gen_new_open_soundcard_internal(). */
+
+	if (gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
+		return cw_gen_new_open_soundcard_internal(gen, gen_conf);
+	}
+
+	if (cw_device_pool_acquire_internal(gen, gen_conf)) {
+		return CW_SUCCESS;
+	}
 
 
 	if (gen_conf->sound_system == CW_AUDIO_NULL) {
@@ -943,8 +1463,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 		}
 	}
 
-	if (gen_conf->sound_system == CW_AUDIO_PA
-	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
+	if (gen_conf->sound_system == CW_AUDIO_PA) {
 
 		if (cw_is_pa_possible(gen_conf->sound_device)) {
 			cw_pa_init_gen_internal(gen);
@@ -952,8 +1471,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 		}
 	}
 
-	if (gen_conf->sound_system == CW_AUDIO_OSS
-	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
+	if (gen_conf->sound_system == CW_AUDIO_OSS) {
 
 		if (cw_is_oss_possible(gen_conf->sound_device)) {
 			cw_oss_init_gen_internal(gen);
@@ -961,8 +1479,7 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 		}
 	}
 
-	if (gen_conf->sound_system == CW_AUDIO_ALSA
-	    || gen_conf->sound_system == CW_AUDIO_SOUNDCARD) {
+	if (gen_conf->sound_system == CW_AUDIO_ALSA) {
 
 		if (cw_is_alsa_possible(gen_conf->sound_device)) {
 			cw_alsa_init_gen_internal(gen);
@@ -970,6 +1487,40 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 		}
 	}
 
+	/* JACK and PipeWire are used only when they are explicitly
+	   requested, they are not a part of CW_AUDIO_SOUNDCARD. */
+	if (gen_conf->sound_system == CW_AUDIO_PIPEWIRE) {
+
+		if (cw_is_pipewire_possible(gen_conf->sound_device)) {
+			cw_pipewire_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
+	if (gen_conf->sound_system == CW_AUDIO_JACK) {
+
+		if (cw_is_jack_possible(gen_conf->sound_device)) {
+			cw_jack_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
+	if (gen_conf->sound_system == CW_AUDIO_RTP) {
+
+		if (cw_is_rtp_possible(gen_conf->sound_device)) {
+			cw_rtp_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
+	if (gen_conf->sound_system == CW_AUDIO_FILE) {
+
+		if (cw_is_file_possible(gen_conf->sound_device)) {
+			cw_file_init_gen_internal(gen);
+			return gen->open_and_configure_sound_device(gen, gen_conf);
+		}
+	}
+
 	if (gen_conf->sound_system == CW_AUDIO_CONSOLE) {
 
 		if (cw_is_console_possible(gen_conf->sound_device)) {
@@ -986,68 +1537,248 @@ cw_ret_t cw_gen_new_open_internal(cw_gen_t * gen, const cw_gen_config_t * gen_co
 
 
 /**
-   @brief Dequeue tones and push them to sound output
+   @brief Open sound system for CW_AUDIO_SOUNDCARD
 
-   This is a thread function.
+   Sound system remembered in on-disk cache for requested device is
+   tried first. If it fails, PulseAudio, OSS and ALSA are probed in
+   parallel, and the one that has been successfully opened is
+   remembered.
 
-   Function dequeues tones from tone queue associated with generator
-   and then sends them to preconfigured sound output (soundcard, NULL
-   or console).
+   @param[in] gen generator for which to open a sound system
+   @param[in] gen_conf configuration with CW_AUDIO_SOUNDCARD sound system
 
-   Function dequeues tones (or waits for new tones in queue) and pushes them
-   to sound output as long as generator->do_dequeue_and_generate is true.
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_gen_new_open_soundcard_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	cw_gen_config_t conf = *gen_conf;
 
-   The generator must be fully configured before creating thread with
-   this function.
+	const int cached = cw_probe_cache_read_internal(gen_conf->sound_device);
+	if (CW_AUDIO_NONE != cached) {
+		conf.sound_system = cached;
+		if (CW_SUCCESS == cw_gen_new_open_internal(gen, &conf)) {
+			return CW_SUCCESS;
+		}
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "cached sound system %s is not available anymore",
+			      cw_get_audio_system_label(cached));
+	}
 
-   @internal
-   @reviewed 2020-10-17
-   @endinternal
+	conf.sound_system = cw_probe_soundcard_internal(gen_conf->sound_device);
+	if (CW_AUDIO_NONE == conf.sound_system || cached == (int) conf.sound_system) {
+		return CW_FAILURE;
+	}
+	if (CW_SUCCESS != cw_gen_new_open_internal(gen, &conf)) {
+		return CW_FAILURE;
+	}
+	cw_probe_cache_write_internal(gen_conf->sound_device, conf.sound_system);
 
-   @param[in] arg generator (cast to (void *)) to be used for generating tones
+	return CW_SUCCESS;
+}
 
-   @return NULL pointer
-*/
-void * cw_gen_dequeue_and_generate_internal(void * arg)
-{
-	cw_gen_t * gen = (cw_gen_t *) arg;
 
-	const char name_prefix[] = "deq ";
-	char name[sizeof (name_prefix) + sizeof (gen->label)] = { 0 };
-	snprintf(name, sizeof (name), "%s%s\n", name_prefix, gen->label);
-	name[15] = '\0';
-#if defined(__linux__)
-	/* Choosing prctl() over pthread_setname_np() for Linux
-	   because prctl doesn't require explicit "#define
-	   _GNU_SOURCE". */
-	prctl(PR_SET_NAME, name, 0, 0, 0);
-#elif defined(__FreeBSD__)
-	pthread_set_name_np(pthread_self(), name);
-#endif
 
-	/* Tone dequeued in previous call to cw_tq_dequeue_internal(). */
-	cw_tone_t prev_tone = { 0 };
 
-	/* Tone dequeued in current call to cw_tq_dequeue_internal(). */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+/**
+   @brief Apply realtime configuration to generator's thread
 
-	while (gen->do_dequeue_and_generate) {
-		const cw_queue_state_t queue_state = cw_tq_dequeue_internal(gen->tq, &tone);
-		if (CW_TQ_EMPTY == queue_state) {
+   Called by generator's thread function for itself, before the thread
+   starts generating tones. Problems are reported as warnings: the
+   thread then generates tones with default scheduling, as it always
+   did.
 
-			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
-				      MSG_PREFIX "Detected empty queue");
+   Only generator's own thread is configured. Sound systems that pull
+   samples from generator (JACK, PipeWire, asynchronous PulseAudio) call
+   the generator from their own threads, which are scheduled by the
+   sound server.
+
+   @param[in] gen generator
+*/
+static void cw_gen_thread_setup_realtime_internal(cw_gen_t * gen)
+{
+	if (SCHED_FIFO == gen->thread.sched_policy || SCHED_RR == gen->thread.sched_policy) {
+		const struct sched_param param = { .sched_priority = gen->thread.sched_priority };
+		const int rv = pthread_setschedparam(pthread_self(), gen->thread.sched_policy, &param);
+		if (0 != rv) {
+			/* Typically EPERM: process doesn't have
+			   CAP_SYS_NICE and RLIMIT_RTPRIO is too low. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to set realtime scheduling of generator thread (policy %d, priority %d): %s",
+				      gen->thread.sched_policy, gen->thread.sched_priority, strerror(rv));
+		}
+	}
+
+	if (0 != gen->thread.cpu_affinity) {
+#if defined(__linux__) && defined(CPU_SET)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu = 0; cpu < (int) (8 * sizeof (gen->thread.cpu_affinity)) && cpu < CPU_SETSIZE; cpu++) {
+			if (gen->thread.cpu_affinity & (1ULL << cpu)) {
+				CPU_SET(cpu, &cpus);
+			}
+		}
+		const int rv = pthread_setaffinity_np(pthread_self(), sizeof (cpus), &cpus);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to set CPU affinity %#llx of generator thread: %s",
+				      gen->thread.cpu_affinity, strerror(rv));
+		}
+#else
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "CPU affinity of generator thread is not supported on this platform");
+#endif
+	}
+
+	if (gen->thread.lock_memory) {
+		/* MCL_FUTURE: tables of slope amplitudes and tone
+		   cache are (re)allocated during generator's life. */
+		if (0 != mlockall(MCL_CURRENT | MCL_FUTURE)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "failed to lock memory: %s", strerror(errno));
+		}
+
+		/* Fault-in pages of buffers now instead of on first
+		   write of samples. This is done also when mlockall()
+		   fails. */
+		if (gen->own_buffer) {
+			cw_gen_prefault_internal(gen->own_buffer, (size_t) gen->buffer_n_samples * sizeof (cw_sample_t));
+		}
+		for (int i = 1; i < gen->pipeline.n_buffers; i++) {
+			cw_gen_prefault_internal(gen->pipeline.buffers[i], (size_t) gen->buffer_n_samples * sizeof (cw_sample_t));
+		}
+		if (gen->device_buffer) {
+			cw_gen_prefault_internal(gen->device_buffer, (size_t) gen->buffer_n_samples * cw_gen_frame_size_internal(gen));
+		}
+		if (gen->tone_slope.amplitudes) {
+			cw_gen_prefault_internal(gen->tone_slope.amplitudes, (size_t) gen->tone_slope.n_amplitudes * sizeof (float));
+		}
+		if (gen->tone_slope.amplitudes_fixed) {
+			cw_gen_prefault_internal(gen->tone_slope.amplitudes_fixed, (size_t) gen->tone_slope.n_amplitudes * sizeof (int32_t));
+		}
+
+		/* Stack of the thread. */
+		unsigned char stack[64 * 1024];
+		cw_gen_prefault_internal(stack, sizeof (stack));
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Touch every page of given memory
+
+   Contents of the memory are not changed.
+
+   @param[in] memory memory to touch
+   @param[in] size size of memory
+*/
+static void cw_gen_prefault_internal(void * memory, size_t size)
+{
+	const long page_size = sysconf(_SC_PAGESIZE);
+	const size_t step = page_size > 0 ? (size_t) page_size : 4096;
+	volatile unsigned char * bytes = (volatile unsigned char *) memory;
+	for (size_t i = 0; i < size; i += step) {
+		bytes[i] = bytes[i];
+	}
+	return;
+}
+
+
+
+
+/**
+   @brief Dequeue tones and push them to sound output
+
+   This is a thread function.
+
+   Function dequeues tones from tone queue associated with generator
+   and then sends them to preconfigured sound output (soundcard, NULL
+   or console).
+
+   Function dequeues tones (or waits for new tones in queue) and pushes them
+   to sound output as long as generator->do_dequeue_and_generate is true.
+
+   The generator must be fully configured before creating thread with
+   this function.
+
+   @internal
+   @reviewed 2020-10-17
+   @endinternal
+
+   @param[in] arg generator (cast to (void *)) to be used for generating tones
+
+   @return NULL pointer
+*/
+void * cw_gen_dequeue_and_generate_internal(void * arg)
+{
+	cw_gen_t * gen = (cw_gen_t *) arg;
+
+	const char name_prefix[] = "deq ";
+	char name[sizeof (name_prefix) + sizeof (gen->label)] = { 0 };
+	snprintf(name, sizeof (name), "%s%s\n", name_prefix, gen->label);
+	name[15] = '\0';
+#if defined(__linux__)
+	/* Choosing prctl() over pthread_setname_np() for Linux
+	   because prctl doesn't require explicit "#define
+	   _GNU_SOURCE". */
+	prctl(PR_SET_NAME, name, 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), name);
+#endif
+
+	cw_gen_thread_setup_realtime_internal(gen);
+	cw_gen_pipeline_start_internal(gen);
+
+	pthread_mutex_lock(&gen->thread.mutex);
+	gen->thread.ready = true;
+	pthread_cond_broadcast(&gen->thread.cond);
+	pthread_mutex_unlock(&gen->thread.mutex);
+
+	/* Tone dequeued in previous call to cw_tq_dequeue_internal(). */
+	cw_tone_t prev_tone = { 0 };
+
+	/* Tone dequeued in current call to cw_tq_dequeue_internal(). */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+
+	while (gen->do_dequeue_and_generate) {
+		const cw_queue_state_t queue_state = cw_tq_dequeue_internal(gen->tq, &tone);
+		if (CW_TQ_EMPTY == queue_state) {
+
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+				      MSG_PREFIX "Detected empty queue");
 
 			cw_gen_value_tracking_internal(gen, &tone, queue_state);
+
+			/* No character of memory is being played now. */
+			cw_gen_memories_release_retired_internal(gen);
+
+			/* Samples of last tones must reach sound device
+			   before the device is drained. */
+			if (gen->flush_on_empty_queue) {
+				cw_gen_flush_buffer_internal(gen);
+			}
+			bool device_drained = false;
 #if 1
 			if (gen->on_empty_queue) {
 				if (CW_SUCCESS != gen->on_empty_queue(gen)) {
 					cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
 						      MSG_PREFIX "handling of empty queue by generator has failed");
+				} else {
+					device_drained = true;
 				}
 			}
 #endif
+			cw_gen_record_end_of_sound_internal(gen, device_drained);
+
+			/* Device may run out of samples while the queue
+			   is empty, so samples written after this point
+			   don't continue measurement of device's clock. */
+			__atomic_store_n(&gen->device_clock.restart, true, __ATOMIC_RELAXED);
 
 			/* We won't get here while there are some
 			   accumulated tones in queue, because
@@ -1072,14 +1803,8 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 			/* The 'while' loop handles spurious wakeups of
 			   pthread_cond_wait() and also ensures that the
 			   wait() function is called only when a wait is
-			   necessary. TODO: make sure that getting
-			   gen->tq->state doesn't require locking a tq
-			   mutex. */
-			pthread_mutex_lock(&(gen->tq->wait_mutex));
-			while (CW_TQ_EMPTY == gen->tq->state && gen->do_dequeue_and_generate) {
-				pthread_cond_wait(&gen->tq->wait_var, &gen->tq->wait_mutex);
-			}
-			pthread_mutex_unlock(&(gen->tq->wait_mutex));
+			   necessary. */
+			cw_gen_idle_wait_for_tone_internal(gen);
 
 #if 0
 			/* Original implementation using signals. */ /* This code has been disabled some time before 2017-01-19. */
@@ -1090,8 +1815,23 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 			continue;
 		}
 
+		if (gen->idle.timeout > 0 && cw_gen_idle_retire_silence_internal(gen, &tone)) {
+			/* Generator will wait for next tone as if the queue
+			   has become empty. */
+			continue;
+		}
+
 		const bool is_empty_tone = CW_TQ_EMPTY == queue_state;
 
+		if (tone.is_scheduled) {
+			cw_gen_scheduled_tone_calculate_duration_internal(gen, &tone);
+		}
+
+		/* Beginning of a tone is the boundary at which new volume
+		   can be applied without changing amplitude in the middle
+		   of a slope. */
+		cw_gen_apply_pending_parameters_internal(gen, true);
+
 		cw_gen_value_tracking_internal(gen, &tone, queue_state);
 
 #ifdef IAMBIC_KEY_HAS_TIMER
@@ -1104,10 +1844,8 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 		}
 #endif
 
-
-#ifdef ENABLE_DEV_LIBCW_DEBUGGING
-		cw_debug_ev (&cw_debug_object_ev, 0, tone.frequency ? CW_DEBUG_EVENT_TONE_HIGH : CW_DEBUG_EVENT_TONE_LOW);
-#endif
+		/* In silencing phase 'tone' is replaced below. */
+		const bool is_mark = tone.is_mark;
 
 		/* This is a blocking write. */
 		if (gen->sound_system == CW_AUDIO_NULL || gen->sound_system == CW_AUDIO_CONSOLE) {
@@ -1135,11 +1873,18 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 				   aren't in 'silencing' phase). Use the tone
 				   to calculate samples in buffer. */
 				cw_gen_tone_calculate_samples_size_internal(gen, &tone);
+				cw_gen_drift_correct_internal(gen, &tone);
 			}
 
 			cw_gen_write_to_soundcard_internal(gen, &tone);
 		}
 
+		if (is_mark) {
+			/* Listeners notified below about end of the tone
+			   should see the completed token. */
+			cw_gen_tokens_mark_played_internal(gen);
+		}
+
 		if (prev_tone.is_forever && tone.is_forever) {
 			/*
 			  Don't notify about dequeueing two consecutive
@@ -1156,9 +1901,8 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 #ifdef GENERATOR_CLIENT_THREAD
 			fprintf(stderr, MSG_PREFIX "      sending signal on dequeue, target thread id = %ld\n", gen->library_client.thread_id);
 #endif
-			pthread_mutex_lock(&gen->tq->wait_mutex);
-			pthread_cond_broadcast(&gen->tq->wait_var);
-			pthread_mutex_unlock(&gen->tq->wait_mutex);
+			__atomic_add_fetch(&gen->metrics.n_tone_ends, 1, __ATOMIC_RELAXED);
+			cw_tq_broadcast_internal(gen->tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_TONE_END));
 		}
 
 #ifdef GENERATOR_CLIENT_THREAD
@@ -1217,13 +1961,10 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 			   Remember that we are in silencing phase, which may
 			   or may not mean that generator is being
 			   stopped and deleted. */
-			cw_tq_flush_internal(gen->tq);
+			cw_gen_flush_tone_queue_internal(gen);
 			gen->silencing_initialized = false;
 		}
 
-#ifdef ENABLE_DEV_LIBCW_DEBUGGING
-		cw_debug_ev (&cw_debug_object_ev, 0, tone.frequency ? CW_DEBUG_EVENT_TONE_LOW : CW_DEBUG_EVENT_TONE_HIGH);
-#endif
 		/* And finally, at the very end... */
 		CW_TONE_COPY(&prev_tone, &tone);
 
@@ -1232,22 +1973,17 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
 		      MSG_PREFIX "EXIT: generator stopped (gen->do_dequeue_and_generate = %d)", gen->do_dequeue_and_generate);
 
+	/* Let buffers that are still in pipeline be written before
+	   anybody is notified that generator has stopped. */
+	cw_gen_pipeline_stop_internal(gen);
+
 	/* Some functions in main thread may be waiting for the last
 	   notification from the generator thread to continue/finalize
 	   their business. Let's send that notification right before
 	   exiting. */
 
-	/* This small delay before sending the notification turns out
-	   to be helpful.
-
-	   TODO: this is one of most mysterious comments in this code
-	   base. What was I thinking? */
-	cw_usleep_internal(CW_USECS_PER_SEC / 2);
-
-	pthread_mutex_lock(&gen->tq->wait_mutex);
 	/* There may be many listeners, so use broadcast(). */
-	pthread_cond_broadcast(&gen->tq->wait_var);
-	pthread_mutex_unlock(&gen->tq->wait_mutex);
+	cw_tq_wake_all_internal(gen->tq);
 
 #ifdef GENERATOR_CLIENT_THREAD
 	/* Original implementation using signals. */
@@ -1276,6 +2012,19 @@ void * cw_gen_dequeue_and_generate_internal(void * arg)
    so initial phase of new fragment of sine wave in the buffer matches
    ending phase of a sine wave generated in previous call.
 
+   Values of samples are calculated by oscillator engine selected for given
+   generator (see cw_gen_oscillator_t), or by cheaper engine when quality
+   of synthesis has been lowered (see cw_gen_enable_quality_scaling()).
+   Regardless of the floating-point
+   engine, the phase at the end of fragment is calculated in the same
+   way, so switching between these engines doesn't affect continuity of
+   the wave. Fixed-point engine keeps its own, integer phase.
+
+   Silent tones (spaces) don't go through oscillator engine at all.
+   Beginnings of marks with chirp (see cw_gen_set_chirp()) are
+   calculated by cw_gen_calculate_sine_wave_chirp_internal(),
+   regardless of engine.
+
    @internal
    @reviewed 2020-08-04
    @endinternal
@@ -1289,6 +2038,77 @@ int cw_gen_calculate_sine_wave_internal(cw_gen_t * gen, cw_tone_t * tone)
 {
 	assert (gen->buffer_sub_stop <= gen->buffer_n_samples);
 
+	if (tone->frequency <= 0) {
+		return cw_gen_calculate_silence_internal(gen, tone);
+	}
+
+	if (tone->sample_iterator < gen->modulation.chirp_n_samples) {
+		/* Frequency changes during the fragment. */
+		return cw_gen_calculate_sine_wave_chirp_internal(gen, tone);
+	}
+
+	switch (cw_gen_quality_oscillator_internal(gen)) {
+	case CW_GEN_OSCILLATOR_PHASOR:
+		return cw_gen_calculate_sine_wave_phasor_internal(gen, tone);
+	case CW_GEN_OSCILLATOR_TABLE:
+		return cw_gen_calculate_sine_wave_table_internal(gen, tone);
+	case CW_GEN_OSCILLATOR_FIXED_POINT:
+		return cw_gen_calculate_sine_wave_fixed_internal(gen, tone);
+	case CW_GEN_OSCILLATOR_SINF:
+	default:
+		return cw_gen_calculate_sine_wave_sinf_internal(gen, tone);
+	}
+}
+
+
+
+
+/**
+   @brief Calculate a fragment of silence
+
+   Spaces between marks are tones with zero frequency, and at low speeds
+   they make more than a half of all generated samples. Amplitude of
+   every sample of such tone is zero, so the subarea of buffer can be
+   simply cleared. Phase of sine wave doesn't change for zero frequency,
+   so gen->phase_offset and gen->phase_acc are left untouched.
+
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
+
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_silence_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	const int n = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+
+	memset(gen->buffer + gen->buffer_sub_start, 0, sizeof (cw_sample_t) * (size_t) n);
+	tone->sample_iterator += n;
+
+	/* Fading goes on during spaces too. */
+	cw_gen_advance_gain_internal(gen, n);
+
+	return n;
+}
+
+
+
+
+/**
+   @brief Calculate a fragment of sine wave with sinf() called for every sample
+
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
+
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_sine_wave_sinf_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
 	/* We need two separate iterators to correctly generate sine wave:
 	    -- i -- for iterating through output buffer (generator
 	            buffer's subarea), it can travel between buffer
@@ -1305,349 +2125,484 @@ int cw_gen_calculate_sine_wave_internal(cw_gen_t * gen, cw_tone_t * tone)
 	  the memory too. Therefore it has to always start from zero for
 	  every new fragment of sine wave. Therefore a separate t. */
 
-	float phase = 0.0F;
+	float wave[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	float amplitudes[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
 	int t = 0;
 
-	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; i++) {
-		phase = (2.0F * CW_PI
-			 * (float) (tone->frequency * t)
-			 / (float) gen->sample_rate)
-			+ gen->phase_offset;
-		const int amplitude = cw_gen_calculate_sample_amplitude_internal(gen, tone);
-
-		gen->buffer[i] = ((float) amplitude) * sinf(phase);
+	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; ) {
+		const int n = cw_gen_synthesis_block_n_samples_internal(gen, i);
 
-		tone->sample_iterator++;
+		for (int j = 0; j < n; j++) {
+			const float phase = (2.0F * CW_PI
+					     * (float) (tone->frequency * (t + j))
+					     / (float) gen->sample_rate)
+				+ gen->phase_offset;
+			wave[j] = sinf(phase);
+		}
+		cw_gen_synthesize_block_internal(gen, tone, gen->buffer + i, wave, amplitudes, n);
 
-		t++;
+		i += n;
+		t += n;
 	}
 
-	phase = (2.0F * CW_PI
-		 * (float) (tone->frequency * t)
-		 / (float) gen->sample_rate)
-		+ gen->phase_offset;
+	cw_gen_update_phase_offset_internal(gen, tone, t);
 
-	/* "phase" is now phase of the first sample in next fragment to be
-	   calculated.
-	   However, for long fragments this can be a large value, well
-	   beyond <0; 2*Pi) range.
-	   The value of phase may further accumulate in different
-	   calculations, and at some point it may overflow. This would
-	   result in an audible click.
+	return t;
+}
 
-	   Let's bring back the phase from beyond <0; 2*Pi) range into the
-	   <0; 2*Pi) range, in other words lets "normalize" it. Or, in yet
-	   other words, lets apply modulo operation to the phase.
 
-	   The normalized phase will be used as a phase offset for next
-	   fragment (during next function call). It will be added phase of
-	   every sample calculated in next function call. */
 
-	/* TODO: check if n_periods can be a float. We could avoid the casts. */
-	const int n_periods = (int) floorf(phase / (2.0F * CW_PI));
-	gen->phase_offset = phase - (float) n_periods * 2.0F * CW_PI;
 
-	return t;
-}
+/**
+   @brief Calculate a fragment of sine wave with recursive oscillator
 
+   Instead of calling sinf() for every sample, a unit complex phasor
+   (cos(phase), sin(phase)) is rotated by a constant step (cos(delta),
+   sin(delta)) for every sample. Imaginary part of the phasor is the value
+   of sine wave.
 
+   Initial value of the phasor is calculated from gen->phase_offset at the
+   beginning of every fragment, so rounding errors can't accumulate between
+   fragments. Within a fragment the magnitude of the phasor is periodically
+   brought back to 1.0, so rounding errors can't accumulate in long buffers
+   either.
 
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
 
-/**
-   @brief Calculate value of a single sample of sine wave
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_sine_wave_phasor_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	const float delta = 2.0F * CW_PI * (float) tone->frequency / (float) gen->sample_rate;
+	const float step_re = cosf(delta);
+	const float step_im = sinf(delta);
 
-   This function calculates an amplitude (a value) of a single sample
-   in sine wave PCM data.
+	float re = cosf(gen->phase_offset);
+	float im = sinf(gen->phase_offset);
 
-   Actually "calculation" is a bit too big word. The function just
-   makes a decision which of precalculated values to return. There are
-   no complicated arithmetical calculations being made each time the
-   function is called, so the execution time should be pretty small.
+	float wave[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	float amplitudes[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	int t = 0;
 
-   The precalcuated values depend on some factors, so the values
-   should be re-calculated each time these factors change. See
-   cw_gen_set_tone_slope() for list of these factors.
+	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; ) {
+		const int n = cw_gen_synthesis_block_n_samples_internal(gen, i);
+
+		for (int j = 0; j < n; j++) {
+			wave[j] = im;
+
+			/* Rotate the phasor: (re + j*im) * (step_re + j*step_im). */
+			const float new_re = re * step_re - im * step_im;
+			const float new_im = re * step_im + im * step_re;
+			re = new_re;
+			im = new_im;
+
+			if (0 == ((t + j) % CW_GEN_PHASOR_RENORMALIZATION_PERIOD)) {
+				/* First-order approximation of 1/sqrt(x) around
+				   x = 1. Magnitude of the phasor is very close to
+				   1.0, so this is good enough, and cheaper than
+				   sqrtf(). */
+				const float correction = (3.0F - (re * re + im * im)) / 2.0F;
+				re *= correction;
+				im *= correction;
+			}
+		}
+		cw_gen_synthesize_block_internal(gen, tone, gen->buffer + i, wave, amplitudes, n);
 
-   A generator contains some of information needed to get an amplitude of
-   every sample in a sine wave - this is why this function needs @p gen.  If
-   tone's slopes are non-rectangular, the duration of slopes is defined in
-   generator. If a tone is non-silent, the volume is also defined in
-   generator.
+		i += n;
+		t += n;
+	}
 
-   However, decision tree for getting the amplitude also depends on some
-   parameters that are strictly bound to tone, such as what is the shape of
-   slopes for a given tone - this is why we have @p tone.  The @p tone also
-   stores iterator of samples - this is how we know for which sample in a
-   tone to calculate the amplitude.
+	cw_gen_update_phase_offset_internal(gen, tone, t);
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+	return t;
+}
 
-   @param[in] gen generator used to generate a sine wave
-   @param[in] tone tone being generated
 
-   @return value of a sample of sine wave, a non-negative number
-*/
-int cw_gen_calculate_sample_amplitude_internal(cw_gen_t * gen, const cw_tone_t * tone)
-{
-#if 0   /* Blunt algorithm for calculating amplitude. For debug purposes only. */
 
-	return tone->frequency ? gen->volume_abs : 0;
 
-#else
+/**
+   @brief Calculate a fragment of sine wave with lookup of precalculated table
 
-	if (tone->frequency <= 0) {
-		return 0;
-	}
+   A 32-bit phase accumulator covers full period of sine wave (2^32 ==
+   2*Pi). Top bits of the accumulator select a cell in table of sine
+   values, remaining bits are used to interpolate linearly between the cell
+   and the next one. Natural wraparound of unsigned integer does modulo
+   operation on the phase for free.
 
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
 
-	float amplitude = 0.0F;
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
 
-	/* Every tone, regardless of slope mode (CW_SLOPE_MODE_*), has
-	   three components. It has rising slope + plateau + falling
-	   slope.
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_sine_wave_table_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	const uint32_t step = (uint32_t) (uint64_t) ((double) tone->frequency * 4294967296.0 / (double) gen->sample_rate);
+	uint32_t acc = cw_gen_phase_offset_to_acc_internal(gen->phase_offset);
 
-	   There can be four variants of rising and falling slope
-	   length, just as there are four CW_SLOPE_MODE_* values.
+	const int frac_bits = 32 - CW_GEN_SINE_TABLE_BITS;
+	const uint32_t frac_mask = (1U << frac_bits) - 1;
+	const float frac_scale = 1.0F / (float) (1U << frac_bits);
 
-	   There can be also tones with zero-length plateau, and there
-	   can be also tones with zero-length slopes. */
+	float wave[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	float amplitudes[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	int t = 0;
 
-	if (tone->sample_iterator < tone->rising_slope_n_samples) {
-		/* Beginning of tone, rising slope. */
-		const int i = tone->sample_iterator;
-		amplitude = gen->tone_slope.amplitudes[i];
-		assert (amplitude >= 0);
+	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; ) {
+		const int n = cw_gen_synthesis_block_n_samples_internal(gen, i);
+
+		/* Accumulator value is derived from 'j' instead of being
+		   incremented in every iteration, so that there is no
+		   loop-carried dependency. */
+		for (int j = 0; j < n; j++) {
+			const uint32_t sample_acc = acc + (uint32_t) j * step;
+			const uint32_t idx = sample_acc >> frac_bits;
+			const float frac = (float) (sample_acc & frac_mask) * frac_scale;
+			wave[j] = g_sine_table[idx] + frac * (g_sine_table[idx + 1] - g_sine_table[idx]);
+		}
+		acc += (uint32_t) n * step;
 
-	} else if (tone->sample_iterator >= tone->rising_slope_n_samples
-		   && tone->sample_iterator < tone->n_samples - tone->falling_slope_n_samples) {
+		cw_gen_synthesize_block_internal(gen, tone, gen->buffer + i, wave, amplitudes, n);
 
-		/* Middle of tone, plateau, constant amplitude. */
-		amplitude = (float) gen->volume_abs;
-		assert (amplitude >= 0);
+		i += n;
+		t += n;
+	}
 
-	} else if (tone->sample_iterator >= tone->n_samples - tone->falling_slope_n_samples) {
-		/* Falling slope. */
-		const cw_sample_iter_t i = tone->n_samples - tone->sample_iterator - 1;
-		assert (i >= 0);
-		amplitude = gen->tone_slope.amplitudes[i];
-		assert (amplitude >= 0);
+	cw_gen_update_phase_offset_internal(gen, tone, t);
 
-	} else {
-		cw_assert (0, MSG_PREFIX "->sample_iterator out of bounds:\n"
-			   "tone->sample_iterator: %ld\n"
-			   "tone->n_samples: %"PRId64"\n"
-			   "tone->rising_slope_n_samples: %d\n"
-			   "tone->falling_slope_n_samples: %d\n",
-			   tone->sample_iterator,
-			   tone->n_samples,
-			   tone->rising_slope_n_samples,
-			   tone->falling_slope_n_samples);
-	}
-
-	assert (amplitude >= 0.0F);
-	return (int) amplitude;
-#endif
+	return t;
 }
 
 
 
 
 /**
-   @brief Set parameters describing slopes of tones generated by generator
+   @brief Calculate a fragment of sine wave using only integer arithmetic
 
-   Most of variables related to slope of tones is in @p tone, but there are
-   still some variables that are generator-specific, as they are common for
-   all tones.  This function sets two of these generator-specific variables.
+   Integer counterpart of cw_gen_calculate_sine_wave_table_internal().
+   The 32-bit phase accumulator is stored between fragments in
+   gen->phase_acc. Table of sine values and slope amplitudes are
+   integers, and the product of amplitude and sine value is scaled back
+   from Q15 format.
 
-   A: If you pass to function conflicting values of @p slope_shape and
-   @p slope_duration, the function will return CW_FAILURE. These
-   conflicting values are rectangular slope shape and larger than zero
-   slope length. You just can't have rectangular slopes that have
-   non-zero length.
+   Amplitude is at most CW_AUDIO_VOLUME_RANGE (2^15) and value from sine
+   table is at most 2^15 - 1, so their product fits in int32_t, and the
+   scaled value fits in cw_sample_t.
 
-   B: If you pass to function '\-1' as value of both @p slope_shape and
-   @p slope_duration, the function won't change any of the related two
-   generator's parameters.
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
 
-   C1: If you pass to function '\-1' as value of either @p slope_shape or
-   @p slope_duration, the function will attempt to set only this generator's
-   parameter that is different than '\-1'.
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
 
-   C2: However, if selected slope shape is rectangular, function will
-   set generator's slope length to zero, even if value of \p
-   slope_duration is '\-1'.
+   @return number of calculated samples
+*/
+static int cw_gen_calculate_sine_wave_fixed_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	const uint32_t step = cw_gen_phase_acc_step_internal(gen, tone->frequency);
+	uint32_t acc = gen->phase_acc;
 
-   D: Notice that the function allows non-rectangular slope shape with
-   zero length of the slopes. The slopes will be non-rectangular, but
-   just unusually short.
+	/* Bits of accumulator below table index. Top 16 of them are used
+	   for interpolation, so that product with difference of table
+	   cells fits in int32_t. */
+	const int frac_bits = 32 - CW_GEN_SINE_TABLE_BITS;
+	const int frac_shift = frac_bits - 16;
 
-   @internal TODO: Seriously, these rules (A-D) for setting a slope are too complicated. Simplify them. Accept only a small subset of valid/sane values. Perhaps split the function into two separate functions: for setting slope shape and slope duration. @endinternal
+	int32_t amplitudes[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES];
+	int t = 0;
 
-   The function should be called every time one of following
-   parameters change:
+	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; ) {
+		const int n = cw_gen_synthesis_block_n_samples_internal(gen, i);
+
+/* Loop of fixed-point engine, for amplitude of j-th sample given by
+   AMPLITUDE. */
+#define CW_GEN_FIXED_POINT_LOOP(AMPLITUDE)				\
+		for (int j = 0; j < n; j++) {				\
+			const uint32_t idx = acc >> frac_bits;		\
+			const int32_t frac = (int32_t) ((acc >> frac_shift) & 0xFFFFU); \
+			const int32_t diff = g_sine_table_q15[idx + 1] - g_sine_table_q15[idx]; \
+			const int32_t value = g_sine_table_q15[idx] + (diff * frac) / (1 << 16); \
+									\
+			gen->buffer[i + j] = (cw_sample_t) (((AMPLITUDE) * value) / CW_GEN_Q15_ONE); \
+									\
+			acc += step;					\
+		}
 
-   @li shape of slope,
-   @li duration of slope,
-   @li generator's sample rate,
-   @li generator's volume.
+		if (cw_gen_block_is_plateau_internal(gen, tone, n)) {
+			/* The same amplitude as calculated by
+			   cw_gen_calculate_amplitudes_fixed_internal()
+			   for plateau. */
+			tone->sample_iterator += n;
+			int32_t amplitude = gen->volume_abs;
+			if (CW_GEN_GAIN_ONE != gen->modulation.gain) {
+				amplitude = (int32_t) (((int64_t) amplitude * gen->modulation.gain) >> 30);
+			}
+			CW_GEN_FIXED_POINT_LOOP(amplitude)
+		} else {
+			cw_gen_calculate_amplitudes_fixed_internal(gen, tone, amplitudes, n);
+			CW_GEN_FIXED_POINT_LOOP(amplitudes[j])
+		}
+#undef CW_GEN_FIXED_POINT_LOOP
 
-   There are four supported shapes of slopes:
-   @li linear (the only one supported by libcw until version 4.1.1),
-   @li raised cosine (supposedly the most desired shape),
-   @li sine,
-   @li rectangular.
+		i += n;
+		t += n;
+	}
 
-   Use CW_TONE_SLOPE_SHAPE_* symbolic names as values of @p slope_shape.
+	gen->phase_acc = acc;
 
-   FIXME: first argument of this public function is gen, but no
-   function provides access to generator variable.
+	return t;
+}
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
 
-   @param[in] gen generator for which to set tone slope parameters
-   @param[in] slope_shape shape of slope: linear, raised cosine, sine, rectangular
-   @param[in] slope_duration duration of slope [microseconds]
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
+
+/**
+   @brief Calculate a fragment of sine wave with changing frequency
+
+   Used for beginning of a mark when chirp is set (see
+   cw_gen_set_chirp()): frequency of first sample of the mark is
+   shifted by gen->modulation.chirp_offset, and the shift decreases
+   linearly to zero over gen->modulation.chirp_n_samples samples.
+
+   A 32-bit phase accumulator is used, as in
+   cw_gen_calculate_sine_wave_table_internal(). Step of the accumulator
+   changes by constant value from sample to sample, so value of the
+   accumulator at any sample of a block is a closed-form function of
+   sample's index in the block, and there is no loop-carried dependency.
+   Blocks are split at the end of chirp, so remainder of the fragment is
+   calculated with constant frequency.
+
+   Values of float table of sine and float amplitudes are used also by
+   generators with fixed-point engine; both phase_offset and phase_acc
+   are updated at the end.
+
+   See cw_gen_calculate_sine_wave_internal() for description of arguments
+   and return value.
+
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone specification of samples that should be calculated
+
+   @return number of calculated samples
 */
-int cw_generator_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+static int cw_gen_calculate_sine_wave_chirp_internal(cw_gen_t * gen, cw_tone_t * tone)
 {
-	return cw_gen_set_tone_slope(gen, slope_shape, slope_duration);
+	const double rad_to_acc = 4294967296.0 / (2.0 * (double) CW_PI);
+
+	uint32_t acc = CW_GEN_OSCILLATOR_FIXED_POINT == gen->oscillator
+		? gen->phase_acc
+		: cw_gen_phase_offset_to_acc_internal(gen->phase_offset);
+
+	const uint32_t step = cw_gen_phase_acc_step_internal(gen, tone->frequency);
+	const cw_sample_iter_t chirp_n_samples = gen->modulation.chirp_n_samples;
+	/* Additional step of accumulator at first sample of the mark, and
+	   its decrease per sample. Negative values wrap around, which is
+	   fine for modulo-2^32 arithmetic. */
+	const int64_t offset_step = ((int64_t) gen->modulation.chirp_offset * 4294967296LL) / (int64_t) gen->sample_rate;
+	const int64_t offset_step_decrease = offset_step / chirp_n_samples;
+
+	const int frac_bits = 32 - CW_GEN_SINE_TABLE_BITS;
+	const uint32_t frac_mask = (1U << frac_bits) - 1;
+	const float frac_scale = 1.0F / (float) (1U << frac_bits);
+
+	float wave[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	float amplitudes[CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES] = { 0 };
+	int t = 0;
+
+	for (int i = gen->buffer_sub_start; i <= gen->buffer_sub_stop; ) {
+		int n = cw_gen_synthesis_block_n_samples_internal(gen, i);
+
+		uint32_t block_step = step;
+		uint32_t block_step_decrease = 0;
+		const cw_sample_iter_t p = tone->sample_iterator;
+		if (p < chirp_n_samples) {
+			if (n > chirp_n_samples - p) {
+				n = (int) (chirp_n_samples - p);
+			}
+			block_step = step + (uint32_t) (offset_step - p * offset_step_decrease);
+			block_step_decrease = (uint32_t) offset_step_decrease;
+		}
+
+		for (int j = 0; j < n; j++) {
+			const uint32_t sample_acc = acc
+				+ (uint32_t) j * block_step
+				- block_step_decrease * (uint32_t) (j * (j - 1) / 2);
+			const uint32_t idx = sample_acc >> frac_bits;
+			const float frac = (float) (sample_acc & frac_mask) * frac_scale;
+			wave[j] = g_sine_table[idx] + frac * (g_sine_table[idx + 1] - g_sine_table[idx]);
+		}
+		acc += (uint32_t) n * block_step - block_step_decrease * (uint32_t) (n * (n - 1) / 2);
+
+		cw_gen_synthesize_block_internal(gen, tone, gen->buffer + i, wave, amplitudes, n);
+
+		i += n;
+		t += n;
+	}
+
+	gen->phase_acc = acc;
+	gen->phase_offset = (float) ((double) acc / rad_to_acc);
+
+	return t;
 }
 
 
 
 
 /**
-   See comment for cw_generator_set_tone_slope()
+   @brief Get count of samples in next block of synthesis
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+   Fragment of sine wave is calculated in blocks of at most
+   CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES samples, so that intermediate values
+   fit in small arrays on stack.
+
+   @param[in] gen generator that generates sine wave
+   @param[in] i index of first sample of the block in gen->buffer
+
+   @return count of samples in the block
 */
-cw_ret_t cw_gen_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+static int cw_gen_synthesis_block_n_samples_internal(const cw_gen_t * gen, int i)
 {
-	assert (gen);
+	const int n = gen->buffer_sub_stop - i + 1;
+	return n < CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES ? n : CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES;
+}
 
-	/* Handle conflicting values of arguments. */
-	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR
-	    && slope_duration > 0) {
 
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-			      MSG_PREFIX "requested a rectangular slope shape, but also requested slope duration > 0");
 
-		return CW_FAILURE;
-	}
 
-	/* Assign new values from arguments. */
-	if (slope_shape != -1) {
-		gen->tone_slope.shape = slope_shape;
-	}
-	if (slope_duration != -1) {
-		gen->tone_slope.duration = slope_duration;
-	}
+/**
+   @brief Calculate amplitudes of a block of samples of a tone
 
+   Put into @p amplitudes amplitudes of @p n consecutive samples of @p
+   tone, starting at tone->sample_iterator. The iterator is advanced by
+   @p n.
 
-	/* Override of slope duration. */
-	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
-		/* TODO: what's going on here? Why do we set this to zero? */
-		gen->tone_slope.duration = 0;
-	}
+   Every tone, regardless of slope mode (CW_SLOPE_MODE_*), has three
+   components. It has rising slope + plateau + falling slope.  There can
+   be also tones with zero-length plateau, and there can be also tones
+   with zero-length slopes.
 
+   Instead of deciding for every sample which of the three components the
+   sample belongs to, the function calculates which part of the block
+   overlaps with each component, and fills each part in a separate loop
+   without branches. Values used in the loops are precalculated, see
+   cw_gen_set_tone_slope() for list of factors that they depend on.
 
-	int slope_n_samples = ((gen->sample_rate / 100) * gen->tone_slope.duration) / 10000;
-	cw_assert (slope_n_samples >= 0, MSG_PREFIX "negative slope_n_samples: %d", slope_n_samples);
+   In case of short tones, where rising slope and falling slope overlap,
+   rising slope takes precedence.
 
+   Amplitudes are scaled by current gain of generator (see
+   cw_gen_set_gain()).
 
-	/* Reallocate the table of slope amplitudes only when necessary.
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone tone being generated
+   @param[out] amplitudes array of amplitudes to fill, non-negative values
+   @param[in] n count of samples
+*/
+void cw_gen_calculate_amplitudes_internal(cw_gen_t * gen, cw_tone_t * tone, float * amplitudes, int n)
+{
+	const cw_sample_iter_t first = tone->sample_iterator;
+	tone->sample_iterator += n;
 
-	   In practice the function will be called foremost when user changes
-	   volume of tone, and then the function may be called several times
-	   in a row if volume is changed in steps. In such situation the size
-	   of amplitudes table doesn't change.
-
-	   TODO: do we really need to change type/duration of slopes when
-	   volume changes? Perhaps a call to
-	   cw_gen_recalculate_slope_amplitudes_internal() would be enough? */
-
-	if (gen->tone_slope.n_amplitudes != slope_n_samples) {
-
-		 /* Remember that slope_n_samples may be zero. In that
-		    case realloc() would equal to free(). We don't
-		    want to have NULL ->amplitudes, so don't modify
-		    ->amplitudes for zero-duration slopes.  Since with
-		    zero-duration slopes we won't be referring to
-		    ->amplitudes[], it is ok that the table will not
-		    be up-to-date. */
-
-		if (slope_n_samples > 0) {
-			gen->tone_slope.amplitudes = realloc(gen->tone_slope.amplitudes, sizeof(float) * slope_n_samples);
-			if (!gen->tone_slope.amplitudes) {
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-					      MSG_PREFIX "failed to realloc() table of slope amplitudes");
-				return CW_FAILURE;
-			}
+	if (tone->frequency <= 0) {
+		for (int j = 0; j < n; j++) {
+			amplitudes[j] = 0.0F;
 		}
+		return;
+	}
+
+	const cw_sample_iter_t end = first + n;
+	cw_sample_iter_t plateau_start = 0;
+	cw_sample_iter_t falling_start = 0;
+	cw_gen_get_amplitude_spans_internal(tone, first, n, &plateau_start, &falling_start);
+
+	/* Slope amplitudes are normalized, volume is applied here. */
+	const float * slope = gen->tone_slope.amplitudes;
+	const float plateau = (float) gen->volume_abs;
 
-		gen->tone_slope.n_amplitudes = slope_n_samples;
+	/* Beginning of tone, rising slope. */
+	for (cw_sample_iter_t k = first; k < plateau_start; k++) {
+		amplitudes[k - first] = slope[k] * plateau;
 	}
 
-	cw_gen_recalculate_slope_amplitudes_internal(gen);
+	/* Middle of tone, plateau, constant amplitude. */
+	for (cw_sample_iter_t k = plateau_start; k < falling_start; k++) {
+		amplitudes[k - first] = plateau;
+	}
 
-	return CW_SUCCESS;
-}
+	/* Falling slope. Slope amplitudes are read backwards. */
+	for (cw_sample_iter_t k = falling_start; k < end; k++) {
+		amplitudes[k - first] = slope[tone->n_samples - k - 1] * plateau;
+	}
 
+	cw_gen_apply_gain_internal(gen, amplitudes, n);
 
+	return;
+}
 
 
-/**
-   @brief Recalculate amplitudes of PCM samples that form tone's slopes
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
 
-   TODO: consider writing unit test code for the function.
+/**
+   @brief Move gain of generator forward by given count of samples
 
-   @param[in] gen generator
+   @param[in,out] gen generator
+   @param[in] n count of samples
 */
-void cw_gen_recalculate_slope_amplitudes_internal(cw_gen_t * gen)
+static void cw_gen_advance_gain_internal(cw_gen_t * gen, cw_sample_iter_t n)
 {
-	/* The values in amplitudes[] change from zero to max (at
-	   least for any sane slope shape), so naturally they can be
-	   used in forming rising slope. However they can be used in
-	   forming falling slope as well - just iterate the table from
-	   end to beginning. */
-	for (int i = 0; i < gen->tone_slope.n_amplitudes; i++) {
+	if (gen->modulation.gain_n_remaining <= 0) {
+		return;
+	}
+	if (n >= gen->modulation.gain_n_remaining) {
+		gen->modulation.gain = gen->modulation.gain_target;
+		gen->modulation.gain_n_remaining = 0;
+	} else {
+		gen->modulation.gain += (int32_t) n * gen->modulation.gain_step;
+		gen->modulation.gain_n_remaining -= n;
+	}
 
-		if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_LINEAR) {
-			gen->tone_slope.amplitudes[i] = (float) (i * gen->volume_abs) / (float) gen->tone_slope.n_amplitudes;
+	return;
+}
 
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_SINE) {
-			const float radian = (float) i * (CW_PI / 2.0F) / (float) gen->tone_slope.n_amplitudes;
-			const float y = sinf(radian);
-			gen->tone_slope.amplitudes[i] = y * (float) gen->volume_abs;
 
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RAISED_COSINE) {
-			const float radian = (float) i * CW_PI / (float) gen->tone_slope.n_amplitudes;
-			const float y = (1 - ((1 + cosf(radian)) / 2));
-			gen->tone_slope.amplitudes[i] = y * (float) gen->volume_abs;
 
-		} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
-			/* CW_TONE_SLOPE_SHAPE_RECTANGULAR is covered
-			   before entering this "for" loop. */
-			/* TODO: to avoid treating
-			   CW_TONE_SLOPE_SHAPE_RECTANGULAR as special case,
-			   add the calculation here. */
-			cw_assert (0, MSG_PREFIX "we shouldn't be here, calculating rectangular slopes");
 
-		} else {
-			cw_assert (0, MSG_PREFIX "unsupported slope shape %d", gen->tone_slope.shape);
+/**
+   @brief Scale a block of amplitudes by gain of generator
+
+   While gain is changing, each sample gets its own, linearly
+   interpolated gain. Both loops have no dependencies between
+   iterations. With gain at full volume (the usual case) nothing is
+   done.
+
+   @param[in,out] gen generator
+   @param[in,out] amplitudes amplitudes to scale
+   @param[in] n count of amplitudes
+*/
+static void cw_gen_apply_gain_internal(cw_gen_t * gen, float * amplitudes, int n)
+{
+	const float scale = 1.0F / (float) CW_GEN_GAIN_ONE;
+	int j = 0;
+
+	if (gen->modulation.gain_n_remaining > 0) {
+		const int n_ramp = gen->modulation.gain_n_remaining < n ? (int) gen->modulation.gain_n_remaining : n;
+		const int32_t gain = gen->modulation.gain;
+		const int32_t step = gen->modulation.gain_step;
+		for (; j < n_ramp; j++) {
+			amplitudes[j] *= (float) (gain + (j + 1) * step) * scale;
+		}
+		cw_gen_advance_gain_internal(gen, n_ramp);
+	}
+
+	if (CW_GEN_GAIN_ONE != gen->modulation.gain) {
+		const float gain = (float) gen->modulation.gain * scale;
+		for (; j < n; j++) {
+			amplitudes[j] *= gain;
 		}
 	}
 
@@ -1658,196 +2613,183 @@ void cw_gen_recalculate_slope_amplitudes_internal(cw_gen_t * gen)
 
 
 /**
-   @brief Write tone to soundcard
-
-   @internal
-   @reviewed 2020-10-13
-   @endinternal
+   @brief Scale a block of integer amplitudes by gain of generator
 
-   @param[in] gen
-   @param[in] tone tone dequeued from queue (if dequeueing was successful); must always be non-NULL
+   Fixed-point variant of cw_gen_apply_gain_internal().
 
-   @return 0
+   @param[in,out] gen generator
+   @param[in,out] amplitudes amplitudes to scale
+   @param[in] n count of amplitudes
 */
-int cw_gen_write_to_soundcard_internal(cw_gen_t * gen, cw_tone_t * tone)
+static void cw_gen_apply_gain_fixed_internal(cw_gen_t * gen, int32_t * amplitudes, int n)
 {
-	cw_assert (NULL != tone, MSG_PREFIX "'tone' argument should always be non-NULL");
+	int j = 0;
+
+	if (gen->modulation.gain_n_remaining > 0) {
+		const int n_ramp = gen->modulation.gain_n_remaining < n ? (int) gen->modulation.gain_n_remaining : n;
+		const int32_t gain = gen->modulation.gain;
+		const int32_t step = gen->modulation.gain_step;
+		for (; j < n_ramp; j++) {
+			amplitudes[j] = (int32_t) (((int64_t) amplitudes[j] * (gain + (j + 1) * step)) >> 30);
+		}
+		cw_gen_advance_gain_internal(gen, n_ramp);
+	}
 
-	/* Total number of samples to write in a loop below. */
-	int64_t samples_to_write = tone->n_samples;
+	if (CW_GEN_GAIN_ONE != gen->modulation.gain) {
+		const int64_t gain = gen->modulation.gain;
+		for (; j < n; j++) {
+			amplitudes[j] = (int32_t) (((int64_t) amplitudes[j] * gain) >> 30);
+		}
+	}
 
-#define LIBCW_WRITE_LOOP_DEBUG_LEVEL 0
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-	/* Debug code. */
-	int n_loops = 0;
-	const float n_loops_expected = floorf(1.0 * samples_to_write / gen->buffer_n_samples); /* In reality number of loops executed is sometimes n_loops_expected, but mostly it's n_loops_expected+1. */
-	fprintf(stderr, MSG_PREFIX "entering loop (~%.1f iterations expected), tone->frequency = %d, buffer->n_samples = %d, samples_to_write = %"PRId64"\n",
-		(double) n_loops_expected, tone->frequency, gen->buffer_n_samples, samples_to_write);
-#endif
+	return;
+}
 
-	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "%lld samples, %d us, %d Hz", tone->n_samples, tone->duration, gen->frequency);
-	while (samples_to_write > 0) {
 
-		const int64_t free_space = gen->buffer_n_samples - gen->buffer_sub_start;
-		if (samples_to_write > free_space) {
-			/* There will be some tone samples left for
-			   next iteration of this loop.  But buffer in
-			   this iteration will be ready to be pushed
-			   to sound sink. */
-			gen->buffer_sub_stop = gen->buffer_n_samples - 1;
-		} else if (samples_to_write == free_space) {
-			/* How nice, end of tone samples aligns with
-			   end of buffer (last sample of tone will be
-			   placed in last cell of buffer).
 
-			   But the result is the same - a full buffer
-			   ready to be pushed to sound sink. */
-			gen->buffer_sub_stop = gen->buffer_n_samples - 1;
-		} else {
-			/* There will be too few samples to fill a
-			   buffer. We can't send an under-filled buffer to
-			   sound sink. We will have to get more
-			   samples to fill the buffer completely. */
-			gen->buffer_sub_stop = gen->buffer_sub_start + samples_to_write - 1;
-		}
 
-		/* How many samples of sound buffer's subarea will be
-		   calculated in a given cycle of "calculate sine
-		   wave" code, i.e. in current iteration of the 'while' loop? */
-		const int buffer_sub_n_samples = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+/**
+   @brief Find where plateau and falling slope start in a block of tone's samples
 
+   Values returned through @p plateau_start and @p falling_start are
+   sample iterator values, clipped to range of the block (<first;
+   first + n>). Samples of the block before @p plateau_start belong to
+   rising slope, samples from @p falling_start to end of the block belong
+   to falling slope.
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-		/* Debug code. */
-		++n_loops;
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 1
-		/* Debug code. */
-		fprintf(stderr, MSG_PREFIX "       loop #%d, buffer_sub_n_samples = %d\n", n_loops, buffer_sub_n_samples);
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
-			      MSG_PREFIX
-			      "sub start: %d, sub stop: %d, sub size: %d / %"PRIu64,
-			      gen->buffer_sub_start, gen->buffer_sub_stop, buffer_sub_n_samples, samples_to_write);
-#endif
-#endif
+   @param[in] tone tone being generated
+   @param[in] first sample iterator value of first sample in the block
+   @param[in] n count of samples in the block
+   @param[out] plateau_start start of plateau
+   @param[out] falling_start start of falling slope
+*/
+static void cw_gen_get_amplitude_spans_internal(const cw_tone_t * tone, cw_sample_iter_t first, int n, cw_sample_iter_t * plateau_start, cw_sample_iter_t * falling_start)
+{
+	const cw_sample_iter_t end = first + n;
+
+	cw_assert (end <= tone->n_samples,
+		   MSG_PREFIX "->sample_iterator out of bounds:\n"
+		   "tone->sample_iterator: %"PRId64"\n"
+		   "tone->n_samples: %"PRId64"\n"
+		   "tone->rising_slope_n_samples: %d\n"
+		   "tone->falling_slope_n_samples: %d\n",
+		   end,
+		   tone->n_samples,
+		   tone->rising_slope_n_samples,
+		   tone->falling_slope_n_samples);
+
+	cw_sample_iter_t plateau = tone->rising_slope_n_samples;
+	cw_sample_iter_t falling = tone->n_samples - tone->falling_slope_n_samples;
+	if (falling < plateau) {
+		/* Overlapping slopes. Rising slope takes precedence. */
+		falling = plateau;
+	}
 
+	*plateau_start = plateau < first ? first : (plateau > end ? end : plateau);
+	*falling_start = falling < first ? first : (falling > end ? end : falling);
+
+	return;
+}
 
-		const int calculated = cw_gen_calculate_sine_wave_internal(gen, tone);
-		cw_assert (calculated == buffer_sub_n_samples, MSG_PREFIX "calculated wrong number of samples: %d != %d", calculated, buffer_sub_n_samples);
 
-		if (gen->buffer_sub_stop == gen->buffer_n_samples - 1) {
 
-			/* We have a buffer full of samples. The
-			   buffer is ready to be pushed to sound
-			   sink. */
-			gen->write_buffer_to_sound_device(gen);
-#ifdef ENABLE_DEV_PCM_SAMPLES_FILE
-			cw_dev_debug_raw_sink_write_internal(gen);
-#endif
-			gen->buffer_sub_start = 0;
-			gen->buffer_sub_stop = 0;
-		} else {
-			/* #needmoresamples
-			   There is still some space left in the
-			   buffer, go fetch new tone from tone
-			   queue. */
 
-			gen->buffer_sub_start = gen->buffer_sub_stop + 1;
+/**
+   @brief Calculate integer amplitudes of a block of samples of a tone
 
-			cw_assert (gen->buffer_sub_start <= gen->buffer_n_samples - 1,
-				   MSG_PREFIX "sub start out of range: sub start = %d, buffer n samples = %d",
-				   gen->buffer_sub_start, gen->buffer_n_samples);
-		}
+   Fixed-point variant of cw_gen_calculate_amplitudes_internal().
 
-		samples_to_write -= buffer_sub_n_samples;
+   @param[in] gen generator that generates sine wave
+   @param[in,out] tone tone being generated
+   @param[out] amplitudes array of amplitudes to fill, non-negative values
+   @param[in] n count of samples
+*/
+static void cw_gen_calculate_amplitudes_fixed_internal(cw_gen_t * gen, cw_tone_t * tone, int32_t * amplitudes, int n)
+{
+	const cw_sample_iter_t first = tone->sample_iterator;
+	tone->sample_iterator += n;
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-		/* Debug code. */
-		if (samples_to_write < 0) {
-			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "samples left = %"PRId64, samples_to_write);
+	if (tone->frequency <= 0) {
+		for (int j = 0; j < n; j++) {
+			amplitudes[j] = 0;
 		}
-#endif
+		return;
+	}
 
-	} /* while (samples_to_write > 0) { */
+	const cw_sample_iter_t end = first + n;
+	cw_sample_iter_t plateau_start = 0;
+	cw_sample_iter_t falling_start = 0;
+	cw_gen_get_amplitude_spans_internal(tone, first, n, &plateau_start, &falling_start);
 
-#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
-	/* Debug code. */
-	fprintf(stderr, MSG_PREFIX "left loop, %d iterations executed from %.1f iterations planned, samples left = %d\n",
-		n_loops, (double) n_loops_expected, (int) samples_to_write);
-#endif
+	/* Q15 slope amplitudes multiplied by volume of at most 2^15
+	   fit in int32_t. */
+	const int32_t * slope = gen->tone_slope.amplitudes_fixed;
+	const int32_t plateau = gen->volume_abs;
 
-	return 0;
-}
+	for (cw_sample_iter_t k = first; k < plateau_start; k++) {
+		amplitudes[k - first] = (slope[k] * plateau) >> 15;
+	}
 
+	for (cw_sample_iter_t k = plateau_start; k < falling_start; k++) {
+		amplitudes[k - first] = plateau;
+	}
 
+	for (cw_sample_iter_t k = falling_start; k < end; k++) {
+		amplitudes[k - first] = (slope[tone->n_samples - k - 1] * plateau) >> 15;
+	}
 
+	cw_gen_apply_gain_fixed_internal(gen, amplitudes, n);
 
-/**
-   @brief Construct empty tone with correct/needed values of samples count
+	return;
+}
 
-   The function sets values tone->..._n_samples fields of empty @p
-   tone based on information from @p gen (i.e. looking on how many
-   samples of silence need to be "created").  The sample count values
-   are set in a way that allows filling remainder of generator's
-   buffer with silence.
 
-   After this point tone duration should not be used - it's the samples count that is correct.
 
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples count.
+/**
+   @brief Scale a block of sine wave by amplitudes and convert to samples
+
+   This is the common, final stage of every oscillator engine. The loop
+   has no branches and no dependencies between iterations, and it always
+   goes through complete block, so that compiler can vectorize it with
+   its default optimization settings. Only first @p n samples are copied
+   to @p samples. On platforms where it is possible, the function is
+   additionally compiled for more than one instruction set, and the
+   variant matching the CPU is selected at run time.
+
+   Values are saturated to range of cw_sample_t, so rounding errors in
+   oscillator can't result in wraparound of sample value at full volume.
+
+   @param[out] samples output samples
+   @param[in] wave block of values of sine wave, in range <-1.0; 1.0>
+   @param[in] amplitudes block of amplitudes of samples
+   @param[in] n count of samples to copy to @p samples
 */
-void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+CW_GEN_MULTIVERSIONED static void cw_gen_apply_amplitudes_internal(cw_sample_t * restrict samples, const float * restrict wave, const float * restrict amplitudes, int n)
 {
-	/* All tones have been already dequeued from tone queue.
+	CW_GEN_APPLY_AMPLITUDES_LOOP(amplitudes[j])
+	return;
+}
 
-	   @p tone does not represent a valid tone to generate. At
-	   first sight there is no need to write anything to
-	   soundcard. But...
-
-	   It may happen that during previous call to the function
-	   there were too few samples in a tone to completely fill a
-	   buffer (see #needmoresamples tag below).
-
-	   We need to fill the buffer until it is full and ready to be
-	   sent to sound sink.
-
-	   Since there are no new tones for which we could generate
-	   samples, we need to generate silence samples.
-
-	   Padding the buffer with silence seems to be a good idea (it
-	   will work regardless of value (Mark/Space) of last valid
-	   tone). We just need to know how many samples of the silence
-	   to produce.
 
-	   Number of these samples will be stored in
-	   samples_to_write. */
-
-	/* We don't have a valid tone, so let's construct a fake one
-	   for purposes of padding. */
-
-	/* Required length of padding space is from end of last buffer
-	   subarea to end of buffer. */
-	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);;
-
-	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
-	tone->frequency = 0;   /* This fake tone is a piece of silence. */
 
-	/* The silence tone used for padding doesn't require any
-	   slopes. A slope falling to silence has been already
-	   provided by last non-fake and non-silent tone. */
-	tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
-	tone->rising_slope_n_samples = 0;
-	tone->falling_slope_n_samples = 0;
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
+/**
+   @brief Scale a block of sine wave by constant amplitude and convert to samples
 
-	//fprintf(stderr, "++++ count of samples in empty tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+   Variant of cw_gen_apply_amplitudes_internal() for blocks of samples
+   that are entirely in plateau of a tone. Most of samples of a mark
+   are calculated by this function: with amplitude in a register the
+   loop reads only the sine wave.
 
+   @param[out] samples output samples
+   @param[in] wave block of values of sine wave, in range <-1.0; 1.0>
+   @param[in] amplitude amplitude of all samples
+   @param[in] n count of samples to copy to @p samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_apply_plateau_internal(cw_sample_t * restrict samples, const float * restrict wave, float amplitude, int n)
+{
+	CW_GEN_APPLY_AMPLITUDES_LOOP(amplitude)
 	return;
 }
 
@@ -1855,60 +2797,61 @@ void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_
 
 
 /**
-   @brief Calculate tone suitable for silencing a generator
-
-   Calculate a @p tone variable that, when passed to generator's write()
-   function, will silence a generator.
+   @brief Check if all samples of a block of tone are in plateau, with constant gain
 
-   @internal
-   @reviewed 2020-10-13
-   @endinternal
+   @param[in] gen generator
+   @param[in] tone tone being generated
+   @param[in] n count of samples in the block, starting at tone->sample_iterator
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples
+   @return true if all samples of the block have the same amplitude
+   @return false otherwise
 */
-void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+static bool cw_gen_block_is_plateau_internal(const cw_gen_t * gen, const cw_tone_t * tone, int n)
 {
-	/* Make sure that we fill a buffer to the end (i.e. calculate as many
-	   samples as there are from current position in the buffer to the
-	   end of the buffer). Otherwise a buffer underrun may occur. */
-	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);
+	if (tone->frequency <= 0 || gen->modulation.gain_n_remaining > 0) {
+		return false;
+	}
 
-	/* Also make sure that a tone is long enough for it to be heard
-	   (otherwise it may be perceived as click). */
-	tone->n_samples += (5 * gen->buffer_n_samples);
+	const cw_sample_iter_t first = tone->sample_iterator;
+	cw_sample_iter_t plateau_start = 0;
+	cw_sample_iter_t falling_start = 0;
+	cw_gen_get_amplitude_spans_internal(tone, first, n, &plateau_start, &falling_start);
 
-	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
+	return plateau_start == first && falling_start == first + n;
+}
 
-	/* Length of a single slope. */
-	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
-	slope_n_samples *= gen->tone_slope.duration;
-	slope_n_samples /= 10000;
 
-	switch (tone->slope_mode) {
-	case CW_SLOPE_MODE_NO_SLOPES:
-	case CW_SLOPE_MODE_RISING_SLOPE:
-		/* Previous tone has ended with full level. Let the silencing
-		   tone fall from the full level to zero. */
-		tone->slope_mode = CW_SLOPE_MODE_FALLING_SLOPE;
-		break;
-	case CW_SLOPE_MODE_FALLING_SLOPE:
-	case CW_SLOPE_MODE_STANDARD_SLOPES:
-		/* Level of previous slope has already fallen to zero. Keep
-		   the level at zero. */
-	default:
-		tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
-		tone->frequency = 0;
-		break;
-	}
-	tone->rising_slope_n_samples = 0;
-	tone->falling_slope_n_samples = slope_n_samples;
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
 
-	//fprintf(stderr, "++++ count of samples in silencing tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+/**
+   @brief Calculate amplitudes of a block of tone and apply them to sine wave
+
+   Common part of floating-point oscillator engines. Kernel specialized
+   for constant amplitude is selected once per block, so neither of the
+   kernels checks anything per sample. Amplitudes of both kernels are
+   calculated in the same way, so selection of kernel doesn't change
+   values of samples.
+
+   @param[in,out] gen generator
+   @param[in,out] tone tone being generated, its sample iterator is advanced by @p n
+   @param[out] samples output samples
+   @param[in] wave block of values of sine wave
+   @param[out] amplitudes work array of CW_GEN_SYNTHESIS_BLOCK_N_SAMPLES amplitudes
+   @param[in] n count of samples
+*/
+static void cw_gen_synthesize_block_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * samples, const float * wave, float * amplitudes, int n)
+{
+	if (cw_gen_block_is_plateau_internal(gen, tone, n)) {
+		tone->sample_iterator += n;
+		float amplitude = (float) gen->volume_abs;
+		if (CW_GEN_GAIN_ONE != gen->modulation.gain) {
+			amplitude *= (float) gen->modulation.gain * (1.0F / (float) CW_GEN_GAIN_ONE);
+		}
+		cw_gen_apply_plateau_internal(samples, wave, amplitude, n);
+	} else {
+		cw_gen_calculate_amplitudes_internal(gen, tone, amplitudes, n);
+		cw_gen_apply_amplitudes_internal(samples, wave, amplitudes, n);
+	}
 
 	return;
 }
@@ -1917,1195 +2860,5334 @@ void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen,
 
 
 /**
-   @brief Recalculate non-empty tone parameters from microseconds into samples
+   @brief Calculate phase offset for next fragment of sine wave
 
-   The function sets tone->..._n_samples fields of non-empty @p tone
-   based on other information from @p tone and from @p gen.
-
-   After this point tone duration should not be used - it's the samples count that is correct.
-
-   @internal
-   @reviewed 2020-08-05
-   @endinternal
+   Calculate phase of first sample of next fragment of sine wave, and
+   store it in gen->phase_offset.
 
-   @param[in] gen
-   @param[in] tone tone for which to calculate samples count.
+   @param[in,out] gen generator that generates sine wave
+   @param[in] tone tone for which a fragment of sine wave was calculated
+   @param[in] n_samples count of samples in just calculated fragment
 */
-void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+static void cw_gen_update_phase_offset_internal(cw_gen_t * gen, const cw_tone_t * tone, int n_samples)
 {
-	/* 100 * 10000 = 1.000.000 usecs per second. */
-	tone->n_samples = gen->sample_rate / 100;
-	tone->n_samples *= tone->duration;
-	tone->n_samples /= 10000;
-
-	//fprintf(stderr, MSG_PREFIX "length of regular tone = %d [samples]\n", tone->n_samples);
-
-	/* Length of a single slope (rising or falling). */
-	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
-	slope_n_samples *= gen->tone_slope.duration;
-	slope_n_samples /= 10000;
+	const float phase = (2.0F * CW_PI
+			     * (float) (tone->frequency * n_samples)
+			     / (float) gen->sample_rate)
+		+ gen->phase_offset;
 
-	if (tone->slope_mode == CW_SLOPE_MODE_RISING_SLOPE) {
-		tone->rising_slope_n_samples = slope_n_samples;
-		tone->falling_slope_n_samples = 0;
+	/* "phase" is now phase of the first sample in next fragment to be
+	   calculated.
+	   However, for long fragments this can be a large value, well
+	   beyond <0; 2*Pi) range.
+	   The value of phase may further accumulate in different
+	   calculations, and at some point it may overflow. This would
+	   result in an audible click.
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_FALLING_SLOPE) {
-		tone->rising_slope_n_samples = 0;
-		tone->falling_slope_n_samples = slope_n_samples;
+	   Let's bring back the phase from beyond <0; 2*Pi) range into the
+	   <0; 2*Pi) range, in other words lets "normalize" it. Or, in yet
+	   other words, lets apply modulo operation to the phase.
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES) {
-		tone->rising_slope_n_samples = slope_n_samples;
-		tone->falling_slope_n_samples = slope_n_samples;
+	   The normalized phase will be used as a phase offset for next
+	   fragment (during next function call). It will be added phase of
+	   every sample calculated in next function call. */
 
-	} else if (tone->slope_mode == CW_SLOPE_MODE_NO_SLOPES) {
-		tone->rising_slope_n_samples = 0;
-		tone->falling_slope_n_samples = 0;
+	/* TODO: check if n_periods can be a float. We could avoid the casts. */
+	const int n_periods = (int) floorf(phase / (2.0F * CW_PI));
+	gen->phase_offset = phase - (float) n_periods * 2.0F * CW_PI;
 
-	} else {
-		cw_assert (0, MSG_PREFIX "unknown tone slope mode %d", tone->slope_mode);
-	}
+	return;
+}
 
-	/* This is part of initialization of tone. Zero samples from the tone
-	   have been calculated and put into generator's buffer. */
-	tone->sample_iterator = 0;
 
-#if 0
-	/* Debug code. */
-	if (tone->is_forever) {
-		fprintf(stderr, "++++ count of samples in forever tone '%c' = %d\n", tone->debug_id, tone->n_samples);
-	} else {
-		fprintf(stderr, "++++ count of samples in regular tone '%c' = %d\n", tone->debug_id, tone->n_samples);
-	}
-#endif
 
-	return;
-}
 
+/**
+   @brief Convert phase offset to value of 32-bit phase accumulator
 
+   Phase offset of generator that has been created but hasn't been
+   started is negative. Conversion of negative value to unsigned type is
+   undefined, so the phase is first brought into <0; 2*Pi) range.
 
+   @param[in] phase_offset phase [radians]
 
-cw_ret_t cw_gen_set_speed(cw_gen_t * gen, int new_value)
+   @return value of phase accumulator, in which full range corresponds to 2*Pi
+*/
+static uint32_t cw_gen_phase_offset_to_acc_internal(float phase_offset)
 {
-	if (new_value < CW_SPEED_MIN || new_value > CW_SPEED_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+	/* 2^32 / (2*Pi). Double precision is used only for the
+	   conversions done once per fragment. */
+	const double rad_to_acc = 4294967296.0 / (2.0 * (double) CW_PI);
 
-	if (new_value != gen->send_speed) {
-		gen->send_speed = new_value;
-
-		/* Changes of send speed require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
+	double phase = fmod((double) phase_offset, 2.0 * (double) CW_PI);
+	if (phase < 0.0) {
+		phase += 2.0 * (double) CW_PI;
 	}
 
-	return CW_SUCCESS;
+	/* Phase very close to 2*Pi may give 2^32, which wraps to zero. */
+	return (uint32_t) (uint64_t) (phase * rad_to_acc);
 }
 
 
 
 
-cw_ret_t cw_gen_set_frequency(cw_gen_t * gen, int new_value)
+/**
+   @brief Initialize tables of sine values used by table oscillators
+
+   The table covers one full period of sine wave. There is one extra
+   cell at the end (equal to first cell), so that linear interpolation
+   between last and "next" cell doesn't need wrapping of index.
+*/
+void cw_gen_constructor_internal(void)
 {
-	if (new_value < CW_FREQUENCY_MIN || new_value > CW_FREQUENCY_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	} else {
-		gen->frequency = new_value;
-		return CW_SUCCESS;
+	for (int i = 0; i <= CW_GEN_SINE_TABLE_SIZE; i++) {
+		const double radian = 2.0 * (double) CW_PI * (double) i / (double) CW_GEN_SINE_TABLE_SIZE;
+		g_sine_table[i] = (float) sin(radian);
+		g_sine_table_q15[i] = (int32_t) lround(sin(radian) * (CW_GEN_Q15_ONE - 1));
 	}
+	return;
 }
 
 
 
 
-cw_ret_t cw_gen_set_volume(cw_gen_t * gen, int new_value)
-{
-	if (new_value < CW_VOLUME_MIN || new_value > CW_VOLUME_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	} else {
-		gen->volume_percent = new_value;
-		gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+/**
+   @brief Set parameters describing slopes of tones generated by generator
 
-		cw_gen_set_tone_slope(gen, -1, -1);
+   Most of variables related to slope of tones is in @p tone, but there are
+   still some variables that are generator-specific, as they are common for
+   all tones.  This function sets two of these generator-specific variables.
 
-		return CW_SUCCESS;
-	}
-}
+   A: If you pass to function conflicting values of @p slope_shape and
+   @p slope_duration, the function will return CW_FAILURE. These
+   conflicting values are rectangular slope shape and larger than zero
+   slope length. You just can't have rectangular slopes that have
+   non-zero length.
 
+   B: If you pass to function '\-1' as value of both @p slope_shape and
+   @p slope_duration, the function won't change any of the related two
+   generator's parameters.
 
+   C1: If you pass to function '\-1' as value of either @p slope_shape or
+   @p slope_duration, the function will attempt to set only this generator's
+   parameter that is different than '\-1'.
 
+   C2: However, if selected slope shape is rectangular, function will
+   set generator's slope length to zero, even if value of \p
+   slope_duration is '\-1'.
 
-cw_ret_t cw_gen_set_gap(cw_gen_t * gen, int new_value)
-{
-	if (new_value < CW_GAP_MIN || new_value > CW_GAP_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+   D: Notice that the function allows non-rectangular slope shape with
+   zero length of the slopes. The slopes will be non-rectangular, but
+   just unusually short.
 
-	if (new_value != gen->gap) {
-		gen->gap = new_value;
-		/* Changes of gap require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
-	}
+   @internal TODO: Seriously, these rules (A-D) for setting a slope are too complicated. Simplify them. Accept only a small subset of valid/sane values. Perhaps split the function into two separate functions: for setting slope shape and slope duration. @endinternal
 
-	return CW_SUCCESS;
-}
+   The function should be called every time one of following
+   parameters change:
 
+   @li shape of slope,
+   @li duration of slope,
+   @li generator's sample rate,
+   @li generator's volume.
 
+   There are four supported shapes of slopes:
+   @li linear (the only one supported by libcw until version 4.1.1),
+   @li raised cosine (supposedly the most desired shape),
+   @li sine,
+   @li rectangular.
 
+   Use CW_TONE_SLOPE_SHAPE_* symbolic names as values of @p slope_shape.
 
-cw_ret_t cw_gen_set_weighting(cw_gen_t * gen, int new_value)
-{
-	if (new_value < CW_WEIGHTING_MIN || new_value > CW_WEIGHTING_MAX) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+   FIXME: first argument of this public function is gen, but no
+   function provides access to generator variable.
 
-	if (new_value != gen->weighting) {
-		gen->weighting = new_value;
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
 
-		/* Changes of weighting require resynchronization. */
-		gen->parameters_in_sync = false;
-		cw_gen_sync_parameters_internal(gen);
-	}
+   @param[in] gen generator for which to set tone slope parameters
+   @param[in] slope_shape shape of slope: linear, raised cosine, sine, rectangular
+   @param[in] slope_duration duration of slope [microseconds]
 
-	return CW_SUCCESS;
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+int cw_generator_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+{
+	return cw_gen_set_tone_slope(gen, slope_shape, slope_duration);
 }
 
 
 
 
-int cw_gen_get_speed(const cw_gen_t * gen)
-{
-	return gen->send_speed;
-}
-
+/**
+   See comment for cw_generator_set_tone_slope()
 
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+*/
+cw_ret_t cw_gen_set_tone_slope(cw_gen_t * gen, int slope_shape, int slope_duration)
+{
+	assert (gen);
 
+	/* Handle conflicting values of arguments. */
+	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR
+	    && slope_duration > 0) {
 
-int cw_gen_get_frequency(const cw_gen_t * gen)
-{
-	return gen->frequency;
-}
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "requested a rectangular slope shape, but also requested slope duration > 0");
 
+		return CW_FAILURE;
+	}
 
+	/* Assign new values from arguments. */
+	if (slope_shape != -1) {
+		gen->tone_slope.shape = slope_shape;
+	}
+	if (slope_duration != -1) {
+		gen->tone_slope.duration = slope_duration;
+	}
 
 
-int cw_gen_get_volume(const cw_gen_t * gen)
-{
-	return gen->volume_percent;
-}
+	/* Override of slope duration. */
+	if (slope_shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
+		/* TODO: what's going on here? Why do we set this to zero? */
+		gen->tone_slope.duration = 0;
+	}
 
 
+	int slope_n_samples = ((gen->sample_rate / 100) * gen->tone_slope.duration) / 10000;
+	cw_assert (slope_n_samples >= 0, MSG_PREFIX "negative slope_n_samples: %d", slope_n_samples);
 
 
-int cw_gen_get_gap(const cw_gen_t * gen)
-{
-	return gen->gap;
-}
+	/* Reallocate the table of slope amplitudes only when necessary.
 
+	   The tables only grow, so switching between shorter and longer
+	   slopes doesn't allocate memory each time, and generator with
+	   preallocated tables doesn't allocate memory here at all. */
 
+	if (CW_SUCCESS != cw_gen_reserve_slope_amplitudes_internal(gen, slope_n_samples)) {
+		return CW_FAILURE;
+	}
+	gen->tone_slope.n_amplitudes = slope_n_samples;
 
+	cw_gen_recalculate_slope_amplitudes_internal(gen);
 
-int cw_gen_get_weighting(const cw_gen_t * gen)
-{
-	return gen->weighting;
+	return CW_SUCCESS;
 }
 
 
 
 
-void cw_gen_get_timing_parameters_internal(cw_gen_t * gen,
-					   int * dot_duration,
-					   int * dash_duration,
-					   int * ims_duration,
-					   int * ics_duration,
-					   int * iws_duration,
-					   int * additional_space_duration,
-					   int * adjustment_space_duration)
-{
-	cw_gen_sync_parameters_internal(gen);
+/**
+   @brief Make sure that tables of slope amplitudes have room for @p n_amplitudes amplitudes
 
-	if (dot_duration)  { *dot_duration  = gen->durations.dot_duration; }
-	if (dash_duration) { *dash_duration = gen->durations.dash_duration; }
-	if (ims_duration)  { *ims_duration  = gen->durations.ims_duration; }
-	if (ics_duration)  { *ics_duration  = gen->durations.ics_duration; }
-	if (iws_duration)  { *iws_duration  = gen->durations.iws_duration; }
+   The tables are not allocated for zero-duration slopes, which don't
+   use them.
 
-	if (additional_space_duration) { *additional_space_duration = gen->durations.additional_space_duration; }
-	if (adjustment_space_duration) { *adjustment_space_duration = gen->durations.adjustment_space_duration; }
-}
+   @param[in,out] gen generator
+   @param[in] n_amplitudes requested count of amplitudes
 
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure to allocate memory
+*/
+static cw_ret_t cw_gen_reserve_slope_amplitudes_internal(cw_gen_t * gen, int n_amplitudes)
+{
+	if (n_amplitudes <= gen->tone_slope.capacity) {
+		return CW_SUCCESS;
+	}
 
+	float * amplitudes = realloc(gen->tone_slope.amplitudes, sizeof (float) * (size_t) n_amplitudes);
+	if (NULL == amplitudes) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to realloc() table of slope amplitudes");
+		return CW_FAILURE;
+	}
+	gen->tone_slope.amplitudes = amplitudes;
 
+	int32_t * amplitudes_fixed = realloc(gen->tone_slope.amplitudes_fixed, sizeof (int32_t) * (size_t) n_amplitudes);
+	if (NULL == amplitudes_fixed) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to realloc() table of integer slope amplitudes");
+		return CW_FAILURE;
+	}
+	gen->tone_slope.amplitudes_fixed = amplitudes_fixed;
 
-void cw_gen_get_durations_internal(cw_gen_t * gen, cw_gen_durations_t * durations)
-{
-	/*
-	  This function shall always and forever be a wrapper around
-	  cw_gen_get_timing_parameters_internal(). Let the wrapped function do
-	  some steps necessary before returning the parameters.
-	*/
+	gen->tone_slope.capacity = n_amplitudes;
 
-	cw_gen_get_timing_parameters_internal
-		(gen,
-		 &durations->dot_duration,
-		 &durations->dash_duration,
-		 &durations->ims_duration,
-		 &durations->ics_duration,
-		 &durations->iws_duration,
-		 &durations->additional_space_duration,
-		 &durations->adjustment_space_duration);
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Enqueue a mark (Dot or Dash)
-
-   Low level primitive to enqueue a tone for mark of the given type, followed
-   by the standard inter-mark-space.
+   @brief Allocate all memory that generator needs to generate tones
 
-   Function sets errno to EINVAL if an argument is invalid, and
-   returns CW_FAILURE.
-
-   Function also returns CW_FAILURE if adding the element to queue of
-   tones failed.
-
-   @reviewedon 2023-08-26
+   See cw_gen_config_t::preallocate. Sample rate and capacity of tone
+   queue must be already known.
 
-   @param[in] gen generator to be used to enqueue a mark and inter-mark-space
-   @param[in] mark mark to send: Dot (CW_DOT_REPRESENTATION) or Dash (CW_DASH_REPRESENTATION)
-   @param[in] is_first is it a first mark in a character?
+   @param[in,out] gen generator
 
-   @return CW_FAILURE on failure
    @return CW_SUCCESS on success
+   @return CW_FAILURE on failure to allocate memory
 */
-cw_ret_t cw_gen_enqueue_mark_internal(cw_gen_t * gen, char mark, bool is_first)
+static cw_ret_t cw_gen_preallocate_internal(cw_gen_t * gen)
 {
-	cw_ret_t cwret = CW_FAILURE;
+	/* Tone queue. */
+	if (CW_SUCCESS != cw_tq_preallocate_internal(gen->tq)) {
+		return CW_FAILURE;
+	}
 
-	/* Synchronize low-level timings if required. */
-	cw_gen_sync_parameters_internal(gen);
-	/* TODO: do we need to synchronize here receiver as well? */
+	/* Slopes. */
+	const int slope_n_samples = (int) (((gen->sample_rate / 100) * CW_GEN_PREALLOCATED_SLOPE_DURATION) / 10000);
+	if (CW_SUCCESS != cw_gen_reserve_slope_amplitudes_internal(gen, slope_n_samples)) {
+		return CW_FAILURE;
+	}
 
-	/* Send either a dot or a dash mark, depending on representation. */
-	if (mark == CW_DOT_REPRESENTATION) {
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, gen->frequency, gen->durations.dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		tone.is_first = is_first;
-		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-		/* Enqueueing a mark means resetting of spaces counter. */
-		gen->space_units_count = 0;
-	} else if (mark == CW_DASH_REPRESENTATION) {
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, gen->frequency, gen->durations.dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		tone.is_first = is_first;
-		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-		/* Enqueueing a mark means resetting of spaces counter. */
-		gen->space_units_count = 0;
-	} else {
-		errno = EINVAL;
-		cwret = CW_FAILURE;
-		/* Reset on error. */
-		gen->space_units_count = 0;
+	/* Cache of pre-rendered tones. */
+	for (int i = 0; i < CW_GEN_TONE_CACHE_N_ENTRIES; i++) {
+		cw_gen_tone_cache_entry_t * entry = &gen->tone_cache.entries[i];
+		if (entry->samples_capacity < CW_GEN_TONE_CACHE_MAX_N_SAMPLES) {
+			cw_sample_t * samples = realloc(entry->samples, sizeof (cw_sample_t) * CW_GEN_TONE_CACHE_MAX_N_SAMPLES);
+			if (NULL == samples) {
+				return CW_FAILURE;
+			}
+			entry->samples = samples;
+			entry->samples_capacity = CW_GEN_TONE_CACHE_MAX_N_SAMPLES;
+		}
 	}
 
-	if (CW_SUCCESS != cwret) {
-		return CW_FAILURE;
+	/* Plateau loop. The fragment has sample_rate / gcd(sample_rate,
+	   frequency) samples, which is never more than sample rate. */
+	if (gen->plateau_loop.samples_capacity < (int) gen->sample_rate) {
+		cw_sample_t * samples = realloc(gen->plateau_loop.samples, sizeof (cw_sample_t) * gen->sample_rate);
+		if (NULL == samples) {
+			return CW_FAILURE;
+		}
+		gen->plateau_loop.samples = samples;
+		gen->plateau_loop.samples_capacity = (int) gen->sample_rate;
 	}
 
-	/* Send the inter-mark-space. */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, gen->durations.ims_duration, CW_SLOPE_MODE_NO_SLOPES);
-	cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	/* Enqueueing an ims must be recorded in space units counter. */
-	gen->space_units_count = UNITS_PER_IMS;
-	return cwret;
+	gen->preallocated = true;
+
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Enqueue inter-character-space
+   @brief Recalculate amplitudes of PCM samples that form tone's slopes
 
-   The function enqueues enough space to form 3-Unit inter-character-space.
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
 
-   The function can be called even when inter-mark-space has already been
-   enqueued. In such situation standard inter-mark-space (one Unit) will be
-   followed by just two Units to form a full standard inter-character-space
-   (three Units).
+   TODO: consider writing unit test code for the function.
 
-   Inter-character adjustment space is added at the end.
+   @param[in] gen generator
+*/
+void cw_gen_recalculate_slope_amplitudes_internal(cw_gen_t * gen)
+{
+	const int n_amplitudes = gen->tone_slope.n_amplitudes;
 
-   @reviewedon 2023-08-06
+	/* The tables are normalized, so they don't depend on volume,
+	   only on these few parameters. */
+	if (gen->tone_slope.calculated_sample_rate == gen->sample_rate
+	    && gen->tone_slope.calculated_shape == gen->tone_slope.shape
+	    && gen->tone_slope.calculated_n_amplitudes == n_amplitudes) {
+		return;
+	}
 
-   @param[in] gen generator in which to enqueue the space
+	/* The values in amplitudes[] change from zero to max (at
+	   least for any sane slope shape), so naturally they can be
+	   used in forming rising slope. However they can be used in
+	   forming falling slope as well - just iterate the table from
+	   end to beginning. */
+	if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_LINEAR) {
+		for (int i = 0; i < n_amplitudes; i++) {
+			gen->tone_slope.amplitudes[i] = (float) i / (float) n_amplitudes;
+		}
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
-*/
-cw_ret_t cw_gen_enqueue_ics_internal(cw_gen_t * gen)
-{
-	/* Synchronize low-level timing parameters. */
-	cw_gen_sync_parameters_internal(gen);
+	} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_SINE
+		   || gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RAISED_COSINE) {
+
+		/* Shapes that need trigonometric functions are taken from
+		   cache shared by all generators. Generator with
+		   preallocated memory calculates the shapes without the
+		   cache, because a miss in the cache allocates new
+		   entry. */
+		pthread_mutex_lock(&g_cw_slope_cache_mutex);
+		const float * unit = gen->preallocated ? NULL : cw_gen_slope_cache_get_internal(gen->sample_rate, gen->tone_slope.shape, gen->tone_slope.duration, n_amplitudes);
+		if (unit) {
+			memcpy(gen->tone_slope.amplitudes, unit, sizeof (float) * (size_t) n_amplitudes);
+		} else {
+			for (int i = 0; i < n_amplitudes; i++) {
+				gen->tone_slope.amplitudes[i] = cw_gen_slope_unit_amplitude_internal(gen->tone_slope.shape, i, n_amplitudes);
+			}
+		}
+		pthread_mutex_unlock(&g_cw_slope_cache_mutex);
 
-	/* The ics enqueued here should be shorter by already enqueued/played
-	   spaces. Calculate the duration of shorter ics depending on what kind
-	   of spaces were already enqueued before. */
-	int ics_duration = 0;
-	switch (gen->space_units_count) {
-	case 0:
-		/* It's possible that dot or dash was enqueued without ims with
-		   cw_gen_enqueue_ik_symbol_no_ims_internal(), or maybe the count was
-		   reset on error, so enqueue ics with its full duration. */
-		ics_duration = gen->durations.ics_duration;
-		break;
-	case UNITS_PER_IMS:
-		/* This ics is appended after already enqueued ims. Duration of the
-		   tone that we enqueue here should be shorter by ims. The ims and
-		   current shortened tone will together form 3-units ics. */
-		ics_duration = gen->durations.ics_duration - gen->durations.ims_duration;
-		break;
-	case UNITS_PER_ICS:
-	case UNITS_PER_IWS:
-		/* libcw API provides functions for enqueueing ics or iws, so it's
-		   possible that application will enqueue multiple ics spaces or mix
-		   of ics and iws. So enqueue this ics in its full duration. */
-		ics_duration = gen->durations.ics_duration;
-		break;
-	default:
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
-		              MSG_PREFIX "Unexpected count of space units in 'enqueue ics': %d", gen->space_units_count);
-		ics_duration = gen->durations.ics_duration;
-		break;
+	} else if (gen->tone_slope.shape == CW_TONE_SLOPE_SHAPE_RECTANGULAR) {
+		/* CW_TONE_SLOPE_SHAPE_RECTANGULAR has zero-duration
+		   slopes, so there is nothing to calculate. */
+		/* TODO: to avoid treating
+		   CW_TONE_SLOPE_SHAPE_RECTANGULAR as special case,
+		   add the calculation here. */
+		cw_assert (0 == n_amplitudes, MSG_PREFIX "we shouldn't be here, calculating rectangular slopes");
+
+	} else {
+		cw_assert (0, MSG_PREFIX "unsupported slope shape %d", gen->tone_slope.shape);
 	}
 
-	/* Failsafe. */
-	if (ics_duration < 0) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
-		              MSG_PREFIX "Negative value of ics duration: %d", ics_duration);
-		ics_duration = gen->durations.ics_duration;
+	for (int i = 0; i < n_amplitudes; i++) {
+		/* Recalculation happens only when parameters of
+		   generator change, so it's ok to use floats here even
+		   for fixed-point engine. */
+		gen->tone_slope.amplitudes_fixed[i] = (int32_t) (gen->tone_slope.amplitudes[i] * 32768.0F);
 	}
 
-	/* Enqueue ics with calculated duration, plus any additional inter-character gap. */
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, 0, ics_duration + gen->durations.additional_space_duration, CW_SLOPE_MODE_NO_SLOPES);
-	const cw_ret_t cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	gen->space_units_count = UNITS_PER_ICS;
-	return cwret;
+	gen->tone_slope.calculated_sample_rate = gen->sample_rate;
+	gen->tone_slope.calculated_shape = gen->tone_slope.shape;
+	gen->tone_slope.calculated_n_amplitudes = n_amplitudes;
+
+	cw_gen_tone_cache_invalidate_internal(gen);
+
+	return;
 }
 
 
 
 
 /**
-   @brief Enqueue space character (' ') in generator, to be sent using Morse code
+   @brief Calculate one amplitude of slope of unit height
 
-   The function should be used to enqueue a regular ' ' character.
+   @param[in] shape shape of slope: CW_TONE_SLOPE_SHAPE_SINE or CW_TONE_SLOPE_SHAPE_RAISED_COSINE
+   @param[in] i index of sample in slope
+   @param[in] n_amplitudes count of samples in slope
 
-   The function enqueues space of length 5 Units. The function is intended to
-   be used after inter-mark-space and inter-character-space have already been
-   enqueued.
+   @return amplitude in range from 0.0 to 1.0
+*/
+static float cw_gen_slope_unit_amplitude_internal(int shape, int i, int n_amplitudes)
+{
+	if (shape == CW_TONE_SLOPE_SHAPE_SINE) {
+		const float radian = (float) i * (CW_PI / 2.0F) / (float) n_amplitudes;
+		return sinf(radian);
+	} else {
+		const float radian = (float) i * CW_PI / (float) n_amplitudes;
+		return (1 - ((1 + cosf(radian)) / 2));
+	}
+}
 
-   In such situation standard inter-mark-space (one Unit) and
-   inter-character-space (two Units) and regular space (five units) form a
-   full standard inter-word-space (seven Units).
 
-   TODO: review this description again. This function alone doesn't send
-   space character, it sends a part of what can be seen as inter-word-space.
 
-   Inter-word adjustment space is added at the end.
 
-   @reviewedon 2023-08-06
+/**
+   @brief Get slope of unit height from library-wide cache of slopes
 
-   @param[in] gen generator in which to enqueue the space
+   Slope is calculated and put into cache if it isn't there yet.
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
+   Must be called with g_cw_slope_cache_mutex locked. Returned pointer
+   is valid only until the mutex is unlocked.
+
+   @param[in] sample_rate sample rate of generator
+   @param[in] shape shape of slope: CW_TONE_SLOPE_SHAPE_SINE or CW_TONE_SLOPE_SHAPE_RAISED_COSINE
+   @param[in] duration duration of slope [us]
+   @param[in] n_amplitudes count of samples in slope
+
+   @return table of @p n_amplitudes amplitudes on success
+   @return NULL on failure to allocate cache entry
 */
-cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen)
+static const float * cw_gen_slope_cache_get_internal(unsigned int sample_rate, int shape, int duration, int n_amplitudes)
 {
-	/* Synchronize low-level timing parameters. */
-	cw_gen_sync_parameters_internal(gen);
+	for (int e = 0; e < CW_GEN_SLOPE_CACHE_N_ENTRIES; e++) {
+		const cw_slope_cache_entry_t * entry = &g_cw_slope_cache[e];
+		if (NULL != entry->amplitudes
+		    && entry->sample_rate == sample_rate
+		    && entry->shape == shape
+		    && entry->duration == duration
+		    && entry->n_amplitudes == n_amplitudes) {
+			return entry->amplitudes;
+		}
+	}
 
-	/* The iws enqueued here should be shorter by already enqueued/played
-	   spaces. Calculate the duration of shorter iws depending on what kind
-	   of spaces were already enqueued before. */
-	int iws_duration = 0;
-	switch (gen->space_units_count) {
-	case 0:
-		/* We may get here when we only begin to play some string, or when
-		   some reset of space_units_count was done, or when previous
-		   element was an iws. This iws should have full duration. */
-		iws_duration = gen->durations.iws_duration;
-		break;
-	case UNITS_PER_IMS:
-		/* This iws is appended after already enqueued ims (e.g. at the end
-		   of a word, when ' ' space character is played). Duration of the
-		   tone that we enqueue here should be shorter by ims. The ims and
-		   current shortened tone will together form 7-unit iws. */
-		iws_duration = gen->durations.iws_duration - gen->durations.ims_duration;
-		break;
-	case UNITS_PER_ICS:
-		/* This iws is appended after already enqueued ics. Duration of the
-		   tone that we enqueue here should be shorter by ics. The ics and
-		   current shortened tone will together form 7-unit iws. */
-		iws_duration = gen->durations.iws_duration - gen->durations.ics_duration;
-		break;
-	case UNITS_PER_IWS:
-		/* This is probably a situation when application wants to enqueue two
-		   or more ' ' characters. Enqueue full duration of inter-word-space. */
-		iws_duration = gen->durations.iws_duration;
-		break;
-	default:
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
-		              MSG_PREFIX "Unexpected count of space units in 'enqueue iws': %d", gen->space_units_count);
-		iws_duration = gen->durations.iws_duration;
-		break;
-	};
+	float * amplitudes = (float *) malloc(sizeof (float) * (size_t) n_amplitudes);
+	if (NULL == amplitudes) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "failed to allocate entry of cache of slopes");
+		return NULL;
+	}
+	for (int i = 0; i < n_amplitudes; i++) {
+		amplitudes[i] = cw_gen_slope_unit_amplitude_internal(shape, i, n_amplitudes);
+	}
 
-	/* Failsafe. */
-	if (iws_duration < 0) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
-		              MSG_PREFIX "Negative value of iws duration: %d", iws_duration);
-		iws_duration = gen->durations.iws_duration;
+	cw_slope_cache_entry_t * entry = &g_cw_slope_cache[g_cw_slope_cache_next];
+	g_cw_slope_cache_next = (g_cw_slope_cache_next + 1) % CW_GEN_SLOPE_CACHE_N_ENTRIES;
+	free(entry->amplitudes);
+	entry->sample_rate = sample_rate;
+	entry->shape = shape;
+	entry->duration = duration;
+	entry->n_amplitudes = n_amplitudes;
+	entry->amplitudes = amplitudes;
+
+	return entry->amplitudes;
+}
+
+
+
+
+/**
+   @brief Get current time on monotonic clock, for metrics of generator
+
+   @return current time, in nanoseconds
+*/
+static uint64_t cw_gen_metrics_now_internal(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+
+
+
+/**
+   @brief Update metrics of generator after a buffer has been written to sound device
+
+   Times of write and synthesis collected for the buffer in
+   gen->metrics are added to totals, and reset for next buffer. Time
+   of synthesis is also passed to quality scaling.
+
+   @param[in] gen generator
+   @param[in] write_cwret result of writing the buffer
+   @param[in] n_samples count of samples in the buffer
+*/
+static void cw_gen_metrics_buffer_written_internal(cw_gen_t * gen, cw_ret_t write_cwret, int n_samples)
+{
+	const uint64_t write_ns = gen->metrics.buffer_write_ns;
+	const uint64_t synthesis_ns = gen->metrics.buffer_synthesis_ns;
+	gen->metrics.buffer_write_ns = 0;
+	gen->metrics.buffer_synthesis_ns = 0;
+
+	if (CW_SUCCESS == write_cwret) {
+		__atomic_add_fetch(&gen->metrics.n_buffers_written, 1, __ATOMIC_RELAXED);
 	}
 
-	/* Send silence for the word delay period, plus any adjustment
-	   that may be needed at end of word. Make it in two tones,
-	   and here is why.
+	/* Only generator's thread writes the fields, so a plain
+	   read-modify-write of each field is safe. */
+	const uint64_t n_timed = __atomic_load_n(&gen->metrics.n_timed_buffers, __ATOMIC_RELAXED);
+	if (0 == n_timed || write_ns < __atomic_load_n(&gen->metrics.write_ns_min, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&gen->metrics.write_ns_min, write_ns, __ATOMIC_RELAXED);
+	}
+	if (write_ns > __atomic_load_n(&gen->metrics.write_ns_max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&gen->metrics.write_ns_max, write_ns, __ATOMIC_RELAXED);
+	}
+	if (synthesis_ns > __atomic_load_n(&gen->metrics.synthesis_ns_max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&gen->metrics.synthesis_ns_max, synthesis_ns, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&gen->metrics.write_ns_total, write_ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&gen->metrics.synthesis_ns_total, synthesis_ns, __ATOMIC_RELAXED);
+	__atomic_store_n(&gen->metrics.n_timed_buffers, n_timed + 1, __ATOMIC_RELAXED);
 
-	   Let's say that 'tone queue low watermark' is one element
-	   (i.e. one tone).
+	cw_gen_quality_update_internal(gen, synthesis_ns, n_samples);
+}
 
-	   In order for tone queue to recognize that a 'low tone
-	   queue' callback needs to be called, the level in tq needs
-	   to drop from 2 to 1.
 
-	   Almost every queued character guarantees that there will be
-	   at least two tones, e.g for 'E' it is dash + following
-	   space. But what about a ' ' character?
 
-	   If we enqueue ' ' character as single tone, there is only one
-	   tone in tone queue, and the tone queue manager can't
-	   recognize when the level drops from 2 to 1 (and thus the
-	   'low level' callback won't be called).
 
-	   If we enqueue ' ' character as two separate tones (as we do
-	   this in this function), the tone queue manager can
-	   recognize level dropping from 2 to 1. Then the passing of
-	   critical level can be noticed, and "low level" callback can
-	   be called.
+/**
+   @brief Allocate buffers of generator's pipeline
 
-	   BUT: Sometimes the first tone is dequeued before/during the
-	   second one is enqueued, and we can't recognize 2->1 event.
+   Pipeline is used only by sound systems that write whole buffer
+   from generator's memory with blocking write_buffer_to_sound_device().
+   With any other sound system, or when @p n_buffers is less than two,
+   the function doesn't allocate anything and pipeline is not used.
 
-	   So, to be super-sure that there is a recognizable event of
-	   passing tone queue level from 2 to 1, we split the inter-word-space
-	   into N parts and enqueue them. This way we have N + 1
-	   tones per space, and client applications that rely on low
-	   level threshold == 1 can correctly work when enqueueing
-	   spaces.
+   The function must be called after ::own_buffer has been allocated.
 
-	   At 60 wpm duration of gen->iws_duration is 100000 [us], so
-	   it's large enough to safely divide it by small integer
-	   value. */
+   @param[in] gen generator with opened sound device
+   @param[in] n_buffers requested count of buffers in pipeline
 
-	int enqueued = 0;
-	cw_tone_t tone;
-#if 0
-	/* This section is incorrect. Enable this section only for
-	   tests.  This section "implements" a bug that was present in
-	   libcw until version 6.4.1 and that is now tested by
-	   src/libcw/tests/libcw_test_tq_short_space.c */
-	const int n = 1; /* No division. Old situation causing an error in
-		      client applications. */
-#else
-	const int n = 2; /* "small integer value" - used to have more tones per inter-word-space. */
-#endif
-	CW_TONE_INIT(&tone, 0, iws_duration / n, CW_SLOPE_MODE_NO_SLOPES);
-	for (int i = 0; i < n; i++) {
-		if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
-			/* Reset on error. */
-			gen->space_units_count = 0;
-			return CW_FAILURE;
-		}
-		enqueued++;
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure to allocate memory
+*/
+static cw_ret_t cw_gen_pipeline_new_internal(cw_gen_t * gen, int n_buffers)
+{
+	gen->pipeline.n_buffers = 0;
+	if (n_buffers < 2
+	    || NULL == gen->own_buffer
+	    || NULL == gen->write_buffer_to_sound_device
+	    || NULL != gen->acquire_buffer_from_sound_device
+	    || NULL != gen->start_sound_device
+	    || gen->sidetone.enabled) {
+
+		/* Sound devices that pull samples from generator or
+		   in which samples are calculated in place don't
+		   have a separate write that could be overlapped with
+		   calculation of samples. Low-latency sidetone
+		   discards silence that waits in ::buffer, so it
+		   needs only one buffer. */
+		return CW_SUCCESS;
+	}
+	if (n_buffers > CW_GEN_PIPELINE_N_BUFFERS_MAX) {
+		n_buffers = CW_GEN_PIPELINE_N_BUFFERS_MAX;
 	}
 
-	/* TODO acerion 2023.06.13: Don't enqueue the adjustment space as
-	   separate tone. Add value of gen->adjustment_space_duration to
-	   'duration' and enqueue resulting duration above. See how
-	   'additional_space_duration' is added to ics duration in
-	   cw_gen_enqueue_ics_internal(). */
-	if (gen->durations.adjustment_space_duration > 0) {
-		CW_TONE_INIT(&tone, 0, gen->durations.adjustment_space_duration, CW_SLOPE_MODE_NO_SLOPES);
-		if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
-			/* Reset on error. */
-			gen->space_units_count = 0;
+	gen->pipeline.buffers[0] = gen->own_buffer;
+	for (int i = 1; i < n_buffers; i++) {
+		gen->pipeline.buffers[i] = (cw_sample_t *) calloc((size_t) gen->buffer_n_samples, sizeof (cw_sample_t));
+		if (NULL == gen->pipeline.buffers[i]) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			for (int j = 1; j < i; j++) {
+				free(gen->pipeline.buffers[j]);
+				gen->pipeline.buffers[j] = NULL;
+			}
 			return CW_FAILURE;
 		}
-		enqueued++;
 	}
+	gen->pipeline.n_buffers = n_buffers;
+	gen->pipeline.current = 0;
 
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
-		      MSG_PREFIX "enqueued %d tones per iws, tq len = %zu",
-		      enqueued, cw_tq_length_internal(gen->tq));
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "pipeline of %d buffers", n_buffers);
 
-	/* We don't really need to store the information that UNITS_PER_IWS units
-	   have been enqueued. It's safe to reset the counter here and let the
-	   next 'enqueue space' call start from zero. */
-	gen->space_units_count = 0;
 	return CW_SUCCESS;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_representation(cw_gen_t * gen, const char * representation)
+/**
+   @brief Start pipeline's thread that writes buffers to sound device
+
+   Called by generator's thread. If the thread can't be created, or
+   generator doesn't use pipeline, generator's thread writes its
+   buffers itself.
+
+   @param[in] gen generator
+*/
+static void cw_gen_pipeline_start_internal(cw_gen_t * gen)
 {
-	if (!cw_representation_is_valid(representation)) {
-		errno = EINVAL;
-		return CW_FAILURE;
+	if (0 == gen->pipeline.n_buffers) {
+		return;
 	}
 
-	/* Before we let this representation loose on tone generation,
-	   we'd really like to know that all of its tones will get queued
-	   up successfully.  The right way to do this is to calculate the
-	   number of tones in our representation, then check that the space
-	   exists in the tone queue. However, since the queue is comfortably
-	   long, we can get away with just looking for a high water mark.  */
-	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
-		errno = EAGAIN;
-		return CW_FAILURE;
+	/* ::buffer may still hold samples calculated before previous
+	   stop of generator, so it stays the current buffer. All other
+	   buffers are free. */
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	gen->pipeline.filled_head = 0;
+	gen->pipeline.n_filled = 0;
+	gen->pipeline.n_free = 0;
+	for (int i = 0; i < gen->pipeline.n_buffers; i++) {
+		gen->pipeline.written[i] = false;
+		if (gen->pipeline.buffers[i] == gen->buffer) {
+			gen->pipeline.current = i;
+		} else {
+			gen->pipeline.free[gen->pipeline.n_free++] = i;
+		}
+	}
+	gen->pipeline.quit = false;
+	pthread_mutex_unlock(&gen->pipeline.mutex);
+
+	/* The new thread inherits scheduling policy and CPU affinity
+	   of generator's thread. */
+	const int rv = pthread_create(&gen->pipeline.thread_id, NULL, cw_gen_pipeline_write_internal, (void *) gen);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "failed to create pipeline's thread: %s", strerror(rv));
+		return;
 	}
+	gen->pipeline.running = true;
 
-	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
-	for (int i = 0; representation[i] != '\0'; i++) {
-		const bool is_first = i == 0;
-		if (CW_SUCCESS != cw_gen_enqueue_mark_internal(gen, representation[i], is_first)) {
-			return CW_FAILURE;
-		}
+	return;
+}
+
+
+
+
+/**
+   @brief Write remaining buffers of pipeline and stop pipeline's thread
+
+   Called by generator's thread.
+
+   @param[in] gen generator
+*/
+static void cw_gen_pipeline_stop_internal(cw_gen_t * gen)
+{
+	if (!gen->pipeline.running) {
+		return;
 	}
 
-	/* This function will enqueue just a right amount of space after the last
-	   inter-mark-space to form a 3-unit inter-character-space. */
-	if (CW_SUCCESS != cw_gen_enqueue_ics_internal(gen)) {
-		return CW_FAILURE;
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	gen->pipeline.quit = true;
+	pthread_cond_broadcast(&gen->pipeline.cond);
+	pthread_mutex_unlock(&gen->pipeline.mutex);
+
+	pthread_join(gen->pipeline.thread_id, NULL);
+	gen->pipeline.running = false;
+
+	for (int i = 0; i < gen->pipeline.n_buffers; i++) {
+		cw_gen_pipeline_collect_internal(gen, i);
 	}
 
-	return CW_SUCCESS;
+	return;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_representation_no_ics(cw_gen_t * gen, const char * representation)
+/**
+   @brief Pass full ::buffer to pipeline's thread and take next free buffer
+
+   Called by generator's thread. The function waits until pipeline's
+   thread frees a buffer, so generator can't get ahead of sound device
+   by more than (count of buffers - 1) buffers.
+
+   @param[in] gen generator with running pipeline
+   @param[in] n_samples count of samples in full ::buffer
+*/
+static void cw_gen_pipeline_submit_internal(cw_gen_t * gen, int n_samples)
 {
-	if (!cw_representation_is_valid(representation)) {
-		errno = EINVAL;
-		return CW_FAILURE;
+	const int n = gen->pipeline.n_buffers;
+
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	gen->pipeline.n_samples[gen->pipeline.current] = n_samples;
+	gen->pipeline.filled[(gen->pipeline.filled_head + gen->pipeline.n_filled) % n] = gen->pipeline.current;
+	gen->pipeline.n_filled++;
+	pthread_cond_broadcast(&gen->pipeline.cond);
+
+	while (0 == gen->pipeline.n_free) {
+		pthread_cond_wait(&gen->pipeline.cond, &gen->pipeline.mutex);
 	}
+	const int next = gen->pipeline.free[--gen->pipeline.n_free];
+	pthread_mutex_unlock(&gen->pipeline.mutex);
 
-	/* Before we let this representation loose on tone generation,
-	   we'd really like to know that all of its tones will get queued
-	   up successfully.  The right way to do this is to calculate the
-	   number of tones in our representation, then check that the space
-	   exists in the tone queue. However, since the queue is comfortably
-	   long, we can get away with just looking for a high water mark.
+	gen->pipeline.current = next;
+	gen->buffer = gen->pipeline.buffers[next];
+	cw_gen_pipeline_collect_internal(gen, next);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add result of write of pipeline's buffer to metrics of generator
+
+   Called by generator's thread for a buffer that has been written
+   by pipeline's thread and is not used by pipeline's thread anymore.
+
+   @param[in] gen generator
+   @param[in] i index of buffer in pipeline
+*/
+static void cw_gen_pipeline_collect_internal(cw_gen_t * gen, int i)
+{
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	const bool written = gen->pipeline.written[i];
+	const cw_ret_t write_cwret = gen->pipeline.write_cwret[i];
+	const uint64_t write_ns = gen->pipeline.write_ns[i];
+	const uint64_t dsp_ns = gen->pipeline.dsp_ns[i];
+	const int n_samples = gen->pipeline.n_samples[i];
+	gen->pipeline.written[i] = false;
+	pthread_mutex_unlock(&gen->pipeline.mutex);
+
+	if (written) {
+		gen->metrics.buffer_write_ns += write_ns;
+		gen->metrics.buffer_synthesis_ns += dsp_ns;
+		cw_gen_metrics_buffer_written_internal(gen, write_cwret, n_samples);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write full buffers of pipeline to sound device
+
+   This is a thread function. It returns when generator's thread has
+   asked it to quit, and all full buffers have been written.
+
+   @param[in] arg generator
+
+   @return NULL
+*/
+static void * cw_gen_pipeline_write_internal(void * arg)
+{
+	cw_gen_t * gen = (cw_gen_t *) arg;
+	const int n = gen->pipeline.n_buffers;
+
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	while (true) {
+		while (0 == gen->pipeline.n_filled && !gen->pipeline.quit) {
+			pthread_cond_wait(&gen->pipeline.cond, &gen->pipeline.mutex);
+		}
+		if (0 == gen->pipeline.n_filled) {
+			break;
+		}
+		const int i = gen->pipeline.filled[gen->pipeline.filled_head];
+		const int n_samples = gen->pipeline.n_samples[i];
+		gen->pipeline.filled_head = (gen->pipeline.filled_head + 1) % n;
+		gen->pipeline.n_filled--;
+		pthread_mutex_unlock(&gen->pipeline.mutex);
+
+		gen->out_buffer = gen->pipeline.buffers[i];
+		gen->out_n_samples = n_samples;
+		const uint64_t dsp_begin = cw_gen_metrics_now_internal();
+		cw_gen_dsp_process_internal(gen, gen->out_buffer, gen->out_n_samples);
+		const uint64_t dsp_ns = cw_gen_metrics_now_internal() - dsp_begin;
+		CW_TRACE(CW_TRACE_GEN_WRITE_BEGIN, n_samples);
+		const uint64_t write_begin = cw_gen_metrics_now_internal();
+		const cw_ret_t write_cwret = gen->write_buffer_to_sound_device(gen);
+		const uint64_t write_ns = cw_gen_metrics_now_internal() - write_begin;
+		CW_TRACE(CW_TRACE_GEN_WRITE_END, write_cwret);
+		cw_gen_tap_write_internal(gen, gen->pipeline.buffers[i], n_samples);
+		cw_gen_sinks_publish_internal(gen, gen->pipeline.buffers[i], n_samples);
+
+		pthread_mutex_lock(&gen->pipeline.mutex);
+		/* Under lock, so that generator's thread sees new end
+		   of device's queue together with count of buffers that
+		   are still waiting for write. */
+		cw_gen_device_clock_update_internal(gen);
+		gen->pipeline.written[i] = true;
+		gen->pipeline.write_cwret[i] = write_cwret;
+		gen->pipeline.write_ns[i] = write_ns;
+		gen->pipeline.dsp_ns[i] = dsp_ns;
+		gen->pipeline.free[gen->pipeline.n_free++] = i;
+		pthread_cond_broadcast(&gen->pipeline.cond);
+	}
+	pthread_mutex_unlock(&gen->pipeline.mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Wait until pipeline's thread has written all full buffers
+
+   Called by generator's thread.
+
+   @param[in] gen generator with running pipeline
+*/
+static void cw_gen_pipeline_drain_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->pipeline.mutex);
+	while (gen->pipeline.n_free < gen->pipeline.n_buffers - 1) {
+		pthread_cond_wait(&gen->pipeline.cond, &gen->pipeline.mutex);
+	}
+	pthread_mutex_unlock(&gen->pipeline.mutex);
+
+	for (int i = 0; i < gen->pipeline.n_buffers; i++) {
+		if (i != gen->pipeline.current) {
+			cw_gen_pipeline_collect_internal(gen, i);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write samples from partially filled buffer to sound device
+
+   Called by generator's thread when tone queue has become empty, so
+   that the last samples are played right away instead of waiting in
+   ::buffer for next tones (see cw_gen_config_t::flush_on_empty_queue).
+   Rest of the buffer is not padded with silence: the sound device
+   gets a short write.
+
+   Sound systems that pull samples from generator, or that don't use
+   ::buffer, aren't affected.
+
+   @param[in] gen generator
+*/
+static void cw_gen_flush_buffer_internal(cw_gen_t * gen)
+{
+	if (0 == gen->buffer_sub_start
+	    || NULL == gen->buffer
+	    || NULL == gen->write_buffer_to_sound_device
+	    || NULL != gen->start_sound_device) {
+		return;
+	}
+
+	if (gen->pipeline.running) {
+		/* Samples from previous buffers must be written first. */
+		cw_gen_pipeline_drain_internal(gen);
+	}
+
+	gen->out_buffer = gen->buffer;
+	gen->out_n_samples = gen->buffer_sub_start;
+	cw_gen_dsp_process_internal(gen, gen->out_buffer, gen->out_n_samples);
+	CW_TRACE(CW_TRACE_GEN_WRITE_BEGIN, gen->out_n_samples);
+	const cw_ret_t write_cwret = gen->write_buffer_to_sound_device(gen);
+	CW_TRACE(CW_TRACE_GEN_WRITE_END, write_cwret);
+	cw_gen_device_clock_update_internal(gen);
+	if (CW_SUCCESS != write_cwret) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "failed to flush %d samples", gen->out_n_samples);
+	}
+	cw_gen_tap_write_internal(gen, gen->out_buffer, gen->out_n_samples);
+	cw_gen_sinks_publish_internal(gen, gen->out_buffer, gen->out_n_samples);
+	gen->out_n_samples = gen->buffer_n_samples;
+
+	/* Silence that has just been written isn't waiting in ::buffer
+	   anymore. */
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Stop playing silent 'forever' tone that has been played for too long
+
+   Straight key leaves silent 'forever' tone in tone queue after each
+   Mark, and generator would calculate and write silence until the key
+   is closed again. After cw_gen_config_t::idle_timeout of such silence
+   the tone is removed from the queue, so that generator can go idle.
+
+   @param[in] gen generator with enabled idle mode
+   @param[in] tone tone dequeued from generator's queue
+
+   @return true if @p tone has been removed from queue and should not be played
+   @return false otherwise
+*/
+static bool cw_gen_idle_retire_silence_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (!tone->is_forever || tone->frequency > 0) {
+		gen->idle.silence_duration = 0;
+		return false;
+	}
+
+	gen->idle.silence_duration += tone->duration;
+	if (gen->idle.silence_duration < gen->idle.timeout) {
+		return false;
+	}
+
+	return cw_tq_retire_forever_tone_internal(gen->tq);
+}
+
+
+
+
+/**
+   @brief Wait in generator's thread until a tone is enqueued
+
+   In idle mode (cw_gen_config_t::idle_timeout) the wait is split in
+   two: if the queue stays empty for the idle timeout, sound device is
+   paused, and resumed when the wait ends.
+
+   @param[in] gen generator
+*/
+static void cw_gen_idle_wait_for_tone_internal(cw_gen_t * gen)
+{
+	cw_tone_queue_t * tq = gen->tq;
+	gen->idle.silence_duration = 0;
+
+	if (gen->idle.timeout > 0 && !gen->idle.paused) {
+		struct timespec deadline = { 0 };
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		const int64_t nsec = deadline.tv_nsec + (gen->idle.timeout % CW_USECS_PER_SEC) * 1000;
+		deadline.tv_sec += (time_t) (gen->idle.timeout / CW_USECS_PER_SEC + nsec / 1000000000);
+		deadline.tv_nsec = (long) (nsec % 1000000000);
+
+		bool timed_out = false;
+		cw_tq_wait_lock_internal(tq, CW_TQ_WAIT_NONEMPTY);
+		while (CW_TQ_EMPTY == cw_tq_get_state_internal(tq) && gen->do_dequeue_and_generate && !timed_out) {
+			timed_out = CW_SUCCESS != cw_tq_timed_wait_internal(tq, CW_TQ_WAIT_NONEMPTY, &deadline);
+			__atomic_add_fetch(&gen->metrics.n_wakeups, 1, __ATOMIC_RELAXED);
+		}
+		cw_tq_wait_unlock_internal(tq, CW_TQ_WAIT_NONEMPTY);
+
+		if (timed_out && NULL != gen->pause_sound_device) {
+			gen->idle.paused = CW_SUCCESS == gen->pause_sound_device(gen);
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+				      MSG_PREFIX "generator is idle, sound device %s", gen->idle.paused ? "paused" : "not paused");
+		}
+	}
+
+	cw_tq_wait_lock_internal(tq, CW_TQ_WAIT_NONEMPTY);
+	while (CW_TQ_EMPTY == cw_tq_get_state_internal(tq) && gen->do_dequeue_and_generate) {
+		cw_tq_wait_internal(tq, CW_TQ_WAIT_NONEMPTY);
+		__atomic_add_fetch(&gen->metrics.n_wakeups, 1, __ATOMIC_RELAXED);
+	}
+	cw_tq_wait_unlock_internal(tq, CW_TQ_WAIT_NONEMPTY);
+
+	if (gen->idle.paused && gen->do_dequeue_and_generate) {
+		if (NULL != gen->resume_sound_device) {
+			gen->resume_sound_device(gen);
+		}
+		gen->idle.paused = false;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Configure adaptive size of writes to sound device
+
+   Adaptive size is enabled only if it has been requested in @p
+   gen_conf, sound system can change the size of writes, and samples
+   are written by generator's thread (without pipeline).
+
+   Sound device is set to full size of writes, also when it has been
+   taken from pool of devices.
+
+   @param[in] gen generator with opened sound device
+   @param[in] gen_conf configuration of generator
+*/
+static void cw_gen_adaptive_period_new_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	gen->adaptive_period.enabled = false;
+	gen->adaptive_period.is_small = false;
+	gen->adaptive_period.small_n_samples = gen->buffer_n_samples / CW_GEN_ADAPTIVE_PERIOD_DIVISOR;
+	if (gen->adaptive_period.small_n_samples < 1) {
+		gen->adaptive_period.small_n_samples = 1;
+	}
+	gen->adaptive_period.keying_time = 0;
+
+	if (!gen_conf->adaptive_period
+	    || NULL == gen->set_sound_device_write_size
+	    || gen->pipeline.n_buffers > 1) {
+		return;
+	}
+
+	gen->adaptive_period.enabled = CW_SUCCESS == gen->set_sound_device_write_size(gen, gen->buffer_n_samples);
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "adaptive size of writes: %s, %d/%d samples",
+		      gen->adaptive_period.enabled ? "enabled" : "disabled",
+		      gen->adaptive_period.small_n_samples, gen->buffer_n_samples);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Note that key has been used with generator
+
+   Called by threads enqueueing Marks and Spaces of straight key and
+   iambic keyer.
+
+   @param[in] gen generator
+*/
+static void cw_gen_adaptive_period_keying_internal(cw_gen_t * gen)
+{
+	if (gen->adaptive_period.enabled) {
+		__atomic_store_n(&gen->adaptive_period.keying_time, cw_gen_metrics_now_internal(), __ATOMIC_RELAXED);
+	}
+}
+
+
+
+
+/**
+   @brief Select size of next write to sound device
+
+   Called by generator's thread before first sample of new buffer is
+   calculated. Small writes are used while straight key is closed
+   (generator plays 'forever' Mark), or when key has been used
+   recently.
+
+   @param[in] gen generator with enabled adaptive size of writes
+   @param[in] tone tone which samples are about to be calculated
+*/
+static void cw_gen_adaptive_period_update_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	bool keying = tone->is_forever && tone->frequency > 0;
+	if (!keying) {
+		const uint64_t keying_time = __atomic_load_n(&gen->adaptive_period.keying_time, __ATOMIC_RELAXED);
+		keying = 0 != keying_time && cw_gen_metrics_now_internal() - keying_time < CW_GEN_ADAPTIVE_PERIOD_HOLD_NS;
+	}
+	if (keying == gen->adaptive_period.is_small) {
+		return;
+	}
+
+	const int n_samples = keying ? gen->adaptive_period.small_n_samples : gen->buffer_n_samples;
+	if (CW_SUCCESS == gen->set_sound_device_write_size(gen, n_samples)) {
+		gen->adaptive_period.is_small = keying;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Record time at which sound of generator ends
+
+   Called by generator's thread when tone queue has become empty.
+
+   @param[in] gen generator
+   @param[in] device_drained whether sound device has already played all written samples
+*/
+static void cw_gen_record_end_of_sound_internal(cw_gen_t * gen, bool device_drained)
+{
+	struct timeval now = { 0 };
+	if (CW_SUCCESS != cw_gen_get_timestamp(gen, &now)) {
+		return;
+	}
+	int64_t end = (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec;
+	if (!device_drained) {
+		end += gen->sound_device_latency;
+	}
+	__atomic_store_n(&gen->end_of_sound_time, end, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update correlation of generator's samples with clock of sound device
+
+   Called right after a buffer has been written to sound device, by the
+   thread that has written it.
+
+   @param[in] gen generator
+*/
+static void cw_gen_device_clock_update_internal(cw_gen_t * gen)
+{
+	gen->device_clock.n_written += (uint64_t) gen->out_n_samples;
+
+	struct timeval now = { 0 };
+	if (CW_SUCCESS != cw_gen_get_timestamp(gen, &now)) {
+		return;
+	}
+	const int64_t now_usecs = (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec;
+	int delay = 0;
+	if (NULL != gen->get_sound_device_delay && CW_SUCCESS == gen->get_sound_device_delay(gen, &delay)) {
+		if (gen->device_clock.drift_compensation) {
+			cw_gen_drift_measure_internal(gen, now_usecs, delay);
+		}
+	} else {
+		delay = gen->sound_device_latency;
+	}
+	__atomic_store_n(&gen->device_clock.queue_end, now_usecs + delay, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Measure drift of sample clock of sound device
+
+   Samples played by sound device since reference point are counted
+   from samples written to the device and from delay reported by the
+   device. Only delay reported by the device (not estimated latency)
+   can be used here.
+
+   @param[in] gen generator
+   @param[in] now current time [microseconds]
+   @param[in] delay duration of samples written to device and not played yet [microseconds]
+*/
+static void cw_gen_drift_measure_internal(cw_gen_t * gen, int64_t now, int delay)
+{
+	if (gen->sample_rate <= 0) {
+		return;
+	}
+	const int64_t n_queued = ((int64_t) delay * gen->sample_rate) / CW_USECS_PER_SEC;
+	const int64_t n_played = (int64_t) gen->device_clock.n_written - n_queued;
+	const uint64_t n_underruns = __atomic_load_n(&gen->metrics.n_underruns, __ATOMIC_RELAXED);
+
+	if (__atomic_exchange_n(&gen->device_clock.restart, false, __ATOMIC_RELAXED)
+	    || !gen->device_clock.has_reference
+	    || n_underruns != gen->device_clock.reference_underruns) {
+
+		gen->device_clock.has_reference = true;
+		gen->device_clock.reference_time = now;
+		gen->device_clock.reference_played = n_played;
+		gen->device_clock.reference_underruns = n_underruns;
+		return;
+	}
+
+	const int64_t elapsed = now - gen->device_clock.reference_time;
+	if (elapsed < CW_GEN_DRIFT_MIN_INTERVAL) {
+		return;
+	}
+	const double ratio = ((double) (n_played - gen->device_clock.reference_played) * CW_USECS_PER_SEC)
+		/ ((double) elapsed * gen->sample_rate);
+	const int64_t drift_ppb = (int64_t) llround((ratio - 1.0) * 1e9);
+	if (llabs(drift_ppb) <= CW_GEN_DRIFT_MAX_PPB) {
+		__atomic_store_n(&gen->device_clock.drift_ppb, drift_ppb, __ATOMIC_RELAXED);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Correct count of samples of tone for drift of sample clock
+
+   Every tone adds to ::device_clock.debt the difference between its
+   count of samples and the count that would make it last for its
+   duration on device with measured real rate (including fraction of
+   sample lost in rounding). The debt is paid by changing count of
+   samples of silent tones, so that samples of Marks can still be
+   taken from the cache of rendered tones.
+
+   @param[in] gen generator
+   @param[in/out] tone tone with count of samples calculated from its duration
+*/
+static void cw_gen_drift_correct_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	if (!gen->device_clock.drift_compensation || tone->is_forever) {
+		return;
+	}
+	if (tone->is_scheduled) {
+		/* Duration of the tone has been calculated from
+		   device's clock, so the tone starts over with no debt. */
+		gen->device_clock.debt = 0.0;
+	}
+
+	const int64_t drift_ppb = __atomic_load_n(&gen->device_clock.drift_ppb, __ATOMIC_RELAXED);
+	const double n_exact = ((double) tone->duration * gen->sample_rate / CW_USECS_PER_SEC) * (1.0 + (double) drift_ppb / 1e9);
+	gen->device_clock.debt += n_exact - (double) tone->n_samples;
+
+	if (tone->frequency > 0) {
+		return;
+	}
+	int64_t correction = (int64_t) gen->device_clock.debt;
+	const int64_t n_slopes = tone->rising_slope_n_samples + tone->falling_slope_n_samples;
+	if (tone->n_samples + correction < n_slopes) {
+		correction = n_slopes - tone->n_samples;
+		if (correction > 0) {
+			correction = 0;
+		}
+	}
+	tone->n_samples += correction;
+	gen->device_clock.debt -= (double) correction;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate when a tone that is being dequeued will be played
+
+   First sample of the tone will be calculated at ::buffer_sub_start
+   of ::buffer, so it will be played after samples already waiting in
+   sound device, in full buffers of pipeline, and in ::buffer.
+
+   Sound systems that pull samples from generator play the tone after
+   latency of the device. For Null and Console sound systems the tone
+   is played right away.
+
+   @param[in] gen generator
+   @param[out] playback_time time at which tone will be played
+*/
+static void cw_gen_get_playback_time_internal(cw_gen_t * gen, struct timeval * playback_time)
+{
+	if (CW_SUCCESS != cw_gen_get_timestamp(gen, playback_time)) {
+		return;
+	}
+	const int64_t now = (int64_t) playback_time->tv_sec * CW_USECS_PER_SEC + playback_time->tv_usec;
+	int64_t start = now;
+
+	if (NULL != gen->start_sound_device) {
+		start += gen->sound_device_latency;
+
+	} else if (NULL != gen->buffer && gen->sample_rate > 0) {
+		int64_t n_waiting = gen->buffer_sub_start;
+		int64_t queue_end = 0;
+		if (gen->pipeline.running) {
+			pthread_mutex_lock(&gen->pipeline.mutex);
+			queue_end = __atomic_load_n(&gen->device_clock.queue_end, __ATOMIC_RELAXED);
+			n_waiting += (int64_t) (gen->pipeline.n_buffers - 1 - gen->pipeline.n_free) * gen->buffer_n_samples;
+			pthread_mutex_unlock(&gen->pipeline.mutex);
+		} else {
+			queue_end = __atomic_load_n(&gen->device_clock.queue_end, __ATOMIC_RELAXED);
+		}
+		/* Sound device that has played all its samples starts
+		   playing new samples when they are written. */
+		if (queue_end > start) {
+			start = queue_end;
+		}
+		start += (n_waiting * CW_USECS_PER_SEC) / gen->sample_rate;
+	}
+
+	playback_time->tv_sec = (time_t) (start / CW_USECS_PER_SEC);
+	playback_time->tv_usec = (suseconds_t) (start % CW_USECS_PER_SEC);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate duration of silence preceding scheduled start of tones
+
+   The silence lasts from time at which it will be played (see
+   cw_gen_get_playback_time_internal()) until the time requested with
+   cw_gen_enqueue_at(). The duration is zero if that time has already
+   passed.
+
+   @param[in] gen generator
+   @param[in/out] tone silent tone that has been dequeued just now
+*/
+static void cw_gen_scheduled_tone_calculate_duration_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	const int64_t start = __atomic_exchange_n(&gen->scheduled_start, 0, __ATOMIC_SEQ_CST);
+
+	struct timeval playback_time = { 0 };
+	cw_gen_get_playback_time_internal(gen, &playback_time);
+	int64_t duration = start - ((int64_t) playback_time.tv_sec * CW_USECS_PER_SEC + playback_time.tv_usec);
+	if (duration < 0) {
+		duration = 0;
+	} else if (duration > INT_MAX) {
+		duration = INT_MAX;
+	}
+	tone->duration = (int) duration;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Count underrun of sound device of generator
+
+   To be called by sound systems after they have recovered from
+   underrun (xrun) of sound device.
+
+   @param[in] gen generator
+*/
+void cw_gen_metrics_underrun_internal(cw_gen_t * gen)
+{
+	__atomic_add_fetch(&gen->metrics.n_underruns, 1, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Write tone to soundcard
+
+   @internal
+   @reviewed 2020-10-13
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone dequeued from queue (if dequeueing was successful); must always be non-NULL
+
+   @return 0
+*/
+CW_PROF_HOT int cw_gen_write_to_soundcard_internal(cw_gen_t * gen, cw_tone_t * tone)
+{
+	cw_assert (NULL != tone, MSG_PREFIX "'tone' argument should always be non-NULL");
+	CW_PROF_MARK(gen_write_begin);
+
+	/* Total number of samples to write in a loop below. */
+	int64_t samples_to_write = tone->n_samples;
+
+	cw_gen_apply_pending_modulation_internal(gen, tone);
+
+	/* Samples of the tone may be available in cache of
+	   pre-rendered tones. If they are, phase of sine wave is already
+	   set as if the samples were calculated now. */
+	const cw_sample_t * cached = cw_gen_tone_cache_get_internal(gen, tone);
+
+	/* Plateau of a very long tone (e.g. QRSS) is generated by
+	   replaying a short periodic fragment of sine wave. */
+	bool plateau_loop_usable = NULL == cached && cw_gen_plateau_loop_is_usable_internal(gen, tone);
+	gen->plateau_loop.active = false;
+
+	if (gen->sidetone.enabled && tone->frequency > 0) {
+		/* Key is already down, there is no silence to cut. */
+		__atomic_store_n(&gen->sidetone.cut_requested, false, __ATOMIC_SEQ_CST);
+	}
+
+#define LIBCW_WRITE_LOOP_DEBUG_LEVEL 0
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+	/* Debug code. */
+	int n_loops = 0;
+	const float n_loops_expected = floorf(1.0 * samples_to_write / gen->buffer_n_samples); /* In reality number of loops executed is sometimes n_loops_expected, but mostly it's n_loops_expected+1. */
+	fprintf(stderr, MSG_PREFIX "entering loop (~%.1f iterations expected), tone->frequency = %d, buffer->n_samples = %d, samples_to_write = %"PRId64"\n",
+		(double) n_loops_expected, tone->frequency, gen->buffer_n_samples, samples_to_write);
+#endif
+
+	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "%lld samples, %d us, %d Hz", tone->n_samples, tone->duration, gen->frequency);
+	while (samples_to_write > 0) {
+
+		if (gen->sidetone.enabled
+		    && tone->is_forever && tone->frequency <= 0
+		    && __atomic_exchange_n(&gen->sidetone.cut_requested, false, __ATOMIC_SEQ_CST)) {
+			/* Key has gone down while we were playing silence
+			   after previous Mark. Don't finish this tone, next
+			   tone in queue is the new Mark. */
+			cw_gen_sidetone_cut_internal(gen);
+			break;
+		}
+
+		if (0 == gen->buffer_sub_start && gen->adaptive_period.enabled) {
+			cw_gen_adaptive_period_update_internal(gen, tone);
+		}
+
+		if (0 == gen->buffer_sub_start && NULL != gen->acquire_buffer_from_sound_device) {
+			/* Samples of new buffer may be calculated directly
+			   in memory of sound device. Getting the memory may
+			   block until there is free space in the device, so
+			   it counts as a part of write. */
+			const uint64_t acquire_begin = cw_gen_metrics_now_internal();
+			gen->acquire_buffer_from_sound_device(gen);
+			gen->metrics.buffer_write_ns += cw_gen_metrics_now_internal() - acquire_begin;
+		}
+
+		/* Count of samples in buffer that is written to sound
+		   device when full. */
+		const int write_n_samples = gen->adaptive_period.is_small ? gen->adaptive_period.small_n_samples : gen->buffer_n_samples;
+
+		const int64_t free_space = write_n_samples - gen->buffer_sub_start;
+		if (samples_to_write > free_space) {
+			/* There will be some tone samples left for
+			   next iteration of this loop.  But buffer in
+			   this iteration will be ready to be pushed
+			   to sound sink. */
+			gen->buffer_sub_stop = write_n_samples - 1;
+		} else if (samples_to_write == free_space) {
+			/* How nice, end of tone samples aligns with
+			   end of buffer (last sample of tone will be
+			   placed in last cell of buffer).
+
+			   But the result is the same - a full buffer
+			   ready to be pushed to sound sink. */
+			gen->buffer_sub_stop = write_n_samples - 1;
+		} else {
+			/* There will be too few samples to fill a
+			   buffer. We can't send an under-filled buffer to
+			   sound sink. We will have to get more
+			   samples to fill the buffer completely. */
+			gen->buffer_sub_stop = gen->buffer_sub_start + samples_to_write - 1;
+		}
+
+		/* How many samples of sound buffer's subarea will be
+		   calculated in a given cycle of "calculate sine
+		   wave" code, i.e. in current iteration of the 'while' loop? */
+		const int buffer_sub_n_samples = gen->buffer_sub_stop - gen->buffer_sub_start + 1;
+
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+		/* Debug code. */
+		++n_loops;
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 1
+		/* Debug code. */
+		fprintf(stderr, MSG_PREFIX "       loop #%d, buffer_sub_n_samples = %d\n", n_loops, buffer_sub_n_samples);
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+			      MSG_PREFIX
+			      "sub start: %d, sub stop: %d, sub size: %d / %"PRIu64,
+			      gen->buffer_sub_start, gen->buffer_sub_stop, buffer_sub_n_samples, samples_to_write);
+#endif
+#endif
+
+
+		if (NULL == cached && !gen->plateau_loop.active
+		    && cw_gen_apply_pending_modulation_internal(gen, tone)) {
+			/* Gain has started to change in the middle of the tone. */
+			plateau_loop_usable = plateau_loop_usable && cw_gen_plateau_loop_is_usable_internal(gen, tone);
+		}
+
+		const uint64_t synthesis_begin = cw_gen_metrics_now_internal();
+		if (NULL != cached) {
+			memcpy(gen->buffer + gen->buffer_sub_start, cached + tone->sample_iterator, sizeof (cw_sample_t) * (size_t) buffer_sub_n_samples);
+			tone->sample_iterator += buffer_sub_n_samples;
+
+		} else if (plateau_loop_usable
+			   && cw_gen_plateau_loop_covers_subarea_internal(tone, buffer_sub_n_samples)) {
+
+			/* Plateau of a long tone. Samples are copied from
+			   periodic buffer. */
+			if (!gen->plateau_loop.active) {
+				if (CW_SUCCESS != cw_gen_plateau_loop_prepare_internal(gen, tone)) {
+					plateau_loop_usable = false;
+					continue; /* Try again, without the loop. */
+				}
+			}
+			cw_gen_plateau_loop_copy_internal(gen, tone, buffer_sub_n_samples);
+
+		} else {
+			if (gen->plateau_loop.active) {
+				/* End of plateau. Falling slope will be
+				   calculated as usual, but first the phase
+				   of the sine wave has to be synchronized
+				   with samples taken from the loop. */
+				cw_gen_plateau_loop_finish_internal(gen, tone);
+				plateau_loop_usable = false;
+			}
+			const int calculated = cw_gen_calculate_sine_wave_internal(gen, tone);
+			cw_assert (calculated == buffer_sub_n_samples, MSG_PREFIX "calculated wrong number of samples: %d != %d", calculated, buffer_sub_n_samples);
+		}
+		gen->metrics.buffer_synthesis_ns += cw_gen_metrics_now_internal() - synthesis_begin;
+
+		if (gen->sidetone.enabled) {
+			gen->sidetone.silent_run = tone->frequency <= 0 ? gen->sidetone.silent_run + buffer_sub_n_samples : 0;
+		}
+
+		if (gen->buffer_sub_stop == write_n_samples - 1) {
+
+			/* We have a buffer full of samples. The
+			   buffer is ready to be pushed to sound
+			   sink. */
+#ifdef ENABLE_DEV_PCM_SAMPLES_FILE
+			cw_dev_debug_raw_sink_write_internal(gen);
+#endif
+			if (gen->pipeline.running) {
+				/* Buffer is written by pipeline's thread,
+				   and ::buffer is switched to next free
+				   buffer. */
+				cw_gen_pipeline_submit_internal(gen, write_n_samples);
+			} else {
+				gen->sidetone.writing_silence = gen->sidetone.enabled && gen->sidetone.silent_run >= write_n_samples;
+				gen->out_buffer = gen->buffer;
+				gen->out_n_samples = write_n_samples;
+				const uint64_t dsp_begin = cw_gen_metrics_now_internal();
+				cw_gen_dsp_process_internal(gen, gen->out_buffer, gen->out_n_samples);
+				gen->metrics.buffer_synthesis_ns += cw_gen_metrics_now_internal() - dsp_begin;
+				CW_TRACE(CW_TRACE_GEN_WRITE_BEGIN, write_n_samples);
+				const uint64_t write_begin = cw_gen_metrics_now_internal();
+				const cw_ret_t write_cwret = gen->write_buffer_to_sound_device(gen);
+				gen->metrics.buffer_write_ns += cw_gen_metrics_now_internal() - write_begin;
+				CW_TRACE(CW_TRACE_GEN_WRITE_END, write_cwret);
+				cw_gen_device_clock_update_internal(gen);
+				cw_gen_metrics_buffer_written_internal(gen, write_cwret, write_n_samples);
+				/* Tap and sinks get the buffer only after
+				   sound device, they can't delay it. */
+				cw_gen_tap_write_internal(gen, gen->out_buffer, write_n_samples);
+				cw_gen_sinks_publish_internal(gen, gen->out_buffer, write_n_samples);
+				if (CW_SUCCESS != write_cwret && gen->sidetone.writing_silence) {
+					/* Possibly abandoned. Don't count samples
+					   of the buffer as silence waiting in
+					   sound device. */
+					gen->sidetone.silent_run -= write_n_samples;
+				}
+				gen->sidetone.writing_silence = false;
+			}
+			gen->buffer_sub_start = 0;
+			gen->buffer_sub_stop = 0;
+		} else {
+			/* #needmoresamples
+			   There is still some space left in the
+			   buffer, go fetch new tone from tone
+			   queue. */
+
+			gen->buffer_sub_start = gen->buffer_sub_stop + 1;
+
+			cw_assert (gen->buffer_sub_start <= write_n_samples - 1,
+				   MSG_PREFIX "sub start out of range: sub start = %d, buffer n samples = %d",
+				   gen->buffer_sub_start, gen->buffer_n_samples);
+		}
+
+		samples_to_write -= buffer_sub_n_samples;
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+		/* Debug code. */
+		if (samples_to_write < 0) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG, MSG_PREFIX "samples left = %"PRId64, samples_to_write);
+		}
+#endif
+
+	} /* while (samples_to_write > 0) { */
+
+	if (gen->plateau_loop.active) {
+		/* Tone without falling slope ended in plateau. */
+		cw_gen_plateau_loop_finish_internal(gen, tone);
+	}
+
+#if LIBCW_WRITE_LOOP_DEBUG_LEVEL > 0
+	/* Debug code. */
+	fprintf(stderr, MSG_PREFIX "left loop, %d iterations executed from %.1f iterations planned, samples left = %d\n",
+		n_loops, (double) n_loops_expected, (int) samples_to_write);
+#endif
+
+	CW_PROF_MARK(gen_write_end);
+	return 0;
+}
+
+
+
+
+cw_ret_t cw_gen_render(cw_gen_t * gen, cw_sample_t * samples, size_t n_samples)
+{
+	if (NULL == gen || (NULL == samples && n_samples > 0)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "render: NULL argument");
+		return CW_FAILURE;
+	}
+	if (gen->do_dequeue_and_generate || gen->thread.running) {
+		/* Tones are dequeued by generator's own thread. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "render: generator is started");
+		return CW_FAILURE;
+	}
+
+	while (n_samples > 0) {
+		const int n = n_samples > INT_MAX ? INT_MAX : (int) n_samples;
+		cw_gen_render_internal(gen, samples, n);
+		samples += n;
+		n_samples -= (size_t) n;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Render samples from generator's tone queue into given array
+
+   This is a "pull" counterpart of generator's thread function
+   (cw_gen_dequeue_and_generate_internal()) and of
+   cw_gen_write_to_soundcard_internal(): tones are dequeued from
+   generator's tone queue and their samples are calculated into @p
+   samples, but nothing is written to generator's sound sink and the
+   function never waits. If the tone queue is empty, the remainder of
+   @p samples is filled with silence.
+
+   A tone that doesn't fit into @p samples is continued in next call of
+   the function. Listeners waiting on generator's tone queue and
+   iambic keyer are notified at the end of each tone, just as they are
+   notified by generator's thread.
+
+   The function must not be called for a generator that has been
+   started with cw_gen_start().
+
+   @param[in] gen generator from which to render samples
+   @param[out] samples array for samples
+   @param[in] n_samples count of samples to render
+
+   @return count of samples calculated from tones (as opposed to padding silence)
+*/
+int cw_gen_render_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples)
+{
+	int i = 0;
+	while (i < n_samples) {
+		if (!gen->render.has_tone && !cw_gen_render_start_tone_internal(gen)) {
+			break;
+		}
+
+		cw_tone_t * tone = &gen->render.tone;
+		int n = n_samples - i;
+		if (n > tone->n_samples - tone->sample_iterator) {
+			n = (int) (tone->n_samples - tone->sample_iterator);
+		}
+		if (n > 0) {
+			if (NULL != gen->render.cached) {
+				memcpy(samples + i, gen->render.cached + tone->sample_iterator, sizeof (cw_sample_t) * (size_t) n);
+				tone->sample_iterator += n;
+			} else {
+				cw_gen_apply_pending_modulation_internal(gen, tone);
+				cw_gen_render_samples_internal(gen, tone, samples + i, n);
+			}
+			i += n;
+		}
+
+		if (tone->sample_iterator < tone->n_samples) {
+			continue;
+		}
+		cw_gen_render_end_tone_internal(gen);
+	}
+
+	if (i < n_samples) {
+		memset(samples + i, 0, sizeof (cw_sample_t) * (size_t) (n_samples - i));
+	}
+
+	return i;
+}
+
+
+
+
+/**
+   @brief Go through tones from generator's tone queue without producing samples
+
+   Generator's state (phase of sine wave, gain and chirp modulation)
+   changes exactly as if the tones were rendered with
+   cw_gen_render_internal() into array of @p n_samples samples, but
+   samples of Spaces and of cached tones are not produced at all. Only
+   tones that can't be taken from cache of tones are calculated, into
+   temporary memory. This is used to find state of generator and
+   count of samples at a given tone quickly.
+
+   @param[in] gen generator from which to take tones
+   @param[in] n_samples count of samples to go through
+
+   @return count of samples of tones (as opposed to padding silence) that cw_gen_render_internal() would calculate
+   @return -1 if temporary memory can't be allocated
+*/
+int cw_gen_render_skip_internal(cw_gen_t * gen, int n_samples)
+{
+	cw_sample_t * scratch = NULL;
+	int scratch_capacity = 0;
+
+	int i = 0;
+	while (i < n_samples) {
+		if (!gen->render.has_tone && !cw_gen_render_start_tone_internal(gen)) {
+			break;
+		}
+
+		cw_tone_t * tone = &gen->render.tone;
+		int n = n_samples - i;
+		if (n > tone->n_samples - tone->sample_iterator) {
+			n = (int) (tone->n_samples - tone->sample_iterator);
+		}
+		if (n > 0) {
+			if (NULL != gen->render.cached) {
+				/* Phase at the end of the tone has been set by
+				   cache of tones. */
+				tone->sample_iterator += n;
+			} else if (tone->frequency <= 0) {
+				/* See cw_gen_calculate_silence_internal(). */
+				cw_gen_apply_pending_modulation_internal(gen, tone);
+				tone->sample_iterator += n;
+				cw_gen_advance_gain_internal(gen, n);
+			} else {
+				if (scratch_capacity < n) {
+					cw_sample_t * new_scratch = (cw_sample_t *) realloc(scratch, sizeof (cw_sample_t) * (size_t) n);
+					if (NULL == new_scratch) {
+						cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+							      MSG_PREFIX "failed to realloc() temporary samples");
+						free(scratch);
+						return -1;
+					}
+					scratch = new_scratch;
+					scratch_capacity = n;
+				}
+				cw_gen_apply_pending_modulation_internal(gen, tone);
+				cw_gen_render_samples_internal(gen, tone, scratch, n);
+			}
+			i += n;
+		}
+
+		if (tone->sample_iterator < tone->n_samples) {
+			continue;
+		}
+		cw_gen_render_end_tone_internal(gen);
+	}
+
+	free(scratch);
+
+	return i;
+}
+
+
+
+
+/**
+   @brief Go through one tone from generator's tone queue without producing samples
+
+   The tone is dequeued (or continued, if its rendering has already
+   been started with cw_gen_render_internal()), value of generator is
+   tracked, and count of samples of the tone is calculated as in
+   cw_gen_render_internal(), but no samples are calculated at all, and
+   phase of sine wave and modulation are not advanced. This is used
+   where only timing of tones is needed (see cw_gen_loopback_string()).
+
+   @param[in] gen generator from which to take tones
+   @param[out] n_samples count of remaining samples of the tone
+   @param[out] is_forever whether the tone is "forever" tone
+
+   @return true if a tone has been skipped
+   @return false if tone queue is empty
+*/
+bool cw_gen_render_skip_tone_internal(cw_gen_t * gen, int64_t * n_samples, bool * is_forever)
+{
+	if (!gen->render.has_tone && !cw_gen_render_start_tone_internal(gen)) {
+		return false;
+	}
+
+	cw_tone_t * tone = &gen->render.tone;
+	*n_samples = (int64_t) (tone->n_samples - tone->sample_iterator);
+	*is_forever = tone->is_forever;
+	tone->sample_iterator = tone->n_samples;
+	cw_gen_render_end_tone_internal(gen);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Take next tone from generator's tone queue for rendering
+
+   @param[in] gen generator
+
+   @return true if there is a new tone to render
+   @return false if tone queue is empty
+*/
+static bool cw_gen_render_start_tone_internal(cw_gen_t * gen)
+{
+	cw_tone_t * tone = &gen->render.tone;
+	const cw_queue_state_t queue_state = cw_tq_dequeue_internal(gen->tq, tone);
+	cw_gen_value_tracking_internal(gen, tone, queue_state);
+	if (CW_TQ_EMPTY == queue_state) {
+		cw_gen_memories_release_retired_internal(gen);
+		return false;
+	}
+	if (tone->is_scheduled) {
+		cw_gen_scheduled_tone_calculate_duration_internal(gen, tone);
+	}
+	cw_gen_apply_pending_parameters_internal(gen, false);
+	cw_gen_tone_calculate_samples_size_internal(gen, tone);
+	cw_gen_drift_correct_internal(gen, tone);
+	cw_gen_apply_pending_modulation_internal(gen, tone);
+	gen->render.cached = cw_gen_tone_cache_get_internal(gen, tone);
+	gen->render.has_tone = true;
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Finish rendering of a tone
+
+   Listeners waiting on generator's tone queue and iambic keyer are
+   notified at the end of each tone, just as they are notified by
+   generator's thread.
+
+   @param[in] gen generator
+*/
+static void cw_gen_render_end_tone_internal(cw_gen_t * gen)
+{
+	cw_tone_t * tone = &gen->render.tone;
+
+	gen->render.has_tone = false;
+	if (tone->is_mark) {
+		cw_gen_tokens_mark_played_internal(gen);
+	}
+	if (!(gen->render.prev_tone.is_forever && tone->is_forever)) {
+		/* See cw_gen_dequeue_and_generate_internal() for
+		   explanation why and when this is done. */
+		__atomic_add_fetch(&gen->metrics.n_tone_ends, 1, __ATOMIC_RELAXED);
+		cw_tq_broadcast_internal(gen->tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_TONE_END));
+	}
+	cw_key_ik_update_graph_state_internal(gen->key);
+	CW_TONE_COPY(&gen->render.prev_tone, tone);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get sample rate requested in generator's configuration
+
+   Used by sound systems that try the requested rate before standard
+   rates from cw_supported_sample_rates[].
+
+   @param[in] gen_conf generator's configuration
+
+   @return requested sample rate
+   @return zero if no rate has been requested or if requested rate is out of range
+*/
+unsigned int cw_gen_get_requested_sample_rate_internal(const cw_gen_config_t * gen_conf)
+{
+	const unsigned int rate = gen_conf->sample_rate;
+	if (0 == rate) {
+		return 0;
+	}
+	/* Lowest of standard rates is the lower limit. */
+	if (rate < 8000 || rate > CW_GEN_SAMPLE_RATE_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "requested sample rate %u is out of range, using standard rates", rate);
+		return 0;
+	}
+	return rate;
+}
+
+
+
+
+/**
+   @brief Get format of samples requested in generator's configuration
+
+   Invalid values from @p gen_conf are replaced with default values
+   (S16, one channel). Used by sound systems that negotiate format of
+   samples with their device.
+
+   @param[in] gen_conf generator's configuration
+   @param[out] sample_format requested format of samples
+   @param[out] n_channels requested count of channels
+*/
+void cw_gen_get_requested_sample_format_internal(const cw_gen_config_t * gen_conf, cw_sample_format_t * sample_format, int * n_channels)
+{
+	switch (gen_conf->sample_format) {
+	case CW_SAMPLE_FORMAT_S16:
+	case CW_SAMPLE_FORMAT_S32:
+	case CW_SAMPLE_FORMAT_FLOAT32:
+		*sample_format = gen_conf->sample_format;
+		break;
+	default:
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "unsupported sample format %d, falling back to default", gen_conf->sample_format);
+		*sample_format = CW_SAMPLE_FORMAT_S16;
+		break;
+	}
+
+	if (0 == gen_conf->n_channels || 1 == gen_conf->n_channels || 2 == gen_conf->n_channels) {
+		*n_channels = 0 == gen_conf->n_channels ? 1 : gen_conf->n_channels;
+	} else {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "unsupported count of channels %d, falling back to mono", gen_conf->n_channels);
+		*n_channels = 1;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get size of one frame of samples sent to sound device
+
+   @param[in] gen generator
+
+   @return size of samples of all channels for one sampling instant, in bytes
+*/
+size_t cw_gen_frame_size_internal(const cw_gen_t * gen)
+{
+	const size_t sample_size = CW_SAMPLE_FORMAT_S16 == gen->sample_format ? sizeof (int16_t) : sizeof (int32_t);
+	return sample_size * (size_t) gen->n_channels;
+}
+
+
+
+
+/**
+   @brief Convert generator's samples to format of sound device
+
+   Values of S16 samples are scaled to full range of output format,
+   and every sample is copied to all channels of output frame.
+
+   @param[in] gen generator (source of output format)
+   @param[in] samples mono S16 samples
+   @param[in] n_samples count of @p samples
+   @param[out] output array of at least @p n_samples frames of output format
+*/
+CW_GEN_MULTIVERSIONED void cw_gen_convert_samples_internal(const cw_gen_t * gen, const cw_sample_t * restrict samples, int n_samples, void * restrict output)
+{
+	const int n_channels = gen->n_channels;
+
+	/* Indexed stores instead of incremented pointer, so that loops
+	   over mono samples can be vectorized. */
+	switch (gen->sample_format) {
+	case CW_SAMPLE_FORMAT_S32: {
+		int32_t * restrict out = (int32_t *) output;
+		for (int i = 0; i < n_samples; i++) {
+			/* Multiplication instead of shift of negative value. */
+			const int32_t value = (int32_t) samples[i] * 65536;
+			for (int c = 0; c < n_channels; c++) {
+				out[i * n_channels + c] = value;
+			}
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_FLOAT32: {
+		float * restrict out = (float *) output;
+		for (int i = 0; i < n_samples; i++) {
+			const float value = (float) samples[i] / 32768.0F;
+			for (int c = 0; c < n_channels; c++) {
+				out[i * n_channels + c] = value;
+			}
+		}
+		break;
+	}
+	case CW_SAMPLE_FORMAT_S16:
+	default: {
+		int16_t * restrict out = (int16_t *) output;
+		for (int i = 0; i < n_samples; i++) {
+			for (int c = 0; c < n_channels; c++) {
+				out[i * n_channels + c] = samples[i];
+			}
+		}
+		break;
+	}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get samples from generator's out buffer in format of sound device
+
+   For S16 mono sound device this is generator's out buffer itself,
+   otherwise the samples are converted to generator's device buffer.
+
+   @param[in] gen generator
+   @param[out] n_bytes size of returned samples, in bytes (may be NULL)
+
+   @return pointer to out_n_samples frames of samples
+*/
+const void * cw_gen_get_device_samples_internal(cw_gen_t * gen, size_t * n_bytes)
+{
+	if (n_bytes) {
+		*n_bytes = (size_t) gen->out_n_samples * cw_gen_frame_size_internal(gen);
+	}
+	if (NULL == gen->device_buffer) {
+		return gen->out_buffer;
+	}
+	if (gen->device_buffer_filled) {
+		return gen->device_buffer;
+	}
+	cw_gen_convert_samples_internal(gen, gen->out_buffer, gen->out_n_samples, gen->device_buffer);
+	return gen->device_buffer;
+}
+
+
+
+
+/**
+   @brief Calculate samples of a tone into given array
+
+   Oscillator engines write to generator's buffer, so for a moment @p
+   samples become the buffer.  Phase of sine wave in generator is updated
+   as if the samples were calculated into generator's buffer.
+
+   @param[in] gen generator
+   @param[in,out] tone tone to be calculated
+   @param[out] samples array for samples
+   @param[in] n_samples count of samples to calculate
+*/
+static void cw_gen_render_samples_internal(cw_gen_t * gen, cw_tone_t * tone, cw_sample_t * samples, int n_samples)
+{
+	cw_sample_t * buffer = gen->buffer;
+	const int buffer_n_samples = gen->buffer_n_samples;
+	const int buffer_sub_start = gen->buffer_sub_start;
+	const int buffer_sub_stop = gen->buffer_sub_stop;
+
+	gen->buffer = samples;
+	gen->buffer_n_samples = n_samples;
+
+	/* Phase of sine wave is calculated from sample's index within
+	   fragment, and it loses precision for long fragments. */
+	for (int i = 0; i < n_samples; i += CW_GEN_RENDER_FRAGMENT_N_SAMPLES) {
+		gen->buffer_sub_start = i;
+		gen->buffer_sub_stop = (i + CW_GEN_RENDER_FRAGMENT_N_SAMPLES < n_samples ? i + CW_GEN_RENDER_FRAGMENT_N_SAMPLES : n_samples) - 1;
+		cw_gen_calculate_sine_wave_internal(gen, tone);
+	}
+
+	gen->buffer = buffer;
+	gen->buffer_n_samples = buffer_n_samples;
+	gen->buffer_sub_start = buffer_sub_start;
+	gen->buffer_sub_stop = buffer_sub_stop;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get increment of fixed-point phase accumulator per sample
+
+   @param[in] gen generator
+   @param[in] frequency frequency of tone
+
+   @return increment of gen->phase_acc for one sample
+*/
+static uint32_t cw_gen_phase_acc_step_internal(const cw_gen_t * gen, int frequency)
+{
+	return (uint32_t) (((uint64_t) frequency << 32) / gen->sample_rate);
+}
+
+
+
+
+/**
+   @brief Check if plateau of a tone can be generated from periodic fragment
+
+   Frequency and sample rate are integers, so a fragment of sine wave
+   that is sample_rate / gcd(sample_rate, frequency) samples long
+   contains an integer number of periods, and can be repeated without
+   discontinuities. The fragment is never longer than one second.
+
+   The loop is used only for tones with plateau longer than
+   CW_GEN_PLATEAU_LOOP_MIN_DURATION. For shorter tones the cost of
+   calculating the fragment would not be paid back.
+
+   @param[in] gen generator
+   @param[in] tone tone to be generated
+
+   @return true if the loop can be used for the tone
+   @return false otherwise
+*/
+static bool cw_gen_plateau_loop_is_usable_internal(const cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (tone->frequency <= 0 || tone->is_forever || 0 == gen->sample_rate
+	    || cw_gen_modulation_is_active_internal(gen)) {
+		return false;
+	}
+
+	const cw_sample_iter_t plateau_n_samples = tone->n_samples - tone->rising_slope_n_samples - tone->falling_slope_n_samples;
+	const cw_sample_iter_t min_n_samples = ((cw_sample_iter_t) gen->sample_rate * CW_GEN_PLATEAU_LOOP_MIN_DURATION) / CW_USECS_PER_SEC;
+
+	return plateau_n_samples >= min_n_samples;
+}
+
+
+
+
+/**
+   @brief Check if all samples of next subarea belong to tone's plateau
+
+   @param[in] tone tone being generated
+   @param[in] n_samples count of samples in the subarea
+
+   @return true if all the samples are in plateau
+   @return false otherwise
+*/
+static bool cw_gen_plateau_loop_covers_subarea_internal(const cw_tone_t * tone, int n_samples)
+{
+	return tone->sample_iterator >= tone->rising_slope_n_samples
+		&& tone->sample_iterator + n_samples <= tone->n_samples - tone->falling_slope_n_samples;
+}
+
+
+
+
+/**
+   @brief Calculate periodic fragment of sine wave for plateau of a tone
+
+   The fragment starts with current phase of sine wave, so the first
+   sample of plateau continues the rising slope.
+
+   @param[in,out] gen generator
+   @param[in] tone tone being generated
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure to allocate memory
+*/
+static cw_ret_t cw_gen_plateau_loop_prepare_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	/* Greatest common divisor. */
+	unsigned int a = gen->sample_rate;
+	unsigned int b = (unsigned int) tone->frequency;
+	while (0 != b) {
+		const unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+	const int n_samples = (int) (gen->sample_rate / a);
+
+	if (gen->plateau_loop.samples_capacity < n_samples) {
+		cw_sample_t * samples = realloc(gen->plateau_loop.samples, sizeof (cw_sample_t) * (size_t) n_samples);
+		if (NULL == samples) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to realloc() samples of plateau loop");
+			return CW_FAILURE;
+		}
+		gen->plateau_loop.samples = samples;
+		gen->plateau_loop.samples_capacity = n_samples;
+	}
+
+	gen->plateau_loop.n_samples = n_samples;
+	gen->plateau_loop.start_iterator = tone->sample_iterator;
+	gen->plateau_loop.phase_offset = gen->phase_offset;
+	gen->plateau_loop.phase_acc = gen->phase_acc;
+
+	/* Constant amplitude: a tone without slopes. */
+	cw_tone_t plateau;
+	CW_TONE_INIT(&plateau, tone->frequency, 0, CW_SLOPE_MODE_NO_SLOPES);
+	plateau.n_samples = n_samples;
+	cw_gen_render_samples_internal(gen, &plateau, gen->plateau_loop.samples, n_samples);
+
+	gen->plateau_loop.active = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Copy next samples of plateau from periodic fragment into buffer
+
+   @param[in,out] gen generator
+   @param[in,out] tone tone being generated
+   @param[in] n_samples count of samples to copy into buffer's subarea
+*/
+static void cw_gen_plateau_loop_copy_internal(cw_gen_t * gen, cw_tone_t * tone, int n_samples)
+{
+	const int loop_n_samples = gen->plateau_loop.n_samples;
+	int pos = (int) ((tone->sample_iterator - gen->plateau_loop.start_iterator) % loop_n_samples);
+
+	cw_sample_t * dest = gen->buffer + gen->buffer_sub_start;
+	int left = n_samples;
+	while (left > 0) {
+		int n = loop_n_samples - pos;
+		if (n > left) {
+			n = left;
+		}
+		memcpy(dest, gen->plateau_loop.samples + pos, sizeof (cw_sample_t) * (size_t) n);
+		dest += n;
+		left -= n;
+		pos = 0;
+	}
+
+	tone->sample_iterator += n_samples;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set phase of sine wave at the end of plateau generated from loop
+
+   The phase is set to a value that it would have if all samples of the
+   plateau were calculated.
+
+   @param[in,out] gen generator
+   @param[in] tone tone being generated
+*/
+static void cw_gen_plateau_loop_finish_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	const cw_sample_iter_t elapsed = tone->sample_iterator - gen->plateau_loop.start_iterator;
+
+	/* The loop contains integer number of periods. */
+	gen->phase_offset = gen->plateau_loop.phase_offset;
+	cw_gen_update_phase_offset_internal(gen, tone, (int) (elapsed % gen->plateau_loop.n_samples));
+
+	gen->phase_acc = gen->plateau_loop.phase_acc + (uint32_t) elapsed * cw_gen_phase_acc_step_internal(gen, tone->frequency);
+
+	gen->plateau_loop.active = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get pre-rendered samples of a tone from generator's cache
+
+   If samples of a tone with the same parameters as @p tone are in
+   generator's cache, the function returns them. Otherwise, if the tone
+   can be cached, samples of the tone are calculated, put into the cache
+   and returned.
+
+   Only tones that start with rising slope are cached. The first sample
+   of such tone has zero amplitude, so phase of sine wave at the
+   beginning of the tone can be rounded to one of few values without
+   audible effect. Phase of sine wave at the end of the tone is stored in
+   the cache, and is restored in generator when cached samples are
+   returned, so that next tone continues the sine wave correctly.
+
+   Returned samples are valid until next call of the function.
+
+   Samples of a character of generator's memory (a tone with
+   tone->is_clip set) are always available: they are pre-rendered
+   samples of the memory.
+
+   @param[in] gen generator
+   @param[in] tone tone to be generated
+
+   @return pointer to tone's tone->n_samples samples
+   @return NULL if samples of the tone are not available (tone can't be cached, or memory allocation failed)
+*/
+const cw_sample_t * cw_gen_tone_cache_get_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (tone->is_clip) {
+		return cw_gen_memory_get_samples_internal(gen, tone);
+	}
+
+	if (tone->frequency <= 0
+	    || tone->is_forever
+	    || cw_gen_modulation_is_active_internal(gen)
+	    || tone->rising_slope_n_samples <= 0
+	    || tone->n_samples <= 0
+	    || tone->n_samples > CW_GEN_TONE_CACHE_MAX_N_SAMPLES
+	    || 0 != tone->sample_iterator) {
+
+		return NULL;
+	}
+
+	const unsigned int generation = gen->tone_cache.generation;
+	const int phase_bucket = cw_gen_tone_cache_phase_bucket_internal(gen);
+
+	for (int i = 0; i < CW_GEN_TONE_CACHE_N_ENTRIES; i++) {
+		const cw_gen_tone_cache_entry_t * entry = &gen->tone_cache.entries[i];
+		if (entry->valid
+		    && entry->generation == generation
+		    && entry->frequency == tone->frequency
+		    && entry->n_samples == tone->n_samples
+		    && entry->rising_slope_n_samples == tone->rising_slope_n_samples
+		    && entry->falling_slope_n_samples == tone->falling_slope_n_samples
+		    && entry->slope_shape == gen->tone_slope.shape
+		    && entry->volume_abs == gen->volume_abs
+		    && entry->sample_rate == gen->sample_rate
+		    && entry->phase_bucket == phase_bucket) {
+
+			gen->phase_offset = entry->phase_offset;
+			gen->phase_acc = entry->phase_acc;
+			return entry->samples;
+		}
+	}
+
+	/* Cache miss. Render the tone into next entry. */
+	cw_gen_tone_cache_entry_t * entry = &gen->tone_cache.entries[gen->tone_cache.next];
+	gen->tone_cache.next = (gen->tone_cache.next + 1) % CW_GEN_TONE_CACHE_N_ENTRIES;
+	entry->valid = false;
+
+	if (entry->samples_capacity < tone->n_samples) {
+		cw_sample_t * samples = realloc(entry->samples, sizeof (cw_sample_t) * (size_t) tone->n_samples);
+		if (NULL == samples) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to realloc() samples of cached tone");
+			return NULL;
+		}
+		entry->samples = samples;
+		entry->samples_capacity = tone->n_samples;
+	}
+
+	cw_tone_t rendered_tone;
+	CW_TONE_COPY(&rendered_tone, tone);
+	cw_gen_tone_cache_set_phase_bucket_internal(gen, phase_bucket);
+	cw_gen_render_samples_internal(gen, &rendered_tone, entry->samples, (int) tone->n_samples);
+
+	entry->generation = generation;
+	entry->frequency = tone->frequency;
+	entry->n_samples = tone->n_samples;
+	entry->rising_slope_n_samples = tone->rising_slope_n_samples;
+	entry->falling_slope_n_samples = tone->falling_slope_n_samples;
+	entry->slope_shape = gen->tone_slope.shape;
+	entry->volume_abs = gen->volume_abs;
+	entry->sample_rate = gen->sample_rate;
+	entry->phase_bucket = phase_bucket;
+	entry->phase_offset = gen->phase_offset;
+	entry->phase_acc = gen->phase_acc;
+	entry->valid = true;
+
+	return entry->samples;
+}
+
+
+
+
+/**
+   @brief Get index of range of phases containing current phase of generator
+
+   @param[in] gen generator
+
+   @return index of phase bucket
+*/
+static int cw_gen_tone_cache_phase_bucket_internal(const cw_gen_t * gen)
+{
+	const int n_buckets = 1 << CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS;
+
+	if (CW_GEN_OSCILLATOR_FIXED_POINT == gen->oscillator) {
+		return (int) (gen->phase_acc >> (32 - CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS));
+	}
+
+	/* Phase offset may be negative before generator is started. */
+	const int bucket = (int) (gen->phase_offset * (float) n_buckets / (2.0F * CW_PI));
+	return bucket < 0 ? 0 : (bucket >= n_buckets ? n_buckets - 1 : bucket);
+}
+
+
+
+
+/**
+   @brief Set phase of generator to beginning of given phase bucket
+
+   @param[in,out] gen generator
+   @param[in] phase_bucket index of phase bucket
+*/
+static void cw_gen_tone_cache_set_phase_bucket_internal(cw_gen_t * gen, int phase_bucket)
+{
+	const int n_buckets = 1 << CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS;
+
+	gen->phase_acc = (uint32_t) phase_bucket << (32 - CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS);
+	gen->phase_offset = (float) phase_bucket * 2.0F * CW_PI / (float) n_buckets;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Invalidate all tones in generator's cache of pre-rendered tones
+
+   The function may be called from any thread. It doesn't touch entries
+   of the cache, so it doesn't interfere with generator's thread.
+
+   @param[in,out] gen generator
+*/
+static void cw_gen_tone_cache_invalidate_internal(cw_gen_t * gen)
+{
+	gen->tone_cache.generation++;
+	return;
+}
+
+
+
+
+/**
+   @brief Construct empty tone with correct/needed values of samples count
+
+   The function sets values tone->..._n_samples fields of empty @p
+   tone based on information from @p gen (i.e. looking on how many
+   samples of silence need to be "created").  The sample count values
+   are set in a way that allows filling remainder of generator's
+   buffer with silence.
+
+   After this point tone duration should not be used - it's the samples count that is correct.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples count.
+*/
+void cw_gen_empty_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	/* All tones have been already dequeued from tone queue.
+
+	   @p tone does not represent a valid tone to generate. At
+	   first sight there is no need to write anything to
+	   soundcard. But...
+
+	   It may happen that during previous call to the function
+	   there were too few samples in a tone to completely fill a
+	   buffer (see #needmoresamples tag below).
+
+	   We need to fill the buffer until it is full and ready to be
+	   sent to sound sink.
+
+	   Since there are no new tones for which we could generate
+	   samples, we need to generate silence samples.
+
+	   Padding the buffer with silence seems to be a good idea (it
+	   will work regardless of value (Mark/Space) of last valid
+	   tone). We just need to know how many samples of the silence
+	   to produce.
+
+	   Number of these samples will be stored in
+	   samples_to_write. */
+
+	/* We don't have a valid tone, so let's construct a fake one
+	   for purposes of padding. */
+
+	/* Required length of padding space is from end of last buffer
+	   subarea to end of buffer. */
+	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);;
+
+	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
+	tone->frequency = 0;   /* This fake tone is a piece of silence. */
+
+	/* The silence tone used for padding doesn't require any
+	   slopes. A slope falling to silence has been already
+	   provided by last non-fake and non-silent tone. */
+	tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
+	tone->rising_slope_n_samples = 0;
+	tone->falling_slope_n_samples = 0;
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+	//fprintf(stderr, "++++ count of samples in empty tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate tone suitable for silencing a generator
+
+   Calculate a @p tone variable that, when passed to generator's write()
+   function, will silence a generator.
+
+   @internal
+   @reviewed 2020-10-13
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples
+*/
+void cw_gen_silencing_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	/* Make sure that we fill a buffer to the end (i.e. calculate as many
+	   samples as there are from current position in the buffer to the
+	   end of the buffer). Otherwise a buffer underrun may occur. */
+	tone->n_samples = gen->buffer_n_samples - (gen->buffer_sub_stop + 1);
+
+	/* Also make sure that a tone is long enough for it to be heard
+	   (otherwise it may be perceived as click). */
+	tone->n_samples += (5 * gen->buffer_n_samples);
+
+	tone->duration = 0;    /* This value matters no more, because now we only deal with samples. */
+
+	/* Length of a single slope. */
+	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
+	slope_n_samples *= gen->tone_slope.duration;
+	slope_n_samples /= 10000;
+
+	switch (tone->slope_mode) {
+	case CW_SLOPE_MODE_NO_SLOPES:
+	case CW_SLOPE_MODE_RISING_SLOPE:
+		/* Previous tone has ended with full level. Let the silencing
+		   tone fall from the full level to zero. */
+		tone->slope_mode = CW_SLOPE_MODE_FALLING_SLOPE;
+		break;
+	case CW_SLOPE_MODE_FALLING_SLOPE:
+	case CW_SLOPE_MODE_STANDARD_SLOPES:
+		/* Level of previous slope has already fallen to zero. Keep
+		   the level at zero. */
+	default:
+		tone->slope_mode = CW_SLOPE_MODE_NO_SLOPES;
+		tone->frequency = 0;
+		break;
+	}
+	tone->rising_slope_n_samples = 0;
+	tone->falling_slope_n_samples = slope_n_samples;
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+	//fprintf(stderr, "++++ count of samples in silencing tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Recalculate non-empty tone parameters from microseconds into samples
+
+   The function sets tone->..._n_samples fields of non-empty @p tone
+   based on other information from @p tone and from @p gen.
+
+   After this point tone duration should not be used - it's the samples count that is correct.
+
+   @internal
+   @reviewed 2020-08-05
+   @endinternal
+
+   @param[in] gen
+   @param[in] tone tone for which to calculate samples count.
+*/
+void cw_gen_tone_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	if (tone->is_clip) {
+		cw_gen_memory_calculate_samples_size_internal(gen, tone);
+		return;
+	}
+
+	/* 100 * 10000 = 1.000.000 usecs per second. */
+	tone->n_samples = gen->sample_rate / 100;
+	tone->n_samples *= tone->duration;
+	tone->n_samples /= 10000;
+
+	//fprintf(stderr, MSG_PREFIX "length of regular tone = %d [samples]\n", tone->n_samples);
+
+	/* Length of a single slope (rising or falling). */
+	cw_sample_iter_t slope_n_samples = gen->sample_rate / 100;
+	slope_n_samples *= gen->tone_slope.duration;
+	slope_n_samples /= 10000;
+
+	if (tone->slope_mode == CW_SLOPE_MODE_RISING_SLOPE) {
+		tone->rising_slope_n_samples = slope_n_samples;
+		tone->falling_slope_n_samples = 0;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_FALLING_SLOPE) {
+		tone->rising_slope_n_samples = 0;
+		tone->falling_slope_n_samples = slope_n_samples;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES) {
+		tone->rising_slope_n_samples = slope_n_samples;
+		tone->falling_slope_n_samples = slope_n_samples;
+
+	} else if (tone->slope_mode == CW_SLOPE_MODE_NO_SLOPES) {
+		tone->rising_slope_n_samples = 0;
+		tone->falling_slope_n_samples = 0;
+
+	} else {
+		cw_assert (0, MSG_PREFIX "unknown tone slope mode %d", tone->slope_mode);
+	}
+
+	/* This is part of initialization of tone. Zero samples from the tone
+	   have been calculated and put into generator's buffer. */
+	tone->sample_iterator = 0;
+
+#if 0
+	/* Debug code. */
+	if (tone->is_forever) {
+		fprintf(stderr, "++++ count of samples in forever tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	} else {
+		fprintf(stderr, "++++ count of samples in regular tone '%c' = %d\n", tone->debug_id, tone->n_samples);
+	}
+#endif
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_set_speed(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_SPEED_MIN || new_value > CW_SPEED_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Don't let earlier batched update overwrite this value. */
+	cw_gen_apply_pending_parameters_internal(gen, false);
+
+	if (new_value != gen->send_speed) {
+		gen->send_speed = new_value;
+
+		/* Changes of send speed require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_frequency(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_FREQUENCY_MIN || new_value > CW_FREQUENCY_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	} else {
+		cw_gen_apply_pending_parameters_internal(gen, false);
+		gen->frequency = new_value;
+		return CW_SUCCESS;
+	}
+}
+
+
+
+
+cw_ret_t cw_gen_set_volume(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_VOLUME_MIN || new_value > CW_VOLUME_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	} else {
+		cw_gen_apply_pending_parameters_internal(gen, false);
+
+		pthread_mutex_lock(&gen->pending_parameters.mutex);
+		/* This value replaces volume of earlier batched update. */
+		__atomic_store_n(&gen->pending_parameters.is_pending_volume, false, __ATOMIC_RELAXED);
+		gen->volume_percent = new_value;
+		gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+		pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+		/* Slope amplitudes are normalized, volume is applied when
+		   samples are calculated. Nothing to recalculate. */
+
+		return CW_SUCCESS;
+	}
+}
+
+
+
+
+cw_ret_t cw_gen_set_gap(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_GAP_MIN || new_value > CW_GAP_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_apply_pending_parameters_internal(gen, false);
+
+	if (new_value != gen->gap) {
+		gen->gap = new_value;
+		/* Changes of gap require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_weighting(cw_gen_t * gen, int new_value)
+{
+	if (new_value < CW_WEIGHTING_MIN || new_value > CW_WEIGHTING_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_apply_pending_parameters_internal(gen, false);
+
+	if (new_value != gen->weighting) {
+		gen->weighting = new_value;
+
+		/* Changes of weighting require resynchronization. */
+		gen->parameters_in_sync = false;
+		cw_gen_sync_parameters_internal(gen);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_parameters(cw_gen_t * gen, const cw_gen_parameters_t * parameters)
+{
+	if (parameters->speed < CW_SPEED_MIN || parameters->speed > CW_SPEED_MAX
+	    || parameters->frequency < CW_FREQUENCY_MIN || parameters->frequency > CW_FREQUENCY_MAX
+	    || parameters->volume < CW_VOLUME_MIN || parameters->volume > CW_VOLUME_MAX
+	    || parameters->gap < CW_GAP_MIN || parameters->gap > CW_GAP_MAX
+	    || parameters->weighting < CW_WEIGHTING_MIN || parameters->weighting > CW_WEIGHTING_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Only store the values. Whichever thread needs them first will
+	   apply them, so many calls in a row end with one recalculation. */
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	gen->pending_parameters.values = *parameters;
+	__atomic_store_n(&gen->pending_parameters.is_pending_enqueue, true, __ATOMIC_RELEASE);
+	__atomic_store_n(&gen->pending_parameters.is_pending_volume, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_get_parameters(cw_gen_t * gen, cw_gen_parameters_t * parameters)
+{
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	const cw_gen_parameters_t * pending = &gen->pending_parameters.values;
+	const bool is_pending_enqueue = gen->pending_parameters.is_pending_enqueue;
+
+	parameters->speed = is_pending_enqueue ? pending->speed : gen->send_speed;
+	parameters->frequency = is_pending_enqueue ? pending->frequency : gen->frequency;
+	parameters->gap = is_pending_enqueue ? pending->gap : gen->gap;
+	parameters->weighting = is_pending_enqueue ? pending->weighting : gen->weighting;
+	parameters->volume = gen->pending_parameters.is_pending_volume ? pending->volume : gen->volume_percent;
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+}
+
+
+
+
+void cw_gen_apply_pending_parameters_internal(cw_gen_t * gen, bool is_generator_thread)
+{
+	const bool apply_enqueue = !is_generator_thread
+		&& __atomic_load_n(&gen->pending_parameters.is_pending_enqueue, __ATOMIC_ACQUIRE);
+	const bool apply_volume = (is_generator_thread || !gen->thread.running)
+		&& __atomic_load_n(&gen->pending_parameters.is_pending_volume, __ATOMIC_ACQUIRE);
+	if (!apply_enqueue && !apply_volume) {
+		/* This is the path taken by generator's thread for almost
+		   every tone, so it doesn't lock anything. */
+		return;
+	}
+
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	const cw_gen_parameters_t * pending = &gen->pending_parameters.values;
+	if (apply_enqueue && gen->pending_parameters.is_pending_enqueue) {
+		if (pending->speed != gen->send_speed
+		    || pending->gap != gen->gap
+		    || pending->weighting != gen->weighting) {
+
+			gen->send_speed = pending->speed;
+			gen->gap = pending->gap;
+			gen->weighting = pending->weighting;
+			/* Durations will be recalculated once, on next sync. */
+			gen->parameters_in_sync = false;
+		}
+		gen->frequency = pending->frequency;
+		__atomic_store_n(&gen->pending_parameters.is_pending_enqueue, false, __ATOMIC_RELEASE);
+	}
+	if (apply_volume && gen->pending_parameters.is_pending_volume) {
+		/* Slope amplitudes don't depend on volume, so the change
+		   costs nothing more. */
+		gen->volume_percent = pending->volume;
+		gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+		__atomic_store_n(&gen->pending_parameters.is_pending_volume, false, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_set_gain(cw_gen_t * gen, int gain, int duration)
+{
+	if (gain < 0 || gain > 100 || duration < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	gen->modulation.requested_gain = gain;
+	gen->modulation.requested_gain_duration = duration;
+	__atomic_store_n(&gen->modulation.is_pending_gain, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_chirp(cw_gen_t * gen, int offset, int duration)
+{
+	if (offset < -CW_FREQUENCY_MAX || offset > CW_FREQUENCY_MAX
+	    || duration < 0 || duration > CW_GEN_CHIRP_DURATION_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	gen->modulation.requested_chirp_offset = offset;
+	gen->modulation.requested_chirp_duration = duration;
+	__atomic_store_n(&gen->modulation.is_pending_chirp, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+bool cw_gen_apply_pending_modulation_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (tone->is_clip) {
+		/* Samples of the tone have been rendered without
+		   modulation. Requests wait for next tone. */
+		return false;
+	}
+
+	const bool apply_gain = __atomic_load_n(&gen->modulation.is_pending_gain, __ATOMIC_ACQUIRE);
+	/* Frequency of a mark can't jump in the middle of the mark. */
+	const bool apply_chirp = 0 == tone->sample_iterator
+		&& __atomic_load_n(&gen->modulation.is_pending_chirp, __ATOMIC_ACQUIRE);
+	if (!apply_gain && !apply_chirp) {
+		return false;
+	}
+
+	pthread_mutex_lock(&gen->pending_parameters.mutex);
+	if (apply_gain) {
+		const int32_t target = (int32_t) (((int64_t) gen->modulation.requested_gain * CW_GEN_GAIN_ONE) / 100);
+		const int32_t diff = target - gen->modulation.gain;
+		cw_sample_iter_t n = ((cw_sample_iter_t) gen->modulation.requested_gain_duration * gen->sample_rate) / CW_USECS_PER_SEC;
+		if (n > (cw_sample_iter_t) (diff < 0 ? -diff : diff)) {
+			/* Change by at least one unit per sample. */
+			n = diff < 0 ? -diff : diff;
+		}
+
+		gen->modulation.gain_target = target;
+		if (n > 0) {
+			gen->modulation.gain_step = (int32_t) (diff / n);
+			gen->modulation.gain_n_remaining = n;
+		} else {
+			gen->modulation.gain = target;
+			gen->modulation.gain_step = 0;
+			gen->modulation.gain_n_remaining = 0;
+		}
+		__atomic_store_n(&gen->modulation.is_pending_gain, false, __ATOMIC_RELEASE);
+	}
+	if (apply_chirp) {
+		gen->modulation.chirp_offset = gen->modulation.requested_chirp_offset;
+		gen->modulation.chirp_n_samples = 0 == gen->modulation.chirp_offset
+			? 0
+			: (int) (((int64_t) gen->modulation.requested_chirp_duration * gen->sample_rate) / CW_USECS_PER_SEC);
+		__atomic_store_n(&gen->modulation.is_pending_chirp, false, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&gen->pending_parameters.mutex);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Check if samples of marks depend on something else than the marks
+
+   Samples of marks with changing gain, with gain other than full
+   volume, or with chirp can't be taken from cache of pre-rendered tones
+   or from periodic fragment of sine wave.
+
+   @param[in] gen generator
+
+   @return true if gain or chirp affect samples of marks
+   @return false otherwise
+*/
+static bool cw_gen_modulation_is_active_internal(const cw_gen_t * gen)
+{
+	return CW_GEN_GAIN_ONE != gen->modulation.gain
+		|| gen->modulation.gain_n_remaining > 0
+		|| gen->modulation.chirp_n_samples > 0;
+}
+
+
+
+
+int cw_gen_get_speed(const cw_gen_t * gen)
+{
+	return gen->send_speed;
+}
+
+
+
+
+int cw_gen_get_frequency(const cw_gen_t * gen)
+{
+	return gen->frequency;
+}
+
+
+
+
+int cw_gen_get_volume(const cw_gen_t * gen)
+{
+	return gen->volume_percent;
+}
+
+
+
+
+int cw_gen_get_gap(const cw_gen_t * gen)
+{
+	return gen->gap;
+}
+
+
+
+
+int cw_gen_get_weighting(const cw_gen_t * gen)
+{
+	return gen->weighting;
+}
+
+
+
+
+void cw_gen_get_timing_parameters_internal(cw_gen_t * gen,
+					   int * dot_duration,
+					   int * dash_duration,
+					   int * ims_duration,
+					   int * ics_duration,
+					   int * iws_duration,
+					   int * additional_space_duration,
+					   int * adjustment_space_duration)
+{
+	cw_gen_sync_parameters_internal(gen);
+
+	if (dot_duration)  { *dot_duration  = gen->durations->dot_duration; }
+	if (dash_duration) { *dash_duration = gen->durations->dash_duration; }
+	if (ims_duration)  { *ims_duration  = gen->durations->ims_duration; }
+	if (ics_duration)  { *ics_duration  = gen->durations->ics_duration; }
+	if (iws_duration)  { *iws_duration  = gen->durations->iws_duration; }
+
+	if (additional_space_duration) { *additional_space_duration = gen->durations->additional_space_duration; }
+	if (adjustment_space_duration) { *adjustment_space_duration = gen->durations->adjustment_space_duration; }
+}
+
+
+
+
+void cw_gen_get_durations_internal(cw_gen_t * gen, cw_gen_durations_t * durations)
+{
+	/*
+	  This function shall always and forever be a wrapper around
+	  cw_gen_get_timing_parameters_internal(). Let the wrapped function do
+	  some steps necessary before returning the parameters.
+	*/
+
+	cw_gen_get_timing_parameters_internal
+		(gen,
+		 &durations->dot_duration,
+		 &durations->dash_duration,
+		 &durations->ims_duration,
+		 &durations->ics_duration,
+		 &durations->iws_duration,
+		 &durations->additional_space_duration,
+		 &durations->adjustment_space_duration);
+}
+
+
+
+
+/**
+   @brief Enqueue a tone in generator's tone queue, or in generator's batch of tones
+
+   If generator is collecting tones of a character (see
+   cw_gen_enqueue_batch_begin_internal()), the tone is added to the
+   batch. Otherwise the tone is added directly to tone queue.
+
+   @exception EAGAIN the batch of tones is full
+
+   @param[in] gen generator in which to enqueue the tone
+   @param[in] tone tone to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_tone_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (0 == gen->enqueue_batch.depth) {
+		return cw_tq_enqueue_internal(gen->tq, tone);
+	}
+
+	if (gen->enqueue_batch.n_tones >= CW_GEN_ENQUEUE_BATCH_CAPACITY) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "batch of tones is full");
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+	gen->enqueue_batch.tones[gen->enqueue_batch.n_tones++] = *tone;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Enqueue a space in generator's tone queue, or in generator's batch of tones
+
+   Works as cw_gen_enqueue_tone_internal(), but a space that follows
+   another space in generator's batch of tones is merged into that
+   space. E.g. inter-character-space is merged into inter-mark-space
+   that follows last mark of a character. This way there are less tones
+   to be enqueued, dequeued and rendered by generator.
+
+   Spaces are not merged with a tone that is already in tone queue:
+   generator may be dequeueing that tone right now.
+
+   @exception EAGAIN the batch of tones is full
+
+   @param[in] gen generator in which to enqueue the space
+   @param[in] tone silent tone to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_space_internal(cw_gen_t * gen, const cw_tone_t * tone)
+{
+	if (0 != gen->enqueue_batch.depth && gen->enqueue_batch.n_tones > 0) {
+		cw_tone_t * prev = &gen->enqueue_batch.tones[gen->enqueue_batch.n_tones - 1];
+		if (0 == prev->frequency && 0 == tone->frequency
+		    && !prev->is_clip && !tone->is_clip
+		    && !prev->is_forever && !tone->is_forever
+		    && !prev->is_scheduled && !tone->is_scheduled
+		    && !tone->is_first
+		    && prev->slope_mode == tone->slope_mode
+		    && tone->duration >= 0
+		    && prev->duration <= INT_MAX - tone->duration) {
+
+			prev->duration += tone->duration;
+			return CW_SUCCESS;
+		}
+	}
+
+	return cw_gen_enqueue_tone_internal(gen, tone);
+}
+
+
+
+
+/**
+   @brief Start collecting enqueued tones in generator's batch of tones
+
+   Tones enqueued by generator's 'enqueue' primitives after call to this
+   function are not added to tone queue one by one, but are collected in
+   generator's batch of tones. They are added to tone queue at once, under
+   a single lock and with single notification of generator's thread, by
+   matching call to cw_gen_enqueue_batch_end_internal().
+
+   Calls to the two functions can be nested, only the outermost pair of
+   calls is effective.
+
+   @param[in] gen generator
+*/
+void cw_gen_enqueue_batch_begin_internal(cw_gen_t * gen)
+{
+	if (0 == gen->enqueue_batch.depth++) {
+		gen->enqueue_batch.n_tones = 0;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Stop collecting enqueued tones in generator's batch of tones
+
+   See cw_gen_enqueue_batch_begin_internal().
+
+   @p cwret is result of enqueueing tones since the call to
+   cw_gen_enqueue_batch_begin_internal(). If it is CW_FAILURE, collected
+   tones are discarded. Otherwise, in outermost call, all the tones are
+   added to tone queue. Either all of them are added, or none.
+
+   @exception EAGAIN tones not enqueued because high water mark of tone queue would be exceeded
+
+   @param[in] gen generator
+   @param[in] cwret result of enqueueing tones to the batch
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_batch_end_internal(cw_gen_t * gen, cw_ret_t cwret)
+{
+	cw_assert (gen->enqueue_batch.depth > 0, MSG_PREFIX "unbalanced end of batch of tones");
+
+	if (0 != --gen->enqueue_batch.depth) {
+		return cwret;
+	}
+
+	const size_t n_tones = gen->enqueue_batch.n_tones;
+	gen->enqueue_batch.n_tones = 0;
+	if (CW_SUCCESS != cwret) {
+		return CW_FAILURE;
+	}
+
+	size_t marked = n_tones;
+	if (gen->enqueue_batch.mark) {
+		/* Tone queue drops tones with zero duration, so mark
+		   the last tone that will get to the queue. */
+		for (size_t i = n_tones; i > 0; i--) {
+			if (gen->enqueue_batch.tones[i - 1].duration > 0) {
+				marked = i - 1;
+				gen->enqueue_batch.tones[marked].is_mark = true;
+				break;
+			}
+		}
+	}
+
+	const cw_ret_t enqueued = gen->enqueue_batch.priority
+		? cw_tq_enqueue_priority_internal(gen->tq, gen->enqueue_batch.tones, n_tones)
+		: cw_tq_enqueue_batch_internal(gen->tq, gen->enqueue_batch.tones, n_tones);
+	if (marked < n_tones) {
+		gen->enqueue_batch.tones[marked].is_mark = false;
+	}
+	if (CW_SUCCESS != enqueued) {
+		/* Reset on error. */
+		gen->space_units_count = 0;
+		return CW_FAILURE;
+	}
+	gen->enqueue_batch.marked = marked < n_tones;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Enqueue a mark (Dot or Dash)
+
+   Low level primitive to enqueue a tone for mark of the given type, followed
+   by the standard inter-mark-space.
+
+   Function sets errno to EINVAL if an argument is invalid, and
+   returns CW_FAILURE.
+
+   Function also returns CW_FAILURE if adding the element to queue of
+   tones failed.
+
+   @reviewedon 2023-08-26
+
+   @param[in] gen generator to be used to enqueue a mark and inter-mark-space
+   @param[in] mark mark to send: Dot (CW_DOT_REPRESENTATION) or Dash (CW_DASH_REPRESENTATION)
+   @param[in] is_first is it a first mark in a character?
+
+   @return CW_FAILURE on failure
+   @return CW_SUCCESS on success
+*/
+cw_ret_t cw_gen_enqueue_mark_internal(cw_gen_t * gen, char mark, bool is_first)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	/* Synchronize low-level timings if required. */
+	cw_gen_sync_parameters_internal(gen);
+	/* TODO: do we need to synchronize here receiver as well? */
+
+	/* Send either a dot or a dash mark, depending on representation. */
+	if (mark == CW_DOT_REPRESENTATION) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, gen->frequency, gen->durations->dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone.is_first = is_first;
+		cwret = cw_gen_enqueue_tone_internal(gen, &tone);
+		/* Enqueueing a mark means resetting of spaces counter. */
+		gen->space_units_count = 0;
+	} else if (mark == CW_DASH_REPRESENTATION) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, gen->frequency, gen->durations->dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		tone.is_first = is_first;
+		cwret = cw_gen_enqueue_tone_internal(gen, &tone);
+		/* Enqueueing a mark means resetting of spaces counter. */
+		gen->space_units_count = 0;
+	} else {
+		errno = EINVAL;
+		cwret = CW_FAILURE;
+		/* Reset on error. */
+		gen->space_units_count = 0;
+	}
+
+	if (CW_SUCCESS != cwret) {
+		return CW_FAILURE;
+	}
+
+	/* Send the inter-mark-space. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, gen->durations->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
+	cwret = cw_gen_enqueue_space_internal(gen, &tone);
+	/* Enqueueing an ims must be recorded in space units counter. */
+	gen->space_units_count = UNITS_PER_IMS;
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Calculate duration of inter-character-space to be enqueued
+
+   The inter-character-space should be shorter by spaces that have been
+   already enqueued after last Mark (see cw_gen_t::space_units_count).
+   Additional inter-character space is not included.
+
+   @param[in] durations durations of Marks and Spaces
+   @param[in] space_units_count count of Units of spaces enqueued after last Mark
+
+   @return duration of inter-character-space [microseconds]
+*/
+int cw_gen_ics_duration_internal(const cw_gen_durations_t * durations, int space_units_count)
+{
+	/* The ics should be shorter by already enqueued/played
+	   spaces. Calculate the duration of shorter ics depending on what kind
+	   of spaces were already enqueued before. */
+	int ics_duration = 0;
+	switch (space_units_count) {
+	case 0:
+		/* It's possible that dot or dash was enqueued without
+		   ims, or maybe the count was reset on error, so enqueue
+		   ics with its full duration. */
+		ics_duration = durations->ics_duration;
+		break;
+	case UNITS_PER_IMS:
+		/* This ics is appended after already enqueued ims. Duration of the
+		   tone that we enqueue here should be shorter by ims. The ims and
+		   current shortened tone will together form 3-units ics. */
+		ics_duration = durations->ics_duration - durations->ims_duration;
+		break;
+	case UNITS_PER_ICS:
+	case UNITS_PER_IWS:
+		/* libcw API provides functions for enqueueing ics or iws, so it's
+		   possible that application will enqueue multiple ics spaces or mix
+		   of ics and iws. So enqueue this ics in its full duration. */
+		ics_duration = durations->ics_duration;
+		break;
+	default:
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
+		              MSG_PREFIX "Unexpected count of space units in 'enqueue ics': %d", space_units_count);
+		ics_duration = durations->ics_duration;
+		break;
+	}
+
+	/* Failsafe. */
+	if (ics_duration < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
+		              MSG_PREFIX "Negative value of ics duration: %d", ics_duration);
+		ics_duration = durations->ics_duration;
+	}
+
+	return ics_duration;
+}
+
+
+
+
+/**
+   @brief Calculate duration of inter-word-space to be enqueued
+
+   The inter-word-space should be shorter by spaces that have been
+   already enqueued after last Mark (see cw_gen_t::space_units_count).
+   Adjustment space is not included.
+
+   @param[in] durations durations of Marks and Spaces
+   @param[in] space_units_count count of Units of spaces enqueued after last Mark
+
+   @return duration of inter-word-space [microseconds]
+*/
+int cw_gen_iws_duration_internal(const cw_gen_durations_t * durations, int space_units_count)
+{
+	/* The iws should be shorter by already enqueued/played
+	   spaces. Calculate the duration of shorter iws depending on what kind
+	   of spaces were already enqueued before. */
+	int iws_duration = 0;
+	switch (space_units_count) {
+	case 0:
+		/* We may get here when we only begin to play some string, or when
+		   some reset of space_units_count was done, or when previous
+		   element was an iws. This iws should have full duration. */
+		iws_duration = durations->iws_duration;
+		break;
+	case UNITS_PER_IMS:
+		/* This iws is appended after already enqueued ims (e.g. at the end
+		   of a word, when ' ' space character is played). Duration of the
+		   tone that we enqueue here should be shorter by ims. The ims and
+		   current shortened tone will together form 7-unit iws. */
+		iws_duration = durations->iws_duration - durations->ims_duration;
+		break;
+	case UNITS_PER_ICS:
+		/* This iws is appended after already enqueued ics. Duration of the
+		   tone that we enqueue here should be shorter by ics. The ics and
+		   current shortened tone will together form 7-unit iws. */
+		iws_duration = durations->iws_duration - durations->ics_duration;
+		break;
+	case UNITS_PER_IWS:
+		/* This is probably a situation when application wants to enqueue two
+		   or more ' ' characters. Enqueue full duration of inter-word-space. */
+		iws_duration = durations->iws_duration;
+		break;
+	default:
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
+		              MSG_PREFIX "Unexpected count of space units in 'enqueue iws': %d", space_units_count);
+		iws_duration = durations->iws_duration;
+		break;
+	};
+
+	/* Failsafe. */
+	if (iws_duration < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_ERROR,
+		              MSG_PREFIX "Negative value of iws duration: %d", iws_duration);
+		iws_duration = durations->iws_duration;
+	}
+
+	return iws_duration;
+}
+
+
+
+
+/**
+   @brief Enqueue inter-character-space
+
+   The function enqueues enough space to form 3-Unit inter-character-space.
+
+   The function can be called even when inter-mark-space has already been
+   enqueued. In such situation standard inter-mark-space (one Unit) will be
+   followed by just two Units to form a full standard inter-character-space
+   (three Units).
+
+   Inter-character adjustment space is added at the end.
+
+   @reviewedon 2023-08-06
+
+   @param[in] gen generator in which to enqueue the space
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_ics_internal(cw_gen_t * gen)
+{
+	/* Synchronize low-level timing parameters. */
+	cw_gen_sync_parameters_internal(gen);
+
+	const int ics_duration = cw_gen_ics_duration_internal(gen->durations, gen->space_units_count);
+
+	/* Enqueue ics with calculated duration, plus any additional inter-character gap. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, ics_duration + gen->durations->additional_space_duration, CW_SLOPE_MODE_NO_SLOPES);
+	const cw_ret_t cwret = cw_gen_enqueue_space_internal(gen, &tone);
+	gen->space_units_count = UNITS_PER_ICS;
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Enqueue space character (' ') in generator, to be sent using Morse code
+
+   The function should be used to enqueue a regular ' ' character.
+
+   The function enqueues space of length 5 Units. The function is intended to
+   be used after inter-mark-space and inter-character-space have already been
+   enqueued.
+
+   In such situation standard inter-mark-space (one Unit) and
+   inter-character-space (two Units) and regular space (five units) form a
+   full standard inter-word-space (seven Units).
+
+   TODO: review this description again. This function alone doesn't send
+   space character, it sends a part of what can be seen as inter-word-space.
+
+   Inter-word adjustment space is added at the end.
+
+   @reviewedon 2023-08-06
+
+   @param[in] gen generator in which to enqueue the space
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen)
+{
+	/* Synchronize low-level timing parameters. */
+	cw_gen_sync_parameters_internal(gen);
+
+	const int iws_duration = cw_gen_iws_duration_internal(gen->durations, gen->space_units_count);
+
+	/* Send silence for the word delay period, plus any adjustment
+	   that may be needed at end of word. Make it in two tones,
+	   and here is why.
+
+	   Let's say that 'tone queue low watermark' is one element
+	   (i.e. one tone).
+
+	   In order for tone queue to recognize that a 'low tone
+	   queue' callback needs to be called, the level in tq needs
+	   to drop from 2 to 1.
+
+	   Almost every queued character guarantees that there will be
+	   at least two tones, e.g for 'E' it is dash + following
+	   space. But what about a ' ' character?
+
+	   If we enqueue ' ' character as single tone, there is only one
+	   tone in tone queue, and the tone queue manager can't
+	   recognize when the level drops from 2 to 1 (and thus the
+	   'low level' callback won't be called).
+
+	   If we enqueue ' ' character as two separate tones (as we do
+	   this in this function), the tone queue manager can
+	   recognize level dropping from 2 to 1. Then the passing of
+	   critical level can be noticed, and "low level" callback can
+	   be called.
+
+	   BUT: Sometimes the first tone is dequeued before/during the
+	   second one is enqueued, and we can't recognize 2->1 event.
+
+	   So, to be super-sure that there is a recognizable event of
+	   passing tone queue level from 2 to 1, we split the inter-word-space
+	   into N parts and enqueue them. This way we have N + 1
+	   tones per space, and client applications that rely on low
+	   level threshold == 1 can correctly work when enqueueing
+	   spaces.
+
+	   At 60 wpm duration of gen->iws_duration is 100000 [us], so
+	   it's large enough to safely divide it by small integer
+	   value. */
+
+	int enqueued = 0;
+	cw_tone_t tone;
+#if 0
+	/* This section is incorrect. Enable this section only for
+	   tests.  This section "implements" a bug that was present in
+	   libcw until version 6.4.1 and that is now tested by
+	   src/libcw/tests/libcw_test_tq_short_space.c */
+	const int n = 1; /* No division. Old situation causing an error in
+		      client applications. */
+#else
+	const int n = 2; /* "small integer value" - used to have more tones per inter-word-space. */
+#endif
+	CW_TONE_INIT(&tone, 0, iws_duration / n, CW_SLOPE_MODE_NO_SLOPES);
+	for (int i = 0; i < n; i++) {
+		if (CW_SUCCESS != cw_gen_enqueue_tone_internal(gen, &tone)) {
+			/* Reset on error. */
+			gen->space_units_count = 0;
+			return CW_FAILURE;
+		}
+		enqueued++;
+	}
+
+	/* In batch of tones the adjustment space is merged into last
+	   part of inter-word-space (see cw_gen_enqueue_space_internal()). */
+	if (gen->durations->adjustment_space_duration > 0) {
+		CW_TONE_INIT(&tone, 0, gen->durations->adjustment_space_duration, CW_SLOPE_MODE_NO_SLOPES);
+		if (CW_SUCCESS != cw_gen_enqueue_space_internal(gen, &tone)) {
+			/* Reset on error. */
+			gen->space_units_count = 0;
+			return CW_FAILURE;
+		}
+		enqueued++;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "enqueued %d tones per iws, tq len = %zu",
+		      enqueued, cw_tq_length_internal(gen->tq));
+
+	/* We don't really need to store the information that UNITS_PER_IWS units
+	   have been enqueued. It's safe to reset the counter here and let the
+	   next 'enqueue space' call start from zero. */
+	gen->space_units_count = 0;
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Build tone programs of all characters from main table of characters
+
+   Tone program of a character is the sequence of tones that
+   cw_gen_enqueue_valid_character_internal() would enqueue for the
+   character: marks, each followed by inter-mark-space, and a part of
+   inter-character-space that follows last inter-mark-space (see
+   cw_gen_enqueue_ics_internal()). The tones are calculated with current
+   timing parameters and frequency of @p gen.
+
+   Last inter-mark-space of a character is stored twice: alone, and
+   merged with inter-character-space into single tone (see
+   cw_gen_enqueue_space_internal()).
+
+   @param[in] gen generator for which to build tone programs
+*/
+static void cw_gen_sync_tone_programs_internal(cw_gen_t * gen)
+{
+	memset(gen->tone_programs.n_marks, 0, sizeof (gen->tone_programs.n_marks));
+	gen->tone_programs.frequency = gen->frequency;
+
+	/* The inter-character-space is shorter by already enqueued
+	   inter-mark-space. */
+	int ics_duration = gen->durations->ics_duration - gen->durations->ims_duration;
+	if (ics_duration < 0) {
+		ics_duration = gen->durations->ics_duration;
+	}
+	ics_duration += gen->durations->additional_space_duration;
+
+	char charlist[UCHAR_MAX + 1] = { 0 };
+	cw_list_characters(charlist);
+
+	size_t n_tones = 0;
+	for (int i = 0; charlist[i] != '\0'; i++) {
+		const char * representation = cw_character_to_representation_internal(charlist[i]);
+		if (NULL == representation || ' ' == charlist[i]) {
+			continue;
+		}
+		const size_t n_marks = strlen(representation);
+		if (0 == n_marks || n_tones + 2 * n_marks + 1 > CW_GEN_TONE_PROGRAMS_CAPACITY) {
+			/* The character will be enqueued mark by mark. */
+			continue;
+		}
+
+		const unsigned char c = (unsigned char) charlist[i];
+		gen->tone_programs.offsets[c] = (uint16_t) n_tones;
+		gen->tone_programs.n_marks[c] = (uint8_t) n_marks;
+
+		cw_tone_t * tone = &gen->tone_programs.tones[n_tones];
+		for (size_t m = 0; m < n_marks; m++) {
+			const int duration = representation[m] == CW_DASH_REPRESENTATION
+				? gen->durations->dash_duration
+				: gen->durations->dot_duration;
+			CW_TONE_INIT(tone, gen->frequency, duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+			tone->is_first = 0 == m;
+			tone++;
+			CW_TONE_INIT(tone, 0, gen->durations->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
+			tone++;
+		}
+		CW_TONE_INIT(tone, 0, gen->durations->ims_duration + ics_duration, CW_SLOPE_MODE_NO_SLOPES);
+
+		n_tones += 2 * n_marks + 1;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if given character can be enqueued as a copy of its tone program
+
+   Function synchronizes generator's parameters and tone programs.
+
+   @param[in] gen generator
+   @param[in] character character to check
+
+   @return true if @p character has a tone program
+   @return false otherwise
+*/
+static bool cw_gen_has_tone_program_internal(cw_gen_t * gen, char character)
+{
+	cw_gen_sync_parameters_internal(gen);
+
+	/* Frequency of generator can be changed without
+	   re-synchronization of timing parameters. */
+	if (gen->tone_programs.frequency != gen->frequency) {
+		cw_gen_sync_tone_programs_internal(gen);
+	}
+
+	return 0 != gen->tone_programs.n_marks[(unsigned char) character];
+}
+
+
+
+
+/**
+   @brief Enqueue a character by copying its tone program
+
+   Call cw_gen_has_tone_program_internal() to check that @p character
+   has a tone program before calling this function.
+
+   @exception EAGAIN tone queue is full
+
+   @param[in] gen generator in which to enqueue the character
+   @param[in] character character to enqueue
+   @param[in] with_ics whether to enqueue inter-character-space after last inter-mark-space
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_tone_program_internal(cw_gen_t * gen, char character, bool with_ics)
+{
+	/* See comment about high water mark in cw_gen_enqueue_representation(). */
+	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	const unsigned char c = (unsigned char) character;
+	const size_t n_tones = 2 * (size_t) gen->tone_programs.n_marks[c];
+
+	cw_gen_enqueue_batch_begin_internal(gen);
+	cw_ret_t cwret = CW_SUCCESS;
+
+	if (gen->enqueue_batch.n_tones + n_tones > CW_GEN_ENQUEUE_BATCH_CAPACITY) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "batch of tones is full");
+		errno = EAGAIN;
+		cwret = CW_FAILURE;
+		/* Reset on error. */
+		gen->space_units_count = 0;
+	} else {
+		/* With inter-character-space, last inter-mark-space
+		   is replaced with its merged version. */
+		const cw_tone_t * program = &gen->tone_programs.tones[gen->tone_programs.offsets[c]];
+		cw_tone_t * tones = &gen->enqueue_batch.tones[gen->enqueue_batch.n_tones];
+		memcpy(tones, program, n_tones * sizeof (cw_tone_t));
+		if (with_ics) {
+			tones[n_tones - 1] = program[n_tones];
+		}
+		gen->enqueue_batch.n_tones += n_tones;
+		gen->space_units_count = with_ics ? UNITS_PER_ICS : UNITS_PER_IMS;
+	}
+
+	return cw_gen_enqueue_batch_end_internal(gen, cwret);
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_representation(cw_gen_t * gen, const char * representation)
+{
+	if (!cw_representation_is_valid(representation)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Before we let this representation loose on tone generation,
+	   we'd really like to know that all of its tones will get queued
+	   up successfully.  The right way to do this is to calculate the
+	   number of tones in our representation, then check that the space
+	   exists in the tone queue. However, since the queue is comfortably
+	   long, we can get away with just looking for a high water mark.  */
+	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	/* All tones of the representation are added to tone queue at once. */
+	cw_gen_enqueue_batch_begin_internal(gen);
+	cw_ret_t cwret = CW_SUCCESS;
+
+	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
+	for (int i = 0; CW_SUCCESS == cwret && representation[i] != '\0'; i++) {
+		const bool is_first = i == 0;
+		cwret = cw_gen_enqueue_mark_internal(gen, representation[i], is_first);
+	}
+
+	/* This function will enqueue just a right amount of space after the last
+	   inter-mark-space to form a 3-unit inter-character-space. */
+	if (CW_SUCCESS == cwret) {
+		cwret = cw_gen_enqueue_ics_internal(gen);
+	}
+
+	return cw_gen_enqueue_batch_end_internal(gen, cwret);
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_representation_no_ics(cw_gen_t * gen, const char * representation)
+{
+	if (!cw_representation_is_valid(representation)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Before we let this representation loose on tone generation,
+	   we'd really like to know that all of its tones will get queued
+	   up successfully.  The right way to do this is to calculate the
+	   number of tones in our representation, then check that the space
+	   exists in the tone queue. However, since the queue is comfortably
+	   long, we can get away with just looking for a high water mark.
+
+	   TODO: do the check the proper way.
+	   TODO: wrap this check into a function and reuse it in cw_gen_enqueue_representation()
+	*/
+	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	/* All tones of the representation are added to tone queue at once. */
+	cw_gen_enqueue_batch_begin_internal(gen);
+	cw_ret_t cwret = CW_SUCCESS;
+
+	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
+	for (int i = 0; CW_SUCCESS == cwret && representation[i] != '\0'; i++) {
+		const bool is_first = i == 0;
+		cwret = cw_gen_enqueue_mark_internal(gen, representation[i], is_first);
+	}
+
+	/* No inter-character-space added here. */
+
+	return cw_gen_enqueue_batch_end_internal(gen, cwret);
+}
+
+
+
+
+/**
+   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
+
+   _valid_character_ in function's name means that the function expects the
+   character @p character to be valid (@p character should be validated by
+   caller before passing it to the function).
+
+   no_ics in function's name means that the inter-character-space is not
+   appended at the end of Marks and Spaces enqueued in generator (but the
+   last inter-mark-space is).
+
+   @exception ENOENT @p character is not a valid character.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator to be used to enqueue character
+   @param[in] character character to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_valid_character_no_ics_internal(cw_gen_t * gen, char character)
+{
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "no generator available");
+		return CW_FAILURE;
+	}
+
+	/* ' ' character (i.e. inter-word-space) is a special case. */
+	if (character == ' ') {
+		cw_gen_enqueue_batch_begin_internal(gen);
+		const cw_ret_t cwret = cw_gen_enqueue_iws_internal(gen);
+		return cw_gen_enqueue_batch_end_internal(gen, cwret);
+	}
+
+	if (cw_gen_has_tone_program_internal(gen, character)) {
+		/* Last inter-mark-space is a part of the program, but
+		   inter-character-space is not. */
+		return cw_gen_enqueue_tone_program_internal(gen, character, false);
+	}
+
+	const char * representation = cw_character_to_representation_internal(character);
+
+	/* This shouldn't happen since we are in _valid_character_ function... */
+	cw_assert (NULL != representation, MSG_PREFIX "failed to find representation for character '%c'/%hhx", character, character);
+
+	/* ... but fail gracefully anyway. */
+	if (NULL == representation) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	if (CW_SUCCESS != cw_gen_enqueue_representation_no_ics(gen, representation)) {
+		return CW_FAILURE;
+	}
+
+	/* No inter-character-space here. */
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
+
+   After enqueueing last Mark (Dot or Dash) comprising a character, an
+   inter-mark-space is enqueued. Inter-character-space is enqueued after that
+   last inter-mark-space. The inter-character-space is not added if @p
+   character is a ' ' character (i.e. inter-word-space).
+
+   _valid_character_ in function's name means that the function expects the
+   character @p character to be valid (@p character should be validated by
+   caller before passing it to the function).
+
+   @exception ENOENT @p character is not a valid character.
+
+   @reviewed 2023-08-26
+
+   @param[in] gen generator to be used to enqueue character
+   @param[in] character character to enqueue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_valid_character_internal(cw_gen_t * gen, char character)
+{
+	if (NULL == gen) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "no generator available");
+		return CW_FAILURE;
+	}
+
+	if (' ' != character && cw_gen_has_tone_program_internal(gen, character)) {
+		return cw_gen_enqueue_tone_program_internal(gen, character, true);
+	}
+
+	/* Marks and spaces of the character, together with
+	   inter-character-space, are added to tone queue at once. */
+	cw_gen_enqueue_batch_begin_internal(gen);
+
+	/* This function is adding 1 Unit of inter-mark-space at the end. */
+	cw_ret_t cwret = cw_gen_enqueue_valid_character_no_ics_internal(gen, character);
+
+	/*
+	  In the context of this function adding ics after freshly enqueued
+	  iws would not be valid: iws should not be followed by ics.
+	  Therefore don't call cw_gen_enqueue_ics_internal() for ' '
+	  character.
+	*/
+	if (CW_SUCCESS == cwret && ' ' != character) {
+		/* This function will add enough units to form a full 3-Unit
+		   inter-character-space. */
+		cwret = cw_gen_enqueue_ics_internal(gen);
+	}
+
+	return cw_gen_enqueue_batch_end_internal(gen, cwret);
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_character(cw_gen_t * gen, char character)
+{
+	if (!cw_character_is_valid(character)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	/* This function adds inter-character-space at the end of character. */
+	if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, character)) {
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_character_no_ics(cw_gen_t * gen, char character)
+{
+	if (!cw_character_is_valid(character)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	/* This function doesn't add inter-character-space at the end of character. */
+	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string)
+{
+	return cw_gen_enqueue_string_internal(gen, string, NULL, false);
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_at(cw_gen_t * gen, const struct timeval * timestamp, const char * string)
+{
+	if (NULL == gen || NULL == timestamp) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_gen_enqueue_string_internal(gen, string, timestamp, false);
+}
+
+
+
+
+/**
+   @brief Enqueue a string, optionally preceded by silence lasting until given time
+
+   @exception ENOENT @p string is invalid
+   @exception EINVAL @p start is in the past or too far in the future
+   @exception EBUSY start of another string is already scheduled
+
+   @param[in] gen generator to use
+   @param[in] string string to enqueue
+   @param[in] start time at which first Mark of the string should be played, or NULL
+   @param[in] mark whether to mark last tone of the string (see cw_tone_t::is_mark)
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_string_internal(cw_gen_t * gen, const char * string, const struct timeval * start, bool mark)
+{
+	if (NULL == string) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	/* Short strings don't need allocation. */
+	uint8_t local_translated[CW_GEN_TRANSLATED_STRING_LOCAL_CAPACITY];
+	uint8_t * translated = local_translated;
+	const size_t len = strlen(string);
+	if (len > CW_GEN_TRANSLATED_STRING_LOCAL_CAPACITY) {
+		translated = (uint8_t *) malloc(len);
+		if (NULL == translated) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to allocate %zu bytes", len);
+			return CW_FAILURE;
+		}
+	}
+
+	/* Check that the string is composed of valid characters, and
+	   translate the characters in the same pass. */
+	size_t n_translated = 0;
+	cw_ret_t cwret = cw_translate_string(string, translated, len, &n_translated);
+	if (CW_SUCCESS != cwret) {
+		errno = ENOENT;
+	} else {
+		if (NULL != start) {
+			cwret = cw_gen_enqueue_scheduled_silence_internal(gen, start);
+		}
+		if (CW_SUCCESS == cwret) {
+			cwret = cw_gen_enqueue_translated_string_internal(gen, translated, n_translated, mark);
+		}
+	}
+
+	if (translated != local_translated) {
+		free(translated);
+	}
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Enqueue silence that lasts until given time
+
+   Duration of the silence is calculated by generator when the silence
+   is dequeued, from the time at which the silence will be played. At
+   the time of enqueueing the duration is only estimated (for
+   cw_gen_get_queue_duration() and similar functions).
+
+   @exception EINVAL @p start is in the past or too far in the future
+   @exception EBUSY start of another string is already scheduled
+
+   @param[in] gen generator to use
+   @param[in] start time at which the silence should end
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_scheduled_silence_internal(cw_gen_t * gen, const struct timeval * start)
+{
+	struct timeval now = { 0 };
+	if (CW_SUCCESS != cw_gen_get_timestamp(gen, &now)) {
+		return CW_FAILURE;
+	}
+	const int64_t start_usecs = (int64_t) start->tv_sec * CW_USECS_PER_SEC + start->tv_usec;
+	const int64_t estimate = start_usecs - ((int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec);
+	if (estimate <= 0 || estimate > INT_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	int64_t expected = 0;
+	if (!__atomic_compare_exchange_n(&gen->scheduled_start, &expected, start_usecs, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 0, (int) estimate, CW_SLOPE_MODE_NO_SLOPES);
+	tone.is_scheduled = true;
+	if (CW_SUCCESS != cw_tq_enqueue_internal(gen->tq, &tone)) {
+		__atomic_store_n(&gen->scheduled_start, 0, __ATOMIC_SEQ_CST);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_translated_string(cw_gen_t * gen, const uint8_t * translated, size_t n_translated)
+{
+	return cw_gen_enqueue_translated_string_internal(gen, translated, n_translated, false);
+}
+
+
+
+
+/**
+   @brief Enqueue a translated string, optionally marking its last tone
+
+   See cw_gen_enqueue_translated_string(). If @p mark is true, last
+   tone of the string is marked with cw_tone_t::is_mark, and
+   gen->enqueue_batch.marked tells if the tone has been enqueued (a
+   string may have no tones).
+
+   @param[in] gen generator to use
+   @param[in] translated characters translated with cw_translate_string()
+   @param[in] n_translated count of characters in @p translated
+   @param[in] mark whether to mark last tone of the string
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_enqueue_translated_string_internal(cw_gen_t * gen, const uint8_t * translated, size_t n_translated, bool mark)
+{
+	if (NULL == gen || (NULL == translated && n_translated > 0)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Check all values before enqueueing anything. */
+	for (size_t i = 0; i < n_translated; i++) {
+		if (CW_TRANSLATED_SPACE != translated[i]
+		    && 0 == cw_representation_hash_to_character_internal(translated[i])) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+	}
+
+	/* Send every character in the string. */
+	for (size_t i = 0; i < n_translated; i++) {
+		/* Look up a character with the same representation: its tone
+		   program is ready to be copied. */
+		const char character = CW_TRANSLATED_SPACE == translated[i]
+			? ' '
+			: (char) cw_representation_hash_to_character_internal(translated[i]);
+
+		/* This function adds inter-character-space at the end of character. */
+		gen->enqueue_batch.mark = mark && i == n_translated - 1;
+		const cw_ret_t cwret = cw_gen_enqueue_valid_character_internal(gen, character);
+		gen->enqueue_batch.mark = false;
+		if (CW_SUCCESS != cwret) {
+			return CW_FAILURE;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_string_with_token(cw_gen_t * gen, const char * string, uint64_t * token)
+{
+	if (NULL == gen || NULL == token) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Token is added to pending tokens before the marked tone can
+	   be played. Other strings with tokens, flushing and removing
+	   characters wait until the string is enqueued. */
+	pthread_mutex_lock(&gen->tokens.enqueue_mutex);
+
+	uint64_t new_token = 0;
+	if (CW_SUCCESS != cw_gen_tokens_push_internal(gen, &new_token)) {
+		pthread_mutex_unlock(&gen->tokens.enqueue_mutex);
+		return CW_FAILURE;
+	}
+
+	gen->enqueue_batch.marked = false;
+	const cw_ret_t cwret = cw_gen_enqueue_string_internal(gen, string, NULL, true);
+
+	uint64_t first = 0;
+	uint64_t last = 0;
+	if (CW_SUCCESS != cwret) {
+		/* Mark of the token is not in tone queue. */
+		cw_gen_tokens_drop_newest_internal(gen);
+	} else if (!gen->enqueue_batch.marked) {
+		/* There is no tone to wait for, complete the token
+		   right after tokens before it. */
+		cw_gen_tokens_update_internal(gen, false, 1, false, &first, &last);
+	}
+
+	pthread_mutex_unlock(&gen->tokens.enqueue_mutex);
+
+	cw_gen_tokens_notify_internal(gen, first, last);
+
+	if (CW_SUCCESS == cwret) {
+		*token = new_token;
+	}
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Issue a new token and add it to generator's pending tokens
+
+   Call with gen->tokens.enqueue_mutex locked.
+
+   @exception ENOMEM failed to grow ring of pending tokens
+
+   @param[in] gen generator
+   @param[out] token new token
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_tokens_push_internal(cw_gen_t * gen, uint64_t * token)
+{
+	pthread_mutex_lock(&gen->tokens.mutex);
+
+	const size_t n_pending = gen->tokens.tail - gen->tokens.head;
+	if (n_pending == gen->tokens.n_slots) {
+		const size_t n_slots = 0 == gen->tokens.n_slots ? CW_GEN_TOKENS_INITIAL_N_SLOTS : 2 * gen->tokens.n_slots;
+		cw_gen_pending_token_t * pending = (cw_gen_pending_token_t *) malloc(n_slots * sizeof (cw_gen_pending_token_t));
+		if (NULL == pending) {
+			pthread_mutex_unlock(&gen->tokens.mutex);
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to allocate %zu pending tokens", n_slots);
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		for (size_t i = 0; i < n_pending; i++) {
+			pending[i] = gen->tokens.pending[(gen->tokens.head + i) & (gen->tokens.n_slots - 1)];
+		}
+		free(gen->tokens.pending);
+		gen->tokens.pending = pending;
+		gen->tokens.n_slots = n_slots;
+		gen->tokens.head = 0;
+		gen->tokens.tail = n_pending;
+	}
+
+	cw_gen_pending_token_t * entry = &gen->tokens.pending[gen->tokens.tail & (gen->tokens.n_slots - 1)];
+	entry->token = ++gen->tokens.last_issued;
+	entry->is_orphan = false;
+	gen->tokens.tail++;
+	*token = entry->token;
+
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Withdraw token added with cw_gen_tokens_push_internal()
+
+   Used when the token's string has not been enqueued. Call with
+   gen->tokens.enqueue_mutex locked, so that the token is the newest
+   one.
+
+   @param[in] gen generator
+*/
+static void cw_gen_tokens_drop_newest_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->tokens.mutex);
+	gen->tokens.tail--;
+	gen->tokens.last_issued--;
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Update generator's pending tokens after change of marks in tone queue
+
+   Range of tokens completed by the update is returned through @p
+   first and @p last, pass it to cw_gen_tokens_notify_internal() after
+   unlocking gen->tokens.enqueue_mutex. If no token has been completed,
+   @p first is larger than @p last.
+
+   @param[in] gen generator
+   @param[in] played generator has played a marked tone
+   @param[in] n_orphaned count of marks removed from end of tone queue
+   @param[in] flushed tone queue has been flushed
+   @param[out] first first completed token
+   @param[out] last last completed token
+*/
+static void cw_gen_tokens_update_internal(cw_gen_t * gen, bool played, size_t n_orphaned, bool flushed, uint64_t * first, uint64_t * last)
+{
+	pthread_mutex_lock(&gen->tokens.mutex);
+
+	const size_t mask = gen->tokens.n_slots - 1;
+	uint64_t completed = gen->tokens.last_completed;
+
+	/* Marks removed from tone queue are the newest ones. */
+	for (size_t i = gen->tokens.tail; i != gen->tokens.head && n_orphaned > 0; i--) {
+		cw_gen_pending_token_t * entry = &gen->tokens.pending[(i - 1) & mask];
+		if (!entry->is_orphan) {
+			entry->is_orphan = true;
+			n_orphaned--;
+		}
+	}
+
+	if (flushed) {
+		gen->tokens.head = gen->tokens.tail;
+		completed = gen->tokens.last_issued;
+	} else if (played && gen->tokens.head != gen->tokens.tail) {
+		completed = gen->tokens.pending[gen->tokens.head & mask].token;
+		gen->tokens.head++;
+	}
+
+	/* Orphan doesn't wait for anything but tokens before it. */
+	while (gen->tokens.head != gen->tokens.tail && gen->tokens.pending[gen->tokens.head & mask].is_orphan) {
+		completed = gen->tokens.pending[gen->tokens.head & mask].token;
+		gen->tokens.head++;
+	}
+
+	*first = gen->tokens.last_completed + 1;
+	*last = completed;
+	if (completed != gen->tokens.last_completed) {
+		__atomic_store_n(&gen->tokens.last_completed, completed, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&gen->tokens.cond);
+	}
+
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Call client's callback for completed tokens
+
+   @param[in] gen generator
+   @param[in] first first completed token
+   @param[in] last last completed token
+*/
+static void cw_gen_tokens_notify_internal(cw_gen_t * gen, uint64_t first, uint64_t last)
+{
+	if (0 == first || first > last) {
+		return;
+	}
+
+	pthread_mutex_lock(&gen->tokens.mutex);
+	const cw_gen_token_callback_t callback = gen->tokens.callback;
+	void * callback_arg = gen->tokens.callback_arg;
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
+	if (NULL != callback) {
+		for (uint64_t token = first; token <= last; token++) {
+			callback(callback_arg, token);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Complete the oldest pending token after its marked tone has been played
+
+   Called by generator's thread.
+
+   @param[in] gen generator
+*/
+static void cw_gen_tokens_mark_played_internal(cw_gen_t * gen)
+{
+	uint64_t first = 0;
+	uint64_t last = 0;
+	cw_gen_tokens_update_internal(gen, true, 0, false, &first, &last);
+	cw_gen_tokens_notify_internal(gen, first, last);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_utf8_string(cw_gen_t * gen, const cw_alphabet_t * alphabet, const char * string)
+{
+	if (NULL == gen || NULL == alphabet || NULL == string) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Check that the string is composed of valid characters. */
+	for (size_t i = 0; string[i] != '\0'; ) {
+		uint32_t code_point = 0;
+		const size_t n_bytes = cw_utf8_decode_internal(&string[i], &code_point);
+		if (0 == n_bytes) {
+			errno = EILSEQ;
+			return CW_FAILURE;
+		}
+		if (' ' != code_point && NULL == cw_alphabet_code_point_to_representation(alphabet, code_point)) {
+			errno = ENOENT;
+			return CW_FAILURE;
+		}
+		i += n_bytes;
+	}
+
+	/* Send every character in the string. */
+	for (size_t i = 0; string[i] != '\0'; ) {
+		uint32_t code_point = 0;
+		i += cw_utf8_decode_internal(&string[i], &code_point);
+
+		cw_ret_t cwret = CW_FAILURE;
+		const char * representation = cw_alphabet_lookup_internal(alphabet, code_point);
+		if (NULL != representation) {
+			/* This function adds inter-character-space at the end of representation. */
+			cwret = cw_gen_enqueue_representation(gen, representation);
+		} else {
+			/* ASCII character of main table, or ' '. This
+			   function adds inter-character-space at the end of
+			   character. */
+			cwret = cw_gen_enqueue_valid_character_internal(gen, (char) code_point);
+		}
+		if (CW_SUCCESS != cwret) {
+			return CW_FAILURE;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_priority_string(cw_gen_t * gen, const char * string)
+{
+	if (NULL == gen || NULL == string) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Check that the string is composed of valid characters. */
+	if (!cw_string_is_valid(string)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	/* Priority characters are played between characters of the main
+	   queue, i.e. after an inter-character-space. Spaces enqueued
+	   here must not affect the next character enqueued in the main
+	   queue. */
+	const int space_units_count = gen->space_units_count;
+	gen->space_units_count = UNITS_PER_ICS;
+	gen->enqueue_batch.priority = true;
+
+	cw_ret_t cwret = CW_SUCCESS;
+	for (int i = 0; string[i] != '\0'; i++) {
+		/* This function adds inter-character-space at the end of
+		   character. Tones of each character are enqueued at once,
+		   so generator never plays a part of priority character. */
+		cwret = cw_gen_enqueue_valid_character_internal(gen, string[i]);
+		if (CW_SUCCESS != cwret) {
+			break;
+		}
+	}
+
+	gen->enqueue_batch.priority = false;
+	gen->space_units_count = space_units_count;
+
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_tones(cw_gen_t * gen, const cw_gen_tone_t * tones, size_t n_tones)
+{
+	if (NULL == gen || (NULL == tones && n_tones > 0)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (0 == n_tones) {
+		return CW_SUCCESS;
+	}
+
+	/* Small sets of tones don't need allocation. */
+	cw_tone_t local_tones[CW_GEN_ENQUEUE_BATCH_CAPACITY];
+	cw_tone_t * queue_tones = local_tones;
+	if (n_tones > CW_GEN_ENQUEUE_BATCH_CAPACITY) {
+		queue_tones = (cw_tone_t *) malloc(n_tones * sizeof (cw_tone_t));
+		if (NULL == queue_tones) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to allocate %zu tones", n_tones);
+			return CW_FAILURE;
+		}
+	}
+
+	bool has_mark = false;
+	for (size_t i = 0; i < n_tones; i++) {
+		CW_TONE_INIT(&queue_tones[i], tones[i].frequency, tones[i].duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		has_mark = has_mark || tones[i].frequency > 0;
+	}
+
+	const cw_ret_t cwret = cw_tq_enqueue_batch_internal(gen->tq, queue_tones, n_tones);
+	if (CW_SUCCESS == cwret && has_mark) {
+		/* Enqueueing a mark must reset counter of spaces. See
+		   also cw_queue_tone(). */
+		gen->space_units_count = 0;
+	}
+
+	if (queue_tones != local_tones) {
+		free(queue_tones);
+	}
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Reset generator's essential parameters to their initial values
+
+   You need to call cw_gen_sync_parameters_internal() after call to this function.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator for which to reset parameters
+*/
+void cw_gen_reset_parameters_internal(cw_gen_t * gen)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+
+	gen->send_speed = CW_SPEED_INITIAL;
+	gen->frequency = CW_FREQUENCY_INITIAL;
+	gen->volume_percent = CW_VOLUME_INITIAL;
+	gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
+	gen->gap = CW_GAP_INITIAL;
+	gen->weighting = CW_WEIGHTING_INITIAL;
+
+	gen->parameters_in_sync = false;
+
+	return;
+
+}
+
+
+
+
+/**
+   @brief Calculate durations of Marks and Spaces for given parameters
+
+   @param[in] speed sending speed [wpm]
+   @param[in] weighting weighting
+   @param[in] gap extra gap between characters [Units]
+   @param[out] durations calculated durations
+*/
+void cw_gen_calculate_durations_internal(int speed, int weighting, int gap, cw_gen_durations_t * durations)
+{
+	cw_gen_calculate_unit_durations_internal(CW_DOT_CALIBRATION / speed, weighting, gap, durations);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate durations of Marks and Spaces for given duration of Unit
+
+   @param[in] unit_duration duration of Unit, derived from sending speed [us]
+   @param[in] weighting weighting
+   @param[in] gap extra gap between characters [Units]
+   @param[out] durations calculated durations
+*/
+void cw_gen_calculate_unit_durations_internal(int unit_duration, int weighting, int gap, cw_gen_durations_t * durations)
+{
+	/*
+	  Set the length of a Dot to be a Unit with any weighting
+	  adjustment, and the length of a Dash as three Dot lengths.
+	  The weighting adjustment is by adding or subtracting a
+	  length based on 50 % as a neutral weighting.
+	*/
+	durations->unit_duration = unit_duration;
+	const int weighting_duration = (2 * (weighting - 50) * durations->unit_duration) / 100;
+	durations->dot_duration = durations->unit_duration + weighting_duration;
+	durations->dash_duration = 3 * durations->dot_duration;
+
+	/*
+	  The duration of inter-mark-space is adjusted by 28/22 times
+	  weighting length to keep PARIS calibration correctly
+	  timed (PARIS has 22 full units, and 28 empty ones).
+	  Inter-mark-space and inter-character-space take
+	  weightings into account.
+	*/
+	const int w = (28 * weighting_duration) / 22;
+
+	durations->ims_duration = UNITS_PER_IMS * durations->unit_duration - w;
+	durations->ics_duration = UNITS_PER_ICS * durations->unit_duration + w;
+	durations->iws_duration = UNITS_PER_IWS * durations->unit_duration - w;
+	durations->additional_space_duration = gap * durations->unit_duration;
+
+	/* For "Farnsworth", there also needs to be an adjustment
+	   delay added to the end of words, otherwise the rhythm is
+	   lost on word end.
+	   I don't know if there is an "official" value for this,
+	   but 2.33 or so times the gap is the correctly scaled
+	   value, and seems to sound okay.
+
+	   Thanks to Michael D. Ivey <ivey@gweezlebur.com> for
+	   identifying this in earlier versions of libcw. */
+	durations->adjustment_space_duration = (7 * durations->additional_space_duration) / 3;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Synchronize generator's low level timing parameters
+
+   @reviewedon 2023-08-26
+
+   @param[in] gen generator for which to synchronize parameters
+*/
+void cw_gen_sync_parameters_internal(cw_gen_t * gen)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+
+	/* Parameters set with cw_gen_set_parameters() take effect from
+	   here on. */
+	cw_gen_apply_pending_parameters_internal(gen, false);
+
+	/* Do nothing if we are already synchronized. */
+	if (gen->parameters_in_sync) {
+		return;
+	}
+
+	/* Durations are shared with other generators and receivers
+	   with the same parameters. Old block is released only after
+	   new one is taken, so that a block used again is not
+	   recalculated. */
+	cw_timing_key_t key;
+	cw_timing_key_init_internal(&key, CW_DOT_CALIBRATION / gen->send_speed, gen->gap);
+	key.weighting = gen->weighting;
+	const cw_timing_t * timing = cw_timing_acquire_internal(&key);
+	cw_timing_release_internal(&gen->timing);
+	if (NULL != timing) {
+		gen->timing = timing;
+		gen->durations = &timing->gen_durations;
+	} else {
+		cw_gen_calculate_durations_internal(gen->send_speed, gen->weighting, gen->gap, &gen->own_durations);
+		gen->durations = &gen->own_durations;
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_INFO,
+		      MSG_PREFIX "'%s': gen durations [us] at speed %d [wpm]:\n"
+		      "[II] " MSG_PREFIX "    dot: %11d\n"
+		      "[II] " MSG_PREFIX "   dash: %11d\n"
+		      "[II] " MSG_PREFIX "    ims: %11d\n"
+		      "[II] " MSG_PREFIX "    ics: %11d\n"
+		      "[II] " MSG_PREFIX "    iws: %11d\n"
+		      "[II] " MSG_PREFIX "   adsd: %11d\n"
+		      "[II] " MSG_PREFIX "   ajsd: %11d",
+
+		      gen->label,
+		      gen->send_speed,
+		      gen->durations->dot_duration,
+		      gen->durations->dash_duration,
+		      gen->durations->ims_duration,
+		      gen->durations->ics_duration,
+		      gen->durations->iws_duration,
+		      gen->durations->additional_space_duration,
+		      gen->durations->adjustment_space_duration);
+
+	/* Durations of tones have changed, cached tones will be
+	   useless. */
+	cw_gen_tone_cache_invalidate_internal(gen);
+
+	/* Tone programs of characters must be rebuilt with new durations. */
+	cw_gen_sync_tone_programs_internal(gen);
+
+	/* Generator parameters are now in sync. */
+	gen->parameters_in_sync = true;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Enqueue beginning of mark from straight key
+
+   Helper function intended to hide from keying module the details of tone
+   queue and of enqueueing a tone.
+
+   Call this function from straight key code only (see "sk" in function's
+   name). The function should be called only on "key down" (begin mark) event
+   from hardware straight key.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_sk_begin_mark_internal(cw_gen_t * gen)
+{
+	/* In case of straight key we don't know at all how long the
+	   tone should be (we don't know for how long the straight key
+	   will be closed).
+
+	   Let's enqueue a beginning of mark (rising slope) +
+	   "forever" (constant) tone. The constant tone will be generated
+	   until key goes into CW_KEY_VALUE_OPEN state. */
+
+
+	cw_gen_sidetone_request_cut_internal(gen);
+	cw_gen_adaptive_period_keying_internal(gen);
+
+
+	/* Enqueue rising slope */
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, gen->frequency, gen->tone_slope.duration, CW_SLOPE_MODE_RISING_SLOPE);
+	cw_ret_t cwret = cw_tq_enqueue_internal(gen->tq, &tone);
+	/* Enqueueing a mark, so reset counter of enqueued space units. */
+	gen->space_units_count = 0;
+	if (cwret != CW_SUCCESS) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "enqueue begin mark: failed to enqueue rising slope: '%s'", strerror(errno));
+		/* TODO: what do we do with this error now? The cwret
+		   variable will be overwritten below. */
+	}
+
+
+	/* Enqueue plateau - forever tone. */
+
+	/* If there was an error during enqueue of rising slope of
+	   mark, assume that it was a transient error, and proceed to
+	   enqueueing forever tone. Only after we fail to enqueue the
+	   "main" tone, we are allowed to return failure to caller. */
+	CW_TONE_INIT(&tone, gen->frequency, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
+	tone.is_forever = true;
+	cwret = cw_tq_enqueue_internal(gen->tq, &tone);
+	/* Enqueueing a mark, so reset counter of enqueued space units. */
+	gen->space_units_count = 0;
+	if (cwret != CW_SUCCESS) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "enqueue begin mark: failed to enqueue forever tone: '%s'", strerror(errno));
+	}
+
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "enqueue begin mark: tone queue len = %zu", cw_tq_length_internal(gen->tq));
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Enqueue beginning of space from straight key
+
+   Helper function intended to hide from keying module the details of tone
+   queue and of enqueueing a tone.
+
+   Call this function from straight key code only (see "sk" in function's
+   name). The function should be called only on "key up" (begin space) event
+   from hardware straight key.
+
+   @internal
+   @reviewed 2020-08-06
+   @endinternal
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_gen_enqueue_sk_begin_space_internal(cw_gen_t * gen)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	cw_gen_adaptive_period_keying_internal(gen);
+
+	if (gen->sound_system == CW_AUDIO_CONSOLE) {
+		/* FIXME: I think that enqueueing tone is not just a
+		   matter of generating it using generator, but also a
+		   matter of timing events using generator. Enqueueing
+		   tone here and dequeueing it later will be used to
+		   control state of a key. How does enqueueing a
+		   quantum tone influences the key state? */
+
+
+		/* Generate just a bit of silence, just to switch
+		   buzzer from generating a sound to being silent. */
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
+		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
+	} else {
+		/* For soundcards a falling slope with volume from max
+		   to zero should be enough, but... */
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, gen->frequency, gen->tone_slope.duration, CW_SLOPE_MODE_FALLING_SLOPE);
+		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
+		if (CW_SUCCESS == cwret) {
+			/* ... but on some occasions, on some
+			   platforms, some sound systems may need to
+			   constantly generate "silent" tone. These four
+			   lines of code are just for them.
 
-	   TODO: do the check the proper way.
-	   TODO: wrap this check into a function and reuse it in cw_gen_enqueue_representation()
-	*/
-	if (cw_tq_length_internal(gen->tq) >= gen->tq->high_water_mark) {
-		errno = EAGAIN;
-		return CW_FAILURE;
-	}
+			   FIXME: what occasions? what platforms? what sound systems?
 
-	/* Enqueue the marks. Every mark is followed by inter-mark-space. */
-	for (int i = 0; representation[i] != '\0'; i++) {
-		const bool is_first = i == 0;
-		if (CW_SUCCESS != cw_gen_enqueue_mark_internal(gen, representation[i], is_first)) {
-			return CW_FAILURE;
+			   It would be better to avoid queueing silent
+			   "forever" tone because this increases CPU
+			   usage. It would be better to simply not to
+			   queue any new tones after "falling slope"
+			   tone. Silence after the last falling slope
+			   would simply last on itself until there is
+			   new tone in queue to dequeue. */
+			CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
+			tone.is_forever = true;
+			cwret = cw_tq_enqueue_internal(gen->tq, &tone);
 		}
 	}
 
-	/* No inter-character-space added here. */
+	/* The function enqueues 'space', this 'space' means just 'silence'.
+	   Reset space unit counts because no meaningful 'space units' have been
+	   enqueued. */
+	gen->space_units_count = 0;
 
-	return CW_SUCCESS;
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
+   @brief Enqueue an element (Dot or Dash, followed by ims) from iambic keyer
 
-   _valid_character_ in function's name means that the function expects the
-   character @p character to be valid (@p character should be validated by
-   caller before passing it to the function).
+   Helper function intended to hide from keying module the details of tone
+   queue and of enqueueing a tone.
 
-   no_ics in function's name means that the inter-character-space is not
-   appended at the end of Marks and Spaces enqueued in generator (but the
-   last inter-mark-space is).
+   Call this function from iambic keyer code only (see "ik" in function's
+   name). The function should be called on hardware key events only. Since we
+   enqueue symbols, we know that they have limited, specified
+   length. This means that the function should be called for events
+   from iambic keyer.
 
-   @exception ENOENT @p character is not a valid character.
+   Mark and ims following it are enqueued together, so that generator
+   doesn't have to wait for the keyer between the two.
+
+   Element enqueued @p in_advance (while previous element is still
+   being played) doesn't discard silence of sidetone (see
+   cw_gen_config_t::sidetone_low_latency): the silence is ims of
+   previous element. Call cw_gen_commit_ik_element_internal() when
+   keyer actually starts such element, or
+   cw_gen_cancel_ik_element_internal() to remove it from queue.
 
    @internal
    @reviewed 2020-08-06
    @endinternal
 
-   @param[in] gen generator to be used to enqueue character
-   @param[in] character character to enqueue
+   @param[in] gen generator
+   @param[in] symbol symbol of Mark to enqueue (Dot/Dash)
+   @param[in] in_advance whether the element is enqueued before keyer starts it
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
 */
-cw_ret_t cw_gen_enqueue_valid_character_no_ics_internal(cw_gen_t * gen, char character)
+cw_ret_t cw_gen_enqueue_ik_element_internal(cw_gen_t * gen, char symbol, bool in_advance)
 {
-	if (NULL == gen) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
-			      MSG_PREFIX "no generator available");
-		return CW_FAILURE;
-	}
-
-	/* ' ' character (i.e. inter-word-space) is a special case. */
-	if (character == ' ') {
-		return cw_gen_enqueue_iws_internal(gen);
-	}
-
-	const char * representation = cw_character_to_representation_internal(character);
+	cw_tone_t tones[2] = { { 0 }, { 0 } };
 
-	/* This shouldn't happen since we are in _valid_character_ function... */
-	cw_assert (NULL != representation, MSG_PREFIX "failed to find representation for character '%c'/%hhx", character, character);
+	cw_gen_adaptive_period_keying_internal(gen);
 
-	/* ... but fail gracefully anyway. */
-	if (NULL == representation) {
-		errno = ENOENT;
+	switch (symbol) {
+	case CW_DOT_REPRESENTATION:
+		CW_TONE_INIT(&tones[0], gen->frequency, gen->durations->dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		break;
+	case CW_DASH_REPRESENTATION:
+		CW_TONE_INIT(&tones[0], gen->frequency, gen->durations->dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
+		break;
+	default:
+		cw_assert (0, MSG_PREFIX "unknown iambic keyer symbol '%d'", symbol);
+		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	CW_TONE_INIT(&tones[1], 0, gen->durations->ims_duration, CW_SLOPE_MODE_NO_SLOPES);
 
-	if (CW_SUCCESS != cw_gen_enqueue_representation_no_ics(gen, representation)) {
-		return CW_FAILURE;
+	if (!in_advance) {
+		cw_gen_sidetone_request_cut_internal(gen);
 	}
 
-	/* No inter-character-space here. */
-
-	return CW_SUCCESS;
+	const cw_ret_t cwret = cw_tq_enqueue_batch_internal(gen->tq, tones, 2);
+	/* Element ends with ims. Record this fact in space units
+	   counter. */
+	gen->space_units_count = UNITS_PER_IMS;
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Enqueue a given valid ASCII character in generator, to be sent using Morse code
+   @brief Start element that has been enqueued by iambic keyer in advance
 
-   After enqueueing last Mark (Dot or Dash) comprising a character, an
-   inter-mark-space is enqueued. Inter-character-space is enqueued after that
-   last inter-mark-space. The inter-character-space is not added if @p
-   character is a ' ' character (i.e. inter-word-space).
+   See cw_gen_enqueue_ik_element_internal().
 
-   _valid_character_ in function's name means that the function expects the
-   character @p character to be valid (@p character should be validated by
-   caller before passing it to the function).
+   @param[in] gen generator
+*/
+void cw_gen_commit_ik_element_internal(cw_gen_t * gen)
+{
+	cw_gen_sidetone_request_cut_internal(gen);
+	return;
+}
 
-   @exception ENOENT @p character is not a valid character.
 
-   @reviewed 2023-08-26
 
-   @param[in] gen generator to be used to enqueue character
-   @param[in] character character to enqueue
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
+/**
+   @brief Remove from queue element that has been enqueued by iambic keyer in advance
+
+   See cw_gen_enqueue_ik_element_internal(). The element is removed
+   only if none of its tones has been dequeued yet.
+
+   @param[in] gen generator
+
+   @return CW_SUCCESS if the element has been removed
+   @return CW_FAILURE otherwise
 */
-cw_ret_t cw_gen_enqueue_valid_character_internal(cw_gen_t * gen, char character)
+cw_ret_t cw_gen_cancel_ik_element_internal(cw_gen_t * gen)
 {
-	/* This function is adding 1 Unit of inter-mark-space at the end. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
-		return CW_FAILURE;
-	}
-
-	if (' ' == character) {
-		/*
-		  In the context of this function adding ics after freshly enqueued
-		  iws would not be valid: iws should not be followed by ics.
-		  Therefore don't call cw_gen_enqueue_ics_internal(). Just return
-		  now.
+	return cw_tq_remove_last_tones_internal(gen->tq, 2);
+}
 
-		  Since cw_gen_enqueue_valid_character_no_ics_internal() called above
-		  has succeeded, return the success here.
-		*/
-		return CW_SUCCESS;
-	}
 
-	/* This function will add enough units to form a full 3-Unit
-	   inter-character-space. */
-	if (CW_SUCCESS != cw_gen_enqueue_ics_internal(gen)) {
-		return CW_FAILURE;
-	}
 
-	return CW_SUCCESS;
-}
 
+/**
+   @brief Ask generator's thread to cut silence played after previous Mark
 
+   Call this function when a key goes down, before enqueueing the new
+   Mark. Does nothing if low-latency sidetone has not been requested
+   in generator's configuration.
 
+   The request is served by cw_gen_write_to_soundcard_internal() if it is
+   writing silent 'forever' tone. A generator waiting in non-blocking
+   write of silence is woken up, so that it doesn't wait for the silence
+   to be accepted by sound device.
 
-cw_ret_t cw_gen_enqueue_character(cw_gen_t * gen, char character)
+   @param[in] gen generator
+*/
+static void cw_gen_sidetone_request_cut_internal(cw_gen_t * gen)
 {
-	if (!cw_character_is_valid(character)) {
-		errno = ENOENT;
-		return CW_FAILURE;
+	if (!gen->sidetone.enabled) {
+		return;
 	}
 
-	/* This function adds inter-character-space at the end of character. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, character)) {
-		return CW_FAILURE;
+	__atomic_store_n(&gen->sidetone.cut_requested, true, __ATOMIC_SEQ_CST);
+	if (gen->sound_nonblocking) {
+		cw_gen_wakeup_internal(gen);
 	}
 
-	return CW_SUCCESS;
+	return;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_character_no_ics(cw_gen_t * gen, char character)
+/**
+   @brief Discard silence waiting in generator's buffer and in sound device
+
+   Called by generator's thread when it serves a request made with
+   cw_gen_sidetone_request_cut_internal(). Silent samples at the end of
+   generator's buffer are discarded, so that samples of the new Mark
+   are calculated right after the last non-silent sample. If there are
+   no non-silent samples in the buffer, silence written earlier to
+   sound device is discarded as well.
+
+   @param[in] gen generator
+*/
+static void cw_gen_sidetone_cut_internal(cw_gen_t * gen)
 {
-	if (!cw_character_is_valid(character)) {
-		errno = ENOENT;
-		return CW_FAILURE;
+	int64_t n_in_buffer = gen->sidetone.silent_run;
+	if (n_in_buffer > gen->buffer_sub_start) {
+		n_in_buffer = gen->buffer_sub_start;
 	}
+	const int64_t n_in_device = gen->sidetone.silent_run - n_in_buffer;
 
-	/* This function doesn't add inter-character-space at the end of character. */
-	if (CW_SUCCESS != cw_gen_enqueue_valid_character_no_ics_internal(gen, character)) {
-		return CW_FAILURE;
+	gen->buffer_sub_start -= (int) n_in_buffer;
+	gen->buffer_sub_stop = gen->buffer_sub_start;
+
+	cw_ret_t cwret = CW_FAILURE;
+	if (n_in_device > 0 && NULL != gen->drop_silence_from_sound_device) {
+		cwret = gen->drop_silence_from_sound_device(gen, n_in_device);
 	}
 
-	return CW_SUCCESS;
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "sidetone: discarded %"PRId64" silent samples in buffer, %"PRId64" silent samples in device (%s)",
+		      n_in_buffer, n_in_device, CW_SUCCESS == cwret ? "dropped" : "kept");
+
+	/* Whatever is left in sound device, we can't count it as
+	   silence anymore. */
+	gen->sidetone.silent_run = 0;
+
+	return;
 }
 
 
 
 
-cw_ret_t cw_gen_enqueue_string(cw_gen_t * gen, const char * string)
+cw_ret_t cw_gen_wait_for_queue_level(cw_gen_t * gen, size_t level)
 {
-	/* Check that the string is composed of valid characters. */
-	if (!cw_string_is_valid(string)) {
-		errno = ENOENT;
-		return CW_FAILURE;
-	}
+	return cw_tq_wait_for_level_internal(gen->tq, level);
+}
 
-	/* Send every character in the string. */
-	for (int i = 0; string[i] != '\0'; i++) {
-		/* This function adds inter-character-space at the end of character. */
-		if (CW_SUCCESS != cw_gen_enqueue_valid_character_internal(gen, string[i])) {
-			return CW_FAILURE;
-		}
-	}
 
-	return CW_SUCCESS;
-}
 
 
+void cw_gen_flush_queue(cw_gen_t * gen)
+{
+	/* This function locks and unlocks mutex. */
+	cw_gen_flush_tone_queue_internal(gen);
 
+	/* TODO: we probably want to have these two functions
+	   separated. Function called cw_gen_flush_queue() probably shouldn't
+	   also silence generator. */
 
-/**
-   @brief Reset generator's essential parameters to their initial values
+	/* Force silence on the speaker anyway, and stop any background
+	   soundcard tone generation. */
+	cw_gen_silence_internal(gen);
 
-   You need to call cw_gen_sync_parameters_internal() after call to this function.
+	return;
+}
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
 
-   @param[in] gen generator for which to reset parameters
-*/
-void cw_gen_reset_parameters_internal(cw_gen_t * gen)
-{
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
 
-	gen->send_speed = CW_SPEED_INITIAL;
-	gen->frequency = CW_FREQUENCY_INITIAL;
-	gen->volume_percent = CW_VOLUME_INITIAL;
-	gen->volume_abs = (gen->volume_percent * CW_AUDIO_VOLUME_RANGE) / 100;
-	gen->gap = CW_GAP_INITIAL;
-	gen->weighting = CW_WEIGHTING_INITIAL;
 
-	gen->parameters_in_sync = false;
+cw_ret_t cw_gen_remove_last_character(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->tokens.enqueue_mutex);
+	size_t n_marks = 0;
+	const cw_ret_t cwret = cw_tq_remove_last_character_internal(gen->tq, &n_marks);
+	uint64_t first = 0;
+	uint64_t last = 0;
+	if (n_marks > 0) {
+		cw_gen_tokens_update_internal(gen, false, n_marks, false, &first, &last);
+	}
+	pthread_mutex_unlock(&gen->tokens.enqueue_mutex);
 
-	return;
+	cw_gen_tokens_notify_internal(gen, first, last);
 
+	return cwret;
 }
 
 
 
 
 /**
-   @brief Synchronize generator's low level timing parameters
-
-   @reviewedon 2023-08-26
+   @brief Flush generator's tone queue and complete all tokens
 
-   @param[in] gen generator for which to synchronize parameters
+   @param[in] gen generator
 */
-void cw_gen_sync_parameters_internal(cw_gen_t * gen)
+static void cw_gen_flush_tone_queue_internal(cw_gen_t * gen)
 {
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
-
-	/* Do nothing if we are already synchronized. */
-	if (gen->parameters_in_sync) {
-		return;
-	}
+	pthread_mutex_lock(&gen->tokens.enqueue_mutex);
+	cw_tq_flush_internal(gen->tq);
+	__atomic_store_n(&gen->scheduled_start, 0, __ATOMIC_SEQ_CST);
+	uint64_t first = 0;
+	uint64_t last = 0;
+	cw_gen_tokens_update_internal(gen, false, 0, true, &first, &last);
+	pthread_mutex_unlock(&gen->tokens.enqueue_mutex);
 
-	/*
-	  Set the length of a Dot to be a Unit with any weighting
-	  adjustment, and the length of a Dash as three Dot lengths.
-	  The weighting adjustment is by adding or subtracting a
-	  length based on 50 % as a neutral weighting.
-	*/
-	gen->durations.unit_duration = CW_DOT_CALIBRATION / gen->send_speed;
-	const int weighting_duration = (2 * (gen->weighting - 50) * gen->durations.unit_duration) / 100;
-	gen->durations.dot_duration = gen->durations.unit_duration + weighting_duration;
-	gen->durations.dash_duration = 3 * gen->durations.dot_duration;
+	cw_gen_tokens_notify_internal(gen, first, last);
 
-	/*
-	  The duration of inter-mark-space is adjusted by 28/22 times
-	  weighting length to keep PARIS calibration correctly
-	  timed (PARIS has 22 full units, and 28 empty ones).
-	  Inter-mark-space and inter-character-space take
-	  weightings into account.
-	*/
-	const int w = (28 * weighting_duration) / 22;
+	return;
+}
 
-	gen->durations.ims_duration = UNITS_PER_IMS * gen->durations.unit_duration - w;
-	gen->durations.ics_duration = UNITS_PER_ICS * gen->durations.unit_duration + w;
-	gen->durations.iws_duration = UNITS_PER_IWS * gen->durations.unit_duration - w;
-	gen->durations.additional_space_duration = gen->gap * gen->durations.unit_duration;
 
-	/* For "Farnsworth", there also needs to be an adjustment
-	   delay added to the end of words, otherwise the rhythm is
-	   lost on word end.
-	   I don't know if there is an "official" value for this,
-	   but 2.33 or so times the gap is the correctly scaled
-	   value, and seems to sound okay.
 
-	   Thanks to Michael D. Ivey <ivey@gweezlebur.com> for
-	   identifying this in earlier versions of libcw. */
-	gen->durations.adjustment_space_duration = (7 * gen->durations.additional_space_duration) / 3;
 
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_INFO,
-		      MSG_PREFIX "'%s': gen durations [us] at speed %d [wpm]:\n"
-		      "[II] " MSG_PREFIX "    dot: %11d\n"
-		      "[II] " MSG_PREFIX "   dash: %11d\n"
-		      "[II] " MSG_PREFIX "    ims: %11d\n"
-		      "[II] " MSG_PREFIX "    ics: %11d\n"
-		      "[II] " MSG_PREFIX "    iws: %11d\n"
-		      "[II] " MSG_PREFIX "   adsd: %11d\n"
-		      "[II] " MSG_PREFIX "   ajsd: %11d",
+cw_ret_t cw_gen_get_sound_device(cw_gen_t const * gen, char * buffer, size_t size)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+	snprintf(buffer, size, "%s", gen->picked_device_name);
+	return CW_SUCCESS;
+}
 
-		      gen->label,
-		      gen->send_speed,
-		      gen->durations.dot_duration,
-		      gen->durations.dash_duration,
-		      gen->durations.ims_duration,
-		      gen->durations.ics_duration,
-		      gen->durations.iws_duration,
-		      gen->durations.additional_space_duration,
-		      gen->durations.adjustment_space_duration);
 
-	/* Generator parameters are now in sync. */
-	gen->parameters_in_sync = true;
 
-	return;
+
+int cw_gen_get_sound_system(cw_gen_t const * gen)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
+	return gen->sound_system;
 }
 
 
 
 
-/**
-   @brief Enqueue beginning of mark from straight key
+cw_ret_t cw_gen_get_timestamp(cw_gen_t * gen, struct timeval * timestamp)
+{
+	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
 
-   Helper function intended to hide from keying module the details of tone
-   queue and of enqueueing a tone.
+	if (CW_AUDIO_NULL == gen->sound_system && gen->null_data.virtual_clock) {
+		cw_null_get_timestamp_internal(gen, timestamp);
+		return CW_SUCCESS;
+	}
+	if (0 != gettimeofday(timestamp, NULL)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "get timestamp: gettimeofday(): %s", strerror(errno));
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
 
-   Call this function from straight key code only (see "sk" in function's
-   name). The function should be called only on "key down" (begin mark) event
-   from hardware straight key.
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
 
-   @param[in] gen generator
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
-*/
-cw_ret_t cw_gen_enqueue_sk_begin_mark_internal(cw_gen_t * gen)
+size_t cw_gen_get_queue_length(cw_gen_t const * gen)
 {
-	/* In case of straight key we don't know at all how long the
-	   tone should be (we don't know for how long the straight key
-	   will be closed).
-
-	   Let's enqueue a beginning of mark (rising slope) +
-	   "forever" (constant) tone. The constant tone will be generated
-	   until key goes into CW_KEY_VALUE_OPEN state. */
-
+	return cw_tq_length_internal(gen->tq);
+}
 
-	/* Enqueue rising slope */
 
-	cw_tone_t tone;
-	CW_TONE_INIT(&tone, gen->frequency, gen->tone_slope.duration, CW_SLOPE_MODE_RISING_SLOPE);
-	cw_ret_t cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	/* Enqueueing a mark, so reset counter of enqueued space units. */
-	gen->space_units_count = 0;
-	if (cwret != CW_SUCCESS) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "enqueue begin mark: failed to enqueue rising slope: '%s'", strerror(errno));
-		/* TODO: what do we do with this error now? The cwret
-		   variable will be overwritten below. */
-	}
 
 
-	/* Enqueue plateau - forever tone. */
+size_t cw_gen_get_queue_n_characters(cw_gen_t const * gen)
+{
+	return cw_tq_n_characters_internal(gen->tq);
+}
 
-	/* If there was an error during enqueue of rising slope of
-	   mark, assume that it was a transient error, and proceed to
-	   enqueueing forever tone. Only after we fail to enqueue the
-	   "main" tone, we are allowed to return failure to caller. */
-	CW_TONE_INIT(&tone, gen->frequency, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
-	tone.is_forever = true;
-	cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	/* Enqueueing a mark, so reset counter of enqueued space units. */
-	gen->space_units_count = 0;
-	if (cwret != CW_SUCCESS) {
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "enqueue begin mark: failed to enqueue forever tone: '%s'", strerror(errno));
-	}
 
 
-	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
-		      MSG_PREFIX "enqueue begin mark: tone queue len = %zu", cw_tq_length_internal(gen->tq));
 
-	return cwret;
+uint64_t cw_gen_get_queue_duration(cw_gen_t const * gen)
+{
+	return cw_tq_duration_internal(gen->tq);
 }
 
 
 
 
-/**
-   @brief Enqueue beginning of space from straight key
+cw_ret_t cw_gen_get_end_of_sound_time(cw_gen_t const * gen, struct timeval * timestamp)
+{
+	if (NULL == gen || NULL == timestamp) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-   Helper function intended to hide from keying module the details of tone
-   queue and of enqueueing a tone.
+	const int64_t end = __atomic_load_n(&gen->end_of_sound_time, __ATOMIC_RELAXED);
+	if (end < 0) {
+		errno = ENODATA;
+		return CW_FAILURE;
+	}
+	timestamp->tv_sec = (time_t) (end / CW_USECS_PER_SEC);
+	timestamp->tv_usec = (suseconds_t) (end % CW_USECS_PER_SEC);
 
-   Call this function from straight key code only (see "sk" in function's
-   name). The function should be called only on "key up" (begin space) event
-   from hardware straight key.
+	return CW_SUCCESS;
+}
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
 
-   @param[in] gen generator
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
-*/
-cw_ret_t cw_gen_enqueue_sk_begin_space_internal(cw_gen_t * gen)
+
+cw_ret_t cw_gen_get_sound_latency(cw_gen_t const * gen, int * latency)
 {
-	cw_ret_t cwret = CW_FAILURE;
+	if (NULL == gen || NULL == latency) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-	if (gen->sound_system == CW_AUDIO_CONSOLE) {
-		/* FIXME: I think that enqueueing tone is not just a
-		   matter of generating it using generator, but also a
-		   matter of timing events using generator. Enqueueing
-		   tone here and dequeueing it later will be used to
-		   control state of a key. How does enqueueing a
-		   quantum tone influences the key state? */
+	int buffer_duration = 0;
+	if (gen->buffer_n_samples > 0 && gen->sample_rate > 0) {
+		buffer_duration = (int) (((int64_t) gen->buffer_n_samples * CW_USECS_PER_SEC) / gen->sample_rate);
+	}
+	*latency = buffer_duration + gen->sound_device_latency;
 
+	return CW_SUCCESS;
+}
 
-		/* Generate just a bit of silence, just to switch
-		   buzzer from generating a sound to being silent. */
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
-		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	} else {
-		/* For soundcards a falling slope with volume from max
-		   to zero should be enough, but... */
-		cw_tone_t tone;
-		CW_TONE_INIT(&tone, gen->frequency, gen->tone_slope.duration, CW_SLOPE_MODE_FALLING_SLOPE);
-		cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-		if (CW_SUCCESS == cwret) {
-			/* ... but on some occasions, on some
-			   platforms, some sound systems may need to
-			   constantly generate "silent" tone. These four
-			   lines of code are just for them.
 
-			   FIXME: what occasions? what platforms? what sound systems?
 
-			   It would be better to avoid queueing silent
-			   "forever" tone because this increases CPU
-			   usage. It would be better to simply not to
-			   queue any new tones after "falling slope"
-			   tone. Silence after the last falling slope
-			   would simply last on itself until there is
-			   new tone in queue to dequeue. */
-			CW_TONE_INIT(&tone, 0, gen->quantum_duration, CW_SLOPE_MODE_NO_SLOPES);
-			tone.is_forever = true;
-			cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-		}
+
+cw_ret_t cw_gen_get_sample_format(const cw_gen_t * gen, cw_sample_format_t * sample_format, int * n_channels)
+{
+	if (NULL == gen || NULL == sample_format || NULL == n_channels) {
+		errno = EINVAL;
+		return CW_FAILURE;
 	}
 
-	/* The function enqueues 'space', this 'space' means just 'silence'.
-	   Reset space unit counts because no meaningful 'space units' have been
-	   enqueued. */
-	gen->space_units_count = 0;
+	*sample_format = gen->sample_format;
+	*n_channels = gen->n_channels;
 
-	return cwret;
+	return CW_SUCCESS;
 }
 
 
 
 
-/**
-   @brief Enqueue an element (dot/dash/ims) from iambic keyer
-
-   Helper function intended to hide from keying module the details of tone
-   queue and of enqueueing a tone.
+cw_ret_t cw_gen_get_metrics(cw_gen_t * gen, cw_gen_metrics_t * metrics)
+{
+	if (NULL == gen || NULL == metrics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-   Call this function from iambic keyer code only (see "ik" in function's
-   name). The function should be called on hardware key events only. Since we
-   enqueue symbols, we know that they have limited, specified
-   length. This means that the function should be called for events
-   from iambic keyer.
+	memset(metrics, 0, sizeof (cw_gen_metrics_t));
 
-   @p symbol may be an ims, and the ims will be enqueued. But if the symbol
-   is dot or dash, the function won't append ims after the dot or dash -
-   hence "no_ims" in function's name.
+	metrics->n_buffers_written = __atomic_load_n(&gen->metrics.n_buffers_written, __ATOMIC_RELAXED);
+	metrics->n_underruns = __atomic_load_n(&gen->metrics.n_underruns, __ATOMIC_RELAXED);
+	metrics->n_wakeups = __atomic_load_n(&gen->metrics.n_wakeups, __ATOMIC_RELAXED);
 
-   @internal
-   @reviewed 2020-08-06
-   @endinternal
+	const uint64_t n_timed = __atomic_load_n(&gen->metrics.n_timed_buffers, __ATOMIC_RELAXED);
+	if (n_timed > 0) {
+		metrics->write_time_min = __atomic_load_n(&gen->metrics.write_ns_min, __ATOMIC_RELAXED) / 1000;
+		metrics->write_time_max = __atomic_load_n(&gen->metrics.write_ns_max, __ATOMIC_RELAXED) / 1000;
+		metrics->write_time_avg = __atomic_load_n(&gen->metrics.write_ns_total, __ATOMIC_RELAXED) / n_timed / 1000;
+		metrics->synthesis_time_max = __atomic_load_n(&gen->metrics.synthesis_ns_max, __ATOMIC_RELAXED) / 1000;
+		metrics->synthesis_time_avg = __atomic_load_n(&gen->metrics.synthesis_ns_total, __ATOMIC_RELAXED) / n_timed / 1000;
+	}
 
-   @param[in] gen generator
-   @param[in] symbol symbol to enqueue (Space/Dot/Dash)
+	metrics->queue_length_peak = cw_tq_length_peak_internal(gen->tq);
+	metrics->sample_clock_drift_ppb = __atomic_load_n(&gen->device_clock.drift_ppb, __ATOMIC_RELAXED);
+	metrics->device_latency = gen->sound_device_latency;
+	metrics->period_n_samples = gen->buffer_n_samples;
+	metrics->n_tone_ends = __atomic_load_n(&gen->metrics.n_tone_ends, __ATOMIC_RELAXED);
 
-   @return CW_SUCCESS on success
-   @return CW_FAILURE on failure
-*/
-cw_ret_t cw_gen_enqueue_ik_symbol_no_ims_internal(cw_gen_t * gen, char symbol)
-{
-	cw_tone_t tone = { 0 };
+	return CW_SUCCESS;
+}
 
-	/* In all other places the assignment to gen->space_units_count happens
-	   after call to cw_tq_enqueue_internal(). To keep this convention I need
-	   this temporary var. */
-	int units_count = 0;
 
-	switch (symbol) {
-	case CW_DOT_REPRESENTATION:
-		CW_TONE_INIT(&tone, gen->frequency, gen->durations.dot_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		/* Enqueueing a mark means resetting of spaces counter. */
-		units_count = 0;
-		break;
 
-	case CW_DASH_REPRESENTATION:
-		CW_TONE_INIT(&tone, gen->frequency, gen->durations.dash_duration, CW_SLOPE_MODE_STANDARD_SLOPES);
-		/* Enqueueing a mark means resetting of spaces counter. */
-		units_count = 0;
-		break;
 
-	case CW_SYMBOL_IMS:
-		CW_TONE_INIT(&tone, 0, gen->durations.ims_duration, CW_SLOPE_MODE_NO_SLOPES);
-		/* Enqueueing an ims. Record this fact in space units counter. */
-		units_count = UNITS_PER_IMS;
-		break;
-	default:
-		cw_assert (0, MSG_PREFIX "unknown iambic keyer symbol '%d'", symbol);
-		/* Reset on error. */
-		units_count = 0;
-		break;
+cw_ret_t cw_gen_export_metrics(cw_gen_t * gen, const char * labels, cw_metrics_write_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
 	}
 
-	const cw_ret_t cwret = cw_tq_enqueue_internal(gen->tq, &tone);
-	gen->space_units_count = units_count;
-	return cwret;
+	cw_gen_metrics_t metrics;
+	cw_gen_get_metrics(gen, &metrics);
+
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_queue_length", "gauge",
+					 "Count of tones in queue of generator.", labels,
+					 (double) cw_gen_get_queue_length(gen));
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_queue_characters", "gauge",
+					 "Count of characters in queue of generator.", labels,
+					 (double) cw_gen_get_queue_n_characters(gen));
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_queue_duration_seconds", "gauge",
+					 "Duration of tones in queue of generator.", labels,
+					 (double) cw_gen_get_queue_duration(gen) / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_queue_length_peak", "gauge",
+					 "Largest count of tones that has been in queue of generator.", labels,
+					 (double) metrics.queue_length_peak);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_buffers_written", "counter",
+					 "Buffers of samples written to sound device.", labels,
+					 (double) metrics.n_buffers_written);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_underruns", "counter",
+					 "Underruns (xruns) of sound device.", labels,
+					 (double) metrics.n_underruns);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_wakeups", "counter",
+					 "Wakeups of generator waiting for tones in empty queue.", labels,
+					 (double) metrics.n_wakeups);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_tone_ends", "counter",
+					 "Ends of tones reported to waiting threads.", labels,
+					 (double) metrics.n_tone_ends);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_write_time_avg_seconds", "gauge",
+					 "Average time of writing a buffer to sound device.", labels,
+					 (double) metrics.write_time_avg / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_write_time_max_seconds", "gauge",
+					 "Longest time of writing a buffer to sound device.", labels,
+					 (double) metrics.write_time_max / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_synthesis_time_avg_seconds", "gauge",
+					 "Average time of calculating samples of a buffer.", labels,
+					 (double) metrics.synthesis_time_avg / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_synthesis_time_max_seconds", "gauge",
+					 "Longest time of calculating samples of a buffer.", labels,
+					 (double) metrics.synthesis_time_max / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_device_latency_seconds", "gauge",
+					 "Duration of samples that buffer of sound device can hold.", labels,
+					 (double) metrics.device_latency / CW_USECS_PER_SEC);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_period_samples", "gauge",
+					 "Count of samples written to sound device at once.", labels,
+					 (double) metrics.period_n_samples);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_gen_sample_clock_drift_ppb", "gauge",
+					 "Measured deviation of rate of sample clock of sound device, in parts per billion.", labels,
+					 (double) metrics.sample_clock_drift_ppb);
+
+	return CW_SUCCESS;
 }
 
 
 
 
-cw_ret_t cw_gen_wait_for_queue_level(cw_gen_t * gen, size_t level)
+cw_ret_t cw_gen_set_queue_capacity(cw_gen_t * gen, size_t capacity, size_t high_water_mark)
 {
-	return cw_tq_wait_for_level_internal(gen->tq, level);
+	if (NULL == gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_tq_set_capacity_internal(gen->tq, capacity, high_water_mark);
 }
 
 
 
 
-void cw_gen_flush_queue(cw_gen_t * gen)
+cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level)
 {
-	/* This function locks and unlocks mutex. */
-	cw_tq_flush_internal(gen->tq);
+	return cw_tq_register_low_level_callback_internal(gen->tq, callback_func, callback_arg, level);
+}
 
-	/* TODO: we probably want to have these two functions
-	   separated. Function called cw_gen_flush_queue() probably shouldn't
-	   also silence generator. */
 
-	/* Force silence on the speaker anyway, and stop any background
-	   soundcard tone generation. */
-	cw_gen_silence_internal(gen);
 
-	return;
+
+cw_ret_t cw_gen_register_low_duration_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, uint64_t duration)
+{
+	return cw_tq_register_low_duration_callback_internal(gen->tq, callback_func, callback_arg, duration);
 }
 
 
 
 
-cw_ret_t cw_gen_remove_last_character(cw_gen_t * gen)
+bool cw_gen_is_token_completed(cw_gen_t * gen, uint64_t token)
 {
-	return cw_tq_remove_last_character_internal(gen->tq);
+	return __atomic_load_n(&gen->tokens.last_completed, __ATOMIC_ACQUIRE) >= token;
 }
 
 
 
 
-cw_ret_t cw_gen_get_sound_device(cw_gen_t const * gen, char * buffer, size_t size)
+cw_ret_t cw_gen_wait_for_token(cw_gen_t * gen, uint64_t token)
 {
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
-	snprintf(buffer, size, "%s", gen->picked_device_name);
+	pthread_mutex_lock(&gen->tokens.mutex);
+	if (token > gen->tokens.last_issued) {
+		pthread_mutex_unlock(&gen->tokens.mutex);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	while (gen->tokens.last_completed < token) {
+		pthread_cond_wait(&gen->tokens.cond, &gen->tokens.mutex);
+	}
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
 	return CW_SUCCESS;
 }
 
 
 
 
-int cw_gen_get_sound_system(cw_gen_t const * gen)
+cw_ret_t cw_gen_register_token_callback(cw_gen_t * gen, cw_gen_token_callback_t callback_func, void * callback_arg)
 {
-	cw_assert (NULL != gen, MSG_PREFIX "generator is NULL");
-	return gen->sound_system;
+	pthread_mutex_lock(&gen->tokens.mutex);
+	gen->tokens.callback = callback_func;
+	gen->tokens.callback_arg = callback_arg;
+	pthread_mutex_unlock(&gen->tokens.mutex);
+
+	return CW_SUCCESS;
 }
 
 
 
 
-size_t cw_gen_get_queue_length(cw_gen_t const * gen)
+int cw_gen_get_queue_event_fd(cw_gen_t * gen)
 {
-	return cw_tq_length_internal(gen->tq);
+	return cw_tq_get_event_fd_internal(gen->tq);
 }
 
 
 
 
-cw_ret_t cw_gen_register_low_level_callback(cw_gen_t * gen, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level)
+void cw_gen_clear_queue_event(cw_gen_t * gen)
 {
-	return cw_tq_register_low_level_callback_internal(gen->tq, callback_func, callback_arg, level);
+	cw_tq_clear_event_internal(gen->tq);
 }
 
 
@@ -3211,7 +8293,7 @@ static cw_ret_t cw_gen_value_tracking_internal(cw_gen_t * gen, const cw_tone_t *
 	case CW_TQ_JUST_EMPTIED:
 	case CW_TQ_NONEMPTY:
 		/* A valid tone has been dequeued just now. */
-		value = tone->frequency ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+		value = (tone->frequency || tone->is_clip) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
 		break;
 
 	case CW_TQ_EMPTY:
@@ -3321,6 +8403,14 @@ void cw_gen_value_tracking_set_value_internal(cw_gen_t * gen, __attribute__((unu
 		(*gen->value_tracking.value_tracking_callback_func)(gen->value_tracking.value_tracking_callback_arg, gen->value_tracking.value);
 	}
 #endif
+	if (gen->value_tracking.timed_callback_func || NULL != __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE)) {
+		struct timeval playback_time = { 0 };
+		cw_gen_get_playback_time_internal(gen, &playback_time);
+		if (gen->value_tracking.timed_callback_func) {
+			(*gen->value_tracking.timed_callback_func)(gen->value_tracking.timed_callback_arg, gen->value_tracking.value, &playback_time);
+		}
+		cw_gen_timing_monitor_update_internal(gen, gen->value_tracking.value, (int64_t) playback_time.tv_sec * CW_USECS_PER_SEC + playback_time.tv_usec);
+	}
 	return;
 }
 
@@ -3362,6 +8452,39 @@ void cw_gen_register_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_val
 
 
 
+/**
+   @brief Register external callback function for tracking state of generator, with time of playback
+
+   Works as cw_gen_register_value_tracking_callback_internal(), but
+   the third argument passed to @p callback_func is the time (see
+   cw_gen_get_timestamp()) at which the change of generator's value
+   will be heard: the callback is called when a tone is dequeued, but
+   samples of the tone reach DAC only after samples that are already
+   waiting in generator's buffers and in sound device.
+
+   The time is calculated from duration of samples waiting in
+   generator's buffers and from delay of sound device (reported by
+   ALSA, OSS or PulseAudio after each write, or estimated with
+   latency of the device for other sound systems).
+
+   The callback may be registered together with the callback
+   registered with cw_gen_register_value_tracking_callback_internal().
+
+   @param[in] gen generator for which to register a callback
+   @param[in] callback_func callback function to be called on generator state changes
+   @param[in] callback_arg first argument to callback_func
+*/
+void cw_gen_register_timed_value_tracking_callback_internal(cw_gen_t * gen, cw_gen_timed_value_tracking_callback_t callback_func, void * callback_arg)
+{
+	gen->value_tracking.timed_callback_func = callback_func;
+	gen->value_tracking.timed_callback_arg = callback_arg;
+
+	return;
+}
+
+
+
+
 /**
    @brief Pick a device name for given sound system
 
@@ -3412,6 +8535,14 @@ cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name,
 		   empty string argument. We have to provide explicit device
 		   name or path. So behaviour is the same as for ALSA. */
 
+	case CW_AUDIO_FILE:
+		/* Device name of File sound system is a path to output
+		   file. */
+
+	case CW_AUDIO_RTP:
+		/* Device name of RTP sound system is "host:port" of
+		   listener. */
+
 	case CW_AUDIO_ALSA:
 		/* When you want to tell ALSA to use ALSA's default device,
 		   don't pass NULL or empty string, because ALSA's
@@ -3433,6 +8564,12 @@ cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name,
 		break;
 
 	case CW_AUDIO_PA:
+	case CW_AUDIO_JACK:
+		/* For JACK the device name is a name of playback port to
+		   connect to, empty value means 'physical playback ports'. */
+	case CW_AUDIO_PIPEWIRE:
+		/* For PipeWire the device name is a name of target node,
+		   empty value means 'let session manager decide'. */
 		if (NULL == alternative_device_name
 		    || '\0' == alternative_device_name[0]
 		    || 0 == strcmp(alternative_device_name, default_sound_devices[sound_system])) {
@@ -10,16 +10,33 @@
 
 #include "config.h"
 
+#include <limits.h> /* UCHAR_MAX */
+#include <stdint.h>
+
 #include "libcw.h"
 #include "libcw2.h"
 
 #include <cwutils/cw_config.h>
 #include "libcw_alsa.h"
 #include "libcw_console.h"
+#include "libcw_file.h"
+#include "libcw_jack.h"
 #include "libcw_key.h"
+#include "libcw_null.h"
 #include "libcw_oss.h"
 #include "libcw_pa.h"
+#include "libcw_pipewire.h"
+#include "libcw_rtp.h"
 #include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
 
 
 
@@ -34,6 +51,139 @@
 
 
 
+/* Highest sample rate that can be requested with
+   cw_gen_config_t::sample_rate, e.g. for SDR transmit chains. [Hz] */
+#define CW_GEN_SAMPLE_RATE_MAX 192000
+
+/* Count of slope shapes (of unit amplitude) remembered in library-wide
+   cache, see cw_gen_recalculate_slope_amplitudes_internal(). */
+#define CW_GEN_SLOPE_CACHE_N_ENTRIES 8
+
+/* Count of tones that can be stored in generator's cache of
+   pre-rendered tones. */
+#define CW_GEN_TONE_CACHE_N_ENTRIES 16
+
+/* Longest tone that can be stored in the cache. 2^16 samples is more
+   than a dash at 5 WPM at 48 kHz. [samples] */
+#define CW_GEN_TONE_CACHE_MAX_N_SAMPLES (1 << 16)
+
+/* Longest slope for which tables of slope amplitudes are allocated by
+   generator with preallocated memory (cw_gen_config_t::preallocate).
+   Ten times default duration of slope. [microseconds] */
+#define CW_GEN_PREALLOCATED_SLOPE_DURATION (10 * CW_AUDIO_SLOPE_DURATION)
+
+/* Maximal count of buffers of samples in generator's pipeline
+   (cw_gen_config_t::pipeline_n_buffers). */
+#define CW_GEN_PIPELINE_N_BUFFERS_MAX 3
+
+/* Shortest continuous playback over which rate of sample clock of
+   sound device is measured (cw_gen_config_t::drift_compensation).
+   Over shorter time jitter of reported delay of device outweighs the
+   drift. [microseconds] */
+#define CW_GEN_DRIFT_MIN_INTERVAL (10 * 1000 * 1000)
+
+/* Measurements of drift of sample clock larger than this are
+   considered bogus and ignored. [parts per billion] */
+#define CW_GEN_DRIFT_MAX_PPB (1000 * 1000)
+
+/* Phase of sine wave at the beginning of cached tone is rounded to one
+   of 2^CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS values. */
+#define CW_GEN_TONE_CACHE_PHASE_BUCKET_BITS 2
+
+/* Range of values of cw_sample_t, as floats. */
+#define CW_GEN_SAMPLE_VALUE_MAX  32767.0F
+#define CW_GEN_SAMPLE_VALUE_MIN -32768.0F
+
+/* Hot loops of synthesis can be compiled for more than one instruction
+   set, with the best variant being selected at run time by dynamic
+   loader (GNU indirect functions). */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define CW_GEN_MULTIVERSIONED __attribute__((target_clones("avx2", "default")))
+#else
+#define CW_GEN_MULTIVERSIONED
+#endif
+
+/* Gain of generator in Q30 format: this value is full volume. */
+#define CW_GEN_GAIN_ONE (1 << 30)
+
+/* Count of tones that can be collected in generator's batch of tones
+   before adding them to tone queue at once. Longest character has
+   CW_DATA_MAX_REPRESENTATION_LENGTH marks, each followed by
+   inter-mark-space, and is followed by inter-character-space. */
+#define CW_GEN_ENQUEUE_BATCH_CAPACITY 32
+
+/* Initial size of generator's ring of tokens waiting for completion
+   (see cw_gen_enqueue_string_with_token()). Must be a power of two,
+   the ring is doubled when it is full. */
+#define CW_GEN_TOKENS_INITIAL_N_SLOTS 16
+
+/* Count of tones in generator's pool of tone programs of characters
+   (see cw_gen_sync_tone_programs_internal()). Each character takes two
+   tones per mark and one tone of inter-character-space. The pool is
+   large enough for all characters in main table of characters;
+   characters that don't fit are enqueued mark by mark. */
+#define CW_GEN_TONE_PROGRAMS_CAPACITY 768
+
+/* Strings up to this length are translated by cw_gen_enqueue_string()
+   without allocation of memory. */
+#define CW_GEN_TRANSLATED_STRING_LOCAL_CAPACITY 256
+
+/* Maximal count of poll descriptors of non-blocking sound device
+   that can be passed to cw_gen_wait_for_sound_device_internal(). */
+#define CW_GEN_SOUND_POLL_FDS_MAX 8
+
+
+
+
+/*
+  In proper Morse code timing the following three rules are given:
+  1. Duration of inter-mark-space is one Unit, perhaps adjusted.
+  2. Duration of inter-character-space is three Units total.
+  3. Duration of inter-word-space is seven Units total.
+*/
+#define UNITS_PER_IMS 1
+#define UNITS_PER_ICS 3
+#define UNITS_PER_IWS 7
+
+
+
+
+/**
+   @brief Pre-rendered samples of a tone
+
+   First group of fields is a key: samples can be re-used only for a tone
+   with the same parameters, generated with the same generator
+   parameters.
+*/
+typedef struct {
+	bool valid;
+	unsigned int generation;          /**< Value of generator's cache generation at the time of rendering. */
+	int frequency;
+	cw_sample_iter_t n_samples;
+	int rising_slope_n_samples;
+	int falling_slope_n_samples;
+	int slope_shape;
+	int volume_abs;
+	unsigned int sample_rate;
+	int phase_bucket;
+
+	cw_sample_t * samples;            /**< Pre-rendered samples of the tone. */
+	cw_sample_iter_t samples_capacity; /**< Size of samples[]. */
+	float phase_offset;               /**< Phase of sine wave after the tone (floating-point engines). */
+	uint32_t phase_acc;               /**< Phase of sine wave after the tone (fixed-point engine). */
+} cw_gen_tone_cache_entry_t;
+
+
+
+
+/* Plateau of tones longer than this is generated by replaying a short
+   periodic fragment of sine wave instead of calculating every
+   sample. [us] */
+#define CW_GEN_PLATEAU_LOOP_MIN_DURATION (2 * CW_USECS_PER_SEC)
+
+
+
+
 /* Symbolic name for inter-mark-space. TODO: this should not be a space
    character. Space character is reserved for inter-character-space.*/
 enum { CW_SYMBOL_IMS = ' ' };
@@ -59,8 +209,28 @@ typedef struct {
 
 
 
+/* Token of a string waiting for completion, see
+   cw_gen_enqueue_string_with_token(). */
+typedef struct {
+	uint64_t token;
+	bool is_orphan; /* Mark of the string has been removed from tone queue. */
+} cw_gen_pending_token_t;
+
+
+
+
 struct cw_gen_struct {
 
+	/* Fields are grouped by threads writing them: parameters written
+	   by client code, fields of synthesis written by generator's
+	   thread (see ::buffer), pipeline shared with pipeline's thread
+	   (see ::pipeline), and fields written by a thread that enqueues
+	   characters (see ::enqueue_batch). Each of these groups starts
+	   at a new cache line (see CW_CACHE_LINE_ALIGNED), so that
+	   enqueueing tones doesn't invalidate cache lines used by
+	   generator's thread in synthesis loop. Generator must be
+	   allocated with cw_calloc_aligned_internal(). */
+
 	/* Tone queue. */
 
 	/* Generator can only generate tones that were first put into
@@ -103,8 +273,16 @@ struct cw_gen_struct {
 	   sending speed).
 
 	   Be sure to read comment in cw_gen_sync_parameters_internal() on
-	   calculation of values of these parameters. */
-	cw_gen_durations_t durations;
+	   calculation of values of these parameters.
+
+	   Durations are kept in timing block shared with generators
+	   and receivers that have the same parameters (see
+	   libcw_timing.c). ::durations points to durations in
+	   ::timing, or to ::own_durations if all blocks of the
+	   table are in use. */
+	const struct cw_timing_struct * timing;
+	const cw_gen_durations_t * durations;
+	cw_gen_durations_t own_durations;
 
 
 
@@ -126,6 +304,21 @@ struct cw_gen_struct {
 	bool parameters_in_sync;
 
 
+	/* Parameters set with cw_gen_set_parameters(), waiting to be
+	   applied by cw_gen_apply_pending_parameters_internal(). Speed,
+	   frequency, gap and weighting are used when tones are enqueued,
+	   so they are applied by the thread enqueueing tones. Volume is
+	   used when samples are calculated, so if generator's thread is
+	   running, the volume is applied by the thread at the beginning of
+	   a tone. The flags are checked without locking the mutex. */
+	struct {
+		pthread_mutex_t mutex;
+		cw_gen_parameters_t values;
+		bool is_pending_enqueue;  /* Speed, frequency, gap and weighting are waiting. */
+		bool is_pending_volume;   /* Volume is waiting. */
+	} pending_parameters;
+
+
 
 
 	/* Misc fields. */
@@ -140,8 +333,64 @@ struct cw_gen_struct {
 	   We should also send exactly buffer_n_samples samples to sound
 	   system, in order to avoid situation when sound system waits for
 	   filling its buffer too long - this would result in errors and
-	   probably audible clicks. */
-	cw_sample_t * buffer;
+	   probably audible clicks.
+
+	   First field of group of fields used in synthesis of samples,
+	   written only by generator's thread. */
+	cw_sample_t * buffer CW_CACHE_LINE_ALIGNED;
+
+	/* Memory for samples allocated by generator. ::buffer points to
+	   it, unless sound system has pointed ::buffer directly at
+	   memory of sound device (see
+	   acquire_buffer_from_sound_device()). */
+	cw_sample_t * own_buffer;
+
+	/* Sinks receiving every buffer written to sound device, see
+	   cw_gen_add_sink(). NULL until first sink is added. Accessed
+	   atomically. */
+	struct cw_gen_sinks_struct * sinks;
+
+	/* Monitor of timing of Marks and Spaces played by generator, see
+	   cw_gen_enable_timing_monitor(). NULL until the monitor is
+	   enabled for the first time. Accessed atomically. */
+	struct cw_gen_timing_monitor_struct * timing_monitor;
+
+	/* Tap of samples played by generator, see cw_gen_enable_tap().
+	   NULL until the tap is enabled for the first time. Accessed
+	   atomically. */
+	struct cw_gen_tap_struct * tap;
+
+	/* Quality scaling of generator, see
+	   cw_gen_enable_quality_scaling(). NULL until quality scaling
+	   is enabled for the first time. Accessed atomically. */
+	struct cw_gen_quality_scaling_struct * quality_scaling;
+
+	/* Current quality of synthesis, lowered by quality scaling. Read
+	   by generator's thread and by pipeline's thread. Accessed
+	   atomically. */
+	cw_gen_quality_t quality;
+
+	/* Memories of generator with their pre-rendered samples, see
+	   cw_gen_set_memory(). NULL until first memory is set. Accessed
+	   atomically. */
+	struct cw_gen_memories_struct * memories;
+
+	/* Chain of post-processing of samples written to sound device,
+	   see cw_gen_add_dsp_bandpass(). NULL until first stage is
+	   added. Accessed atomically. */
+	struct cw_gen_dsp_struct * dsp;
+
+	/* Samples to be written by write_buffer_to_sound_device(). This
+	   is ::buffer, unless generator's pipeline is running: then
+	   ::buffer is already being filled with next samples while the
+	   pipeline's thread writes ::out_buffer. */
+	cw_sample_t * out_buffer;
+
+	/* Count of samples in ::out_buffer to be written. This is
+	   ::buffer_n_samples, except for partially filled buffer that
+	   is flushed when tone queue becomes empty (see
+	   cw_gen_config_t::flush_on_empty_queue). */
+	int out_n_samples;
 
 	/* Size of data buffer, in samples.
 
@@ -160,6 +409,27 @@ struct cw_gen_struct {
 	   type). */
 	int buffer_n_samples;
 
+	/* Format of samples expected by sound device. Samples are always
+	   calculated into ::buffer as mono cw_sample_t, and converted to
+	   the format only when they are written to the device (see
+	   cw_gen_get_device_samples_internal()). Sound systems that
+	   negotiate the format set these fields when they open the
+	   device, other sound systems leave the defaults (S16, mono). */
+	cw_sample_format_t sample_format;
+	int n_channels;
+
+	/* Samples from ::buffer, converted to ::sample_format and
+	   ::n_channels. Allocated only when the format is other than S16
+	   mono. */
+	void * device_buffer;
+
+	/* Has ::device_buffer already been filled with samples of
+	   ::out_buffer by post-processing chain (see
+	   cw_gen_dsp_process_internal())? The chain converts its float
+	   samples to ::sample_format directly, without rounding them to
+	   cw_sample_t first. Set before every write of ::out_buffer. */
+	bool device_buffer_filled;
+
 
 	/* We need two indices to gen->buffer, indicating beginning
 	   and end of a subarea in the buffer.  The subarea is not
@@ -205,6 +475,17 @@ struct cw_gen_struct {
 	   function calculating consecutive fragments of sine wave. */
 	float phase_offset;
 
+	/* Engine used to calculate samples of sine wave (sinf(), recursive
+	   phasor, table lookup). Selected once, in cw_gen_new(). Regardless
+	   of engine, phase_offset is the only "memory" of previously
+	   calculated fragment of sine wave (with exception of fixed-point
+	   engine, see phase_acc). */
+	cw_gen_oscillator_t oscillator;
+
+	/* Phase of sine wave used by fixed-point oscillator engine instead
+	   of phase_offset. Full range of the variable corresponds to 2*Pi. */
+	uint32_t phase_acc;
+
 
 
 	/* Tone parameters. */
@@ -230,27 +511,115 @@ struct cw_gen_struct {
 		/* Linear/raised cosine/sine/rectangle. */
 		int shape;
 
-		/* Table of amplitudes of every PCM sample of tone's
-		   slope.
+		/* Table of normalized amplitudes of every PCM sample of
+		   tone's slope, in range <0.0; 1.0). Volume of generator
+		   is applied when samples are calculated, so change of
+		   volume doesn't change the table.
 
 		   The values in amplitudes[] change from zero to max
 		   (at least for any sane slope shape), so naturally
 		   they can be used in forming rising slope. However
 		   they can be used in forming falling slope as well -
-		   just iterate the table from end to beginning.
-
-		   TODO: it seems that amplitudes can be
-		   integers. Investigate it. */
+		   just iterate the table from end to beginning. */
 		float * amplitudes;
 
+		/* The same values as in amplitudes[], in Q15 format.
+		   Used by fixed-point oscillator engine. */
+		int32_t * amplitudes_fixed;
+
 		/* This is a secondary parameter, derived from
 		   ->duration. n_amplitudes is useful when iterating over
 		   ->amplitudes[] or reallocing the ->amplitudes[]. */
 		int n_amplitudes;
+
+		/* Size of ->amplitudes[] and ->amplitudes_fixed[]. The
+		   tables only grow. */
+		int capacity;
+
+		/* Parameters for which ->amplitudes[] have been
+		   calculated. The tables are recalculated only when
+		   one of these changes. */
+		unsigned int calculated_sample_rate;
+		int calculated_shape;
+		int calculated_n_amplitudes;
 	} tone_slope;
 
 
 
+	/* Cache of pre-rendered tones. Most of tones generated by a
+	   generator are dots and dashes with the same parameters, so
+	   their samples can be copied from the cache instead of being
+	   calculated again.
+
+	   Entries are accessed only by generator's thread. Other threads
+	   invalidate the cache only by incrementing ->generation. */
+	struct {
+		cw_gen_tone_cache_entry_t entries[CW_GEN_TONE_CACHE_N_ENTRIES];
+		int next; /* Index of entry to be replaced on next cache miss. */
+		volatile unsigned int generation;
+	} tone_cache;
+
+
+
+	/* Periodic fragment of sine wave used to generate plateau of
+	   very long tones (e.g. QRSS), see
+	   CW_GEN_PLATEAU_LOOP_MIN_DURATION. Accessed only by generator's
+	   thread. */
+	struct {
+		cw_sample_t * samples;
+		int samples_capacity;
+		int n_samples;        /* Count of samples in the fragment, fragment contains integer number of periods. */
+		bool active;          /* Is plateau of current tone being generated from the fragment? */
+		cw_sample_iter_t start_iterator; /* Value of tone's sample iterator at first sample of the fragment. */
+		float phase_offset;   /* Phase of sine wave at first sample of the fragment. */
+		uint32_t phase_acc;   /* Phase of sine wave at first sample of the fragment (fixed-point engine). */
+	} plateau_loop;
+
+
+
+	/* Gradual changes of gain and chirp of marks, calculated for
+	   every sample in synthesis loop, see cw_gen_set_gain() and
+	   cw_gen_set_chirp(). Requests are written by client under
+	   pending_parameters.mutex, and are picked up by generator at the
+	   beginning of a fragment of samples (chirp only at the beginning
+	   of a tone). Remaining fields are accessed only by generator. */
+	struct {
+		bool is_pending_gain;
+		int requested_gain;          /* [percents] */
+		int requested_gain_duration; /* [us] */
+
+		bool is_pending_chirp;
+		int requested_chirp_offset;   /* [Hz] */
+		int requested_chirp_duration; /* [us] */
+
+		/* Current gain and its target, in Q30 format (1 << 30 is
+		   full volume). */
+		int32_t gain;
+		int32_t gain_target;
+		int32_t gain_step;                 /* Change of gain per sample. */
+		cw_sample_iter_t gain_n_remaining; /* Count of samples until gain reaches target. */
+
+		int chirp_offset;           /* Frequency at beginning of a mark, relative to frequency of the mark [Hz]. */
+		int chirp_n_samples;        /* Count of samples in which frequency slides to frequency of the mark. */
+	} modulation;
+
+
+
+	/* State of rendering samples on demand, without generator's own
+	   thread and sound sink (e.g. by a mixer, see
+	   cw_gen_render_internal()). A tone may span many calls to the
+	   render function, so the tone currently being rendered is
+	   remembered here. */
+	struct {
+		cw_tone_t tone;                /* Tone currently being rendered. */
+		cw_tone_t prev_tone;           /* Tone rendered before current tone. */
+		bool has_tone;                 /* Is ->tone a valid tone with samples left to render? */
+		const cw_sample_t * cached;    /* Pre-rendered samples of ->tone, or NULL. */
+		int64_t loopback_time;         /* [samples] Virtual time of cw_gen_loopback_string(). */
+	} render;
+
+
+
 	/* Library's client (client code using library). */
 	struct library_client {
 		/* Main thread, existing from beginning to end of main process run.
@@ -302,6 +671,20 @@ struct cw_gen_struct {
 		   cw_gen_dequeue_and_generate_internal() was launched
 		   successfully. */
 		bool running;
+
+		/* Set by thread function when it is about to enter its
+		   loop. cw_gen_start() waits for it on ->cond instead of
+		   sleeping for a fixed time. */
+		bool ready;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+
+		/* Realtime setup of the thread, applied by the thread
+		   function itself. See cw_gen_config_t. */
+		int sched_policy;
+		int sched_priority;
+		unsigned long long cpu_affinity;
+		bool lock_memory;
 	} thread;
 
 	/* start/stop flag.
@@ -311,6 +694,76 @@ struct cw_gen_struct {
 	   dequeue_and_generate thread function. */
 	bool do_dequeue_and_generate;
 
+	/* Warm standby, see cw_gen_config_t::standby_on_stop.
+	   'standby' is true between cw_gen_stop() and next
+	   cw_gen_start() of generator configured for standby. Thread
+	   function (or sound device's pull callback) keeps running
+	   on empty tone queue during that time. */
+	bool standby_on_stop;
+	bool standby;
+
+	/* All memory needed to generate tones has been allocated in
+	   cw_gen_new(), see cw_gen_config_t::preallocate. */
+	bool preallocated;
+
+	/* Write partially filled ::buffer when tone queue becomes
+	   empty, see cw_gen_config_t::flush_on_empty_queue. */
+	bool flush_on_empty_queue;
+
+	/* Time at which sound of last samples written before tone queue
+	   has become empty ends, in microseconds since the Epoch (see
+	   cw_gen_get_end_of_sound_time()). -1 if the queue hasn't become
+	   empty yet. Accessed atomically. */
+	int64_t end_of_sound_time;
+
+	/* Time at which first tone after scheduled silence (see
+	   cw_tone_t::is_scheduled) should start to play, in
+	   microseconds since the Epoch (see cw_gen_enqueue_at()). Zero if
+	   no start is scheduled. Accessed atomically. */
+	int64_t scheduled_start;
+
+	/* Pipeline of buffers of samples, see
+	   cw_gen_config_t::pipeline_n_buffers.
+
+	   ::buffers[0] is ::own_buffer. Generator's thread calculates
+	   samples into ::buffers[::current] (pointed to by ::buffer),
+	   puts full buffer into ::filled FIFO and takes next buffer from
+	   ::free stack. Pipeline's thread writes buffers from ::filled
+	   to sound device and puts them back on ::free, together with
+	   result of the write, which generator's thread later adds to
+	   ::metrics. All fields except ::buffers are protected by
+	   ::mutex. The pipeline starts at a new cache line, because it
+	   is written by two threads.
+
+	   Count of samples of a full buffer is recorded in ::n_samples
+	   when the buffer is put into ::filled. Pipeline's thread must not
+	   read ::buffer_n_samples, because generator's thread temporarily
+	   changes it when it renders samples outside of ::buffer (see
+	   cw_gen_render_samples_internal()). */
+	struct {
+		int n_buffers;      /* 0 if pipeline is not used. */
+		cw_sample_t * buffers[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		int current;
+
+		int filled[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		int filled_head;
+		int n_filled;
+		int free[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		int n_free;
+		int n_samples[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+
+		bool written[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		cw_ret_t write_cwret[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		uint64_t write_ns[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+		uint64_t dsp_ns[CW_GEN_PIPELINE_N_BUFFERS_MAX];
+
+		bool quit;
+		bool running;
+		pthread_t thread_id;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+	} CW_CACHE_LINE_ALIGNED pipeline;
+
 	bool silencing_initialized;
 
 
@@ -326,6 +779,87 @@ struct cw_gen_struct {
 
 	bool sound_device_is_open;
 
+	/* Duration of samples that may be waiting in buffer of sound
+	   device before they are played, i.e. latency of the device
+	   itself. Set by sound systems that can tell it, zero otherwise.
+	   [microseconds] */
+	int sound_device_latency;
+
+	/* Non-blocking mode of sound device (cw_gen_config_t::sound_nonblocking).
+	   Sound systems that support the mode don't block in write, but
+	   wait with cw_gen_wait_for_sound_device_internal() both for
+	   their device and for ::wakeup_fds. Sound systems that don't
+	   support the mode ignore the flag.
+
+	   ::wakeup_fds are made readable by cw_gen_stop(), so that writing
+	   of a buffer can be abandoned once ::sound_wait_cancelled is set.
+	   With eventfd both descriptors are the same, with pipe [0] is read
+	   end and [1] is write end. */
+	bool sound_nonblocking;
+	int wakeup_fds[2];
+	bool sound_wait_cancelled;
+
+	/* Sound device is taken from and returned to library-wide pool
+	   of devices (cw_gen_config_t::device_pool). ::slot is index of
+	   pool's entry with generator's device if the device has been
+	   taken from pool, -1 otherwise. ::key is configuration with
+	   which the device has been opened. */
+	struct {
+		bool enabled;
+		int slot;
+		cw_gen_config_t key;
+	} device_pool;
+
+	/* Low-latency sidetone (cw_gen_config_t::sidetone_low_latency).
+
+	   Key going down sets ::cut_requested. Generator's thread then
+	   stops playing silent 'forever' tone, and discards silence waiting
+	   in ::buffer and in buffer of sound device, so that the new Mark
+	   doesn't wait for the silence to be played.
+
+	   ::silent_run is count of silent samples calculated since last
+	   non-silent sample, including silent samples still kept in
+	   ::buffer. ::writing_silence is set while a buffer containing
+	   only silence is written to sound device, so that non-blocking
+	   write of the buffer can be abandoned (see
+	   cw_gen_wait_for_sound_device_internal()). */
+	struct {
+		bool enabled;
+		bool cut_requested;
+		int64_t silent_run;
+		bool writing_silence;
+	} sidetone;
+
+	/* Idle mode (cw_gen_config_t::idle_timeout).
+
+	   ::silence_duration is duration [us] of silent 'forever' tone
+	   played since last other tone. ::paused is set while sound
+	   device is paused with pause_sound_device(). Both fields are
+	   used only by generator's thread. */
+	struct {
+		int64_t timeout;  /* [us], zero: idle mode is disabled. */
+		int64_t silence_duration;
+		bool paused;
+	} idle;
+
+	/* Adaptive size of writes to sound device
+	   (cw_gen_config_t::adaptive_period).
+
+	   While key is used, buffers of ::small_n_samples samples are
+	   written to sound device, so that sidetone of next Mark waits
+	   for shorter write. Otherwise buffers of ::buffer_n_samples
+	   samples are written, with fewer wakeups of generator's
+	   thread. ::keying_time is CLOCK_MONOTONIC time [ns] of last
+	   Mark or Space enqueued by key, it is accessed atomically.
+	   ::is_small is changed only by generator's thread, at the
+	   beginning of a buffer. */
+	struct {
+		bool enabled;
+		bool is_small;
+		int small_n_samples;
+		uint64_t keying_time;
+	} adaptive_period;
+
 #ifdef ENABLE_DEV_PCM_SAMPLES_FILE
 	/* Output file descriptor for debug data (console, OSS, ALSA,
 	   PulseAudio). */
@@ -356,9 +890,78 @@ struct cw_gen_struct {
 	cw_ret_t (* write_buffer_to_sound_device)(cw_gen_t * gen);
 	cw_ret_t (* write_tone_to_sound_device)(cw_gen_t * gen, const cw_tone_t * tone);
 
+	/**
+	   @brief Let generator calculate samples directly in memory of sound device
+
+	   The function is called before first sample of a new buffer is
+	   calculated. It sets gen->buffer either to memory of sound device
+	   that can take gen->buffer_n_samples samples, or to
+	   gen->own_buffer. In both cases write_buffer_to_sound_device() is
+	   called when the buffer is full.
+
+	   A sound system may not set this function pointer.
+
+	   @param[in/out] gen generator with opened sound sink
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE on failure
+	*/
+	cw_ret_t (* acquire_buffer_from_sound_device)(cw_gen_t * gen);
+
+	/**
+	   @brief Set count of samples written to sound device at once
+
+	   Sound device should wake up generator's thread (blocked in
+	   write_buffer_to_sound_device()) when there is free space for
+	   @p n_samples samples. Used for
+	   cw_gen_config_t::adaptive_period.
+
+	   A sound system may not set this function pointer.
+
+	   @param[in] gen generator with opened sound sink
+	   @param[in] n_samples count of samples, not larger than gen->buffer_n_samples
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE on failure
+	*/
+	cw_ret_t (* set_sound_device_write_size)(cw_gen_t * gen, int n_samples);
+
+	/**
+	   @brief Pause and resume sound device of idle generator
+
+	   pause_sound_device() is called by generator's thread when tone
+	   queue has been empty for cw_gen_config_t::idle_timeout. The
+	   device should stop consuming samples and let hardware enter
+	   low-power state. resume_sound_device() is called before next
+	   samples are written to the device.
+
+	   A sound system may not set these function pointers.
+	*/
+	cw_ret_t (* pause_sound_device)(cw_gen_t * gen);
+	cw_ret_t (* resume_sound_device)(cw_gen_t * gen);
+
+	/**
+	   @brief Start and stop sound device that pulls samples from generator
+
+	   Some sound systems (asynchronous PulseAudio stream) call
+	   cw_gen_render_internal() from their own thread whenever the
+	   device needs samples. For generators using such sound system
+	   cw_gen_start() and cw_gen_stop() call these functions instead
+	   of starting and stopping generator's thread.
+
+	   Sound systems that expect samples to be written to them by
+	   generator's thread don't set these function pointers.
+	*/
+	cw_ret_t (* start_sound_device)(cw_gen_t * gen);
+	void (* stop_sound_device)(cw_gen_t * gen);
+
 	/**
 	   @brief Do some housekeeping of sound sink when tone queue goes completely empty
 
+	   The function returns after samples written to sound sink have
+	   been played, so for generator the sound ends at the time of
+	   return (see cw_gen_get_end_of_sound_time()).
+
 	   A sound system may not set this function pointer.
 
 	   @param[in/out] gen generator with opened sound sink
@@ -368,6 +971,79 @@ struct cw_gen_struct {
 	*/
 	cw_ret_t (* on_empty_queue)(cw_gen_t * gen);
 
+	/**
+	   @brief Discard silence waiting to be played by sound device
+
+	   Used by low-latency sidetone (see cw_gen_t::sidetone). Nothing
+	   is discarded if some of samples waiting in the device are not
+	   silent (e.g. falling slope of previous Mark is still being
+	   played).
+
+	   A sound system may not set this function pointer.
+
+	   @param[in/out] gen generator with opened sound sink
+	   @param[in] n_silent_samples count of most recently written samples that are silent
+
+	   @return CW_SUCCESS if samples have been discarded
+	   @return CW_FAILURE otherwise
+	*/
+	cw_ret_t (* drop_silence_from_sound_device)(cw_gen_t * gen, int64_t n_silent_samples);
+
+	/**
+	   @brief Get duration of samples waiting in sound device
+
+	   Called right after a buffer has been written to sound device,
+	   by the same thread that writes the buffers. See
+	   cw_gen_t::device_clock.
+
+	   A sound system may not set this function pointer. ::sound_device_latency
+	   is then used instead.
+
+	   @param[in/out] gen generator with opened sound sink
+	   @param[out] delay duration of samples written to device and not played yet [microseconds]
+
+	   @return CW_SUCCESS on success
+	   @return CW_FAILURE otherwise
+	*/
+	cw_ret_t (* get_sound_device_delay)(cw_gen_t * gen, int * delay);
+
+	/* Correlation of generator's samples with clock of sound device.
+
+	   ::queue_end is the time (in microseconds since the Epoch, see
+	   cw_gen_get_timestamp()) at which samples written so far to
+	   sound device will have been played. It is updated after each
+	   write to sound device, and is used to calculate when a tone
+	   that is just being dequeued will really be played (see
+	   cw_gen_register_timed_value_tracking_callback_internal()).
+	   Accessed atomically.
+
+	   Remaining fields measure real rate of sample clock of sound
+	   device (see cw_gen_config_t::drift_compensation): count of
+	   samples played between reference point and last write,
+	   divided by time between them. Reference is set again when
+	   continuity of playback is broken (tone queue has become empty,
+	   or device had underrun). The fields are used by the thread
+	   that writes to sound device, except for ::restart and
+	   ::drift_ppb (accessed atomically) and ::debt (used only by
+	   generator's thread). */
+	struct {
+		int64_t queue_end;
+
+		bool drift_compensation;
+		bool restart;                  /* Reference point should be set again. */
+		uint64_t n_written;            /* Count of samples written to sound device. */
+		bool has_reference;
+		int64_t reference_time;        /* [microseconds] */
+		int64_t reference_played;      /* Count of samples played by device at ::reference_time. */
+		uint64_t reference_underruns;
+		int64_t drift_ppb;             /* Deviation of real rate from ::sample_rate [parts per billion]. */
+
+		/* Samples that tones should have had in total (after
+		   correction for drift, and without rounding to whole
+		   samples), but haven't got yet. Paid in silent tones. */
+		double debt;
+	} device_clock;
+
 	/*
 	  Current value of generator, as dictated by value of the tone
 	  that has been most recently dequeued. Value tracking
@@ -386,6 +1062,9 @@ struct cw_gen_struct {
 
 		cw_gen_value_tracking_callback_t value_tracking_callback_func;
 		void * value_tracking_callback_arg;
+
+		cw_gen_timed_value_tracking_callback_t timed_callback_func;
+		void * timed_callback_arg;
 	} value_tracking;
 
 
@@ -394,6 +1073,15 @@ struct cw_gen_struct {
 
 	cw_console_data_t console;
 
+	/* Data used by File sound system. */
+	cw_file_data_t file_data;
+
+	/* Data used by RTP sound system. */
+	cw_rtp_data_t rtp_data;
+
+	/* Data used by Null sound system. */
+	cw_null_data_t null_data;
+
 #ifdef LIBCW_WITH_OSS
 	/* Data used by OSS. */
 	cw_oss_data_t oss_data;
@@ -409,6 +1097,54 @@ struct cw_gen_struct {
 	cw_pa_data_t pa_data;
 #endif
 
+#ifdef LIBCW_WITH_JACK
+	/* Data used by JACK. */
+	cw_jack_data_t jack_data;
+#endif
+
+#ifdef LIBCW_WITH_PIPEWIRE
+	/* Data used by PipeWire. */
+	cw_pipewire_data_t pipewire_data;
+#endif
+
+	/* Runtime metrics of generator, see cw_gen_get_metrics().
+	   Written only by generator's thread, read by any thread.
+	   Accessed with relaxed atomic operations, times are in
+	   nanoseconds. */
+	struct {
+		uint64_t n_buffers_written;
+		uint64_t n_underruns;
+		uint64_t n_wakeups;
+		uint64_t n_tone_ends;
+		uint64_t n_timed_buffers;   /* Count of buffers with measured times of write and synthesis. */
+		uint64_t write_ns_min;
+		uint64_t write_ns_max;
+		uint64_t write_ns_total;
+		uint64_t synthesis_ns_max;
+		uint64_t synthesis_ns_total;
+
+		/* Times spent so far on buffer that is being filled.
+		   Used only by generator's thread. */
+		uint64_t buffer_write_ns;
+		uint64_t buffer_synthesis_ns;
+	} metrics;
+
+	/* Tones of a character, collected by 'enqueue' primitives and
+	   added to tone queue at once (see
+	   cw_gen_enqueue_batch_begin_internal()). Used only by a thread
+	   that enqueues characters.
+
+	   First field of group of fields written by a thread that
+	   enqueues characters. */
+	struct {
+		cw_tone_t tones[CW_GEN_ENQUEUE_BATCH_CAPACITY];
+		size_t n_tones;
+		int depth; /* Nesting level of begin/end calls. Zero when tones are not being collected. */
+		bool priority; /* Add collected tones to priority lane of tone queue. */
+		bool mark;     /* Set cw_tone_t::is_mark in last of collected tones. */
+		bool marked;   /* Last tone of a batch has been marked. */
+	} CW_CACHE_LINE_ALIGNED enqueue_batch;
+
 	/*
 	  Count of units of space enqueued in generator.
 	  When enqueueing ims, ics or iws, increase the counter accordingly.
@@ -416,6 +1152,53 @@ struct cw_gen_struct {
 	  On errors reset the counter.
 	*/
 	int space_units_count;
+
+	/* Tokens of strings enqueued with
+	   cw_gen_enqueue_string_with_token(). Last tone of such string is
+	   marked with cw_tone_t::is_mark, and generator completes the
+	   oldest pending token after it has played a marked tone.
+
+	   ::pending is a ring of tokens (from ::head to ::tail, not
+	   wrapped) in order of their marks in tone queue, grown on
+	   demand. Token whose
+	   mark has been removed from the queue is an orphan, completed
+	   together with the token before it.
+
+	   ::enqueue_mutex serializes enqueueing marked strings with
+	   flushing the queue and removing characters from it, so that
+	   order of ::pending matches order of marks. Other fields are
+	   protected by ::mutex, the only mutex locked by generator's
+	   thread. */
+	struct {
+		cw_gen_pending_token_t * pending;
+		size_t n_slots; /* Power of two. */
+		size_t head;
+		size_t tail;
+
+		uint64_t last_issued;
+		uint64_t last_completed; /* Also read with atomic operations, without ::mutex. */
+
+		cw_gen_token_callback_t callback;
+		void * callback_arg;
+
+		pthread_mutex_t enqueue_mutex;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+	} tokens;
+
+	/* Tone programs of characters: ready-made sequences of tones
+	   forming a character at current timing parameters and
+	   frequency. Tones of a character are marks and
+	   inter-mark-spaces, followed by inter-character-space. Rebuilt
+	   by cw_gen_sync_parameters_internal(), so that enqueueing a
+	   character is a copy of its program. Used only by a thread that
+	   enqueues characters. */
+	struct {
+		cw_tone_t tones[CW_GEN_TONE_PROGRAMS_CAPACITY];
+		uint16_t offsets[UCHAR_MAX + 1];  /* Index of first tone of character's program in ->tones[]. */
+		uint8_t n_marks[UCHAR_MAX + 1];   /* Count of marks in character. Zero: character has no program. */
+		int frequency;                    /* Frequency of marks in programs. */
+	} tone_programs;
 };
 
 
@@ -491,20 +1274,68 @@ cw_ret_t cw_gen_enqueue_mark_internal(cw_gen_t * gen, char mark, bool is_first);
 cw_ret_t cw_gen_enqueue_ics_internal(cw_gen_t * gen);
 cw_ret_t cw_gen_enqueue_iws_internal(cw_gen_t * gen);
 cw_ret_t cw_gen_enqueue_valid_character_internal(cw_gen_t * gen, char character);
+void cw_gen_enqueue_batch_begin_internal(cw_gen_t * gen);
+cw_ret_t cw_gen_enqueue_batch_end_internal(cw_gen_t * gen, cw_ret_t cwret);
 
 /* These are also 'enqueue' primitives, but are intended to be used on
    hardware keying events from straight key (sk) and iambic keyer (ik). */
 cw_ret_t cw_gen_enqueue_sk_begin_mark_internal(cw_gen_t * gen);
 cw_ret_t cw_gen_enqueue_sk_begin_space_internal(cw_gen_t * gen);
-cw_ret_t cw_gen_enqueue_ik_symbol_no_ims_internal(cw_gen_t * gen, char symbol);
+cw_ret_t cw_gen_enqueue_ik_element_internal(cw_gen_t * gen, char symbol, bool in_advance);
+void cw_gen_commit_ik_element_internal(cw_gen_t * gen);
+cw_ret_t cw_gen_cancel_ik_element_internal(cw_gen_t * gen);
 
 cw_ret_t cw_gen_silence_internal(cw_gen_t * gen);
+int cw_gen_render_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples);
+int cw_gen_render_skip_internal(cw_gen_t * gen, int n_samples);
+bool cw_gen_render_skip_tone_internal(cw_gen_t * gen, int64_t * n_samples, bool * is_forever);
+unsigned int cw_gen_get_requested_sample_rate_internal(const cw_gen_config_t * gen_conf);
+void cw_gen_get_requested_sample_format_internal(const cw_gen_config_t * gen_conf, cw_sample_format_t * sample_format, int * n_channels);
+size_t cw_gen_frame_size_internal(const cw_gen_t * gen);
+void cw_gen_convert_samples_internal(const cw_gen_t * gen, const cw_sample_t * samples, int n_samples, void * output);
+const void * cw_gen_get_device_samples_internal(cw_gen_t * gen, size_t * n_bytes);
 char * cw_gen_get_sound_system_label_internal(const cw_gen_t * gen, char * buffer, size_t size);
 
 void cw_generator_delete_internal(void);
 
 void cw_gen_reset_parameters_internal(cw_gen_t * gen);
 void cw_gen_sync_parameters_internal(cw_gen_t * gen);
+void cw_gen_calculate_durations_internal(int speed, int weighting, int gap, cw_gen_durations_t * durations);
+void cw_gen_calculate_unit_durations_internal(int unit_duration, int weighting, int gap, cw_gen_durations_t * durations);
+int cw_gen_ics_duration_internal(const cw_gen_durations_t * durations, int space_units_count);
+int cw_gen_iws_duration_internal(const cw_gen_durations_t * durations, int space_units_count);
+
+
+
+
+/**
+   @brief Apply parameters set with cw_gen_set_parameters()
+
+   In generator's thread only volume is applied. In other threads
+   speed, frequency, gap and weighting are applied (durations of tones
+   are recalculated by next call to cw_gen_sync_parameters_internal()),
+   and volume is applied too if generator's thread isn't running.
+
+   @param[in] gen generator
+   @param[in] is_generator_thread whether the function is called in generator's thread
+*/
+void cw_gen_apply_pending_parameters_internal(cw_gen_t * gen, bool is_generator_thread);
+
+
+
+
+/**
+   @brief Start gradual changes requested with cw_gen_set_gain() and cw_gen_set_chirp()
+
+   Chirp is picked up only at the beginning of @p tone.
+
+   @param[in] gen generator
+   @param[in] tone tone being generated
+
+   @return true if a request has been picked up
+   @return false otherwise
+*/
+bool cw_gen_apply_pending_modulation_internal(cw_gen_t * gen, const cw_tone_t * tone);
 
 /**
    @brief Get the duration of the shortest dot mark that can be generated by libcw
@@ -524,6 +1355,20 @@ int cw_gen_get_shortest_dot_duration_internal(void);
 cw_ret_t cw_gen_pick_device_name_internal(const char * alternative_device_name, enum cw_audio_systems sound_system, char * picked_device_name, size_t size);
 
 int cw_generator_new_internal(const cw_gen_config_t * gen_conf);
+cw_gen_t * cw_generator_get_internal(void);
+
+void cw_gen_metrics_underrun_internal(cw_gen_t * gen);
+
+struct pollfd;
+cw_ret_t cw_gen_wait_for_sound_device_internal(cw_gen_t * gen, struct pollfd * fds, int n_fds);
+
+
+
+
+#if defined(__cplusplus)
+}
+#endif
+
 
 
 
@@ -0,0 +1,622 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_dsp.c
+
+   @brief Post-processing of samples calculated by generator.
+
+   Samples of every buffer that generator writes to its sound device
+   can go through a short chain of stages simulating conditions on the
+   band: band-pass filter of receiver (with its ringing), band noise,
+   and fading (QSB). The chain is applied to the buffer in place, right
+   before the buffer is written to sound device, so sinks of generator
+   get processed samples too.
+
+   Samples are processed in blocks of floats. Each block is converted
+   from cw_sample_t once, goes through all stages, and is converted
+   once at the end: to cw_sample_t (optionally with TPDF dither) and,
+   for sound devices using S32 or FLOAT32 samples, directly to format
+   of the device. Loops that can be vectorized (conversions, noise,
+   gain, dither) are compiled for more than one instruction set, see
+   CW_GEN_MULTIVERSIONED. Biquad filter is recursive, so it is
+   calculated sample by sample.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_dsp.h"
+#include "libcw_gen_quality.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen dsp: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static const double CW_GEN_DSP_PI = 3.14159265358979323846;
+
+/* Standard deviation of sum of four values uniformly distributed in
+   range <0; 1): sqrt(4 / 12). */
+static const float CW_GEN_DSP_NOISE_SIGMA = 0.57735027F;
+
+
+
+
+static cw_gen_dsp_t * cw_gen_dsp_get_internal(cw_gen_t * gen);
+static cw_ret_t cw_gen_dsp_add_stage_internal(cw_gen_t * gen, const cw_gen_dsp_stage_t * stage);
+static void cw_gen_dsp_to_float_internal(float * restrict block, const cw_sample_t * restrict samples, int n);
+static void cw_gen_dsp_to_samples_internal(cw_sample_t * restrict samples, const float * restrict block, int n);
+static void cw_gen_dsp_to_device_internal(const cw_gen_t * gen, const float * restrict block, int n, int offset);
+static void cw_gen_dsp_dither_internal(cw_gen_dsp_t * dsp, float * block, int n);
+static void cw_gen_dsp_biquad_internal(cw_gen_dsp_stage_t * stage, float * block, int n);
+static void cw_gen_dsp_noise_internal(cw_gen_dsp_stage_t * stage, float * block, int n);
+static void cw_gen_dsp_fading_internal(cw_gen_dsp_stage_t * stage, float * block, int n);
+
+
+
+
+cw_ret_t cw_gen_add_dsp_bandpass(cw_gen_t * gen, int frequency, int bandwidth)
+{
+	if (NULL == gen || 0 == gen->sample_rate
+	    || frequency <= 0 || (unsigned int) frequency >= gen->sample_rate / 2
+	    || bandwidth <= 0) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Band-pass filter with peak gain of 0 dB, from "Cookbook
+	   formulae for audio EQ biquad filter coefficients" by Robert
+	   Bristow-Johnson. */
+	const double w0 = 2.0 * CW_GEN_DSP_PI * frequency / gen->sample_rate;
+	const double q = (double) frequency / bandwidth;
+	const double alpha = sin(w0) / (2.0 * q);
+	const double a0 = 1.0 + alpha;
+
+	cw_gen_dsp_stage_t stage;
+	memset(&stage, 0, sizeof (stage));
+	stage.process = cw_gen_dsp_biquad_internal;
+	stage.biquad.b0 = (float) (alpha / a0);
+	stage.biquad.b1 = 0.0F;
+	stage.biquad.b2 = (float) (-alpha / a0);
+	stage.biquad.a1 = (float) (-2.0 * cos(w0) / a0);
+	stage.biquad.a2 = (float) ((1.0 - alpha) / a0);
+
+	return cw_gen_dsp_add_stage_internal(gen, &stage);
+}
+
+
+
+
+cw_ret_t cw_gen_add_dsp_noise(cw_gen_t * gen, int level)
+{
+	if (NULL == gen || level <= 0 || level > 100) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_dsp_stage_t stage;
+	memset(&stage, 0, sizeof (stage));
+	stage.process = cw_gen_dsp_noise_internal;
+	stage.noise.scale = ((float) level / 100.0F) * CW_GEN_SAMPLE_VALUE_MAX / CW_GEN_DSP_NOISE_SIGMA;
+	for (int l = 0; l < CW_GEN_DSP_NOISE_N_LANES; l++) {
+		/* Any non-zero seeds, different for each lane. */
+		stage.noise.state[l] = 0x9e3779b9U * (uint32_t) (l + 1);
+	}
+
+	return cw_gen_dsp_add_stage_internal(gen, &stage);
+}
+
+
+
+
+cw_ret_t cw_gen_add_dsp_fading(cw_gen_t * gen, int depth, int period)
+{
+	if (NULL == gen || 0 == gen->sample_rate
+	    || depth <= 0 || depth > 100
+	    || period <= 0) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_dsp_stage_t stage;
+	memset(&stage, 0, sizeof (stage));
+	stage.process = cw_gen_dsp_fading_internal;
+	stage.fading.phase = 0.0;
+	stage.fading.step = 2.0 * CW_GEN_DSP_PI * CW_USECS_PER_SEC / ((double) period * gen->sample_rate);
+	stage.fading.depth = (float) depth / 100.0F;
+
+	return cw_gen_dsp_add_stage_internal(gen, &stage);
+}
+
+
+
+
+cw_ret_t cw_gen_clear_dsp(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_dsp_t * dsp = __atomic_load_n(&gen->dsp, __ATOMIC_ACQUIRE);
+	if (NULL == dsp) {
+		return CW_SUCCESS;
+	}
+
+	pthread_mutex_lock(&dsp->mutex);
+	__atomic_store_n(&dsp->n_stages, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&dsp->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_set_dsp_dither(cw_gen_t * gen, bool dither)
+{
+	if (NULL == gen) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_dsp_t * dsp = cw_gen_dsp_get_internal(gen);
+	if (NULL == dsp) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&dsp->mutex);
+	dsp->dither = dither;
+	pthread_mutex_unlock(&dsp->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Apply generator's chain of post-processing to samples
+
+   Called right before generator's out buffer is written to sound
+   device, by generator's thread or by thread of generator's pipeline.
+
+   Stages are skipped when quality of synthesis has been lowered to
+   CW_GEN_QUALITY_MINIMAL (see cw_gen_enable_quality_scaling()).
+
+   If the chain isn't empty and sound device uses S32 or FLOAT32
+   samples, processed samples are also converted straight to
+   generator's device buffer, and gen->device_buffer_filled is set.
+
+   @param[in] gen generator
+   @param[in,out] samples samples to process in place
+   @param[in] n_samples count of samples
+*/
+void cw_gen_dsp_process_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples)
+{
+	cw_gen_dsp_t * dsp = __atomic_load_n(&gen->dsp, __ATOMIC_ACQUIRE);
+	if (NULL == dsp || 0 == __atomic_load_n(&dsp->n_stages, __ATOMIC_ACQUIRE)
+	    || cw_gen_quality_dsp_bypassed_internal(gen)) {
+		gen->device_buffer_filled = false;
+		return;
+	}
+
+	/* S16 device gets the same values as cw_sample_t, device buffer
+	   only duplicates them to all channels. */
+	const bool to_device = NULL != gen->device_buffer && CW_SAMPLE_FORMAT_S16 != gen->sample_format;
+
+	float block[CW_GEN_DSP_BLOCK_N_SAMPLES];
+
+	pthread_mutex_lock(&dsp->mutex);
+	for (int i = 0; i < n_samples; i += CW_GEN_DSP_BLOCK_N_SAMPLES) {
+		const int n = n_samples - i < CW_GEN_DSP_BLOCK_N_SAMPLES ? n_samples - i : CW_GEN_DSP_BLOCK_N_SAMPLES;
+		cw_gen_dsp_to_float_internal(block, samples + i, n);
+		for (int s = 0; s < dsp->n_stages; s++) {
+			dsp->stages[s].process(&dsp->stages[s], block, n);
+		}
+		if (to_device) {
+			cw_gen_dsp_to_device_internal(gen, block, n, i);
+		}
+		if (dsp->dither) {
+			cw_gen_dsp_dither_internal(dsp, block, n);
+		}
+		cw_gen_dsp_to_samples_internal(samples + i, block, n);
+	}
+	pthread_mutex_unlock(&dsp->mutex);
+
+	gen->device_buffer_filled = to_device;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Delete chain of post-processing of generator
+
+   Generator's thread must be already stopped.
+
+   @param[in] gen generator
+*/
+void cw_gen_dsp_delete_internal(cw_gen_t * gen)
+{
+	cw_gen_dsp_t * dsp = gen->dsp;
+	if (NULL == dsp) {
+		return;
+	}
+
+	pthread_mutex_destroy(&dsp->mutex);
+	free(dsp);
+	gen->dsp = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get chain of post-processing of generator, allocate it if necessary
+
+   @param[in] gen generator
+
+   @return chain of generator on success
+   @return NULL on failure to allocate the chain
+*/
+static cw_gen_dsp_t * cw_gen_dsp_get_internal(cw_gen_t * gen)
+{
+	cw_gen_dsp_t * dsp = __atomic_load_n(&gen->dsp, __ATOMIC_ACQUIRE);
+	if (NULL != dsp) {
+		return dsp;
+	}
+
+	cw_gen_dsp_t * new_dsp = calloc(1, sizeof (cw_gen_dsp_t));
+	if (NULL == new_dsp) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	pthread_mutex_init(&new_dsp->mutex, NULL);
+	for (int l = 0; l < CW_GEN_DSP_NOISE_N_LANES; l++) {
+		/* Any non-zero seeds, different from seeds of noise
+		   stages. */
+		new_dsp->dither_state[l] = 0x85ebca6bU * (uint32_t) (l + 1);
+	}
+
+	/* Generator's thread sees the chain only after it has been
+	   fully initialized. */
+	if (__atomic_compare_exchange_n(&gen->dsp, &dsp, new_dsp, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return new_dsp;
+	}
+
+	/* Another thread has been first. */
+	pthread_mutex_destroy(&new_dsp->mutex);
+	free(new_dsp);
+	return dsp;
+}
+
+
+
+
+/**
+   @brief Append stage at the end of generator's chain of post-processing
+
+   @exception EINVAL chain already has CW_GEN_DSP_N_STAGES_MAX stages
+   @exception ENOMEM the chain can't be allocated
+
+   @param[in] gen generator
+   @param[in] stage stage to append
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_dsp_add_stage_internal(cw_gen_t * gen, const cw_gen_dsp_stage_t * stage)
+{
+	cw_gen_dsp_t * dsp = cw_gen_dsp_get_internal(gen);
+	if (NULL == dsp) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&dsp->mutex);
+	if (dsp->n_stages >= CW_GEN_DSP_N_STAGES_MAX) {
+		pthread_mutex_unlock(&dsp->mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "too many stages of post-processing");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	dsp->stages[dsp->n_stages] = *stage;
+	__atomic_store_n(&dsp->n_stages, dsp->n_stages + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&dsp->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Convert samples to block of floats
+
+   @param[out] block block of floats
+   @param[in] samples samples to convert
+   @param[in] n count of samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_to_float_internal(float * restrict block, const cw_sample_t * restrict samples, int n)
+{
+	for (int j = 0; j < n; j++) {
+		block[j] = (float) samples[j];
+	}
+	return;
+}
+
+
+
+
+/**
+   @brief Convert block of floats to samples
+
+   Values are rounded to nearest integer and saturated to range of
+   cw_sample_t: noise added to signal at full volume must not wrap
+   around.
+
+   @param[out] samples converted samples
+   @param[in] block block of floats
+   @param[in] n count of samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_to_samples_internal(cw_sample_t * restrict samples, const float * restrict block, int n)
+{
+	for (int j = 0; j < n; j++) {
+		float value = floorf(block[j] + 0.5F);
+		value = value > CW_GEN_SAMPLE_VALUE_MAX ? CW_GEN_SAMPLE_VALUE_MAX : value;
+		value = value < CW_GEN_SAMPLE_VALUE_MIN ? CW_GEN_SAMPLE_VALUE_MIN : value;
+		samples[j] = (cw_sample_t) value;
+	}
+	return;
+}
+
+
+
+
+/**
+   @brief Convert block of floats to format of generator's sound device
+
+   Values are scaled like in cw_gen_convert_samples_internal(), and
+   saturated to range of the format.
+
+   @param[in] gen generator with S32 or FLOAT32 device buffer
+   @param[in] block block of floats
+   @param[in] n count of samples in @p block
+   @param[in] offset index of frame in device buffer, to which first sample of @p block is converted
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_to_device_internal(const cw_gen_t * gen, const float * restrict block, int n, int offset)
+{
+	const int n_channels = gen->n_channels;
+
+	if (CW_SAMPLE_FORMAT_FLOAT32 == gen->sample_format) {
+		float * restrict out = (float *) gen->device_buffer + (size_t) offset * (size_t) n_channels;
+		for (int j = 0; j < n; j++) {
+			float value = block[j] / 32768.0F;
+			value = value > 1.0F ? 1.0F : value;
+			value = value < -1.0F ? -1.0F : value;
+			for (int c = 0; c < n_channels; c++) {
+				out[j * n_channels + c] = value;
+			}
+		}
+	} else {
+		int32_t * restrict out = (int32_t *) gen->device_buffer + (size_t) offset * (size_t) n_channels;
+		for (int j = 0; j < n; j++) {
+			/* Largest float that is still in range of int32_t. */
+			float value = block[j] * 65536.0F;
+			value = value > 2147483520.0F ? 2147483520.0F : value;
+			value = value < -2147483648.0F ? -2147483648.0F : value;
+			for (int c = 0; c < n_channels; c++) {
+				out[j * n_channels + c] = (int32_t) value;
+			}
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add TPDF dither to block of samples
+
+   Dither is a difference of two values uniformly distributed in range
+   <0; 1), so it has triangular distribution in range (-1; 1) of
+   cw_sample_t's least significant bit. It decorrelates rounding
+   error from signal, e.g. from quiet, slowly decaying ringing of
+   filter.
+
+   @param[in,out] dsp chain with state of generators of dither
+   @param[in,out] block block of samples
+   @param[in] n count of samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_dither_internal(cw_gen_dsp_t * dsp, float * block, int n)
+{
+	uint32_t state[CW_GEN_DSP_NOISE_N_LANES];
+	memcpy(state, dsp->dither_state, sizeof (state));
+
+	float dither[CW_GEN_DSP_BLOCK_N_SAMPLES];
+	for (int i = 0; i < n; i += CW_GEN_DSP_NOISE_N_LANES) {
+		for (int l = 0; l < CW_GEN_DSP_NOISE_N_LANES; l++) {
+			int32_t draws[2];
+			for (int k = 0; k < 2; k++) {
+				uint32_t x = state[l];
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				state[l] = x;
+				draws[k] = (int32_t) (x >> 8);
+			}
+			dither[i + l] = (float) (draws[0] - draws[1]) / 16777216.0F;
+		}
+	}
+	for (int j = 0; j < n; j++) {
+		block[j] += dither[j];
+	}
+
+	memcpy(dsp->dither_state, state, sizeof (state));
+
+	return;
+}
+
+
+
+
+/**
+   @brief Filter block of samples with biquad filter
+
+   @param[in,out] stage stage with coefficients and state of filter
+   @param[in,out] block block of samples
+   @param[in] n count of samples
+*/
+static void cw_gen_dsp_biquad_internal(cw_gen_dsp_stage_t * stage, float * block, int n)
+{
+	const float b0 = stage->biquad.b0;
+	const float b1 = stage->biquad.b1;
+	const float b2 = stage->biquad.b2;
+	const float a1 = stage->biquad.a1;
+	const float a2 = stage->biquad.a2;
+	float z1 = stage->biquad.z1;
+	float z2 = stage->biquad.z2;
+
+	for (int j = 0; j < n; j++) {
+		const float x = block[j];
+		const float y = b0 * x + z1;
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		block[j] = y;
+	}
+
+	/* Ringing of filter decays in silence towards denormal values,
+	   which are very slow to calculate. */
+	stage->biquad.z1 = fabsf(z1) < 1e-15F ? 0.0F : z1;
+	stage->biquad.z2 = fabsf(z2) < 1e-15F ? 0.0F : z2;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add noise to block of samples
+
+   Pseudo-random numbers are calculated by CW_GEN_DSP_NOISE_N_LANES
+   independent generators, so that the loop can be vectorized.
+
+   @param[in,out] stage stage with state of noise generators
+   @param[in,out] block block of samples
+   @param[in] n count of samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_noise_internal(cw_gen_dsp_stage_t * stage, float * block, int n)
+{
+	uint32_t state[CW_GEN_DSP_NOISE_N_LANES];
+	memcpy(state, stage->noise.state, sizeof (state));
+	const float scale = stage->noise.scale / 16777216.0F;
+
+	float noise[CW_GEN_DSP_BLOCK_N_SAMPLES];
+	for (int i = 0; i < n; i += CW_GEN_DSP_NOISE_N_LANES) {
+		for (int l = 0; l < CW_GEN_DSP_NOISE_N_LANES; l++) {
+			uint32_t sum = 0;
+			for (int k = 0; k < 4; k++) {
+				uint32_t x = state[l];
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				state[l] = x;
+				sum += x >> 8;
+			}
+			noise[i + l] = (float) (int32_t) sum * scale - 2.0F * stage->noise.scale;
+		}
+	}
+	for (int j = 0; j < n; j++) {
+		block[j] += noise[j];
+	}
+
+	memcpy(stage->noise.state, state, sizeof (state));
+
+	return;
+}
+
+
+
+
+/**
+   @brief Apply slowly changing gain to block of samples
+
+   Gain is calculated exactly at the beginning and at the end of the
+   block, and changes linearly in between. Period of fading is much
+   longer than a block.
+
+   @param[in,out] stage stage with state of fading
+   @param[in,out] block block of samples
+   @param[in] n count of samples
+*/
+CW_GEN_MULTIVERSIONED static void cw_gen_dsp_fading_internal(cw_gen_dsp_stage_t * stage, float * block, int n)
+{
+	const double end_phase = stage->fading.phase + stage->fading.step * n;
+	const float depth = stage->fading.depth;
+	const float gain_begin = 1.0F - depth * (float) (0.5 - 0.5 * cos(stage->fading.phase));
+	const float gain_end = 1.0F - depth * (float) (0.5 - 0.5 * cos(end_phase));
+	const float slope = (gain_end - gain_begin) / (float) n;
+
+	for (int j = 0; j < n; j++) {
+		block[j] *= gain_begin + slope * (float) j;
+	}
+
+	stage->fading.phase = fmod(end_phase, 2.0 * CW_GEN_DSP_PI);
+
+	return;
+}
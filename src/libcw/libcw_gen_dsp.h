@@ -0,0 +1,103 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_DSP
+#define H_LIBCW_GEN_DSP
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Maximal count of stages in chain of post-processing of one
+   generator. */
+#define CW_GEN_DSP_N_STAGES_MAX 8
+
+/* Samples are processed in blocks of this many samples. Intermediate
+   values of a block are kept as floats. */
+#define CW_GEN_DSP_BLOCK_N_SAMPLES 256
+
+/* Count of independent generators of pseudo-random numbers in noise
+   stage, calculated in parallel. */
+#define CW_GEN_DSP_NOISE_N_LANES 8
+
+
+
+
+typedef struct cw_gen_dsp_struct cw_gen_dsp_t;
+typedef struct cw_gen_dsp_stage_struct cw_gen_dsp_stage_t;
+
+
+
+
+/* Function processing a block of samples in place. */
+typedef void (* cw_gen_dsp_process_t)(cw_gen_dsp_stage_t * stage, float * block, int n);
+
+
+
+
+/* Stage of post-processing chain. Only the member matching
+   ::process is used. */
+struct cw_gen_dsp_stage_struct {
+	cw_gen_dsp_process_t process;
+
+	/* Biquad filter, transposed direct form II. Coefficients are
+	   normalized (a0 = 1). */
+	struct {
+		float b0, b1, b2, a1, a2;
+		float z1, z2;
+	} biquad;
+
+	/* Gaussian-like noise: sum of four uniformly distributed values
+	   from xorshift32 generators. */
+	struct {
+		uint32_t state[CW_GEN_DSP_NOISE_N_LANES];
+		float scale;
+	} noise;
+
+	/* Slow sine-shaped fading of gain (QSB). */
+	struct {
+		double phase;     /* [radians] */
+		double step;      /* Change of phase per sample [radians]. */
+		float depth;      /* Gain changes between 1.0 and 1.0 - depth. */
+	} fading;
+};
+
+
+
+
+/* All fields are protected by ::mutex. */
+struct cw_gen_dsp_struct {
+	cw_gen_dsp_stage_t stages[CW_GEN_DSP_N_STAGES_MAX];
+	int n_stages;
+
+	/* TPDF dither added when processed block is converted back to
+	   cw_sample_t, see cw_gen_set_dsp_dither(). */
+	bool dither;
+	uint32_t dither_state[CW_GEN_DSP_NOISE_N_LANES];
+
+	pthread_mutex_t mutex;
+};
+
+
+
+
+void cw_gen_dsp_process_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples);
+void cw_gen_dsp_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_DSP */
@@ -0,0 +1,285 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_loopback.c
+
+   @brief Generator connected directly to receiver, in virtual time.
+
+   Testing a receiver with a generator usually means starting the
+   generator, playing tones in real time, and passing changes of
+   generator's value to the receiver through a callback, with
+   timestamps taken from a clock. A round trip of a few characters
+   takes seconds.
+
+   Loopback doesn't start the generator. Tones are taken from
+   generator's tone queue in calling thread, exactly as when samples
+   are rendered on demand (cw_gen_render()), but samples aren't
+   calculated: only counts of samples of tones are. Changes of
+   generator's value (see cw_gen_value_tracking_internal()) are
+   passed to receiver with timestamps derived from the counts of
+   samples, so the receiver sees the same timing as a listener of
+   the sound device would see, without waiting for it.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_rec.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen loopback: "
+
+
+
+
+/* Count of characters enqueued in generator at once. Far below
+   capacity of tone queue. */
+#define CW_GEN_LOOPBACK_CHUNK_SIZE 32
+
+/* Count of Marks and Spaces passed to receiver at once. */
+#define CW_GEN_LOOPBACK_N_EDGES 256
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Marks and Spaces waiting to be passed to receiver. */
+typedef struct {
+	cw_gen_t * gen;
+	cw_rec_t * rec;
+
+	cw_rec_edge_t edges[CW_GEN_LOOPBACK_N_EDGES];
+	size_t n_edges;
+	int64_t edges_start;      /* [samples] Virtual time of beginning of edges[0]. */
+	int64_t edges_n_samples;  /* [samples] Total duration of ::edges. */
+
+	int64_t character_start;  /* [microseconds] See cw_rec_receive_edges_internal(). */
+	int64_t space_start;      /* [microseconds] */
+
+	cw_rec_decoded_t * decoded;
+	size_t capacity;
+	size_t n_decoded;
+} cw_gen_loopback_t;
+
+
+
+
+static cw_ret_t cw_gen_loopback_drain_internal(cw_gen_loopback_t * loopback);
+static cw_ret_t cw_gen_loopback_flush_internal(cw_gen_loopback_t * loopback);
+static int64_t cw_gen_loopback_usecs_internal(const cw_gen_loopback_t * loopback, int64_t n_samples);
+
+
+
+
+cw_ret_t cw_gen_loopback_string(cw_gen_t * gen, cw_rec_t * rec, const char * string, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	if (NULL == gen || NULL == rec || NULL == string || NULL == decoded || NULL == n_decoded) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	*n_decoded = 0;
+	if (gen->do_dequeue_and_generate || gen->thread.running || 0 == gen->sample_rate) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "generator is started, or has no sample rate");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	const size_t len = strlen(string);
+	uint8_t * translated = (uint8_t *) malloc(len + 1);
+	if (NULL == translated) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "malloc()");
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	size_t n_translated = 0;
+	if (CW_SUCCESS != cw_translate_string(string, translated, len, &n_translated)) {
+		free(translated);
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	cw_gen_loopback_t * loopback = (cw_gen_loopback_t *) malloc(sizeof (cw_gen_loopback_t));
+	if (NULL == loopback) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "malloc()");
+		free(translated);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	loopback->gen = gen;
+	loopback->rec = rec;
+	loopback->n_edges = 0;
+	loopback->edges_start = gen->render.loopback_time;
+	loopback->edges_n_samples = 0;
+	loopback->character_start = cw_gen_loopback_usecs_internal(loopback, gen->render.loopback_time);
+	loopback->space_start = loopback->character_start;
+	loopback->decoded = decoded;
+	loopback->capacity = capacity;
+	loopback->n_decoded = 0;
+
+	/* Tones already waiting in the queue are sent before the string. */
+	cw_ret_t cwret = cw_gen_loopback_drain_internal(loopback);
+	for (size_t i = 0; i < n_translated && CW_SUCCESS == cwret; i += CW_GEN_LOOPBACK_CHUNK_SIZE) {
+		const size_t n = n_translated - i < CW_GEN_LOOPBACK_CHUNK_SIZE ? n_translated - i : CW_GEN_LOOPBACK_CHUNK_SIZE;
+		cwret = cw_gen_enqueue_translated_string(gen, translated + i, n);
+		if (CW_SUCCESS == cwret) {
+			cwret = cw_gen_loopback_drain_internal(loopback);
+		}
+	}
+	/* Tone queue is empty: the last Space has ended. */
+	if (CW_SUCCESS == cwret) {
+		cwret = cw_gen_loopback_flush_internal(loopback);
+	}
+
+	*n_decoded = loopback->n_decoded;
+	const int err = errno;
+	free(loopback);
+	free(translated);
+	errno = err;
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Take all tones from generator's tone queue, and collect them as Marks and Spaces
+
+   Tones for which generator's value is the same are merged into one
+   Mark or Space. Collected Marks and Spaces are passed to receiver
+   when there is no room for more of them.
+
+   @param[in,out] loopback loopback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if there is no room for received characters
+*/
+static cw_ret_t cw_gen_loopback_drain_internal(cw_gen_loopback_t * loopback)
+{
+	cw_gen_t * gen = loopback->gen;
+
+	int64_t n_samples = 0;
+	bool is_forever = false;
+	while (cw_gen_render_skip_tone_internal(gen, &n_samples, &is_forever)) {
+		const bool is_mark = CW_KEY_VALUE_CLOSED == gen->value_tracking.value;
+		if (0 == loopback->n_edges || loopback->edges[loopback->n_edges - 1].is_mark != is_mark) {
+			/* Previous Mark or Space has ended. */
+			if (CW_GEN_LOOPBACK_N_EDGES == loopback->n_edges
+			    && CW_SUCCESS != cw_gen_loopback_flush_internal(loopback)) {
+				return CW_FAILURE;
+			}
+			loopback->edges[loopback->n_edges].is_mark = is_mark;
+			loopback->edges[loopback->n_edges].timespan = 0.0;
+			loopback->n_edges++;
+		}
+
+		/* Timespan is calculated from virtual time, so that
+		   rounding errors don't accumulate. */
+		const int64_t start = loopback->edges_start + loopback->edges_n_samples;
+		loopback->edges[loopback->n_edges - 1].timespan += (double) (cw_gen_loopback_usecs_internal(loopback, start + n_samples) - cw_gen_loopback_usecs_internal(loopback, start));
+		loopback->edges_n_samples += n_samples;
+		gen->render.loopback_time += n_samples;
+
+		if (is_forever) {
+			/* "Forever" tone stays in the queue until next tone
+			   is enqueued. It would be dequeued again and
+			   again. */
+			break;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Pass collected Marks and Spaces to receiver
+
+   @param[in,out] loopback loopback
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if there is no room for received characters
+*/
+static cw_ret_t cw_gen_loopback_flush_internal(cw_gen_loopback_t * loopback)
+{
+	if (0 == loopback->n_edges) {
+		return CW_SUCCESS;
+	}
+
+	size_t n = 0;
+	const cw_ret_t cwret = cw_rec_receive_edges_internal(loopback->rec,
+							     cw_gen_loopback_usecs_internal(loopback, loopback->edges_start),
+							     loopback->edges, loopback->n_edges,
+							     loopback->decoded + loopback->n_decoded, loopback->capacity - loopback->n_decoded, &n,
+							     &loopback->character_start, &loopback->space_start);
+	loopback->n_decoded += n;
+
+	loopback->edges_start += loopback->edges_n_samples;
+	loopback->edges_n_samples = 0;
+	loopback->n_edges = 0;
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Convert virtual time of loopback to microseconds
+
+   @param[in] loopback loopback
+   @param[in] n_samples [samples] virtual time
+
+   @return virtual time [microseconds]
+*/
+static int64_t cw_gen_loopback_usecs_internal(const cw_gen_loopback_t * loopback, int64_t n_samples)
+{
+	return (n_samples * CW_USECS_PER_SEC) / (int64_t) loopback->gen->sample_rate;
+}
@@ -0,0 +1,605 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_memory.c
+
+   @brief Memories of generator: strings played from pre-rendered samples.
+
+   A memory (e.g. "CQ TEST" message of a contest keyer) is rendered
+   once at current parameters of generator, and is then played many
+   times without calculating its samples.
+
+   Every character of a memory is enqueued in tone queue as a single
+   tone with tone->is_clip flag, pointing to samples of the character
+   in memory's rendition. Generator takes samples of such tone from
+   the rendition the same way it takes samples of a tone from its cache
+   of tones (see cw_gen_tone_cache_get_internal()). Characters are
+   still separate tones marked as first tones of characters, so
+   cw_gen_remove_last_character() and flushing of tone queue work as
+   for any other string.
+
+   When parameters of generator change, next play of a memory renders
+   the memory again. Previous rendition may still have characters in
+   tone queue, so it is only retired, and it is deleted by generator
+   when tone queue becomes empty.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_memory.h"
+#include "libcw_gen_render.h"
+#include "libcw_tq.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen memory: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_gen_memories_t * cw_gen_memories_get_internal(cw_gen_t * gen);
+static cw_gen_memory_rendition_t * cw_gen_memory_render_internal(cw_gen_t * gen, const char * string);
+static bool cw_gen_memory_rendition_is_current_internal(cw_gen_t * gen, const cw_gen_memory_rendition_t * rendition);
+static void cw_gen_memory_rendition_delete_internal(cw_gen_memory_rendition_t ** rendition);
+static void cw_gen_memory_retire_internal(cw_gen_memories_t * memories, int memory);
+static int cw_gen_memory_add_rendition_internal(cw_gen_memories_t * memories, cw_gen_memory_rendition_t * rendition);
+
+
+
+
+cw_ret_t cw_gen_set_memory(cw_gen_t * gen, int memory, const char * string)
+{
+	if (NULL == gen || memory < 0 || memory >= CW_GEN_N_MEMORIES) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (NULL != string) {
+		const size_t len = strlen(string);
+		if (0 == len || len > CW_GEN_MEMORY_N_CHARACTERS_MAX) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		for (size_t i = 0; i < len; i++) {
+			if (!cw_character_is_valid(string[i])) {
+				errno = ENOENT;
+				return CW_FAILURE;
+			}
+		}
+	}
+
+	cw_gen_memories_t * memories = cw_gen_memories_get_internal(gen);
+	if (NULL == memories) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&memories->mutex);
+
+	char * new_string = NULL;
+	cw_gen_memory_rendition_t * rendition = NULL;
+	int slot = -1;
+	if (NULL != string) {
+		new_string = strdup(string);
+		rendition = cw_gen_memory_render_internal(gen, string);
+		if (NULL == new_string || NULL == rendition) {
+			pthread_mutex_unlock(&memories->mutex);
+			free(new_string);
+			cw_gen_memory_rendition_delete_internal(&rendition);
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		/* Rendition of the memory that is being replaced doesn't
+		   need a slot anymore if it has never been enqueued. */
+		cw_gen_memory_retire_internal(memories, memory);
+		slot = cw_gen_memory_add_rendition_internal(memories, rendition);
+		if (-1 == slot) {
+			pthread_mutex_unlock(&memories->mutex);
+			free(new_string);
+			cw_gen_memory_rendition_delete_internal(&rendition);
+			errno = EAGAIN;
+			return CW_FAILURE;
+		}
+	} else {
+		cw_gen_memory_retire_internal(memories, memory);
+	}
+
+	free(memories->strings[memory]);
+	memories->strings[memory] = new_string;
+	memories->current[memory] = slot;
+
+	pthread_mutex_unlock(&memories->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_enqueue_memory(cw_gen_t * gen, int memory)
+{
+	if (NULL == gen || memory < 0 || memory >= CW_GEN_N_MEMORIES) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_memories_t * memories = __atomic_load_n(&gen->memories, __ATOMIC_ACQUIRE);
+	if (NULL == memories) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&memories->mutex);
+
+	if (NULL == memories->strings[memory]) {
+		pthread_mutex_unlock(&memories->mutex);
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	int slot = memories->current[memory];
+	if (-1 == slot || !cw_gen_memory_rendition_is_current_internal(gen, memories->renditions[slot])) {
+		/* Parameters of generator have changed since the memory
+		   has been rendered. */
+		cw_gen_memory_rendition_t * rendition = cw_gen_memory_render_internal(gen, memories->strings[memory]);
+		if (NULL == rendition) {
+			pthread_mutex_unlock(&memories->mutex);
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		cw_gen_memory_retire_internal(memories, memory);
+		slot = cw_gen_memory_add_rendition_internal(memories, rendition);
+		if (-1 == slot) {
+			pthread_mutex_unlock(&memories->mutex);
+			cw_gen_memory_rendition_delete_internal(&rendition);
+			errno = EAGAIN;
+			return CW_FAILURE;
+		}
+		memories->current[memory] = slot;
+	}
+	cw_gen_memory_rendition_t * rendition = memories->renditions[slot];
+
+	cw_tone_t * tones = (cw_tone_t *) malloc(sizeof (cw_tone_t) * rendition->n_characters);
+	if (NULL == tones) {
+		pthread_mutex_unlock(&memories->mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to allocate %zu tones", rendition->n_characters);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	for (size_t c = 0; c < rendition->n_characters; c++) {
+		const size_t n_samples = rendition->char_starts[c + 1] - rendition->char_starts[c];
+		/* Duration is used only for accounting of tone queue (and
+		   by sound systems that don't write samples), so it is
+		   rounded up: cw_gen_render_n_samples_max_internal() must
+		   not find less samples than there are. */
+		const int duration = (int) ((n_samples * CW_USECS_PER_SEC + rendition->sample_rate - 1) / rendition->sample_rate);
+		CW_TONE_INIT(&tones[c], 0, duration, CW_SLOPE_MODE_NO_SLOPES);
+		tones[c].is_first = true;
+		tones[c].is_clip = true;
+		tones[c].clip = slot * CW_GEN_MEMORY_N_CHARACTERS_MAX + (int) c;
+	}
+	rendition->is_enqueued = true;
+
+	/* All characters or none. */
+	const cw_ret_t cwret = cw_tq_enqueue_batch_internal(gen->tq, tones, rendition->n_characters);
+
+	pthread_mutex_unlock(&memories->mutex);
+	free(tones);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Calculate count of samples of character of memory
+
+   Count of samples of @p tone is taken from rendition of memory, not
+   from tone's duration. The samples already contain slopes, so the
+   tone has no slopes of its own. Frequency of the tone is frequency
+   with which the memory has been rendered, so that the tone counts as
+   a Mark.
+
+   @param[in] gen generator
+   @param[in,out] tone tone with tone->is_clip set
+*/
+void cw_gen_memory_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone)
+{
+	tone->rising_slope_n_samples = 0;
+	tone->falling_slope_n_samples = 0;
+	tone->sample_iterator = 0;
+
+	cw_gen_memories_t * memories = __atomic_load_n(&gen->memories, __ATOMIC_ACQUIRE);
+	const cw_gen_memory_rendition_t * rendition = NULL;
+	const int c = tone->clip % CW_GEN_MEMORY_N_CHARACTERS_MAX;
+	if (NULL != memories) {
+		rendition = __atomic_load_n(&memories->renditions[tone->clip / CW_GEN_MEMORY_N_CHARACTERS_MAX], __ATOMIC_ACQUIRE);
+	}
+	if (NULL == rendition || (size_t) c >= rendition->n_characters) {
+		/* This should never happen. Play silence instead. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "no samples for character %d of memory", tone->clip);
+		tone->frequency = 0;
+		tone->n_samples = ((cw_sample_iter_t) tone->duration * gen->sample_rate) / CW_USECS_PER_SEC;
+		return;
+	}
+
+	tone->frequency = rendition->parameters.frequency;
+	tone->n_samples = (cw_sample_iter_t) (rendition->char_starts[c + 1] - rendition->char_starts[c]);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get pre-rendered samples of character of memory
+
+   @param[in] gen generator
+   @param[in] tone tone with tone->is_clip set
+
+   @return pointer to tone->n_samples samples
+   @return NULL if there are no samples of the tone
+*/
+const cw_sample_t * cw_gen_memory_get_samples_internal(const cw_gen_t * gen, const cw_tone_t * tone)
+{
+	cw_gen_memories_t * memories = __atomic_load_n(&gen->memories, __ATOMIC_ACQUIRE);
+	if (NULL == memories) {
+		return NULL;
+	}
+	const cw_gen_memory_rendition_t * rendition = __atomic_load_n(&memories->renditions[tone->clip / CW_GEN_MEMORY_N_CHARACTERS_MAX], __ATOMIC_ACQUIRE);
+	const int c = tone->clip % CW_GEN_MEMORY_N_CHARACTERS_MAX;
+	if (NULL == rendition || (size_t) c >= rendition->n_characters) {
+		return NULL;
+	}
+
+	return rendition->samples + rendition->char_starts[c];
+}
+
+
+
+
+/**
+   @brief Delete retired renditions of memories
+
+   The function must be called by generator (generator's thread, or
+   thread rendering samples of generator) when generator's tone queue
+   is empty and generator doesn't play any tone.
+
+   @param[in] gen generator
+*/
+void cw_gen_memories_release_retired_internal(cw_gen_t * gen)
+{
+	cw_gen_memories_t * memories = __atomic_load_n(&gen->memories, __ATOMIC_ACQUIRE);
+	if (NULL == memories || 0 == __atomic_load_n(&memories->n_retired, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	pthread_mutex_lock(&memories->mutex);
+	/* Retired renditions are never enqueued again, so if the queue
+	   is empty now, none of their characters is in it. */
+	if (0 == cw_tq_length_internal(gen->tq)) {
+		for (int i = 0; i < CW_GEN_MEMORY_N_RENDITIONS; i++) {
+			cw_gen_memory_rendition_t * rendition = memories->renditions[i];
+			if (NULL != rendition && rendition->is_retired) {
+				__atomic_store_n(&memories->renditions[i], NULL, __ATOMIC_RELEASE);
+				cw_gen_memory_rendition_delete_internal(&rendition);
+			}
+		}
+		__atomic_store_n(&memories->n_retired, 0, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&memories->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Delete memories of generator
+
+   Generator's thread must be already stopped.
+
+   @param[in] gen generator
+*/
+void cw_gen_memories_delete_internal(cw_gen_t * gen)
+{
+	cw_gen_memories_t * memories = gen->memories;
+	if (NULL == memories) {
+		return;
+	}
+
+	for (int i = 0; i < CW_GEN_N_MEMORIES; i++) {
+		free(memories->strings[i]);
+	}
+	for (int i = 0; i < CW_GEN_MEMORY_N_RENDITIONS; i++) {
+		cw_gen_memory_rendition_delete_internal(&memories->renditions[i]);
+	}
+	pthread_mutex_destroy(&memories->mutex);
+	free(memories);
+	gen->memories = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get memories of generator, allocate them if necessary
+
+   @param[in] gen generator
+
+   @return memories of generator on success
+   @return NULL on failure to allocate memories
+*/
+static cw_gen_memories_t * cw_gen_memories_get_internal(cw_gen_t * gen)
+{
+	cw_gen_memories_t * memories = __atomic_load_n(&gen->memories, __ATOMIC_ACQUIRE);
+	if (NULL != memories) {
+		return memories;
+	}
+
+	cw_gen_memories_t * new_memories = calloc(1, sizeof (cw_gen_memories_t));
+	if (NULL == new_memories) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	for (int i = 0; i < CW_GEN_N_MEMORIES; i++) {
+		new_memories->current[i] = -1;
+	}
+	pthread_mutex_init(&new_memories->mutex, NULL);
+
+	/* Generator's thread sees the memories only after they have
+	   been fully initialized. */
+	if (__atomic_compare_exchange_n(&gen->memories, &memories, new_memories, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return new_memories;
+	}
+
+	/* Another thread has been first. */
+	pthread_mutex_destroy(&new_memories->mutex);
+	free(new_memories);
+	return memories;
+}
+
+
+
+
+/**
+   @brief Render samples of string at current parameters of generator
+
+   Characters are rendered one after another by a copy of @p gen, each
+   one as if it was enqueued with cw_gen_enqueue_character() in empty
+   tone queue. Rendering starts with zero phase and without gain or
+   chirp modulation, so that the samples don't depend on what @p gen
+   has been playing before.
+
+   @param[in] gen generator
+   @param[in] string valid string to render
+
+   @return new rendition on success
+   @return NULL on failure
+*/
+static cw_gen_memory_rendition_t * cw_gen_memory_render_internal(cw_gen_t * gen, const char * string)
+{
+	cw_gen_memory_rendition_t * rendition = calloc(1, sizeof (cw_gen_memory_rendition_t));
+	if (NULL == rendition) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	rendition->n_characters = strlen(string);
+	rendition->char_starts = (size_t *) malloc(sizeof (size_t) * (rendition->n_characters + 1));
+	cw_gen_t * copy = cw_gen_render_copy_gen_internal(gen);
+	if (NULL == rendition->char_starts || NULL == copy) {
+		cw_gen_delete(&copy);
+		cw_gen_memory_rendition_delete_internal(&rendition);
+		return NULL;
+	}
+
+	cw_gen_get_parameters(gen, &rendition->parameters);
+	rendition->sample_rate = gen->sample_rate;
+	rendition->slope_shape = gen->tone_slope.shape;
+	rendition->slope_duration = gen->tone_slope.duration;
+	rendition->oscillator = gen->oscillator;
+
+	copy->phase_offset = 0.0F;
+	copy->phase_acc = 0;
+	copy->modulation.is_pending_gain = false;
+	copy->modulation.is_pending_chirp = false;
+	copy->modulation.gain = CW_GEN_GAIN_ONE;
+	copy->modulation.gain_target = CW_GEN_GAIN_ONE;
+	copy->modulation.gain_step = 0;
+	copy->modulation.gain_n_remaining = 0;
+	copy->modulation.chirp_offset = 0;
+	copy->modulation.chirp_n_samples = 0;
+
+	size_t capacity = 0;
+	size_t n_samples = 0;
+	for (size_t c = 0; c < rendition->n_characters; c++) {
+		rendition->char_starts[c] = n_samples;
+		if (CW_SUCCESS != cw_gen_enqueue_character(copy, string[c])) {
+			cw_gen_delete(&copy);
+			cw_gen_memory_rendition_delete_internal(&rendition);
+			return NULL;
+		}
+		const int n_max = cw_gen_render_n_samples_max_internal(copy);
+		if (n_samples + (size_t) n_max > capacity) {
+			const size_t new_capacity = 2 * capacity + (size_t) n_max;
+			cw_sample_t * new_samples = (cw_sample_t *) realloc(rendition->samples, sizeof (cw_sample_t) * new_capacity);
+			if (NULL == new_samples) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to allocate %zu samples", new_capacity);
+				cw_gen_delete(&copy);
+				cw_gen_memory_rendition_delete_internal(&rendition);
+				return NULL;
+			}
+			rendition->samples = new_samples;
+			capacity = new_capacity;
+		}
+		n_samples += (size_t) cw_gen_render_internal(copy, rendition->samples + n_samples, n_max);
+	}
+	rendition->char_starts[rendition->n_characters] = n_samples;
+
+	cw_gen_delete(&copy);
+
+	return rendition;
+}
+
+
+
+
+/**
+   @brief Check if rendition of memory has been made at current parameters of generator
+
+   @param[in] gen generator
+   @param[in] rendition rendition of memory
+
+   @return true if samples of the rendition are valid for @p gen
+   @return false otherwise
+*/
+static bool cw_gen_memory_rendition_is_current_internal(cw_gen_t * gen, const cw_gen_memory_rendition_t * rendition)
+{
+	cw_gen_parameters_t parameters;
+	cw_gen_get_parameters(gen, &parameters);
+
+	return parameters.speed == rendition->parameters.speed
+		&& parameters.frequency == rendition->parameters.frequency
+		&& parameters.volume == rendition->parameters.volume
+		&& parameters.gap == rendition->parameters.gap
+		&& parameters.weighting == rendition->parameters.weighting
+		&& gen->sample_rate == rendition->sample_rate
+		&& gen->tone_slope.shape == rendition->slope_shape
+		&& gen->tone_slope.duration == rendition->slope_duration
+		&& (int) gen->oscillator == rendition->oscillator;
+}
+
+
+
+
+/**
+   @brief Delete rendition of memory
+
+   @param[in,out] rendition pointer to rendition to delete
+*/
+static void cw_gen_memory_rendition_delete_internal(cw_gen_memory_rendition_t ** rendition)
+{
+	if (NULL == *rendition) {
+		return;
+	}
+	free((*rendition)->samples);
+	free((*rendition)->char_starts);
+	free(*rendition);
+	*rendition = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Retire current rendition of memory
+
+   A rendition that has never been enqueued is deleted immediately.
+   Other renditions are deleted by generator when its tone queue
+   becomes empty (see cw_gen_memories_release_retired_internal()).
+
+   Caller must hold memories->mutex.
+
+   @param[in] memories memories of generator
+   @param[in] memory index of memory
+*/
+static void cw_gen_memory_retire_internal(cw_gen_memories_t * memories, int memory)
+{
+	const int slot = memories->current[memory];
+	if (-1 == slot) {
+		return;
+	}
+	memories->current[memory] = -1;
+
+	cw_gen_memory_rendition_t * rendition = memories->renditions[slot];
+	if (rendition->is_enqueued) {
+		rendition->is_retired = true;
+		__atomic_add_fetch(&memories->n_retired, 1, __ATOMIC_RELEASE);
+	} else {
+		__atomic_store_n(&memories->renditions[slot], NULL, __ATOMIC_RELEASE);
+		cw_gen_memory_rendition_delete_internal(&rendition);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Put rendition in free slot of table of renditions
+
+   Caller must hold memories->mutex.
+
+   @param[in] memories memories of generator
+   @param[in] rendition rendition to add
+
+   @return index of slot on success
+   @return -1 if there is no free slot
+*/
+static int cw_gen_memory_add_rendition_internal(cw_gen_memories_t * memories, cw_gen_memory_rendition_t * rendition)
+{
+	for (int i = 0; i < CW_GEN_MEMORY_N_RENDITIONS; i++) {
+		if (NULL == memories->renditions[i]) {
+			__atomic_store_n(&memories->renditions[i], rendition, __ATOMIC_RELEASE);
+			return i;
+		}
+	}
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+		      MSG_PREFIX "too many renditions of memories are waiting for end of playback");
+	return -1;
+}
@@ -0,0 +1,105 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_MEMORY
+#define H_LIBCW_GEN_MEMORY
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_tq.h"
+
+
+
+
+/* Count of memories of generator (see cw_gen_set_memory()). */
+#define CW_GEN_N_MEMORIES 16
+
+/* Maximal count of characters in one memory. */
+#define CW_GEN_MEMORY_N_CHARACTERS_MAX 1024
+
+/* Count of renditions of memories that may exist at the same time:
+   current renditions of all memories, and renditions replaced after
+   change of generator's parameters whose characters may still be in
+   tone queue. Renditions are identified in tone queue by index in
+   table of renditions, so CW_GEN_MEMORY_N_RENDITIONS *
+   CW_GEN_MEMORY_N_CHARACTERS_MAX must fit in 16 bits (see
+   cw_tone_desc_t). */
+#define CW_GEN_MEMORY_N_RENDITIONS 64
+
+
+
+
+typedef struct cw_gen_memories_struct cw_gen_memories_t;
+
+
+
+
+/* Samples of a memory rendered at given parameters of generator. */
+typedef struct {
+	/* Parameters of generator for which the samples have been
+	   rendered. */
+	cw_gen_parameters_t parameters;
+	unsigned int sample_rate;
+	int slope_shape;
+	int slope_duration;
+	int oscillator;
+
+	cw_sample_t * samples;
+
+	/* Character c is samples[char_starts[c]] to
+	   samples[char_starts[c + 1] - 1], including space that follows
+	   the character. */
+	size_t * char_starts;
+	size_t n_characters;
+
+	/* Characters of the rendition have been enqueued in tone
+	   queue. */
+	bool is_enqueued;
+
+	/* The rendition is no longer current rendition of any memory. It
+	   is deleted when generator's tone queue becomes empty. */
+	bool is_retired;
+} cw_gen_memory_rendition_t;
+
+
+
+
+/* All fields are protected by ::mutex. Generator's thread reads
+   ::renditions[] without the mutex: a rendition is never deleted
+   while its characters are in tone queue. */
+struct cw_gen_memories_struct {
+	char * strings[CW_GEN_N_MEMORIES];
+
+	/* Index of current rendition of a memory in ::renditions[], -1
+	   when there is no such rendition. */
+	int current[CW_GEN_N_MEMORIES];
+
+	cw_gen_memory_rendition_t * renditions[CW_GEN_MEMORY_N_RENDITIONS];
+	int n_retired;      /* Count of retired renditions. */
+
+	pthread_mutex_t mutex;
+};
+
+
+
+
+void cw_gen_memory_calculate_samples_size_internal(const cw_gen_t * gen, cw_tone_t * tone);
+const cw_sample_t * cw_gen_memory_get_samples_internal(const cw_gen_t * gen, const cw_tone_t * tone);
+void cw_gen_memories_release_retired_internal(cw_gen_t * gen);
+void cw_gen_memories_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_MEMORY */
@@ -0,0 +1,380 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_monitor.c
+
+   @brief Monitor of timing of Marks and Spaces played by generator.
+
+   Generator reports each change of its value (start of Mark, start of
+   Space) together with the time at which the change will be heard,
+   calculated from samples waiting in generator's buffers and from
+   delay of sound device. Differences between consecutive times are
+   durations of Marks and Spaces as played by the device, and are
+   compared with ideal durations of generator.
+
+   Monitor is allocated when it is enabled for the first time, and is
+   freed together with generator. Generator's thread doesn't take the
+   monitor's mutex as long as the monitor is not enabled.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_monitor.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen monitor: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_gen_timing_monitor_t * cw_gen_timing_monitor_get_internal(cw_gen_t * gen);
+static void cw_gen_timing_monitor_reset_internal(cw_gen_timing_monitor_t * monitor);
+static bool cw_gen_timing_classify_internal(const cw_gen_durations_t * durations, cw_key_value_t value, int64_t duration, cw_gen_timing_element_t * element, int * ideal);
+
+
+
+
+cw_ret_t cw_gen_enable_timing_monitor(cw_gen_t * gen, int threshold, cw_gen_timing_alarm_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen || threshold < 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_timing_monitor_t * monitor = cw_gen_timing_monitor_get_internal(gen);
+	if (NULL == monitor) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+	monitor->threshold = threshold;
+	monitor->callback_func = callback_func;
+	monitor->callback_arg = callback_arg;
+	if (!__atomic_load_n(&monitor->enabled, __ATOMIC_RELAXED)) {
+		/* Don't measure a Space that has started before the
+		   monitor has been enabled. */
+		monitor->has_previous = false;
+	}
+	__atomic_store_n(&monitor->enabled, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_disable_timing_monitor(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		return;
+	}
+	cw_gen_timing_monitor_t * monitor = __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE);
+	if (NULL == monitor) {
+		return;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+	__atomic_store_n(&monitor->enabled, false, __ATOMIC_RELEASE);
+	monitor->callback_func = NULL;
+	monitor->callback_arg = NULL;
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_get_timing_statistics(cw_gen_t * gen, cw_gen_timing_statistics_t * statistics)
+{
+	if (NULL == gen || NULL == statistics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	memset(statistics, 0, sizeof (cw_gen_timing_statistics_t));
+
+	cw_gen_timing_monitor_t * monitor = __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE);
+	if (NULL == monitor) {
+		return CW_SUCCESS;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+	for (int i = 0; i < CW_GEN_TIMING_N_ELEMENTS; i++) {
+		const cw_gen_timing_accumulator_t * acc = &monitor->accumulators[i];
+		cw_gen_timing_error_statistics_t * result = &statistics->elements[i];
+		result->count = acc->count;
+		result->n_alarms = acc->n_alarms;
+		if (0 == acc->count) {
+			continue;
+		}
+		result->error_min = acc->error_min;
+		result->error_max = acc->error_max;
+		const double mean = acc->error_sum / (double) acc->count;
+		const double variance = acc->error_sum_sq / (double) acc->count - mean * mean;
+		result->error_mean = (float) mean;
+		result->jitter = variance > 0.0 ? (float) sqrt(variance) : 0.0F;
+	}
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_reset_timing_statistics(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		return;
+	}
+	cw_gen_timing_monitor_t * monitor = __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE);
+	if (NULL == monitor) {
+		return;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+	cw_gen_timing_monitor_reset_internal(monitor);
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Register change of generator's value in timing monitor
+
+   Called by generator's thread each time generator's value changes.
+   Duration of Mark or Space that has ended with the change is
+   compared with ideal duration, and added to statistics.
+
+   @param[in] gen generator
+   @param[in] value new value of generator
+   @param[in] playback_time [microseconds] time at which the change will be heard
+*/
+void cw_gen_timing_monitor_update_internal(cw_gen_t * gen, cw_key_value_t value, int64_t playback_time)
+{
+	cw_gen_timing_monitor_t * monitor = __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE);
+	if (NULL == monitor || !__atomic_load_n(&monitor->enabled, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	pthread_mutex_lock(&monitor->mutex);
+
+	const bool has_previous = monitor->has_previous;
+	const cw_key_value_t previous_value = monitor->previous_value;
+	const int64_t duration = playback_time - monitor->previous_time;
+	monitor->has_previous = true;
+	monitor->previous_value = value;
+	monitor->previous_time = playback_time;
+
+	cw_gen_timing_element_t element = CW_GEN_TIMING_DOT;
+	int ideal = 0;
+	if (has_previous
+	    && previous_value != value
+	    && cw_gen_timing_classify_internal(gen->durations, previous_value, duration, &element, &ideal)) {
+
+		const int32_t error = (int32_t) (duration - ideal);
+		cw_gen_timing_accumulator_t * acc = &monitor->accumulators[element];
+		if (0 == acc->count || error < acc->error_min) {
+			acc->error_min = error;
+		}
+		if (0 == acc->count || error > acc->error_max) {
+			acc->error_max = error;
+		}
+		acc->error_sum += error;
+		acc->error_sum_sq += (double) error * error;
+		acc->count++;
+
+		if (abs(error) > monitor->threshold) {
+			acc->n_alarms++;
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+				      MSG_PREFIX "duration of element %d is %d us, ideal is %d us", element, (int) duration, ideal);
+			if (monitor->callback_func) {
+				monitor->callback_func(monitor->callback_arg, element, ideal, (int) duration);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&monitor->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Delete timing monitor of generator
+
+   Generator's thread must not be running.
+
+   @param[in] gen generator
+*/
+void cw_gen_timing_monitor_delete_internal(cw_gen_t * gen)
+{
+	cw_gen_timing_monitor_t * monitor = gen->timing_monitor;
+	if (NULL == monitor) {
+		return;
+	}
+	pthread_mutex_destroy(&monitor->mutex);
+	free(monitor);
+	gen->timing_monitor = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get timing monitor of generator, allocate it if necessary
+
+   @param[in] gen generator
+
+   @return timing monitor on success
+   @return NULL on failure
+*/
+static cw_gen_timing_monitor_t * cw_gen_timing_monitor_get_internal(cw_gen_t * gen)
+{
+	cw_gen_timing_monitor_t * monitor = __atomic_load_n(&gen->timing_monitor, __ATOMIC_ACQUIRE);
+	if (NULL != monitor) {
+		return monitor;
+	}
+
+	cw_gen_timing_monitor_t * new_monitor = calloc(1, sizeof (cw_gen_timing_monitor_t));
+	if (NULL == new_monitor) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	pthread_mutex_init(&new_monitor->mutex, NULL);
+
+	/* Generator's thread sees the monitor only after it has been
+	   fully initialized. */
+	if (__atomic_compare_exchange_n(&gen->timing_monitor, &monitor, new_monitor, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return new_monitor;
+	} else {
+		/* Another thread has been first. */
+		pthread_mutex_destroy(&new_monitor->mutex);
+		free(new_monitor);
+		return monitor;
+	}
+}
+
+
+
+
+/**
+   @brief Clear statistics of timing monitor
+
+   Caller must hold monitor's mutex.
+
+   @param[in/out] monitor timing monitor
+*/
+static void cw_gen_timing_monitor_reset_internal(cw_gen_timing_monitor_t * monitor)
+{
+	memset(monitor->accumulators, 0, sizeof (monitor->accumulators));
+	monitor->has_previous = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Find type of Mark or Space with ideal duration nearest to given duration
+
+   @param[in] durations ideal durations of generator
+   @param[in] value value of generator during the Mark or Space
+   @param[in] duration [microseconds] measured duration of the Mark or Space
+   @param[out] element type of the Mark or Space
+   @param[out] ideal [microseconds] ideal duration of @p element
+
+   @return true if the Mark or Space should be measured
+   @return false if it is too long to be a part of Morse code
+*/
+static bool cw_gen_timing_classify_internal(const cw_gen_durations_t * durations, cw_key_value_t value, int64_t duration, cw_gen_timing_element_t * element, int * ideal)
+{
+	cw_gen_timing_element_t candidates[3];
+	int ideals[3];
+	int n_candidates = 0;
+	if (CW_KEY_VALUE_CLOSED == value) {
+		candidates[0] = CW_GEN_TIMING_DOT;
+		ideals[0] = durations->dot_duration;
+		candidates[1] = CW_GEN_TIMING_DASH;
+		ideals[1] = durations->dash_duration;
+		n_candidates = 2;
+	} else {
+		candidates[0] = CW_GEN_TIMING_IMS;
+		ideals[0] = durations->ims_duration;
+		candidates[1] = CW_GEN_TIMING_ICS;
+		ideals[1] = durations->ics_duration + durations->additional_space_duration;
+		candidates[2] = CW_GEN_TIMING_IWS;
+		ideals[2] = durations->iws_duration + durations->additional_space_duration + durations->adjustment_space_duration;
+		n_candidates = 3;
+	}
+
+	/* Longest candidate is the last one. */
+	if (duration > 2 * (int64_t) ideals[n_candidates - 1]) {
+		return false;
+	}
+
+	int best = 0;
+	for (int i = 1; i < n_candidates; i++) {
+		if (llabs(duration - ideals[i]) < llabs(duration - ideals[best])) {
+			best = i;
+		}
+	}
+	*element = candidates[best];
+	*ideal = ideals[best];
+
+	return true;
+}
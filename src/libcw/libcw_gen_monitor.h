@@ -0,0 +1,67 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_MONITOR
+#define H_LIBCW_GEN_MONITOR
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Accumulated errors of durations of one type of Marks or Spaces. */
+typedef struct {
+	uint64_t count;
+	uint64_t n_alarms;
+	int32_t error_min;    /* [microseconds] */
+	int32_t error_max;    /* [microseconds] */
+	double error_sum;     /* [microseconds] */
+	double error_sum_sq;  /* [microseconds^2] */
+} cw_gen_timing_accumulator_t;
+
+
+
+
+/* Timing monitor of generator, see cw_gen_enable_timing_monitor().
+   All fields except for ::enabled are protected by ::mutex. Alarm
+   callback is called with the mutex held, so that no alarm is raised
+   after the monitor has been disabled. */
+typedef struct cw_gen_timing_monitor_struct {
+	bool enabled;          /* Accessed atomically. */
+
+	int threshold;         /* [microseconds] */
+	cw_gen_timing_alarm_callback_t callback_func;
+	void * callback_arg;
+
+	/* Last change of generator's value. */
+	bool has_previous;
+	cw_key_value_t previous_value;
+	int64_t previous_time;  /* [microseconds] On generator's playback timeline. */
+
+	cw_gen_timing_accumulator_t accumulators[CW_GEN_TIMING_N_ELEMENTS];
+
+	pthread_mutex_t mutex;
+} cw_gen_timing_monitor_t;
+
+
+
+
+void cw_gen_timing_monitor_update_internal(cw_gen_t * gen, cw_key_value_t value, int64_t playback_time);
+void cw_gen_timing_monitor_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_MONITOR */
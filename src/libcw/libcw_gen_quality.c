@@ -0,0 +1,304 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+
+/**
+   @file libcw_gen_quality.c
+
+   @brief Scaling of quality of synthesis to load of generator's thread.
+
+   After each buffer is written to sound device, time spent by
+   generator on calculating and post-processing samples of the buffer
+   is compared with duration of the buffer. Mean of this load over a
+   few buffers decides whether generator should use cheaper synthesis
+   (oscillator engine with table of sine values, no post-processing),
+   or whether it can go back to full quality.
+
+   Current quality is kept in generator (cw_gen_t::quality), and is
+   read by generator's thread when it calculates samples, and by
+   thread of generator's pipeline when it post-processes them.
+   Quality scaling is allocated when it is enabled for the first time,
+   and is freed together with generator.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_quality.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen quality: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_gen_quality_scaling_t * cw_gen_quality_scaling_get_internal(cw_gen_t * gen);
+
+
+
+
+cw_ret_t cw_gen_enable_quality_scaling(cw_gen_t * gen, const cw_gen_quality_policy_t * policy, cw_gen_quality_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen || NULL == policy
+	    || policy->restore_load <= 0 || policy->restore_load >= policy->degrade_load
+	    || policy->n_buffers <= 0) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_quality_scaling_t * scaling = cw_gen_quality_scaling_get_internal(gen);
+	if (NULL == scaling) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&scaling->mutex);
+	scaling->policy = *policy;
+	scaling->callback_func = callback_func;
+	scaling->callback_arg = callback_arg;
+	scaling->load_sum = 0.0;
+	scaling->n_loads = 0;
+	__atomic_store_n(&scaling->enabled, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&scaling->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_disable_quality_scaling(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		return;
+	}
+	cw_gen_quality_scaling_t * scaling = __atomic_load_n(&gen->quality_scaling, __ATOMIC_ACQUIRE);
+	if (NULL == scaling) {
+		return;
+	}
+
+	pthread_mutex_lock(&scaling->mutex);
+	__atomic_store_n(&scaling->enabled, false, __ATOMIC_RELEASE);
+	scaling->callback_func = NULL;
+	scaling->callback_arg = NULL;
+	/* Generator's thread changes quality only under the mutex, and
+	   only when scaling is enabled. */
+	__atomic_store_n(&gen->quality, CW_GEN_QUALITY_FULL, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&scaling->mutex);
+
+	return;
+}
+
+
+
+
+cw_gen_quality_t cw_gen_get_quality(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		return CW_GEN_QUALITY_FULL;
+	}
+	return __atomic_load_n(&gen->quality, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Add load of buffer written to sound device to quality scaling
+
+   Called by generator's thread for each buffer written to sound
+   device. When enough buffers have been measured, quality of synthesis
+   is lowered or raised by one level, according to mean load.
+
+   @param[in] gen generator
+   @param[in] synthesis_ns [nanoseconds] time of calculating and post-processing samples of the buffer
+   @param[in] n_samples count of samples in the buffer
+*/
+void cw_gen_quality_update_internal(cw_gen_t * gen, uint64_t synthesis_ns, int n_samples)
+{
+	cw_gen_quality_scaling_t * scaling = __atomic_load_n(&gen->quality_scaling, __ATOMIC_ACQUIRE);
+	if (NULL == scaling || !__atomic_load_n(&scaling->enabled, __ATOMIC_ACQUIRE)
+	    || n_samples <= 0 || 0 == gen->sample_rate) {
+		return;
+	}
+
+	const double buffer_ns = (double) n_samples * 1000000000.0 / (double) gen->sample_rate;
+	const double load = 100.0 * (double) synthesis_ns / buffer_ns;
+
+	pthread_mutex_lock(&scaling->mutex);
+	if (!__atomic_load_n(&scaling->enabled, __ATOMIC_RELAXED)) {
+		pthread_mutex_unlock(&scaling->mutex);
+		return;
+	}
+
+	scaling->load_sum += load;
+	scaling->n_loads++;
+	if (scaling->n_loads < scaling->policy.n_buffers) {
+		pthread_mutex_unlock(&scaling->mutex);
+		return;
+	}
+
+	const double mean_load = scaling->load_sum / scaling->n_loads;
+	scaling->load_sum = 0.0;
+	scaling->n_loads = 0;
+
+	const cw_gen_quality_t quality = __atomic_load_n(&gen->quality, __ATOMIC_RELAXED);
+	cw_gen_quality_t new_quality = quality;
+	if (mean_load > scaling->policy.degrade_load && CW_GEN_QUALITY_MINIMAL != quality) {
+		new_quality = (cw_gen_quality_t) (quality + 1);
+	} else if (mean_load < scaling->policy.restore_load && CW_GEN_QUALITY_FULL != quality) {
+		new_quality = (cw_gen_quality_t) (quality - 1);
+	}
+
+	if (new_quality != quality) {
+		__atomic_store_n(&gen->quality, new_quality, __ATOMIC_RELAXED);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+			      MSG_PREFIX "load is %.1f%%, quality changed from %d to %d", mean_load, quality, new_quality);
+		if (scaling->callback_func) {
+			scaling->callback_func(scaling->callback_arg, new_quality, (int) lround(mean_load));
+		}
+	}
+
+	pthread_mutex_unlock(&scaling->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get oscillator engine that generator should use at current quality
+
+   Fixed-point engine is never replaced: it is the cheapest one, and
+   it keeps phase of sine wave in its own variable.
+
+   @param[in] gen generator
+
+   @return oscillator engine
+*/
+cw_gen_oscillator_t cw_gen_quality_oscillator_internal(const cw_gen_t * gen)
+{
+	if (CW_GEN_QUALITY_FULL == __atomic_load_n(&gen->quality, __ATOMIC_RELAXED)
+	    || CW_GEN_OSCILLATOR_FIXED_POINT == gen->oscillator) {
+		return gen->oscillator;
+	}
+	return CW_GEN_OSCILLATOR_TABLE;
+}
+
+
+
+
+/**
+   @brief Check whether post-processing is bypassed at current quality
+
+   @param[in] gen generator
+
+   @return true if stages of post-processing should be skipped
+   @return false otherwise
+*/
+bool cw_gen_quality_dsp_bypassed_internal(const cw_gen_t * gen)
+{
+	return CW_GEN_QUALITY_MINIMAL == __atomic_load_n(&gen->quality, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Delete quality scaling of generator
+
+   Generator's thread must not be running.
+
+   @param[in] gen generator
+*/
+void cw_gen_quality_delete_internal(cw_gen_t * gen)
+{
+	cw_gen_quality_scaling_t * scaling = gen->quality_scaling;
+	if (NULL == scaling) {
+		return;
+	}
+	pthread_mutex_destroy(&scaling->mutex);
+	free(scaling);
+	gen->quality_scaling = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get quality scaling of generator, allocate it if necessary
+
+   @param[in] gen generator
+
+   @return quality scaling on success
+   @return NULL on failure
+*/
+static cw_gen_quality_scaling_t * cw_gen_quality_scaling_get_internal(cw_gen_t * gen)
+{
+	cw_gen_quality_scaling_t * scaling = __atomic_load_n(&gen->quality_scaling, __ATOMIC_ACQUIRE);
+	if (NULL != scaling) {
+		return scaling;
+	}
+
+	cw_gen_quality_scaling_t * new_scaling = calloc(1, sizeof (cw_gen_quality_scaling_t));
+	if (NULL == new_scaling) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	pthread_mutex_init(&new_scaling->mutex, NULL);
+
+	/* Generator's thread sees quality scaling only after it has been
+	   fully initialized. */
+	if (__atomic_compare_exchange_n(&gen->quality_scaling, &scaling, new_scaling, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return new_scaling;
+	} else {
+		/* Another thread has been first. */
+		pthread_mutex_destroy(&new_scaling->mutex);
+		free(new_scaling);
+		return scaling;
+	}
+}
@@ -0,0 +1,54 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_QUALITY
+#define H_LIBCW_GEN_QUALITY
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Quality scaling of generator, see cw_gen_enable_quality_scaling().
+
+   ::policy and callback are protected by ::mutex. Measurement of
+   load is done only by generator's thread, also under ::mutex, so
+   that no event is reported after quality scaling has been
+   disabled. */
+typedef struct cw_gen_quality_scaling_struct {
+	bool enabled;          /* Accessed atomically. */
+	cw_gen_quality_policy_t policy;
+	cw_gen_quality_callback_t callback_func;
+	void * callback_arg;
+
+	/* Load of buffers measured since last decision. */
+	double load_sum;       /* [percents] */
+	int n_loads;
+
+	pthread_mutex_t mutex;
+} cw_gen_quality_scaling_t;
+
+
+
+
+void cw_gen_quality_update_internal(cw_gen_t * gen, uint64_t synthesis_ns, int n_samples);
+cw_gen_oscillator_t cw_gen_quality_oscillator_internal(const cw_gen_t * gen);
+bool cw_gen_quality_dsp_bypassed_internal(const cw_gen_t * gen);
+void cw_gen_quality_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_QUALITY */
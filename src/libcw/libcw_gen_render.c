@@ -0,0 +1,495 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_render.c
+
+   @brief Rendering of long strings by a few threads.
+
+   Samples of a tone depend on parameters of the tone and on a small
+   state carried over from previous tones: phase of sine wave, and
+   progress of gain and chirp modulation (cw_gen_render_state_t).
+   Durations of tones don't depend on the state. So a string can be
+   split at word boundaries into segments, and each segment can be
+   rendered independently by a copy of generator, as long as the copy
+   starts with the state that the generator would have at the
+   beginning of the segment.
+
+   The states and offsets of samples of segments are found in one
+   quick pass through all tones of the string, without calculating
+   samples (cw_gen_render_skip_internal()). Phase at the end of a
+   cached tone is known from the cache of tones, and Spaces don't
+   change the phase, so for most texts the pass costs almost nothing.
+   Only tones that can't be cached (e.g. with gain or chirp modulation)
+   are calculated in the pass, and then once more by a worker.
+
+   Segments are then rendered in parallel, directly to their place in
+   array of samples of whole string.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_render.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen render: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static bool cw_gen_render_states_equal_internal(const cw_gen_render_state_t * a, const cw_gen_render_state_t * b);
+static cw_ret_t cw_gen_render_measure_words_internal(cw_gen_t * gen, const uint8_t * translated, const size_t * word_starts, size_t n_words, size_t * word_n_samples, cw_gen_render_state_t * word_states);
+static cw_ret_t cw_gen_render_segment_internal(cw_gen_render_segment_t * segment);
+static void * cw_gen_render_segment_thread_internal(void * arg);
+
+
+
+
+cw_ret_t cw_gen_render_string(cw_gen_t * gen, const char * string, int n_workers, cw_sample_t ** samples, size_t * n_samples)
+{
+	if (NULL == gen || NULL == string || NULL == samples || NULL == n_samples
+	    || n_workers < 0 || n_workers > CW_GEN_RENDER_N_WORKERS_MAX) {
+
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (gen->do_dequeue_and_generate || gen->thread.running
+	    || gen->render.has_tone || cw_tq_is_nonempty_internal(gen->tq)) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "generator is started, or its tone queue isn't empty");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (0 == n_workers) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_workers = n_cpus < 1 ? 1 : (n_cpus > CW_GEN_RENDER_N_WORKERS_MAX ? CW_GEN_RENDER_N_WORKERS_MAX : (int) n_cpus);
+	}
+
+	const size_t len = strlen(string);
+	uint8_t * translated = (uint8_t *) malloc(len + 1);
+	size_t * word_starts = (size_t *) malloc(sizeof (size_t) * (len + 1));
+	size_t * word_n_samples = (size_t *) malloc(sizeof (size_t) * (len + 1));
+	cw_gen_render_state_t * word_states = (cw_gen_render_state_t *) malloc(sizeof (cw_gen_render_state_t) * (len + 1));
+	cw_gen_render_segment_t * segments = (cw_gen_render_segment_t *) calloc((size_t) n_workers, sizeof (cw_gen_render_segment_t));
+	if (NULL == translated || NULL == word_starts || NULL == word_n_samples || NULL == word_states || NULL == segments) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "malloc()");
+		free(translated);
+		free(word_starts);
+		free(word_n_samples);
+		free(word_states);
+		free(segments);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	cw_ret_t cwret = CW_SUCCESS;
+	int err = ENOMEM;
+	size_t n_translated = 0;
+	if (CW_SUCCESS != cw_translate_string(string, translated, len, &n_translated)) {
+		cwret = CW_FAILURE;
+		err = ENOENT;
+	}
+
+	/* A word is a run of characters followed by a run of spaces, so
+	   that inter-word-space ends the word, and the next word starts
+	   with a mark. */
+	size_t n_words = 0;
+	for (size_t i = 0; i < n_translated; i++) {
+		if (0 == i || (CW_TRANSLATED_SPACE == translated[i - 1] && CW_TRANSLATED_SPACE != translated[i])) {
+			word_starts[n_words++] = i;
+		}
+	}
+	word_starts[n_words] = n_translated;
+
+	/* States of generator between words, and counts of samples of
+	   words. word_states[w] is state at beginning of word w. */
+	cw_gen_t * measuring_gen = NULL;
+	if (CW_SUCCESS == cwret) {
+		measuring_gen = cw_gen_render_copy_gen_internal(gen);
+		if (NULL == measuring_gen) {
+			cwret = CW_FAILURE;
+		}
+	}
+	if (CW_SUCCESS == cwret) {
+		cwret = cw_gen_render_measure_words_internal(measuring_gen, translated, word_starts, n_words, word_n_samples, word_states);
+	}
+	size_t total = 0;
+	for (size_t w = 0; w < n_words && CW_SUCCESS == cwret; w++) {
+		total += word_n_samples[w];
+	}
+
+	cw_sample_t * result = NULL;
+	if (CW_SUCCESS == cwret) {
+		result = (cw_sample_t *) malloc(sizeof (cw_sample_t) * (total > 0 ? total : 1));
+		if (NULL == result) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to allocate %zu samples", total);
+			cwret = CW_FAILURE;
+		}
+	}
+
+	/* Segments have similar count of samples. */
+	int n_segments = 0;
+	size_t first_word = 0;
+	size_t offset = 0;
+	while (CW_SUCCESS == cwret && first_word < n_words && n_segments < n_workers) {
+		cw_gen_render_segment_t * segment = &segments[n_segments];
+		const size_t end_offset = (total * (size_t) (n_segments + 1)) / (size_t) n_workers;
+		size_t end_word = first_word;
+		size_t segment_n_samples = 0;
+		while (end_word < n_words && (offset + segment_n_samples < end_offset || end_word == first_word || n_segments == n_workers - 1)) {
+			segment_n_samples += word_n_samples[end_word];
+			end_word++;
+		}
+
+		segment->translated = translated;
+		segment->word_starts = word_starts + first_word;
+		segment->word_n_samples = word_n_samples + first_word;
+		segment->n_words = end_word - first_word;
+		segment->start_state = word_states[first_word];
+		segment->end_state = word_states[end_word];
+		segment->samples = result + offset;
+		n_segments++;
+
+		segment->gen = cw_gen_render_copy_gen_internal(gen);
+		if (NULL == segment->gen) {
+			cwret = CW_FAILURE;
+		}
+		first_word = end_word;
+		offset += segment_n_samples;
+	}
+
+	/* Calling thread renders the first segment. */
+	int n_threads = 0;
+	for (int s = 1; s < n_segments && CW_SUCCESS == cwret; s++) {
+		const int rv = pthread_create(&segments[s].thread_id, NULL, cw_gen_render_segment_thread_internal, (void *) &segments[s]);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create thread: '%s'", strerror(rv));
+			cwret = CW_FAILURE;
+			err = EAGAIN;
+			break;
+		}
+		n_threads++;
+	}
+	if (CW_SUCCESS == cwret && n_segments > 0) {
+		cwret = cw_gen_render_segment_internal(&segments[0]);
+	}
+	for (int s = 1; s <= n_threads; s++) {
+		pthread_join(segments[s].thread_id, NULL);
+		if (CW_SUCCESS != segments[s].cwret) {
+			cwret = CW_FAILURE;
+		}
+	}
+
+	if (CW_SUCCESS == cwret) {
+		/* Generator continues from the end of the string, and
+		   requests of modulation waiting in the generator have
+		   been taken over by the string. */
+		cw_gen_render_set_state_internal(gen, &word_states[n_words]);
+		gen->modulation.is_pending_gain = measuring_gen->modulation.is_pending_gain;
+		gen->modulation.is_pending_chirp = measuring_gen->modulation.is_pending_chirp;
+
+		*samples = result;
+		*n_samples = total;
+	} else {
+		free(result);
+	}
+
+	for (int s = 0; s < n_segments; s++) {
+		cw_gen_delete(&segments[s].gen);
+	}
+	cw_gen_delete(&measuring_gen);
+	free(segments);
+	free(translated);
+	free(word_starts);
+	free(word_n_samples);
+	free(word_states);
+
+	if (CW_SUCCESS != cwret) {
+		errno = err;
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Create generator calculating the same samples as given generator
+
+   The new generator has the same sample rate, oscillator, parameters,
+   slopes, modulation and phase as @p gen, and it doesn't use any
+   sound device.
+
+   @param[in] gen generator to copy
+
+   @return new generator on success
+   @return NULL on failure
+*/
+cw_gen_t * cw_gen_render_copy_gen_internal(cw_gen_t * gen)
+{
+	cw_gen_config_t gen_conf = { 0 };
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.oscillator = gen->oscillator;
+	cw_gen_t * copy = cw_gen_new(&gen_conf);
+	if (NULL == copy) {
+		return NULL;
+	}
+
+	/* Slopes are calculated for sample rate, so the rate is set
+	   first. */
+	copy->sample_rate = gen->sample_rate;
+	cw_gen_parameters_t parameters;
+	cw_gen_get_parameters(gen, &parameters);
+	if (CW_SUCCESS != cw_gen_set_parameters(copy, &parameters)
+	    || CW_SUCCESS != cw_gen_set_tone_slope(copy, gen->tone_slope.shape, gen->tone_slope.duration)) {
+
+		cw_gen_delete(&copy);
+		return NULL;
+	}
+	copy->modulation = gen->modulation;
+	copy->phase_offset = gen->phase_offset;
+	copy->phase_acc = gen->phase_acc;
+
+	return copy;
+}
+
+
+
+
+/**
+   @brief Get state of generator that affects samples of next tones
+
+   @param[in] gen generator
+   @param[out] state state of generator
+*/
+void cw_gen_render_get_state_internal(const cw_gen_t * gen, cw_gen_render_state_t * state)
+{
+	memset(state, 0, sizeof (cw_gen_render_state_t));
+	state->phase_offset = gen->phase_offset;
+	state->phase_acc = gen->phase_acc;
+	state->gain = gen->modulation.gain;
+	state->gain_target = gen->modulation.gain_target;
+	state->gain_step = gen->modulation.gain_step;
+	state->gain_n_remaining = gen->modulation.gain_n_remaining;
+	state->chirp_offset = gen->modulation.chirp_offset;
+	state->chirp_n_samples = gen->modulation.chirp_n_samples;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Set state of generator that affects samples of next tones
+
+   @param[in,out] gen generator
+   @param[in] state new state of generator
+*/
+void cw_gen_render_set_state_internal(cw_gen_t * gen, const cw_gen_render_state_t * state)
+{
+	gen->phase_offset = state->phase_offset;
+	gen->phase_acc = state->phase_acc;
+	gen->modulation.gain = state->gain;
+	gen->modulation.gain_target = state->gain_target;
+	gen->modulation.gain_step = state->gain_step;
+	gen->modulation.gain_n_remaining = state->gain_n_remaining;
+	gen->modulation.chirp_offset = state->chirp_offset;
+	gen->modulation.chirp_n_samples = state->chirp_n_samples;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Compare two states of generator
+
+   Phases are compared bit by bit: a difference in the last bit of
+   phase may change value of a sample.
+
+   @param[in] a first state
+   @param[in] b second state
+
+   @return true if the states are identical
+   @return false otherwise
+*/
+static bool cw_gen_render_states_equal_internal(const cw_gen_render_state_t * a, const cw_gen_render_state_t * b)
+{
+	return 0 == memcmp(&a->phase_offset, &b->phase_offset, sizeof (a->phase_offset))
+		&& a->phase_acc == b->phase_acc
+		&& a->gain == b->gain
+		&& a->gain_target == b->gain_target
+		&& a->gain_step == b->gain_step
+		&& a->gain_n_remaining == b->gain_n_remaining
+		&& a->chirp_offset == b->chirp_offset
+		&& a->chirp_n_samples == b->chirp_n_samples;
+}
+
+
+
+
+/**
+   @brief Get upper limit of count of samples of tones in generator's queue
+
+   Durations of tones are calculated from generator's durations
+   (gen->durations) when the tones are enqueued. Count of samples of
+   a tone is rounded down, so one sample per tone is a safe margin.
+
+   @param[in] gen generator
+
+   @return count of samples, large enough to render all enqueued tones in one call
+*/
+int cw_gen_render_n_samples_max_internal(cw_gen_t * gen)
+{
+	const uint64_t duration = cw_tq_duration_internal(gen->tq);
+	const uint64_t n = (duration * gen->sample_rate) / CW_USECS_PER_SEC + cw_tq_length_internal(gen->tq) + 1;
+	return n > INT_MAX ? INT_MAX : (int) n;
+}
+
+
+
+
+/**
+   @brief Find counts of samples of words, and states of generator between them
+
+   All tones of a word are rendered in one call, as when whole string
+   is rendered with one call to cw_gen_render(), so that tones are
+   split into fragments of sine wave at the same samples.
+
+   @param[in] gen generator with empty tone queue
+   @param[in] translated translated characters of string
+   @param[in] word_starts indices of first characters of words in @p translated, with index of end of string at [n_words]
+   @param[in] n_words count of words
+   @param[out] word_n_samples counts of samples of words
+   @param[out] word_states states of generator at beginning of words, and at end of string ([n_words])
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_render_measure_words_internal(cw_gen_t * gen, const uint8_t * translated, const size_t * word_starts, size_t n_words, size_t * word_n_samples, cw_gen_render_state_t * word_states)
+{
+	for (size_t w = 0; w < n_words; w++) {
+		cw_gen_render_get_state_internal(gen, &word_states[w]);
+		if (CW_SUCCESS != cw_gen_enqueue_translated_string(gen, translated + word_starts[w], word_starts[w + 1] - word_starts[w])) {
+			return CW_FAILURE;
+		}
+		const int n_max = cw_gen_render_n_samples_max_internal(gen);
+		const int n = cw_gen_render_skip_internal(gen, n_max);
+		if (n < 0) {
+			return CW_FAILURE;
+		}
+		if (n == n_max) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "word doesn't fit in %d samples", n_max);
+			return CW_FAILURE;
+		}
+		word_n_samples[w] = (size_t) n;
+	}
+	cw_gen_render_get_state_internal(gen, &word_states[n_words]);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Render all words of segment
+
+   @param[in,out] segment segment to render
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_gen_render_segment_internal(cw_gen_render_segment_t * segment)
+{
+	cw_gen_render_set_state_internal(segment->gen, &segment->start_state);
+
+	cw_sample_t * samples = segment->samples;
+	for (size_t w = 0; w < segment->n_words; w++) {
+		const size_t start = segment->word_starts[w];
+		const size_t end = segment->word_starts[w + 1];
+		if (CW_SUCCESS != cw_gen_enqueue_translated_string(segment->gen, segment->translated + start, end - start)) {
+			return CW_FAILURE;
+		}
+		/* Word fills exactly its place in array of samples. */
+		const int n = cw_gen_render_internal(segment->gen, samples, (int) segment->word_n_samples[w]);
+		if ((size_t) n != segment->word_n_samples[w] || cw_tq_is_nonempty_internal(segment->gen->tq)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+				      MSG_PREFIX "count of samples of word has changed: %zu -> %d", segment->word_n_samples[w], n);
+			return CW_FAILURE;
+		}
+		samples += n;
+	}
+
+	cw_gen_render_state_t state;
+	cw_gen_render_get_state_internal(segment->gen, &state);
+	if (!cw_gen_render_states_equal_internal(&state, &segment->end_state)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "state of generator at end of segment differs from expected state");
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+static void * cw_gen_render_segment_thread_internal(void * arg)
+{
+	cw_gen_render_segment_t * segment = (cw_gen_render_segment_t *) arg;
+	segment->cwret = cw_gen_render_segment_internal(segment);
+	return NULL;
+}
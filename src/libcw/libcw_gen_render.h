@@ -0,0 +1,92 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_RENDER
+#define H_LIBCW_GEN_RENDER
+
+
+
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+/* Maximal count of threads rendering one string with
+   cw_gen_render_string(). */
+#define CW_GEN_RENDER_N_WORKERS_MAX 64
+
+
+
+
+/* Part of state of generator that is carried from one tone to the
+   next one and that affects values of samples. Tones rendered from
+   the same state produce the same samples. */
+typedef struct {
+	float phase_offset;
+	uint32_t phase_acc;
+
+	int32_t gain;
+	int32_t gain_target;
+	int32_t gain_step;
+	cw_sample_iter_t gain_n_remaining;
+
+	int chirp_offset;
+	int chirp_n_samples;
+} cw_gen_render_state_t;
+
+
+
+
+/* Segment of string, made of whole words, rendered by one worker. */
+typedef struct {
+	/* Generator with parameters of rendered generator, used only
+	   by the segment. */
+	cw_gen_t * gen;
+
+	/* Translated characters of string (see cw_translate_string()). */
+	const uint8_t * translated;
+
+	/* Words of the segment: word w is translated[word_starts[w]]
+	   to translated[word_starts[w + 1] - 1], it ends with one or
+	   more spaces (except maybe for the last word of string), and it
+	   has word_n_samples[w] samples. */
+	const size_t * word_starts;
+	const size_t * word_n_samples;
+	size_t n_words;
+
+	/* State of generator at beginning and at end of the segment,
+	   found before rendering (see cw_gen_render_skip_internal()). */
+	cw_gen_render_state_t start_state;
+	cw_gen_render_state_t end_state;
+
+	/* Place for samples of the segment in array of samples of whole
+	   string. */
+	cw_sample_t * samples;
+
+	cw_ret_t cwret;
+	pthread_t thread_id;
+} cw_gen_render_segment_t;
+
+
+
+
+cw_gen_t * cw_gen_render_copy_gen_internal(cw_gen_t * gen);
+void cw_gen_render_get_state_internal(const cw_gen_t * gen, cw_gen_render_state_t * state);
+void cw_gen_render_set_state_internal(cw_gen_t * gen, const cw_gen_render_state_t * state);
+int cw_gen_render_n_samples_max_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_RENDER */
@@ -0,0 +1,525 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_gen_sink.c
+
+   @brief Additional sinks of samples calculated by generator.
+
+   Generator writes its samples to one sound device. Samples of every
+   buffer written to the device may be also passed to a few sinks (e.g.
+   a recorder, or a stream to remote listeners), so that the same signal
+   isn't calculated by many generators.
+
+   Buffers passed to sinks are kept in a small set of reference-counted
+   slots shared by all sinks. When generator calculates samples in its
+   own memory, a slot is used as generator's buffer, and a full buffer is
+   passed to sinks by reference: the generator takes another free slot
+   for next samples. When generator calculates samples in memory of
+   sound device or in buffers of its pipeline, a full buffer is copied
+   once to a slot shared by all sinks.
+
+   Every sink has its own thread and its own queue of buffers. A sink
+   that doesn't keep up with generator loses its oldest buffers, it never
+   blocks generator. Only the sound device of generator can do that.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_sink.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen sink: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_gen_sinks_t * cw_gen_sinks_new_internal(cw_gen_t * gen);
+static void cw_gen_sinks_free_internal(cw_gen_sinks_t * sinks);
+static int cw_gen_sinks_find_sink_internal(cw_gen_sinks_t * sinks, cw_gen_sink_callback_t callback_func, void * callback_arg);
+static int cw_gen_sinks_take_free_slot_internal(cw_gen_sinks_t * sinks);
+static void cw_gen_sink_stop_internal(cw_gen_sink_t * sink);
+static void * cw_gen_sink_thread_internal(void * arg);
+
+
+
+
+cw_ret_t cw_gen_add_sink(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (NULL == gen->write_buffer_to_sound_device || NULL != gen->start_sound_device || gen->buffer_n_samples <= 0) {
+		/* Generator doesn't write buffers of samples. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sound system of generator doesn't write buffers of samples");
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_sinks_t * sinks = __atomic_load_n(&gen->sinks, __ATOMIC_ACQUIRE);
+	if (NULL == sinks) {
+		cw_gen_sinks_t * new_sinks = cw_gen_sinks_new_internal(gen);
+		if (NULL == new_sinks) {
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		/* Generator's thread sees the sinks only after they have
+		   been fully initialized. */
+		if (__atomic_compare_exchange_n(&gen->sinks, &sinks, new_sinks, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			sinks = new_sinks;
+		} else {
+			/* Another thread has been first. */
+			cw_gen_sinks_free_internal(new_sinks);
+		}
+	}
+
+	cw_gen_sink_t * sink = calloc(1, sizeof (cw_gen_sink_t));
+	if (NULL == sink) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	sink->sinks = sinks;
+	sink->callback_func = callback_func;
+	sink->callback_arg = callback_arg;
+	pthread_cond_init(&sink->cond, NULL);
+
+	pthread_mutex_lock(&sinks->mutex);
+	if (-1 != cw_gen_sinks_find_sink_internal(sinks, callback_func, callback_arg)
+	    || sinks->n_sinks >= CW_GEN_SINKS_MAX) {
+		pthread_mutex_unlock(&sinks->mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sink is already added, or there are too many sinks");
+		pthread_cond_destroy(&sink->cond);
+		free(sink);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	const int rv = pthread_create(&sink->thread_id, NULL, cw_gen_sink_thread_internal, (void *) sink);
+	if (0 != rv) {
+		pthread_mutex_unlock(&sinks->mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to create sink's thread: %s", strerror(rv));
+		pthread_cond_destroy(&sink->cond);
+		free(sink);
+		errno = rv;
+		return CW_FAILURE;
+	}
+	sinks->sinks[sinks->n_sinks++] = sink;
+	pthread_mutex_unlock(&sinks->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_remove_sink(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == gen || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_sinks_t * sinks = __atomic_load_n(&gen->sinks, __ATOMIC_ACQUIRE);
+	if (NULL == sinks) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&sinks->mutex);
+	const int i = cw_gen_sinks_find_sink_internal(sinks, callback_func, callback_arg);
+	if (-1 == i) {
+		pthread_mutex_unlock(&sinks->mutex);
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+	cw_gen_sink_t * sink = sinks->sinks[i];
+	/* Generator doesn't publish new buffers to removed sink. */
+	sinks->sinks[i] = sinks->sinks[--sinks->n_sinks];
+	sinks->sinks[sinks->n_sinks] = NULL;
+	pthread_mutex_unlock(&sinks->mutex);
+
+	cw_gen_sink_stop_internal(sink);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_gen_get_sink_statistics(cw_gen_t * gen, cw_gen_sink_callback_t callback_func, void * callback_arg, cw_gen_sink_statistics_t * statistics)
+{
+	if (NULL == gen || NULL == callback_func || NULL == statistics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_sinks_t * sinks = __atomic_load_n(&gen->sinks, __ATOMIC_ACQUIRE);
+	if (NULL == sinks) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&sinks->mutex);
+	const int i = cw_gen_sinks_find_sink_internal(sinks, callback_func, callback_arg);
+	if (-1 != i) {
+		*statistics = sinks->sinks[i]->statistics;
+		statistics->n_queued = (unsigned int) sinks->sinks[i]->queue_n + (sinks->sinks[i]->busy ? 1 : 0);
+	}
+	pthread_mutex_unlock(&sinks->mutex);
+
+	if (-1 == i) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Pass full buffer of samples to sinks of generator
+
+   Called by generator's thread (or by thread of generator's pipeline)
+   after the buffer has been written to sound device. If @p samples is
+   generator's ::buffer calculated in generator's own memory, the buffer
+   is handed to the sinks as it is, and ::buffer is switched to a free
+   slot. Otherwise the samples are copied to a free slot.
+
+   The function never waits for the sinks.
+
+   @param[in] gen generator
+   @param[in] samples samples written to sound device
+   @param[in] n_samples count of samples in @p samples
+*/
+void cw_gen_sinks_publish_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples)
+{
+	cw_gen_sinks_t * sinks = __atomic_load_n(&gen->sinks, __ATOMIC_ACQUIRE);
+	if (NULL == sinks || n_samples <= 0 || n_samples > sinks->n_samples_max) {
+		return;
+	}
+
+	pthread_mutex_lock(&sinks->mutex);
+	if (0 == sinks->n_sinks) {
+		pthread_mutex_unlock(&sinks->mutex);
+		return;
+	}
+
+	int slot = -1;
+	if (-1 != sinks->current && samples == sinks->slots[sinks->current].samples) {
+		slot = sinks->current;
+		sinks->current = -1;
+	} else {
+		slot = cw_gen_sinks_take_free_slot_internal(sinks);
+		memcpy(sinks->slots[slot].samples, samples, (size_t) n_samples * sizeof (cw_sample_t));
+	}
+	sinks->slots[slot].n_samples = n_samples;
+	sinks->sample_rate = gen->sample_rate;
+
+	for (int i = 0; i < sinks->n_sinks; i++) {
+		cw_gen_sink_t * sink = sinks->sinks[i];
+		if (CW_GEN_SINK_QUEUE_CAPACITY == sink->queue_n) {
+			/* Sink is too slow. Drop its oldest buffer instead
+			   of waiting for it. */
+			sinks->slots[sink->queue[sink->queue_head]].n_refs--;
+			sink->queue_head = (sink->queue_head + 1) % CW_GEN_SINK_QUEUE_CAPACITY;
+			sink->queue_n--;
+			sink->statistics.n_dropped++;
+		}
+		sink->queue[(sink->queue_head + sink->queue_n) % CW_GEN_SINK_QUEUE_CAPACITY] = slot;
+		sink->queue_n++;
+		sinks->slots[slot].n_refs++;
+		pthread_cond_signal(&sink->cond);
+	}
+
+	/* Samples of next buffer can be calculated directly in a slot
+	   if generator calculates them in its own memory. Memory of sound
+	   device, and buffers of pipeline, are managed elsewhere. */
+	if (0 == gen->pipeline.n_buffers
+	    && NULL == gen->acquire_buffer_from_sound_device
+	    && samples == gen->buffer
+	    && (samples == gen->own_buffer || -1 == sinks->current)
+	    && gen->buffer_n_samples <= sinks->n_samples_max) {
+
+		if (-1 == sinks->current) {
+			sinks->current = cw_gen_sinks_take_free_slot_internal(sinks);
+		}
+		gen->buffer = sinks->slots[sinks->current].samples;
+	}
+	pthread_mutex_unlock(&sinks->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Stop threads of all sinks of generator and free the sinks
+
+   Called when generator is deleted, after generator's thread has been
+   joined. Buffers waiting in queues of sinks are passed to the sinks
+   before the threads end.
+
+   @param[in] gen generator
+*/
+void cw_gen_sinks_delete_internal(cw_gen_t * gen)
+{
+	cw_gen_sinks_t * sinks = gen->sinks;
+	if (NULL == sinks) {
+		return;
+	}
+
+	for (int i = 0; i < sinks->n_sinks; i++) {
+		cw_gen_sink_stop_internal(sinks->sinks[i]);
+		sinks->sinks[i] = NULL;
+	}
+	sinks->n_sinks = 0;
+
+	if (-1 != sinks->current && gen->buffer == sinks->slots[sinks->current].samples) {
+		gen->buffer = gen->own_buffer;
+	}
+	cw_gen_sinks_free_internal(sinks);
+	gen->sinks = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Allocate sinks of generator
+
+   Every slot has size of generator's buffer.
+
+   @param[in] gen generator
+
+   @return new sinks on success
+   @return NULL on failure
+*/
+static cw_gen_sinks_t * cw_gen_sinks_new_internal(cw_gen_t * gen)
+{
+	cw_gen_sinks_t * sinks = calloc(1, sizeof (cw_gen_sinks_t));
+	if (NULL == sinks) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	pthread_mutex_init(&sinks->mutex, NULL);
+	sinks->n_samples_max = gen->buffer_n_samples;
+	for (int i = 0; i < CW_GEN_SINK_N_SLOTS; i++) {
+		sinks->slots[i].samples = calloc((size_t) sinks->n_samples_max, sizeof (cw_sample_t));
+		if (NULL == sinks->slots[i].samples) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			cw_gen_sinks_free_internal(sinks);
+			return NULL;
+		}
+	}
+	sinks->current = -1;
+
+	return sinks;
+}
+
+
+
+
+/**
+   @brief Free slots and mutex of sinks that have no sinks' threads
+
+   @param[in] sinks sinks to free
+*/
+static void cw_gen_sinks_free_internal(cw_gen_sinks_t * sinks)
+{
+	for (int i = 0; i < CW_GEN_SINK_N_SLOTS; i++) {
+		free(sinks->slots[i].samples);
+		sinks->slots[i].samples = NULL;
+	}
+	pthread_mutex_destroy(&sinks->mutex);
+	free(sinks);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Find sink with given callback
+
+   Call with ::mutex locked.
+
+   @param[in] sinks sinks of generator
+   @param[in] callback_func callback of sink
+   @param[in] callback_arg argument of callback of sink
+
+   @return index of sink in sinks->sinks[]
+   @return -1 if there is no such sink
+*/
+static int cw_gen_sinks_find_sink_internal(cw_gen_sinks_t * sinks, cw_gen_sink_callback_t callback_func, void * callback_arg)
+{
+	for (int i = 0; i < sinks->n_sinks; i++) {
+		if (sinks->sinks[i]->callback_func == callback_func
+		    && sinks->sinks[i]->callback_arg == callback_arg) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+
+
+/**
+   @brief Find slot that is not used by sinks nor by generator
+
+   Call with ::mutex locked. See CW_GEN_SINK_N_SLOTS for why a free
+   slot always exists.
+
+   @param[in] sinks sinks of generator
+
+   @return index of free slot
+*/
+static int cw_gen_sinks_take_free_slot_internal(cw_gen_sinks_t * sinks)
+{
+	for (int i = 0; i < CW_GEN_SINK_N_SLOTS; i++) {
+		if (0 == sinks->slots[i].n_refs && i != sinks->current) {
+			return i;
+		}
+	}
+	cw_assert (0, MSG_PREFIX "no free slot");
+	return 0;
+}
+
+
+
+
+/**
+   @brief Stop sink's thread and free the sink
+
+   The sink must have been already removed from sinks of generator.
+   Sink's thread passes buffers remaining in its queue to the callback
+   before it ends.
+
+   @param[in] sink sink to stop
+*/
+static void cw_gen_sink_stop_internal(cw_gen_sink_t * sink)
+{
+	cw_gen_sinks_t * sinks = sink->sinks;
+
+	pthread_mutex_lock(&sinks->mutex);
+	sink->quit = true;
+	pthread_cond_signal(&sink->cond);
+	pthread_mutex_unlock(&sinks->mutex);
+
+	pthread_join(sink->thread_id, NULL);
+
+	pthread_cond_destroy(&sink->cond);
+	free(sink);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Pass buffers from sink's queue to sink's callback
+
+   This is a thread function. It returns when the sink is asked to quit
+   and its queue is empty.
+
+   @param[in] arg sink
+
+   @return NULL
+*/
+static void * cw_gen_sink_thread_internal(void * arg)
+{
+	cw_gen_sink_t * sink = (cw_gen_sink_t *) arg;
+	cw_gen_sinks_t * sinks = sink->sinks;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "gen sink", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "gen sink");
+#endif
+
+	pthread_mutex_lock(&sinks->mutex);
+	while (true) {
+		while (0 == sink->queue_n && !sink->quit) {
+			pthread_cond_wait(&sink->cond, &sinks->mutex);
+		}
+		if (0 == sink->queue_n) {
+			break;
+		}
+		/* Slot stays referenced until callback is done with it. */
+		const int slot = sink->queue[sink->queue_head];
+		sink->queue_head = (sink->queue_head + 1) % CW_GEN_SINK_QUEUE_CAPACITY;
+		sink->queue_n--;
+		sink->busy = true;
+		const int sample_rate = sinks->sample_rate;
+		pthread_mutex_unlock(&sinks->mutex);
+
+		sink->callback_func(sink->callback_arg, sinks->slots[slot].samples, sinks->slots[slot].n_samples, sample_rate);
+
+		pthread_mutex_lock(&sinks->mutex);
+		sinks->slots[slot].n_refs--;
+		sink->statistics.n_buffers++;
+		sink->busy = false;
+	}
+	pthread_mutex_unlock(&sinks->mutex);
+
+	return NULL;
+}
@@ -0,0 +1,105 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_SINK
+#define H_LIBCW_GEN_SINK
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Maximal count of sinks added to one generator with
+   cw_gen_add_sink(). */
+#define CW_GEN_SINKS_MAX 8
+
+/* Maximal count of buffers waiting in queue of one sink. When a sink
+   doesn't keep up with generator, its oldest buffer is dropped. */
+#define CW_GEN_SINK_QUEUE_CAPACITY 8
+
+/* Count of slots of samples shared by sinks of generator. Queues of
+   all sinks hold the most recently published buffers, so slots in use
+   are at most: the queued ones, one being consumed by each sink, and
+   one being filled by generator. There is always a free slot. */
+#define CW_GEN_SINK_N_SLOTS (CW_GEN_SINK_QUEUE_CAPACITY + CW_GEN_SINKS_MAX + 1)
+
+
+
+
+typedef struct cw_gen_sinks_struct cw_gen_sinks_t;
+
+
+
+
+/* Buffer of samples shared by sinks. */
+typedef struct {
+	cw_sample_t * samples;
+	int n_samples;
+	int n_refs;         /* Count of queues of sinks (and sinks' threads) using the slot. */
+} cw_gen_sink_slot_t;
+
+
+
+
+/* Sink added to generator with cw_gen_add_sink(). */
+typedef struct {
+	cw_gen_sinks_t * sinks;
+
+	cw_gen_sink_callback_t callback_func;
+	void * callback_arg;
+
+	/* FIFO of indices of slots waiting for the callback. */
+	int queue[CW_GEN_SINK_QUEUE_CAPACITY];
+	int queue_head;
+	int queue_n;
+	bool busy;          /* Callback is processing a buffer taken from the queue. */
+
+	cw_gen_sink_statistics_t statistics;
+
+	bool quit;
+	pthread_cond_t cond;
+	pthread_t thread_id;
+} cw_gen_sink_t;
+
+
+
+
+/* All fields are protected by ::mutex. Sinks' threads call their
+   callbacks without holding the mutex. */
+struct cw_gen_sinks_struct {
+	cw_gen_sink_slot_t slots[CW_GEN_SINK_N_SLOTS];
+	int n_samples_max;  /* Size of every slot [samples]. */
+	int sample_rate;
+
+	/* Slot used as generator's ::buffer, so that full buffer is
+	   passed to sinks without copying. -1 when generator's ::buffer
+	   is not a slot. */
+	int current;
+
+	cw_gen_sink_t * sinks[CW_GEN_SINKS_MAX];
+	int n_sinks;
+
+	pthread_mutex_t mutex;
+};
+
+
+
+
+void cw_gen_sinks_publish_internal(cw_gen_t * gen, cw_sample_t * samples, int n_samples);
+void cw_gen_sinks_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_SINK */
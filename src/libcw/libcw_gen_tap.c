@@ -0,0 +1,336 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+
+/**
+   @file libcw_gen_tap.c
+
+   @brief Tap of samples played by generator, for displays.
+
+   The thread that passes buffers of samples to sound device also
+   copies (decimated) samples to a ring in memory of the tap. Readers
+   take samples from the ring at their own rate, each with its own
+   position. Nothing is ever locked: writer doesn't wait for readers,
+   it overwrites the oldest samples, and readers detect samples
+   overwritten while they were being copied, exactly as readers of
+   ring in shared memory do (see libcw_shm_ring.c).
+
+   Tap is allocated when it is enabled for the first time, and is
+   freed together with generator. Writer only reads a pointer as long
+   as the tap has never been enabled.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_gen_tap.h"
+
+
+
+
+#define MSG_PREFIX "libcw/gen tap: "
+
+#define CW_GEN_TAP_MASK ((uint64_t) CW_GEN_TAP_CAPACITY - 1)
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static cw_gen_tap_t * cw_gen_tap_get_internal(cw_gen_t * gen);
+
+
+
+
+cw_ret_t cw_gen_enable_tap(cw_gen_t * gen, int decimation, cw_gen_tap_mode_t mode)
+{
+	if (NULL == gen
+	    || decimation < 1 || decimation > CW_GEN_TAP_DECIMATION_MAX
+	    || (CW_GEN_TAP_SAMPLE != mode && CW_GEN_TAP_PEAK != mode)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_gen_tap_t * tap = cw_gen_tap_get_internal(gen);
+	if (NULL == tap) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	__atomic_store_n(&tap->decimation, decimation, __ATOMIC_RELAXED);
+	__atomic_store_n(&tap->mode, mode, __ATOMIC_RELAXED);
+	__atomic_store_n(&tap->enabled, true, __ATOMIC_RELEASE);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+void cw_gen_disable_tap(cw_gen_t * gen)
+{
+	if (NULL == gen) {
+		return;
+	}
+	cw_gen_tap_t * tap = __atomic_load_n(&gen->tap, __ATOMIC_ACQUIRE);
+	if (NULL == tap) {
+		return;
+	}
+	__atomic_store_n(&tap->enabled, false, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_gen_get_tap_position(cw_gen_t * gen, uint64_t * position, int * sample_rate)
+{
+	if (NULL == gen || NULL == position) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	cw_gen_tap_t * tap = __atomic_load_n(&gen->tap, __ATOMIC_ACQUIRE);
+	if (NULL == tap) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	*position = __atomic_load_n(&tap->write_position, __ATOMIC_ACQUIRE);
+	if (NULL != sample_rate) {
+		*sample_rate = (int) gen->sample_rate / __atomic_load_n(&tap->decimation, __ATOMIC_RELAXED);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_gen_read_tap(cw_gen_t * gen, uint64_t * position, cw_sample_t * samples, int n_samples)
+{
+	if (NULL == gen || NULL == position || NULL == samples || n_samples <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	cw_gen_tap_t * tap = __atomic_load_n(&gen->tap, __ATOMIC_ACQUIRE);
+	if (NULL == tap) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	while (true) {
+		const uint64_t write_position = __atomic_load_n(&tap->write_position, __ATOMIC_ACQUIRE);
+		if (write_position <= *position) {
+			return 0;
+		}
+
+		uint64_t start = *position;
+		if (write_position - start > CW_GEN_TAP_CAPACITY) {
+			start = write_position - CW_GEN_TAP_CAPACITY;
+		}
+		uint64_t n = write_position - start;
+		if (n > (uint64_t) n_samples) {
+			n = (uint64_t) n_samples;
+		}
+
+		const uint64_t index = start & CW_GEN_TAP_MASK;
+		const uint64_t n_head = n < CW_GEN_TAP_CAPACITY - index ? n : CW_GEN_TAP_CAPACITY - index;
+		memcpy(samples, tap->samples + index, (size_t) n_head * sizeof (cw_sample_t));
+		memcpy(samples + n_head, tap->samples, (size_t) (n - n_head) * sizeof (cw_sample_t));
+
+		/* Discard samples that writer has started to overwrite
+		   while they were being copied. */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		const uint64_t reserve_position = __atomic_load_n(&tap->reserve_position, __ATOMIC_RELAXED);
+		if (reserve_position > CW_GEN_TAP_CAPACITY && reserve_position - CW_GEN_TAP_CAPACITY > start) {
+			const uint64_t n_overwritten = reserve_position - CW_GEN_TAP_CAPACITY - start;
+			if (n_overwritten >= n) {
+				*position = reserve_position - CW_GEN_TAP_CAPACITY;
+				continue;
+			}
+			memmove(samples, samples + n_overwritten, (size_t) (n - n_overwritten) * sizeof (cw_sample_t));
+			start += n_overwritten;
+			n -= n_overwritten;
+		}
+
+		*position = start + n;
+		return (int) n;
+	}
+}
+
+
+
+
+/**
+   @brief Copy samples passed to sound device to tap of generator
+
+   Called by the thread that passes samples to sound device (generator's
+   thread, thread of generator's pipeline, or callback of sound
+   server), after the samples have been post-processed. Only one
+   thread calls the function for given generator.
+
+   @param[in] gen generator
+   @param[in] samples samples passed to sound device
+   @param[in] n_samples count of samples in @p samples
+*/
+void cw_gen_tap_write_internal(cw_gen_t * gen, const cw_sample_t * samples, int n_samples)
+{
+	cw_gen_tap_t * tap = __atomic_load_n(&gen->tap, __ATOMIC_ACQUIRE);
+	if (NULL == tap || !__atomic_load_n(&tap->enabled, __ATOMIC_ACQUIRE) || n_samples <= 0) {
+		return;
+	}
+
+	const int decimation = __atomic_load_n(&tap->decimation, __ATOMIC_RELAXED);
+	const cw_gen_tap_mode_t mode = __atomic_load_n(&tap->mode, __ATOMIC_RELAXED);
+	if (decimation != tap->writer_decimation || mode != tap->writer_mode) {
+		tap->writer_decimation = decimation;
+		tap->writer_mode = mode;
+		tap->writer_phase = 0;
+		tap->writer_peak = 0;
+	}
+
+	/* Index (in @p samples) of first sample that ends a group:
+	   first sample of a group is kept with CW_GEN_TAP_SAMPLE, peak
+	   of a group is known at its last sample with CW_GEN_TAP_PEAK. */
+	const int first = CW_GEN_TAP_SAMPLE == mode
+		? (decimation - tap->writer_phase) % decimation
+		: decimation - 1 - tap->writer_phase;
+	const uint64_t n_out = first < n_samples ? (uint64_t) ((n_samples - 1 - first) / decimation + 1) : 0;
+
+	/* Only writer modifies positions, so it can read them without
+	   synchronization. */
+	uint64_t position = tap->write_position;
+	const uint64_t end = position + n_out;
+	if (n_out > 0) {
+		/* Readers that see any of the samples written below see
+		   also the new reserve position. */
+		__atomic_store_n(&tap->reserve_position, end, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+
+	if (CW_GEN_TAP_SAMPLE == mode) {
+		for (int i = first; i < n_samples; i += decimation) {
+			tap->samples[position++ & CW_GEN_TAP_MASK] = samples[i];
+		}
+		tap->writer_phase = (int) ((tap->writer_phase + n_samples) % decimation);
+	} else {
+		cw_sample_t peak = tap->writer_peak;
+		int phase = tap->writer_phase;
+		for (int i = 0; i < n_samples; i++) {
+			/* Absolute value of the most negative sample doesn't
+			   fit in cw_sample_t. */
+			const cw_sample_t value = samples[i] >= 0 ? samples[i] : (INT16_MIN == samples[i] ? INT16_MAX : (cw_sample_t) -samples[i]);
+			if (value > peak) {
+				peak = value;
+			}
+			if (++phase == decimation) {
+				tap->samples[position++ & CW_GEN_TAP_MASK] = peak;
+				peak = 0;
+				phase = 0;
+			}
+		}
+		tap->writer_peak = peak;
+		tap->writer_phase = phase;
+	}
+
+	if (n_out > 0) {
+		__atomic_store_n(&tap->write_position, end, __ATOMIC_RELEASE);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Delete tap of generator
+
+   Nothing may be writing samples to sound device of generator.
+
+   @param[in] gen generator
+*/
+void cw_gen_tap_delete_internal(cw_gen_t * gen)
+{
+	free(gen->tap);
+	gen->tap = NULL;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get tap of generator, allocate it if necessary
+
+   @param[in] gen generator
+
+   @return tap on success
+   @return NULL on failure
+*/
+static cw_gen_tap_t * cw_gen_tap_get_internal(cw_gen_t * gen)
+{
+	cw_gen_tap_t * tap = __atomic_load_n(&gen->tap, __ATOMIC_ACQUIRE);
+	if (NULL != tap) {
+		return tap;
+	}
+
+	cw_gen_tap_t * new_tap = calloc(1, sizeof (cw_gen_tap_t));
+	if (NULL == new_tap) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	new_tap->writer_decimation = 1;
+	new_tap->decimation = 1;
+
+	/* Writer sees the tap only after it has been fully
+	   initialized. */
+	if (__atomic_compare_exchange_n(&gen->tap, &tap, new_tap, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return new_tap;
+	} else {
+		/* Another thread has been first. */
+		free(new_tap);
+		return tap;
+	}
+}
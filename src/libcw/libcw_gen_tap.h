@@ -0,0 +1,61 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_GEN_TAP
+#define H_LIBCW_GEN_TAP
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Tap of samples of generator, see cw_gen_enable_tap().
+
+   ::decimation, ::mode and ::enabled are set by client code and read
+   by the writing thread. Fields with "writer_" prefix are accessed
+   only by the thread writing samples to sound device. Positions are
+   written only by that thread, and are read by readers. All
+   accesses of shared fields are atomic. */
+typedef struct cw_gen_tap_struct {
+	bool enabled;
+	int decimation;
+	cw_gen_tap_mode_t mode;
+
+	/* Decimation and mode that writer has started to use. When
+	   client code changes them, writer starts new group of samples. */
+	int writer_decimation;
+	cw_gen_tap_mode_t writer_mode;
+	int writer_phase;        /* Index of next sample in current group of ::writer_decimation samples. */
+	cw_sample_t writer_peak; /* Largest absolute value in current group, for CW_GEN_TAP_PEAK. */
+
+	/* Position of end of samples that writer is writing. Samples
+	   before (reserve_position - CW_GEN_TAP_CAPACITY) may be being
+	   overwritten. */
+	uint64_t reserve_position;
+	/* Position of end of samples that have been written. */
+	uint64_t write_position;
+
+	cw_sample_t samples[CW_GEN_TAP_CAPACITY];
+} cw_gen_tap_t;
+
+
+
+
+void cw_gen_tap_write_internal(cw_gen_t * gen, const cw_sample_t * samples, int n_samples);
+void cw_gen_tap_delete_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_GEN_TAP */
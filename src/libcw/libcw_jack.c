@@ -0,0 +1,572 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_jack.c
+
+   @brief JACK sound system.
+
+   libcw registers itself as a JACK client with one output port. Samples
+   are not pushed to the server by generator's thread: they are rendered
+   from generator's tone queue by JACK's process callback, in JACK's
+   realtime thread, so latency of the sound is the latency of JACK's
+   graph. Sample rate and size of buffer are dictated by the server.
+
+   Name of "device" is a name of input port to connect to (e.g.
+   "system:playback_1"). With default device name the output port is
+   connected to first two physical playback ports.
+*/
+
+
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+
+
+#include "config.h"
+#include "libcw_debug.h"
+#include "libcw_jack.h"
+
+
+
+
+#define MSG_PREFIX "libcw/jack: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#ifdef LIBCW_WITH_JACK
+
+
+
+
+#include <assert.h>
+#include <dlfcn.h> /* dlopen() and related symbols */
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw_gen.h"
+#include "libcw_gen_tap.h"
+#include "libcw_utils.h"
+
+
+
+
+/* Count of physical playback ports to which a mono output port is
+   connected when default device is used. */
+#define CW_JACK_N_PHYSICAL_PORTS_MAX 2
+
+
+
+
+typedef struct cw_jack_lib_handle_t {
+
+	/* Returned by dlopen(). The library stays loaded until the end of
+	   the process, JACK may still be calling into it from its threads
+	   when one of generators is being deleted. */
+	void * lib_handle;
+
+	jack_client_t *(* jack_client_open)(const char * client_name, jack_options_t options, jack_status_t * status, ...);
+	int            (* jack_client_close)(jack_client_t * client);
+	int            (* jack_set_process_callback)(jack_client_t * client, JackProcessCallback process_callback, void * arg);
+	void           (* jack_on_shutdown)(jack_client_t * client, JackShutdownCallback function, void * arg);
+	jack_port_t   *(* jack_port_register)(jack_client_t * client, const char * port_name, const char * port_type, unsigned long flags, unsigned long buffer_size);
+	void          *(* jack_port_get_buffer)(jack_port_t * port, jack_nframes_t n_frames);
+	const char    *(* jack_port_name)(const jack_port_t * port);
+	void           (* jack_port_get_latency_range)(jack_port_t * port, jack_latency_callback_mode_t mode, jack_latency_range_t * range);
+	jack_nframes_t (* jack_get_sample_rate)(jack_client_t * client);
+	jack_nframes_t (* jack_get_buffer_size)(jack_client_t * client);
+	int            (* jack_activate)(jack_client_t * client);
+	int            (* jack_deactivate)(jack_client_t * client);
+	const char   **(* jack_get_ports)(jack_client_t * client, const char * port_name_pattern, const char * type_name_pattern, unsigned long flags);
+	int            (* jack_connect)(jack_client_t * client, const char * source_port, const char * destination_port);
+	void           (* jack_free)(void * ptr);
+} cw_jack_lib_handle_t;
+
+
+static cw_jack_lib_handle_t g_cw_jack_lib_handle;
+
+
+
+
+static bool     cw_jack_load_library_internal(void);
+static int      cw_jack_dlsym_internal(cw_jack_lib_handle_t * cw_jack);
+static cw_ret_t cw_jack_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_jack_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_jack_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_jack_connect_ports_internal(cw_gen_t * gen);
+static cw_ret_t cw_jack_start_internal(cw_gen_t * gen);
+static void     cw_jack_stop_internal(cw_gen_t * gen);
+static int      cw_jack_process_cb(jack_nframes_t n_frames, void * arg);
+static void     cw_jack_shutdown_cb(void * arg);
+
+
+
+
+/**
+   @brief Check if it is possible to open JACK output with given device name
+
+   Function first tries to load JACK library, and then tries to connect
+   to a running JACK server (the server is not started if it isn't
+   running). The connection is closed before returning.
+
+   @param[in] device_name name of JACK port to connect to; if NULL then
+   the function will use library-default device name.
+
+   @return true if connecting to JACK server succeeded
+   @return false otherwise
+*/
+bool cw_is_jack_possible(__attribute__((unused)) const char * device_name)
+{
+	if (!cw_jack_load_library_internal()) {
+		return false;
+	}
+
+	jack_status_t status = 0;
+	jack_client_t * client = g_cw_jack_lib_handle.jack_client_open("cw_is_jack_possible", JackNoStartServer, &status);
+	if (NULL == client) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "is possible: can't connect to JACK server, status = 0x%x", (unsigned int) status);
+		return false;
+	}
+	g_cw_jack_lib_handle.jack_client_close(client);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with JACK sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with sound system (doesn't try to open or configure it).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_jack_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_JACK;
+	gen->open_and_configure_sound_device = cw_jack_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_jack_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_jack_write_buffer_to_sound_device_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Load JACK library and resolve its symbols
+
+   The library is loaded only once.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_jack_load_library_internal(void)
+{
+	if (NULL != g_cw_jack_lib_handle.lib_handle) {
+		return true;
+	}
+
+	const char * const library_name[] = {
+		"libjack.so.0",
+		"libjack.so",
+		NULL,
+	};
+	int i = 0;
+	while (NULL != library_name[i]) {
+		if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &g_cw_jack_lib_handle.lib_handle)) {
+			break;
+		}
+		i++;
+	}
+	if (NULL == g_cw_jack_lib_handle.lib_handle) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "can't open JACK library");
+		return false;
+	}
+
+	const int rv = cw_jack_dlsym_internal(&g_cw_jack_lib_handle);
+	if (rv < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to resolve JACK symbol #%d, can't correctly load JACK library", rv);
+		dlclose(g_cw_jack_lib_handle.lib_handle);
+		g_cw_jack_lib_handle.lib_handle = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Resolve/get symbols from JACK library
+
+   @param[in,out] cw_jack libcw JACK data structure with library handle to opened JACK library
+
+   @return 0 on success
+   @return negative value on failure
+*/
+static int cw_jack_dlsym_internal(cw_jack_lib_handle_t * cw_jack)
+{
+#define CW_JACK_DLSYM(symbol)						\
+	*(void **) &(cw_jack->symbol) = dlsym(cw_jack->lib_handle, #symbol); \
+	if (!cw_jack->symbol) return -(__LINE__);
+
+	CW_JACK_DLSYM(jack_client_open);
+	CW_JACK_DLSYM(jack_client_close);
+	CW_JACK_DLSYM(jack_set_process_callback);
+	CW_JACK_DLSYM(jack_on_shutdown);
+	CW_JACK_DLSYM(jack_port_register);
+	CW_JACK_DLSYM(jack_port_get_buffer);
+	CW_JACK_DLSYM(jack_port_name);
+	CW_JACK_DLSYM(jack_port_get_latency_range);
+	CW_JACK_DLSYM(jack_get_sample_rate);
+	CW_JACK_DLSYM(jack_get_buffer_size);
+	CW_JACK_DLSYM(jack_activate);
+	CW_JACK_DLSYM(jack_deactivate);
+	CW_JACK_DLSYM(jack_get_ports);
+	CW_JACK_DLSYM(jack_connect);
+	CW_JACK_DLSYM(jack_free);
+
+#undef CW_JACK_DLSYM
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Open JACK output, associate it with given generator
+
+   Function registers libcw as JACK client, registers output port,
+   activates the client and connects the port to playback port(s).
+
+   @param[in] gen generator
+   @param[in] gen_conf generator's configuration
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_jack_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	cw_jack_lib_handle_t * cw_jack = &g_cw_jack_lib_handle;
+	cw_jack_data_t * jack = &gen->jack_data;
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	jack_status_t status = 0;
+	jack->client = cw_jack->jack_client_open(gen->library_client.name ? gen->library_client.name : "libcw",
+						 JackNoStartServer, &status);
+	if (NULL == jack->client) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't connect to JACK server, status = 0x%x", (unsigned int) status);
+		return CW_FAILURE;
+	}
+
+	jack->port = cw_jack->jack_port_register(jack->client, "output", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+	if (NULL == jack->port) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't register output port");
+		cw_jack->jack_client_close(jack->client);
+		jack->client = NULL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_init(&jack->mutex, NULL);
+	jack->rendering = false;
+
+	/* Generator's buffer is only a scratch space for samples
+	   rendered by process callback. The server may change size of its
+	   buffer later, the callback can render in many steps. */
+	gen->sample_rate = cw_jack->jack_get_sample_rate(jack->client);
+	gen->buffer_n_samples = (int) cw_jack->jack_get_buffer_size(jack->client);
+	/* JACK ports always carry mono, 32 bit float samples. */
+	gen->sample_format = CW_SAMPLE_FORMAT_FLOAT32;
+	gen->n_channels = 1;
+
+	cw_jack->jack_set_process_callback(jack->client, cw_jack_process_cb, gen);
+	cw_jack->jack_on_shutdown(jack->client, cw_jack_shutdown_cb, gen);
+
+	if (0 != cw_jack->jack_activate(jack->client)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't activate JACK client");
+		cw_jack_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Not fatal: user can make the connection with a patchbay. */
+	cw_jack_connect_ports_internal(gen);
+
+	jack_latency_range_t range = { 0 };
+	cw_jack->jack_port_get_latency_range(jack->port, JackPlaybackLatency, &range);
+	gen->sound_device_latency = (int) (((int64_t) range.max * CW_USECS_PER_SEC) / (int64_t) gen->sample_rate);
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "open device: sample rate = %u, buffer size = %d [samples], playback latency = %d [us]",
+		      gen->sample_rate, gen->buffer_n_samples, gen->sound_device_latency);
+
+	gen->start_sound_device = cw_jack_start_internal;
+	gen->stop_sound_device = cw_jack_stop_internal;
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Connect JACK output port of generator to playback port(s)
+
+   @param[in] gen generator with active JACK client
+
+   @return CW_SUCCESS if at least one connection has been made
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_jack_connect_ports_internal(cw_gen_t * gen)
+{
+	cw_jack_lib_handle_t * cw_jack = &g_cw_jack_lib_handle;
+	cw_jack_data_t * jack = &gen->jack_data;
+	const char * source = cw_jack->jack_port_name(jack->port);
+
+	if ('\0' != gen->picked_device_name[0]) {
+		if (0 != cw_jack->jack_connect(jack->client, source, gen->picked_device_name)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "can't connect to port '%s'", gen->picked_device_name);
+			return CW_FAILURE;
+		}
+		return CW_SUCCESS;
+	}
+
+	const char ** ports = cw_jack->jack_get_ports(jack->client, NULL, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+	if (NULL == ports) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "there are no physical playback ports");
+		return CW_FAILURE;
+	}
+	int n_connected = 0;
+	for (int i = 0; NULL != ports[i] && i < CW_JACK_N_PHYSICAL_PORTS_MAX; i++) {
+		if (0 == cw_jack->jack_connect(jack->client, source, ports[i])) {
+			n_connected++;
+		}
+	}
+	cw_jack->jack_free(ports);
+
+	return n_connected > 0 ? CW_SUCCESS : CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Close JACK client associated with given generator
+
+   @param[in] gen generator
+*/
+static void cw_jack_close_sound_device_internal(cw_gen_t * gen)
+{
+	cw_jack_lib_handle_t * cw_jack = &g_cw_jack_lib_handle;
+	cw_jack_data_t * jack = &gen->jack_data;
+
+	if (NULL == jack->client) {
+		return;
+	}
+
+	/* Process callback isn't called after this. */
+	cw_jack->jack_deactivate(jack->client);
+	cw_jack->jack_client_close(jack->client);
+	jack->client = NULL;
+	jack->port = NULL;
+
+	pthread_mutex_destroy(&jack->mutex);
+	jack->rendering = false;
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write generator's buffer to JACK
+
+   Samples are pulled from generator by JACK's process callback, there
+   is no way to push them.
+
+   @param[in] gen generator
+
+   @return CW_FAILURE
+*/
+static cw_ret_t cw_jack_write_buffer_to_sound_device_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+		      MSG_PREFIX "write: JACK sound system doesn't accept pushed samples");
+	errno = ENOTSUP;
+	return CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Let JACK's process callback pull samples from generator
+
+   @param[in] gen generator with open JACK client
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t cw_jack_start_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->jack_data.mutex);
+	gen->jack_data.rendering = true;
+	pthread_mutex_unlock(&gen->jack_data.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop pulling samples from generator
+
+   @param[in] gen generator with open JACK client
+*/
+static void cw_jack_stop_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->jack_data.mutex);
+	gen->jack_data.rendering = false;
+	/* Tone that has been partially rendered belongs to tone queue
+	   that has been flushed. */
+	gen->render.has_tone = false;
+	pthread_mutex_unlock(&gen->jack_data.mutex);
+
+	return;
+}
+
+
+
+
+/* Callback called in JACK's realtime thread for every period of @p n_frames samples. */
+static int cw_jack_process_cb(jack_nframes_t n_frames, void * arg)
+{
+	cw_gen_t * gen = (cw_gen_t *) arg;
+	cw_jack_data_t * jack = &gen->jack_data;
+	jack_default_audio_sample_t * out = (jack_default_audio_sample_t *) g_cw_jack_lib_handle.jack_port_get_buffer(jack->port, n_frames);
+
+	/* Never wait for a thread that isn't realtime. */
+	if (0 != pthread_mutex_trylock(&jack->mutex)) {
+		memset(out, 0, sizeof (jack_default_audio_sample_t) * n_frames);
+		return 0;
+	}
+	if (!jack->rendering) {
+		pthread_mutex_unlock(&jack->mutex);
+		memset(out, 0, sizeof (jack_default_audio_sample_t) * n_frames);
+		return 0;
+	}
+
+	jack_nframes_t done = 0;
+	while (done < n_frames) {
+		jack_nframes_t n = n_frames - done;
+		if (n > (jack_nframes_t) gen->buffer_n_samples) {
+			n = (jack_nframes_t) gen->buffer_n_samples;
+		}
+		cw_gen_render_internal(gen, gen->buffer, (int) n);
+		cw_gen_tap_write_internal(gen, gen->buffer, (int) n);
+		cw_gen_convert_samples_internal(gen, gen->buffer, (int) n, out + done);
+		done += n;
+	}
+	pthread_mutex_unlock(&jack->mutex);
+
+	return 0;
+}
+
+
+
+
+/* Callback called when JACK server shuts down or disconnects the client. */
+static void cw_jack_shutdown_cb(void * arg)
+{
+	cw_gen_t * gen = (cw_gen_t *) arg;
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+		      MSG_PREFIX "JACK server has shut down");
+	gen->sound_device_is_open = false;
+}
+
+
+
+
+#else /* #ifdef LIBCW_WITH_JACK */
+
+
+
+
+bool cw_is_jack_possible(__attribute__((unused)) const char * device_name)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return false;
+}
+
+
+
+
+cw_ret_t cw_jack_init_gen_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return CW_FAILURE;
+}
+
+
+
+
+#endif /* #ifdef LIBCW_WITH_JACK */
@@ -0,0 +1,51 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_JACK
+#define H_LIBCW_JACK
+
+
+
+
+#include "config.h"
+
+
+
+
+#ifdef LIBCW_WITH_JACK
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <jack/jack.h>
+
+typedef struct cw_jack_data_struct {
+	jack_client_t * client;
+	jack_port_t * port;
+
+	/* Samples are rendered by JACK's process callback, in JACK's
+	   realtime thread. The callback only tries to lock the mutex, and
+	   outputs silence if it can't, so it never blocks on libcw
+	   threads. ::rendering is protected by the mutex. */
+	pthread_mutex_t mutex;
+	bool rendering;        /* Process callback pulls samples from generator. */
+} cw_jack_data_t;
+
+#endif /* #ifdef LIBCW_WITH_JACK */
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_jack_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_JACK */
@@ -27,12 +27,18 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <errno.h>
 #include <inttypes.h> /* uint32_t */
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>   /* usleep() */
 
 
@@ -43,7 +49,10 @@
 #include "libcw_gen.h"
 #include "libcw_key.h"
 #include "libcw_rec.h"
+#include "libcw_scheduler.h"
 #include "libcw_signal.h"
+#include "libcw_prof.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -142,9 +151,17 @@ static const char * cw_iambic_keyer_graph_states[] = {
 
 
 
-static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t * key);
+static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t * key, int64_t timestamp);
+static cw_ret_t cw_key_ik_advance_graph_state_internal(volatile cw_key_t * key);
+static void cw_key_ik_schedule_element_end_internal(volatile cw_key_t * key);
+static void cw_key_ik_deadline_callback_internal(void * arg);
+static int64_t cw_key_ik_now_internal(void);
+static bool cw_key_ik_events_pop_internal(cw_key_ik_events_t * events, cw_key_ik_event_t * event);
+static void * cw_key_ik_events_thread_fn(void * arg);
 static cw_ret_t cw_key_ik_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value, char symbol);
-static cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value);
+static void cw_key_ik_enqueue_next_element_internal(volatile cw_key_t * key);
+static void cw_key_ik_cancel_next_element_internal(volatile cw_key_t * key);
+static void cw_key_call_value_callback_internal(volatile cw_key_t * key, cw_key_value_t key_value);
 
 
 
@@ -263,6 +280,59 @@ void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec)
 
 
 
+/**
+   @brief Register function called on each change of value of key
+
+   @p callback_func is called with new value of straight key (see
+   cw_key_sk_set_value()) or of iambic keyer, and with time of the
+   change on CLOCK_MONOTONIC timeline. The function is called from
+   thread that changed the value: thread of client code, of key input,
+   of keyer or of generator. It must not block.
+
+   Pass NULL @p callback_func to unregister the callback. Register and
+   unregister the callback only when the key is not keyed.
+
+   @param[in,out] key key
+   @param[in] callback_func function to be called, or NULL
+   @param[in] callback_arg argument passed to @p callback_func
+*/
+void cw_key_register_value_callback(volatile cw_key_t * key, cw_key_value_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == key) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_WARNING,
+			      MSG_PREFIX "Passed NULL key pointer");
+		return;
+	}
+
+	key->value_callback = callback_func;
+	key->value_callback_arg = callback_arg;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Call key's value callback, if registered
+
+   @param[in] key key whose value has changed
+   @param[in] key_value new value of key
+*/
+static void cw_key_call_value_callback_internal(volatile cw_key_t * key, cw_key_value_t key_value)
+{
+	if (NULL == key->value_callback) {
+		return;
+	}
+	const int64_t timestamp = cw_key_ik_now_internal() / 1000;
+	key->value_callback(key->value_callback_arg, key_value, timestamp);
+
+	return;
+}
+
+
+
+
 /**
    @brief Set new key value, generate appropriate tone (Mark/Space)
 
@@ -274,17 +344,22 @@ void cw_key_register_receiver(volatile cw_key_t * key, cw_rec_t * rec)
    related generator @p gen is changed accordingly (a tone is started or
    stopped).
 
+   In direct receiving mode (see cw_key_sk_enable_direct_receiving()) the
+   change is also passed to key's receiver as beginning or end of Mark at
+   @p timestamp.
+
    @internal
    @reviewed 2020-08-01
    @endinternal
 
    @param[in] key key in use
    @param[in] key_value key value to be set
+   @param[in] timestamp time of change of key value on receiver's (wall-clock) timeline, zero for current time [microseconds]
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
 */
-cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value)
+cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value, int64_t timestamp)
 {
 	if (NULL == key) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
@@ -315,12 +390,30 @@ cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
 
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
 		      MSG_PREFIX_SK "sk set value %d->%d", key->sk.key_value, key_value);
+	CW_TRACE(CW_TRACE_KEY_SK, key_value);
 
 	/* Remember the new key value. */
 	key->sk.key_value = key_value;
 
-	/* TODO: if you want to have a per-key callback called on each key
-	  value change, you should call it here. */
+	cw_key_call_value_callback_internal(key, key_value);
+
+	if (key->sk.is_direct_receiving && NULL != key->rec) {
+		/* Receiver gets the change at the time of input, not
+		   when generator dequeues the tone. */
+		if (0 == timestamp) {
+			struct timeval t;
+			gettimeofday(&t, NULL);
+			timestamp = (int64_t) t.tv_sec * CW_USECS_PER_SEC + t.tv_usec;
+		}
+		const cw_ret_t rec_cwret = CW_KEY_VALUE_CLOSED == key->sk.key_value
+			? cw_rec_mark_begin_usecs(key->rec, timestamp)
+			: cw_rec_mark_end_usecs(key->rec, timestamp);
+		if (CW_SUCCESS != rec_cwret) {
+			/* E.g. noise spike. Not an error of the key. */
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_KEYING, CW_DEBUG_DEBUG,
+				      MSG_PREFIX_SK "receiver rejected key value %d, errno = %d", key->sk.key_value, errno);
+		}
+	}
 
 	cw_ret_t cwret = CW_FAILURE;
 	if (key->sk.key_value == CW_KEY_VALUE_CLOSED) {
@@ -384,9 +477,15 @@ cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
    @reviewed 2020-08-01
    @endinternal
 
+   Mark is enqueued together with ims that follows it, so for ims
+   (@p symbol being Space) nothing is enqueued. If the Mark has been
+   enqueued in advance (see cw_key_ik_enqueue_next_element_internal()),
+   it isn't enqueued again; if a different Mark has been enqueued in
+   advance, that Mark is cancelled.
+
    @param[in] key current key
    @param[in] key_value key value to be set
-   @param[in] symbol symbol to enqueue (Space, Dot, Dash)
+   @param[in] symbol symbol of started element (Space, Dot, Dash)
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
@@ -407,14 +506,26 @@ cw_ret_t cw_key_ik_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
 
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO,
 		      MSG_PREFIX_IK "ik set value %d->%d (symbol '%c')", key->ik.key_value, key_value, symbol);
+	CW_TRACE(CW_TRACE_KEY_IK, key_value);
 
 	/* Remember the new key value. */
 	key->ik.key_value = key_value;
 
-	/* TODO: if you want to have a per-key callback called on each key value
-	  change, you should call it here. */
+	cw_key_call_value_callback_internal(key, key_value);
 
-	cw_ret_t cwret = cw_gen_enqueue_ik_symbol_no_ims_internal(key->gen, symbol);
+	if (CW_SYMBOL_IMS == symbol) {
+		/* Ims has been enqueued together with the Mark. */
+		return CW_SUCCESS;
+	}
+
+	if (symbol == key->ik.next_element) {
+		key->ik.next_element = 0;
+		cw_gen_commit_ik_element_internal(key->gen);
+		return CW_SUCCESS;
+	}
+	cw_key_ik_cancel_next_element_internal(key);
+
+	cw_ret_t cwret = cw_gen_enqueue_ik_element_internal(key->gen, symbol, false);
 	cw_assert (CW_SUCCESS == cwret, MSG_PREFIX_IK "failed to key symbol '%c'", symbol);
 	return cwret;
 }
@@ -422,6 +533,89 @@ cw_ret_t cw_key_ik_set_value_internal(volatile cw_key_t * key, cw_key_value_t ke
 
 
 
+/**
+   @brief Enqueue in advance element that will follow current element
+
+   Called at the end of Mark, when generator starts playing ims that
+   follows the Mark. If values of paddles and latches say which element
+   keyer will start at the end of the ims, the element is enqueued
+   right away, so that generator has it in its queue when the ims
+   ends, and doesn't wait for the keyer. The decision is still made at
+   the end of the ims (paddle may be released or the other paddle may
+   be pressed in the meantime), and wrong guess is cancelled then.
+
+   Element that follows Dot in Curtis mode B, or opposite element with
+   latch set, is certain. Repetition of the same element is assumed
+   while its paddle is closed.
+
+   Only keyer clocked by generator enqueues elements in advance: at
+   the end of ims generator's thread waits for the keyer, so the
+   element can't be dequeued before the keyer cancels it. In timed
+   mode (see cw_key_ik_enable_timed_mode()) generator may be ahead of
+   the keyer.
+
+   @param[in] key iambic key at the end of Mark
+*/
+static void cw_key_ik_enqueue_next_element_internal(volatile cw_key_t * key)
+{
+	if (key->ik.is_timed_mode || 0 != key->ik.next_element) {
+		return;
+	}
+
+	char element = 0;
+	switch (key->ik.graph_state) {
+	case KS_AFTER_DOT_A:
+	case KS_AFTER_DOT_B:
+		if (KS_AFTER_DOT_B == key->ik.graph_state || key->ik.dash_latch) {
+			element = CW_DASH_REPRESENTATION;
+		} else if (CW_KEY_VALUE_CLOSED == key->ik.dot_paddle_value) {
+			element = CW_DOT_REPRESENTATION;
+		}
+		break;
+	case KS_AFTER_DASH_A:
+	case KS_AFTER_DASH_B:
+		if (KS_AFTER_DASH_B == key->ik.graph_state || key->ik.dot_latch) {
+			element = CW_DOT_REPRESENTATION;
+		} else if (CW_KEY_VALUE_CLOSED == key->ik.dash_paddle_value) {
+			element = CW_DASH_REPRESENTATION;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (0 != element && CW_SUCCESS == cw_gen_enqueue_ik_element_internal(key->gen, element, true)) {
+		key->ik.next_element = element;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Cancel element enqueued by cw_key_ik_enqueue_next_element_internal()
+
+   @param[in] key iambic key
+*/
+static void cw_key_ik_cancel_next_element_internal(volatile cw_key_t * key)
+{
+	if (0 == key->ik.next_element) {
+		return;
+	}
+	if (CW_SUCCESS != cw_gen_cancel_ik_element_internal(key->gen)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYER_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX_IK "'%s': failed to cancel element '%c' enqueued in advance", key->label, key->ik.next_element);
+	}
+	key->ik.next_element = 0;
+
+	return;
+}
+
+
+
+
 /* ******************************************************************** */
 /*                        Section:Iambic keyer                          */
 /* ******************************************************************** */
@@ -493,6 +687,84 @@ bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t *key)
 
 
 
+/**
+   @brief Enable timed mode of iambic keyer
+
+   By default iambic keyer is clocked by its generator: the keyer
+   moves to next graph state when the generator has finished playing
+   a Mark or Space enqueued by the keyer. The moment of end of an
+   element is then known only with granularity of sound system's
+   buffer (period), and so is the delay between a change of paddles
+   and keyer's reaction to it.
+
+   In timed mode the keyer schedules ends of elements by itself, on
+   CLOCK_MONOTONIC timeline with nanosecond resolution. End of each
+   element is calculated from end of previous element, not from the
+   moment when the end was noticed, so late wake-ups don't accumulate.
+   Generator still plays the Marks and Spaces enqueued by the keyer,
+   but it doesn't drive keyer's graph state.
+
+   Timed mode can be changed only when the keyer is idle.
+
+   @exception EBUSY keyer is not idle
+
+   @param[in] key key for which to change the parameter
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_enable_timed_mode(volatile cw_key_t * key)
+{
+	if (KS_IDLE != key->ik.graph_state) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+	key->ik.is_timed_mode = true;
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   See documentation of cw_key_ik_enable_timed_mode() for more information
+
+   @exception EBUSY keyer is not idle
+
+   @param[in] key key for which to change the parameter
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_disable_timed_mode(volatile cw_key_t * key)
+{
+	if (KS_IDLE != key->ik.graph_state) {
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+	key->ik.is_timed_mode = false;
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   See documentation of cw_key_ik_enable_timed_mode() for more information
+
+   @param[in] key key to investigate
+
+   @return true if timed mode is enabled for the key
+   @return false otherwise
+*/
+bool cw_key_ik_get_timed_mode(const volatile cw_key_t * key)
+{
+	return key->ik.is_timed_mode;
+}
+
+
+
+
 /**
    @brief Update graph state of iambic keyer, enqueue tone representing value of the iambic keyer
 
@@ -508,6 +780,10 @@ bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t *key)
    this function to inform iambic keyer that it's time for the keyer to
    update its internal graph state.
 
+   In timed mode (see cw_key_ik_enable_timed_mode()) the keyer doesn't
+   depend on generator's notifications, and the function returns
+   without changing keyer's graph state.
+
    @internal
    @reviewed 2020-08-01
    @endinternal
@@ -517,7 +793,7 @@ bool cw_key_ik_get_curtis_mode_b(const volatile cw_key_t *key)
    @return CW_FAILURE if there is a lock and the function cannot proceed
    @return CW_SUCCESS otherwise
 */
-cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
+CW_PROF_HOT cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 {
 	if (NULL == key) {
 		/* This function is called from generator thread. It
@@ -533,6 +809,37 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 		return CW_SUCCESS;
 	}
 
+	if (key->ik.is_timed_mode) {
+		/* Ends of elements are scheduled by keyer itself, see
+		   cw_key_ik_deadline_callback_internal(). */
+		return CW_SUCCESS;
+	}
+
+	CW_PROF_MARK(key_ik_update_begin);
+	const cw_ret_t cwret = cw_key_ik_advance_graph_state_internal(key);
+	CW_PROF_MARK(key_ik_update_end);
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Move iambic keyer to next graph state, enqueue tone representing value of the iambic keyer
+
+   Function evaluates values of paddles and paddle latches at the end
+   of current element, and moves keyer to next graph state.
+
+   In timed mode the function also schedules end of the element that
+   has been started.
+
+   @param[in] key iambic key
+
+   @return CW_FAILURE if there is a lock and the function cannot proceed
+   @return CW_SUCCESS otherwise
+*/
+static cw_ret_t cw_key_ik_advance_graph_state_internal(volatile cw_key_t * key)
+{
 	/* Iambic keyer needs a generator to measure times, so the generator
 	   must exist. Be paranoid and check it, just in case. */
 	cw_assert (key->gen, MSG_PREFIX_IK "gen is NULL");
@@ -581,6 +888,7 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 		   No routine status checks are made! (TODO) */
 		cw_key_ik_set_value_internal(key, CW_KEY_VALUE_OPEN, CW_SYMBOL_IMS);
 		key->ik.graph_state = key->ik.graph_state == KS_IN_DOT_A ? KS_AFTER_DOT_A : KS_AFTER_DOT_B;
+		cw_key_ik_enqueue_next_element_internal(key);
 		break;
 
 	case KS_IN_DASH_A:
@@ -597,6 +905,7 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 		   No routine status checks are made! (TODO) */
 		cw_key_ik_set_value_internal(key, CW_KEY_VALUE_OPEN, CW_SYMBOL_IMS);
 		key->ik.graph_state = key->ik.graph_state == KS_IN_DASH_A ? KS_AFTER_DASH_A : KS_AFTER_DASH_B;
+		cw_key_ik_enqueue_next_element_internal(key);
 		break;
 
 	case KS_AFTER_DOT_A:
@@ -641,6 +950,7 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 			cw_key_ik_set_value_internal(key, CW_KEY_VALUE_CLOSED, CW_DOT_REPRESENTATION);
 			key->ik.graph_state = KS_IN_DOT_A;
 		} else {
+			cw_key_ik_cancel_next_element_internal(key);
 			key->ik.graph_state = KS_IDLE;
 			//cw_finalization_schedule_internal();
 		}
@@ -689,6 +999,7 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 			cw_key_ik_set_value_internal(key, CW_KEY_VALUE_CLOSED, CW_DASH_REPRESENTATION);
 			key->ik.graph_state = KS_IN_DASH_A;
 		} else {
+			cw_key_ik_cancel_next_element_internal(key);
 			key->ik.graph_state = KS_IDLE;
 			//cw_finalization_schedule_internal();
 		}
@@ -707,7 +1018,16 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
 		      cw_iambic_keyer_graph_states[old_graph_state],
 		      cw_iambic_keyer_graph_states[key->ik.graph_state]);
 
+	if (key->ik.is_timed_mode) {
+		cw_key_ik_schedule_element_end_internal(key);
+	}
+
 	key->ik.lock = false;
+
+	/* Wake up threads waiting for end of element or for the keyer to
+	   become idle. */
+	cw_tq_broadcast_internal(key->gen->tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_KEYER));
+
 	return CW_SUCCESS;
 }
 
@@ -744,6 +1064,31 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key)
    @return CW_FAILURE on failure
 */
 cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value)
+{
+	return cw_key_ik_notify_paddle_event_internal(key, dot_paddle_value, dash_paddle_value, cw_key_ik_now_internal());
+}
+
+
+
+
+/**
+   @brief Inform iambic keyer about paddle event captured at given time
+
+   See cw_key_ik_notify_paddle_event() for more information.
+
+   In timed mode (see cw_key_ik_enable_timed_mode()) first element sent
+   by idle keyer starts at @p timestamp, so delay between capture of
+   the event and the call doesn't shorten the element.
+
+   @param[in] key key to notify about changed values of paddles
+   @param[in] dot_paddle_value value of dot paddle
+   @param[in] dash_paddle_value value of dash paddle
+   @param[in] timestamp time of capture of the event, on CLOCK_MONOTONIC timeline [nanoseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_notify_paddle_event_internal(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value, int64_t timestamp)
 {
 #if 0 /* This is disabled, but I'm not sure why. */  /* This code has been disabled some time before 2017-01-31. */
 	/* If the tone queue or the straight key are busy, this is going to
@@ -798,7 +1143,7 @@ cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t d
 	if (key->ik.graph_state == KS_IDLE) {
 		/* If the current graph state is idle, give the graph state
 		   process an initial impulse. */
-		return cw_key_ik_update_graph_state_initial_internal(key);
+		return cw_key_ik_update_graph_state_initial_internal(key, timestamp);
 	} else {
 		/* The graph state machine for iambic keyer is already in
 		   motion, no need to do anything more.
@@ -828,11 +1173,12 @@ cw_ret_t cw_key_ik_notify_paddle_event(volatile cw_key_t * key, cw_key_value_t d
    @endinternal
 
    @param[in] key key for which to initiate its work
+   @param[in] timestamp time of paddle event that initiates the work, on CLOCK_MONOTONIC timeline [nanoseconds]
 
    @return CW_SUCCESS on success
    @return CW_FAILURE on failure
 */
-static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t * key)
+static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t * key, int64_t timestamp)
 {
 	cw_assert (key, MSG_PREFIX_IK "key is NULL");
 	cw_assert (key->gen, MSG_PREFIX_IK "gen is NULL");
@@ -884,16 +1230,23 @@ static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t
 		      cw_iambic_keyer_graph_states[key->ik.graph_state]);
 
 
+	if (key->ik.is_timed_mode) {
+		/* First element starts with the paddle event, ends of
+		   next elements will be calculated from end of previous
+		   ones. */
+		key->ik.element_end = timestamp;
+	}
+
 	/* Here comes the "real" initial transition - this is why we
 	   called this function. We will transition from graph state set
 	   above into "real" graph state, reflecting values of paddles. */
-	cw_ret_t cwret = cw_key_ik_update_graph_state_internal(key);
+	cw_ret_t cwret = cw_key_ik_advance_graph_state_internal(key);
 	if (CW_FAILURE == cwret) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYER_STATES, CW_DEBUG_ERROR,
 			      MSG_PREFIX_IK "ik update initial: call to update_graph_state_initial() failed first time");
 		/* Just try again, once. */
 		usleep(1000);
-		cwret = cw_key_ik_update_graph_state_internal(key);
+		cwret = cw_key_ik_advance_graph_state_internal(key);
 		if (CW_FAILURE == cwret) {
 			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYER_STATES, CW_DEBUG_ERROR,
 				      MSG_PREFIX_IK "ik update initial: call to update_graph_state_initial() failed twice");
@@ -906,6 +1259,114 @@ static cw_ret_t cw_key_ik_update_graph_state_initial_internal(volatile cw_key_t
 
 
 
+/**
+   @brief Schedule end of element started by iambic keyer in timed mode
+
+   End of element is calculated from end of previous element
+   (key->ik.element_end), with duration of Mark or Space that has been
+   enqueued in generator for the element.
+
+   @param[in,out] key iambic key in timed mode
+*/
+static void cw_key_ik_schedule_element_end_internal(volatile cw_key_t * key)
+{
+	int duration = 0; /* [us] */
+	switch (key->ik.graph_state) {
+	case KS_IN_DOT_A:
+	case KS_IN_DOT_B:
+		duration = key->gen->durations->dot_duration;
+		break;
+	case KS_IN_DASH_A:
+	case KS_IN_DASH_B:
+		duration = key->gen->durations->dash_duration;
+		break;
+	case KS_AFTER_DOT_A:
+	case KS_AFTER_DOT_B:
+	case KS_AFTER_DASH_A:
+	case KS_AFTER_DASH_B:
+		duration = key->gen->durations->ims_duration;
+		break;
+	case KS_IDLE:
+	default:
+		/* No element, nothing to schedule. */
+		return;
+	}
+
+	key->ik.element_end += (int64_t) duration * 1000;
+
+	/* Scheduler's timeline has microsecond resolution. Round up, so
+	   that the deadline isn't reached before end of the element. */
+	const int64_t deadline = (key->ik.element_end + 999) / 1000;
+	if (!cw_scheduler_schedule_internal(key->ik.scheduler_entry, deadline)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYER_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX_IK "'%s': failed to schedule end of element", key->label);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Move iambic keyer in timed mode to next graph state at end of element
+
+   Function is called by library's scheduler thread.
+
+   @param[in] arg iambic key
+*/
+static void cw_key_ik_deadline_callback_internal(void * arg)
+{
+	volatile cw_key_t * key = (volatile cw_key_t *) arg;
+
+	if (!key->ik.is_timed_mode || KS_IDLE == key->ik.graph_state) {
+		/* Keyer has been reset while waiting for the deadline. */
+		return;
+	}
+
+#ifdef IAMBIC_KEY_HAS_TIMER
+	if (NULL != key->ik.ik_timer) {
+		/* Timestamp of end of element, on client's (wall-clock)
+		   timeline. */
+		struct timeval t;
+		gettimeofday(&t, NULL);
+		const int64_t lateness = (cw_key_ik_now_internal() - key->ik.element_end) / 1000;
+		const int64_t timestamp = (int64_t) t.tv_sec * CW_USECS_PER_SEC + t.tv_usec - lateness;
+		key->ik.ik_timer->tv_sec = (time_t) (timestamp / CW_USECS_PER_SEC);
+		key->ik.ik_timer->tv_usec = (suseconds_t) (timestamp % CW_USECS_PER_SEC);
+	}
+#endif
+
+	if (CW_FAILURE == cw_key_ik_advance_graph_state_internal(key)) {
+		/* Graph state is being updated by other thread. Just
+		   try again, in a moment. */
+		if (!cw_scheduler_schedule_internal(key->ik.scheduler_entry, cw_scheduler_now_internal() + 1000)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYER_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX_IK "'%s': failed to re-schedule end of element", key->label);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current time on timeline of iambic keyer in timed mode
+
+   @return time since unspecified point in the past (CLOCK_MONOTONIC) [nanoseconds]
+*/
+static int64_t cw_key_ik_now_internal(void)
+{
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+}
+
+
+
+
 /**
    @brief Change value of Dot paddle
 
@@ -1058,34 +1519,34 @@ cw_ret_t cw_key_ik_wait_for_end_of_current_element(const volatile cw_key_t * key
 
 	/* First wait for the graph state to move to idle (or just do nothing
 	   if it's not), or to one of the after- graph states. */
-	pthread_mutex_lock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_lock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 	while (key->ik.graph_state != KS_IDLE
 	       && key->ik.graph_state != KS_AFTER_DOT_A
 	       && key->ik.graph_state != KS_AFTER_DOT_B
 	       && key->ik.graph_state != KS_AFTER_DASH_A
 	       && key->ik.graph_state != KS_AFTER_DASH_B) {
 
-		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_tq_wait_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
-	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_unlock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 
 
 	/* Now wait for the graph state to move to idle (unless it is, or was,
 	   already), or one of the in- graph states, at which point we know
 	   we're actually at the end of the element we were in when we
 	   entered this routine. */
-	pthread_mutex_lock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_lock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 	while (key->ik.graph_state != KS_IDLE
 	       && key->ik.graph_state != KS_IN_DOT_A
 	       && key->ik.graph_state != KS_IN_DOT_B
 	       && key->ik.graph_state != KS_IN_DASH_A
 	       && key->ik.graph_state != KS_IN_DASH_B) {
 
-		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_tq_wait_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
-	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_unlock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 
 	return CW_SUCCESS;
 }
@@ -1124,12 +1585,12 @@ cw_ret_t cw_key_ik_wait_for_keyer(volatile cw_key_t * key)
 	}
 
 	/* Wait for the keyer graph state to go idle. */
-	pthread_mutex_lock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_lock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 	while (key->ik.graph_state != KS_IDLE) {
-		pthread_cond_wait(&key->gen->tq->wait_var, &key->gen->tq->wait_mutex);
+		cw_tq_wait_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 		/* cw_signal_wait_internal(); */ /* Old implementation was using signals. */ /* This code has been disabled some time before 2017-01-31. */
 	}
-	pthread_mutex_unlock(&key->gen->tq->wait_mutex);
+	cw_tq_wait_unlock_internal(key->gen->tq, CW_TQ_WAIT_KEYER);
 
 	return CW_SUCCESS;
 }
@@ -1189,6 +1650,11 @@ void cw_key_ik_reset_state_internal(volatile cw_key_t * key)
 	key->ik.dash_latch = false;
 	key->ik.curtis_mode_b = false;
 	key->ik.curtis_b_latch = false;
+	key->ik.next_element = 0;
+
+	if (key->gen) {
+		cw_tq_broadcast_internal(key->gen->tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_KEYER));
+	}
 
 	return;
 }
@@ -1224,6 +1690,12 @@ void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs)
 		return;
 	}
 
+	if (key->ik.is_timed_mode) {
+		/* In timed mode the timer is set at ends of elements,
+		   see cw_key_ik_deadline_callback_internal(). */
+		return;
+	}
+
 	if (key->ik.graph_state != KS_IDLE && NULL != key->ik.ik_timer) {
 		/* Update timestamp that clocks iambic keyer
 		   with current time interval. This must be
@@ -1246,6 +1718,243 @@ void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs)
 
 
 
+/* ******************************************************************** */
+/*                        Section:Paddle events                         */
+/* ******************************************************************** */
+
+
+
+
+/**
+   @brief Start keyer thread consuming paddle events
+
+   After the call client code can pass changes of paddles to @p key
+   with cw_key_ik_post_paddle_event(). The events are put into a
+   lock-free ring, and the keyer thread passes them to iambic keyer in
+   the same way as cw_key_ik_notify_paddle_event() does.
+
+   @exception EALREADY the thread is already running
+   @exception ENOMEM failed to allocate the ring
+   @exception EAGAIN failed to create the thread
+
+   @param[in,out] key key for which to start the thread
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_start_paddle_events(cw_key_t * key)
+{
+	if (NULL != key->ik.events) {
+		errno = EALREADY;
+		return CW_FAILURE;
+	}
+
+	cw_key_ik_events_t * events = (cw_key_ik_events_t *) calloc(1, sizeof (cw_key_ik_events_t));
+	if (NULL == events) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX_IK "'%s': start paddle events: calloc()", key->label);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	for (unsigned int i = 0; i < CW_KEY_IK_EVENTS_CAPACITY; i++) {
+		events->ring[i].sequence = i;
+	}
+	if (0 != sem_init(&events->sem, 0, 0)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX_IK "'%s': start paddle events: sem_init()", key->label);
+		free(events);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	events->do_consume = true;
+
+	/* The ring is visible to producers only after the thread has
+	   been created. */
+	key->ik.events = events;
+	const int rv = pthread_create(&events->thread, NULL, cw_key_ik_events_thread_fn, key);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX_IK "'%s': start paddle events: failed to create keyer thread", key->label);
+		key->ik.events = NULL;
+		sem_destroy(&events->sem);
+		free(events);
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop keyer thread started with cw_key_ik_start_paddle_events()
+
+   Events that have not been consumed yet are discarded. Client code
+   must not call cw_key_ik_post_paddle_event() for @p key during or after
+   the call.
+
+   The thread is stopped automatically when @p key is deleted.
+
+   @param[in,out] key key for which to stop the thread
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_key_ik_stop_paddle_events(cw_key_t * key)
+{
+	cw_key_ik_events_t * events = key->ik.events;
+	if (NULL == events) {
+		return CW_SUCCESS;
+	}
+
+	__atomic_store_n(&events->do_consume, false, __ATOMIC_RELEASE);
+	sem_post(&events->sem);
+	pthread_join(events->thread, NULL);
+
+	key->ik.events = NULL;
+	sem_destroy(&events->sem);
+	free(events);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Post change of values of paddles to keyer thread
+
+   Function captures time of the event, puts the event into lock-free
+   ring of @p key and wakes up keyer thread started with
+   cw_key_ik_start_paddle_events(). The function never blocks and is
+   async-signal-safe, so it can be called from signal handlers and
+   realtime threads handling paddle hardware. Many threads can post
+   events for the same key at the same time.
+
+   The keyer thread handles the event as cw_key_ik_notify_paddle_event()
+   does. In timed mode (see cw_key_ik_enable_timed_mode()) the first
+   element sent by idle keyer starts at the time of capture of the
+   event, not when the keyer thread got to the event.
+
+   @exception ENODEV keyer thread is not running
+   @exception EAGAIN the ring is full, the event is dropped
+
+   @param[in] key key to notify about changed values of paddles
+   @param[in] dot_paddle_value value of dot paddle
+   @param[in] dash_paddle_value value of dash paddle
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_key_ik_post_paddle_event(cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value)
+{
+	const int64_t timestamp = cw_key_ik_now_internal();
+
+	cw_key_ik_events_t * events = key->ik.events;
+	if (NULL == events) {
+		errno = ENODEV;
+		return CW_FAILURE;
+	}
+
+	unsigned int pos = __atomic_load_n(&events->enqueue_pos, __ATOMIC_RELAXED);
+	while (true) {
+		cw_key_ik_event_t * slot = &events->ring[pos & (CW_KEY_IK_EVENTS_CAPACITY - 1)];
+		const unsigned int sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		const int diff = (int) (sequence - pos);
+		if (0 == diff) {
+			/* Free slot. Claim it, unless other producer has
+			   been faster; on failure @p pos is updated. */
+			if (__atomic_compare_exchange_n(&events->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->timestamp = timestamp;
+				slot->dot_paddle_value = dot_paddle_value;
+				slot->dash_paddle_value = dash_paddle_value;
+				__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+				break;
+			}
+		} else if (diff < 0) {
+			/* Slot hasn't been consumed yet: ring is full. */
+			errno = EAGAIN;
+			return CW_FAILURE;
+		} else {
+			/* Other producer has claimed the slot. */
+			pos = __atomic_load_n(&events->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	sem_post(&events->sem);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Take oldest event from ring of paddle events
+
+   Function may be called only by keyer thread.
+
+   @param[in,out] events ring of events
+   @param[out] event taken event
+
+   @return true if an event has been taken
+   @return false if the ring is empty
+*/
+static bool cw_key_ik_events_pop_internal(cw_key_ik_events_t * events, cw_key_ik_event_t * event)
+{
+	cw_key_ik_event_t * slot = &events->ring[events->dequeue_pos & (CW_KEY_IK_EVENTS_CAPACITY - 1)];
+	const unsigned int sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+	if (sequence != events->dequeue_pos + 1) {
+		/* Slot is free, or it's being filled by producer. */
+		return false;
+	}
+
+	*event = *slot;
+	__atomic_store_n(&slot->sequence, events->dequeue_pos + CW_KEY_IK_EVENTS_CAPACITY, __ATOMIC_RELEASE);
+	events->dequeue_pos++;
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Main function of keyer thread
+
+   @param[in] arg key with ring of paddle events
+
+   @return NULL
+*/
+static void * cw_key_ik_events_thread_fn(void * arg)
+{
+	cw_key_t * key = (cw_key_t *) arg;
+	cw_key_ik_events_t * events = key->ik.events;
+
+	while (true) {
+		while (0 != sem_wait(&events->sem) && EINTR == errno) {
+			;
+		}
+		if (!__atomic_load_n(&events->do_consume, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		cw_key_ik_event_t event;
+		while (cw_key_ik_events_pop_internal(events, &event)) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_KEYER_STATES, CW_DEBUG_DEBUG,
+				      MSG_PREFIX_IK "'%s': paddle event %d,%d delivered after %" PRId64 " [ns]",
+				      key->label, event.dot_paddle_value, event.dash_paddle_value,
+				      cw_key_ik_now_internal() - event.timestamp);
+			cw_key_ik_notify_paddle_event_internal(key, event.dot_paddle_value, event.dash_paddle_value, event.timestamp);
+		}
+	}
+
+	return NULL;
+}
+
+
+
 /* ******************************************************************** */
 /*                        Section:Straight key                          */
 /* ******************************************************************** */
@@ -1282,7 +1991,64 @@ cw_ret_t cw_key_sk_set_value(volatile cw_key_t * key, cw_key_value_t key_value)
 	}
 #endif
 
-	return cw_key_sk_set_value_internal(key, key_value);
+	return cw_key_sk_set_value_internal(key, key_value, 0);
+}
+
+
+
+
+/**
+   @brief Pass changes of straight key directly to receiver
+
+   By default a receiver registered with cw_key_register_receiver()
+   learns about changes of straight key only through generator: the
+   generator reports change of its value when it dequeues a tone, so
+   the receiver gets timestamps delayed by latency of generator's tone
+   queue and sound system.
+
+   In direct receiving mode each change of key value passed to
+   cw_key_sk_set_value() is timestamped at the call and passed to the
+   receiver immediately, with cw_rec_mark_begin() or cw_rec_mark_end().
+   Sidetone is generated by generator as before. Client code shouldn't
+   feed the receiver from generator's value tracking callback in this
+   mode.
+
+   @param[in] key key for which to change the parameter
+*/
+void cw_key_sk_enable_direct_receiving(volatile cw_key_t * key)
+{
+	key->sk.is_direct_receiving = true;
+	return;
+}
+
+
+
+
+/**
+   See documentation of cw_key_sk_enable_direct_receiving() for more information
+
+   @param[in] key key for which to change the parameter
+*/
+void cw_key_sk_disable_direct_receiving(volatile cw_key_t * key)
+{
+	key->sk.is_direct_receiving = false;
+	return;
+}
+
+
+
+
+/**
+   See documentation of cw_key_sk_enable_direct_receiving() for more information
+
+   @param[in] key key to investigate
+
+   @return true if direct receiving mode is enabled for the key
+   @return false otherwise
+*/
+bool cw_key_sk_get_direct_receiving(const volatile cw_key_t * key)
+{
+	return key->sk.is_direct_receiving;
 }
 
 
@@ -1384,7 +2150,11 @@ cw_key_t * cw_key_new(void)
 	key->gen = (cw_gen_t *) NULL;
 	key->rec = (cw_rec_t *) NULL;
 
+	key->value_callback = NULL;
+	key->value_callback_arg = NULL;
+
 	key->sk.key_value = CW_KEY_VALUE_OPEN;
+	key->sk.is_direct_receiving = false;
 
 	key->ik.graph_state = KS_IDLE;
 	key->ik.key_value = CW_KEY_VALUE_OPEN;
@@ -1396,9 +2166,23 @@ cw_key_t * cw_key_new(void)
 
 	key->ik.curtis_mode_b = false;
 	key->ik.curtis_b_latch = false;
+	key->ik.next_element = 0;
 
 	key->ik.lock = false;
 
+	key->ik.is_timed_mode = false;
+	key->ik.element_end = 0;
+	key->ik.scheduler_entry = (cw_scheduler_entry_t *) calloc(1, sizeof (cw_scheduler_entry_t));
+	if (NULL == key->ik.scheduler_entry) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: calloc()");
+		free(key);
+		return (cw_key_t *) NULL;
+	}
+	cw_scheduler_entry_init_internal(key->ik.scheduler_entry, cw_key_ik_deadline_callback_internal, key);
+
+	key->ik.events = NULL;
+
 #ifdef IAMBIC_KEY_HAS_TIMER
 	key->ik.ik_timer = NULL;
 #endif
@@ -1430,6 +2214,10 @@ void cw_key_delete(cw_key_t ** key)
 		return;
 	}
 
+	cw_key_ik_stop_paddle_events(*key);
+	cw_scheduler_cancel_internal((*key)->ik.scheduler_entry);
+	free((*key)->ik.scheduler_entry);
+
 	if (NULL != (*key)->gen) {
 		/* Unregister. */
 		(*key)->gen->key = NULL;
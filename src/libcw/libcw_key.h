@@ -9,12 +9,16 @@
 
 
 
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdbool.h>
+#include <stdint.h> /* int64_t */
 
 
 
 
 #include "libcw2.h"
+#include "libcw_scheduler.h"
 
 
 
@@ -34,6 +38,43 @@ enum {
 
 
 
+/* Capacity of ring of paddle events, see cw_key_ik_post_paddle_event().
+   Must be a power of two. */
+enum { CW_KEY_IK_EVENTS_CAPACITY = 64 };
+
+
+/* Paddle event captured by cw_key_ik_post_paddle_event(). */
+typedef struct {
+	/* Ticket of slot in ring. Slot with ticket equal to position of
+	   producer is free, slot with ticket one above position of
+	   consumer is filled. */
+	unsigned int sequence;
+
+	int64_t timestamp; /* [nanoseconds] Time of capture, on CLOCK_MONOTONIC timeline. */
+	cw_key_value_t dot_paddle_value;
+	cw_key_value_t dash_paddle_value;
+} cw_key_ik_event_t;
+
+
+/* Lock-free ring of paddle events, with many producers (client code
+   posting events, possibly from signal handlers) and one consumer
+   (keyer thread passing the events to iambic keyer). Fields marked as
+   atomic are accessed only with __atomic builtins. */
+typedef struct {
+	cw_key_ik_event_t ring[CW_KEY_IK_EVENTS_CAPACITY];
+	unsigned int enqueue_pos; /* Atomic. */
+	unsigned int dequeue_pos; /* Accessed only by keyer thread. */
+
+	/* Posted for each event. sem_post() doesn't block and is
+	   async-signal-safe. */
+	sem_t sem;
+
+	bool do_consume; /* Atomic. */
+	pthread_t thread;
+} cw_key_ik_events_t;
+
+
+
 /* For modern API. */
 typedef void (* cw_key_callback_t)(volatile struct timeval * timestamp, int key_state, void * callback_arg);
 
@@ -78,9 +119,19 @@ struct cw_key_struct {
 	cw_rec_t * rec;
 
 
+	/* Called on each change of value of straight key or of iambic
+	   keyer, see cw_key_register_value_callback(). */
+	cw_key_value_callback_t value_callback;
+	void * value_callback_arg;
+
+
 	/* Straight key. */
 	struct {
 		cw_key_value_t key_value;
+
+		/* Pass changes of key value directly to ->rec, see
+		   cw_key_sk_enable_direct_receiving(). */
+		bool is_direct_receiving;
 	} sk;
 
 
@@ -116,6 +167,26 @@ struct cw_key_struct {
 		/* FIXME: describe why we need this flag. */
 		bool lock;
 
+		/* Element (Dot or Dash) that has been enqueued in
+		   generator after current element, before keyer has
+		   decided to start it. Zero if there is no such
+		   element. */
+		char next_element;
+
+		/* Timed mode, see cw_key_ik_enable_timed_mode(). Ends of
+		   elements are scheduled by keyer on CLOCK_MONOTONIC
+		   timeline instead of being reported by generator. */
+		bool is_timed_mode;
+		int64_t element_end; /* [nanoseconds] End of current element. Valid in non-idle graph state. */
+		/* Allocated separately, so that the entry isn't accessed
+		   through volatile pointer to key. */
+		cw_scheduler_entry_t * scheduler_entry;
+
+		/* Ring of paddle events consumed by keyer thread, see
+		   cw_key_ik_start_paddle_events(). NULL when the thread
+		   is not running. */
+		cw_key_ik_events_t * events;
+
 #define IAMBIC_KEY_HAS_TIMER
 #ifdef IAMBIC_KEY_HAS_TIMER
 		/* Timer for receiving of iambic keying, owned by client code. */
@@ -134,6 +205,7 @@ cw_ret_t cw_key_ik_update_graph_state_internal(volatile cw_key_t * key);
 void cw_key_ik_increment_timer_internal(volatile cw_key_t * key, int usecs);
 #endif
 void cw_key_ik_register_timer_internal(volatile cw_key_t * key, struct timeval * timer);
+cw_ret_t cw_key_ik_notify_paddle_event_internal(volatile cw_key_t * key, cw_key_value_t dot_paddle_value, cw_key_value_t dash_paddle_value, int64_t timestamp);
 
 
 void cw_key_ik_get_paddle_latches_internal(volatile cw_key_t * key, int * dot_paddle_latch_state, int * dash_paddle_latch_state);
@@ -142,6 +214,7 @@ bool cw_key_ik_is_busy_internal(const volatile cw_key_t * key);
 void cw_key_ik_reset_internal(volatile cw_key_t * key);
 void cw_key_ik_reset_state_internal(volatile cw_key_t * key);
 
+cw_ret_t cw_key_sk_set_value_internal(volatile cw_key_t * key, cw_key_value_t key_value, int64_t timestamp);
 void cw_key_sk_reset_internal(volatile cw_key_t * key);
 void cw_key_sk_reset_state_internal(volatile cw_key_t * key);
 
@@ -0,0 +1,592 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+/**
+   @file libcw_key_input.c
+
+   @brief Inputs reading keys and paddles from hardware devices.
+
+   Each input has a thread that blocks in the kernel until value of a
+   key line changes: in read() of evdev events, in read() of GPIO line
+   events, or in TIOCMIWAIT ioctl() of serial port. Changes are passed
+   to the key directly from the thread, with timestamps of kernel
+   events where the kernel provides them.
+
+   TIOCMIWAIT can't be waited on with poll(), so the thread is woken up
+   for termination with a signal that interrupts the blocking call.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h> /* PRId64 */
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/gpio.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_key.h"
+#include "libcw_key_input.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/key input: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#if defined(__linux__)
+
+
+
+
+/* Signal interrupting blocking calls of input threads. */
+#define CW_KEY_INPUT_WAKEUP_SIGNAL (SIGRTMIN)
+
+
+
+
+static pthread_once_t g_cw_key_input_signal_once = PTHREAD_ONCE_INIT;
+
+
+
+
+static void cw_key_input_install_signal_handler_internal(void);
+static void cw_key_input_signal_handler_internal(int signal_number);
+static cw_ret_t cw_key_input_open_internal(cw_key_input_t * input);
+static void * cw_key_input_thread_fn(void * arg);
+static void cw_key_input_read_evdev_internal(cw_key_input_t * input);
+static void cw_key_input_read_gpio_internal(cw_key_input_t * input);
+static void cw_key_input_read_serial_internal(cw_key_input_t * input);
+static void cw_key_input_set_values_internal(cw_key_input_t * input, cw_key_value_t dot_value, cw_key_value_t dash_value, int64_t timestamp);
+static int64_t cw_key_input_now_internal(void);
+
+
+
+
+cw_key_input_t * cw_key_input_new(cw_key_t * key, const cw_key_input_config_t * config)
+{
+	if (NULL == key || NULL == config) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: NULL key or config");
+		errno = EINVAL;
+		return NULL;
+	}
+	if ('\0' == config->device[0]
+	    || (config->is_iambic && config->dot_line == config->dash_line)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: invalid config");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_key_input_t * input = (cw_key_input_t *) calloc(1, sizeof (cw_key_input_t));
+	if (NULL == input) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: calloc()");
+		errno = ENOMEM;
+		return NULL;
+	}
+	input->config = *config;
+	input->config.device[LIBCW_KEY_INPUT_DEVICE_NAME_SIZE - 1] = '\0';
+	input->key = key;
+	input->fd = -1;
+	input->dot_value = CW_KEY_VALUE_OPEN;
+	input->dash_value = CW_KEY_VALUE_OPEN;
+
+	if (CW_SUCCESS != cw_key_input_open_internal(input)) {
+		const int err = errno;
+		if (input->fd >= 0) {
+			close(input->fd);
+		}
+		free(input);
+		errno = err;
+		return NULL;
+	}
+
+	pthread_once(&g_cw_key_input_signal_once, cw_key_input_install_signal_handler_internal);
+
+	input->do_read = true;
+	const int rv = pthread_create(&input->thread, NULL, cw_key_input_thread_fn, input);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: failed to create input thread");
+		close(input->fd);
+		free(input);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return input;
+}
+
+
+
+
+void cw_key_input_delete(cw_key_input_t ** input)
+{
+	if (NULL == input || NULL == *input) {
+		return;
+	}
+
+	__atomic_store_n(&(*input)->do_read, false, __ATOMIC_RELEASE);
+
+	/* The signal may arrive before the thread enters blocking call,
+	   so repeat it until the thread notices the flag. */
+	while (!__atomic_load_n(&(*input)->has_exited, __ATOMIC_ACQUIRE)) {
+		pthread_kill((*input)->thread, CW_KEY_INPUT_WAKEUP_SIGNAL);
+		cw_usleep_internal(1000);
+	}
+	pthread_join((*input)->thread, NULL);
+
+	close((*input)->fd);
+
+	if ((*input)->config.is_iambic) {
+		cw_key_ik_notify_paddle_event((*input)->key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+	} else {
+		cw_key_sk_set_value((*input)->key, CW_KEY_VALUE_OPEN);
+	}
+
+	free(*input);
+	*input = NULL;
+}
+
+
+
+
+/**
+   @brief Install handler of signal waking up input threads
+
+   The handler is installed without SA_RESTART, so that blocking calls
+   interrupted by the signal fail with EINTR. Handler installed by
+   client code is left in place (it must be installed without
+   SA_RESTART too).
+*/
+static void cw_key_input_install_signal_handler_internal(void)
+{
+	struct sigaction old_action;
+	if (0 != sigaction(CW_KEY_INPUT_WAKEUP_SIGNAL, NULL, &old_action)) {
+		return;
+	}
+	if (SIG_DFL != old_action.sa_handler && SIG_IGN != old_action.sa_handler) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_WARNING,
+			      MSG_PREFIX "signal %d has handler installed by client code", CW_KEY_INPUT_WAKEUP_SIGNAL);
+		return;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof (action));
+	action.sa_handler = cw_key_input_signal_handler_internal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = 0;
+	sigaction(CW_KEY_INPUT_WAKEUP_SIGNAL, &action, NULL);
+}
+
+
+
+
+static void cw_key_input_signal_handler_internal(__attribute__((unused)) int signal_number)
+{
+	/* Only interrupt blocking call of input thread. */
+	return;
+}
+
+
+
+
+/**
+   @brief Open device of input, read initial values of lines
+
+   @param[in,out] input input with configuration
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure (errno is set)
+*/
+static cw_ret_t cw_key_input_open_internal(cw_key_input_t * input)
+{
+	const cw_key_input_config_t * config = &input->config;
+
+	switch (config->type) {
+	case CW_KEY_INPUT_EVDEV:
+		input->fd = open(config->device, O_RDONLY | O_CLOEXEC);
+		if (input->fd < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to open evdev device '%s'", config->device);
+			return CW_FAILURE;
+		}
+		{
+			/* Timestamps of events on the same timeline
+			   as iambic keyer's. */
+			int clock_id = CLOCK_MONOTONIC;
+			if (0 != ioctl(input->fd, EVIOCSCLOCKID, &clock_id)) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+					      MSG_PREFIX "'%s' is not an evdev device", config->device);
+				return CW_FAILURE;
+			}
+		}
+		return CW_SUCCESS;
+
+	case CW_KEY_INPUT_GPIO:
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+		{
+			const int chip_fd = open(config->device, O_RDONLY | O_CLOEXEC);
+			if (chip_fd < 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to open GPIO chip '%s'", config->device);
+				return CW_FAILURE;
+			}
+
+			struct gpio_v2_line_request request;
+			memset(&request, 0, sizeof (request));
+			request.offsets[0] = config->dot_line;
+			request.offsets[1] = config->dash_line;
+			request.num_lines = config->is_iambic ? 2 : 1;
+			snprintf(request.consumer, sizeof (request.consumer), "%s", "libcw");
+			request.config.flags = GPIO_V2_LINE_FLAG_INPUT
+				| GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING
+				| (config->active_low ? GPIO_V2_LINE_FLAG_ACTIVE_LOW : 0);
+			/* Events are timestamped with CLOCK_MONOTONIC by default. */
+
+			const int rv = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+			const int err = errno;
+			close(chip_fd);
+			if (0 != rv) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to request lines of GPIO chip '%s'", config->device);
+				errno = err;
+				return CW_FAILURE;
+			}
+			input->fd = request.fd;
+
+			/* Key may be already closed. */
+			struct gpio_v2_line_values values = { .bits = 0, .mask = config->is_iambic ? 3 : 1 };
+			if (0 == ioctl(input->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values)) {
+				cw_key_input_set_values_internal(input,
+								 (values.bits & 1) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN,
+								 (values.bits & 2) ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN,
+								 cw_key_input_now_internal());
+			}
+		}
+		return CW_SUCCESS;
+#else
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "GPIO inputs need GPIO character device API v2");
+		errno = ENOTSUP;
+		return CW_FAILURE;
+#endif
+
+	case CW_KEY_INPUT_SERIAL:
+		input->fd = open(config->device, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (input->fd < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to open serial port '%s'", config->device);
+			return CW_FAILURE;
+		}
+		{
+			int lines = 0;
+			if (0 != ioctl(input->fd, TIOCMGET, &lines)) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+					      MSG_PREFIX "'%s' doesn't have modem lines", config->device);
+				return CW_FAILURE;
+			}
+		}
+		return CW_SUCCESS;
+
+	default:
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid type of input %d", config->type);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+}
+
+
+
+
+/**
+   @brief Main function of input thread
+
+   @param[in] arg key input
+
+   @return NULL
+*/
+static void * cw_key_input_thread_fn(void * arg)
+{
+	cw_key_input_t * input = (cw_key_input_t *) arg;
+
+	switch (input->config.type) {
+	case CW_KEY_INPUT_EVDEV:
+		cw_key_input_read_evdev_internal(input);
+		break;
+	case CW_KEY_INPUT_GPIO:
+		cw_key_input_read_gpio_internal(input);
+		break;
+	case CW_KEY_INPUT_SERIAL:
+		cw_key_input_read_serial_internal(input);
+		break;
+	default:
+		break;
+	}
+
+	__atomic_store_n(&input->has_exited, true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Read key events from evdev device
+
+   Events of autorepeat of keys are ignored.
+
+   @param[in,out] input key input
+*/
+static void cw_key_input_read_evdev_internal(cw_key_input_t * input)
+{
+	struct input_event events[16];
+
+	while (__atomic_load_n(&input->do_read, __ATOMIC_ACQUIRE)) {
+		const ssize_t n_bytes = read(input->fd, events, sizeof (events));
+		if (n_bytes < 0) {
+			if (EINTR == errno || EAGAIN == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to read evdev device '%s'", input->config.device);
+			break;
+		}
+
+		cw_key_value_t dot_value = input->dot_value;
+		cw_key_value_t dash_value = input->dash_value;
+		for (size_t i = 0; i < (size_t) n_bytes / sizeof (events[0]); i++) {
+			const struct input_event * event = &events[i];
+			if (EV_KEY != event->type || 2 == event->value) {
+				continue;
+			}
+			const cw_key_value_t value = event->value ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+			if (event->code == input->config.dot_line) {
+				dot_value = value;
+			} else if (input->config.is_iambic && event->code == input->config.dash_line) {
+				dash_value = value;
+			} else {
+				continue;
+			}
+			const int64_t timestamp = (int64_t) event->input_event_sec * 1000 * 1000 * 1000
+				+ (int64_t) event->input_event_usec * 1000;
+			cw_key_input_set_values_internal(input, dot_value, dash_value, timestamp);
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Read edge events from lines of GPIO chip
+
+   @param[in,out] input key input
+*/
+static void cw_key_input_read_gpio_internal(cw_key_input_t * input)
+{
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+	struct gpio_v2_line_event events[16];
+
+	while (__atomic_load_n(&input->do_read, __ATOMIC_ACQUIRE)) {
+		const ssize_t n_bytes = read(input->fd, events, sizeof (events));
+		if (n_bytes < 0) {
+			if (EINTR == errno || EAGAIN == errno) {
+				continue;
+			}
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to read lines of GPIO chip '%s'", input->config.device);
+			break;
+		}
+
+		cw_key_value_t dot_value = input->dot_value;
+		cw_key_value_t dash_value = input->dash_value;
+		for (size_t i = 0; i < (size_t) n_bytes / sizeof (events[0]); i++) {
+			const struct gpio_v2_line_event * event = &events[i];
+			/* Active-low lines are inverted by kernel. */
+			const cw_key_value_t value = GPIO_V2_LINE_EVENT_RISING_EDGE == event->id ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN;
+			if (event->offset == input->config.dot_line) {
+				dot_value = value;
+			} else {
+				dash_value = value;
+			}
+			cw_key_input_set_values_internal(input, dot_value, dash_value, (int64_t) event->timestamp_ns);
+		}
+	}
+#else
+	(void) input;
+#endif
+}
+
+
+
+
+/**
+   @brief Wait for changes of modem lines of serial port
+
+   @param[in,out] input key input
+*/
+static void cw_key_input_read_serial_internal(cw_key_input_t * input)
+{
+	const int mask = (int) (input->config.dot_line | (input->config.is_iambic ? input->config.dash_line : 0));
+
+	while (__atomic_load_n(&input->do_read, __ATOMIC_ACQUIRE)) {
+		int lines = 0;
+		if (0 != ioctl(input->fd, TIOCMGET, &lines)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to get modem lines of '%s'", input->config.device);
+			break;
+		}
+		const int64_t timestamp = cw_key_input_now_internal();
+		const bool is_dot_high = 0 != (lines & (int) input->config.dot_line);
+		const bool is_dash_high = 0 != (lines & (int) input->config.dash_line);
+		cw_key_input_set_values_internal(input,
+						 is_dot_high != input->config.active_low ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN,
+						 is_dash_high != input->config.active_low ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN,
+						 timestamp);
+
+		/* Blocks until one of lines in mask changes. Changes
+		   between TIOCMGET and TIOCMIWAIT are not lost: the
+		   values are read again at next iteration. */
+		if (0 != ioctl(input->fd, TIOCMIWAIT, mask) && EINTR != errno) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to wait for modem lines of '%s'", input->config.device);
+			break;
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Pass changed values of lines to key of input
+
+   @param[in,out] input key input
+   @param[in] dot_value value of straight key or Dot paddle
+   @param[in] dash_value value of Dash paddle
+   @param[in] timestamp time of change on CLOCK_MONOTONIC timeline [nanoseconds]
+*/
+static void cw_key_input_set_values_internal(cw_key_input_t * input, cw_key_value_t dot_value, cw_key_value_t dash_value, int64_t timestamp)
+{
+	if (!input->config.is_iambic) {
+		dash_value = CW_KEY_VALUE_OPEN;
+	}
+	if (dot_value == input->dot_value && dash_value == input->dash_value) {
+		return;
+	}
+	input->dot_value = dot_value;
+	input->dash_value = dash_value;
+
+	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_KEYING, CW_DEBUG_DEBUG,
+		      MSG_PREFIX "'%s': lines %d,%d, delay %" PRId64 " [ns]",
+		      input->config.device, dot_value, dash_value, cw_key_input_now_internal() - timestamp);
+
+	if (input->config.is_iambic) {
+		cw_key_ik_notify_paddle_event_internal(input->key, dot_value, dash_value, timestamp);
+	} else {
+		/* Receiver of key in direct receiving mode gets time of
+		   the change on its (wall-clock) timeline. */
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		const int64_t delay = (cw_key_input_now_internal() - timestamp) / 1000;
+		cw_key_sk_set_value_internal(input->key, dot_value, (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec - delay);
+	}
+}
+
+
+
+
+/**
+   @brief Get current time on CLOCK_MONOTONIC timeline
+
+   @return time since unspecified point in the past [nanoseconds]
+*/
+static int64_t cw_key_input_now_internal(void)
+{
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * 1000 * 1000 * 1000 + now.tv_nsec;
+}
+
+
+
+
+#else /* #if defined(__linux__) */
+
+
+
+
+cw_key_input_t * cw_key_input_new(__attribute__((unused)) cw_key_t * key, __attribute__((unused)) const cw_key_input_config_t * config)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+		      MSG_PREFIX "key inputs are not supported on this platform");
+	errno = ENOTSUP;
+	return NULL;
+}
+
+
+
+
+void cw_key_input_delete(__attribute__((unused)) cw_key_input_t ** input)
+{
+	return;
+}
+
+
+
+
+#endif /* #if defined(__linux__) */
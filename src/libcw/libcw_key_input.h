@@ -0,0 +1,45 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_KEY_INPUT
+#define H_LIBCW_KEY_INPUT
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+struct cw_key_input_struct {
+	cw_key_input_config_t config;
+
+	/* Key fed with values of lines (not owned by input). */
+	cw_key_t * key;
+
+	/* Descriptor of device, or of GPIO line request. */
+	int fd;
+
+	/* Last values passed to key. */
+	cw_key_value_t dot_value;
+	cw_key_value_t dash_value;
+
+	pthread_t thread;
+	bool do_read;     /* Atomic. Cleared by cw_key_input_delete(). */
+	bool has_exited;  /* Atomic. Set by input thread before return. */
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_KEY_INPUT */
@@ -0,0 +1,665 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_mixer.c
+
+   @brief Mixer of many generators playing through one sound sink.
+
+   Every generator normally has its own sound sink and its own thread
+   dequeueing tones and writing samples to the sink. Applications
+   simulating many simultaneous signals (e.g. contest simulators) would
+   need dozens of threads and sound devices.
+
+   A mixer has only one sound sink and one thread. In every iteration of
+   the thread a block of samples is rendered from tone queues of all
+   registered generators, and the blocks are summed (with per-generator
+   gain) into one buffer that is written to mixer's sound sink.
+
+   Generators registered in a mixer should be created with Null sound
+   system (they never use their own sound sink), and must not be started
+   with cw_gen_start().
+
+   With many generators rendering of their samples may take more time
+   than one thread has for a block. Mixer can then use a fixed pool of
+   worker threads (see cw_mixer_set_n_workers()). Each worker gets an
+   equal share of sources of a block, and a worker that has rendered
+   its share steals sources not yet taken by other workers. Mixer's
+   thread is one of the workers, and it sums the rendered blocks when
+   all sources are rendered. Count of threads depends on count of CPUs,
+   not on count of generators.
+*/
+
+
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* sysconf() */
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_mixer.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/mixer: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void * cw_mixer_mix_internal(void * arg);
+static void * cw_mixer_worker_internal(void * arg);
+static void cw_mixer_stop_workers_internal(cw_mixer_t * mixer);
+static void cw_mixer_render_sources_internal(cw_mixer_t * mixer, int worker);
+static int cw_mixer_take_source_internal(uint64_t * deque, bool steal);
+
+
+
+
+cw_mixer_t * cw_mixer_new(const cw_gen_config_t * gen_conf)
+{
+	if (NULL == gen_conf) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "NULL configuration");
+		return NULL;
+	}
+	if (CW_AUDIO_CONSOLE == gen_conf->sound_system) {
+		/* Console buzzer can play only one tone at a time. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "console sound system can't be used by mixer");
+		return NULL;
+	}
+
+	cw_mixer_t * mixer = calloc(1, sizeof (cw_mixer_t));
+	if (NULL == mixer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+	pthread_mutex_init(&mixer->mutex, NULL);
+	pthread_mutex_init(&mixer->pool.mutex, NULL);
+	pthread_cond_init(&mixer->pool.block_start, NULL);
+	pthread_cond_init(&mixer->pool.block_done, NULL);
+	mixer->pool.n_workers = 1;
+
+	mixer->sink = cw_gen_new(gen_conf);
+	if (NULL == mixer->sink) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to create sound sink");
+		cw_mixer_delete(&mixer);
+		return NULL;
+	}
+
+	/* Samples are written to sink's buffer, so size of block is the
+	   same as size of the buffer. Null sound system doesn't have a
+	   buffer. */
+	if (NULL != mixer->sink->buffer && mixer->sink->buffer_n_samples > 0) {
+		mixer->block_n_samples = mixer->sink->buffer_n_samples;
+	} else {
+		mixer->block_n_samples = CW_MIXER_NULL_BLOCK_N_SAMPLES;
+	}
+
+	mixer->rendered = calloc((size_t) mixer->block_n_samples, sizeof (cw_sample_t));
+	mixer->accumulator = calloc((size_t) mixer->block_n_samples, sizeof (int32_t));
+	mixer->output = calloc((size_t) mixer->block_n_samples, sizeof (cw_sample_t));
+	if (NULL == mixer->rendered || NULL == mixer->accumulator || NULL == mixer->output) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to allocate buffers");
+		cw_mixer_delete(&mixer);
+		return NULL;
+	}
+
+	return mixer;
+}
+
+
+
+
+void cw_mixer_delete(cw_mixer_t ** mixer)
+{
+	if (NULL == mixer || NULL == *mixer) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL mixer");
+		return;
+	}
+
+	if ((*mixer)->thread.running) {
+		cw_mixer_stop(*mixer);
+	}
+	cw_mixer_stop_workers_internal(*mixer);
+
+	/* Registered generators are owned by caller. */
+	if (NULL != (*mixer)->sink) {
+		cw_gen_delete(&(*mixer)->sink);
+	}
+	for (int i = 0; i < (*mixer)->n_sources; i++) {
+		free((*mixer)->sources[i].rendered);
+	}
+	free((*mixer)->rendered);
+	free((*mixer)->accumulator);
+	free((*mixer)->output);
+	pthread_cond_destroy(&(*mixer)->pool.block_start);
+	pthread_cond_destroy(&(*mixer)->pool.block_done);
+	pthread_mutex_destroy(&(*mixer)->pool.mutex);
+	pthread_mutex_destroy(&(*mixer)->mutex);
+
+	free(*mixer);
+	*mixer = NULL;
+
+	return;
+}
+
+
+
+
+cw_ret_t cw_mixer_add_generator(cw_mixer_t * mixer, cw_gen_t * gen, int gain)
+{
+	if (NULL == mixer || NULL == gen) {
+		return CW_FAILURE;
+	}
+	if (gain < CW_MIXER_GAIN_MIN || gain > CW_MIXER_GAIN_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid gain %d", gain);
+		return CW_FAILURE;
+	}
+	if (gen->do_dequeue_and_generate || gen->thread.running) {
+		/* Tones of started generator are dequeued by
+		   generator's own thread. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "generator is started, can't add it to mixer");
+		return CW_FAILURE;
+	}
+
+	cw_ret_t cwret = CW_SUCCESS;
+
+	pthread_mutex_lock(&mixer->mutex);
+	for (int i = 0; i < mixer->n_sources; i++) {
+		if (mixer->sources[i].gen == gen) {
+			/* Already registered, only update its gain. */
+			mixer->sources[i].gain = gain;
+			pthread_mutex_unlock(&mixer->mutex);
+			return CW_SUCCESS;
+		}
+	}
+
+	if (mixer->n_sources == CW_MIXER_N_GENERATORS_MAX) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "too many generators in mixer");
+		cwret = CW_FAILURE;
+	} else {
+		/* Samples of all generators are mixed into one buffer, so
+		   all generators must use sample rate of mixer's sink. Slope
+		   durations are expressed in samples, so slopes have to be
+		   recalculated as well. */
+		gen->sample_rate = mixer->sink->sample_rate;
+		cwret = cw_gen_set_tone_slope(gen, -1, -1);
+		cw_sample_t * rendered = NULL;
+		if (CW_SUCCESS == cwret) {
+			rendered = calloc((size_t) mixer->block_n_samples, sizeof (cw_sample_t));
+			if (NULL == rendered) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to allocate buffer of generator");
+				cwret = CW_FAILURE;
+			}
+		}
+		if (CW_SUCCESS == cwret) {
+			mixer->sources[mixer->n_sources].gen = gen;
+			mixer->sources[mixer->n_sources].gain = gain;
+			mixer->sources[mixer->n_sources].rendered = rendered;
+			mixer->sources[mixer->n_sources].has_samples = false;
+			mixer->n_sources++;
+		}
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_mixer_remove_generator(cw_mixer_t * mixer, cw_gen_t * gen)
+{
+	if (NULL == mixer || NULL == gen) {
+		return CW_FAILURE;
+	}
+
+	cw_ret_t cwret = CW_FAILURE;
+
+	pthread_mutex_lock(&mixer->mutex);
+	for (int i = 0; i < mixer->n_sources; i++) {
+		if (mixer->sources[i].gen == gen) {
+			/* Order of sources doesn't matter. */
+			free(mixer->sources[i].rendered);
+			mixer->sources[i] = mixer->sources[mixer->n_sources - 1];
+			mixer->n_sources--;
+			cwret = CW_SUCCESS;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_mixer_set_n_workers(cw_mixer_t * mixer, int n_workers)
+{
+	if (NULL == mixer || n_workers < 0 || n_workers > CW_MIXER_N_WORKERS_MAX) {
+		return CW_FAILURE;
+	}
+	if (0 == n_workers) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_workers = n_cpus < 1 ? 1 : (n_cpus > CW_MIXER_N_WORKERS_MAX ? CW_MIXER_N_WORKERS_MAX : (int) n_cpus);
+	}
+
+	/* Pool is not used by block that is being mixed right now. */
+	pthread_mutex_lock(&mixer->mutex);
+
+	cw_mixer_stop_workers_internal(mixer);
+
+	cw_ret_t cwret = CW_SUCCESS;
+	mixer->pool.do_work = true;
+	for (int w = 1; w < n_workers; w++) {
+		cw_mixer_worker_t * worker = &mixer->pool.workers[w];
+		worker->mixer = mixer;
+		worker->index = w;
+		worker->deque = 0;
+		const int rv = pthread_create(&worker->thread_id, NULL, cw_mixer_worker_internal, (void *) worker);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create worker thread: '%s'", strerror(rv));
+			cwret = CW_FAILURE;
+			break;
+		}
+		mixer->pool.n_workers = w + 1;
+	}
+	if (CW_SUCCESS != cwret) {
+		cw_mixer_stop_workers_internal(mixer);
+	}
+
+	pthread_mutex_unlock(&mixer->mutex);
+
+	return cwret;
+}
+
+
+
+
+cw_ret_t cw_mixer_start(cw_mixer_t * mixer)
+{
+	if (NULL == mixer) {
+		return CW_FAILURE;
+	}
+	if (mixer->thread.running) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "mixer is already started");
+		return CW_SUCCESS;
+	}
+
+	mixer->do_mix = true;
+	const int rv = pthread_create(&mixer->thread.id, NULL, cw_mixer_mix_internal, (void *) mixer);
+	if (0 != rv) {
+		mixer->do_mix = false;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to create mixer thread: '%s'", strerror(rv));
+		return CW_FAILURE;
+	}
+	mixer->thread.running = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_mixer_stop(cw_mixer_t * mixer)
+{
+	if (NULL == mixer) {
+		return CW_FAILURE;
+	}
+	if (!mixer->thread.running) {
+		return CW_SUCCESS;
+	}
+
+	/* Mixer's thread never waits on a condition variable, it is
+	   blocked at most for duration of one block. */
+	mixer->do_mix = false;
+	const int rv = pthread_join(mixer->thread.id, NULL);
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to join mixer thread: '%s'", strerror(rv));
+		return CW_FAILURE;
+	}
+	mixer->thread.running = false;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Thread function of mixer
+
+   Mix blocks of samples from all registered generators and write them
+   to mixer's sound sink, until mixer->do_mix becomes false.
+
+   Write to sound sink is blocking, so sound device determines the pace
+   of the loop. Null sound system has no device, so the loop sleeps for
+   duration of block instead.
+
+   @param[in] arg mixer
+
+   @return NULL
+*/
+static void * cw_mixer_mix_internal(void * arg)
+{
+	cw_mixer_t * mixer = (cw_mixer_t *) arg;
+	cw_gen_t * sink = mixer->sink;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "mixer", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "mixer");
+#endif
+
+	const bool sink_has_buffer = NULL != sink->buffer && sink->buffer_n_samples == mixer->block_n_samples;
+	const int block_duration = (int) (((int64_t) mixer->block_n_samples * CW_USECS_PER_SEC) / sink->sample_rate);
+
+	/* Without sink's buffer the blocks are paced on a timeline, so
+	   that delays in waking up don't accumulate. */
+	struct timespec timeline = { 0 };
+
+	while (mixer->do_mix) {
+		if (sink_has_buffer) {
+			if (NULL != sink->acquire_buffer_from_sound_device) {
+				sink->acquire_buffer_from_sound_device(sink);
+			}
+			cw_mixer_mix_block_internal(mixer, sink->buffer);
+			sink->out_buffer = sink->buffer;
+			sink->out_n_samples = sink->buffer_n_samples;
+			sink->write_buffer_to_sound_device(sink);
+		} else {
+			cw_mixer_mix_block_internal(mixer, mixer->output);
+			cw_sleep_on_timeline_internal(&timeline, block_duration);
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Mix one block of samples from all registered generators
+
+   @param[in] mixer mixer
+   @param[out] output array for mixer->block_n_samples mixed samples
+*/
+void cw_mixer_mix_block_internal(cw_mixer_t * mixer, cw_sample_t * output)
+{
+	const int n = mixer->block_n_samples;
+	int32_t * restrict accumulator = mixer->accumulator;
+	const cw_sample_t * restrict rendered = mixer->rendered;
+
+	memset(accumulator, 0, sizeof (int32_t) * (size_t) n);
+
+	pthread_mutex_lock(&mixer->mutex);
+	if (mixer->pool.n_workers > 1 && mixer->n_sources > 1) {
+		/* Split sources between workers. */
+		__atomic_store_n(&mixer->pool.n_done, 0, __ATOMIC_SEQ_CST);
+		mixer->pool.n_tasks = mixer->n_sources;
+		const int n_workers = mixer->pool.n_workers;
+		for (int w = 0; w < n_workers; w++) {
+			const uint64_t first = (uint64_t) (mixer->n_sources * w / n_workers);
+			const uint64_t end = (uint64_t) (mixer->n_sources * (w + 1) / n_workers);
+			__atomic_store_n(&mixer->pool.workers[w].deque, (first << 32) | end, __ATOMIC_SEQ_CST);
+		}
+
+		pthread_mutex_lock(&mixer->pool.mutex);
+		mixer->pool.block_seq++;
+		pthread_cond_broadcast(&mixer->pool.block_start);
+		pthread_mutex_unlock(&mixer->pool.mutex);
+
+		cw_mixer_render_sources_internal(mixer, 0);
+
+		pthread_mutex_lock(&mixer->pool.mutex);
+		while (__atomic_load_n(&mixer->pool.n_done, __ATOMIC_SEQ_CST) < mixer->pool.n_tasks) {
+			pthread_cond_wait(&mixer->pool.block_done, &mixer->pool.mutex);
+		}
+		pthread_mutex_unlock(&mixer->pool.mutex);
+
+		for (int s = 0; s < mixer->n_sources; s++) {
+			if (!mixer->sources[s].has_samples) {
+				continue;
+			}
+			const cw_sample_t * restrict source_rendered = mixer->sources[s].rendered;
+			const int32_t gain = mixer->sources[s].gain;
+			for (int i = 0; i < n; i++) {
+				accumulator[i] += source_rendered[i] * gain;
+			}
+		}
+	} else {
+		for (int s = 0; s < mixer->n_sources; s++) {
+			if (0 == cw_gen_render_internal(mixer->sources[s].gen, mixer->rendered, n)) {
+				/* Only silence in this block. */
+				continue;
+			}
+			const int32_t gain = mixer->sources[s].gain;
+			for (int i = 0; i < n; i++) {
+				accumulator[i] += rendered[i] * gain;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mixer->mutex);
+
+	for (int i = 0; i < n; i++) {
+		int32_t value = accumulator[i] / CW_MIXER_GAIN_MAX;
+		if (value > INT16_MAX) {
+			value = INT16_MAX;
+		} else if (value < INT16_MIN) {
+			value = INT16_MIN;
+		}
+		output[i] = (cw_sample_t) value;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Stop worker threads of mixer's pool
+
+   After the call the pool has only one worker: the thread mixing
+   blocks. Caller must hold mixer->mutex, or otherwise make sure that
+   no block is being mixed.
+
+   @param[in] mixer mixer
+*/
+static void cw_mixer_stop_workers_internal(cw_mixer_t * mixer)
+{
+	pthread_mutex_lock(&mixer->pool.mutex);
+	mixer->pool.do_work = false;
+	pthread_cond_broadcast(&mixer->pool.block_start);
+	pthread_mutex_unlock(&mixer->pool.mutex);
+
+	for (int w = 1; w < mixer->pool.n_workers; w++) {
+		pthread_join(mixer->pool.workers[w].thread_id, NULL);
+	}
+	mixer->pool.n_workers = 1;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Thread function of worker of mixer's pool
+
+   Wait for new block to be mixed, and render sources of the block
+   together with other workers, until the pool is stopped.
+
+   @param[in] arg worker (cw_mixer_worker_t)
+
+   @return NULL
+*/
+static void * cw_mixer_worker_internal(void * arg)
+{
+	cw_mixer_worker_t * worker = (cw_mixer_worker_t *) arg;
+	cw_mixer_t * mixer = worker->mixer;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "mixer worker", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "mixer worker");
+#endif
+
+	pthread_mutex_lock(&mixer->pool.mutex);
+	unsigned int block_seq = mixer->pool.block_seq;
+	while (true) {
+		while (mixer->pool.do_work && block_seq == mixer->pool.block_seq) {
+			pthread_cond_wait(&mixer->pool.block_start, &mixer->pool.mutex);
+		}
+		if (!mixer->pool.do_work) {
+			break;
+		}
+		block_seq = mixer->pool.block_seq;
+		pthread_mutex_unlock(&mixer->pool.mutex);
+
+		cw_mixer_render_sources_internal(mixer, worker->index);
+
+		pthread_mutex_lock(&mixer->pool.mutex);
+	}
+	pthread_mutex_unlock(&mixer->pool.mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Render sources of current block by given worker
+
+   Worker renders sources from its own range first, and then steals
+   sources from ranges of other workers, until there are no sources
+   left to be taken. The worker that renders the last source of the
+   block notifies mixing thread.
+
+   A worker that is late may find a range of next block, it renders
+   sources of the next block then. The sources are valid: they are
+   not changed while a block is being mixed.
+
+   @param[in] mixer mixer
+   @param[in] worker index of worker
+*/
+static void cw_mixer_render_sources_internal(cw_mixer_t * mixer, int worker)
+{
+	const int n_workers = mixer->pool.n_workers;
+	const int n = mixer->block_n_samples;
+
+	int victim = worker;
+	int n_empty = 0;
+	while (n_empty < n_workers) {
+		const int s = cw_mixer_take_source_internal(&mixer->pool.workers[victim].deque, victim != worker);
+		if (-1 == s) {
+			/* Try range of next worker. */
+			victim = (victim + 1) % n_workers;
+			n_empty++;
+			continue;
+		}
+		n_empty = 0;
+
+		cw_mixer_source_t * source = &mixer->sources[s];
+		source->has_samples = 0 != cw_gen_render_internal(source->gen, source->rendered, n);
+
+		if (__atomic_add_fetch(&mixer->pool.n_done, 1, __ATOMIC_SEQ_CST) == mixer->pool.n_tasks) {
+			pthread_mutex_lock(&mixer->pool.mutex);
+			pthread_cond_signal(&mixer->pool.block_done);
+			pthread_mutex_unlock(&mixer->pool.mutex);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Take index of a source from worker's range
+
+   Owner of the range takes sources from its end, thieves take sources
+   from its beginning, so that they rarely compete for the same
+   source.
+
+   @param[in,out] deque range of indexes of sources (see cw_mixer_worker_t::deque)
+   @param[in] steal whether the caller is not owner of the range
+
+   @return index of source
+   @return -1 if the range is empty
+*/
+static int cw_mixer_take_source_internal(uint64_t * deque, bool steal)
+{
+	uint64_t range = __atomic_load_n(deque, __ATOMIC_SEQ_CST);
+	while (true) {
+		const uint64_t first = range >> 32;
+		const uint64_t end = range & 0xffffffffU;
+		if (first >= end) {
+			return -1;
+		}
+		const uint64_t new_range = steal ? (((first + 1) << 32) | end) : ((first << 32) | (end - 1));
+		if (__atomic_compare_exchange_n(deque, &range, new_range, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			return (int) (steal ? first : end - 1);
+		}
+	}
+}
@@ -0,0 +1,142 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_MIXER
+#define H_LIBCW_MIXER
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+
+
+
+
+/* Maximal count of generators that can be registered in one mixer. */
+#define CW_MIXER_N_GENERATORS_MAX 256
+
+/* Maximal count of threads rendering samples of generators for one
+   mixer, including mixer's thread. See cw_mixer_set_n_workers(). */
+#define CW_MIXER_N_WORKERS_MAX 64
+
+/* Size of block of samples mixed in one iteration of mixer's thread,
+   used when mixer's sound sink doesn't have its own buffer (Null sound
+   system). 10 ms at 48 kHz. */
+#define CW_MIXER_NULL_BLOCK_N_SAMPLES 480
+
+/* Range of gain of a generator registered in mixer, in percents. */
+#define CW_MIXER_GAIN_MIN 0
+#define CW_MIXER_GAIN_MAX 100
+
+
+
+
+/* Generator registered in mixer. */
+typedef struct {
+	cw_gen_t * gen;
+	int gain;           /* [percents] */
+
+	/* Block of samples rendered by worker of mixer's pool, and
+	   whether there are any non-silent samples in it. Used only when
+	   the pool has more than one worker. */
+	cw_sample_t * rendered;
+	bool has_samples;
+} cw_mixer_source_t;
+
+
+
+
+/* Thread of mixer's pool of workers. */
+typedef struct {
+	cw_mixer_t * mixer;
+	int index;
+
+	/* Range of indexes of sources to be rendered by the worker in
+	   current block: first index in upper 32 bits, end index in lower
+	   32 bits. Worker takes sources from the end of the range, other
+	   workers that have run out of their own sources steal them from
+	   the beginning. Accessed with atomic operations. */
+	uint64_t deque;
+
+	pthread_t thread_id;
+} cw_mixer_worker_t;
+
+
+
+
+struct cw_mixer_struct {
+	/* Generator that owns mixer's sound sink. Its tone queue is not
+	   used, only its sound device and buffer. */
+	cw_gen_t * sink;
+
+	/* Count of samples mixed in one iteration of mixer's thread. */
+	int block_n_samples;
+
+	/* Registered generators. Protected by ->mutex. */
+	cw_mixer_source_t sources[CW_MIXER_N_GENERATORS_MAX];
+	int n_sources;
+	pthread_mutex_t mutex;
+
+	/* Samples rendered by single generator. */
+	cw_sample_t * rendered;
+
+	/* Sum of samples of all generators, scaled by gains. */
+	int32_t * accumulator;
+
+	/* Mixed samples, used when sound sink doesn't have its own
+	   buffer. */
+	cw_sample_t * output;
+
+	struct {
+		pthread_t id;
+		bool running;
+	} thread;
+
+	/* Set to false to ask mixer's thread to return. */
+	volatile bool do_mix;
+
+	/* Pool of threads that render blocks of samples of registered
+	   generators in parallel, see cw_mixer_set_n_workers(). Worker
+	   0 is the thread that mixes the block (mixer's thread), other
+	   workers have their own threads.
+
+	   Mixing thread holds ->mutex while workers render the block, so
+	   sources don't change in the meantime. ::block_seq and
+	   ::do_work are protected by ::mutex, ::n_done is accessed with
+	   atomic operations. */
+	struct {
+		cw_mixer_worker_t workers[CW_MIXER_N_WORKERS_MAX];
+		int n_workers;
+
+		pthread_mutex_t mutex;
+		pthread_cond_t block_start;  /* Signalled when new block is to be rendered, or when workers should return. */
+		pthread_cond_t block_done;   /* Signalled when all sources of block have been rendered. */
+		unsigned int block_seq;
+		bool do_work;
+
+		int n_tasks;                 /* Count of sources to render in current block. */
+		int n_done;                  /* Count of sources already rendered in current block. */
+	} pool;
+};
+
+
+
+
+/* Exposed to unit tests. */
+CW_STATIC_FUNC void cw_mixer_mix_block_internal(cw_mixer_t * mixer, cw_sample_t * output);
+
+
+
+
+#endif /* #ifndef H_LIBCW_MIXER */
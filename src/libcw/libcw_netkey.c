@@ -0,0 +1,762 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_netkey.c
+
+   @brief Keying of remote key over UDP.
+
+   Sender is registered as value callback of local key (see
+   cw_key_register_value_callback()) and sends a packet on each change
+   of key value. Each packet carries last CW_NETKEY_HISTORY changes
+   with their sequence numbers and timestamps, so a change lost with
+   its packet is recovered from the next packet. While key doesn't
+   change, sender repeats last packet every
+   CW_NETKEY_KEEPALIVE_INTERVAL.
+
+   Receiver plays the changes on remote key at their timestamp plus an
+   offset. The offset is the smallest delay of recent packets plus a
+   margin proportional to jitter of the delay, limited by maximal delay
+   given by client code. Change arriving after its time of playout is
+   played immediately. The offset is changed only when the key is open
+   and no changes are waiting, so that adaptation doesn't change
+   durations of Marks. Key left closed by lost changes is opened when
+   no packet arrives for CW_NETKEY_LINK_TIMEOUT.
+
+   Format of packet (integers in network byte order):
+   - magic "CWNK", version (1 byte), count of changes (1 byte), two
+     reserved bytes,
+   - identifier of session of sender (4 bytes), four reserved bytes,
+   - time of sending on sender's CLOCK_MONOTONIC timeline (8 bytes) [us],
+   - changes, oldest first: sequence number (4 bytes), key value
+     (1 byte), three reserved bytes, time of change (8 bytes) [us].
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_key.h"
+#include "libcw_netkey.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/netkey: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+#define CW_NETKEY_MAGIC "CWNK"
+#define CW_NETKEY_VERSION 1
+
+#define CW_NETKEY_HEADER_SIZE 24
+#define CW_NETKEY_CHANGE_SIZE 16
+#define CW_NETKEY_PACKET_SIZE_MAX (CW_NETKEY_HEADER_SIZE + CW_NETKEY_HISTORY * CW_NETKEY_CHANGE_SIZE)
+
+/* [us] Interval of repeating of last packet by sender. */
+#define CW_NETKEY_KEEPALIVE_INTERVAL 100000
+
+/* [us] Key is opened by receiver when there is no packet for this
+   long. */
+#define CW_NETKEY_LINK_TIMEOUT 500000
+
+/* [us] Upper limit of maximal delay added by jitter buffer. */
+#define CW_NETKEY_DELAY_LIMIT 1000000
+
+/* Margin of jitter buffer above minimal delay of network, in averages
+   of delay above the minimal delay. */
+#define CW_NETKEY_JITTER_FACTOR 3
+
+/* [ms] Longest sleep of receiver thread. */
+#define CW_NETKEY_POLL_INTERVAL 50
+
+
+
+
+static void cw_netkey_sender_callback_internal(void * arg, cw_key_value_t key_value, int64_t timestamp);
+static void * cw_netkey_sender_thread_fn(void * arg);
+static void cw_netkey_sender_send_internal(cw_netkey_sender_t * sender);
+static int cw_netkey_receiver_open_internal(int port, int * bound_port);
+static void * cw_netkey_receiver_thread_fn(void * arg);
+static void cw_netkey_receiver_handle_packet_internal(cw_netkey_receiver_t * receiver, const uint8_t * packet, size_t size, int64_t now);
+static void cw_netkey_receiver_enqueue_internal(cw_netkey_receiver_t * receiver, const cw_netkey_change_t * change, int64_t now);
+static void cw_netkey_receiver_play_internal(cw_netkey_receiver_t * receiver, int64_t now);
+static int64_t cw_netkey_now_internal(void);
+static void cw_netkey_put_u32_internal(uint8_t * buffer, uint32_t value);
+static void cw_netkey_put_u64_internal(uint8_t * buffer, uint64_t value);
+static uint32_t cw_netkey_get_u32_internal(const uint8_t * buffer);
+static uint64_t cw_netkey_get_u64_internal(const uint8_t * buffer);
+
+
+
+
+cw_netkey_sender_t * cw_netkey_sender_new(cw_key_t * key, const char * host, int port)
+{
+	if (NULL == key || NULL == host || port <= 0 || port > 65535) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sender new: invalid arguments");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	char service[8] = { 0 };
+	snprintf(service, sizeof (service), "%d", port);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	struct addrinfo * result = NULL;
+	if (0 != getaddrinfo(host, service, &hints, &result)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sender new: can't resolve '%s'", host);
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = -1;
+	for (struct addrinfo * ai = result; NULL != ai && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd >= 0 && 0 != connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	const int err = errno;
+	freeaddrinfo(result);
+	if (fd < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sender new: can't create socket for '%s'", host);
+		errno = err;
+		return NULL;
+	}
+
+	cw_netkey_sender_t * sender = (cw_netkey_sender_t *) calloc(1, sizeof (cw_netkey_sender_t));
+	if (NULL == sender) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sender new: calloc()");
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+	sender->key = key;
+	sender->fd = fd;
+	sender->session = (uint32_t) cw_netkey_now_internal() ^ ((uint32_t) getpid() << 16U);
+
+	pthread_mutex_init(&sender->mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sender->wakeup, &attr);
+	pthread_condattr_destroy(&attr);
+
+	sender->do_send = true;
+	if (0 != pthread_create(&sender->thread, NULL, cw_netkey_sender_thread_fn, sender)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "sender new: failed to create sender thread");
+		pthread_cond_destroy(&sender->wakeup);
+		pthread_mutex_destroy(&sender->mutex);
+		close(fd);
+		free(sender);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	cw_key_register_value_callback(key, cw_netkey_sender_callback_internal, sender);
+
+	return sender;
+}
+
+
+
+
+void cw_netkey_sender_delete(cw_netkey_sender_t ** sender)
+{
+	if (NULL == sender || NULL == *sender) {
+		return;
+	}
+
+	cw_key_register_value_callback((*sender)->key, NULL, NULL);
+
+	pthread_mutex_lock(&(*sender)->mutex);
+	(*sender)->do_send = false;
+	pthread_cond_signal(&(*sender)->wakeup);
+	pthread_mutex_unlock(&(*sender)->mutex);
+	pthread_join((*sender)->thread, NULL);
+
+	close((*sender)->fd);
+	pthread_cond_destroy(&(*sender)->wakeup);
+	pthread_mutex_destroy(&(*sender)->mutex);
+
+	free(*sender);
+	*sender = NULL;
+}
+
+
+
+
+cw_netkey_receiver_t * cw_netkey_receiver_new(cw_key_t * key, int port, int delay_max)
+{
+	if (NULL == key || port < 0 || port > 65535 || delay_max < 0 || delay_max > CW_NETKEY_DELAY_LIMIT) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_CLIENT_CODE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "receiver new: invalid arguments");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_netkey_receiver_t * receiver = (cw_netkey_receiver_t *) calloc(1, sizeof (cw_netkey_receiver_t));
+	if (NULL == receiver) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "receiver new: calloc()");
+		errno = ENOMEM;
+		return NULL;
+	}
+	receiver->key = key;
+	receiver->delay_max = delay_max;
+	receiver->value = CW_KEY_VALUE_OPEN;
+
+	receiver->fd = cw_netkey_receiver_open_internal(port, &receiver->port);
+	if (receiver->fd < 0) {
+		const int err = errno;
+		free(receiver);
+		errno = err;
+		return NULL;
+	}
+	if (0 != pipe(receiver->wakeup_fds)) {
+		const int err = errno;
+		close(receiver->fd);
+		free(receiver);
+		errno = err;
+		return NULL;
+	}
+
+	pthread_mutex_init(&receiver->mutex, NULL);
+	if (0 != pthread_create(&receiver->thread, NULL, cw_netkey_receiver_thread_fn, receiver)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "receiver new: failed to create receiver thread");
+		pthread_mutex_destroy(&receiver->mutex);
+		close(receiver->wakeup_fds[0]);
+		close(receiver->wakeup_fds[1]);
+		close(receiver->fd);
+		free(receiver);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return receiver;
+}
+
+
+
+
+void cw_netkey_receiver_delete(cw_netkey_receiver_t ** receiver)
+{
+	if (NULL == receiver || NULL == *receiver) {
+		return;
+	}
+
+	const char byte = 0;
+	if (1 != write((*receiver)->wakeup_fds[1], &byte, 1)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+			      MSG_PREFIX "receiver delete: failed to wake up receiver thread");
+	}
+	pthread_join((*receiver)->thread, NULL);
+
+	if (CW_KEY_VALUE_CLOSED == (*receiver)->value) {
+		cw_key_sk_set_value((*receiver)->key, CW_KEY_VALUE_OPEN);
+	}
+
+	close((*receiver)->wakeup_fds[0]);
+	close((*receiver)->wakeup_fds[1]);
+	close((*receiver)->fd);
+	pthread_mutex_destroy(&(*receiver)->mutex);
+
+	free(*receiver);
+	*receiver = NULL;
+}
+
+
+
+
+int cw_netkey_receiver_get_port(const cw_netkey_receiver_t * receiver)
+{
+	return receiver->port;
+}
+
+
+
+
+cw_ret_t cw_netkey_receiver_get_statistics(cw_netkey_receiver_t * receiver, cw_netkey_statistics_t * statistics)
+{
+	if (NULL == receiver || NULL == statistics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	pthread_mutex_lock(&receiver->mutex);
+	*statistics = receiver->statistics;
+	pthread_mutex_unlock(&receiver->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Send change of value of key
+
+   Called by key (see cw_key_register_value_callback()) in thread that
+   changed value of the key.
+
+   @param[in] arg sender
+   @param[in] key_value new value of key
+   @param[in] timestamp time of change [us]
+*/
+static void cw_netkey_sender_callback_internal(void * arg, cw_key_value_t key_value, int64_t timestamp)
+{
+	cw_netkey_sender_t * sender = (cw_netkey_sender_t *) arg;
+
+	pthread_mutex_lock(&sender->mutex);
+	if (CW_NETKEY_HISTORY == sender->n_history) {
+		memmove(sender->history, sender->history + 1, (CW_NETKEY_HISTORY - 1) * sizeof (cw_netkey_change_t));
+		sender->n_history--;
+	}
+	sender->history[sender->n_history++] = (cw_netkey_change_t) { .sequence = sender->sequence++, .timestamp = timestamp, .value = key_value };
+	cw_netkey_sender_send_internal(sender);
+	pthread_mutex_unlock(&sender->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Repeat last packet while value of key doesn't change
+
+   @param[in] arg sender
+
+   @return NULL
+*/
+static void * cw_netkey_sender_thread_fn(void * arg)
+{
+	cw_netkey_sender_t * sender = (cw_netkey_sender_t *) arg;
+
+	pthread_mutex_lock(&sender->mutex);
+	while (sender->do_send) {
+		struct timespec deadline = { 0 };
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += (CW_NETKEY_KEEPALIVE_INTERVAL % CW_USECS_PER_SEC) * 1000;
+		deadline.tv_sec += CW_NETKEY_KEEPALIVE_INTERVAL / CW_USECS_PER_SEC + deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		if (ETIMEDOUT == pthread_cond_timedwait(&sender->wakeup, &sender->mutex, &deadline) && sender->do_send) {
+			cw_netkey_sender_send_internal(sender);
+		}
+	}
+	pthread_mutex_unlock(&sender->mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Send packet with recent changes of key value
+
+   Must be called with sender's mutex locked.
+
+   @param[in] sender sender
+*/
+static void cw_netkey_sender_send_internal(cw_netkey_sender_t * sender)
+{
+	uint8_t packet[CW_NETKEY_PACKET_SIZE_MAX] = { 0 };
+	memcpy(packet, CW_NETKEY_MAGIC, 4);
+	packet[4] = CW_NETKEY_VERSION;
+	packet[5] = (uint8_t) sender->n_history;
+	cw_netkey_put_u32_internal(packet + 8, sender->session);
+	cw_netkey_put_u64_internal(packet + 16, (uint64_t) cw_netkey_now_internal());
+	for (size_t i = 0; i < sender->n_history; i++) {
+		uint8_t * change = packet + CW_NETKEY_HEADER_SIZE + i * CW_NETKEY_CHANGE_SIZE;
+		cw_netkey_put_u32_internal(change, sender->history[i].sequence);
+		change[4] = CW_KEY_VALUE_CLOSED == sender->history[i].value ? 1 : 0;
+		cw_netkey_put_u64_internal(change + 8, (uint64_t) sender->history[i].timestamp);
+	}
+
+	const size_t size = CW_NETKEY_HEADER_SIZE + sender->n_history * CW_NETKEY_CHANGE_SIZE;
+	if (send(sender->fd, packet, size, MSG_DONTWAIT) < 0) {
+		/* E.g. receiver is not running yet. The change will be
+		   repeated in next packets. */
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_DEBUG,
+			      MSG_PREFIX "failed to send packet, errno = %d", errno);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Open UDP socket of receiver
+
+   Socket accepts both IPv6 and IPv4 packets where possible.
+
+   @param[in] port port to bind to, or zero for port chosen by system
+   @param[out] bound_port port to which the socket is bound
+
+   @return descriptor of socket on success
+   @return -1 on failure (errno is set)
+*/
+static int cw_netkey_receiver_open_internal(int port, int * bound_port)
+{
+	int fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0) {
+		const int no = 0;
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof (no));
+		struct sockaddr_in6 address;
+		memset(&address, 0, sizeof (address));
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons((uint16_t) port);
+		if (0 != bind(fd, (struct sockaddr *) &address, sizeof (address))) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	if (fd < 0) {
+		fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "receiver new: socket()");
+			return -1;
+		}
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof (address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons((uint16_t) port);
+		if (0 != bind(fd, (struct sockaddr *) &address, sizeof (address))) {
+			const int err = errno;
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "receiver new: can't bind to port %d", port);
+			close(fd);
+			errno = err;
+			return -1;
+		}
+	}
+
+	struct sockaddr_storage address;
+	socklen_t address_len = sizeof (address);
+	getsockname(fd, (struct sockaddr *) &address, &address_len);
+	if (AF_INET6 == address.ss_family) {
+		*bound_port = ntohs(((struct sockaddr_in6 *) &address)->sin6_port);
+	} else {
+		*bound_port = ntohs(((struct sockaddr_in *) &address)->sin_port);
+	}
+
+	return fd;
+}
+
+
+
+
+/**
+   @brief Receive packets, play changes of key value at their times
+
+   @param[in] arg receiver
+
+   @return NULL
+*/
+static void * cw_netkey_receiver_thread_fn(void * arg)
+{
+	cw_netkey_receiver_t * receiver = (cw_netkey_receiver_t *) arg;
+
+	while (true) {
+		int64_t wait = CW_NETKEY_POLL_INTERVAL * 1000; /* [us] */
+		if (receiver->queue_n > 0) {
+			const int64_t until_playout = receiver->queue[receiver->queue_head].timestamp - cw_netkey_now_internal();
+			wait = until_playout < 0 ? 0 : (until_playout < wait ? until_playout : wait);
+		}
+		const struct timespec timeout = { .tv_sec = 0, .tv_nsec = (long) wait * 1000 };
+
+		struct pollfd fds[2] = { { .fd = receiver->fd, .events = POLLIN }, { .fd = receiver->wakeup_fds[0], .events = POLLIN } };
+		if (ppoll(fds, 2, &timeout, NULL) < 0 && EINTR != errno) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_ERROR,
+				      MSG_PREFIX "ppoll() failed, errno = %d", errno);
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			uint8_t packet[CW_NETKEY_PACKET_SIZE_MAX + 1];
+			ssize_t size = 0;
+			while ((size = recv(receiver->fd, packet, sizeof (packet), MSG_DONTWAIT)) >= 0) {
+				cw_netkey_receiver_handle_packet_internal(receiver, packet, (size_t) size, cw_netkey_now_internal());
+			}
+		}
+
+		cw_netkey_receiver_play_internal(receiver, cw_netkey_now_internal());
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Put changes of key value from a packet into jitter buffer
+
+   Changes already received (or older) are skipped. On first packet of
+   a session of sender only the most recent change is taken: older
+   changes happened before receiver started listening.
+
+   @param[in,out] receiver receiver
+   @param[in] packet packet
+   @param[in] size size of @p packet [bytes]
+   @param[in] now time of arrival of packet [us]
+*/
+static void cw_netkey_receiver_handle_packet_internal(cw_netkey_receiver_t * receiver, const uint8_t * packet, size_t size, int64_t now)
+{
+	if (size < CW_NETKEY_HEADER_SIZE
+	    || 0 != memcmp(packet, CW_NETKEY_MAGIC, 4)
+	    || CW_NETKEY_VERSION != packet[4]
+	    || packet[5] > CW_NETKEY_HISTORY
+	    || size != CW_NETKEY_HEADER_SIZE + packet[5] * (size_t) CW_NETKEY_CHANGE_SIZE) {
+		return;
+	}
+	const size_t n_changes = packet[5];
+	const uint32_t session = cw_netkey_get_u32_internal(packet + 8);
+	const int64_t sent = (int64_t) cw_netkey_get_u64_internal(packet + 16);
+
+	pthread_mutex_lock(&receiver->mutex);
+
+	receiver->statistics.n_packets++;
+	receiver->last_packet = now;
+
+	const bool is_new_session = !receiver->has_session || session != receiver->session;
+	if (is_new_session) {
+		receiver->has_session = true;
+		receiver->session = session;
+		receiver->n_delays = 0;
+		receiver->delays_idx = 0;
+		receiver->jitter = 0;
+		receiver->last_playout = 0;
+		receiver->next_sequence = n_changes > 0 ? cw_netkey_get_u32_internal(packet + CW_NETKEY_HEADER_SIZE + (n_changes - 1) * CW_NETKEY_CHANGE_SIZE) : 0;
+	}
+
+	/* Track delay of network. */
+	const int64_t delay = now - sent;
+	receiver->delays[receiver->delays_idx] = delay;
+	receiver->delays_idx = (receiver->delays_idx + 1) % CW_NETKEY_DELAY_WINDOW;
+	if (receiver->n_delays < CW_NETKEY_DELAY_WINDOW) {
+		receiver->n_delays++;
+	}
+	int64_t delay_min = delay;
+	for (size_t i = 0; i < receiver->n_delays; i++) {
+		if (receiver->delays[i] < delay_min) {
+			delay_min = receiver->delays[i];
+		}
+	}
+	receiver->jitter += (delay - delay_min - receiver->jitter) / 8;
+
+	if (is_new_session || (0 == receiver->queue_n && CW_KEY_VALUE_OPEN == receiver->value)) {
+		int64_t margin = CW_NETKEY_JITTER_FACTOR * receiver->jitter;
+		if (margin > receiver->delay_max) {
+			margin = receiver->delay_max;
+		}
+		receiver->offset = delay_min + margin;
+		receiver->statistics.delay = (int) margin;
+	}
+
+	for (size_t i = 0; i < n_changes; i++) {
+		const uint8_t * data = packet + CW_NETKEY_HEADER_SIZE + i * CW_NETKEY_CHANGE_SIZE;
+		const cw_netkey_change_t change = {
+			.sequence = cw_netkey_get_u32_internal(data),
+			.timestamp = (int64_t) cw_netkey_get_u64_internal(data + 8),
+			.value = 0 != data[4] ? CW_KEY_VALUE_CLOSED : CW_KEY_VALUE_OPEN,
+		};
+		const int32_t distance = (int32_t) (change.sequence - receiver->next_sequence);
+		if (distance < 0) {
+			/* Already received. */
+			continue;
+		}
+		receiver->statistics.n_lost += (unsigned int) distance;
+		if (i < n_changes - 1) {
+			/* Packet that brought the change as its newest one
+			   was lost. */
+			receiver->statistics.n_recovered++;
+		}
+		receiver->next_sequence = change.sequence + 1;
+		cw_netkey_receiver_enqueue_internal(receiver, &change, now);
+	}
+
+	pthread_mutex_unlock(&receiver->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Schedule playout of change of key value
+
+   @param[in,out] receiver receiver
+   @param[in] change change, with timestamp on sender's timeline
+   @param[in] now current time [us]
+*/
+static void cw_netkey_receiver_enqueue_internal(cw_netkey_receiver_t * receiver, const cw_netkey_change_t * change, int64_t now)
+{
+	int64_t playout = change->timestamp + receiver->offset;
+	if (playout < receiver->last_playout) {
+		playout = receiver->last_playout;
+	}
+	if (playout < now) {
+		receiver->statistics.n_late++;
+		playout = now;
+	}
+	receiver->last_playout = playout;
+
+	if (CW_NETKEY_QUEUE_CAPACITY == receiver->queue_n) {
+		/* Make room by playing oldest change now. */
+		const cw_netkey_change_t * oldest = &receiver->queue[receiver->queue_head];
+		cw_netkey_receiver_play_internal(receiver, oldest->timestamp);
+	}
+	const size_t tail = (receiver->queue_head + receiver->queue_n) % CW_NETKEY_QUEUE_CAPACITY;
+	receiver->queue[tail] = *change;
+	receiver->queue[tail].timestamp = playout;
+	receiver->queue_n++;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Pass to key changes whose time of playout has come
+
+   Key that stays closed while no packets arrive is opened.
+
+   @param[in,out] receiver receiver
+   @param[in] now current time [us]
+*/
+static void cw_netkey_receiver_play_internal(cw_netkey_receiver_t * receiver, int64_t now)
+{
+	while (receiver->queue_n > 0 && receiver->queue[receiver->queue_head].timestamp <= now) {
+		const cw_key_value_t value = receiver->queue[receiver->queue_head].value;
+		receiver->queue_head = (receiver->queue_head + 1) % CW_NETKEY_QUEUE_CAPACITY;
+		receiver->queue_n--;
+		if (value != receiver->value) {
+			receiver->value = value;
+			cw_key_sk_set_value(receiver->key, value);
+		}
+	}
+
+	if (0 == receiver->queue_n && CW_KEY_VALUE_CLOSED == receiver->value
+	    && now - receiver->last_packet > CW_NETKEY_LINK_TIMEOUT) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_KEYING, CW_DEBUG_WARNING,
+			      MSG_PREFIX "no packets from sender, opening key");
+		receiver->value = CW_KEY_VALUE_OPEN;
+		cw_key_sk_set_value(receiver->key, CW_KEY_VALUE_OPEN);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get current time on CLOCK_MONOTONIC timeline
+
+   @return time [us]
+*/
+static int64_t cw_netkey_now_internal(void)
+{
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_nsec / 1000;
+}
+
+
+
+
+static void cw_netkey_put_u32_internal(uint8_t * buffer, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		buffer[i] = (uint8_t) (value >> (8 * (3 - i)));
+	}
+}
+
+
+
+
+static void cw_netkey_put_u64_internal(uint8_t * buffer, uint64_t value)
+{
+	cw_netkey_put_u32_internal(buffer, (uint32_t) (value >> 32U));
+	cw_netkey_put_u32_internal(buffer + 4, (uint32_t) value);
+}
+
+
+
+
+static uint32_t cw_netkey_get_u32_internal(const uint8_t * buffer)
+{
+	return ((uint32_t) buffer[0] << 24U) | ((uint32_t) buffer[1] << 16U) | ((uint32_t) buffer[2] << 8U) | buffer[3];
+}
+
+
+
+
+static uint64_t cw_netkey_get_u64_internal(const uint8_t * buffer)
+{
+	return ((uint64_t) cw_netkey_get_u32_internal(buffer) << 32U) | cw_netkey_get_u32_internal(buffer + 4);
+}
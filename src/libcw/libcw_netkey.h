@@ -0,0 +1,129 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_NETKEY
+#define H_LIBCW_NETKEY
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Count of most recent changes of key value sent in each packet. Loss
+   of up to CW_NETKEY_HISTORY - 1 packets in a row is recovered from
+   copies in next packet. */
+#define CW_NETKEY_HISTORY 8
+
+/* Capacity of jitter buffer of receiver [changes of key value]. */
+#define CW_NETKEY_QUEUE_CAPACITY 64
+
+/* Count of recent packets over which receiver looks for minimal
+   delay of network. */
+#define CW_NETKEY_DELAY_WINDOW 64
+
+
+
+
+/* Change of key value. */
+typedef struct {
+	uint32_t sequence;
+	int64_t timestamp;          /* [us] On sender's timeline, or (in jitter buffer) time of playout on receiver's timeline. */
+	cw_key_value_t value;
+} cw_netkey_change_t;
+
+
+
+
+struct cw_netkey_sender_struct {
+	/* Key whose changes are sent (not owned by sender). */
+	cw_key_t * key;
+
+	/* UDP socket connected to receiver. */
+	int fd;
+
+	/* Identifier of session, lets receiver notice restart of
+	   sender. */
+	uint32_t session;
+
+	/* Most recent changes of key value, oldest first. Protected by
+	   ::mutex. */
+	cw_netkey_change_t history[CW_NETKEY_HISTORY];
+	size_t n_history;
+	uint32_t sequence;          /* Sequence number of next change. */
+
+	/* Sender thread repeats last packet while there are no changes,
+	   so that receiver can recover last change and knows that link is
+	   alive. */
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeup;
+	bool do_send;               /* Protected by ::mutex. */
+	pthread_t thread;
+};
+
+
+
+
+struct cw_netkey_receiver_struct {
+	/* Key keyed by receiver (not owned by receiver). */
+	cw_key_t * key;
+
+	/* UDP socket, and pipe waking up receiver thread for termination. */
+	int fd;
+	int wakeup_fds[2];
+	int port;
+
+	/* [us] Upper limit of delay added by jitter buffer. */
+	int delay_max;
+
+	/* Changes waiting for their time of playout, in order of the
+	   times. */
+	cw_netkey_change_t queue[CW_NETKEY_QUEUE_CAPACITY];
+	size_t queue_head;
+	size_t queue_n;
+
+	bool has_session;
+	uint32_t session;
+	uint32_t next_sequence;
+
+	/* Delays of recent packets (time of arrival minus time of sending,
+	   including difference of clocks of the two hosts), and average
+	   of delays above the minimal one. */
+	int64_t delays[CW_NETKEY_DELAY_WINDOW];
+	size_t delays_idx;
+	size_t n_delays;
+	int64_t jitter;             /* [us] */
+
+	/* [us] Time of playout of change is its timestamp on sender's
+	   timeline plus this offset. Updated only when key is open and
+	   jitter buffer is empty, so that durations of Marks are not
+	   changed. */
+	int64_t offset;
+	int64_t last_playout;       /* [us] */
+	int64_t last_packet;        /* [us] Time of arrival of last packet. */
+
+	/* Last value passed to key. */
+	cw_key_value_t value;
+
+	/* Protected by ::mutex. */
+	cw_netkey_statistics_t statistics;
+	pthread_mutex_t mutex;
+
+	pthread_t thread;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_NETKEY */
@@ -32,10 +32,17 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <assert.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 
 
 
@@ -54,6 +61,14 @@ static cw_ret_t cw_null_write_tone_to_sound_device_internal(cw_gen_t * gen, cons
 
 
 
+/* If a tone is written later than this after end of previous tone,
+   the previous tone is not considered to be directly followed by the
+   new one, and timeline of tones is restarted. [us] */
+#define CW_NULL_TIMELINE_MAX_LATENESS 2000
+
+
+
+
 /**
    @brief Configure given @p gen variable to work with Null sound system
 
@@ -112,8 +127,22 @@ bool cw_is_null_possible(__attribute__((unused)) const char * device_name)
 
    @return CW_SUCCESS
 */
-static cw_ret_t cw_null_open_and_configure_sound_device_internal(cw_gen_t * gen, __attribute__((unused)) const cw_gen_config_t * gen_conf)
+static cw_ret_t cw_null_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
 {
+	if (gen->sound_device_is_open) {
+		return CW_SUCCESS;
+	}
+
+	gen->null_data.virtual_clock = gen_conf->null_virtual_clock;
+	if (gen->null_data.virtual_clock) {
+		pthread_mutex_init(&gen->null_data.mutex, NULL);
+		/* Start virtual clock at current wall clock time, so
+		   that its timestamps look like ordinary timestamps. */
+		gettimeofday(&gen->null_data.now, NULL);
+	}
+	gen->null_data.timeline.tv_sec = 0;
+	gen->null_data.timeline.tv_nsec = 0;
+
 	gen->sound_device_is_open = true;
 	return CW_SUCCESS;
 }
@@ -130,6 +159,10 @@ static cw_ret_t cw_null_open_and_configure_sound_device_internal(cw_gen_t * gen,
 */
 static void cw_null_close_sound_device_internal(cw_gen_t * gen)
 {
+	if (gen->sound_device_is_open && gen->null_data.virtual_clock) {
+		pthread_mutex_destroy(&gen->null_data.mutex);
+		gen->null_data.virtual_clock = false;
+	}
 	gen->sound_device_is_open = false;
 	return;
 }
@@ -144,6 +177,14 @@ static void cw_null_close_sound_device_internal(cw_gen_t * gen)
    sleeps for period of time that would be necessary to write the
    samples to a real sound device and play/sound them.
 
+   With virtual clock the function doesn't sleep, but advances the
+   virtual clock by duration of the tone. 'Forever' tones are still
+   played in real time: the generator would otherwise spin on them
+   while waiting for client code to enqueue next tone.
+
+   Without virtual clock consecutive tones are played on absolute
+   timeline, see cw_sleep_on_timeline_internal().
+
    @reviewed 2020-07-12
 
    @param[in] gen generator that will write to sound device
@@ -151,13 +192,53 @@ static void cw_null_close_sound_device_internal(cw_gen_t * gen)
 
    @return CW_SUCCESS
 */
-static cw_ret_t cw_null_write_tone_to_sound_device_internal(__attribute__((unused)) cw_gen_t * gen, const cw_tone_t * tone)
+static cw_ret_t cw_null_write_tone_to_sound_device_internal(cw_gen_t * gen, const cw_tone_t * tone)
 {
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_NULL);
 	assert (tone->duration >= 0); /* TODO: shouldn't the condition be "tone->duration > 0"? */
 
-	cw_usleep_internal(tone->duration);
+	if (gen->null_data.virtual_clock) {
+		if (tone->is_forever) {
+			cw_usleep_internal(tone->duration);
+		}
+		pthread_mutex_lock(&gen->null_data.mutex);
+		const long long usecs = gen->null_data.now.tv_usec + (long long) tone->duration;
+		gen->null_data.now.tv_sec += usecs / CW_USECS_PER_SEC;
+		gen->null_data.now.tv_usec = usecs % CW_USECS_PER_SEC;
+		pthread_mutex_unlock(&gen->null_data.mutex);
+	} else {
+		/* Consecutive tones end at points of one timeline, so
+		   that delays in waking up don't accumulate. After a
+		   pause in playback (e.g. when the queue was empty) the
+		   timeline is started anew. */
+		struct timespec now = { 0 };
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (cw_timespec_diff_usecs_internal(&gen->null_data.timeline, &now) > CW_NULL_TIMELINE_MAX_LATENESS) {
+			gen->null_data.timeline = now;
+		}
+		cw_sleep_on_timeline_internal(&gen->null_data.timeline, tone->duration);
+	}
 
 	return CW_SUCCESS;
 }
+
+
+
+
+/**
+   @brief Get current time of virtual clock of Null sound system
+
+   @param[in] gen generator using Null sound system with virtual clock
+   @param[out] timestamp current time of virtual clock
+*/
+void cw_null_get_timestamp_internal(cw_gen_t * gen, struct timeval * timestamp)
+{
+	assert (gen->null_data.virtual_clock);
+
+	pthread_mutex_lock(&gen->null_data.mutex);
+	*timestamp = gen->null_data.now;
+	pthread_mutex_unlock(&gen->null_data.mutex);
+
+	return;
+}
@@ -9,13 +9,41 @@
 
 
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <time.h>
+
+
+
+
 #include "libcw2.h"
+
+
+
+
+typedef struct {
+	/* Don't sleep for duration of tones, advance virtual clock
+	   instead. */
+	bool virtual_clock;
+	/* Current time of virtual clock. */
+	struct timeval now;
+	pthread_mutex_t mutex;
+	/* End of previous tone played in real time, on CLOCK_MONOTONIC
+	   clock. */
+	struct timespec timeline;
+} cw_null_data_t;
+
+
+
+
 #include "libcw_gen.h"
 
 
 
 
 cw_ret_t cw_null_init_gen_internal(cw_gen_t * gen);
+void cw_null_get_timestamp_internal(cw_gen_t * gen, struct timeval * timestamp);
 
 
 
@@ -65,6 +65,7 @@ extern cw_debug_t cw_debug_object_dev;
 #include <fcntl.h>
 #include <limits.h>
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -88,6 +89,7 @@ extern cw_debug_t cw_debug_object_dev;
 
 #include "libcw_debug_internal.h"
 #include "libcw_gen.h"
+#include "libcw_utils.h"
 
 
 
@@ -99,17 +101,24 @@ extern const unsigned int cw_supported_sample_rates[];
 
 /* Conditional compilation flags. */
 #define CW_OSS_SET_FRAGMENT       1  /* ioctl(fd, SNDCTL_DSP_SETFRAGMENT, &param) */
-#define CW_OSS_SET_POLICY         0  /* ioctl(fd, SNDCTL_DSP_POLICY, &param) */
+#define CW_OSS_SET_POLICY         1  /* ioctl(fd, SNDCTL_DSP_POLICY, &param), only if fragment size requested by cw_gen_config_t::oss_latency has not been set. */
 
 /* Constants specific to OSS sound system configuration. */
-static const unsigned int CW_OSS_SETFRAGMENT = 7U;              /* Sound fragment size, 2^7 samples. */
+static const unsigned int CW_OSS_SETFRAGMENT = 7U;              /* Default fragment size, 2^7 bytes. */
+static const unsigned int CW_OSS_N_FRAGMENTS = 0x0032U;         /* Default count of fragments. */
+static const unsigned int CW_OSS_SETFRAGMENT_MIN = 4U;          /* Smallest fragment size accepted by drivers, 2^4 bytes. */
 static const int CW_OSS_SAMPLE_FORMAT = AFMT_S16_NE;  /* Sound format AFMT_S16_NE = signed 16 bit, native endianess; LE = Little endianess. */
 
-static cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate);
+static cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int requested_sample_rate, int requested_latency, unsigned int * sample_rate);
+static void cw_oss_get_fragments_internal(unsigned int sample_rate, int requested_latency, unsigned int * fragment_exponent, unsigned int * n_fragments);
 static cw_ret_t cw_oss_get_version_internal(int fd, cw_oss_version_t * version);
 static cw_ret_t cw_oss_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_oss_write_nonblocking_internal(cw_gen_t * gen, size_t n_bytes);
 static cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void cw_oss_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_oss_drop_silence_from_sound_device_internal(cw_gen_t * gen, int64_t n_silent_samples);
+static cw_ret_t cw_oss_get_sound_device_delay_internal(cw_gen_t * gen, int * delay);
+static cw_ret_t cw_oss_pause_sound_device_internal(cw_gen_t * gen);
 
 
 
@@ -172,7 +181,7 @@ bool cw_is_oss_possible(const char * device_name)
 	  values from ioctl() and returns CW_FAILURE if one of ioctls()
 	  returns -1. */
 	unsigned int dummy = 0;
-	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(soundcard, &dummy);
+	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(soundcard, 0, 0, &dummy);
 	close(soundcard);
 	if (cw_ret != CW_SUCCESS) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
@@ -208,6 +217,9 @@ cw_ret_t cw_oss_init_gen_internal(cw_gen_t * gen)
 	gen->open_and_configure_sound_device = cw_oss_open_and_configure_sound_device_internal;
 	gen->close_sound_device              = cw_oss_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_oss_write_buffer_to_sound_device_internal;
+	gen->drop_silence_from_sound_device  = cw_oss_drop_silence_from_sound_device_internal;
+	gen->get_sound_device_delay          = cw_oss_get_sound_device_delay_internal;
+	gen->pause_sound_device              = cw_oss_pause_sound_device_internal;
 
 	return CW_SUCCESS;
 }
@@ -230,8 +242,11 @@ cw_ret_t cw_oss_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_OSS);
 
-	size_t n_bytes = sizeof (gen->buffer[0]) * gen->buffer_n_samples;
-	ssize_t rv = write(gen->oss_data.sound_sink_fd, gen->buffer, n_bytes);
+	size_t n_bytes = sizeof (gen->out_buffer[0]) * (size_t) gen->out_n_samples;
+	if (gen->sound_nonblocking) {
+		return cw_oss_write_nonblocking_internal(gen, n_bytes);
+	}
+	ssize_t rv = write(gen->oss_data.sound_sink_fd, gen->out_buffer, n_bytes);
 	if (rv != (ssize_t) n_bytes) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "write: %s", strerror(errno));
@@ -245,6 +260,149 @@ cw_ret_t cw_oss_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Write generator's buffer to OSS device opened in non-blocking mode
+
+   Write as much as the device accepts, and wait for the device (or for
+   stopping of generator) when it is full.
+
+   @param[in] gen generator that will write to sound device
+   @param[in] n_bytes size of data in generator's buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise (including abandoning the write because generator is being stopped or because silence is cut for sidetone)
+*/
+static cw_ret_t cw_oss_write_nonblocking_internal(cw_gen_t * gen, size_t n_bytes)
+{
+	const char * data = (const char *) gen->out_buffer;
+	size_t n_written = 0;
+
+	while (n_written < n_bytes) {
+		const ssize_t rv = write(gen->oss_data.sound_sink_fd, data + n_written, n_bytes - n_written);
+		if (rv > 0) {
+			n_written += (size_t) rv;
+			continue;
+		}
+		if (-1 == rv && EINTR == errno) {
+			continue;
+		}
+		if (-1 == rv && EAGAIN != errno && EWOULDBLOCK != errno) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: %s", strerror(errno));
+			return CW_FAILURE;
+		}
+
+		struct pollfd fd = { .fd = gen->oss_data.sound_sink_fd, .events = POLLOUT, .revents = 0 };
+		if (CW_SUCCESS != cw_gen_wait_for_sound_device_internal(gen, &fd, 1)) {
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "write: abandoned after %zu/%zu bytes", n_written, n_bytes);
+			return CW_FAILURE;
+		}
+		if (fd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: error condition on device, revents = %#x", (unsigned int) fd.revents);
+			return CW_FAILURE;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Drop silence waiting to be played by OSS device
+
+   Data is dropped only if all samples waiting in buffer of device are
+   silent, i.e. if there are no more than @p n_silent_samples of them.
+
+   @param[in] gen generator with opened OSS device
+   @param[in] n_silent_samples count of most recently written samples that are silent
+
+   @return CW_SUCCESS if samples have been dropped
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_oss_drop_silence_from_sound_device_internal(cw_gen_t * gen, int64_t n_silent_samples)
+{
+	int n_bytes = 0;
+	if (-1 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_GETODELAY, &n_bytes)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "ioctl(SNDCTL_DSP_GETODELAY): '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+	if ((int64_t) n_bytes / (int64_t) sizeof (gen->buffer[0]) > n_silent_samples) {
+		/* Tail of previous Mark hasn't been played yet. */
+		return CW_FAILURE;
+	}
+
+	/* Stop playback and discard buffered data. Next write starts
+	   playback again, with unchanged parameters. */
+	if (-1 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_RESET, NULL)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "ioctl(SNDCTL_DSP_RESET): '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop playback of OSS device of idle generator
+
+   Samples that are still waiting in buffer of device are played
+   first. Next write starts playback again.
+
+   @param[in] gen generator with opened OSS device
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_oss_pause_sound_device_internal(cw_gen_t * gen)
+{
+	if (-1 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_SYNC, NULL)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "ioctl(SNDCTL_DSP_SYNC): '%s'", strerror(errno));
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get duration of samples waiting to be played by OSS device
+
+   @param[in] gen generator with opened OSS device
+   @param[out] delay duration of waiting samples [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_oss_get_sound_device_delay_internal(cw_gen_t * gen, int * delay)
+{
+	if (0 == gen->sample_rate) {
+		return CW_FAILURE;
+	}
+
+	int n_bytes = 0;
+	if (-1 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_GETODELAY, &n_bytes) || n_bytes < 0) {
+		return CW_FAILURE;
+	}
+	const int64_t n_samples = (int64_t) n_bytes / (int64_t) sizeof (gen->buffer[0]);
+	*delay = (int) ((n_samples * CW_USECS_PER_SEC) / gen->sample_rate);
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Open and configure OSS handle stored in given generator
 
@@ -270,14 +428,14 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
 	   cw_oss_open_and_configure_sound_device_internal() and is_possible() function. */
 
 	/* Open the given soundcard device file, for write only. */
-	gen->oss_data.sound_sink_fd = open(gen->picked_device_name, O_WRONLY);
+	gen->oss_data.sound_sink_fd = open(gen->picked_device_name, O_WRONLY | (gen->sound_nonblocking ? O_NONBLOCK : 0));
 	if (-1 == gen->oss_data.sound_sink_fd) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: open(%s): '%s'", gen->picked_device_name, strerror(errno));
 		return CW_FAILURE;
 	}
 
-	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(gen->oss_data.sound_sink_fd, &gen->sample_rate);
+	cw_ret_t cw_ret = cw_oss_open_device_ioctls_internal(gen->oss_data.sound_sink_fd, cw_gen_get_requested_sample_rate_internal(gen_conf), gen_conf->oss_latency, &gen->sample_rate);
 	if (cw_ret != CW_SUCCESS) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
 			      MSG_PREFIX "open: one or more OSS ioctl() calls failed");
@@ -302,19 +460,26 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
 		return CW_FAILURE;
 	}
 
-	if ((size & 0x0000ffff) != (1U << CW_OSS_SETFRAGMENT)) {
+	if (size < (int) sizeof (cw_sample_t)) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open: OSS fragment size not set, %d", size);
+			      MSG_PREFIX "open: invalid OSS fragment size %d", size);
 		close(gen->oss_data.sound_sink_fd);
-		/* FIXME */
 		return CW_FAILURE;
-	} else {
-		/* TODO: are we reporting size correctly? Shouldn't it be
-		   "(size & 0x0000ffff)" or maybe even "2^(size & 0x0000ffff)"? */
-		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
-			      MSG_PREFIX "open: OSS fragment size = %d", size);
 	}
-	gen->buffer_n_samples = size;
+	/* Generator writes one fragment at a time. */
+	gen->buffer_n_samples = size / (int) sizeof (cw_sample_t);
+
+	/* Samples written to device may wait in all of its fragments
+	   before they are played. */
+	audio_buf_info space;
+	/* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+	if (0 == ioctl(gen->oss_data.sound_sink_fd, SNDCTL_DSP_GETOSPACE, &space) && space.fragstotal > 0) {
+		const int64_t n_samples = ((int64_t) space.fragstotal * space.fragsize) / (int64_t) sizeof (cw_sample_t);
+		gen->sound_device_latency = (int) ((n_samples * CW_USECS_PER_SEC) / gen->sample_rate);
+	}
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "open: fragment size = %d samples, device latency = %d [us]",
+		      gen->buffer_n_samples, gen->sound_device_latency);
 
 
 	cw_oss_get_version_internal(gen->oss_data.sound_sink_fd, &gen->oss_data.version);
@@ -341,12 +506,14 @@ cw_ret_t cw_oss_open_and_configure_sound_device_internal(cw_gen_t * gen, const c
    @reviewed 2020-07-19
 
    @param[in] fd file descriptor of open OSS file;
+   @param[in] requested_sample_rate sample rate to try before standard rates (zero if none)
+   @param[in] requested_latency requested duration of samples in buffer of device (zero for default fragments) [us]
    @param[out] sample_rate sample rate configured by ioctl calls
 
    @return CW_FAILURE on errors
    @return CW_SUCCESS on success
 */
-cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
+cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int requested_sample_rate, int requested_latency, unsigned int * sample_rate)
 {
 	int parameter = 0; /* Ignored. */
 	/* Don't let clang-tidy report warning about signed. To fix
@@ -423,8 +590,10 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 	   value, and retain the one we actually get. */
 	unsigned int rate = 0;
 	bool success = false;
-	for (int i = 0; cw_supported_sample_rates[i]; i++) {
-		rate = cw_supported_sample_rates[i];
+	/* Requested rate (index -1) is tried before the standard rates. */
+	for (int i = requested_sample_rate ? -1 : 0; i < 0 || cw_supported_sample_rates[i]; i++) {
+		const unsigned int asked = i < 0 ? requested_sample_rate : cw_supported_sample_rates[i];
+		rate = asked;
 		/* Don't cast second argument of ioctl() to int, because you will get
 		   this warning in dmesg (found on FreeBSD 12.1):
 		   "ioctl sign-extension ioctl ffffffffc0045002" */
@@ -433,9 +602,9 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 		   would introduce runtime warnings in dmesg on FreeBSD. */
 		/* NOLINTNEXTLINE(hicpp-signed-bitwise) */
 		if (0 == ioctl(fd, SNDCTL_DSP_SPEED, &rate)) {
-			if (rate != cw_supported_sample_rates[i]) {
+			if (rate != asked) {
 				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "ioctls: imprecise sample rate:");
-				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "ioctls: asked for: %u", cw_supported_sample_rates[i]);
+				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "ioctls: asked for: %u", asked);
 				cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING, MSG_PREFIX "ioctls: got:       %u", rate);
 			}
 			success = true;
@@ -486,7 +655,12 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 	 * support.
 	 */
 	/* parameter = 0x7fff << 16 | CW_OSS_SETFRAGMENT; */
-	parameter = 0x0032U << 16U | CW_OSS_SETFRAGMENT;
+	unsigned int fragment_exponent = CW_OSS_SETFRAGMENT;
+	unsigned int n_fragments = CW_OSS_N_FRAGMENTS;
+	if (requested_latency > 0) {
+		cw_oss_get_fragments_internal(rate, requested_latency, &fragment_exponent, &n_fragments);
+	}
+	parameter = (int) (n_fragments << 16U | fragment_exponent);
 
 	/* Don't cast second argument of ioctl() to int, because you will get
 	   this warning in dmesg (found on FreeBSD 12.1):
@@ -514,19 +688,32 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 		return CW_FAILURE;
 	}
 
-	if (parameter != (1U << CW_OSS_SETFRAGMENT)) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+	const bool fragment_set = parameter == (int) (1U << fragment_exponent);
+	if (!fragment_set) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "ioctls: OSS fragment size not set, %d", parameter);
 	}
-
+#else
+	const bool fragment_set = false;
 #endif
-#if CW_OSS_SET_POLICY
-	parameter = 5; /* TODO: what does this value mean? */
-	if (-1 == ioctl(fd, SNDCTL_DSP_POLICY, &parameter)) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "ioctls: ioctl(SNDCTL_DSP_POLICY): '%s'", strerror(errno));
-		return CW_FAILURE;
+#if CW_OSS_SET_POLICY && defined(SNDCTL_DSP_POLICY)
+	if (requested_latency > 0 && !fragment_set) {
+		/* OSS 4 timing policy, from 0 (shortest buffer) to 10,
+		   5 being the default. Policy N gives roughly 2^N ms
+		   of buffer. */
+		parameter = 0;
+		while (parameter < 10 && (1000 << parameter) < requested_latency) {
+			parameter++;
+		}
+		/* NOLINTNEXTLINE(hicpp-signed-bitwise) */
+		if (-1 == ioctl(fd, SNDCTL_DSP_POLICY, &parameter)) {
+			/* Not fatal, driver keeps its default buffering. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "ioctls: ioctl(SNDCTL_DSP_POLICY): '%s'", strerror(errno));
+		}
 	}
+#else
+	(void) fragment_set;
 #endif
 
 	/* Don't let clang-tidy report warning about signed. To fix
@@ -553,6 +740,43 @@ cw_ret_t cw_oss_open_device_ioctls_internal(int fd, unsigned int * sample_rate)
 
 
 
+/**
+   @brief Calculate fragments of OSS device for requested latency
+
+   Buffer of device is split into at least two fragments, each of them
+   being the largest power of two (in bytes) not longer than half of
+   @p requested_latency. Generator writes one fragment at a time.
+
+   @param[in] sample_rate sample rate of device
+   @param[in] requested_latency requested duration of samples in buffer of device [us]
+   @param[out] fragment_exponent fragment size is 2^fragment_exponent bytes
+   @param[out] n_fragments count of fragments
+*/
+static void cw_oss_get_fragments_internal(unsigned int sample_rate, int requested_latency, unsigned int * fragment_exponent, unsigned int * n_fragments)
+{
+	const int64_t n_bytes = ((int64_t) sample_rate * requested_latency / CW_USECS_PER_SEC) * (int64_t) sizeof (cw_sample_t);
+
+	unsigned int exponent = CW_OSS_SETFRAGMENT_MIN;
+	while (exponent < 15 && ((int64_t) 2 << (exponent + 1)) <= n_bytes) {
+		exponent++;
+	}
+
+	int64_t n = n_bytes >> exponent;
+	if (n < 2) {
+		n = 2;
+	} else if (n > 0x7fff) {
+		n = 0x7fff;
+	}
+
+	*fragment_exponent = exponent;
+	*n_fragments = (unsigned int) n;
+
+	return;
+}
+
+
+
+
 /**
    @brief Close OSS device stored in given generator
 
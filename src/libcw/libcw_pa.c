@@ -63,6 +63,7 @@ extern cw_debug_t cw_debug_object_dev;
 #include <assert.h>
 #include <dlfcn.h> /* dlopen() and related symbols */
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -83,7 +84,8 @@ extern cw_debug_t cw_debug_object_dev;
 
 typedef struct cw_pa_lib_handle_t {
 
-	/* Returned by dlopen(). To be cleaned up with dlclose(). */
+	/* Returned by dlopen(). The library stays loaded until the end of
+	   the process. */
 	void * lib_handle;
 
 	pa_simple *(* pa_simple_new)(const char * server_name, const char * name, pa_stream_direction_t dir, const char * device_name, const char * stream_name, const pa_sample_spec * ss, const pa_channel_map * map, const pa_buffer_attr * attr, int * error);
@@ -93,30 +95,100 @@ typedef struct cw_pa_lib_handle_t {
 	int        (* pa_simple_drain)(pa_simple * simple, int * error);
 
 	size_t     (* pa_usec_to_bytes)(pa_usec_t t, const pa_sample_spec * spec);
-	char      *(* pa_strerror)(int error);
+	const char *(* pa_strerror)(int error);
+
+	/* Asynchronous API from "libpulse" library, used when
+	   cw_gen_config_t::pa_async is set. Returned by dlopen(), the
+	   library stays loaded until the end of the process. */
+	void * async_lib_handle;
+
+	pa_threaded_mainloop *(* pa_threaded_mainloop_new)(void);
+	void        (* pa_threaded_mainloop_free)(pa_threaded_mainloop * m);
+	int         (* pa_threaded_mainloop_start)(pa_threaded_mainloop * m);
+	void        (* pa_threaded_mainloop_stop)(pa_threaded_mainloop * m);
+	void        (* pa_threaded_mainloop_lock)(pa_threaded_mainloop * m);
+	void        (* pa_threaded_mainloop_unlock)(pa_threaded_mainloop * m);
+	void        (* pa_threaded_mainloop_wait)(pa_threaded_mainloop * m);
+	void        (* pa_threaded_mainloop_signal)(pa_threaded_mainloop * m, int wait_for_accept);
+	pa_mainloop_api *(* pa_threaded_mainloop_get_api)(pa_threaded_mainloop * m);
+
+	pa_context *(* pa_context_new)(pa_mainloop_api * mainloop, const char * name);
+	void        (* pa_context_set_state_callback)(pa_context * c, pa_context_notify_cb_t cb, void * userdata);
+	int         (* pa_context_connect)(pa_context * c, const char * server, pa_context_flags_t flags, const pa_spawn_api * api);
+	pa_context_state_t (* pa_context_get_state)(const pa_context * c);
+	int         (* pa_context_errno)(const pa_context * c);
+	void        (* pa_context_disconnect)(pa_context * c);
+	void        (* pa_context_unref)(pa_context * c);
+
+	pa_stream  *(* pa_stream_new)(pa_context * c, const char * name, const pa_sample_spec * ss, const pa_channel_map * map);
+	void        (* pa_stream_set_state_callback)(pa_stream * s, pa_stream_notify_cb_t cb, void * userdata);
+	void        (* pa_stream_set_write_callback)(pa_stream * s, pa_stream_request_cb_t cb, void * userdata);
+	int         (* pa_stream_connect_playback)(pa_stream * s, const char * dev, const pa_buffer_attr * attr, pa_stream_flags_t flags, const pa_cvolume * volume, pa_stream * sync_stream);
+	pa_stream_state_t (* pa_stream_get_state)(const pa_stream * s);
+	const pa_buffer_attr *(* pa_stream_get_buffer_attr)(pa_stream * s);
+	size_t      (* pa_stream_writable_size)(const pa_stream * s);
+	int         (* pa_stream_begin_write)(pa_stream * s, void ** data, size_t * nbytes);
+	int         (* pa_stream_write)(pa_stream * s, const void * data, size_t nbytes, pa_free_cb_t free_cb, int64_t offset, pa_seek_mode_t seek);
+	pa_operation *(* pa_stream_flush)(pa_stream * s, pa_stream_success_cb_t cb, void * userdata);
+	int         (* pa_stream_disconnect)(pa_stream * s);
+	void        (* pa_stream_unref)(pa_stream * s);
+	void        (* pa_operation_unref)(pa_operation * o);
+	pa_usec_t   (* pa_bytes_to_usec)(uint64_t length, const pa_sample_spec * spec);
 } cw_pa_lib_handle_t;
 
 
 
 
 /*
-  FIXME: verify how this data structure is handled when there are
-  many generators.
-  How many times the structure is set?
-  How many times it's closed?
-  Is it closed for all generators when first of these generators is destroyed?
-  Do we need a reference counter for this structure?
+  There is only one instance of this data structure in the process,
+  shared by all generators. Its parts are filled once, by
+  cw_pa_load_library_internal() and cw_pa_async_load_library_internal(),
+  and are never cleared.
 */
 static cw_pa_lib_handle_t g_cw_pa_lib_handle;
 
+/* Protects loading of libraries into g_cw_pa_lib_handle. Set to true
+   (with release semantics) once all symbols of given library have
+   been resolved. */
+static pthread_mutex_t g_cw_pa_load_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool g_cw_pa_loaded = false;
+static bool g_cw_pa_async_loaded = false;
+
+/* With direct linking (--enable-direct-linking) calls to PulseAudio
+   functions are resolved at build time and can be optimized by
+   compiler and linker. g_cw_pa_lib_handle is still filled, with
+   addresses of the linked functions. */
+#if LIBCW_PULSEAUDIO_DIRECT_LINK
+#define CW_PA(symbol) symbol
+#define CW_PA_RESOLVE(cw_pa, lib_handle, symbol) (cw_pa)->symbol = symbol
+#else
+#define CW_PA(symbol) g_cw_pa_lib_handle.symbol
+#define CW_PA_RESOLVE(cw_pa, lib_handle, symbol) *(void **) &((cw_pa)->symbol) = dlsym((lib_handle), #symbol)
+#endif
+
 
 
 
-static pa_simple  * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, unsigned int * sample_rate, int * error);
+static pa_simple  * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, pa_sample_format_t format, int n_channels, unsigned int * sample_rate, int * error);
+static pa_sample_format_t cw_pa_sample_format_internal(cw_sample_format_t sample_format);
+static bool         cw_pa_load_library_internal(void);
 static int          cw_pa_dlsym_internal(cw_pa_lib_handle_t * cw_pa);
 static cw_ret_t     cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
 static void         cw_pa_close_sound_device_internal(cw_gen_t * gen);
 static cw_ret_t     cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t     cw_pa_get_sound_device_delay_internal(cw_gen_t * gen, int * delay);
+
+static bool         cw_pa_async_load_library_internal(void);
+static int          cw_pa_async_dlsym_internal(cw_pa_lib_handle_t * cw_pa);
+static cw_ret_t     cw_pa_async_open_internal(cw_gen_t * gen, const char * stream_name);
+static void         cw_pa_async_close_internal(cw_gen_t * gen);
+static cw_ret_t     cw_pa_async_write_buffer_internal(cw_gen_t * gen);
+static cw_ret_t     cw_pa_async_start_internal(cw_gen_t * gen);
+static void         cw_pa_async_stop_internal(cw_gen_t * gen);
+static void         cw_pa_async_fill_internal(cw_gen_t * gen, size_t n_bytes);
+static void         cw_pa_async_context_state_cb(pa_context * context, void * userdata);
+static void         cw_pa_async_stream_state_cb(pa_stream * stream, void * userdata);
+static void         cw_pa_async_stream_write_cb(pa_stream * stream, size_t n_bytes, void * userdata);
 
 
 
@@ -124,6 +196,135 @@ static cw_ret_t     cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen);
 static const pa_sample_format_t CW_PA_SAMPLE_FORMAT = PA_SAMPLE_S16LE; /* Signed 16 bit, Little Endian */
 static const int CW_PA_BUFFER_N_SAMPLES = 256;
 
+/* Buffering targets of asynchronous stream. Server keeps about
+   CW_PA_ASYNC_TLENGTH of samples in its buffer, and asks for more in
+   chunks of CW_PA_ASYNC_MINREQ. Playback starts (also after an
+   underrun) as soon as first chunk has been written. [us] */
+#define CW_PA_ASYNC_TLENGTH  (20 * 1000)
+#define CW_PA_ASYNC_MINREQ   ( 5 * 1000)
+
+
+
+
+/**
+   @brief Load PulseAudio 'libpulse-simple' library and resolve its symbols
+
+   The library is loaded and its symbols are resolved only once, on
+   first call of the function. The library stays loaded until the end
+   of the process, so all generators (in all threads) share one set
+   of resolved symbols.
+
+   With direct linking of PulseAudio libraries the function doesn't
+   call dlopen(), it only fills the table with addresses of linked
+   functions.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_pa_load_library_internal(void)
+{
+	if (__atomic_load_n(&g_cw_pa_loaded, __ATOMIC_ACQUIRE)) {
+		return true;
+	}
+
+	pthread_mutex_lock(&g_cw_pa_load_mutex);
+#if LIBCW_PULSEAUDIO_DIRECT_LINK
+	if (!g_cw_pa_loaded) {
+		/* Nothing to open, symbols are only copied. */
+		if (cw_pa_dlsym_internal(&g_cw_pa_lib_handle) >= 0) {
+			__atomic_store_n(&g_cw_pa_loaded, true, __ATOMIC_RELEASE);
+		}
+	}
+#else
+	if (!g_cw_pa_loaded) {
+		/*
+		  https://bugs.debian.org/cgi-bin/bugreport.cgi?bug=979113
+		  TODO: consider removing the unversioned library name in the future,
+		  after testing presence and usage of .so.0 on more platforms.
+		*/
+		const char * const library_name[] = {
+			"libpulse-simple.so.0",
+			"libpulse-simple.so",
+			NULL,
+		};
+		int i = 0;
+		while (NULL != library_name[i]) {
+			if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &g_cw_pa_lib_handle.lib_handle)) {
+				break;
+			}
+			i++;
+		}
+		if (NULL == g_cw_pa_lib_handle.lib_handle) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "can't open PulseAudio 'libpulse-simple' library");
+		} else {
+			const int rv = cw_pa_dlsym_internal(&g_cw_pa_lib_handle);
+			if (rv < 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to resolve PulseAudio symbol #%d, can't correctly load PulseAudio library", rv);
+				dlclose(g_cw_pa_lib_handle.lib_handle);
+				g_cw_pa_lib_handle.lib_handle = NULL;
+			} else {
+				__atomic_store_n(&g_cw_pa_loaded, true, __ATOMIC_RELEASE);
+			}
+		}
+	}
+#endif
+	const bool loaded = g_cw_pa_loaded;
+	pthread_mutex_unlock(&g_cw_pa_load_mutex);
+
+	return loaded;
+}
+
+
+
+
+/**
+   @brief Load PulseAudio 'libpulse' library with asynchronous API and resolve its symbols
+
+   Like cw_pa_load_library_internal(), the library is loaded only once
+   and stays loaded until the end of the process.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_pa_async_load_library_internal(void)
+{
+	if (__atomic_load_n(&g_cw_pa_async_loaded, __ATOMIC_ACQUIRE)) {
+		return true;
+	}
+
+	pthread_mutex_lock(&g_cw_pa_load_mutex);
+#if LIBCW_PULSEAUDIO_DIRECT_LINK
+	if (!g_cw_pa_async_loaded) {
+		if (cw_pa_async_dlsym_internal(&g_cw_pa_lib_handle) >= 0) {
+			__atomic_store_n(&g_cw_pa_async_loaded, true, __ATOMIC_RELEASE);
+		}
+	}
+#else
+	if (!g_cw_pa_async_loaded) {
+		if (CW_SUCCESS != cw_dlopen_internal("libpulse.so.0", &g_cw_pa_lib_handle.async_lib_handle)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "async open: can't open PulseAudio 'libpulse' library");
+		} else {
+			const int rv = cw_pa_async_dlsym_internal(&g_cw_pa_lib_handle);
+			if (rv < 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "async open: failed to resolve PulseAudio symbol #%d", rv);
+				dlclose(g_cw_pa_lib_handle.async_lib_handle);
+				g_cw_pa_lib_handle.async_lib_handle = NULL;
+			} else {
+				__atomic_store_n(&g_cw_pa_async_loaded, true, __ATOMIC_RELEASE);
+			}
+		}
+	}
+#endif
+	const bool loaded = g_cw_pa_async_loaded;
+	pthread_mutex_unlock(&g_cw_pa_load_mutex);
+
+	return loaded;
+}
+
 
 
 
@@ -131,8 +332,9 @@ static const int CW_PA_BUFFER_N_SAMPLES = 256;
    @brief Check if it is possible to open PulseAudio output with given device
    name
 
-   Function first tries to load PulseAudio library, and then does a test
-   opening of PulseAudio output, but it closes it before returning.
+   Function first loads PulseAudio library (only once, see
+   cw_pa_load_library_internal()), and then does a test opening of
+   PulseAudio output, but it closes it before returning.
 
    @reviewed 2020-11-14
 
@@ -149,34 +351,7 @@ bool cw_is_pa_possible(const char * device_name)
 	   accessible on this machine, and this should not be logged as
 	   error. */
 
-	/*
-	  https://bugs.debian.org/cgi-bin/bugreport.cgi?bug=979113
-	  TODO: consider removing the unversioned library name in the future,
-	  after testing presence and usage of .so.0 on more platforms.
-	*/
-	const char * const library_name[] = {
-		"libpulse-simple.so.0",
-		"libpulse-simple.so",
-		NULL,
-	};
-	int i = 0;
-	while (NULL != library_name[i]) {
-		if (CW_SUCCESS == cw_dlopen_internal(library_name[i], &g_cw_pa_lib_handle.lib_handle)) {
-			break;
-		}
-		i++;
-	}
-	if (NULL == g_cw_pa_lib_handle.lib_handle) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: can't open PulseAudio 'libpulse-simple' library");
-		return false;
-	}
-
-	int rv = cw_pa_dlsym_internal(&g_cw_pa_lib_handle);
-	if (rv < 0) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "is possible: failed to resolve PulseAudio symbol #%d, can't correctly load PulseAudio library", rv);
-		dlclose(g_cw_pa_lib_handle.lib_handle);
+	if (!cw_pa_load_library_internal()) {
 		return false;
 	}
 
@@ -186,13 +361,10 @@ bool cw_is_pa_possible(const char * device_name)
 
 	unsigned int sample_rate = 0;
 	int error = 0;
-	pa_simple * simple = cw_pa_simple_new_internal(picked_device_name, "cw_is_pa_possible()", &sample_rate, &error);
+	pa_simple * simple = cw_pa_simple_new_internal(picked_device_name, "cw_is_pa_possible()", CW_PA_SAMPLE_FORMAT, CW_AUDIO_CHANNELS, &sample_rate, &error);
 	if (NULL == simple) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR, /* TODO: is this really an error? */
-			      MSG_PREFIX "is possible: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
-		if (g_cw_pa_lib_handle.lib_handle) { /* FIXME: this closing of global handle won't work well for multi-generator library. */
-			dlclose(g_cw_pa_lib_handle.lib_handle);
-		}
+			      MSG_PREFIX "is possible: can't connect to PulseAudio server: %s", CW_PA(pa_strerror)(error));
 		/* Without this env an attempt to connect to PulseAudio
 		   server may end with "Connection refused". */
 		if (NULL == getenv("XDG_RUNTIME_DIR")) {
@@ -201,8 +373,7 @@ bool cw_is_pa_possible(const char * device_name)
 		}
 		return false;
 	} else {
-		/* TODO: verify this comment: We do dlclose(g_cw_pa_lib_handle.lib_handle) in cw_pa_close_sound_device_internal(). */
-		g_cw_pa_lib_handle.pa_simple_free(simple);
+		CW_PA(pa_simple_free)(simple);
 		simple = NULL;
 		return true;
 	}
@@ -231,6 +402,7 @@ cw_ret_t cw_pa_init_gen_internal(cw_gen_t * gen)
 	gen->open_and_configure_sound_device = cw_pa_open_and_configure_sound_device_internal;
 	gen->close_sound_device              = cw_pa_close_sound_device_internal;
 	gen->write_buffer_to_sound_device    = cw_pa_write_buffer_to_sound_device_internal;
+	gen->get_sound_device_delay          = cw_pa_get_sound_device_delay_internal;
 
 	return CW_SUCCESS;
 }
@@ -253,12 +425,17 @@ static cw_ret_t cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 	assert (gen);
 	assert (gen->sound_system == CW_AUDIO_PA);
 
+	if (gen->pa_data.stream) {
+		return cw_pa_async_write_buffer_internal(gen);
+	}
+
 	int error = 0;
-	size_t n_bytes = sizeof (gen->buffer[0]) * gen->buffer_n_samples;
-	int rv = g_cw_pa_lib_handle.pa_simple_write(gen->pa_data.simple, gen->buffer, n_bytes, &error);
+	size_t n_bytes = 0;
+	const void * samples = cw_gen_get_device_samples_internal(gen, &n_bytes);
+	int rv = CW_PA(pa_simple_write)(gen->pa_data.simple, samples, n_bytes, &error);
 	if (rv < 0) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "write: pa_simple_write() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
+			      MSG_PREFIX "write: pa_simple_write() failed: %s", CW_PA(pa_strerror)(error));
 		return CW_FAILURE;
 	} else {
 		//cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO, MSG_PREFIX "written %d samples with PulseAudio", gen->buffer_n_samples);
@@ -269,6 +446,60 @@ static cw_ret_t cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Get duration of samples waiting to be played by PulseAudio device
+
+   Only simple API can tell the delay. For asynchronous stream the
+   function fails, and latency of the stream is used instead.
+
+   @param[in] gen generator with opened PulseAudio device
+   @param[out] delay duration of waiting samples [microseconds]
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_get_sound_device_delay_internal(cw_gen_t * gen, int * delay)
+{
+	if (NULL == gen->pa_data.simple) {
+		return CW_FAILURE;
+	}
+
+	int error = 0;
+	const pa_usec_t latency = CW_PA(pa_simple_get_latency)(gen->pa_data.simple, &error);
+	if ((pa_usec_t) -1 == latency) {
+		return CW_FAILURE;
+	}
+	*delay = (int) latency;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get PulseAudio's sample format corresponding to libcw's sample format
+
+   @param[in] sample_format libcw's sample format
+
+   @return PulseAudio's sample format
+*/
+static pa_sample_format_t cw_pa_sample_format_internal(cw_sample_format_t sample_format)
+{
+	switch (sample_format) {
+	case CW_SAMPLE_FORMAT_S32:
+		return PA_SAMPLE_S32NE;
+	case CW_SAMPLE_FORMAT_FLOAT32:
+		return PA_SAMPLE_FLOAT32NE;
+	case CW_SAMPLE_FORMAT_S16:
+	default:
+		return CW_PA_SAMPLE_FORMAT;
+	}
+}
+
+
+
+
 /**
    @brief Wrapper for pa_simple_new()
 
@@ -287,27 +518,29 @@ static cw_ret_t cw_pa_write_buffer_to_sound_device_internal(cw_gen_t * gen)
 
    @param[in] picked_device_name name of PulseAudio device to be used. Non-NULL pointer only. Empty string for default device.
    @param[in] stream_name descriptive name of client, passed to pa_simple_new
+   @param[in] format format of samples
+   @param[in] n_channels count of channels
    @param[out] sample_rate sample rate configured for sound sink
    @param[out] error potential PulseAudio error code
 
    @return pointer to new PulseAudio sink on success
    @return NULL on failure
 */
-static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, unsigned int * sample_rate, int * error)
+static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, const char * stream_name, pa_sample_format_t format, int n_channels, unsigned int * sample_rate, int * error)
 {
 	pa_sample_spec spec = { 0 };
-	spec.format = CW_PA_SAMPLE_FORMAT;
+	spec.format = format;
 	spec.rate = 44100; /* TODO: why this value is hardcoded? */
-	spec.channels = 1;
+	spec.channels = (uint8_t) n_channels;
 
 	// http://www.mail-archive.com/pulseaudio-tickets@mail.0pointer.de/msg03295.html
 	pa_buffer_attr attr = { 0 };
 	attr.prebuf    = (uint32_t) -1;
 	attr.fragsize  = (uint32_t) -1;
 	/* TODO: notice that the values are smaller than in the URL above. */
-	attr.tlength   = g_cw_pa_lib_handle.pa_usec_to_bytes(10 * 1000, &spec);
-	attr.minreq    = g_cw_pa_lib_handle.pa_usec_to_bytes(0, &spec);
-	attr.maxlength = g_cw_pa_lib_handle.pa_usec_to_bytes(10 * 1000, &spec);
+	attr.tlength   = CW_PA(pa_usec_to_bytes)(10 * 1000, &spec);
+	attr.minreq    = CW_PA(pa_usec_to_bytes)(0, &spec);
+	attr.maxlength = CW_PA(pa_usec_to_bytes)(10 * 1000, &spec);
 	/* attr.prebuf = ; */ /* ? */
 	/* attr.fragsize = sizeof(uint32_t) -1; */ /* Not relevant to playback. */
 
@@ -316,7 +549,7 @@ static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, co
 	   API. */
 	const char * dev = ('\0' == picked_device_name[0]) ? NULL : picked_device_name;
 
-	pa_simple * simple = g_cw_pa_lib_handle.pa_simple_new(NULL,                  /* Server name (NULL for default). */
+	pa_simple * simple = CW_PA(pa_simple_new)(NULL,                  /* Server name (NULL for default). */
 							      "libcw",               /* Descriptive name of client (program name etc.). */
 							      PA_STREAM_PLAYBACK,    /* Stream direction. */
 							      dev,                   /* Device/sink name (NULL for default). */
@@ -353,19 +586,19 @@ static pa_simple * cw_pa_simple_new_internal(const char * picked_device_name, co
 */
 static int cw_pa_dlsym_internal(cw_pa_lib_handle_t * cw_pa)
 {
-	*(void **) &(cw_pa->pa_simple_new)         = dlsym(cw_pa->lib_handle, "pa_simple_new");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_simple_new);
 	if (!cw_pa->pa_simple_new)         return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_free)        = dlsym(cw_pa->lib_handle, "pa_simple_free");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_simple_free);
 	if (!cw_pa->pa_simple_free)        return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_write)       = dlsym(cw_pa->lib_handle, "pa_simple_write");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_simple_write);
 	if (!cw_pa->pa_simple_write)       return -(__LINE__);
-	*(void **) &(cw_pa->pa_strerror)           = dlsym(cw_pa->lib_handle, "pa_strerror");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_strerror);
 	if (!cw_pa->pa_strerror)           return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_get_latency) = dlsym(cw_pa->lib_handle, "pa_simple_get_latency");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_simple_get_latency);
 	if (!cw_pa->pa_simple_get_latency) return -(__LINE__);
-	*(void **) &(cw_pa->pa_simple_drain)       = dlsym(cw_pa->lib_handle, "pa_simple_drain");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_simple_drain);
 	if (!cw_pa->pa_simple_drain)       return -(__LINE__);
-	*(void **) &(cw_pa->pa_usec_to_bytes)      = dlsym(cw_pa->lib_handle, "pa_usec_to_bytes");
+	CW_PA_RESOLVE(cw_pa, cw_pa->lib_handle, pa_usec_to_bytes);
 	if (!cw_pa->pa_usec_to_bytes)      return -(__LINE__);
 
 	return 0;
@@ -395,26 +628,49 @@ static cw_ret_t cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, c
 	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
 					 gen->picked_device_name, sizeof (gen->picked_device_name));
 
+	/* PulseAudio server converts samples to format of the sink, so
+	   requested format is always accepted. */
+	cw_gen_get_requested_sample_format_internal(gen_conf, &gen->sample_format, &gen->n_channels);
+
+	if (gen_conf->pa_async) {
+		if (CW_SUCCESS == cw_pa_async_open_internal(gen, gen->library_client.name ? gen->library_client.name : "app")) {
+			gen->buffer_n_samples = CW_PA_BUFFER_N_SAMPLES;
+			gen->start_sound_device = cw_pa_async_start_internal;
+			gen->stop_sound_device = cw_pa_async_stop_internal;
+#ifdef ENABLE_DEV_PCM_SAMPLES_FILE
+			cw_dev_debug_raw_sink_open_internal(gen);
+#endif
+			gen->sound_device_is_open = true;
+			return CW_SUCCESS;
+		}
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+			      MSG_PREFIX "open device: can't open asynchronous stream, falling back to simple API");
+	}
+
 	unsigned int sample_rate = 0;
 	int error = 0;
 	gen->pa_data.simple = cw_pa_simple_new_internal(gen->picked_device_name,
 							gen->library_client.name ? gen->library_client.name : "app",
+							cw_pa_sample_format_internal(gen->sample_format),
+							gen->n_channels,
 							&sample_rate,
 							&error);
 
  	if (NULL == gen->pa_data.simple) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open device: can't connect to PulseAudio server: %s", g_cw_pa_lib_handle.pa_strerror(error));
+			      MSG_PREFIX "open device: can't connect to PulseAudio server: %s", CW_PA(pa_strerror)(error));
 		return false;
 	}
 
 	gen->buffer_n_samples = CW_PA_BUFFER_N_SAMPLES;
 	gen->sample_rate = sample_rate;
-	gen->pa_data.latency_usecs = g_cw_pa_lib_handle.pa_simple_get_latency(gen->pa_data.simple, &error);
+	gen->pa_data.latency_usecs = CW_PA(pa_simple_get_latency)(gen->pa_data.simple, &error);
 
 	if ((pa_usec_t) -1 == gen->pa_data.latency_usecs) {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-			      MSG_PREFIX "open device: pa_simple_get_latency() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
+			      MSG_PREFIX "open device: pa_simple_get_latency() failed: %s", CW_PA(pa_strerror)(error));
+	} else {
+		gen->sound_device_latency = (int) gen->pa_data.latency_usecs;
 	}
 
 #ifdef ENABLE_DEV_PCM_SAMPLES_FILE
@@ -439,23 +695,23 @@ static cw_ret_t cw_pa_open_and_configure_sound_device_internal(cw_gen_t * gen, c
 */
 static void cw_pa_close_sound_device_internal(cw_gen_t * gen)
 {
-	if (gen->pa_data.simple) {
+	if (gen->pa_data.stream) {
+		cw_pa_async_close_internal(gen);
+	} else if (gen->pa_data.simple) {
 		/* Make sure that every single sample was played */
 		int error = 0;
-		if (g_cw_pa_lib_handle.pa_simple_drain(gen->pa_data.simple, &error) < 0) {
+		if (CW_PA(pa_simple_drain)(gen->pa_data.simple, &error) < 0) {
 			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
-				      MSG_PREFIX "close device: pa_simple_drain() failed: %s", g_cw_pa_lib_handle.pa_strerror(error));
+				      MSG_PREFIX "close device: pa_simple_drain() failed: %s", CW_PA(pa_strerror)(error));
 		}
-		g_cw_pa_lib_handle.pa_simple_free(gen->pa_data.simple);
+		CW_PA(pa_simple_free)(gen->pa_data.simple);
 		gen->pa_data.simple = NULL;
 	} else {
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
 			      MSG_PREFIX "close device: called the function for NULL PA sink");
 	}
 
-	if (g_cw_pa_lib_handle.lib_handle) { /* FIXME: this closing of global handle won't work well for multi-generator library. */
-		dlclose(g_cw_pa_lib_handle.lib_handle);
-	}
+	/* Don't close the library: other generators may be using it. */
 
 	gen->sound_device_is_open = false;
 
@@ -468,6 +724,408 @@ static void cw_pa_close_sound_device_internal(cw_gen_t * gen)
 
 
 
+/**
+   @brief Resolve/get symbols of asynchronous API from PulseAudio library
+
+   @param[in,out] cw_pa libcw pa data structure with library handle to opened "libpulse" library
+
+   @return 0 on success
+   @return negative value on failure
+*/
+static int cw_pa_async_dlsym_internal(cw_pa_lib_handle_t * cw_pa)
+{
+#define CW_PA_ASYNC_DLSYM(symbol)					\
+	CW_PA_RESOLVE(cw_pa, cw_pa->async_lib_handle, symbol);		\
+	if (!cw_pa->symbol) return -(__LINE__);
+
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_new);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_free);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_start);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_stop);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_lock);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_unlock);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_wait);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_signal);
+	CW_PA_ASYNC_DLSYM(pa_threaded_mainloop_get_api);
+
+	CW_PA_ASYNC_DLSYM(pa_context_new);
+	CW_PA_ASYNC_DLSYM(pa_context_set_state_callback);
+	CW_PA_ASYNC_DLSYM(pa_context_connect);
+	CW_PA_ASYNC_DLSYM(pa_context_get_state);
+	CW_PA_ASYNC_DLSYM(pa_context_errno);
+	CW_PA_ASYNC_DLSYM(pa_context_disconnect);
+	CW_PA_ASYNC_DLSYM(pa_context_unref);
+
+	CW_PA_ASYNC_DLSYM(pa_stream_new);
+	CW_PA_ASYNC_DLSYM(pa_stream_set_state_callback);
+	CW_PA_ASYNC_DLSYM(pa_stream_set_write_callback);
+	CW_PA_ASYNC_DLSYM(pa_stream_connect_playback);
+	CW_PA_ASYNC_DLSYM(pa_stream_get_state);
+	CW_PA_ASYNC_DLSYM(pa_stream_get_buffer_attr);
+	CW_PA_ASYNC_DLSYM(pa_stream_writable_size);
+	CW_PA_ASYNC_DLSYM(pa_stream_begin_write);
+	CW_PA_ASYNC_DLSYM(pa_stream_write);
+	CW_PA_ASYNC_DLSYM(pa_stream_flush);
+	CW_PA_ASYNC_DLSYM(pa_stream_disconnect);
+	CW_PA_ASYNC_DLSYM(pa_stream_unref);
+	CW_PA_ASYNC_DLSYM(pa_operation_unref);
+	CW_PA_ASYNC_DLSYM(pa_bytes_to_usec);
+
+#undef CW_PA_ASYNC_DLSYM
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Open asynchronous PulseAudio stream for given generator
+
+   Function starts a threaded mainloop, connects to PulseAudio server and
+   creates playback stream with explicit, small buffering targets
+   (CW_PA_ASYNC_TLENGTH, CW_PA_ASYNC_MINREQ). Samples are pulled from
+   generator by stream's write callback after the generator is started
+   (see cw_pa_async_start_internal()), or are pushed to the stream with
+   cw_pa_async_write_buffer_internal().
+
+   @param[in,out] gen generator for which to open the stream
+   @param[in] stream_name descriptive name of stream
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pa_async_open_internal(cw_gen_t * gen, const char * stream_name)
+{
+	if (!cw_pa_async_load_library_internal()) {
+		return CW_FAILURE;
+	}
+
+	cw_pa_data_t * pa = &gen->pa_data;
+	pa->spec.format = cw_pa_sample_format_internal(gen->sample_format);
+	pa->spec.rate = 44100; /* Same as in cw_pa_simple_new_internal(). */
+	pa->spec.channels = (uint8_t) gen->n_channels;
+	pa->rendering = false;
+
+	pa->mainloop = CW_PA(pa_threaded_mainloop_new)();
+	if (NULL == pa->mainloop) {
+		return CW_FAILURE;
+	}
+	pa->context = CW_PA(pa_context_new)(CW_PA(pa_threaded_mainloop_get_api)(pa->mainloop), "libcw");
+	if (NULL == pa->context) {
+		CW_PA(pa_threaded_mainloop_free)(pa->mainloop);
+		pa->mainloop = NULL;
+		return CW_FAILURE;
+	}
+	CW_PA(pa_context_set_state_callback)(pa->context, cw_pa_async_context_state_cb, gen);
+
+	CW_PA(pa_threaded_mainloop_lock)(pa->mainloop);
+	if (0 != CW_PA(pa_threaded_mainloop_start)(pa->mainloop)
+	    || 0 != CW_PA(pa_context_connect)(pa->context, NULL, PA_CONTEXT_NOFLAGS, NULL)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "async open: can't connect to PulseAudio server");
+		CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+		cw_pa_async_close_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Wait for connection to server. */
+	pa_context_state_t context_state = PA_CONTEXT_UNCONNECTED;
+	while (true) {
+		context_state = CW_PA(pa_context_get_state)(pa->context);
+		if (PA_CONTEXT_READY == context_state || !PA_CONTEXT_IS_GOOD(context_state)) {
+			break;
+		}
+		CW_PA(pa_threaded_mainloop_wait)(pa->mainloop);
+	}
+	if (PA_CONTEXT_READY != context_state) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "async open: can't connect to PulseAudio server: %s",
+			      CW_PA(pa_strerror)(CW_PA(pa_context_errno)(pa->context)));
+		CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+		cw_pa_async_close_internal(gen);
+		return CW_FAILURE;
+	}
+
+	pa->stream = CW_PA(pa_stream_new)(pa->context, stream_name, &pa->spec, NULL);
+	if (NULL == pa->stream) {
+		CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+		cw_pa_async_close_internal(gen);
+		return CW_FAILURE;
+	}
+	CW_PA(pa_stream_set_state_callback)(pa->stream, cw_pa_async_stream_state_cb, gen);
+	CW_PA(pa_stream_set_write_callback)(pa->stream, cw_pa_async_stream_write_cb, gen);
+
+	pa_buffer_attr attr = { 0 };
+	attr.maxlength = (uint32_t) -1;
+	attr.tlength   = (uint32_t) CW_PA(pa_usec_to_bytes)(CW_PA_ASYNC_TLENGTH, &pa->spec);
+	attr.minreq    = (uint32_t) CW_PA(pa_usec_to_bytes)(CW_PA_ASYNC_MINREQ, &pa->spec);
+	attr.prebuf    = attr.minreq;
+	attr.fragsize  = (uint32_t) -1; /* Not relevant to playback. */
+
+	/* If device name is empty, it means 'use default device'. */
+	const char * dev = ('\0' == gen->picked_device_name[0]) ? NULL : gen->picked_device_name;
+	const pa_stream_flags_t flags = (pa_stream_flags_t) (PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING);
+	if (0 != CW_PA(pa_stream_connect_playback)(pa->stream, dev, &attr, flags, NULL, NULL)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "async open: can't connect playback stream: %s",
+			      CW_PA(pa_strerror)(CW_PA(pa_context_errno)(pa->context)));
+		CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+		cw_pa_async_close_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Wait for the stream to be ready. */
+	pa_stream_state_t stream_state = PA_STREAM_UNCONNECTED;
+	while (true) {
+		stream_state = CW_PA(pa_stream_get_state)(pa->stream);
+		if (PA_STREAM_READY == stream_state || !PA_STREAM_IS_GOOD(stream_state)) {
+			break;
+		}
+		CW_PA(pa_threaded_mainloop_wait)(pa->mainloop);
+	}
+	if (PA_STREAM_READY != stream_state) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "async open: playback stream failed: %s",
+			      CW_PA(pa_strerror)(CW_PA(pa_context_errno)(pa->context)));
+		CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+		cw_pa_async_close_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Server may have adjusted our targets. */
+	const pa_buffer_attr * actual = CW_PA(pa_stream_get_buffer_attr)(pa->stream);
+	if (actual) {
+		pa->latency_usecs = CW_PA(pa_bytes_to_usec)(actual->tlength, &pa->spec);
+		gen->sound_device_latency = (int) pa->latency_usecs;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "async open: tlength = %u, minreq = %u, prebuf = %u [bytes], latency = %d [us]",
+			      actual->tlength, actual->minreq, actual->prebuf, gen->sound_device_latency);
+	}
+	CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+
+	gen->sample_rate = pa->spec.rate;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close asynchronous PulseAudio stream of given generator
+
+   Function can be also used to clean up partially opened stream.
+
+   @param[in,out] gen generator for which to close the stream
+*/
+static void cw_pa_async_close_internal(cw_gen_t * gen)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+
+	if (NULL == pa->mainloop) {
+		return;
+	}
+
+	/* Stop the thread first, callbacks won't be called after this. */
+	CW_PA(pa_threaded_mainloop_stop)(pa->mainloop);
+
+	if (pa->stream) {
+		CW_PA(pa_stream_disconnect)(pa->stream);
+		CW_PA(pa_stream_unref)(pa->stream);
+		pa->stream = NULL;
+	}
+	if (pa->context) {
+		CW_PA(pa_context_disconnect)(pa->context);
+		CW_PA(pa_context_unref)(pa->context);
+		pa->context = NULL;
+	}
+	CW_PA(pa_threaded_mainloop_free)(pa->mainloop);
+	pa->mainloop = NULL;
+	pa->rendering = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Let asynchronous stream pull samples from generator
+
+   @param[in] gen generator with opened asynchronous stream
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t cw_pa_async_start_internal(cw_gen_t * gen)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+
+	CW_PA(pa_threaded_mainloop_lock)(pa->mainloop);
+	pa->rendering = true;
+	/* Server may have been asking for data while nobody was
+	   rendering. Don't wait for next request. */
+	cw_pa_async_fill_internal(gen, CW_PA(pa_stream_writable_size)(pa->stream));
+	CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop pulling samples from generator, drop samples buffered in server
+
+   @param[in] gen generator with opened asynchronous stream
+*/
+static void cw_pa_async_stop_internal(cw_gen_t * gen)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+
+	CW_PA(pa_threaded_mainloop_lock)(pa->mainloop);
+	pa->rendering = false;
+	/* Tone that has been partially rendered belongs to tone queue
+	   that has been flushed. */
+	gen->render.has_tone = false;
+	pa_operation * operation = CW_PA(pa_stream_flush)(pa->stream, NULL, NULL);
+	if (operation) {
+		CW_PA(pa_operation_unref)(operation);
+	}
+	CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Render samples from generator directly into buffer of asynchronous stream
+
+   Must be called with lock of mainloop held.
+
+   @param[in] gen generator from which to render samples
+   @param[in] n_bytes count of bytes requested by server
+*/
+static void cw_pa_async_fill_internal(cw_gen_t * gen, size_t n_bytes)
+{
+	pa_stream * stream = gen->pa_data.stream;
+	const size_t frame_size = cw_gen_frame_size_internal(gen);
+	const bool native = CW_SAMPLE_FORMAT_S16 == gen->sample_format && 1 == gen->n_channels;
+
+	while (n_bytes >= frame_size) {
+		void * data = NULL;
+		size_t size = n_bytes;
+		if (0 != CW_PA(pa_stream_begin_write)(stream, &data, &size) || NULL == data) {
+			break;
+		}
+		size -= size % frame_size;
+		if (0 == size) {
+			break;
+		}
+		if (native) {
+			cw_gen_render_internal(gen, (cw_sample_t *) data, (int) (size / frame_size));
+		} else {
+			/* Render into generator's buffer, convert into stream's buffer. */
+			for (size_t i = 0; i < size / frame_size; ) {
+				const int n = (int) (size / frame_size - i) < gen->buffer_n_samples ? (int) (size / frame_size - i) : gen->buffer_n_samples;
+				cw_gen_render_internal(gen, gen->buffer, n);
+				cw_gen_convert_samples_internal(gen, gen->buffer, n, (char *) data + i * frame_size);
+				i += (size_t) n;
+			}
+		}
+		if (0 != CW_PA(pa_stream_write)(stream, data, size, NULL, 0, PA_SEEK_RELATIVE)) {
+			break;
+		}
+		n_bytes -= size;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write generator's buffer to asynchronous stream
+
+   Used when samples are pushed to the stream instead of being pulled
+   from generator, e.g. by mixer. Function blocks until the server
+   can accept whole buffer.
+
+   @param[in] gen generator with opened asynchronous stream
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_pa_async_write_buffer_internal(cw_gen_t * gen)
+{
+	cw_pa_data_t * pa = &gen->pa_data;
+	size_t n_bytes = 0;
+	const void * samples = cw_gen_get_device_samples_internal(gen, &n_bytes);
+
+	CW_PA(pa_threaded_mainloop_lock)(pa->mainloop);
+	while (CW_PA(pa_stream_writable_size)(pa->stream) < n_bytes) {
+		if (!PA_STREAM_IS_GOOD(CW_PA(pa_stream_get_state)(pa->stream))) {
+			CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+				      MSG_PREFIX "write: stream is in bad state");
+			return CW_FAILURE;
+		}
+		/* Signalled by write callback. */
+		CW_PA(pa_threaded_mainloop_wait)(pa->mainloop);
+	}
+	const int rv = CW_PA(pa_stream_write)(pa->stream, samples, n_bytes, NULL, 0, PA_SEEK_RELATIVE);
+	CW_PA(pa_threaded_mainloop_unlock)(pa->mainloop);
+
+	if (0 != rv) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "write: pa_stream_write() failed: %s", CW_PA(pa_strerror)(rv));
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/* Callback called in mainloop thread when state of context changes. */
+static void cw_pa_async_context_state_cb(__attribute__((unused)) pa_context * context, void * userdata)
+{
+	cw_gen_t * gen = (cw_gen_t *) userdata;
+	CW_PA(pa_threaded_mainloop_signal)(gen->pa_data.mainloop, 0);
+}
+
+
+
+
+/* Callback called in mainloop thread when state of stream changes. */
+static void cw_pa_async_stream_state_cb(__attribute__((unused)) pa_stream * stream, void * userdata)
+{
+	cw_gen_t * gen = (cw_gen_t *) userdata;
+	CW_PA(pa_threaded_mainloop_signal)(gen->pa_data.mainloop, 0);
+}
+
+
+
+
+/* Callback called in mainloop thread when server requests @p n_bytes of samples. */
+static void cw_pa_async_stream_write_cb(__attribute__((unused)) pa_stream * stream, size_t n_bytes, void * userdata)
+{
+	cw_gen_t * gen = (cw_gen_t *) userdata;
+	if (gen->pa_data.rendering) {
+		cw_pa_async_fill_internal(gen, n_bytes);
+	} else {
+		/* Let cw_pa_async_write_buffer_internal() know that
+		   there is free space. */
+		CW_PA(pa_threaded_mainloop_signal)(gen->pa_data.mainloop, 0);
+	}
+}
+
+
+
+
 #else /* #ifdef LIBCW_WITH_PULSEAUDIO */
 
 
@@ -16,13 +16,25 @@
 
 #ifdef LIBCW_WITH_PULSEAUDIO
 
+#include <stdbool.h>
+
 #include <pulse/error.h>
+#include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
 
 typedef struct cw_pa_data_struct {
 	pa_simple * simple;    /* Audio handle. */
 	pa_sample_spec spec;   /* Sample specification. */
 	pa_usec_t latency_usecs;
+
+	/* Asynchronous stream (cw_gen_config_t::pa_async), used instead
+	   of ::simple. Stream's callbacks are called in thread of
+	   ::mainloop, and ::rendering is accessed with lock of the
+	   mainloop held. */
+	pa_threaded_mainloop * mainloop;
+	pa_context * context;
+	pa_stream * stream;
+	bool rendering;        /* Write callback pulls samples from generator. */
 } cw_pa_data_t;
 
 #endif /* #ifdef LIBCW_WITH_PULSEAUDIO */
@@ -0,0 +1,648 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_pipewire.c
+
+   @brief PipeWire sound system (native API).
+
+   libcw creates a PipeWire playback stream. Samples are not pushed to
+   the server by generator's thread: they are rendered from generator's
+   tone queue by stream's process callback, called in PipeWire's
+   realtime data thread, for every cycle of the graph. Size of the cycle
+   (quantum) requested by libcw is CW_PIPEWIRE_QUANTUM samples.
+
+   Name of "device" is a name of target node. With default device name
+   session manager picks the target.
+*/
+
+
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+
+
+#include "config.h"
+#include "libcw_debug.h"
+#include "libcw_pipewire.h"
+
+
+
+
+#define MSG_PREFIX "libcw/pipewire: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+#ifdef LIBCW_WITH_PIPEWIRE
+
+
+
+
+#include <assert.h>
+#include <dlfcn.h> /* dlopen() and related symbols */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw_gen.h"
+#include "libcw_gen_tap.h"
+#include "libcw_utils.h"
+
+
+
+
+/* Sample rate of the stream. This is the default rate of PipeWire's
+   graph, so usually no resampling is done by the server. */
+#define CW_PIPEWIRE_SAMPLE_RATE 48000
+
+/* Requested size of graph's cycle. 256 samples is 5.3 ms. */
+#define CW_PIPEWIRE_QUANTUM 256
+
+/* Time limit for connecting the stream. [s] */
+#define CW_PIPEWIRE_CONNECT_TIMEOUT 2
+
+/* Older versions of PipeWire name the property differently. */
+#ifndef PW_KEY_TARGET_OBJECT
+#define PW_KEY_TARGET_OBJECT PW_KEY_NODE_TARGET
+#endif
+
+
+
+
+typedef struct cw_pipewire_lib_handle_t {
+
+	/* Returned by dlopen(). The library stays loaded until the end of
+	   the process, PipeWire may still be calling into it from its
+	   threads when one of generators is being deleted. */
+	void * lib_handle;
+
+	void    (* pw_init)(int * argc, char ** argv[]);
+
+	struct pw_thread_loop *(* pw_thread_loop_new)(const char * name, const struct spa_dict * props);
+	void    (* pw_thread_loop_destroy)(struct pw_thread_loop * loop);
+	int     (* pw_thread_loop_start)(struct pw_thread_loop * loop);
+	void    (* pw_thread_loop_stop)(struct pw_thread_loop * loop);
+	void    (* pw_thread_loop_lock)(struct pw_thread_loop * loop);
+	void    (* pw_thread_loop_unlock)(struct pw_thread_loop * loop);
+	void    (* pw_thread_loop_signal)(struct pw_thread_loop * loop, bool wait_for_accept);
+	int     (* pw_thread_loop_timed_wait)(struct pw_thread_loop * loop, int wait_max_sec);
+	struct pw_loop *(* pw_thread_loop_get_loop)(struct pw_thread_loop * loop);
+
+	struct pw_context *(* pw_context_new)(struct pw_loop * main_loop, struct pw_properties * props, size_t user_data_size);
+	void    (* pw_context_destroy)(struct pw_context * context);
+	struct pw_core *(* pw_context_connect)(struct pw_context * context, struct pw_properties * properties, size_t user_data_size);
+	int     (* pw_core_disconnect)(struct pw_core * core);
+
+	struct pw_properties *(* pw_properties_new)(const char * key, ...);
+	int     (* pw_properties_set)(struct pw_properties * properties, const char * key, const char * value);
+
+	struct pw_stream *(* pw_stream_new_simple)(struct pw_loop * loop, const char * name, struct pw_properties * props, const struct pw_stream_events * events, void * data);
+	enum pw_stream_state (* pw_stream_get_state)(struct pw_stream * stream, const char ** error);
+	int     (* pw_stream_connect)(struct pw_stream * stream, enum pw_direction direction, uint32_t target_id, enum pw_stream_flags flags, const struct spa_pod ** params, uint32_t n_params);
+	struct pw_buffer *(* pw_stream_dequeue_buffer)(struct pw_stream * stream);
+	int     (* pw_stream_queue_buffer)(struct pw_stream * stream, struct pw_buffer * buffer);
+	int     (* pw_stream_flush)(struct pw_stream * stream, bool drain);
+	void    (* pw_stream_destroy)(struct pw_stream * stream);
+} cw_pipewire_lib_handle_t;
+
+
+static cw_pipewire_lib_handle_t g_cw_pipewire_lib_handle;
+
+
+
+
+static bool     cw_pipewire_load_library_internal(void);
+static int      cw_pipewire_dlsym_internal(cw_pipewire_lib_handle_t * cw_pw);
+static cw_ret_t cw_pipewire_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_pipewire_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_pipewire_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_pipewire_start_internal(cw_gen_t * gen);
+static void     cw_pipewire_stop_internal(cw_gen_t * gen);
+static void     cw_pipewire_state_changed_cb(void * data, enum pw_stream_state old, enum pw_stream_state state, const char * error);
+static void     cw_pipewire_process_cb(void * data);
+
+
+
+
+static const struct pw_stream_events g_cw_pipewire_stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = cw_pipewire_state_changed_cb,
+	.process = cw_pipewire_process_cb,
+};
+
+
+
+
+/**
+   @brief Check if it is possible to open PipeWire output with given device name
+
+   Function first tries to load PipeWire library, and then tries to
+   connect to PipeWire server. The connection is closed before
+   returning.
+
+   @param[in] device_name name of PipeWire target node; if NULL then
+   the function will use library-default device name.
+
+   @return true if connecting to PipeWire server succeeded
+   @return false otherwise
+*/
+bool cw_is_pipewire_possible(__attribute__((unused)) const char * device_name)
+{
+	if (!cw_pipewire_load_library_internal()) {
+		return false;
+	}
+	cw_pipewire_lib_handle_t * cw_pw = &g_cw_pipewire_lib_handle;
+
+	struct pw_thread_loop * loop = cw_pw->pw_thread_loop_new("cw_is_pipewire_possible", NULL);
+	if (NULL == loop) {
+		return false;
+	}
+	bool possible = false;
+	struct pw_context * context = cw_pw->pw_context_new(cw_pw->pw_thread_loop_get_loop(loop), NULL, 0);
+	if (NULL != context) {
+		struct pw_core * core = cw_pw->pw_context_connect(context, NULL, 0);
+		if (NULL != core) {
+			possible = true;
+			cw_pw->pw_core_disconnect(core);
+		} else {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "is possible: can't connect to PipeWire server");
+		}
+		cw_pw->pw_context_destroy(context);
+	}
+	cw_pw->pw_thread_loop_destroy(loop);
+
+	return possible;
+}
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with PipeWire sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with sound system (doesn't try to open or configure it).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_pipewire_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_PIPEWIRE;
+	gen->open_and_configure_sound_device = cw_pipewire_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_pipewire_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_pipewire_write_buffer_to_sound_device_internal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Load PipeWire library, resolve its symbols and initialize it
+
+   The library is loaded only once.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_pipewire_load_library_internal(void)
+{
+	if (NULL != g_cw_pipewire_lib_handle.lib_handle) {
+		return true;
+	}
+
+	if (CW_SUCCESS != cw_dlopen_internal("libpipewire-0.3.so.0", &g_cw_pipewire_lib_handle.lib_handle)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+			      MSG_PREFIX "can't open PipeWire library");
+		return false;
+	}
+
+	const int rv = cw_pipewire_dlsym_internal(&g_cw_pipewire_lib_handle);
+	if (rv < 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to resolve PipeWire symbol #%d, can't correctly load PipeWire library", rv);
+		dlclose(g_cw_pipewire_lib_handle.lib_handle);
+		g_cw_pipewire_lib_handle.lib_handle = NULL;
+		return false;
+	}
+
+	g_cw_pipewire_lib_handle.pw_init(NULL, NULL);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Resolve/get symbols from PipeWire library
+
+   @param[in,out] cw_pw libcw PipeWire data structure with library handle to opened PipeWire library
+
+   @return 0 on success
+   @return negative value on failure
+*/
+static int cw_pipewire_dlsym_internal(cw_pipewire_lib_handle_t * cw_pw)
+{
+#define CW_PIPEWIRE_DLSYM(symbol)					\
+	*(void **) &(cw_pw->symbol) = dlsym(cw_pw->lib_handle, #symbol); \
+	if (!cw_pw->symbol) return -(__LINE__);
+
+	CW_PIPEWIRE_DLSYM(pw_init);
+
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_new);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_destroy);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_start);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_stop);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_lock);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_unlock);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_signal);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_timed_wait);
+	CW_PIPEWIRE_DLSYM(pw_thread_loop_get_loop);
+
+	CW_PIPEWIRE_DLSYM(pw_context_new);
+	CW_PIPEWIRE_DLSYM(pw_context_destroy);
+	CW_PIPEWIRE_DLSYM(pw_context_connect);
+	CW_PIPEWIRE_DLSYM(pw_core_disconnect);
+
+	CW_PIPEWIRE_DLSYM(pw_properties_new);
+	CW_PIPEWIRE_DLSYM(pw_properties_set);
+
+	CW_PIPEWIRE_DLSYM(pw_stream_new_simple);
+	CW_PIPEWIRE_DLSYM(pw_stream_get_state);
+	CW_PIPEWIRE_DLSYM(pw_stream_connect);
+	CW_PIPEWIRE_DLSYM(pw_stream_dequeue_buffer);
+	CW_PIPEWIRE_DLSYM(pw_stream_queue_buffer);
+	CW_PIPEWIRE_DLSYM(pw_stream_flush);
+	CW_PIPEWIRE_DLSYM(pw_stream_destroy);
+
+#undef CW_PIPEWIRE_DLSYM
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Open PipeWire playback stream, associate it with given generator
+
+   @param[in] gen generator
+   @param[in] gen_conf generator's configuration
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_pipewire_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	cw_pipewire_lib_handle_t * cw_pw = &g_cw_pipewire_lib_handle;
+	cw_pipewire_data_t * pw = &gen->pipewire_data;
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	/* PipeWire converts samples to format of the sink, so requested
+	   format is always accepted. */
+	cw_gen_get_requested_sample_format_internal(gen_conf, &gen->sample_format, &gen->n_channels);
+	enum spa_audio_format format = SPA_AUDIO_FORMAT_S16;
+	if (CW_SAMPLE_FORMAT_S32 == gen->sample_format) {
+		format = SPA_AUDIO_FORMAT_S32;
+	} else if (CW_SAMPLE_FORMAT_FLOAT32 == gen->sample_format) {
+		format = SPA_AUDIO_FORMAT_F32;
+	}
+
+	pw->loop = cw_pw->pw_thread_loop_new("libcw", NULL);
+	if (NULL == pw->loop) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't create thread loop");
+		return CW_FAILURE;
+	}
+
+	char latency[32] = { 0 };
+	snprintf(latency, sizeof (latency), "%d/%d", CW_PIPEWIRE_QUANTUM, CW_PIPEWIRE_SAMPLE_RATE);
+	struct pw_properties * props = cw_pw->pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio",
+								 PW_KEY_MEDIA_CATEGORY, "Playback",
+								 PW_KEY_MEDIA_ROLE, "Communication",
+								 PW_KEY_NODE_LATENCY, latency,
+								 NULL);
+	if ('\0' != gen->picked_device_name[0]) {
+		cw_pw->pw_properties_set(props, PW_KEY_TARGET_OBJECT, gen->picked_device_name);
+	}
+
+	pthread_mutex_init(&pw->mutex, NULL);
+	pw->rendering = false;
+
+	cw_pw->pw_thread_loop_lock(pw->loop);
+
+	/* Ownership of props is passed to the stream. */
+	pw->stream = cw_pw->pw_stream_new_simple(cw_pw->pw_thread_loop_get_loop(pw->loop),
+						 gen->library_client.name ? gen->library_client.name : "libcw",
+						 props, &g_cw_pipewire_stream_events, gen);
+	if (NULL == pw->stream) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't create stream");
+		cw_pw->pw_thread_loop_unlock(pw->loop);
+		cw_pipewire_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	uint8_t pod_buffer[1024];
+	struct spa_pod_builder builder = SPA_POD_BUILDER_INIT(pod_buffer, sizeof (pod_buffer));
+	const struct spa_pod * params[1];
+	params[0] = spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat,
+					       &SPA_AUDIO_INFO_RAW_INIT(.format = format,
+									.channels = (uint32_t) gen->n_channels,
+									.rate = CW_PIPEWIRE_SAMPLE_RATE));
+
+	const enum pw_stream_flags flags = (enum pw_stream_flags) (PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS | PW_STREAM_FLAG_RT_PROCESS);
+	if (0 != cw_pw->pw_stream_connect(pw->stream, PW_DIRECTION_OUTPUT, PW_ID_ANY, flags, params, 1)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: can't connect stream");
+		cw_pw->pw_thread_loop_unlock(pw->loop);
+		cw_pipewire_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	if (0 != cw_pw->pw_thread_loop_start(pw->loop)) {
+		cw_pw->pw_thread_loop_unlock(pw->loop);
+		cw_pipewire_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Wait for the stream to be connected. */
+	const char * error = NULL;
+	enum pw_stream_state state = PW_STREAM_STATE_CONNECTING;
+	while (true) {
+		state = cw_pw->pw_stream_get_state(pw->stream, &error);
+		if (PW_STREAM_STATE_PAUSED == state
+		    || PW_STREAM_STATE_STREAMING == state
+		    || PW_STREAM_STATE_ERROR == state) {
+			break;
+		}
+		if (0 != cw_pw->pw_thread_loop_timed_wait(pw->loop, CW_PIPEWIRE_CONNECT_TIMEOUT)) {
+			break;
+		}
+	}
+	cw_pw->pw_thread_loop_unlock(pw->loop);
+
+	if (PW_STREAM_STATE_PAUSED != state && PW_STREAM_STATE_STREAMING != state) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open device: stream has not been connected: %s", error ? error : "timeout");
+		cw_pipewire_close_sound_device_internal(gen);
+		return CW_FAILURE;
+	}
+
+	/* Generator's buffer isn't used by process callback (samples
+	   are rendered directly into stream's buffers), but generator
+	   expects to have one. */
+	gen->sample_rate = CW_PIPEWIRE_SAMPLE_RATE;
+	gen->buffer_n_samples = CW_PIPEWIRE_QUANTUM;
+	/* Buffer of the device: one quantum being played while the next
+	   one is being rendered. */
+	gen->sound_device_latency = (int) (((int64_t) CW_PIPEWIRE_QUANTUM * CW_USECS_PER_SEC) / CW_PIPEWIRE_SAMPLE_RATE);
+
+	gen->start_sound_device = cw_pipewire_start_internal;
+	gen->stop_sound_device = cw_pipewire_stop_internal;
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close PipeWire stream associated with given generator
+
+   Function can be also used to clean up partially opened stream.
+
+   @param[in] gen generator
+*/
+static void cw_pipewire_close_sound_device_internal(cw_gen_t * gen)
+{
+	cw_pipewire_lib_handle_t * cw_pw = &g_cw_pipewire_lib_handle;
+	cw_pipewire_data_t * pw = &gen->pipewire_data;
+
+	if (NULL == pw->loop) {
+		return;
+	}
+
+	/* Stop the thread first, callbacks won't be called after this. */
+	cw_pw->pw_thread_loop_stop(pw->loop);
+	if (pw->stream) {
+		cw_pw->pw_stream_destroy(pw->stream);
+		pw->stream = NULL;
+	}
+	cw_pw->pw_thread_loop_destroy(pw->loop);
+	pw->loop = NULL;
+
+	pthread_mutex_destroy(&pw->mutex);
+	pw->rendering = false;
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Write generator's buffer to PipeWire
+
+   Samples are pulled from generator by stream's process callback,
+   there is no way to push them.
+
+   @param[in] gen generator
+
+   @return CW_FAILURE
+*/
+static cw_ret_t cw_pipewire_write_buffer_to_sound_device_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+		      MSG_PREFIX "write: PipeWire sound system doesn't accept pushed samples");
+	errno = ENOTSUP;
+	return CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Let stream's process callback pull samples from generator
+
+   @param[in] gen generator with open PipeWire stream
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t cw_pipewire_start_internal(cw_gen_t * gen)
+{
+	pthread_mutex_lock(&gen->pipewire_data.mutex);
+	gen->pipewire_data.rendering = true;
+	pthread_mutex_unlock(&gen->pipewire_data.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop pulling samples from generator, drop samples queued in stream
+
+   @param[in] gen generator with open PipeWire stream
+*/
+static void cw_pipewire_stop_internal(cw_gen_t * gen)
+{
+	cw_pipewire_lib_handle_t * cw_pw = &g_cw_pipewire_lib_handle;
+	cw_pipewire_data_t * pw = &gen->pipewire_data;
+
+	pthread_mutex_lock(&pw->mutex);
+	pw->rendering = false;
+	/* Tone that has been partially rendered belongs to tone queue
+	   that has been flushed. */
+	gen->render.has_tone = false;
+	pthread_mutex_unlock(&pw->mutex);
+
+	cw_pw->pw_thread_loop_lock(pw->loop);
+	cw_pw->pw_stream_flush(pw->stream, false);
+	cw_pw->pw_thread_loop_unlock(pw->loop);
+
+	return;
+}
+
+
+
+
+/* Callback called in thread of the loop when state of stream changes. */
+static void cw_pipewire_state_changed_cb(void * data, __attribute__((unused)) enum pw_stream_state old, __attribute__((unused)) enum pw_stream_state state, __attribute__((unused)) const char * error)
+{
+	cw_gen_t * gen = (cw_gen_t *) data;
+	g_cw_pipewire_lib_handle.pw_thread_loop_signal(gen->pipewire_data.loop, false);
+}
+
+
+
+
+/* Callback called in PipeWire's realtime data thread for every cycle of the graph. */
+static void cw_pipewire_process_cb(void * data)
+{
+	cw_gen_t * gen = (cw_gen_t *) data;
+	cw_pipewire_data_t * pw = &gen->pipewire_data;
+
+	struct pw_buffer * pw_buffer = g_cw_pipewire_lib_handle.pw_stream_dequeue_buffer(pw->stream);
+	if (NULL == pw_buffer) {
+		return;
+	}
+	struct spa_data * spa_data = &pw_buffer->buffer->datas[0];
+	char * frames = (char *) spa_data->data;
+	if (NULL == frames) {
+		return;
+	}
+
+	const uint32_t frame_size = (uint32_t) cw_gen_frame_size_internal(gen);
+	uint32_t n_frames = spa_data->maxsize / frame_size;
+	if (pw_buffer->requested > 0 && pw_buffer->requested < n_frames) {
+		n_frames = (uint32_t) pw_buffer->requested;
+	}
+
+	/* Never wait for a thread that isn't realtime. */
+	if (0 == pthread_mutex_trylock(&pw->mutex)) {
+		if (!pw->rendering) {
+			memset(frames, 0, frame_size * n_frames);
+		} else if (CW_SAMPLE_FORMAT_S16 == gen->sample_format && 1 == gen->n_channels) {
+			cw_gen_render_internal(gen, (cw_sample_t *) frames, (int) n_frames);
+			cw_gen_tap_write_internal(gen, (cw_sample_t *) frames, (int) n_frames);
+		} else {
+			/* Render into generator's buffer, convert into stream's buffer. */
+			for (uint32_t i = 0; i < n_frames; ) {
+				const int n = (int) (n_frames - i) < gen->buffer_n_samples ? (int) (n_frames - i) : gen->buffer_n_samples;
+				cw_gen_render_internal(gen, gen->buffer, n);
+				cw_gen_tap_write_internal(gen, gen->buffer, n);
+				cw_gen_convert_samples_internal(gen, gen->buffer, n, frames + i * frame_size);
+				i += (uint32_t) n;
+			}
+		}
+		pthread_mutex_unlock(&pw->mutex);
+	} else {
+		memset(frames, 0, frame_size * n_frames);
+	}
+
+	spa_data->chunk->offset = 0;
+	spa_data->chunk->stride = (int32_t) frame_size;
+	spa_data->chunk->size = n_frames * frame_size;
+	g_cw_pipewire_lib_handle.pw_stream_queue_buffer(pw->stream, pw_buffer);
+}
+
+
+
+
+#else /* #ifdef LIBCW_WITH_PIPEWIRE */
+
+
+
+
+bool cw_is_pipewire_possible(__attribute__((unused)) const char * device_name)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return false;
+}
+
+
+
+
+cw_ret_t cw_pipewire_init_gen_internal(__attribute__((unused)) cw_gen_t * gen)
+{
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "This sound system has been disabled during compilation");
+	return CW_FAILURE;
+}
+
+
+
+
+#endif /* #ifdef LIBCW_WITH_PIPEWIRE */
@@ -0,0 +1,54 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_PIPEWIRE
+#define H_LIBCW_PIPEWIRE
+
+
+
+
+#include "config.h"
+
+
+
+
+#ifdef LIBCW_WITH_PIPEWIRE
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/* Only pointers are stored here, so PipeWire's headers (and their
+   compiler flags) are needed only in libcw_pipewire.c. */
+struct pw_thread_loop;
+struct pw_stream;
+
+typedef struct cw_pipewire_data_struct {
+	struct pw_thread_loop * loop;
+	struct pw_stream * stream;
+
+	/* Samples are rendered by stream's process callback, in
+	   PipeWire's realtime data thread. The callback only tries to lock
+	   the mutex, and outputs silence if it can't, so it never blocks
+	   on libcw threads. ::rendering is protected by the mutex. */
+	pthread_mutex_t mutex;
+	bool rendering;        /* Process callback pulls samples from generator. */
+} cw_pipewire_data_t;
+
+#endif /* #ifdef LIBCW_WITH_PIPEWIRE */
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_pipewire_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_PIPEWIRE */
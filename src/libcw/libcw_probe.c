@@ -0,0 +1,446 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_probe.c
+
+   @brief Detection of sound system for CW_AUDIO_SOUNDCARD.
+
+   Checking if PulseAudio, OSS or ALSA is available means loading
+   their libraries and opening their devices. On machines without
+   PulseAudio server the PulseAudio client may wait for a long time
+   before giving up. The checks are therefore made in parallel, and
+   results of checks that don't finish in CW_PROBE_TIMEOUT are
+   ignored.
+
+   Sound system that has been successfully opened for given device is
+   remembered in a small on-disk cache ($XDG_CACHE_HOME/unixcw/sound_systems,
+   or ~/.cache/unixcw/sound_systems), and is tried first next time.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw_debug.h"
+#include "libcw_probe.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/probe: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Sound systems combined in CW_AUDIO_SOUNDCARD, in order of
+   preference. */
+static const int cw_probe_sound_systems[] = { CW_AUDIO_PA, CW_AUDIO_OSS, CW_AUDIO_ALSA };
+#define CW_PROBE_N_SOUND_SYSTEMS (int) (sizeof (cw_probe_sound_systems) / sizeof (cw_probe_sound_systems[0]))
+
+
+
+
+/* State of parallel probing, shared by caller and probing threads.
+   Threads that don't finish before timeout keep running, so the
+   state is freed by whoever releases it last. */
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int n_refs;
+
+	char device_name[LIBCW_SOUND_DEVICE_NAME_SIZE];
+	bool done[CW_PROBE_N_SOUND_SYSTEMS];
+	bool possible[CW_PROBE_N_SOUND_SYSTEMS];
+} cw_probe_t;
+
+typedef struct {
+	cw_probe_t * probe;
+	int index;
+} cw_probe_thread_arg_t;
+
+
+
+
+static bool cw_probe_is_possible_internal(int sound_system, const char * device_name);
+static void * cw_probe_thread_internal(void * arg);
+static void cw_probe_unref_internal(cw_probe_t * probe);
+static int cw_probe_pick_internal(const cw_probe_t * probe, bool timed_out);
+static cw_ret_t cw_probe_cache_path_internal(char * path, size_t size, bool create_dir);
+
+
+
+
+/**
+   @brief Find sound system that can be used for CW_AUDIO_SOUNDCARD
+
+   PulseAudio, OSS and ALSA are checked in parallel. Available system
+   with highest priority (PulseAudio, OSS, ALSA) is returned, but
+   systems that don't answer in CW_PROBE_TIMEOUT are skipped.
+
+   @param[in] device_name name of device requested by client (may be NULL or empty)
+
+   @return CW_AUDIO_PA, CW_AUDIO_OSS or CW_AUDIO_ALSA on success
+   @return CW_AUDIO_NONE if none of the systems is available
+*/
+int cw_probe_soundcard_internal(const char * device_name)
+{
+	cw_probe_t * probe = (cw_probe_t *) calloc(1, sizeof (cw_probe_t));
+	if (NULL == probe) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return CW_AUDIO_NONE;
+	}
+	pthread_mutex_init(&probe->mutex, NULL);
+	pthread_cond_init(&probe->cond, NULL);
+	probe->n_refs = 1;
+	snprintf(probe->device_name, sizeof (probe->device_name), "%s", device_name ? device_name : "");
+
+	for (int i = 0; i < CW_PROBE_N_SOUND_SYSTEMS; i++) {
+		cw_probe_thread_arg_t * thread_arg = (cw_probe_thread_arg_t *) malloc(sizeof (cw_probe_thread_arg_t));
+		pthread_t thread_id;
+		bool started = false;
+		if (NULL != thread_arg) {
+			thread_arg->probe = probe;
+			thread_arg->index = i;
+			pthread_mutex_lock(&probe->mutex);
+			probe->n_refs++;
+			pthread_mutex_unlock(&probe->mutex);
+			if (0 == pthread_create(&thread_id, NULL, cw_probe_thread_internal, thread_arg)) {
+				pthread_detach(thread_id);
+				started = true;
+			} else {
+				pthread_mutex_lock(&probe->mutex);
+				probe->n_refs--;
+				pthread_mutex_unlock(&probe->mutex);
+				free(thread_arg);
+			}
+		}
+		if (!started) {
+			/* Fall back to checking in this thread. */
+			const bool possible = cw_probe_is_possible_internal(cw_probe_sound_systems[i], probe->device_name);
+			pthread_mutex_lock(&probe->mutex);
+			probe->possible[i] = possible;
+			probe->done[i] = true;
+			pthread_mutex_unlock(&probe->mutex);
+		}
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += CW_PROBE_TIMEOUT / CW_USECS_PER_SEC;
+	deadline.tv_nsec += (CW_PROBE_TIMEOUT % CW_USECS_PER_SEC) * 1000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	int sound_system = CW_AUDIO_NONE;
+	pthread_mutex_lock(&probe->mutex);
+	while (-1 == (sound_system = cw_probe_pick_internal(probe, false))) {
+		if (ETIMEDOUT == pthread_cond_timedwait(&probe->cond, &probe->mutex, &deadline)) {
+			sound_system = cw_probe_pick_internal(probe, true);
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "some sound systems haven't answered in %d ms", CW_PROBE_TIMEOUT / 1000);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&probe->mutex);
+	cw_probe_unref_internal(probe);
+
+	return sound_system;
+}
+
+
+
+
+/**
+   @brief Pick sound system from results of probing
+
+   Must be called with probe's mutex locked.
+
+   @param[in] probe state of probing
+   @param[in] timed_out treat sound systems that haven't answered yet as not available
+
+   @return sound system (or CW_AUDIO_NONE) if decision can be made
+   @return -1 if decision depends on sound system that hasn't answered yet
+*/
+static int cw_probe_pick_internal(const cw_probe_t * probe, bool timed_out)
+{
+	for (int i = 0; i < CW_PROBE_N_SOUND_SYSTEMS; i++) {
+		if (!probe->done[i]) {
+			if (!timed_out) {
+				return -1;
+			}
+			continue;
+		}
+		if (probe->possible[i]) {
+			return cw_probe_sound_systems[i];
+		}
+	}
+	return CW_AUDIO_NONE;
+}
+
+
+
+
+/**
+   @brief Check if given sound system is available
+
+   @param[in] sound_system CW_AUDIO_PA, CW_AUDIO_OSS or CW_AUDIO_ALSA
+   @param[in] device_name name of device (may be empty)
+
+   @return true if the sound system can be used
+   @return false otherwise
+*/
+static bool cw_probe_is_possible_internal(int sound_system, const char * device_name)
+{
+	switch (sound_system) {
+	case CW_AUDIO_PA:
+		return cw_is_pa_possible(device_name);
+	case CW_AUDIO_OSS:
+		return cw_is_oss_possible(device_name);
+	case CW_AUDIO_ALSA:
+		return cw_is_alsa_possible(device_name);
+	default:
+		return false;
+	}
+}
+
+
+
+
+/* Thread function: check one sound system, publish result. */
+static void * cw_probe_thread_internal(void * arg)
+{
+	cw_probe_thread_arg_t * thread_arg = (cw_probe_thread_arg_t *) arg;
+	cw_probe_t * probe = thread_arg->probe;
+	const int i = thread_arg->index;
+	free(thread_arg);
+
+	const bool possible = cw_probe_is_possible_internal(cw_probe_sound_systems[i], probe->device_name);
+
+	pthread_mutex_lock(&probe->mutex);
+	probe->possible[i] = possible;
+	probe->done[i] = true;
+	pthread_cond_broadcast(&probe->cond);
+	pthread_mutex_unlock(&probe->mutex);
+
+	cw_probe_unref_internal(probe);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Release reference to state of probing, free the state with last reference
+
+   @param[in] probe state of probing
+*/
+static void cw_probe_unref_internal(cw_probe_t * probe)
+{
+	pthread_mutex_lock(&probe->mutex);
+	const int n_refs = --probe->n_refs;
+	pthread_mutex_unlock(&probe->mutex);
+
+	if (0 == n_refs) {
+		pthread_cond_destroy(&probe->cond);
+		pthread_mutex_destroy(&probe->mutex);
+		free(probe);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get sound system that has been successfully used with given device
+
+   @param[in] device_name name of device requested by client (may be NULL or empty)
+
+   @return CW_AUDIO_PA, CW_AUDIO_OSS or CW_AUDIO_ALSA if cache has an entry for the device
+   @return CW_AUDIO_NONE otherwise
+*/
+int cw_probe_cache_read_internal(const char * device_name)
+{
+	char path[PATH_MAX] = { 0 };
+	if (CW_SUCCESS != cw_probe_cache_path_internal(path, sizeof (path), false)) {
+		return CW_AUDIO_NONE;
+	}
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		return CW_AUDIO_NONE;
+	}
+
+	/* Each line: label of sound system, tab, name of device. */
+	int sound_system = CW_AUDIO_NONE;
+	char line[LIBCW_SOUND_DEVICE_NAME_SIZE + 32];
+	while (CW_AUDIO_NONE == sound_system && NULL != fgets(line, sizeof (line), file)) {
+		line[strcspn(line, "\n")] = '\0';
+		char * tab = strchr(line, '\t');
+		if (NULL == tab) {
+			continue;
+		}
+		*tab = '\0';
+		if (0 != strcmp(tab + 1, device_name ? device_name : "")) {
+			continue;
+		}
+		for (int i = 0; i < CW_PROBE_N_SOUND_SYSTEMS; i++) {
+			if (0 == strcmp(line, cw_get_audio_system_label(cw_probe_sound_systems[i]))) {
+				sound_system = cw_probe_sound_systems[i];
+				break;
+			}
+		}
+	}
+	fclose(file);
+
+	return sound_system;
+}
+
+
+
+
+/**
+   @brief Remember sound system that has been successfully used with given device
+
+   Errors are ignored: without the cache the sound system will be just
+   probed again next time.
+
+   @param[in] device_name name of device requested by client (may be NULL or empty)
+   @param[in] sound_system CW_AUDIO_PA, CW_AUDIO_OSS or CW_AUDIO_ALSA
+*/
+void cw_probe_cache_write_internal(const char * device_name, int sound_system)
+{
+	if (NULL == device_name) {
+		device_name = "";
+	}
+	if (sound_system == cw_probe_cache_read_internal(device_name)) {
+		return;
+	}
+
+	char path[PATH_MAX] = { 0 };
+	if (CW_SUCCESS != cw_probe_cache_path_internal(path, sizeof (path), true)) {
+		return;
+	}
+	char tmp_path[PATH_MAX + 8] = { 0 };
+	snprintf(tmp_path, sizeof (tmp_path), "%s.tmp", path);
+
+	FILE * tmp = fopen(tmp_path, "w");
+	if (NULL == tmp) {
+		return;
+	}
+	fprintf(tmp, "%s\t%s\n", cw_get_audio_system_label(sound_system), device_name);
+
+	/* Keep entries of other devices, newest first. */
+	FILE * file = fopen(path, "r");
+	if (NULL != file) {
+		char line[LIBCW_SOUND_DEVICE_NAME_SIZE + 32];
+		int n_entries = 1;
+		while (n_entries < CW_PROBE_CACHE_N_ENTRIES && NULL != fgets(line, sizeof (line), file)) {
+			line[strcspn(line, "\n")] = '\0';
+			const char * tab = strchr(line, '\t');
+			if (NULL == tab || 0 == strcmp(tab + 1, device_name)) {
+				continue;
+			}
+			fprintf(tmp, "%s\n", line);
+			n_entries++;
+		}
+		fclose(file);
+	}
+
+	if (0 != fclose(tmp) || 0 != rename(tmp_path, path)) {
+		remove(tmp_path);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get path to on-disk cache of probe results
+
+   @param[out] path buffer for path
+   @param[in] size size of @p path
+   @param[in] create_dir create directories of the path if they don't exist
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if location of cache can't be determined
+*/
+static cw_ret_t cw_probe_cache_path_internal(char * path, size_t size, bool create_dir)
+{
+	char dir[PATH_MAX] = { 0 };
+	const char * xdg = getenv("XDG_CACHE_HOME");
+	const char * home = getenv("HOME");
+	if (NULL != xdg && '\0' != xdg[0]) {
+		snprintf(dir, sizeof (dir), "%s", xdg);
+	} else if (NULL != home && '\0' != home[0]) {
+		snprintf(dir, sizeof (dir), "%s/.cache", home);
+	} else {
+		return CW_FAILURE;
+	}
+
+	if (create_dir) {
+		mkdir(dir, 0700);
+	}
+	const size_t len = strlen(dir);
+	snprintf(dir + len, sizeof (dir) - len, "/unixcw");
+	if (create_dir) {
+		mkdir(dir, 0700);
+	}
+
+	const int n = snprintf(path, size, "%s/sound_systems", dir);
+	if (n < 0 || (size_t) n >= size) {
+		return CW_FAILURE;
+	}
+	return CW_SUCCESS;
+}
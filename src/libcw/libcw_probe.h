@@ -0,0 +1,36 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_PROBE
+#define H_LIBCW_PROBE
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* How long to wait for results of probing of sound systems before
+   giving up on systems that haven't answered yet, e.g. PulseAudio
+   client waiting for a server that doesn't exist. [microseconds] */
+#define CW_PROBE_TIMEOUT 1500000
+
+/* Maximal count of devices remembered in on-disk cache of probe
+   results. */
+#define CW_PROBE_CACHE_N_ENTRIES 16
+
+
+
+
+int cw_probe_soundcard_internal(const char * device_name);
+int cw_probe_cache_read_internal(const char * device_name);
+void cw_probe_cache_write_internal(const char * device_name, int sound_system);
+
+
+
+
+#endif /* #ifndef H_LIBCW_PROBE */
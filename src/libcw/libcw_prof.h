@@ -0,0 +1,55 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_PROF
+#define H_LIBCW_PROF
+
+
+
+
+#include "config.h"
+
+
+
+
+/*
+  Support for sampling profilers (perf, VTune), enabled with
+  --enable-profiling.
+
+  CW_PROF_HOT is put in front of definitions of functions on hot paths
+  of libcw. Such functions are never inlined, so that their CPU time
+  is attributed to them, and not to their callers.
+
+  CW_PROF_MARK(name) is a static probe (USDT) marking beginning or end
+  of a hot path. The probe is a single "nop" instruction, it can be
+  enabled e.g. with "perf probe sdt_libcw:name" or used in bpftrace.
+  The probe is available only when <sys/sdt.h> is installed.
+*/
+
+
+
+
+#if defined(LIBCW_WITH_PROFILING)
+
+#define CW_PROF_HOT __attribute__((noinline))
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+#define CW_PROF_MARK(name) DTRACE_PROBE(libcw, name)
+#else
+#define CW_PROF_MARK(name) {}
+#endif
+
+#else
+
+#define CW_PROF_HOT
+#define CW_PROF_MARK(name) {}
+
+#endif /* #if defined(LIBCW_WITH_PROFILING) */
+
+
+
+
+#endif /* #ifndef H_LIBCW_PROF */
@@ -62,6 +62,7 @@
 #include <errno.h>
 #include <limits.h> /* INT_MAX, for clang. */
 #include <math.h>  /* sqrtf(), cosf() */
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/time.h> /* struct timeval */
@@ -92,6 +93,10 @@
 #include "libcw_key.h"
 #include "libcw_rec.h"
 #include "libcw_rec_internal.h"
+#include "libcw_scheduler.h"
+#include "libcw_prof.h"
+#include "libcw_timing.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 
 
@@ -128,6 +133,62 @@ static const char * cw_receiver_states[] = {
 static void cw_rec_update_average_internal(cw_rec_averaging_t * avg, int mark_duration);
 static void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mark);
 static void cw_rec_reset_average_internal(cw_rec_averaging_t * avg, int initial);
+static void cw_rec_sync_adaptive_parameters_internal(cw_rec_t * rec);
+static void cw_rec_apply_parameters_internal(cw_rec_t * rec, const cw_rec_parameters_t * parameters);
+
+static void cw_rec_append_mark_internal(cw_rec_t * rec, char mark, int mark_duration);
+static void cw_rec_metrics_count_internal(uint64_t * counter);
+static void cw_rec_metrics_end_of_character_internal(cw_rec_t * rec, int latency);
+static unsigned int cw_rec_representation_hash_internal(const cw_rec_t * rec);
+
+/* Functions for soft-decision decoding of characters. */
+static void cw_rec_identify_mark_soft_internal(cw_rec_t * rec, int mark_duration, char * mark);
+static float cw_rec_mark_cost_internal(const cw_rec_t * rec, int mark_duration, char mark);
+static int cw_rec_soft_decode_internal(const cw_rec_t * rec);
+
+/* Functions handling timestamps on receiver's timeline. */
+static cw_ret_t cw_rec_timestamp_to_usecs_internal(const struct timeval * timestamp, int64_t * usecs);
+static int cw_rec_duration_internal(int64_t earlier, int64_t later);
+
+static cw_ret_t cw_rec_mark_begin_internal(cw_rec_t * rec, int64_t timestamp);
+static cw_ret_t cw_rec_mark_end_internal(cw_rec_t * rec, int64_t timestamp);
+static cw_ret_t cw_rec_add_mark_internal(cw_rec_t * rec, int64_t timestamp, char mark);
+static bool cw_rec_edge_is_mark_internal(const cw_rec_t * rec, const cw_rec_edge_t * edge);
+static void cw_rec_batch_collect_internal(cw_rec_t * rec, int64_t timestamp);
+static void cw_rec_batch_append_internal(cw_rec_t * rec, char character, int64_t timestamp);
+static cw_ret_t cw_rec_poll_representation_internal(cw_rec_t * rec, int64_t timestamp, char * representation, bool * is_end_of_word, bool * is_error);
+static cw_ret_t cw_rec_poll_character_internal(cw_rec_t * rec, int64_t timestamp, char * character, bool * is_end_of_word, bool * is_error);
+static cw_ret_t cw_rec_push_edge_internal(cw_rec_t * rec, int64_t timestamp, bool is_mark_begin);
+static int64_t cw_rec_consume_edges_internal(cw_rec_t * rec, int64_t timestamp);
+
+
+
+
+/* Functions calling callbacks of receivers at deadlines served by
+   library's scheduler (see cw_rec_register_character_callback()). */
+
+/* Character or inter-word-space to be passed to receiver's callback. */
+typedef struct {
+	char character;
+	bool is_end_of_word;
+	bool is_error;
+} cw_rec_callback_event_t;
+
+/* Protects state of receivers with registered callbacks, which is
+   accessed by scheduler thread. */
+static pthread_mutex_t g_cw_rec_callback_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Maximal count of queued edges passed to receiver by one call of
+   receiver's deadline callback, so that the scheduler thread doesn't
+   delay deadlines of other receivers. */
+#define CW_REC_EDGE_QUEUE_CONSUME_MAX 32
+
+static void cw_rec_deadline_callback_internal(void * arg);
+static cw_ret_t cw_rec_mark_begin_locked_internal(cw_rec_t * rec, int64_t timestamp, cw_rec_callback_event_t * events, int * n_events);
+static int cw_rec_consume_edges_locked_internal(cw_rec_t * rec, cw_rec_callback_event_t * events);
+static int cw_rec_poll_deadline_internal(cw_rec_t * rec, int64_t now, cw_rec_callback_event_t * events);
+static void cw_rec_update_deadline_internal(cw_rec_t * rec);
+static void cw_rec_call_callback_internal(cw_rec_character_callback_t callback, void * callback_arg, const cw_rec_callback_event_t * events, int n_events);
 
 
 
@@ -204,6 +265,12 @@ void cw_rec_delete(cw_rec_t ** rec)
 		return;
 	}
 
+	if (NULL != (*rec)->character_callback) {
+		cw_rec_register_character_callback(*rec, NULL, NULL);
+	}
+
+	cw_timing_release_internal(&(*rec)->timing);
+
 	free(*rec);
 	*rec = (cw_rec_t *) NULL;
 
@@ -448,6 +515,219 @@ cw_ret_t cw_rec_set_noise_spike_threshold(cw_rec_t * rec, int new_value)
 
 
 
+/**
+   @brief Set estimator of durations of Dots and Dashes in adaptive mode
+
+   In adaptive receiving mode receiver tracks speed of incoming Morse
+   code with averaged durations of last @p window Dots and last
+   @p window Dashes. Default is moving average of
+   CW_REC_AVERAGING_DURATIONS_COUNT Marks. On noisy or fading signals
+   longer window, exponential average or median make the tracking
+   steadier, at the cost of slower reaction to changes of speed.
+
+   For CW_REC_AVERAGING_EXPONENTIAL @p window sets the weight of new
+   Mark: 2 / (@p window + 1).
+
+   Averages are restarted from current Dot and Dash durations.
+
+   @exception EINVAL @p mode or @p window is out of range.
+
+   @param[in,out] rec receiver
+   @param[in] mode type of estimator
+   @param[in] window count of Marks used by estimator, 1 to CW_REC_AVERAGING_WINDOW_MAX
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_set_averaging(cw_rec_t * rec, cw_rec_averaging_mode_t mode, int window)
+{
+	if (window < 1 || window > CW_REC_AVERAGING_WINDOW_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (CW_REC_AVERAGING_MOVING != mode
+	    && CW_REC_AVERAGING_EXPONENTIAL != mode
+	    && CW_REC_AVERAGING_MEDIAN != mode) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_sync_parameters_internal(rec);
+
+	rec->dot_averaging.mode = mode;
+	rec->dot_averaging.window = window;
+	rec->dash_averaging.mode = mode;
+	rec->dash_averaging.window = window;
+	cw_rec_reset_average_internal(&rec->dot_averaging, rec->dot_duration_ideal);
+	cw_rec_reset_average_internal(&rec->dash_averaging, rec->dash_duration_ideal);
+	/* Reset doesn't touch averages themselves, so that first Mark
+	   received after enabling adaptive mode moves the threshold as
+	   it always did. Here averages start from current durations. */
+	rec->dot_averaging.average = rec->dot_duration_ideal;
+	rec->dash_averaging.average = rec->dash_duration_ideal;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Enable or disable soft-decision decoding of characters
+
+   By default receiver makes hard decision about each Mark: a Mark
+   that doesn't fit into duration ranges of Dot and Dash puts receiver
+   into error state, and a representation that doesn't match any
+   character is dropped by cw_rec_poll_character().
+
+   With soft decision enabled, a Mark outside of both ranges is taken
+   as the closer of Dot and Dash (on logarithmic scale), and receiver
+   stays out of error state. Durations of Marks are retained, and when
+   a representation doesn't match any character, cw_rec_poll_character()
+   returns the character whose representation has the same count of
+   Marks and is the most likely one given the durations.
+
+   @param[in,out] rec receiver
+   @param[in] soft_decision whether to enable soft-decision decoding
+*/
+void cw_rec_set_soft_decision(cw_rec_t * rec, bool soft_decision)
+{
+	rec->is_soft_decision = soft_decision;
+}
+
+
+
+
+/**
+   @brief Seed receiver with timing of a station
+
+   Receiver in adaptive mode needs a few Marks to converge on speed of
+   a new transmission, and the first characters are often lost. With
+   profile of the station saved earlier (see cw_rec_get_profile()),
+   averages of Dots and Dashes start at the station's durations, and
+   speed, tolerance and gap are set from the profile, so the receiver
+   is locked on the station from the first character.
+
+   In fixed speed mode speed is set to the closest integer speed.
+
+   @exception EINVAL durations in @p profile are not positive, Dash is not longer than Dot, or tolerance is out of range
+
+   @param[in,out] rec receiver
+   @param[in] profile timing of station
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_set_profile(cw_rec_t * rec, const cw_rec_profile_t * profile)
+{
+	int unit_duration = 0;
+	if (CW_SUCCESS != cw_rec_profile_unit_internal(profile, &unit_duration)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Inter-character-space is 3 Units plus gap. */
+	int gap = (profile->ics_duration - 3 * unit_duration + unit_duration / 2) / unit_duration;
+	gap = gap < CW_GAP_MIN ? CW_GAP_MIN : (gap > CW_GAP_MAX ? CW_GAP_MAX : gap);
+
+	rec->tolerance = profile->tolerance;
+	rec->gap = gap;
+	rec->parameters_in_sync = false;
+
+	if (rec->is_adaptive_receive_mode) {
+		cw_rec_reset_average_internal(&rec->dot_averaging, profile->dot_duration);
+		cw_rec_reset_average_internal(&rec->dash_averaging, profile->dash_duration);
+		rec->dot_averaging.average = profile->dot_duration;
+		rec->dash_averaging.average = profile->dash_duration;
+
+		/* See cw_rec_update_averages_internal(). */
+		rec->adaptive_speed_threshold = (profile->dash_duration - profile->dot_duration) / 2 + profile->dot_duration;
+		rec->speed = CW_DOT_CALIBRATION / ((float) rec->adaptive_speed_threshold / 2.0F);
+		cw_rec_sync_adaptive_parameters_internal(rec);
+	} else {
+		rec->speed = (float) cw_rec_profile_speed_internal(unit_duration);
+		cw_rec_sync_parameters_internal(rec);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_rec_get_profile(const cw_rec_t * rec, cw_rec_profile_t * profile)
+{
+	if (NULL == rec || NULL == profile) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_statistics_t statistics;
+	cw_rec_get_statistics(rec, &statistics);
+
+	if (rec->is_adaptive_receive_mode) {
+		profile->dot_duration = rec->dot_averaging.average;
+		profile->dash_duration = rec->dash_averaging.average;
+	} else {
+		profile->dot_duration = rec->dot_duration_ideal + (int32_t) lroundf(statistics.dot.mean_delta);
+		profile->dash_duration = rec->dash_duration_ideal + (int32_t) lroundf(statistics.dash.mean_delta);
+	}
+	profile->ims_duration = rec->ims_duration_ideal + (int32_t) lroundf(statistics.inter_mark_space.mean_delta);
+	profile->ics_duration = rec->ics_duration_ideal + (int32_t) lroundf(statistics.inter_character_space.mean_delta);
+	profile->tolerance = rec->tolerance;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get duration of Unit of station from its profile
+
+   Unit is average of duration of Dot and of one third of duration of
+   Dash.
+
+   @param[in] profile timing of station (may be NULL)
+   @param[out] unit_duration duration of Unit [microseconds]
+
+   @return CW_SUCCESS if @p profile is valid
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_profile_unit_internal(const cw_rec_profile_t * profile, int * unit_duration)
+{
+	if (NULL == profile
+	    || profile->dot_duration <= 0
+	    || profile->dash_duration <= profile->dot_duration
+	    || profile->ims_duration <= 0
+	    || profile->ics_duration <= 0
+	    || profile->tolerance < CW_TOLERANCE_MIN || profile->tolerance > CW_TOLERANCE_MAX) {
+		return CW_FAILURE;
+	}
+
+	*unit_duration = (profile->dot_duration + profile->dash_duration / 3) / 2;
+	return *unit_duration > 0 ? CW_SUCCESS : CW_FAILURE;
+}
+
+
+
+
+/**
+   @brief Get integer speed closest to given duration of Unit
+
+   @param[in] unit_duration duration of Unit [microseconds]
+
+   @return speed in range CW_SPEED_MIN - CW_SPEED_MAX [wpm]
+*/
+int cw_rec_profile_speed_internal(int unit_duration)
+{
+	const long speed = lroundf((float) CW_DOT_CALIBRATION / (float) unit_duration);
+	return speed < CW_SPEED_MIN ? CW_SPEED_MIN : (speed > CW_SPEED_MAX ? CW_SPEED_MAX : (int) speed);
+}
+
+
+
+
 /**
    @brief Get receiver's noise spike threshold
 
@@ -520,11 +800,17 @@ cw_ret_t cw_rec_set_gap(cw_rec_t * rec, int new_value)
 */
 void cw_rec_reset_average_internal(cw_rec_averaging_t * avg, int initial)
 {
-	for (int i = 0; i < CW_REC_AVERAGING_DURATIONS_COUNT; i++) {
+	if (0 == avg->window) {
+		/* Receivers are allocated with zeroed memory. */
+		avg->window = CW_REC_AVERAGING_DURATIONS_COUNT;
+	}
+
+	for (int i = 0; i < CW_REC_AVERAGING_WINDOW_MAX; i++) {
 		avg->buffer[i] = initial;
 	}
 
-	avg->sum = initial * CW_REC_AVERAGING_DURATIONS_COUNT;
+	avg->sum = initial * avg->window;
+	avg->ewma = (float) initial;
 	avg->cursor = 0;
 
 	return;
@@ -532,7 +818,6 @@ void cw_rec_reset_average_internal(cw_rec_averaging_t * avg, int initial)
 
 
 
-
 /**
    @brief Update value of average "duration of mark"
 
@@ -559,17 +844,41 @@ void cw_rec_update_average_internal(cw_rec_averaging_t * avg, int mark_duration)
 	avg->sum -= avg->buffer[avg->cursor];
 	avg->sum += mark_duration;
 
-	avg->average = avg->sum / CW_REC_AVERAGING_DURATIONS_COUNT;
-
 	avg->buffer[avg->cursor++] = mark_duration;
-	avg->cursor %= CW_REC_AVERAGING_DURATIONS_COUNT;
+	avg->cursor %= avg->window;
+
+	switch (avg->mode) {
+	case CW_REC_AVERAGING_EXPONENTIAL:
+		avg->ewma += (2.0F / (float) (avg->window + 1)) * ((float) mark_duration - avg->ewma);
+		avg->average = (int) lroundf(avg->ewma);
+		break;
+	case CW_REC_AVERAGING_MEDIAN:
+		{
+			/* Insertion sort of a copy: the window is short. */
+			int sorted[CW_REC_AVERAGING_WINDOW_MAX];
+			for (int i = 0; i < avg->window; i++) {
+				int j = i;
+				for (; j > 0 && sorted[j - 1] > avg->buffer[i]; j--) {
+					sorted[j] = sorted[j - 1];
+				}
+				sorted[j] = avg->buffer[i];
+			}
+			avg->average = (avg->window % 2)
+				? sorted[avg->window / 2]
+				: (sorted[avg->window / 2 - 1] + sorted[avg->window / 2]) / 2;
+		}
+		break;
+	case CW_REC_AVERAGING_MOVING:
+	default:
+		avg->average = avg->sum / avg->window;
+		break;
+	}
 
 	return;
 }
 
 
 
-
 /**
    @brief Add a Mark or Space duration to statistics
 
@@ -614,6 +923,22 @@ void cw_rec_duration_stats_update_internal(cw_rec_t * rec, stat_type_t type, int
 	}
 	const int duration_delta = duration - ideal;
 
+	/* Evict from running totals the oldest record that is about to
+	   be overwritten. */
+	const cw_rec_duration_stats_point_t * oldest = &rec->duration_stats[rec->duration_stats_idx];
+	if (CW_REC_STAT_NONE != oldest->type) {
+		cw_rec_duration_stats_totals_t * totals = &rec->duration_stats_totals[oldest->type];
+		totals->sum -= oldest->duration_delta;
+		totals->sum_of_squares -= (int64_t) oldest->duration_delta * oldest->duration_delta;
+		totals->count--;
+	}
+	if (CW_REC_STAT_NONE != type) {
+		cw_rec_duration_stats_totals_t * totals = &rec->duration_stats_totals[type];
+		totals->sum += duration_delta;
+		totals->sum_of_squares += (int64_t) duration_delta * duration_delta;
+		totals->count++;
+	}
+
 	/* Add this statistic to the buffer. */
 	rec->duration_stats[rec->duration_stats_idx].type = type;
 	rec->duration_stats[rec->duration_stats_idx].duration_delta = duration_delta;
@@ -658,23 +983,14 @@ cw_ret_t cw_rec_duration_stats_get_internal(const cw_rec_t * rec, stat_type_t ty
 
 	/* TODO: some locking of statistics with mutex? */
 
-	/* Sum and count values for marks/spaces matching the given
-	   type.  A cleared buffer always begins refilling at zeroth
-	   mark, so to optimize we can stop on the first unoccupied
-	   slot in the circular buffer. */
-	int sum_of_squares = 0;
-	int count = 0;
-	for (int i = 0; i < CW_REC_DURATION_STATS_CAPACITY; i++) {
-		if (rec->duration_stats[i].type == type) {
-			const int duration_delta = rec->duration_stats[i].duration_delta;
-			sum_of_squares += (duration_delta * duration_delta);
-			count++;
-		} else if (rec->duration_stats[i].type == CW_REC_STAT_NONE) {
-			break;
-		} else {
-			; /* A type of statistics that we are not interested in. Continue. */
-		}
+	/* Totals are maintained by cw_rec_duration_stats_update_internal(),
+	   so there is no need to scan the circular buffer. */
+	if (type <= CW_REC_STAT_NONE || (int) type >= (int) CW_REC_STAT_TYPES_COUNT) {
+		*result = 0.0F;
+		return CW_SUCCESS;
 	}
+	const int64_t sum_of_squares = rec->duration_stats_totals[type].sum_of_squares;
+	const int count = rec->duration_stats_totals[type].count;
 
 	if (0 == count) {
 		*result = 0.0F;
@@ -741,6 +1057,137 @@ void cw_rec_get_statistics_internal(const cw_rec_t * rec, float * dot_sd, float
 
 
 
+/**
+   @brief Get receiver's timing statistics
+
+   Get counts of received Dots, Dashes, inter-mark-spaces and
+   inter-character-spaces, and mean and root mean square of
+   differences between their received and ideal durations. Statistics
+   are held for last 256 received Marks and Spaces. Ideal durations
+   are those at receive speed valid at the moment of receiving given
+   Mark or Space.
+
+   Running totals of the statistics are maintained while receiving,
+   so the function is cheap enough to be called after each received
+   character.
+
+   @exception EINVAL @p rec or @p statistics is NULL
+
+   @param[in] rec receiver from which to get statistics
+   @param[out] statistics statistics of receiver
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_get_statistics(const cw_rec_t * rec, cw_rec_statistics_t * statistics)
+{
+	if (NULL == rec || NULL == statistics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	const stat_type_t types[] = { CW_REC_STAT_DOT, CW_REC_STAT_DASH, CW_REC_STAT_INTER_MARK_SPACE, CW_REC_STAT_INTER_CHARACTER_SPACE };
+	cw_rec_duration_statistics_t * results[] = { &statistics->dot, &statistics->dash, &statistics->inter_mark_space, &statistics->inter_character_space };
+
+	for (size_t i = 0; i < sizeof (types) / sizeof (types[0]); i++) {
+		const cw_rec_duration_stats_totals_t * totals = &rec->duration_stats_totals[types[i]];
+		results[i]->count = totals->count;
+		if (0 == totals->count) {
+			results[i]->mean_delta = 0.0F;
+		} else {
+			results[i]->mean_delta = (float) totals->sum / (float) totals->count;
+		}
+		cw_rec_duration_stats_get_internal(rec, types[i], &results[i]->sd);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_rec_get_metrics(const cw_rec_t * rec, cw_rec_metrics_t * metrics)
+{
+	if (NULL == rec || NULL == metrics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	metrics->n_marks_accepted = __atomic_load_n(&rec->metrics.n_marks_accepted, __ATOMIC_RELAXED);
+	metrics->n_spikes_rejected = __atomic_load_n(&rec->metrics.n_spikes_rejected, __ATOMIC_RELAXED);
+	metrics->n_marks_unrecognized = __atomic_load_n(&rec->metrics.n_marks_unrecognized, __ATOMIC_RELAXED);
+	metrics->n_representations_unrecognized = __atomic_load_n(&rec->metrics.n_representations_unrecognized, __ATOMIC_RELAXED);
+	metrics->n_buffer_overflows = __atomic_load_n(&rec->metrics.n_buffer_overflows, __ATOMIC_RELAXED);
+	metrics->n_speed_changes = __atomic_load_n(&rec->metrics.n_speed_changes, __ATOMIC_RELAXED);
+	metrics->n_characters = __atomic_load_n(&rec->metrics.n_characters, __ATOMIC_RELAXED);
+	for (int i = 0; i < CW_REC_LATENCY_HISTOGRAM_N_BINS; i++) {
+		metrics->decode_latency[i] = __atomic_load_n(&rec->metrics.decode_latency[i], __ATOMIC_RELAXED);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_rec_export_metrics(const cw_rec_t * rec, const char * labels, cw_metrics_write_callback_t callback_func, void * callback_arg)
+{
+	if (NULL == rec || NULL == callback_func) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_metrics_t metrics;
+	cw_rec_get_metrics(rec, &metrics);
+
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_marks_accepted", "counter",
+					 "Marks identified as Dots or Dashes.", labels,
+					 (double) metrics.n_marks_accepted);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_spikes_rejected", "counter",
+					 "Marks rejected as noise spikes.", labels,
+					 (double) metrics.n_spikes_rejected);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_marks_unrecognized", "counter",
+					 "Marks that were neither Dots nor Dashes.", labels,
+					 (double) metrics.n_marks_unrecognized);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_representations_unrecognized", "counter",
+					 "Representations that didn't match any character.", labels,
+					 (double) metrics.n_representations_unrecognized);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_buffer_overflows", "counter",
+					 "Representations that didn't fit in buffer of receiver.", labels,
+					 (double) metrics.n_buffer_overflows);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_speed_changes", "counter",
+					 "Changes of speed made in adaptive mode.", labels,
+					 (double) metrics.n_speed_changes);
+	cw_metrics_write_family_internal(callback_func, callback_arg, "cw_rec_characters", "counter",
+					 "Characters whose end has been recognized.", labels,
+					 (double) metrics.n_characters);
+
+	/* Upper bound of first bin is 25 ms, each next bin is twice as
+	   wide. Last bin has no upper bound. */
+	const char * header = "# TYPE cw_rec_decode_latency_seconds histogram\n"
+		"# HELP cw_rec_decode_latency_seconds Time from end of last Mark of a character to recognition of end of the character.\n";
+	callback_func(callback_arg, header, strlen(header));
+	uint64_t cumulative = 0;
+	double upper_bound = 0.025;
+	for (int i = 0; i < CW_REC_LATENCY_HISTOGRAM_N_BINS; i++) {
+		cumulative += metrics.decode_latency[i];
+		char le[32];
+		if (i == CW_REC_LATENCY_HISTOGRAM_N_BINS - 1) {
+			snprintf(le, sizeof (le), "le=\"+Inf\"");
+		} else {
+			snprintf(le, sizeof (le), "le=\"%g\"", upper_bound);
+		}
+		cw_metrics_write_sample_internal(callback_func, callback_arg, "cw_rec_decode_latency_seconds_bucket", labels, le, (double) cumulative);
+		upper_bound *= 2;
+	}
+	cw_metrics_write_sample_internal(callback_func, callback_arg, "cw_rec_decode_latency_seconds_count", labels, NULL, (double) cumulative);
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Clear receiver statistics
 
@@ -757,6 +1204,11 @@ void cw_rec_reset_statistics(cw_rec_t * rec)
 		rec->duration_stats[i].duration_delta = 0;
 	}
 	rec->duration_stats_idx = 0;
+	for (int i = 0; i < CW_REC_STAT_TYPES_COUNT; i++) {
+		rec->duration_stats_totals[i].sum = 0;
+		rec->duration_stats_totals[i].sum_of_squares = 0;
+		rec->duration_stats_totals[i].count = 0;
+	}
 
 	return;
 }
@@ -967,6 +1419,74 @@ bool cw_rec_get_adaptive_mode(const cw_rec_t * rec)
 */
 cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 {
+	int64_t usecs = 0;
+	if (CW_SUCCESS != cw_rec_timestamp_to_usecs_internal(timestamp, &usecs)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_rec_mark_begin_usecs(rec, usecs);
+}
+
+
+
+
+/**
+   @brief Inform @p rec about beginning of a Mark, with integer timestamp
+
+   Variant of cw_rec_mark_begin() for client code with its own timeline,
+   e.g. one counted in samples of sound. Timestamps passed to one
+   receiver should be on the same timeline: don't mix calls of this
+   function (and of other *_usecs() functions) with calls of functions
+   accepting struct timeval, unless @p timestamp is in microseconds
+   since the Epoch.
+
+   @exception ERANGE invalid state of receiver was discovered.
+
+   @param[in,out] rec receiver which to inform about beginning of Mark
+   @param[in] timestamp timestamp of "beginning of Mark" event [microseconds]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_mark_begin_usecs(cw_rec_t * rec, int64_t timestamp)
+{
+	if (NULL == rec->character_callback) {
+		if (rec->is_batch_polled) {
+			/* Character or inter-word-space that ended before
+			   this Mark is kept until next cw_rec_poll_batch(). */
+			cw_rec_batch_collect_internal(rec, timestamp);
+			if (RS_EOC_GAP == rec->state || RS_EOC_GAP_ERR == rec->state) {
+				cw_rec_reset_state(rec);
+			}
+		}
+		const bool is_new_character = RS_IDLE == rec->state;
+		const cw_ret_t cwret = cw_rec_mark_begin_internal(rec, timestamp);
+		if (CW_SUCCESS == cwret && is_new_character) {
+			rec->character_start = timestamp;
+		}
+		return cwret;
+	}
+
+	pthread_mutex_lock(&g_cw_rec_callback_mutex);
+	cw_rec_callback_event_t events[2];
+	int n_events = 0;
+	const cw_ret_t cwret = cw_rec_mark_begin_locked_internal(rec, timestamp, events, &n_events);
+	const int saved_errno = errno;
+	const cw_rec_character_callback_t callback = rec->character_callback;
+	void * callback_arg = rec->character_callback_arg;
+	pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+
+	cw_rec_call_callback_internal(callback, callback_arg, events, n_events);
+	errno = saved_errno;
+	return cwret;
+}
+
+
+
+static cw_ret_t cw_rec_mark_begin_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	CW_TRACE(CW_TRACE_REC_MARK_BEGIN, rec->state);
+
 #if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
 	if (rec->is_pending_inter_word_space) {
 
@@ -1006,12 +1526,8 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
 		      MSG_PREFIX "'%s': mark_begin: receive state: %s", rec->label, cw_receiver_states[rec->state]);
 
-	/* Validate and save the timestamp, or get one and then save it.
-	   This is a timestamp of beginning of Mark. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_start, timestamp)) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+	/* Save the timestamp of beginning of Mark. */
+	rec->mark_start = timestamp;
 
 	if (RS_INTER_MARK_SPACE == rec->state) {
 		/* Measure duration of inter-mark-space that is about to end
@@ -1020,8 +1536,7 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 		   rec->mark_end is timestamp of end of previous Mark. It is
 		   set when receiver goes into inter-mark-space state by
 		   cw_rec_mark_end() or by cw_rec_add_mark(). */
-		const int space_duration = cw_timestamp_compare_internal(&rec->mark_end,
-									 &rec->mark_start);
+		const int space_duration = cw_rec_duration_internal(rec->mark_end, rec->mark_start);
 		cw_rec_duration_stats_update_internal(rec, CW_REC_STAT_INTER_MARK_SPACE, space_duration);
 
 		/* TODO: this may have been a very long space. Should
@@ -1063,43 +1578,92 @@ cw_ret_t cw_rec_mark_begin(cw_rec_t * rec, const struct timeval * timestamp)
 */
 cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 {
-	/* The receiver state is expected to be inside of a Mark, otherwise
-	   there is nothing to end. */
-	if (RS_MARK != rec->state) {
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
-			      MSG_PREFIX "'%s': mark_end: receiver state not RS_MARK: %s", rec->label, cw_receiver_states[rec->state]);
-		errno = ERANGE;
-		return CW_FAILURE;
-	}
-	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
-		      MSG_PREFIX "'%s': mark_end: receiver state: %s", rec->label, cw_receiver_states[rec->state]);
-
-	/* Take a safe copy of the current end timestamp, in case we need
-	   to put it back if we decide this Mark is really just noise. */
-	struct timeval saved_end_timestamp = rec->mark_end;
-
-	/* Save the timestamp passed in, or get one. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_end, timestamp)) {
+	int64_t usecs = 0;
+	if (CW_SUCCESS != cw_rec_timestamp_to_usecs_internal(timestamp, &usecs)) {
 		errno = EINVAL;
 		return CW_FAILURE;
 	}
+	return cw_rec_mark_end_usecs(rec, usecs);
+}
 
-	/* Compare the timestamps to determine the duration of the Mark. */
-	const int mark_duration = cw_timestamp_compare_internal(&rec->mark_start,
-								&rec->mark_end);
 
-#if 0
-	fprintf(stderr, "------- mark duration: %ld.%ld - %ld.%ld = %d ms\n",
-		rec->mark_end.tv_sec, rec->mark_end.tv_usec,
-		rec->mark_start.tv_sec, rec->mark_start.tv_usec,
-		mark_duration);
-#endif
 
-	if (rec->noise_spike_threshold > 0
-	    && mark_duration <= rec->noise_spike_threshold) {
 
-		/* This pair of start()/stop() calls is just a noise,
-		   ignore it.
+/**
+   @brief Inform @p rec about end of a Mark, with integer timestamp
+
+   Variant of cw_rec_mark_end() for client code with its own timeline.
+   See cw_rec_mark_begin_usecs() for notes about timeline.
+
+   @exception ERANGE invalid state of receiver was discovered (e.g. the call was not preceded by a cw_rec_mark_begin_usecs() call)
+   @exception ENOENT function can't tell from duration of the Mark if it's Dot or Dash,
+   @exception ENOMEM the receiver's representation buffer is full
+   @exception EAGAIN the Mark has been classified as noise spike and rejected
+
+   @param[in,out] rec receiver which to inform about end of Mark
+   @param[in] timestamp timestamp of "end of Mark" event [microseconds]
+
+   @return CW_SUCCESS when no errors occurred
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_mark_end_usecs(cw_rec_t * rec, int64_t timestamp)
+{
+	CW_PROF_MARK(rec_mark_end_begin);
+
+	cw_ret_t cwret;
+	if (NULL == rec->character_callback) {
+		cwret = cw_rec_mark_end_internal(rec, timestamp);
+	} else {
+		pthread_mutex_lock(&g_cw_rec_callback_mutex);
+		cwret = cw_rec_mark_end_internal(rec, timestamp);
+		const int saved_errno = errno;
+		cw_rec_update_deadline_internal(rec);
+		pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+		errno = saved_errno;
+	}
+
+	CW_PROF_MARK(rec_mark_end_end);
+	return cwret;
+}
+
+
+
+CW_PROF_HOT static cw_ret_t cw_rec_mark_end_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	CW_TRACE(CW_TRACE_REC_MARK_END, rec->state);
+
+	/* The receiver state is expected to be inside of a Mark, otherwise
+	   there is nothing to end. */
+	if (RS_MARK != rec->state) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "'%s': mark_end: receiver state not RS_MARK: %s", rec->label, cw_receiver_states[rec->state]);
+		errno = ERANGE;
+		return CW_FAILURE;
+	}
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+		      MSG_PREFIX "'%s': mark_end: receiver state: %s", rec->label, cw_receiver_states[rec->state]);
+
+	/* Take a safe copy of the current end timestamp, in case we need
+	   to put it back if we decide this Mark is really just noise. */
+	const int64_t saved_end_timestamp = rec->mark_end;
+
+	/* Save the timestamp passed in. */
+	rec->mark_end = timestamp;
+
+	/* Compare the timestamps to determine the duration of the Mark. */
+	const int mark_duration = cw_rec_duration_internal(rec->mark_start, rec->mark_end);
+
+#if 0
+	fprintf(stderr, "------- mark duration: %lld - %lld = %d ms\n",
+		(long long) rec->mark_end, (long long) rec->mark_start,
+		mark_duration);
+#endif
+
+	if (rec->noise_spike_threshold > 0
+	    && mark_duration <= rec->noise_spike_threshold) {
+
+		/* This pair of start()/stop() calls is just a noise,
+		   ignore it.
 
 		   Revert to state of receiver as it was before complementary
 		   cw_rec_mark_begin(). After call to cw_rec_mark_begin() the
@@ -1121,6 +1685,7 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 			      rec->label,
 			      mark_duration, rec->noise_spike_threshold);
 
+		cw_rec_metrics_count_internal(&rec->metrics.n_spikes_rejected);
 		errno = EAGAIN;
 		return CW_FAILURE;
 	}
@@ -1135,7 +1700,10 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 	   Otherwise, it returns a Mark (Dot or Dash), for us to put
 	   in representation buffer. */
 	char mark = 0;
-	if (CW_SUCCESS != cw_rec_identify_mark_internal(rec, mark_duration, &mark)) {
+	if (rec->is_soft_decision) {
+		cw_rec_identify_mark_soft_internal(rec, mark_duration, &mark);
+	} else if (CW_SUCCESS != cw_rec_identify_mark_internal(rec, mark_duration, &mark)) {
+		cw_rec_metrics_count_internal(&rec->metrics.n_marks_unrecognized);
 		errno = ENOENT;
 		return CW_FAILURE;
 	}
@@ -1164,7 +1732,7 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 	}
 
 	/* Add the Mark to the receiver's representation buffer. */
-	rec->representation[rec->representation_ind++] = mark;
+	cw_rec_append_mark_internal(rec, mark, mark_duration);
 
 	/* Until we complete the whole character (all Dots and Dashes), this
 	   will print only part of representation. */
@@ -1181,6 +1749,7 @@ cw_ret_t cw_rec_mark_end(cw_rec_t * rec, const struct timeval * timestamp)
 
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
 			      MSG_PREFIX "'%s': mark_end: receiver's representation buffer is full", rec->label);
+		cw_rec_metrics_count_internal(&rec->metrics.n_buffer_overflows);
 
 		errno = ENOMEM;
 		return CW_FAILURE;
@@ -1311,6 +1880,217 @@ cw_ret_t cw_rec_identify_mark_internal(cw_rec_t * rec, int mark_duration, char *
 
 
 
+/**
+   @brief Append a Mark to receiver's representation buffer
+
+   @param[in,out] rec receiver
+   @param[in] mark CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION
+   @param[in] mark_duration duration of the Mark [us]
+*/
+static void cw_rec_append_mark_internal(cw_rec_t * rec, char mark, int mark_duration)
+{
+	rec->mark_durations[rec->representation_ind] = mark_duration;
+	rec->representation[rec->representation_ind++] = mark;
+	rec->representation_bits = (rec->representation_bits << 1U) | (CW_DASH_REPRESENTATION == mark ? 1U : 0U);
+	cw_rec_metrics_count_internal(&rec->metrics.n_marks_accepted);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Increment counter in receiver's metrics
+
+   @param[in,out] counter counter to increment
+*/
+static void cw_rec_metrics_count_internal(uint64_t * counter)
+{
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+
+
+
+/**
+   @brief Update receiver's metrics after end of character has been recognized
+
+   @param[in,out] rec receiver
+   @param[in] latency time from end of last Mark of the character to recognition of end of the character [us]
+*/
+static void cw_rec_metrics_end_of_character_internal(cw_rec_t * rec, int latency)
+{
+	cw_rec_metrics_count_internal(&rec->metrics.n_characters);
+
+	int bin = 0;
+	int bin_limit = 25000;
+	while (bin < CW_REC_LATENCY_HISTOGRAM_N_BINS - 1 && latency >= bin_limit) {
+		bin++;
+		bin_limit *= 2;
+	}
+	cw_rec_metrics_count_internal(&rec->metrics.decode_latency[bin]);
+}
+
+
+
+
+/**
+   @brief Get hash of representation in receiver's buffer
+
+   @param[in] rec receiver
+
+   @return hash that can be passed to cw_representation_hash_to_character_internal()
+   @return zero if representation is too long to be a character
+*/
+static unsigned int cw_rec_representation_hash_internal(const cw_rec_t * rec)
+{
+	const int n_marks = rec->representation_ind;
+	if (n_marks < CW_DATA_MIN_REPRESENTATION_LENGTH || n_marks > CW_DATA_MAX_REPRESENTATION_LENGTH) {
+		return 0;
+	}
+	const unsigned int sentinel = 1U << n_marks;
+	return sentinel | (rec->representation_bits & (sentinel - 1U));
+}
+
+
+
+
+/**
+   @brief Identify a Mark as Dot or Dash in soft-decision mode
+
+   Mark that fits into duration range of Dot or Dash is identified
+   just like in cw_rec_identify_mark_internal(). Any other Mark is
+   identified as the closer of Dot and Dash, without changing state
+   of receiver.
+
+   @param[in,out] rec receiver
+   @param[in] mark_duration duration of Mark to analyze
+   @param[out] mark variable to store identified Mark
+*/
+static void cw_rec_identify_mark_soft_internal(cw_rec_t * rec, int mark_duration, char * mark)
+{
+	cw_rec_sync_parameters_internal(rec);
+
+	if (mark_duration >= rec->dot_duration_min
+	    && mark_duration <= rec->dot_duration_max) {
+		*mark = CW_DOT_REPRESENTATION;
+	} else if (mark_duration >= rec->dash_duration_min
+		   && mark_duration <= rec->dash_duration_max) {
+		*mark = CW_DASH_REPRESENTATION;
+	} else {
+		const float dot_cost = cw_rec_mark_cost_internal(rec, mark_duration, CW_DOT_REPRESENTATION);
+		const float dash_cost = cw_rec_mark_cost_internal(rec, mark_duration, CW_DASH_REPRESENTATION);
+		*mark = (dot_cost <= dash_cost) ? CW_DOT_REPRESENTATION : CW_DASH_REPRESENTATION;
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+			      MSG_PREFIX "'%s': identify: mark '%d [us]' outside of limits taken as '%c'",
+			      rec->label, mark_duration, *mark);
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate cost of taking a Mark of given duration as Dot or Dash
+
+   The cost is a negative log-likelihood of the Mark being a Dot or a
+   Dash, for durations of Marks having log-normal distribution around
+   ideal durations: square of logarithm of ratio of @p mark_duration
+   and ideal duration.
+
+   @param[in] rec receiver
+   @param[in] mark_duration duration of Mark [us]
+   @param[in] mark CW_DOT_REPRESENTATION or CW_DASH_REPRESENTATION
+
+   @return cost of the decision
+*/
+static float cw_rec_mark_cost_internal(const cw_rec_t * rec, int mark_duration, char mark)
+{
+	const int ideal = (CW_DOT_REPRESENTATION == mark) ? rec->dot_duration_ideal : rec->dash_duration_ideal;
+	const float ratio = logf((float) (mark_duration > 0 ? mark_duration : 1) / (float) (ideal > 0 ? ideal : 1));
+	return ratio * ratio;
+}
+
+
+
+
+/**
+   @brief Find the most likely character for durations of Marks in receiver's buffer
+
+   Search representations of all characters that have the same count
+   of Marks as representation buffer of @p rec, and return the one
+   with the lowest total cost of its Marks. Branches of the search are
+   cut as soon as their cost exceeds cost of the best character found
+   so far.
+
+   @param[in] rec receiver
+
+   @return character on success
+   @return zero if no character has given count of Marks
+*/
+static int cw_rec_soft_decode_internal(const cw_rec_t * rec)
+{
+	const int n_marks = rec->representation_ind;
+	if (n_marks < CW_DATA_MIN_REPRESENTATION_LENGTH || n_marks > CW_DATA_MAX_REPRESENTATION_LENGTH) {
+		return 0;
+	}
+
+	float costs[CW_DATA_MAX_REPRESENTATION_LENGTH][2] = { { 0 } };
+	for (int i = 0; i < n_marks; i++) {
+		costs[i][0] = cw_rec_mark_cost_internal(rec, rec->mark_durations[i], CW_DOT_REPRESENTATION);
+		costs[i][1] = cw_rec_mark_cost_internal(rec, rec->mark_durations[i], CW_DASH_REPRESENTATION);
+	}
+
+	/* Depth-first search over the binary tree of representations,
+	   with bits of 'path' selecting Dot (0) or Dash (1). */
+	int best_character = 0;
+	float best_cost = 0.0F;
+	float path_costs[CW_DATA_MAX_REPRESENTATION_LENGTH + 1] = { 0 };
+	unsigned int path = 0;
+	int depth = 0;
+	while (depth >= 0) {
+		if (depth == n_marks) {
+			unsigned int hash = 1U;
+			for (int i = 0; i < n_marks; i++) {
+				hash = (hash << 1U) | ((path >> i) & 1U);
+			}
+			const int character = cw_representation_hash_to_character_internal(hash);
+			if (0 != character && (0 == best_character || path_costs[depth] < best_cost)) {
+				best_character = character;
+				best_cost = path_costs[depth];
+			}
+			depth--;
+		} else {
+			const unsigned int branch = (path >> depth) & 1U;
+			const float cost = path_costs[depth] + costs[depth][branch];
+			if (0 == best_character || cost < best_cost) {
+				path_costs[depth + 1] = cost;
+				depth++;
+				continue;
+			}
+		}
+
+		/* Current branch at 'depth' is done. Backtrack to the
+		   deepest Dot that can be turned into Dash. */
+		while (depth >= 0 && ((path >> depth) & 1U)) {
+			path &= ~(1U << depth);
+			depth--;
+		}
+		if (depth >= 0) {
+			path |= 1U << depth;
+		}
+	}
+
+	return best_character;
+}
+
+
+
+
 /**
    @brief Update receiver's averaging data structures with most recent data
 
@@ -1349,37 +2129,20 @@ void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mar
 	/* Recalculate the adaptive threshold. */
 	const int avg_dot_duration = rec->dot_averaging.average;
 	const int avg_dash_duration = rec->dash_averaging.average;
-	rec->adaptive_speed_threshold = (avg_dash_duration - avg_dot_duration) / 2 + avg_dot_duration;
+	const int threshold = (avg_dash_duration - avg_dot_duration) / 2 + avg_dot_duration;
+	if (threshold == rec->adaptive_speed_threshold && rec->parameters_in_sync) {
+		/* Speed and all timing parameters stay the same. */
+		return;
+	}
+	rec->adaptive_speed_threshold = threshold;
 
 	/* We are in adaptive mode. Since ->adaptive_speed_threshold
-	   has changed, we need to calculate new ->speed with sync().
-	   Low-level parameters will also be re-synchronized to new
-	   threshold/speed. */
-	rec->parameters_in_sync = false;
-	cw_rec_sync_parameters_internal(rec);
-
-	if (rec->speed < CW_SPEED_MIN || rec->speed > CW_SPEED_MAX) {
-
-		/* Clamp the speed. */
-		rec->speed = rec->speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
-
-		/* Direct manipulation of speed in line above
-		   (clamping) requires resetting adaptive mode and
-		   re-synchronizing to calculate the new threshold,
-		   which unfortunately recalculates everything else
-		   according to fixed speed.
-
-		   So, we then have to reset adaptive mode and
-		   re-synchronize one more time, to get all other
-		   parameters back to where they should be. */
-
-		rec->is_adaptive_receive_mode = false;
-		rec->parameters_in_sync = false;
-		cw_rec_sync_parameters_internal(rec);
-
-		rec->is_adaptive_receive_mode = true;
-		rec->parameters_in_sync = false;
-		cw_rec_sync_parameters_internal(rec);
+	   has changed, we need to calculate new ->speed, and
+	   low-level parameters that depend on it. */
+	const long speed_before = lroundf(rec->speed);
+	cw_rec_sync_adaptive_parameters_internal(rec);
+	if (lroundf(rec->speed) != speed_before) {
+		cw_rec_metrics_count_internal(&rec->metrics.n_speed_changes);
 	}
 
 	return;
@@ -1418,6 +2181,53 @@ void cw_rec_update_averages_internal(cw_rec_t * rec, int mark_duration, char mar
    @return CW_FAILURE on failure
 */
 cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char mark)
+{
+	int64_t usecs = 0;
+	if (CW_SUCCESS != cw_rec_timestamp_to_usecs_internal(timestamp, &usecs)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_rec_add_mark_usecs(rec, usecs, mark);
+}
+
+
+
+
+/**
+   @brief Add Dot or Dash to receiver's representation buffer, with integer timestamp
+
+   Variant of cw_rec_add_mark() for client code with its own timeline.
+   See cw_rec_mark_begin_usecs() for notes about timeline.
+
+   @exception ERANGE invalid state of receiver was discovered.
+   @exception ENOMEM the receiver's representation buffer is full
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of "end of mark" event [microseconds]
+   @param[in] mark Mark to be inserted into receiver's representation buffer
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_rec_add_mark_usecs(cw_rec_t * rec, int64_t timestamp, char mark)
+{
+	if (NULL == rec->character_callback) {
+		return cw_rec_add_mark_internal(rec, timestamp, mark);
+	}
+
+	pthread_mutex_lock(&g_cw_rec_callback_mutex);
+	const cw_ret_t cwret = cw_rec_add_mark_internal(rec, timestamp, mark);
+	const int saved_errno = errno;
+	cw_rec_update_deadline_internal(rec);
+	pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+
+	errno = saved_errno;
+	return cwret;
+}
+
+
+
+static cw_ret_t cw_rec_add_mark_internal(cw_rec_t * rec, int64_t timestamp, char mark)
 {
 	/* The receiver's state is expected to be idle or
 	   inter-mark-space in order to use this routine. */
@@ -1453,13 +2263,13 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 	   called later look at the time since the last end of Mark
 	   to determine whether we are at the end of a word, or just
 	   at the end of a character. */
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&rec->mark_end, timestamp)) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
+	rec->mark_end = timestamp;
 
-	/* Add the mark to the receiver's representation buffer. */
-	rec->representation[rec->representation_ind++] = mark;
+	/* Add the mark to the receiver's representation buffer. Type of
+	   the Mark is certain, so for soft-decision decoding the Mark
+	   has ideal duration. */
+	cw_rec_sync_parameters_internal(rec);
+	cw_rec_append_mark_internal(rec, mark, (CW_DOT_REPRESENTATION == mark) ? rec->dot_duration_ideal : rec->dash_duration_ideal);
 
 	/* We just added a Mark to the receiver's buffer.  As in
 	   cw_rec_mark_end(): if the buffer is full full, then we have to do
@@ -1470,6 +2280,7 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
 			      MSG_PREFIX "'%s': add_mark: receiver's representation buffer is full", rec->label);
+		cw_rec_metrics_count_internal(&rec->metrics.n_buffer_overflows);
 
 		errno = ENOMEM;
 		return CW_FAILURE;
@@ -1486,75 +2297,304 @@ cw_ret_t cw_rec_add_mark(cw_rec_t * rec, const struct timeval * timestamp, char
 
 
 /**
-   @brief Try to poll fully received representation from receiver
+   @brief Queue beginning of a Mark for @p rec, without locking the receiver
+
+   Thread-safe variant of cw_rec_mark_begin_usecs() for code feeding
+   the receiver in one thread (e.g. keying callback called in
+   generator's thread) while the receiver is polled in another thread.
+   The beginning of Mark is put into receiver's lock-free
+   single-producer, single-consumer queue. Queued edges are passed to
+   the receiver by thread calling cw_rec_poll_character(),
+   cw_rec_poll_representation(), cw_rec_poll_batch() or their *_usecs()
+   variants, or, if the receiver has a registered callback (see
+   cw_rec_register_character_callback()), by library's scheduler
+   thread. Edges keep their timestamps, so a late poll doesn't change
+   durations of Marks and Spaces.
+
+   Only one thread may push edges to given receiver, in order of their
+   timestamps. Don't mix the function with cw_rec_mark_begin() and
+   cw_rec_mark_end() for the same receiver.
+
+   Client code doesn't have to reset the receiver before a Mark that
+   begins after a character: thread consuming the edges resets the
+   receiver when the character has been polled (or passed to
+   callback). Errors detected by the receiver at the end of the Mark
+   (see cw_rec_mark_end_usecs()) are not reported to caller of this
+   function; they are visible to thread polling the receiver as errors
+   of polled character.
+
+   The function doesn't take receiver's lock. If the receiver has a
+   registered callback and the queue was empty, the function
+   schedules receiver's deadline in library's scheduler, to wake up
+   scheduler thread.
+
+   @exception EAGAIN the queue is full, consuming thread doesn't keep up
 
-   Try to get fully received representation of received character and
-   receiver's state flags. The representation is fully received when @p rec
-   has recognized that after the last Mark in the representation an
-   inter-character-space or inter-word-space has occurred.
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of beginning of Mark [microseconds]
 
-   @p timestamp helps to recognize that space. If you call this function
-   after a certain period after adding a last Mark to the @p rec, the
-   receiver will know that either inter-character-space or inter-word-space
-   has elapsed.
+   @return CW_SUCCESS when the beginning of Mark has been queued
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_push_mark_begin(cw_rec_t * rec, int64_t timestamp)
+{
+	return cw_rec_push_edge_internal(rec, timestamp, true);
+}
 
-   The representation is appended to end of @p representation.
 
-   If receiver is not done with recognizing and receiving a representation,
-   it will return error (because representation is not ready yet).
 
-   Function returns a representation of a character. After the character may
-   come an inter-character-space or inter-word-space. Which of the two occurs
-   depends on value of a timestamp, either passed explicitly through
-   @p timestamp, or generated internally by the function at the moment of the
-   call. Depending on the duration of the Space, @p is_end_of_word is set
-   accordingly.
 
-   @internal
-   The fact that the representation is appended may be a problem. Why not
-   simply copy (instead of append) the representation?
-   @endinternal
+/**
+   @brief Queue end of a Mark for @p rec, without locking the receiver
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   Thread-safe variant of cw_rec_mark_end_usecs(). See
+   cw_rec_push_mark_begin() for details.
 
-   @exception ERANGE invalid state of receiver was discovered
-   @exception EINVAL errors while processing or getting @p timestamp
-   @exception EAGAIN function called too early, representation not ready yet
+   @exception EAGAIN the queue is full, consuming thread doesn't keep up
 
    @param[in,out] rec receiver
-   @param[in] timestamp (may be NULL)
-   @param[out] representation representation of character from receiver's buffer
-   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
-   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+   @param[in] timestamp timestamp of end of Mark [microseconds]
 
-   @return CW_SUCCESS if a correct representation has been returned through @p representation
+   @return CW_SUCCESS when the end of Mark has been queued
    @return CW_FAILURE otherwise
 */
-cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
-				    const struct timeval * timestamp,
-				    char * representation,
-				    bool * is_end_of_word,
-				    bool * is_error)
+cw_ret_t cw_rec_push_mark_end(cw_rec_t * rec, int64_t timestamp)
 {
-	if (RS_EOW_GAP == rec->state || RS_EOW_GAP_ERR == rec->state) {
+	return cw_rec_push_edge_internal(rec, timestamp, false);
+}
 
-		/* Until receiver is notified about new mark, its
-		   state won't change, and representation stored by
-		   receiver's buffer won't change.
 
-		   Repeated calls of this function when receiver is in
-		   this state will simply return the same
-		   representation over and over again.
 
-		   Because the state of receiver is settled as EOW, @p
-		   timestamp is uninteresting. We don't expect it to hold any
-		   useful information that could influence receiver's state
-		   or representation buffer (the EOW space can't turn into
-		   even longer space). */
 
-		cw_rec_poll_representation_iws_internal(rec, representation, is_end_of_word, is_error);
+/**
+   @brief Put beginning or end of Mark into receiver's queue
+
+   Called only by producer.
+
+   @exception EAGAIN the queue is full
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of the edge [microseconds]
+   @param[in] is_mark_begin whether the edge is beginning of Mark
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE otherwise
+*/
+static cw_ret_t cw_rec_push_edge_internal(cw_rec_t * rec, int64_t timestamp, bool is_mark_begin)
+{
+	const uint64_t tail = rec->edge_queue_tail;
+	if (tail - __atomic_load_n(&rec->edge_queue_head, __ATOMIC_ACQUIRE) == CW_REC_EDGE_QUEUE_CAPACITY) {
+		errno = EAGAIN;
+		return CW_FAILURE;
+	}
+
+	cw_rec_queued_edge_t * edge = &rec->edge_queue[tail & (CW_REC_EDGE_QUEUE_CAPACITY - 1)];
+	edge->timestamp = timestamp;
+	edge->is_mark_begin = is_mark_begin;
+	/* Publish the slot only after it has been written. */
+	__atomic_store_n(&rec->edge_queue_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (NULL != __atomic_load_n(&rec->character_callback, __ATOMIC_ACQUIRE)) {
+		/* Scheduler thread that has already consumed all
+		   previous edges may have checked the queue before the
+		   edge was published (see
+		   cw_rec_update_deadline_internal()). Either the check
+		   sees the edge, or this load sees that the thread has
+		   consumed previous edges. */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&rec->edge_queue_head, __ATOMIC_ACQUIRE) == tail) {
+			cw_scheduler_schedule_internal(&rec->scheduler_entry, cw_scheduler_now_internal());
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Pass edges from receiver's queue to receiver without callback
+
+   Called by thread polling the receiver, before the poll. Before
+   beginning of a Mark that follows a Space, the receiver is polled at
+   the beginning of the Mark, so that the Space can end a character.
+   If the character hasn't been polled yet, remaining edges are left
+   in the queue, and the poll should be made at the beginning of the
+   Mark (returned timestamp): otherwise the Mark would make the
+   receiver discard the character.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of the poll [microseconds]
+
+   @return timestamp at which to poll the receiver [microseconds]
+*/
+static int64_t cw_rec_consume_edges_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	uint64_t head = rec->edge_queue_head;
+	const uint64_t tail = __atomic_load_n(&rec->edge_queue_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		const cw_rec_queued_edge_t * edge = &rec->edge_queue[head & (CW_REC_EDGE_QUEUE_CAPACITY - 1)];
+		if (!edge->is_mark_begin) {
+			cw_rec_mark_end_usecs(rec, edge->timestamp);
+			continue;
+		}
+
+		if (!rec->is_batch_polled) {
+			/* In batch mode cw_rec_mark_begin_usecs() collects
+			   the character itself. */
+			if (RS_INTER_MARK_SPACE == rec->state) {
+				cw_rec_poll_character_internal(rec, edge->timestamp, NULL, NULL, NULL);
+			}
+			if (RS_IDLE != rec->state && RS_INTER_MARK_SPACE != rec->state && RS_MARK != rec->state) {
+				if (!rec->is_character_delivered) {
+					timestamp = edge->timestamp;
+					break;
+				}
+				cw_rec_reset_state(rec);
+			}
+		}
+		cw_rec_mark_begin_usecs(rec, edge->timestamp);
+	}
+	/* Give the slots back to producer only after they have been read. */
+	__atomic_store_n(&rec->edge_queue_head, head, __ATOMIC_RELEASE);
+
+	return timestamp;
+}
+
+
+
+
+/**
+   @brief Try to poll fully received representation from receiver
+
+   Try to get fully received representation of received character and
+   receiver's state flags. The representation is fully received when @p rec
+   has recognized that after the last Mark in the representation an
+   inter-character-space or inter-word-space has occurred.
+
+   @p timestamp helps to recognize that space. If you call this function
+   after a certain period after adding a last Mark to the @p rec, the
+   receiver will know that either inter-character-space or inter-word-space
+   has elapsed.
+
+   The representation is appended to end of @p representation.
+
+   If receiver is not done with recognizing and receiving a representation,
+   it will return error (because representation is not ready yet).
+
+   Function returns a representation of a character. After the character may
+   come an inter-character-space or inter-word-space. Which of the two occurs
+   depends on value of a timestamp, either passed explicitly through
+   @p timestamp, or generated internally by the function at the moment of the
+   call. Depending on the duration of the Space, @p is_end_of_word is set
+   accordingly.
+
+   @internal
+   The fact that the representation is appended may be a problem. Why not
+   simply copy (instead of append) the representation?
+   @endinternal
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @exception ERANGE invalid state of receiver was discovered
+   @exception EINVAL errors while processing or getting @p timestamp
+   @exception EAGAIN function called too early, representation not ready yet
+
+   @param[in,out] rec receiver
+   @param[in] timestamp (may be NULL)
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a correct representation has been returned through @p representation
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
+				    const struct timeval * timestamp,
+				    char * representation,
+				    bool * is_end_of_word,
+				    bool * is_error)
+{
+	int64_t usecs = 0;
+	if (CW_SUCCESS != cw_rec_timestamp_to_usecs_internal(timestamp, &usecs)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_rec_poll_representation_usecs(rec, usecs, representation, is_end_of_word, is_error);
+}
+
+
+
+
+/**
+   @brief Try to poll fully received representation from receiver, with integer timestamp
+
+   Variant of cw_rec_poll_representation() for client code with its own
+   timeline. See cw_rec_mark_begin_usecs() for notes about timeline.
+
+   @exception ERANGE invalid state of receiver was discovered
+   @exception EAGAIN function called too early, representation not ready yet
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of the poll [microseconds]
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a correct representation has been returned through @p representation
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_poll_representation_usecs(cw_rec_t * rec,
+					  int64_t timestamp,
+					  char * representation,
+					  bool * is_end_of_word,
+					  bool * is_error)
+{
+	if (NULL == rec->character_callback) {
+		timestamp = cw_rec_consume_edges_internal(rec, timestamp);
+	}
+	const cw_ret_t cwret = cw_rec_poll_representation_internal(rec, timestamp, representation, is_end_of_word, is_error);
+	if (CW_SUCCESS == cwret && NULL == rec->character_callback && !rec->is_batch_polled) {
+		/* Next queued Mark may reset the receiver. */
+		rec->is_character_delivered = true;
+	}
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Implementation of cw_rec_poll_representation_usecs()
+
+   Doesn't take edges from receiver's queue.
+*/
+static cw_ret_t cw_rec_poll_representation_internal(cw_rec_t * rec,
+						    int64_t timestamp,
+						    char * representation,
+						    bool * is_end_of_word,
+						    bool * is_error)
+{
+	if (RS_EOW_GAP == rec->state || RS_EOW_GAP_ERR == rec->state) {
+
+		/* Until receiver is notified about new mark, its
+		   state won't change, and representation stored by
+		   receiver's buffer won't change.
+
+		   Repeated calls of this function when receiver is in
+		   this state will simply return the same
+		   representation over and over again.
+
+		   Because the state of receiver is settled as EOW, @p
+		   timestamp is uninteresting. We don't expect it to hold any
+		   useful information that could influence receiver's state
+		   or representation buffer (the EOW space can't turn into
+		   even longer space). */
+
+		cw_rec_poll_representation_iws_internal(rec, representation, is_end_of_word, is_error);
 		return CW_SUCCESS;
 
 	} else if (RS_IDLE == rec->state || RS_MARK == rec->state) {
@@ -1585,13 +2625,7 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 	   To see which case is true, calculate duration of this Space
 	   by comparing current/given timestamp with end of last
 	   Mark. */
-	struct timeval now_timestamp;
-	if (CW_SUCCESS != cw_timestamp_validate_internal(&now_timestamp, timestamp)) {
-		errno = EINVAL;
-		return CW_FAILURE;
-	}
-
-	const int space_duration = cw_timestamp_compare_internal(&rec->mark_end, &now_timestamp);
+	const int space_duration = cw_rec_duration_internal(rec->mark_end, timestamp);
 	if (INT_MAX == space_duration) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
 			      MSG_PREFIX "'%s': poll: space duration == INT_MAX", rec->label);
@@ -1612,6 +2646,9 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 
 		   We have a complete character representation in
 		   receiver's buffer and we can return it. */
+		if (RS_INTER_MARK_SPACE == rec->state) {
+			cw_rec_metrics_end_of_character_internal(rec, space_duration);
+		}
 		cw_rec_poll_representation_ics_internal(rec, space_duration, representation, is_end_of_word, is_error);
 		return CW_SUCCESS;
 
@@ -1625,6 +2662,9 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 
 		   We have a complete character representation in
 		   receiver's buffer and we can return it. */
+		if (RS_INTER_MARK_SPACE == rec->state) {
+			cw_rec_metrics_end_of_character_internal(rec, space_duration);
+		}
 		cw_rec_poll_representation_iws_internal(rec, representation, is_end_of_word, is_error);
 		return CW_SUCCESS;
 
@@ -1662,7 +2702,7 @@ cw_ret_t cw_rec_poll_representation(cw_rec_t * rec,
 
    @param[in,out] rec receiver
    @param[in] space_duration duration of current inter-character-space
-   @param[out] representation representation of character from receiver's buffer
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
    @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
    @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
 */
@@ -1706,8 +2746,10 @@ void cw_rec_poll_representation_ics_internal(cw_rec_t * rec,
 	}
 
 	/* Append representation from receiver's buffer to caller's buffer. */
-	*representation = '\0';
-	strncat(representation, rec->representation, rec->representation_ind);
+	if (representation) {
+		*representation = '\0';
+		strncat(representation, rec->representation, rec->representation_ind);
+	}
 
 	/* Since we are in ics state, there will be no more Dots or Dashes added to current representation. */
 	rec->representation[rec->representation_ind] = '\0';
@@ -1734,7 +2776,7 @@ void cw_rec_poll_representation_ics_internal(cw_rec_t * rec,
    @endinternal
 
    @param[in,out] rec receiver
-   @param[out] representation representation of character from receiver's buffer
+   @param[out] representation representation of character from receiver's buffer (may be NULL)
    @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
    @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
 */
@@ -1768,8 +2810,10 @@ void cw_rec_poll_representation_iws_internal(cw_rec_t * rec,
 	}
 
 	/* Append representation from receiver's buffer to caller's buffer. */
-	*representation = '\0';
-	strncat(representation, rec->representation, rec->representation_ind);
+	if (representation) {
+		*representation = '\0';
+		strncat(representation, rec->representation, rec->representation_ind);
+	}
 
 	/* Since we are in iws state, there will be no more Dots or Dashes added to current representation. */
 	rec->representation[rec->representation_ind] = '\0';
@@ -1824,6 +2868,67 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 			       char * character,
 			       bool * is_end_of_word,
 			       bool * is_error)
+{
+	int64_t usecs = 0;
+	if (CW_SUCCESS != cw_rec_timestamp_to_usecs_internal(timestamp, &usecs)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	return cw_rec_poll_character_usecs(rec, usecs, character, is_end_of_word, is_error);
+}
+
+
+
+
+/**
+   @brief Try to poll fully received character from receiver, with integer timestamp
+
+   Variant of cw_rec_poll_character() for client code with its own
+   timeline. See cw_rec_mark_begin_usecs() for notes about timeline.
+
+   @exception ERANGE invalid state of receiver was discovered.
+   @exception EAGAIN function called too early, character not ready yet
+   @exception ENOENT function can't convert representation retrieved from receiver into a character
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of the poll [microseconds]
+   @param[out] character character received by receiver
+   @param[out] is_end_of_word flag indicating if receiver is at end of word (may be NULL)
+   @param[out] is_error flag indicating whether receiver is in error state (may be NULL)
+
+   @return CW_SUCCESS if a character has been recognized by receiver and is returned through @p character
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_rec_poll_character_usecs(cw_rec_t * rec,
+				     int64_t timestamp,
+				     char * character,
+				     bool * is_end_of_word,
+				     bool * is_error)
+{
+	if (NULL == rec->character_callback) {
+		timestamp = cw_rec_consume_edges_internal(rec, timestamp);
+	}
+	const cw_ret_t cwret = cw_rec_poll_character_internal(rec, timestamp, character, is_end_of_word, is_error);
+	if (CW_SUCCESS == cwret && NULL == rec->character_callback && !rec->is_batch_polled) {
+		/* Next queued Mark may reset the receiver. */
+		rec->is_character_delivered = true;
+	}
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Implementation of cw_rec_poll_character_usecs()
+
+   Doesn't take edges from receiver's queue.
+*/
+static cw_ret_t cw_rec_poll_character_internal(cw_rec_t * rec,
+					       int64_t timestamp,
+					       char * character,
+					       bool * is_end_of_word,
+					       bool * is_error)
 {
 	/* TODO: in theory we don't need these intermediate bool
 	   variables, since is_end_of_word and is_error won't be
@@ -1831,19 +2936,28 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 	bool end_of_word = false;
 	bool error = false;
 
-	char representation[CW_REC_REPRESENTATION_CAPACITY + 1];
+	/* Unrecognized representation is counted in metrics only
+	   once, when its end is recognized. */
+	const bool is_new_representation = RS_INTER_MARK_SPACE == rec->state;
 
-	/* See if we can obtain a representation from receiver. */
-	cw_ret_t cwret = cw_rec_poll_representation(rec, timestamp,
-						    representation,
-						    &end_of_word, &error);
+	/* See if receiver has a complete representation. The
+	   representation string isn't needed: the character is looked
+	   up by hash kept by receiver while receiving Marks. */
+	cw_ret_t cwret = cw_rec_poll_representation_internal(rec, timestamp,
+							     NULL,
+							     &end_of_word, &error);
 	if (CW_SUCCESS != cwret) {
 		return CW_FAILURE;
 	}
 
-	/* Look up the representation using the lookup functions. */
-	int looked_up = cw_representation_to_character_internal(representation);
+	int looked_up = cw_representation_hash_to_character_internal(cw_rec_representation_hash_internal(rec));
+	if (0 == looked_up && rec->is_soft_decision) {
+		looked_up = cw_rec_soft_decode_internal(rec);
+	}
 	if (0 == looked_up) {
+		if (is_new_representation) {
+			cw_rec_metrics_count_internal(&rec->metrics.n_representations_unrecognized);
+		}
 		errno = ENOENT;
 		return CW_FAILURE;
 	}
@@ -1881,86 +2995,264 @@ cw_ret_t cw_rec_poll_character(cw_rec_t * rec,
 
 
 
-/**
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
-*/
-void cw_rec_reset_state(cw_rec_t * rec)
+static bool cw_rec_edge_is_mark_internal(const cw_rec_t * rec, const cw_rec_edge_t * edge)
 {
-	memset(rec->representation, 0, sizeof (rec->representation));
-	rec->representation_ind = 0;
+	if (!edge->is_mark) {
+		return false;
+	}
+	/* Noise spike. */
+	return !(rec->noise_spike_threshold > 0 && edge->timespan <= rec->noise_spike_threshold);
+}
 
-#if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
-	rec->is_pending_inter_word_space = false;
-#endif
 
-	cw_rec_set_state_internal(rec, RS_IDLE);
 
-	return;
+
+/**
+   @brief Receive recorded sequence of Marks and Spaces in one call
+
+   Function drives @p rec with Marks and Spaces from @p edges, and stores
+   characters recognized by @p rec in @p decoded. Each inter-word-space
+   is stored as ' ' character. This is the same as calling
+   cw_rec_mark_begin_usecs(), cw_rec_mark_end_usecs() and
+   cw_rec_poll_character_usecs() for each edge, but without per-call
+   validation of timestamps, so hours of recorded keying can be decoded
+   very quickly.
+
+   Duration of a Space is known only at its end, so a character is
+   recognized only after a Space that follows it. End @p edges with a
+   Space to get the last character. Consecutive edges of the same kind
+   are treated as one longer Mark or Space. A Mark not longer than
+   noise spike threshold (see cw_rec_set_noise_spike_threshold()) is
+   treated as part of Space around it, so that the spike doesn't split
+   an inter-word-space. Characters that can't be recognized are
+   skipped.
+
+   @p decoded may be filled in several calls: pass timestamp of end of
+   previous call's edges in @p timestamp to keep receiver's timeline
+   continuous.
+
+   @exception ENOMEM more characters were received than @p capacity
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of beginning of first edge [microseconds]
+   @param[in] edges Marks and Spaces to receive
+   @param[in] n_edges count of items in @p edges
+   @param[out] decoded received characters
+   @param[in] capacity count of items that fit into @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS if all edges were received
+   @return CW_FAILURE if @p decoded is too small (it is filled up to its capacity)
+*/
+cw_ret_t cw_rec_receive_edges(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	/* Beginning of first Mark of character being received. */
+	int64_t character_start = timestamp;
+	/* Beginning of current Space (end of last Mark). */
+	int64_t space_start = timestamp;
+
+	return cw_rec_receive_edges_internal(rec, timestamp, edges, n_edges, decoded, capacity, n_decoded, &character_start, &space_start);
 }
 
 
 
 
 /**
-   @brief Get the number of Marks (Dots/Dashes) the receiver's buffer can accommodate
+   @brief Pass recorded Marks and Spaces to receiver, keeping position in character
 
-   The value returned by this function is the maximum number of Marks written
-   out by cw_rec_poll_representation() (not including terminating NUL).
+   Implementation of cw_rec_receive_edges(). Beginning of character
+   being received and beginning of current Space are kept by caller in
+   @p character_start and @p space_start, so that a character started
+   by edges of one call can be completed by edges of next call with
+   correct timestamp.
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   @param[in,out] rec receiver
+   @param[in] timestamp beginning of first edge [us]
+   @param[in] edges edges to receive
+   @param[in] n_edges count of items in @p edges
+   @param[out] decoded decoded characters
+   @param[in] capacity count of items in @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
+   @param[in,out] character_start beginning of first Mark of character being received [us]
+   @param[in,out] space_start beginning of current Space [us]
 
-   @return number of Marks that can be stored in receiver's representation buffer
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if @p decoded is too small (errno is set to ENOMEM)
 */
-int cw_rec_get_receive_buffer_capacity_internal(void)
+cw_ret_t cw_rec_receive_edges_internal(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded, int64_t * character_start, int64_t * space_start)
 {
-	return CW_REC_REPRESENTATION_CAPACITY;
-}
+	*n_decoded = 0;
 
+	double now = (double) timestamp;
 
+	for (size_t i = 0; i < n_edges; i++) {
+		const bool is_mark = cw_rec_edge_is_mark_internal(rec, &edges[i]);
+		const bool is_first = 0 == i || cw_rec_edge_is_mark_internal(rec, &edges[i - 1]) != is_mark;
+		const bool is_last = n_edges - 1 == i || cw_rec_edge_is_mark_internal(rec, &edges[i + 1]) != is_mark;
+		if (edges[i].is_mark && !is_mark) {
+			cw_rec_metrics_count_internal(&rec->metrics.n_spikes_rejected);
+		}
 
+		if (is_mark && is_first) {
+			const int64_t mark_start = (int64_t) llround(now);
+			if (CW_SUCCESS != cw_rec_mark_begin_usecs(rec, mark_start)) {
+				/* Receiver is left in error state by
+				   previous character. */
+				cw_rec_reset_state(rec);
+				cw_rec_mark_begin_usecs(rec, mark_start);
+			}
+			if (0 == rec->representation_ind) {
+				*character_start = mark_start;
+			}
+		}
 
-/**
-   @brief Get number of Marks (Dots and Dashes) currently stored in receiver's representation buffer
+		now += edges[i].timespan;
+		if (!is_last) {
+			continue;
+		}
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+		if (is_mark) {
+			*space_start = (int64_t) llround(now);
+			if (CW_SUCCESS != cw_rec_mark_end_usecs(rec, *space_start)) {
+				if (ENOENT == errno) {
+					/* Neither Dot nor Dash: character can't
+					   be recognized. */
+					cw_rec_reset_state(rec);
+				}
+			}
+			continue;
+		}
 
-   @param[in] rec receiver from which to get current number of Marks
-*/
-int cw_rec_get_buffer_length_internal(const cw_rec_t * rec)
-{
-	return rec->representation_ind;
+		char character = 0;
+		bool is_end_of_word = false;
+		bool is_error = false;
+		const cw_ret_t cwret = cw_rec_poll_character_internal(rec, (int64_t) llround(now), &character, &is_end_of_word, &is_error);
+		if (CW_SUCCESS != cwret && EAGAIN == errno) {
+			/* Inter-mark-space. */
+			continue;
+		}
+		if (RS_IDLE != rec->state) {
+			cw_rec_reset_state(rec);
+		}
+		if (CW_SUCCESS != cwret) {
+			continue;
+		}
+
+		if (*n_decoded == capacity) {
+			errno = ENOMEM;
+			return CW_FAILURE;
+		}
+		decoded[*n_decoded].character = character;
+		decoded[*n_decoded].timestamp = *character_start;
+		(*n_decoded)++;
+
+		if (is_end_of_word) {
+			if (*n_decoded == capacity) {
+				errno = ENOMEM;
+				return CW_FAILURE;
+			}
+			decoded[*n_decoded].character = ' ';
+			decoded[*n_decoded].timestamp = *space_start;
+			(*n_decoded)++;
+		}
+	}
+
+	return CW_SUCCESS;
 }
 
 
 
 
 /**
-   @brief Reset receiver's essential parameters to their initial values
+   @brief Poll all characters completed since previous poll
 
-   @internal
-   @reviewed 2020-08-11
-   @endinternal
+   Function stores in @p decoded all characters and inter-word-spaces
+   (as ' ' character) received by @p rec since previous call, together
+   with their timestamps, and the character that is completed by
+   Space lasting at @p timestamp. This is cheaper than calling
+   cw_rec_poll_character_usecs() for each character, and the client
+   code doesn't have to poll the receiver between characters: after
+   first call of the function, beginning of a Mark that follows a
+   complete character stores the character in receiver, until next
+   call of this function. Receiver keeps up to CW_REC_BATCH_CAPACITY
+   characters; older characters are discarded when there are more.
+
+   Characters that don't fit into @p decoded are returned by next call.
+   Characters that can't be recognized are skipped.
+
+   The function can't be used for receiver with registered callback
+   (see cw_rec_register_character_callback()), and shouldn't be mixed
+   with other poll functions.
+
+   @exception EINVAL @p rec has registered callback
 
    @param[in,out] rec receiver
+   @param[in] timestamp timestamp of the poll [microseconds]
+   @param[out] decoded received characters
+   @param[in] capacity count of items that fit into @p decoded
+   @param[out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
 */
-void cw_rec_reset_parameters_internal(cw_rec_t * rec)
+cw_ret_t cw_rec_poll_batch(cw_rec_t * rec, int64_t timestamp, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
 {
-	cw_assert (NULL != rec, MSG_PREFIX "reset parameters: receiver is NULL");
+	*n_decoded = 0;
+	if (NULL != rec->character_callback) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
 
-	rec->speed = CW_SPEED_INITIAL;
-	rec->tolerance = CW_TOLERANCE_INITIAL;
-	rec->is_adaptive_receive_mode = CW_REC_ADAPTIVE_MODE_INITIAL;
-	rec->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
+	rec->is_batch_polled = true;
+	cw_rec_consume_edges_internal(rec, timestamp);
+	cw_rec_batch_collect_internal(rec, timestamp);
 
-	/* FIXME: consider resetting ->gap as well. */
+	*n_decoded = rec->batch_n < capacity ? rec->batch_n : capacity;
+	memcpy(decoded, rec->batch, *n_decoded * sizeof (cw_rec_decoded_t));
+	rec->batch_n -= *n_decoded;
+	memmove(rec->batch, rec->batch + *n_decoded, rec->batch_n * sizeof (cw_rec_decoded_t));
 
-	rec->parameters_in_sync = false;
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Store in receiver's batch the character completed at given time
+
+   The character is stored only once, even if the Space after it
+   turns out to be inter-word-space on later call. Receiver is reset
+   at end of word.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp current time on receiver's timeline [microseconds]
+*/
+static void cw_rec_batch_collect_internal(cw_rec_t * rec, int64_t timestamp)
+{
+	if (RS_IDLE == rec->state || RS_MARK == rec->state) {
+		return;
+	}
+
+	char character = 0;
+	bool is_end_of_word = false;
+	bool is_error = false;
+	if (CW_SUCCESS == cw_rec_poll_character_internal(rec, timestamp, &character, &is_end_of_word, &is_error)) {
+		if (!rec->is_character_delivered) {
+			cw_rec_batch_append_internal(rec, character, rec->character_start);
+			rec->is_character_delivered = true;
+		}
+		if (is_end_of_word) {
+			cw_rec_batch_append_internal(rec, ' ', rec->mark_end);
+			cw_rec_reset_state(rec);
+		}
+	} else if (EAGAIN != errno) {
+		/* Representation that can't be converted into a
+		   character. */
+		cw_rec_reset_state(rec);
+	} else {
+		; /* Inter-mark-space. */
+	}
 
 	return;
 }
@@ -1969,7 +3261,154 @@ void cw_rec_reset_parameters_internal(cw_rec_t * rec)
 
 
 /**
-   @brief Synchronize receivers' parameters
+   @brief Append character to receiver's batch, discarding the oldest one if the batch is full
+
+   @param[in,out] rec receiver
+   @param[in] character character, or ' ' for inter-word-space
+   @param[in] timestamp beginning of the character [microseconds]
+*/
+static void cw_rec_batch_append_internal(cw_rec_t * rec, char character, int64_t timestamp)
+{
+	if (CW_REC_BATCH_CAPACITY == rec->batch_n) {
+		memmove(rec->batch, rec->batch + 1, (CW_REC_BATCH_CAPACITY - 1) * sizeof (cw_rec_decoded_t));
+		rec->batch_n--;
+	}
+	rec->batch[rec->batch_n].character = character;
+	rec->batch[rec->batch_n].timestamp = timestamp;
+	rec->batch_n++;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Register callback informing about received characters
+
+   When a character received by @p rec becomes final (an
+   inter-character-space has elapsed after its last Mark), @p callback
+   is called with the character. When the Space grows into an
+   inter-word-space, @p callback is called with ' ' and with
+   is_end_of_word set to true. Client code doesn't have to poll @p rec
+   with cw_rec_poll_character() or cw_rec_poll_representation() and
+   shouldn't reset its state: the receiver is reset by library.
+
+   The callback is called by library's scheduler thread that serves all
+   receivers with registered callbacks, at the moment when duration of
+   Space reaches threshold of inter-character-space or inter-word-space.
+   If the thread was late, the callback may be called by a thread
+   calling cw_rec_mark_begin() for @p rec. The callback must not call
+   functions of @p rec.
+
+   Receiver's deadlines are calculated in wall-clock time, so timestamps passed to @p rec
+   must be timestamps from gettimeofday() (NULL or struct timeval
+   timestamps, or microseconds since the Epoch for *_usecs()
+   functions).
+
+   Pass NULL @p callback to unregister a callback. Callback is
+   unregistered automatically when @p rec is deleted.
+
+   @param[in,out] rec receiver
+   @param[in] callback callback to be called for received characters (may be NULL)
+   @param[in] callback_arg argument to be passed to @p callback
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_rec_register_character_callback(cw_rec_t * rec, cw_rec_character_callback_t callback, void * callback_arg)
+{
+	pthread_mutex_lock(&g_cw_rec_callback_mutex);
+	const bool was_registered = NULL != rec->character_callback;
+	rec->character_callback_arg = callback_arg;
+	rec->is_character_delivered = false;
+	if (!was_registered) {
+		cw_scheduler_entry_init_internal(&rec->scheduler_entry, cw_rec_deadline_callback_internal, rec);
+	}
+	/* Read without lock by cw_rec_push_edge_internal(). */
+	__atomic_store_n(&rec->character_callback, callback, __ATOMIC_RELEASE);
+	if (NULL != callback) {
+		cw_rec_update_deadline_internal(rec);
+	} else {
+		rec->deadline = 0;
+	}
+	pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+
+	if (NULL == callback && was_registered) {
+		/* Without lock: callback of scheduler entry may be
+		   waiting for it. */
+		cw_scheduler_cancel_internal(&rec->scheduler_entry);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+*/
+void cw_rec_reset_state(cw_rec_t * rec)
+{
+	memset(rec->representation, 0, sizeof (rec->representation));
+	rec->representation_ind = 0;
+
+#if REC_HAS_PENDING_INTER_WORD_SPACE_FLAG
+	rec->is_pending_inter_word_space = false;
+#endif
+
+	rec->is_character_delivered = false;
+	rec->deadline = 0;
+
+	cw_rec_set_state_internal(rec, RS_IDLE);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get the number of Marks (Dots/Dashes) the receiver's buffer can accommodate
+
+   The value returned by this function is the maximum number of Marks written
+   out by cw_rec_poll_representation() (not including terminating NUL).
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @return number of Marks that can be stored in receiver's representation buffer
+*/
+int cw_rec_get_receive_buffer_capacity_internal(void)
+{
+	return CW_REC_REPRESENTATION_CAPACITY;
+}
+
+
+
+
+/**
+   @brief Get number of Marks (Dots and Dashes) currently stored in receiver's representation buffer
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @param[in] rec receiver from which to get current number of Marks
+*/
+int cw_rec_get_buffer_length_internal(const cw_rec_t * rec)
+{
+	return rec->representation_ind;
+}
+
+
+
+
+/**
+   @brief Reset receiver's essential parameters to their initial values
 
    @internal
    @reviewed 2020-08-11
@@ -1977,113 +3416,248 @@ void cw_rec_reset_parameters_internal(cw_rec_t * rec)
 
    @param[in,out] rec receiver
 */
-void cw_rec_sync_parameters_internal(cw_rec_t * rec)
+void cw_rec_reset_parameters_internal(cw_rec_t * rec)
 {
-	cw_assert (NULL != rec, MSG_PREFIX "sync parameters: receiver is NULL");
+	cw_assert (NULL != rec, MSG_PREFIX "reset parameters: receiver is NULL");
 
-	/* Do nothing if we are already synchronized. */
-	if (rec->parameters_in_sync) {
-		return;
-	}
+	rec->speed = CW_SPEED_INITIAL;
+	rec->tolerance = CW_TOLERANCE_INITIAL;
+	rec->is_adaptive_receive_mode = CW_REC_ADAPTIVE_MODE_INITIAL;
+	rec->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
 
-	/* First, depending on whether we are set for fixed speed or
-	   adaptive speed, calculate either the threshold from the
-	   receive speed, or the receive speed from the threshold,
-	   knowing that the threshold is always, effectively, two dot
-	   durations.  Weighting is ignored for receive parameters,
-	   although the core unit duration is recalculated for the
-	   receive speed, which may differ from the send speed. */
+	/* FIXME: consider resetting ->gap as well. */
 
-	/* FIXME: shouldn't we move the calculation of unit_duration (that
-	   depends on rec->speed) after the calculation of
-	   rec->speed? */
-	const int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+	rec->parameters_in_sync = false;
 
-	if (rec->is_adaptive_receive_mode) {
-		rec->speed = CW_DOT_CALIBRATION	/ ((float) rec->adaptive_speed_threshold / 2.0F);
-	} else {
-		rec->adaptive_speed_threshold = 2 * unit_duration;
-	}
+	return;
+}
 
 
 
-	rec->dot_duration_ideal = unit_duration;
-	rec->dash_duration_ideal = 3 * unit_duration;
-	rec->ims_duration_ideal = unit_duration;
-	rec->ics_duration_ideal = 3 * unit_duration;
 
-	/* These two lines mimic calculations done in
-	   cw_gen_sync_parameters_internal().  See the function for
-	   more comments. */
-	rec->additional_delay = rec->gap * unit_duration;
-	rec->adjustment_delay = (7 * rec->additional_delay) / 3;
+/**
+   @brief Calculate low level timing parameters of receiver
+
+   Calculate duration ranges of Marks and Spaces for given Unit
+   duration. The calculation is shared by receivers and by timing
+   tables of compact receivers (see cw_rec_timing_new()).
+
+   @param[in] unit_duration duration of Unit at receive speed [us]
+   @param[in] tolerance tolerance of fixed speed receiving mode [percents]
+   @param[in] gap inter-character-gap, as in generator
+   @param[in] is_adaptive whether receiving mode is adaptive
+   @param[out] parameters calculated parameters
+*/
+void cw_rec_calculate_parameters_internal(int unit_duration, int tolerance, int gap, bool is_adaptive, cw_rec_parameters_t * parameters)
+{
+	parameters->dot_duration_ideal = unit_duration;
+	parameters->dash_duration_ideal = 3 * unit_duration;
+	parameters->ims_duration_ideal = unit_duration;
+	parameters->ics_duration_ideal = 3 * unit_duration;
+	parameters->adaptive_threshold = 2 * unit_duration;
+
+	/* See cw_rec_sync_parameters_internal(). */
+	const int additional_delay = gap * unit_duration;
+	const int adjustment_delay = (7 * additional_delay) / 3;
 
 	/* Set duration ranges of low level parameters. The duration
 	   ranges depend on whether we are required to adapt to the
 	   incoming Morse code speeds. */
-	if (rec->is_adaptive_receive_mode) {
+	if (is_adaptive) {
 		/* Adaptive receiving mode. */
-		rec->dot_duration_min = 0;
-		rec->dot_duration_max = 2 * rec->dot_duration_ideal;
+		parameters->dot_duration_min = 0;
+		parameters->dot_duration_max = 2 * parameters->dot_duration_ideal;
 
 		/* Any mark longer than Dot is a Dash in adaptive
 		   receiving mode. */
 
-		/* FIXME: shouldn't this be '= rec->dot_duration_max + 1'?
+		/* FIXME: shouldn't this be '= parameters->dot_duration_max + 1'?
 		   now the duration ranges for Dot and Dash overlap. */
-		rec->dash_duration_min = rec->dot_duration_max;
-		rec->dash_duration_max = INT_MAX;
-
-#if 0
-		int debug_ics_duration_max = rec->ics_duration_max;
-#endif
+		parameters->dash_duration_min = parameters->dot_duration_max;
+		parameters->dash_duration_max = INT_MAX;
 
 		/* Make the inter-mark-space be anything up to the
 		   adaptive threshold durations - that is two Dots.  And
 		   the inter-character-space is anything longer than
 		   that, and shorter than five Dots. */
-		rec->ims_duration_min = rec->dot_duration_min;
-		rec->ims_duration_max = rec->dot_duration_max;
-		rec->ics_duration_min = rec->ims_duration_max;
-		rec->ics_duration_max = 5 * rec->dot_duration_ideal;
-
-#if 0
-		if (debug_ics_duration_max != rec->ics_duration_max) {
-			fprintf(stderr, "ics_duration_max changed from %d to %d --------\n", debug_ics_duration_max, rec->ics_duration_max);
-		}
-#endif
+		parameters->ims_duration_min = parameters->dot_duration_min;
+		parameters->ims_duration_max = parameters->dot_duration_max;
+		parameters->ics_duration_min = parameters->ims_duration_max;
+		parameters->ics_duration_max = 5 * parameters->dot_duration_ideal;
 
 	} else {
 		/* Fixed speed receiving mode. */
 
 		/* Dividing by 100[%] because tolerance is in percents. */
-		const int dot_margin = (rec->dot_duration_ideal * rec->tolerance) / 100; /* [microseconds] */
+		const int dot_margin = (parameters->dot_duration_ideal * tolerance) / 100; /* [microseconds] */
 
-		rec->dot_duration_min = rec->dot_duration_ideal - dot_margin;
-		rec->dot_duration_max = rec->dot_duration_ideal + dot_margin;
+		parameters->dot_duration_min = parameters->dot_duration_ideal - dot_margin;
+		parameters->dot_duration_max = parameters->dot_duration_ideal + dot_margin;
 		/* TODO (acerion) 2023.07.27: shouldn't calculations of dash duration
 		   range be using dash_margin? */
-		rec->dash_duration_min = rec->dash_duration_ideal - dot_margin;
-		rec->dash_duration_max = rec->dash_duration_ideal + dot_margin;
+		parameters->dash_duration_min = parameters->dash_duration_ideal - dot_margin;
+		parameters->dash_duration_max = parameters->dash_duration_ideal + dot_margin;
 
 		/* Make the inter-mark-space the same as the dot
 		   duration range. */
-		rec->ims_duration_min = rec->dot_duration_min;
-		rec->ims_duration_max = rec->dot_duration_max;
+		parameters->ims_duration_min = parameters->dot_duration_min;
+		parameters->ims_duration_max = parameters->dot_duration_max;
 
 		/* Make the inter-character-space, expected to be
 		   three dots, the same as dash duration range at the
 		   lower end, but make it the same as the dash duration
 		   range _plus_ the "Farnsworth" delay at the top of
 		   the duration range. */
-		rec->ics_duration_min = rec->dash_duration_min;
-		rec->ics_duration_max = rec->dash_duration_max
-			+ rec->additional_delay + rec->adjustment_delay;
+		parameters->ics_duration_min = parameters->dash_duration_min;
+		parameters->ics_duration_max = parameters->dash_duration_max
+			+ additional_delay + adjustment_delay;
 
 		/* Any space longer than ics_duration_max is by implication
 		   inter-word-space. */
 	}
 
+	return;
+}
+
+
+
+
+/**
+   @brief Copy low level timing parameters into receiver
+
+   Receiver's adaptive speed threshold is not changed.
+
+   @param[in,out] rec receiver
+   @param[in] parameters parameters calculated by cw_rec_calculate_parameters_internal()
+*/
+static void cw_rec_apply_parameters_internal(cw_rec_t * rec, const cw_rec_parameters_t * parameters)
+{
+	rec->dot_duration_ideal = parameters->dot_duration_ideal;
+	rec->dot_duration_min = parameters->dot_duration_min;
+	rec->dot_duration_max = parameters->dot_duration_max;
+
+	rec->dash_duration_ideal = parameters->dash_duration_ideal;
+	rec->dash_duration_min = parameters->dash_duration_min;
+	rec->dash_duration_max = parameters->dash_duration_max;
+
+	rec->ims_duration_ideal = parameters->ims_duration_ideal;
+	rec->ims_duration_min = parameters->ims_duration_min;
+	rec->ims_duration_max = parameters->ims_duration_max;
+
+	rec->ics_duration_ideal = parameters->ics_duration_ideal;
+	rec->ics_duration_min = parameters->ics_duration_min;
+	rec->ics_duration_max = parameters->ics_duration_max;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Synchronize parameters of receiver in adaptive mode to new adaptive threshold
+
+   Lighter variant of cw_rec_sync_parameters_internal() called after
+   each Mark received in adaptive mode. Only the speed and parameters
+   derived from it are calculated, and speed is clamped to valid range
+   without re-synchronizing the receiver twice.
+
+   Results are the same as those of the full synchronization: unit
+   duration is calculated from speed from before the update, unless
+   the speed had to be clamped.
+
+   @param[in,out] rec receiver
+*/
+static void cw_rec_sync_adaptive_parameters_internal(cw_rec_t * rec)
+{
+	int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+
+	rec->speed = CW_DOT_CALIBRATION / ((float) rec->adaptive_speed_threshold / 2.0F);
+	if (rec->speed < CW_SPEED_MIN || rec->speed > CW_SPEED_MAX) {
+		const float clamped = rec->speed < CW_SPEED_MIN ? CW_SPEED_MIN : CW_SPEED_MAX;
+		unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / clamped);
+		rec->adaptive_speed_threshold = 2 * unit_duration;
+		rec->speed = CW_DOT_CALIBRATION / ((float) rec->adaptive_speed_threshold / 2.0F);
+	}
+
+	rec->additional_delay = rec->gap * unit_duration;
+	rec->adjustment_delay = (7 * rec->additional_delay) / 3;
+
+	cw_rec_parameters_t parameters;
+	cw_rec_calculate_parameters_internal(unit_duration, rec->tolerance, rec->gap, true, &parameters);
+	cw_rec_apply_parameters_internal(rec, &parameters);
+
+	rec->parameters_in_sync = true;
+}
+
+
+
+
+/**
+   @brief Synchronize receivers' parameters
+
+   @internal
+   @reviewed 2020-08-11
+   @endinternal
+
+   @param[in,out] rec receiver
+*/
+void cw_rec_sync_parameters_internal(cw_rec_t * rec)
+{
+	cw_assert (NULL != rec, MSG_PREFIX "sync parameters: receiver is NULL");
+
+	/* Do nothing if we are already synchronized. */
+	if (rec->parameters_in_sync) {
+		return;
+	}
+
+	/* First, depending on whether we are set for fixed speed or
+	   adaptive speed, calculate either the threshold from the
+	   receive speed, or the receive speed from the threshold,
+	   knowing that the threshold is always, effectively, two dot
+	   durations.  Weighting is ignored for receive parameters,
+	   although the core unit duration is recalculated for the
+	   receive speed, which may differ from the send speed. */
+
+	/* FIXME: shouldn't we move the calculation of unit_duration (that
+	   depends on rec->speed) after the calculation of
+	   rec->speed? */
+	const int unit_duration = (int) floorf((float) CW_DOT_CALIBRATION / rec->speed);
+
+	if (rec->is_adaptive_receive_mode) {
+		rec->speed = CW_DOT_CALIBRATION	/ ((float) rec->adaptive_speed_threshold / 2.0F);
+	} else {
+		rec->adaptive_speed_threshold = 2 * unit_duration;
+	}
+
+
+
+	/* These two lines mimic calculations done in
+	   cw_gen_sync_parameters_internal().  See the function for
+	   more comments. */
+	rec->additional_delay = rec->gap * unit_duration;
+	rec->adjustment_delay = (7 * rec->additional_delay) / 3;
+
+	/* Parameters are shared with other receivers and generators
+	   with the same settings. Tolerance is not used in adaptive
+	   mode, so it's not a part of key in that mode. */
+	cw_timing_key_t key;
+	cw_timing_key_init_internal(&key, unit_duration, rec->gap);
+	key.is_adaptive = rec->is_adaptive_receive_mode;
+	if (!rec->is_adaptive_receive_mode) {
+		key.tolerance = rec->tolerance;
+	}
+	const cw_timing_t * timing = cw_timing_acquire_internal(&key);
+	cw_timing_release_internal(&rec->timing);
+	if (NULL != timing) {
+		rec->timing = timing;
+		cw_rec_apply_parameters_internal(rec, &timing->rec_parameters);
+	} else {
+		cw_rec_parameters_t parameters;
+		cw_rec_calculate_parameters_internal(unit_duration, rec->tolerance, rec->gap, rec->is_adaptive_receive_mode, &parameters);
+		cw_rec_apply_parameters_internal(rec, &parameters);
+	}
+
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_PARAMETERS, CW_DEBUG_INFO,
 		      MSG_PREFIX "'%s': sync parameters: receiver timings [us] at speed %.2f [wpm]:\n"
 		      "[II] " MSG_PREFIX "    dot:    min: %11d   max: %11d\n"
@@ -2166,3 +3740,302 @@ int cw_rec_get_label(const cw_rec_t * rec, char * label, size_t size)
 
 	return CW_SUCCESS;
 }
+
+
+
+
+/**
+   @brief Convert struct timeval timestamp to microseconds
+
+   If @p timestamp is NULL, current time is used.
+
+   @param[in] timestamp timestamp to be validated and converted (may be NULL)
+   @param[out] usecs microseconds since the Epoch
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE if @p timestamp is invalid or current time can't be got
+*/
+static cw_ret_t cw_rec_timestamp_to_usecs_internal(const struct timeval * timestamp, int64_t * usecs)
+{
+	struct timeval valid = { 0 };
+	if (CW_SUCCESS != cw_timestamp_validate_internal(&valid, timestamp)) {
+		return CW_FAILURE;
+	}
+	*usecs = (int64_t) valid.tv_sec * CW_USECS_PER_SEC + valid.tv_usec;
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Calculate duration between two timestamps on receiver's timeline
+
+   Like cw_timestamp_compare_internal(), the function clamps durations
+   that are negative or don't fit into an int to INT_MAX.
+
+   @param[in] earlier earlier timestamp [microseconds]
+   @param[in] later later timestamp [microseconds]
+
+   @return duration between timestamps [microseconds]
+*/
+static int cw_rec_duration_internal(int64_t earlier, int64_t later)
+{
+	const int64_t delta = later - earlier;
+	if (delta < 0 || delta > INT_MAX) {
+		return INT_MAX;
+	}
+	return (int) delta;
+}
+
+
+
+
+
+/**
+   @brief Poll receiver with callback at its deadline
+
+   Function is called by library's scheduler thread.
+
+   @param[in] arg receiver
+*/
+static void cw_rec_deadline_callback_internal(void * arg)
+{
+	cw_rec_t * rec = (cw_rec_t *) arg;
+
+	pthread_mutex_lock(&g_cw_rec_callback_mutex);
+	if (NULL == rec->character_callback) {
+		pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+		return;
+	}
+
+	/* Two events for each edge, and two for the poll below. */
+	cw_rec_callback_event_t events[2 * CW_REC_EDGE_QUEUE_CONSUME_MAX + 2];
+	int n_events = cw_rec_consume_edges_locked_internal(rec, events);
+	if (0 != rec->deadline) {
+		struct timeval now_tv = { 0 };
+		gettimeofday(&now_tv, NULL);
+		const int64_t now = (int64_t) now_tv.tv_sec * CW_USECS_PER_SEC + now_tv.tv_usec;
+		if (now < rec->deadline) {
+			/* Wall clock and monotonic clock went apart, or
+			   the callback was called for queued edges. */
+			cw_rec_update_deadline_internal(rec);
+		} else {
+			n_events += cw_rec_poll_deadline_internal(rec, now, events + n_events);
+		}
+	} else {
+		; /* Deadline has been cancelled by new Mark. */
+	}
+	const cw_rec_character_callback_t callback = rec->character_callback;
+	void * callback_arg = rec->character_callback_arg;
+	pthread_mutex_unlock(&g_cw_rec_callback_mutex);
+
+	/* Don't touch @p rec from now on: callback may delete it. */
+	cw_rec_call_callback_internal(callback, callback_arg, events, n_events);
+}
+
+
+
+
+/**
+   @brief Inform receiver with callback about beginning of a Mark
+
+   Call with g_cw_rec_callback_mutex locked.
+
+   @param[in,out] rec receiver
+   @param[in] timestamp timestamp of beginning of Mark [microseconds]
+   @param[out] events events to be passed to callback of @p rec (space for two events after @p n_events)
+   @param[in,out] n_events count of items in @p events
+
+   @return result of cw_rec_mark_begin_internal(), with errno set by it
+*/
+static cw_ret_t cw_rec_mark_begin_locked_internal(cw_rec_t * rec, int64_t timestamp, cw_rec_callback_event_t * events, int * n_events)
+{
+	/* Scheduler thread may have not yet polled a character or
+	   inter-word-space that ended before this Mark. */
+	if (0 != rec->deadline && timestamp >= rec->deadline) {
+		*n_events += cw_rec_poll_deadline_internal(rec, timestamp, events + *n_events);
+	}
+	if (RS_EOC_GAP == rec->state || RS_EOC_GAP_ERR == rec->state) {
+		/* Character has been passed to callback, and the Space
+		   after it turned out to be inter-character-space. */
+		cw_rec_reset_state(rec);
+	}
+	const cw_ret_t cwret = cw_rec_mark_begin_internal(rec, timestamp);
+	const int saved_errno = errno;
+	cw_rec_update_deadline_internal(rec);
+	errno = saved_errno;
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Pass edges from receiver's queue to receiver with callback
+
+   Call with g_cw_rec_callback_mutex locked. At most
+   CW_REC_EDGE_QUEUE_CONSUME_MAX edges are taken from the queue. If more
+   edges are left, cw_rec_update_deadline_internal() schedules next
+   call of receiver's deadline callback immediately.
+
+   @param[in,out] rec receiver
+   @param[out] events events to be passed to callback of @p rec (space for two events per edge)
+
+   @return count of events in @p events
+*/
+static int cw_rec_consume_edges_locked_internal(cw_rec_t * rec, cw_rec_callback_event_t * events)
+{
+	int n_events = 0;
+	uint64_t head = rec->edge_queue_head;
+	const uint64_t tail = __atomic_load_n(&rec->edge_queue_tail, __ATOMIC_ACQUIRE);
+	for (int i = 0; head != tail && i < CW_REC_EDGE_QUEUE_CONSUME_MAX; i++) {
+		const cw_rec_queued_edge_t edge = rec->edge_queue[head & (CW_REC_EDGE_QUEUE_CAPACITY - 1)];
+		/* Head is moved before the edge is processed, so that
+		   cw_rec_update_deadline_internal() sees only edges that
+		   are still waiting. */
+		__atomic_store_n(&rec->edge_queue_head, ++head, __ATOMIC_RELEASE);
+		if (edge.is_mark_begin) {
+			cw_rec_mark_begin_locked_internal(rec, edge.timestamp, events, &n_events);
+		} else {
+			cw_rec_mark_end_internal(rec, edge.timestamp);
+			cw_rec_update_deadline_internal(rec);
+		}
+	}
+
+	return n_events;
+}
+
+
+
+
+/**
+   @brief Poll receiver whose deadline has passed
+
+   Call with g_cw_rec_callback_mutex locked.
+
+   @param[in,out] rec receiver to poll
+   @param[in] now current time on receiver's timeline [microseconds]
+   @param[out] events character and/or inter-word-space to be passed to callback of @p rec (space for two events)
+
+   @return count of events in @p events
+*/
+static int cw_rec_poll_deadline_internal(cw_rec_t * rec, int64_t now, cw_rec_callback_event_t * events)
+{
+	int n_events = 0;
+
+	char character = 0;
+	bool is_end_of_word = false;
+	bool is_error = false;
+	if (CW_SUCCESS == cw_rec_poll_character_internal(rec, now, &character, &is_end_of_word, &is_error)) {
+		if (!rec->is_character_delivered) {
+			events[n_events].character = character;
+			events[n_events].is_end_of_word = false;
+			events[n_events].is_error = is_error;
+			n_events++;
+			rec->is_character_delivered = true;
+		}
+		if (is_end_of_word) {
+			events[n_events].character = ' ';
+			events[n_events].is_end_of_word = true;
+			events[n_events].is_error = false;
+			n_events++;
+			cw_rec_reset_state(rec);
+		}
+	} else if (EAGAIN != errno) {
+		/* Representation that can't be converted into a
+		   character, or receiver in state that won't change
+		   without new Marks. */
+		cw_rec_reset_state(rec);
+	} else {
+		; /* Thread woke up too early. */
+	}
+
+	cw_rec_update_deadline_internal(rec);
+
+	return n_events;
+}
+
+
+
+
+/**
+   @brief Calculate time of next poll of receiver with callback
+
+   Call with g_cw_rec_callback_mutex locked. Deadline on receiver's
+   timeline (wall-clock) is converted into deadline on scheduler's
+   timeline (monotonic clock).
+
+   When receiver doesn't need a deadline, its entry in scheduler is not
+   cancelled (this could deadlock with scheduler thread waiting for
+   g_cw_rec_callback_mutex). The scheduled callback will notice that the
+   deadline is gone.
+
+   @param[in,out] rec receiver
+*/
+static void cw_rec_update_deadline_internal(cw_rec_t * rec)
+{
+	cw_rec_sync_parameters_internal(rec);
+
+	switch (rec->state) {
+	case RS_INTER_MARK_SPACE:
+		rec->deadline = rec->mark_end + rec->ics_duration_min;
+		break;
+	case RS_EOC_GAP:
+	case RS_EOC_GAP_ERR:
+		rec->deadline = rec->mark_end + rec->ics_duration_max + 1;
+		break;
+	case RS_IDLE:
+	case RS_MARK:
+	case RS_EOW_GAP:
+	case RS_EOW_GAP_ERR:
+	default:
+		rec->deadline = 0;
+		break;
+	}
+
+	if (0 != rec->deadline) {
+		struct timeval now = { 0 };
+		gettimeofday(&now, NULL);
+		const int64_t until = rec->deadline - ((int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec);
+		if (!cw_scheduler_schedule_internal(&rec->scheduler_entry, cw_scheduler_now_internal() + until)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "'%s': failed to schedule deadline", rec->label);
+		}
+	}
+
+	/* Edges pushed to receiver's queue are consumed by deadline
+	   callback. The fence pairs with the one in
+	   cw_rec_push_edge_internal(). */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (rec->edge_queue_head != __atomic_load_n(&rec->edge_queue_tail, __ATOMIC_ACQUIRE)) {
+		if (!cw_scheduler_schedule_internal(&rec->scheduler_entry, cw_scheduler_now_internal())) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "'%s': failed to schedule consumption of queued edges", rec->label);
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Pass polled characters and inter-word-spaces to receiver's callback
+
+   Call without g_cw_rec_callback_mutex locked.
+
+   @param[in] callback callback of receiver
+   @param[in] callback_arg argument of callback
+   @param[in] events events to pass to @p callback
+   @param[in] n_events count of items in @p events
+*/
+static void cw_rec_call_callback_internal(cw_rec_character_callback_t callback, void * callback_arg, const cw_rec_callback_event_t * events, int n_events)
+{
+	if (NULL == callback) {
+		return;
+	}
+	for (int i = 0; i < n_events; i++) {
+		callback(callback_arg, events[i].character, events[i].is_end_of_word, events[i].is_error);
+	}
+}
@@ -10,6 +10,7 @@
 
 
 #include <stdbool.h>
+#include <stdint.h> /* int64_t */
 #include <sys/time.h> /* struct timeval */
 
 
@@ -18,6 +19,7 @@
 #include "libcw.h"
 #include "libcw2.h"
 #include "libcw_debug.h"
+#include "libcw_scheduler.h"
 
 
 
@@ -68,10 +70,21 @@ enum { CW_REC_REPRESENTATION_CAPACITY = 256 };
 enum { CW_REC_DURATION_STATS_CAPACITY = 256 };
 
 
-/* Length of array used to calculate average duration of a mark. Average
-   duration of a mark is used in adaptive receiving mode to track speed
-   of incoming Morse data. */
+/* Default and maximal count of marks used to calculate average duration
+   of a mark. Average duration of a mark is used in adaptive receiving
+   mode to track speed of incoming Morse data. */
 enum { CW_REC_AVERAGING_DURATIONS_COUNT = 4 };
+enum { CW_REC_AVERAGING_WINDOW_MAX = 32 };
+
+
+/* Count of characters and inter-word-spaces kept by receiver until
+   they are read with cw_rec_poll_batch(). */
+enum { CW_REC_BATCH_CAPACITY = 64 };
+
+
+/* Capacity of receiver's queue of beginnings and ends of Marks, see
+   cw_rec_push_mark_begin(). Must be a power of two. */
+enum { CW_REC_EDGE_QUEUE_CAPACITY = 256 };
 
 
 /* Types of receiver's timing statistics.
@@ -91,18 +104,43 @@ typedef struct {
 } cw_rec_duration_stats_point_t;
 
 
+/* Running totals of records of one type in the statistics buffer.
+   Updated when a record is added to or evicted from the buffer, so
+   that statistics can be returned without scanning the buffer. */
+typedef struct {
+	int64_t sum;             /* Sum of duration deltas. [us] */
+	int64_t sum_of_squares;  /* Sum of squares of duration deltas. [us^2] */
+	int count;               /* Count of records of given type. */
+} cw_rec_duration_stats_totals_t;
+
+enum { CW_REC_STAT_TYPES_COUNT = CW_REC_STAT_INTER_CHARACTER_SPACE + 1 };
+
+
 /* A moving averages structure - circular buffer. Used for calculating
    averaged duration ([us]) of dots and dashes. */
 typedef struct {
-	int buffer[CW_REC_AVERAGING_DURATIONS_COUNT];  /* Buffered mark durations. */
-	int cursor;                                    /* Circular buffer cursor. */
-	int sum;                                       /* Running sum of durations of marks. [us] */
-	int average;                                   /* Averaged duration of a mark. [us] */
+	int buffer[CW_REC_AVERAGING_WINDOW_MAX];  /* Buffered mark durations. */
+	int cursor;                               /* Circular buffer cursor. */
+	int sum;                                  /* Running sum of durations of marks. [us] */
+	float ewma;                               /* Exponentially weighted average of durations of marks. [us] */
+	int average;                              /* Averaged duration of a mark. [us] */
+
+	cw_rec_averaging_mode_t mode;
+	int window;                               /* Count of marks used by moving average and median (weight of exponential average). */
 } cw_rec_averaging_t;
 
 
 
 
+/* Beginning or end of Mark in receiver's queue. */
+typedef struct {
+	int64_t timestamp;   /* [us] */
+	bool is_mark_begin;
+} cw_rec_queued_edge_t;
+
+
+
+
 typedef struct cw_rec_parameters_t {
 
 	int dot_duration_ideal;
@@ -160,9 +198,11 @@ struct cw_rec_struct {
 
 
 
-	/* Retained timestamps of mark's begin and end. */
-	struct timeval mark_start;
-	struct timeval mark_end;
+	/* Retained timestamps of mark's begin and end. Microseconds on
+	   client's timeline (for struct timeval timestamps: since the
+	   Epoch). */
+	int64_t mark_start; /* [microseconds]/[us] */
+	int64_t mark_end;   /* [microseconds]/[us] */
 
 	/* Buffer for received representation (dots/dashes). This is a
 	   fixed-length buffer, filled in as tone on/off timings are
@@ -174,6 +214,20 @@ struct cw_rec_struct {
 	char representation[CW_REC_REPRESENTATION_CAPACITY + 1];
 	int representation_ind;
 
+	/* The same representation as bits: Dash is 1, Dot is 0, last
+	   received Mark is in the lowest bit. Together with
+	   ->representation_ind the bits give hash of representation
+	   (see cw_representation_to_hash_internal()), so characters are
+	   looked up without building and parsing a string. Bits above
+	   ->representation_ind are stale and are masked out. */
+	unsigned int representation_bits;
+
+	/* Durations of Marks in representation buffer, and flag of
+	   soft-decision decoding of characters from the durations, see
+	   cw_rec_set_soft_decision(). */
+	int mark_durations[CW_REC_REPRESENTATION_CAPACITY]; /* [us] */
+	bool is_soft_decision;
+
 
 
 	/* Receiver's low-level timing parameters */
@@ -184,7 +238,15 @@ struct cw_rec_struct {
 	/* These are basic timing parameters which should be
 	   recalculated each time client code demands changing some
 	   higher-level parameter of receiver.  How these values are
-	   calculated depends on receiving mode (fixed/adaptive). */
+	   calculated depends on receiving mode (fixed/adaptive).
+
+	   The values are copied from ::timing: block of durations
+	   shared with generators and receivers that have the same
+	   parameters (see libcw_timing.c). Receiver keeps its own
+	   copy because in adaptive mode the values are recalculated
+	   after each Mark, and because they are read for every Mark
+	   and Space. */
+	const struct cw_timing_struct * timing;
 	int dot_duration_ideal;        /* Duration of an ideal dot. [microseconds]/[us] */
 	int dot_duration_min;          /* Minimal duration of mark that will be identified as dot. [us] */
 	int dot_duration_max;          /* Maximal duration of mark that will be identified as dot. [us] */
@@ -224,6 +286,14 @@ struct cw_rec_struct {
 	   circular buffer pointer. */
 	cw_rec_duration_stats_point_t duration_stats[CW_REC_DURATION_STATS_CAPACITY];
 	int duration_stats_idx;
+	cw_rec_duration_stats_totals_t duration_stats_totals[CW_REC_STAT_TYPES_COUNT];
+
+
+
+	/* Runtime metrics, see cw_rec_get_metrics(). Written by
+	   thread feeding the receiver, may be read by any thread.
+	   Accessed with relaxed atomic operations. */
+	cw_rec_metrics_t metrics;
 
 
 
@@ -241,6 +311,33 @@ struct cw_rec_struct {
 	bool is_pending_inter_word_space;
 #endif
 
+	/* Callback informing client code about received characters,
+	   see cw_rec_register_character_callback(). The receiver is
+	   polled by library's scheduler thread at ->deadline. */
+	cw_rec_character_callback_t character_callback;
+	void * character_callback_arg;
+	int64_t deadline; /* [microseconds] Zero: no deadline. */
+	bool is_character_delivered; /* Was character from representation buffer passed to callback (or to batch)? */
+	cw_scheduler_entry_t scheduler_entry;
+
+	/* Characters and inter-word-spaces completed by beginnings of
+	   Marks, not yet read with cw_rec_poll_batch(). Receiver collects
+	   them only after first call of cw_rec_poll_batch(). */
+	bool is_batch_polled;
+	cw_rec_decoded_t batch[CW_REC_BATCH_CAPACITY];
+	size_t batch_n;
+	int64_t character_start; /* [microseconds] Beginning of first Mark of current character. */
+
+	/* Single-producer, single-consumer queue of beginnings and ends
+	   of Marks, see cw_rec_push_mark_begin(). ::edge_queue_tail is
+	   written only by producer, ::edge_queue_head only by thread
+	   consuming the edges; both are accessed with atomic operations
+	   and only grow (index of item is the counter modulo
+	   CW_REC_EDGE_QUEUE_CAPACITY). */
+	cw_rec_queued_edge_t edge_queue[CW_REC_EDGE_QUEUE_CAPACITY];
+	uint64_t edge_queue_head;
+	uint64_t edge_queue_tail;
+
 	char label[LIBCW_OBJECT_INSTANCE_LABEL_SIZE];
 };
 
@@ -250,6 +347,10 @@ struct cw_rec_struct {
 /* Other helper functions. */
 void cw_rec_reset_parameters_internal(cw_rec_t * rec);
 void cw_rec_sync_parameters_internal(cw_rec_t * rec);
+void cw_rec_calculate_parameters_internal(int unit_duration, int tolerance, int gap, bool is_adaptive, cw_rec_parameters_t * parameters);
+cw_ret_t cw_rec_profile_unit_internal(const cw_rec_profile_t * profile, int * unit_duration);
+int cw_rec_profile_speed_internal(int unit_duration);
+cw_ret_t cw_rec_receive_edges_internal(cw_rec_t * rec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded, int64_t * character_start, int64_t * space_start);
 void cw_rec_get_parameters_internal(cw_rec_t * rec,
 				    int * dot_duration_ideal, int * dash_duration_ideal,
 				    int * dot_duration_min,   int * dot_duration_max,
@@ -0,0 +1,500 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_rec_compact.c
+
+   @brief Compact receivers for decoding thousands of signals at once.
+
+   cw_rec_t keeps a representation buffer, durations of Marks, a ring
+   of timing statistics, averaging buffers, a label and its own copy of
+   timing parameters: several kilobytes per receiver. An application
+   decoding every carrier in a wide band (see libcw_skimmer.c) needs
+   thousands of receivers, and most of that memory is never touched.
+
+   A compact receiver keeps only what changes while receiving: times of
+   last Mark, representation as bits, state, speed, and (in adaptive
+   mode) exponential average of duration of Unit. Timing
+   parameters are looked up by speed in a read-only table shared by all
+   receivers (cw_rec_timing_t), calculated with the same function as
+   parameters of cw_rec_t (cw_rec_calculate_parameters_internal()).
+   Statistics are optional and may be shared by many receivers.
+
+   Receivers are updated in batches: one event for each receiver of an
+   array in one call, so the loop runs over contiguous memory.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h> /* INT_MAX */
+#include <math.h> /* sqrtf() */
+#include <stdlib.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_data.h"
+#include "libcw_debug.h"
+#include "libcw_rec.h"
+#include "libcw_rec_compact.h"
+
+
+
+
+#define MSG_PREFIX "libcw/rec compact: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Count of Marks of character that is going to be reported as error:
+   it had Mark that was neither Dot nor Dash, or too many Marks. */
+#define CW_REC_COMPACT_N_MARKS_ERROR (CW_DATA_MAX_REPRESENTATION_LENGTH + 1)
+
+/* Indexes of cw_rec_compact_stats_t arrays. */
+enum {
+	CW_REC_COMPACT_STAT_DOT = 0,
+	CW_REC_COMPACT_STAT_DASH,
+	CW_REC_COMPACT_STAT_INTER_MARK_SPACE,
+	CW_REC_COMPACT_STAT_INTER_CHARACTER_SPACE
+};
+
+
+
+
+static bool cw_rec_compact_mark_begin_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_output_t * output, cw_rec_compact_stats_t * stats);
+static void cw_rec_compact_mark_end_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_stats_t * stats);
+static bool cw_rec_compact_poll_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_output_t * output, cw_rec_compact_stats_t * stats);
+static void cw_rec_compact_update_speed_internal(cw_rec_compact_t * rec, int mark_duration, bool is_dash);
+static void cw_rec_compact_stats_add_internal(cw_rec_compact_stats_t * stats, int type, int delta);
+static int cw_rec_compact_duration_internal(int64_t earlier, int64_t later);
+
+
+
+
+cw_rec_timing_t * cw_rec_timing_new(int tolerance, int gap)
+{
+	if (tolerance < CW_TOLERANCE_MIN || tolerance > CW_TOLERANCE_MAX
+	    || gap < CW_GAP_MIN || gap > CW_GAP_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_rec_timing_t * timing = calloc(1, sizeof (cw_rec_timing_t));
+	if (NULL == timing) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	timing->noise_spike_threshold = CW_REC_NOISE_THRESHOLD_INITIAL;
+	for (int i = 0; i < CW_REC_TIMING_N_SPEEDS; i++) {
+		const int unit_duration = CW_DOT_CALIBRATION / (CW_SPEED_MIN + i);
+		cw_rec_calculate_parameters_internal(unit_duration, tolerance, gap, false, &timing->parameters[i][0]);
+		cw_rec_calculate_parameters_internal(unit_duration, tolerance, gap, true, &timing->parameters[i][1]);
+	}
+
+	return timing;
+}
+
+
+
+
+void cw_rec_timing_delete(cw_rec_timing_t ** timing)
+{
+	if (NULL == timing || NULL == *timing) {
+		return;
+	}
+
+	free(*timing);
+	*timing = NULL;
+}
+
+
+
+
+cw_ret_t cw_rec_compact_init(cw_rec_compact_t * rec, int speed, bool is_adaptive)
+{
+	if (NULL == rec || speed < CW_SPEED_MIN || speed > CW_SPEED_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	const int unit_duration = CW_DOT_CALIBRATION / speed;
+	*rec = (cw_rec_compact_t) {
+		.unit_average = unit_duration,
+		.state = RS_IDLE,
+		.speed = (uint8_t) speed,
+		.is_adaptive = is_adaptive,
+	};
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_rec_compact_get_speed(const cw_rec_compact_t * rec)
+{
+	return rec->speed;
+}
+
+
+
+
+cw_ret_t cw_rec_compact_set_profile(cw_rec_compact_t * rec, const cw_rec_profile_t * profile)
+{
+	int unit_duration = 0;
+	if (NULL == rec || CW_SUCCESS != cw_rec_profile_unit_internal(profile, &unit_duration)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	rec->unit_average = unit_duration;
+	rec->speed = (uint8_t) cw_rec_profile_speed_internal(unit_duration);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+size_t cw_rec_compact_update(const cw_rec_timing_t * timing, cw_rec_compact_t * recs, const cw_rec_compact_input_t * inputs, cw_rec_compact_output_t * outputs, size_t n, cw_rec_compact_stats_t * stats)
+{
+	size_t n_reported = 0;
+	for (size_t i = 0; i < n; i++) {
+		cw_rec_compact_t * rec = &recs[i];
+		cw_rec_compact_output_t * output = &outputs[i];
+		*output = (cw_rec_compact_output_t) { 0 };
+
+		bool is_reported = false;
+		switch (inputs[i].event) {
+		case CW_REC_COMPACT_MARK_BEGIN:
+			is_reported = cw_rec_compact_mark_begin_internal(timing, rec, inputs[i].timestamp, output, stats);
+			break;
+		case CW_REC_COMPACT_MARK_END:
+			cw_rec_compact_mark_end_internal(timing, rec, inputs[i].timestamp, stats);
+			break;
+		case CW_REC_COMPACT_POLL:
+		default:
+			is_reported = cw_rec_compact_poll_internal(timing, rec, inputs[i].timestamp, output, stats);
+			break;
+		}
+		if (is_reported) {
+			n_reported++;
+		}
+	}
+
+	return n_reported;
+}
+
+
+
+
+cw_ret_t cw_rec_compact_get_statistics(const cw_rec_compact_stats_t * stats, cw_rec_statistics_t * statistics)
+{
+	if (NULL == stats || NULL == statistics) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_duration_statistics_t * results[] = { &statistics->dot, &statistics->dash, &statistics->inter_mark_space, &statistics->inter_character_space };
+	for (size_t i = 0; i < sizeof (results) / sizeof (results[0]); i++) {
+		results[i]->count = stats->count[i];
+		if (0 == stats->count[i]) {
+			results[i]->mean_delta = 0.0F;
+			results[i]->sd = 0.0F;
+		} else {
+			results[i]->mean_delta = (float) stats->sum[i] / (float) stats->count[i];
+			results[i]->sd = sqrtf((float) stats->sum_of_squares[i] / (float) stats->count[i]);
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Handle beginning of Mark in compact receiver
+
+   Space that ends here completes the character if it is at least as
+   long as inter-character-space. Such character is reported (unless
+   it has been already reported by poll), and the Mark begins a new
+   character.
+
+   @param[in] timing timing table
+   @param[in,out] rec receiver
+   @param[in] timestamp time of beginning of Mark [us]
+   @param[out] output result of update
+   @param[in,out] stats statistics (may be NULL)
+
+   @return true if a character or an error has been reported through @p output
+   @return false otherwise
+*/
+static bool cw_rec_compact_mark_begin_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_output_t * output, cw_rec_compact_stats_t * stats)
+{
+	if (RS_MARK == rec->state) {
+		/* Beginning of Mark was already seen. */
+		return false;
+	}
+
+	bool is_reported = false;
+	if (RS_INTER_MARK_SPACE == rec->state) {
+		const cw_rec_parameters_t * parameters = &timing->parameters[rec->speed - CW_SPEED_MIN][rec->is_adaptive];
+		const int space_duration = cw_rec_compact_duration_internal(rec->mark_end, timestamp);
+		if (space_duration < parameters->ics_duration_min) {
+			/* Next Mark of the same character. */
+			cw_rec_compact_stats_add_internal(stats, CW_REC_COMPACT_STAT_INTER_MARK_SPACE, space_duration - parameters->ims_duration_ideal);
+			rec->mark_start = timestamp;
+			rec->state = RS_MARK;
+			return false;
+		}
+		is_reported = cw_rec_compact_poll_internal(timing, rec, timestamp, output, stats);
+	}
+
+	/* Beginning of new character. */
+	rec->representation_bits = 0;
+	rec->n_marks = 0;
+	rec->mark_start = timestamp;
+	rec->state = RS_MARK;
+
+	return is_reported;
+}
+
+
+
+
+/**
+   @brief Handle end of Mark in compact receiver
+
+   Mark not longer than noise spike threshold is ignored. Other Marks
+   are identified as Dot or Dash and appended to representation. Mark
+   that can't be identified, or that doesn't fit into representation,
+   turns the character into an error (see
+   CW_REC_COMPACT_N_MARKS_ERROR).
+
+   @param[in] timing timing table
+   @param[in,out] rec receiver
+   @param[in] timestamp time of end of Mark [us]
+   @param[in,out] stats statistics (may be NULL)
+*/
+static void cw_rec_compact_mark_end_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_stats_t * stats)
+{
+	if (RS_MARK != rec->state) {
+		return;
+	}
+
+	const int mark_duration = cw_rec_compact_duration_internal(rec->mark_start, timestamp);
+	if (timing->noise_spike_threshold > 0 && mark_duration <= timing->noise_spike_threshold) {
+		/* Back to state from before the spike. */
+		rec->state = 0 == rec->n_marks ? RS_IDLE : RS_INTER_MARK_SPACE;
+		return;
+	}
+
+	rec->mark_end = timestamp;
+
+	const cw_rec_parameters_t * parameters = &timing->parameters[rec->speed - CW_SPEED_MIN][rec->is_adaptive];
+	bool is_dash = false;
+	if (mark_duration >= parameters->dot_duration_min && mark_duration <= parameters->dot_duration_max) {
+		is_dash = false;
+	} else if (mark_duration >= parameters->dash_duration_min && mark_duration <= parameters->dash_duration_max) {
+		is_dash = true;
+	} else {
+		/* Character will be reported as error. */
+		rec->n_marks = CW_REC_COMPACT_N_MARKS_ERROR;
+		rec->state = RS_INTER_MARK_SPACE;
+		return;
+	}
+
+	if (rec->is_adaptive) {
+		cw_rec_compact_update_speed_internal(rec, mark_duration, is_dash);
+		parameters = &timing->parameters[rec->speed - CW_SPEED_MIN][1];
+	}
+	if (is_dash) {
+		cw_rec_compact_stats_add_internal(stats, CW_REC_COMPACT_STAT_DASH, mark_duration - parameters->dash_duration_ideal);
+	} else {
+		cw_rec_compact_stats_add_internal(stats, CW_REC_COMPACT_STAT_DOT, mark_duration - parameters->dot_duration_ideal);
+	}
+
+	if (rec->n_marks >= CW_DATA_MAX_REPRESENTATION_LENGTH) {
+		/* Too many Marks for a valid character. */
+		rec->n_marks = CW_REC_COMPACT_N_MARKS_ERROR;
+	} else {
+		rec->representation_bits = (uint8_t) ((rec->representation_bits << 1U) | (is_dash ? 1U : 0U));
+		rec->n_marks++;
+	}
+	rec->state = RS_INTER_MARK_SPACE;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if Space after last Mark completes character or word
+
+   @param[in] timing timing table
+   @param[in,out] rec receiver
+   @param[in] timestamp current time [us]
+   @param[out] output result of update
+   @param[in,out] stats statistics (may be NULL)
+
+   @return true if a character, an error or an inter-word-space has been reported through @p output
+   @return false otherwise
+*/
+static bool cw_rec_compact_poll_internal(const cw_rec_timing_t * timing, cw_rec_compact_t * rec, int64_t timestamp, cw_rec_compact_output_t * output, cw_rec_compact_stats_t * stats)
+{
+	if (RS_INTER_MARK_SPACE != rec->state && RS_EOC_GAP != rec->state && RS_EOC_GAP_ERR != rec->state) {
+		return false;
+	}
+
+	const cw_rec_parameters_t * parameters = &timing->parameters[rec->speed - CW_SPEED_MIN][rec->is_adaptive];
+	const int space_duration = cw_rec_compact_duration_internal(rec->mark_end, timestamp);
+	if (space_duration < parameters->ics_duration_min) {
+		return false;
+	}
+
+	bool is_reported = false;
+	if (RS_INTER_MARK_SPACE == rec->state) {
+		if (space_duration <= parameters->ics_duration_max) {
+			cw_rec_compact_stats_add_internal(stats, CW_REC_COMPACT_STAT_INTER_CHARACTER_SPACE, space_duration - parameters->ics_duration_ideal);
+		}
+		int character = 0;
+		if (rec->n_marks <= CW_DATA_MAX_REPRESENTATION_LENGTH) {
+			const unsigned int sentinel = 1U << rec->n_marks;
+			character = cw_representation_hash_to_character_internal(sentinel | rec->representation_bits);
+		}
+		if (0 == character) {
+			output->is_error = true;
+			rec->state = RS_EOC_GAP_ERR;
+		} else {
+			output->character = (char) character;
+			rec->state = RS_EOC_GAP;
+		}
+		is_reported = true;
+	} else {
+		; /* Character (or error) has been reported by earlier poll. */
+	}
+
+	if (space_duration > parameters->ics_duration_max) {
+		output->is_end_of_word = true;
+		rec->state = RS_EOC_GAP_ERR == rec->state ? RS_EOW_GAP_ERR : RS_EOW_GAP;
+		is_reported = true;
+	}
+
+	return is_reported;
+}
+
+
+
+
+/**
+   @brief Track speed of received signal in adaptive receiving mode
+
+   Dots and Dashes (divided by three) update one exponential average
+   of duration of Unit, which gives the speed, rounded to entry of
+   timing table. Unlike separate averages of Dots and Dashes, the
+   average follows change of speed also when only Dots (or only
+   Dashes) are received.
+
+   Newest duration has weight of 1/2: the ranges of adaptive mode are
+   derived from the average, so with slower averaging a receiver
+   starting far from the speed of the signal takes Dashes for long
+   Dots and Inter-character-spaces for Inter-mark-spaces, and never
+   catches up.
+
+   @param[in,out] rec receiver
+   @param[in] mark_duration duration of received Mark [us]
+   @param[in] is_dash whether the Mark is a Dash
+*/
+static void cw_rec_compact_update_speed_internal(cw_rec_compact_t * rec, int mark_duration, bool is_dash)
+{
+	const int unit_duration = is_dash ? mark_duration / 3 : mark_duration;
+	rec->unit_average += (unit_duration - rec->unit_average) / 2;
+
+	int speed = rec->unit_average > 0 ? (int) lroundf((float) CW_DOT_CALIBRATION / (float) rec->unit_average) : CW_SPEED_MAX;
+	if (speed < CW_SPEED_MIN) {
+		speed = CW_SPEED_MIN;
+	} else if (speed > CW_SPEED_MAX) {
+		speed = CW_SPEED_MAX;
+	} else {
+		; /* Speed is in range. */
+	}
+	rec->speed = (uint8_t) speed;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Add difference between received and ideal duration to statistics
+
+   @param[in,out] stats statistics (may be NULL)
+   @param[in] type index of type of Mark or Space
+   @param[in] delta difference between received and ideal duration [us]
+*/
+static void cw_rec_compact_stats_add_internal(cw_rec_compact_stats_t * stats, int type, int delta)
+{
+	if (NULL == stats) {
+		return;
+	}
+	stats->sum[type] += delta;
+	stats->sum_of_squares[type] += (int64_t) delta * delta;
+	stats->count[type]++;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get duration between two timestamps, saturated to INT_MAX
+
+   @param[in] earlier earlier timestamp [us]
+   @param[in] later later timestamp [us]
+
+   @return duration [us]
+*/
+static int cw_rec_compact_duration_internal(int64_t earlier, int64_t later)
+{
+	const int64_t duration = later - earlier;
+	if (duration < 0) {
+		return 0;
+	}
+	return duration > INT_MAX ? INT_MAX : (int) duration;
+}
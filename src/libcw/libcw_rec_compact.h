@@ -0,0 +1,37 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_REC_COMPACT
+#define H_LIBCW_REC_COMPACT
+
+
+
+
+#include "libcw2.h"
+#include "libcw_rec.h"
+
+
+
+
+/* Count of integer speeds in timing table of compact receivers. */
+#define CW_REC_TIMING_N_SPEEDS (CW_SPEED_MAX - CW_SPEED_MIN + 1)
+
+
+
+
+/* Read-only timing parameters shared by compact receivers. */
+struct cw_rec_timing_struct {
+	int noise_spike_threshold; /* [us] */
+
+	/* Parameters for each integer speed (index: speed -
+	   CW_SPEED_MIN), for fixed (0) and adaptive (1) receiving
+	   mode. */
+	cw_rec_parameters_t parameters[CW_REC_TIMING_N_SPEEDS][2];
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_REC_COMPACT */
@@ -0,0 +1,557 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_rec_pool.c
+
+   @brief Pool of receivers decoding many channels on many threads.
+
+   A channelizer (e.g. cw_skimmer_t) or a network feed may produce
+   edges of hundreds of signals. One thread calling
+   cw_rec_receive_edges() for each of them may not keep up.
+
+   Pool has one receiver per channel, and the channels are split into
+   shards, one per worker thread. Each shard has a lock-free
+   single-producer, single-consumer queue of edges: pushing edges
+   doesn't take any lock unless the queue is full or the worker
+   sleeps. Worker takes edges from its queue in batches, groups edges
+   of a batch by channel, and passes each group to the channel's
+   receiver with one call, so that a receiver is touched once per
+   batch instead of once per edge.
+
+   Characters decoded by workers are collected by cw_rec_pool_read()
+   into one stream, ordered by timestamps, with index of channel of
+   each character.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> /* sysconf() */
+
+#if defined(__linux__)
+#include <sys/prctl.h> /* prctl() */
+#elif defined(__FreeBSD__)
+#include <pthread_np.h> /* pthread_set_name_np() */
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_rec.h"
+#include "libcw_rec_pool.h"
+
+
+
+
+#define MSG_PREFIX "libcw/rec pool: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Edges of one channel in batch taken from queue by worker. */
+typedef struct {
+	int channel;
+	size_t first;  /* Index of first edge in batch. */
+	size_t n;      /* Count of edges. */
+} cw_rec_pool_segment_t;
+
+
+
+
+static void * cw_rec_pool_worker_internal(void * arg);
+static void cw_rec_pool_process_batch_internal(cw_rec_pool_shard_t * shard, const cw_rec_pool_item_t * items, size_t n_items);
+static void cw_rec_pool_stop_workers_internal(cw_rec_pool_t * pool);
+static void cw_rec_pool_wait_for_progress_internal(cw_rec_pool_shard_t * shard, bool wait_for_empty);
+static int cw_rec_pool_compare_segments_internal(const void * a, const void * b);
+static int cw_rec_pool_compare_decoded_internal(const void * a, const void * b);
+
+
+
+
+cw_rec_pool_t * cw_rec_pool_new(int n_channels, int n_workers)
+{
+	if (n_channels < 1 || n_channels > CW_REC_POOL_N_CHANNELS_MAX
+	    || n_workers < 0 || n_workers > CW_REC_POOL_N_WORKERS_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (0 == n_workers) {
+		const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_workers = n_cpus < 1 ? 1 : (n_cpus > CW_REC_POOL_N_WORKERS_MAX ? CW_REC_POOL_N_WORKERS_MAX : (int) n_cpus);
+	}
+	if (n_workers > n_channels) {
+		/* Shard without channels would have nothing to do. */
+		n_workers = n_channels;
+	}
+
+	cw_rec_pool_t * pool = calloc(1, sizeof (cw_rec_pool_t));
+	if (NULL == pool) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	pool->channels = calloc((size_t) n_channels, sizeof (cw_rec_pool_channel_t));
+	if (NULL == pool->channels) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to allocate channels");
+		free(pool);
+		return NULL;
+	}
+	pool->n_channels = n_channels;
+	for (int c = 0; c < n_channels; c++) {
+		pool->channels[c].rec = cw_rec_new();
+		if (NULL == pool->channels[c].rec) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create receiver of channel %d", c);
+			cw_rec_pool_delete(&pool);
+			return NULL;
+		}
+	}
+
+	for (int w = 0; w < n_workers; w++) {
+		cw_rec_pool_shard_t * shard = &pool->shards[w];
+		shard->pool = pool;
+		shard->index = w;
+		shard->do_work = true;
+		pthread_mutex_init(&shard->mutex, NULL);
+		pthread_cond_init(&shard->wakeup, NULL);
+		pthread_cond_init(&shard->progress, NULL);
+		/* Shard is counted before its thread is started, so that
+		   cw_rec_pool_delete() cleans it up on errors. */
+		pool->n_shards = w + 1;
+
+		shard->items = calloc(CW_REC_POOL_QUEUE_CAPACITY, sizeof (cw_rec_pool_item_t));
+		if (NULL == shard->items) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to allocate queue of shard %d", w);
+			cw_rec_pool_delete(&pool);
+			return NULL;
+		}
+
+		const int rv = pthread_create(&shard->thread_id, NULL, cw_rec_pool_worker_internal, (void *) shard);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create worker thread: '%s'", strerror(rv));
+			cw_rec_pool_delete(&pool);
+			return NULL;
+		}
+		shard->is_running = true;
+	}
+
+	return pool;
+}
+
+
+
+
+void cw_rec_pool_delete(cw_rec_pool_t ** pool)
+{
+	if (NULL == pool || NULL == *pool) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL pool");
+		return;
+	}
+
+	cw_rec_pool_stop_workers_internal(*pool);
+
+	for (int w = 0; w < (*pool)->n_shards; w++) {
+		cw_rec_pool_shard_t * shard = &(*pool)->shards[w];
+		free(shard->items);
+		free(shard->decoded);
+		pthread_cond_destroy(&shard->progress);
+		pthread_cond_destroy(&shard->wakeup);
+		pthread_mutex_destroy(&shard->mutex);
+	}
+	for (int c = 0; c < (*pool)->n_channels; c++) {
+		if (NULL != (*pool)->channels[c].rec) {
+			cw_rec_delete(&(*pool)->channels[c].rec);
+		}
+	}
+	free((*pool)->channels);
+	free((*pool)->pending);
+
+	free(*pool);
+	*pool = NULL;
+
+	return;
+}
+
+
+
+
+cw_rec_t * cw_rec_pool_get_receiver(cw_rec_pool_t * pool, int channel)
+{
+	if (NULL == pool || channel < 0 || channel >= pool->n_channels) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return pool->channels[channel].rec;
+}
+
+
+
+
+cw_ret_t cw_rec_pool_push_edges(cw_rec_pool_t * pool, int channel, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges)
+{
+	if (NULL == pool || NULL == edges || channel < 0 || channel >= pool->n_channels) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	cw_rec_pool_shard_t * shard = &pool->shards[channel % pool->n_shards];
+
+	double now = (double) timestamp;
+	size_t i = 0;
+	while (i < n_edges) {
+		const uint64_t tail = shard->tail;
+		const uint64_t head = __atomic_load_n(&shard->head, __ATOMIC_ACQUIRE);
+		const size_t n_free = CW_REC_POOL_QUEUE_CAPACITY - (size_t) (tail - head);
+		if (0 == n_free) {
+			cw_rec_pool_wait_for_progress_internal(shard, false);
+			continue;
+		}
+
+		const size_t n = n_edges - i < n_free ? n_edges - i : n_free;
+		for (size_t k = 0; k < n; k++) {
+			cw_rec_pool_item_t * item = &shard->items[(tail + k) & (CW_REC_POOL_QUEUE_CAPACITY - 1)];
+			item->timestamp = (int64_t) llround(now);
+			item->edge = edges[i + k];
+			item->channel = channel;
+			item->is_first = 0 == i + k;
+			now += edges[i + k].timespan;
+		}
+		__atomic_store_n(&shard->tail, tail + n, __ATOMIC_RELEASE);
+		i += n;
+	}
+
+	/* Worker checks the queue with locked mutex before it starts
+	   waiting, so it can't miss the new edges. */
+	pthread_mutex_lock(&shard->mutex);
+	if (shard->is_worker_waiting) {
+		pthread_cond_signal(&shard->wakeup);
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_rec_pool_read(cw_rec_pool_t * pool, cw_rec_pool_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	if (NULL == pool || NULL == decoded || NULL == n_decoded) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Collect characters of all shards. */
+	for (int w = 0; w < pool->n_shards; w++) {
+		cw_rec_pool_shard_t * shard = &pool->shards[w];
+		cw_rec_pool_wait_for_progress_internal(shard, true);
+
+		pthread_mutex_lock(&shard->mutex);
+		if (0 == shard->n_decoded) {
+			pthread_mutex_unlock(&shard->mutex);
+			continue;
+		}
+		if (pool->n_pending + shard->n_decoded > pool->pending_capacity) {
+			const size_t new_capacity = 2 * (pool->n_pending + shard->n_decoded);
+			cw_rec_pool_decoded_t * pending = realloc(pool->pending, new_capacity * sizeof (cw_rec_pool_decoded_t));
+			if (NULL == pending) {
+				pthread_mutex_unlock(&shard->mutex);
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "realloc()");
+				return CW_FAILURE;
+			}
+			pool->pending = pending;
+			pool->pending_capacity = new_capacity;
+		}
+		memcpy(pool->pending + pool->n_pending, shard->decoded, shard->n_decoded * sizeof (cw_rec_pool_decoded_t));
+		pool->n_pending += shard->n_decoded;
+		shard->n_decoded = 0;
+		pthread_mutex_unlock(&shard->mutex);
+	}
+
+	if (pool->n_pending > 1) {
+		qsort(pool->pending, pool->n_pending, sizeof (cw_rec_pool_decoded_t), cw_rec_pool_compare_decoded_internal);
+	}
+
+	*n_decoded = pool->n_pending < capacity ? pool->n_pending : capacity;
+	memcpy(decoded, pool->pending, *n_decoded * sizeof (cw_rec_pool_decoded_t));
+	pool->n_pending -= *n_decoded;
+	memmove(pool->pending, pool->pending + *n_decoded, pool->n_pending * sizeof (cw_rec_pool_decoded_t));
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Thread function of worker of pool of receivers
+
+   Take batches of edges from queue of shard and decode them, until
+   the pool is deleted.
+
+   @param[in] arg shard of the worker (cw_rec_pool_shard_t)
+
+   @return NULL
+*/
+static void * cw_rec_pool_worker_internal(void * arg)
+{
+	cw_rec_pool_shard_t * shard = (cw_rec_pool_shard_t *) arg;
+
+#if defined(__linux__)
+	prctl(PR_SET_NAME, "rec pool worker", 0, 0, 0);
+#elif defined(__FreeBSD__)
+	pthread_set_name_np(pthread_self(), "rec pool worker");
+#endif
+
+	cw_rec_pool_item_t batch[CW_REC_POOL_BATCH_SIZE];
+
+	pthread_mutex_lock(&shard->mutex);
+	while (shard->do_work) {
+		const uint64_t head = shard->head;
+		const uint64_t tail = __atomic_load_n(&shard->tail, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			shard->is_worker_waiting = true;
+			pthread_cond_wait(&shard->wakeup, &shard->mutex);
+			shard->is_worker_waiting = false;
+			continue;
+		}
+		shard->is_busy = true;
+		pthread_mutex_unlock(&shard->mutex);
+
+		const size_t n = tail - head < CW_REC_POOL_BATCH_SIZE ? (size_t) (tail - head) : CW_REC_POOL_BATCH_SIZE;
+		for (size_t k = 0; k < n; k++) {
+			batch[k] = shard->items[(head + k) & (CW_REC_POOL_QUEUE_CAPACITY - 1)];
+		}
+		/* Producer may reuse the slots now. */
+		__atomic_store_n(&shard->head, head + n, __ATOMIC_RELEASE);
+
+		cw_rec_pool_process_batch_internal(shard, batch, n);
+
+		pthread_mutex_lock(&shard->mutex);
+		shard->is_busy = false;
+		pthread_cond_broadcast(&shard->progress);
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Decode batch of edges taken from queue of shard
+
+   Edges are grouped by channel, so that each receiver is given all
+   its edges from the batch at once. Order of edges of one channel is
+   preserved. Decoded characters are appended to shard's list of
+   characters.
+
+   @param[in,out] shard shard of the worker
+   @param[in] items edges taken from queue
+   @param[in] n_items count of items in @p items
+*/
+static void cw_rec_pool_process_batch_internal(cw_rec_pool_shard_t * shard, const cw_rec_pool_item_t * items, size_t n_items)
+{
+	/* Split the batch into runs of edges of one channel with
+	   continuous timeline. */
+	cw_rec_pool_segment_t segments[CW_REC_POOL_BATCH_SIZE];
+	size_t n_segments = 0;
+	for (size_t k = 0; k < n_items; k++) {
+		if (0 == k || items[k].is_first || items[k].channel != items[k - 1].channel) {
+			segments[n_segments].channel = items[k].channel;
+			segments[n_segments].first = k;
+			segments[n_segments].n = 0;
+			n_segments++;
+		}
+		segments[n_segments - 1].n++;
+	}
+	qsort(segments, n_segments, sizeof (cw_rec_pool_segment_t), cw_rec_pool_compare_segments_internal);
+
+	/* Every edge ends at most one character and one word. */
+	cw_rec_edge_t edges[CW_REC_POOL_BATCH_SIZE];
+	cw_rec_decoded_t decoded[2 * CW_REC_POOL_BATCH_SIZE];
+	cw_rec_pool_decoded_t results[2 * CW_REC_POOL_BATCH_SIZE];
+	size_t n_results = 0;
+
+	for (size_t s = 0; s < n_segments; s++) {
+		const cw_rec_pool_segment_t * segment = &segments[s];
+		cw_rec_pool_channel_t * channel = &shard->pool->channels[segment->channel];
+		for (size_t k = 0; k < segment->n; k++) {
+			edges[k] = items[segment->first + k].edge;
+		}
+
+		size_t n_decoded = 0;
+		cw_rec_receive_edges_internal(channel->rec, items[segment->first].timestamp, edges, segment->n,
+					      decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded,
+					      &channel->character_start, &channel->space_start);
+		for (size_t d = 0; d < n_decoded; d++) {
+			results[n_results].channel = segment->channel;
+			results[n_results].character = decoded[d].character;
+			results[n_results].timestamp = decoded[d].timestamp;
+			n_results++;
+		}
+	}
+
+	if (0 == n_results) {
+		return;
+	}
+
+	pthread_mutex_lock(&shard->mutex);
+	if (shard->n_decoded + n_results > shard->decoded_capacity) {
+		const size_t new_capacity = 2 * (shard->n_decoded + n_results);
+		cw_rec_pool_decoded_t * new_decoded = realloc(shard->decoded, new_capacity * sizeof (cw_rec_pool_decoded_t));
+		if (NULL == new_decoded) {
+			pthread_mutex_unlock(&shard->mutex);
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc(), %zu decoded characters are lost", n_results);
+			return;
+		}
+		shard->decoded = new_decoded;
+		shard->decoded_capacity = new_capacity;
+	}
+	memcpy(shard->decoded + shard->n_decoded, results, n_results * sizeof (cw_rec_pool_decoded_t));
+	shard->n_decoded += n_results;
+	pthread_mutex_unlock(&shard->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Stop worker threads of pool
+
+   @param[in] pool pool of receivers
+*/
+static void cw_rec_pool_stop_workers_internal(cw_rec_pool_t * pool)
+{
+	for (int w = 0; w < pool->n_shards; w++) {
+		pthread_mutex_lock(&pool->shards[w].mutex);
+		pool->shards[w].do_work = false;
+		pthread_cond_broadcast(&pool->shards[w].wakeup);
+		pthread_cond_broadcast(&pool->shards[w].progress);
+		pthread_mutex_unlock(&pool->shards[w].mutex);
+	}
+
+	for (int w = 0; w < pool->n_shards; w++) {
+		if (pool->shards[w].is_running) {
+			pthread_join(pool->shards[w].thread_id, NULL);
+			pool->shards[w].is_running = false;
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wait for worker of shard to take edges from queue
+
+   @param[in] shard shard of pool
+   @param[in] wait_for_empty if true, wait until all edges in queue have been processed; if false, wait until queue is not full
+*/
+static void cw_rec_pool_wait_for_progress_internal(cw_rec_pool_shard_t * shard, bool wait_for_empty)
+{
+	pthread_mutex_lock(&shard->mutex);
+	while (shard->do_work) {
+		const uint64_t pending = shard->tail - __atomic_load_n(&shard->head, __ATOMIC_ACQUIRE);
+		if (wait_for_empty ? (0 == pending && !shard->is_busy) : (pending < CW_REC_POOL_QUEUE_CAPACITY)) {
+			break;
+		}
+		if (shard->is_worker_waiting) {
+			pthread_cond_signal(&shard->wakeup);
+		}
+		pthread_cond_wait(&shard->progress, &shard->mutex);
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Compare segments of batch by channel, then by position in batch
+
+   @param[in] a first segment
+   @param[in] b second segment
+
+   @return result of comparison, as for qsort()
+*/
+static int cw_rec_pool_compare_segments_internal(const void * a, const void * b)
+{
+	const cw_rec_pool_segment_t * sa = (const cw_rec_pool_segment_t *) a;
+	const cw_rec_pool_segment_t * sb = (const cw_rec_pool_segment_t *) b;
+	if (sa->channel != sb->channel) {
+		return sa->channel < sb->channel ? -1 : 1;
+	}
+	return sa->first < sb->first ? -1 : (sa->first > sb->first ? 1 : 0);
+}
+
+
+
+
+/**
+   @brief Compare decoded characters by timestamp, then by channel
+
+   @param[in] a first character
+   @param[in] b second character
+
+   @return result of comparison, as for qsort()
+*/
+static int cw_rec_pool_compare_decoded_internal(const void * a, const void * b)
+{
+	const cw_rec_pool_decoded_t * da = (const cw_rec_pool_decoded_t *) a;
+	const cw_rec_pool_decoded_t * db = (const cw_rec_pool_decoded_t *) b;
+	if (da->timestamp != db->timestamp) {
+		return da->timestamp < db->timestamp ? -1 : 1;
+	}
+	return da->channel < db->channel ? -1 : (da->channel > db->channel ? 1 : 0);
+}
@@ -0,0 +1,115 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_REC_POOL
+#define H_LIBCW_REC_POOL
+
+
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Maximal count of worker threads (shards) of pool of receivers. */
+#define CW_REC_POOL_N_WORKERS_MAX 64
+
+/* Maximal count of channels of pool of receivers. */
+#define CW_REC_POOL_N_CHANNELS_MAX 65536
+
+/* Capacity of queue of edges of one shard. Must be a power of two. */
+#define CW_REC_POOL_QUEUE_CAPACITY 4096
+
+/* Maximal count of edges taken from queue by worker at once. */
+#define CW_REC_POOL_BATCH_SIZE 256
+
+
+
+
+/* Edge in queue of shard. */
+typedef struct {
+	int64_t timestamp;   /* [us] Beginning of the edge. */
+	cw_rec_edge_t edge;
+	int channel;
+	bool is_first;       /* First edge of a call to cw_rec_pool_push_edges(). */
+} cw_rec_pool_item_t;
+
+
+
+
+/* Channel of pool: receiver and its position in current character. */
+typedef struct {
+	cw_rec_t * rec;
+	int64_t character_start; /* [us] */
+	int64_t space_start;     /* [us] */
+} cw_rec_pool_channel_t;
+
+
+
+
+/* Shard of pool: channels handled by one worker thread. */
+typedef struct {
+	cw_rec_pool_t * pool;
+	int index;
+
+	/* Single-producer, single-consumer queue of edges. ::head is
+	   written only by worker, ::tail only by producer; both are
+	   accessed with atomic operations and only grow (index of item is
+	   the counter modulo CW_REC_POOL_QUEUE_CAPACITY). */
+	cw_rec_pool_item_t * items;
+	uint64_t head;
+	uint64_t tail;
+
+	/* Characters decoded by worker, not yet read by
+	   cw_rec_pool_read(). Protected by ::mutex. */
+	cw_rec_pool_decoded_t * decoded;
+	size_t n_decoded;
+	size_t decoded_capacity;
+
+	/* Worker sleeps on ::wakeup when queue is empty, producer sleeps
+	   on ::progress when queue is full or when it waits for the
+	   queue to be drained. The flags are protected by ::mutex. */
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeup;
+	pthread_cond_t progress;
+	bool is_worker_waiting;
+	bool is_busy;            /* Worker is processing edges taken from queue. */
+
+	/* Set to false to ask worker to return. Protected by ::mutex. */
+	bool do_work;
+
+	pthread_t thread_id;
+	bool is_running;
+} cw_rec_pool_shard_t;
+
+
+
+
+struct cw_rec_pool_struct {
+	cw_rec_pool_channel_t * channels;
+	int n_channels;
+
+	cw_rec_pool_shard_t shards[CW_REC_POOL_N_WORKERS_MAX];
+	int n_shards;
+
+	/* Characters collected from shards by cw_rec_pool_read() that
+	   didn't fit into caller's buffer. Sorted. */
+	cw_rec_pool_decoded_t * pending;
+	size_t n_pending;
+	size_t pending_capacity;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_REC_POOL */
@@ -0,0 +1,434 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_rec_spec.c
+
+   @brief Speculative receiver decoding signal of unknown speed.
+
+   Receiver in fixed speed mode decodes garbage when it is set to wrong
+   speed, and receiver in adaptive mode needs a few characters to
+   converge on speed of the signal (and may not converge at all when it
+   starts far from it).
+
+   Speculative receiver passes each edge to several compact receivers
+   in fixed speed mode (hypotheses), with speeds spread evenly on
+   logarithmic scale, so that each speed in the range falls into
+   tolerance of at least one hypothesis. A hypothesis at wrong speed
+   takes Dashes for Dots (or the other way) and quickly collects
+   Marks that don't form a valid character. Each hypothesis gains
+   points for characters with valid representation and for words found
+   in dictionary, and loses points for invalid representations.
+
+   Characters of each hypothesis are kept aside until the best scoring
+   hypothesis recognizes an inter-word-space. Then its characters are
+   committed to caller, and characters of other hypotheses from the same
+   period are discarded.
+*/
+
+
+
+
+#include "config.h"
+
+#include <ctype.h> /* toupper() */
+#include <errno.h>
+#include <math.h> /* powf() */
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_rec.h"
+#include "libcw_rec_spec.h"
+
+
+
+
+#define MSG_PREFIX "libcw/rec spec: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+/* Points for valid and invalid representation of character. Invalid
+   representation costs more than valid one gains, so that hypothesis
+   decoding only some of characters correctly loses to hypothesis
+   decoding all of them. */
+enum { CW_REC_SPEC_SCORE_CHARACTER = 1 };
+enum { CW_REC_SPEC_SCORE_ERROR = -3 };
+
+
+
+
+static cw_ret_t cw_rec_spec_update_internal(cw_rec_spec_t * spec, cw_rec_compact_event_t event, int64_t timestamp, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
+static void cw_rec_spec_collect_internal(cw_rec_spec_t * spec, int h, cw_rec_compact_event_t event, int64_t timestamp);
+static cw_ret_t cw_rec_spec_commit_internal(cw_rec_spec_t * spec, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded);
+static int cw_rec_spec_word_score_internal(const cw_rec_spec_t * spec, const cw_rec_spec_hypothesis_t * hyp);
+static int cw_rec_spec_compare_words_internal(const void * a, const void * b);
+
+
+
+
+cw_rec_spec_t * cw_rec_spec_new(int speed_min, int speed_max, int n_hypotheses)
+{
+	if (speed_min < CW_SPEED_MIN || speed_max > CW_SPEED_MAX || speed_min > speed_max
+	    || n_hypotheses < 1 || n_hypotheses > CW_REC_SPEC_N_HYPOTHESES_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_rec_spec_t * spec = calloc(1, sizeof (cw_rec_spec_t));
+	if (NULL == spec) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	spec->timing = cw_rec_timing_new(CW_TOLERANCE_INITIAL, CW_GAP_INITIAL);
+	if (NULL == spec->timing) {
+		cw_rec_spec_delete(&spec);
+		return NULL;
+	}
+
+	/* Ratio of speeds of neighbouring hypotheses is constant. */
+	spec->n_hypotheses = n_hypotheses;
+	const float ratio = (float) speed_max / (float) speed_min;
+	for (int h = 0; h < n_hypotheses; h++) {
+		const float position = n_hypotheses > 1 ? (float) h / (float) (n_hypotheses - 1) : 0.0F;
+		const int speed = (int) lroundf((float) speed_min * powf(ratio, position));
+		cw_rec_compact_init(&spec->recs[h], speed, false);
+	}
+
+	return spec;
+}
+
+
+
+
+void cw_rec_spec_delete(cw_rec_spec_t ** spec)
+{
+	if (NULL == spec || NULL == *spec) {
+		return;
+	}
+
+	cw_rec_timing_delete(&(*spec)->timing);
+	free((*spec)->dictionary);
+	free(*spec);
+	*spec = NULL;
+}
+
+
+
+
+cw_ret_t cw_rec_spec_set_dictionary(cw_rec_spec_t * spec, const char * const * words, size_t n_words)
+{
+	if (NULL == spec || (n_words > 0 && NULL == words)) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	for (size_t w = 0; w < n_words; w++) {
+		const size_t len = NULL == words[w] ? 0 : strlen(words[w]);
+		if (0 == len || len > CW_REC_SPEC_WORD_LENGTH_MAX) {
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+	}
+
+	char * dictionary = NULL;
+	if (n_words > 0) {
+		dictionary = calloc(n_words, CW_REC_SPEC_WORD_LENGTH_MAX + 1);
+		if (NULL == dictionary) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			return CW_FAILURE;
+		}
+		for (size_t w = 0; w < n_words; w++) {
+			char * word = dictionary + w * (CW_REC_SPEC_WORD_LENGTH_MAX + 1);
+			for (size_t i = 0; '\0' != words[w][i]; i++) {
+				word[i] = (char) toupper((unsigned char) words[w][i]);
+			}
+		}
+		qsort(dictionary, n_words, CW_REC_SPEC_WORD_LENGTH_MAX + 1, cw_rec_spec_compare_words_internal);
+	}
+
+	free(spec->dictionary);
+	spec->dictionary = dictionary;
+	spec->n_words = n_words;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_rec_spec_receive_edges(cw_rec_spec_t * spec, int64_t timestamp, const cw_rec_edge_t * edges, size_t n_edges, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	if (NULL == spec || (n_edges > 0 && NULL == edges) || NULL == decoded || NULL == n_decoded) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	*n_decoded = 0;
+
+	double now = (double) timestamp;
+	for (size_t i = 0; i < n_edges; i++) {
+		const bool is_first = 0 == i || edges[i - 1].is_mark != edges[i].is_mark;
+		const bool is_last = n_edges - 1 == i || edges[i + 1].is_mark != edges[i].is_mark;
+
+		if (edges[i].is_mark && is_first) {
+			if (CW_SUCCESS != cw_rec_spec_update_internal(spec, CW_REC_COMPACT_MARK_BEGIN, (int64_t) llround(now), decoded, capacity, n_decoded)) {
+				return CW_FAILURE;
+			}
+		}
+
+		now += edges[i].timespan;
+		if (!is_last) {
+			continue;
+		}
+
+		/* End of Mark, or end of Space that may complete a
+		   character or a word. */
+		const cw_rec_compact_event_t event = edges[i].is_mark ? CW_REC_COMPACT_MARK_END : CW_REC_COMPACT_POLL;
+		if (CW_SUCCESS != cw_rec_spec_update_internal(spec, event, (int64_t) llround(now), decoded, capacity, n_decoded)) {
+			return CW_FAILURE;
+		}
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_rec_spec_get_speed(const cw_rec_spec_t * spec)
+{
+	return cw_rec_compact_get_speed(&spec->recs[spec->best]);
+}
+
+
+
+
+/**
+   @brief Pass one event to all hypotheses, commit characters of the best one
+
+   Characters of best scoring hypothesis are committed when the
+   hypothesis recognizes inter-word-space, or when its buffer is full.
+
+   @exception ENOMEM committed characters don't fit into @p decoded
+
+   @param[in,out] spec speculative receiver
+   @param[in] event event for receivers of hypotheses
+   @param[in] timestamp time of the event [us]
+   @param[out] decoded buffer for committed characters
+   @param[in] capacity count of items in @p decoded
+   @param[in,out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rec_spec_update_internal(cw_rec_spec_t * spec, cw_rec_compact_event_t event, int64_t timestamp, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	for (int h = 0; h < spec->n_hypotheses; h++) {
+		spec->inputs[h] = (cw_rec_compact_input_t) { .timestamp = timestamp, .event = event };
+	}
+	cw_rec_compact_update(spec->timing, spec->recs, spec->inputs, spec->outputs, (size_t) spec->n_hypotheses, NULL);
+
+	for (int h = 0; h < spec->n_hypotheses; h++) {
+		cw_rec_spec_collect_internal(spec, h, event, timestamp);
+	}
+
+	/* Current best hypothesis keeps its position on a tie. */
+	int best = spec->best;
+	for (int h = 0; h < spec->n_hypotheses; h++) {
+		if (spec->hypotheses[h].score > spec->hypotheses[best].score) {
+			best = h;
+		}
+	}
+
+	const cw_rec_spec_hypothesis_t * hyp = &spec->hypotheses[best];
+	if (0 == hyp->n_pending) {
+		return CW_SUCCESS;
+	}
+	if (spec->outputs[best].is_end_of_word || CW_REC_SPEC_PENDING_CAPACITY == hyp->n_pending) {
+		spec->best = best;
+		return cw_rec_spec_commit_internal(spec, decoded, capacity, n_decoded);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Collect result of update of receiver of one hypothesis
+
+   Characters beginning before end of last commit are ignored: the
+   period has already been decoded by another hypothesis.
+
+   @param[in,out] spec speculative receiver
+   @param[in] h index of hypothesis
+   @param[in] event event passed to receiver of the hypothesis
+   @param[in] timestamp time of the event [us]
+*/
+static void cw_rec_spec_collect_internal(cw_rec_spec_t * spec, int h, cw_rec_compact_event_t event, int64_t timestamp)
+{
+	const cw_rec_compact_t * rec = &spec->recs[h];
+	const cw_rec_compact_output_t * output = &spec->outputs[h];
+	cw_rec_spec_hypothesis_t * hyp = &spec->hypotheses[h];
+
+	if (('\0' != output->character || output->is_error) && hyp->character_start > spec->committed_until) {
+		if (output->is_error) {
+			hyp->score += CW_REC_SPEC_SCORE_ERROR;
+		} else {
+			hyp->score += CW_REC_SPEC_SCORE_CHARACTER;
+			if (hyp->n_pending < CW_REC_SPEC_PENDING_CAPACITY) {
+				hyp->pending[hyp->n_pending++] = (cw_rec_decoded_t) { .character = output->character, .timestamp = hyp->character_start };
+			}
+		}
+	}
+
+	if (output->is_end_of_word && rec->mark_end > spec->committed_until
+	    && hyp->n_pending > 0 && ' ' != hyp->pending[hyp->n_pending - 1].character) {
+
+		hyp->score += cw_rec_spec_word_score_internal(spec, hyp);
+		if (hyp->n_pending < CW_REC_SPEC_PENDING_CAPACITY) {
+			hyp->pending[hyp->n_pending++] = (cw_rec_decoded_t) { .character = ' ', .timestamp = rec->mark_end };
+		}
+	}
+
+	/* Mark that begins new character. */
+	if (CW_REC_COMPACT_MARK_BEGIN == event && RS_MARK == rec->state && 0 == rec->n_marks) {
+		hyp->character_start = timestamp;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Commit characters of best hypothesis
+
+   Characters of other hypotheses decoded from the same period are
+   discarded, and scores of all hypotheses are halved, so that recent
+   characters count more than old ones when speed of signal changes.
+
+   @exception ENOMEM characters don't fit into @p decoded
+
+   @param[in,out] spec speculative receiver
+   @param[out] decoded buffer for committed characters
+   @param[in] capacity count of items in @p decoded
+   @param[in,out] n_decoded count of characters stored in @p decoded
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rec_spec_commit_internal(cw_rec_spec_t * spec, cw_rec_decoded_t * decoded, size_t capacity, size_t * n_decoded)
+{
+	const cw_rec_spec_hypothesis_t * best = &spec->hypotheses[spec->best];
+	if (capacity - *n_decoded < best->n_pending) {
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+	memcpy(decoded + *n_decoded, best->pending, best->n_pending * sizeof (cw_rec_decoded_t));
+	*n_decoded += best->n_pending;
+	spec->committed_until = best->pending[best->n_pending - 1].timestamp;
+
+	for (int h = 0; h < spec->n_hypotheses; h++) {
+		cw_rec_spec_hypothesis_t * hyp = &spec->hypotheses[h];
+		size_t first = 0;
+		while (first < hyp->n_pending && hyp->pending[first].timestamp <= spec->committed_until) {
+			first++;
+		}
+		memmove(hyp->pending, hyp->pending + first, (hyp->n_pending - first) * sizeof (cw_rec_decoded_t));
+		hyp->n_pending -= first;
+		hyp->score /= 2;
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Get points for last word decoded by hypothesis
+
+   Word found in dictionary gets one point per character, on top of
+   points that its characters got for being valid.
+
+   @param[in] spec speculative receiver
+   @param[in] hyp hypothesis
+
+   @return points for the word
+*/
+static int cw_rec_spec_word_score_internal(const cw_rec_spec_t * spec, const cw_rec_spec_hypothesis_t * hyp)
+{
+	if (0 == spec->n_words) {
+		return 0;
+	}
+
+	size_t start = hyp->n_pending;
+	while (start > 0 && ' ' != hyp->pending[start - 1].character) {
+		start--;
+	}
+	const size_t len = hyp->n_pending - start;
+	if (len > CW_REC_SPEC_WORD_LENGTH_MAX) {
+		return 0;
+	}
+
+	char word[CW_REC_SPEC_WORD_LENGTH_MAX + 1] = { 0 };
+	for (size_t i = 0; i < len; i++) {
+		word[i] = hyp->pending[start + i].character;
+	}
+	if (NULL == bsearch(word, spec->dictionary, spec->n_words, CW_REC_SPEC_WORD_LENGTH_MAX + 1, cw_rec_spec_compare_words_internal)) {
+		return 0;
+	}
+
+	return (int) len;
+}
+
+
+
+
+/**
+   @brief Compare two words of dictionary
+
+   @param[in] a first word
+   @param[in] b second word
+
+   @return result of comparison, as for qsort()
+*/
+static int cw_rec_spec_compare_words_internal(const void * a, const void * b)
+{
+	return strcmp((const char *) a, (const char *) b);
+}
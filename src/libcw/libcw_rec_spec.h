@@ -0,0 +1,78 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_REC_SPEC
+#define H_LIBCW_REC_SPEC
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Maximal count of hypotheses of speculative receiver. */
+#define CW_REC_SPEC_N_HYPOTHESES_MAX 32
+
+/* Capacity of buffer of characters of one hypothesis that have not
+   been committed yet. */
+#define CW_REC_SPEC_PENDING_CAPACITY 64
+
+/* Maximal length of word of dictionary of speculative receiver. */
+#define CW_REC_SPEC_WORD_LENGTH_MAX 15
+
+
+
+
+/* Hypothesis of speculative receiver: characters it has decoded since
+   last commit, and how well they look. */
+typedef struct {
+	cw_rec_decoded_t pending[CW_REC_SPEC_PENDING_CAPACITY];
+	size_t n_pending;
+	int64_t character_start; /* [us] Beginning of first Mark of current character. */
+	int score;
+} cw_rec_spec_hypothesis_t;
+
+
+
+
+struct cw_rec_spec_struct {
+	cw_rec_timing_t * timing;
+
+	/* Receivers of hypotheses are kept in one array (and events and
+	   results for them in two other arrays), so that one edge is
+	   passed to all hypotheses with one call to
+	   cw_rec_compact_update(). */
+	cw_rec_compact_t recs[CW_REC_SPEC_N_HYPOTHESES_MAX];
+	cw_rec_compact_input_t inputs[CW_REC_SPEC_N_HYPOTHESES_MAX];
+	cw_rec_compact_output_t outputs[CW_REC_SPEC_N_HYPOTHESES_MAX];
+	cw_rec_spec_hypothesis_t hypotheses[CW_REC_SPEC_N_HYPOTHESES_MAX];
+	int n_hypotheses;
+
+	/* Hypothesis whose characters have been committed most
+	   recently. Wins ties of scores. */
+	int best;
+
+	/* [us] Characters starting at or before this time have been
+	   committed (or rejected) and are not collected anymore. */
+	int64_t committed_until;
+
+	/* Sorted array of words, each CW_REC_SPEC_WORD_LENGTH_MAX + 1
+	   bytes long, in upper case. */
+	char * dictionary;
+	size_t n_words;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_REC_SPEC */
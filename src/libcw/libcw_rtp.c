@@ -0,0 +1,583 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_rtp.c
+
+   @brief RTP streaming sound sink.
+
+   Samples are sent over UDP in RTP packets (RFC 3550) to a remote
+   listener, instead of being played by a sound device. Each buffer of
+   generator becomes one packet. Buffers are encoded with Opus (RFC
+   7587, 20 ms frames at 48 kHz) when Opus library can be loaded with
+   dlopen(), otherwise they are sent as uncompressed L16 samples (RFC
+   3551, 10 ms per packet). At 32 kbit/s an Opus stream is ~20 times
+   smaller than the L16 one.
+
+   Packets are sent in real time: generator's thread is blocked after
+   each packet for the duration of its samples, the same way as it is
+   blocked by a sound card. When generator has nothing to play, no
+   packets are sent, and timestamp of next packet tells the listener
+   how long the pause was. First packet after a pause has marker bit set.
+
+   Name of "device" is "host:port" of the listener ("[address]:port"
+   for IPv6 addresses). Port is optional, with default 5004.
+
+   Payload types are dynamic: 96 for Opus, 97 for L16. The listener has
+   to be told about them out of band (e.g. in SDP file).
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <assert.h>
+#include <dlfcn.h> /* dlopen() and related symbols */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_rtp.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/rtp: "
+
+/* Opus supports this rate natively, and RTP clock of Opus stream is
+   always 48 kHz (RFC 7587). */
+#define CW_RTP_SAMPLE_RATE 48000
+
+/* Size of generator's buffer, i.e. samples in one RTP packet. Opus:
+   20 ms frame. L16: 10 ms, 960 bytes, so that packet fits in Ethernet
+   frame. */
+#define CW_RTP_OPUS_N_SAMPLES 960
+#define CW_RTP_L16_N_SAMPLES 480
+
+#define CW_RTP_PAYLOAD_TYPE_OPUS 96
+#define CW_RTP_PAYLOAD_TYPE_L16  97
+
+#define CW_RTP_DEFAULT_PORT "5004"
+
+/* Bitrate of Opus encoder [bits per second]. Mono tones don't need
+   more. */
+#define CW_RTP_OPUS_BITRATE 32000
+
+/* Constants from opus_defines.h. They are a part of stable ABI of
+   libopus. Opus headers are not needed to build libcw. */
+#define CW_RTP_OPUS_OK                  0
+#define CW_RTP_OPUS_APPLICATION_AUDIO   2049
+#define CW_RTP_OPUS_SET_BITRATE_REQUEST 4002
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+typedef struct cw_rtp_opus_lib_handle_t {
+
+	/* Returned by dlopen(). The library stays loaded until the end of
+	   the process. */
+	void * lib_handle;
+	bool load_attempted;
+
+	void * (* opus_encoder_create)(int32_t sample_rate, int channels, int application, int * error);
+	int32_t (* opus_encode)(void * encoder, const int16_t * pcm, int frame_size, unsigned char * data, int32_t max_data_bytes);
+	int     (* opus_encoder_ctl)(void * encoder, int request, ...);
+	void    (* opus_encoder_destroy)(void * encoder);
+} cw_rtp_opus_lib_handle_t;
+
+
+
+
+static cw_rtp_opus_lib_handle_t g_cw_rtp_opus_lib_handle;
+static pthread_mutex_t g_cw_rtp_opus_lib_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+static cw_ret_t cw_rtp_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf);
+static void     cw_rtp_close_sound_device_internal(cw_gen_t * gen);
+static cw_ret_t cw_rtp_write_buffer_to_sound_device_internal(cw_gen_t * gen);
+static bool     cw_rtp_load_opus_internal(void);
+static int      cw_rtp_opus_dlsym_internal(cw_rtp_opus_lib_handle_t * cw_opus);
+static cw_ret_t cw_rtp_resolve_internal(const char * device_name, struct addrinfo ** result);
+static int      cw_rtp_encode_internal(cw_gen_t * gen, uint8_t * payload);
+static void     cw_rtp_put_header_internal(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Configure given @p gen variable to work with RTP sound system
+
+   This function only initializes @p gen by setting some of its members. It
+   doesn't interact with network (doesn't try to open a socket).
+
+   @param[in,out] gen generator structure to initialize
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_rtp_init_gen_internal(cw_gen_t * gen)
+{
+	assert (gen);
+
+	gen->sound_system                    = CW_AUDIO_RTP;
+	gen->open_and_configure_sound_device = cw_rtp_open_and_configure_sound_device_internal;
+	gen->close_sound_device              = cw_rtp_close_sound_device_internal;
+	gen->write_buffer_to_sound_device    = cw_rtp_write_buffer_to_sound_device_internal;
+
+	gen->sample_rate = CW_RTP_SAMPLE_RATE;
+
+	gen->rtp_data.socket_fd = -1;
+	gen->rtp_data.encoder = NULL;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Check if it is possible to stream samples over RTP
+
+   The function only checks if address of listener can be resolved.
+   Opus library is not required: without it samples are sent
+   uncompressed.
+
+   @param[in] device_name "host:port" of listener, or NULL/empty string for default listener
+
+   @return true if address of listener can be resolved
+   @return false otherwise
+*/
+bool cw_is_rtp_possible(const char * device_name)
+{
+	struct addrinfo * result = NULL;
+	if (CW_SUCCESS != cw_rtp_resolve_internal(device_name, &result)) {
+		return false;
+	}
+	freeaddrinfo(result);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Open socket for RTP stream and configure encoder
+
+   @param[in,out] gen generator for which to open the stream
+   @param[in] gen_conf generator's configuration
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rtp_open_and_configure_sound_device_internal(cw_gen_t * gen, const cw_gen_config_t * gen_conf)
+{
+	if (gen->sound_device_is_open) {
+		/* Ignore the call if the device is already open. */
+		return CW_SUCCESS;
+	}
+
+	cw_gen_pick_device_name_internal(gen_conf->sound_device, gen->sound_system,
+					 gen->picked_device_name, sizeof (gen->picked_device_name));
+
+	struct addrinfo * result = NULL;
+	if (CW_SUCCESS != cw_rtp_resolve_internal(gen->picked_device_name, &result)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: can't resolve address of listener '%s'", gen->picked_device_name);
+		return CW_FAILURE;
+	}
+	int fd = -1;
+	for (struct addrinfo * ai = result; NULL != ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (-1 == fd) {
+			continue;
+		}
+		/* Connected socket: errors reported by listener's host
+		   (e.g. port unreachable) don't accumulate anywhere. */
+		if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+	if (-1 == fd) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "open: can't open socket for listener '%s': '%s'", gen->picked_device_name, strerror(errno));
+		return CW_FAILURE;
+	}
+
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	rtp->socket_fd = fd;
+	rtp->encoder = NULL;
+	if (cw_rtp_load_opus_internal()) {
+		int error = 0;
+		rtp->encoder = g_cw_rtp_opus_lib_handle.opus_encoder_create(CW_RTP_SAMPLE_RATE, 1, CW_RTP_OPUS_APPLICATION_AUDIO, &error);
+		if (NULL == rtp->encoder || CW_RTP_OPUS_OK != error) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "open: can't create Opus encoder (%d), samples will be sent uncompressed", error);
+			rtp->encoder = NULL;
+		} else {
+			g_cw_rtp_opus_lib_handle.opus_encoder_ctl(rtp->encoder, CW_RTP_OPUS_SET_BITRATE_REQUEST, (int32_t) CW_RTP_OPUS_BITRATE);
+		}
+	}
+	if (NULL != rtp->encoder) {
+		rtp->payload_type = CW_RTP_PAYLOAD_TYPE_OPUS;
+		gen->buffer_n_samples = CW_RTP_OPUS_N_SAMPLES;
+	} else {
+		rtp->payload_type = CW_RTP_PAYLOAD_TYPE_L16;
+		gen->buffer_n_samples = CW_RTP_L16_N_SAMPLES;
+	}
+
+	/* Initial values of sequence number and timestamp should be
+	   random (RFC 3550, 5.1). */
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const uint32_t seed = (uint32_t) now.tv_nsec ^ ((uint32_t) getpid() << 16U) ^ (uint32_t) (uintptr_t) gen;
+	rtp->ssrc = seed * 2654435761U;
+	rtp->sequence = (uint16_t) (seed >> 7U);
+	rtp->timestamp = seed * 40503U;
+	rtp->marker = true;
+	rtp->timeline_started = false;
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+		      MSG_PREFIX "streaming to '%s', %s payload, %d samples per packet",
+		      gen->picked_device_name, NULL != rtp->encoder ? "Opus" : "L16", gen->buffer_n_samples);
+
+	gen->sound_device_is_open = true;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Close RTP stream of given generator
+
+   @param[in] gen generator for which to close the stream
+*/
+static void cw_rtp_close_sound_device_internal(cw_gen_t * gen)
+{
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+
+	if (NULL != rtp->encoder) {
+		g_cw_rtp_opus_lib_handle.opus_encoder_destroy(rtp->encoder);
+		rtp->encoder = NULL;
+	}
+	if (-1 != rtp->socket_fd) {
+		close(rtp->socket_fd);
+		rtp->socket_fd = -1;
+	}
+	gen->sound_device_is_open = false;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Send generator's buffer in one RTP packet
+
+   The function returns when samples of the packet should have been
+   played by listener, so that generator produces samples in real time.
+
+   @param[in] gen generator with full buffer of samples
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rtp_write_buffer_to_sound_device_internal(cw_gen_t * gen)
+{
+	assert (gen);
+	assert (gen->sound_system == CW_AUDIO_RTP);
+
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	const int packet_usecs = (int) (((int64_t) gen->buffer_n_samples * CW_USECS_PER_SEC) / CW_RTP_SAMPLE_RATE);
+
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!rtp->timeline_started) {
+		rtp->timeline = now;
+		rtp->timeline_started = true;
+	} else {
+		const int64_t late = ((int64_t) now.tv_sec - rtp->timeline.tv_sec) * CW_USECS_PER_SEC
+			+ ((int64_t) now.tv_nsec - rtp->timeline.tv_nsec) / 1000;
+		if (late > packet_usecs) {
+			/* Generator had nothing to send for a while. The
+			   pause is a part of the stream's timeline, so
+			   that listener plays next samples later, not
+			   right after previous ones. */
+			rtp->timestamp += (uint32_t) ((late * CW_RTP_SAMPLE_RATE) / CW_USECS_PER_SEC);
+			rtp->timeline = now;
+			rtp->marker = true;
+		}
+	}
+
+	cw_rtp_put_header_internal(gen);
+	const int payload_size = cw_rtp_encode_internal(gen, rtp->packet + CW_RTP_HEADER_SIZE);
+	cw_ret_t cwret = CW_SUCCESS;
+	if (payload_size <= 0) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+			      MSG_PREFIX "write: failed to encode samples (%d)", payload_size);
+		cwret = CW_FAILURE;
+	} else {
+		const ssize_t rv = send(rtp->socket_fd, rtp->packet, (size_t) (CW_RTP_HEADER_SIZE + payload_size), MSG_NOSIGNAL);
+		if (-1 == rv && ECONNREFUSED != errno) {
+			/* Listener that isn't running yet (port
+			   unreachable) is not an error of the stream. */
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_WARNING,
+				      MSG_PREFIX "write: failed to send packet: '%s'", strerror(errno));
+			cwret = CW_FAILURE;
+		}
+	}
+
+	/* A lost packet still takes its place in the stream. */
+	rtp->sequence++;
+	rtp->timestamp += (uint32_t) gen->buffer_n_samples;
+	rtp->marker = false;
+
+	cw_sleep_on_timeline_internal(&rtp->timeline, packet_usecs);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Put RTP header of next packet into packet buffer
+
+   @param[in] gen generator
+*/
+static void cw_rtp_put_header_internal(cw_gen_t * gen)
+{
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	uint8_t * header = rtp->packet;
+
+	header[0] = 0x80; /* Version 2, no padding, no extension, no CSRC. */
+	header[1] = (uint8_t) ((rtp->marker ? 0x80 : 0x00) | rtp->payload_type);
+	header[2] = (uint8_t) (rtp->sequence >> 8U);
+	header[3] = (uint8_t) rtp->sequence;
+	header[4] = (uint8_t) (rtp->timestamp >> 24U);
+	header[5] = (uint8_t) (rtp->timestamp >> 16U);
+	header[6] = (uint8_t) (rtp->timestamp >> 8U);
+	header[7] = (uint8_t) rtp->timestamp;
+	header[8] = (uint8_t) (rtp->ssrc >> 24U);
+	header[9] = (uint8_t) (rtp->ssrc >> 16U);
+	header[10] = (uint8_t) (rtp->ssrc >> 8U);
+	header[11] = (uint8_t) rtp->ssrc;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Put samples of generator's output buffer into payload of packet
+
+   Short buffer (see cw_gen_config_t::flush_on_empty_queue) is padded
+   with silence: every packet carries the same count of samples.
+
+   @param[in] gen generator
+   @param[out] payload payload of packet, CW_RTP_PAYLOAD_CAPACITY bytes
+
+   @return size of payload on success
+   @return zero or negative value on failure
+*/
+static int cw_rtp_encode_internal(cw_gen_t * gen, uint8_t * payload)
+{
+	cw_rtp_data_t * rtp = &gen->rtp_data;
+	const cw_sample_t * samples = gen->out_buffer;
+
+	if (gen->out_n_samples < gen->buffer_n_samples) {
+		/* Rest of generator's buffer is not used until next
+		   buffer is calculated. */
+		memset(gen->out_buffer + gen->out_n_samples, 0, (size_t) (gen->buffer_n_samples - gen->out_n_samples) * sizeof (cw_sample_t));
+	}
+
+	if (NULL != rtp->encoder) {
+		return (int) g_cw_rtp_opus_lib_handle.opus_encode(rtp->encoder, samples, gen->buffer_n_samples,
+								  payload, CW_RTP_PAYLOAD_CAPACITY);
+	}
+
+	/* L16: big-endian samples. */
+	for (int i = 0; i < gen->buffer_n_samples; i++) {
+		const uint16_t s = (uint16_t) samples[i];
+		payload[2 * i] = (uint8_t) (s >> 8U);
+		payload[2 * i + 1] = (uint8_t) s;
+	}
+	return gen->buffer_n_samples * (int) sizeof (cw_sample_t);
+}
+
+
+
+
+/**
+   @brief Load Opus library and resolve its symbols
+
+   Loading is attempted only once.
+
+   @return true if the library is available
+   @return false otherwise
+*/
+static bool cw_rtp_load_opus_internal(void)
+{
+	pthread_mutex_lock(&g_cw_rtp_opus_lib_mutex);
+	if (!g_cw_rtp_opus_lib_handle.load_attempted) {
+		g_cw_rtp_opus_lib_handle.load_attempted = true;
+
+		if (CW_SUCCESS != cw_dlopen_internal("libopus.so.0", &g_cw_rtp_opus_lib_handle.lib_handle)) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_INFO,
+				      MSG_PREFIX "can't open Opus library");
+			g_cw_rtp_opus_lib_handle.lib_handle = NULL;
+		} else {
+			const int rv = cw_rtp_opus_dlsym_internal(&g_cw_rtp_opus_lib_handle);
+			if (rv < 0) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_SOUND_SYSTEM, CW_DEBUG_ERROR,
+					      MSG_PREFIX "failed to resolve Opus symbol #%d, can't correctly load Opus library", rv);
+				dlclose(g_cw_rtp_opus_lib_handle.lib_handle);
+				g_cw_rtp_opus_lib_handle.lib_handle = NULL;
+			}
+		}
+	}
+	const bool loaded = NULL != g_cw_rtp_opus_lib_handle.lib_handle;
+	pthread_mutex_unlock(&g_cw_rtp_opus_lib_mutex);
+
+	return loaded;
+}
+
+
+
+
+/**
+   @brief Resolve/get symbols from Opus library
+
+   @param[in,out] cw_opus libcw Opus data structure with library handle to opened Opus library
+
+   @return 0 on success
+   @return negative value on failure
+*/
+static int cw_rtp_opus_dlsym_internal(cw_rtp_opus_lib_handle_t * cw_opus)
+{
+#define CW_OPUS_DLSYM(symbol)						\
+	*(void **) &(cw_opus->symbol) = dlsym(cw_opus->lib_handle, #symbol); \
+	if (!cw_opus->symbol) return -(__LINE__);
+
+	CW_OPUS_DLSYM(opus_encoder_create);
+	CW_OPUS_DLSYM(opus_encode);
+	CW_OPUS_DLSYM(opus_encoder_ctl);
+	CW_OPUS_DLSYM(opus_encoder_destroy);
+
+#undef CW_OPUS_DLSYM
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Resolve "host:port" name of RTP listener
+
+   @param[in] device_name "host:port", "[address]:port" or "host", NULL or empty string for default listener
+   @param[out] result list of addresses, to be freed with freeaddrinfo()
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+static cw_ret_t cw_rtp_resolve_internal(const char * device_name, struct addrinfo ** result)
+{
+	char name[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	if (NULL == device_name || '\0' == device_name[0]) {
+		snprintf(name, sizeof (name), "%s", CW_DEFAULT_RTP_DEVICE);
+	} else {
+		snprintf(name, sizeof (name), "%s", device_name);
+	}
+
+	char * host = name;
+	const char * port = CW_RTP_DEFAULT_PORT;
+	if ('[' == name[0]) {
+		char * end = strchr(name, ']');
+		if (NULL == end) {
+			return CW_FAILURE;
+		}
+		*end = '\0';
+		host = name + 1;
+		if (':' == end[1]) {
+			port = end + 2;
+		} else if ('\0' != end[1]) {
+			return CW_FAILURE;
+		}
+	} else {
+		char * colon = strrchr(name, ':');
+		if (NULL != colon && colon == strchr(name, ':')) {
+			/* Exactly one colon: it separates port. Names
+			   with many colons are IPv6 addresses without
+			   port. */
+			*colon = '\0';
+			port = colon + 1;
+		}
+	}
+	if ('\0' == host[0] || '\0' == port[0]) {
+		return CW_FAILURE;
+	}
+
+	struct addrinfo hints = { 0 };
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	hints.ai_flags = AI_NUMERICSERV;
+	if (0 != getaddrinfo(host, port, &hints, result)) {
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+}
@@ -0,0 +1,72 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_RTP
+#define H_LIBCW_RTP
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Size of header of RTP packet without CSRC list and extensions. */
+#define CW_RTP_HEADER_SIZE 12
+
+/* Capacity of payload of RTP packet. Payload of one packet is one
+   buffer of generator: Opus frame, or raw samples when Opus library
+   is not available. Fits in Ethernet frame with IPv6 and UDP
+   headers. */
+#define CW_RTP_PAYLOAD_CAPACITY 1200
+
+
+
+
+typedef struct {
+	int socket_fd;
+
+	/* Opus encoder (OpusEncoder *), NULL if samples are sent as
+	   uncompressed L16. */
+	void * encoder;
+	uint8_t payload_type;
+
+	/* Fields of RTP header. */
+	uint16_t sequence;
+	uint32_t timestamp;
+	uint32_t ssrc;
+	bool marker;            /* Set marker bit in next packet: first packet of talkspurt. */
+
+	/* Time at which samples of next packet should start to play.
+	   Generator's thread is blocked until this time, as if it was
+	   writing to a sound card. */
+	struct timespec timeline;
+	bool timeline_started;
+
+	uint8_t packet[CW_RTP_HEADER_SIZE + CW_RTP_PAYLOAD_CAPACITY];
+} cw_rtp_data_t;
+
+
+
+
+#include "libcw_gen.h"
+
+
+
+
+cw_ret_t cw_rtp_init_gen_internal(cw_gen_t * gen);
+
+
+
+
+#endif /* #ifndef H_LIBCW_RTP */
@@ -0,0 +1,378 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_scheduler.c
+
+   @brief Library-wide scheduler of deadlines of libcw components.
+
+   Components that need to do something at a specific moment (e.g. a
+   receiver that has to notice that inter-character-space has elapsed)
+   register a deadline with the scheduler instead of running their own
+   thread or polling on a timer. One scheduler thread serves all
+   deadlines: it keeps them in a binary min-heap, sleeps until the
+   earliest one on absolute CLOCK_MONOTONIC timeline, and calls callback
+   of each entry whose deadline has passed.
+
+   The thread is waiting on a condition variable configured with
+   CLOCK_MONOTONIC, so it can be woken up when an earlier deadline is
+   scheduled, and its sleep isn't affected by changes of wall-clock
+   time. The thread is created with first scheduled deadline and exits
+   when there are no deadlines left.
+
+   Callbacks are called without scheduler's lock held, so they can
+   schedule or cancel deadlines. They should be short: they delay
+   other deadlines.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+
+
+#include "libcw_debug.h"
+#include "libcw_scheduler.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/scheduler: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/* Signalled when callback of ->running_entry returns. */
+	pthread_cond_t running_cond;
+
+	/* Binary min-heap of scheduled entries, ordered by deadline. */
+	cw_scheduler_entry_t ** heap;
+	size_t heap_size;
+	size_t heap_capacity;
+
+	bool is_thread_running;
+	pthread_t thread;
+
+	/* Entry whose callback is being called by scheduler thread. */
+	const cw_scheduler_entry_t * running_entry;
+} cw_scheduler_t;
+
+
+
+
+static cw_scheduler_t g_cw_scheduler = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.running_cond = PTHREAD_COND_INITIALIZER,
+};
+static pthread_once_t g_cw_scheduler_once = PTHREAD_ONCE_INIT;
+
+
+
+
+static void cw_scheduler_init_internal(void);
+static void * cw_scheduler_thread_fn(void * arg);
+static void cw_scheduler_heap_swap_internal(size_t a, size_t b);
+static void cw_scheduler_heap_sift_up_internal(size_t idx);
+static void cw_scheduler_heap_sift_down_internal(size_t idx);
+static void cw_scheduler_heap_remove_internal(cw_scheduler_entry_t * entry);
+
+
+
+
+/**
+   @brief Initialize scheduler's entry
+
+   @param[out] entry entry to initialize
+   @param[in] callback function to call at entry's deadlines
+   @param[in] callback_arg argument of @p callback
+*/
+void cw_scheduler_entry_init_internal(cw_scheduler_entry_t * entry, cw_scheduler_callback_t callback, void * callback_arg)
+{
+	entry->deadline = 0;
+	entry->callback = callback;
+	entry->callback_arg = callback_arg;
+	entry->heap_idx = -1;
+}
+
+
+
+
+/**
+   @brief Schedule or re-schedule deadline of an entry
+
+   If @p entry is already scheduled, its deadline is moved to
+   @p deadline. Deadlines in the past are served immediately.
+
+   @param[in,out] entry entry to schedule
+   @param[in] deadline deadline on timeline of cw_scheduler_now_internal() [microseconds]
+
+   @return true on success
+   @return false on failure to allocate memory or to start scheduler thread
+*/
+bool cw_scheduler_schedule_internal(cw_scheduler_entry_t * entry, int64_t deadline)
+{
+	pthread_once(&g_cw_scheduler_once, cw_scheduler_init_internal);
+
+	pthread_mutex_lock(&g_cw_scheduler.mutex);
+
+	if (entry->heap_idx < 0) {
+		if (g_cw_scheduler.heap_size == g_cw_scheduler.heap_capacity) {
+			const size_t capacity = g_cw_scheduler.heap_capacity ? 2 * g_cw_scheduler.heap_capacity : 16;
+			cw_scheduler_entry_t ** heap = realloc(g_cw_scheduler.heap, capacity * sizeof (cw_scheduler_entry_t *));
+			if (NULL == heap) {
+				cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+					      MSG_PREFIX "realloc()");
+				pthread_mutex_unlock(&g_cw_scheduler.mutex);
+				return false;
+			}
+			g_cw_scheduler.heap = heap;
+			g_cw_scheduler.heap_capacity = capacity;
+		}
+		entry->deadline = deadline;
+		entry->heap_idx = (ptrdiff_t) g_cw_scheduler.heap_size;
+		g_cw_scheduler.heap[g_cw_scheduler.heap_size++] = entry;
+		cw_scheduler_heap_sift_up_internal((size_t) entry->heap_idx);
+	} else {
+		const int64_t old_deadline = entry->deadline;
+		entry->deadline = deadline;
+		if (deadline < old_deadline) {
+			cw_scheduler_heap_sift_up_internal((size_t) entry->heap_idx);
+		} else {
+			cw_scheduler_heap_sift_down_internal((size_t) entry->heap_idx);
+		}
+	}
+
+	if (!g_cw_scheduler.is_thread_running) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		const int rv = pthread_create(&g_cw_scheduler.thread, &attr, cw_scheduler_thread_fn, NULL);
+		pthread_attr_destroy(&attr);
+		if (0 != rv) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "failed to create scheduler thread");
+			cw_scheduler_heap_remove_internal(entry);
+			pthread_mutex_unlock(&g_cw_scheduler.mutex);
+			return false;
+		}
+		g_cw_scheduler.is_thread_running = true;
+	} else if (0 == entry->heap_idx) {
+		/* New earliest deadline. */
+		pthread_cond_signal(&g_cw_scheduler.cond);
+	} else {
+		; /* Thread will get to the entry in time. */
+	}
+
+	pthread_mutex_unlock(&g_cw_scheduler.mutex);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Cancel deadline of an entry
+
+   If callback of the entry is being called by scheduler thread, the
+   function waits for the callback to return (unless it is called by
+   the callback itself). After the function returns, the entry's
+   callback won't be called until the entry is scheduled again, so
+   data structure containing @p entry may be deallocated.
+
+   @param[in,out] entry entry to cancel
+*/
+void cw_scheduler_cancel_internal(cw_scheduler_entry_t * entry)
+{
+	pthread_mutex_lock(&g_cw_scheduler.mutex);
+
+	while (g_cw_scheduler.running_entry == entry
+	       && !pthread_equal(pthread_self(), g_cw_scheduler.thread)) {
+		pthread_cond_wait(&g_cw_scheduler.running_cond, &g_cw_scheduler.mutex);
+	}
+	if (entry->heap_idx >= 0) {
+		cw_scheduler_heap_remove_internal(entry);
+	}
+
+	pthread_mutex_unlock(&g_cw_scheduler.mutex);
+}
+
+
+
+
+/**
+   @brief Get current time on scheduler's timeline
+
+   @return time since unspecified point in the past (CLOCK_MONOTONIC) [microseconds]
+*/
+int64_t cw_scheduler_now_internal(void)
+{
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_nsec / 1000;
+}
+
+
+
+
+/**
+   @brief Initialize condition variable of scheduler with monotonic clock
+*/
+static void cw_scheduler_init_internal(void)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&g_cw_scheduler.cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+
+
+
+/**
+   @brief Main function of scheduler thread
+
+   @param[in] arg unused
+
+   @return NULL
+*/
+static void * cw_scheduler_thread_fn(__attribute__((unused)) void * arg)
+{
+	pthread_mutex_lock(&g_cw_scheduler.mutex);
+	while (g_cw_scheduler.heap_size > 0) {
+		cw_scheduler_entry_t * entry = g_cw_scheduler.heap[0];
+		const int64_t now = cw_scheduler_now_internal();
+		if (now < entry->deadline) {
+			const struct timespec until = {
+				.tv_sec = (time_t) (entry->deadline / CW_USECS_PER_SEC),
+				.tv_nsec = (long) (entry->deadline % CW_USECS_PER_SEC) * 1000
+			};
+			pthread_cond_timedwait(&g_cw_scheduler.cond, &g_cw_scheduler.mutex, &until);
+			continue;
+		}
+
+		cw_scheduler_heap_remove_internal(entry);
+		g_cw_scheduler.running_entry = entry;
+		const cw_scheduler_callback_t callback = entry->callback;
+		void * callback_arg = entry->callback_arg;
+
+		pthread_mutex_unlock(&g_cw_scheduler.mutex);
+		callback(callback_arg);
+		pthread_mutex_lock(&g_cw_scheduler.mutex);
+
+		g_cw_scheduler.running_entry = NULL;
+		pthread_cond_broadcast(&g_cw_scheduler.running_cond);
+	}
+	g_cw_scheduler.is_thread_running = false;
+	pthread_mutex_unlock(&g_cw_scheduler.mutex);
+
+	return NULL;
+}
+
+
+
+
+static void cw_scheduler_heap_swap_internal(size_t a, size_t b)
+{
+	cw_scheduler_entry_t * tmp = g_cw_scheduler.heap[a];
+	g_cw_scheduler.heap[a] = g_cw_scheduler.heap[b];
+	g_cw_scheduler.heap[b] = tmp;
+	g_cw_scheduler.heap[a]->heap_idx = (ptrdiff_t) a;
+	g_cw_scheduler.heap[b]->heap_idx = (ptrdiff_t) b;
+}
+
+
+
+
+static void cw_scheduler_heap_sift_up_internal(size_t idx)
+{
+	while (idx > 0) {
+		const size_t parent = (idx - 1) / 2;
+		if (g_cw_scheduler.heap[parent]->deadline <= g_cw_scheduler.heap[idx]->deadline) {
+			break;
+		}
+		cw_scheduler_heap_swap_internal(parent, idx);
+		idx = parent;
+	}
+}
+
+
+
+
+static void cw_scheduler_heap_sift_down_internal(size_t idx)
+{
+	while (true) {
+		const size_t left = 2 * idx + 1;
+		const size_t right = left + 1;
+		size_t smallest = idx;
+		if (left < g_cw_scheduler.heap_size && g_cw_scheduler.heap[left]->deadline < g_cw_scheduler.heap[smallest]->deadline) {
+			smallest = left;
+		}
+		if (right < g_cw_scheduler.heap_size && g_cw_scheduler.heap[right]->deadline < g_cw_scheduler.heap[smallest]->deadline) {
+			smallest = right;
+		}
+		if (smallest == idx) {
+			break;
+		}
+		cw_scheduler_heap_swap_internal(idx, smallest);
+		idx = smallest;
+	}
+}
+
+
+
+
+static void cw_scheduler_heap_remove_internal(cw_scheduler_entry_t * entry)
+{
+	const size_t idx = (size_t) entry->heap_idx;
+	const size_t last = g_cw_scheduler.heap_size - 1;
+	if (idx != last) {
+		cw_scheduler_heap_swap_internal(idx, last);
+	}
+	g_cw_scheduler.heap_size--;
+	entry->heap_idx = -1;
+
+	if (idx < g_cw_scheduler.heap_size) {
+		cw_scheduler_heap_sift_up_internal(idx);
+		cw_scheduler_heap_sift_down_internal(idx);
+	}
+}
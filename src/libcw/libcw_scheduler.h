@@ -0,0 +1,49 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SCHEDULER
+#define H_LIBCW_SCHEDULER
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+/* Function called by scheduler thread when deadline of entry has
+   passed. */
+typedef void (* cw_scheduler_callback_t)(void * callback_arg);
+
+
+
+
+/* Deadline of libcw component, kept in scheduler's heap. The entry is
+   embedded in the component's data structure and must be initialized
+   with cw_scheduler_entry_init_internal(). */
+typedef struct {
+	int64_t deadline; /* [microseconds] On CLOCK_MONOTONIC timeline, see cw_scheduler_now_internal(). */
+	cw_scheduler_callback_t callback;
+	void * callback_arg;
+
+	/* Position in scheduler's heap, or -1 when not scheduled. */
+	ptrdiff_t heap_idx;
+} cw_scheduler_entry_t;
+
+
+
+
+void cw_scheduler_entry_init_internal(cw_scheduler_entry_t * entry, cw_scheduler_callback_t callback, void * callback_arg);
+bool cw_scheduler_schedule_internal(cw_scheduler_entry_t * entry, int64_t deadline);
+void cw_scheduler_cancel_internal(cw_scheduler_entry_t * entry);
+int64_t cw_scheduler_now_internal(void);
+
+
+
+
+#endif /* #ifndef H_LIBCW_SCHEDULER */
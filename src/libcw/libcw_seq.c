@@ -0,0 +1,222 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_seq.c
+
+   @brief Sequencer: text to timed Marks and Spaces, without sound.
+
+   A generator has a tone queue, a buffer of samples, a thread and a
+   sound sink. Applications simulating thousands of stations (e.g. for
+   training of receivers, or for testing of decoders) don't need any of
+   them: they need to know only when each Mark starts and how long it
+   lasts.
+
+   A sequencer is a few dozen bytes of timing state. Text sent to the
+   sequencer is converted into Marks and Spaces that are passed to a
+   callback with their start times on sequencer's own timeline.
+   Durations are calculated with the same functions that generator uses
+   when enqueueing characters (see cw_gen_calculate_durations_internal(),
+   cw_gen_ics_duration_internal() and cw_gen_iws_duration_internal()),
+   so a sequencer with the same parameters produces the same timing as
+   a generator. Adjacent spaces (inter-mark-space followed by
+   inter-character-space or inter-word-space) are reported as one
+   Space.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_gen.h"
+#include "libcw_seq.h"
+
+
+
+
+#define MSG_PREFIX "libcw/seq: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+static void cw_seq_emit_internal(cw_seq_t * seq, bool is_mark, int64_t duration, cw_seq_event_callback_t callback, void * callback_arg);
+
+
+
+
+cw_seq_t * cw_seq_new(void)
+{
+	cw_seq_t * seq = calloc(1, sizeof (cw_seq_t));
+	if (NULL == seq) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	seq->send_speed = CW_SPEED_INITIAL;
+	seq->weighting = CW_WEIGHTING_INITIAL;
+	seq->gap = CW_GAP_INITIAL;
+	cw_gen_calculate_durations_internal(seq->send_speed, seq->weighting, seq->gap, &seq->durations);
+
+	return seq;
+}
+
+
+
+
+void cw_seq_delete(cw_seq_t ** seq)
+{
+	if (NULL == seq || NULL == *seq) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_GENERATOR, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL sequencer");
+		return;
+	}
+
+	free(*seq);
+	*seq = NULL;
+}
+
+
+
+
+cw_ret_t cw_seq_set_parameters(cw_seq_t * seq, const cw_gen_parameters_t * parameters)
+{
+	if (NULL == seq || NULL == parameters) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (parameters->speed < CW_SPEED_MIN || parameters->speed > CW_SPEED_MAX
+	    || parameters->gap < CW_GAP_MIN || parameters->gap > CW_GAP_MAX
+	    || parameters->weighting < CW_WEIGHTING_MIN || parameters->weighting > CW_WEIGHTING_MAX) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	seq->send_speed = parameters->speed;
+	seq->weighting = parameters->weighting;
+	seq->gap = parameters->gap;
+	cw_gen_calculate_durations_internal(seq->send_speed, seq->weighting, seq->gap, &seq->durations);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+cw_ret_t cw_seq_send_string(cw_seq_t * seq, const char * string, cw_seq_event_callback_t callback, void * callback_arg)
+{
+	if (NULL == seq || NULL == string || NULL == callback) {
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+	if (!cw_string_is_valid(string)) {
+		errno = ENOENT;
+		return CW_FAILURE;
+	}
+
+	const cw_gen_durations_t * durations = &seq->durations;
+
+	/* Spaces are accumulated until next Mark or end of string. */
+	int64_t space_duration = 0;
+
+	for (size_t i = 0; string[i] != '\0'; i++) {
+		if (' ' == string[i]) {
+			/* Generator enqueues inter-word-space as two halves
+			   plus the adjustment space. */
+			const int iws_duration = cw_gen_iws_duration_internal(durations, seq->space_units_count);
+			space_duration += 2 * (iws_duration / 2) + durations->adjustment_space_duration;
+			seq->space_units_count = 0;
+			continue;
+		}
+
+		unsigned int n_marks = 0;
+		unsigned int bits = 0;
+		cw_character_get_packed_representation(string[i], &n_marks, &bits);
+		for (unsigned int m = 0; m < n_marks; m++) {
+			if (space_duration > 0) {
+				cw_seq_emit_internal(seq, false, space_duration, callback, callback_arg);
+				space_duration = 0;
+			}
+			const bool is_dash = bits & (1U << (n_marks - 1 - m));
+			cw_seq_emit_internal(seq, true, is_dash ? durations->dash_duration : durations->dot_duration, callback, callback_arg);
+
+			space_duration += durations->ims_duration;
+			seq->space_units_count = UNITS_PER_IMS;
+		}
+
+		space_duration += cw_gen_ics_duration_internal(durations, seq->space_units_count) + durations->additional_space_duration;
+		seq->space_units_count = UNITS_PER_ICS;
+	}
+
+	if (space_duration > 0) {
+		cw_seq_emit_internal(seq, false, space_duration, callback, callback_arg);
+	}
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int64_t cw_seq_get_time(const cw_seq_t * seq)
+{
+	return seq->time;
+}
+
+
+
+
+/**
+   @brief Pass a Mark or Space to callback and advance sequencer's time
+
+   @param[in] seq sequencer
+   @param[in] is_mark whether the event is a Mark or a Space
+   @param[in] duration duration of the event [microseconds]
+   @param[in] callback callback receiving the event
+   @param[in] callback_arg argument passed to @p callback
+*/
+static void cw_seq_emit_internal(cw_seq_t * seq, bool is_mark, int64_t duration, cw_seq_event_callback_t callback, void * callback_arg)
+{
+	const cw_seq_event_t event = {
+		.is_mark = is_mark,
+		.start = seq->time,
+		.duration = duration,
+	};
+	seq->time += duration;
+	callback(callback_arg, &event);
+}
@@ -0,0 +1,47 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SEQ
+#define H_LIBCW_SEQ
+
+
+
+
+#include <stdint.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_gen.h"
+
+
+
+
+/* Sequencer: timing of Morse code of a generator, without tone queue,
+   buffer, thread or sound sink. */
+struct cw_seq_struct {
+	/* Parameters set with cw_seq_set_parameters(). */
+	int send_speed;
+	int weighting;
+	int gap;
+
+	/* Durations of Marks and Spaces, calculated from parameters the
+	   same way as in generator. */
+	cw_gen_durations_t durations;
+
+	/* Count of Units of Spaces after last Mark, see
+	   cw_gen_t::space_units_count. */
+	int space_units_count;
+
+	/* Start of next event, counted from creation of sequencer.
+	   [microseconds] */
+	int64_t time;
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_SEQ */
@@ -0,0 +1,564 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_shm_ring.c
+
+   @brief Ring of samples in POSIX shared memory.
+
+   Generator's samples are passed to other processes through a ring
+   buffer in shared memory object. The writer is a sink of generator
+   (see libcw_gen_sink.c), so copying samples to the ring is done in
+   sink's thread and never delays the generator.
+
+   Readers read samples in place. Writer wakes readers with futex only
+   when some of them sleep waiting for samples, so neither side makes
+   system calls per buffer while readers keep up with the stream. On
+   systems without futex readers poll the ring.
+
+   Layout of shared memory object and protocol of reading it are
+   documented in libcw2.h, at cw_shm_ring_header_t and
+   cw_shm_ring_new().
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_shm_ring.h"
+
+
+
+
+#define MSG_PREFIX "libcw/shm ring: "
+
+/* Interval of polling of ring by readers on systems without futex. */
+#define CW_SHM_RING_POLL_INTERVAL_NS 1000000
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+
+
+
+
+static bool cw_shm_ring_name_is_valid_internal(const char * name);
+static bool cw_shm_ring_header_is_valid_internal(const cw_shm_ring_header_t * header, size_t map_size);
+static void cw_shm_ring_copy_out_internal(const cw_shm_ring_t * ring, uint64_t position, cw_sample_t * samples, int n_samples);
+static void cw_shm_ring_wait_internal(cw_shm_ring_t * ring, uint32_t futex, const struct timespec * deadline);
+static void cw_shm_ring_wake_internal(cw_shm_ring_t * ring);
+static bool cw_shm_ring_deadline_passed_internal(const struct timespec * deadline);
+
+
+
+
+cw_shm_ring_t * cw_shm_ring_new(const char * name, int capacity)
+{
+	if (!cw_shm_ring_name_is_valid_internal(name)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid name of shared memory object");
+		errno = EINVAL;
+		return NULL;
+	}
+	if (capacity < CW_SHM_RING_CAPACITY_MIN || capacity > CW_SHM_RING_CAPACITY_MAX
+	    || 0 != (capacity & (capacity - 1))) {
+
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid capacity %d", capacity);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	cw_shm_ring_t * ring = (cw_shm_ring_t *) calloc(1, sizeof (cw_shm_ring_t));
+	if (NULL == ring) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		errno = ENOMEM;
+		return NULL;
+	}
+	snprintf(ring->name, sizeof (ring->name), "%s", name);
+	ring->map_size = CW_SHM_RING_HEADER_SIZE + (size_t) capacity * sizeof (cw_sample_t);
+
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (-1 == fd) {
+		const int err = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "shm_open(%s): %s", name, strerror(err));
+		free(ring);
+		errno = err;
+		return NULL;
+	}
+
+	void * map = MAP_FAILED;
+	if (0 == ftruncate(fd, (off_t) ring->map_size)) {
+		map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if (MAP_FAILED == map) {
+		const int err = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to map shared memory object %s: %s", name, strerror(err));
+		close(fd);
+		shm_unlink(name);
+		free(ring);
+		errno = err;
+		return NULL;
+	}
+	/* Mapping stays valid after closing its descriptor. */
+	close(fd);
+
+	ring->header = (cw_shm_ring_header_t *) map;
+	ring->samples = (cw_sample_t *) ((uint8_t *) map + CW_SHM_RING_HEADER_SIZE);
+	ring->capacity = (uint32_t) capacity;
+	ring->is_writer = true;
+
+	/* ftruncate() has filled the object with zeros. */
+	ring->header->version = CW_SHM_RING_VERSION;
+	ring->header->header_size = CW_SHM_RING_HEADER_SIZE;
+	ring->header->capacity = (uint32_t) capacity;
+	ring->header->sample_size = sizeof (cw_sample_t);
+	/* Readers opening the ring accept it only when they see the
+	   magic, so it is stored after the other fields. */
+	__atomic_store_n(&ring->header->magic, CW_SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+	cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_INFO,
+		      MSG_PREFIX "created ring %s of %d samples", name, capacity);
+
+	return ring;
+}
+
+
+
+
+cw_shm_ring_t * cw_shm_ring_open(const char * name)
+{
+	if (!cw_shm_ring_name_is_valid_internal(name)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid name of shared memory object");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Readers write ::n_waiters, so the object is mapped for
+	   writing. */
+	const int fd = shm_open(name, O_RDWR, 0);
+	if (-1 == fd) {
+		const int err = errno;
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "shm_open(%s): %s", name, strerror(err));
+		errno = err;
+		return NULL;
+	}
+	struct stat st;
+	if (0 != fstat(fd, &st)) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof (cw_shm_ring_header_t)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "shared memory object %s is too small", name);
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	const size_t map_size = (size_t) st.st_size;
+	void * map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const int err = errno;
+	close(fd);
+	if (MAP_FAILED == map) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "mmap(%s): %s", name, strerror(err));
+		errno = err;
+		return NULL;
+	}
+
+	const cw_shm_ring_header_t * header = (const cw_shm_ring_header_t *) map;
+	if (!cw_shm_ring_header_is_valid_internal(header, map_size)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_GENERATOR, CW_DEBUG_ERROR,
+			      MSG_PREFIX "shared memory object %s is not a ring of samples", name);
+		munmap(map, map_size);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	cw_shm_ring_t * ring = (cw_shm_ring_t *) calloc(1, sizeof (cw_shm_ring_t));
+	if (NULL == ring) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		munmap(map, map_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+	snprintf(ring->name, sizeof (ring->name), "%s", name);
+	ring->header = (cw_shm_ring_header_t *) map;
+	ring->samples = (cw_sample_t *) ((uint8_t *) map + header->header_size);
+	ring->map_size = map_size;
+	ring->capacity = header->capacity;
+	ring->is_writer = false;
+
+	return ring;
+}
+
+
+
+
+void cw_shm_ring_delete(cw_shm_ring_t ** ring)
+{
+	if (NULL == ring || NULL == *ring) {
+		return;
+	}
+
+	if ((*ring)->is_writer) {
+		shm_unlink((*ring)->name);
+	}
+	munmap((*ring)->header, (*ring)->map_size);
+	free(*ring);
+	*ring = NULL;
+
+	return;
+}
+
+
+
+
+void cw_shm_ring_write(void * ring_arg, const cw_sample_t * samples, int n_samples, int sample_rate)
+{
+	cw_shm_ring_t * ring = (cw_shm_ring_t *) ring_arg;
+	if (NULL == ring || !ring->is_writer || NULL == samples || n_samples <= 0) {
+		return;
+	}
+	cw_shm_ring_header_t * header = ring->header;
+
+	if (header->sample_rate != (uint32_t) sample_rate) {
+		__atomic_store_n(&header->sample_rate, (uint32_t) sample_rate, __ATOMIC_RELAXED);
+	}
+
+	/* Only writer modifies positions, so it can read them without
+	   synchronization. */
+	const uint64_t position = header->write_position;
+	const uint64_t end = position + (uint64_t) n_samples;
+
+	/* Samples that wouldn't fit in ring are overwritten anyway. */
+	uint64_t first = position;
+	if ((uint64_t) n_samples > ring->capacity) {
+		samples += (uint64_t) n_samples - ring->capacity;
+		first = end - ring->capacity;
+	}
+
+	/* Readers that see any of the samples written below see
+	   also the new reserve position. */
+	__atomic_store_n(&header->reserve_position, end, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	const uint32_t index = (uint32_t) (first & (ring->capacity - 1));
+	const uint32_t n = (uint32_t) (end - first);
+	const uint32_t n_head = n < ring->capacity - index ? n : ring->capacity - index;
+	memcpy(ring->samples + index, samples, n_head * sizeof (cw_sample_t));
+	memcpy(ring->samples, samples + n_head, (n - n_head) * sizeof (cw_sample_t));
+
+	__atomic_store_n(&header->write_position, end, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&header->futex, 1, __ATOMIC_SEQ_CST);
+
+	/* A reader either sees the incremented futex word before it
+	   sleeps, or it is already counted here. */
+	if (0 != __atomic_load_n(&header->n_waiters, __ATOMIC_SEQ_CST)) {
+		cw_shm_ring_wake_internal(ring);
+	}
+
+	return;
+}
+
+
+
+
+int cw_shm_ring_read(cw_shm_ring_t * ring, uint64_t * position, cw_sample_t * samples, int n_samples, int timeout_ms)
+{
+	if (NULL == ring || NULL == position || NULL == samples || n_samples <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	cw_shm_ring_header_t * header = ring->header;
+	const uint64_t capacity = ring->capacity;
+
+	struct timespec deadline = { 0 };
+	if (timeout_ms > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	while (true) {
+		/* Futex word is read before position, so that a write done
+		   after reading the position changes the word. */
+		const uint32_t futex = __atomic_load_n(&header->futex, __ATOMIC_SEQ_CST);
+		const uint64_t write_position = __atomic_load_n(&header->write_position, __ATOMIC_SEQ_CST);
+
+		if (write_position > *position) {
+			uint64_t start = *position;
+			if (write_position - start > capacity) {
+				start = write_position - capacity;
+			}
+			uint64_t n = write_position - start;
+			if (n > (uint64_t) n_samples) {
+				n = (uint64_t) n_samples;
+			}
+			cw_shm_ring_copy_out_internal(ring, start, samples, (int) n);
+
+			/* Discard samples that writer has started to overwrite
+			   while they were being copied. */
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			const uint64_t reserve_position = __atomic_load_n(&header->reserve_position, __ATOMIC_RELAXED);
+			if (reserve_position > capacity && reserve_position - capacity > start) {
+				const uint64_t n_overwritten = reserve_position - capacity - start;
+				if (n_overwritten >= n) {
+					*position = reserve_position - capacity;
+					continue;
+				}
+				memmove(samples, samples + n_overwritten, (size_t) (n - n_overwritten) * sizeof (cw_sample_t));
+				start += n_overwritten;
+				n -= n_overwritten;
+			}
+
+			*position = start + n;
+			return (int) n;
+		}
+
+		if (0 == timeout_ms) {
+			return 0;
+		}
+		if (timeout_ms > 0 && cw_shm_ring_deadline_passed_internal(&deadline)) {
+			return 0;
+		}
+		cw_shm_ring_wait_internal(ring, futex, timeout_ms > 0 ? &deadline : NULL);
+	}
+}
+
+
+
+
+const cw_shm_ring_header_t * cw_shm_ring_get_header(const cw_shm_ring_t * ring)
+{
+	if (NULL == ring) {
+		return NULL;
+	}
+	return ring->header;
+}
+
+
+
+
+/**
+   @brief Check name of shared memory object
+
+   Portable names of POSIX shared memory objects start with '/' and
+   don't contain other slashes.
+
+   @param[in] name name to check
+
+   @return true if name is valid
+   @return false otherwise
+*/
+static bool cw_shm_ring_name_is_valid_internal(const char * name)
+{
+	if (NULL == name || '/' != name[0] || '\0' == name[1]) {
+		return false;
+	}
+	if (NULL != strchr(name + 1, '/')) {
+		return false;
+	}
+	return strlen(name) < CW_SHM_RING_NAME_SIZE;
+}
+
+
+
+
+/**
+   @brief Check header of ring opened by reader
+
+   @param[in] header header at beginning of shared memory object
+   @param[in] map_size size of shared memory object
+
+   @return true if header describes a ring that fits in the object
+   @return false otherwise
+*/
+static bool cw_shm_ring_header_is_valid_internal(const cw_shm_ring_header_t * header, size_t map_size)
+{
+	if (CW_SHM_RING_MAGIC != __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+	if (CW_SHM_RING_VERSION != header->version
+	    || sizeof (cw_sample_t) != header->sample_size) {
+		return false;
+	}
+	if (header->header_size < sizeof (cw_shm_ring_header_t)
+	    || 0 != header->header_size % sizeof (cw_sample_t)) {
+		return false;
+	}
+	const uint32_t capacity = header->capacity;
+	if (capacity < CW_SHM_RING_CAPACITY_MIN || capacity > CW_SHM_RING_CAPACITY_MAX
+	    || 0 != (capacity & (capacity - 1))) {
+		return false;
+	}
+	return header->header_size + (size_t) capacity * sizeof (cw_sample_t) <= map_size;
+}
+
+
+
+
+/**
+   @brief Copy samples from ring, handling wrap-around
+
+   @param[in] ring ring
+   @param[in] position position of first sample to copy
+   @param[out] samples buffer for samples
+   @param[in] n_samples count of samples to copy, not larger than capacity
+*/
+static void cw_shm_ring_copy_out_internal(const cw_shm_ring_t * ring, uint64_t position, cw_sample_t * samples, int n_samples)
+{
+	const uint32_t index = (uint32_t) (position & (ring->capacity - 1));
+	const uint32_t n = (uint32_t) n_samples;
+	const uint32_t n_head = n < ring->capacity - index ? n : ring->capacity - index;
+	memcpy(samples, ring->samples + index, n_head * sizeof (cw_sample_t));
+	memcpy(samples + n_head, ring->samples, (n - n_head) * sizeof (cw_sample_t));
+
+	return;
+}
+
+
+
+
+/**
+   @brief Sleep until writer changes futex word, or until deadline
+
+   The function may return earlier (spurious wakeup, signal); the
+   caller checks the ring again.
+
+   @param[in] ring ring
+   @param[in] futex value of futex word seen together with lack of new samples
+   @param[in] deadline time (CLOCK_MONOTONIC) of end of waiting, NULL for no limit
+*/
+static void cw_shm_ring_wait_internal(cw_shm_ring_t * ring, uint32_t futex, const struct timespec * deadline)
+{
+#if defined(__linux__)
+	struct timespec timeout;
+	struct timespec * timeout_ptr = NULL;
+	if (NULL != deadline) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timeout.tv_sec = deadline->tv_sec - now.tv_sec;
+		timeout.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+		if (timeout.tv_nsec < 0) {
+			timeout.tv_sec--;
+			timeout.tv_nsec += 1000000000;
+		}
+		if (timeout.tv_sec < 0) {
+			return;
+		}
+		timeout_ptr = &timeout;
+	}
+
+	__atomic_add_fetch(&ring->header->n_waiters, 1, __ATOMIC_SEQ_CST);
+	/* Shared futex: writer is in another process. FUTEX_WAIT
+	   returns immediately if the word differs from @p futex. */
+	syscall(SYS_futex, &ring->header->futex, FUTEX_WAIT, futex, timeout_ptr, NULL, 0);
+	__atomic_sub_fetch(&ring->header->n_waiters, 1, __ATOMIC_SEQ_CST);
+#else
+	(void) ring;
+	(void) futex;
+	(void) deadline;
+	const struct timespec interval = { .tv_sec = 0, .tv_nsec = CW_SHM_RING_POLL_INTERVAL_NS };
+	nanosleep(&interval, NULL);
+#endif
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wake all readers sleeping on futex word of ring
+
+   @param[in] ring ring
+*/
+static void cw_shm_ring_wake_internal(cw_shm_ring_t * ring)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, &ring->header->futex, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+	(void) ring;
+#endif
+
+	return;
+}
+
+
+
+
+/**
+   @brief Check if deadline has passed
+
+   @param[in] deadline time (CLOCK_MONOTONIC) to check
+
+   @return true if current time is at or after @p deadline
+   @return false otherwise
+*/
+static bool cw_shm_ring_deadline_passed_internal(const struct timespec * deadline)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != deadline->tv_sec) {
+		return now.tv_sec > deadline->tv_sec;
+	}
+	return now.tv_nsec >= deadline->tv_nsec;
+}
@@ -0,0 +1,56 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SHM_RING
+#define H_LIBCW_SHM_RING
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+#include "libcw2.h"
+
+
+
+
+/* Offset of samples from beginning of shared memory object. Samples
+   start at cache line boundary, away from fields of header modified
+   by readers. */
+#define CW_SHM_RING_HEADER_SIZE 64
+
+/* Limits of capacity of ring [samples]. */
+#define CW_SHM_RING_CAPACITY_MIN 256
+#define CW_SHM_RING_CAPACITY_MAX (1 << 26)
+
+/* Size of name of shared memory object, including terminating NUL. */
+#define CW_SHM_RING_NAME_SIZE 64
+
+
+
+
+struct cw_shm_ring_struct {
+	/* Beginning of mapping of shared memory object. */
+	cw_shm_ring_header_t * header;
+	cw_sample_t * samples;
+	size_t map_size;
+
+	/* Capacity copied from header. Reader doesn't trust the value
+	   in shared memory after validating it at opening. */
+	uint32_t capacity;
+
+	/* Ring created by this process with cw_shm_ring_new(). */
+	bool is_writer;
+	char name[CW_SHM_RING_NAME_SIZE];
+};
+
+
+
+
+#endif /* #ifndef H_LIBCW_SHM_RING */
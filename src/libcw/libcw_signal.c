@@ -23,6 +23,14 @@
 
    \brief Signal handling routines.
 
+   Timeouts requested with cw_timer_run_with_handler_internal() are
+   served by timer service. By default the service uses timer of
+   legacy API's context (an entry of scheduler thread, see
+   libcw_scheduler.c), so each context has its own timer, and no
+   signals are sent to the process. The original implementation using
+   setitimer() and SIGALRM is compiled when LIBCW_WITH_SIGALRM_TIMERS
+   is defined (configure's --enable-sigalrm-timers).
+
    There are some static variables in this file, maybe they should be
    moved to some common structure. I've noticed that these functions
    are used in libcw_gen, libcw_tq and libcw_key. Perhaps these static
@@ -37,6 +45,7 @@
 
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 
@@ -46,6 +55,7 @@
 #include "libcw.h"
 #include "libcw_debug.h"
 #include "libcw_gen.h"
+#include "libcw_scheduler.h"
 #include "libcw_signal.h"
 #include "libcw_utils.h"
 
@@ -82,82 +92,147 @@
 
 
 
+/* SIGALRM is reserved for internal use only when the library uses
+   SIGALRM timers. */
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
+#define CW_SIG_IS_RESERVED(signal_number) ((signal_number) == SIGALRM)
+#else
+#define CW_SIG_IS_RESERVED(signal_number) false
+#endif
+
+
+
+
 extern cw_debug_t cw_debug_object;
 extern cw_debug_t cw_debug_object_ev;
 extern cw_debug_t cw_debug_object_dev;
 
 
-extern cw_gen_t *cw_generator;
 
 
 
 
 
 static int  cw_timer_run_internal(int usecs);
+static void cw_signal_main_handler_internal(int signal_number);
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
 static void cw_sigalrm_handlers_caller_internal(int signal_number);
 static int  cw_sigalrm_block_internal(bool block);
-static void cw_signal_main_handler_internal(int signal_number);
+#endif
 
 
 
 
 
-/* The library keeps a single central non-sparse list of SIGALRM signal
-   handlers. The handler functions will be called sequentially on each
-   SIGALRM received. */
+/* The library keeps a single central non-sparse list of timer (a.k.a.
+   SIGALRM signal) handlers. The handler functions will be called
+   sequentially on each timeout. */
 enum { CW_SIGALRM_HANDLERS_MAX = 32 };
 static void (*cw_sigalrm_handlers[CW_SIGALRM_HANDLERS_MAX])(void);
 
+/* Serializes additions to cw_sigalrm_handlers[]. */
+static pthread_mutex_t cw_sigalrm_handlers_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
 /* Flag to tell us if the SIGALRM handler is installed, and a place to
    keep the old SIGALRM disposition, so we can restore it when the
    library decides it can stop handling SIGALRM for a while.  */
 static bool cw_is_sigalrm_handlers_caller_installed = false;
 static struct sigaction cw_sigalrm_original_disposition;
+#else
+/* Replacement of blocking of SIGALRM with cw_block_callback(): while
+   the flag is set, scheduler thread waits before calling handlers. */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool blocked;
+} cw_timer_handlers_block = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.blocked = false,
+};
+#endif
 
 
 
 
 
 /**
-   \brief Call handlers of SIGALRM signal
+   \brief Call registered timer handlers
 
-   This function calls the SIGALRM signal handlers of the library
-   subsystems, expecting them to ignore unexpected calls.
+   This function calls the timer handlers of the library subsystems,
+   expecting them to ignore unexpected calls.
 
    The handlers are kept in cw_sigalrm_handlers[] table, and can be added
    to the table with cw_timer_run_with_handler_internal().
 
-   SIGALRM is sent to a process every time an itimer timer expires.
-   The timer is set with cw_timer_run_internal().
+   The function is called by scheduler thread when timer of a context
+   expires, or by top level SIGALRM handler if library uses SIGALRM
+   timers.
 */
-void cw_sigalrm_handlers_caller_internal(__attribute__((unused)) int signal_number)
+void cw_timer_handlers_call_internal(void)
 {
-	/* Call the known functions that are interested in SIGALRM signal.
+#if !defined(LIBCW_WITH_SIGALRM_TIMERS)
+	pthread_mutex_lock(&cw_timer_handlers_block.mutex);
+	while (cw_timer_handlers_block.blocked) {
+		pthread_cond_wait(&cw_timer_handlers_block.cond, &cw_timer_handlers_block.mutex);
+	}
+#endif
+
+	/* Call the known functions that are interested in timeouts.
 	   Stop on the first free slot found; valid because the array is
 	   filled in order from index 0, and there are no deletions. */
-	for (int handler = 0;
-	     handler < CW_SIGALRM_HANDLERS_MAX && cw_sigalrm_handlers[handler]; handler++) {
+	for (int handler = 0; handler < CW_SIGALRM_HANDLERS_MAX; handler++) {
+		void (* handler_fn)(void) = __atomic_load_n(&cw_sigalrm_handlers[handler], __ATOMIC_ACQUIRE);
+		if (NULL == handler_fn) {
+			break;
+		}
 
 		cw_debug_msg ((&cw_debug_object_dev), CW_DEBUG_INTERNAL, CW_DEBUG_DEBUG,
-			      MSG_PREFIX "SIGALRM handler #%d", handler);
+			      MSG_PREFIX "timer handler #%d", handler);
 
-		(cw_sigalrm_handlers[handler])();
+		handler_fn();
 	}
 
+#if !defined(LIBCW_WITH_SIGALRM_TIMERS)
+	pthread_mutex_unlock(&cw_timer_handlers_block.mutex);
+#endif
+
 	return;
 }
 
 
 
 
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
+/**
+   \brief Call handlers of SIGALRM signal
+
+   SIGALRM is sent to a process every time an itimer timer expires.
+   The timer is set with cw_timer_run_internal().
+*/
+void cw_sigalrm_handlers_caller_internal(__attribute__((unused)) int signal_number)
+{
+	cw_timer_handlers_call_internal();
+	return;
+}
+#endif
+
+
+
+
 
 /**
    \brief Set up a timer for specified number of microseconds
 
-   Convenience function to set the itimer for a single shot timeout after
-   a given number of microseconds. SIGALRM is sent to caller process when the
-   timer expires.
+   Convenience function to set a timer for a single shot timeout after
+   a given number of microseconds. Zero \p usecs cancels pending
+   timeout.
+
+   With SIGALRM timers the function sets the itimer, and SIGALRM is
+   sent to caller process when the timer expires. Otherwise the
+   function sets the timer of calling thread's context.
 
    \param usecs - time in microseconds
 
@@ -166,6 +241,23 @@ void cw_sigalrm_handlers_caller_internal(__attribute__((unused)) int signal_numb
 */
 int cw_timer_run_internal(int usecs)
 {
+#if !defined(LIBCW_WITH_SIGALRM_TIMERS)
+	cw_scheduler_entry_t * timer = cw_context_timer_get_internal();
+	if (0 == usecs) {
+		cw_scheduler_cancel_internal(timer);
+		return CW_SUCCESS;
+	}
+
+	/* Deadline in the past (negative usecs) is served by scheduler
+	   right away. */
+	if (!cw_scheduler_schedule_internal(timer, cw_scheduler_now_internal() + usecs)) {
+		cw_debug_msg ((&cw_debug_object), CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to schedule timer (%d)", usecs);
+		return CW_FAILURE;
+	}
+
+	return CW_SUCCESS;
+#else
 	struct itimerval itimer;
 
 	/* Set up a single shot timeout for the given period. */
@@ -181,6 +273,7 @@ int cw_timer_run_internal(int usecs)
 	}
 
 	return CW_SUCCESS;
+#endif
 }
 
 
@@ -188,14 +281,16 @@ int cw_timer_run_internal(int usecs)
 
 
 /**
-   \brief Register SIGALRM handler(s), and send SIGALRM signal
+   \brief Register timer handler(s), and request a timeout
 
-   Install top level handler of SIGALRM signal (cw_sigalrm_handlers_caller_internal())
-   if it is not already installed.
+   With SIGALRM timers, install top level handler of SIGALRM signal
+   (cw_sigalrm_handlers_caller_internal()) if it is not already
+   installed.
 
    Register given \p sigalrm_handler lower level handler, if not NULL and
    if not yet registered.
-   Then send SIGALRM signal after delay equal to \p usecs microseconds.
+   Then call registered handlers after delay equal to \p usecs
+   microseconds.
 
    \param usecs - time for itimer
    \param sigalrm_handler - SIGALRM handler to register
@@ -213,6 +308,7 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 	   of the lower level SIGALRM handler to the list of known
 	   handlers. */
 	if (sigalrm_handler) {
+		pthread_mutex_lock(&cw_sigalrm_handlers_mutex);
 		int handler = 0;
 
 		/* Search for this handler, or the first free entry,
@@ -231,14 +327,16 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 		   the list of lower level handlers. */
 		if (cw_sigalrm_handlers[handler] != sigalrm_handler) {
 			if (cw_sigalrm_handlers[handler]) {
+				pthread_mutex_unlock(&cw_sigalrm_handlers_mutex);
 				errno = ENOMEM;
 				cw_debug_msg ((&cw_debug_object), CW_DEBUG_INTERNAL, CW_DEBUG_ERROR,
 					      MSG_PREFIX "overflow cw_sigalrm_handlers");
 				return CW_FAILURE;
 			} else {
-				cw_sigalrm_handlers[handler] = sigalrm_handler;
+				__atomic_store_n(&cw_sigalrm_handlers[handler], sigalrm_handler, __ATOMIC_RELEASE);
 			}
 		}
+		pthread_mutex_unlock(&cw_sigalrm_handlers_mutex);
 	}
 
 	/* The fact that we receive a call means that something is using
@@ -246,11 +344,15 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 	   doesn't happen. */
 	cw_finalization_cancel_internal();
 
+#if !defined(LIBCW_WITH_SIGALRM_TIMERS)
+	/* Non-positive usecs: deadline that has already passed. */
+	return cw_timer_run_internal(usecs <= 0 ? -1 : usecs);
+#else
 	/* Depending on the value of usec, either set an itimer, or send
 	   ourselves SIGALRM right away. */
 	if (usecs <= 0) {
 		/* Send ourselves SIGALRM immediately. */
-		if (pthread_kill(cw_generator->thread.id, SIGALRM) != 0) {
+		if (pthread_kill(cw_generator_get_internal()->thread.id, SIGALRM) != 0) {
 	        // if (raise(SIGALRM) != 0) {
 			cw_debug_msg ((&cw_debug_object), CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
 				      MSG_PREFIX "raise()");
@@ -266,6 +368,7 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 	}
 
 	return CW_SUCCESS;
+#endif
 }
 
 
@@ -274,6 +377,7 @@ int cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void))
 
 int cw_sigalrm_install_top_level_handler_internal(void)
 {
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
 	if (!cw_is_sigalrm_handlers_caller_installed) {
 		/* Install the main SIGALRM handler routine (a.k.a. top level
 		   SIGALRM handler) - a function that calls all registered
@@ -294,6 +398,7 @@ int cw_sigalrm_install_top_level_handler_internal(void)
 
 		cw_is_sigalrm_handlers_caller_installed = true;
 	}
+#endif
 	return CW_SUCCESS;
 }
 
@@ -307,11 +412,17 @@ int cw_sigalrm_install_top_level_handler_internal(void)
    Restores SIGALRM's disposition for the system to the state we found
    it in before we installed our own SIGALRM handler.
 
+   Without SIGALRM timers the function only cancels pending timeout of
+   calling thread's context.
+
    \return CW_FAILURE on failure
    \return CW_SUCCESS on success
 */
 int cw_sigalrm_restore_internal(void)
 {
+#if !defined(LIBCW_WITH_SIGALRM_TIMERS)
+	return cw_timer_run_internal(0);
+#else
 	/* Ignore the call if we haven't installed our handler. */
 	if (cw_is_sigalrm_handlers_caller_installed) {
 		/* Cancel any pending itimer setting. */
@@ -330,6 +441,7 @@ int cw_sigalrm_restore_internal(void)
 	}
 
 	return CW_SUCCESS;
+#endif
 }
 
 
@@ -394,6 +506,7 @@ bool cw_sigalrm_is_blocked_internal(void)
    \return CW_SUCCESS on success
    \return CW_FAILURE on failure
 */
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
 int cw_sigalrm_block_internal(bool block)
 {
 	sigset_t set;
@@ -424,6 +537,7 @@ int cw_sigalrm_block_internal(bool block)
 
 	return CW_SUCCESS;
 }
+#endif
 
 
 
@@ -436,14 +550,26 @@ int cw_sigalrm_block_internal(bool block)
    caller code if \p block is true, and unblocks the callback if \p block is
    false.
 
-   Function works by blocking SIGALRM; a block should always be matched by
-   an unblock, otherwise the tone queue will suspend forever.
+   With SIGALRM timers the function works by blocking SIGALRM.
+   Otherwise timer handlers are held back in scheduler thread until
+   unblock, and blocking waits for handlers that are already running.
+   A block should always be matched by an unblock, otherwise the tone
+   queue will suspend forever.
 
    \param block - pass 1 to block SIGALRM, and 0 to unblock it
 */
 void cw_block_callback(int block)
 {
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
 	cw_sigalrm_block_internal((bool) block);
+#else
+	pthread_mutex_lock(&cw_timer_handlers_block.mutex);
+	cw_timer_handlers_block.blocked = (bool) block;
+	if (!block) {
+		pthread_cond_broadcast(&cw_timer_handlers_block.cond);
+	}
+	pthread_mutex_unlock(&cw_timer_handlers_block.mutex);
+#endif
 	return;
 }
 
@@ -590,10 +716,10 @@ int cw_register_signal_handler(int signal_number, void (*callback_func)(int))
 		is_initialized = true;
 	}
 
-	/* Reject invalid signal numbers, and SIGALRM, which we use internally. */
+	/* Reject invalid signal numbers, and SIGALRM if we use it internally. */
 	if (signal_number < 0
 	    || signal_number >= CW_SIG_MAX
-	    || signal_number == SIGALRM) {
+	    || CW_SIG_IS_RESERVED(signal_number)) {
 
 		errno = EINVAL;
 		return CW_FAILURE;
@@ -652,7 +778,7 @@ int cw_unregister_signal_handler(int signal_number)
 	/* Reject unacceptable signal numbers. */
 	if (signal_number < 0
 	    || signal_number >= CW_SIG_MAX
-	    || signal_number == SIGALRM) {
+	    || CW_SIG_IS_RESERVED(signal_number)) {
 
 		errno = EINVAL;
 		return CW_FAILURE;
@@ -15,12 +15,21 @@
 
 
 
+#include "libcw_scheduler.h"
+
+
+
+
 
 int  cw_sigalrm_install_top_level_handler_internal(void);
 bool cw_sigalrm_is_blocked_internal(void);
 int  cw_signal_wait_internal(void);
 int  cw_sigalrm_restore_internal(void);
 int  cw_timer_run_with_handler_internal(int usecs, void (*sigalrm_handler)(void));
+void cw_timer_handlers_call_internal(void);
+
+/* Defined in libcw.c. */
+cw_scheduler_entry_t * cw_context_timer_get_internal(void);
 
 
 
@@ -0,0 +1,764 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+
+/**
+   @file libcw_skimmer.c
+
+   @brief Decoder of many CW signals present in one wideband stream of samples.
+
+   Input samples are split into overlapping, windowed frames, and each
+   frame is transformed with FFT. Every FFT bin in passband works as a
+   narrow tone filter with its own envelopes of marks and noise (see
+   libcw_detector.c). When a strong mark begins in a bin that is a
+   local maximum of the spectrum, a channel with its own adaptive
+   compact receiver (see libcw_rec_compact.c) is opened for the bin
+   (after all bins have been processed, and only if there is no other
+   channel nearby); begins and ends of marks in the bin are passed to
+   the receiver, and decoded characters are passed to client's
+   callback. Channels without marks are closed after a timeout.
+
+   Two real frames are transformed with one complex FFT. Frames of one
+   call to cw_skimmer_process() are transformed in parallel, and then
+   bins are processed in parallel, each thread with its own contiguous
+   range of bins.
+*/
+
+
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_debug.h"
+#include "libcw_rec_compact.h"
+#include "libcw_skimmer.h"
+#include "libcw_utils.h"
+
+
+
+
+#define MSG_PREFIX "libcw/skimmer: "
+
+
+
+
+/* From libcw_debug.c. */
+extern cw_debug_t cw_debug_object;
+extern cw_debug_t cw_debug_object_dev;
+
+
+
+
+/* Range of work of one thread. */
+typedef struct {
+	cw_skimmer_t * skimmer;
+	int thread_idx;
+	size_t first;       /* First item (pair of frames, or bin). */
+	size_t last;        /* One past last item. */
+	size_t n_frames;    /* Count of frames in current call. */
+} cw_skimmer_work_t;
+
+
+
+
+static void cw_skimmer_run_parallel_internal(cw_skimmer_t * skimmer, void * (* worker)(void *), size_t n_items, size_t n_frames);
+static void * cw_skimmer_transform_frames_internal(void * arg);
+static void * cw_skimmer_process_bins_internal(void * arg);
+static void cw_skimmer_process_bin_internal(cw_skimmer_t * skimmer, int bin, size_t n_frames);
+static void cw_skimmer_open_channels_internal(cw_skimmer_t * skimmer);
+static void cw_skimmer_channel_push_internal(cw_skimmer_channel_t * channel, char character, bool is_end_of_word);
+static const cw_rec_profile_t * cw_skimmer_find_profile_internal(const cw_skimmer_t * skimmer, int bin);
+static int64_t cw_skimmer_get_sample_timestamp_internal(const cw_skimmer_t * skimmer, uint64_t sample_idx);
+
+
+
+
+cw_skimmer_t * cw_skimmer_new(int sample_rate, int frequency_low, int frequency_high, int n_threads)
+{
+	if (sample_rate <= 0 || frequency_low <= 0 || frequency_low >= frequency_high || frequency_high >= sample_rate / 2) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "invalid sample rate %d Hz or passband %d-%d Hz", sample_rate, frequency_low, frequency_high);
+		return NULL;
+	}
+
+	cw_skimmer_t * skimmer = calloc(1, sizeof (cw_skimmer_t));
+	if (NULL == skimmer) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return NULL;
+	}
+
+	skimmer->sample_rate = sample_rate;
+	skimmer->n_threads = n_threads < 1 ? 1 : (n_threads > CW_SKIMMER_N_THREADS_MAX ? CW_SKIMMER_N_THREADS_MAX : n_threads);
+
+	skimmer->fft_size = 16;
+	while (sample_rate / skimmer->fft_size > CW_SKIMMER_BIN_WIDTH_MAX) {
+		skimmer->fft_size *= 2;
+	}
+	const int n = skimmer->fft_size;
+	skimmer->hop_n_samples = n / CW_SKIMMER_HOP_DIVISOR;
+
+	skimmer->bin_first = (int) (((int64_t) frequency_low * n + sample_rate / 2) / sample_rate);
+	const int bin_last = (int) (((int64_t) frequency_high * n + sample_rate / 2) / sample_rate);
+	if (skimmer->bin_first < 1) {
+		skimmer->bin_first = 1;
+	}
+	skimmer->n_bins = bin_last - skimmer->bin_first + 1;
+
+	skimmer->window = calloc((size_t) n, sizeof (float));
+	skimmer->twiddle_cos = calloc((size_t) n / 2, sizeof (float));
+	skimmer->twiddle_sin = calloc((size_t) n / 2, sizeof (float));
+	skimmer->bit_reverse = calloc((size_t) n, sizeof (int));
+	skimmer->scratch = calloc((size_t) (2 * n * skimmer->n_threads), sizeof (float));
+	skimmer->envelopes = calloc((size_t) skimmer->n_bins, sizeof (cw_envelope_t));
+	skimmer->channels = calloc((size_t) skimmer->n_bins, sizeof (cw_skimmer_channel_t *));
+	skimmer->open_requests = calloc((size_t) skimmer->n_bins, sizeof (bool));
+	skimmer->rec_timing = cw_rec_timing_new(CW_TOLERANCE_INITIAL, CW_GAP_INITIAL);
+	if (NULL == skimmer->window || NULL == skimmer->twiddle_cos || NULL == skimmer->twiddle_sin
+	    || NULL == skimmer->bit_reverse || NULL == skimmer->scratch
+	    || NULL == skimmer->envelopes || NULL == skimmer->channels || NULL == skimmer->open_requests
+	    || NULL == skimmer->rec_timing) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		cw_skimmer_delete(&skimmer);
+		return NULL;
+	}
+
+	const double pi = 3.14159265358979323846;
+	float window_sum = 0.0F;
+	for (int i = 0; i < n; i++) {
+		skimmer->window[i] = (float) (0.5 - 0.5 * cos(2.0 * pi * i / n));
+		window_sum += skimmer->window[i];
+	}
+	skimmer->scale = 2.0F / window_sum;
+	for (int i = 0; i < n / 2; i++) {
+		skimmer->twiddle_cos[i] = (float) cos(2.0 * pi * i / n);
+		skimmer->twiddle_sin[i] = (float) sin(2.0 * pi * i / n);
+	}
+	int n_bits = 0;
+	while ((1 << n_bits) < n) {
+		n_bits++;
+	}
+	for (int i = 0; i < n; i++) {
+		int reversed = 0;
+		for (int b = 0; b < n_bits; b++) {
+			reversed |= ((i >> b) & 1) << (n_bits - 1 - b);
+		}
+		skimmer->bit_reverse[i] = reversed;
+	}
+
+	const double hop_duration = (double) skimmer->hop_n_samples * CW_USECS_PER_SEC / sample_rate;
+	cw_envelope_get_coefficients_internal(hop_duration, &skimmer->coefficients);
+
+	return skimmer;
+}
+
+
+
+
+void cw_skimmer_delete(cw_skimmer_t ** skimmer)
+{
+	if (NULL == skimmer || NULL == *skimmer) {
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_WARNING,
+			      MSG_PREFIX "called the function for NULL skimmer");
+		return;
+	}
+
+	if (NULL != (*skimmer)->channels) {
+		for (int b = 0; b < (*skimmer)->n_bins; b++) {
+			free((*skimmer)->channels[b]);
+		}
+	}
+	free((*skimmer)->channels);
+	cw_rec_timing_delete(&(*skimmer)->rec_timing);
+	free((*skimmer)->profiles);
+	free((*skimmer)->open_requests);
+	free((*skimmer)->envelopes);
+	free((*skimmer)->window);
+	free((*skimmer)->twiddle_cos);
+	free((*skimmer)->twiddle_sin);
+	free((*skimmer)->bit_reverse);
+	free((*skimmer)->scratch);
+	free((*skimmer)->input);
+	free((*skimmer)->magnitudes);
+
+	free(*skimmer);
+	*skimmer = NULL;
+
+	return;
+}
+
+
+
+
+void cw_skimmer_register_callback(cw_skimmer_t * skimmer, cw_skimmer_callback_t callback_func, void * callback_arg)
+{
+	skimmer->callback_func = callback_func;
+	skimmer->callback_arg = callback_arg;
+}
+
+
+
+
+cw_ret_t cw_skimmer_process(cw_skimmer_t * skimmer, const struct timeval * timestamp, const cw_sample_t * samples, size_t n_samples)
+{
+	if (NULL == skimmer || (NULL == samples && n_samples > 0)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_ERROR,
+			      MSG_PREFIX "NULL skimmer or samples");
+		return CW_FAILURE;
+	}
+
+	const uint64_t first_new_idx = skimmer->input_start_idx + skimmer->input_fill;
+	if (NULL != timestamp) {
+		skimmer->origin = (int64_t) timestamp->tv_sec * CW_USECS_PER_SEC + timestamp->tv_usec;
+		skimmer->origin_idx = first_new_idx;
+		skimmer->origin_valid = true;
+	} else if (!skimmer->origin_valid) {
+		struct timeval now = { 0 };
+		if (CW_SUCCESS != cw_timestamp_validate_internal(&now, NULL)) {
+			return CW_FAILURE;
+		}
+		skimmer->origin = (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec;
+		skimmer->origin_idx = first_new_idx;
+		skimmer->origin_valid = true;
+	} else {
+		; /* Continue existing timeline. */
+	}
+
+	if (skimmer->input_fill + n_samples > skimmer->input_capacity) {
+		const size_t capacity = skimmer->input_fill + n_samples;
+		float * input = realloc(skimmer->input, capacity * sizeof (float));
+		if (NULL == input) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc()");
+			return CW_FAILURE;
+		}
+		skimmer->input = input;
+		skimmer->input_capacity = capacity;
+	}
+	float * dest = skimmer->input + skimmer->input_fill;
+	for (size_t i = 0; i < n_samples; i++) {
+		dest[i] = (float) samples[i];
+	}
+	skimmer->input_fill += n_samples;
+
+	const size_t fft_size = (size_t) skimmer->fft_size;
+	const size_t hop = (size_t) skimmer->hop_n_samples;
+	if (skimmer->input_fill < fft_size) {
+		return CW_SUCCESS;
+	}
+	const size_t n_frames = (skimmer->input_fill - fft_size) / hop + 1;
+
+	const size_t n_magnitudes = n_frames * (size_t) skimmer->n_bins;
+	if (n_magnitudes > skimmer->magnitudes_capacity) {
+		float * magnitudes = realloc(skimmer->magnitudes, n_magnitudes * sizeof (float));
+		if (NULL == magnitudes) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "realloc()");
+			return CW_FAILURE;
+		}
+		skimmer->magnitudes = magnitudes;
+		skimmer->magnitudes_capacity = n_magnitudes;
+	}
+
+	/* Frames are transformed in pairs. */
+	cw_skimmer_run_parallel_internal(skimmer, cw_skimmer_transform_frames_internal, (n_frames + 1) / 2, n_frames);
+	cw_skimmer_run_parallel_internal(skimmer, cw_skimmer_process_bins_internal, (size_t) skimmer->n_bins, n_frames);
+	skimmer->n_frames_total += n_frames;
+
+	cw_skimmer_open_channels_internal(skimmer);
+
+	/* Pass decoded characters to client code, close silent channels. */
+	const uint64_t timeout_frames = ((uint64_t) CW_SKIMMER_CHANNEL_TIMEOUT * (uint64_t) skimmer->sample_rate) / ((uint64_t) CW_USECS_PER_SEC * hop);
+	for (int b = 0; b < skimmer->n_bins; b++) {
+		cw_skimmer_channel_t * channel = skimmer->channels[b];
+		if (NULL == channel) {
+			continue;
+		}
+		const int frequency = (int) (((int64_t) (skimmer->bin_first + b) * skimmer->sample_rate) / skimmer->fft_size);
+		for (int i = 0; i < channel->n_output; i++) {
+			if (skimmer->callback_func) {
+				skimmer->callback_func(skimmer->callback_arg, frequency, channel->output[i].character, channel->output[i].is_end_of_word);
+			}
+		}
+		channel->n_output = 0;
+
+		if (!skimmer->envelopes[b].is_mark && skimmer->n_frames_total - channel->last_mark_frame > timeout_frames) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_RECEIVE_STATES, CW_DEBUG_INFO,
+				      MSG_PREFIX "closing channel at %d Hz", frequency);
+			free(channel);
+			skimmer->channels[b] = NULL;
+		}
+	}
+
+	/* Keep samples needed by next frames. */
+	const size_t consumed = n_frames * hop;
+	memmove(skimmer->input, skimmer->input + consumed, (skimmer->input_fill - consumed) * sizeof (float));
+	skimmer->input_fill -= consumed;
+	skimmer->input_start_idx += consumed;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+int cw_skimmer_get_n_channels(const cw_skimmer_t * skimmer)
+{
+	int n = 0;
+	for (int b = 0; b < skimmer->n_bins; b++) {
+		if (NULL != skimmer->channels[b]) {
+			n++;
+		}
+	}
+	return n;
+}
+
+
+
+
+cw_ret_t cw_skimmer_set_profiles(cw_skimmer_t * skimmer, const int * frequencies, const cw_rec_profile_t * profiles, size_t n)
+{
+	if (0 == n) {
+		free(skimmer->profiles);
+		skimmer->profiles = NULL;
+		return CW_SUCCESS;
+	}
+
+	cw_rec_profile_t * bin_profiles = calloc((size_t) skimmer->n_bins, sizeof (cw_rec_profile_t));
+	if (NULL == bin_profiles) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "calloc()");
+		return CW_FAILURE;
+	}
+	for (size_t i = 0; i < n; i++) {
+		const int bin = (int) (((int64_t) frequencies[i] * skimmer->fft_size + skimmer->sample_rate / 2) / skimmer->sample_rate) - skimmer->bin_first;
+		int unit_duration = 0;
+		if (bin < 0 || bin >= skimmer->n_bins || CW_SUCCESS != cw_rec_profile_unit_internal(&profiles[i], &unit_duration)) {
+			free(bin_profiles);
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		bin_profiles[bin] = profiles[i];
+	}
+
+	free(skimmer->profiles);
+	skimmer->profiles = bin_profiles;
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Split work into contiguous ranges and run them in skimmer's threads
+
+   The calling thread processes the first range itself, and ranges
+   for which a thread could not be created.
+
+   @param[in] skimmer skimmer
+   @param[in] worker function processing one range of items
+   @param[in] n_items count of items to split between threads
+   @param[in] n_frames count of frames in current call
+*/
+static void cw_skimmer_run_parallel_internal(cw_skimmer_t * skimmer, void * (* worker)(void *), size_t n_items, size_t n_frames)
+{
+	size_t n_threads = (size_t) skimmer->n_threads;
+	if (n_threads > n_items) {
+		n_threads = n_items;
+	}
+	if (n_threads < 1) {
+		return;
+	}
+
+	cw_skimmer_work_t work[CW_SKIMMER_N_THREADS_MAX];
+	pthread_t threads[CW_SKIMMER_N_THREADS_MAX];
+	bool started[CW_SKIMMER_N_THREADS_MAX] = { false };
+	for (size_t t = 0; t < n_threads; t++) {
+		work[t].skimmer = skimmer;
+		work[t].thread_idx = (int) t;
+		work[t].first = (n_items * t) / n_threads;
+		work[t].last = (n_items * (t + 1)) / n_threads;
+		work[t].n_frames = n_frames;
+	}
+
+	for (size_t t = 1; t < n_threads; t++) {
+		if (0 != pthread_create(&threads[t], NULL, worker, &work[t])) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "pthread_create()");
+			worker(&work[t]);
+		} else {
+			started[t] = true;
+		}
+	}
+	worker(&work[0]);
+	for (size_t t = 1; t < n_threads; t++) {
+		if (started[t]) {
+			pthread_join(threads[t], NULL);
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Transform range of pairs of frames, store magnitudes of bins of passband
+
+   @param[in] arg range of work (cw_skimmer_work_t)
+
+   @return NULL
+*/
+static void * cw_skimmer_transform_frames_internal(void * arg)
+{
+	const cw_skimmer_work_t * work = (const cw_skimmer_work_t *) arg;
+	cw_skimmer_t * skimmer = work->skimmer;
+	const int n = skimmer->fft_size;
+	const size_t hop = (size_t) skimmer->hop_n_samples;
+	const float * window = skimmer->window;
+	float * re = skimmer->scratch + (size_t) (2 * n * work->thread_idx);
+	float * im = re + n;
+
+	for (size_t pair = work->first; pair < work->last; pair++) {
+		/* First frame of pair is real part of FFT input, second
+		   frame is imaginary part. */
+		const size_t frame_a = 2 * pair;
+		const size_t frame_b = frame_a + 1;
+		const float * a = skimmer->input + frame_a * hop;
+		for (int i = 0; i < n; i++) {
+			re[i] = a[i] * window[i];
+		}
+		if (frame_b < work->n_frames) {
+			const float * b = skimmer->input + frame_b * hop;
+			for (int i = 0; i < n; i++) {
+				im[i] = b[i] * window[i];
+			}
+		} else {
+			memset(im, 0, (size_t) n * sizeof (float));
+		}
+
+		cw_skimmer_fft_internal(skimmer, re, im);
+
+		/* Separate spectra of the two frames:
+		   A[k] = (Z[k] + conj(Z[n - k])) / 2,
+		   B[k] = (Z[k] - conj(Z[n - k])) / 2i. */
+		for (int bin = 0; bin < skimmer->n_bins; bin++) {
+			const int k = skimmer->bin_first + bin;
+			const int nk = n - k;
+			const float ar = re[k] + re[nk];
+			const float ai = im[k] - im[nk];
+			const float br = im[k] + im[nk];
+			const float bi = re[nk] - re[k];
+			float * magnitudes = skimmer->magnitudes + (size_t) bin * work->n_frames;
+			magnitudes[frame_a] = 0.5F * sqrtf(ar * ar + ai * ai) * skimmer->scale;
+			if (frame_b < work->n_frames) {
+				magnitudes[frame_b] = 0.5F * sqrtf(br * br + bi * bi) * skimmer->scale;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Process frames of current call in range of bins
+
+   @param[in] arg range of work (cw_skimmer_work_t)
+
+   @return NULL
+*/
+static void * cw_skimmer_process_bins_internal(void * arg)
+{
+	const cw_skimmer_work_t * work = (const cw_skimmer_work_t *) arg;
+	for (size_t bin = work->first; bin < work->last; bin++) {
+		cw_skimmer_process_bin_internal(work->skimmer, (int) bin, work->n_frames);
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Detect marks in one bin, open a channel if necessary, and drive its receiver
+
+   Only state of the bin @p bin is modified, magnitudes of neighbouring
+   bins are only read, so different bins can be processed in
+   parallel. Bin without channel only requests opening of a channel,
+   the channel is opened by cw_skimmer_open_channels_internal().
+
+   @param[in] skimmer skimmer
+   @param[in] bin index of bin in passband
+   @param[in] n_frames count of frames in current call
+*/
+static void cw_skimmer_process_bin_internal(cw_skimmer_t * skimmer, int bin, size_t n_frames)
+{
+	cw_envelope_t * envelope = &skimmer->envelopes[bin];
+	const float * magnitudes = skimmer->magnitudes + (size_t) bin * n_frames;
+	const float * lower = bin > 0 ? magnitudes - n_frames : NULL;
+	const float * upper = bin < skimmer->n_bins - 1 ? magnitudes + n_frames : NULL;
+
+	for (size_t f = 0; f < n_frames; f++) {
+		const cw_envelope_event_t event = cw_envelope_update_internal(envelope, magnitudes[f], &skimmer->coefficients);
+		cw_skimmer_channel_t * channel = skimmer->channels[bin];
+
+		if (NULL == channel) {
+			if (CW_ENVELOPE_MARK_BEGIN == event) {
+				/* Carrier leaks into neighbouring bins. Only
+				   bin with maximal magnitude asks for a
+				   channel. Peaks of noise in some of many bins
+				   are often high enough to begin a mark, so
+				   opening a channel requires stronger
+				   signal. */
+				const bool is_local_max = (NULL == lower || magnitudes[f] > lower[f])
+					&& (NULL == upper || magnitudes[f] >= upper[f]);
+				if (is_local_max && magnitudes[f] > CW_SKIMMER_OPEN_SNR * envelope->floor) {
+					skimmer->open_requests[bin] = true;
+				}
+			}
+			continue;
+		}
+
+		/* Frame is attributed to its middle sample. */
+		const uint64_t frame_idx = skimmer->n_frames_total + f;
+		const int64_t timestamp = cw_skimmer_get_sample_timestamp_internal(skimmer, skimmer->input_start_idx + f * (size_t) skimmer->hop_n_samples + (size_t) skimmer->fft_size / 2);
+
+		cw_rec_compact_input_t input = { .timestamp = timestamp, .event = CW_REC_COMPACT_POLL };
+		if (CW_ENVELOPE_MARK_BEGIN == event) {
+			input.event = CW_REC_COMPACT_MARK_BEGIN;
+			channel->last_mark_frame = frame_idx;
+		} else if (CW_ENVELOPE_MARK_END == event) {
+			input.event = CW_REC_COMPACT_MARK_END;
+		} else if (envelope->is_mark) {
+			continue; /* Middle of mark. */
+		} else {
+			; /* Space: poll for end of character or word. */
+		}
+
+		/* Compact receiver reports each character and
+		   inter-word-space only once. */
+		cw_rec_compact_output_t output;
+		if (0 != cw_rec_compact_update(skimmer->rec_timing, &channel->rec, &input, &output, 1, NULL)) {
+			if ('\0' != output.character) {
+				cw_skimmer_channel_push_internal(channel, output.character, false);
+			}
+			if (output.is_end_of_word) {
+				cw_skimmer_channel_push_internal(channel, ' ', true);
+			}
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Open channels requested during processing of bins
+
+   Request is rejected if there is a channel nearby, another request
+   nearby for a bin with stronger signal, or a much stronger carrier
+   whose key clicks may have caused the request. Marks of the current call in
+   bin of new channel are lost, the receiver gets marks from next call.
+
+   @param[in] skimmer skimmer
+*/
+static void cw_skimmer_open_channels_internal(cw_skimmer_t * skimmer)
+{
+	for (int b = 0; b < skimmer->n_bins; b++) {
+		if (!skimmer->open_requests[b]) {
+			continue;
+		}
+
+		bool is_rejected = false;
+		const int first = b - CW_SKIMMER_CLICKS_RANGE < 0 ? 0 : b - CW_SKIMMER_CLICKS_RANGE;
+		const int last = b + CW_SKIMMER_CLICKS_RANGE >= skimmer->n_bins ? skimmer->n_bins - 1 : b + CW_SKIMMER_CLICKS_RANGE;
+		for (int n = first; n <= last; n++) {
+			if (abs(n - b) <= CW_SKIMMER_CHANNEL_SPACING) {
+				if (NULL != skimmer->channels[n]
+				    || (n != b && skimmer->open_requests[n] && skimmer->envelopes[n].peak > skimmer->envelopes[b].peak)) {
+					is_rejected = true;
+					break;
+				}
+			}
+			if (skimmer->envelopes[n].peak > CW_SKIMMER_CLICKS_RATIO * skimmer->envelopes[b].peak) {
+				/* Key clicks of strong carrier nearby. */
+				is_rejected = true;
+				break;
+			}
+		}
+		if (is_rejected) {
+			continue;
+		}
+
+		cw_skimmer_channel_t * channel = calloc(1, sizeof (cw_skimmer_channel_t));
+		if (NULL == channel) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+				      MSG_PREFIX "calloc()");
+			continue;
+		}
+		/* Speed of the carrier is not known, unless a known
+		   station is expected at this frequency. */
+		cw_rec_compact_init(&channel->rec, CW_SPEED_INITIAL, true);
+		const cw_rec_profile_t * profile = cw_skimmer_find_profile_internal(skimmer, b);
+		if (NULL != profile) {
+			cw_rec_compact_set_profile(&channel->rec, profile);
+		}
+		channel->last_mark_frame = skimmer->n_frames_total;
+		skimmer->channels[b] = channel;
+	}
+	memset(skimmer->open_requests, 0, (size_t) skimmer->n_bins * sizeof (bool));
+}
+
+
+
+
+/**
+   @brief Find profile of station expected at given bin
+
+   Carrier of a station may open a channel in a bin next to the bin of
+   the station's frequency, so profile of the closest bin within
+   CW_SKIMMER_CHANNEL_SPACING bins is returned.
+
+   @param[in] skimmer skimmer
+   @param[in] bin index of bin in passband
+
+   @return profile of station
+   @return NULL if no station is expected near @p bin
+*/
+static const cw_rec_profile_t * cw_skimmer_find_profile_internal(const cw_skimmer_t * skimmer, int bin)
+{
+	if (NULL == skimmer->profiles) {
+		return NULL;
+	}
+	for (int distance = 0; distance <= CW_SKIMMER_CHANNEL_SPACING; distance++) {
+		const int candidates[2] = { bin - distance, bin + distance };
+		for (int i = 0; i < 2; i++) {
+			const int b = candidates[i];
+			if (b >= 0 && b < skimmer->n_bins && 0 != skimmer->profiles[b].dot_duration) {
+				return &skimmer->profiles[b];
+			}
+		}
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Put decoded character into output buffer of channel
+
+   @param[in] channel channel
+   @param[in] character decoded character, or space for end of word
+   @param[in] is_end_of_word is this end of word?
+*/
+static void cw_skimmer_channel_push_internal(cw_skimmer_channel_t * channel, char character, bool is_end_of_word)
+{
+	if (channel->n_output >= CW_SKIMMER_OUTPUT_CAPACITY) {
+		/* Client code calls cw_skimmer_process() with very
+		   long blocks of samples. */
+		return;
+	}
+	channel->output[channel->n_output].character = character;
+	channel->output[channel->n_output].is_end_of_word = is_end_of_word;
+	channel->n_output++;
+}
+
+
+
+
+/**
+   @brief In-place radix-2 complex FFT
+
+   @param[in] skimmer skimmer with FFT tables
+   @param[in,out] re real parts of input and output
+   @param[in,out] im imaginary parts of input and output
+*/
+void cw_skimmer_fft_internal(const cw_skimmer_t * skimmer, float * re, float * im)
+{
+	const int n = skimmer->fft_size;
+	for (int i = 0; i < n; i++) {
+		const int j = skimmer->bit_reverse[i];
+		if (j > i) {
+			float tmp = re[i];
+			re[i] = re[j];
+			re[j] = tmp;
+			tmp = im[i];
+			im[i] = im[j];
+			im[j] = tmp;
+		}
+	}
+
+	for (int size = 2; size <= n; size *= 2) {
+		const int half = size / 2;
+		const int step = n / size;
+		for (int start = 0; start < n; start += size) {
+			for (int j = 0; j < half; j++) {
+				/* Twiddle factor exp(-2 pi i j / size). */
+				const float c = skimmer->twiddle_cos[j * step];
+				const float s = skimmer->twiddle_sin[j * step];
+				const int p = start + j;
+				const int q = p + half;
+				const float tr = re[q] * c + im[q] * s;
+				const float ti = im[q] * c - re[q] * s;
+				re[q] = re[p] - tr;
+				im[q] = im[p] - ti;
+				re[p] += tr;
+				im[p] += ti;
+			}
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Get timestamp of input sample with given index
+
+   @param[in] skimmer skimmer
+   @param[in] sample_idx index of sample since creation of skimmer
+
+   @return timestamp of the sample [microseconds]
+*/
+static int64_t cw_skimmer_get_sample_timestamp_internal(const cw_skimmer_t * skimmer, uint64_t sample_idx)
+{
+	const int64_t offset = (int64_t) sample_idx - (int64_t) skimmer->origin_idx;
+	return skimmer->origin + (offset * CW_USECS_PER_SEC) / skimmer->sample_rate;
+}
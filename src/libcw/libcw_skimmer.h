@@ -0,0 +1,149 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_SKIMMER
+#define H_LIBCW_SKIMMER
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+
+
+
+#include "libcw2.h"
+#include "libcw_detector.h"
+#include "libcw_rec_compact.h"
+
+
+
+
+/* Maximal width of frequency bin of channelizer. Size of FFT is the
+   smallest power of two giving bins not wider than this. [Hz] */
+#define CW_SKIMMER_BIN_WIDTH_MAX 50
+
+/* Consecutive FFT frames overlap by 3/4 of their length. */
+#define CW_SKIMMER_HOP_DIVISOR 4
+
+/* Magnitude of first mark in a bin must be this many times above
+   envelope of noise (~14 dB) to open a channel for the bin. */
+#define CW_SKIMMER_OPEN_SNR 5.0F
+
+/* A channel is not opened closer than this to another channel, so that
+   carrier leaking into neighbouring bins doesn't open more channels.
+   [bins] */
+#define CW_SKIMMER_CHANNEL_SPACING 2
+
+/* Edges of marks of strong carrier (key clicks) spread over many bins.
+   A channel is not opened for a bin if there is a carrier this many
+   times stronger (20 dB) within this range of bins. */
+#define CW_SKIMMER_CLICKS_RANGE 8
+#define CW_SKIMMER_CLICKS_RATIO 10.0F
+
+/* Channel in which no mark has begun for this time is closed. [us] */
+#define CW_SKIMMER_CHANNEL_TIMEOUT (10 * 1000 * 1000)
+
+/* Capacity of buffer of characters decoded in a channel during one
+   call to cw_skimmer_process(), before they are passed to client's
+   callback. */
+#define CW_SKIMMER_OUTPUT_CAPACITY 64
+
+/* Maximal count of threads processing samples. */
+#define CW_SKIMMER_N_THREADS_MAX 16
+
+
+
+
+/* Decoder of one carrier. Cold data, accessed only for bins with an
+   active carrier. */
+typedef struct {
+	cw_rec_compact_t rec;
+	/* Index of frame in which last mark has begun. */
+	uint64_t last_mark_frame;
+
+	/* Characters decoded in current call to cw_skimmer_process(). */
+	struct {
+		char character;
+		bool is_end_of_word;
+	} output[CW_SKIMMER_OUTPUT_CAPACITY];
+	int n_output;
+} cw_skimmer_channel_t;
+
+
+
+
+struct cw_skimmer_struct {
+	int sample_rate;   /* [Hz] */
+
+	/* FFT. */
+	int fft_size;
+	int hop_n_samples;
+	float * window;
+	float * twiddle_cos;
+	float * twiddle_sin;
+	int * bit_reverse;
+	float scale;
+	/* Real and imaginary parts of FFT input/output, separate for
+	   each thread. */
+	float * scratch;
+
+	/* Bins of passband: bin_first and following n_bins bins. */
+	int bin_first;
+	int n_bins;
+
+	/* Per-bin state, contiguous and small, so that the hot loop
+	   over bins and frames stays in cache. */
+	cw_envelope_t * envelopes;
+	cw_skimmer_channel_t ** channels;
+	/* Set by processing of a bin without channel when a strong mark
+	   begins in it, cleared when processing of all bins has
+	   finished. */
+	bool * open_requests;
+	cw_envelope_coefficients_t coefficients;
+	/* Timing parameters shared by receivers of all channels. */
+	cw_rec_timing_t * rec_timing;
+
+	/* Timing profiles of stations expected in bins, see
+	   cw_skimmer_set_profiles(). Zeroed profile: no station. NULL
+	   when no profiles have been loaded. */
+	cw_rec_profile_t * profiles;
+
+	/* Input samples not yet consumed by FFT frames. */
+	float * input;
+	size_t input_fill;
+	size_t input_capacity;
+
+	/* Magnitudes of bins for frames of one call, bin-major:
+	   magnitudes[bin * n_frames + frame]. */
+	float * magnitudes;
+	size_t magnitudes_capacity;
+
+	/* Timeline: time of input sample with index ->origin_idx
+	   [microseconds], index of first sample in ->input, and count of
+	   all frames so far. */
+	int64_t origin;
+	uint64_t origin_idx;
+	bool origin_valid;
+	uint64_t input_start_idx;
+	uint64_t n_frames_total;
+
+	int n_threads;
+
+	cw_skimmer_callback_t callback_func;
+	void * callback_arg;
+};
+
+
+
+
+void cw_skimmer_fft_internal(const cw_skimmer_t * skimmer, float * re, float * im);
+
+
+
+
+#endif /* #ifndef H_LIBCW_SKIMMER */
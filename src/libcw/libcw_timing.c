@@ -0,0 +1,275 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_timing.c
+
+   @brief Timing blocks shared by generators and receivers of a process.
+
+   Durations of Marks and Spaces of generator, and duration ranges of
+   receiver, are calculated from a few parameters: speed, gap,
+   weighting, tolerance and receiving mode. An application simulating
+   thousands of generators and receivers uses only a handful of
+   different settings, so every generator and receiver takes a block
+   of durations for its settings from a library-wide table instead of
+   calculating its own copy.
+
+   Blocks are immutable and reference-counted. A block is calculated
+   when the first generator or receiver with given settings needs it.
+   Change of parameters is a lookup in the table, and all generators
+   with the same settings read the same memory.
+
+   Blocks are kept in a static array, so taking a block never
+   allocates memory (see cw_gen_config_t::preallocate). Block released
+   by its last user stays in the table, and is reused for other
+   settings only when there are no unused blocks left; least recently
+   released block is reused first. When all blocks are in use, callers
+   calculate durations into their own memory. Since blocks are never
+   freed, a thread that reads durations of generator while another
+   thread changes generator's parameters (see
+   cw_key_ik_schedule_element_end_internal()) never reads freed memory.
+
+   Fields of key that are not used by generators (tolerance,
+   receiving mode) or by receivers (weighting) are set to their
+   initial values, so generators and receivers with the same speed
+   and gap share the same block.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <pthread.h>
+#include <stddef.h>
+
+
+
+
+#include "libcw_timing.h"
+
+
+
+
+static cw_timing_t g_cw_timing_blocks[CW_TIMING_N_BLOCKS];
+static cw_timing_t * g_cw_timing_buckets[CW_TIMING_N_BUCKETS];
+static uint64_t g_cw_timing_n_releases; /* Counter of releases, for finding least recently released block. */
+static pthread_mutex_t g_cw_timing_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+static unsigned int cw_timing_key_hash_internal(const cw_timing_key_t * key);
+static bool cw_timing_key_equal_internal(const cw_timing_key_t * a, const cw_timing_key_t * b);
+static cw_timing_t * cw_timing_take_unused_internal(void);
+
+
+
+
+/**
+   @brief Initialize key of timing block
+
+   Weighting, tolerance and receiving mode are set to their initial
+   values. Generators and receivers overwrite the fields that they use.
+
+   @param[out] key key to initialize
+   @param[in] unit_duration duration of Unit [us]
+   @param[in] gap inter-character-gap
+*/
+void cw_timing_key_init_internal(cw_timing_key_t * key, int unit_duration, int gap)
+{
+	key->unit_duration = unit_duration;
+	key->gap = gap;
+	key->weighting = CW_WEIGHTING_INITIAL;
+	key->tolerance = CW_TOLERANCE_INITIAL;
+	key->is_adaptive = false;
+}
+
+
+
+
+/**
+   @brief Get timing block for given key
+
+   The block is found in the table, or is calculated in an unused
+   block of the table. Caller must release the block with
+   cw_timing_release_internal().
+
+   @param[in] key parameters of the block
+
+   @return timing block on success
+   @return NULL if all blocks of the table are in use
+*/
+const cw_timing_t * cw_timing_acquire_internal(const cw_timing_key_t * key)
+{
+	const unsigned int bucket = cw_timing_key_hash_internal(key) % CW_TIMING_N_BUCKETS;
+
+	pthread_mutex_lock(&g_cw_timing_mutex);
+
+	cw_timing_t * timing = g_cw_timing_buckets[bucket];
+	while (NULL != timing && !cw_timing_key_equal_internal(&timing->key, key)) {
+		timing = timing->next;
+	}
+
+	if (NULL == timing) {
+		timing = cw_timing_take_unused_internal();
+		if (NULL == timing) {
+			pthread_mutex_unlock(&g_cw_timing_mutex);
+			return NULL;
+		}
+		timing->key = *key;
+		cw_gen_calculate_unit_durations_internal(key->unit_duration, key->weighting, key->gap, &timing->gen_durations);
+		cw_rec_calculate_parameters_internal(key->unit_duration, key->tolerance, key->gap, key->is_adaptive, &timing->rec_parameters);
+
+		timing->in_use = true;
+		timing->next = g_cw_timing_buckets[bucket];
+		g_cw_timing_buckets[bucket] = timing;
+	}
+	timing->n_references++;
+
+	pthread_mutex_unlock(&g_cw_timing_mutex);
+
+	return timing;
+}
+
+
+
+
+/**
+   @brief Release timing block taken with cw_timing_acquire_internal()
+
+   Block released by last generator or receiver stays in the table
+   until it's needed for other settings. @p timing is set to NULL.
+
+   @param[in,out] timing timing block, may point to NULL
+*/
+void cw_timing_release_internal(const cw_timing_t ** timing)
+{
+	if (NULL == timing || NULL == *timing) {
+		return;
+	}
+
+	cw_timing_t * block = &g_cw_timing_blocks[*timing - g_cw_timing_blocks];
+
+	pthread_mutex_lock(&g_cw_timing_mutex);
+	if (block->n_references > 0) {
+		block->n_references--;
+		if (0 == block->n_references) {
+			block->released = ++g_cw_timing_n_releases;
+		}
+	}
+	pthread_mutex_unlock(&g_cw_timing_mutex);
+
+	*timing = NULL;
+}
+
+
+
+
+/**
+   @brief Get count of timing blocks in use
+
+   @return count of blocks held by generators and receivers
+*/
+size_t cw_timing_count_internal(void)
+{
+	size_t n_blocks = 0;
+
+	pthread_mutex_lock(&g_cw_timing_mutex);
+	for (int i = 0; i < CW_TIMING_N_BLOCKS; i++) {
+		if (g_cw_timing_blocks[i].n_references > 0) {
+			n_blocks++;
+		}
+	}
+	pthread_mutex_unlock(&g_cw_timing_mutex);
+
+	return n_blocks;
+}
+
+
+
+
+static unsigned int cw_timing_key_hash_internal(const cw_timing_key_t * key)
+{
+	unsigned int hash = (unsigned int) key->unit_duration;
+	hash = hash * 31U + (unsigned int) key->gap;
+	hash = hash * 31U + (unsigned int) key->weighting;
+	hash = hash * 31U + (unsigned int) key->tolerance;
+	hash = hash * 31U + (key->is_adaptive ? 1U : 0U);
+
+	return hash;
+}
+
+
+
+
+static bool cw_timing_key_equal_internal(const cw_timing_key_t * a, const cw_timing_key_t * b)
+{
+	return a->unit_duration == b->unit_duration
+		&& a->gap == b->gap
+		&& a->weighting == b->weighting
+		&& a->tolerance == b->tolerance
+		&& a->is_adaptive == b->is_adaptive;
+}
+
+
+
+
+/**
+   @brief Take block without references out of the table
+
+   Block that has never been used is preferred, then least recently
+   released block. Call with mutex of the table locked.
+
+   @return block removed from its bucket
+   @return NULL if all blocks are in use
+*/
+static cw_timing_t * cw_timing_take_unused_internal(void)
+{
+	cw_timing_t * oldest = NULL;
+	for (int i = 0; i < CW_TIMING_N_BLOCKS; i++) {
+		cw_timing_t * block = &g_cw_timing_blocks[i];
+		if (!block->in_use) {
+			return block;
+		}
+		if (0 == block->n_references
+		    && (NULL == oldest || block->released < oldest->released)) {
+			oldest = block;
+		}
+	}
+	if (NULL == oldest) {
+		return NULL;
+	}
+
+	const unsigned int bucket = cw_timing_key_hash_internal(&oldest->key) % CW_TIMING_N_BUCKETS;
+	cw_timing_t ** link = &g_cw_timing_buckets[bucket];
+	while (*link != oldest) {
+		link = &(*link)->next;
+	}
+	*link = oldest->next;
+	oldest->in_use = false;
+
+	return oldest;
+}
@@ -0,0 +1,73 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_TIMING
+#define H_LIBCW_TIMING
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_rec.h"
+
+
+
+
+/* Count of blocks in library-wide table of timing blocks, and count
+   of buckets of the table. */
+#define CW_TIMING_N_BLOCKS  128
+#define CW_TIMING_N_BUCKETS  64
+
+
+
+
+/* Parameters from which timing block is calculated. */
+typedef struct {
+	int unit_duration;   /* Derived from speed. [us] */
+	int gap;
+	int weighting;       /* Used only by generators. */
+	int tolerance;       /* Used only by receivers. */
+	bool is_adaptive;    /* Used only by receivers. */
+} cw_timing_key_t;
+
+
+
+
+/* Immutable durations of Marks and Spaces calculated for given key,
+   shared by generators and receivers. */
+typedef struct cw_timing_struct {
+	cw_timing_key_t key;
+
+	cw_gen_durations_t gen_durations;
+	cw_rec_parameters_t rec_parameters;
+
+	/* Is the block in a bucket of table, count of generators and
+	   receivers holding the block, value of counter of releases at
+	   last release of the block, and link to next block in bucket.
+	   Protected by mutex of the table. */
+	bool in_use;
+	int n_references;
+	uint64_t released;
+	struct cw_timing_struct * next;
+} cw_timing_t;
+
+
+
+
+void cw_timing_key_init_internal(cw_timing_key_t * key, int unit_duration, int gap);
+const cw_timing_t * cw_timing_acquire_internal(const cw_timing_key_t * key);
+void cw_timing_release_internal(const cw_timing_t ** timing);
+size_t cw_timing_count_internal(void);
+
+
+
+
+#endif /* #ifndef H_LIBCW_TIMING */
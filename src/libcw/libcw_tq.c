@@ -32,8 +32,12 @@
    queue.
 
 
-   The tone queue (the circular list) is implemented using constant
-   size table.
+   The tone queue (the circular list) is implemented using a table
+   allocated on heap. Count of slots in the table is a power of two, so
+   that wrapping of indexes is done with a bit mask. The table starts
+   small (CW_TONE_QUEUE_INITIAL_N_SLOTS) and is doubled when it runs out
+   of free slots, until it can hold as many tones as queue's capacity
+   allows. The table never shrinks.
 
 
    Explanation of "forever" tone:
@@ -62,15 +66,69 @@
    Tone queue data type is not visible to user of library's API. Tone
    queue is an integral part of a generator. Generator data type is
    visible to user of library's API.
+
+
+   Concurrency:
+
+   Tones are added to the queue by producers (client code enqueueing
+   characters, iambic keyer) and are removed from the queue by single
+   consumer (generator's thread, or a caller of cw_gen_render()). The
+   producers and the consumer don't share a lock:
+
+   - count of tones in queue (tq->len) is the point of synchronization.
+     Producer writes a tone into slot at tail, and only then increments
+     tq->len. Consumer copies a tone from slot at head, and then takes
+     it by decrementing tq->len with compare-and-swap. If the count has
+     changed in the meantime, the consumer tries again;
+
+   - tail index is owned by producers, which are serialized by
+     tq->enqueue_mutex (there can be more than one producer: e.g. iambic
+     keyer enqueues tones both from client code and from generator's
+     thread). Head index is owned by consumer;
+
+   - removing tones from queue (flushing, removing last character) is
+     done by producer, by moving tail index back. Before the slots can
+     be reused, the producer waits until consumer is outside of
+     dequeue function (see tq->dequeue_seq), so that the consumer never
+     takes a tone that has been removed and replaced by new one;
+
+   - growing the table of tones is done by producer. The producer sets
+     tq->resizing flag and waits until consumer is outside of dequeue
+     function. Consumer that sees the flag when entering dequeue
+     function steps back and waits until the table is replaced.
+
+   - in multi-producer mode (see cw_tq_set_multi_producer_internal())
+     producers of batches of tones don't lock tq->enqueue_mutex. Each of
+     them reserves a contiguous range of slots, so that tones of one
+     character are not interleaved with tones of other producers, and
+     commits the tones in order of reservation (see tq->mp). Code that
+     locks tq->enqueue_mutex first waits until all such producers are
+     done with their tones.
+
+   tq->wait_mutex and tq->wait_vars are used only by functions that need
+   to block until some event happens in the queue. Producer and consumer
+   lock the mutex only to notify waiters, and only when there are any
+   waiters registered in tq->n_waiters for reasons related to the event.
+   E.g. enqueueing a tone wakes only generator's thread waiting for
+   non-empty queue, it doesn't wake threads waiting for queue level.
 */
 
 
 
 
+#include "config.h"
+
+
+
+
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h> /* "PRIu32" */
 #include <pthread.h>
+#include <sched.h>    /* sched_yield() */
 #include <stdlib.h>
+#include <time.h>     /* struct timespec */
+#include <unistd.h>
 
 
 
@@ -80,6 +138,8 @@
 #include "libcw_debug.h"
 #include "libcw_gen.h"
 #include "libcw_signal.h"
+#include "libcw_prof.h"
+#include "libcw_trace.h"
 #include "libcw_tq.h"
 #include "libcw_tq_internal.h"
 
@@ -94,6 +154,10 @@
 # include <strings.h>
 #endif
 
+#if defined(HAVE_SYS_EVENTFD_H)
+# include <sys/eventfd.h>
+#endif
+
 
 
 
@@ -173,33 +237,84 @@ cw_tone_queue_t * cw_tq_new_internal(void)
 	   generator, then maybe we don't have to malloc it. That would be
 	   one error source less. */
 
-	cw_tone_queue_t * tq = (cw_tone_queue_t *) calloc(1, sizeof (cw_tone_queue_t));
+	/* Groups of fields of tone queue are aligned to cache lines. */
+	cw_tone_queue_t * tq = (cw_tone_queue_t *) cw_calloc_aligned_internal(sizeof (cw_tone_queue_t));
 	if (NULL == tq) {
 		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
-				      MSG_PREFIX "new: failed to calloc() tone queue");
+				      MSG_PREFIX "new: failed to allocate tone queue");
 		return (cw_tone_queue_t *) NULL;
 	}
 
 	pthread_mutex_init(&tq->wait_mutex, NULL);
 	pthread_mutex_lock(&tq->wait_mutex);
-	pthread_cond_init(&tq->wait_var, NULL);
+	/* Deadlines of cw_tq_timed_wait_internal() are on
+	   CLOCK_MONOTONIC timeline. */
+	pthread_condattr_t wait_attr;
+	pthread_condattr_init(&wait_attr);
+	pthread_condattr_setclock(&wait_attr, CLOCK_MONOTONIC);
+	for (int i = 0; i < CW_TQ_WAIT_N_REASONS; i++) {
+		pthread_cond_init(&tq->wait_vars[i], &wait_attr);
+		tq->n_waiters[i] = 0;
+	}
+	pthread_condattr_destroy(&wait_attr);
+	pthread_mutex_init(&tq->enqueue_mutex, NULL);
+	pthread_mutex_init(&tq->priority.mutex, NULL);
+
+	tq->queue = (cw_tone_desc_t *) NULL;
+	tq->n_slots = 0;
+	tq->slots_mask = 0;
+	tq->resizing = false;
 
 	tq->head = 0;
 	tq->tail = 0;
+	tq->tail_seq = 0;
 	tq->len = 0;
+	tq->duration = 0;
+
+	tq->chars_index.seqs = (size_t *) NULL;
+	tq->chars_index.n_slots = 0;
+	tq->chars_index.mask = 0;
+	tq->chars_index.head = 0;
+	tq->chars_index.tail = 0;
+	tq->n_chars = 0;
+	tq->len_peak = 0;
+
+	tq->priority.head = 0;
+	tq->priority.tail = 0;
+	tq->priority.len = 0;
+	tq->priority.draining = false;
+
 	tq->state = CW_TQ_EMPTY;
+	tq->dequeue_seq = 0;
+	tq->mp.enabled = false;
+	tq->mp.blocked = false;
+	tq->mp.n_active = 0;
+	tq->mp.reserve_seq = 0;
+	tq->mp.seq_to_index = 0;
+	tq->event_fds[0] = -1;
+	tq->event_fds[1] = -1;
+	tq->event_pending = false;
 
 	tq->low_water_mark = 0;
 	tq->low_water_callback = NULL;
 	tq->low_water_callback_arg = NULL;
 
-	tq->gen = (cw_gen_t *) NULL; /* This field will be set by generator code. */
+	tq->low_water_duration = 0;
+	tq->low_water_duration_callback = NULL;
+	tq->low_water_duration_callback_arg = NULL;
 
-	cw_ret_t cwret = cw_tq_set_capacity_internal(tq, CW_TONE_QUEUE_CAPACITY_MAX, CW_TONE_QUEUE_HIGH_WATER_MARK_MAX);
-	cw_assert (CW_SUCCESS == cwret, MSG_PREFIX "new: failed to set initial capacity of tq");
+	tq->gen = (cw_gen_t *) NULL; /* This field will be set by generator code. */
 
 	pthread_mutex_unlock(&tq->wait_mutex);
 
+	/* This also allocates initial table of tones. */
+	if (CW_SUCCESS != cw_tq_set_capacity_internal(tq, CW_TONE_QUEUE_CAPACITY_MAX, CW_TONE_QUEUE_HIGH_WATER_MARK_MAX)) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "new: failed to set initial capacity of tq");
+		cw_tq_delete_internal(&tq);
+		return (cw_tone_queue_t *) NULL;
+	}
+
 	return tq;
 }
 
@@ -246,8 +361,22 @@ void cw_tq_delete_internal(cw_tone_queue_t ** tq)
 	   by function called _destroy().
 
 	   So don't call pthread_cond_destroy(). */
-	//pthread_cond_destroy(&(*tq)->wait_var);
+	//pthread_cond_destroy(&(*tq)->wait_vars[i]);
 	pthread_mutex_destroy(&(*tq)->wait_mutex);
+	pthread_mutex_destroy(&(*tq)->enqueue_mutex);
+	pthread_mutex_destroy(&(*tq)->priority.mutex);
+
+	if (-1 != (*tq)->event_fds[0]) {
+		close((*tq)->event_fds[0]);
+		if ((*tq)->event_fds[1] != (*tq)->event_fds[0]) {
+			close((*tq)->event_fds[1]);
+		}
+	}
+
+	free((*tq)->queue);
+	(*tq)->queue = (cw_tone_desc_t *) NULL;
+	free((*tq)->chars_index.seqs);
+	(*tq)->chars_index.seqs = (size_t *) NULL;
 
 	free(*tq);
 	*tq = (cw_tone_queue_t *) NULL;
@@ -269,22 +398,121 @@ void cw_tq_delete_internal(cw_tone_queue_t ** tq)
 */
 void cw_tq_make_empty_internal(cw_tone_queue_t * tq)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
-	bool broadcast = false;
-	if (tq->len > 0 || tq->state != CW_TQ_EMPTY) {
-		broadcast = true;
+	cw_tq_lock_producers_internal(tq);
+
+	/* Take all tones from the queue at once, and move tail back to
+	   head. */
+	const size_t len = __atomic_exchange_n(&tq->len, 0, __ATOMIC_SEQ_CST);
+	tq->tail = (tq->tail - len) & tq->slots_mask;
+	tq->tail_seq -= len;
+
+	pthread_mutex_lock(&tq->priority.mutex);
+	const size_t priority_len = __atomic_exchange_n(&tq->priority.len, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->priority.head, tq->priority.tail, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tq->priority.mutex);
+
+	/* Consumer may be in the middle of dequeueing a tone, and may
+	   update queue's state when it is done. Wait for it, so that
+	   CW_TQ_EMPTY set below is the final state. */
+	cw_tq_wait_for_consumer_internal(tq);
+	tq->chars_index.head = tq->chars_index.tail;
+	__atomic_store_n(&tq->n_chars, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->duration, 0, __ATOMIC_SEQ_CST);
+	const cw_queue_state_t state_before = __atomic_exchange_n(&tq->state, CW_TQ_EMPTY, __ATOMIC_SEQ_CST);
+
+	cw_tq_unlock_producers_internal(tq);
+
+	if (len > 0 || priority_len > 0 || state_before != CW_TQ_EMPTY) {
+		//fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'make empty'\n", __func__, __LINE__);
+		cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_LEVEL) | CW_TQ_WAIT_BIT(CW_TQ_WAIT_TONE_END));
 	}
 
-	tq->head = 0;
-	tq->tail = 0;
-	tq->len = 0;
-	tq->state = CW_TQ_EMPTY;
+	return;
+}
 
-	if (broadcast) {
-		//fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'make empty'\n", __func__, __LINE__);
-		pthread_cond_broadcast(&tq->wait_var);
+
+
+
+/**
+   @brief Wait until consumer of tone queue is outside of dequeue function
+
+   Producer that has removed tones from @p tq must call this function
+   before slots of removed tones are re-used by new tones. Otherwise
+   consumer that has started dequeueing before the removal could take
+   a tone that doesn't belong to the queue anymore.
+
+   Function returns immediately if consumer is not dequeueing at the
+   moment.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_wait_for_consumer_internal(cw_tone_queue_t * tq)
+{
+	const unsigned int seq = __atomic_load_n(&tq->dequeue_seq, __ATOMIC_SEQ_CST);
+	if (0 == (seq & 1)) {
+		return;
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+
+	/* Dequeueing takes a very short time, it doesn't make sense to
+	   involve condition variables here. */
+	while (seq == __atomic_load_n(&tq->dequeue_seq, __ATOMIC_SEQ_CST)) {
+		sched_yield();
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Lock tone queue for exclusive access by producer
+
+   Lock tq->enqueue_mutex. In multi-producer mode also stop producers
+   that enqueue tones without the mutex, and wait until producers that
+   have reserved slots in queue commit their tones. After the call
+   state of tail of queue is stable until
+   cw_tq_unlock_producers_internal() is called.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_lock_producers_internal(cw_tone_queue_t * tq)
+{
+	pthread_mutex_lock(&tq->enqueue_mutex);
+
+	if (__atomic_load_n(&tq->mp.enabled, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&tq->mp.blocked, true, __ATOMIC_SEQ_CST);
+		/* Committing a batch of tones takes a very short time. */
+		while (0 != __atomic_load_n(&tq->mp.n_active, __ATOMIC_SEQ_CST)) {
+			sched_yield();
+		}
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Unlock tone queue locked with cw_tq_lock_producers_internal()
+
+   In multi-producer mode positions of new reservations are
+   synchronized with tail of queue, which may have been moved while
+   the queue was locked, and producers that don't use the mutex are let
+   in again.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_unlock_producers_internal(cw_tone_queue_t * tq)
+{
+	if (__atomic_load_n(&tq->mp.enabled, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&tq->mp.reserve_seq, tq->tail_seq, __ATOMIC_SEQ_CST);
+		tq->mp.seq_to_index = tq->tail - tq->tail_seq;
+	}
+	__atomic_store_n(&tq->mp.blocked, false, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_unlock(&tq->enqueue_mutex);
 
 	return;
 }
@@ -304,15 +532,22 @@ void cw_tq_make_empty_internal(cw_tone_queue_t * tq)
    (CW_TONE_QUEUE_CAPACITY_MAX and CW_TONE_QUEUE_HIGH_WATER_MARK_MAX)
    by internal call to cw_tq_new_internal().
 
-   @p capacity must be no larger than CW_TONE_QUEUE_CAPACITY_MAX.
-   @p high_water_mark must be no larger than CW_TONE_QUEUE_HIGH_WATER_MARK_MAX.
+   @p capacity must be no larger than CW_TONE_QUEUE_CAPACITY_LIMIT.
 
    Both values must be larger than zero (this condition is subject to
    changes in future revisions of the library).
 
    @p high_water_mark must be no larger than @p capacity.
 
+   @p capacity must be no smaller than current count of tones in queue.
+
+   Memory for tones is not allocated up front for whole @p capacity:
+   the queue's table of tones grows as tones are enqueued. Queue with
+   preallocated memory (see cw_tq_preallocate_internal()) allocates
+   memory for whole new @p capacity here.
+
    @exception EINVAL any of the two parameters (@p capacity or @p high_water_mark) is invalid.
+   @exception ENOMEM failed to allocate table of tones
 
    @internal
    @reviewed 2020-07-28
@@ -332,7 +567,7 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 		return CW_FAILURE;
 	}
 
-	if (0 == high_water_mark || high_water_mark > CW_TONE_QUEUE_HIGH_WATER_MARK_MAX) {
+	if (0 == high_water_mark) {
 		/* If we allowed high water mark to be zero, the queue
 		   would not accept any new tones: it would constantly
 		   be full. Any attempt to enqueue any tone would
@@ -342,7 +577,7 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 		return CW_FAILURE;
 	}
 
-	if (0 == capacity || capacity > CW_TONE_QUEUE_CAPACITY_MAX) {
+	if (0 == capacity || capacity > CW_TONE_QUEUE_CAPACITY_LIMIT) {
 		/* Tone queue of capacity zero doesn't make much
 		   sense, so capacity == 0 is not allowed. */
 		errno = EINVAL;
@@ -354,9 +589,245 @@ cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size
 		return CW_FAILURE;
 	}
 
+	cw_tq_lock_producers_internal(tq);
+
+	if (__atomic_load_n(&tq->len, __ATOMIC_ACQUIRE) > capacity) {
+		cw_tq_unlock_producers_internal(tq);
+		errno = EINVAL;
+		return CW_FAILURE;
+	}
+
+	/* Make sure that there is a table of tones to start with. */
+	const size_t n_slots = capacity < CW_TONE_QUEUE_INITIAL_N_SLOTS ? capacity : CW_TONE_QUEUE_INITIAL_N_SLOTS;
+	if (CW_SUCCESS != cw_tq_reserve_slots_internal(tq, tq->preallocated ? capacity : n_slots)) {
+		cw_tq_unlock_producers_internal(tq);
+		return CW_FAILURE;
+	}
+	if (tq->preallocated && CW_SUCCESS != cw_tq_reserve_chars_index_internal(tq, capacity)) {
+		cw_tq_unlock_producers_internal(tq);
+		return CW_FAILURE;
+	}
+
 	tq->capacity = capacity;
 	tq->high_water_mark = high_water_mark;
 
+	cw_tq_unlock_producers_internal(tq);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Allocate memory of queue for its whole capacity
+
+   After the call the queue doesn't allocate memory when tones are
+   enqueued. This remains true when capacity of queue is changed with
+   cw_tq_set_capacity_internal().
+
+   @exception ENOMEM failed to allocate memory
+
+   @param[in] tq tone queue
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_preallocate_internal(cw_tone_queue_t * tq)
+{
+	cw_tq_lock_producers_internal(tq);
+
+	cw_ret_t cwret = cw_tq_reserve_slots_internal(tq, tq->capacity);
+	if (CW_SUCCESS == cwret) {
+		cwret = cw_tq_reserve_chars_index_internal(tq, tq->capacity);
+	}
+	if (CW_SUCCESS == cwret) {
+		tq->preallocated = true;
+	}
+
+	cw_tq_unlock_producers_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Enable or disable multi-producer mode of queue
+
+   In multi-producer mode many threads can add batches of tones to the
+   queue with cw_tq_enqueue_batch_internal() at the same time, without
+   waiting for each other on a lock, as long as the table of tones
+   doesn't need to grow. Tones of each batch stay contiguous in the
+   queue. Other operations on queue (adding single tones, removing
+   tones, changing capacity) are still serialized with a lock, and
+   they wait for producers that don't use the lock.
+
+   The mode is useful when a queue is fed by many senders at the same
+   time. With one producer it only adds a few atomic operations to
+   enqueueing.
+
+   @exception ENOMEM failed to allocate memory
+
+   @param[in] tq tone queue
+   @param[in] enabled whether to enable multi-producer mode
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_set_multi_producer_internal(cw_tone_queue_t * tq, bool enabled)
+{
+	cw_tq_lock_producers_internal(tq);
+
+	/* Producers without the lock never grow index of characters.
+	   Count of characters is never larger than count of tones, so
+	   index with as many slots as table of tones is large enough. */
+	cw_ret_t cwret = CW_SUCCESS;
+	if (enabled && tq->chars_index.n_slots < tq->n_slots) {
+		cwret = cw_tq_reserve_chars_index_internal(tq, tq->n_slots);
+	}
+	if (CW_SUCCESS == cwret) {
+		__atomic_store_n(&tq->mp.enabled, enabled, __ATOMIC_SEQ_CST);
+	}
+
+	cw_tq_unlock_producers_internal(tq);
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Make sure that table of tones in queue has at least @p n_slots slots
+
+   If the table is too small, function allocates new table, with count
+   of slots being the smallest power of two not smaller than @p
+   n_slots, and moves tones to the new table. Positions of tones
+   relative to head of queue are preserved.
+
+   This function must be called by producer, with tq->enqueue_mutex
+   locked.
+
+   @exception ENOMEM failed to allocate new table
+
+   @param[in] tq tone queue
+   @param[in] n_slots requested count of slots
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_reserve_slots_internal(cw_tone_queue_t * tq, size_t n_slots)
+{
+	if (n_slots <= tq->n_slots) {
+		return CW_SUCCESS;
+	}
+
+	size_t new_n_slots = 1;
+	while (new_n_slots < n_slots) {
+		new_n_slots <<= 1;
+	}
+
+	cw_tone_desc_t * new_queue = (cw_tone_desc_t *) malloc(new_n_slots * sizeof (cw_tone_desc_t));
+	if (NULL == new_queue) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reserve slots: failed to allocate %zu slots", new_n_slots);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	/* Keep consumer away from the table while it is replaced. */
+	__atomic_store_n(&tq->resizing, true, __ATOMIC_SEQ_CST);
+	cw_tq_wait_for_consumer_internal(tq);
+
+	/* Consumer is outside of dequeue function, and producers wait
+	   for enqueue_mutex, so head and len are stable. Head index
+	   stays valid in the larger table, but tones may wrap at
+	   different position, so each tone is copied separately. */
+	const size_t head = tq->head;
+	const size_t len = __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+	for (size_t i = 0; i < len; i++) {
+		const size_t old_idx = (head + i) & tq->slots_mask;
+		const size_t new_idx = (head + i) & (new_n_slots - 1);
+		new_queue[new_idx] = tq->queue[old_idx];
+	}
+
+	cw_tone_desc_t * old_queue = tq->queue;
+	tq->queue = new_queue;
+	tq->n_slots = new_n_slots;
+	tq->slots_mask = new_n_slots - 1;
+	tq->tail = (head + len) & tq->slots_mask;
+
+	__atomic_store_n(&tq->resizing, false, __ATOMIC_SEQ_CST);
+
+	free(old_queue);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Make sure that index of characters has room for @p n_chars new entries
+
+   Function first drops entries of characters that are no longer in
+   queue, and grows the index only if this isn't enough. Count of
+   characters in queue is never larger than count of tones, so the
+   index doesn't grow larger than table of tones.
+
+   This function must be called by producer, with tq->enqueue_mutex
+   locked.
+
+   @exception ENOMEM failed to allocate new index
+
+   @param[in] tq tone queue
+   @param[in] n_chars count of characters to be added to the index
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_reserve_chars_index_internal(cw_tone_queue_t * tq, size_t n_chars)
+{
+	if (tq->chars_index.tail - tq->chars_index.head + n_chars <= tq->chars_index.n_slots) {
+		return CW_SUCCESS;
+	}
+
+	/* First tones of these characters have been dequeued. */
+	const size_t head_seq = tq->tail_seq - __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+	while (tq->chars_index.head != tq->chars_index.tail
+	       && tq->chars_index.seqs[tq->chars_index.head & tq->chars_index.mask] < head_seq) {
+		tq->chars_index.head++;
+	}
+
+	const size_t n_used = tq->chars_index.tail - tq->chars_index.head;
+	if (n_used + n_chars <= tq->chars_index.n_slots) {
+		return CW_SUCCESS;
+	}
+
+	size_t new_n_slots = tq->chars_index.n_slots ? tq->chars_index.n_slots : CW_TONE_QUEUE_INITIAL_N_SLOTS;
+	while (new_n_slots < n_used + n_chars) {
+		new_n_slots <<= 1;
+	}
+
+	size_t * new_seqs = (size_t *) malloc(new_n_slots * sizeof (size_t));
+	if (NULL == new_seqs) {
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "reserve chars index: failed to allocate %zu slots", new_n_slots);
+		errno = ENOMEM;
+		return CW_FAILURE;
+	}
+
+	for (size_t i = tq->chars_index.head; i != tq->chars_index.tail; i++) {
+		new_seqs[i & (new_n_slots - 1)] = tq->chars_index.seqs[i & tq->chars_index.mask];
+	}
+
+	free(tq->chars_index.seqs);
+	tq->chars_index.seqs = new_seqs;
+	tq->chars_index.n_slots = new_n_slots;
+	tq->chars_index.mask = new_n_slots - 1;
+
 	return CW_SUCCESS;
 }
 
@@ -421,11 +892,8 @@ size_t cw_tq_get_high_water_mark_internal(const cw_tone_queue_t * tq)
 */
 size_t cw_tq_length_internal(cw_tone_queue_t * tq)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
-	const size_t len = tq->len;
-	pthread_mutex_unlock(&tq->wait_mutex);
-
-	return len;
+	return __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST)
+		+ __atomic_load_n(&tq->priority.len, __ATOMIC_SEQ_CST);
 }
 
 
@@ -450,7 +918,7 @@ size_t cw_tq_length_internal(cw_tone_queue_t * tq)
 */
 size_t cw_tq_prev_index_internal(const cw_tone_queue_t * tq, size_t ind)
 {
-	return ind == 0 ? tq->capacity - 1 : ind - 1;
+	return (ind - 1) & tq->slots_mask;
 }
 
 
@@ -475,7 +943,59 @@ size_t cw_tq_prev_index_internal(const cw_tone_queue_t * tq, size_t ind)
 */
 size_t cw_tq_next_index_internal(const cw_tone_queue_t * tq, size_t ind)
 {
-	return ind == tq->capacity - 1 ? 0 : ind + 1;
+	return (ind + 1) & tq->slots_mask;
+}
+
+
+
+
+/**
+   @brief Store a tone in tone descriptor
+
+   Only those fields of @p tone that are known before the tone is
+   dequeued are stored in @p desc. @p tone must be already validated
+   (see cw_tq_enqueue_internal()).
+
+   @param[out] desc descriptor to fill
+   @param[in] tone tone to store
+*/
+void cw_tq_tone_to_desc_internal(cw_tone_desc_t * desc, const cw_tone_t * tone)
+{
+	desc->duration = tone->duration;
+	desc->frequency = (uint16_t) (tone->is_clip ? tone->clip : tone->frequency);
+	desc->debug_id = tone->debug_id;
+	desc->slope_mode = (unsigned int) tone->slope_mode;
+	desc->is_forever = tone->is_forever;
+	desc->is_first = tone->is_first;
+	desc->is_scheduled = tone->is_scheduled;
+	desc->is_clip = tone->is_clip;
+	desc->is_mark = tone->is_mark;
+}
+
+
+
+
+/**
+   @brief Get a tone from tone descriptor
+
+   Derived fields of @p tone (counts of samples, samples iterator) are
+   zeroed. Generator calculates them after dequeueing the tone.
+
+   @param[out] tone tone to fill
+   @param[in] desc descriptor of tone
+*/
+void cw_tq_desc_to_tone_internal(cw_tone_t * tone, const cw_tone_desc_t * desc)
+{
+	CW_TONE_INIT(tone, desc->is_clip ? 0 : desc->frequency, desc->duration, (cw_tone_slope_mode_t) desc->slope_mode);
+	tone->is_forever = desc->is_forever;
+	tone->is_first = desc->is_first;
+	tone->is_scheduled = desc->is_scheduled;
+	if (desc->is_clip) {
+		tone->is_clip = true;
+		tone->clip = desc->frequency;
+	}
+	tone->is_mark = desc->is_mark;
+	tone->debug_id = desc->debug_id;
 }
 
 
@@ -514,39 +1034,70 @@ size_t cw_tq_next_index_internal(const cw_tone_queue_t * tq, size_t ind)
 
    @return current state of tone queue (state after dequeueing current tone)
 */
-cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
+CW_PROF_HOT cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
-
-	bool call_callback = false;
-	const size_t len_before = tq->len;
-	const cw_queue_state_t state_before = tq->state;
+	CW_PROF_MARK(tq_dequeue_begin);
+
+	/* Let producers know that we may be reading tones from queue. */
+	__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tq->resizing, __ATOMIC_SEQ_CST)) {
+		/* Producer is replacing table of tones. Step out of
+		   dequeue function and let the producer finish. */
+		__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+		sched_yield();
+		__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+	}
 
-	switch (tq->state) {
-	case CW_TQ_EMPTY:
-		/* Ignore calls if queue is empty. */
-		break;
+	/* Length of queue can grow only between dequeues, so its
+	   largest value is seen here, or by cw_tq_length_peak_internal(). */
+	const size_t len = cw_tq_length_internal(tq);
+	if (len > __atomic_load_n(&tq->len_peak, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&tq->len_peak, len, __ATOMIC_RELAXED);
+	}
 
-	case CW_TQ_JUST_EMPTIED:
+	size_t len_before = 0;
+	size_t len_after = 0;
+	uint64_t duration_after = 0;
+	size_t priority_len_after = 0;
+	bool priority_dequeued = false;
+	const cw_queue_state_t state_before = __atomic_load_n(&tq->state, __ATOMIC_SEQ_CST);
+	cw_queue_state_t queue_state = state_before;
+
+	if (cw_tq_dequeue_priority_internal(tq, tone, &priority_len_after)) {
+		priority_dequeued = true;
+		CW_TRACE(CW_TRACE_TQ_DEQUEUE, tone->frequency);
+		queue_state = 0 == priority_len_after && 0 == __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST)
+			? CW_TQ_JUST_EMPTIED : CW_TQ_NONEMPTY;
+		__atomic_store_n(&tq->state, queue_state, __ATOMIC_SEQ_CST);
+
+	} else if (cw_tq_dequeue_sub_internal(tq, tone, &len_before, &len_after, &duration_after)) {
+		CW_TRACE(CW_TRACE_TQ_DEQUEUE, tone->frequency);
+		queue_state = 0 == len_after ? CW_TQ_JUST_EMPTIED : CW_TQ_NONEMPTY;
+		__atomic_store_n(&tq->state, queue_state, __ATOMIC_SEQ_CST);
+
+	} else if (CW_TQ_EMPTY != state_before) {
 		/* There are no more tones to dequeue, but we still need to
-		   update the state. */
-		tq->state = CW_TQ_EMPTY;
-		break;
-
-	case CW_TQ_NONEMPTY:
-		cw_assert (tq->len > 0, MSG_PREFIX "dequeue: tone queue is CW_TQ_NONEMPTY, but tq->len = %zu\n", tq->len);
-		call_callback = cw_tq_dequeue_sub_internal(tq, tone);
-		if (0 == tq->len) {
-			tq->state = CW_TQ_JUST_EMPTIED;
+		   update the state. Producer may be enqueueing a tone right
+		   now: don't overwrite its CW_TQ_NONEMPTY state with
+		   CW_TQ_EMPTY. */
+		queue_state = CW_TQ_EMPTY;
+		cw_queue_state_t expected = state_before;
+		if (__atomic_compare_exchange_n(&tq->state, &expected, CW_TQ_EMPTY, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			if (__atomic_load_n(&tq->len, __ATOMIC_SEQ_CST) > 0
+			    || __atomic_load_n(&tq->priority.len, __ATOMIC_SEQ_CST) > 0) {
+				/* A tone has been enqueued before the state
+				   has been changed. */
+				expected = CW_TQ_EMPTY;
+				__atomic_compare_exchange_n(&tq->state, &expected, CW_TQ_NONEMPTY, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+			}
 		}
-		break;
-	default:
-		cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
-			      MSG_PREFIX "unexpected queue state %d", tq->state);
-		break;
+	} else {
+		/* Ignore calls if queue is empty. */
+		;
 	}
 
-	const cw_queue_state_t queue_state = tq->state;
+	__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+
 #if 0
 	/* Verbose debug. */
 	cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG
@@ -554,12 +1105,29 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 		      queue_state, tone->frequency, tone->duration);
 #endif
 
-	if (len_before != tq->len || state_before != tq->state) {
+	if (priority_dequeued || len_before != len_after || state_before != queue_state) {
 		//fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'dequeue'\n", __func__, __LINE__);
-		pthread_cond_broadcast(&tq->wait_var);
+		/* Dequeueing a tone means end of previous tone. Only
+		   change of length is interesting for level waiters. */
+		unsigned int reasons = CW_TQ_WAIT_BIT(CW_TQ_WAIT_TONE_END);
+		if (priority_dequeued || len_before != len_after) {
+			reasons |= CW_TQ_WAIT_BIT(CW_TQ_WAIT_LEVEL);
+		}
+		cw_tq_broadcast_internal(tq, reasons);
 	}
 
-	pthread_mutex_unlock(&tq->wait_mutex);
+	/* It may seem that the double condition in 'if ()' is
+	   redundant, but for some reason it is necessary. Be very, very
+	   careful when modifying this.
+
+	   "forever" tone that is not removed from queue doesn't change
+	   length of queue, so callback won't be called for it. As
+	   top-level comment of cw_tq_dequeue_sub_internal() says: avoid
+	   endlessly calling the callback if the only queued tone is
+	   "forever" tone. */
+	const bool call_callback = NULL != tq->low_water_callback
+		&& len_before > tq->low_water_mark
+		&& len_after <= tq->low_water_mark;
 
 	/* Since client's callback can use libcw functions
 	   that call pthread_mutex_lock(&tq->...), we should
@@ -569,6 +1137,19 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 		(*(tq->low_water_callback))(tq->low_water_callback_arg);
 	}
 
+	/* Duration of queue changes only when a tone is removed from the
+	   queue, "forever" tone is treated as in case of the callback
+	   above. */
+	const uint64_t low_water_duration = tq->low_water_duration;
+	const bool call_duration_callback = NULL != tq->low_water_duration_callback
+		&& len_before != len_after
+		&& duration_after + (uint64_t) tone->duration > low_water_duration
+		&& duration_after <= low_water_duration;
+	if (call_duration_callback) {
+		(*(tq->low_water_duration_callback))(tq->low_water_duration_callback_arg);
+	}
+
+	CW_PROF_MARK(tq_dequeue_end);
 	return queue_state;
 }
 
@@ -576,93 +1157,207 @@ cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 
 
 /**
-   @brief Handle dequeueing of tone from non-empty tone queue
-
-   Function gets a tone from head of the queue.
-
-   If this was a last tone in queue, and it was a "forever" tone, the
-   tone is not removed from the queue (the philosophy of "forever"
-   tone), and "low watermark" condition is not checked.
-
-   Otherwise remove the tone from tone queue, check "low watermark"
-   condition, and return value of the check (true/false).
+   @brief Remove "forever" tone that is the only tone in queue
 
-   In any case, dequeued tone is returned through @p tone. @p tone
-   must be a valid pointer provided by caller.
+   cw_tq_dequeue_internal() never removes last "forever" tone from
+   queue, so generator keeps playing it until next tone is enqueued.
+   This function lets generator stop playing such tone: the queue
+   becomes empty, and next call to cw_tq_dequeue_internal() returns
+   CW_TQ_EMPTY.
 
-   TODO: add unit tests
+   Nothing is removed if the queue contains any other tone.
 
-   @internal
-   @reviewed 2020-10-17
-   @endinternal
+   This function must be called only by consumer of tone queue.
 
-   @param[in] tq tone queue to dequeue from
-   @param[out] tone dequeued tone
+   @param[in] tq tone queue
 
-   @return true if a condition for calling "low watermark" callback is true
+   @return true if "forever" tone has been removed
    @return false otherwise
 */
-bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
+bool cw_tq_retire_forever_tone_internal(cw_tone_queue_t * tq)
 {
-	CW_TONE_COPY(tone, &(tq->queue[tq->head]));
-
-	if (tone->is_forever && tq->len == 1) {
-		/* Don't permanently remove the last tone that is
-		   "forever" tone in queue. Keep it in tq until client
-		   code adds next tone (this means possibly waiting
-		   forever). Queue's head should not be
-		   iterated. "forever" tone should be played by caller
-		   code, this is why we return the tone through
-		   function's argument. */
-
-		/* Don't call "low watermark" callback for "forever"
-		   tone. As the function's top-level comment has
-		   stated: avoid endlessly calling the callback if the
-		   only queued tone is "forever" tone.*/
-		return false;
+	/* Let producers know that we may be reading tones from queue,
+	   see cw_tq_dequeue_internal(). */
+	__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tq->resizing, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
+		sched_yield();
+		__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
 	}
 
-	/* Used to check if we passed tq's low level watermark. */
-	const size_t tq_len_before = tq->len;
+	bool retired = false;
+	size_t len = __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+	if (1 == len && 0 == __atomic_load_n(&tq->priority.len, __ATOMIC_SEQ_CST)) {
+		const size_t head = tq->head;
+		const cw_tone_desc_t desc = tq->queue[head];
+		if (desc.is_forever
+		    && __atomic_compare_exchange_n(&tq->len, &len, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&tq->head, cw_tq_next_index_internal(tq, head), __ATOMIC_RELEASE);
+			if (desc.is_first) {
+				__atomic_sub_fetch(&tq->n_chars, 1, __ATOMIC_SEQ_CST);
+			}
+			__atomic_sub_fetch(&tq->duration, (uint64_t) desc.duration, __ATOMIC_SEQ_CST);
+			retired = true;
+		}
+	}
 
-	/* Dequeue. We already have the tone, now update tq's state. */
-	tq->head = cw_tq_next_index_internal(tq, tq->head);
-	tq->len--;
+	__atomic_add_fetch(&tq->dequeue_seq, 1, __ATOMIC_SEQ_CST);
 
-	if (tq->len == 0) {
-		/* Verify basic property of empty tq. */
-		cw_assert (tq->head == tq->tail, MSG_PREFIX "dequeue sub: head: %zu, tail: %zu", tq->head, tq->tail);
+	if (retired) {
+		cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_TONE_END) | CW_TQ_WAIT_BIT(CW_TQ_WAIT_LEVEL));
 	}
 
+	return retired;
+}
 
-#if 0   /* Disabled because these debug messages produce lots of output
-	   to console. Enable only when necessary. */
-	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
-		      MSG_PREFIX "dequeue sub: dequeue tone %d us, %d Hz", tone->duration, tone->frequency);
-	cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
-		      MSG_PREFIX "dequeue sub: head = %zu, tail = %zu, length = %zu -> %zu",
-		      tq->head, tq->tail, tq_len_before, tq->len);
-#endif
 
-	/* You can remove this assert in future. It is only temporary,
-	   to check that some changes introduced on 2015.03.01 didn't
-	   break one assumption. */
-	cw_assert (!(tone->is_forever && tq_len_before == 1), MSG_PREFIX "dequeue sub: 'forever' tone appears!");
 
 
-	bool call_callback = false;
-	if (tq->low_water_callback) {
-		/* It may seem that the double condition in 'if ()' is
-		   redundant, but for some reason it is necessary. Be
-		   very, very careful when modifying this. */
-		if (tq_len_before > tq->low_water_mark
-		    && tq->len <= tq->low_water_mark) {
+/**
+   @brief Dequeue a tone from priority lane of tone queue
+
+   Function gets a tone from priority lane of @p tq if the lane is not
+   empty and if consumer is at a boundary of characters in ring of
+   tones, or if it has already started dequeueing from the lane (see
+   comment on cw_tone_queue_t::priority).
+
+   Count of tones remaining in the lane is returned through @p
+   len_after. The value is not set if the function returns false.
+
+   This function must be called only by consumer of tone queue.
+
+   @param[in] tq tone queue to dequeue from
+   @param[out] tone dequeued tone
+   @param[out] len_after count of tones in priority lane after dequeueing
+
+   @return true if a tone has been returned through @p tone
+   @return false otherwise
+*/
+bool cw_tq_dequeue_priority_internal(cw_tone_queue_t * tq, cw_tone_t * tone, size_t * len_after)
+{
+	if (0 == __atomic_load_n(&tq->priority.len, __ATOMIC_ACQUIRE)) {
+		tq->priority.draining = false;
+		return false;
+	}
+
+	if (!tq->priority.draining) {
+		/* Don't break a character that is being played from the
+		   ring. Tone at head of the ring can be safely read while
+		   the count of tones in the ring is non-zero, see
+		   cw_tq_dequeue_sub_internal(). */
+		if (__atomic_load_n(&tq->len, __ATOMIC_ACQUIRE) > 0 && !tq->queue[tq->head].is_first) {
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&tq->priority.mutex);
+	if (0 == tq->priority.len) {
+		/* The lane has been flushed in the meantime. */
+		pthread_mutex_unlock(&tq->priority.mutex);
+		tq->priority.draining = false;
+		return false;
+	}
+	cw_tq_desc_to_tone_internal(tone, &tq->priority.queue[tq->priority.head]);
+	__atomic_store_n(&tq->priority.head, (tq->priority.head + 1) & (CW_TONE_QUEUE_PRIORITY_CAPACITY - 1), __ATOMIC_SEQ_CST);
+	*len_after = __atomic_sub_fetch(&tq->priority.len, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tq->priority.mutex);
+
+	tq->priority.draining = *len_after > 0;
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Handle dequeueing of tone from tone queue
+
+   Function gets a tone from head of the queue.
 
-			call_callback = true;
+   If this was a last tone in queue, and it was a "forever" tone, the
+   tone is not removed from the queue (the philosophy of "forever"
+   tone). Otherwise remove the tone from tone queue.
+
+   In any case, dequeued tone is returned through @p tone. @p tone
+   must be a valid pointer provided by caller.
+
+   Count of tones in queue before and after dequeueing is returned
+   through @p len_before and @p len_after. The values are equal if
+   "forever" tone has not been removed from queue. Duration of tones
+   in queue after dequeueing is returned through @p duration_after.
+   The values are not set if the function returns false.
+
+   This function must be called only by consumer of tone queue.
+
+   TODO: add unit tests
+
+   @internal
+   @reviewed 2020-10-17
+   @endinternal
+
+   @param[in] tq tone queue to dequeue from
+   @param[out] tone dequeued tone
+   @param[out] len_before count of tones in queue before dequeueing
+   @param[out] len_after count of tones in queue after dequeueing
+   @param[out] duration_after duration of tones in queue after dequeueing
+
+   @return true if a tone has been returned through @p tone
+   @return false if there were no tones in queue
+*/
+bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone, size_t * len_before, size_t * len_after, uint64_t * duration_after)
+{
+	size_t len = __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+
+	while (len > 0) {
+		/* Copy the tone first, and take it from the queue
+		   later. While we hold a non-zero count of tones,
+		   producers won't write to slot at head: the slot is
+		   used, and producers removing tones wait for us (see
+		   cw_tq_wait_for_consumer_internal()). */
+		const size_t head = tq->head;
+		cw_tq_desc_to_tone_internal(tone, &tq->queue[head]);
+
+		if (tone->is_forever && 1 == len) {
+			/* Don't permanently remove the last tone that is
+			   "forever" tone in queue. Keep it in tq until client
+			   code adds next tone (this means possibly waiting
+			   forever). Queue's head should not be
+			   iterated. "forever" tone should be played by caller
+			   code, this is why we return the tone through
+			   function's argument. */
+			*len_before = len;
+			*len_after = len;
+			*duration_after = __atomic_load_n(&tq->duration, __ATOMIC_SEQ_CST);
+			return true;
+		}
+
+		/* Dequeue. We already have the tone, now update tq's
+		   state. If a producer has changed the count of tones in
+		   meantime, 'len' is updated with current count and we
+		   try again. */
+		if (__atomic_compare_exchange_n(&tq->len, &len, len - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&tq->head, cw_tq_next_index_internal(tq, head), __ATOMIC_RELEASE);
+			if (tone->is_first) {
+				__atomic_sub_fetch(&tq->n_chars, 1, __ATOMIC_SEQ_CST);
+			}
+			*duration_after = __atomic_sub_fetch(&tq->duration, (uint64_t) tone->duration, __ATOMIC_SEQ_CST);
+			*len_before = len;
+			*len_after = len - 1;
+
+#if 0   /* Disabled because these debug messages produce lots of output
+	   to console. Enable only when necessary. */
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
+				      MSG_PREFIX "dequeue sub: dequeue tone %d us, %d Hz", tone->duration, tone->frequency);
+			cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG,
+				      MSG_PREFIX "dequeue sub: head = %zu, length = %zu -> %zu",
+				      head, *len_before, *len_after);
+#endif
+			return true;
 		}
 	}
 
-	return call_callback;
+	return false;
 }
 
 
@@ -689,6 +1384,7 @@ bool cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone)
 
    @exception EINVAL invalid values of @p tone
    @exception EAGAIN tone not enqueued because tone queue is full
+   @exception ENOMEM failed to grow table of tones
 
    @param[in] tq tone queue to enqueue to
    @param[in] tone tone to enqueue
@@ -726,19 +1422,34 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 	}
 
 
-	pthread_mutex_lock(&tq->wait_mutex);
+	cw_tq_lock_producers_internal(tq);
 
-	if (tq->len == tq->capacity) {
+	if (__atomic_load_n(&tq->len, __ATOMIC_ACQUIRE) == tq->capacity) {
 		/* Tone queue is full. */
 
 		errno = EAGAIN;
 		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
 			      MSG_PREFIX "enqueue: can't enqueue tone, tq is full");
-		pthread_mutex_unlock(&tq->wait_mutex);
+		cw_tq_unlock_producers_internal(tq);
 
 		return CW_FAILURE;
 	}
 
+	const size_t len = __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+	if (len == tq->n_slots) {
+		/* Queue is not full, but table of tones is. */
+		if (CW_SUCCESS != cw_tq_reserve_slots_internal(tq, len + 1)) {
+			cw_tq_unlock_producers_internal(tq);
+			return CW_FAILURE;
+		}
+	}
+	if (tone->is_first) {
+		if (CW_SUCCESS != cw_tq_reserve_chars_index_internal(tq, 1)) {
+			cw_tq_unlock_producers_internal(tq);
+			return CW_FAILURE;
+		}
+	}
+
 
 	// cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_DEBUG, MSG_PREFIX "enqueue: enqueue tone %d us, %d Hz", tone->duration, tone->frequency);
 
@@ -746,12 +1457,25 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 
 	   Notice that tail is incremented after adding a tone. This
 	   means that for empty tq new tone is inserted at index
-	   tail == head (which should be kind of obvious). */
-	tq->queue[tq->tail] = *tone;
+	   tail == head (which should be kind of obvious).
+
+	   The tone becomes visible to consumer only after the count of
+	   tones is incremented. */
+	cw_tq_tone_to_desc_internal(&tq->queue[tq->tail], tone);
+	CW_TRACE(CW_TRACE_TQ_ENQUEUE, tone->frequency);
+	if (tone->is_first) {
+		tq->chars_index.seqs[tq->chars_index.tail++ & tq->chars_index.mask] = tq->tail_seq;
+		__atomic_add_fetch(&tq->n_chars, 1, __ATOMIC_SEQ_CST);
+	}
+
+	__atomic_add_fetch(&tq->duration, (uint64_t) tone->duration, __ATOMIC_SEQ_CST);
 
 	tq->tail = cw_tq_next_index_internal(tq, tq->tail);
-	tq->len++;
-	tq->state = CW_TQ_NONEMPTY;
+	tq->tail_seq++;
+	__atomic_add_fetch(&tq->len, 1, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->state, CW_TQ_NONEMPTY, __ATOMIC_SEQ_CST);
+
+	cw_tq_unlock_producers_internal(tq);
 
 	/*
 	  tq->len and perhaps tq->state have changed. Signal this fact
@@ -765,9 +1489,315 @@ cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone)
 	  reaches all listeners.
 	*/
 	// fprintf(stderr, "[II] " MSG_PREFIX "%s:%d broadcast on 'enqueue'\n", __func__, __LINE__);
-	pthread_cond_broadcast(&tq->wait_var);
+	cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_NONEMPTY));
 
-	pthread_mutex_unlock(&tq->wait_mutex);
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Add many tones to tone queue at once
+
+   This routine adds all tones from @p tones to the queue, and then sends
+   a single notification to generator.
+
+   Either all tones are added to queue, or none: the function doesn't
+   enqueue anything if any of the tones is invalid (see
+   cw_tq_enqueue_internal() for conditions of validity of a tone), or if
+   count of tones in queue would become larger than queue's high water
+   mark.
+
+   Tones with zero duration are dropped, as in cw_tq_enqueue_internal().
+
+   @exception EINVAL invalid values of one of tones in @p tones
+   @exception EAGAIN tones not enqueued because high water mark of queue would be exceeded
+   @exception ENOMEM failed to grow table of tones
+
+   @param[in] tq tone queue to enqueue to
+   @param[in] tones tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_enqueue_batch_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones)
+{
+	cw_assert (tq, MSG_PREFIX "enqueue batch: tone queue is null");
+	cw_assert (tones || 0 == n_tones, MSG_PREFIX "enqueue batch: tones is null");
+
+	size_t n_nonempty = 0;
+	size_t n_first = 0;
+	uint64_t duration = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].frequency < CW_FREQUENCY_MIN
+		    || tones[i].frequency > CW_FREQUENCY_MAX
+		    || tones[i].duration < 0) {
+
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		if (tones[i].duration > 0) {
+			n_nonempty++;
+			duration += (uint64_t) tones[i].duration;
+			if (tones[i].is_first) {
+				n_first++;
+			}
+		}
+	}
+
+	if (0 == n_nonempty) {
+		return CW_SUCCESS;
+	}
+
+	if (__atomic_load_n(&tq->mp.enabled, __ATOMIC_SEQ_CST)
+	    && cw_tq_enqueue_batch_mp_internal(tq, tones, n_tones, n_nonempty, n_first, duration)) {
+		cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_NONEMPTY));
+		return CW_SUCCESS;
+	}
+
+
+	cw_tq_lock_producers_internal(tq);
+
+	const size_t len = __atomic_load_n(&tq->len, __ATOMIC_ACQUIRE);
+	if (len + n_nonempty > tq->high_water_mark) {
+		errno = EAGAIN;
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "enqueue batch: can't enqueue %zu tones, tq length = %zu", n_nonempty, len);
+		cw_tq_unlock_producers_internal(tq);
+
+		return CW_FAILURE;
+	}
+
+	if (CW_SUCCESS != cw_tq_reserve_slots_internal(tq, len + n_nonempty)
+	    || CW_SUCCESS != cw_tq_reserve_chars_index_internal(tq, n_first)) {
+		cw_tq_unlock_producers_internal(tq);
+		return CW_FAILURE;
+	}
+	if (tq->mp.enabled && tq->chars_index.n_slots < tq->n_slots
+	    && CW_SUCCESS != cw_tq_reserve_chars_index_internal(tq, tq->n_slots)) {
+		/* See cw_tq_set_multi_producer_internal(). */
+		cw_tq_unlock_producers_internal(tq);
+		return CW_FAILURE;
+	}
+
+	/* All tones become visible to consumer at once, when the count
+	   of tones is incremented. */
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].duration > 0) {
+			cw_tq_tone_to_desc_internal(&tq->queue[tq->tail], &tones[i]);
+			CW_TRACE(CW_TRACE_TQ_ENQUEUE, tones[i].frequency);
+			if (tones[i].is_first) {
+				tq->chars_index.seqs[tq->chars_index.tail++ & tq->chars_index.mask] = tq->tail_seq;
+			}
+			tq->tail = cw_tq_next_index_internal(tq, tq->tail);
+			tq->tail_seq++;
+		}
+	}
+	if (n_first > 0) {
+		__atomic_add_fetch(&tq->n_chars, n_first, __ATOMIC_SEQ_CST);
+	}
+	__atomic_add_fetch(&tq->duration, duration, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&tq->len, n_nonempty, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->state, CW_TQ_NONEMPTY, __ATOMIC_SEQ_CST);
+
+	cw_tq_unlock_producers_internal(tq);
+
+	cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_NONEMPTY));
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Add many tones to tone queue without locking the queue
+
+   Fast path of cw_tq_enqueue_batch_internal() in multi-producer mode
+   (see tq->mp). @p n_nonempty, @p n_first and @p duration are count of
+   tones with non-zero duration, count of first tones of characters and
+   sum of durations of @p tones, calculated by caller that has already
+   validated the tones.
+
+   The function doesn't enqueue anything and returns false when the
+   queue is locked, when the tones don't fit in current table of tones,
+   or when count of tones may exceed high water mark. The caller should
+   then enqueue the tones under a lock, which gives precise answer.
+
+   @param[in] tq tone queue to enqueue to
+   @param[in] tones tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+   @param[in] n_nonempty count of tones with non-zero duration
+   @param[in] n_first count of first tones of characters
+   @param[in] duration sum of durations of tones
+
+   @return true if tones have been enqueued
+   @return false otherwise
+*/
+bool cw_tq_enqueue_batch_mp_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones, size_t n_nonempty, size_t n_first, uint64_t duration)
+{
+	__atomic_add_fetch(&tq->mp.n_active, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tq->mp.blocked, __ATOMIC_SEQ_CST)) {
+		__atomic_sub_fetch(&tq->mp.n_active, 1, __ATOMIC_SEQ_CST);
+		return false;
+	}
+
+	/* Table of tones and index of characters are not replaced while
+	   there are active producers, see cw_tq_lock_producers_internal(). */
+	if (tq->chars_index.n_slots < tq->n_slots) {
+		__atomic_sub_fetch(&tq->mp.n_active, 1, __ATOMIC_SEQ_CST);
+		return false;
+	}
+
+	/* Reserve range of positions [start, start + n_nonempty). Position
+	   of head is calculated from values read in this order, so that it
+	   is never ahead of real head, even if other producers commit
+	   their tones in the meantime. */
+	size_t start = __atomic_load_n(&tq->mp.reserve_seq, __ATOMIC_SEQ_CST);
+	do {
+		const size_t tail_seq = __atomic_load_n(&tq->tail_seq, __ATOMIC_SEQ_CST);
+		const size_t head_seq = tail_seq - __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST);
+		const size_t n_used = start + n_nonempty - head_seq;
+		if (n_used > tq->high_water_mark || n_used > tq->n_slots) {
+			__atomic_sub_fetch(&tq->mp.n_active, 1, __ATOMIC_SEQ_CST);
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&tq->mp.reserve_seq, &start, start + n_nonempty, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+	/* Slots of the range are not visible to consumer, and they are not
+	   used by other producers. */
+	size_t seq = start;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].duration > 0) {
+			cw_tq_tone_to_desc_internal(&tq->queue[(tq->mp.seq_to_index + seq) & tq->slots_mask], &tones[i]);
+			CW_TRACE(CW_TRACE_TQ_ENQUEUE, tones[i].frequency);
+			seq++;
+		}
+	}
+
+	/* Commit tones in order of reservation. Producers that have
+	   reserved earlier ranges are writing a few tones, it won't take
+	   long. */
+	while (start != __atomic_load_n(&tq->tail_seq, __ATOMIC_SEQ_CST)) {
+		sched_yield();
+	}
+
+	if (n_first > 0) {
+		/* Drop entries of dequeued characters, so that the index
+		   of characters, which is as large as table of tones, has
+		   room for new entries. */
+		const size_t head_seq = start - __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST);
+		while (tq->chars_index.head != tq->chars_index.tail
+		       && tq->chars_index.seqs[tq->chars_index.head & tq->chars_index.mask] < head_seq) {
+			tq->chars_index.head++;
+		}
+
+		seq = start;
+		for (size_t i = 0; i < n_tones; i++) {
+			if (tones[i].duration > 0) {
+				if (tones[i].is_first) {
+					tq->chars_index.seqs[tq->chars_index.tail++ & tq->chars_index.mask] = seq;
+				}
+				seq++;
+			}
+		}
+		__atomic_add_fetch(&tq->n_chars, n_first, __ATOMIC_SEQ_CST);
+	}
+	tq->tail = (tq->mp.seq_to_index + start + n_nonempty) & tq->slots_mask;
+
+	__atomic_add_fetch(&tq->duration, duration, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&tq->len, n_nonempty, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->state, CW_TQ_NONEMPTY, __ATOMIC_SEQ_CST);
+
+	/* Moving tail is the last step: it lets next producer commit its
+	   tones. ::len is incremented before, otherwise producers could
+	   see head of queue ahead of its real position. */
+	__atomic_store_n(&tq->tail_seq, start + n_nonempty, __ATOMIC_SEQ_CST);
+
+	__atomic_sub_fetch(&tq->mp.n_active, 1, __ATOMIC_SEQ_CST);
+
+	return true;
+}
+
+
+
+
+/**
+   @brief Add tones to priority lane of tone queue
+
+   Tones from priority lane are played ahead of tones already queued in
+   the ring of tones, starting at the nearest boundary of characters in
+   the ring (see comment on cw_tone_queue_t::priority). Use this
+   function for short, urgent messages that shouldn't wait until the
+   whole queue is played.
+
+   Conditions of validity of tones are the same as for
+   cw_tq_enqueue_batch_internal(), and as in that function, either all
+   tones are added, or none. "forever" tones are not accepted. Tones with
+   zero duration are dropped.
+
+   @exception EINVAL invalid values of one of tones in @p tones
+   @exception EAGAIN tones not enqueued because priority lane is full
+
+   @param[in] tq tone queue to enqueue to
+   @param[in] tones tones to enqueue
+   @param[in] n_tones count of tones in @p tones
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+cw_ret_t cw_tq_enqueue_priority_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones)
+{
+	cw_assert (tq, MSG_PREFIX "enqueue priority: tone queue is null");
+	cw_assert (tones || 0 == n_tones, MSG_PREFIX "enqueue priority: tones is null");
+
+	size_t n_nonempty = 0;
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].frequency < CW_FREQUENCY_MIN
+		    || tones[i].frequency > CW_FREQUENCY_MAX
+		    || tones[i].duration < 0
+		    || tones[i].is_forever) {
+
+			errno = EINVAL;
+			return CW_FAILURE;
+		}
+		if (tones[i].duration > 0) {
+			n_nonempty++;
+		}
+	}
+
+	if (0 == n_nonempty) {
+		return CW_SUCCESS;
+	}
+
+
+	pthread_mutex_lock(&tq->priority.mutex);
+
+	const size_t len = __atomic_load_n(&tq->priority.len, __ATOMIC_ACQUIRE);
+	if (len + n_nonempty > CW_TONE_QUEUE_PRIORITY_CAPACITY) {
+		errno = EAGAIN;
+		cw_debug_msg (&cw_debug_object_dev, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+			      MSG_PREFIX "enqueue priority: can't enqueue %zu tones, priority lane length = %zu", n_nonempty, len);
+		pthread_mutex_unlock(&tq->priority.mutex);
+
+		return CW_FAILURE;
+	}
+
+	for (size_t i = 0; i < n_tones; i++) {
+		if (tones[i].duration > 0) {
+			cw_tq_tone_to_desc_internal(&tq->priority.queue[tq->priority.tail], &tones[i]);
+			CW_TRACE(CW_TRACE_TQ_ENQUEUE, tones[i].frequency);
+			tq->priority.tail = (tq->priority.tail + 1) & (CW_TONE_QUEUE_PRIORITY_CAPACITY - 1);
+		}
+	}
+	__atomic_add_fetch(&tq->priority.len, n_nonempty, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&tq->state, CW_TQ_NONEMPTY, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_unlock(&tq->priority.mutex);
+
+	cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_NONEMPTY));
 
 	return CW_SUCCESS;
 }
@@ -824,6 +1854,47 @@ cw_ret_t cw_tq_register_low_level_callback_internal(cw_tone_queue_t * tq, cw_que
 
 
 
+/**
+   @brief Register callback for low duration of tones in queue
+
+   Register a function to be called automatically by the dequeue routine
+   whenever duration of tones in tone queue falls to a given @p duration.
+   To be more precise: the callback is called by queue's dequeue function
+   if dequeueing a tone made the duration of tones remaining in queue
+   drop from above @p duration to equal or less than @p duration.
+
+   Unlike the count of tones, the duration tells how much time is left
+   until the queue is drained, regardless of speed of Morse code. The
+   tone that is being played is not included in the duration, so the
+   callback is called at least this tone's duration before the queue
+   becomes empty.
+
+   The callback is called without any tone queue's lock held, so it can
+   enqueue new tones.
+
+   If @p callback_func is NULL then the mechanism becomes disabled.
+
+   @p callback_arg will be passed to @p callback_func.
+
+   @param[in] tq tone queue in which to register a callback
+   @param[in] callback_func callback function to be registered
+   @param[in] callback_arg argument for callback_func to pass return value
+   @param[in] duration duration of tones in queue triggering call of the callback [microseconds]
+
+   @return CW_SUCCESS
+*/
+cw_ret_t cw_tq_register_low_duration_callback_internal(cw_tone_queue_t * tq, cw_queue_low_callback_t callback_func, void * callback_arg, uint64_t duration)
+{
+	tq->low_water_duration = duration;
+	tq->low_water_duration_callback = callback_func;
+	tq->low_water_duration_callback_arg = callback_arg;
+
+	return CW_SUCCESS;
+}
+
+
+
+
 /**
    @brief Wait for the current tone to complete
 
@@ -843,7 +1914,7 @@ cw_ret_t cw_tq_register_low_level_callback_internal(cw_tone_queue_t * tq, cw_que
 */
 cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 {
-	pthread_mutex_lock(&tq->wait_mutex);
+	cw_tq_wait_lock_internal(tq, CW_TQ_WAIT_TONE_END);
 	/* According to man page, spurious wakeups of pthread_cond_wait() may
 	   occur.  Call the function in loop with two conditions to work
 	   around these wakeups.
@@ -870,12 +1941,16 @@ cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 	   function and in other tq functions allows us to safely get
 	   tq->head. */
 
-	/* Wait for the queue index to change or the dequeue to go completely empty. */
-	const size_t check_tq_head = tq->head;
-	while (tq->head == check_tq_head && tq->state != CW_TQ_EMPTY) {
-		pthread_cond_wait(&tq->wait_var, &tq->wait_mutex);
+	/* Wait for the queue index (of the ring or of priority lane) to
+	   change or the dequeue to go completely empty. */
+	const size_t check_tq_head = __atomic_load_n(&tq->head, __ATOMIC_SEQ_CST);
+	const size_t check_priority_head = __atomic_load_n(&tq->priority.head, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tq->head, __ATOMIC_SEQ_CST) == check_tq_head
+	       && __atomic_load_n(&tq->priority.head, __ATOMIC_SEQ_CST) == check_priority_head
+	       && __atomic_load_n(&tq->state, __ATOMIC_SEQ_CST) != CW_TQ_EMPTY) {
+		cw_tq_wait_internal(tq, CW_TQ_WAIT_TONE_END);
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_wait_unlock_internal(tq, CW_TQ_WAIT_TONE_END);
 
 
 #if 0   /* Original implementation using signals. */ /* This code has been disabled some time before 2017-01-30. */
@@ -919,11 +1994,11 @@ cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq)
 cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level)
 {
 	/* Wait until the queue length is at or below given level. */
-	pthread_mutex_lock(&tq->wait_mutex);
-	while (tq->len > level) {
-		pthread_cond_wait(&tq->wait_var, &tq->wait_mutex);
+	cw_tq_wait_lock_internal(tq, CW_TQ_WAIT_LEVEL);
+	while (cw_tq_length_internal(tq) > level) {
+		cw_tq_wait_internal(tq, CW_TQ_WAIT_LEVEL);
 	}
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_wait_unlock_internal(tq, CW_TQ_WAIT_LEVEL);
 
 
 #if 0   /* Original implementation using signals. */  /* This code has been disabled some time before 2017-01-30. */
@@ -957,8 +2032,7 @@ cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level)
 */
 bool cw_tq_is_full_internal(const cw_tone_queue_t * tq)
 {
-	/* TODO: shouldn't we lock tq when making the comparison? */
-	return tq->len == tq->capacity;
+	return __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST) == tq->capacity;
 }
 
 
@@ -1018,8 +2092,64 @@ void cw_tq_flush_internal(cw_tone_queue_t * tq)
 */
 bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq)
 {
-	/* TODO: shouldn't we lock tq when making the comparison? */
-	return CW_TQ_NONEMPTY == tq->state;
+	return CW_TQ_NONEMPTY == __atomic_load_n(&tq->state, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+   @brief Get count of characters in tone queue
+
+   Only characters with first tone still in queue are counted: a
+   character that is being played at the moment is not counted.
+   Tones enqueued without being marked as first tones of characters
+   (e.g. tones of iambic keyer) are not counted either.
+
+   @param[in] tq tone queue
+
+   @return count of characters in queue
+*/
+size_t cw_tq_n_characters_internal(const cw_tone_queue_t * tq)
+{
+	return __atomic_load_n(&tq->n_chars, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+   @brief Get sum of durations of tones in tone queue
+
+   Duration of tone that is being played at the moment is not
+   included, unless it is a "forever" tone.
+
+   @param[in] tq tone queue
+
+   @return duration of tones in queue, in microseconds
+*/
+uint64_t cw_tq_duration_internal(const cw_tone_queue_t * tq)
+{
+	return __atomic_load_n(&tq->duration, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+   @brief Get largest count of tones that has been in tone queue
+
+   Tones in priority lane are counted too.
+
+   @param[in] tq tone queue
+
+   @return largest count of tones in queue since the queue has been created
+*/
+size_t cw_tq_length_peak_internal(cw_tone_queue_t * tq)
+{
+	const size_t len = cw_tq_length_internal(tq);
+	const size_t peak = __atomic_load_n(&tq->len_peak, __ATOMIC_RELAXED);
+	return len > peak ? len : peak;
 }
 
 
@@ -1033,6 +2163,9 @@ bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq)
    The function removes character's tones only if all the tones, including
    the first tone in the character, are still in tone queue.
 
+   The tones are found with index of characters, so the time of removal
+   doesn't depend on length of queue.
+
    TODO: write tests for this function
 
    @internal
@@ -1040,40 +2173,477 @@ bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq)
    @endinternal
 
    @param[in] tq tone queue from which to remove tones
+   @param[out] n_marks count of removed tones with cw_tone_t::is_mark set (may be NULL)
 
    @return CW_SUCCESS if a character has been removed successfully
    @return CW_FAILURE otherwise
 */
-cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq)
+cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq, size_t * n_marks)
 {
 	cw_ret_t cwret = CW_FAILURE;
+	size_t n_removed_marks = 0;
+
+	cw_tq_lock_producers_internal(tq);
+
+	size_t len = 0;
+	size_t n_removed = 0;
+
+	if (tq->chars_index.head != tq->chars_index.tail) {
+		/* Last character and all tones enqueued after it. */
+		const size_t first_seq = tq->chars_index.seqs[(tq->chars_index.tail - 1) & tq->chars_index.mask];
+		n_removed = tq->tail_seq - first_seq;
+
+		/* Consumer may dequeue some tones in the meantime,
+		   perhaps including first tone of the character. Then
+		   'len' is updated with current count and we check
+		   again. */
+		len = __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST);
+		while (n_removed <= len) {
+			if (__atomic_compare_exchange_n(&tq->len, &len, len - n_removed, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+				cwret = CW_SUCCESS;
+				break;
+			}
+		}
 
-	pthread_mutex_lock(&tq->wait_mutex);
+		if (CW_SUCCESS == cwret) {
+			tq->chars_index.tail--;
+			__atomic_sub_fetch(&tq->n_chars, 1, __ATOMIC_SEQ_CST);
+
+			/* Removed tones are out of consumer's reach now. */
+			uint64_t duration = 0;
+			for (size_t i = 1; i <= n_removed; i++) {
+				const cw_tone_desc_t * desc = &tq->queue[(tq->tail - i) & tq->slots_mask];
+				duration += (uint64_t) desc->duration;
+				n_removed_marks += desc->is_mark;
+			}
+			__atomic_sub_fetch(&tq->duration, duration, __ATOMIC_SEQ_CST);
+		} else {
+			/* First tone of last character has been
+			   dequeued, and so have been first tones of all
+			   characters before it. */
+			tq->chars_index.head = tq->chars_index.tail;
+		}
+	}
 
-	size_t len = tq->len;
-	size_t idx = tq->tail;
-	bool is_found = false;
+	if (CW_SUCCESS == cwret) {
+		cw_tq_wait_for_consumer_internal(tq);
+		tq->tail = (tq->tail - n_removed) & tq->slots_mask;
+		tq->tail_seq -= n_removed;
+		if (len == n_removed) {
+			__atomic_store_n(&tq->state, CW_TQ_JUST_EMPTIED, __ATOMIC_SEQ_CST);
+		}
+	}
 
-	while (len > 0) {
-		--len;
-		idx = cw_tq_prev_index_internal(tq, idx);
-		if (tq->queue[idx].is_first) {
-			is_found = true;
-			break;
+	cw_tq_unlock_producers_internal(tq);
+
+	if (CW_SUCCESS == cwret) {
+		cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_LEVEL));
+	}
+	if (NULL != n_marks) {
+		*n_marks = n_removed_marks;
+	}
+
+	return cwret;
+}
+
+
+
+
+/**
+   @brief Attempt to remove last tones from tone queue
+
+   Remove @p n_tones tones enqueued last, if all of them are still in
+   tone queue and none of them belongs to a character (see
+   cw_tq_remove_last_character_internal()). Used by iambic keyer to
+   cancel element that has been enqueued in advance.
+
+   @param[in] tq tone queue from which to remove tones
+   @param[in] n_tones count of tones to remove
+
+   @return CW_SUCCESS if the tones have been removed
+   @return CW_FAILURE otherwise
+*/
+cw_ret_t cw_tq_remove_last_tones_internal(cw_tone_queue_t * tq, size_t n_tones)
+{
+	cw_ret_t cwret = CW_FAILURE;
+
+	cw_tq_lock_producers_internal(tq);
+
+	size_t len = 0;
+	const bool is_character = tq->chars_index.head != tq->chars_index.tail
+		&& tq->chars_index.seqs[(tq->chars_index.tail - 1) & tq->chars_index.mask] + n_tones > tq->tail_seq;
+
+	if (n_tones > 0 && !is_character) {
+		/* Consumer may dequeue some of the tones in the
+		   meantime, see cw_tq_remove_last_character_internal(). */
+		len = __atomic_load_n(&tq->len, __ATOMIC_SEQ_CST);
+		while (n_tones <= len) {
+			if (__atomic_compare_exchange_n(&tq->len, &len, len - n_tones, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+				cwret = CW_SUCCESS;
+				break;
+			}
 		}
 	}
 
-	if (is_found) {
-		tq->len = len;
-		tq->tail = idx;
-		cwret = CW_SUCCESS;
+	if (CW_SUCCESS == cwret) {
+		uint64_t duration = 0;
+		for (size_t i = 1; i <= n_tones; i++) {
+			duration += (uint64_t) tq->queue[(tq->tail - i) & tq->slots_mask].duration;
+		}
+		__atomic_sub_fetch(&tq->duration, duration, __ATOMIC_SEQ_CST);
 
-		if (0 == tq->len) {
-			tq->state = CW_TQ_JUST_EMPTIED;
+		cw_tq_wait_for_consumer_internal(tq);
+		tq->tail = (tq->tail - n_tones) & tq->slots_mask;
+		tq->tail_seq -= n_tones;
+		if (len == n_tones) {
+			__atomic_store_n(&tq->state, CW_TQ_JUST_EMPTIED, __ATOMIC_SEQ_CST);
 		}
 	}
 
-	pthread_mutex_unlock(&tq->wait_mutex);
+	cw_tq_unlock_producers_internal(tq);
+
+	if (CW_SUCCESS == cwret) {
+		cw_tq_broadcast_internal(tq, CW_TQ_WAIT_BIT(CW_TQ_WAIT_LEVEL));
+	}
 
 	return cwret;
 }
+
+
+
+
+/**
+   @brief Get current state of tone queue
+
+   @param[in] tq tone queue
+
+   @return state of tone queue
+*/
+cw_queue_state_t cw_tq_get_state_internal(const cw_tone_queue_t * tq)
+{
+	return __atomic_load_n(&tq->state, __ATOMIC_SEQ_CST);
+}
+
+
+
+
+/**
+   @brief Lock tq->wait_mutex, accounting for contention of the mutex
+
+   Uncontended lock costs one extra atomic operation. Only when the
+   mutex is held by another thread, time of waiting for the mutex is
+   measured and added to tq->wait_contended_ns.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_lock_wait_mutex_internal(cw_tone_queue_t * tq)
+{
+	if (0 == pthread_mutex_trylock(&tq->wait_mutex)) {
+		return;
+	}
+
+	struct timespec before;
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	pthread_mutex_lock(&tq->wait_mutex);
+	struct timespec after;
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	const int64_t ns = (int64_t) (after.tv_sec - before.tv_sec) * 1000000000 + (after.tv_nsec - before.tv_nsec);
+	__atomic_add_fetch(&tq->wait_n_contended, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&tq->wait_contended_ns, (uint64_t) ns, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get contention of tone queue's mutex used by waiting functions
+
+   Counters are cumulative since the queue has been created. Threads
+   re-acquiring the mutex on return from pthread_cond_wait() are not
+   counted.
+
+   @param[in] tq tone queue
+   @param[out] n_contended count of locks of the mutex that had to wait for another thread
+   @param[out] contended_ns total time of waiting for the mutex [nanoseconds]
+*/
+void cw_tq_get_wait_contention_internal(const cw_tone_queue_t * tq, uint64_t * n_contended, uint64_t * contended_ns)
+{
+	*n_contended = __atomic_load_n(&tq->wait_n_contended, __ATOMIC_RELAXED);
+	*contended_ns = __atomic_load_n(&tq->wait_contended_ns, __ATOMIC_RELAXED);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Lock tone queue's mutex before waiting for an event in the queue
+
+   Use this function instead of locking tq->wait_mutex directly, so that
+   the queue knows that it has to notify waiters about the event (see
+   cw_tq_broadcast_internal()). The waiting code should look like this:
+
+   cw_tq_wait_lock_internal(tq, reason);
+   while (<condition>) {
+       cw_tq_wait_internal(tq, reason);
+   }
+   cw_tq_wait_unlock_internal(tq, reason);
+
+   @param[in] tq tone queue
+   @param[in] reason reason of waiting, telling which events should wake up the waiter
+*/
+void cw_tq_wait_lock_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason)
+{
+	cw_tq_lock_wait_mutex_internal(tq);
+	__atomic_add_fetch(&tq->n_waiters[reason], 1, __ATOMIC_SEQ_CST);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Block until tone queue notifies about event related to given reason
+
+   Call the function only between cw_tq_wait_lock_internal() and
+   cw_tq_wait_unlock_internal() called with the same @p reason. Spurious
+   wakeups are possible, so the function should be called in a loop.
+
+   @param[in] tq tone queue
+   @param[in] reason reason of waiting
+*/
+void cw_tq_wait_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason)
+{
+	pthread_cond_wait(&tq->wait_vars[reason], &tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Block until tone queue notifies about event related to given reason, or until deadline
+
+   Timed variant of cw_tq_wait_internal(), with the same rules of
+   use.
+
+   @param[in] tq tone queue
+   @param[in] reason reason of waiting
+   @param[in] deadline time on CLOCK_MONOTONIC timeline at which to stop waiting
+
+   @return CW_SUCCESS if the function has returned before deadline
+   @return CW_FAILURE if the deadline has passed
+*/
+cw_ret_t cw_tq_timed_wait_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason, const struct timespec * deadline)
+{
+	const int rv = pthread_cond_timedwait(&tq->wait_vars[reason], &tq->wait_mutex, deadline);
+
+	return ETIMEDOUT == rv ? CW_FAILURE : CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Unlock tone queue's mutex after waiting for an event in the queue
+
+   Counterpart of cw_tq_wait_lock_internal().
+
+   @param[in] tq tone queue
+   @param[in] reason reason of waiting, the same as passed to cw_tq_wait_lock_internal()
+*/
+void cw_tq_wait_unlock_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason)
+{
+	__atomic_sub_fetch(&tq->n_waiters[reason], 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Notify waiters about event in tone queue
+
+   Broadcast condition variables of reasons given in @p reasons (a mask
+   made of CW_TQ_WAIT_BIT() values), but only those for which there is
+   anyone waiting. If nobody is waiting for any of the reasons, the
+   function doesn't lock tq->wait_mutex.
+
+   If event descriptor has been created, make it readable. Change of
+   keyer's state alone is not an event in the queue and doesn't touch
+   the descriptor.
+
+   Call the function after the event (e.g. change of queue's length)
+   has been made visible to other threads.
+
+   @param[in] tq tone queue
+   @param[in] reasons mask of reasons of waiting that are affected by the event
+*/
+void cw_tq_broadcast_internal(cw_tone_queue_t * tq, unsigned int reasons)
+{
+	const int event_fd = __atomic_load_n(&tq->event_fds[1], __ATOMIC_ACQUIRE);
+	if (-1 != event_fd
+	    && (reasons & ~CW_TQ_WAIT_BIT(CW_TQ_WAIT_KEYER))
+	    && !__atomic_exchange_n(&tq->event_pending, true, __ATOMIC_SEQ_CST)) {
+		/* Descriptor is non-blocking. If it is already full, it
+		   is readable anyway, so result of write is ignored. */
+#if defined(HAVE_SYS_EVENTFD_H)
+		const uint64_t value = 1;
+#else
+		const char value = 1;
+#endif
+		const ssize_t rv = write(event_fd, &value, sizeof (value));
+		(void) rv;
+	}
+
+	/* Pairs with atomic increment of n_waiters done by waiter before
+	   it checks its waiting condition: either we see the waiter, or
+	   the waiter sees the event. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	unsigned int waited = 0;
+	for (int i = 0; i < CW_TQ_WAIT_N_REASONS; i++) {
+		if ((reasons & CW_TQ_WAIT_BIT(i))
+		    && 0 != __atomic_load_n(&tq->n_waiters[i], __ATOMIC_RELAXED)) {
+			waited |= CW_TQ_WAIT_BIT(i);
+		}
+	}
+	if (0 == waited) {
+		return;
+	}
+
+	cw_tq_lock_wait_mutex_internal(tq);
+	for (int i = 0; i < CW_TQ_WAIT_N_REASONS; i++) {
+		if (waited & CW_TQ_WAIT_BIT(i)) {
+			pthread_cond_broadcast(&tq->wait_vars[i]);
+		}
+	}
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Wake up all threads waiting for any event in tone queue
+
+   Unlike cw_tq_broadcast_internal(), the function broadcasts all
+   condition variables unconditionally. Use it when conditions of
+   waiters not related to queue itself have changed, e.g. when
+   generator is being stopped.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_wake_all_internal(cw_tone_queue_t * tq)
+{
+	cw_tq_lock_wait_mutex_internal(tq);
+	for (int i = 0; i < CW_TQ_WAIT_N_REASONS; i++) {
+		pthread_cond_broadcast(&tq->wait_vars[i]);
+	}
+	pthread_mutex_unlock(&tq->wait_mutex);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get file descriptor notifying about events in tone queue
+
+   The descriptor becomes readable after an event occurs in @p tq: a tone
+   is enqueued or dequeued (which is also the end of previous tone), or
+   tones are removed from queue. The descriptor can be watched with
+   select(), poll() or epoll instead of blocking a thread in
+   cw_tq_wait_for_level_internal() or
+   cw_tq_wait_for_end_of_current_tone_internal().
+
+   After the descriptor has become readable, call
+   cw_tq_clear_event_internal() and then check the state of queue.
+
+   The descriptor is created on first call, and is owned by @p tq.
+
+   @exception EMFILE, ENFILE, ENOMEM failed to create the descriptor
+
+   @param[in] tq tone queue
+
+   @return file descriptor on success
+   @return -1 on failure
+*/
+int cw_tq_get_event_fd_internal(cw_tone_queue_t * tq)
+{
+	pthread_mutex_lock(&tq->enqueue_mutex);
+
+	if (-1 == tq->event_fds[0]) {
+		int fds[2] = { -1, -1 };
+#if defined(HAVE_SYS_EVENTFD_H)
+		fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		fds[1] = fds[0];
+#else
+		if (0 == pipe(fds)) {
+			for (int i = 0; i < 2; i++) {
+				fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+				fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+			}
+		}
+#endif
+		if (-1 == fds[0]) {
+			cw_debug_msg (&cw_debug_object, CW_DEBUG_TONE_QUEUE, CW_DEBUG_ERROR,
+				      MSG_PREFIX "get event fd: failed to create descriptor");
+			pthread_mutex_unlock(&tq->enqueue_mutex);
+			return -1;
+		}
+
+		tq->event_fds[0] = fds[0];
+		/* Producers and consumer look at write end only. */
+		__atomic_store_n(&tq->event_fds[1], fds[1], __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&tq->enqueue_mutex);
+
+	return tq->event_fds[0];
+}
+
+
+
+
+/**
+   @brief Make event descriptor of tone queue non-readable
+
+   Clear events signalled through descriptor returned by
+   cw_tq_get_event_fd_internal(). Events that occur after (or during)
+   the call will make the descriptor readable again.
+
+   @param[in] tq tone queue
+*/
+void cw_tq_clear_event_internal(cw_tone_queue_t * tq)
+{
+	const int event_fd = tq->event_fds[0];
+	if (-1 == event_fd) {
+		return;
+	}
+
+	/* Clear the flag first: event written after this point makes
+	   the descriptor readable again. */
+	__atomic_store_n(&tq->event_pending, false, __ATOMIC_SEQ_CST);
+
+#if defined(HAVE_SYS_EVENTFD_H)
+	uint64_t value = 0;
+#else
+	char value[16];
+#endif
+	while (read(event_fd, &value, sizeof (value)) > 0) {
+		;
+	}
+
+	return;
+}
@@ -17,11 +17,13 @@
 #include <pthread.h>    /* pthread_mutex_t */
 #include <stdbool.h>    /* bool */
 #include <stdint.h>     /* uint32_t */
+#include <time.h>       /* struct timespec */
 
 
 
 
 #include "libcw2.h"
+#include "libcw_utils.h"
 
 
 
@@ -45,9 +47,9 @@ extern "C"
    queue capacity. See if we really handle the capacity correctly. */
 
 enum {
-	/* Default and maximum values of two basic parameters of tone
-	   queue: capacity and high water mark. The parameters can be
-	   modified using suitable function. */
+	/* Default values of two basic parameters of tone queue: capacity
+	   and high water mark. The parameters can be modified using
+	   suitable function, up to CW_TONE_QUEUE_CAPACITY_LIMIT. */
 
 	/* Tone queue will accept at most "capacity" tones. */
 	CW_TONE_QUEUE_CAPACITY_MAX = 3000,        /* ~= 5 minutes at 12 WPM */
@@ -55,7 +57,22 @@ enum {
 	/* Tone queue will refuse to accept new tones (TODO: tones or
 	   characters?) if number of tones in queue (queue length) is already
 	   equal or larger than queue's high water mark. */
-	CW_TONE_QUEUE_HIGH_WATER_MARK_MAX = 2900
+	CW_TONE_QUEUE_HIGH_WATER_MARK_MAX = 2900,
+
+	/* Largest capacity that can be set for tone queue. Tones are kept
+	   in a ring that grows on demand, so a queue with large capacity
+	   doesn't take much memory until it is actually filled. */
+	CW_TONE_QUEUE_CAPACITY_LIMIT = 1 << 20,   /* ~= 28 hours at 12 WPM */
+
+	/* Count of slots in ring of newly created tone queue. The ring is
+	   doubled each time it runs out of free slots, until it can hold
+	   "capacity" tones. Must be a power of two. */
+	CW_TONE_QUEUE_INITIAL_N_SLOTS = 256,
+
+	/* Count of tones that can be held in priority lane of tone queue
+	   (see cw_tq_enqueue_priority_internal()). Must be a power of
+	   two. */
+	CW_TONE_QUEUE_PRIORITY_CAPACITY = 512
 };
 
 
@@ -98,6 +115,34 @@ typedef enum {
 
 
 
+/*
+  Reasons for which a thread may block in a wait for an event in tone
+  queue. Each reason has its own condition variable, so that an event
+  wakes up only threads that are interested in it.
+*/
+typedef enum {
+	/* Generator's thread waiting for a tone to be enqueued. */
+	CW_TQ_WAIT_NONEMPTY = 0,
+
+	/* Waiting for length of queue to drop to given level. */
+	CW_TQ_WAIT_LEVEL,
+
+	/* Waiting for end of tone that is currently being played. */
+	CW_TQ_WAIT_TONE_END,
+
+	/* Waiting for change of graph state of iambic keyer driven by
+	   generator of the queue. */
+	CW_TQ_WAIT_KEYER,
+
+	CW_TQ_WAIT_N_REASONS
+} cw_tq_wait_reason_t;
+
+#define CW_TQ_WAIT_BIT(reason) (1U << (reason))
+#define CW_TQ_WAIT_ALL ((1U << CW_TQ_WAIT_N_REASONS) - 1)
+
+
+
+
 /* If there are any slopes in a tone, there can be only rising slope (without
    falling slope), falling slope (without rising slope), or both slopes
    (i.e. standard slopes).  These values don't tell anything about shape of
@@ -135,6 +180,26 @@ typedef struct {
 	   character (all tones constituting a character) from the queue. */
 	bool is_first;
 
+	/* Is this silence that lasts until scheduled start of next tone?
+	   Duration of such tone is calculated when the tone is dequeued,
+	   see cw_gen_enqueue_at(). */
+	bool is_scheduled;
+
+	/* Is this a character of generator's memory, played from
+	   pre-rendered samples? See cw_gen_enqueue_memory(). Frequency
+	   and count of samples of such tone are taken from the samples
+	   when the tone is dequeued. */
+	bool is_clip;
+
+	/* Handle of pre-rendered samples of the character, if ::is_clip
+	   is set. */
+	int clip;
+
+	/* Is this the last tone of a string enqueued with
+	   cw_gen_enqueue_string_with_token()? Generator completes the
+	   string's token after playing the tone. */
+	bool is_mark;
+
 	/* Type/mode of slope(s) in a tone. */
 	cw_tone_slope_mode_t slope_mode;
 
@@ -208,6 +273,10 @@ typedef struct {
 		(m_tone)->slope_mode              = m_slope_mode;	\
 		(m_tone)->is_forever              = false;		\
 		(m_tone)->is_first                = false;		\
+		(m_tone)->is_scheduled            = false;		\
+		(m_tone)->is_clip                 = false;		\
+		(m_tone)->clip                    = 0;			\
+		(m_tone)->is_mark                 = false;		\
 		(m_tone)->n_samples               = 0;			\
 		(m_tone)->sample_iterator         = 0;			\
 		(m_tone)->rising_slope_n_samples  = 0;			\
@@ -225,6 +294,10 @@ typedef struct {
 		(m_dest)->slope_mode              = (m_source)->slope_mode; \
 		(m_dest)->is_forever              = (m_source)->is_forever; \
 		(m_dest)->is_first                = (m_source)->is_first; \
+		(m_dest)->is_scheduled            = (m_source)->is_scheduled; \
+		(m_dest)->is_clip                 = (m_source)->is_clip; \
+		(m_dest)->clip                    = (m_source)->clip;	\
+		(m_dest)->is_mark                 = (m_source)->is_mark; \
 		(m_dest)->n_samples               = (m_source)->n_samples; \
 		(m_dest)->sample_iterator         = (m_source)->sample_iterator;	\
 		(m_dest)->rising_slope_n_samples  = (m_source)->rising_slope_n_samples; \
@@ -235,29 +308,77 @@ typedef struct {
 
 
 
+/* Tone as it is stored in tone queue.
 
-struct cw_gen_struct;
-
+   Only properties of a tone that are known when the tone is enqueued
+   are stored. Fields of cw_tone_t that are derived from duration
+   (count of samples, count of samples in slopes, samples iterator)
+   are calculated by generator after the tone is dequeued. Keeping
+   the descriptor small (8 bytes) lets much more tones fit in a cache
+   line than full cw_tone_t would. */
 typedef struct {
-	volatile cw_tone_t queue[CW_TONE_QUEUE_CAPACITY_MAX];
+	/* Duration of a tone, in microseconds. */
+	int duration;
+
+	/* Frequency of a tone, in Hz. Enqueued tones are validated
+	   against CW_FREQUENCY_MAX, so the value fits in 16 bits. For
+	   tones with ::is_clip set this is handle of pre-rendered samples
+	   (cw_tone_t::clip). */
+	uint16_t frequency;
+
+	char debug_id;
+
+	/* Value of cw_tone_slope_mode_t. */
+	unsigned int slope_mode : 2;
+	bool is_forever : 1;
+	bool is_first : 1;
+	bool is_scheduled : 1;
+	bool is_clip : 1;
+	bool is_mark : 1;
+} cw_tone_desc_t;
 
-	/* Tail index of tone queue. Index of last (newest) inserted
-	   tone, index of tone to be dequeued from the list as a last
-	   one.
 
-	   The index is incremented *after* adding a tone to queue. */
-	volatile size_t tail;
 
-	/* Head index of tone queue. Index of first (oldest) tone
-	   inserted to the queue. Index of the tone to be dequeued
-	   from the queue as a first one. */
-	volatile size_t head;
 
-	cw_queue_state_t state;
 
+struct cw_gen_struct;
+
+typedef struct {
+	/* Fields are grouped by threads writing them. Each group starts
+	   at a new cache line (see CW_CACHE_LINE_ALIGNED), so that
+	   producers enqueueing tones don't invalidate cache lines used by
+	   consumer dequeueing tones, and vice versa. Keep new fields in a
+	   proper group. */
+
+	/* Read-mostly: configuration, and ::queue re-allocated only when it grows. */
+
+	/* Circular list of tones. The list is shared without a lock between
+	   producers (code enqueueing tones) and a single consumer (generator
+	   dequeueing tones). See "Concurrency" in libcw_tq.c for details.
+
+	   The list is allocated on heap, has ::n_slots slots, and is
+	   re-allocated by producers when it runs out of free slots. */
+	cw_tone_desc_t * queue;
+
+	/* Count of slots in ::queue. Always a power of two, so that
+	   indexes can be wrapped with ::slots_mask. The ring grows at
+	   most to the smallest power of two that can hold ::capacity
+	   tones. */
+	size_t n_slots;
+	size_t slots_mask;
+
+	/* Set by producer that re-allocates ::queue. Consumer doesn't
+	   touch ::queue while this flag is set. Accessed with atomic
+	   operations. */
+	bool resizing;
+
+	/* Maximal count of tones in queue. */
 	size_t capacity;
 	size_t high_water_mark;
-	size_t len;
+
+	/* Table of tones and index of characters are allocated for
+	   whole ::capacity, see cw_tq_preallocate_internal(). */
+	bool preallocated;
 
 	/* It's useful to have the tone queue dequeue function call
 	   a client-supplied callback routine when the amount of data
@@ -267,16 +388,192 @@ typedef struct {
 	void     (* low_water_callback)(void *);
 	void     * low_water_callback_arg;
 
-
-	/* Inter-thread communication. Used to broadcast queue events to
-	   waiting functions. */
-	pthread_cond_t wait_var;
-	pthread_mutex_t wait_mutex;
+	/* Similar to low water mark above, but expressed as duration of
+	   tones in queue (see ::duration), in microseconds. Independent
+	   of the tones-count low water mark. */
+	uint64_t low_water_duration;
+	void     (* low_water_duration_callback)(void *);
+	void     * low_water_duration_callback_arg;
 
 	/* Generator associated with a tone queue. */
 	struct cw_gen_struct * gen;
 
 	char label[LIBCW_OBJECT_INSTANCE_LABEL_SIZE];
+
+	/* Written by producers. */
+
+	/* Tail index of tone queue. Index of last (newest) inserted
+	   tone, index of tone to be dequeued from the list as a last
+	   one.
+
+	   The index is incremented *after* adding a tone to queue.
+
+	   Modified only by producers, with ::enqueue_mutex locked, or by
+	   producer committing its tones in multi-producer mode. */
+	size_t tail CW_CACHE_LINE_ALIGNED;
+
+	/* Position of tail in stream of all tones that went through the
+	   queue: count of tones enqueued minus count of tones removed
+	   by producers (flushed queue, removed character). Unlike
+	   ::tail, the value is not wrapped.
+
+	   Modified only by producers, with ::enqueue_mutex locked, or
+	   with atomic store by producer committing its tones in
+	   multi-producer mode (see ::mp). */
+	size_t tail_seq;
+
+	/* Index of characters in queue, used to find tones of last
+	   character without searching the queue.
+
+	   ::seqs is a ring of positions (see ::tail_seq) of first tones
+	   of characters, in order of enqueueing. Entries from ::head to
+	   ::tail (not wrapped, wrap with ::mask) may describe characters
+	   still present in queue. Entries of characters that have been
+	   dequeued in the meantime are dropped lazily.
+
+	   Used only by producers, with ::enqueue_mutex locked, or by
+	   producer committing its tones in multi-producer mode. */
+	struct {
+		size_t * seqs;
+		size_t n_slots;
+		size_t mask;
+		size_t head;
+		size_t tail;
+	} chars_index;
+
+	/* Serializes producers. Consumer never locks this mutex, so
+	   enqueueing never waits for generator and vice versa. */
+	pthread_mutex_t enqueue_mutex;
+
+	/* Multi-producer mode (see cw_tq_set_multi_producer_internal()).
+
+	   Producers of batches of tones don't lock ::enqueue_mutex.
+	   Producer reserves a contiguous range of positions in stream of
+	   tones by advancing ::reserve_seq with compare-and-swap, writes
+	   its tones into the range, and then commits them in order of
+	   reservation: it waits until ::tail_seq reaches beginning of its
+	   range, updates queue's bookkeeping and moves ::tail_seq past the
+	   range.
+
+	   ::n_active is count of producers between reservation and
+	   commit. Code that locks ::enqueue_mutex (resizing queue,
+	   removing tones, enqueueing in a regular way) sets ::blocked and
+	   waits until ::n_active drops to zero, so that it sees the queue
+	   in a state without reservations. ::seq_to_index converts
+	   position in stream to index in ::queue, it is updated when the
+	   mutex is unlocked.
+
+	   ::enabled is modified with ::enqueue_mutex locked. All fields
+	   are accessed with atomic operations, except for ::seq_to_index
+	   that changes only while ::blocked is set. */
+	struct {
+		bool enabled;
+		bool blocked;
+		unsigned int n_active;
+		size_t reserve_seq;
+		size_t seq_to_index;
+	} mp;
+
+	/* Written by consumer. */
+
+	/* Head index of tone queue. Index of first (oldest) tone
+	   inserted to the queue. Index of the tone to be dequeued
+	   from the queue as a first one.
+
+	   Modified only by consumer, with atomic store. */
+	size_t head CW_CACHE_LINE_ALIGNED;
+
+	/* Incremented by consumer at the beginning and at the end of
+	   dequeueing, so it is odd while consumer may be reading
+	   ::queue. Producers removing tones from queue use it to wait
+	   until consumer's view of queue is up to date. */
+	unsigned int dequeue_seq;
+
+	/* Largest count of tones (including tones in priority lane)
+	   seen by consumer at the beginning of dequeueing. Written only
+	   by consumer, read with cw_tq_length_peak_internal(). Accessed
+	   with atomic operations. */
+	size_t len_peak;
+
+	/* Written by producers and by consumer. */
+
+	/* Accessed with atomic operations. */
+	cw_queue_state_t state CW_CACHE_LINE_ALIGNED;
+
+	/* Count of tones in queue. Accessed with atomic operations.
+	   Consumer takes a tone from queue by decrementing the value
+	   with compare-and-swap. */
+	size_t len;
+
+	/* Sum of durations of tones in queue, in microseconds. Updated
+	   together with ::len: incremented by producers before tones
+	   become visible to consumer, decremented by consumer after a
+	   tone is dequeued. "forever" tone is counted once, as long as
+	   it stays in queue. Accessed with atomic operations. */
+	uint64_t duration;
+
+	/* Count of characters with first tone still in queue.
+	   Incremented by producers before a first tone of character
+	   becomes visible to consumer, decremented by consumer after
+	   the tone is dequeued, so it never drops below zero. Accessed
+	   with atomic operations. */
+	size_t n_chars;
+
+	/* Priority lane. Tones in the lane are dequeued before tones in
+	   ring of tones, but only at a boundary of characters in the
+	   ring: when the tone at head of the ring is the first tone of a
+	   character, or when the ring is empty. Once consumer starts
+	   dequeueing from the lane, it continues until the lane is empty,
+	   so that tones of priority characters are not interleaved with
+	   tones from the ring.
+
+	   Tones in the lane are counted by cw_tq_length_internal(), but
+	   not by ::len, ::duration and ::n_chars, so high water mark and
+	   low water callbacks apply only to the ring. Producers are
+	   serialized by ::mutex. Consumer takes the mutex only when ::len
+	   (accessed with atomic operations) is non-zero. ::draining is
+	   used only by consumer. */
+	struct {
+		cw_tone_desc_t queue[CW_TONE_QUEUE_PRIORITY_CAPACITY];
+		size_t head;
+		size_t tail;
+		size_t len;
+		bool draining;
+		pthread_mutex_t mutex;
+	} CW_CACHE_LINE_ALIGNED priority;
+
+	/* Waiting for events. */
+
+	/* Inter-thread communication. Used to broadcast queue events to
+	   waiting functions. Only blocking waits use the mutex. There is
+	   one condition variable and one count of waiters per
+	   cw_tq_wait_reason_t, all protected by the same mutex. Waiting
+	   functions must use cw_tq_wait_lock_internal() and
+	   cw_tq_wait_unlock_internal() so that ::n_waiters is up to date,
+	   otherwise they may miss events. */
+	pthread_cond_t wait_vars[CW_TQ_WAIT_N_REASONS] CW_CACHE_LINE_ALIGNED;
+	pthread_mutex_t wait_mutex;
+	size_t n_waiters[CW_TQ_WAIT_N_REASONS];
+
+	/* Contention of ::wait_mutex: count of locks of the mutex that
+	   had to wait for another thread, and total time of the waits
+	   [nanoseconds]. Both fields are accessed with atomic operations,
+	   see cw_tq_get_wait_contention_internal(). */
+	uint64_t wait_n_contended;
+	uint64_t wait_contended_ns;
+
+	/* Pollable notification of the same events, for clients that
+	   can't block a thread in a wait function. Created on demand by
+	   cw_tq_get_event_fd_internal(), -1 until then. With eventfd
+	   both descriptors are the same, with pipe [0] is read end and
+	   [1] is write end.
+
+	   ::event_pending is set when an event has been written to
+	   descriptor and not yet cleared with cw_tq_clear_event_internal(),
+	   so that a burst of events results in a single write. Both
+	   fields are accessed with atomic operations. */
+	int event_fds[2];
+	bool event_pending;
 } cw_tone_queue_t;
 
 
@@ -285,19 +582,41 @@ cw_tone_queue_t * cw_tq_new_internal(void);
 void              cw_tq_delete_internal(cw_tone_queue_t ** tq);
 void              cw_tq_flush_internal(cw_tone_queue_t * tq);
 
+cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size_t high_water_mark);
 size_t cw_tq_capacity_internal(const cw_tone_queue_t * tq);
+cw_ret_t cw_tq_preallocate_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_set_multi_producer_internal(cw_tone_queue_t * tq, bool enabled);
 size_t cw_tq_length_internal(cw_tone_queue_t * tq);
+size_t cw_tq_n_characters_internal(const cw_tone_queue_t * tq);
+size_t cw_tq_length_peak_internal(cw_tone_queue_t * tq);
+uint64_t cw_tq_duration_internal(const cw_tone_queue_t * tq);
 cw_ret_t cw_tq_enqueue_internal(cw_tone_queue_t * tq, const cw_tone_t * tone);
+cw_ret_t cw_tq_enqueue_batch_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones);
+cw_ret_t cw_tq_enqueue_priority_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones);
 cw_queue_state_t cw_tq_dequeue_internal(cw_tone_queue_t * tq, cw_tone_t * tone);
+bool cw_tq_retire_forever_tone_internal(cw_tone_queue_t * tq);
 
 cw_ret_t cw_tq_wait_for_level_internal(cw_tone_queue_t * tq, size_t level);
 cw_ret_t cw_tq_register_low_level_callback_internal(cw_tone_queue_t * tq, cw_queue_low_callback_t callback_func, void * callback_arg, size_t level);
+cw_ret_t cw_tq_register_low_duration_callback_internal(cw_tone_queue_t * tq, cw_queue_low_callback_t callback_func, void * callback_arg, uint64_t duration);
 bool cw_tq_is_nonempty_internal(const cw_tone_queue_t * tq);
 cw_ret_t cw_tq_wait_for_end_of_current_tone_internal(cw_tone_queue_t * tq);
 void cw_tq_reset_internal(cw_tone_queue_t * tq);
 bool cw_tq_is_full_internal(const cw_tone_queue_t * tq);
 
-cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq);
+cw_ret_t cw_tq_remove_last_character_internal(cw_tone_queue_t * tq, size_t * n_marks);
+cw_ret_t cw_tq_remove_last_tones_internal(cw_tone_queue_t * tq, size_t n_tones);
+
+cw_queue_state_t cw_tq_get_state_internal(const cw_tone_queue_t * tq);
+void cw_tq_wait_lock_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason);
+void cw_tq_wait_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason);
+cw_ret_t cw_tq_timed_wait_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason, const struct timespec * deadline);
+void cw_tq_wait_unlock_internal(cw_tone_queue_t * tq, cw_tq_wait_reason_t reason);
+void cw_tq_broadcast_internal(cw_tone_queue_t * tq, unsigned int reasons);
+void cw_tq_wake_all_internal(cw_tone_queue_t * tq);
+int cw_tq_get_event_fd_internal(cw_tone_queue_t * tq);
+void cw_tq_clear_event_internal(cw_tone_queue_t * tq);
+void cw_tq_get_wait_contention_internal(const cw_tone_queue_t * tq, uint64_t * n_contended, uint64_t * contended_ns);
 
 
 
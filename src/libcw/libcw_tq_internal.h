@@ -20,12 +20,21 @@
 
 
 
-CW_STATIC_FUNC cw_ret_t cw_tq_set_capacity_internal(cw_tone_queue_t * tq, size_t capacity, size_t high_water_mark);
 CW_STATIC_FUNC size_t cw_tq_get_high_water_mark_internal(const cw_tone_queue_t * tq) __attribute__((unused));
 CW_STATIC_FUNC size_t cw_tq_prev_index_internal(const cw_tone_queue_t * tq, size_t ind) __attribute__((unused));
 CW_STATIC_FUNC size_t cw_tq_next_index_internal(const cw_tone_queue_t * tq, size_t ind);
-CW_STATIC_FUNC bool   cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone);
+CW_STATIC_FUNC bool   cw_tq_dequeue_sub_internal(cw_tone_queue_t * tq, cw_tone_t * tone, size_t * len_before, size_t * len_after, uint64_t * duration_after);
+CW_STATIC_FUNC bool   cw_tq_dequeue_priority_internal(cw_tone_queue_t * tq, cw_tone_t * tone, size_t * len_after);
 CW_STATIC_FUNC void   cw_tq_make_empty_internal(cw_tone_queue_t * tq);
+CW_STATIC_FUNC void   cw_tq_wait_for_consumer_internal(cw_tone_queue_t * tq);
+CW_STATIC_FUNC void   cw_tq_lock_producers_internal(cw_tone_queue_t * tq);
+CW_STATIC_FUNC void   cw_tq_unlock_producers_internal(cw_tone_queue_t * tq);
+CW_STATIC_FUNC void   cw_tq_lock_wait_mutex_internal(cw_tone_queue_t * tq);
+CW_STATIC_FUNC bool   cw_tq_enqueue_batch_mp_internal(cw_tone_queue_t * tq, const cw_tone_t * tones, size_t n_tones, size_t n_nonempty, size_t n_first, uint64_t duration);
+CW_STATIC_FUNC cw_ret_t cw_tq_reserve_slots_internal(cw_tone_queue_t * tq, size_t n_slots);
+CW_STATIC_FUNC cw_ret_t cw_tq_reserve_chars_index_internal(cw_tone_queue_t * tq, size_t n_chars);
+CW_STATIC_FUNC void   cw_tq_tone_to_desc_internal(cw_tone_desc_t * desc, const cw_tone_t * tone);
+CW_STATIC_FUNC void   cw_tq_desc_to_tone_internal(cw_tone_t * tone, const cw_tone_desc_t * desc);
 
 
 
@@ -0,0 +1,481 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+
+
+/**
+   @file libcw_trace.c
+
+   @brief Low-overhead tracing of events in library.
+
+   Trace probes (CW_TRACE()) are placed in time-critical places of the
+   library: enqueueing and dequeueing of tones, writing of buffers to
+   sound sink, changes of key values and marks of receiver. A probe
+   records an event with a CLOCK_MONOTONIC timestamp in a ring of the
+   calling thread. Each ring has exactly one producer (the thread that
+   owns the ring) and one consumer (dumper thread), so recording an
+   event doesn't need any locks, and doesn't make any system calls
+   other than clock_gettime() (which is usually served by vDSO). When a
+   ring is full, new events are dropped and counted.
+
+   Dumper thread started with cw_trace_start() periodically moves
+   events from all rings to a file descriptor, as lines of text:
+
+   libcwtrace:<TAB>ring<TAB>timestamp [ns]<TAB>event<TAB>value
+
+   Events from one ring are written in order of their recording. Events
+   from different rings are not merged, sort them by timestamp if
+   needed.
+
+   A ring is allocated on first event recorded by a thread. It is
+   released for reuse by other threads when the thread exits.
+
+   Probes are removed at compile time when library is configured with
+   --disable-trace.
+*/
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw.h"
+#include "libcw_debug.h"
+#include "libcw_trace.h"
+
+
+
+
+#define MSG_PREFIX "libcw/trace: "
+
+
+
+
+extern cw_debug_t cw_debug_object;
+
+
+
+
+#if defined(LIBCW_WITH_TRACE)
+
+
+
+
+/* Capacity of ring of single thread. Must be a power of two. */
+enum { CW_TRACE_RING_CAPACITY = 8192 };
+
+/* Interval between runs of dumper [microseconds]. */
+enum { CW_TRACE_DUMP_INTERVAL = 100 * 1000 };
+
+
+
+
+typedef struct {
+	int64_t timestamp; /* [nanoseconds] On CLOCK_MONOTONIC timeline. */
+	uint32_t event;    /* One of cw_trace_event_t values. */
+	int32_t value;
+} cw_trace_record_t;
+
+
+
+
+typedef struct cw_trace_ring_struct {
+	cw_trace_record_t records[CW_TRACE_RING_CAPACITY];
+
+	/* Free-running counters of records. 'head' is written only by
+	   owner of the ring, 'tail' only by dumper. */
+	size_t head;
+	size_t tail;
+
+	/* Count of events dropped because the ring was full. */
+	uint64_t n_dropped;
+	/* Count of dropped events already reported by dumper. */
+	uint64_t n_dropped_reported;
+
+	/* Is the ring used by a thread? */
+	bool owned;
+
+	/* Index of the ring, used as identifier of ring in dump. */
+	int index;
+
+	/* Rings are never freed: the list can be walked without locks. */
+	struct cw_trace_ring_struct * next;
+} cw_trace_ring_t;
+
+
+
+
+static const char * cw_trace_event_labels[CW_TRACE_EVENT_MAX] = {
+	[CW_TRACE_TQ_ENQUEUE]      = "tq_enqueue",
+	[CW_TRACE_TQ_DEQUEUE]      = "tq_dequeue",
+	[CW_TRACE_GEN_WRITE_BEGIN] = "gen_write_begin",
+	[CW_TRACE_GEN_WRITE_END]   = "gen_write_end",
+	[CW_TRACE_KEY_SK]          = "key_sk",
+	[CW_TRACE_KEY_IK]          = "key_ik",
+	[CW_TRACE_REC_MARK_BEGIN]  = "rec_mark_begin",
+	[CW_TRACE_REC_MARK_END]    = "rec_mark_end",
+};
+
+
+
+
+bool cw_trace_is_enabled = false;
+
+/* List of all rings ever allocated. */
+static cw_trace_ring_t * cw_trace_rings = NULL;
+static int cw_trace_n_rings = 0;
+
+/* Ring of calling thread. */
+static __thread cw_trace_ring_t * cw_trace_thread_ring = NULL;
+
+/* Key used only to release ring of exiting thread. */
+static pthread_key_t cw_trace_ring_key;
+static pthread_once_t cw_trace_ring_key_once = PTHREAD_ONCE_INIT;
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool running;
+	pthread_t thread;
+	int fd;
+} cw_trace_dumper = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.running = false,
+	.fd = -1,
+};
+
+
+
+
+static void cw_trace_ring_key_init_internal(void);
+static void cw_trace_ring_release_internal(void * ring);
+static cw_trace_ring_t * cw_trace_ring_acquire_internal(void);
+static void * cw_trace_dumper_thread_fn(void * arg);
+static void cw_trace_dump_internal(int fd);
+
+
+
+
+/**
+   @brief Record an event in ring of calling thread
+
+   Don't call this function directly, use CW_TRACE() probe.
+
+   @internal
+   @reviewed 2026-10-15
+   @endinternal
+
+   @param[in] event event to record
+   @param[in] value value associated with the event
+*/
+void cw_trace_record_internal(cw_trace_event_t event, int32_t value)
+{
+	cw_trace_ring_t * ring = cw_trace_thread_ring;
+	if (NULL == ring) {
+		ring = cw_trace_ring_acquire_internal();
+		if (NULL == ring) {
+			return;
+		}
+	}
+
+	const size_t head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= CW_TRACE_RING_CAPACITY) {
+		__atomic_add_fetch(&ring->n_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	cw_trace_record_t * record = &ring->records[head & (CW_TRACE_RING_CAPACITY - 1)];
+	record->timestamp = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+	record->event = (uint32_t) event;
+	record->value = value;
+
+	/* Record becomes visible to dumper. */
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+/**
+   @brief Start dumper of trace
+
+   Enable trace probes and start a thread that periodically writes
+   recorded events to @p fd. The descriptor is not closed by the
+   library.
+
+   @exception EBUSY dumper is already running
+   @exception ENOSYS library has been configured with --disable-trace
+
+   @reviewed 2026-10-15
+
+   @param[in] fd file descriptor to which to write events
+
+   @return CW_SUCCESS on success
+   @return CW_FAILURE on failure
+*/
+int cw_trace_start(int fd)
+{
+	pthread_mutex_lock(&cw_trace_dumper.mutex);
+	if (cw_trace_dumper.running) {
+		pthread_mutex_unlock(&cw_trace_dumper.mutex);
+		errno = EBUSY;
+		return CW_FAILURE;
+	}
+
+	cw_trace_dumper.fd = fd;
+	cw_trace_dumper.running = true;
+	const int rv = pthread_create(&cw_trace_dumper.thread, NULL, cw_trace_dumper_thread_fn, NULL);
+	if (0 != rv) {
+		cw_trace_dumper.running = false;
+		pthread_mutex_unlock(&cw_trace_dumper.mutex);
+		cw_debug_msg (&cw_debug_object, CW_DEBUG_STDLIB, CW_DEBUG_ERROR,
+			      MSG_PREFIX "failed to create dumper thread: %d", rv);
+		errno = rv;
+		return CW_FAILURE;
+	}
+	__atomic_store_n(&cw_trace_is_enabled, true, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&cw_trace_dumper.mutex);
+
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Stop dumper of trace
+
+   Disable trace probes, stop dumper thread, and write to descriptor
+   all events that are still in rings.
+
+   Function does nothing if dumper is not running.
+
+   @reviewed 2026-10-15
+*/
+void cw_trace_stop(void)
+{
+	pthread_mutex_lock(&cw_trace_dumper.mutex);
+	if (!cw_trace_dumper.running) {
+		pthread_mutex_unlock(&cw_trace_dumper.mutex);
+		return;
+	}
+	__atomic_store_n(&cw_trace_is_enabled, false, __ATOMIC_RELAXED);
+	cw_trace_dumper.running = false;
+	pthread_cond_signal(&cw_trace_dumper.cond);
+	pthread_mutex_unlock(&cw_trace_dumper.mutex);
+
+	pthread_join(cw_trace_dumper.thread, NULL);
+
+	/* Events recorded since last run of dumper. */
+	cw_trace_dump_internal(cw_trace_dumper.fd);
+	cw_trace_dumper.fd = -1;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Create key used to detect exit of thread owning a ring
+*/
+static void cw_trace_ring_key_init_internal(void)
+{
+	pthread_key_create(&cw_trace_ring_key, cw_trace_ring_release_internal);
+}
+
+
+
+
+/**
+   @brief Release ring of exiting thread for reuse by other threads
+
+   @param[in] ring ring owned by the thread
+*/
+static void cw_trace_ring_release_internal(void * ring)
+{
+	__atomic_store_n(&((cw_trace_ring_t *) ring)->owned, false, __ATOMIC_RELEASE);
+}
+
+
+
+
+/**
+   @brief Get a ring for calling thread
+
+   Reuse a ring released by a thread that has exited, or allocate a
+   new one.
+
+   @return ring on success
+   @return NULL on failure to allocate a ring
+*/
+static cw_trace_ring_t * cw_trace_ring_acquire_internal(void)
+{
+	pthread_once(&cw_trace_ring_key_once, cw_trace_ring_key_init_internal);
+
+	cw_trace_ring_t * ring = __atomic_load_n(&cw_trace_rings, __ATOMIC_ACQUIRE);
+	for (; NULL != ring; ring = ring->next) {
+		bool expected = false;
+		if (__atomic_compare_exchange_n(&ring->owned, &expected, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	if (NULL == ring) {
+		ring = (cw_trace_ring_t *) calloc(1, sizeof (cw_trace_ring_t));
+		if (NULL == ring) {
+			return NULL;
+		}
+		ring->owned = true;
+		ring->index = __atomic_fetch_add(&cw_trace_n_rings, 1, __ATOMIC_RELAXED);
+		ring->next = __atomic_load_n(&cw_trace_rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&cw_trace_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			;
+		}
+	}
+
+	pthread_setspecific(cw_trace_ring_key, ring);
+	cw_trace_thread_ring = ring;
+
+	return ring;
+}
+
+
+
+
+/**
+   @brief Thread function of dumper
+
+   @param arg unused
+
+   @return NULL
+*/
+static void * cw_trace_dumper_thread_fn(__attribute__((unused)) void * arg)
+{
+	pthread_mutex_lock(&cw_trace_dumper.mutex);
+	while (cw_trace_dumper.running) {
+		const int fd = cw_trace_dumper.fd;
+		pthread_mutex_unlock(&cw_trace_dumper.mutex);
+
+		cw_trace_dump_internal(fd);
+
+		struct timespec until = { 0 };
+		clock_gettime(CLOCK_REALTIME, &until);
+		const int64_t until_nsec = until.tv_nsec + (int64_t) CW_TRACE_DUMP_INTERVAL * 1000;
+		until.tv_sec += until_nsec / 1000000000;
+		until.tv_nsec = until_nsec % 1000000000;
+
+		pthread_mutex_lock(&cw_trace_dumper.mutex);
+		if (cw_trace_dumper.running) {
+			pthread_cond_timedwait(&cw_trace_dumper.cond, &cw_trace_dumper.mutex, &until);
+		}
+	}
+	pthread_mutex_unlock(&cw_trace_dumper.mutex);
+
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Move events from all rings to file descriptor
+
+   @param[in] fd file descriptor to which to write events
+*/
+static void cw_trace_dump_internal(int fd)
+{
+	char line[128];
+
+	for (cw_trace_ring_t * ring = __atomic_load_n(&cw_trace_rings, __ATOMIC_ACQUIRE); NULL != ring; ring = ring->next) {
+		const size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		size_t tail = ring->tail;
+		for (; tail != head; tail++) {
+			const cw_trace_record_t * record = &ring->records[tail & (CW_TRACE_RING_CAPACITY - 1)];
+			const int n = snprintf(line, sizeof (line), "libcwtrace:\t%d\t%lld\t%s\t%d\n",
+					       ring->index, (long long int) record->timestamp,
+					       record->event < CW_TRACE_EVENT_MAX ? cw_trace_event_labels[record->event] : "unknown",
+					       (int) record->value);
+			if (write(fd, line, (size_t) n) != n) {
+				/* Keep draining the ring: nobody will read the events anyway. */
+				;
+			}
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+		const uint64_t n_dropped = __atomic_load_n(&ring->n_dropped, __ATOMIC_RELAXED);
+		if (n_dropped != ring->n_dropped_reported) {
+			const int n = snprintf(line, sizeof (line), "libcwtrace:\t%d\tdropped\t%llu\n",
+					       ring->index, (unsigned long long int) (n_dropped - ring->n_dropped_reported));
+			if (write(fd, line, (size_t) n) != n) {
+				;
+			}
+			ring->n_dropped_reported = n_dropped;
+		}
+	}
+
+	return;
+}
+
+
+
+
+#else /* #if defined(LIBCW_WITH_TRACE) */
+
+
+
+
+int cw_trace_start(__attribute__((unused)) int fd)
+{
+	errno = ENOSYS;
+	return CW_FAILURE;
+}
+
+
+
+
+void cw_trace_stop(void)
+{
+	return;
+}
+
+
+
+
+#endif /* #if defined(LIBCW_WITH_TRACE) */
@@ -0,0 +1,66 @@
+/*
+  This file is a part of unixcw project.
+  unixcw project is covered by GNU General Public License, version 2 or later.
+*/
+
+#ifndef H_LIBCW_TRACE
+#define H_LIBCW_TRACE
+
+
+
+
+#include "config.h"
+
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+/* Events recorded by trace probes. Meaning of value recorded with an
+   event is given in comment. */
+typedef enum {
+	CW_TRACE_TQ_ENQUEUE = 0,       /* Tone has been added to tone queue. Value: frequency of tone. */
+	CW_TRACE_TQ_DEQUEUE,           /* Tone has been taken from tone queue. Value: frequency of tone. */
+	CW_TRACE_GEN_WRITE_BEGIN,      /* Generator starts writing buffer to sound sink. Value: count of samples. */
+	CW_TRACE_GEN_WRITE_END,        /* Generator has written buffer to sound sink. Value: CW_SUCCESS or CW_FAILURE. */
+	CW_TRACE_KEY_SK,               /* Straight key has changed its value. Value: new value of key. */
+	CW_TRACE_KEY_IK,               /* Iambic keyer has changed its value. Value: new value of keyer. */
+	CW_TRACE_REC_MARK_BEGIN,       /* Receiver has been told about beginning of Mark. Value: state of receiver. */
+	CW_TRACE_REC_MARK_END,         /* Receiver has been told about end of Mark. Value: state of receiver. */
+
+	CW_TRACE_EVENT_MAX
+} cw_trace_event_t;
+
+
+
+
+#if defined(LIBCW_WITH_TRACE)
+
+/* Set while dumper of trace is running. Probes don't record anything
+   when the flag is not set. */
+extern bool cw_trace_is_enabled;
+
+void cw_trace_record_internal(cw_trace_event_t event, int32_t value);
+
+/* Trace probe. The probe is removed at compile time when library is
+   configured with --disable-trace. */
+#define CW_TRACE(event, value) {					\
+	if (__atomic_load_n(&cw_trace_is_enabled, __ATOMIC_RELAXED)) {	\
+		cw_trace_record_internal((event), (int32_t) (value));	\
+	}								\
+}
+
+#else
+
+#define CW_TRACE(event, value) {}
+
+#endif /* #if defined(LIBCW_WITH_TRACE) */
+
+
+
+
+#endif /* #ifndef H_LIBCW_TRACE */
@@ -29,7 +29,8 @@
    allowed me to drop compile-time dependency on ALSA libs and
    PulseAudio libs, and replace it with run-time dependency.
 
-   You will find calls to dlclose() in libcw_alsa.c and libcw_pa.c.
+   Libraries opened with it by libcw_alsa.c and libcw_pa.c are loaded
+   once and stay loaded until the end of the process.
 */
 
 
@@ -46,6 +47,7 @@
 #include <stdlib.h> /* strtol() */
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h> /* clock_nanosleep() */
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -94,7 +96,11 @@ static const char * cw_sound_system_labels[] = {
 	"OSS",
 	"ALSA",
 	"PulseAudio",
-	"Soundcard" };
+	"Soundcard",
+	"File",
+	"JACK",
+	"PipeWire",
+	"RTP" };
 
 
 
@@ -214,7 +220,7 @@ void cw_license(void)
    @brief Get a readable label of given sound system
 
    The function returns one of following strings:
-   None, Null, Console, OSS, ALSA, PulseAudio, Soundcard
+   None, Null, Console, OSS, ALSA, PulseAudio, Soundcard, File, JACK, PipeWire, RTP
 
    Returned pointer is owned and managed by the library.
 
@@ -265,21 +271,98 @@ void cw_usecs_to_timespec_internal(struct timespec * ts, int usecs)
 
 
 
+/**
+   @brief Move point in time by given amount of microseconds
+
+   @param[in,out] ts point in time to move
+   @param[in] usecs microseconds to add to @p ts, may be negative
+*/
+void cw_timespec_add_usecs_internal(struct timespec * ts, int64_t usecs)
+{
+	assert (NULL != ts);
+
+	int64_t nsecs = (int64_t) ts->tv_nsec + (usecs % CW_USECS_PER_SEC) * 1000;
+	ts->tv_sec += (time_t) (usecs / CW_USECS_PER_SEC);
+	if (nsecs >= 1000 * 1000 * 1000) {
+		ts->tv_sec++;
+		nsecs -= 1000 * 1000 * 1000;
+	} else if (nsecs < 0) {
+		ts->tv_sec--;
+		nsecs += 1000 * 1000 * 1000;
+	}
+	ts->tv_nsec = (long) nsecs;
+
+	return;
+}
+
+
+
+
+/**
+   @brief Get difference between two points in time
+
+   @return difference in microseconds, negative if @p later is in fact earlier than @p earlier
+*/
+int64_t cw_timespec_diff_usecs_internal(const struct timespec * earlier, const struct timespec * later)
+{
+	return ((int64_t) later->tv_sec - (int64_t) earlier->tv_sec) * CW_USECS_PER_SEC
+		+ ((int64_t) later->tv_nsec - (int64_t) earlier->tv_nsec) / 1000;
+}
+
+
+
+
+void cw_sleep_until_internal(const struct timespec * deadline)
+{
+	assert (NULL != deadline);
+
+	/* clock_nanosleep() returns error code instead of setting
+	   errno. With absolute deadline the call can be simply
+	   repeated after interruption. */
+	while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL)) {
+		;
+	}
+
+	return;
+}
+
+
+
+
 void cw_usleep_internal(int usecs)
 {
-	struct timespec remaining = { 0 };
-	cw_usecs_to_timespec_internal(&remaining, usecs);
-
-	int rv = 0;
-	do {
-		struct timespec req = { .tv_sec = remaining.tv_sec, .tv_nsec = remaining.tv_nsec };
-		//fprintf(stderr, " -- sleeping for %ld s, %ld ns\n", req.tv_sec, req.tv_nsec);
-		/* TODO acerion 2023.11.11: use clock_nanosleep() with MONOTONIC clock ID. */
-		rv = nanosleep(&req, &remaining);
-		if (rv) {
-			//fprintf(stderr, " -- remains %ld s, %ld ns\n", remaining.tv_sec, remaining.tv_nsec);
-		}
-	} while (rv);
+	assert (usecs >= 0);
+
+	struct timespec deadline = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	cw_timespec_add_usecs_internal(&deadline, usecs);
+	cw_sleep_until_internal(&deadline);
+
+	return;
+}
+
+
+
+
+void cw_sleep_on_timeline_internal(struct timespec * timeline, int usecs)
+{
+	assert (usecs >= 0);
+	assert (NULL != timeline);
+
+	struct timespec deadline = *timeline;
+	cw_timespec_add_usecs_internal(&deadline, usecs);
+
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (cw_timespec_diff_usecs_internal(&now, &deadline) < 0) {
+		/* We are late by more than whole interval. Don't try
+		   to catch up, start new timeline. */
+		deadline = now;
+		cw_timespec_add_usecs_internal(&deadline, usecs);
+	}
+	*timeline = deadline;
+
+	cw_sleep_until_internal(&deadline);
 
 	return;
 }
@@ -287,7 +370,49 @@ void cw_usleep_internal(int usecs)
 
 
 
-#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO))
+void cw_metrics_write_family_internal(cw_metrics_write_callback_t callback_func, void * callback_arg, const char * name, const char * type, const char * help, const char * labels, double value)
+{
+	char line[256];
+	int n = snprintf(line, sizeof (line), "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+	if (n > 0 && (size_t) n < sizeof (line)) {
+		callback_func(callback_arg, line, (size_t) n);
+	}
+
+	if (0 == strcmp(type, "counter")) {
+		snprintf(line, sizeof (line), "%s_total", name);
+		cw_metrics_write_sample_internal(callback_func, callback_arg, line, labels, NULL, value);
+	} else {
+		cw_metrics_write_sample_internal(callback_func, callback_arg, name, labels, NULL, value);
+	}
+}
+
+
+
+
+void cw_metrics_write_sample_internal(cw_metrics_write_callback_t callback_func, void * callback_arg, const char * name, const char * labels, const char * extra_labels, double value)
+{
+	const bool has_labels = NULL != labels && '\0' != labels[0];
+	const bool has_extra_labels = NULL != extra_labels && '\0' != extra_labels[0];
+
+	char line[512];
+	int n = 0;
+	if (has_labels || has_extra_labels) {
+		n = snprintf(line, sizeof (line), "%s{%s%s%s} %.15g\n", name,
+			     has_labels ? labels : "",
+			     has_labels && has_extra_labels ? "," : "",
+			     has_extra_labels ? extra_labels : "",
+			     value);
+	} else {
+		n = snprintf(line, sizeof (line), "%s %.15g\n", name, value);
+	}
+	if (n > 0 && (size_t) n < sizeof (line)) {
+		callback_func(callback_arg, line, (size_t) n);
+	}
+}
+
+
+
+
 /**
    @brief Try to dynamically open shared library
 
@@ -326,7 +451,20 @@ cw_ret_t cw_dlopen_internal(const char * library_name, void ** handle)
 		return CW_SUCCESS;
 	}
 }
-#endif
+
+
+
+
+void * cw_calloc_aligned_internal(size_t size)
+{
+	void * ptr = NULL;
+	if (0 != posix_memalign(&ptr, CW_CACHE_LINE_SIZE, size)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(ptr, 0, size);
+	return ptr;
+}
 
 
 
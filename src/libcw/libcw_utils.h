@@ -19,7 +19,9 @@ extern "C"
 
 #include "config.h"
 
+#include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "libcw2.h"
 
@@ -31,6 +33,23 @@ extern "C"
 
 
 
+/* Size of cache line assumed by layout of structures shared between
+   threads. Fields written by different threads (e.g. code enqueueing
+   tones and generator's thread) are put in separate groups, and each
+   group starts at a new cache line, so that writes of one thread
+   don't invalidate cache lines read by the other thread (false
+   sharing). Structures with such members must be allocated with
+   cw_calloc_aligned_internal(). */
+#define CW_CACHE_LINE_SIZE 64
+#if defined(__GNUC__)
+#define CW_CACHE_LINE_ALIGNED __attribute__((aligned(CW_CACHE_LINE_SIZE)))
+#else
+#define CW_CACHE_LINE_ALIGNED
+#endif
+
+
+
+
 int cw_timestamp_compare_internal(const struct timeval * earlier, const struct timeval * later);
 cw_ret_t cw_timestamp_validate_internal(struct timeval * out_timestamp, const struct timeval * in_timestamp);
 void cw_usecs_to_timespec_internal(struct timespec * ts, int usecs);
@@ -38,27 +57,88 @@ void cw_usecs_to_timespec_internal(struct timespec * ts, int usecs);
 
 
 
+void cw_timespec_add_usecs_internal(struct timespec * ts, int64_t usecs);
+int64_t cw_timespec_diff_usecs_internal(const struct timespec * earlier, const struct timespec * later);
+
+
+
+
+/**
+   @brief Sleep until given point in time on CLOCK_MONOTONIC clock
+
+   The function uses clock_nanosleep(TIMER_ABSTIME). When the sleep is
+   interrupted by a signal (e.g. SIGALRM used by libcw), the sleep is
+   resumed with the same deadline, so the signals neither shorten nor
+   lengthen the sleep. The function returns immediately if @p deadline
+   is already in the past.
+*/
+void cw_sleep_until_internal(const struct timespec * deadline);
+
+
+
+
 /**
    @brief Sleep for given amount of microseconds
 
-   The function uses nanosleep(), and can handle incoming SIGALRM signals
-   that cause regular nanosleep() to return. The function calls nanosleep()
-   until all time specified by @p usecs has elapsed.
+   The function calculates a deadline on CLOCK_MONOTONIC clock and
+   sleeps until the deadline with cw_sleep_until_internal(), so
+   incoming signals (e.g. SIGALRM) don't change duration of the sleep.
 
    The function may sleep a little longer than specified by @param
-   usecs if it needs to spend some time handling SIGALRM signal. Other
-   restrictions from nanosleep()'s man page also apply.
-
-   @reviewed 2020-08-17
+   usecs if it needs to spend some time handling the signals. Loops
+   that sleep repeatedly should use cw_sleep_on_timeline_internal()
+   instead, so that these delays don't accumulate.
 */
 void cw_usleep_internal(int usecs);
 
 
 
 
-#if (defined(LIBCW_WITH_ALSA) || defined(LIBCW_WITH_PULSEAUDIO))
+/**
+   @brief Sleep until end of next interval on absolute timeline
+
+   The function advances @p timeline (a point in time on CLOCK_MONOTONIC
+   clock) by @p usecs microseconds, and sleeps until that point in time
+   with clock_nanosleep(TIMER_ABSTIME). Unlike with consecutive calls to
+   cw_usleep_internal(), delays in waking up don't accumulate over
+   consecutive calls.
+
+   If the end of the interval is already in the past (e.g. because
+   @p timeline was never set, or has not been advanced for a while), the
+   timeline is restarted from current time.
+*/
+void cw_sleep_on_timeline_internal(struct timespec * timeline, int usecs);
+
+
+
+
+/**
+   @brief Write one metric family with one sample in OpenMetrics text format
+
+   Sample of counter family is named "<name>_total". @p labels may be
+   NULL or empty.
+*/
+void cw_metrics_write_family_internal(cw_metrics_write_callback_t callback_func, void * callback_arg, const char * name, const char * type, const char * help, const char * labels, double value);
+
+/**
+   @brief Write one sample of metric in OpenMetrics text format
+
+   @p labels and @p extra_labels may be NULL or empty. If both are
+   given, they are separated with comma.
+*/
+void cw_metrics_write_sample_internal(cw_metrics_write_callback_t callback_func, void * callback_arg, const char * name, const char * labels, const char * extra_labels, double value);
+
+
+
 cw_ret_t cw_dlopen_internal(const char * library_name, void ** handle);
-#endif
+
+/**
+   @brief Allocate zeroed memory aligned to CW_CACHE_LINE_SIZE
+
+   Like calloc(1, @p size), but returned memory starts at a cache
+   line. Free the memory with free().
+*/
+void * cw_calloc_aligned_internal(size_t size);
 
 void cw_finalization_schedule_internal(void);
 void cw_finalization_cancel_internal(void);
@@ -130,6 +130,20 @@ int gen_setup(cw_test_executor_t * cte, cw_gen_t ** gen)
 
 
 
+int gen_setup_for_tq(cw_test_executor_t * cte, cw_gen_t ** gen)
+{
+	*gen = cw_gen_new(&cte->current_gen_conf);
+	if (!*gen) {
+		kite_log(cte, LOG_ERR, "%s:%d: Can't create generator, stopping the test\n", __func__, __LINE__);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
 void gen_destroy(cw_gen_t ** gen)
 {
 	cw_gen_delete(gen); /* This function sets **gen to NULL. */
@@ -92,6 +92,24 @@ int gen_setup(cw_test_executor_t * cte, cw_gen_t ** gen);
 
 
 
+/**
+   @brief Prepare new generator for test that dequeues tones by itself
+
+   The generator has default parameters of new generator, and it is
+   not started. Tones enqueued by a test stay in generator's tone queue
+   until the test dequeues them directly from the queue with
+   cw_tq_dequeue_internal(). This lets a test look at every tone and at
+   state of the queue without racing with generator's thread, and
+   makes dequeueing of a tone stand in for playing of the tone.
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int gen_setup_for_tq(cw_test_executor_t * cte, cw_gen_t ** gen);
+
+
+
+
 /**
    @brief Delete @param gen, set the pointer to NULL
 
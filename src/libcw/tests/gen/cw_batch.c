@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_batch.c
+
+   Test of batch renderer (libcw_batch.c)
+*/
+
+
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_batch.h"
+#include "libcw_gen.h"
+#include "cw_batch.h"
+
+
+
+
+#define TEST_WAV_HEADER_SIZE 44
+
+/* Count of files rendered in one test. Larger than count of buffers of
+   batch renderer, so buffers are reused. */
+#define TEST_N_FILES 24
+
+static const char * test_strings[] = {
+	"paris",
+	"cq cq de test k",
+	"the quick brown fox jumps over the lazy dog",
+	"0123456789 ?=/",
+};
+
+
+
+
+static cwt_retv test_batch(cw_test_executor_t * cte, bool try_io_uring);
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte);
+static cwt_retv test_compare_file(cw_test_executor_t * cte, const char * path, const char * string, bool try_io_uring);
+
+
+
+
+/**
+   @brief Test batch renderer
+
+   Many strings are rendered into many files, with io_uring and with
+   threads calling write(). Samples in every file must be identical to
+   samples of the same string rendered with cw_gen_render_string() by
+   new generator.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_batch(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_batch(cte, true)
+	    || cwt_retv_ok != test_batch(cte, false)) {
+		return cwt_retv_err;
+	}
+
+	errno = 0;
+	cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_batch_new)(NULL, 1), "creating batch renderer without generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of creating batch renderer without generator");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Render files with batch renderer, and check them
+
+   @param cte test executor
+   @param[in] try_io_uring whether batch renderer should use io_uring
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_batch(cw_test_executor_t * cte, bool try_io_uring)
+{
+	char dir[64] = { 0 };
+	snprintf(dir, sizeof (dir), "/tmp/libcw_test_batch_XXXXXX");
+	if (NULL == mkdtemp(dir)) {
+		cte->log_error(cte, "%s:%d: Failed to create directory\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	cw_gen_t * gen = test_new_gen(cte);
+	if (NULL == gen) {
+		rmdir(dir);
+		return cwt_retv_err;
+	}
+	cw_batch_t * batch = cw_batch_new_internal(gen, 3, try_io_uring);
+	cw_gen_delete(&gen);
+	if (NULL == batch) {
+		cte->log_error(cte, "%s:%d: Failed to create batch renderer\n", __func__, __LINE__);
+		rmdir(dir);
+		return cwt_retv_err;
+	}
+
+	const int n_strings = (int) (sizeof (test_strings) / sizeof (test_strings[0]));
+	char path[128] = { 0 };
+	bool add_success = true;
+	for (int i = 0; i < TEST_N_FILES; i++) {
+		snprintf(path, sizeof (path), "%s/%d.wav", dir, i);
+		add_success = add_success && CW_SUCCESS == LIBCW_TEST_FUT(cw_batch_add)(batch, test_strings[i % n_strings], path);
+	}
+	cte->expect_op_int(cte, true, "==", add_success, "adding jobs (io_uring %d)", try_io_uring);
+	unsigned int n_failed = 1;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_batch_wait)(batch, &n_failed), "waiting for jobs (io_uring %d)", try_io_uring);
+	cte->expect_op_int(cte, 0, "==", (int) n_failed, "count of failed jobs (io_uring %d)", try_io_uring);
+
+	cwt_retv retv = cwt_retv_ok;
+	for (int i = 0; i < TEST_N_FILES && cwt_retv_ok == retv; i++) {
+		snprintf(path, sizeof (path), "%s/%d.wav", dir, i);
+		retv = test_compare_file(cte, path, test_strings[i % n_strings], try_io_uring);
+	}
+
+	/* Failed jobs don't stop other jobs. */
+	snprintf(path, sizeof (path), "%s/invalid.wav", dir);
+	cw_batch_add(batch, "paris\x01", path);
+	cw_batch_add(batch, "paris", "/nonexistent/libcw_test_batch.wav");
+	snprintf(path, sizeof (path), "%s/valid.wav", dir);
+	cw_batch_add(batch, "paris", path);
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_batch_wait)(batch, &n_failed), "waiting for failing jobs (io_uring %d)", try_io_uring);
+	cte->expect_op_int(cte, EIO, "==", errno, "errno of waiting for failing jobs (io_uring %d)", try_io_uring);
+	cte->expect_op_int(cte, 2, "==", (int) n_failed, "count of failing jobs (io_uring %d)", try_io_uring);
+	cte->expect_op_int(cte, 0, "==", access(path, F_OK), "file of valid job next to failing jobs (io_uring %d)", try_io_uring);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_batch_wait)(batch, &n_failed), "waiting without new jobs (io_uring %d)", try_io_uring);
+
+	cw_batch_delete(&batch);
+	cte->expect_null_pointer(cte, batch, "deleted batch renderer");
+
+	for (int i = 0; i < TEST_N_FILES; i++) {
+		snprintf(path, sizeof (path), "%s/%d.wav", dir, i);
+		unlink(path);
+	}
+	snprintf(path, sizeof (path), "%s/valid.wav", dir);
+	unlink(path);
+	rmdir(dir);
+
+	return retv;
+}
+
+
+
+
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return NULL;
+	}
+	cw_gen_set_speed(gen, 40);
+	cw_gen_set_frequency(gen, 650);
+	return gen;
+}
+
+
+
+
+/**
+   @brief Compare contents of rendered file with samples of string
+
+   @param cte test executor
+   @param[in] path path to file
+   @param[in] string string rendered into the file
+   @param[in] try_io_uring whether batch renderer used io_uring
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_compare_file(cw_test_executor_t * cte, const char * path, const char * string, bool try_io_uring)
+{
+	cw_gen_t * gen = test_new_gen(cte);
+	if (NULL == gen) {
+		return cwt_retv_err;
+	}
+	cw_sample_t * samples = NULL;
+	size_t n_samples = 0;
+	const cw_ret_t cwret = cw_gen_render_string(gen, string, 1, &samples, &n_samples);
+	cw_gen_delete(&gen);
+	if (CW_SUCCESS != cwret) {
+		cte->log_error(cte, "%s:%d: Failed to render reference samples\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		cte->log_error(cte, "%s:%d: Failed to open file %s\n", __func__, __LINE__, path);
+		free(samples);
+		return cwt_retv_err;
+	}
+	const size_t expected_size = TEST_WAV_HEADER_SIZE + sizeof (cw_sample_t) * n_samples;
+	uint8_t * contents = calloc(expected_size + 1, 1);
+	const size_t file_size = NULL == contents ? 0 : fread(contents, 1, expected_size + 1, file);
+	fclose(file);
+
+	bool samples_equal = file_size == expected_size;
+	for (size_t i = 0; i < n_samples && samples_equal; i++) {
+		const uint8_t * s = contents + TEST_WAV_HEADER_SIZE + 2 * i;
+		samples_equal = samples[i] == (cw_sample_t) (uint16_t) (s[0] | (s[1] << 8));
+	}
+	cte->expect_op_int(cte, (int) expected_size, "==", (int) file_size, "size of file %s (io_uring %d)", path, try_io_uring);
+	cte->expect_op_int(cte, true, "==", NULL != contents && 0 == memcmp(contents, "RIFF", 4), "RIFF tag of file %s", path);
+	cte->expect_op_int(cte, true, "==", samples_equal, "samples of file %s (io_uring %d)", path, try_io_uring);
+
+	free(contents);
+	free(samples);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_file_sound_system.c
+
+   Test of File sound system (libcw_file.c)
+*/
+
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_file_sound_system.h"
+
+
+
+
+#define TEST_WAV_HEADER_SIZE 44
+
+/* Text sent in the test. At 60 WPM it takes a few seconds to play it in
+   real time. */
+#define TEST_TEXT "paris paris paris paris paris"
+
+
+
+
+static uint32_t test_get_u32_le(const uint8_t * bytes);
+
+
+
+
+/**
+   @brief Test File sound system
+
+   A text is rendered by generator using File sound system into a WAV
+   file. The test verifies the header of the file, that the file contains
+   some sound, and that rendering took less time than playing the text
+   in real time would take.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_file_sound_system(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_file_%ld.wav", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+
+	cte->expect_op_int(cte, true, "==", cw_is_file_possible(path), "file output is possible");
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, CW_AUDIO_FILE, "==", cw_gen_get_sound_system(gen), "sound system of generator");
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+
+	struct timeval before;
+	gettimeofday(&before, NULL);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+	cw_gen_wait_for_queue_level(gen, 0);
+	struct timeval after;
+	gettimeofday(&after, NULL);
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	/* Each "paris" is 50 units. Rendering should be much faster than
+	   that. */
+	const int realtime_duration = 5 * 50 * durations.dot_duration;
+	const int elapsed = cw_timestamp_compare_internal(&before, &after);
+	cte->expect_op_int(cte, realtime_duration / 2, ">", elapsed, "time of rendering (real time: %d us)", realtime_duration);
+
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		cte->log_error(cte, "%s:%d: Failed to open output file %s\n", __func__, __LINE__, path);
+		return cwt_retv_err;
+	}
+	fseek(file, 0, SEEK_END);
+	const long file_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	uint8_t * contents = calloc((size_t) file_size + 1, 1);
+	if (NULL == contents || (size_t) file_size != fread(contents, 1, (size_t) file_size, file)) {
+		cte->log_error(cte, "%s:%d: Failed to read output file\n", __func__, __LINE__);
+		free(contents);
+		fclose(file);
+		unlink(path);
+		return cwt_retv_err;
+	}
+	fclose(file);
+	unlink(path);
+
+	cte->expect_op_int(cte, TEST_WAV_HEADER_SIZE, "<", (int) file_size, "size of file");
+	cte->expect_op_int(cte, 0, "==", memcmp(contents, "RIFF", 4), "RIFF tag");
+	cte->expect_op_int(cte, 0, "==", memcmp(contents + 8, "WAVE", 4), "WAVE tag");
+	cte->expect_op_int(cte, 16, "==", (int) contents[34], "bits per sample");
+	cte->expect_op_int(cte, (int) (file_size - 8), "==", (int) test_get_u32_le(contents + 4), "size of RIFF chunk");
+	cte->expect_op_int(cte, (int) (file_size - TEST_WAV_HEADER_SIZE), "==", (int) test_get_u32_le(contents + 40), "size of data chunk");
+
+	/* Duration of rendered sound is at least duration of the text. */
+	const uint32_t sample_rate = test_get_u32_le(contents + 24);
+	const int64_t n_samples = (file_size - TEST_WAV_HEADER_SIZE) / 2;
+	const int64_t rendered_duration = n_samples * CW_USECS_PER_SEC / sample_rate;
+	cte->expect_op_int(cte, realtime_duration * 9 / 10, "<", (int) rendered_duration, "duration of rendered sound");
+
+	int n_non_zero = 0;
+	for (long i = TEST_WAV_HEADER_SIZE; i < file_size; i++) {
+		if (0 != contents[i]) {
+			n_non_zero++;
+		}
+	}
+	cte->expect_op_int(cte, 0, "<", n_non_zero, "count of non-zero bytes of samples");
+
+	free(contents);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Get little-endian 32-bit integer from array of bytes
+
+   @param[in] bytes array of bytes
+
+   @return value of integer
+*/
+static uint32_t test_get_u32_le(const uint8_t * bytes)
+{
+	return (uint32_t) bytes[0]
+		| ((uint32_t) bytes[1] << 8)
+		| ((uint32_t) bytes[2] << 16)
+		| ((uint32_t) bytes[3] << 24);
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_add_sink.c
+
+   Test of sinks of generator (cw_gen_add_sink()).
+*/
+
+
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_sink.h"
+#include "cw_gen_add_sink.h"
+
+
+
+
+#define TEST_TEXT "paris paris"
+
+/* Capacity of test sink [buffers]. */
+#define TEST_SINK_CAPACITY 256
+
+
+
+
+/* Sink collecting copies of buffers passed to it. */
+typedef struct {
+	cw_sample_t * buffers[TEST_SINK_CAPACITY];
+	int n_samples[TEST_SINK_CAPACITY];
+	int n_buffers;
+	int sample_rate;
+	useconds_t delay; /* [us] Time spent in callback, to simulate slow sink. */
+} test_sink_t;
+
+
+
+
+static void test_sink_callback(void * callback_arg, const cw_sample_t * samples, int n_samples, int sample_rate);
+static cwt_retv test_sinks_internal(cw_test_executor_t * cte, int pipeline_n_buffers);
+static int test_sink_n_matching_internal(const test_sink_t * sink, const uint8_t * contents, long size);
+
+
+
+
+/**
+   @brief Test that sinks of generator get samples written to sound device
+
+   Generator with File sound system writes its buffers as fast as it
+   can. A fast sink should get the same samples that have been written
+   to the file. A slow sink can't keep up, so it loses some buffers,
+   but it doesn't block the generator.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_add_sink(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Without pipeline buffers are passed to sinks by reference,
+	   with pipeline they are copied. */
+	if (cwt_retv_ok != test_sinks_internal(cte, 0)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_sinks_internal(cte, 2)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void test_sink_callback(void * callback_arg, const cw_sample_t * samples, int n_samples, int sample_rate)
+{
+	test_sink_t * sink = (test_sink_t *) callback_arg;
+	if (sink->n_buffers < TEST_SINK_CAPACITY) {
+		sink->buffers[sink->n_buffers] = malloc((size_t) n_samples * sizeof (cw_sample_t));
+		if (NULL != sink->buffers[sink->n_buffers]) {
+			memcpy(sink->buffers[sink->n_buffers], samples, (size_t) n_samples * sizeof (cw_sample_t));
+			sink->n_samples[sink->n_buffers] = n_samples;
+			sink->n_buffers++;
+		}
+	}
+	sink->sample_rate = sample_rate;
+	if (sink->delay > 0) {
+		usleep(sink->delay);
+	}
+}
+
+
+
+
+/**
+   @brief Count buffers of sink that are found in file, in order
+
+   @param[in] sink sink with collected buffers
+   @param[in] contents contents of file written by generator
+   @param[in] size size of @p contents
+
+   @return count of buffers of @p sink found in @p contents at increasing offsets
+*/
+static int test_sink_n_matching_internal(const test_sink_t * sink, const uint8_t * contents, long size)
+{
+	int n_matching = 0;
+	long offset = 0;
+	for (int i = 0; i < sink->n_buffers; i++) {
+		const long n_bytes = (long) sink->n_samples[i] * (long) sizeof (cw_sample_t);
+		for (; offset + n_bytes <= size; offset += (long) sizeof (cw_sample_t)) {
+			if (0 == memcmp(contents + offset, sink->buffers[i], (size_t) n_bytes)) {
+				n_matching++;
+				offset += n_bytes;
+				break;
+			}
+		}
+	}
+	return n_matching;
+}
+
+
+
+
+/**
+   @brief Render test text to file and to two sinks
+
+   @param cte test executor
+   @param[in] pipeline_n_buffers count of buffers in generator's pipeline
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_sinks_internal(cw_test_executor_t * cte, int pipeline_n_buffers)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_sink_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.sidetone_low_latency = false;
+	gen_conf.pipeline_n_buffers = pipeline_n_buffers;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	test_sink_t * fast = calloc(1, sizeof (test_sink_t));
+	test_sink_t * slow = calloc(1, sizeof (test_sink_t));
+	if (NULL == fast || NULL == slow) {
+		cte->log_error(cte, "%s:%d: Failed to allocate sinks\n", __func__, __LINE__);
+		free(fast);
+		free(slow);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	slow->delay = 20000;
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_add_sink(gen, test_sink_callback, fast), "adding fast sink");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_add_sink(gen, test_sink_callback, slow), "adding slow sink");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_gen_add_sink(gen, test_sink_callback, fast), "adding the same sink twice");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of adding the same sink twice");
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	if (0 == pipeline_n_buffers) {
+		/* Generator calculates samples directly in memory shared
+		   with sinks. */
+		cte->expect_op_int(cte, true, "==", gen->buffer != gen->own_buffer, "generator's buffer is a slot of sinks");
+	}
+
+	cw_gen_sink_statistics_t fast_stats = { 0 };
+	cw_gen_sink_statistics_t slow_stats = { 0 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_get_sink_statistics(gen, test_sink_callback, fast, &fast_stats), "statistics of fast sink");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_get_sink_statistics(gen, test_sink_callback, slow, &slow_stats), "statistics of slow sink");
+	/* Generator has written all buffers long before the slow sink
+	   could take them. */
+	cte->expect_op_int(cte, 0, "<", (int) slow_stats.n_dropped, "count of buffers dropped by slow sink");
+	cte->expect_op_int(cte, (int) (fast_stats.n_buffers + fast_stats.n_dropped + fast_stats.n_queued), "==",
+			   (int) (slow_stats.n_buffers + slow_stats.n_dropped + slow_stats.n_queued), "count of buffers published to sinks");
+
+	/* Removing a sink passes remaining buffers to it. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_remove_sink(gen, test_sink_callback, fast), "removing fast sink");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_remove_sink(gen, test_sink_callback, slow), "removing slow sink");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_gen_remove_sink(gen, test_sink_callback, slow), "removing removed sink");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of removing removed sink");
+	cte->expect_op_int(cte, (int) (fast_stats.n_buffers + fast_stats.n_queued), "==", fast->n_buffers, "count of buffers in fast sink");
+	cte->expect_op_int(cte, gen->sample_rate, "==", fast->sample_rate, "sample rate passed to sink");
+
+	cw_gen_delete(&gen);
+
+	FILE * file = fopen(path, "rb");
+	uint8_t * contents = NULL;
+	long size = 0;
+	if (NULL != file) {
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		contents = calloc((size_t) size + 1, 1);
+		if (NULL != contents && (size_t) size != fread(contents, 1, (size_t) size, file)) {
+			free(contents);
+			contents = NULL;
+		}
+		fclose(file);
+	}
+	unlink(path);
+
+	const bool have_contents = NULL != contents;
+	if (have_contents) {
+		/* Buffers are passed to sinks in order, and they hold
+		   the same samples as the file. */
+		cte->expect_op_int(cte, fast->n_buffers, "==", test_sink_n_matching_internal(fast, contents, size), "buffers of fast sink found in file (%d buffers in pipeline)", pipeline_n_buffers);
+		cte->expect_op_int(cte, slow->n_buffers, "==", test_sink_n_matching_internal(slow, contents, size), "buffers of slow sink found in file (%d buffers in pipeline)", pipeline_n_buffers);
+		if (0 == fast_stats.n_dropped) {
+			long n_bytes = 0;
+			for (int i = 0; i < fast->n_buffers; i++) {
+				n_bytes += (long) fast->n_samples[i] * (long) sizeof (cw_sample_t);
+			}
+			cte->expect_op_int(cte, (int) size, "==", (int) n_bytes, "size of samples in fast sink");
+		}
+	} else {
+		cte->log_error(cte, "%s:%d: Failed to read output file %s\n", __func__, __LINE__, path);
+	}
+	free(contents);
+
+	for (int i = 0; i < fast->n_buffers; i++) {
+		free(fast->buffers[i]);
+	}
+	for (int i = 0; i < slow->n_buffers; i++) {
+		free(slow->buffers[i]);
+	}
+	free(fast);
+	free(slow);
+
+	return have_contents ? cwt_retv_ok : cwt_retv_err;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_calculate_amplitudes_internal.c
+
+   Test of cw_gen_calculate_amplitudes_internal()
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "cw_gen_calculate_amplitudes_internal.h"
+
+
+
+
+/* Maximal count of samples in tested tones. */
+#define TEST_MAX_N_SAMPLES 4000
+
+
+
+
+static float test_reference_amplitude(const cw_gen_t * gen, const cw_tone_t * tone, cw_sample_iter_t sample_iterator);
+
+
+
+
+/**
+   @brief Test cw_gen_calculate_amplitudes_internal()
+
+   Amplitudes calculated by tested function for tones with different
+   durations and slopes are compared with amplitudes calculated by a
+   straightforward per-sample decision (rising slope / plateau / falling
+   slope). Amplitudes are calculated in blocks of varying size, so that
+   boundaries of blocks fall inside of slopes and plateau.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_calculate_amplitudes_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const cw_ret_t cwret = cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set tone slope");
+	const int n_amplitudes = gen->tone_slope.n_amplitudes;
+
+	/* n_samples, rising_slope_n_samples, falling_slope_n_samples.
+	   Includes tones with overlapping slopes, and tones with
+	   no plateau. */
+	const int tones[][3] = {
+		{ TEST_MAX_N_SAMPLES, n_amplitudes, n_amplitudes },
+		{ TEST_MAX_N_SAMPLES, n_amplitudes, 0            },
+		{ TEST_MAX_N_SAMPLES, 0,            n_amplitudes },
+		{ TEST_MAX_N_SAMPLES, 0,            0            },
+		{ 2 * n_amplitudes,   n_amplitudes, n_amplitudes },
+		{ n_amplitudes + 7,   n_amplitudes, n_amplitudes },
+		{ n_amplitudes,       n_amplitudes, n_amplitudes },
+		{ 1,                  1,            1            },
+	};
+	const int block_sizes[] = { 1, 13, 256, 3, 100, 255, 37 };
+
+	float * amplitudes = calloc(TEST_MAX_N_SAMPLES, sizeof (float));
+	if (NULL == amplitudes) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	for (size_t i = 0; i < sizeof (tones) / sizeof (tones[0]); i++) {
+		for (int frequency = 0; frequency <= 1; frequency++) { /* Silent and non-silent tone. */
+			cw_tone_t tone;
+			CW_TONE_INIT(&tone, frequency * 800, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+			tone.n_samples = tones[i][0];
+			tone.rising_slope_n_samples = tones[i][1] < n_amplitudes ? tones[i][1] : n_amplitudes;
+			tone.falling_slope_n_samples = tones[i][2] < n_amplitudes ? tones[i][2] : n_amplitudes;
+
+			size_t block = i;
+			int n = 0;
+			while (n < tone.n_samples) {
+				int size = block_sizes[block++ % (sizeof (block_sizes) / sizeof (block_sizes[0]))];
+				if (size > tone.n_samples - n) {
+					size = (int) tone.n_samples - n;
+				}
+				LIBCW_TEST_FUT(cw_gen_calculate_amplitudes_internal)(gen, &tone, amplitudes + n, size);
+				n += size;
+			}
+			cte->expect_op_int_errors_only(cte, tone.n_samples, "==", tone.sample_iterator, "tone %zu: sample iterator after calculation", i);
+
+			int n_mismatches = 0;
+			for (cw_sample_iter_t s = 0; s < tone.n_samples; s++) {
+				const float expected = test_reference_amplitude(gen, &tone, s);
+				if (amplitudes[s] < expected || amplitudes[s] > expected) {
+					n_mismatches++;
+				}
+			}
+			cte->expect_op_int(cte, 0, "==", n_mismatches, "tone %zu, frequency %d: mismatched amplitudes", i, tone.frequency);
+		}
+	}
+
+	free(amplitudes);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Calculate amplitude of a single sample with per-sample decision tree
+
+   @param[in] gen generator with precalculated slope amplitudes
+   @param[in] tone tone for which to calculate amplitude
+   @param[in] sample_iterator index of sample in tone
+
+   @return value of amplitude
+*/
+static float test_reference_amplitude(const cw_gen_t * gen, const cw_tone_t * tone, cw_sample_iter_t sample_iterator)
+{
+	if (tone->frequency <= 0) {
+		return 0.0F;
+	}
+
+	if (sample_iterator < tone->rising_slope_n_samples) {
+		return gen->tone_slope.amplitudes[sample_iterator] * (float) gen->volume_abs;
+	} else if (sample_iterator < tone->n_samples - tone->falling_slope_n_samples) {
+		return (float) gen->volume_abs;
+	} else {
+		return gen->tone_slope.amplitudes[tone->n_samples - sample_iterator - 1] * (float) gen->volume_abs;
+	}
+}
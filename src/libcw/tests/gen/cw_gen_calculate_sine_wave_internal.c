@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_calculate_sine_wave_internal.c
+
+   Test of cw_gen_calculate_sine_wave_internal()
+*/
+
+
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "cw_gen_calculate_sine_wave_internal.h"
+
+
+
+
+/* Size of generator's buffer used in the test. */
+#define TEST_BUFFER_N_SAMPLES 512
+
+/* Count of samples generated with each oscillator. Long enough to cover
+   many fragments of sine wave, short enough for a quick test. */
+#define TEST_N_SAMPLES (TEST_BUFFER_N_SAMPLES * 40)
+
+/* Maximal allowed difference between a sample calculated by tested
+   oscillator and a sample calculated by reference sinf() oscillator. */
+#define TEST_MAX_SAMPLE_DIFF 8
+
+
+
+
+static cwt_retv test_calculate_samples(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, int frequency, bool is_started, cw_sample_t * samples);
+
+
+
+
+/**
+   @brief Test cw_gen_calculate_sine_wave_internal()
+
+   Samples of sine wave calculated with every non-default oscillator engine
+   are compared with samples calculated with default engine (sinf() called
+   for every sample). The samples are calculated in fragments of varying
+   size, so the test also verifies that the engines keep continuity of
+   phase between fragments. Silent tone must result in zero samples.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_calculate_sine_wave_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int frequencies[] = { 100, 800, 1234, CW_FREQUENCY_MAX };
+	const cw_gen_oscillator_t oscillators[] = { CW_GEN_OSCILLATOR_PHASOR, CW_GEN_OSCILLATOR_TABLE, CW_GEN_OSCILLATOR_FIXED_POINT };
+
+	cw_sample_t * reference = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	cw_sample_t * tested = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == reference || NULL == tested) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffers\n", __func__, __LINE__);
+		free(reference);
+		free(tested);
+		return cwt_retv_err;
+	}
+
+	for (size_t f = 0; f < sizeof (frequencies) / sizeof (frequencies[0]); f++) {
+		if (cwt_retv_ok != test_calculate_samples(cte, CW_GEN_OSCILLATOR_SINF, frequencies[f], true, reference)) {
+			free(reference);
+			free(tested);
+			return cwt_retv_err;
+		}
+
+		for (size_t o = 0; o < sizeof (oscillators) / sizeof (oscillators[0]); o++) {
+			if (cwt_retv_ok != test_calculate_samples(cte, oscillators[o], frequencies[f], true, tested)) {
+				free(reference);
+				free(tested);
+				return cwt_retv_err;
+			}
+
+			int max_diff = 0;
+			for (int i = 0; i < TEST_N_SAMPLES; i++) {
+				const int diff = abs(reference[i] - tested[i]);
+				if (diff > max_diff) {
+					max_diff = diff;
+				}
+			}
+			cte->expect_op_int(cte, TEST_MAX_SAMPLE_DIFF, ">=", max_diff,
+					   "oscillator %d, frequency %d: max difference from reference", oscillators[o], frequencies[f]);
+		}
+	}
+
+	/* Generator that hasn't been started has negative phase offset. It
+	   is used as it is by engines that take phase from the offset
+	   (fixed-point engine takes it from phase accumulator). */
+	const cw_gen_oscillator_t offset_oscillators[] = { CW_GEN_OSCILLATOR_PHASOR, CW_GEN_OSCILLATOR_TABLE };
+	if (cwt_retv_ok != test_calculate_samples(cte, CW_GEN_OSCILLATOR_SINF, 800, false, reference)) {
+		free(reference);
+		free(tested);
+		return cwt_retv_err;
+	}
+	for (size_t o = 0; o < sizeof (offset_oscillators) / sizeof (offset_oscillators[0]); o++) {
+		if (cwt_retv_ok != test_calculate_samples(cte, offset_oscillators[o], 800, false, tested)) {
+			free(reference);
+			free(tested);
+			return cwt_retv_err;
+		}
+
+		int max_diff = 0;
+		for (int i = 0; i < TEST_N_SAMPLES; i++) {
+			const int diff = abs(reference[i] - tested[i]);
+			if (diff > max_diff) {
+				max_diff = diff;
+			}
+		}
+		cte->expect_op_int(cte, TEST_MAX_SAMPLE_DIFF, ">=", max_diff,
+				   "oscillator %d, generator not started: max difference from reference", offset_oscillators[o]);
+	}
+
+	/* Silent tone: every engine should produce only zeros, even if
+	   generator's buffer contained some other values. */
+	const cw_gen_oscillator_t all_oscillators[] = { CW_GEN_OSCILLATOR_SINF, CW_GEN_OSCILLATOR_PHASOR, CW_GEN_OSCILLATOR_TABLE, CW_GEN_OSCILLATOR_FIXED_POINT };
+	for (size_t o = 0; o < sizeof (all_oscillators) / sizeof (all_oscillators[0]); o++) {
+		if (cwt_retv_ok != test_calculate_samples(cte, all_oscillators[o], 0, true, tested)) {
+			free(reference);
+			free(tested);
+			return cwt_retv_err;
+		}
+
+		int n_non_zero = 0;
+		for (int i = 0; i < TEST_N_SAMPLES; i++) {
+			if (0 != tested[i]) {
+				n_non_zero++;
+			}
+		}
+		cte->expect_op_int(cte, 0, "==", n_non_zero, "oscillator %d, silent tone: count of non-zero samples", all_oscillators[o]);
+	}
+
+	free(reference);
+	free(tested);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Calculate samples of a long tone with given oscillator
+
+   Samples are calculated in fragments of varying sizes, and then copied
+   from generator's buffer to @p samples.
+
+   @param cte test executor
+   @param[in] oscillator oscillator engine to use
+   @param[in] frequency frequency of tone
+   @param[in] is_started whether phase of generator should be as in started generator, or as in new generator
+   @param[out] samples output buffer for TEST_N_SAMPLES samples
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_calculate_samples(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, int frequency, bool is_started, cw_sample_t * samples)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.oscillator = oscillator;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, oscillator, "==", gen->oscillator, "oscillator of new generator");
+
+	/* Some sound systems (e.g. Null) don't need generator's buffer, so
+	   the test provides its own buffer. */
+	cw_sample_t * buffer = calloc(TEST_BUFFER_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == buffer) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	cw_sample_t * original_buffer = gen->buffer;
+	const int original_buffer_n_samples = gen->buffer_n_samples;
+	gen->buffer = buffer;
+	gen->buffer_n_samples = TEST_BUFFER_N_SAMPLES;
+	if (is_started) {
+		/* Phase set by cw_gen_start(). */
+		gen->phase_offset = 0.0F;
+	}
+
+	/* A tone without slopes, so that all samples have the same
+	   amplitude. */
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, frequency, 0, CW_SLOPE_MODE_NO_SLOPES);
+	tone.n_samples = TEST_N_SAMPLES;
+
+	/* Sizes of consecutive fragments. Use some odd values. */
+	const int fragment_sizes[] = { 1, 77, TEST_BUFFER_N_SAMPLES, 3, 200, 511, 64 };
+	size_t fragment = 0;
+
+	int n = 0;
+	while (n < TEST_N_SAMPLES) {
+		int size = fragment_sizes[fragment++ % (sizeof (fragment_sizes) / sizeof (fragment_sizes[0]))];
+		if (size > TEST_N_SAMPLES - n) {
+			size = TEST_N_SAMPLES - n;
+		}
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = size - 1;
+
+		/* Garbage left in buffer by sound sink. */
+		for (int i = 0; i < size; i++) {
+			gen->buffer[i] = 1;
+		}
+
+		const int calculated = LIBCW_TEST_FUT(cw_gen_calculate_sine_wave_internal)(gen, &tone);
+		cte->expect_op_int_errors_only(cte, size, "==", calculated, "count of calculated samples");
+
+		for (int i = 0; i < size; i++) {
+			samples[n + i] = gen->buffer[i];
+		}
+		n += size;
+	}
+
+	gen->buffer = original_buffer;
+	gen->buffer_n_samples = original_buffer_n_samples;
+	free(buffer);
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
+
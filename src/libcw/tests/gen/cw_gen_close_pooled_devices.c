@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_gen_close_pooled_devices.c
+
+   Test of library-wide pool of sound devices, and of
+   cw_gen_close_pooled_devices().
+*/
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_close_pooled_devices.h"
+
+
+
+
+/**
+   @brief Test reusing sound device of deleted generator by new generator
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_close_pooled_devices(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.device_pool = true;
+
+	/* Start from empty pool. */
+	LIBCW_TEST_FUT(cw_gen_close_pooled_devices)();
+
+	for (int i = 0; i < 3; i++) {
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		if (NULL == gen) {
+			cte->log_error(cte, "%s:%d: Failed to create generator #%d\n", __func__, __LINE__, i);
+			return cwt_retv_err;
+		}
+
+		/* First generator opens its device, next ones take it
+		   from the pool. Only some sound systems are pooled. */
+		const bool poolable = CW_AUDIO_ALSA == gen->sound_system
+			|| CW_AUDIO_OSS == gen->sound_system
+			|| (CW_AUDIO_PA == gen->sound_system && !gen_conf.pa_async);
+		const int expected_slot = (i > 0 && poolable) ? 0 : -1;
+		cte->expect_op_int(cte, expected_slot, "==", gen->device_pool.slot, "slot of device of generator #%d", i);
+		cte->expect_op_int(cte, true, "==", gen->sound_device_is_open, "device of generator #%d is open", i);
+
+		/* Generator with pooled device must be usable. */
+		cw_gen_start(gen);
+		cw_gen_enqueue_character(gen, 'e');
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_wait_for_queue_level(gen, 0), "playing with generator #%d", i);
+		cw_gen_stop(gen);
+
+		cw_gen_delete(&gen);
+	}
+
+	LIBCW_TEST_FUT(cw_gen_close_pooled_devices)();
+
+	/* After closing of pooled devices new generator has to open
+	   its device again. */
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, -1, "==", gen->device_pool.slot, "slot of device after closing pooled devices");
+	cw_gen_delete(&gen);
+	LIBCW_TEST_FUT(cw_gen_close_pooled_devices)();
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_CLOSE_POOLED_DEVICES_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_CLOSE_POOLED_DEVICES_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_close_pooled_devices(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_CLOSE_POOLED_DEVICES_H_ */
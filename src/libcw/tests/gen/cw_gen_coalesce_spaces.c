@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_coalesce_spaces.c
+
+   Test of merging of adjacent spaces enqueued for a character.
+*/
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_coalesce_spaces.h"
+
+
+
+
+/**
+   @brief Test that inter-character-space is merged into last inter-mark-space
+
+   A character enqueued by copying its tone program, and the same
+   character enqueued from its representation, should take one tone
+   per mark and one tone per space, and keep their total duration.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_coalesce_spaces(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_sync_parameters_internal(gen);
+	cw_gen_get_durations_internal(gen, &durations);
+	const int n_expected_duration = durations.dot_duration + durations.ims_duration
+		+ durations.dash_duration + durations.ics_duration + durations.additional_space_duration;
+
+	/* Generator is not started, so enqueued tones stay in queue. */
+	cw_gen_enqueue_character(gen, 'a');
+	cte->expect_op_int(cte, 4, "==", (int) cw_gen_get_queue_length(gen), "count of tones of character");
+	cte->expect_op_int(cte, n_expected_duration, "==", (int) cw_gen_get_queue_duration(gen), "duration of tones of character");
+	cw_gen_flush_queue(gen);
+
+	cw_gen_enqueue_representation(gen, ".-");
+	cte->expect_op_int(cte, 4, "==", (int) cw_gen_get_queue_length(gen), "count of tones of representation");
+	cte->expect_op_int(cte, n_expected_duration, "==", (int) cw_gen_get_queue_duration(gen), "duration of tones of representation");
+	cw_gen_flush_queue(gen);
+
+	/* Removing last character removes its merged space too. */
+	cw_gen_enqueue_character(gen, 'e');
+	cw_gen_enqueue_character(gen, 'a');
+	cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, 2, "==", (int) cw_gen_get_queue_length(gen), "count of tones after removing last character");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
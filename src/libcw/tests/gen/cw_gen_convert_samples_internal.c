@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_gen_convert_samples_internal.c
+
+   Test of cw_gen_convert_samples_internal() and of related functions
+   converting generator's samples to format negotiated with sound device.
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_convert_samples_internal.h"
+
+
+
+
+#define N_SAMPLES 4
+
+
+
+
+/**
+   @brief Test conversion of generator's samples to format of sound device
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_convert_samples_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const cw_sample_format_t orig_sample_format = gen->sample_format;
+	const int orig_n_channels = gen->n_channels;
+
+
+	/* Invalid arguments. */
+	cw_sample_format_t sample_format = CW_SAMPLE_FORMAT_FLOAT32;
+	int n_channels = 0;
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_get_sample_format)(NULL, &sample_format, &n_channels);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting sample format of NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting sample format of NULL generator");
+
+	/* Valid call. Sound systems tested here don't negotiate format
+	   of samples. */
+	cwret = LIBCW_TEST_FUT(cw_gen_get_sample_format)(gen, &sample_format, &n_channels);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting sample format of generator");
+	if (CW_AUDIO_NULL == gen->sound_system || CW_AUDIO_CONSOLE == gen->sound_system || CW_AUDIO_OSS == gen->sound_system) {
+		cte->expect_op_int(cte, CW_SAMPLE_FORMAT_S16, "==", sample_format, "sample format of %s", cw_get_audio_system_label(gen->sound_system));
+		cte->expect_op_int(cte, 1, "==", n_channels, "count of channels of %s", cw_get_audio_system_label(gen->sound_system));
+	}
+
+
+	const cw_sample_t samples[N_SAMPLES] = { 0, 1, -32768, 32767 };
+
+	/* S16, stereo: plain copy of every sample to both channels. */
+	{
+		gen->sample_format = CW_SAMPLE_FORMAT_S16;
+		gen->n_channels = 2;
+		cte->expect_op_int(cte, 4, "==", (int) cw_gen_frame_size_internal(gen), "frame size of S16 stereo");
+
+		int16_t out[N_SAMPLES * 2] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_convert_samples_internal)(gen, samples, N_SAMPLES, out);
+		bool failure = false;
+		for (int i = 0; i < N_SAMPLES; i++) {
+			if (out[2 * i] != samples[i] || out[2 * i + 1] != samples[i]) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "S16 stereo samples");
+	}
+
+	/* S32, mono: exact scaling to upper 16 bits. */
+	{
+		gen->sample_format = CW_SAMPLE_FORMAT_S32;
+		gen->n_channels = 1;
+		cte->expect_op_int(cte, 4, "==", (int) cw_gen_frame_size_internal(gen), "frame size of S32 mono");
+
+		int32_t out[N_SAMPLES] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_convert_samples_internal)(gen, samples, N_SAMPLES, out);
+		bool failure = false;
+		for (int i = 0; i < N_SAMPLES; i++) {
+			if (out[i] != (int32_t) samples[i] * 65536) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "S32 mono samples");
+		cte->expect_op_int(cte, INT32_MIN, "==", out[2], "minimal S32 sample");
+	}
+
+	/* Float32, stereo: scaling to <-1.0, 1.0). */
+	{
+		gen->sample_format = CW_SAMPLE_FORMAT_FLOAT32;
+		gen->n_channels = 2;
+		cte->expect_op_int(cte, 8, "==", (int) cw_gen_frame_size_internal(gen), "frame size of float32 stereo");
+
+		float out[N_SAMPLES * 2] = { 0 };
+		LIBCW_TEST_FUT(cw_gen_convert_samples_internal)(gen, samples, N_SAMPLES, out);
+		/* Scaling back to S16 must be exact. */
+		cte->expect_op_int(cte, 0, "==", (int) (out[0] * 32768.0F), "float32 silence");
+		cte->expect_op_int(cte, -32768, "==", (int) (out[4] * 32768.0F), "minimal float32 sample");
+		cte->expect_op_int(cte, -32768, "==", (int) (out[5] * 32768.0F), "minimal float32 sample in second channel");
+		cte->expect_op_int(cte, 32767, "==", (int) (out[7] * 32768.0F), "maximal float32 sample in second channel");
+		cte->expect_op_float(cte, 1.0F, ">", out[6], "maximal float32 sample");
+		cte->expect_op_float(cte, 0.999F, "<", out[7], "maximal float32 sample in second channel");
+	}
+
+
+	gen->sample_format = orig_sample_format;
+	gen->n_channels = orig_n_channels;
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_drift_compensation.c
+
+   Test of correction of durations of tones for drift of sample clock
+   of sound device (cw_gen_config_t::drift_compensation).
+*/
+
+
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_drift_compensation.h"
+
+
+
+
+/* At this speed duration of Dot is not a whole count of samples, so
+   each tone loses a fraction of sample in rounding. */
+#define TEST_SPEED 47
+
+#define TEST_STRING "eeeeeeeeeeeeeeeeeeee"
+
+/* Drift of sample clock simulated in the test. [parts per billion] */
+#define TEST_DRIFT_PPB 100000
+
+/* Samples rendered in one call to cw_gen_render_internal(). */
+#define TEST_BLOCK_N_SAMPLES 512
+
+
+
+
+static cwt_retv test_render_internal(cw_test_executor_t * cte, bool drift_compensation, int64_t drift_ppb);
+
+
+
+
+/**
+   @brief Test that total count of samples of tones follows their total duration
+
+   Samples of a string are rendered without sound device. Without
+   compensation, rounding of each tone to whole samples makes the
+   string shorter than its duration. With compensation, the string
+   has as many samples as its duration on sound device with given
+   drift of sample clock, within one sample.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_drift_compensation(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_render_internal(cte, false, 0)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_render_internal(cte, true, 0)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_render_internal(cte, true, TEST_DRIFT_PPB)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_render_internal(cte, true, -TEST_DRIFT_PPB)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Render test string and compare count of its samples with its duration
+
+   @param cte test executor
+   @param[in] drift_compensation whether generator compensates drift
+   @param[in] drift_ppb drift of sample clock, as if measured by generator
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_render_internal(cw_test_executor_t * cte, bool drift_compensation, int64_t drift_ppb)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.drift_compensation = drift_compensation;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	gen->device_clock.drift_ppb = drift_ppb;
+
+	cw_gen_set_speed(gen, TEST_SPEED);
+	cw_gen_enqueue_string(gen, TEST_STRING);
+	const uint64_t duration = cw_gen_get_queue_duration(gen);
+
+	cw_sample_t * samples = (cw_sample_t *) malloc(sizeof (cw_sample_t) * TEST_BLOCK_N_SAMPLES);
+	if (NULL == samples) {
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	int64_t n_rendered = 0;
+	int n = 0;
+	do {
+		n = cw_gen_render_internal(gen, samples, TEST_BLOCK_N_SAMPLES);
+		n_rendered += n;
+	} while (n == TEST_BLOCK_N_SAMPLES);
+	free(samples);
+
+	const double n_exact = ((double) duration * gen->sample_rate / CW_USECS_PER_SEC) * (1.0 + (double) drift_ppb / 1e9);
+	cw_gen_delete(&gen);
+
+	const int64_t n_expected = (int64_t) n_exact;
+	if (drift_compensation) {
+		cte->expect_op_int(cte, (int) (n_expected - 1), "<=", (int) n_rendered, "count of samples with compensation, drift %d ppb (lower bound)", (int) drift_ppb);
+		cte->expect_op_int(cte, (int) (n_expected + 1), ">=", (int) n_rendered, "count of samples with compensation, drift %d ppb (upper bound)", (int) drift_ppb);
+	} else {
+		cte->expect_op_int(cte, (int) (n_expected - 1), ">", (int) n_rendered, "count of samples without compensation is less than exact count");
+	}
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_DRIFT_COMPENSATION_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_DRIFT_COMPENSATION_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_drift_compensation(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_DRIFT_COMPENSATION_H_ */
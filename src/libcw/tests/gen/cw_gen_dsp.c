@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_dsp.c
+
+   Test of post-processing chain of generator's samples
+*/
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_dsp.h"
+#include "cw_gen_dsp.h"
+
+
+
+
+#define TEST_N_SAMPLES 8192
+#define TEST_AMPLITUDE 10000.0
+#define TEST_PI 3.14159265358979323846
+
+
+
+
+static double test_rms_of_processed_sine(cw_gen_t * gen, cw_sample_t * samples, int frequency);
+static cwt_retv test_output_stage(cw_test_executor_t * cte, cw_gen_t * gen, cw_sample_t * samples);
+
+
+
+
+/**
+   @brief Test adding stages to generator's post-processing chain and their effect on samples
+
+   Samples are processed by calling cw_gen_dsp_process_internal()
+   directly, so the test doesn't depend on sound system.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_dsp(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_sample_t * samples = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == gen || NULL == samples) {
+		cte->log_error(cte, "%s:%d: Failed to allocate test data\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		free(samples);
+		return cwt_retv_err;
+	}
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_bandpass)(gen, (int) gen->sample_rate, 100), "adding filter above Nyquist frequency");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of adding filter above Nyquist frequency");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_noise)(gen, 0), "adding noise with zero level");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of adding noise with zero level");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_fading)(gen, 101, 1000000), "adding fading with too large depth");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of adding fading with too large depth");
+
+	/* Without stages samples are not modified. */
+	const double rms_unprocessed = test_rms_of_processed_sine(gen, samples, 700);
+	cte->expect_op_double(cte, TEST_AMPLITUDE / sqrt(2.0) * 0.99, "<", rms_unprocessed, "RMS of samples without processing");
+
+	/* Filter passes its center frequency and attenuates far
+	   frequency. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_bandpass)(gen, 700, 200), "adding filter");
+	const double rms_center = test_rms_of_processed_sine(gen, samples, 700);
+	cw_gen_clear_dsp(gen);
+	cw_gen_add_dsp_bandpass(gen, 700, 200);
+	const double rms_far = test_rms_of_processed_sine(gen, samples, 3000);
+	cte->expect_op_double(cte, rms_unprocessed * 0.9, "<", rms_center, "RMS of center frequency after filter");
+	cte->expect_op_double(cte, rms_unprocessed * 0.1, ">", rms_far, "RMS of far frequency after filter");
+
+	/* Noise is added to silence, within bounds of samples. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_clear_dsp)(gen), "clearing chain");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_noise)(gen, 10), "adding noise");
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		samples[i] = 0;
+	}
+	cw_gen_dsp_process_internal(gen, samples, TEST_N_SAMPLES);
+	double sum = 0.0;
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		sum += (double) samples[i] * samples[i];
+	}
+	const double rms_noise = sqrt(sum / TEST_N_SAMPLES);
+	cte->expect_op_double(cte, (double) CW_GEN_SAMPLE_VALUE_MAX * 0.05, "<", rms_noise, "RMS of noise, lower bound");
+	cte->expect_op_double(cte, (double) CW_GEN_SAMPLE_VALUE_MAX * 0.15, ">", rms_noise, "RMS of noise, upper bound");
+
+	/* Full-depth fading with phase starting at full gain
+	   attenuates half of its period. */
+	cw_gen_clear_dsp(gen);
+	const int period = (int) (1000000.0 * 2 * TEST_N_SAMPLES / gen->sample_rate);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_fading)(gen, 100, period), "adding fading");
+	const double rms_fading = test_rms_of_processed_sine(gen, samples, 700);
+	cte->expect_op_double(cte, rms_unprocessed * 0.95, ">", rms_fading, "RMS of samples after fading");
+
+	/* Chain has limited length. */
+	cw_gen_clear_dsp(gen);
+	for (int i = 0; i < CW_GEN_DSP_N_STAGES_MAX; i++) {
+		cw_gen_add_dsp_noise(gen, 1);
+	}
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_add_dsp_noise)(gen, 1), "adding stage to full chain");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of adding stage to full chain");
+
+	cw_gen_clear_dsp(gen);
+	cte->expect_op_double(cte, 0.001, ">", fabs(rms_unprocessed - test_rms_of_processed_sine(gen, samples, 700)), "RMS of samples after clearing chain");
+
+	const cwt_retv retv = test_output_stage(cte, gen, samples);
+
+	free(samples);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Process samples of sine wave with generator's chain, return RMS of the result
+
+   @param[in] gen generator
+   @param[out] samples buffer of TEST_N_SAMPLES samples
+   @param[in] frequency frequency of sine wave
+
+   @return RMS of processed samples, with first quarter of samples skipped to let filters settle
+*/
+static double test_rms_of_processed_sine(cw_gen_t * gen, cw_sample_t * samples, int frequency)
+{
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		samples[i] = (cw_sample_t) (TEST_AMPLITUDE * sin(2.0 * TEST_PI * frequency * i / gen->sample_rate));
+	}
+	cw_gen_dsp_process_internal(gen, samples, TEST_N_SAMPLES);
+
+	double sum = 0.0;
+	for (int i = TEST_N_SAMPLES / 4; i < TEST_N_SAMPLES; i++) {
+		sum += (double) samples[i] * samples[i];
+	}
+	return sqrt(sum / (TEST_N_SAMPLES - TEST_N_SAMPLES / 4));
+}
+
+
+
+
+/**
+   @brief Test conversions at the end of post-processing chain
+
+   Processed float samples are converted straight to FLOAT32 device
+   buffer, not through cw_sample_t. Dither changes samples of silence
+   by at most one least significant bit.
+
+   @param cte test executor
+   @param[in] gen generator with empty chain and Null sound system
+   @param[out] samples buffer of TEST_N_SAMPLES samples
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+static cwt_retv test_output_stage(cw_test_executor_t * cte, cw_gen_t * gen, cw_sample_t * samples)
+{
+	/* Null sound system has no device buffer, pretend that device
+	   uses FLOAT32 samples. */
+	gen->sample_format = CW_SAMPLE_FORMAT_FLOAT32;
+	gen->n_channels = 1;
+	gen->device_buffer = calloc(TEST_N_SAMPLES, sizeof (float));
+	if (NULL == gen->device_buffer) {
+		cte->log_error(cte, "%s:%d: Failed to allocate test data\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const float * device_samples = (const float *) gen->device_buffer;
+
+	cw_gen_add_dsp_fading(gen, 50, 1000000);
+	test_rms_of_processed_sine(gen, samples, 700);
+	cte->expect_op_int(cte, true, "==", gen->device_buffer_filled, "device buffer filled by chain");
+	int n_mismatches = 0;
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		/* cw_sample_t is the float sample rounded to integer. */
+		if (fabs((double) device_samples[i] * 32768.0 - samples[i]) > 0.501) {
+			n_mismatches++;
+		}
+	}
+	cte->expect_op_int(cte, 0, "==", n_mismatches, "float samples in device buffer");
+
+	cw_gen_clear_dsp(gen);
+	test_rms_of_processed_sine(gen, samples, 700);
+	cte->expect_op_int(cte, false, "==", gen->device_buffer_filled, "device buffer not filled by empty chain");
+
+	/* Filter keeps silence silent, dither doesn't. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_set_dsp_dither)(gen, true), "enabling dither");
+	cw_gen_add_dsp_bandpass(gen, 700, 200);
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		samples[i] = 0;
+	}
+	cw_gen_dsp_process_internal(gen, samples, TEST_N_SAMPLES);
+	int n_nonzero = 0;
+	int n_out_of_range = 0;
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		n_nonzero += 0 != samples[i];
+		n_out_of_range += samples[i] < -1 || samples[i] > 1;
+	}
+	cte->expect_op_int(cte, 0, "<", n_nonzero, "dithered silence is not silent");
+	cte->expect_op_int(cte, 0, "==", n_out_of_range, "dither is within one least significant bit");
+	cte->expect_op_int(cte, 0, "==", (int) device_samples[TEST_N_SAMPLES / 2], "device samples are not dithered");
+
+	cw_gen_clear_dsp(gen);
+	free(gen->device_buffer);
+	gen->device_buffer = NULL;
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_enqueue_at.c
+
+   Test of scheduled start of enqueued string (cw_gen_enqueue_at()).
+*/
+
+
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_enqueue_at.h"
+
+
+
+
+/* How far in the future (from time of enqueueing) the string should start. [microseconds] */
+#define TEST_START_DELAY 300000
+
+/* String sent before the scheduled string, shorter than TEST_START_DELAY at 60 wpm. */
+#define TEST_PRECEDING_STRING "ee"
+
+
+
+
+typedef struct {
+	bool key_down_seen;
+	struct timeval key_down;
+} test_key_down_t;
+
+
+
+
+static void test_timed_callback_internal(void * callback_arg, int state, const struct timeval * playback_time);
+
+
+
+
+/**
+   @brief Test that first Mark of scheduled string starts at requested time
+
+   Null sound system with virtual clock is used, so the time of start
+   is exact and independent of load of test machine.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_at(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .null_virtual_clock = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+
+	struct timeval now = { 0 };
+	cw_gen_get_timestamp(gen, &now);
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_gen_enqueue_at(gen, &now, "e"), "enqueueing at time that has passed");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for time that has passed");
+
+	struct timeval start = now;
+	start.tv_usec += TEST_START_DELAY;
+	start.tv_sec += start.tv_usec / CW_USECS_PER_SEC;
+	start.tv_usec %= CW_USECS_PER_SEC;
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_gen_enqueue_at(gen, &start, "e%"), "enqueueing invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno for invalid string");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after failed enqueueing");
+
+	/* Preceding string ends before requested time, so the
+	   generator still has to insert silence when it gets to the
+	   scheduled string. */
+	test_key_down_t key_down = { 0 };
+	cw_gen_register_timed_value_tracking_callback_internal(gen, test_timed_callback_internal, &key_down);
+	cw_gen_enqueue_string(gen, TEST_PRECEDING_STRING);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_enqueue_at(gen, &start, "t"), "enqueueing scheduled string");
+	cw_gen_wait_for_queue_level(gen, 0);
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	/* Key-down of preceding string is at the time of enqueueing,
+	   the one we are interested in is key-down of 't'. */
+	cte->expect_op_int(cte, true, "==", key_down.key_down_seen, "key-down has been seen");
+	cte->expect_op_int(cte, 0, "==", cw_timestamp_compare_internal(&start, &key_down.key_down), "first Mark starts at requested time");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Record time of playback of last key-down
+
+   @param[in] callback_arg test_key_down_t variable
+   @param[in] state new value of generator
+   @param[in] playback_time time of playback of the change
+*/
+static void test_timed_callback_internal(void * callback_arg, int state, const struct timeval * playback_time)
+{
+	test_key_down_t * key_down = (test_key_down_t *) callback_arg;
+	if (CW_KEY_VALUE_CLOSED == state) {
+		key_down->key_down_seen = true;
+		key_down->key_down = *playback_time;
+	}
+}
@@ -334,6 +334,10 @@ static int get_tolerance(cw_test_executor_t * cte, cw_sound_system_t sound_syste
 		 *tolerance = TOLERANCE_PA;
 		break;
 	case CW_AUDIO_SOUNDCARD:
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_JACK:
+	case CW_AUDIO_PIPEWIRE:
+	case CW_AUDIO_RTP:
 		/* This sound system is known, but not expected in this
 		   place. Tests are for specific sound systems, not for
 		   catch-all "soundcard" sound system. */
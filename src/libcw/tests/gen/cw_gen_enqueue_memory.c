@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_enqueue_memory.c
+
+   Test of cw_gen_set_memory() and cw_gen_enqueue_memory()
+*/
+
+
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_memory.h"
+#include "cw_gen_enqueue_memory.h"
+
+
+
+
+#define TEST_MEMORY "cq test de n0call n0call test"
+
+/* Count of rendered samples: memory with long silence after it. */
+#define TEST_DURATION 20 /* [seconds] */
+
+
+
+
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte, int speed);
+static cwt_retv test_compare_with_characters(cw_test_executor_t * cte, cw_gen_t * gen, const char * string, int speed, const char * label);
+
+
+
+
+/**
+   @brief Test cw_gen_set_memory() and cw_gen_enqueue_memory()
+
+   Samples of played memory must be identical to samples of the same
+   characters enqueued one by one in generator with zero phase. Last
+   character of memory can be removed from tone queue, and memory is
+   rendered again when speed of generator changes.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_memory(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = test_new_gen(cte, 40);
+	if (NULL == gen) {
+		return cwt_retv_err;
+	}
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enqueue_memory)(gen, 0), "enqueueing empty memory");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of enqueueing empty memory");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_memory)(gen, CW_GEN_N_MEMORIES, "test"), "setting memory out of range");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of setting memory out of range");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_memory)(gen, 0, "test\x01"), "setting memory with invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of setting memory with invalid string");
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_set_memory)(gen, 0, TEST_MEMORY), "setting memory");
+
+	/* Every character is one item in tone queue. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_memory)(gen, 0), "enqueueing memory");
+	cte->expect_op_int(cte, (int) strlen(TEST_MEMORY), "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing memory");
+	if (cwt_retv_ok != test_compare_with_characters(cte, gen, TEST_MEMORY, 40, "memory")) {
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	/* Splice point at boundary of last character. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_memory)(gen, 0), "enqueueing memory again");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_remove_last_character(gen), "removing last character of memory");
+	if (cwt_retv_ok != test_compare_with_characters(cte, gen, "cq test de n0call n0call tes", 40, "memory without last character")) {
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	/* Rendition made at previous speed is replaced, and deleted when
+	   its characters have been played. */
+	cw_gen_set_speed(gen, 25);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_memory)(gen, 0), "enqueueing memory after change of speed");
+	cte->expect_op_int(cte, 1, "==", gen->memories->n_retired, "count of retired renditions before playback");
+	if (cwt_retv_ok != test_compare_with_characters(cte, gen, TEST_MEMORY, 25, "memory after change of speed")) {
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, 0, "==", gen->memories->n_retired, "count of retired renditions after playback");
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_set_memory)(gen, 0, NULL), "clearing memory");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enqueue_memory)(gen, 0), "enqueueing cleared memory");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of enqueueing cleared memory");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte, int speed)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return NULL;
+	}
+	cw_gen_set_speed(gen, speed);
+	cw_gen_set_frequency(gen, 650);
+	return gen;
+}
+
+
+
+
+/**
+   @brief Compare samples of tone queue of generator with samples of characters of string
+
+   Reference samples are rendered by a new generator with zero phase,
+   in which characters of @p string are enqueued one by one.
+
+   @param cte test executor
+   @param[in] gen generator with memory enqueued in its tone queue
+   @param[in] string expected contents of tone queue
+   @param[in] speed speed of @p gen
+   @param[in] label label of test
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_compare_with_characters(cw_test_executor_t * cte, cw_gen_t * gen, const char * string, int speed, const char * label)
+{
+	cw_gen_t * reference_gen = test_new_gen(cte, speed);
+	const size_t n_samples = (size_t) gen->sample_rate * TEST_DURATION;
+	cw_sample_t * samples = calloc(n_samples, sizeof (cw_sample_t));
+	cw_sample_t * reference = calloc(n_samples, sizeof (cw_sample_t));
+	if (NULL == reference_gen || NULL == samples || NULL == reference) {
+		cte->log_error(cte, "%s:%d: Failed to allocate test data\n", __func__, __LINE__);
+		cw_gen_delete(&reference_gen);
+		free(samples);
+		free(reference);
+		return cwt_retv_err;
+	}
+
+	reference_gen->phase_offset = 0.0F;
+	reference_gen->phase_acc = 0;
+	for (size_t i = 0; i < strlen(string); i++) {
+		cw_gen_enqueue_character(reference_gen, string[i]);
+	}
+	cw_gen_render(reference_gen, reference, n_samples);
+	cw_gen_render(gen, samples, n_samples);
+
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after rendering (%s)", label);
+	cte->expect_op_int(cte, 0, "==", memcmp(reference, samples, sizeof (cw_sample_t) * n_samples), "samples (%s)", label);
+
+	free(samples);
+	free(reference);
+	cw_gen_delete(&reference_gen);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_gen_enqueue_priority_string.c
+
+   Test of cw_gen_enqueue_priority_string() and of priority lane of tone
+   queue.
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_enqueue_priority_string.h"
+
+
+
+
+static void test_dequeue_until_first(cw_gen_t * gen, cw_tone_t * tone);
+
+
+
+
+/**
+   @brief Test enqueueing of characters ahead of already queued characters
+
+   Tones are dequeued one by one, so the test can check where priority
+   tones land relative to a character that has started playing.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_priority_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+
+	/* Invalid arguments. */
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_priority_string)(NULL, "T");
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing priority string in NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing priority string in NULL generator");
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_priority_string)(gen, "T\x01");
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing invalid priority string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno after enqueueing invalid priority string");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing invalid priority string");
+
+
+	/* Priority character is played at the end of character that is
+	   being played. */
+	cw_gen_enqueue_string(gen, "EE");
+	const size_t len_main = cw_gen_get_queue_length(gen);
+	cw_tone_t dot;
+	cw_tq_dequeue_internal(gen->tq, &dot);
+	cte->expect_op_int(cte, true, "==", dot.is_first, "first dequeued tone is first tone of character");
+
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_priority_string)(gen, "T");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing priority string");
+	cte->expect_op_int(cte, true, "==", cw_gen_get_queue_length(gen) > len_main - 1, "queue length after enqueueing priority string");
+	cte->expect_op_int(cte, 1, "==", (int) cw_gen_get_queue_n_characters(gen), "priority characters are not counted as characters of queue");
+
+	cw_tone_t tone;
+	test_dequeue_until_first(gen, &tone);
+	cte->expect_op_int(cte, true, "==", tone.duration > dot.duration, "priority Dash is played after first character");
+	test_dequeue_until_first(gen, &tone);
+	cte->expect_op_int(cte, dot.duration, "==", tone.duration, "second character is played after priority character");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_n_characters(gen), "count of characters after dequeueing priority character");
+	cw_gen_flush_queue(gen);
+
+
+	/* Priority character in empty queue. */
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_priority_string)(gen, "T");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing priority string in empty queue");
+	cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", cw_tq_get_state_internal(gen->tq), "state of queue after enqueueing priority string in empty queue");
+	const cw_queue_state_t state = cw_tq_dequeue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, CW_TQ_NONEMPTY, "==", state, "state of queue after dequeueing first priority tone");
+	cte->expect_op_int(cte, true, "==", tone.is_first && tone.duration > dot.duration, "first priority tone is Dash");
+
+	/* Flushing the queue empties priority lane too. */
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after flushing");
+	cte->expect_op_int(cte, CW_TQ_EMPTY, "==", cw_tq_dequeue_internal(gen->tq, &tone), "dequeueing from flushed queue");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Dequeue tones until first tone of a character is dequeued
+
+   The first tone of character is returned through @p tone.
+*/
+static void test_dequeue_until_first(cw_gen_t * gen, cw_tone_t * tone)
+{
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, tone)) {
+		if (tone->is_first) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_enqueue_string_with_token.c
+
+   Test of tokens of enqueued strings (cw_gen_enqueue_string_with_token()).
+*/
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_enqueue_string_with_token.h"
+
+
+
+
+#define TEST_N_TOKENS_MAX 8
+
+/* How long to wait for calls of callback [seconds]. */
+#define TEST_CALLBACK_TIMEOUT 5
+
+
+
+
+/* Tokens passed to callback. Callback is called after the token is
+   completed, so the fields are protected by ::mutex, and test waits
+   on ::cond for the calls. */
+typedef struct {
+	uint64_t tokens[TEST_N_TOKENS_MAX];
+	int n_calls;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} test_completed_tokens_t;
+
+
+
+
+static void test_token_callback(void * arg, uint64_t token);
+static int test_wait_for_calls(test_completed_tokens_t * completed, int n_calls);
+
+
+
+
+/**
+   @brief Test completion of tokens of enqueued strings
+
+   Strings are enqueued before generator is started, so that the
+   test can check which tokens are pending. Null sound system with
+   virtual clock is used, so tones are played quickly.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_string_with_token(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .null_virtual_clock = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 60);
+
+	test_completed_tokens_t completed = { .n_calls = 0 };
+	pthread_mutex_init(&completed.mutex, NULL);
+	pthread_cond_init(&completed.cond, NULL);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_register_token_callback)(gen, test_token_callback, &completed), "registering callback");
+
+	/* Invalid arguments and strings don't use up tokens. */
+	uint64_t token = 0;
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "e", NULL), "enqueueing without token");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of enqueueing without token");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "e%", &token), "enqueueing invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of enqueueing invalid string");
+
+	uint64_t tokens[4] = { 0 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "e", &tokens[0]), "enqueueing first string");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "te", &tokens[1]), "enqueueing second string");
+	cte->expect_op_int(cte, 1, "==", (int) tokens[0], "first token");
+	cte->expect_op_int(cte, 2, "==", (int) tokens[1], "second token");
+
+	/* Empty string and string whose last character is removed
+	   have no marked tone in queue, they are completed together
+	   with second string. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "", &tokens[2]), "enqueueing empty string");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enqueue_string_with_token)(gen, "e", &tokens[3]), "enqueueing fourth string");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_remove_last_character(gen), "removing last character");
+	for (int i = 0; i < 4; i++) {
+		cte->expect_op_int(cte, false, "==", LIBCW_TEST_FUT(cw_gen_is_token_completed)(gen, tokens[i]), "token %d is not completed before generator is started", i);
+	}
+	cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_gen_is_token_completed)(gen, 0), "zero token is completed");
+
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_wait_for_token)(gen, tokens[3] + 1), "waiting for token that has not been returned");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of waiting for token that has not been returned");
+
+	cw_gen_start(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_wait_for_token)(gen, tokens[3]), "waiting for last token");
+	for (int i = 0; i < 4; i++) {
+		cte->expect_op_int(cte, true, "==", cw_gen_is_token_completed(gen, tokens[i]), "token %d is completed", i);
+	}
+	/* Callback is called after tokens are completed. */
+	cte->expect_op_int(cte, 4, "==", test_wait_for_calls(&completed, 4), "count of calls of callback");
+	pthread_mutex_lock(&completed.mutex);
+	bool in_order = true;
+	for (int i = 0; i < 4; i++) {
+		in_order = in_order && completed.tokens[i] == tokens[i];
+	}
+	pthread_mutex_unlock(&completed.mutex);
+	cte->expect_op_int(cte, true, "==", in_order, "callback is called in order of tokens");
+
+	/* Flushing queue completes tokens of strings that won't be
+	   played. */
+	cw_gen_stop(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_enqueue_string_with_token(gen, "eeee", &token), "enqueueing string to be flushed");
+	cte->expect_op_int(cte, false, "==", cw_gen_is_token_completed(gen, token), "token of string to be flushed");
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, true, "==", cw_gen_is_token_completed(gen, token), "token of flushed string");
+	cte->expect_op_int(cte, 5, "==", test_wait_for_calls(&completed, 5), "count of calls of callback after flush");
+
+	cw_gen_delete(&gen);
+	pthread_cond_destroy(&completed.cond);
+	pthread_mutex_destroy(&completed.mutex);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Record completed token
+
+   @param[in] arg test_completed_tokens_t variable
+   @param[in] token completed token
+*/
+static void test_token_callback(void * arg, uint64_t token)
+{
+	test_completed_tokens_t * completed = (test_completed_tokens_t *) arg;
+	pthread_mutex_lock(&completed->mutex);
+	if (completed->n_calls < TEST_N_TOKENS_MAX) {
+		completed->tokens[completed->n_calls] = token;
+	}
+	completed->n_calls++;
+	pthread_cond_broadcast(&completed->cond);
+	pthread_mutex_unlock(&completed->mutex);
+}
+
+
+
+
+/**
+   @brief Wait until callback has been called given count of times
+
+   @param[in] completed test_completed_tokens_t variable
+   @param[in] n_calls expected count of calls
+
+   @return count of calls of callback, smaller than @p n_calls on timeout
+*/
+static int test_wait_for_calls(test_completed_tokens_t * completed, int n_calls)
+{
+	struct timespec deadline = { 0 };
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += TEST_CALLBACK_TIMEOUT;
+
+	pthread_mutex_lock(&completed->mutex);
+	while (completed->n_calls < n_calls) {
+		if (0 != pthread_cond_timedwait(&completed->cond, &completed->mutex, &deadline)) {
+			break;
+		}
+	}
+	const int result = completed->n_calls;
+	pthread_mutex_unlock(&completed->mutex);
+
+	return result;
+}
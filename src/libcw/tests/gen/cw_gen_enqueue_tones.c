@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_enqueue_tones.c
+
+   Test of cw_gen_enqueue_tones() and of enqueueing characters as one
+   batch of tones.
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "libcw_tq_internal.h"
+#include "cw_gen_enqueue_tones.h"
+
+
+
+
+/* Parameters of tone queue used in the test. Small values make it easy
+   to reach high water mark. */
+#define TEST_CAPACITY          30
+#define TEST_HIGH_WATER_MARK   20
+
+
+
+
+static void test_fill_tones(cw_gen_tone_t * tones, size_t n_tones);
+
+
+
+
+/**
+   @brief Test cw_gen_enqueue_tones()
+
+   Tones must be enqueued according to all-or-nothing rule: invalid tone
+   or exceeding high water mark of tone queue results in no tones being
+   enqueued. The same rule applies to tones of a character.
+
+   Enqueued tones are checked in place, in slots of tone queue.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_tones(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+	cw_ret_t cwret = cw_tq_set_capacity_internal(gen->tq, TEST_CAPACITY, TEST_HIGH_WATER_MARK);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting capacity of tone queue");
+
+	cw_gen_tone_t tones[TEST_CAPACITY];
+
+
+	/* Invalid tone in the middle of valid tones. */
+	test_fill_tones(tones, 5);
+	tones[3].frequency = -1;
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, 5);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing batch with invalid tone");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing batch with invalid tone");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing batch with invalid tone");
+
+
+	/* Valid tones. Tone with zero duration is dropped. */
+	test_fill_tones(tones, 10);
+	tones[4].duration = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, 10);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing valid batch");
+	cte->expect_op_int(cte, 9, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing valid batch");
+	cte->expect_op_int(cte, tones[5].frequency, "==", gen->tq->queue[(gen->tq->head + 4) & gen->tq->slots_mask].frequency, "frequency of tone after dropped tone");
+
+
+	/* 9 + 12 tones would exceed high water mark. */
+	test_fill_tones(tones, 12);
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, 12);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing batch above high water mark");
+	cte->expect_op_int(cte, EAGAIN, "==", errno, "errno after enqueueing batch above high water mark");
+	cte->expect_op_int(cte, 9, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing batch above high water mark");
+
+
+	/* 9 + 11 tones reach the high water mark exactly. */
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_tones)(gen, tones, 11);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing batch up to high water mark");
+	cte->expect_op_int(cte, TEST_HIGH_WATER_MARK, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing batch up to high water mark");
+
+
+	/* Character: 'P' is ".--.", i.e. 4 marks, 3 inter-mark-spaces and
+	   last inter-mark-space merged with inter-character-space. 8 tones. */
+	cw_gen_flush_queue(gen);
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, 'P');
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing character");
+	cte->expect_op_int(cte, 8, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing character");
+	cte->expect_op_int(cte, true, "==", gen->tq->queue[gen->tq->head].is_first, "first tone of character");
+
+	/* Room for 12 more tones below high water mark: second 'P' fits,
+	   third one doesn't fit and none of its tones are enqueued. */
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, 'P');
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing second character");
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, 'P');
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing third character");
+	cte->expect_op_int(cte, 16, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing third character");
+
+	/* The last complete character can be removed. */
+	cwret = cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "removing last character");
+	cte->expect_op_int(cte, 8, "==", (int) cw_gen_get_queue_length(gen), "queue length after removing last character");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Fill array of tones with valid tones
+
+   @param[out] tones array of tones to fill
+   @param[in] n_tones count of tones in @p tones
+*/
+static void test_fill_tones(cw_gen_tone_t * tones, size_t n_tones)
+{
+	for (size_t i = 0; i < n_tones; i++) {
+		tones[i].frequency = (i % 2) ? 0 : (int) (500 + 10 * i);
+		tones[i].duration = 10000;
+	}
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_enqueue_translated_string.c
+
+   Test of cw_gen_enqueue_translated_string().
+*/
+
+
+
+
+#include <errno.h>
+#include <string.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_enqueue_translated_string.h"
+
+
+
+
+/**
+   @brief Test that translated string is enqueued with the same tones as the string
+
+   Tones of the string and of the translated string are dequeued and
+   compared one by one.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_translated_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+	/* Long string doesn't fit in local buffer of cw_gen_enqueue_string(). */
+	char string[CW_GEN_TRANSLATED_STRING_LOCAL_CAPACITY + 45] = { 0 };
+	for (size_t i = 0; i < sizeof (string) - 1; i++) {
+		string[i] = "paris PARIS 0123 "[i % 17];
+	}
+	uint8_t translated[sizeof (string)] = { 0 };
+	size_t n_translated = 0;
+	cw_translate_string(string, translated, sizeof (translated), &n_translated);
+
+	static cw_tone_t tones[CW_TONE_QUEUE_CAPACITY_MAX];
+	size_t n_tones = 0;
+	cw_ret_t cwret = cw_gen_enqueue_string(gen, string);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing long string");
+	while (n_tones < sizeof (tones) / sizeof (tones[0]) && CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tones[n_tones])) {
+		n_tones++;
+	}
+
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_translated_string)(gen, translated, n_translated);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing translated string");
+	cte->expect_op_int(cte, (int) n_tones, "==", (int) cw_gen_get_queue_length(gen), "count of tones of translated string");
+
+	bool failure = false;
+	for (size_t i = 0; i < n_tones; i++) {
+		cw_tone_t tone;
+		cw_tq_dequeue_internal(gen->tq, &tone);
+		if (tone.duration != tones[i].duration || tone.frequency != tones[i].frequency || tone.is_first != tones[i].is_first) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "tones of translated string");
+
+
+	/* Invalid arguments. */
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_translated_string)(NULL, translated, n_translated);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing translated string in NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing translated string in NULL generator");
+
+	const uint8_t invalid[] = { translated[0], 0x01 };
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_translated_string)(gen, invalid, sizeof (invalid));
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing invalid translated string");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing invalid translated string");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing invalid translated string");
+
+	errno = 0;
+	cwret = cw_gen_enqueue_string(gen, "PARIS\x01");
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno after enqueueing invalid string");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing invalid string");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_enqueue_utf8_string.c
+
+   Test of cw_gen_enqueue_utf8_string().
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_enqueue_utf8_string.h"
+
+
+
+
+/**
+   @brief Test enqueueing of UTF-8 strings with characters of alphabet
+
+   Tones of UTF-8 string and of string of equivalent Latin characters
+   are dequeued and compared one by one.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_enqueue_utf8_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+	cw_alphabet_t * alphabet = cw_alphabet_new_builtin(CW_ALPHABET_CYRILLIC);
+	if (NULL == alphabet) {
+		cte->log_error(cte, "%s:%d: Failed to create alphabet\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	/* Characters of the two strings have the same representations. */
+	const char * cyrillic = "\xD0\x9F\xD0\xA0\xD0\x98\xD0\x92\xD0\x95\xD0\xA2 \xD0\xBC\xD0\xB8\xD1\x80 73"; /* "ПРИВЕТ мир 73" */
+	const char * latin = "PRIWET MIR 73";
+
+	static cw_tone_t tones[CW_TONE_QUEUE_CAPACITY_MAX];
+	size_t n_tones = 0;
+	cw_gen_enqueue_string(gen, latin);
+	while (n_tones < sizeof (tones) / sizeof (tones[0]) && CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tones[n_tones])) {
+		n_tones++;
+	}
+
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, alphabet, cyrillic);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing UTF-8 string");
+	cte->expect_op_int(cte, (int) n_tones, "==", (int) cw_gen_get_queue_length(gen), "count of tones of UTF-8 string");
+	cte->expect_op_int(cte, 11, "==", (int) cw_gen_get_queue_n_characters(gen), "count of characters of UTF-8 string");
+
+	bool failure = false;
+	for (size_t i = 0; i < n_tones; i++) {
+		cw_tone_t tone;
+		cw_tq_dequeue_internal(gen->tq, &tone);
+		if (tone.duration != tones[i].duration || tone.frequency != tones[i].frequency || tone.is_first != tones[i].is_first) {
+			failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", failure, "tones of UTF-8 string");
+
+
+	/* Invalid strings. Nothing is enqueued. */
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, alphabet, "\xD0\x9F\xD0");
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing invalid UTF-8 string");
+	cte->expect_op_int(cte, EILSEQ, "==", errno, "errno after enqueueing invalid UTF-8 string");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, alphabet, "\xD0\x9F\xCE\x91"); /* Cyrillic and Greek letters. */
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing string with character from other alphabet");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno after enqueueing string with character from other alphabet");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after enqueueing invalid strings");
+
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_enqueue_utf8_string)(gen, NULL, latin);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing UTF-8 string without alphabet");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enqueueing UTF-8 string without alphabet");
+
+	cw_alphabet_delete(&alphabet);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
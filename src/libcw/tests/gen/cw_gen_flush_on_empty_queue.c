@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_flush_on_empty_queue.c
+
+   Test of flushing of partially filled buffer of generator when tone
+   queue becomes empty (cw_gen_config_t::flush_on_empty_queue), and of
+   cw_gen_get_end_of_sound_time().
+*/
+
+
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_flush_on_empty_queue.h"
+
+
+
+
+/* Character sent in the test: a Dot followed by inter-character-space
+   takes 4 units, which is less than one buffer of File sound system. */
+#define TEST_CHARACTER 'e'
+#define TEST_CHARACTER_N_DOTS 4
+
+/* How long to wait for generator to record end of sound. [microseconds] */
+#define TEST_END_OF_SOUND_TIMEOUT (2 * CW_USECS_PER_SEC)
+
+
+
+
+static cwt_retv test_send_internal(cw_test_executor_t * cte, bool flush_on_empty_queue);
+
+
+
+
+/**
+   @brief Test flushing of partially filled buffer on empty tone queue
+
+   A character shorter than generator's buffer is sent to a file. With
+   flushing, its samples are in the file as soon as generator records
+   end of sound. Without flushing, the samples still wait in
+   generator's buffer at that time.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_flush_on_empty_queue(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_send_internal(cte, false)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_send_internal(cte, true)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Send test character to file, check file and end of sound
+
+   @param cte test executor
+   @param[in] flush_on_empty_queue whether generator flushes its buffer
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_send_internal(cw_test_executor_t * cte, bool flush_on_empty_queue)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_flush_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.flush_on_empty_queue = flush_on_empty_queue;
+	gen_conf.pipeline_n_buffers = 0;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	struct timeval end = { 0 };
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_gen_get_end_of_sound_time(gen, &end), "end of sound before start of generator");
+	cte->expect_op_int(cte, ENODATA, "==", errno, "errno for end of sound before start of generator");
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+
+	/* Generator records end of sound also when it finds tone queue
+	   empty right after start. */
+	struct timeval initial_end = { 0 };
+	int waited = 0;
+	while (CW_SUCCESS != cw_gen_get_end_of_sound_time(gen, &initial_end) && waited < TEST_END_OF_SOUND_TIMEOUT) {
+		usleep(1000);
+		waited += 1000;
+	}
+
+	struct timeval before = { 0 };
+	cw_gen_get_timestamp(gen, &before);
+	cw_gen_enqueue_character(gen, TEST_CHARACTER);
+	cw_gen_wait_for_queue_level(gen, 0);
+
+	waited = 0;
+	bool end_recorded = false;
+	while (!end_recorded && waited < TEST_END_OF_SOUND_TIMEOUT) {
+		cw_gen_get_end_of_sound_time(gen, &end);
+		end_recorded = 0 != cw_timestamp_compare_internal(&initial_end, &end);
+		if (!end_recorded) {
+			usleep(1000);
+			waited += 1000;
+		}
+	}
+	cte->expect_op_int(cte, true, "==", end_recorded, "end of sound has been recorded (flush = %d)", flush_on_empty_queue);
+	cte->expect_op_int(cte, 0, "<", cw_timestamp_compare_internal(&before, &end), "end of sound is after enqueueing (flush = %d)", flush_on_empty_queue);
+
+	struct stat file_stat = { 0 };
+	const int stat_rv = stat(path, &file_stat);
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+	const int64_t n_expected = ((int64_t) TEST_CHARACTER_N_DOTS * durations.dot_duration * gen->sample_rate) / CW_USECS_PER_SEC;
+	const int buffer_n_samples = gen->buffer_n_samples;
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	unlink(path);
+
+	if (0 != stat_rv) {
+		cte->log_error(cte, "%s:%d: Failed to stat output file %s\n", __func__, __LINE__, path);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, buffer_n_samples, ">", (int) n_expected, "character is shorter than buffer");
+
+	const int64_t n_written = (int64_t) file_stat.st_size / (int64_t) sizeof (cw_sample_t);
+	if (flush_on_empty_queue) {
+		/* Durations of tones are rounded to whole samples. */
+		const int64_t margin = n_expected / 50;
+		cte->expect_op_int(cte, (int) (n_expected - margin), "<=", (int) n_written, "count of flushed samples (lower bound)");
+		cte->expect_op_int(cte, (int) (n_expected + margin), ">=", (int) n_written, "count of flushed samples (upper bound)");
+	} else {
+		cte->expect_op_int(cte, 0, "==", (int) n_written, "count of samples written without flush");
+	}
+
+	return cwt_retv_ok;
+}
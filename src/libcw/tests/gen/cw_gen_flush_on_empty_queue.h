@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_FLUSH_ON_EMPTY_QUEUE_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_FLUSH_ON_EMPTY_QUEUE_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_flush_on_empty_queue(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_FLUSH_ON_EMPTY_QUEUE_H_ */
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_get_metrics.c
+
+   Test of cw_gen_get_metrics() and cw_gen_export_metrics().
+*/
+
+
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_get_metrics.h"
+
+
+
+
+static void test_metrics_write(void * callback_arg, const char * text, size_t length);
+
+
+
+
+/**
+   @brief Test getting runtime metrics of generator
+
+   A text is rendered by generator using File sound system, so that
+   generator writes buffers of samples as fast as possible.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_metrics(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_metrics_%ld.wav", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+
+	/* Invalid arguments. */
+	cw_gen_metrics_t metrics;
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_get_metrics)(NULL, &metrics);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting metrics of NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting metrics of NULL generator");
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_metrics)(gen, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting metrics into NULL pointer");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting metrics into NULL pointer");
+
+
+	/* Generator that hasn't done anything yet. */
+	cwret = LIBCW_TEST_FUT(cw_gen_get_metrics)(gen, &metrics);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting metrics of new generator");
+	cte->expect_op_int(cte, 0, "==", (int) metrics.n_buffers_written, "buffers written by new generator");
+	cte->expect_op_int(cte, 0, "==", (int) metrics.queue_length_peak, "queue peak of new generator");
+	cte->expect_op_int(cte, gen->buffer_n_samples, "==", metrics.period_n_samples, "period of new generator");
+	cte->expect_op_int(cte, gen->sound_device_latency, "==", metrics.device_latency, "device latency of new generator");
+
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	/* Let generator's thread start waiting for tones. */
+	usleep(100 * 1000);
+
+	const char * text = "paris paris";
+	cw_gen_enqueue_string(gen, text);
+	const size_t queue_length = cw_gen_get_queue_length(gen);
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	cwret = LIBCW_TEST_FUT(cw_gen_get_metrics)(gen, &metrics);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting metrics of generator");
+	cte->expect_op_int(cte, 0, "<", (int) metrics.n_buffers_written, "buffers written");
+	cte->expect_op_int(cte, 0, "==", (int) metrics.n_underruns, "underruns");
+	cte->expect_op_int(cte, 1, "<=", (int) metrics.n_wakeups, "wakeups");
+	cte->expect_op_int(cte, (int) metrics.write_time_min, "<=", (int) metrics.write_time_avg, "min vs. avg write time");
+	cte->expect_op_int(cte, (int) metrics.write_time_avg, "<=", (int) metrics.write_time_max, "avg vs. max write time");
+	cte->expect_op_int(cte, (int) metrics.synthesis_time_avg, "<=", (int) metrics.synthesis_time_max, "avg vs. max synthesis time");
+	cte->expect_op_int(cte, (int) queue_length, "<=", (int) metrics.queue_length_peak, "queue peak");
+
+
+	cw_gen_delete(&gen);
+	unlink(path);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test exporting metrics of generator in OpenMetrics text format
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_export_metrics(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+
+	/* Invalid arguments. */
+	char text[4096] = { 0 };
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_export_metrics)(NULL, NULL, test_metrics_write, text);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "exporting metrics of NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after exporting metrics of NULL generator");
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_export_metrics)(gen, NULL, NULL, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "exporting metrics to NULL callback");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after exporting metrics to NULL callback");
+
+
+	/* Generator that hasn't done anything yet, without labels. */
+	cwret = LIBCW_TEST_FUT(cw_gen_export_metrics)(gen, NULL, test_metrics_write, text);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "exporting metrics of new generator");
+	cte->expect_op_int(cte, true, "==", NULL != strstr(text, "# TYPE cw_gen_buffers_written counter\n"), "type of counter");
+	cte->expect_op_int(cte, true, "==", NULL != strstr(text, "\ncw_gen_buffers_written_total 0\n"), "sample of counter without labels");
+	cte->expect_op_int(cte, true, "==", NULL != strstr(text, "\ncw_gen_queue_length 0\n"), "sample of gauge without labels");
+
+
+	/* Tones in queue of generator that isn't started, with labels. */
+	cw_gen_enqueue_string(gen, "paris");
+	const size_t queue_length = cw_gen_get_queue_length(gen);
+	char expected[64];
+	snprintf(expected, sizeof (expected), "\ncw_gen_queue_length{gen=\"a\"} %zu\n", queue_length);
+	text[0] = '\0';
+	cwret = LIBCW_TEST_FUT(cw_gen_export_metrics)(gen, "gen=\"a\"", test_metrics_write, text);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "exporting metrics of generator");
+	cte->expect_op_int(cte, 0, "<", (int) queue_length, "queue length");
+	cte->expect_op_int(cte, true, "==", NULL != strstr(text, expected), "queue length with labels");
+	cte->expect_op_int(cte, true, "==", NULL != strstr(text, "\ncw_gen_queue_characters{gen=\"a\"} 5\n"), "queued characters with labels");
+	cte->expect_op_int(cte, true, "==", NULL == strstr(text, "# EOF"), "no end of exposition");
+
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Append exported metrics to NUL-terminated text in 4096-byte buffer. */
+static void test_metrics_write(void * callback_arg, const char * text, size_t length)
+{
+	char * buffer = (char *) callback_arg;
+	const size_t used = strlen(buffer);
+	if (used + length < 4096) {
+		memcpy(buffer + used, text, length);
+		buffer[used + length] = '\0';
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_GET_METRICS_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_GET_METRICS_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_get_metrics(cw_test_executor_t * cte);
+cwt_retv test_cw_gen_export_metrics(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_GET_METRICS_H_ */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_get_queue_duration.c
+
+   Test of cw_gen_get_queue_duration().
+*/
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "libcw_tq_internal.h"
+#include "cw_gen_get_queue_duration.h"
+
+
+
+
+/**
+   @brief Test accounting of duration of tones in tone queue
+
+   Duration of queue must follow enqueueing, dequeueing, removing
+   characters and flushing of queue.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_queue_duration(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue of new generator");
+
+
+	/* Tones with known durations. Tone with zero duration is
+	   dropped and doesn't count. */
+	const cw_gen_tone_t tones[] = {
+		{ 500, 10000 },
+		{   0, 20000 },
+		{ 600,     0 },
+		{ 700, 40000 },
+	};
+	cw_ret_t cwret = cw_gen_enqueue_tones(gen, tones, sizeof (tones) / sizeof (tones[0]));
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing tones");
+	cte->expect_op_int(cte, 70000, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after enqueueing tones");
+
+	cw_tone_t tone;
+	cw_tq_dequeue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, 60000, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after dequeueing tone");
+
+
+	/* Removing a character gives back its duration. */
+	const int duration_before = (int) cw_gen_get_queue_duration(gen);
+	cwret = cw_gen_enqueue_character(gen, 'K');
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing character");
+	const int duration_of_char = (int) cw_gen_get_queue_duration(gen) - duration_before;
+	cte->expect_op_int(cte, 0, "<", duration_of_char, "duration of character");
+	cwret = cw_gen_enqueue_character(gen, 'K');
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enqueueing second character");
+	cte->expect_op_int(cte, duration_before + 2 * duration_of_char, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after enqueueing two characters");
+	cwret = cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "removing last character");
+	cte->expect_op_int(cte, duration_before + duration_of_char, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after removing last character");
+
+
+	/* Dequeueing all tones drains the duration. */
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tone)) {
+		;
+	}
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after dequeueing all tones");
+
+
+	cw_gen_enqueue_string(gen, "PARIS");
+	cte->expect_op_int(cte, 0, "<", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after enqueueing string");
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_duration)(gen), "duration of queue after flushing");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_GET_QUEUE_DURATION_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_GET_QUEUE_DURATION_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_get_queue_duration(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_GET_QUEUE_DURATION_H_ */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_get_queue_event_fd.c
+
+   Test of cw_gen_get_queue_event_fd() and cw_gen_clear_queue_event().
+*/
+
+
+
+
+#include <poll.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_get_queue_event_fd.h"
+
+
+
+
+static bool test_is_readable(int fd);
+
+
+
+
+/**
+   @brief Test pollable descriptor of generator's tone queue
+
+   Dequeueing of a tone by the test must make the descriptor readable,
+   just like playing of the tone would.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_queue_event_fd(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+	const int fd = LIBCW_TEST_FUT(cw_gen_get_queue_event_fd)(gen);
+	cte->expect_op_int(cte, 0, "<=", fd, "getting descriptor");
+	cte->expect_op_int(cte, fd, "==", LIBCW_TEST_FUT(cw_gen_get_queue_event_fd)(gen), "getting descriptor again");
+	cte->expect_op_int(cte, false, "==", test_is_readable(fd), "descriptor of new generator is readable");
+
+	/* Many events before clearing. */
+	const cw_gen_tone_t tones[] = { { 500, 10000 }, { 600, 10000 } };
+	cw_gen_enqueue_tones(gen, tones, 1);
+	cte->expect_op_int(cte, true, "==", test_is_readable(fd), "descriptor is readable after enqueueing");
+	cw_gen_enqueue_tones(gen, tones + 1, 1);
+	cte->expect_op_int(cte, true, "==", test_is_readable(fd), "descriptor is readable after enqueueing again");
+	LIBCW_TEST_FUT(cw_gen_clear_queue_event)(gen);
+	cte->expect_op_int(cte, false, "==", test_is_readable(fd), "descriptor is readable after clearing");
+
+	cw_tone_t tone;
+	cw_tq_dequeue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, true, "==", test_is_readable(fd), "descriptor is readable after dequeueing");
+	LIBCW_TEST_FUT(cw_gen_clear_queue_event)(gen);
+
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, true, "==", test_is_readable(fd), "descriptor is readable after flushing");
+	LIBCW_TEST_FUT(cw_gen_clear_queue_event)(gen);
+
+	/* Nothing happens in empty queue. */
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, false, "==", test_is_readable(fd), "descriptor is readable after flushing empty queue");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static bool test_is_readable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+	return 1 == poll(&pfd, 1, 0) && (pfd.revents & POLLIN);
+}
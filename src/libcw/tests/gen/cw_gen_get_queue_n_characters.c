@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_get_queue_n_characters.c
+
+   Test of cw_gen_get_queue_n_characters() and of index of characters
+   used by cw_gen_remove_last_character().
+*/
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "libcw_tq_internal.h"
+#include "cw_gen_get_queue_n_characters.h"
+
+
+
+
+/* Count of characters larger than initial size of index of characters
+   in tone queue. */
+#define TEST_N_CHARS 600
+
+
+
+
+static bool test_remove_characters(cw_test_executor_t * cte, cw_gen_t * gen, int n_chars);
+
+
+
+
+/**
+   @brief Test counting and removing of characters in tone queue
+
+   Dequeueing of first tone of a character by the test stands in for
+   the character starting to play.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_queue_n_characters(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters in new generator");
+
+
+	/* Removing last character leaves the same tones as enqueueing
+	   one character less. */
+	cw_gen_enqueue_string(gen, "PARI");
+	const size_t len_4 = cw_gen_get_queue_length(gen);
+	cw_gen_flush_queue(gen);
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after flushing");
+
+	cw_gen_enqueue_string(gen, "PARIS");
+	cte->expect_op_int(cte, 5, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after enqueueing string");
+	cw_ret_t cwret = cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "removing last character");
+	cte->expect_op_int(cte, 4, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after removing last character");
+	cte->expect_op_int(cte, len_4, "==", cw_gen_get_queue_length(gen), "queue length after removing last character");
+
+
+	/* Character that has started playing is not counted, and can't
+	   be removed. */
+	cw_tone_t tone;
+	cw_tq_dequeue_internal(gen->tq, &tone);
+	cte->expect_op_int(cte, true, "==", tone.is_first, "first dequeued tone is first tone of character");
+	cte->expect_op_int(cte, 3, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after dequeueing first tone");
+	cte->expect_op_int(cte, false, "==", test_remove_characters(cte, gen, 3), "removing characters that haven't started playing");
+	cwret = cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "removing character that has started playing");
+	cte->expect_op_int(cte, true, "==", cw_gen_get_queue_length(gen) > 0, "queue length after failed removal");
+	cw_gen_flush_queue(gen);
+
+
+	/* More characters than initial size of index of characters. */
+	cwret = cw_gen_set_queue_capacity(gen, 5000, 5000);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting capacity of tone queue");
+	bool failure = false;
+	for (int i = 0; i < TEST_N_CHARS && !failure; i++) {
+		cwret = cw_gen_enqueue_character(gen, 'E');
+		failure = !cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueueing character #%d", i);
+	}
+	cte->expect_op_int(cte, false, "==", failure, "enqueueing many characters");
+	cte->expect_op_int(cte, TEST_N_CHARS, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after enqueueing many characters");
+	cte->expect_op_int(cte, false, "==", test_remove_characters(cte, gen, TEST_N_CHARS), "removing many characters");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after removing all characters");
+	cwret = cw_gen_remove_last_character(gen);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "removing character from empty queue");
+
+
+	/* Entries of dequeued characters are re-used. */
+	for (int i = 0; i < TEST_N_CHARS; i++) {
+		cw_gen_enqueue_character(gen, 'E');
+	}
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tone)) {
+		;
+	}
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after dequeueing all tones");
+	for (int i = 0; i < TEST_N_CHARS; i++) {
+		cw_gen_enqueue_character(gen, 'E');
+	}
+	cte->expect_op_int(cte, TEST_N_CHARS, "==", (int) LIBCW_TEST_FUT(cw_gen_get_queue_n_characters)(gen), "count of characters after enqueueing characters again");
+	cte->expect_op_int(cte, false, "==", test_remove_characters(cte, gen, TEST_N_CHARS), "removing characters enqueued again");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after removing characters enqueued again");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Remove @p n_chars characters from end of generator's queue
+
+   Count of characters in queue is checked after each removal.
+
+   @return false if all characters have been removed as expected
+   @return true otherwise
+*/
+static bool test_remove_characters(cw_test_executor_t * cte, cw_gen_t * gen, int n_chars)
+{
+	for (int i = n_chars; i > 0; i--) {
+		const cw_ret_t cwret = cw_gen_remove_last_character(gen);
+		if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "removing character #%d", i)) {
+			return true;
+		}
+		const int n_left = (int) cw_gen_get_queue_n_characters(gen);
+		if (!cte->expect_op_int_errors_only(cte, i - 1, "==", n_left, "count of characters after removing character #%d", i)) {
+			return true;
+		}
+	}
+	return false;
+}
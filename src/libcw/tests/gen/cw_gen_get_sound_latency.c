@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_get_sound_latency.c
+
+   Test of cw_gen_get_sound_latency().
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_get_sound_latency.h"
+
+
+
+
+/**
+   @brief Test getting latency of sound output of generator
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_sound_latency(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+
+	/* Invalid arguments. */
+	int latency = -1;
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_get_sound_latency)(NULL, &latency);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting latency of NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting latency of NULL generator");
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_gen_get_sound_latency)(gen, NULL);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "getting latency into NULL pointer");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after getting latency into NULL pointer");
+
+
+	/* Valid call. Latency can't be shorter than duration of
+	   generator's own buffer. Null and Console sound systems don't
+	   have the buffer. */
+	int buffer_duration = 0;
+	if (gen->buffer_n_samples > 0) {
+		buffer_duration = (int) (((int64_t) gen->buffer_n_samples * CW_USECS_PER_SEC) / gen->sample_rate);
+	}
+	cwret = LIBCW_TEST_FUT(cw_gen_get_sound_latency)(gen, &latency);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting latency of generator");
+	cte->expect_op_int(cte, buffer_duration, "<=", latency, "latency vs. duration of generator's buffer");
+	cte->expect_op_int(cte, buffer_duration + gen->sound_device_latency, "==", latency, "latency vs. sum of buffer and device latencies");
+
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_gen_get_timestamp.c
+
+   Test of virtual clock of Null sound system, read with
+   cw_gen_get_timestamp().
+*/
+
+
+
+
+#include <sys/time.h>
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_get_timestamp.h"
+
+
+
+
+#define N_EVENTS_MAX 16
+
+
+
+
+typedef struct {
+	cw_gen_t * gen;
+	int n_events;
+	struct {
+		int state;
+		struct timeval timestamp;
+	} events[N_EVENTS_MAX];
+} timestamp_callback_data_t;
+
+
+
+
+static void timestamp_callback_fn(void * callback_arg, int state);
+
+
+
+
+static void timestamp_callback_fn(void * callback_arg, int state)
+{
+	timestamp_callback_data_t * data = (timestamp_callback_data_t *) callback_arg;
+	if (data->n_events < N_EVENTS_MAX) {
+		data->events[data->n_events].state = state;
+		cw_gen_get_timestamp(data->gen, &data->events[data->n_events].timestamp);
+		data->n_events++;
+	}
+}
+
+
+
+
+/**
+   @brief Test that virtual clock advances by durations of tones without sleeping
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_get_timestamp(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .null_virtual_clock = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	/* At this speed the string below takes several seconds to play in real time. */
+	cw_gen_set_speed(gen, CW_SPEED_MIN);
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+	timestamp_callback_data_t data = { .gen = gen, .n_events = 0 };
+	cw_gen_register_value_tracking_callback_internal(gen, timestamp_callback_fn, &data);
+
+	struct timeval start = { 0 };
+	gettimeofday(&start, NULL);
+
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "tt");
+	cw_gen_wait_for_queue_level(gen, 0);
+
+	struct timeval end = { 0 };
+	gettimeofday(&end, NULL);
+
+	cw_gen_stop(gen);
+
+	/* Events: mark, space, mark, space. */
+	const bool enough_events = data.n_events >= 4;
+	cte->expect_op_int(cte, true, "==", enough_events, "count of state changes (%d)", data.n_events);
+	if (enough_events) {
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", data.events[0].state, "state of first event");
+		const int mark = cw_timestamp_compare_internal(&data.events[0].timestamp, &data.events[1].timestamp);
+		cte->expect_op_int(cte, durations.dash_duration, "==", mark, "virtual duration of mark");
+		const int space = cw_timestamp_compare_internal(&data.events[1].timestamp, &data.events[2].timestamp);
+		cte->expect_op_int(cte, durations.ims_duration, "<", space, "virtual duration of inter-character space");
+	}
+
+	/* Playing the string takes much less real time than
+	   duration of one of its marks. */
+	const int real_duration = cw_timestamp_compare_internal(&start, &end);
+	cte->expect_op_int(cte, durations.dash_duration, ">", real_duration, "duration of playing in real time");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
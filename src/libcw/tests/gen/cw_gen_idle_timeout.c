@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_idle_timeout.c
+
+   Test of idle mode of generator (cw_gen_config_t::idle_timeout).
+*/
+
+
+
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_idle_timeout.h"
+
+
+
+
+/* Idle timeout used in the test. [milliseconds] */
+#define TEST_IDLE_TIMEOUT 50
+
+/* How long to wait for generator to go idle. [microseconds] */
+#define TEST_IDLE_WAIT_MAX (2 * CW_USECS_PER_SEC)
+
+
+
+
+static long test_file_size(const char * path);
+
+
+
+
+/**
+   @brief Test stopping of silent 'forever' tone of straight key in idle mode
+
+   Straight key leaves silent 'forever' tone in tone queue. Generator
+   with idle timeout stops writing the silence to sound sink after the
+   timeout, and starts writing again when next tone is enqueued.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_idle_timeout(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_idle_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.pipeline_n_buffers = 0;
+	gen_conf.idle_timeout = TEST_IDLE_TIMEOUT;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_start(gen);
+
+	/* Mark and Space of straight key. */
+	cw_gen_enqueue_sk_begin_mark_internal(gen);
+	usleep(10 * 1000);
+	cw_gen_enqueue_sk_begin_space_internal(gen);
+
+	int waited = 0;
+	while (0 != cw_gen_get_queue_length(gen) && waited < TEST_IDLE_WAIT_MAX) {
+		usleep(1000);
+		waited += 1000;
+	}
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "'forever' tone has been removed from queue");
+
+	const long idle_size = test_file_size(path);
+	usleep(3 * TEST_IDLE_TIMEOUT * 1000);
+	cte->expect_op_int(cte, idle_size, "==", test_file_size(path), "no samples are written by idle generator");
+
+	/* Idle generator plays next tones. */
+	cw_gen_enqueue_character(gen, 'e');
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+	cte->expect_op_int(cte, idle_size, "<", test_file_size(path), "samples are written after idle");
+
+	cw_gen_delete(&gen);
+	unlink(path);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Get size of file
+
+   @param[in] path path to file
+
+   @return size of file, -1 on errors
+*/
+static long test_file_size(const char * path)
+{
+	struct stat file_stat = { 0 };
+	if (0 != stat(path, &file_stat)) {
+		return -1;
+	}
+	return (long) file_stat.st_size;
+}
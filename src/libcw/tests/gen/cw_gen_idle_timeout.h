@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_IDLE_TIMEOUT_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_IDLE_TIMEOUT_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_idle_timeout(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_IDLE_TIMEOUT_H_ */
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_loopback_string.c
+
+   Test of cw_gen_loopback_string()
+*/
+
+
+
+
+#include <errno.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_loopback_string.h"
+
+
+
+
+/* Capacity of array of received characters. */
+#define TEST_N_DECODED_MAX 256
+
+
+
+
+static cwt_retv test_round_trip(cw_test_executor_t * cte, int speed, bool is_adaptive);
+
+
+
+
+/**
+   @brief Test cw_gen_loopback_string()
+
+   Strings sent by generator at a few speeds must be received
+   unchanged by fixed-speed and adaptive receivers.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_loopback_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int speeds[] = { CW_SPEED_MIN, CW_SPEED_INITIAL, 30, CW_SPEED_MAX };
+	for (size_t i = 0; i < sizeof (speeds) / sizeof (speeds[0]); i++) {
+		if (cwt_retv_ok != test_round_trip(cte, speeds[i], false)
+		    || cwt_retv_ok != test_round_trip(cte, speeds[i], true)) {
+			return cwt_retv_err;
+		}
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Send strings through loopback, compare received characters with sent ones
+
+   @param cte test executor
+   @param[in] speed speed of generator and of receiver
+   @param[in] is_adaptive whether receiver is in adaptive mode
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_round_trip(cw_test_executor_t * cte, int speed, bool is_adaptive)
+{
+	/* Loopback never uses generator's sound sink. */
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == gen || NULL == rec) {
+		cte->log_error(cte, "%s:%d: Failed to create generator or receiver\n", __func__, __LINE__);
+		if (NULL != gen) {
+			cw_gen_delete(&gen);
+		}
+		if (NULL != rec) {
+			cw_rec_delete(&rec);
+		}
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, speed);
+	cw_rec_set_speed(rec, speed);
+	if (is_adaptive) {
+		cw_rec_enable_adaptive_mode(rec);
+	} else {
+		cw_rec_disable_adaptive_mode(rec);
+	}
+
+	cw_rec_decoded_t decoded[TEST_N_DECODED_MAX];
+	size_t n_decoded = 0;
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_loopback_string)(NULL, rec, "e", decoded, TEST_N_DECODED_MAX, &n_decoded), "loopback with NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno for NULL generator");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_loopback_string)(gen, rec, "a%", decoded, TEST_N_DECODED_MAX, &n_decoded), "loopback of invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno for invalid string");
+
+	/* Round trip. The string is sent twice to check that virtual
+	   time continues between calls. Each inter-word-space is
+	   received as ' ', including the one ending the string. */
+	const char * string = "cq de sp5 paris? 73 ";
+	const char * expected = "CQ DE SP5 PARIS? 73 ";
+	const size_t len = strlen(expected);
+	int64_t previous_timestamp = -1;
+	for (int round = 0; round < 2; round++) {
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_loopback_string)(gen, rec, string, decoded, TEST_N_DECODED_MAX, &n_decoded);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "loopback at %d wpm, adaptive = %d", speed, is_adaptive);
+		cte->expect_op_int(cte, (int) len, "==", (int) n_decoded, "count of received characters at %d wpm, adaptive = %d", speed, is_adaptive);
+
+		bool mismatch = n_decoded != len;
+		bool timestamp_failure = false;
+		for (size_t i = 0; i < n_decoded && i < len; i++) {
+			if (decoded[i].character != expected[i]) {
+				mismatch = true;
+			}
+			if (decoded[i].timestamp <= previous_timestamp) {
+				timestamp_failure = true;
+			}
+			previous_timestamp = decoded[i].timestamp;
+		}
+		cte->expect_op_int(cte, false, "==", mismatch, "received characters at %d wpm, adaptive = %d", speed, is_adaptive);
+		cte->expect_op_int(cte, false, "==", timestamp_failure, "timestamps of received characters at %d wpm, adaptive = %d", speed, is_adaptive);
+	}
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after loopback");
+
+	/* Too many characters. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_loopback_string)(gen, rec, string, decoded, 3, &n_decoded), "loopback with too small array");
+	cte->expect_op_int(cte, ENOMEM, "==", errno, "errno for too small array");
+	cte->expect_op_int(cte, 3, "==", (int) n_decoded, "count of received characters for too small array");
+
+	cw_rec_delete(&rec);
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_multi_producer_queue.c
+
+   Test of tone queue fed by many producers at the same time.
+*/
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_multi_producer_queue.h"
+
+
+
+
+#define N_PRODUCERS            4
+#define N_BATCHES_PER_PRODUCER 400
+#define N_TONES_PER_BATCH      3
+
+
+
+
+typedef struct {
+	cw_gen_t * gen;
+	int producer;
+	bool failure;
+} producer_t;
+
+
+
+
+static void * producer_thread(void * arg);
+
+
+
+
+/**
+   @brief Test that tones of each producer stay contiguous in multi-producer queue
+
+   Producers enqueue batches of tones with cw_gen_enqueue_tones(), while
+   the test dequeues tones from the queue. Frequency of a tone tells which
+   producer has enqueued it, and duration tells in which batch. More tones
+   are enqueued than the queue can hold, so producers wait for room in
+   queue, and the queue grows its table of tones while producers work.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_multi_producer_queue(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.multi_producer_queue = true;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	/* Generator is not started, the test is the consumer of tones. */
+	producer_t producers[N_PRODUCERS];
+	pthread_t threads[N_PRODUCERS];
+	for (int p = 0; p < N_PRODUCERS; p++) {
+		producers[p].gen = gen;
+		producers[p].producer = p;
+		producers[p].failure = false;
+		pthread_create(&threads[p], NULL, producer_thread, &producers[p]);
+	}
+
+	int next_batch[N_PRODUCERS] = { 0 };
+	bool order_failure = false;
+	size_t n_received = 0;
+	const size_t n_expected = N_PRODUCERS * N_BATCHES_PER_PRODUCER * N_TONES_PER_BATCH;
+	while (n_received < n_expected && !order_failure) {
+		cw_tone_t tones[N_TONES_PER_BATCH];
+		if (CW_TQ_EMPTY == cw_tq_dequeue_internal(gen->tq, &tones[0])) {
+			sched_yield();
+			continue;
+		}
+		/* Remaining tones of the batch must follow right away. */
+		for (int i = 1; i < N_TONES_PER_BATCH; i++) {
+			if (CW_TQ_EMPTY == cw_tq_dequeue_internal(gen->tq, &tones[i])) {
+				CW_TONE_INIT(&tones[i], 0, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+			}
+		}
+		n_received += N_TONES_PER_BATCH;
+
+		const int p = (tones[0].frequency - 300) / 100;
+		for (int i = 0; i < N_TONES_PER_BATCH; i++) {
+			if (p < 0 || p >= N_PRODUCERS
+			    || tones[i].frequency != tones[0].frequency
+			    || tones[i].duration != 1000 + next_batch[p]) {
+
+				cte->log_error(cte, "%s:%d: unexpected tone %d Hz, %d us\n", __func__, __LINE__, tones[i].frequency, tones[i].duration);
+				order_failure = true;
+				break;
+			}
+		}
+		if (!order_failure) {
+			next_batch[p]++;
+		}
+	}
+
+	bool enqueue_failure = false;
+	for (int p = 0; p < N_PRODUCERS; p++) {
+		pthread_join(threads[p], NULL);
+		enqueue_failure = enqueue_failure || producers[p].failure;
+	}
+
+	cte->expect_op_int(cte, false, "==", enqueue_failure, "enqueueing batches of tones");
+	cte->expect_op_int(cte, false, "==", order_failure, "order of dequeued tones");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "length of queue after dequeueing all tones");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Enqueue batches of tones of one producer
+
+   @param arg producer (producer_t)
+
+   @return NULL
+*/
+static void * producer_thread(void * arg)
+{
+	producer_t * producer = (producer_t *) arg;
+
+	for (int b = 0; b < N_BATCHES_PER_PRODUCER; b++) {
+		cw_gen_tone_t tones[N_TONES_PER_BATCH];
+		for (int i = 0; i < N_TONES_PER_BATCH; i++) {
+			tones[i].frequency = 300 + 100 * producer->producer;
+			tones[i].duration = 1000 + b;
+		}
+		/* Wait for room in queue. */
+		while (CW_SUCCESS != cw_gen_enqueue_tones(producer->gen, tones, N_TONES_PER_BATCH)) {
+			if (EAGAIN != errno) {
+				producer->failure = true;
+				return NULL;
+			}
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
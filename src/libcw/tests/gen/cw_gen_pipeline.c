@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_pipeline.c
+
+   Test of pipeline of buffers of generator
+   (cw_gen_config_t::pipeline_n_buffers).
+*/
+
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_pipeline.h"
+
+
+
+
+#define TEST_TEXT "paris paris"
+
+
+
+
+static cwt_retv test_render_internal(cw_test_executor_t * cte, int pipeline_n_buffers, uint8_t ** contents, long * size);
+
+
+
+
+/**
+   @brief Test that pipeline of buffers doesn't change generated samples
+
+   The same text is rendered into a file by generator without
+   pipeline, and by generator with pipeline of buffers. Both files must
+   be identical: pipeline changes only which thread writes the buffers,
+   not the buffers themselves.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_pipeline(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	uint8_t * reference = NULL;
+	long reference_size = 0;
+	if (cwt_retv_ok != test_render_internal(cte, 0, &reference, &reference_size)) {
+		return cwt_retv_err;
+	}
+
+	for (int n_buffers = 2; n_buffers <= CW_GEN_PIPELINE_N_BUFFERS_MAX; n_buffers++) {
+		uint8_t * contents = NULL;
+		long size = 0;
+		if (cwt_retv_ok != test_render_internal(cte, n_buffers, &contents, &size)) {
+			free(reference);
+			return cwt_retv_err;
+		}
+		cte->expect_op_int(cte, (int) reference_size, "==", (int) size, "size of file rendered with %d buffers", n_buffers);
+		const bool same = reference_size == size && 0 == memcmp(reference, contents, (size_t) size);
+		cte->expect_op_int(cte, true, "==", same, "samples of text rendered with %d buffers", n_buffers);
+		free(contents);
+	}
+
+	free(reference);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Render test text to file with given count of buffers in pipeline
+
+   @param cte test executor
+   @param[in] pipeline_n_buffers count of buffers in pipeline
+   @param[out] contents contents of the file, to be freed with free()
+   @param[out] size size of @p contents
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_render_internal(cw_test_executor_t * cte, int pipeline_n_buffers, uint8_t ** contents, long * size)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_pipeline_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.sidetone_low_latency = false;
+	gen_conf.pipeline_n_buffers = pipeline_n_buffers;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const int expected_n_buffers = pipeline_n_buffers < 2 ? 0 : pipeline_n_buffers;
+	cte->expect_op_int(cte, expected_n_buffers, "==", gen->pipeline.n_buffers, "count of buffers in pipeline");
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+	cw_gen_wait_for_queue_level(gen, 0);
+	/* Generator that is stopped while it is still generating the
+	   last tone may drop the last, partially filled buffer. */
+	cw_gen_wait_for_end_of_current_tone(gen);
+	cw_gen_stop(gen);
+
+	/* Results of writes done by pipeline's thread are added to
+	   metrics of generator too. */
+	cw_gen_metrics_t metrics = { 0 };
+	cw_gen_get_metrics(gen, &metrics);
+	cte->expect_op_int(cte, 0, "<", (int) metrics.n_buffers_written, "count of written buffers (%d buffers in pipeline)", pipeline_n_buffers);
+	cte->expect_op_int(cte, (int) metrics.n_buffers_written, "==", (int) gen->metrics.n_timed_buffers, "count of timed buffers (%d buffers in pipeline)", pipeline_n_buffers);
+
+	cw_gen_delete(&gen);
+
+	FILE * file = fopen(path, "rb");
+	if (NULL == file) {
+		cte->log_error(cte, "%s:%d: Failed to open output file %s\n", __func__, __LINE__, path);
+		return cwt_retv_err;
+	}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	*contents = calloc((size_t) *size + 1, 1);
+	if (NULL == *contents || (size_t) *size != fread(*contents, 1, (size_t) *size, file)) {
+		cte->log_error(cte, "%s:%d: Failed to read output file\n", __func__, __LINE__);
+		free(*contents);
+		*contents = NULL;
+		fclose(file);
+		unlink(path);
+		return cwt_retv_err;
+	}
+	fclose(file);
+	unlink(path);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_preallocate.c
+
+   Test of generator with preallocated memory (cw_gen_config_t::preallocate)
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_preallocate.h"
+
+
+
+
+/* Count of samples rendered in one call to cw_gen_render(). */
+#define TEST_RENDER_N_SAMPLES 4800
+
+
+
+
+#if defined(__GLIBC__)
+
+/* Allocations are counted only when this is true. Allocations made by
+   any thread are counted. */
+static bool g_test_count_allocations = false;
+static unsigned int g_test_n_allocations = 0;
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+
+/* Hooks of allocation functions, replacing the functions in whole test
+   program. */
+void * malloc(size_t size)
+{
+	if (__atomic_load_n(&g_test_count_allocations, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&g_test_n_allocations, 1, __ATOMIC_SEQ_CST);
+	}
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t n, size_t size)
+{
+	if (__atomic_load_n(&g_test_count_allocations, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&g_test_n_allocations, 1, __ATOMIC_SEQ_CST);
+	}
+	return __libc_calloc(n, size);
+}
+
+void * realloc(void * ptr, size_t size)
+{
+	if (__atomic_load_n(&g_test_count_allocations, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&g_test_n_allocations, 1, __ATOMIC_SEQ_CST);
+	}
+	return __libc_realloc(ptr, size);
+}
+
+#endif /* #if defined(__GLIBC__) */
+
+
+
+
+static unsigned int test_count_allocations(bool start);
+static void test_render_all(cw_gen_t * gen, cw_sample_t * samples);
+
+
+
+
+/**
+   @brief Test that generator with preallocated memory doesn't allocate memory
+
+   Allocations are counted by hooks of malloc(), calloc() and realloc()
+   while characters, strings and tones are enqueued in generator and
+   rendered, while parameters of generator are changed, and while marks
+   are received by receiver.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_preallocate(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+#if defined(__GLIBC__)
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.preallocate = true;
+
+	cw_gen_t * gen = LIBCW_TEST_FUT(cw_gen_new)(&gen_conf);
+	cw_rec_t * rec = cw_rec_new();
+	cw_sample_t * samples = calloc(TEST_RENDER_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == gen || NULL == rec || NULL == samples) {
+		cte->log_error(cte, "%s:%d: Failed to create generator, receiver or buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		cw_rec_delete(&rec);
+		free(samples);
+		return cwt_retv_err;
+	}
+	cw_rec_set_speed(rec, 20);
+
+	/* Check that hooks work. */
+	test_count_allocations(true);
+	free(cw_character_to_representation('a'));
+	cte->expect_op_int(cte, 1, "==", (int) test_count_allocations(false), "count of allocations by hooks check");
+
+	test_count_allocations(true);
+
+	cw_gen_enqueue_string(gen, "paris 73");
+	cw_gen_enqueue_character(gen, 'k');
+	test_render_all(gen, samples);
+
+	cw_gen_set_speed(gen, 35);
+	cw_gen_set_frequency(gen, 750);
+	cw_gen_set_volume(gen, 40);
+	cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_SINE, 20000);
+	cw_gen_enqueue_string(gen, "cq cq de sp5");
+	test_render_all(gen, samples);
+
+	/* Long tone is generated with plateau loop. */
+	const cw_gen_tone_t tones[] = { { 600, 2000000 }, { 0, 100000 }, { 1234, 300000 } };
+	cw_gen_enqueue_tones(gen, tones, sizeof (tones) / sizeof (tones[0]));
+	test_render_all(gen, samples);
+
+	/* Dot, and end of character. */
+	cw_rec_mark_begin_usecs(rec, 1000000);
+	cw_rec_mark_end_usecs(rec, 1060000);
+	char character = 0;
+	bool is_end_of_word = false;
+	bool is_error = false;
+	cw_rec_poll_character_usecs(rec, 1500000, &character, &is_end_of_word, &is_error);
+	cte->expect_op_int(cte, 'E', "==", character, "received character");
+
+	cte->expect_op_int(cte, 0, "==", (int) test_count_allocations(false), "count of allocations");
+
+	cw_gen_delete(&gen);
+	cw_rec_delete(&rec);
+	free(samples);
+#else
+	cte->log_info(cte, "Allocations can't be counted on this platform, skipping the test\n");
+#endif
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Start or stop counting of allocations
+
+   @param[in] start true to reset the counter and start counting, false to stop counting
+
+   @return count of allocations since the counting was started
+*/
+static unsigned int test_count_allocations(bool start)
+{
+#if defined(__GLIBC__)
+	if (start) {
+		__atomic_store_n(&g_test_n_allocations, 0, __ATOMIC_SEQ_CST);
+	}
+	__atomic_store_n(&g_test_count_allocations, start, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&g_test_n_allocations, __ATOMIC_SEQ_CST);
+#else
+	(void) start;
+	return 0;
+#endif
+}
+
+
+
+
+/**
+   @brief Render all tones from generator's queue
+
+   @param[in] gen generator
+   @param[out] samples buffer for TEST_RENDER_N_SAMPLES samples
+*/
+static void test_render_all(cw_gen_t * gen, cw_sample_t * samples)
+{
+	while (0 != cw_gen_get_queue_length(gen)) {
+		cw_gen_render(gen, samples, TEST_RENDER_N_SAMPLES);
+	}
+	/* Last tone. */
+	cw_gen_render(gen, samples, TEST_RENDER_N_SAMPLES);
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_quality_scaling.c
+
+   Test of quality scaling of generator (cw_gen_enable_quality_scaling()).
+*/
+
+
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_quality.h"
+#include "cw_gen_quality_scaling.h"
+
+
+
+
+/* Count of samples in buffers of synthetic test. */
+#define TEST_BUFFER_N_SAMPLES 512
+
+
+
+
+/* Changes of quality received by test_quality_callback(). */
+typedef struct {
+	int n_events;
+	cw_gen_quality_t quality;
+	int load;
+} test_events_t;
+
+
+
+
+static void test_quality_callback(void * callback_arg, cw_gen_quality_t quality, int load);
+static void test_feed_load_internal(cw_gen_t * gen, int load, int n_buffers);
+static cwt_retv test_quality_scaling_synthetic(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator);
+static cwt_retv test_quality_scaling_generator(cw_test_executor_t * cte);
+
+
+
+
+/**
+   @brief Test quality scaling of generator
+
+   Loads of buffers are first passed directly to quality scaling, to
+   check decisions of the policy. Then a generator writing to a file
+   must restore full quality, because it easily keeps up.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_quality_scaling(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_quality_scaling_synthetic(cte, CW_GEN_OSCILLATOR_SINF)
+	    || cwt_retv_ok != test_quality_scaling_synthetic(cte, CW_GEN_OSCILLATOR_FIXED_POINT)
+	    || cwt_retv_ok != test_quality_scaling_generator(cte)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void test_quality_callback(void * callback_arg, cw_gen_quality_t quality, int load)
+{
+	test_events_t * events = (test_events_t *) callback_arg;
+	events->n_events++;
+	events->quality = quality;
+	events->load = load;
+}
+
+
+
+
+/**
+   @brief Pass buffers with given load to quality scaling of generator
+
+   @param[in] gen generator
+   @param[in] load [percents] load of each buffer
+   @param[in] n_buffers count of buffers
+*/
+static void test_feed_load_internal(cw_gen_t * gen, int load, int n_buffers)
+{
+	const uint64_t buffer_ns = (uint64_t) TEST_BUFFER_N_SAMPLES * 1000000000 / (uint64_t) gen->sample_rate;
+	for (int i = 0; i < n_buffers; i++) {
+		cw_gen_quality_update_internal(gen, buffer_ns * (uint64_t) load / 100, TEST_BUFFER_N_SAMPLES);
+	}
+	return;
+}
+
+
+
+
+/**
+   @brief Check decisions of quality scaling for given loads
+
+   @param cte test executor
+   @param[in] oscillator oscillator engine of generator
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_quality_scaling_synthetic(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.oscillator = oscillator;
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	/* Invalid policies. */
+	const cw_gen_quality_policy_t invalid[] = {
+		{ .degrade_load = 80, .restore_load = 80, .n_buffers = 4 },
+		{ .degrade_load = 80, .restore_load = 0,  .n_buffers = 4 },
+		{ .degrade_load = 80, .restore_load = 40, .n_buffers = 0 },
+	};
+	for (size_t i = 0; i < sizeof (invalid) / sizeof (invalid[0]); i++) {
+		errno = 0;
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_quality_scaling)(gen, &invalid[i], NULL, NULL), "enabling quality scaling with invalid policy #%zu", i);
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno of invalid policy #%zu", i);
+	}
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_quality_scaling)(gen, NULL, NULL, NULL), "enabling quality scaling without policy");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of enabling quality scaling without policy");
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", LIBCW_TEST_FUT(cw_gen_get_quality)(gen), "initial quality");
+
+	test_events_t events = { 0 };
+	const cw_gen_quality_policy_t policy = { .degrade_load = 80, .restore_load = 40, .n_buffers = 4 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enable_quality_scaling)(gen, &policy, test_quality_callback, &events), "enabling quality scaling");
+
+	/* Decision is made only after whole window of buffers. */
+	test_feed_load_internal(gen, 90, policy.n_buffers - 1);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", cw_gen_get_quality(gen), "quality before end of window");
+	test_feed_load_internal(gen, 90, 1);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_REDUCED, "==", cw_gen_get_quality(gen), "quality after overload");
+	cte->expect_op_int(cte, 1, "==", events.n_events, "count of events after overload");
+	cte->expect_op_int(cte, CW_GEN_QUALITY_REDUCED, "==", events.quality, "quality reported after overload");
+	cte->expect_op_int(cte, 90, "==", events.load, "load reported after overload");
+	const cw_gen_oscillator_t reduced_oscillator = CW_GEN_OSCILLATOR_FIXED_POINT == oscillator ? CW_GEN_OSCILLATOR_FIXED_POINT : CW_GEN_OSCILLATOR_TABLE;
+	cte->expect_op_int(cte, reduced_oscillator, "==", cw_gen_quality_oscillator_internal(gen), "oscillator at reduced quality");
+	cte->expect_op_int(cte, false, "==", cw_gen_quality_dsp_bypassed_internal(gen), "post-processing at reduced quality");
+
+	/* Quality goes down by one level at a time, and not below
+	   the lowest level. */
+	test_feed_load_internal(gen, 90, policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_MINIMAL, "==", cw_gen_get_quality(gen), "quality after longer overload");
+	cte->expect_op_int(cte, true, "==", cw_gen_quality_dsp_bypassed_internal(gen), "post-processing at minimal quality");
+	test_feed_load_internal(gen, 95, policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_MINIMAL, "==", cw_gen_get_quality(gen), "quality after even longer overload");
+	cte->expect_op_int(cte, 2, "==", events.n_events, "count of events after longer overload");
+
+	/* Load between thresholds doesn't change anything. */
+	test_feed_load_internal(gen, 60, 3 * policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_MINIMAL, "==", cw_gen_get_quality(gen), "quality at moderate load");
+	cte->expect_op_int(cte, 2, "==", events.n_events, "count of events at moderate load");
+
+	/* Mean of window is compared with thresholds. */
+	test_feed_load_internal(gen, 70, policy.n_buffers / 2);
+	test_feed_load_internal(gen, 0, policy.n_buffers / 2);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_REDUCED, "==", cw_gen_get_quality(gen), "quality after load has subsided");
+	cte->expect_op_int(cte, 35, "==", events.load, "load reported after load has subsided");
+	test_feed_load_internal(gen, 10, policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", cw_gen_get_quality(gen), "quality after low load");
+	cte->expect_op_int(cte, 4, "==", events.n_events, "count of events after low load");
+	cte->expect_op_int(cte, oscillator, "==", cw_gen_quality_oscillator_internal(gen), "oscillator at full quality");
+
+	/* Disabling restores full quality, and stops events. */
+	test_feed_load_internal(gen, 90, policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_REDUCED, "==", cw_gen_get_quality(gen), "quality before disabling");
+	LIBCW_TEST_FUT(cw_gen_disable_quality_scaling)(gen);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", cw_gen_get_quality(gen), "quality after disabling");
+	test_feed_load_internal(gen, 90, 2 * policy.n_buffers);
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", cw_gen_get_quality(gen), "quality of disabled quality scaling");
+	cte->expect_op_int(cte, 5, "==", events.n_events, "count of events after disabling");
+
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Check that generator writing to file restores full quality
+
+   Generator calculates samples much faster than they are played, so
+   with restore threshold close to 100% the load is always low enough.
+
+   @param cte test executor
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_quality_scaling_generator(cw_test_executor_t * cte)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_quality_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.sidetone_low_latency = false;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_add_dsp_bandpass(gen, 600, 500);
+
+	test_events_t events = { 0 };
+	const cw_gen_quality_policy_t policy = { .degrade_load = 100, .restore_load = 99, .n_buffers = 2 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_enable_quality_scaling(gen, &policy, test_quality_callback, &events), "enabling quality scaling");
+	/* As if the generator has been overloaded before. */
+	__atomic_store_n(&gen->quality, CW_GEN_QUALITY_MINIMAL, __ATOMIC_RELAXED);
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "paris");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", cw_gen_get_quality(gen), "quality of generator that keeps up");
+	cte->expect_op_int(cte, 2, "==", events.n_events, "count of events of generator that keeps up");
+	cte->expect_op_int(cte, CW_GEN_QUALITY_FULL, "==", events.quality, "last reported quality of generator that keeps up");
+
+	cw_gen_delete(&gen);
+	unlink(path);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_gen_recalculate_slope_amplitudes_internal.c
+
+   Test of cw_gen_recalculate_slope_amplitudes_internal() and of
+   library-wide cache of slope shapes.
+*/
+
+
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "cw_gen_recalculate_slope_amplitudes_internal.h"
+
+
+
+
+static int test_count_mismatches(const cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Test calculation of slope amplitudes for different shapes, volumes and sample rates
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_recalculate_slope_amplitudes_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const unsigned int orig_sample_rate = gen->sample_rate;
+
+
+	/* First calculation of a shape, and then the same shape taken
+	   from cache after switching back from other shape. */
+	cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000);
+	const int n_amplitudes = gen->tone_slope.n_amplitudes;
+	cte->expect_op_int(cte, 0, "<", n_amplitudes, "count of amplitudes");
+	cte->expect_op_int(cte, 0, "==", test_count_mismatches(gen), "raised cosine slope");
+
+	float * copy = calloc((size_t) n_amplitudes, sizeof (float));
+	if (NULL == copy) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	memcpy(copy, gen->tone_slope.amplitudes, sizeof (float) * (size_t) n_amplitudes);
+
+	cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_LINEAR, 5000);
+	cte->expect_op_int(cte, 0, "==", test_count_mismatches(gen), "linear slope");
+	cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000);
+	cte->expect_op_int(cte, 0, "==", memcmp(copy, gen->tone_slope.amplitudes, sizeof (float) * (size_t) n_amplitudes), "raised cosine slope from cache");
+
+
+	/* Normalized table doesn't change with volume. */
+	cw_gen_set_volume(gen, 30);
+	cte->expect_op_int(cte, 0, "==", memcmp(copy, gen->tone_slope.amplitudes, sizeof (float) * (size_t) n_amplitudes), "raised cosine slope after change of volume");
+	free(copy);
+	cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_SINE, 5000);
+	cte->expect_op_int(cte, 0, "==", test_count_mismatches(gen), "sine slope after change of volume");
+
+
+	/* High sample rates. More shapes than cache entries, so that
+	   some entries are replaced. */
+	const unsigned int rates[] = { 96000, 192000, 44100, 48000, 22050 };
+	for (size_t r = 0; r < sizeof (rates) / sizeof (rates[0]); r++) {
+		gen->sample_rate = rates[r];
+		for (int duration = 3000; duration <= 5000; duration += 1000) {
+			cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_SINE, duration);
+			cte->expect_op_int_errors_only(cte, 0, "==", test_count_mismatches(gen), "sine slope, rate %u, duration %d", rates[r], duration);
+		}
+	}
+	cte->expect_op_int(cte, (int) ((22050 / 100) * 5000) / 10000, "==", gen->tone_slope.n_amplitudes, "count of amplitudes at last rate");
+
+
+	/* Requested sample rates. */
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sample_rate = 0;
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_requested_sample_rate_internal(&gen_conf), "no requested sample rate");
+	gen_conf.sample_rate = 192000;
+	cte->expect_op_int(cte, 192000, "==", (int) cw_gen_get_requested_sample_rate_internal(&gen_conf), "requested sample rate 192 kHz");
+	gen_conf.sample_rate = CW_GEN_SAMPLE_RATE_MAX + 1;
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_requested_sample_rate_internal(&gen_conf), "too high requested sample rate");
+
+
+	gen->sample_rate = orig_sample_rate;
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Compare slope amplitudes of generator with amplitudes calculated directly from formulas
+
+   @param[in] gen generator
+
+   @return count of amplitudes that differ from expected values
+*/
+static int test_count_mismatches(const cw_gen_t * gen)
+{
+	const float pi = 3.14159265358979323846F;
+	const int n = gen->tone_slope.n_amplitudes;
+	int n_mismatches = 0;
+
+	for (int i = 0; i < n; i++) {
+		float expected = 0.0F;
+		if (CW_TONE_SLOPE_SHAPE_LINEAR == gen->tone_slope.shape) {
+			expected = (float) i / (float) n;
+		} else if (CW_TONE_SLOPE_SHAPE_SINE == gen->tone_slope.shape) {
+			expected = sinf((float) i * (pi / 2.0F) / (float) n);
+		} else {
+			expected = 1 - ((1 + cosf((float) i * pi / (float) n)) / 2);
+		}
+		const float a = gen->tone_slope.amplitudes[i];
+		if (a < expected || a > expected || gen->tone_slope.amplitudes_fixed[i] != (int32_t) (a * 32768.0F)) {
+			n_mismatches++;
+		}
+	}
+
+	return n_mismatches;
+}
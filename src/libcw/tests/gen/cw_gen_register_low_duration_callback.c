@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_register_low_duration_callback.c
+
+   Test of cw_gen_register_low_duration_callback().
+*/
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "libcw_tq_internal.h"
+#include "cw_gen_register_low_duration_callback.h"
+
+
+
+
+#define TEST_N_TONES          5
+#define TEST_TONE_DURATION    10000   /* [us] */
+#define TEST_LOW_DURATION     20000   /* [us] */
+
+
+
+
+typedef struct {
+	cw_gen_t * gen;
+	int n_calls;
+	/* Duration of queue seen by the callback in last call. */
+	uint64_t duration;
+} test_callback_data_t;
+
+
+
+
+static void test_low_duration_callback(void * arg);
+static void test_enqueue_tones(cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Test low duration callback of generator's tone queue
+
+   The callback must be called once per crossing of the duration
+   threshold, when queue's duration drops from above the threshold to
+   the threshold.
+
+   Tones are dequeued by the test one at a time, so it is known which
+   dequeue should make the duration cross the threshold.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_register_low_duration_callback(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+	test_callback_data_t data = { .gen = gen, .n_calls = 0, .duration = 0 };
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_register_low_duration_callback)(gen, test_low_duration_callback, &data, TEST_LOW_DURATION);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "registering callback");
+
+
+	/* Dequeue tones one by one. Only the dequeue that makes duration
+	   drop to the threshold calls the callback. */
+	cw_tone_t tone;
+	for (int round = 0; round < 2; round++) {
+		data.n_calls = 0;
+		test_enqueue_tones(gen);
+		for (int i = 0; i < TEST_N_TONES; i++) {
+			cw_tq_dequeue_internal(gen->tq, &tone);
+			const int expected_n_calls = i >= TEST_N_TONES - TEST_LOW_DURATION / TEST_TONE_DURATION - 1 ? 1 : 0;
+			cte->expect_op_int(cte, expected_n_calls, "==", data.n_calls, "round %d: count of calls after dequeueing tone #%d", round, i);
+		}
+		cte->expect_op_int(cte, TEST_LOW_DURATION, "==", (int) data.duration, "round %d: duration of queue seen by callback", round);
+	}
+
+
+	/* Unregistered callback is not called. */
+	cwret = LIBCW_TEST_FUT(cw_gen_register_low_duration_callback)(gen, NULL, NULL, 0);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "unregistering callback");
+	data.n_calls = 0;
+	test_enqueue_tones(gen);
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tone)) {
+		;
+	}
+	cte->expect_op_int(cte, 0, "==", data.n_calls, "count of calls of unregistered callback");
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void test_low_duration_callback(void * arg)
+{
+	test_callback_data_t * data = (test_callback_data_t *) arg;
+	data->n_calls++;
+	data->duration = cw_gen_get_queue_duration(data->gen);
+}
+
+
+
+
+static void test_enqueue_tones(cw_gen_t * gen)
+{
+	cw_gen_tone_t tones[TEST_N_TONES];
+	for (int i = 0; i < TEST_N_TONES; i++) {
+		tones[i].frequency = 800;
+		tones[i].duration = TEST_TONE_DURATION;
+	}
+	cw_gen_enqueue_tones(gen, tones, TEST_N_TONES);
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_GEN_REGISTER_LOW_DURATION_CALLBACK_H_
+#define _LIBCW_TESTS_GEN_CW_GEN_REGISTER_LOW_DURATION_CALLBACK_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_gen_register_low_duration_callback(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_GEN_REGISTER_LOW_DURATION_CALLBACK_H_ */
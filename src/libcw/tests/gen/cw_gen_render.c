@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_render.c
+
+   Test of cw_gen_render()
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_render.h"
+
+
+
+
+/* Count of samples rendered in the test: 2 seconds at 48 kHz, longer
+   than the tones. */
+#define TEST_N_SAMPLES (2 * 48000)
+
+/* Maximal allowed difference between samples rendered in one call and
+   samples rendered in many short calls. Boundaries of calculated
+   fragments of sine wave are different in the two cases. */
+#define TEST_MAX_SAMPLE_DIFF 8
+
+
+
+
+static cwt_retv test_render(cw_test_executor_t * cte, cw_sample_t * samples, const int * chunk_sizes, size_t n_chunk_sizes);
+
+
+
+
+/**
+   @brief Test cw_gen_render()
+
+   The same string is rendered from two identical generators: in one
+   call of cw_gen_render(), and in many calls for short chunks of
+   samples. The results must be (almost) the same, must contain some
+   sound, and must end with silence when the tone queue is drained.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_render(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_sample_t * reference = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	cw_sample_t * tested = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == reference || NULL == tested) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffers\n", __func__, __LINE__);
+		free(reference);
+		free(tested);
+		return cwt_retv_err;
+	}
+
+	const int whole[] = { TEST_N_SAMPLES };
+	const int chunks[] = { 1, 64, 333, 1000, 17, 4096 };
+	if (cwt_retv_ok != test_render(cte, reference, whole, sizeof (whole) / sizeof (whole[0]))
+	    || cwt_retv_ok != test_render(cte, tested, chunks, sizeof (chunks) / sizeof (chunks[0]))) {
+		free(reference);
+		free(tested);
+		return cwt_retv_err;
+	}
+
+	int max_diff = 0;
+	int n_non_zero = 0;
+	for (int i = 0; i < TEST_N_SAMPLES; i++) {
+		const int diff = abs(reference[i] - tested[i]);
+		if (diff > max_diff) {
+			max_diff = diff;
+		}
+		if (0 != reference[i]) {
+			n_non_zero++;
+		}
+	}
+	cte->expect_op_int(cte, TEST_MAX_SAMPLE_DIFF, ">=", max_diff, "max difference between samples rendered in one call and in chunks");
+	cte->expect_op_int(cte, 0, "<", n_non_zero, "count of non-zero rendered samples");
+	cte->expect_op_int(cte, 0, "==", reference[TEST_N_SAMPLES - 1], "last sample (after end of tones)");
+
+	free(reference);
+	free(tested);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Render a string into @p samples with calls for chunks of given sizes
+
+   @param cte test executor
+   @param[out] samples output buffer for TEST_N_SAMPLES samples
+   @param[in] chunk_sizes sizes of consecutive chunks (repeated if necessary)
+   @param[in] n_chunk_sizes count of items in @p chunk_sizes
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_render(cw_test_executor_t * cte, cw_sample_t * samples, const int * chunk_sizes, size_t n_chunk_sizes)
+{
+	/* Rendered generator never uses its own sound sink. */
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 30);
+	cw_gen_enqueue_string(gen, "paris");
+
+	size_t chunk = 0;
+	int n = 0;
+	bool failure = false;
+	while (n < TEST_N_SAMPLES) {
+		int size = chunk_sizes[chunk++ % n_chunk_sizes];
+		if (size > TEST_N_SAMPLES - n) {
+			size = TEST_N_SAMPLES - n;
+		}
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_gen_render)(gen, samples + n, (size_t) size)) {
+			failure = true;
+		}
+		n += size;
+	}
+	cte->expect_op_int(cte, false, "==", failure, "rendering of samples");
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue length after rendering");
+
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_render)(NULL, samples, 1), "rendering from NULL generator");
+
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_render_benchmark.c
+
+   Benchmark of cw_gen_render()
+*/
+
+
+
+
+#include <stdlib.h>
+#include <time.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_render_benchmark.h"
+
+
+
+
+/* Samples are rendered in chunks of this size, as they would be
+   requested by a realtime callback of a sound engine. */
+#define TEST_CHUNK_SIZE 256
+
+/* Count of rendered chunks: 20 seconds at 48 kHz. */
+#define TEST_N_CHUNKS ((20 * 48000) / TEST_CHUNK_SIZE)
+
+/* "paris " takes 2 seconds at 30 WPM, so the queue is not drained
+   before the end of the benchmark. */
+#define TEST_N_WORDS 12
+
+
+
+
+static double test_timespec_diff_us(const struct timespec * start, const struct timespec * stop);
+
+
+
+
+/**
+   @brief Benchmark of cw_gen_render()
+
+   Samples of a long string are rendered in short chunks. Throughput of
+   rendering and latencies of single calls are recorded as results of
+   the benchmark, and are compared with baseline if one is given.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_render_benchmark(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_sample_t * samples = calloc(TEST_CHUNK_SIZE, sizeof (cw_sample_t));
+	double * latencies = calloc(TEST_N_CHUNKS, sizeof (double));
+	if (NULL == samples || NULL == latencies) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffers\n", __func__, __LINE__);
+		free(samples);
+		free(latencies);
+		return cwt_retv_err;
+	}
+
+	/* Rendered generator never uses its own sound sink. */
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+		free(samples);
+		free(latencies);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 30);
+	for (int i = 0; i < TEST_N_WORDS; i++) {
+		cw_gen_enqueue_string(gen, "paris ");
+	}
+
+	bool failure = false;
+	double total_us = 0.0;
+	for (int i = 0; i < TEST_N_CHUNKS; i++) {
+		struct timespec start;
+		struct timespec stop;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_gen_render)(gen, samples, TEST_CHUNK_SIZE)) {
+			failure = true;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		latencies[i] = test_timespec_diff_us(&start, &stop);
+		total_us += latencies[i];
+	}
+	cte->expect_op_int(cte, false, "==", failure, "rendering of samples");
+	cte->expect_op_int(cte, 0, "<", (int) cw_gen_get_queue_length(gen), "queue length at end of benchmark");
+
+	if (total_us > 0.0) {
+		const double throughput = (double) TEST_N_CHUNKS * TEST_CHUNK_SIZE / (total_us / 1000000.0);
+		cte->record_perf(cte, "cw_gen_render", "throughput", "samples/s", perf_direction_higher_is_better, throughput);
+	}
+	cte->record_perf_latencies(cte, "cw_gen_render", "call latency", "us", latencies, TEST_N_CHUNKS);
+
+	cw_gen_delete(&gen);
+	free(samples);
+	free(latencies);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static double test_timespec_diff_us(const struct timespec * start, const struct timespec * stop)
+{
+	return (double) (stop->tv_sec - start->tv_sec) * 1000000.0 + (double) (stop->tv_nsec - start->tv_nsec) / 1000.0;
+}
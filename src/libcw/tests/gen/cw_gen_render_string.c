@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_render_string.c
+
+   Test of cw_gen_render_string()
+*/
+
+
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_render_string.h"
+
+
+
+
+#define TEST_TEXT "the quick brown fox jumps over the lazy dog  0123456789 paris cq de test "       \
+	"the quick brown fox jumps over the lazy dog  0123456789 paris cq de test k"
+
+/* Silence rendered after samples of string by reference generator. */
+#define TEST_N_TAIL_SAMPLES 4800
+
+
+
+
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, bool chirp);
+static cwt_retv test_render_string(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, bool chirp);
+
+
+
+
+/**
+   @brief Test cw_gen_render_string()
+
+   The same string is rendered by a few threads, by one thread, and
+   with cw_gen_render() of generator's tone queue. All samples must be
+   identical, and generator rendering with a few threads must end with
+   the same phase as the reference generator.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_render_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Marks of generator with chirp are not cached, so they are
+	   calculated also when segments are being found. */
+	if (cwt_retv_ok != test_render_string(cte, CW_GEN_OSCILLATOR_SINF, false)
+	    || cwt_retv_ok != test_render_string(cte, CW_GEN_OSCILLATOR_FIXED_POINT, false)
+	    || cwt_retv_ok != test_render_string(cte, CW_GEN_OSCILLATOR_PHASOR, true)) {
+		return cwt_retv_err;
+	}
+
+	cw_gen_t * gen = test_new_gen(cte, CW_GEN_OSCILLATOR_SINF, false);
+	if (NULL == gen) {
+		return cwt_retv_err;
+	}
+	cw_sample_t * samples = NULL;
+	size_t n_samples = 0;
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_render_string)(gen, "paris\x01", 2, &samples, &n_samples), "rendering invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of rendering invalid string");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_render_string)(gen, "paris", 65, &samples, &n_samples), "rendering with too many threads");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of rendering with too many threads");
+	cw_gen_enqueue_string(gen, "e");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_render_string)(gen, "paris", 2, &samples, &n_samples), "rendering with non-empty tone queue");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of rendering with non-empty tone queue");
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static cw_gen_t * test_new_gen(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, bool chirp)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.oscillator = oscillator;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return NULL;
+	}
+	cw_gen_set_speed(gen, 40);
+	cw_gen_set_frequency(gen, 650);
+	if (chirp) {
+		cw_gen_set_chirp(gen, 100, 5000);
+	}
+	return gen;
+}
+
+
+
+
+/**
+   @brief Compare samples of string rendered in three ways
+
+   @param cte test executor
+   @param[in] oscillator oscillator engine of generators
+   @param[in] chirp whether marks are chirped
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_render_string(cw_test_executor_t * cte, cw_gen_oscillator_t oscillator, bool chirp)
+{
+	cw_gen_t * parallel_gen = test_new_gen(cte, oscillator, chirp);
+	cw_gen_t * serial_gen = test_new_gen(cte, oscillator, chirp);
+	cw_gen_t * reference_gen = test_new_gen(cte, oscillator, chirp);
+	if (NULL == parallel_gen || NULL == serial_gen || NULL == reference_gen) {
+		cw_gen_delete(&parallel_gen);
+		cw_gen_delete(&serial_gen);
+		cw_gen_delete(&reference_gen);
+		return cwt_retv_err;
+	}
+
+	cw_sample_t * parallel = NULL;
+	size_t n_parallel = 0;
+	cw_sample_t * serial = NULL;
+	size_t n_serial = 0;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_render_string)(parallel_gen, TEST_TEXT, 4, &parallel, &n_parallel), "rendering with 4 threads (oscillator %d, chirp %d)", oscillator, chirp);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_render_string)(serial_gen, TEST_TEXT, 1, &serial, &n_serial), "rendering with 1 thread (oscillator %d, chirp %d)", oscillator, chirp);
+
+	cw_sample_t * reference = calloc(n_parallel + TEST_N_TAIL_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == parallel || NULL == serial || NULL == reference) {
+		cte->log_error(cte, "%s:%d: Failed to get samples\n", __func__, __LINE__);
+		free(parallel);
+		free(serial);
+		free(reference);
+		cw_gen_delete(&parallel_gen);
+		cw_gen_delete(&serial_gen);
+		cw_gen_delete(&reference_gen);
+		return cwt_retv_err;
+	}
+	cw_gen_enqueue_string(reference_gen, TEST_TEXT);
+	cw_gen_render(reference_gen, reference, n_parallel + TEST_N_TAIL_SAMPLES);
+
+	cte->expect_op_int(cte, (int) n_serial, "==", (int) n_parallel, "count of samples (oscillator %d, chirp %d)", oscillator, chirp);
+	cte->expect_op_int(cte, 0, "==", memcmp(serial, parallel, sizeof (cw_sample_t) * (n_parallel < n_serial ? n_parallel : n_serial)), "samples rendered by 1 and 4 threads (oscillator %d, chirp %d)", oscillator, chirp);
+	cte->expect_op_int(cte, 0, "==", memcmp(reference, parallel, sizeof (cw_sample_t) * n_parallel), "samples rendered by 4 threads and from tone queue (oscillator %d, chirp %d)", oscillator, chirp);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(reference_gen), "queue length of reference generator");
+
+	/* Next tones of generator continue the sine wave. */
+	cte->expect_op_int(cte, 0, "==", memcmp(&parallel_gen->phase_offset, &reference_gen->phase_offset, sizeof (float)), "phase after rendering (oscillator %d, chirp %d)", oscillator, chirp);
+	cte->expect_op_int(cte, (int) reference_gen->phase_acc, "==", (int) parallel_gen->phase_acc, "fixed-point phase after rendering (oscillator %d, chirp %d)", oscillator, chirp);
+
+	free(parallel);
+	free(serial);
+	free(reference);
+	cw_gen_delete(&parallel_gen);
+	cw_gen_delete(&serial_gen);
+	cw_gen_delete(&reference_gen);
+
+	return cwt_retv_ok;
+}
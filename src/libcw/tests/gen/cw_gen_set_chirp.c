@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_set_chirp.c
+
+   Test of cw_gen_set_chirp()
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_set_chirp.h"
+
+
+
+
+/* Test tone: 1000 Hz, 300 ms at 48 kHz. */
+#define TEST_FREQUENCY 1000
+#define TEST_TONE_DURATION 300000
+#define TEST_N_SAMPLES (48000 * 3 / 10)
+
+/* Chirp: frequency slides from 1500 Hz to 1000 Hz during first 100 ms. */
+#define TEST_CHIRP_OFFSET 500
+#define TEST_CHIRP_DURATION 100000
+#define TEST_CHIRP_N_SAMPLES (48000 / 10)
+
+
+
+
+static int test_count_periods(const cw_sample_t * samples, int first, int n);
+
+
+
+
+/**
+   @brief Test chirp of Marks
+
+   During chirp the average frequency is 1250 Hz, so there are 125
+   periods of sine wave in first 100 ms of the tone, and 100 periods in
+   next 100 ms. Difference between neighbouring samples must stay below
+   value possible for sine wave of highest frequency of the chirp, so
+   there are no discontinuities of phase.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_set_chirp(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_sample_t * samples = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == gen || NULL == samples) {
+		cte->log_error(cte, "%s:%d: Failed to create generator or buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		free(samples);
+		return cwt_retv_err;
+	}
+
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_chirp)(gen, CW_FREQUENCY_MAX + 1, TEST_CHIRP_DURATION), "setting chirp with invalid offset");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_set_chirp)(gen, TEST_CHIRP_OFFSET, -1), "setting chirp with invalid duration");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_set_chirp)(gen, TEST_CHIRP_OFFSET, TEST_CHIRP_DURATION), "setting chirp");
+
+	const cw_gen_tone_t tone = { .frequency = TEST_FREQUENCY, .duration = TEST_TONE_DURATION };
+	cw_gen_enqueue_tones(gen, &tone, 1);
+	cw_gen_render(gen, samples, TEST_N_SAMPLES);
+
+	const int n_chirp_periods = test_count_periods(samples, 0, TEST_CHIRP_N_SAMPLES);
+	const int n_plateau_periods = test_count_periods(samples, TEST_CHIRP_N_SAMPLES, TEST_CHIRP_N_SAMPLES);
+	cte->expect_between_int(cte, 124, n_chirp_periods, 126, "periods of sine wave during chirp");
+	cte->expect_between_int(cte, 99, n_plateau_periods, 101, "periods of sine wave after chirp");
+
+	int peak = 0;
+	int max_diff = 0;
+	for (int i = 1; i < TEST_N_SAMPLES; i++) {
+		const int value = abs(samples[i]);
+		peak = value > peak ? value : peak;
+		const int diff = abs(samples[i] - samples[i - 1]);
+		max_diff = diff > max_diff ? diff : max_diff;
+	}
+	/* 2 * Pi * 1500 Hz / 48 kHz = 0.196. */
+	cte->expect_op_int(cte, peak / 5, ">", max_diff, "largest difference between neighbouring samples");
+
+	cw_gen_delete(&gen);
+	free(samples);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Count periods of sine wave in a window of samples
+
+   @param[in] samples samples
+   @param[in] first index of first sample of the window
+   @param[in] n count of samples in the window
+
+   @return count of rising zero crossings
+*/
+static int test_count_periods(const cw_sample_t * samples, int first, int n)
+{
+	int count = 0;
+	for (int i = first + 1; i < first + n; i++) {
+		if (samples[i - 1] < 0 && samples[i] >= 0) {
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_set_gain.c
+
+   Test of cw_gen_set_gain()
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_set_gain.h"
+
+
+
+
+/* Duration of the test tone: 300 ms at 48 kHz. */
+#define TEST_TONE_DURATION 300000
+#define TEST_N_SAMPLES (48000 * 3 / 10)
+#define TEST_MS (48000 / 1000)
+
+
+
+
+static int test_peak(const cw_sample_t * samples, int first, int n);
+static cwt_retv test_render_tone(cw_test_executor_t * cte, int gain, int gain_duration, cw_sample_t * samples);
+
+
+
+
+/**
+   @brief Test gradual and instant changes of gain of generator
+
+   A long tone is rendered with full gain, with constant half gain, and
+   with gain fading from full to zero over the duration of the tone.
+   Peak values of samples in short windows are compared with peak value
+   of the tone rendered with full gain.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_set_gain(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_sample_t * full = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	cw_sample_t * half = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	cw_sample_t * fading = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == full || NULL == half || NULL == fading
+	    || cwt_retv_ok != test_render_tone(cte, 100, 0, full)
+	    || cwt_retv_ok != test_render_tone(cte, 50, 0, half)
+	    || cwt_retv_ok != test_render_tone(cte, 0, TEST_TONE_DURATION, fading)) {
+
+		cte->log_error(cte, "%s:%d: Failed to render tones\n", __func__, __LINE__);
+		free(full);
+		free(half);
+		free(fading);
+		return cwt_retv_err;
+	}
+
+	/* Windows on plateau of the tone, away from slopes. */
+	const int reference = test_peak(full, 140 * TEST_MS, 20 * TEST_MS);
+	const int half_peak = test_peak(half, 140 * TEST_MS, 20 * TEST_MS);
+	const int fading_start_peak = test_peak(fading, 10 * TEST_MS, 10 * TEST_MS);
+	const int fading_middle_peak = test_peak(fading, 145 * TEST_MS, 10 * TEST_MS);
+	const int fading_end_peak = test_peak(fading, 280 * TEST_MS, 10 * TEST_MS);
+
+	cte->expect_op_int(cte, 0, "<", reference, "peak of tone with full gain");
+	cte->expect_between_int(cte, reference * 49 / 100, half_peak, reference * 51 / 100, "peak of tone with half gain");
+	cte->expect_between_int(cte, reference * 93 / 100, fading_start_peak, reference * 98 / 100, "peak at beginning of fading");
+	cte->expect_between_int(cte, reference * 48 / 100, fading_middle_peak, reference * 53 / 100, "peak in the middle of fading");
+	cte->expect_between_int(cte, reference * 3 / 100, fading_end_peak, reference * 8 / 100, "peak at end of fading");
+
+	free(full);
+	free(half);
+	free(fading);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Get largest absolute value of samples in a window
+
+   @param[in] samples samples
+   @param[in] first index of first sample of the window
+   @param[in] n count of samples in the window
+
+   @return peak value
+*/
+static int test_peak(const cw_sample_t * samples, int first, int n)
+{
+	int peak = 0;
+	for (int i = first; i < first + n; i++) {
+		const int value = abs(samples[i]);
+		peak = value > peak ? value : peak;
+	}
+	return peak;
+}
+
+
+
+
+/**
+   @brief Render one tone with given change of gain
+
+   The gain is set before the tone is enqueued, starting from full gain.
+
+   @param cte test executor
+   @param[in] gain target gain
+   @param[in] gain_duration duration of change of gain
+   @param[out] samples array for TEST_N_SAMPLES samples
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_render_tone(cw_test_executor_t * cte, int gain, int gain_duration, cw_sample_t * samples)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		return cwt_retv_err;
+	}
+
+	const cw_gen_tone_t tone = { .frequency = 1000, .duration = TEST_TONE_DURATION };
+	const cw_ret_t set_cwret = LIBCW_TEST_FUT(cw_gen_set_gain)(gen, gain, gain_duration);
+	const cw_ret_t enqueue_cwret = cw_gen_enqueue_tones(gen, &tone, 1);
+	const cw_ret_t render_cwret = cw_gen_render(gen, samples, TEST_N_SAMPLES);
+	cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", set_cwret, "setting gain %d over %d us", gain, gain_duration);
+
+	cw_gen_delete(&gen);
+
+	return CW_SUCCESS == set_cwret && CW_SUCCESS == enqueue_cwret && CW_SUCCESS == render_cwret ? cwt_retv_ok : cwt_retv_err;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_set_parameters.c
+
+   Test of batched update of generator's parameters with
+   cw_gen_set_parameters().
+*/
+
+
+
+
+#include <errno.h>
+
+
+
+
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_set_parameters.h"
+
+
+
+
+/**
+   @brief Test setting all basic parameters of generator at once
+
+   Parameters applied by enqueueing are checked on tone dequeued from
+   generator's tone queue.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_set_parameters(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+	/* Invalid value of one parameter: nothing is set. */
+	{
+		cw_gen_parameters_t before = { 0 };
+		cw_gen_get_parameters(gen, &before);
+
+		cw_gen_parameters_t invalid = { .speed = CW_SPEED_MAX, .frequency = CW_FREQUENCY_MAX, .volume = CW_VOLUME_MAX + 1, .gap = CW_GAP_MAX, .weighting = CW_WEIGHTING_MAX };
+		errno = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_parameters)(gen, &invalid);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "setting invalid parameters");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after setting invalid parameters");
+
+		cw_gen_parameters_t after = { 0 };
+		cw_gen_get_parameters(gen, &after);
+		const bool unchanged = before.speed == after.speed
+			&& before.frequency == after.frequency
+			&& before.volume == after.volume
+			&& before.gap == after.gap
+			&& before.weighting == after.weighting;
+		cte->expect_op_int(cte, true, "==", unchanged, "parameters after setting invalid parameters");
+	}
+
+	/* Valid parameters are pending until next tone is enqueued, and are
+	   used for that tone. */
+	{
+		const cw_gen_parameters_t params = { .speed = 30, .frequency = 1000, .volume = 50, .gap = 2, .weighting = 60 };
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_set_parameters)(gen, &params);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting valid parameters");
+
+		cw_gen_parameters_t pending = { 0 };
+		LIBCW_TEST_FUT(cw_gen_get_parameters)(gen, &pending);
+		const bool returned = params.speed == pending.speed
+			&& params.frequency == pending.frequency
+			&& params.volume == pending.volume
+			&& params.gap == pending.gap
+			&& params.weighting == pending.weighting;
+		cte->expect_op_int(cte, true, "==", returned, "getting pending parameters");
+
+		cw_gen_enqueue_character(gen, 'E');
+		cw_tone_t tone;
+		cw_tq_dequeue_internal(gen->tq, &tone);
+		cw_gen_flush_queue(gen);
+
+		int dot_duration = 0;
+		cw_gen_get_timing_parameters_internal(gen, &dot_duration, NULL, NULL, NULL, NULL, NULL, NULL);
+		const bool applied = params.speed == cw_gen_get_speed(gen)
+			&& params.frequency == cw_gen_get_frequency(gen)
+			&& params.volume == cw_gen_get_volume(gen)
+			&& params.gap == cw_gen_get_gap(gen)
+			&& params.weighting == cw_gen_get_weighting(gen);
+		cte->expect_op_int(cte, true, "==", applied, "parameters applied by enqueueing");
+		cte->expect_op_int(cte, dot_duration, "==", tone.duration, "duration of Dot after applying parameters");
+		cte->expect_op_int(cte, params.frequency, "==", tone.frequency, "frequency of Dot after applying parameters");
+	}
+
+	/* Single setter called after batched update wins over the
+	   batched update. */
+	{
+		const cw_gen_parameters_t params = { .speed = 20, .frequency = 800, .volume = 70, .gap = 0, .weighting = 50 };
+		cw_gen_set_parameters(gen, &params);
+		LIBCW_TEST_FUT(cw_gen_set_speed)(gen, 40);
+		cw_gen_enqueue_character(gen, 'E');
+		cw_gen_flush_queue(gen);
+		cte->expect_op_int(cte, 40, "==", cw_gen_get_speed(gen), "speed set after batched update");
+		cte->expect_op_int(cte, params.frequency, "==", cw_gen_get_frequency(gen), "frequency from batched update");
+	}
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
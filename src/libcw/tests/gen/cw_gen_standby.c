@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_standby.c
+
+   Test of warm standby of generator (cw_gen_config_t::standby_on_stop)
+*/
+
+
+
+
+#include <pthread.h>
+#include <sys/time.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_standby.h"
+
+
+
+
+/* Resuming from standby doesn't create a thread, so it should take far
+   less than this [microseconds]. */
+#define TEST_RESUME_DURATION_MAX 50000
+
+
+
+
+/**
+   @brief Test stopping a generator into standby and resuming it
+
+   In standby the generator's thread must still be running (the same
+   thread as before the stop), and after resume the generator must play
+   tones enqueued in it. Deleting the generator must stop it for real.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_standby(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.standby_on_stop = true;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_start)(gen), "first start");
+	const pthread_t thread_id = gen->thread.id;
+
+	const cw_gen_tone_t tone = { .frequency = 600, .duration = 10000 };
+	for (int i = 0; i < 3; i++) {
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_stop)(gen), "stop into standby #%d", i);
+		cte->expect_op_int(cte, true, "==", gen->standby, "generator in standby #%d", i);
+		cte->expect_op_int(cte, true, "==", gen->thread.running, "thread running in standby #%d", i);
+
+		struct timeval before;
+		gettimeofday(&before, NULL);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_start)(gen), "resume #%d", i);
+		struct timeval after;
+		gettimeofday(&after, NULL);
+		cte->expect_op_int(cte, TEST_RESUME_DURATION_MAX, ">", cw_timestamp_compare_internal(&before, &after), "duration of resume #%d", i);
+		cte->expect_op_int(cte, false, "==", gen->standby, "generator out of standby #%d", i);
+		cte->expect_op_int(cte, true, "==", pthread_equal(thread_id, gen->thread.id) ? true : false, "the same thread after resume #%d", i);
+
+		cw_gen_enqueue_tones(gen, &tone, 1);
+		cw_gen_wait_for_queue_level(gen, 0);
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "tone played after resume #%d", i);
+	}
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_stop)(gen), "last stop into standby");
+	cw_gen_delete(&gen);
+	cte->expect_null_pointer(cte, gen, "generator deleted from standby");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_sync_parameters_internal.c
+
+   Test of tone programs of characters, rebuilt by
+   cw_gen_sync_parameters_internal().
+*/
+
+
+
+
+#include <limits.h> /* UCHAR_MAX */
+#include <string.h>
+
+
+
+
+#include "libcw_data.h"
+#include "common.h"
+#include "libcw_gen.h"
+#include "libcw_tq.h"
+#include "cw_gen_sync_parameters_internal.h"
+
+
+
+
+static bool test_dequeue_character(cw_test_executor_t * cte, cw_gen_t * gen, char character, bool with_ics);
+
+
+
+
+/**
+   @brief Test that characters enqueued from tone programs have correct tones
+
+   Tones of each character are dequeued and compared with tones
+   expected for representation of character at current timing
+   parameters of generator.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_sync_parameters_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = NULL;
+	if (0 != gen_setup_for_tq(cte, &gen)) {
+		return cwt_retv_err;
+	}
+
+	struct {
+		int speed;
+		int weighting;
+		int gap;
+		int frequency;
+	} test_data[] = {
+		{ CW_SPEED_INITIAL, CW_WEIGHTING_INITIAL, CW_GAP_INITIAL, CW_FREQUENCY_INITIAL },
+		{ CW_SPEED_MAX,     CW_WEIGHTING_MAX,     3,              CW_FREQUENCY_INITIAL },
+		{ CW_SPEED_MIN,     CW_WEIGHTING_MIN,     CW_GAP_MAX,     CW_FREQUENCY_INITIAL },
+		/* Only frequency is changed, timing parameters stay in sync. */
+		{ CW_SPEED_MIN,     CW_WEIGHTING_MIN,     CW_GAP_MAX,     CW_FREQUENCY_MAX },
+	};
+	const size_t n_test_data = sizeof (test_data) / sizeof (test_data[0]);
+
+	char charlist[UCHAR_MAX + 1] = { 0 };
+	cw_list_characters(charlist);
+
+	for (size_t t = 0; t < n_test_data; t++) {
+		cw_gen_set_speed(gen, test_data[t].speed);
+		cw_gen_set_weighting(gen, test_data[t].weighting);
+		cw_gen_set_gap(gen, test_data[t].gap);
+		cw_gen_set_frequency(gen, test_data[t].frequency);
+
+		bool failure = false;
+		for (int i = 0; !failure && charlist[i] != '\0'; i++) {
+			failure = !test_dequeue_character(cte, gen, charlist[i], true)
+				|| !test_dequeue_character(cte, gen, charlist[i], false);
+		}
+		cte->expect_op_int(cte, false, "==", failure, "tones of characters (speed = %d, weighting = %d, gap = %d, frequency = %d)",
+				   test_data[t].speed, test_data[t].weighting, test_data[t].gap, test_data[t].frequency);
+	}
+
+	/* Inter-character-space enqueued after character without
+	   inter-character-space is shorter by last inter-mark-space. */
+	int ims_duration = 0;
+	int ics_duration = 0;
+	int additional_space_duration = 0;
+	cw_gen_get_timing_parameters_internal(gen, NULL, NULL, &ims_duration, &ics_duration, NULL, &additional_space_duration, NULL);
+	cw_gen_enqueue_character_no_ics(gen, 'E');
+	cw_gen_enqueue_ics_internal(gen);
+	cw_tone_t tone;
+	for (int i = 0; i < 3; i++) {
+		cw_tq_dequeue_internal(gen->tq, &tone);
+	}
+	cte->expect_op_int(cte, ics_duration - ims_duration + additional_space_duration, "==", tone.duration, "duration of inter-character-space after character without inter-character-space");
+	cw_gen_flush_queue(gen);
+
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Enqueue a character and compare dequeued tones with expected tones
+
+   @return true if tones of the character are correct
+   @return false otherwise
+*/
+static bool test_dequeue_character(cw_test_executor_t * cte, cw_gen_t * gen, char character, bool with_ics)
+{
+	int dot_duration = 0;
+	int dash_duration = 0;
+	int ims_duration = 0;
+	int ics_duration = 0;
+	int additional_space_duration = 0;
+	cw_gen_get_timing_parameters_internal(gen, &dot_duration, &dash_duration, &ims_duration, &ics_duration, NULL, &additional_space_duration, NULL);
+
+	const cw_ret_t cwret = with_ics
+		? LIBCW_TEST_FUT(cw_gen_enqueue_character)(gen, character)
+		: LIBCW_TEST_FUT(cw_gen_enqueue_character_no_ics)(gen, character);
+	if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueueing character '%c'", character)) {
+		return false;
+	}
+
+	const char * representation = cw_character_to_representation_internal(character);
+	const size_t n_marks = strlen(representation);
+
+	bool correct = true;
+	cw_tone_t tone;
+	for (size_t m = 0; m < n_marks; m++) {
+		const int mark_duration = representation[m] == CW_DASH_REPRESENTATION ? dash_duration : dot_duration;
+		cw_tq_dequeue_internal(gen->tq, &tone);
+		correct = correct
+			&& tone.duration == mark_duration
+			&& tone.frequency == cw_gen_get_frequency(gen)
+			&& tone.slope_mode == CW_SLOPE_MODE_STANDARD_SLOPES
+			&& tone.is_first == (0 == m);
+		/* Last inter-mark-space is merged with
+		   inter-character-space. */
+		const int space_duration = with_ics && m == n_marks - 1
+			? ics_duration + additional_space_duration
+			: ims_duration;
+		cw_tq_dequeue_internal(gen->tq, &tone);
+		correct = correct
+			&& tone.duration == space_duration
+			&& tone.frequency == 0;
+	}
+	correct = correct && 0 == cw_gen_get_queue_length(gen);
+	cw_gen_flush_queue(gen);
+
+	return cte->expect_op_int_errors_only(cte, true, "==", correct, "tones of character '%c' (with ics = %d)", character, with_ics);
+}
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_tap.c
+
+   Test of tap of generator (cw_gen_enable_tap()).
+*/
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_tap.h"
+
+
+
+
+#define TEST_TEXT "paris paris"
+
+/* Size of array used by reader in one call to cw_gen_read_tap(). */
+#define TEST_READ_N_SAMPLES 300
+
+
+
+
+/* Samples read from tap by reader thread, indexed by position in
+   tap. */
+typedef struct {
+	cw_gen_t * gen;
+	cw_sample_t * samples;
+	bool * is_read;
+	uint64_t capacity;
+	int n_reads;
+	bool positions_failure;
+	bool quit;          /* Accessed atomically. */
+} test_reader_t;
+
+
+
+
+static cwt_retv test_tap_internal(cw_test_executor_t * cte, int decimation, cw_gen_tap_mode_t mode);
+static void * test_reader_thread(void * arg);
+static void test_reader_read_internal(test_reader_t * reader);
+static void test_expected_samples_internal(const cw_sample_t * file_samples, long n_file_samples, int decimation, cw_gen_tap_mode_t mode, cw_sample_t * expected, uint64_t n_expected);
+
+
+
+
+/**
+   @brief Test that tap of generator holds samples written to sound device
+
+   Generator with File sound system writes its buffers as fast as it
+   can, and a reader thread reads the tap in small pieces at the same
+   time. Every sample read by the reader, and every sample left in the
+   tap at the end, must be equal to (decimated) sample from the file.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_tap(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_tap_internal(cte, 1, CW_GEN_TAP_SAMPLE)
+	    || cwt_retv_ok != test_tap_internal(cte, 7, CW_GEN_TAP_SAMPLE)
+	    || cwt_retv_ok != test_tap_internal(cte, 1, CW_GEN_TAP_PEAK)
+	    || cwt_retv_ok != test_tap_internal(cte, 10, CW_GEN_TAP_PEAK)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void * test_reader_thread(void * arg)
+{
+	test_reader_t * reader = (test_reader_t *) arg;
+	while (!__atomic_load_n(&reader->quit, __ATOMIC_ACQUIRE)) {
+		test_reader_read_internal(reader);
+		usleep(500);
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Read new samples from tap, store them at their positions
+
+   @param[in,out] reader reader
+*/
+static void test_reader_read_internal(test_reader_t * reader)
+{
+	uint64_t position = 0;
+	if (CW_SUCCESS != cw_gen_get_tap_position(reader->gen, &position, NULL)) {
+		reader->positions_failure = true;
+		return;
+	}
+	/* Start at the oldest sample, which may be overwritten by
+	   generator during reading. */
+	position = position > CW_GEN_TAP_CAPACITY ? position - CW_GEN_TAP_CAPACITY : 0;
+
+	cw_sample_t samples[TEST_READ_N_SAMPLES];
+	while (true) {
+		const uint64_t before = position;
+		const int n = cw_gen_read_tap(reader->gen, &position, samples, TEST_READ_N_SAMPLES);
+		if (n <= 0) {
+			if (n < 0) {
+				reader->positions_failure = true;
+			}
+			break;
+		}
+		if (position < before + (uint64_t) n || position > reader->capacity) {
+			reader->positions_failure = true;
+			break;
+		}
+		const uint64_t start = position - (uint64_t) n;
+		memcpy(reader->samples + start, samples, (size_t) n * sizeof (cw_sample_t));
+		for (int i = 0; i < n; i++) {
+			reader->is_read[start + (uint64_t) i] = true;
+		}
+		reader->n_reads++;
+	}
+
+	return;
+}
+
+
+
+
+/**
+   @brief Calculate samples that should be in tap, from samples written to sound device
+
+   @param[in] file_samples samples written to file by generator
+   @param[in] n_file_samples count of samples in @p file_samples
+   @param[in] decimation decimation of tap
+   @param[in] mode mode of tap
+   @param[out] expected expected samples of tap
+   @param[in] n_expected count of samples to calculate
+*/
+static void test_expected_samples_internal(const cw_sample_t * file_samples, long n_file_samples, int decimation, cw_gen_tap_mode_t mode, cw_sample_t * expected, uint64_t n_expected)
+{
+	for (uint64_t i = 0; i < n_expected; i++) {
+		const uint64_t first = i * (uint64_t) decimation;
+		if (first + (uint64_t) decimation > (uint64_t) n_file_samples) {
+			break;
+		}
+		if (CW_GEN_TAP_SAMPLE == mode) {
+			expected[i] = file_samples[first];
+		} else {
+			int peak = 0;
+			for (int j = 0; j < decimation; j++) {
+				const int value = abs((int) file_samples[first + (uint64_t) j]);
+				if (value > peak) {
+					peak = value;
+				}
+			}
+			expected[i] = (cw_sample_t) (peak > INT16_MAX ? INT16_MAX : peak);
+		}
+	}
+	return;
+}
+
+
+
+
+/**
+   @brief Render test text to file, read it from tap of generator
+
+   @param cte test executor
+   @param[in] decimation decimation of tap
+   @param[in] mode mode of tap
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_tap_internal(cw_test_executor_t * cte, int decimation, cw_gen_tap_mode_t mode)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_tap_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.sidetone_low_latency = false;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	/* Invalid arguments, and tap that has never been enabled. */
+	uint64_t position = 0;
+	cw_sample_t sample = 0;
+	errno = 0;
+	cte->expect_op_int(cte, -1, "==", LIBCW_TEST_FUT(cw_gen_read_tap)(gen, &position, &sample, 1), "reading tap that has never been enabled");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of reading tap that has never been enabled");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_tap)(gen, 0, mode), "enabling tap with zero decimation");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of enabling tap with zero decimation");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_tap)(gen, CW_GEN_TAP_DECIMATION_MAX + 1, mode), "enabling tap with too large decimation");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of enabling tap with too large decimation");
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enable_tap)(gen, decimation, mode), "enabling tap, decimation %d, mode %d", decimation, mode);
+	int sample_rate = 0;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_get_tap_position)(gen, &position, &sample_rate), "getting position of empty tap");
+	cte->expect_op_int(cte, 0, "==", (int) position, "position of empty tap");
+	cte->expect_op_int(cte, (int) gen->sample_rate / decimation, "==", sample_rate, "sample rate of tap");
+	cte->expect_op_int(cte, 0, "==", LIBCW_TEST_FUT(cw_gen_read_tap)(gen, &position, &sample, 1), "reading empty tap");
+
+	/* Ten seconds of samples is much more than the test text. */
+	test_reader_t reader = { 0 };
+	reader.gen = gen;
+	reader.capacity = (uint64_t) gen->sample_rate * 10 / (uint64_t) decimation;
+	reader.samples = calloc(reader.capacity, sizeof (cw_sample_t));
+	reader.is_read = calloc(reader.capacity, sizeof (bool));
+	pthread_t reader_thread_id;
+	if (NULL == reader.samples || NULL == reader.is_read
+	    || 0 != pthread_create(&reader_thread_id, NULL, test_reader_thread, &reader)) {
+		cte->log_error(cte, "%s:%d: Failed to start reader\n", __func__, __LINE__);
+		free(reader.samples);
+		free(reader.is_read);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	__atomic_store_n(&reader.quit, true, __ATOMIC_RELEASE);
+	pthread_join(reader_thread_id, NULL);
+	/* All samples that are still in the tap. */
+	test_reader_read_internal(&reader);
+	cte->expect_op_int(cte, false, "==", reader.positions_failure, "positions of samples read from tap");
+
+	uint64_t end_position = 0;
+	cw_gen_get_tap_position(gen, &end_position, NULL);
+
+	/* Disabled tap keeps its samples, and doesn't get new ones. */
+	cw_gen_disable_tap(gen);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "e");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+	uint64_t disabled_position = 0;
+	cw_gen_get_tap_position(gen, &disabled_position, NULL);
+	cte->expect_op_int(cte, (int) end_position, "==", (int) disabled_position, "position of disabled tap");
+
+	cw_gen_delete(&gen);
+
+	FILE * file = fopen(path, "rb");
+	cw_sample_t * file_samples = NULL;
+	long n_file_samples = 0;
+	if (NULL != file) {
+		fseek(file, 0, SEEK_END);
+		n_file_samples = ftell(file) / (long) sizeof (cw_sample_t);
+		fseek(file, 0, SEEK_SET);
+		file_samples = calloc((size_t) n_file_samples + 1, sizeof (cw_sample_t));
+		if (NULL != file_samples && (size_t) n_file_samples != fread(file_samples, sizeof (cw_sample_t), (size_t) n_file_samples, file)) {
+			free(file_samples);
+			file_samples = NULL;
+		}
+		fclose(file);
+	}
+	unlink(path);
+
+	const bool have_contents = NULL != file_samples;
+	if (have_contents) {
+		/* File has also samples of "e" played with disabled tap. */
+		cte->expect_op_int(cte, true, "==", end_position > (uint64_t) CW_GEN_TAP_CAPACITY / (uint64_t) decimation, "tap has covered most of the text");
+		cte->expect_op_int(cte, true, "==", end_position <= (uint64_t) n_file_samples / (uint64_t) decimation + 1, "position of tap is within samples written to file");
+		cte->expect_op_int(cte, true, "==", end_position <= reader.capacity, "position of tap is within capacity of reader");
+
+		uint64_t n_read = 0;
+		uint64_t n_mismatched = 0;
+		if (end_position <= reader.capacity) {
+			cw_sample_t * expected = calloc(end_position + 1, sizeof (cw_sample_t));
+			if (NULL != expected) {
+				test_expected_samples_internal(file_samples, n_file_samples, decimation, mode, expected, end_position);
+				for (uint64_t i = 0; i < end_position; i++) {
+					if (reader.is_read[i]) {
+						n_read++;
+						if (reader.samples[i] != expected[i]) {
+							n_mismatched++;
+						}
+					}
+				}
+				free(expected);
+			}
+		}
+		/* At least the samples that have been left in the tap at
+		   the end have been read. */
+		const uint64_t n_in_tap = end_position < CW_GEN_TAP_CAPACITY ? end_position : CW_GEN_TAP_CAPACITY;
+		cte->expect_op_int(cte, true, "==", n_read >= n_in_tap, "count of samples read from tap, decimation %d, mode %d", decimation, mode);
+		cte->expect_op_int(cte, 0, "==", (int) n_mismatched, "samples read from tap are equal to samples in file, decimation %d, mode %d", decimation, mode);
+	} else {
+		cte->log_error(cte, "%s:%d: Failed to read output file %s\n", __func__, __LINE__, path);
+	}
+
+	free(file_samples);
+	free(reader.samples);
+	free(reader.is_read);
+
+	return have_contents ? cwt_retv_ok : cwt_retv_err;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_thread_realtime.c
+
+   Test of realtime configuration of generator's thread
+*/
+
+
+
+
+#include <pthread.h>
+#include <sched.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_thread_realtime.h"
+
+
+
+
+/**
+   @brief Test scheduling policy and CPU affinity of generator's thread
+
+   Realtime policy may be refused when the test is run without
+   privileges. Then the thread must keep its default policy, and the
+   generator must work as usual. CPU affinity to first CPU is always
+   allowed.
+
+   Memory locking is not tested: with MCL_FUTURE it would stay in force
+   for rest of tests.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_thread_realtime(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.thread_sched_policy = SCHED_FIFO;
+	gen_conf.thread_sched_priority = sched_get_priority_min(SCHED_FIFO);
+	gen_conf.thread_cpu_affinity = 1;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_start)(gen), "start");
+
+	int policy = -1;
+	struct sched_param param = { 0 };
+	pthread_getschedparam(gen->thread.id, &policy, &param);
+	if (SCHED_FIFO == policy) {
+		cte->expect_op_int(cte, gen_conf.thread_sched_priority, "==", param.sched_priority, "priority of thread");
+	} else {
+		cte->log_info(cte, "Realtime scheduling of generator thread not permitted, policy is %d\n", policy);
+		cte->expect_op_int(cte, SCHED_OTHER, "==", policy, "fallback policy of thread");
+	}
+
+#if defined(__linux__) && defined(CPU_SET)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	pthread_getaffinity_np(gen->thread.id, sizeof (cpus), &cpus);
+	cte->expect_op_int(cte, 1, "==", CPU_COUNT(&cpus), "count of CPUs of thread");
+	cte->expect_op_int(cte, true, "==", CPU_ISSET(0, &cpus) ? true : false, "CPU of thread");
+#endif
+
+	const cw_gen_tone_t tone = { .frequency = 600, .duration = 10000 };
+	cw_gen_enqueue_tones(gen, &tone, 1);
+	cw_gen_wait_for_queue_level(gen, 0);
+	cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "tone played");
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
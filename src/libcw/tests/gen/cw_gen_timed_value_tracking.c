@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_timed_value_tracking.c
+
+   Test of value tracking callback that receives time of playback of
+   change of generator's value
+   (cw_gen_register_timed_value_tracking_callback_internal()).
+*/
+
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_gen_timed_value_tracking.h"
+
+
+
+
+/* Character sent in the test: a single Dot. */
+#define TEST_CHARACTER 'e'
+
+/* Max count of changes of value recorded by the test. */
+#define TEST_N_EDGES_MAX 8
+
+
+
+
+typedef struct {
+	int n_edges;
+	int values[TEST_N_EDGES_MAX];
+	struct timeval times[TEST_N_EDGES_MAX];
+} test_edges_t;
+
+
+
+
+static void test_timed_callback_internal(void * callback_arg, int state, const struct timeval * playback_time);
+
+
+
+
+/**
+   @brief Test times of playback passed to timed value tracking callback
+
+   A Dot is sent to a file. Times of playback of key-down and key-up
+   must be separated by duration of the Dot, and key-down can't be
+   played before the Dot has been enqueued.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_timed_value_tracking(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_timed_%ld.raw", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	test_edges_t edges = { 0 };
+	cw_gen_register_timed_value_tracking_callback_internal(gen, test_timed_callback_internal, &edges);
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+
+	struct timeval before = { 0 };
+	cw_gen_get_timestamp(gen, &before);
+	cw_gen_enqueue_character(gen, TEST_CHARACTER);
+	cw_gen_wait_for_queue_level(gen, 0);
+	usleep(100 * 1000);
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	unlink(path);
+
+	if (!cte->expect_op_int(cte, 2, "<=", edges.n_edges, "count of changes of value")) {
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", edges.values[0], "first change of value is key-down");
+	cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", edges.values[1], "second change of value is key-up");
+	cte->expect_op_int(cte, 0, "<=", cw_timestamp_compare_internal(&before, &edges.times[0]), "key-down isn't played before enqueueing");
+
+	const int mark = cw_timestamp_compare_internal(&edges.times[0], &edges.times[1]);
+	const int margin = durations.dot_duration / 4;
+	cte->expect_op_int(cte, durations.dot_duration - margin, "<=", mark, "duration of Mark (lower bound)");
+	cte->expect_op_int(cte, durations.dot_duration + margin, ">=", mark, "duration of Mark (upper bound)");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Record change of generator's value and its time of playback
+
+   @param[in] callback_arg test_edges_t variable
+   @param[in] state new value of generator
+   @param[in] playback_time time of playback of the change
+*/
+static void test_timed_callback_internal(void * callback_arg, int state, const struct timeval * playback_time)
+{
+	test_edges_t * edges = (test_edges_t *) callback_arg;
+	if (edges->n_edges < TEST_N_EDGES_MAX) {
+		edges->values[edges->n_edges] = state;
+		edges->times[edges->n_edges] = *playback_time;
+		edges->n_edges++;
+	}
+}
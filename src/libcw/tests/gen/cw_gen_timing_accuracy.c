@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_timing_accuracy.c
+
+   Test of timing of Marks and Spaces in samples calculated by generator
+
+   Automated variant of libcw_gen_tests_debug_pcm_file_timings.c: a known
+   text is rendered in memory with cw_gen_render_string() (no sound
+   device, no raw samples file and no sox are needed) for many speeds,
+   weightings and sample rates. Elements are detected in the samples
+   with the same detector that is used by wav_state_detector, and
+   durations of every type of element are compared with ideal durations
+   from cw_gen_get_durations_internal().
+
+   The test also fails when samples are rendered too slowly, so that
+   changes in synthesis of samples can't silently break either timing or
+   speed of generator.
+*/
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include <cwutils/lib/elements.h>
+#include <cwutils/lib/elements_detect.h>
+#include <cwutils/lib/element_stats.h>
+#include <cwutils/lib/misc.h>
+
+#include "libcw_gen.h"
+#include "cw_gen_timing_accuracy.h"
+
+
+
+
+/* Text rendered in the test. It doesn't start with a space, because
+   rendered samples don't start with inter-word-space. */
+#define TEST_TEXT "PARIS 0 QTH"
+
+/* Allowed divergence of duration of any element from ideal duration
+   [percents], on top of error of detection of edges of elements. The
+   error of detection is up to TEST_EDGE_N_SAMPLES samples, plus
+   TEST_SLOPE_ERROR_US microseconds: first and last samples of slopes
+   are so small that they are rounded to zero, so Marks seem to be a
+   bit shorter, and Spaces a bit longer, than they really are. This
+   matters only for the shortest elements at highest speeds. */
+#define TEST_THRESHOLD_PERCENT 1.0
+#define TEST_EDGE_N_SAMPLES 2
+#define TEST_SLOPE_ERROR_US 100.0
+
+/* Samples must be rendered at least this many times faster than real
+   time. The limit is low enough for slow machines and builds with
+   debug options, but catches synthesis that e.g. recalculates every
+   sample of every tone from scratch. */
+#define TEST_MIN_REALTIME_FACTOR 20.0
+
+
+
+
+static const int g_speeds[] = { 4, 12, 24, 36, 60 };
+static const int g_weightings[] = { 20, 50, 80 };
+static const unsigned int g_sample_rates[] = { 8000, 22050, 44100, 48000 };
+
+
+
+
+static cwt_retv test_timing_accuracy_sub(cw_test_executor_t * cte, int speed, int weighting, unsigned int sample_rate, double * render_seconds, double * audio_seconds);
+static void test_evaluate_elements(cw_test_executor_t * cte, const cw_elements_t * string_elements, const cw_elements_t * wav_elements, const cw_gen_durations_t * durations, unsigned int sample_rate, const char * label);
+static int test_detect_elements(const cw_sample_t * samples, size_t n_samples, unsigned int sample_rate, cw_elements_t * elements);
+static double test_now_seconds(void);
+
+
+
+
+/**
+   @brief Test durations of elements in samples rendered with many settings of generator
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_timing_accuracy(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	double render_seconds = 0.0;
+	double audio_seconds = 0.0;
+	for (size_t s = 0; s < sizeof (g_speeds) / sizeof (g_speeds[0]); s++) {
+		for (size_t w = 0; w < sizeof (g_weightings) / sizeof (g_weightings[0]); w++) {
+			for (size_t r = 0; r < sizeof (g_sample_rates) / sizeof (g_sample_rates[0]); r++) {
+				if (cwt_retv_ok != test_timing_accuracy_sub(cte, g_speeds[s], g_weightings[w], g_sample_rates[r], &render_seconds, &audio_seconds)) {
+					cte->print_test_footer(cte, __func__);
+					return cwt_retv_err;
+				}
+			}
+		}
+	}
+
+	const double realtime_factor = audio_seconds / render_seconds;
+	cte->log_info(cte, "%.1f s of audio rendered in %.3f s (%.0f times faster than real time)\n",
+		      audio_seconds, render_seconds, realtime_factor);
+	cte->expect_op_double(cte, TEST_MIN_REALTIME_FACTOR, "<", realtime_factor, "speed of rendering");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Render test text with given settings, compare durations of detected elements with ideal durations
+
+   @param cte test executor
+   @param[in] speed speed of generator [wpm]
+   @param[in] weighting weighting of generator
+   @param[in] sample_rate sample rate of generator
+   @param[in,out] render_seconds accumulated time of rendering
+   @param[in,out] audio_seconds accumulated duration of rendered samples
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+static cwt_retv test_timing_accuracy_sub(cw_test_executor_t * cte, int speed, int weighting, unsigned int sample_rate, double * render_seconds, double * audio_seconds)
+{
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_elements_t * string_elements = cw_elements_new(0);
+	cw_elements_t * wav_elements = cw_elements_new(0);
+	if (NULL == gen || NULL == string_elements || NULL == wav_elements) {
+		cte->log_error(cte, "%s:%d: Failed to allocate test data\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		cw_elements_delete(&string_elements);
+		cw_elements_delete(&wav_elements);
+		return cwt_retv_err;
+	}
+
+	/* Null sound system doesn't use sample rate, so it can be
+	   replaced. Slopes depend on sample rate. */
+	gen->sample_rate = sample_rate;
+	cw_gen_set_tone_slope(gen, -1, -1);
+	cw_gen_set_speed(gen, speed);
+	cw_gen_set_weighting(gen, weighting);
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+	const double begin = test_now_seconds();
+	cw_sample_t * samples = NULL;
+	size_t n_samples = 0;
+	const cw_ret_t cwret = cw_gen_render_string(gen, TEST_TEXT, 1, &samples, &n_samples);
+	*render_seconds += test_now_seconds() - begin;
+	*audio_seconds += (double) n_samples / sample_rate;
+	cw_gen_delete(&gen);
+
+	cwt_retv retv = cwt_retv_ok;
+	if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "rendering samples")) {
+		retv = cwt_retv_err;
+	} else if (0 != cw_elements_detect_from_string(TEST_TEXT, string_elements)
+		   || 0 != test_detect_elements(samples, n_samples, sample_rate, wav_elements)) {
+		cte->log_error(cte, "%s:%d: Failed to detect elements\n", __func__, __LINE__);
+		retv = cwt_retv_err;
+	} else {
+		char label[64];
+		snprintf(label, sizeof (label), "%d wpm, weighting %d, %u Hz", speed, weighting, sample_rate);
+		test_evaluate_elements(cte, string_elements, wav_elements, &durations, sample_rate, label);
+	}
+
+	free(samples);
+	cw_elements_delete(&string_elements);
+	cw_elements_delete(&wav_elements);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Compare durations of elements detected in samples with ideal durations
+
+   Durations of all elements of one type (e.g. all Dots) are collected
+   in one cw_element_stats_t, and the longest and the shortest of them
+   must not diverge from ideal duration by more than allowed threshold.
+
+   @param cte test executor
+   @param[in] string_elements elements of test text, with types
+   @param[in] wav_elements elements detected in samples
+   @param[in] durations ideal durations of elements
+   @param[in] sample_rate sample rate of samples
+   @param[in] label description of settings of generator, for messages
+*/
+static void test_evaluate_elements(cw_test_executor_t * cte, const cw_elements_t * string_elements, const cw_elements_t * wav_elements, const cw_gen_durations_t * durations, unsigned int sample_rate, const char * label)
+{
+	/* Detector reports also the last Space in samples, so each element
+	   of the text has its counterpart in samples. */
+	if (!cte->expect_op_int_errors_only(cte, (int) string_elements->curr_count, "==", (int) wav_elements->curr_count, "count of elements, %s", label)) {
+		return;
+	}
+
+	/* Statistics of Dots, Dashes, inter-mark-spaces,
+	   inter-character-spaces and inter-word-spaces, indexed with
+	   cw_element_type_t. */
+	cw_element_stats_t stats[cw_element_type_iws + 1];
+	for (int t = 0; t <= cw_element_type_iws; t++) {
+		cw_element_stats_init(&stats[t]);
+	}
+	int n_state_mismatches = 0;
+	for (size_t i = 0; i < wav_elements->curr_count; i++) {
+		cw_element_t expected;
+		cw_element_t actual;
+		cw_elements_get_element(string_elements, i, &expected);
+		cw_elements_get_element(wav_elements, i, &actual);
+		if (expected.state != actual.state) {
+			n_state_mismatches++;
+			continue;
+		}
+		cw_element_stats_update(&stats[expected.type], (int) lround(actual.timespan));
+	}
+	cte->expect_op_int_errors_only(cte, 0, "==", n_state_mismatches, "states of elements, %s", label);
+
+	const double edge_error = TEST_EDGE_N_SAMPLES * 1000000.0 / sample_rate + TEST_SLOPE_ERROR_US; /* [microseconds] */
+	for (int t = cw_element_type_dot; t <= cw_element_type_iws; t++) {
+		if (0 == stats[t].count) {
+			continue;
+		}
+		int ideal = 0;
+		cw_element_type_to_duration((cw_element_type_t) t, durations, &ideal);
+		cw_element_stats_divergences_t divergences;
+		cw_element_stats_calculate_divergences(&stats[t], &divergences, ideal);
+
+		const double threshold = TEST_THRESHOLD_PERCENT + 100.0 * edge_error / ideal;
+		const double divergence = fabs(divergences.min) > fabs(divergences.max) ? fabs(divergences.min) : fabs(divergences.max);
+		if (!cte->expect_op_double_errors_only(cte, threshold, ">", divergence,
+						       "divergence of durations of elements of type '%c', %s",
+						       cw_element_type_get_representation((cw_element_type_t) t), label)) {
+			cte->log_error(cte, "%s, type '%c': ideal = %d us, min = %d us, max = %d us\n", label, cw_element_type_get_representation((cw_element_type_t) t), ideal, stats[t].duration_min, stats[t].duration_max);
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Detect elements in samples
+
+   Samples are passed to detector through a temporary file, in the same
+   form as samples of raw samples file of generator.
+
+   @param[in] samples samples to analyze
+   @param[in] n_samples count of @p samples
+   @param[in] sample_rate sample rate of @p samples
+   @param[out] elements elements to which to append detected elements
+
+   @return 0 on success
+   @return -1 on failure
+*/
+static int test_detect_elements(const cw_sample_t * samples, size_t n_samples, unsigned int sample_rate, cw_elements_t * elements)
+{
+	FILE * file = tmpfile();
+	if (NULL == file) {
+		return -1;
+	}
+	int retval = -1;
+	if (n_samples == fwrite(samples, sizeof (cw_sample_t), n_samples, file)
+	    && 0 == fflush(file)
+	    && 0 == lseek(fileno(file), 0, SEEK_SET)) {
+		retval = cw_elements_detect_from_wav(fileno(file), elements, 1000000.0 / sample_rate);
+	}
+	fclose(file);
+
+	return retval;
+}
+
+
+
+
+static double test_now_seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
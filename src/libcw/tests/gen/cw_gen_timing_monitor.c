@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_gen_timing_monitor.c
+
+   Test of timing monitor of generator.
+*/
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_monitor.h"
+#include "cw_gen_timing_monitor.h"
+
+
+
+
+/* Alarms received by test_alarm_callback(). */
+typedef struct {
+	int n_alarms;
+	cw_gen_timing_element_t element;
+	int ideal_duration;
+	int actual_duration;
+} test_alarms_t;
+
+
+
+
+static void test_alarm_callback(void * callback_arg, cw_gen_timing_element_t element, int ideal_duration, int actual_duration);
+static cwt_retv test_timing_monitor_synthetic(cw_test_executor_t * cte);
+static cwt_retv test_timing_monitor_playback(cw_test_executor_t * cte);
+
+
+
+
+/**
+   @brief Test timing monitor of generator
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_timing_monitor(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cwt_retv retv = test_timing_monitor_synthetic(cte);
+	if (cwt_retv_ok == retv) {
+		retv = test_timing_monitor_playback(cte);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Pass known changes of generator's value directly to monitor
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+static cwt_retv test_timing_monitor_synthetic(cw_test_executor_t * cte)
+{
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 20);
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+
+	/* Invalid arguments. */
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_timing_monitor)(NULL, 1000, NULL, NULL), "enabling monitor of NULL generator");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enabling monitor of NULL generator");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_enable_timing_monitor)(gen, -1, NULL, NULL), "enabling monitor with negative threshold");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno after enabling monitor with negative threshold");
+	cw_gen_timing_statistics_t statistics;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, NULL), "getting statistics into NULL pointer");
+
+	/* Generator without monitor has empty statistics. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, &statistics), "getting statistics without monitor");
+	cte->expect_op_int(cte, 0, "==", (int) statistics.elements[CW_GEN_TIMING_DOT].count, "Dots without monitor");
+
+
+	/* 'A' with one too long Dash, inter-character-space, and 'E'
+	   followed by a long pause. */
+	const int threshold = 1000;
+	const int dash_error = 1500;
+	test_alarms_t alarms = { 0 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_gen_enable_timing_monitor)(gen, threshold, test_alarm_callback, &alarms), "enabling monitor");
+	int64_t t = 1000000;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_CLOSED, t);
+	t += durations.dot_duration;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_OPEN, t);
+	t += durations.ims_duration;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_CLOSED, t);
+	t += durations.dash_duration + dash_error;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_OPEN, t);
+	t += durations.ics_duration - 200;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_CLOSED, t);
+	t += durations.dot_duration + 200;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_OPEN, t);
+	t += 10 * durations.iws_duration;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_CLOSED, t);
+
+	LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, &statistics);
+	const cw_gen_timing_error_statistics_t * dots = &statistics.elements[CW_GEN_TIMING_DOT];
+	const cw_gen_timing_error_statistics_t * dashes = &statistics.elements[CW_GEN_TIMING_DASH];
+	cte->expect_op_int(cte, 2, "==", (int) dots->count, "count of Dots");
+	cte->expect_op_int(cte, 0, "==", dots->error_min, "smallest error of Dots");
+	cte->expect_op_int(cte, 200, "==", dots->error_max, "largest error of Dots");
+	cte->expect_op_int(cte, 100, "==", (int) lroundf(dots->error_mean), "mean error of Dots");
+	cte->expect_op_int(cte, 100, "==", (int) lroundf(dots->jitter), "jitter of Dots");
+	cte->expect_op_int(cte, 1, "==", (int) dashes->count, "count of Dashes");
+	cte->expect_op_int(cte, dash_error, "==", dashes->error_max, "error of Dash");
+	cte->expect_op_int(cte, 1, "==", (int) dashes->n_alarms, "alarms of Dashes");
+	cte->expect_op_int(cte, 1, "==", (int) statistics.elements[CW_GEN_TIMING_IMS].count, "count of inter-mark-spaces");
+	cte->expect_op_int(cte, 1, "==", (int) statistics.elements[CW_GEN_TIMING_ICS].count, "count of inter-character-spaces");
+	cte->expect_op_int(cte, -200, "==", statistics.elements[CW_GEN_TIMING_ICS].error_min, "error of inter-character-space");
+	/* Long pause is not an inter-word-space. */
+	cte->expect_op_int(cte, 0, "==", (int) statistics.elements[CW_GEN_TIMING_IWS].count, "count of inter-word-spaces");
+
+	cte->expect_op_int(cte, 1, "==", alarms.n_alarms, "count of alarms");
+	cte->expect_op_int(cte, CW_GEN_TIMING_DASH, "==", alarms.element, "element of alarm");
+	cte->expect_op_int(cte, durations.dash_duration, "==", alarms.ideal_duration, "ideal duration in alarm");
+	cte->expect_op_int(cte, durations.dash_duration + dash_error, "==", alarms.actual_duration, "actual duration in alarm");
+
+
+	/* Disabled monitor doesn't measure anything, and keeps its
+	   statistics. */
+	LIBCW_TEST_FUT(cw_gen_disable_timing_monitor)(gen);
+	t += 2 * durations.dash_duration;
+	cw_gen_timing_monitor_update_internal(gen, CW_KEY_VALUE_OPEN, t);
+	LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, &statistics);
+	cte->expect_op_int(cte, 1, "==", (int) statistics.elements[CW_GEN_TIMING_DASH].n_alarms, "alarms of Dashes after disabling monitor");
+	cte->expect_op_int(cte, 1, "==", alarms.n_alarms, "count of alarms after disabling monitor");
+
+	LIBCW_TEST_FUT(cw_gen_reset_timing_statistics)(gen);
+	LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, &statistics);
+	cte->expect_op_int(cte, 0, "==", (int) statistics.elements[CW_GEN_TIMING_DOT].count, "Dots after reset");
+
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Monitor a text played by generator with virtual clock
+
+   Changes of value of generator with virtual clock are reported at
+   exact times, so all Marks and Spaces of the text must be measured
+   without errors.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+static cwt_retv test_timing_monitor_playback(cw_test_executor_t * cte)
+{
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL, .null_virtual_clock = true };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_gen_set_speed(gen, 30);
+
+	test_alarms_t alarms = { 0 };
+	cw_gen_enable_timing_monitor(gen, 0, test_alarm_callback, &alarms);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, "paris paris");
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	cw_gen_timing_statistics_t statistics;
+	LIBCW_TEST_FUT(cw_gen_get_timing_statistics)(gen, &statistics);
+	cte->expect_op_int(cte, 2 * 10, "==", (int) statistics.elements[CW_GEN_TIMING_DOT].count, "Dots of played text");
+	cte->expect_op_int(cte, 2 * 4, "==", (int) statistics.elements[CW_GEN_TIMING_DASH].count, "Dashes of played text");
+	cte->expect_op_int(cte, 2 * 9, "==", (int) statistics.elements[CW_GEN_TIMING_IMS].count, "inter-mark-spaces of played text");
+	cte->expect_op_int(cte, 2 * 4, "==", (int) statistics.elements[CW_GEN_TIMING_ICS].count, "inter-character-spaces of played text");
+	cte->expect_op_int(cte, 1, "==", (int) statistics.elements[CW_GEN_TIMING_IWS].count, "inter-word-spaces of played text");
+	for (int i = 0; i < CW_GEN_TIMING_N_ELEMENTS; i++) {
+		cte->expect_op_int(cte, 0, "==", statistics.elements[i].error_min, "smallest error of element %d", i);
+		cte->expect_op_int(cte, 0, "==", statistics.elements[i].error_max, "largest error of element %d", i);
+	}
+	cte->expect_op_int(cte, 0, "==", alarms.n_alarms, "alarms of played text");
+
+	cw_gen_delete(&gen);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void test_alarm_callback(void * callback_arg, cw_gen_timing_element_t element, int ideal_duration, int actual_duration)
+{
+	test_alarms_t * alarms = (test_alarms_t *) callback_arg;
+	alarms->n_alarms++;
+	alarms->element = element;
+	alarms->ideal_duration = ideal_duration;
+	alarms->actual_duration = actual_duration;
+}
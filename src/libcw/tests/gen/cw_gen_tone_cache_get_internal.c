@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_tone_cache_get_internal.c
+
+   Test of cw_gen_tone_cache_get_internal()
+*/
+
+
+
+
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "cw_gen_tone_cache_get_internal.h"
+
+
+
+
+/* Count of samples in tested tone. Short enough to be rendered by
+   generator in a single fragment, so that reference samples calculated
+   in the test are exactly the same. */
+#define TEST_N_SAMPLES 1000
+
+
+
+
+static bool test_phase_equal(float a, float b);
+
+
+
+/**
+   @brief Test cw_gen_tone_cache_get_internal()
+
+   Verify that the cache returns samples identical to samples calculated
+   directly, that repeated requests for the same tone are served from the
+   cache, and that the cache is invalidated by change of generator's
+   parameters. Also verify that tones that can't be cached are rejected.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_tone_cache_get_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cw_ret_t cwret = cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set tone slope");
+
+	cw_sample_t * reference = calloc(TEST_N_SAMPLES, sizeof (cw_sample_t));
+	if (NULL == reference) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, 800, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+	tone.n_samples = TEST_N_SAMPLES;
+	tone.rising_slope_n_samples = gen->tone_slope.n_amplitudes;
+	tone.falling_slope_n_samples = gen->tone_slope.n_amplitudes;
+
+
+	/* Reference samples, calculated directly from phase zero. */
+	cw_sample_t * original_buffer = gen->buffer;
+	const int original_buffer_n_samples = gen->buffer_n_samples;
+	gen->buffer = reference;
+	gen->buffer_n_samples = TEST_N_SAMPLES;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = TEST_N_SAMPLES - 1;
+	gen->phase_offset = 0.0F;
+	gen->phase_acc = 0;
+	{
+		cw_tone_t reference_tone;
+		CW_TONE_COPY(&reference_tone, &tone);
+		cw_gen_calculate_sine_wave_internal(gen, &reference_tone);
+	}
+	const float phase_after_tone = gen->phase_offset;
+	gen->buffer = original_buffer;
+	gen->buffer_n_samples = original_buffer_n_samples;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+
+
+	/* First request: cache miss, samples are rendered. */
+	gen->phase_offset = 0.0F;
+	const cw_sample_t * first = LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &tone);
+	cte->expect_valid_pointer(cte, first, "first request for tone");
+	if (NULL != first) {
+		const int diff = memcmp(first, reference, sizeof (cw_sample_t) * TEST_N_SAMPLES);
+		cte->expect_op_int(cte, 0, "==", diff, "rendered samples are the same as reference samples");
+	}
+	cte->expect_op_int(cte, 1, "==", test_phase_equal(phase_after_tone, gen->phase_offset), "phase after rendered tone");
+
+
+	/* Second request with the same phase: cache hit. */
+	gen->phase_offset = 0.0F;
+	const cw_sample_t * second = LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &tone);
+	cte->expect_op_int(cte, 1, "==", first == second, "second request is served from cache");
+	cte->expect_op_int(cte, 1, "==", test_phase_equal(phase_after_tone, gen->phase_offset), "phase after cached tone");
+
+
+	/* Change of parameters invalidates the cache. */
+	cwret = cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_LINEAR, 5000);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "change tone slope");
+	gen->phase_offset = 0.0F;
+	const cw_sample_t * third = LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &tone);
+	cte->expect_valid_pointer(cte, third, "request after change of parameters");
+	if (NULL != third) {
+		const int diff = memcmp(third, reference, sizeof (cw_sample_t) * TEST_N_SAMPLES);
+		cte->expect_op_int(cte, 0, "!=", diff, "samples are rendered with new parameters");
+	}
+
+
+	/* Tones that can't be cached. */
+	{
+		cw_tone_t silent;
+		CW_TONE_COPY(&silent, &tone);
+		silent.frequency = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &silent), "silent tone");
+
+		cw_tone_t no_rising_slope;
+		CW_TONE_COPY(&no_rising_slope, &tone);
+		no_rising_slope.rising_slope_n_samples = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &no_rising_slope), "tone without rising slope");
+
+		cw_tone_t started;
+		CW_TONE_COPY(&started, &tone);
+		started.sample_iterator = 1;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_gen_tone_cache_get_internal)(gen, &started), "partially generated tone");
+	}
+
+	free(reference);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Check if two phases are exactly equal
+
+   Helper function avoiding direct comparison of floats.
+*/
+static bool test_phase_equal(float a, float b)
+{
+	return !(a < b) && !(a > b);
+}
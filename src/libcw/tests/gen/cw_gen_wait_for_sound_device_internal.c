@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+/**
+   @file cw_gen_wait_for_sound_device_internal.c
+
+   Test of cw_gen_wait_for_sound_device_internal(), used by sound systems
+   in non-blocking mode.
+*/
+
+
+
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_gen_wait_for_sound_device_internal.h"
+
+
+
+
+/**
+   @brief Test waiting for non-blocking sound device
+
+   A pipe plays the role of sound device's descriptor.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_wait_for_sound_device_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+	gen_conf.sound_nonblocking = true;
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, true, "==", gen->sound_nonblocking, "non-blocking mode of generator");
+	cte->expect_op_int(cte, -1, "!=", gen->wakeup_fds[0], "wakeup descriptor of generator");
+
+	int device_fds[2] = { -1, -1 };
+	if (0 != pipe(device_fds)) {
+		cte->log_error(cte, "%s:%d: Failed to create pipe\n", __func__, __LINE__);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+	char byte = 'x';
+
+
+	/* Event on device's descriptor. */
+	{
+		const ssize_t n = write(device_fds[1], &byte, 1);
+		cte->expect_op_int(cte, 1, "==", (int) n, "writing to pipe");
+		struct pollfd fd = { .fd = device_fds[0], .events = POLLIN, .revents = 0 };
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_wait_for_sound_device_internal)(gen, &fd, 1);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "waiting for readable device");
+		cte->expect_op_int(cte, POLLIN, "==", fd.revents & POLLIN, "revents of readable device");
+		const ssize_t m = read(device_fds[0], &byte, 1);
+		cte->expect_op_int(cte, 1, "==", (int) m, "reading from pipe");
+	}
+
+
+	/* Stopping of generator abandons the wait, even if device
+	   doesn't become ready. */
+	{
+		cw_gen_stop(gen);
+		struct pollfd fd = { .fd = device_fds[0], .events = POLLIN, .revents = 0 };
+		errno = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_wait_for_sound_device_internal)(gen, &fd, 1);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "waiting for device of stopped generator");
+		cte->expect_op_int(cte, ECANCELED, "==", errno, "errno after waiting for device of stopped generator");
+	}
+
+
+	/* Starting of generator makes the wait possible again. */
+	{
+		cw_gen_start(gen);
+		const ssize_t n = write(device_fds[1], &byte, 1);
+		cte->expect_op_int(cte, 1, "==", (int) n, "writing to pipe");
+		struct pollfd fd = { .fd = device_fds[0], .events = POLLIN, .revents = 0 };
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_wait_for_sound_device_internal)(gen, &fd, 1);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "waiting for device of restarted generator");
+		cw_gen_stop(gen);
+	}
+
+
+	close(device_fds[0]);
+	close(device_fds[1]);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
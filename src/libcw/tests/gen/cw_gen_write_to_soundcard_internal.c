@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_gen_write_to_soundcard_internal.c
+
+   Test of cw_gen_write_to_soundcard_internal()
+*/
+
+
+
+
+#include <math.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_gen_internal.h"
+#include "cw_gen_write_to_soundcard_internal.h"
+
+
+
+
+/* Size of generator's buffer used in the test. */
+#define TEST_BUFFER_N_SAMPLES 512
+
+/* Maximal allowed difference between a sample written to sound sink
+   and a reference sample calculated with double precision. Generator
+   calculates phase with floats, so there is some small drift of phase
+   in long tones. */
+#define TEST_MAX_SAMPLE_DIFF 32
+
+#define TEST_PI 3.14159265358979323846F
+
+
+
+
+/* Samples "written" to sound sink. */
+static struct {
+	cw_sample_t * samples;
+	int capacity;
+	int n_samples;
+	int64_t n_dropped; /* Count of silent samples passed to drop function of sink. */
+} g_sink;
+
+
+
+
+static cw_ret_t test_write_buffer_to_sink(cw_gen_t * gen);
+static cw_ret_t test_drop_silence_from_sink(cw_gen_t * gen, int64_t n_silent_samples);
+static cwt_retv test_write_tone(cw_test_executor_t * cte, cw_gen_t * gen, int frequency, int duration);
+static cwt_retv test_sidetone_cut(cw_test_executor_t * cte, cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Test cw_gen_write_to_soundcard_internal()
+
+   A long tone, long enough for its plateau to be generated from a
+   periodic fragment of sine wave, is written to a fake sound sink.
+   Samples received by the sink are compared with samples of the same tone
+   calculated with double precision. Frequencies are selected so that the periodic
+   fragment is short (one period), and long (many periods).
+
+   Cutting of silence played after a Mark, done for low-latency
+   sidetone, is tested as well.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_gen_write_to_soundcard_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int frequencies[] = { 800, 1234, 997 };
+	const int duration = 3 * CW_USECS_PER_SEC; /* Longer than CW_GEN_PLATEAU_LOOP_MIN_DURATION. */
+
+	for (size_t f = 0; f < sizeof (frequencies) / sizeof (frequencies[0]); f++) {
+		cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+		if (NULL == gen) {
+			cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+			return cwt_retv_err;
+		}
+		const cwt_retv retv = test_write_tone(cte, gen, frequencies[f], duration);
+		cw_gen_delete(&gen);
+		if (cwt_retv_ok != retv) {
+			return retv;
+		}
+	}
+
+	{
+		cw_gen_config_t gen_conf = cte->current_gen_conf;
+		gen_conf.sidetone_low_latency = true;
+		cw_gen_t * gen = cw_gen_new(&gen_conf);
+		if (NULL == gen) {
+			cte->log_error(cte, "%s:%d: Failed to create tested generator\n", __func__, __LINE__);
+			return cwt_retv_err;
+		}
+		const cwt_retv retv = test_sidetone_cut(cte, gen);
+		cw_gen_delete(&gen);
+		if (cwt_retv_ok != retv) {
+			return retv;
+		}
+	}
+
+	free(g_sink.samples);
+	g_sink.samples = NULL;
+	g_sink.capacity = 0;
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Write a tone through cw_gen_write_to_soundcard_internal() and verify the samples
+
+   @param cte test executor
+   @param gen generator to use
+   @param[in] frequency frequency of tone
+   @param[in] duration duration of tone
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_write_tone(cw_test_executor_t * cte, cw_gen_t * gen, int frequency, int duration)
+{
+	cw_ret_t cwret = cw_gen_set_tone_slope(gen, CW_TONE_SLOPE_SHAPE_RAISED_COSINE, 5000);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "set tone slope");
+
+	cw_tone_t tone;
+	CW_TONE_INIT(&tone, frequency, 0, CW_SLOPE_MODE_STANDARD_SLOPES);
+	tone.n_samples = ((cw_sample_iter_t) gen->sample_rate * duration) / CW_USECS_PER_SEC;
+	tone.rising_slope_n_samples = gen->tone_slope.n_amplitudes;
+	tone.falling_slope_n_samples = gen->tone_slope.n_amplitudes;
+	const int n_samples = (int) tone.n_samples;
+
+	cw_sample_t * reference = calloc((size_t) n_samples, sizeof (cw_sample_t));
+	if (NULL == reference) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	if (g_sink.capacity < n_samples) {
+		cw_sample_t * samples = realloc(g_sink.samples, sizeof (cw_sample_t) * (size_t) n_samples);
+		if (NULL == samples) {
+			cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+			free(reference);
+			return cwt_retv_err;
+		}
+		g_sink.samples = samples;
+		g_sink.capacity = n_samples;
+	}
+	g_sink.n_samples = 0;
+
+
+	/* Reference samples, calculated with double precision. */
+	const double two_pi = 2.0 * (double) TEST_PI;
+	for (int i = 0; i < n_samples; i++) {
+		double amplitude = gen->volume_abs;
+		if (i < tone.rising_slope_n_samples) {
+			amplitude *= (double) gen->tone_slope.amplitudes[i];
+		} else if (i >= n_samples - tone.falling_slope_n_samples) {
+			amplitude *= (double) gen->tone_slope.amplitudes[n_samples - i - 1];
+		}
+		reference[i] = (cw_sample_t) (amplitude * sin(two_pi * frequency * i / gen->sample_rate));
+	}
+	const float reference_phase = (float) fmod(two_pi * frequency * n_samples / gen->sample_rate, two_pi);
+
+	cw_sample_t * original_buffer = gen->buffer;
+	const int original_buffer_n_samples = gen->buffer_n_samples;
+	cw_ret_t (* original_write)(cw_gen_t * gen) = gen->write_buffer_to_sound_device;
+
+
+	/* Tested samples, written to sink through generator's buffer.
+	   Only full buffers reach the sink, the rest of samples stays in
+	   generator's buffer. */
+	cw_sample_t buffer[TEST_BUFFER_N_SAMPLES] = { 0 };
+	gen->phase_offset = 0.0F;
+	gen->buffer = buffer;
+	gen->buffer_n_samples = TEST_BUFFER_N_SAMPLES;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+	gen->write_buffer_to_sound_device = test_write_buffer_to_sink;
+
+	LIBCW_TEST_FUT(cw_gen_write_to_soundcard_internal)(gen, &tone);
+
+	const float tested_phase = gen->phase_offset;
+	gen->buffer = original_buffer;
+	gen->buffer_n_samples = original_buffer_n_samples;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+	gen->write_buffer_to_sound_device = original_write;
+
+
+	cte->expect_op_int(cte, n_samples - (n_samples % TEST_BUFFER_N_SAMPLES), "==", g_sink.n_samples, "frequency %d: count of samples in sink", frequency);
+	int max_diff = 0;
+	for (int i = 0; i < g_sink.n_samples; i++) {
+		const int diff = abs(reference[i] - g_sink.samples[i]);
+		if (diff > max_diff) {
+			max_diff = diff;
+		}
+	}
+	cte->expect_op_int(cte, TEST_MAX_SAMPLE_DIFF, ">=", max_diff, "frequency %d: max difference from reference", frequency);
+
+	/* Phase is in range <0; 2*Pi), but values close to 0 and to 2*Pi
+	   are also close to each other. */
+	float phase_diff = fabsf(reference_phase - tested_phase);
+	if (phase_diff > TEST_PI) {
+		phase_diff = 2 * TEST_PI - phase_diff;
+	}
+	cte->expect_op_float(cte, 0.001F, ">", phase_diff, "frequency %d: phase after tone", frequency);
+
+	free(reference);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Cut silence after a Mark, as it is done when key goes down
+
+   A Mark and silent 'forever' tone are written to fake sound sink. When
+   key goes down, silence kept in generator's buffer should be discarded,
+   and silence already written to the sink should be dropped, but only if
+   there is no part of the Mark in generator's buffer.
+
+   @param cte test executor
+   @param gen generator with low-latency sidetone
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_sidetone_cut(cw_test_executor_t * cte, cw_gen_t * gen)
+{
+	const int n_capacity = 8 * TEST_BUFFER_N_SAMPLES;
+	if (g_sink.capacity < n_capacity) {
+		cw_sample_t * samples = realloc(g_sink.samples, sizeof (cw_sample_t) * (size_t) n_capacity);
+		if (NULL == samples) {
+			cte->log_error(cte, "%s:%d: Failed to allocate buffer\n", __func__, __LINE__);
+			return cwt_retv_err;
+		}
+		g_sink.samples = samples;
+		g_sink.capacity = n_capacity;
+	}
+
+	cw_sample_t * original_buffer = gen->buffer;
+	const int original_buffer_n_samples = gen->buffer_n_samples;
+	cw_ret_t (* original_write)(cw_gen_t * gen) = gen->write_buffer_to_sound_device;
+	cw_ret_t (* original_drop)(cw_gen_t * gen, int64_t n_silent_samples) = gen->drop_silence_from_sound_device;
+
+	cw_sample_t buffer[TEST_BUFFER_N_SAMPLES] = { 0 };
+	gen->buffer = buffer;
+	gen->buffer_n_samples = TEST_BUFFER_N_SAMPLES;
+	gen->write_buffer_to_sound_device = test_write_buffer_to_sink;
+	gen->drop_silence_from_sound_device = test_drop_silence_from_sink;
+
+	/* Mark fills one buffer, and 188 samples of next one. */
+	const int mark_tail_n_samples = 188;
+	const struct {
+		int silence_n_samples;        /* Silence written after the Mark. */
+		int expected_sub_start;       /* Samples left in generator's buffer after the cut. */
+		int expected_n_dropped;       /* Samples passed to drop function. */
+	} test_data[] = {
+		/* Only part of silence has been written to buffer, the
+		   buffer still has tail of the Mark. */
+		{ 100,  mark_tail_n_samples, 0 },
+		/* Buffer with tail of the Mark has been written to sink,
+		   followed by one buffer of silence. */
+		{ 1000, 0,                   (TEST_BUFFER_N_SAMPLES - mark_tail_n_samples) + TEST_BUFFER_N_SAMPLES },
+	};
+
+	for (size_t i = 0; i < sizeof (test_data) / sizeof (test_data[0]); i++) {
+		gen->buffer_sub_start = 0;
+		gen->buffer_sub_stop = 0;
+		gen->sidetone.silent_run = 0;
+		g_sink.n_samples = 0;
+		g_sink.n_dropped = 0;
+
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 800, 0, CW_SLOPE_MODE_NO_SLOPES);
+		tone.n_samples = TEST_BUFFER_N_SAMPLES + mark_tail_n_samples;
+		cw_gen_write_to_soundcard_internal(gen, &tone);
+
+		CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_NO_SLOPES);
+		tone.is_forever = true;
+		tone.n_samples = test_data[i].silence_n_samples;
+		cw_gen_write_to_soundcard_internal(gen, &tone);
+		const int n_in_sink = g_sink.n_samples;
+
+		/* Key goes down. */
+		gen->sidetone.cut_requested = true;
+		CW_TONE_INIT(&tone, 0, 0, CW_SLOPE_MODE_NO_SLOPES);
+		tone.is_forever = true;
+		tone.n_samples = TEST_BUFFER_N_SAMPLES;
+		LIBCW_TEST_FUT(cw_gen_write_to_soundcard_internal)(gen, &tone);
+
+		cte->expect_op_int(cte, false, "==", gen->sidetone.cut_requested, "sidetone cut #%zu: request has been served", i);
+		cte->expect_op_int(cte, n_in_sink, "==", g_sink.n_samples, "sidetone cut #%zu: no silence written after cut", i);
+		cte->expect_op_int(cte, test_data[i].expected_sub_start, "==", gen->buffer_sub_start, "sidetone cut #%zu: samples left in buffer", i);
+		cte->expect_op_int(cte, test_data[i].expected_n_dropped, "==", (int) g_sink.n_dropped, "sidetone cut #%zu: silence dropped from sink", i);
+	}
+
+	gen->buffer = original_buffer;
+	gen->buffer_n_samples = original_buffer_n_samples;
+	gen->buffer_sub_start = 0;
+	gen->buffer_sub_stop = 0;
+	gen->write_buffer_to_sound_device = original_write;
+	gen->drop_silence_from_sound_device = original_drop;
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Fake function writing generator's buffer to sound sink
+
+   @param gen generator
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t test_write_buffer_to_sink(cw_gen_t * gen)
+{
+	for (int i = 0; i < gen->buffer_n_samples && g_sink.n_samples < g_sink.capacity; i++) {
+		g_sink.samples[g_sink.n_samples++] = gen->buffer[i];
+	}
+	return CW_SUCCESS;
+}
+
+
+
+
+/**
+   @brief Fake function dropping silence from sound sink
+
+   @param gen generator
+   @param n_silent_samples count of silent samples at the end of sink
+
+   @return CW_SUCCESS
+*/
+static cw_ret_t test_drop_silence_from_sink(__attribute__((unused)) cw_gen_t * gen, int64_t n_silent_samples)
+{
+	g_sink.n_dropped += n_silent_samples;
+	return CW_SUCCESS;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_mixer_mix_block_internal.c
+
+   Test of cw_mixer_mix_block_internal()
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_mixer.h"
+#include "cw_mixer_mix_block_internal.h"
+
+
+
+
+/* Count of generators mixed in the test. */
+#define TEST_N_GENERATORS 3
+
+/* Upper limit of count of mixed blocks, in case generators don't run
+   out of tones. */
+#define TEST_N_BLOCKS_MAX 1000
+
+
+
+
+static cwt_retv test_mix_blocks(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t ** refs, const int * gains);
+static void test_remove_generator(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t * gen);
+
+
+
+
+/**
+   @brief Test cw_mixer_mix_block_internal()
+
+   Samples mixed by mixer from tone queues of a few generators are
+   compared with samples rendered from separate, identical reference
+   generators and mixed by the test.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_mixer_mix_block_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Mixed generators never use their own sound sinks. */
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	const int frequencies[TEST_N_GENERATORS] = { 600, 900, 1500 };
+	const int gains[TEST_N_GENERATORS] = { 100, 50, 30 };
+	const char * strings[TEST_N_GENERATORS] = { "ae", "t", "5" };
+
+	cw_mixer_t * mixer = cw_mixer_new(&gen_conf);
+	if (NULL == mixer) {
+		cte->log_error(cte, "%s:%d: Failed to create mixer\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	cw_gen_t * gens[TEST_N_GENERATORS] = { 0 };
+	cw_gen_t * refs[TEST_N_GENERATORS] = { 0 };
+	cwt_retv retv = cwt_retv_ok;
+
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		gens[i] = cw_gen_new(&gen_conf);
+		refs[i] = cw_gen_new(&gen_conf);
+		if (NULL == gens[i] || NULL == refs[i]) {
+			cte->log_error(cte, "%s:%d: Failed to create generators\n", __func__, __LINE__);
+			retv = cwt_retv_err;
+			goto cleanup;
+		}
+		cw_gen_set_frequency(gens[i], frequencies[i]);
+		cw_gen_set_frequency(refs[i], frequencies[i]);
+		cw_gen_enqueue_string(gens[i], strings[i]);
+		cw_gen_enqueue_string(refs[i], strings[i]);
+
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_mixer_add_generator)(mixer, gens[i], gains[i]);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "adding generator %d to mixer", i);
+	}
+
+	if (cwt_retv_ok != test_mix_blocks(cte, mixer, refs, gains)) {
+		retv = cwt_retv_err;
+		goto cleanup;
+	}
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gens[i]), "generator %d: queue length after mixing", i);
+	}
+
+	test_remove_generator(cte, mixer, gens[0]);
+
+ cleanup:
+	cw_mixer_delete(&mixer);
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		if (NULL != gens[i]) {
+			cw_gen_delete(&gens[i]);
+		}
+		if (NULL != refs[i]) {
+			cw_gen_delete(&refs[i]);
+		}
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Mix blocks until all reference generators run out of tones
+
+   @param cte test executor
+   @param[in] mixer tested mixer
+   @param[in] refs reference generators
+   @param[in] gains gains of generators
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_mix_blocks(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t ** refs, const int * gains)
+{
+	const int n = mixer->block_n_samples;
+	cw_sample_t * rendered = calloc((size_t) n, sizeof (cw_sample_t));
+	int32_t * expected = calloc((size_t) n, sizeof (int32_t));
+	if (NULL == rendered || NULL == expected) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffers\n", __func__, __LINE__);
+		free(rendered);
+		free(expected);
+		return cwt_retv_err;
+	}
+
+	int n_blocks = 0;
+	int n_differences = 0;
+	int n_non_zero = 0;
+	bool finished = false;
+	while (!finished && n_blocks < TEST_N_BLOCKS_MAX) {
+		finished = true;
+		for (int s = 0; s < n; s++) {
+			expected[s] = 0;
+		}
+		for (int i = 0; i < TEST_N_GENERATORS; i++) {
+			if (0 != cw_gen_render_internal(refs[i], rendered, n)) {
+				finished = false;
+			}
+			for (int s = 0; s < n; s++) {
+				expected[s] += rendered[s] * gains[i];
+			}
+		}
+
+		LIBCW_TEST_FUT(cw_mixer_mix_block_internal)(mixer, mixer->output);
+
+		for (int s = 0; s < n; s++) {
+			int32_t value = expected[s] / CW_MIXER_GAIN_MAX;
+			value = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+			if (value != mixer->output[s]) {
+				n_differences++;
+			}
+			if (0 != mixer->output[s]) {
+				n_non_zero++;
+			}
+		}
+		n_blocks++;
+	}
+
+	cte->expect_op_int(cte, true, "==", finished, "all tones have been mixed (%d blocks)", n_blocks);
+	cte->expect_op_int(cte, 0, "<", n_non_zero, "count of non-zero mixed samples");
+	cte->expect_op_int(cte, 0, "==", n_differences, "count of differences between mixed and expected samples");
+
+	free(rendered);
+	free(expected);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test removing of generator from mixer, and invalid gains
+
+   @param cte test executor
+   @param[in] mixer tested mixer
+   @param[in] gen generator registered in @p mixer
+*/
+static void test_remove_generator(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t * gen)
+{
+	/* Tones of generator removed from mixer are not dequeued anymore. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_remove_generator)(mixer, gen), "removing generator");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_remove_generator)(mixer, gen), "removing generator again");
+	cw_gen_enqueue_string(gen, "e");
+	const size_t len = cw_gen_get_queue_length(gen);
+	LIBCW_TEST_FUT(cw_mixer_mix_block_internal)(mixer, mixer->output);
+	cte->expect_op_int(cte, (int) len, "==", (int) cw_gen_get_queue_length(gen), "queue length of removed generator");
+	int n_non_zero = 0;
+	for (int s = 0; s < mixer->block_n_samples; s++) {
+		if (0 != mixer->output[s]) {
+			n_non_zero++;
+		}
+	}
+	cte->expect_op_int(cte, 0, "==", n_non_zero, "count of non-zero samples without tones");
+
+	/* Invalid gains. */
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_add_generator)(mixer, gen, CW_MIXER_GAIN_MIN - 1), "adding generator with too low gain");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_add_generator)(mixer, gen, CW_MIXER_GAIN_MAX + 1), "adding generator with too high gain");
+
+	return;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_MIXER_MIX_BLOCK_INTERNAL_H_
+#define _LIBCW_TESTS_GEN_CW_MIXER_MIX_BLOCK_INTERNAL_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_mixer_mix_block_internal(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_MIXER_MIX_BLOCK_INTERNAL_H_ */
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_mixer_set_n_workers.c
+
+   Test of mixer rendering generators with pool of worker threads.
+*/
+
+
+
+
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_mixer.h"
+#include "cw_mixer_set_n_workers.h"
+
+
+
+
+/* Count of generators mixed in the test. Larger than count of workers,
+   so that workers have more than one generator to render. */
+#define TEST_N_GENERATORS 40
+
+/* Count of threads rendering samples of generators. */
+#define TEST_N_WORKERS 4
+
+/* Upper limit of count of mixed blocks, in case generators don't run
+   out of tones. */
+#define TEST_N_BLOCKS_MAX 1000
+
+
+
+
+static cwt_retv test_mix_blocks(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t ** refs, const int * gains);
+
+
+
+
+/**
+   @brief Test cw_mixer_set_n_workers()
+
+   Samples mixed by mixer with pool of workers from tone queues of many
+   generators are compared with samples rendered from separate,
+   identical reference generators and mixed by the test.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_mixer_set_n_workers(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_mixer_t * mixer = cw_mixer_new(&gen_conf);
+	if (NULL == mixer) {
+		cte->log_error(cte, "%s:%d: Failed to create mixer\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_set_n_workers)(mixer, -1), "setting negative count of workers");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_mixer_set_n_workers)(mixer, CW_MIXER_N_WORKERS_MAX + 1), "setting too large count of workers");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_set_n_workers)(mixer, 0), "setting count of workers to count of CPUs");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_set_n_workers)(mixer, TEST_N_WORKERS), "setting count of workers");
+
+	cw_gen_t * gens[TEST_N_GENERATORS] = { 0 };
+	cw_gen_t * refs[TEST_N_GENERATORS] = { 0 };
+	int gains[TEST_N_GENERATORS] = { 0 };
+	const char * strings[] = { "ae", "t", "5", "paris", "k" };
+	const size_t n_strings = sizeof (strings) / sizeof (strings[0]);
+	cwt_retv retv = cwt_retv_ok;
+
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		gens[i] = cw_gen_new(&gen_conf);
+		refs[i] = cw_gen_new(&gen_conf);
+		if (NULL == gens[i] || NULL == refs[i]) {
+			cte->log_error(cte, "%s:%d: Failed to create generators\n", __func__, __LINE__);
+			retv = cwt_retv_err;
+			goto cleanup;
+		}
+		gains[i] = 2 + i % 3;
+		cw_gen_set_frequency(gens[i], 400 + 25 * i);
+		cw_gen_set_frequency(refs[i], 400 + 25 * i);
+		cw_gen_enqueue_string(gens[i], strings[(size_t) i % n_strings]);
+		cw_gen_enqueue_string(refs[i], strings[(size_t) i % n_strings]);
+		cw_mixer_add_generator(mixer, gens[i], gains[i]);
+	}
+
+	if (cwt_retv_ok != test_mix_blocks(cte, mixer, refs, gains)) {
+		retv = cwt_retv_err;
+		goto cleanup;
+	}
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		if (0 != cw_gen_get_queue_length(gens[i])) {
+			cte->log_error(cte, "%s:%d: generator %d has tones left in queue\n", __func__, __LINE__, i);
+			retv = cwt_retv_err;
+		}
+	}
+
+	/* Back to mixing without workers. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_mixer_set_n_workers)(mixer, 1), "setting one worker");
+
+ cleanup:
+	cw_mixer_delete(&mixer);
+	for (int i = 0; i < TEST_N_GENERATORS; i++) {
+		if (NULL != gens[i]) {
+			cw_gen_delete(&gens[i]);
+		}
+		if (NULL != refs[i]) {
+			cw_gen_delete(&refs[i]);
+		}
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Mix blocks until all reference generators run out of tones
+
+   @param cte test executor
+   @param[in] mixer tested mixer
+   @param[in] refs reference generators
+   @param[in] gains gains of generators
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_mix_blocks(cw_test_executor_t * cte, cw_mixer_t * mixer, cw_gen_t ** refs, const int * gains)
+{
+	const int n = mixer->block_n_samples;
+	cw_sample_t * rendered = calloc((size_t) n, sizeof (cw_sample_t));
+	int32_t * expected = calloc((size_t) n, sizeof (int32_t));
+	if (NULL == rendered || NULL == expected) {
+		cte->log_error(cte, "%s:%d: Failed to allocate buffers\n", __func__, __LINE__);
+		free(rendered);
+		free(expected);
+		return cwt_retv_err;
+	}
+
+	int n_blocks = 0;
+	int n_differences = 0;
+	int n_non_zero = 0;
+	bool finished = false;
+	while (!finished && n_blocks < TEST_N_BLOCKS_MAX) {
+		finished = true;
+		for (int s = 0; s < n; s++) {
+			expected[s] = 0;
+		}
+		for (int i = 0; i < TEST_N_GENERATORS; i++) {
+			if (0 != cw_gen_render_internal(refs[i], rendered, n)) {
+				finished = false;
+			}
+			for (int s = 0; s < n; s++) {
+				expected[s] += rendered[s] * gains[i];
+			}
+		}
+
+		cw_mixer_mix_block_internal(mixer, mixer->output);
+
+		for (int s = 0; s < n; s++) {
+			int32_t value = expected[s] / CW_MIXER_GAIN_MAX;
+			value = value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+			if (value != mixer->output[s]) {
+				n_differences++;
+			}
+			if (0 != mixer->output[s]) {
+				n_non_zero++;
+			}
+		}
+		n_blocks++;
+	}
+
+	cte->expect_op_int(cte, true, "==", finished, "all tones have been mixed (%d blocks)", n_blocks);
+	cte->expect_op_int(cte, 0, "<", n_non_zero, "count of non-zero mixed samples");
+	cte->expect_op_int(cte, 0, "==", n_differences, "count of differences between mixed and expected samples");
+
+	free(rendered);
+	free(expected);
+
+	return cwt_retv_ok;
+}
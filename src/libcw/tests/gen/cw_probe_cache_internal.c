@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+   @file cw_probe_cache_internal.c
+
+   Test of on-disk cache of results of probing of sound systems.
+*/
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libcw_probe.h"
+#include "cw_probe_cache_internal.h"
+
+
+
+
+/**
+   @brief Test writing and reading of cached sound systems
+
+   Cache is written to temporary directory set as XDG_CACHE_HOME.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_probe_cache_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	char dir[] = "/tmp/libcw_probe_cache_XXXXXX";
+	if (NULL == mkdtemp(dir)) {
+		cte->log_error(cte, "%s:%d: Failed to create temporary directory\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+	const char * old_xdg = getenv("XDG_CACHE_HOME");
+	char * saved_xdg = old_xdg ? strdup(old_xdg) : NULL;
+	setenv("XDG_CACHE_HOME", dir, 1);
+
+	cte->expect_op_int(cte, CW_AUDIO_NONE, "==", LIBCW_TEST_FUT(cw_probe_cache_read_internal)(""), "read from empty cache");
+
+	LIBCW_TEST_FUT(cw_probe_cache_write_internal)("", CW_AUDIO_ALSA);
+	cte->expect_op_int(cte, CW_AUDIO_ALSA, "==", cw_probe_cache_read_internal(""), "read of default device");
+	cte->expect_op_int(cte, CW_AUDIO_ALSA, "==", cw_probe_cache_read_internal(NULL), "read of NULL device");
+
+	/* Entries of different devices don't overwrite each other. */
+	cw_probe_cache_write_internal("hw:1", CW_AUDIO_PA);
+	cte->expect_op_int(cte, CW_AUDIO_PA, "==", cw_probe_cache_read_internal("hw:1"), "read of second device");
+	cte->expect_op_int(cte, CW_AUDIO_ALSA, "==", cw_probe_cache_read_internal(""), "read of default device after write of second device");
+	cte->expect_op_int(cte, CW_AUDIO_NONE, "==", cw_probe_cache_read_internal("hw:2"), "read of unknown device");
+
+	/* New entry for a device replaces old one. */
+	cw_probe_cache_write_internal("", CW_AUDIO_OSS);
+	cte->expect_op_int(cte, CW_AUDIO_OSS, "==", cw_probe_cache_read_internal(""), "read of default device after its update");
+	cte->expect_op_int(cte, CW_AUDIO_PA, "==", cw_probe_cache_read_internal("hw:1"), "read of second device after update of default device");
+
+	char path[sizeof (dir) + 32];
+	snprintf(path, sizeof (path), "%s/unixcw/sound_systems", dir);
+	remove(path);
+	snprintf(path, sizeof (path), "%s/unixcw", dir);
+	rmdir(path);
+	rmdir(dir);
+
+	if (saved_xdg) {
+		setenv("XDG_CACHE_HOME", saved_xdg, 1);
+		free(saved_xdg);
+	} else {
+		unsetenv("XDG_CACHE_HOME");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_PROBE_CACHE_INTERNAL_H_
+#define _LIBCW_TESTS_GEN_CW_PROBE_CACHE_INTERNAL_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_probe_cache_internal(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_PROBE_CACHE_INTERNAL_H_ */
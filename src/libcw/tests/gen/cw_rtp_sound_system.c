@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+
+/**
+   @file cw_rtp_sound_system.c
+
+   Test of RTP sound system (libcw_rtp.c)
+*/
+
+
+
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_utils.h"
+#include "cw_rtp_sound_system.h"
+
+
+
+
+/* Text sent in the test. At 60 WPM it takes a second to stream it. */
+#define TEST_TEXT "paris"
+
+#define TEST_RTP_HEADER_SIZE 12
+#define TEST_PAYLOAD_TYPE_OPUS 96
+#define TEST_PAYLOAD_TYPE_L16 97
+
+
+
+
+/**
+   @brief Test RTP sound system
+
+   A text is streamed by generator using RTP sound system to a UDP
+   socket of the test. The test verifies headers of received packets,
+   that packets carry some sound, and that packets have been sent in
+   real time.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_rtp_sound_system(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cte->expect_op_int(cte, false, "==", cw_is_rtp_possible("[::1:5004"), "RTP output with malformed address");
+	cte->expect_op_int(cte, false, "==", cw_is_rtp_possible("127.0.0.1:"), "RTP output without port");
+
+	const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addr_len = sizeof (addr);
+	if (-1 == fd
+	    || 0 != bind(fd, (struct sockaddr *) &addr, sizeof (addr))
+	    || 0 != getsockname(fd, (struct sockaddr *) &addr, &addr_len)) {
+		cte->log_error(cte, "%s:%d: Failed to open listener's socket\n", __func__, __LINE__);
+		if (-1 != fd) {
+			close(fd);
+		}
+		return cwt_retv_err;
+	}
+	struct timeval timeout = { .tv_sec = 0, .tv_usec = 300 * 1000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_RTP;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "127.0.0.1:%d", (int) ntohs(addr.sin_port));
+
+	cte->expect_op_int(cte, true, "==", cw_is_rtp_possible(gen_conf.sound_device), "RTP output is possible");
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		close(fd);
+		return cwt_retv_err;
+	}
+	cte->expect_op_int(cte, CW_AUDIO_RTP, "==", cw_gen_get_sound_system(gen), "sound system of generator");
+	const int n_packet_samples = gen->buffer_n_samples;
+
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+
+	int n_packets = 0;
+	int payload_type = -1;
+	bool first_has_marker = false;
+	bool headers_valid = true;
+	bool sequence_valid = true;
+	bool timestamps_valid = true;
+	uint16_t prev_sequence = 0;
+	uint32_t prev_timestamp = 0;
+	int n_non_zero = 0;
+	struct timeval first = { 0 };
+	struct timeval last = { 0 };
+
+	uint8_t packet[2048];
+	while (true) {
+		const ssize_t size = recv(fd, packet, sizeof (packet), 0);
+		if (size < 0) {
+			/* Timeout: generator has sent everything. */
+			break;
+		}
+		gettimeofday(&last, NULL);
+		if (0 == n_packets) {
+			first = last;
+		}
+		if (size <= TEST_RTP_HEADER_SIZE || 0x80 != packet[0]) {
+			headers_valid = false;
+			continue;
+		}
+		const bool marker = 0 != (packet[1] & 0x80);
+		const int pt = packet[1] & 0x7f;
+		const uint16_t sequence = (uint16_t) ((packet[2] << 8) | packet[3]);
+		const uint32_t timestamp = ((uint32_t) packet[4] << 24) | ((uint32_t) packet[5] << 16) | ((uint32_t) packet[6] << 8) | (uint32_t) packet[7];
+
+		if (0 == n_packets) {
+			payload_type = pt;
+			first_has_marker = marker;
+		} else {
+			if (pt != payload_type) {
+				headers_valid = false;
+			}
+			if ((uint16_t) (prev_sequence + 1) != sequence) {
+				sequence_valid = false;
+			}
+			/* Marker bit: generator has been late, and timestamp
+			   has skipped the gap. */
+			if (!marker && (uint32_t) (prev_timestamp + (uint32_t) n_packet_samples) != timestamp) {
+				timestamps_valid = false;
+			}
+		}
+		prev_sequence = sequence;
+		prev_timestamp = timestamp;
+
+		if (TEST_PAYLOAD_TYPE_L16 == pt) {
+			for (ssize_t i = TEST_RTP_HEADER_SIZE; i < size; i++) {
+				if (0 != packet[i]) {
+					n_non_zero++;
+				}
+			}
+			if (size - TEST_RTP_HEADER_SIZE != n_packet_samples * 2) {
+				headers_valid = false;
+			}
+		} else {
+			/* Opus frames can't be checked without decoder. */
+			n_non_zero++;
+		}
+		n_packets++;
+	}
+
+	cw_gen_durations_t durations = { 0 };
+	cw_gen_get_durations_internal(gen, &durations);
+
+	cw_gen_stop(gen);
+	cw_gen_delete(&gen);
+	close(fd);
+
+	/* Last inter-word-space may still be waiting in generator's
+	   buffer when the generator is stopped. */
+	const int text_duration = (50 - 7) * durations.dot_duration;
+	const int packet_duration = (int) (((int64_t) n_packet_samples * CW_USECS_PER_SEC) / 48000);
+	cte->expect_op_int(cte, text_duration / packet_duration, "<=", n_packets, "count of packets");
+	cte->expect_op_int(cte, true, "==", TEST_PAYLOAD_TYPE_OPUS == payload_type || TEST_PAYLOAD_TYPE_L16 == payload_type, "payload type");
+	cte->expect_op_int(cte, true, "==", headers_valid, "headers and sizes of packets");
+	cte->expect_op_int(cte, true, "==", first_has_marker, "marker bit of first packet");
+	cte->expect_op_int(cte, true, "==", sequence_valid, "sequence numbers");
+	cte->expect_op_int(cte, true, "==", timestamps_valid, "timestamps");
+	cte->expect_op_int(cte, 0, "<", n_non_zero, "count of non-zero bytes of samples");
+
+	/* Packets are sent in real time, not as fast as samples can be
+	   calculated. */
+	const int elapsed = cw_timestamp_compare_internal(&first, &last);
+	cte->expect_op_int(cte, (n_packets - 1) * packet_duration * 8 / 10, "<=", elapsed, "time of streaming (%d packets)", n_packets);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
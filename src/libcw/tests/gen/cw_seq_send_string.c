@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+/**
+   @file cw_seq_send_string.c
+
+   Test of sequencer producing the same timing as generator.
+*/
+
+
+
+
+#include <errno.h>
+#include <stdlib.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_seq.h"
+#include "cw_seq_send_string.h"
+
+
+
+
+/* Maximal count of events (Marks and Spaces) of tested string. */
+#define TEST_N_EVENTS_MAX 200
+
+
+
+
+/* Events received from sequencer. */
+typedef struct {
+	cw_seq_event_t events[TEST_N_EVENTS_MAX];
+	int n_events;
+} test_events_t;
+
+
+
+
+static void test_collect_event(void * callback_arg, const cw_seq_event_t * event);
+static cwt_retv test_compare_with_generator(cw_test_executor_t * cte, const cw_gen_parameters_t * parameters, const char * string);
+
+
+
+
+/**
+   @brief Test cw_seq_send_string()
+
+   Marks and Spaces produced by sequencer are compared with tones that
+   generator with the same parameters enqueues for the same string.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_seq_send_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_seq_t * seq = LIBCW_TEST_FUT(cw_seq_new)();
+	if (NULL == seq) {
+		cte->log_error(cte, "%s:%d: Failed to create sequencer\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	/* Invalid arguments. */
+	test_events_t * collected = calloc(1, sizeof (test_events_t));
+	if (NULL == collected) {
+		cte->log_error(cte, "%s:%d: Failed to allocate events\n", __func__, __LINE__);
+		cw_seq_delete(&seq);
+		return cwt_retv_err;
+	}
+	cw_gen_parameters_t parameters = { .speed = CW_SPEED_MAX + 1, .frequency = 0, .volume = 0, .gap = 0, .weighting = CW_WEIGHTING_INITIAL };
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_seq_set_parameters)(seq, &parameters), "setting invalid speed");
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_seq_send_string)(seq, "a%", test_collect_event, collected), "sending invalid string");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno for invalid string");
+	cte->expect_op_int(cte, 0, "==", collected->n_events, "count of events for invalid string");
+	cte->expect_op_int(cte, 0, "==", (int) LIBCW_TEST_FUT(cw_seq_get_time)(seq), "time after invalid string");
+	free(collected);
+	cw_seq_delete(&seq);
+
+	const cw_gen_parameters_t parameter_sets[] = {
+		{ .speed = CW_SPEED_INITIAL, .frequency = 600, .volume = 50, .gap = 0, .weighting = CW_WEIGHTING_INITIAL },
+		{ .speed = 25, .frequency = 600, .volume = 50, .gap = 4, .weighting = 35 },
+		{ .speed = CW_SPEED_MAX, .frequency = 600, .volume = 50, .gap = 1, .weighting = 65 },
+	};
+	const char * string = "cq  de sp5 paris? ";
+
+	cwt_retv retv = cwt_retv_ok;
+	for (size_t i = 0; i < sizeof (parameter_sets) / sizeof (parameter_sets[0]); i++) {
+		if (cwt_retv_ok != test_compare_with_generator(cte, &parameter_sets[i], string)) {
+			retv = cwt_retv_err;
+			break;
+		}
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return retv;
+}
+
+
+
+
+/**
+   @brief Store event received from sequencer
+
+   @param[in] callback_arg events collected so far
+   @param[in] event event to store
+*/
+static void test_collect_event(void * callback_arg, const cw_seq_event_t * event)
+{
+	test_events_t * collected = (test_events_t *) callback_arg;
+	if (collected->n_events < TEST_N_EVENTS_MAX) {
+		collected->events[collected->n_events] = *event;
+	}
+	collected->n_events++;
+}
+
+
+
+
+/**
+   @brief Compare events of sequencer with tones enqueued by generator
+
+   Adjacent silent tones dequeued from generator's queue are merged,
+   because sequencer reports them as one Space.
+
+   @param cte test executor
+   @param[in] parameters parameters of sequencer and generator
+   @param[in] string string to send
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_compare_with_generator(cw_test_executor_t * cte, const cw_gen_parameters_t * parameters, const char * string)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_seq_t * seq = cw_seq_new();
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	test_events_t * collected = calloc(1, sizeof (test_events_t));
+	if (NULL == seq || NULL == gen || NULL == collected) {
+		cte->log_error(cte, "%s:%d: Failed to create sequencer or generator\n", __func__, __LINE__);
+		if (NULL != seq) {
+			cw_seq_delete(&seq);
+		}
+		if (NULL != gen) {
+			cw_gen_delete(&gen);
+		}
+		free(collected);
+		return cwt_retv_err;
+	}
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_seq_set_parameters(seq, parameters), "setting parameters of sequencer");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_set_parameters(gen, parameters), "setting parameters of generator");
+
+	/* Send the string in two parts to check that timeline continues. */
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_seq_send_string(seq, "e", test_collect_event, collected), "sending first part of string");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_seq_send_string(seq, string, test_collect_event, collected), "sending second part of string");
+	cw_gen_enqueue_string(gen, "e");
+	cw_gen_enqueue_string(gen, string);
+
+	/* Merge adjacent Spaces of sequencer too: the first part ends
+	   with a Space, and the second part starts with a Space. */
+	int n_events = 0;
+	for (int i = 0; i < collected->n_events && i < TEST_N_EVENTS_MAX; i++) {
+		const cw_seq_event_t * event = &collected->events[i];
+		if (n_events > 0 && !event->is_mark && !collected->events[n_events - 1].is_mark) {
+			collected->events[n_events - 1].duration += event->duration;
+		} else {
+			collected->events[n_events++] = *event;
+		}
+	}
+
+	bool timeline_failure = false;
+	int64_t time = 0;
+	for (int i = 0; i < collected->n_events && i < TEST_N_EVENTS_MAX; i++) {
+		if (collected->events[i].start != time) {
+			timeline_failure = true;
+		}
+		time += collected->events[i].duration;
+	}
+	cte->expect_op_int(cte, false, "==", timeline_failure, "continuity of timeline of sequencer");
+	cte->expect_op_int(cte, true, "==", time == cw_seq_get_time(seq), "time of sequencer");
+
+	int n_tones = 0;
+	bool duration_failure = false;
+	cw_tone_t tone;
+	bool previous_is_mark = true;
+	int64_t space_duration = 0;
+	while (CW_TQ_EMPTY != cw_tq_dequeue_internal(gen->tq, &tone)) {
+		const bool is_mark = tone.frequency > 0;
+		if (!is_mark) {
+			space_duration += tone.duration;
+			previous_is_mark = false;
+			continue;
+		}
+		if (!previous_is_mark) {
+			if (n_tones >= n_events || collected->events[n_tones].is_mark || collected->events[n_tones].duration != space_duration) {
+				duration_failure = true;
+			}
+			n_tones++;
+			space_duration = 0;
+		}
+		if (n_tones >= n_events || !collected->events[n_tones].is_mark || collected->events[n_tones].duration != tone.duration) {
+			duration_failure = true;
+		}
+		n_tones++;
+		previous_is_mark = true;
+	}
+	if (!previous_is_mark) {
+		if (n_tones >= n_events || collected->events[n_tones].is_mark || collected->events[n_tones].duration != space_duration) {
+			duration_failure = true;
+		}
+		n_tones++;
+	}
+
+	cte->expect_op_int(cte, n_tones, "==", n_events, "count of events at speed %d", parameters->speed);
+	cte->expect_op_int(cte, false, "==", duration_failure, "durations of events at speed %d", parameters->speed);
+
+	cw_seq_delete(&seq);
+	cw_gen_delete(&gen);
+	free(collected);
+
+	return cwt_retv_ok;
+}
@@ -0,0 +1,17 @@
+#ifndef _LIBCW_TESTS_GEN_CW_SEQ_SEND_STRING_H_
+#define _LIBCW_TESTS_GEN_CW_SEQ_SEND_STRING_H_
+
+
+
+
+#include "test_framework.h"
+
+
+
+
+cwt_retv test_cw_seq_send_string(cw_test_executor_t * cte);
+
+
+
+
+#endif /* #ifndef _LIBCW_TESTS_GEN_CW_SEQ_SEND_STRING_H_ */
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_shm_ring.c
+
+   Test of ring of samples in shared memory (cw_shm_ring_new()).
+*/
+
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "cw_shm_ring.h"
+
+
+
+
+#define TEST_TEXT "paris"
+
+/* Capacity of ring used with generator: more than samples of test
+   text, so reader can get all of them after generator stops. */
+#define TEST_GEN_RING_CAPACITY (1 << 19)
+
+
+
+
+/* Reader waiting for samples in separate thread. */
+typedef struct {
+	cw_shm_ring_t * ring;
+	uint64_t position;
+	cw_sample_t samples[64];
+	int n_read;
+	long wait_ms;
+} test_reader_t;
+
+
+
+
+static void * test_reader_thread(void * arg);
+static long test_elapsed_ms(const struct timespec * start);
+static cwt_retv test_shm_ring_read_write_internal(cw_test_executor_t * cte);
+static cwt_retv test_shm_ring_gen_internal(cw_test_executor_t * cte);
+
+
+
+
+/**
+   @brief Test ring of samples in shared memory
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_shm_ring(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_shm_ring_read_write_internal(cte)) {
+		return cwt_retv_err;
+	}
+	if (cwt_retv_ok != test_shm_ring_gen_internal(cte)) {
+		return cwt_retv_err;
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void * test_reader_thread(void * arg)
+{
+	test_reader_t * reader = (test_reader_t *) arg;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	reader->n_read = cw_shm_ring_read(reader->ring, &reader->position, reader->samples, (int) (sizeof (reader->samples) / sizeof (reader->samples[0])), 5000);
+	reader->wait_ms = test_elapsed_ms(&start);
+	return NULL;
+}
+
+
+
+
+static long test_elapsed_ms(const struct timespec * start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+
+
+
+/**
+   @brief Write samples to ring and read them in the same process
+
+   @param cte test executor
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_shm_ring_read_write_internal(cw_test_executor_t * cte)
+{
+	errno = 0;
+	cte->expect_null_pointer(cte, cw_shm_ring_new("libcw_test_ring", 256), "creating ring with name without slash");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of creating ring with invalid name");
+	errno = 0;
+	cte->expect_null_pointer(cte, cw_shm_ring_new("/libcw_test_ring", 1000), "creating ring with capacity that isn't power of two");
+	cte->expect_op_int(cte, EINVAL, "==", errno, "errno of creating ring with invalid capacity");
+
+	char name[64] = { 0 };
+	snprintf(name, sizeof (name), "/libcw_test_ring_%ld", (long) getpid());
+	errno = 0;
+	cte->expect_null_pointer(cte, cw_shm_ring_open(name), "opening ring that doesn't exist");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of opening ring that doesn't exist");
+
+	cw_shm_ring_t * writer = cw_shm_ring_new(name, 256);
+	if (NULL == writer) {
+		cte->log_error(cte, "%s:%d: Failed to create ring: %s\n", __func__, __LINE__, strerror(errno));
+		return cwt_retv_err;
+	}
+	errno = 0;
+	cte->expect_null_pointer(cte, cw_shm_ring_new(name, 256), "creating ring that already exists");
+	cte->expect_op_int(cte, EEXIST, "==", errno, "errno of creating ring that already exists");
+
+	cw_shm_ring_t * reader = cw_shm_ring_open(name);
+	if (NULL == reader) {
+		cte->log_error(cte, "%s:%d: Failed to open ring: %s\n", __func__, __LINE__, strerror(errno));
+		cw_shm_ring_delete(&writer);
+		return cwt_retv_err;
+	}
+	const cw_shm_ring_header_t * header = cw_shm_ring_get_header(reader);
+	cte->expect_op_int(cte, CW_SHM_RING_MAGIC, "==", (int) header->magic, "magic of ring");
+	cte->expect_op_int(cte, 256, "==", (int) header->capacity, "capacity of ring");
+	cte->expect_op_int(cte, (int) sizeof (cw_sample_t), "==", (int) header->sample_size, "size of sample in ring");
+
+	/* Nothing to read yet. */
+	cw_sample_t samples[512] = { 0 };
+	uint64_t position = 0;
+	cte->expect_op_int(cte, 0, "==", cw_shm_ring_read(reader, &position, samples, 512, 0), "reading empty ring without waiting");
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	cte->expect_op_int(cte, 0, "==", cw_shm_ring_read(reader, &position, samples, 512, 50), "reading empty ring with timeout");
+	cte->expect_op_int(cte, 40, "<=", (int) test_elapsed_ms(&start), "time of waiting for samples until timeout");
+
+	/* Writer overruns reader: only the newest samples are left. */
+	cw_sample_t written[1100];
+	for (int i = 0; i < 1100; i++) {
+		written[i] = (cw_sample_t) i;
+	}
+	cw_shm_ring_write(writer, written, 1000, 8000);
+	cte->expect_op_int(cte, 8000, "==", (int) header->sample_rate, "sample rate of ring");
+	int n = cw_shm_ring_read(reader, &position, samples, 512, 0);
+	cte->expect_op_int(cte, 256, "==", n, "count of samples read after overrun");
+	cte->expect_op_int(cte, 1000, "==", (int) position, "position of reader after overrun");
+	cte->expect_op_int(cte, 0, "==", memcmp(samples, written + 1000 - 256, 256 * sizeof (cw_sample_t)), "newest samples after overrun");
+
+	/* Samples wrapped around end of ring. */
+	cw_shm_ring_write(writer, written + 1000, 100, 8000);
+	n = cw_shm_ring_read(reader, &position, samples, 512, 0);
+	cte->expect_op_int(cte, 100, "==", n, "count of samples wrapped around end of ring");
+	cte->expect_op_int(cte, 0, "==", memcmp(samples, written + 1000, 100 * sizeof (cw_sample_t)), "samples wrapped around end of ring");
+
+	/* Reader sleeping on futex is woken by writer. */
+	test_reader_t thread_reader = { .ring = reader, .position = position };
+	pthread_t thread_id;
+	if (0 != pthread_create(&thread_id, NULL, test_reader_thread, &thread_reader)) {
+		cte->log_error(cte, "%s:%d: Failed to create reader thread\n", __func__, __LINE__);
+		cw_shm_ring_delete(&reader);
+		cw_shm_ring_delete(&writer);
+		return cwt_retv_err;
+	}
+	usleep(100000);
+	cw_shm_ring_write(writer, written, 10, 8000);
+	pthread_join(thread_id, NULL);
+	cte->expect_op_int(cte, 10, "==", thread_reader.n_read, "count of samples read by woken reader");
+	cte->expect_op_int(cte, 2000, ">", (int) thread_reader.wait_ms, "time of waiting of woken reader");
+	cte->expect_op_int(cte, 0, "==", (int) header->n_waiters, "count of waiting readers after wakeup");
+
+	cw_shm_ring_delete(&writer);
+	errno = 0;
+	cte->expect_null_pointer(cte, cw_shm_ring_open(name), "opening deleted ring");
+	cte->expect_op_int(cte, ENOENT, "==", errno, "errno of opening deleted ring");
+	cw_shm_ring_delete(&reader);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Pass generator's samples to ring, and compare them with file
+
+   @param cte test executor
+
+   @return cwt_retv_ok on success
+   @return cwt_retv_err on failure
+*/
+static cwt_retv test_shm_ring_gen_internal(cw_test_executor_t * cte)
+{
+	char path[LIBCW_SOUND_DEVICE_NAME_SIZE] = { 0 };
+	snprintf(path, sizeof (path), "/tmp/libcw_test_shm_ring_%ld.raw", (long) getpid());
+	char name[64] = { 0 };
+	snprintf(name, sizeof (name), "/libcw_test_gen_ring_%ld", (long) getpid());
+
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_FILE;
+	snprintf(gen_conf.sound_device, sizeof (gen_conf.sound_device), "%s", path);
+	gen_conf.sidetone_low_latency = false;
+
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_shm_ring_t * writer = cw_shm_ring_new(name, TEST_GEN_RING_CAPACITY);
+	cw_shm_ring_t * reader = cw_shm_ring_open(name);
+	cw_sample_t * samples = calloc(TEST_GEN_RING_CAPACITY, sizeof (cw_sample_t));
+	if (NULL == gen || NULL == writer || NULL == reader || NULL == samples) {
+		cte->log_error(cte, "%s:%d: Failed to set up generator and ring\n", __func__, __LINE__);
+		free(samples);
+		cw_shm_ring_delete(&reader);
+		cw_shm_ring_delete(&writer);
+		cw_gen_delete(&gen);
+		return cwt_retv_err;
+	}
+
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_add_sink(gen, cw_shm_ring_write, writer), "adding ring as sink of generator");
+	cw_gen_set_speed(gen, 60);
+	cw_gen_start(gen);
+	cw_gen_enqueue_string(gen, TEST_TEXT);
+	cw_gen_wait_for_queue_level(gen, 0);
+	cw_gen_stop(gen);
+
+	cw_gen_sink_statistics_t stats = { 0 };
+	cw_gen_get_sink_statistics(gen, cw_shm_ring_write, writer, &stats);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_gen_remove_sink(gen, cw_shm_ring_write, writer), "removing ring from generator");
+	const int sample_rate = gen->sample_rate;
+	cw_gen_delete(&gen);
+
+	uint64_t position = 0;
+	const int n_samples = cw_shm_ring_read(reader, &position, samples, TEST_GEN_RING_CAPACITY, 0);
+	cte->expect_op_int(cte, 0, "<", n_samples, "count of samples read from ring");
+	cte->expect_op_int(cte, sample_rate, "==", (int) cw_shm_ring_get_header(reader)->sample_rate, "sample rate of generator in ring");
+
+	FILE * file = fopen(path, "rb");
+	cw_sample_t * contents = NULL;
+	long size = 0;
+	if (NULL != file) {
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		contents = calloc((size_t) size + 1, 1);
+		if (NULL != contents && (size_t) size != fread(contents, 1, (size_t) size, file)) {
+			free(contents);
+			contents = NULL;
+		}
+		fclose(file);
+	}
+	unlink(path);
+
+	const bool have_contents = NULL != contents;
+	if (have_contents) {
+		if (0 == stats.n_dropped) {
+			/* Reader of ring gets exactly what has been written to
+			   the sound device. */
+			cte->expect_op_int(cte, (int) size, "==", n_samples * (int) sizeof (cw_sample_t), "size of samples in ring");
+			cte->expect_op_int(cte, 0, "==", memcmp(contents, samples, (size_t) size), "samples in ring");
+		} else {
+			cte->expect_op_int(cte, (int) size, ">", n_samples * (int) sizeof (cw_sample_t), "size of samples in ring of sink that dropped buffers");
+		}
+	} else {
+		cte->log_error(cte, "%s:%d: Failed to read output file %s\n", __func__, __LINE__, path);
+	}
+	free(contents);
+	free(samples);
+	cw_shm_ring_delete(&reader);
+	cw_shm_ring_delete(&writer);
+
+	return have_contents ? cwt_retv_ok : cwt_retv_err;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+ * Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+
+
+/**
+   @file cw_timing_acquire_internal.c
+
+   Test of timing blocks shared by generators and receivers.
+*/
+
+
+
+
+#include <string.h>
+
+
+
+
+#include "libcw_gen.h"
+#include "libcw_rec.h"
+#include "libcw_timing.h"
+#include "cw_timing_acquire_internal.h"
+
+
+
+
+static cwt_retv test_shared_by_instances(cw_test_executor_t * cte);
+static void test_reuse_of_blocks(cw_test_executor_t * cte);
+
+
+
+
+/**
+   @brief Test sharing of timing blocks
+
+   Generators and receivers with the same parameters must point to the
+   same block, the block must have the same durations as durations
+   calculated by a generator for itself, and released blocks must be
+   reused for other parameters.
+
+   @param cte test executor
+
+   @return cwt_retv_ok if execution of the test was carried out without interruptions
+   @return cwt_retv_err if execution of the test had to be aborted
+*/
+cwt_retv test_cw_timing_acquire_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	if (cwt_retv_ok != test_shared_by_instances(cte)) {
+		return cwt_retv_err;
+	}
+	test_reuse_of_blocks(cte);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static cwt_retv test_shared_by_instances(cw_test_executor_t * cte)
+{
+	cw_gen_config_t gen_conf = cte->current_gen_conf;
+	gen_conf.sound_system = CW_AUDIO_NULL;
+
+	cw_gen_t * gen1 = cw_gen_new(&gen_conf);
+	cw_gen_t * gen2 = cw_gen_new(&gen_conf);
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == gen1 || NULL == gen2 || NULL == rec) {
+		cte->log_error(cte, "%s:%d: Failed to create generators or receiver\n", __func__, __LINE__);
+		cw_gen_delete(&gen1);
+		cw_gen_delete(&gen2);
+		cw_rec_delete(&rec);
+		return cwt_retv_err;
+	}
+
+	cw_gen_set_speed(gen1, 25);
+	cw_gen_set_speed(gen2, 25);
+	cw_rec_set_speed(rec, 25);
+	cw_rec_disable_adaptive_mode(rec);
+	cw_gen_sync_parameters_internal(gen1);
+	cw_gen_sync_parameters_internal(gen2);
+	cw_rec_sync_parameters_internal(rec);
+
+	cte->expect_op_int(cte, true, "==", NULL != gen1->timing && gen1->timing == gen2->timing, "generators with the same parameters share timing block");
+	cte->expect_op_int(cte, true, "==", gen1->timing == rec->timing, "generator and receiver with the same speed and gap share timing block");
+
+	cw_gen_durations_t expected;
+	cw_gen_calculate_durations_internal(25, CW_WEIGHTING_INITIAL, CW_GAP_INITIAL, &expected);
+	cte->expect_op_int(cte, 0, "==", memcmp(&expected, gen1->durations, sizeof (expected)), "durations in timing block");
+
+	cw_rec_parameters_t parameters;
+	cw_rec_calculate_parameters_internal(CW_DOT_CALIBRATION / 25, CW_TOLERANCE_INITIAL, CW_GAP_INITIAL, false, &parameters);
+	cte->expect_op_int(cte, parameters.dot_duration_max, "==", rec->dot_duration_max, "receiver's parameters from timing block");
+
+	/* Changing parameters of one generator doesn't change
+	   durations of the other one. */
+	cw_gen_set_weighting(gen2, 60);
+	cw_gen_sync_parameters_internal(gen2);
+	cte->expect_op_int(cte, true, "==", gen1->timing != gen2->timing, "generators with different weighting use different blocks");
+	cte->expect_op_int(cte, expected.dot_duration, "==", gen1->durations->dot_duration, "durations of generator with unchanged parameters");
+	cte->expect_op_int(cte, expected.dot_duration, "<", gen2->durations->dot_duration, "durations of generator with larger weighting");
+
+	cw_gen_set_weighting(gen2, CW_WEIGHTING_INITIAL);
+	cw_gen_sync_parameters_internal(gen2);
+	cte->expect_op_int(cte, true, "==", gen1->timing == gen2->timing, "generators share block again after restoring weighting");
+
+	cw_gen_delete(&gen1);
+	cw_gen_delete(&gen2);
+	cw_rec_delete(&rec);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+static void test_reuse_of_blocks(cw_test_executor_t * cte)
+{
+	/* Keys that aren't used by generators or receivers of other
+	   tests. */
+	cw_timing_key_t key;
+	cw_timing_key_init_internal(&key, 123457, CW_GAP_MAX);
+
+	const size_t n_before = cw_timing_count_internal();
+
+	const cw_timing_t * timing1 = cw_timing_acquire_internal(&key);
+	const cw_timing_t * timing2 = LIBCW_TEST_FUT(cw_timing_acquire_internal)(&key);
+	cte->expect_op_int(cte, true, "==", NULL != timing1 && timing1 == timing2, "block acquired twice for the same key");
+	cte->expect_op_int(cte, 2, "==", NULL == timing1 ? 0 : timing1->n_references, "count of references of block");
+	cte->expect_op_int(cte, (int) n_before + 1, "==", (int) cw_timing_count_internal(), "count of blocks in use after acquiring");
+
+	const cw_timing_t * released = timing1;
+	cw_timing_release_internal(&timing1);
+	cw_timing_release_internal(&timing2);
+	cte->expect_op_int(cte, true, "==", NULL == timing1 && NULL == timing2, "released pointers are reset");
+	cte->expect_op_int(cte, (int) n_before, "==", (int) cw_timing_count_internal(), "count of blocks in use after releasing");
+
+	/* Released block stays in table. */
+	timing1 = cw_timing_acquire_internal(&key);
+	cte->expect_op_int(cte, true, "==", released == timing1, "released block is found again");
+	cw_timing_release_internal(&timing1);
+
+	/* Table never runs out of blocks when blocks are released. */
+	bool failure = false;
+	for (int i = 0; i < 2 * CW_TIMING_N_BLOCKS; i++) {
+		key.unit_duration = 200000 + i;
+		const cw_timing_t * timing = cw_timing_acquire_internal(&key);
+		if (NULL == timing || key.unit_duration != timing->gen_durations.unit_duration) {
+			failure = true;
+		}
+		cw_timing_release_internal(&timing);
+	}
+	cte->expect_op_int(cte, false, "==", failure, "acquiring blocks for many keys");
+}
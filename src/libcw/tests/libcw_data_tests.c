@@ -38,6 +38,7 @@
 
 
 
+#include "libcw_alphabet.h"
 #include "libcw_data.h"
 #include "libcw_data_tests.h"
 #include "libcw_debug.h"
@@ -204,6 +205,14 @@ int test_cw_representation_to_character_internal(cw_test_executor_t * cte)
 			break;
 		}
 
+		/* Lookup by hash, used by receiver. */
+		const unsigned int hash = cw_representation_to_hash_internal(cw_entry->representation);
+		const int char_hash_lookup = LIBCW_TEST_FUT(cw_representation_hash_to_character_internal)(hash);
+		if (!cte->expect_op_int_errors_only(cte, char_hash_lookup, "==", char_direct, "hash lookup vs. direct method: '%s'", cw_entry->representation)) {
+			failure = true;
+			break;
+		}
+
 
 		/* Also test old version of cw_representation_to_character(). */
 		{
@@ -228,6 +237,16 @@ int test_cw_representation_to_character_internal(cw_test_executor_t * cte)
 
 	cte->expect_op_int(cte, false, "==", failure, "representation to character");
 
+	/* Hashes of "-------" (not a character) and out of range. */
+	const unsigned int invalid_hashes[] = { 0, 1, CW_DATA_MAX_REPRESENTATION_HASH, CW_DATA_MAX_REPRESENTATION_HASH + 1 };
+	bool invalid_failure = false;
+	for (size_t h = 0; h < sizeof (invalid_hashes) / sizeof (invalid_hashes[0]); h++) {
+		if (0 != LIBCW_TEST_FUT(cw_representation_hash_to_character_internal)(invalid_hashes[h])) {
+			invalid_failure = true;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", invalid_failure, "hash lookup of invalid hashes");
+
 	cte->print_test_footer(cte, __func__);
 
 	return 0;
@@ -556,6 +575,97 @@ cwt_retv test_data_main_table_lookups(cw_test_executor_t * cte)
 
 
 
+/**
+   @brief Verify tables and values precomputed at build time
+
+   Lookup tables, counts and maximal lengths are precomputed from
+   tables of characters, prosigns and phonetics. Compare them with
+   values calculated here from the source tables.
+*/
+cwt_retv test_data_precomputed_tables(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Main table: count, maximal length of representation, lookup
+	   of representation by character. */
+	{
+		int count = 0;
+		int max_length = 0;
+		bool c2r_failure = false;
+		for (const cw_entry_t * cw_entry = CW_TABLE; cw_entry->character; cw_entry++) {
+			count++;
+			const int length = (int) strlen(cw_entry->representation);
+			if (length > max_length) {
+				max_length = length;
+			}
+			if (cw_entry->representation != LIBCW_TEST_FUT(cw_character_to_representation_internal)(cw_entry->character)) {
+				c2r_failure = true;
+			}
+		}
+		cte->expect_op_int(cte, count, "==", LIBCW_TEST_FUT(cw_get_character_count)(), "count of characters");
+		cte->expect_op_int(cte, max_length, "==", LIBCW_TEST_FUT(cw_get_maximum_representation_length)(), "maximal length of representation");
+		cte->expect_op_int(cte, false, "==", c2r_failure, "lookup of representations");
+	}
+
+	/* Lookup of character by hash of representation, for all hashes. */
+	{
+		const cw_entry_t * table[CW_DATA_MAX_REPRESENTATION_HASH + 1] = { 0 };
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_data_init_r2c_hash_table_internal)(table), "initializing reference hash table");
+		bool r2c_failure = false;
+		for (unsigned int hash = 0; hash <= CW_DATA_MAX_REPRESENTATION_HASH; hash++) {
+			const int expected = table[hash] ? table[hash]->character : 0;
+			if (expected != LIBCW_TEST_FUT(cw_representation_hash_to_character_internal)(hash)) {
+				r2c_failure = true;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", r2c_failure, "lookup of characters by hash");
+	}
+
+	/* Prosigns: lookup of expansion by character, maximal length of expansion. */
+	{
+		char procedural_characters[UCHAR_MAX + 1] = { 0 };
+		cw_list_procedural_characters(procedural_characters);
+		int max_length = 0;
+		bool lookup_failure = false;
+		for (const char * c = procedural_characters; '\0' != *c; c++) {
+			bool is_usually_expanded = false;
+			const char * expansion = LIBCW_TEST_FUT(cw_lookup_procedural_character_internal)(*c, &is_usually_expanded);
+			if (NULL == expansion) {
+				lookup_failure = true;
+				continue;
+			}
+			const int length = (int) strlen(expansion);
+			if (length > max_length) {
+				max_length = length;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", lookup_failure, "lookup of procedural expansions");
+		cte->expect_op_int(cte, max_length, "==", LIBCW_TEST_FUT(cw_get_maximum_procedural_expansion_length)(), "maximal length of procedural expansion");
+	}
+
+	/* Phonetics: maximal length. Phonetics are copied up to the
+	   maximal length, so use a generous buffer. */
+	{
+		int max_length = 0;
+		for (char c = 'A'; c <= 'Z'; c++) {
+			char phonetic[64] = { 0 };
+			cw_lookup_phonetic(c, phonetic);
+			const int length = (int) strlen(phonetic);
+			if (length > max_length) {
+				max_length = length;
+			}
+		}
+		cte->expect_op_int(cte, max_length, "==", LIBCW_TEST_FUT(cw_get_maximum_phonetic_length)(), "maximal length of phonetic");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
 /**
    \brief Test functions looking up procedural characters and their representation.
 
@@ -942,6 +1052,287 @@ int test_validate_string_internal(cw_test_executor_t * cte)
 
 
 
+/**
+   @brief Test lookups that return pointers to library's data
+*/
+cwt_retv test_cw_character_get_functions(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Test: representations and packed representations of all
+	   characters from library's list of characters. */
+	{
+		char charlist[UCHAR_MAX + 1] = { 0 };
+		cw_list_characters(charlist);
+		bool failure = false;
+		for (size_t i = 0; charlist[i] != '\0'; i++) {
+			const char * expected = cw_character_to_representation_internal(charlist[i]);
+			const char * representation = LIBCW_TEST_FUT(cw_character_get_representation)(charlist[i]);
+			if (!cte->expect_op_int_errors_only(cte, true, "==", representation == expected, "representation of '%c'", charlist[i])) {
+				failure = true;
+				break;
+			}
+
+			unsigned int n_marks = 0;
+			unsigned int bits = 0;
+			const cw_ret_t cwret = LIBCW_TEST_FUT(cw_character_get_packed_representation)(charlist[i], &n_marks, &bits);
+			if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "packed representation of '%c'", charlist[i])) {
+				failure = true;
+				break;
+			}
+			if (!cte->expect_op_int_errors_only(cte, (int) strlen(expected), "==", (int) n_marks, "count of marks of '%c'", charlist[i])) {
+				failure = true;
+				break;
+			}
+			for (unsigned int m = 0; m < n_marks; m++) {
+				const char mark = (bits & (1U << (n_marks - 1 - m))) ? CW_DASH_REPRESENTATION : CW_DOT_REPRESENTATION;
+				if (!cte->expect_op_int_errors_only(cte, expected[m], "==", mark, "mark #%u of '%c'", m, charlist[i])) {
+					failure = true;
+					break;
+				}
+			}
+			if (failure) {
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "representations of characters");
+
+		cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_character_get_representation)('a') == LIBCW_TEST_FUT(cw_character_get_representation)('A'), "lower case letter");
+
+		unsigned int n_marks = 0;
+		unsigned int bits = 0;
+		LIBCW_TEST_FUT(cw_character_get_packed_representation)('k', &n_marks, &bits);
+		cte->expect_op_int(cte, 3, "==", (int) n_marks, "count of marks of 'k'");
+		cte->expect_op_int(cte, 5, "==", (int) bits, "marks of 'k'"); /* -.- */
+
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_character_get_representation)('\x01'), "representation of invalid character");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno after looking up representation of invalid character");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_character_get_packed_representation)(' ', &n_marks, &bits), "packed representation of space");
+	}
+
+	/* Test: procedural signals. */
+	{
+		char list[UCHAR_MAX + 1] = { 0 };
+		cw_list_procedural_characters(list);
+		bool failure = false;
+		for (size_t i = 0; list[i] != '\0'; i++) {
+			bool expected_is_usually_expanded = false;
+			const char * expected = cw_lookup_procedural_character_internal(list[i], &expected_is_usually_expanded);
+			bool is_usually_expanded = !expected_is_usually_expanded;
+			const char * expansion = LIBCW_TEST_FUT(cw_character_get_procedural_expansion)(list[i], &is_usually_expanded);
+			if (!cte->expect_op_int_errors_only(cte, true, "==", expansion == expected && is_usually_expanded == expected_is_usually_expanded, "expansion of '%c'", list[i])) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "expansions of procedural signals");
+
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_character_get_procedural_expansion)('A', NULL), "expansion of letter");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno after looking up expansion of letter");
+	}
+
+	/* Test: phonetics. */
+	{
+		const char * phonetic = LIBCW_TEST_FUT(cw_character_get_phonetic)('x');
+		cte->expect_valid_pointer(cte, phonetic, "phonetic of 'x'");
+		if (phonetic) {
+			cte->expect_strcasecmp(cte, "X-ray", phonetic, "phonetic of 'x'");
+		}
+
+		errno = 0;
+		cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_character_get_phonetic)('1'), "phonetic of digit");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno after looking up phonetic of digit");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test translation of strings into packed representations of characters
+*/
+cwt_retv test_cw_translate_string(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Test: every character from library's list of characters is
+	   translated into hash of its representation. */
+	{
+		char charlist[UCHAR_MAX + 1] = { 0 };
+		cw_list_characters(charlist);
+		uint8_t translated[UCHAR_MAX + 1] = { 0 };
+		size_t n_translated = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_translate_string)(charlist, translated, sizeof (translated), &n_translated);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "translating list of characters");
+		cte->expect_op_int(cte, (int) strlen(charlist), "==", (int) n_translated, "count of translated characters");
+
+		bool failure = false;
+		for (size_t i = 0; i < n_translated; i++) {
+			const unsigned int expected = cw_representation_to_hash_internal(cw_character_to_representation_internal(charlist[i]));
+			if (!cte->expect_op_int_errors_only(cte, (int) expected, "==", (int) translated[i], "translated character '%c'", charlist[i])) {
+				failure = true;
+				break;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "translated characters");
+	}
+
+	/* Test: space and lower case letters. */
+	{
+		uint8_t translated[8] = { 0 };
+		size_t n_translated = 0;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_translate_string)("a A", translated, sizeof (translated), &n_translated);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "translating string with space");
+		cte->expect_op_int(cte, 3, "==", (int) n_translated, "count of characters of string with space");
+		cte->expect_op_int(cte, translated[0], "==", translated[2], "lower case and upper case letters");
+		cte->expect_op_int(cte, CW_TRANSLATED_SPACE, "==", translated[1], "translated space");
+	}
+
+	/* Test: invalid arguments. */
+	{
+		uint8_t translated[8] = { 0 };
+		size_t n_translated = 0;
+
+		errno = 0;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_translate_string)("AB\x01", translated, sizeof (translated), &n_translated);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "translating invalid string");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno after translating invalid string");
+		cte->expect_op_int(cte, 2, "==", (int) n_translated, "index of invalid character");
+
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_translate_string)("PARIS", translated, 4, &n_translated);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "translating string into too small buffer");
+		cte->expect_op_int(cte, ENOSPC, "==", errno, "errno after translating string into too small buffer");
+
+		errno = 0;
+		cwret = LIBCW_TEST_FUT(cw_translate_string)(NULL, translated, sizeof (translated), &n_translated);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "translating NULL string");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after translating NULL string");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test lookups of characters in alphabets
+*/
+cwt_retv test_cw_alphabet_lookups(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Test: built-in alphabets. */
+	{
+		cw_alphabet_t * alphabet = LIBCW_TEST_FUT(cw_alphabet_new_builtin)(CW_ALPHABET_CYRILLIC);
+		cte->expect_valid_pointer(cte, alphabet, "creating built-in alphabet");
+
+		const char * representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, 0x0416); /* Cyrillic capital letter zhe */
+		cte->expect_op_int(cte, 0, "==", NULL == representation ? -1 : strcmp(representation, "...-"), "representation of Cyrillic letter");
+		representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, 0x0436); /* Cyrillic small letter zhe */
+		cte->expect_op_int(cte, 0, "==", NULL == representation ? -1 : strcmp(representation, "...-"), "representation of lower case Cyrillic letter");
+		representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, '7');
+		cte->expect_op_int(cte, 0, "==", NULL == representation ? -1 : strcmp(representation, "--..."), "representation of digit from main table");
+
+		errno = 0;
+		representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, 0x0391); /* Greek capital letter alpha */
+		cte->expect_null_pointer(cte, representation, "representation of character from other alphabet");
+		cte->expect_op_int(cte, ENOENT, "==", errno, "errno after looking up character from other alphabet");
+
+		uint32_t code_point = LIBCW_TEST_FUT(cw_alphabet_representation_to_code_point)(alphabet, "...-");
+		cte->expect_op_int(cte, 0x0416, "==", (int) code_point, "code point of Cyrillic letter");
+		code_point = LIBCW_TEST_FUT(cw_alphabet_representation_to_code_point)(alphabet, ".----");
+		cte->expect_op_int(cte, '1', "==", (int) code_point, "code point of digit from main table");
+		errno = 0;
+		code_point = LIBCW_TEST_FUT(cw_alphabet_representation_to_code_point)(alphabet, ".-.x");
+		cte->expect_op_int(cte, 0, "==", (int) code_point, "code point of invalid representation");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after looking up invalid representation");
+
+		cw_alphabet_delete(&alphabet);
+		cte->expect_null_pointer(cte, alphabet, "deleted alphabet");
+
+		const cw_alphabet_id_t ids[] = { CW_ALPHABET_LATIN, CW_ALPHABET_GREEK, CW_ALPHABET_WABUN };
+		for (size_t i = 0; i < sizeof (ids) / sizeof (ids[0]); i++) {
+			alphabet = LIBCW_TEST_FUT(cw_alphabet_new_builtin)(ids[i]);
+			cte->expect_valid_pointer(cte, alphabet, "creating built-in alphabet %d", (int) ids[i]);
+			cw_alphabet_delete(&alphabet);
+		}
+	}
+
+	/* Test: client's alphabet, with representation shared by two
+	   characters and code points in distant pages. */
+	{
+		const cw_alphabet_entry_t entries[] = {
+			{ 0x1F600, "...---..." },
+			{ 0x0100, ".-.-" },
+			{ 0x10FFFF, ".-.-" },
+		};
+		errno = 0;
+		cw_alphabet_t * alphabet = LIBCW_TEST_FUT(cw_alphabet_new)(entries, 3);
+		cte->expect_null_pointer(cte, alphabet, "creating alphabet with too long representation");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after creating alphabet with too long representation");
+
+		alphabet = LIBCW_TEST_FUT(cw_alphabet_new)(&entries[1], 2);
+		cte->expect_valid_pointer(cte, alphabet, "creating alphabet");
+		const char * representation = LIBCW_TEST_FUT(cw_alphabet_code_point_to_representation)(alphabet, 0x10FFFF);
+		cte->expect_op_int(cte, 0, "==", NULL == representation ? -1 : strcmp(representation, ".-.-"), "representation of largest code point");
+		const uint32_t code_point = LIBCW_TEST_FUT(cw_alphabet_representation_to_code_point)(alphabet, ".-.-");
+		cte->expect_op_int(cte, 0x0100, "==", (int) code_point, "code point of first character with shared representation");
+		cw_alphabet_delete(&alphabet);
+
+		const cw_alphabet_entry_t duplicates[] = { { 0x0100, ".-" }, { 0x0100, "-." } };
+		errno = 0;
+		alphabet = LIBCW_TEST_FUT(cw_alphabet_new)(duplicates, 2);
+		cte->expect_null_pointer(cte, alphabet, "creating alphabet with duplicate code points");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "errno after creating alphabet with duplicate code points");
+	}
+
+	/* Test: decoding of UTF-8. */
+	{
+		struct {
+			const char * string;
+			size_t n_bytes;
+			uint32_t code_point;
+		} test_data[] = {
+			{ "A",                  1, 'A'      },
+			{ "\xC3\x9C",           2, 0x00DC   },
+			{ "\xE3\x82\xA2",       3, 0x30A2   },
+			{ "\xF0\x9F\x98\x80",   4, 0x1F600  },
+			{ "\xC0\x81",           0, 0        }, /* Overlong encoding. */
+			{ "\xED\xA0\x80",       0, 0        }, /* Surrogate. */
+			{ "\xF4\x90\x80\x80",   0, 0        }, /* Beyond largest code point. */
+			{ "\xE3\x82",           0, 0        }, /* Truncated sequence. */
+			{ "\x82",               0, 0        }, /* Continuation byte. */
+		};
+		bool failure = false;
+		for (size_t i = 0; i < sizeof (test_data) / sizeof (test_data[0]); i++) {
+			uint32_t code_point = 0;
+			const size_t n_bytes = LIBCW_TEST_FUT(cw_utf8_decode_internal)(test_data[i].string, &code_point);
+			if (n_bytes != test_data[i].n_bytes || (0 != n_bytes && code_point != test_data[i].code_point)) {
+				cte->log_error(cte, "decoding UTF-8 sequence #%zu: %zu bytes, U+%04X\n", i, n_bytes, (unsigned int) code_point);
+				failure = true;
+			}
+		}
+		cte->expect_op_int(cte, false, "==", failure, "decoding UTF-8");
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
 /**
    @brief Test validation of representations of characters
 
@@ -22,11 +22,15 @@ cwt_retv test_data_main_table_get_count(cw_test_executor_t * cte);
 cwt_retv test_data_main_table_get_contents(cw_test_executor_t * cte);
 cwt_retv test_data_main_table_get_representation_len_max(cw_test_executor_t * cte);
 cwt_retv test_data_main_table_lookups(cw_test_executor_t * cte);
+cwt_retv test_data_precomputed_tables(cw_test_executor_t * cte);
 
 int test_prosign_lookups_internal(cw_test_executor_t * cte);
 int test_phonetic_lookups_internal(cw_test_executor_t * cte);
 int test_validate_character_internal(cw_test_executor_t * cte);
 int test_validate_string_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_character_get_functions(cw_test_executor_t * cte);
+cwt_retv test_cw_translate_string(cw_test_executor_t * cte);
+cwt_retv test_cw_alphabet_lookups(cw_test_executor_t * cte);
 int test_validate_representation_internal(cw_test_executor_t * cte);
 
 
@@ -20,12 +20,20 @@
 
 
 
+#include "config.h"
+
+
+
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h> /* "PRIu32" */
+#include <pthread.h>
+#include <sys/wait.h>
 
 
 
@@ -39,6 +47,7 @@
 #include "libcw_debug.h"
 #include "libcw_debug_tests.h"
 #include "libcw_key.h"
+#include "libcw_trace.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
 
@@ -92,3 +101,247 @@ int test_cw_debug_flags_internal(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+enum { TEST_TRACE_N_EVENTS = 100 };
+
+
+
+
+#if defined(LIBCW_WITH_TRACE)
+static void * test_trace_thread_fn(__attribute__((unused)) void * arg)
+{
+	for (int i = 0; i < TEST_TRACE_N_EVENTS; i++) {
+		CW_TRACE(CW_TRACE_KEY_IK, i);
+	}
+	return NULL;
+}
+#endif
+
+
+
+
+/**
+   @brief Test that events recorded by trace probes in two threads are dumped
+*/
+int test_cw_trace_start(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+#if defined(LIBCW_WITH_TRACE)
+	int fds[2] = { -1, -1 };
+	cte->assert2(cte, 0 == pipe(fds), "failed to create pipe");
+
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_trace_start)(fds[1]);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "starting trace");
+	cwret = LIBCW_TEST_FUT(cw_trace_start)(fds[1]);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "starting trace again");
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, test_trace_thread_fn, NULL);
+	for (int i = 0; i < TEST_TRACE_N_EVENTS; i++) {
+		CW_TRACE(CW_TRACE_KEY_SK, i);
+	}
+	pthread_join(thread, NULL);
+
+	LIBCW_TEST_FUT(cw_trace_stop)();
+	/* Probes are disabled after stop. */
+	CW_TRACE(CW_TRACE_KEY_SK, 0);
+	close(fds[1]);
+
+	int n_sk = 0;
+	int n_ik = 0;
+	char buffer[4096];
+	char line[128];
+	size_t line_len = 0;
+	ssize_t n_read = 0;
+	while ((n_read = read(fds[0], buffer, sizeof (buffer))) > 0) {
+		for (ssize_t i = 0; i < n_read; i++) {
+			if ('\n' != buffer[i]) {
+				if (line_len < sizeof (line) - 1) {
+					line[line_len++] = buffer[i];
+				}
+				continue;
+			}
+			line[line_len] = '\0';
+			line_len = 0;
+			if (NULL != strstr(line, "\tkey_sk\t")) {
+				n_sk++;
+			} else if (NULL != strstr(line, "\tkey_ik\t")) {
+				n_ik++;
+			}
+		}
+	}
+	close(fds[0]);
+
+	cte->expect_op_int(cte, TEST_TRACE_N_EVENTS, "==", n_sk, "events of main thread");
+	cte->expect_op_int(cte, TEST_TRACE_N_EVENTS, "==", n_ik, "events of other thread");
+#else
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_trace_start)(STDERR_FILENO), "starting trace without probes");
+#endif
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+enum { TEST_DEBUG_MSG_N_THREADS = 4, TEST_DEBUG_MSG_N_MESSAGES = 50 };
+
+
+
+
+static void * test_debug_msg_thread_fn(void * arg)
+{
+	cw_debug_t * debug_object = (cw_debug_t *) arg;
+	for (int i = 0; i < TEST_DEBUG_MSG_N_MESSAGES; i++) {
+		cw_debug_msg (debug_object, CW_DEBUG_KEYING, CW_DEBUG_INFO, "test_debug_msg_marker %d", i);
+		/* Stay below capacity of queue of messages. */
+		usleep(1000);
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   @brief Test that debug messages logged by many threads are all written to stderr
+*/
+int test_cw_debug_msg_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * labels[] = { "[DD]", "[II]", "[WW]", "[EE]" };
+	cw_debug_t debug_object = { .flags = CW_DEBUG_KEYING, .level = CW_DEBUG_INFO, .level_labels = labels };
+
+	const int cwret = LIBCW_TEST_FUT(cw_debug_start_writer)();
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "starting writer thread");
+
+	int fds[2] = { -1, -1 };
+	cte->assert2(cte, 0 == pipe(fds), "failed to create pipe");
+	fflush(stderr);
+	const int stderr_backup = dup(STDERR_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+
+	pthread_t threads[TEST_DEBUG_MSG_N_THREADS];
+	for (int i = 0; i < TEST_DEBUG_MSG_N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, test_debug_msg_thread_fn, &debug_object);
+	}
+	/* Message with level lower than level of debug object is not logged. */
+	cw_debug_msg ((&debug_object), CW_DEBUG_KEYING, CW_DEBUG_DEBUG, "test_debug_msg_marker debug");
+	for (int i = 0; i < TEST_DEBUG_MSG_N_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	LIBCW_TEST_FUT(cw_debug_flush)();
+	fflush(stderr);
+	dup2(stderr_backup, STDERR_FILENO);
+	close(stderr_backup);
+	close(fds[1]);
+
+	int n_messages = 0;
+	char buffer[4096];
+	char line[128];
+	size_t line_len = 0;
+	ssize_t n_read = 0;
+	while ((n_read = read(fds[0], buffer, sizeof (buffer))) > 0) {
+		for (ssize_t i = 0; i < n_read; i++) {
+			if ('\n' != buffer[i]) {
+				if (line_len < sizeof (line) - 1) {
+					line[line_len++] = buffer[i];
+				}
+				continue;
+			}
+			line[line_len] = '\0';
+			line_len = 0;
+			if (0 == strncmp(line, "[II] test_debug_msg_marker ", strlen("[II] test_debug_msg_marker "))) {
+				n_messages++;
+			}
+		}
+	}
+	close(fds[0]);
+
+	cte->expect_op_int(cte, TEST_DEBUG_MSG_N_THREADS * TEST_DEBUG_MSG_N_MESSAGES, "==", n_messages, "count of messages");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Test that debug messages logged by child process of fork() are written to stderr
+
+   Writer thread of debug messages isn't inherited by child process.
+*/
+int test_cw_debug_msg_fork(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * labels[] = { "[DD]", "[II]", "[WW]", "[EE]" };
+	cw_debug_t debug_object = { .flags = CW_DEBUG_KEYING, .level = CW_DEBUG_INFO, .level_labels = labels };
+
+	int fds[2] = { -1, -1 };
+	cte->assert2(cte, 0 == pipe(fds), "failed to create pipe");
+	fflush(stderr);
+	const int stderr_backup = dup(STDERR_FILENO);
+	dup2(fds[1], STDERR_FILENO);
+
+	/* Writer thread must be running before fork(). */
+	const int cwret = LIBCW_TEST_FUT(cw_debug_start_writer)();
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "starting writer thread");
+
+	const pid_t pid = fork();
+	if (0 == pid) {
+		for (int i = 0; i < TEST_DEBUG_MSG_N_MESSAGES; i++) {
+			cw_debug_msg ((&debug_object), CW_DEBUG_KEYING, CW_DEBUG_INFO, "test_debug_fork_marker child %d", i);
+		}
+		LIBCW_TEST_FUT(cw_debug_flush)();
+		fflush(stderr);
+		_exit(0);
+	}
+
+	fflush(stderr);
+	dup2(stderr_backup, STDERR_FILENO);
+	close(stderr_backup);
+	close(fds[1]);
+
+	cte->assert2(cte, pid > 0, "failed to fork");
+	int status = 0;
+	waitpid(pid, &status, 0);
+
+	int n_messages = 0;
+	char buffer[4096];
+	char line[128];
+	size_t line_len = 0;
+	ssize_t n_read = 0;
+	while ((n_read = read(fds[0], buffer, sizeof (buffer))) > 0) {
+		for (ssize_t i = 0; i < n_read; i++) {
+			if ('\n' != buffer[i]) {
+				if (line_len < sizeof (line) - 1) {
+					line[line_len++] = buffer[i];
+				}
+				continue;
+			}
+			line[line_len] = '\0';
+			line_len = 0;
+			if (0 == strncmp(line, "[II] test_debug_fork_marker child ", strlen("[II] test_debug_fork_marker child "))) {
+				n_messages++;
+			}
+		}
+	}
+	close(fds[0]);
+
+	cte->expect_op_int(cte, TEST_DEBUG_MSG_N_MESSAGES, "==", n_messages, "count of messages of child process");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
@@ -15,6 +15,9 @@
 
 
 int test_cw_debug_flags_internal(cw_test_executor_t * cte);
+int test_cw_trace_start(cw_test_executor_t * cte);
+int test_cw_debug_msg_internal(cw_test_executor_t * cte);
+int test_cw_debug_msg_fork(cw_test_executor_t * cte);
 
 
 
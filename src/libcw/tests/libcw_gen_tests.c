@@ -259,6 +259,71 @@ static cwt_retv test_cw_gen_new_start_stop_delete_sub(cw_test_executor_t * cte,
 
 
 
+/* Count of measured start/stop pairs. */
+#define TEST_START_STOP_N_PAIRS 10
+/* Start and stop wait for generator's thread instead of sleeping for
+   fixed time, so a pair takes milliseconds. The bound is much larger,
+   so that a busy machine doesn't fail the test, but fixed sleeps
+   (over a second per pair) would still be detected. */
+#define TEST_START_STOP_MAX_MEDIAN 1000000 /* [us] */
+
+
+
+
+/**
+   @brief Measure duration of starting and stopping a generator
+
+   Median of durations of several start/stop pairs is reported, and is
+   compared with a generous bound. Median is used so that a single pair
+   delayed by load of machine doesn't fail the test.
+*/
+cwt_retv test_cw_gen_start_stop_duration(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_gen_t * gen = cw_gen_new(&cte->current_gen_conf);
+	if (NULL == gen) {
+		cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+		return cwt_retv_err;
+	}
+
+	int durations[TEST_START_STOP_N_PAIRS] = { 0 }; /* [us] */
+	bool failure = false;
+	for (int i = 0; i < TEST_START_STOP_N_PAIRS && !failure; i++) {
+		struct timeval before;
+		gettimeofday(&before, NULL);
+
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_gen_start)(gen);
+		failure = !cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "start() #%d", i);
+		cwret = LIBCW_TEST_FUT(cw_gen_stop)(gen);
+		failure = failure || !cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "stop() #%d", i);
+
+		struct timeval after;
+		gettimeofday(&after, NULL);
+
+		/* Insertion into sorted part of array. */
+		const int duration = cw_timestamp_compare_internal(&before, &after);
+		int j = i;
+		for (; j > 0 && durations[j - 1] > duration; j--) {
+			durations[j] = durations[j - 1];
+		}
+		durations[j] = duration;
+	}
+	cw_gen_delete(&gen);
+	cte->expect_op_int(cte, false, "==", failure, "starting and stopping generator");
+
+	const int median = durations[TEST_START_STOP_N_PAIRS / 2];
+	cte->log_info(cte, "duration of start() and stop(): median %d us, max %d us\n", median, durations[TEST_START_STOP_N_PAIRS - 1]);
+	cte->expect_op_int(cte, TEST_START_STOP_MAX_MEDIAN, ">", median, "median duration of start() and stop() [us]");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
 /**
    @brief Test setting tone slope shape and duration
 
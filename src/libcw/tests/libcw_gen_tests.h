@@ -19,6 +19,7 @@ int test_cw_gen_new_delete(cw_test_executor_t * cte);
 int test_cw_gen_new_start_delete(cw_test_executor_t * cte);
 int test_cw_gen_new_stop_delete(cw_test_executor_t * cte);
 int test_cw_gen_new_start_stop_delete(cw_test_executor_t * cte);
+int test_cw_gen_start_stop_duration(cw_test_executor_t * cte);
 
 int test_cw_gen_set_tone_slope(cw_test_executor_t * cte);
 int test_cw_gen_tone_slope_shape_enums(cw_test_executor_t * cte);
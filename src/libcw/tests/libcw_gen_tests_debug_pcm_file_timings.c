@@ -188,12 +188,13 @@ static int elements_set_ideal_durations(cw_elements_t * elements, const cw_gen_d
 {
 	for (size_t i = 0; i < elements->curr_count; i++) {
 		int duration = 0;
-		if (0 != cw_element_type_to_duration(elements->array[i].type, durations, &duration)) {
+		const cw_element_type_t type = cw_elements_get_type(elements, i);
+		if (0 != cw_element_type_to_duration(type, durations, &duration)) {
 			fprintf(stderr, "[ERROR] Can't assign duration to element #%zu with type '%c'\n",
-			        i, elements->array[i].type);
+			        i, type);
 			return -1;
 		}
-		elements->array[i].timespan = (cw_element_time_t) duration;
+		cw_elements_set_timespan(elements, i, (cw_element_time_t) duration);
 	}
 
 	return 0;
@@ -348,13 +349,17 @@ static void print_test_results(FILE * file, const cw_elements_t * string_element
 	fprintf(file, "[DEBUG]  Num. | str state  type     duration | wav state     duration |\n");
 	fprintf(file, "[DEBUG] ------+------------------------------+------------------------|\n");
 	for (size_t i = 0; i < count; i++) {
+		cw_element_t string_element;
+		cw_element_t wav_element;
+		cw_elements_get_element(string_elements, i, &string_element);
+		cw_elements_get_element(wav_elements, i, &wav_element);
 		fprintf(file, "[DEBUG] %5zu | %5s     '%c' %12.2fus | %5s   %12.2fus |\n",
 		        i,
-		        string_elements->array[i].state == cw_state_mark ? "mark" : "space",
-		        cw_element_type_get_representation(string_elements->array[i].type),
-		        string_elements->array[i].timespan,
-		        wav_elements->array[i].state == cw_state_mark ? "mark" : "space",
-		        wav_elements->array[i].timespan);
+		        string_element.state == cw_state_mark ? "mark" : "space",
+		        cw_element_type_get_representation(string_element.type),
+		        string_element.timespan,
+		        wav_element.state == cw_state_mark ? "mark" : "space",
+		        wav_element.timespan);
 	}
 
 	if (0) {
@@ -401,8 +406,12 @@ static void evaluate_test_results(cw_test_executor_t * cte, const cw_elements_t
 	  cause, and then remove "-1" in the condition of the loop.
 	*/
 	for (size_t i = 0; i < string_elements->curr_count - 1; i++) {
-		const cw_element_t * string_element = &string_elements->array[i];
-		const cw_element_t * wav_element = &wav_elements->array[i];
+		cw_element_t string_element_copy;
+		cw_element_t wav_element_copy;
+		cw_elements_get_element(string_elements, i, &string_element_copy);
+		cw_elements_get_element(wav_elements, i, &wav_element_copy);
+		const cw_element_t * string_element = &string_element_copy;
+		const cw_element_t * wav_element = &wav_element_copy;
 
 		/* dot/dash states should be set correctly in both element sets. */
 		if (string_element->state != wav_element->state) {
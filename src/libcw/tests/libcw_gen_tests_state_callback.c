@@ -96,7 +96,7 @@
 typedef struct callback_data_t {
 	struct timeval prev_timestamp; /* Timestamp at which previous callback was made. */
 
-	int element_idx; /* Index to string_elements->array[]. */
+	int element_idx; /* Index of element in string_elements. */
 	cw_elements_t * string_elements;
 
 	/* Ideal durations of dots, dashes and spaces, as reported by libcw for given
@@ -217,7 +217,7 @@ static void gen_callback_fn(void * callback_arg, int state)
 	const bool execute_nonessential = true;
 
 	callback_data_t * callback_data = (callback_data_t *) callback_arg;
-	const cw_elements_t * string_elements = callback_data->string_elements;
+	cw_elements_t * string_elements = callback_data->string_elements;
 	const size_t this_idx = callback_data->element_idx;
 
 
@@ -226,7 +226,9 @@ static void gen_callback_fn(void * callback_arg, int state)
 	struct timeval prev_timestamp = callback_data->prev_timestamp;
 
 
-	cw_element_t * this_element = &string_elements->array[this_idx];
+	cw_element_t this_element_copy;
+	cw_elements_get_element(string_elements, this_idx, &this_element_copy);
+	const cw_element_t * this_element = &this_element_copy;
 	if (execute_nonessential) {
 		/* Check that state is consistent with element. */
 		if (state) {
@@ -247,7 +249,8 @@ static void gen_callback_fn(void * callback_arg, int state)
 	   All elements are already appended in there, we are just filling
 	   durations. */
 
-	cw_element_t * prev_element = NULL;
+	cw_element_t prev_element_copy;
+	const cw_element_t * prev_element = NULL;
 	if (this_idx == 0) {
 		/* Don't do anything for zero-th element, for which there is no 'prev
 		   timestamp'. */
@@ -256,8 +259,9 @@ static void gen_callback_fn(void * callback_arg, int state)
 		/* Update previous element. We are at the beginning of new element,
 		   and currently calculated duration is how long *previous* element
 		   was. */
-		prev_element = &string_elements->array[this_idx - 1];
-		prev_element->timespan = cw_timestamp_compare_internal(&prev_timestamp, &now_timestamp);
+		cw_elements_set_timespan(string_elements, this_idx - 1, cw_timestamp_compare_internal(&prev_timestamp, &now_timestamp));
+		cw_elements_get_element(string_elements, this_idx - 1, &prev_element_copy);
+		prev_element = &prev_element_copy;
 	}
 
 	if (execute_nonessential) {
@@ -420,7 +424,9 @@ static void calculate_test_results(const cw_elements_t * elements, test_data_t *
 	   correctness of values of these elements. TODO: make the elements
 	   correct. */
 	for (size_t i = 1; i < elements->curr_count - 1; i++) {
-		const cw_element_t * element = &elements->array[i];
+		cw_element_t element_copy;
+		cw_elements_get_element(elements, i, &element_copy);
+		const cw_element_t * element = &element_copy;
 		switch (element->type) {
 		case cw_element_type_dot:
 			cw_element_stats_update(&stats_dot, element->timespan);
@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 
@@ -37,7 +38,9 @@
 #include "libcw_gen.h"
 #include "libcw_key.h"
 #include "libcw_key_tests.h"
+#include "libcw_rec.h"
 #include "libcw_debug.h"
+#include "libcw_scheduler.h"
 #include "libcw_utils.h"
 #include "test_framework.h"
 
@@ -66,6 +69,7 @@ test_straight_key_data_t g_test_straight_key_data[TEST_STRAIGHT_KEY_DATA_COUNT]
 static int key_setup(cw_test_executor_t * cte, cw_key_t ** key, cw_gen_t ** gen);
 static void key_destroy(cw_key_t ** key, cw_gen_t ** gen);
 static int test_keyer_helper(cw_test_executor_t * cte, cw_key_t * key, cw_key_value_t intended_dot_paddle, cw_key_value_t intended_dash_paddle, char mark_representation, const char * marks_name, int max);
+static void test_keyer_wait_for_graph_state(const cw_key_t * key, int state_a, int state_b);
 
 
 
@@ -365,3 +369,522 @@ int test_straight_key(cw_test_executor_t * cte)
 	return 0;
 }
 
+
+
+
+/**
+   Test iambic keyer in timed mode: ends of elements are scheduled by
+   keyer, and series of Dots should take exactly as long as durations of
+   its Marks and Spaces.
+*/
+cwt_retv test_keyer_timed_mode(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return cwt_retv_err;
+	}
+
+
+	/* Test: enabling timed mode in idle keyer. */
+	{
+		cte->expect_op_int(cte, false, "==", LIBCW_TEST_FUT(cw_key_ik_get_timed_mode)(key), "timed mode is initially disabled");
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_enable_timed_mode)(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "enable timed mode in idle keyer");
+		cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_key_ik_get_timed_mode)(key), "timed mode is enabled");
+	}
+
+
+	/* Test: duration of series of Dots. */
+	{
+		const int n_dots = 10;
+		cw_gen_sync_parameters_internal(gen);
+		const int64_t expected = (int64_t) n_dots * (gen->durations->dot_duration + gen->durations->ims_duration); /* [us] */
+
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_OPEN);
+
+		/* Synchronize with beginning of second Dot. */
+		cw_key_ik_wait_for_end_of_current_element(key);
+		const int64_t start = cw_scheduler_now_internal();
+		for (int i = 0; i < n_dots; i++) {
+			cw_key_ik_wait_for_end_of_current_element(key);
+		}
+		const int64_t elapsed = cw_scheduler_now_internal() - start;
+
+		/* Test: changing mode of busy keyer. */
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_disable_timed_mode)(key);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "disable timed mode in busy keyer");
+		cte->expect_op_int(cte, EBUSY, "==", errno, "disable timed mode in busy keyer: errno");
+
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+		cw_key_ik_wait_for_keyer(key);
+
+		/* Ends of elements are calculated from ends of previous
+		   elements, so late wake-ups of waiting thread don't
+		   accumulate. */
+		const int64_t margin = expected / 10;
+		cte->expect_op_int(cte, (int) (expected - margin), "<=", (int) elapsed, "duration of %d Dots: lower bound", n_dots);
+		cte->expect_op_int(cte, (int) (expected + margin), ">=", (int) elapsed, "duration of %d Dots: upper bound", n_dots);
+	}
+
+
+	/* Test: disabling timed mode in idle keyer. */
+	{
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_disable_timed_mode)(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "disable timed mode in idle keyer");
+		cte->expect_op_int(cte, false, "==", LIBCW_TEST_FUT(cw_key_ik_get_timed_mode)(key), "timed mode is disabled");
+	}
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   Test enqueueing of next element by iambic keyer before end of
+   current element, and cancelling of the element on release of paddle
+*/
+cwt_retv test_keyer_next_element(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return cwt_retv_err;
+	}
+	/* Long elements give the test time to act during ims. */
+	cw_gen_set_speed(gen, 10);
+
+
+	/* Test: repeated element is enqueued in advance while paddle is closed. */
+	{
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_OPEN);
+		/* End of first Dot. */
+		test_keyer_wait_for_graph_state(key, KS_AFTER_DOT_A, KS_AFTER_DOT_B);
+		cte->expect_op_int(cte, KS_AFTER_DOT_A, "==", key->ik.graph_state, "keyer is in ims after Dot");
+		cte->expect_op_int(cte, CW_DOT_REPRESENTATION, "==", key->ik.next_element, "Dot is enqueued in advance");
+		cte->expect_op_int(cte, 2, "<=", (int) cw_gen_get_queue_length(gen), "queue holds element enqueued in advance");
+	}
+
+
+	/* Test: element enqueued in advance is cancelled when paddle is released during ims. */
+	{
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+		const cw_ret_t cwret = cw_key_ik_wait_for_keyer(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "wait for keyer after release of paddle");
+		cte->expect_op_int(cte, 0, "==", key->ik.next_element, "no element is enqueued in advance in idle keyer");
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "cancelled element is removed from queue");
+	}
+
+
+	/* Test: opposite element is enqueued in advance when its paddle has been pressed. */
+	{
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_CLOSED);
+		/* End of first Dot, Dash is certain. */
+		test_keyer_wait_for_graph_state(key, KS_AFTER_DOT_A, KS_AFTER_DOT_B);
+		cte->expect_op_int(cte, KS_AFTER_DOT_A, "==", key->ik.graph_state, "keyer is in ims after Dot");
+		cte->expect_op_int(cte, CW_DASH_REPRESENTATION, "==", key->ik.next_element, "Dash is enqueued in advance");
+
+		cw_key_ik_notify_paddle_event(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+		/* Latch of dash paddle keeps the Dash. */
+		test_keyer_wait_for_graph_state(key, KS_IN_DASH_A, KS_IDLE);
+		cte->expect_op_int(cte, KS_IN_DASH_A, "==", key->ik.graph_state, "Dash enqueued in advance is keyed");
+		cw_key_ik_wait_for_keyer(key);
+		cte->expect_op_int(cte, 0, "==", (int) cw_gen_get_queue_length(gen), "queue is empty after last element");
+	}
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   Wait until iambic keyer enters one of two graph states
+
+   @param[in] key iambic key
+   @param[in] state_a first graph state
+   @param[in] state_b second graph state
+*/
+static void test_keyer_wait_for_graph_state(const cw_key_t * key, int state_a, int state_b)
+{
+	/* Long enough for a few elements at 10 WPM. */
+	for (int i = 0; i < 2000; i++) {
+		const int state = key->ik.graph_state;
+		if (state_a == state || state_b == state) {
+			return;
+		}
+		cw_usleep_internal(1000);
+	}
+	return;
+}
+
+
+
+
+/**
+   Test passing of paddle events to iambic keyer through keyer thread
+*/
+cwt_retv test_keyer_paddle_events(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return cwt_retv_err;
+	}
+
+
+	/* Test: posting event without keyer thread. */
+	{
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_post_paddle_event)(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_OPEN);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "post paddle event without keyer thread");
+		cte->expect_op_int(cte, ENODEV, "==", errno, "post paddle event without keyer thread: errno");
+	}
+
+
+	/* Test: starting keyer thread. */
+	{
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_start_paddle_events)(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "start keyer thread");
+
+		cwret = LIBCW_TEST_FUT(cw_key_ik_start_paddle_events)(key);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "start keyer thread again");
+		cte->expect_op_int(cte, EALREADY, "==", errno, "start keyer thread again: errno");
+	}
+
+
+	/* Test: keying Dashes with posted events. */
+	{
+		const int n_dashes = 3;
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_post_paddle_event)(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_CLOSED);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "post paddle event: dash paddle closed");
+
+		/* Event becomes visible to keyer in keyer thread. */
+		while (!cw_key_ik_is_busy_internal(key)) {
+			cw_usleep_internal(1000);
+		}
+		for (int i = 0; i < n_dashes; i++) {
+			cw_key_ik_wait_for_end_of_current_element(key);
+		}
+
+		cw_key_value_t dot_paddle_value = CW_KEY_VALUE_CLOSED;
+		cw_key_value_t dash_paddle_value = CW_KEY_VALUE_OPEN;
+		cw_key_ik_get_paddles(key, &dot_paddle_value, &dash_paddle_value);
+		cte->expect_op_int(cte, CW_KEY_VALUE_OPEN, "==", dot_paddle_value, "dot paddle value from posted event");
+		cte->expect_op_int(cte, CW_KEY_VALUE_CLOSED, "==", dash_paddle_value, "dash paddle value from posted event");
+
+		cwret = LIBCW_TEST_FUT(cw_key_ik_post_paddle_event)(key, CW_KEY_VALUE_OPEN, CW_KEY_VALUE_OPEN);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "post paddle event: paddles open");
+		do {
+			cw_usleep_internal(1000);
+			cw_key_ik_get_paddles(key, &dot_paddle_value, &dash_paddle_value);
+		} while (CW_KEY_VALUE_CLOSED == dash_paddle_value);
+
+		cwret = cw_key_ik_wait_for_keyer(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "wait for keyer after posted events");
+	}
+
+
+	/* Test: stopping keyer thread. */
+	{
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_key_ik_stop_paddle_events)(key);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "stop keyer thread");
+
+		cwret = LIBCW_TEST_FUT(cw_key_ik_post_paddle_event)(key, CW_KEY_VALUE_CLOSED, CW_KEY_VALUE_OPEN);
+		cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "post paddle event after stopping keyer thread");
+	}
+
+	key_destroy(&key, &gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   Test validation of configuration of key input, and handling of
+   devices of wrong type
+*/
+cwt_retv test_key_input_new(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = cw_key_new();
+	if (NULL == key) {
+		cte->log_error(cte, "Can't create key, stopping the test\n");
+		return cwt_retv_err;
+	}
+
+	cw_key_input_config_t config;
+	memset(&config, 0, sizeof (config));
+	config.type = CW_KEY_INPUT_EVDEV;
+	snprintf(config.device, sizeof (config.device), "%s", "/dev/null");
+	config.is_iambic = true;
+	config.dot_line = 29;
+	config.dash_line = 97;
+
+
+	/* Test: NULL arguments. */
+	{
+		cw_key_input_t * input = LIBCW_TEST_FUT(cw_key_input_new)(NULL, &config);
+		cte->expect_null_pointer(cte, input, "new input: NULL key");
+		input = LIBCW_TEST_FUT(cw_key_input_new)(key, NULL);
+		cte->expect_null_pointer(cte, input, "new input: NULL config");
+	}
+
+
+	/* Test: invalid configurations. */
+	{
+		cw_key_input_config_t invalid = config;
+		invalid.device[0] = '\0';
+		cw_key_input_t * input = LIBCW_TEST_FUT(cw_key_input_new)(key, &invalid);
+		cte->expect_null_pointer(cte, input, "new input: empty device name");
+
+		invalid = config;
+		invalid.dash_line = invalid.dot_line;
+		input = LIBCW_TEST_FUT(cw_key_input_new)(key, &invalid);
+		cte->expect_null_pointer(cte, input, "new input: the same line for both paddles");
+		cte->expect_op_int(cte, EINVAL, "==", errno, "new input: the same line for both paddles: errno");
+	}
+
+
+#if defined(__linux__)
+	/* Test: devices that don't exist or are of wrong type. */
+	{
+		const cw_key_input_type_t types[] = { CW_KEY_INPUT_EVDEV, CW_KEY_INPUT_GPIO, CW_KEY_INPUT_SERIAL };
+		for (size_t i = 0; i < sizeof (types) / sizeof (types[0]); i++) {
+			cw_key_input_config_t wrong = config;
+			wrong.type = types[i];
+
+			snprintf(wrong.device, sizeof (wrong.device), "%s", "/dev/nonexistent-key-input");
+			cw_key_input_t * input = LIBCW_TEST_FUT(cw_key_input_new)(key, &wrong);
+			cte->expect_null_pointer(cte, input, "new input of type %d: nonexistent device", types[i]);
+			cte->expect_op_int(cte, ENOENT, "==", errno, "new input of type %d: nonexistent device: errno", types[i]);
+
+			snprintf(wrong.device, sizeof (wrong.device), "%s", "/dev/null");
+			input = LIBCW_TEST_FUT(cw_key_input_new)(key, &wrong);
+			cte->expect_null_pointer(cte, input, "new input of type %d: device of wrong type", types[i]);
+		}
+	}
+#endif
+
+
+	/* Test: deleting NULL input. */
+	{
+		cw_key_input_t * input = NULL;
+		LIBCW_TEST_FUT(cw_key_input_delete)(&input);
+		cte->expect_null_pointer(cte, input, "delete NULL input");
+	}
+
+	cw_key_delete(&key);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   Test passing changes of straight key directly to receiver: a
+   character keyed with straight key is received without generator's
+   value tracking callback.
+*/
+cwt_retv test_straight_key_direct_receiving(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * key = NULL;
+	cw_gen_t * gen = NULL;
+	if (0 != key_setup(cte, &key, &gen)) {
+		return cwt_retv_err;
+	}
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == rec) {
+		cte->log_error(cte, "Can't create receiver, stopping the test\n");
+		key_destroy(&key, &gen);
+		return cwt_retv_err;
+	}
+	cw_rec_set_speed(rec, 20);
+	cw_key_register_receiver(key, rec);
+
+	cte->expect_op_int(cte, false, "==", LIBCW_TEST_FUT(cw_key_sk_get_direct_receiving)(key), "direct receiving is initially disabled");
+	LIBCW_TEST_FUT(cw_key_sk_enable_direct_receiving)(key);
+	cte->expect_op_int(cte, true, "==", LIBCW_TEST_FUT(cw_key_sk_get_direct_receiving)(key), "direct receiving is enabled");
+
+
+	/* Test: keying 'A' (".-") at 20 WPM. */
+	{
+		const int unit = CW_DOT_CALIBRATION / 20; /* [us] */
+		const char * representation = ".-";
+		for (const char * mark = representation; '\0' != *mark; mark++) {
+			cw_key_sk_set_value(key, CW_KEY_VALUE_CLOSED);
+			cw_usleep_internal(CW_DOT_REPRESENTATION == *mark ? unit : 3 * unit);
+			cw_key_sk_set_value(key, CW_KEY_VALUE_OPEN);
+			cw_usleep_internal(unit);
+		}
+		/* Let the space grow into inter-character-space. */
+		cw_usleep_internal(3 * unit);
+
+		char character = '\0';
+		bool is_end_of_word = false;
+		bool is_error = false;
+		const cw_ret_t cwret = cw_rec_poll_character(rec, NULL, &character, &is_end_of_word, &is_error);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "poll character keyed with straight key");
+		cte->expect_op_int(cte, 'A', "==", character, "character keyed with straight key");
+	}
+
+	LIBCW_TEST_FUT(cw_key_sk_disable_direct_receiving)(key);
+	cte->expect_op_int(cte, false, "==", LIBCW_TEST_FUT(cw_key_sk_get_direct_receiving)(key), "direct receiving is disabled");
+
+	key_destroy(&key, &gen);
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/* Changes of value of key recorded by key's value callback. */
+typedef struct {
+	cw_key_value_t values[16];
+	int64_t timestamps[16];
+	int n;
+} test_netkey_changes_t;
+
+
+
+
+static void test_netkey_value_callback(void * callback_arg, cw_key_value_t key_value, int64_t timestamp)
+{
+	test_netkey_changes_t * changes = (test_netkey_changes_t *) callback_arg;
+	if (changes->n < 16) {
+		changes->values[changes->n] = key_value;
+		changes->timestamps[changes->n] = timestamp;
+		changes->n++;
+	}
+}
+
+
+
+
+/**
+   Test keying of remote key over UDP: a character keyed with local
+   straight key is received by receiver of remote key, with durations
+   of Marks and Spaces preserved.
+*/
+cwt_retv test_netkey(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_key_t * local_key = NULL;
+	cw_gen_t * local_gen = NULL;
+	if (0 != key_setup(cte, &local_key, &local_gen)) {
+		return cwt_retv_err;
+	}
+	cw_key_t * remote_key = NULL;
+	cw_gen_t * remote_gen = NULL;
+	if (0 != key_setup(cte, &remote_key, &remote_gen)) {
+		key_destroy(&local_key, &local_gen);
+		return cwt_retv_err;
+	}
+	cw_rec_t * rec = cw_rec_new();
+	cw_rec_set_speed(rec, 20);
+	cw_key_register_receiver(remote_key, rec);
+	cw_key_sk_enable_direct_receiving(remote_key);
+	test_netkey_changes_t changes = { .n = 0 };
+	LIBCW_TEST_FUT(cw_key_register_value_callback)(remote_key, test_netkey_value_callback, &changes);
+
+
+	/* Test: invalid arguments. */
+	{
+		errno = 0;
+		cw_netkey_receiver_t * receiver = LIBCW_TEST_FUT(cw_netkey_receiver_new)(remote_key, 0, 2 * CW_USECS_PER_SEC);
+		cte->expect_op_int(cte, true, "==", NULL == receiver && EINVAL == errno, "new receiver: too long delay");
+		errno = 0;
+		cw_netkey_sender_t * sender = LIBCW_TEST_FUT(cw_netkey_sender_new)(local_key, "127.0.0.1", 0);
+		cte->expect_op_int(cte, true, "==", NULL == sender && EINVAL == errno, "new sender: invalid port");
+	}
+
+
+	cw_netkey_receiver_t * receiver = LIBCW_TEST_FUT(cw_netkey_receiver_new)(remote_key, 0, 20000);
+	cte->assert2(cte, NULL != receiver, "failed to create receiver, errno = %d", errno);
+	const int port = LIBCW_TEST_FUT(cw_netkey_receiver_get_port)(receiver);
+	cw_netkey_sender_t * sender = LIBCW_TEST_FUT(cw_netkey_sender_new)(local_key, "127.0.0.1", port);
+	cte->assert2(cte, NULL != sender, "failed to create sender, errno = %d", errno);
+	/* Let receiver get first packet of the session. */
+	cw_usleep_internal(2 * 100 * 1000);
+
+
+	/* Test: keying 'N' ("-.") at 20 WPM. */
+	{
+		const int unit = CW_DOT_CALIBRATION / 20; /* [us] */
+		const char * representation = "-.";
+		for (const char * mark = representation; '\0' != *mark; mark++) {
+			cw_key_sk_set_value(local_key, CW_KEY_VALUE_CLOSED);
+			cw_usleep_internal(CW_DOT_REPRESENTATION == *mark ? unit : 3 * unit);
+			cw_key_sk_set_value(local_key, CW_KEY_VALUE_OPEN);
+			cw_usleep_internal(unit);
+		}
+		/* Let the space grow into inter-character-space. */
+		cw_usleep_internal(4 * unit);
+
+		char character = '\0';
+		bool is_end_of_word = false;
+		bool is_error = false;
+		const cw_ret_t cwret = cw_rec_poll_character(rec, NULL, &character, &is_end_of_word, &is_error);
+		cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && 'N' == character, "character keyed on remote key: '%c'", character);
+
+		cte->expect_op_int(cte, 4, "==", changes.n, "count of changes of remote key");
+		if (4 == changes.n) {
+			const int dash = (int) (changes.timestamps[1] - changes.timestamps[0]);
+			const int dot = (int) (changes.timestamps[3] - changes.timestamps[2]);
+			const bool durations_valid = abs(dash - 3 * unit) < unit / 5 && abs(dot - unit) < unit / 5;
+			cte->expect_op_int(cte, true, "==", durations_valid, "durations of Marks on remote key: %d/%d", dash, dot);
+		}
+	}
+
+
+	/* Test: statistics. */
+	{
+		cw_netkey_statistics_t statistics;
+		const cw_ret_t cwret = LIBCW_TEST_FUT(cw_netkey_receiver_get_statistics)(receiver, &statistics);
+		cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && statistics.n_packets >= 4 && 0 == statistics.n_lost,
+				   "statistics of receiver: %u packets, %u lost", statistics.n_packets, statistics.n_lost);
+	}
+
+	LIBCW_TEST_FUT(cw_netkey_sender_delete)(&sender);
+	cte->expect_null_pointer(cte, sender, "delete sender");
+	LIBCW_TEST_FUT(cw_netkey_receiver_delete)(&receiver);
+	cte->expect_null_pointer(cte, receiver, "delete receiver");
+
+	cw_key_register_value_callback(remote_key, NULL, NULL);
+	key_destroy(&remote_key, &remote_gen);
+	key_destroy(&local_key, &local_gen);
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
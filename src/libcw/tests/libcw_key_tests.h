@@ -16,6 +16,12 @@
 
 int test_keyer(cw_test_executor_t * cte);
 int test_straight_key(cw_test_executor_t * cte);
+cwt_retv test_keyer_timed_mode(cw_test_executor_t * cte);
+cwt_retv test_keyer_next_element(cw_test_executor_t * cte);
+cwt_retv test_keyer_paddle_events(cw_test_executor_t * cte);
+cwt_retv test_key_input_new(cw_test_executor_t * cte);
+cwt_retv test_straight_key_direct_receiving(cw_test_executor_t * cte);
+cwt_retv test_netkey(cw_test_executor_t * cte);
 
 
 
@@ -33,6 +33,7 @@
 #include <errno.h>
 
 #include <assert.h>
+#include <pthread.h>
 
 #if defined(HAVE_STRING_H)
 # include <string.h>
@@ -51,6 +52,7 @@
 #include "libcw_tq.h"
 #include "libcw_utils.h"
 #include "libcw_gen.h"
+#include "libcw_signal.h"
 #include "libcw_legacy_api_tests.h"
 #include "libcw_key_tests.h"
 
@@ -79,6 +81,8 @@ extern volatile cw_key_t cw_key;
 
 
 static void test_helper_tq_callback(void * ptr);
+static void * test_helper_context_thread(void * arg);
+static void test_helper_context_timer_handler(void);
 
 /* Helper function for iambic key tests. */
 static void legacy_api_test_iambic_key_paddles_common(cw_test_executor_t * cte, int intended_dot_paddle, int intended_dash_paddle, char character, int n_elements);
@@ -1646,3 +1650,196 @@ cwt_retv legacy_api_test_gen_remove_last_character(cw_test_executor_t * cte)
 	return cwt_retv_ok;
 }
 
+
+
+
+/* Data of a thread using legacy API with its own context. */
+typedef struct {
+	cw_gen_config_t gen_conf;
+	int send_speed;           /* Send speed set by the thread. */
+	int receive_speed;        /* Receive speed set by the thread. */
+	bool context_created;
+	bool generator_created;
+	int send_speed_read;      /* Send speed read back after sending. */
+	int receive_speed_read;   /* Receive speed read back after sending. */
+	int send_cwret;
+} test_context_thread_data_t;
+
+
+
+
+/**
+   @brief Test that threads with their own contexts don't share objects of legacy API
+
+   Two threads, each with its own context, set different parameters of
+   their generators and receivers, and send a short string. Parameters
+   read back by each thread should be the ones set by the thread, and
+   parameters of global objects should not change.
+*/
+int legacy_api_test_contexts(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+	legacy_api_standalone_test_setup(cte, true);
+
+	cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_context_get_current)(), "no context is current in main thread");
+
+	const int global_send_speed = cw_get_send_speed();
+	const int global_receive_speed = cw_get_receive_speed();
+
+	test_context_thread_data_t data[2] = {
+		{ .send_speed = CW_SPEED_MIN + 5, .receive_speed = CW_SPEED_MAX - 5 },
+		{ .send_speed = CW_SPEED_MAX - 10, .receive_speed = CW_SPEED_MIN + 10 },
+	};
+	pthread_t threads[2];
+	for (int i = 0; i < 2; i++) {
+		data[i].gen_conf = cte->current_gen_conf;
+		pthread_create(&threads[i], NULL, test_helper_context_thread, &data[i]);
+	}
+	for (int i = 0; i < 2; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		cte->expect_op_int(cte, true, "==", data[i].context_created, "thread %d: context created", i);
+		cte->expect_op_int(cte, true, "==", data[i].generator_created, "thread %d: generator created", i);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", data[i].send_cwret, "thread %d: sending string", i);
+		cte->expect_op_int(cte, data[i].send_speed, "==", data[i].send_speed_read, "thread %d: send speed", i);
+		cte->expect_op_int(cte, data[i].receive_speed, "==", data[i].receive_speed_read, "thread %d: receive speed", i);
+	}
+
+	cte->expect_op_int(cte, global_send_speed, "==", cw_get_send_speed(), "send speed of global generator");
+	cte->expect_op_int(cte, global_receive_speed, "==", cw_get_receive_speed(), "receive speed of global receiver");
+
+	legacy_api_standalone_test_teardown(cte);
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Thread function using legacy API with its own context
+
+   @param arg pointer to test_context_thread_data_t
+
+   @return NULL
+*/
+static void * test_helper_context_thread(void * arg)
+{
+	test_context_thread_data_t * data = (test_context_thread_data_t *) arg;
+
+	cw_context_t * context = LIBCW_TEST_FUT(cw_context_new)();
+	data->context_created = NULL != context;
+	if (NULL == context) {
+		return NULL;
+	}
+	LIBCW_TEST_FUT(cw_context_make_current)(context);
+
+	data->generator_created = CW_SUCCESS == cw_generator_new(data->gen_conf.sound_system, data->gen_conf.sound_device);
+	if (data->generator_created) {
+		cw_set_send_speed(data->send_speed);
+		cw_set_receive_speed(data->receive_speed);
+		cw_generator_start();
+		data->send_cwret = cw_send_string("e");
+		cw_wait_for_tone_queue();
+		data->send_speed_read = cw_get_send_speed();
+		data->receive_speed_read = cw_get_receive_speed();
+		cw_generator_stop();
+	}
+
+	LIBCW_TEST_FUT(cw_context_make_current)(NULL);
+	LIBCW_TEST_FUT(cw_context_delete)(&context);
+
+	return NULL;
+}
+
+
+
+
+/* Calls of timer handler registered by legacy_api_test_context_timers(). */
+static struct {
+	pthread_mutex_t mutex;
+	bool armed;
+	int n_calls;
+	cw_context_t * contexts[4];  /* Contexts current during calls. */
+	pthread_t threads[4];        /* Threads making the calls. */
+} test_context_timer_calls = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+
+
+
+/**
+   @brief Test that timeouts of contexts are served without SIGALRM, with the context made current
+
+   Each of two contexts requests a timeout. The registered timer handler
+   should be called once per context, with the context being current,
+   in a thread other than the one that requested the timeouts.
+*/
+int legacy_api_test_context_timers(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+#if defined(LIBCW_WITH_SIGALRM_TIMERS)
+	cte->log_info(cte, "library uses SIGALRM timers, skipping the test\n");
+#else
+	struct sigaction disposition_before;
+	sigaction(SIGALRM, NULL, &disposition_before);
+
+	cw_context_t * contexts[2] = { cw_context_new(), cw_context_new() };
+	cte->assert2(cte, NULL != contexts[0] && NULL != contexts[1], "failed to create contexts");
+
+	pthread_mutex_lock(&test_context_timer_calls.mutex);
+	test_context_timer_calls.armed = true;
+	test_context_timer_calls.n_calls = 0;
+	pthread_mutex_unlock(&test_context_timer_calls.mutex);
+
+	for (int i = 0; i < 2; i++) {
+		cw_context_make_current(contexts[i]);
+		const int cwret = LIBCW_TEST_FUT(cw_timer_run_with_handler_internal)(20 * 1000 * (i + 1), test_helper_context_timer_handler);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "requesting timeout of context %d", i);
+	}
+	cw_context_make_current(NULL);
+
+	usleep(150 * 1000);
+
+	pthread_mutex_lock(&test_context_timer_calls.mutex);
+	test_context_timer_calls.armed = false;
+	pthread_mutex_unlock(&test_context_timer_calls.mutex);
+
+	cte->expect_op_int(cte, 2, "==", test_context_timer_calls.n_calls, "count of calls of handler");
+	for (int i = 0; i < 2 && i < test_context_timer_calls.n_calls; i++) {
+		cte->expect_op_int(cte, true, "==", contexts[i] == test_context_timer_calls.contexts[i], "context current in call %d", i);
+		cte->expect_op_int(cte, false, "==", pthread_equal(pthread_self(), test_context_timer_calls.threads[i]), "thread of call %d", i);
+	}
+
+	struct sigaction disposition_after;
+	sigaction(SIGALRM, NULL, &disposition_after);
+	cte->expect_op_int(cte, true, "==", disposition_before.sa_handler == disposition_after.sa_handler, "disposition of SIGALRM");
+
+	cw_context_delete(&contexts[0]);
+	cw_context_delete(&contexts[1]);
+#endif
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   @brief Timer handler recording context current during the call
+*/
+static void test_helper_context_timer_handler(void)
+{
+	pthread_mutex_lock(&test_context_timer_calls.mutex);
+	if (test_context_timer_calls.armed && test_context_timer_calls.n_calls < 4) {
+		test_context_timer_calls.contexts[test_context_timer_calls.n_calls] = cw_context_get_current();
+		test_context_timer_calls.threads[test_context_timer_calls.n_calls] = pthread_self();
+		test_context_timer_calls.n_calls++;
+	}
+	pthread_mutex_unlock(&test_context_timer_calls.mutex);
+}
@@ -27,19 +27,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
 
 
 
 
+#include <cwutils/cw_rec_tester.h>
 #include <cwutils/lib/random.h>
 
 #include "libcw.h"
 #include "libcw2.h"
 
+#include "libcw_data.h"
 #include "libcw_debug.h"
 #include "libcw_key.h"
 #include "libcw_rec.h"
 #include "libcw_rec_internal.h"
+#include "libcw_skimmer.h"
 #include "libcw_rec_tests.h"
 #include "libcw_tq.h"
 #include "libcw_utils.h"
@@ -130,6 +135,7 @@ static void cw_rec_test_vector_delete(cw_rec_test_vector ** vec);
 static cw_rec_test_vector * cw_rec_test_vector_factory(cw_test_executor_t * cte, characters_list_maker_t characters_list_maker, send_speeds_maker_t send_speeds_maker, const cw_variation_params * variation_params);
 __attribute__((unused)) static void cw_rec_test_vector_print(cw_test_executor_t * cte, cw_rec_test_vector * vec);
 static bool test_cw_rec_test_begin_end(cw_test_executor_t * cte, cw_rec_t * rec, cw_rec_test_vector * vec);
+static void test_rec_metrics_write(void * callback_arg, const char * text, size_t length);
 
 
 
@@ -1574,3 +1580,1566 @@ int test_cw_rec_parameter_getters_setters_2(cw_test_executor_t * cte)
 
 	return 0;
 }
+
+
+
+
+/**
+   Receive characters on timelines given as integer microseconds: one
+   starting at zero (like a timeline counted in samples of sound), and
+   one far beyond range of timestamps that fit into 32-bit time_t.
+*/
+int test_cw_rec_mark_begin_usecs(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * input = "PARIS";
+	const int speed = 20;
+	const int64_t unit = 1200000 / speed; /* Duration of dot [us]. */
+	const int64_t origins[] = { 0, 10000000000000000LL };
+
+	for (size_t o = 0; o < sizeof (origins) / sizeof (origins[0]); o++) {
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cw_rec_set_speed(rec, speed);
+		cw_rec_disable_adaptive_mode(rec);
+
+		char received[16] = { 0 };
+		size_t n_received = 0;
+		bool failure = false;
+		int64_t now = origins[o];
+		for (const char * c = input; '\0' != *c; c++) {
+			char * representation = cw_character_to_representation(*c);
+			cte->assert2(cte, NULL != representation, "failed to look up '%c'", *c);
+			for (const char * mark = representation; '\0' != *mark; mark++) {
+				if (CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_begin_usecs)(rec, now)) {
+					failure = true;
+				}
+				now += (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * unit;
+				if (CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_mark_end_usecs)(rec, now)) {
+					failure = true;
+				}
+				now += unit;
+			}
+			free(representation);
+
+			/* Inter-character-space. */
+			now += 2 * unit;
+			char character = 0;
+			bool is_end_of_word = false;
+			bool is_error = false;
+			if (CW_SUCCESS == LIBCW_TEST_FUT(cw_rec_poll_character_usecs)(rec, now, &character, &is_end_of_word, &is_error)) {
+				received[n_received++] = character;
+			} else {
+				failure = true;
+			}
+			cw_rec_reset_state(rec);
+		}
+		cte->expect_op_int(cte, false, "==", failure, "receiving on timeline starting at %lld", (long long) origins[o]);
+		cte->expect_strcasecmp(cte, input, received, "received text");
+
+		cw_rec_delete(&rec);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Compare running totals of receiver's statistics with statistics
+   calculated from contents of statistics buffer, also after the
+   buffer wraps around.
+*/
+int test_cw_rec_get_statistics(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, 20);
+	cw_rec_disable_adaptive_mode(rec);
+
+	cw_rec_statistics_t statistics;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_get_statistics)(rec, NULL), "NULL statistics");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_get_statistics)(rec, &statistics), "statistics of new receiver");
+	cte->expect_op_int(cte, 0, "==", statistics.dot.count, "count of Dots of new receiver");
+
+	const stat_type_t types[] = { CW_REC_STAT_DOT, CW_REC_STAT_DASH, CW_REC_STAT_INTER_MARK_SPACE, CW_REC_STAT_INTER_CHARACTER_SPACE };
+	const int n_records = 3 * CW_REC_DURATION_STATS_CAPACITY + 17;
+	unsigned int seed = 1;
+	bool count_failure = false;
+	bool sd_failure = false;
+	bool mean_failure = false;
+	for (int r = 0; r < n_records; r++) {
+		seed = seed * 1103515245U + 12345U;
+		const stat_type_t type = types[(seed >> 16) % 4];
+		seed = seed * 1103515245U + 12345U;
+		const int duration = 40000 + (int) ((seed >> 16) % 20000U);
+		LIBCW_TEST_FUT(cw_rec_duration_stats_update_internal)(rec, type, duration);
+
+		LIBCW_TEST_FUT(cw_rec_get_statistics)(rec, &statistics);
+		const cw_rec_duration_statistics_t * results[] = { &statistics.dot, &statistics.dash, &statistics.inter_mark_space, &statistics.inter_character_space };
+		for (size_t t = 0; t < sizeof (types) / sizeof (types[0]); t++) {
+			double sum = 0.0;
+			double sum_of_squares = 0.0;
+			int count = 0;
+			for (int i = 0; i < CW_REC_DURATION_STATS_CAPACITY; i++) {
+				if (rec->duration_stats[i].type == types[t]) {
+					sum += rec->duration_stats[i].duration_delta;
+					sum_of_squares += (double) rec->duration_stats[i].duration_delta * rec->duration_stats[i].duration_delta;
+					count++;
+				}
+			}
+			if (count != results[t]->count) {
+				count_failure = true;
+			}
+			if (count > 0) {
+				if (fabs(sqrt(sum_of_squares / count) - (double) results[t]->sd) > 1.0) {
+					sd_failure = true;
+				}
+				if (fabs(sum / count - (double) results[t]->mean_delta) > 1.0) {
+					mean_failure = true;
+				}
+			}
+		}
+	}
+	cte->expect_op_int(cte, false, "==", count_failure, "counts");
+	cte->expect_op_int(cte, false, "==", sd_failure, "root mean squares of deltas");
+	cte->expect_op_int(cte, false, "==", mean_failure, "means of deltas");
+
+	cw_rec_reset_statistics(rec);
+	LIBCW_TEST_FUT(cw_rec_get_statistics)(rec, &statistics);
+	const int total = statistics.dot.count + statistics.dash.count + statistics.inter_mark_space.count + statistics.inter_character_space.count;
+	cte->expect_op_int(cte, 0, "==", total, "count of records after reset");
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Append exported metrics to NUL-terminated text in 4096-byte buffer. */
+static void test_rec_metrics_write(void * callback_arg, const char * text, size_t length)
+{
+	char * buffer = (char *) callback_arg;
+	const size_t used = strlen(buffer);
+	if (used + length < 4096) {
+		memcpy(buffer + used, text, length);
+		buffer[used + length] = '\0';
+	}
+}
+
+
+
+
+/**
+   Count events of receiver in its metrics.
+*/
+int test_cw_rec_get_metrics(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, 20);
+	cw_rec_disable_adaptive_mode(rec);
+
+	cw_rec_metrics_t metrics;
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_get_metrics)(NULL, &metrics), "NULL receiver");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_get_metrics)(rec, NULL), "NULL metrics");
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_get_metrics)(rec, &metrics), "metrics of new receiver");
+	cte->expect_op_int(cte, 0, "==", (int) metrics.n_marks_accepted, "Marks accepted by new receiver");
+
+	/* At 20 WPM Dot is 60 ms long. */
+	const int dot = 60000;
+	int64_t t = 1000000;
+	char character = 0;
+
+	/* Noise spike. */
+	cw_rec_mark_begin_usecs(rec, t);
+	cw_rec_mark_end_usecs(rec, t + 1000);
+	t += 10 * dot;
+
+	/* 'E', polled after a regular inter-character-space. */
+	cw_rec_mark_begin_usecs(rec, t);
+	cw_rec_mark_end_usecs(rec, t + dot);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cw_rec_poll_character_usecs(rec, t + 4 * dot, &character, NULL, NULL), "polling 'E'");
+	cte->expect_op_int(cte, 'E', "==", character, "received character");
+	/* Polling the same character again doesn't count it again. */
+	cw_rec_poll_character_usecs(rec, t + 5 * dot, &character, NULL, NULL);
+	cw_rec_reset_state(rec);
+	t += 10 * dot;
+
+	/* Representation that isn't a character. */
+	for (int i = 0; i < 7; i++) {
+		cw_rec_mark_begin_usecs(rec, t);
+		cw_rec_mark_end_usecs(rec, t + 3 * dot);
+		t += 4 * dot;
+	}
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_rec_poll_character_usecs(rec, t + 2 * dot, &character, NULL, NULL), "polling unknown character");
+	cw_rec_poll_character_usecs(rec, t + 10 * dot, &character, NULL, NULL);
+	cw_rec_reset_state(rec);
+	t += 10 * dot;
+
+	/* Mark that is too long to be a Dash in fixed speed mode. */
+	cw_rec_mark_begin_usecs(rec, t);
+	errno = 0;
+	cte->expect_op_int(cte, CW_FAILURE, "==", cw_rec_mark_end_usecs(rec, t + 20 * dot), "ending too long Mark");
+	cw_rec_reset_state(rec);
+	t += 30 * dot;
+
+	/* Overflow of representation buffer. */
+	cw_ret_t cwret = CW_SUCCESS;
+	int n_added = 0;
+	while (CW_SUCCESS == cwret && n_added < 2 * CW_REC_REPRESENTATION_CAPACITY) {
+		cwret = cw_rec_add_mark_usecs(rec, t, CW_DOT_REPRESENTATION);
+		n_added++;
+		t += 2 * dot;
+	}
+	cte->expect_op_int(cte, ENOMEM, "==", errno, "errno after overflow of representation buffer");
+	cw_rec_reset_state(rec);
+
+	LIBCW_TEST_FUT(cw_rec_get_metrics)(rec, &metrics);
+	cte->expect_op_int(cte, 1, "==", (int) metrics.n_spikes_rejected, "spikes rejected");
+	cte->expect_op_int(cte, 1 + 7 + n_added, "==", (int) metrics.n_marks_accepted, "Marks accepted");
+	cte->expect_op_int(cte, 1, "==", (int) metrics.n_marks_unrecognized, "Marks unrecognized");
+	cte->expect_op_int(cte, 1, "==", (int) metrics.n_representations_unrecognized, "representations unrecognized");
+	cte->expect_op_int(cte, 1, "==", (int) metrics.n_buffer_overflows, "buffer overflows");
+	cte->expect_op_int(cte, 0, "==", (int) metrics.n_speed_changes, "speed changes in fixed speed mode");
+	cte->expect_op_int(cte, 2, "==", (int) metrics.n_characters, "characters");
+	/* Latency of 3 Dots (180 ms) falls into bin 100-200 ms. */
+	cte->expect_op_int(cte, 2, "==", (int) metrics.decode_latency[3], "decode latency 100-200 ms");
+
+	/* Receiver adapts to faster keying. */
+	cw_rec_enable_adaptive_mode(rec);
+	const int fast_dot = 30000;
+	for (int i = 0; i < 20; i++) {
+		const int mark_duration = (i % 2) ? 3 * fast_dot : fast_dot;
+		cw_rec_mark_begin_usecs(rec, t);
+		cw_rec_mark_end_usecs(rec, t + mark_duration);
+		t += mark_duration + fast_dot;
+	}
+	LIBCW_TEST_FUT(cw_rec_get_metrics)(rec, &metrics);
+	cte->expect_op_int(cte, 0, "<", (int) metrics.n_speed_changes, "speed changes in adaptive mode");
+
+	/* The same metrics in OpenMetrics text format. */
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_export_metrics)(NULL, NULL, test_rec_metrics_write, NULL), "exporting metrics of NULL receiver");
+	cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_export_metrics)(rec, NULL, NULL, NULL), "exporting metrics to NULL callback");
+	char text[4096] = { 0 };
+	cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_export_metrics)(rec, "receiver=\"a\"", test_rec_metrics_write, text), "exporting metrics");
+	const char * expected_lines[] = {
+		"# TYPE cw_rec_characters counter\n",
+		"\ncw_rec_characters_total{receiver=\"a\"} 2\n",
+		"\ncw_rec_spikes_rejected_total{receiver=\"a\"} 1\n",
+		"# TYPE cw_rec_decode_latency_seconds histogram\n",
+		"\ncw_rec_decode_latency_seconds_bucket{receiver=\"a\",le=\"0.1\"} 0\n",
+		"\ncw_rec_decode_latency_seconds_bucket{receiver=\"a\",le=\"0.2\"} 2\n",
+		"\ncw_rec_decode_latency_seconds_bucket{receiver=\"a\",le=\"+Inf\"} 2\n",
+		"\ncw_rec_decode_latency_seconds_count{receiver=\"a\"} 2\n",
+	};
+	for (size_t i = 0; i < sizeof (expected_lines) / sizeof (expected_lines[0]); i++) {
+		cte->expect_op_int(cte, true, "==", NULL != strstr(text, expected_lines[i]), "exported line %zu", i);
+	}
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Track speed of keying with one distorted Dot, using different
+   estimators of durations of Marks.
+*/
+int test_cw_rec_set_averaging(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	{
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_set_averaging)(rec, CW_REC_AVERAGING_MEDIAN, 0), "window too short");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_set_averaging)(rec, CW_REC_AVERAGING_MEDIAN, CW_REC_AVERAGING_WINDOW_MAX + 1), "window too long");
+		cte->expect_op_int(cte, CW_FAILURE, "==", LIBCW_TEST_FUT(cw_rec_set_averaging)(rec, (cw_rec_averaging_mode_t) 100, 4), "invalid mode");
+		cw_rec_delete(&rec);
+	}
+
+	const struct {
+		cw_rec_averaging_mode_t mode;
+		int window;
+		bool is_robust; /* Is the speed unaffected by single distorted Dot? */
+	} estimators[] = {
+		{ CW_REC_AVERAGING_MOVING,      4, false },
+		{ CW_REC_AVERAGING_EXPONENTIAL, 8, false },
+		{ CW_REC_AVERAGING_MEDIAN,      5, true  },
+	};
+	const char * input = "PARISE";
+	const int speed = 20;
+	const int64_t unit = 1200000 / speed; /* Duration of dot [us]. */
+
+	for (size_t e = 0; e < sizeof (estimators) / sizeof (estimators[0]); e++) {
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cw_rec_set_speed(rec, speed);
+		cw_rec_enable_adaptive_mode(rec);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", LIBCW_TEST_FUT(cw_rec_set_averaging)(rec, estimators[e].mode, estimators[e].window), "setting estimator %d/%d", estimators[e].mode, estimators[e].window);
+
+		char received[16] = { 0 };
+		size_t n_received = 0;
+		int64_t now = 0;
+		for (const char * c = input; '\0' != *c; c++) {
+			/* Final 'E' is keyed with Dot stretched by QSB or noise. */
+			const bool is_distorted = '\0' == *(c + 1);
+			char * representation = cw_character_to_representation(*c);
+			cte->assert2(cte, NULL != representation, "failed to look up '%c'", *c);
+			for (const char * mark = representation; '\0' != *mark; mark++) {
+				cw_rec_mark_begin_usecs(rec, now);
+				if (CW_DOT_REPRESENTATION == *mark) {
+					now += is_distorted ? (9 * unit) / 5 : unit;
+				} else {
+					now += 3 * unit;
+				}
+				cw_rec_mark_end_usecs(rec, now);
+				now += unit;
+			}
+			free(representation);
+
+			/* Inter-character-space. */
+			now += 2 * unit;
+			char character = 0;
+			bool is_end_of_word = false;
+			bool is_error = false;
+			if (CW_SUCCESS == cw_rec_poll_character_usecs(rec, now, &character, &is_end_of_word, &is_error)) {
+				received[n_received++] = character;
+			}
+			cw_rec_reset_state(rec);
+		}
+		cte->expect_strcasecmp(cte, input, received, "received text");
+
+		const float diff = fabsf(cw_rec_get_speed(rec) - (float) speed);
+		if (estimators[e].is_robust) {
+			cte->expect_op_float(cte, 0.1F, ">", diff, "speed after distorted Dot");
+		} else {
+			cte->expect_op_float(cte, 0.5F, "<", diff, "speed after distorted Dot");
+		}
+
+		cw_rec_delete(&rec);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Receive characters with Marks distorted beyond tolerance of fixed
+   speed receiver, with hard and soft decisions.
+*/
+int test_cw_rec_set_soft_decision(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Durations of Marks in units. Each character has one Mark outside
+	   of duration ranges of Dot and Dash. The distorted Mark in '0'
+	   is closer to Dot, but there is no character with "---.-"
+	   representation. */
+	const struct {
+		char character;
+		double marks[CW_DATA_MAX_REPRESENTATION_LENGTH];
+		int n_marks;
+	} inputs[] = {
+		{ 'P', { 1.0, 2.0, 3.0, 1.0 },      4 },
+		{ 'S', { 1.0, 1.7, 1.0 },           3 },
+		{ '0', { 3.0, 3.0, 3.0, 1.6, 3.0 }, 5 },
+	};
+	const int speed = 20;
+	const double unit = 1200000.0 / speed; /* Duration of dot [us]. */
+
+	for (int soft = 0; soft <= 1; soft++) {
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cw_rec_set_speed(rec, speed);
+		cw_rec_disable_adaptive_mode(rec);
+		LIBCW_TEST_FUT(cw_rec_set_soft_decision)(rec, soft);
+
+		int n_correct = 0;
+		bool any_error = false;
+		int64_t now = 0;
+		for (size_t c = 0; c < sizeof (inputs) / sizeof (inputs[0]); c++) {
+			for (int m = 0; m < inputs[c].n_marks; m++) {
+				cw_rec_mark_begin_usecs(rec, now);
+				now += (int64_t) (inputs[c].marks[m] * unit);
+				cw_rec_mark_end_usecs(rec, now);
+				now += (int64_t) unit;
+			}
+
+			/* Inter-character-space. */
+			now += (int64_t) (2 * unit);
+			char character = 0;
+			bool is_end_of_word = false;
+			bool is_error = false;
+			if (CW_SUCCESS == cw_rec_poll_character_usecs(rec, now, &character, &is_end_of_word, &is_error)
+			    && character == inputs[c].character) {
+				n_correct++;
+			}
+			any_error = any_error || is_error;
+			cw_rec_reset_state(rec);
+		}
+
+		if (soft) {
+			cte->expect_op_int(cte, 3, "==", n_correct, "count of characters received with soft decision");
+			cte->expect_op_int(cte, false, "==", any_error, "errors with soft decision");
+		} else {
+			cte->expect_op_int(cte, 0, "==", n_correct, "count of characters received with hard decision");
+		}
+
+		cw_rec_delete(&rec);
+	}
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Receive in one call an hour of keying, recorded as Marks and Spaces.
+*/
+int test_cw_rec_receive_edges(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * word = "PARIS";
+	const int speed = 25;
+	const double unit = 1200000.0 / speed; /* Duration of dot [us]. */
+	/* At 25 WPM this is an hour of keying. */
+	const size_t n_words = 1500;
+	const size_t n_edges_max = n_words * (5 * 10 + 1);
+
+	cw_rec_edge_t * edges = calloc(n_edges_max, sizeof (cw_rec_edge_t));
+	cte->assert2(cte, NULL != edges, "failed to allocate edges");
+	size_t n_edges = 0;
+	unsigned int seed = 1;
+	for (size_t w = 0; w < n_words; w++) {
+		for (const char * c = word; '\0' != *c; c++) {
+			char * representation = cw_character_to_representation(*c);
+			cte->assert2(cte, NULL != representation, "failed to look up '%c'", *c);
+			for (const char * mark = representation; '\0' != *mark; mark++) {
+				/* Imperfect timing of hand keying: +/- 10%. */
+				seed = seed * 1103515245U + 12345U;
+				const double jitter = 0.9 + 0.2 * (double) ((seed >> 16) % 1000U) / 1000.0;
+				edges[n_edges].is_mark = true;
+				edges[n_edges].timespan = (CW_DOT_REPRESENTATION == *mark ? 1 : 3) * unit * jitter;
+				n_edges++;
+				edges[n_edges].is_mark = false;
+				edges[n_edges].timespan = unit;
+				n_edges++;
+			}
+			free(representation);
+			/* Inter-mark-space becomes inter-character-space. */
+			edges[n_edges - 1].timespan = 3 * unit;
+		}
+		/* Inter-character-space becomes inter-word-space. Also test
+		   consecutive edges of the same kind. */
+		edges[n_edges].is_mark = false;
+		edges[n_edges].timespan = 4 * unit;
+		n_edges++;
+	}
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+
+	const size_t capacity = n_words * (strlen(word) + 1);
+	cw_rec_decoded_t * decoded = calloc(capacity, sizeof (cw_rec_decoded_t));
+	cte->assert2(cte, NULL != decoded, "failed to allocate decoded characters");
+
+	size_t n_decoded = 0;
+	const int64_t origin = 1000000;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_receive_edges)(rec, origin, edges, n_edges, decoded, capacity, &n_decoded);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "receiving edges");
+	cte->expect_op_int(cte, capacity, "==", n_decoded, "count of decoded characters");
+
+	bool text_failure = false;
+	for (size_t i = 0; i < n_decoded; i++) {
+		const size_t pos = i % (strlen(word) + 1);
+		const char expected = pos < strlen(word) ? word[pos] : ' ';
+		if (expected != decoded[i].character) {
+			text_failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", text_failure, "decoded text");
+
+	/* First character starts at beginning of edges, second
+	   character ("A") starts after "P" (.--.) and
+	   inter-character-space: 1+1+3+1+3+1+1 units +/- jitter, then 3
+	   units. */
+	cte->expect_op_int(cte, origin, "==", decoded[0].timestamp, "timestamp of first character");
+	const int64_t a_start = decoded[1].timestamp - origin;
+	const bool a_start_valid = a_start > (int64_t) (12 * unit) && a_start < (int64_t) (16 * unit);
+	cte->expect_op_int(cte, true, "==", a_start_valid, "timestamp of second character");
+
+	/* Too small output buffer. */
+	cw_rec_reset_state(rec);
+	cwret = LIBCW_TEST_FUT(cw_rec_receive_edges)(rec, origin, edges, n_edges, decoded, 3, &n_decoded);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "receiving edges into small buffer");
+	cte->expect_op_int(cte, 3, "==", n_decoded, "count of characters in small buffer");
+
+	cw_rec_delete(&rec);
+	free(decoded);
+	free(edges);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	char text[16];
+	size_t n;
+	int n_end_of_word;
+} character_callback_test_data_t;
+
+
+
+
+static void test_character_callback(void * callback_arg, char character, bool is_end_of_word, __attribute__((unused)) bool is_error)
+{
+	character_callback_test_data_t * data = (character_callback_test_data_t *) callback_arg;
+	if (data->n < sizeof (data->text) - 1) {
+		data->text[data->n++] = character;
+	}
+	if (is_end_of_word) {
+		data->n_end_of_word++;
+	}
+}
+
+
+
+
+/**
+   Key a word in real time into a receiver that passes received
+   characters to a callback, without polling the receiver.
+*/
+int test_cw_rec_register_character_callback(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * input = "PARIS";
+	const int speed = 40;
+	const int64_t unit = 1200000 / speed; /* Duration of dot [us]. */
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+
+	character_callback_test_data_t data = { 0 };
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_register_character_callback)(rec, test_character_callback, &data);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "registering callback");
+
+	/* Timestamps of marks are taken by receiver at the moment of
+	   the calls, as at a live key. */
+	bool failure = false;
+	for (const char * c = input; '\0' != *c; c++) {
+		char * representation = cw_character_to_representation(*c);
+		cte->assert2(cte, NULL != representation, "failed to look up '%c'", *c);
+		for (const char * mark = representation; '\0' != *mark; mark++) {
+			if (CW_SUCCESS != cw_rec_mark_begin(rec, NULL)) {
+				failure = true;
+			}
+			usleep((useconds_t) ((CW_DOT_REPRESENTATION == *mark ? 1 : 3) * unit));
+			if (CW_SUCCESS != cw_rec_mark_end(rec, NULL)) {
+				failure = true;
+			}
+			usleep((useconds_t) unit);
+		}
+		free(representation);
+		/* Inter-character-space. */
+		usleep((useconds_t) (2 * unit));
+	}
+	cte->expect_op_int(cte, false, "==", failure, "keying marks");
+
+	/* Let inter-word-space elapse. */
+	usleep((useconds_t) (10 * unit));
+	cte->expect_strcasecmp(cte, "PARIS ", data.text, "received text");
+	cte->expect_op_int(cte, 1, "==", data.n_end_of_word, "count of inter-word-spaces");
+
+	/* Receiver is deleted with callback still registered. */
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Run stress test of receiver in parallel in several configurations
+   with random speed, tolerance, jitter and noise spikes.
+*/
+int test_cw_rec_tester_stress(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+#define STRESS_N_CONFIGS 16
+	cw_rec_tester_stress_params_t params[STRESS_N_CONFIGS] = { 0 };
+	cw_rec_tester_stress_result_t results[STRESS_N_CONFIGS] = { 0 };
+
+	/* First configuration: perfect keying, must be received without errors. */
+	params[0] = (cw_rec_tester_stress_params_t) { .speed = 20, .tolerance = 50, .jitter_percent = 0, .spikes_per_mille = 0, .seed = 1 };
+
+	/* Second configuration: noise spikes, but no jitter. Spikes are
+	   shorter than noise spike threshold, so they must be rejected. */
+	params[1] = (cw_rec_tester_stress_params_t) { .speed = 30, .tolerance = 50, .jitter_percent = 0, .spikes_per_mille = 200, .seed = 2 };
+
+	cw_random_t rng;
+	cw_random_init(&rng, 1);
+	for (size_t i = 2; i < STRESS_N_CONFIGS; i++) {
+		cw_rec_tester_stress_randomize_params(&rng, &params[i]);
+	}
+
+	const int retval = LIBCW_TEST_FUT(cw_rec_tester_stress_run)(params, results, STRESS_N_CONFIGS, 0);
+	cte->expect_op_int(cte, 0, "==", retval, "running stress test");
+	cw_rec_tester_stress_print_results(stderr, results, STRESS_N_CONFIGS);
+
+	bool decode_failure = false;
+	for (size_t i = 0; i < STRESS_N_CONFIGS; i++) {
+		if (!results[i].success || 0 == results[i].n_decoded) {
+			decode_failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", decode_failure, "all configurations decoded");
+
+	cte->expect_op_int(cte, 0, "==", results[0].n_errors, "errors with perfect keying");
+	cte->expect_op_int(cte, 0, "<", results[1].n_spikes, "count of noise spikes");
+	cte->expect_op_int(cte, 0, "==", results[1].n_errors, "errors with noise spikes");
+
+	/* Virtual clock: receiving is much faster than keying in real time. */
+	const bool faster_than_real_time = results[0].duration < results[0].keying_duration;
+	cte->expect_op_int(cte, true, "==", faster_than_real_time, "test faster than real time (%.3f s vs. %.3f s)",
+			   results[0].duration, results[0].keying_duration);
+#undef STRESS_N_CONFIGS
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/**
+   Test receiving of tones rendered by generator, with noise added,
+   through tone detector.
+
+   Samples are passed to detector in short blocks, as they would come
+   from a sound card, and receiver is polled after each block with
+   timestamp taken from detector.
+*/
+int test_cw_detector_process(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * input = "PARIS CQ";
+	const int speed = 20;
+	const int frequency = 700;
+	enum { block_n_samples = 480 };
+
+	cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+	cw_gen_t * gen = cw_gen_new(&gen_conf);
+	cw_rec_t * rec = cw_rec_new();
+	if (NULL == gen || NULL == rec) {
+		cte->log_error(cte, "%s:%d: Failed to create generator or receiver\n", __func__, __LINE__);
+		return -1;
+	}
+	cw_gen_set_speed(gen, speed);
+	cw_gen_set_frequency(gen, frequency);
+	cw_gen_set_volume(gen, 50);
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+
+	/* Null sound system works at 48 kHz. */
+	const int sample_rate = 48000;
+	cw_detector_t * detector = LIBCW_TEST_FUT(cw_detector_new)(rec, sample_rate, frequency);
+	cte->expect_op_int(cte, false, "==", NULL == detector, "creating detector");
+	if (NULL == detector) {
+		cw_rec_delete(&rec);
+		cw_gen_delete(&gen);
+		return -1;
+	}
+
+	cw_gen_enqueue_string(gen, input);
+
+	/* Length of input plus some silence at the beginning and at the end. */
+	const int n_blocks = (8 * sample_rate) / block_n_samples;
+	const int lead_in_n_blocks = (sample_rate / 2) / block_n_samples;
+	char received[32] = { 0 };
+	size_t n_received = 0;
+	unsigned int noise_seed = 1;
+	bool process_failure = false;
+	for (int b = 0; b < n_blocks; b++) {
+		cw_sample_t samples[block_n_samples] = { 0 };
+		/* Detector starts listening before the tones start. */
+		if (b >= lead_in_n_blocks) {
+			cw_gen_render(gen, samples, block_n_samples);
+		}
+		for (int i = 0; i < block_n_samples; i++) {
+			/* Simple deterministic noise, 10% of amplitude of tones. */
+			noise_seed = noise_seed * 1103515245U + 12345U;
+			samples[i] = (cw_sample_t) (samples[i] + (int) ((noise_seed >> 16) % 3200U) - 1600);
+		}
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_detector_process)(detector, NULL, samples, block_n_samples)) {
+			process_failure = true;
+			break;
+		}
+
+		struct timeval timestamp = { 0 };
+		LIBCW_TEST_FUT(cw_detector_get_timestamp)(detector, &timestamp);
+		char character = 0;
+		bool is_end_of_word = false;
+		bool is_error = false;
+		if (CW_SUCCESS == cw_rec_poll_character(rec, &timestamp, &character, &is_end_of_word, &is_error)) {
+			if (n_received < sizeof (received) - 1) {
+				received[n_received++] = character;
+			}
+			cw_rec_reset_state(rec);
+		}
+	}
+	cte->expect_op_int(cte, false, "==", process_failure, "processing samples");
+
+	/* Spaces between words are not collected. */
+	char expected[32] = { 0 };
+	size_t n_expected = 0;
+	for (const char * c = input; '\0' != *c; c++) {
+		if (' ' != *c) {
+			expected[n_expected++] = *c;
+		}
+	}
+	cte->expect_strcasecmp(cte, expected, received, "received text");
+
+	cw_detector_delete(&detector);
+	cte->expect_op_int(cte, true, "==", NULL == detector, "deleting detector");
+	cw_rec_delete(&rec);
+	cw_gen_delete(&gen);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	int frequency;
+	char text[64];
+	size_t n;
+} skimmer_test_channel_t;
+
+
+
+
+static void skimmer_test_callback(void * callback_arg, int frequency, char character, __attribute__((unused)) bool is_end_of_word)
+{
+	skimmer_test_channel_t * channels = (skimmer_test_channel_t *) callback_arg;
+	for (int i = 0; i < 2; i++) {
+		/* Carrier is reported at frequency of nearest FFT bin. */
+		if (abs(channels[i].frequency - frequency) < CW_SKIMMER_BIN_WIDTH_MAX) {
+			if (channels[i].n < sizeof (channels[i].text) - 1) {
+				channels[i].text[channels[i].n++] = character;
+			}
+		}
+	}
+}
+
+
+
+
+/**
+   Test decoding of two signals with different frequencies and speeds
+   present in one stream of samples.
+*/
+int test_cw_skimmer_process(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	enum { block_n_samples = 4800 };
+	const int sample_rate = 48000;
+	skimmer_test_channel_t channels[2] = { { .frequency = 600 }, { .frequency = 1500 } };
+	const int speeds[2] = { 18, 25 };
+	const char * inputs[2] = { "VVV PARIS", "EEE CQ TEST" };
+
+	cw_gen_t * gens[2] = { NULL, NULL };
+	for (int i = 0; i < 2; i++) {
+		cw_gen_config_t gen_conf = { .sound_system = CW_AUDIO_NULL };
+		gens[i] = cw_gen_new(&gen_conf);
+		if (NULL == gens[i]) {
+			cte->log_error(cte, "%s:%d: Failed to create generator\n", __func__, __LINE__);
+			return -1;
+		}
+		cw_gen_set_speed(gens[i], speeds[i]);
+		cw_gen_set_frequency(gens[i], channels[i].frequency);
+		cw_gen_set_volume(gens[i], 30);
+		cw_gen_enqueue_string(gens[i], inputs[i]);
+	}
+
+	cw_skimmer_t * skimmer = LIBCW_TEST_FUT(cw_skimmer_new)(sample_rate, 300, 3000, 2);
+	cte->expect_op_int(cte, false, "==", NULL == skimmer, "creating skimmer");
+	if (NULL == skimmer) {
+		cw_gen_delete(&gens[0]);
+		cw_gen_delete(&gens[1]);
+		return -1;
+	}
+	cw_skimmer_register_callback(skimmer, skimmer_test_callback, channels);
+
+	const int n_blocks = (10 * sample_rate) / block_n_samples;
+	const int lead_in_n_blocks = (sample_rate / 2) / block_n_samples;
+	int max_n_channels = 0;
+	bool process_failure = false;
+	unsigned int noise_seed = 1;
+	for (int b = 0; b < n_blocks; b++) {
+		cw_sample_t samples[block_n_samples] = { 0 };
+		cw_sample_t other[block_n_samples] = { 0 };
+		if (b >= lead_in_n_blocks) {
+			cw_gen_render(gens[0], samples, block_n_samples);
+			cw_gen_render(gens[1], other, block_n_samples);
+		}
+		for (int i = 0; i < block_n_samples; i++) {
+			noise_seed = noise_seed * 1103515245U + 12345U;
+			samples[i] = (cw_sample_t) (samples[i] + other[i] + (int) ((noise_seed >> 16) % 2000U) - 1000);
+		}
+		if (CW_SUCCESS != LIBCW_TEST_FUT(cw_skimmer_process)(skimmer, NULL, samples, block_n_samples)) {
+			process_failure = true;
+			break;
+		}
+		const int n_channels = cw_skimmer_get_n_channels(skimmer);
+		if (n_channels > max_n_channels) {
+			max_n_channels = n_channels;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", process_failure, "processing samples");
+	cte->expect_op_int(cte, 2, "==", max_n_channels, "count of channels");
+
+	/* Receivers adapt to speed of carriers during first
+	   characters, so only last words are checked. */
+	for (int i = 0; i < 2; i++) {
+		const char * last_word = strrchr(inputs[i], ' ') + 1;
+		const bool found = NULL != strstr(channels[i].text, last_word);
+		cte->expect_op_int(cte, true, "==", found, "text at %d Hz: '%s'", channels[i].frequency, channels[i].text);
+	}
+
+	cw_skimmer_delete(&skimmer);
+	cw_gen_delete(&gens[0]);
+	cw_gen_delete(&gens[1]);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Marks and Spaces produced by sequencer, for tests of compact
+   receivers and of pool of receivers. */
+typedef struct {
+	cw_seq_event_t events[200];
+	size_t n_events;
+} rec_compact_test_events_t;
+
+
+
+
+static void rec_compact_test_callback(void * callback_arg, const cw_seq_event_t * event)
+{
+	rec_compact_test_events_t * data = (rec_compact_test_events_t *) callback_arg;
+	if (data->n_events < sizeof (data->events) / sizeof (data->events[0])) {
+		data->events[data->n_events] = *event;
+		data->n_events++;
+	}
+}
+
+
+
+
+int test_cw_rec_compact_update(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	errno = 0;
+	cw_rec_timing_t * timing = LIBCW_TEST_FUT(cw_rec_timing_new)(CW_TOLERANCE_MAX + 1, CW_GAP_INITIAL);
+	cte->expect_op_int(cte, true, "==", NULL == timing && EINVAL == errno, "creating timing table with invalid tolerance");
+	timing = LIBCW_TEST_FUT(cw_rec_timing_new)(CW_TOLERANCE_INITIAL, CW_GAP_INITIAL);
+	cte->assert2(cte, NULL != timing, "failed to create timing table");
+
+	enum { n_recs = 3 };
+	cw_rec_compact_t recs[n_recs];
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_compact_init)(&recs[0], CW_SPEED_MIN - 1, false);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EINVAL == errno, "initializing receiver with invalid speed");
+
+	/* Signal at 25 wpm, received by fixed speed receiver at the same
+	   speed, and by adaptive receivers starting below and above the
+	   speed. */
+	const int speed = 25;
+	const int initial_speeds[n_recs] = { speed, 12, 40 };
+	const bool is_adaptive[n_recs] = { false, true, true };
+	for (int r = 0; r < n_recs; r++) {
+		cwret = LIBCW_TEST_FUT(cw_rec_compact_init)(&recs[r], initial_speeds[r], is_adaptive[r]);
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "initializing receiver %d", r);
+	}
+
+	const char * input = "EEE PARIS 73 ";
+	rec_compact_test_events_t data = { .n_events = 0 };
+	cw_seq_t * seq = cw_seq_new();
+	cte->assert2(cte, NULL != seq, "failed to create sequencer");
+	const cw_gen_parameters_t parameters = { .speed = speed, .gap = CW_GAP_INITIAL, .weighting = CW_WEIGHTING_INITIAL };
+	cw_seq_set_parameters(seq, &parameters);
+	cw_seq_send_string(seq, input, rec_compact_test_callback, &data);
+	const int64_t end = cw_seq_get_time(seq);
+	cw_seq_delete(&seq);
+
+	/* All receivers get the same events, in steps of 1 ms. */
+	char texts[n_recs][40] = { { 0 } };
+	size_t text_lens[n_recs] = { 0 };
+	cw_rec_compact_stats_t stats;
+	memset(&stats, 0, sizeof (stats));
+	const int64_t origin = 1000000;
+	const int64_t step = 1000;
+	size_t e = 0;
+	for (int64_t t = 0; t <= end; t += step) {
+		cw_rec_compact_event_t event = CW_REC_COMPACT_POLL;
+		int64_t timestamp = origin + t;
+		if (e < data.n_events && data.events[e].start <= t) {
+			if (data.events[e].is_mark) {
+				event = CW_REC_COMPACT_MARK_BEGIN;
+			} else {
+				event = CW_REC_COMPACT_MARK_END;
+			}
+			timestamp = origin + data.events[e].start;
+			e++;
+		}
+		cw_rec_compact_input_t inputs[n_recs];
+		cw_rec_compact_output_t outputs[n_recs];
+		for (int r = 0; r < n_recs; r++) {
+			inputs[r].timestamp = timestamp;
+			inputs[r].event = event;
+		}
+		/* Statistics are gathered only for fixed speed receiver. */
+		LIBCW_TEST_FUT(cw_rec_compact_update)(timing, recs, inputs, outputs, 1, &stats);
+		LIBCW_TEST_FUT(cw_rec_compact_update)(timing, recs + 1, inputs + 1, outputs + 1, n_recs - 1, NULL);
+		for (int r = 0; r < n_recs; r++) {
+			if (text_lens[r] + 2 >= sizeof (texts[r])) {
+				continue;
+			}
+			if (outputs[r].is_error) {
+				texts[r][text_lens[r]++] = '#';
+			} else if ('\0' != outputs[r].character) {
+				texts[r][text_lens[r]++] = outputs[r].character;
+			} else {
+				; /* No character in this step. */
+			}
+			if (outputs[r].is_end_of_word) {
+				texts[r][text_lens[r]++] = ' ';
+			}
+		}
+	}
+
+	/* Adaptive receivers may misread first characters while they
+	   adapt to speed of signal. */
+	cte->expect_op_int(cte, 0, "==", strcmp(input, texts[0]), "text received at fixed speed: '%s'", texts[0]);
+	for (int r = 1; r < n_recs; r++) {
+		const char * found = strstr(texts[r], "PARIS 73 ");
+		cte->expect_op_int(cte, false, "==", NULL == found, "text received by adaptive receiver starting at %d wpm: '%s'", initial_speeds[r], texts[r]);
+		const int received_speed = LIBCW_TEST_FUT(cw_rec_compact_get_speed)(&recs[r]);
+		const bool speed_valid = received_speed >= speed - 2 && received_speed <= speed + 2;
+		cte->expect_op_int(cte, true, "==", speed_valid, "speed tracked by adaptive receiver: %d wpm", received_speed);
+	}
+
+	/* "EEE PARIS 73": 3+2+1+2+2+3+3+3 Dots, 2+1+1+2+2 Dashes, 27
+	   Marks in 10 characters. */
+	cw_rec_statistics_t statistics;
+	cwret = LIBCW_TEST_FUT(cw_rec_compact_get_statistics)(&stats, &statistics);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting statistics");
+	cte->expect_op_int(cte, 19, "==", statistics.dot.count, "count of Dots");
+	cte->expect_op_int(cte, 8, "==", statistics.dash.count, "count of Dashes");
+	cte->expect_op_int(cte, 27 - 10, "==", statistics.inter_mark_space.count, "count of inter-mark-spaces");
+	const bool deviation_valid = fabsf(statistics.dot.mean_delta) < step && fabsf(statistics.dash.mean_delta) < step;
+	cte->expect_op_int(cte, true, "==", deviation_valid, "mean deviation of Marks");
+
+	cw_rec_timing_delete(&timing);
+	cte->expect_null_pointer(cte, timing, "deleting timing table");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+int test_cw_rec_pool(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	errno = 0;
+	cw_rec_pool_t * pool = LIBCW_TEST_FUT(cw_rec_pool_new)(0, 2);
+	cte->expect_op_int(cte, true, "==", NULL == pool && EINVAL == errno, "creating pool without channels");
+
+	/* More channels than workers, so that shards have many
+	   channels. */
+	enum { n_channels = 6 };
+	const char * words[n_channels] = { "PARIS", "CQ", "TEST", "73", "QRZ", "SOS" };
+	const int speed = 20;
+	pool = LIBCW_TEST_FUT(cw_rec_pool_new)(n_channels, 2);
+	cte->assert2(cte, NULL != pool, "failed to create pool");
+
+	rec_compact_test_events_t data[n_channels];
+	for (int c = 0; c < n_channels; c++) {
+		cw_rec_t * rec = LIBCW_TEST_FUT(cw_rec_pool_get_receiver)(pool, c);
+		cte->assert2(cte, NULL != rec, "failed to get receiver of channel %d", c);
+		cw_rec_set_speed(rec, speed);
+		cw_rec_disable_adaptive_mode(rec);
+
+		cw_seq_t * seq = cw_seq_new();
+		cte->assert2(cte, NULL != seq, "failed to create sequencer");
+		const cw_gen_parameters_t parameters = { .speed = speed, .gap = CW_GAP_INITIAL, .weighting = CW_WEIGHTING_INITIAL };
+		cw_seq_set_parameters(seq, &parameters);
+		data[c].n_events = 0;
+		cw_seq_send_string(seq, words[c], rec_compact_test_callback, &data[c]);
+		cw_seq_delete(&seq);
+		/* Space long enough to end the word. */
+		data[c].events[data[c].n_events - 1].duration = 10 * 1200000 / speed;
+	}
+	errno = 0;
+	cte->expect_null_pointer(cte, LIBCW_TEST_FUT(cw_rec_pool_get_receiver)(pool, n_channels), "getting receiver of invalid channel");
+
+	/* Channels start at different times. Events of channels are
+	   pushed one by one, interleaved. */
+	const int64_t origin = 1000000;
+	bool push_failure = false;
+	for (size_t e = 0; !push_failure; e++) {
+		bool pushed = false;
+		for (int c = 0; c < n_channels; c++) {
+			if (e >= data[c].n_events) {
+				continue;
+			}
+			const cw_rec_edge_t edge = { .timespan = (double) data[c].events[e].duration, .is_mark = data[c].events[e].is_mark };
+			const int64_t timestamp = origin + 7000 * c + data[c].events[e].start;
+			if (CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_pool_push_edges)(pool, c, timestamp, &edge, 1)) {
+				push_failure = true;
+			}
+			pushed = true;
+		}
+		if (!pushed) {
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", push_failure, "pushing edges");
+	const cw_rec_edge_t edge = { .timespan = 1000.0, .is_mark = true };
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_pool_push_edges)(pool, -1, origin, &edge, 1);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "pushing edges of invalid channel");
+
+	/* Small buffer: characters are read with many calls. */
+	char texts[n_channels][16] = { { 0 } };
+	size_t text_lens[n_channels] = { 0 };
+	bool order_failure = false;
+	int64_t last_timestamp = 0;
+	size_t n_total = 0;
+	while (true) {
+		cw_rec_pool_decoded_t decoded[4];
+		size_t n_decoded = 0;
+		cwret = LIBCW_TEST_FUT(cw_rec_pool_read)(pool, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+		if (CW_SUCCESS != cwret || 0 == n_decoded) {
+			break;
+		}
+		for (size_t i = 0; i < n_decoded; i++) {
+			const int c = decoded[i].channel;
+			if (decoded[i].timestamp < last_timestamp) {
+				order_failure = true;
+			}
+			last_timestamp = decoded[i].timestamp;
+			if (c >= 0 && c < n_channels && text_lens[c] + 1 < sizeof (texts[c])) {
+				texts[c][text_lens[c]++] = decoded[i].character;
+			}
+			n_total++;
+		}
+	}
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "reading decoded characters");
+	cte->expect_op_int(cte, false, "==", order_failure, "order of decoded characters");
+
+	size_t n_expected = 0;
+	for (int c = 0; c < n_channels; c++) {
+		char expected[16] = { 0 };
+		snprintf(expected, sizeof (expected), "%s ", words[c]);
+		n_expected += strlen(expected);
+		cte->expect_op_int(cte, 0, "==", strcmp(expected, texts[c]), "text of channel %d: '%s'", c, texts[c]);
+	}
+	cte->expect_op_int(cte, n_expected, "==", n_total, "count of decoded characters");
+
+	/* First character of channel starts with first edge of the
+	   channel. */
+	cw_rec_t * rec = cw_rec_pool_get_receiver(pool, 0);
+	cw_rec_reset_state(rec);
+	const cw_rec_edge_t edges[] = { { .timespan = 60000.0, .is_mark = true }, { .timespan = 600000.0, .is_mark = false } };
+	cw_rec_pool_push_edges(pool, 0, 2 * origin, edges, sizeof (edges) / sizeof (edges[0]));
+	cw_rec_pool_decoded_t decoded[4];
+	size_t n_decoded = 0;
+	cw_rec_pool_read(pool, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+	const bool e_valid = 2 == n_decoded && 'E' == decoded[0].character && 2 * origin == decoded[0].timestamp && 0 == decoded[0].channel;
+	cte->expect_op_int(cte, true, "==", e_valid, "timestamp of character");
+
+	cw_rec_pool_delete(&pool);
+	cte->expect_null_pointer(cte, pool, "deleting pool");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+static void rec_poll_batch_test_callback(__attribute__((unused)) void * callback_arg, __attribute__((unused)) char character, __attribute__((unused)) bool is_end_of_word, __attribute__((unused)) bool is_error)
+{
+}
+
+
+
+
+int test_cw_rec_poll_batch(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int speed = 20;
+	const char * input = "PARIS CQ";
+	rec_compact_test_events_t data = { .n_events = 0 };
+	cw_seq_t * seq = cw_seq_new();
+	cte->assert2(cte, NULL != seq, "failed to create sequencer");
+	const cw_gen_parameters_t parameters = { .speed = speed, .gap = CW_GAP_INITIAL, .weighting = CW_WEIGHTING_INITIAL };
+	cw_seq_set_parameters(seq, &parameters);
+	cw_seq_send_string(seq, input, rec_compact_test_callback, &data);
+	cw_seq_delete(&seq);
+
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, speed);
+	cw_rec_disable_adaptive_mode(rec);
+
+	/* Receiver collects characters only after first poll. */
+	const int64_t origin = 1000000;
+	cw_rec_decoded_t decoded[16];
+	size_t n_decoded = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_poll_batch)(rec, origin, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+	cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && 0 == n_decoded, "polling receiver without Marks");
+
+	/* Whole text is keyed without polls between characters. */
+	bool mark_failure = false;
+	int64_t first_mark_starts[8] = { 0 };
+	size_t n_characters = 0;
+	bool is_after_long_space = true;
+	for (size_t e = 0; e < data.n_events; e++) {
+		const int64_t start = origin + data.events[e].start;
+		if (data.events[e].is_mark) {
+			if (is_after_long_space && n_characters < sizeof (first_mark_starts) / sizeof (first_mark_starts[0])) {
+				first_mark_starts[n_characters++] = start;
+			}
+			mark_failure = mark_failure || CW_SUCCESS != cw_rec_mark_begin_usecs(rec, start);
+			mark_failure = mark_failure || CW_SUCCESS != cw_rec_mark_end_usecs(rec, start + data.events[e].duration);
+		} else {
+			/* Inter-mark-space is one Unit. */
+			is_after_long_space = data.events[e].duration > 1200000 / speed * 2;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", mark_failure, "receiving Marks");
+
+	/* Small buffer, then the rest. Last character is completed by
+	   Space lasting at the time of the poll. */
+	const int64_t end = origin + data.events[data.n_events - 1].start + 10 * 1200000 / speed;
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_batch)(rec, end, decoded, 3, &n_decoded);
+	cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && 3 == n_decoded, "polling batch into small buffer");
+	size_t n_rest = 0;
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_batch)(rec, end, decoded + 3, sizeof (decoded) / sizeof (decoded[0]) - 3, &n_rest);
+	n_decoded += n_rest;
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "polling rest of batch");
+
+	char text[sizeof (decoded) / sizeof (decoded[0]) + 1] = { 0 };
+	bool timestamp_failure = false;
+	size_t c = 0;
+	for (size_t i = 0; i < n_decoded; i++) {
+		text[i] = decoded[i].character;
+		if (' ' != decoded[i].character) {
+			timestamp_failure = timestamp_failure || c >= n_characters || first_mark_starts[c] != decoded[i].timestamp;
+			c++;
+		}
+	}
+	cte->expect_op_int(cte, 0, "==", strcmp("PARIS CQ ", text), "received text: '%s'", text);
+	cte->expect_op_int(cte, false, "==", timestamp_failure, "timestamps of characters");
+
+	/* Nothing new since previous poll. */
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_batch)(rec, end + 1000, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+	cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && 0 == n_decoded, "polling empty batch");
+
+	/* Receiver with callback delivers characters to callback. */
+	cw_rec_register_character_callback(rec, rec_poll_batch_test_callback, NULL);
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_rec_poll_batch)(rec, end, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EINVAL == errno, "polling batch of receiver with callback");
+
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Producer of edges for receiver with callback, keying in real time
+   in its own thread. */
+typedef struct {
+	cw_rec_t * rec;
+	const char * input;
+	int64_t unit; /* [us] */
+	bool failure;
+} rec_push_test_producer_t;
+
+
+
+
+static int64_t rec_push_test_now(void)
+{
+	struct timeval now = { 0 };
+	gettimeofday(&now, NULL);
+	return (int64_t) now.tv_sec * CW_USECS_PER_SEC + now.tv_usec;
+}
+
+
+
+
+static void * rec_push_test_producer(void * arg)
+{
+	rec_push_test_producer_t * producer = (rec_push_test_producer_t *) arg;
+	for (const char * c = producer->input; '\0' != *c; c++) {
+		char * representation = cw_character_to_representation(*c);
+		for (const char * mark = representation; NULL != mark && '\0' != *mark; mark++) {
+			producer->failure = producer->failure || CW_SUCCESS != cw_rec_push_mark_begin(producer->rec, rec_push_test_now());
+			usleep((useconds_t) ((CW_DOT_REPRESENTATION == *mark ? 1 : 3) * producer->unit));
+			producer->failure = producer->failure || CW_SUCCESS != cw_rec_push_mark_end(producer->rec, rec_push_test_now());
+			usleep((useconds_t) producer->unit);
+		}
+		free(representation);
+		/* Inter-character-space. */
+		usleep((useconds_t) (2 * producer->unit));
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   Edges pushed to receiver's queue are received by polls (also by
+   polls made long after the edges), and by receiver with callback
+   while they are pushed by another thread.
+*/
+int test_cw_rec_push_mark_begin(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int speed = 20;
+	const char * input = "PARIS CQ";
+	rec_compact_test_events_t data = { .n_events = 0 };
+	cw_seq_t * seq = cw_seq_new();
+	cte->assert2(cte, NULL != seq, "failed to create sequencer");
+	const cw_gen_parameters_t parameters = { .speed = speed, .gap = CW_GAP_INITIAL, .weighting = CW_WEIGHTING_INITIAL };
+	cw_seq_set_parameters(seq, &parameters);
+	cw_seq_send_string(seq, input, rec_compact_test_callback, &data);
+	cw_seq_delete(&seq);
+
+	const int64_t origin = 1000000;
+	const int64_t end = origin + data.events[data.n_events - 1].start + 10 * 1200000 / speed;
+
+	for (int mode = 0; mode < 2; mode++) {
+		cw_rec_t * rec = cw_rec_new();
+		cte->assert2(cte, NULL != rec, "failed to create receiver");
+		cw_rec_set_speed(rec, speed);
+		cw_rec_disable_adaptive_mode(rec);
+
+		/* Whole text is queued before first poll. */
+		bool push_failure = false;
+		for (size_t e = 0; e < data.n_events; e++) {
+			if (data.events[e].is_mark) {
+				const int64_t start = origin + data.events[e].start;
+				push_failure = push_failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_push_mark_begin)(rec, start);
+				push_failure = push_failure || CW_SUCCESS != LIBCW_TEST_FUT(cw_rec_push_mark_end)(rec, start + data.events[e].duration);
+			}
+		}
+		cte->expect_op_int(cte, false, "==", push_failure, "pushing Marks");
+
+		char text[32] = { 0 };
+		size_t n = 0;
+		if (0 == mode) {
+			/* Each poll returns one character: Marks of next
+			   character are taken from the queue only after
+			   the character has been polled. */
+			char character = 0;
+			bool is_end_of_word = false;
+			while (n < sizeof (text) - 2
+			       && CW_SUCCESS == cw_rec_poll_character_usecs(rec, end, &character, &is_end_of_word, NULL)) {
+				text[n++] = character;
+				if (is_end_of_word) {
+					text[n++] = ' ';
+					cw_rec_reset_state(rec);
+				}
+			}
+		} else {
+			cw_rec_decoded_t decoded[16];
+			size_t n_decoded = 0;
+			cw_rec_poll_batch(rec, end, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+			for (size_t i = 0; i < n_decoded && n < sizeof (text) - 1; i++) {
+				text[n++] = decoded[i].character;
+			}
+		}
+		cte->expect_op_int(cte, 0, "==", strcmp("PARIS CQ ", text), "text received by %s: '%s'", 0 == mode ? "polls of characters" : "poll of batch", text);
+
+		cw_rec_delete(&rec);
+	}
+
+	/* Full queue. */
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	bool push_failure = false;
+	for (int i = 0; i < CW_REC_EDGE_QUEUE_CAPACITY; i++) {
+		push_failure = push_failure || CW_SUCCESS != cw_rec_push_mark_begin(rec, origin + i * 1000);
+	}
+	cte->expect_op_int(cte, false, "==", push_failure, "filling queue");
+	errno = 0;
+	const cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_push_mark_end)(rec, origin + CW_REC_EDGE_QUEUE_CAPACITY * 1000);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EAGAIN == errno, "pushing to full queue");
+	cw_rec_delete(&rec);
+
+	/* Receiver with callback, fed by another thread. */
+	rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	const int callback_speed = 40;
+	cw_rec_set_speed(rec, callback_speed);
+	cw_rec_disable_adaptive_mode(rec);
+	character_callback_test_data_t callback_data = { 0 };
+	cw_rec_register_character_callback(rec, test_character_callback, &callback_data);
+
+	rec_push_test_producer_t producer = { .rec = rec, .input = "PARIS", .unit = 1200000 / callback_speed, .failure = false };
+	pthread_t thread;
+	cte->assert2(cte, 0 == pthread_create(&thread, NULL, rec_push_test_producer, &producer), "failed to create producer thread");
+	pthread_join(thread, NULL);
+	cte->expect_op_int(cte, false, "==", producer.failure, "pushing Marks from producer thread");
+
+	/* Let inter-word-space elapse. */
+	usleep((useconds_t) (10 * producer.unit));
+	cte->expect_strcasecmp(cte, "PARIS ", callback_data.text, "text received by callback");
+	cw_rec_delete(&rec);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+/* Decode text keyed by sequencer with given parameters. */
+static void rec_profile_test_receive(cw_rec_t * rec, const cw_gen_parameters_t * parameters, const char * input, char * text, size_t size)
+{
+	rec_compact_test_events_t data = { .n_events = 0 };
+	cw_seq_t * seq = cw_seq_new();
+	cw_seq_set_parameters(seq, parameters);
+	cw_seq_send_string(seq, input, rec_compact_test_callback, &data);
+	cw_seq_delete(&seq);
+
+	cw_rec_edge_t edges[sizeof (data.events) / sizeof (data.events[0])];
+	for (size_t e = 0; e < data.n_events; e++) {
+		edges[e].timespan = (double) data.events[e].duration;
+		edges[e].is_mark = data.events[e].is_mark;
+	}
+	cw_rec_decoded_t decoded[32];
+	size_t n_decoded = 0;
+	cw_rec_receive_edges(rec, 1000000, edges, data.n_events, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+
+	size_t i = 0;
+	for (; i < n_decoded && i + 1 < size; i++) {
+		text[i] = decoded[i].character;
+	}
+	text[i] = '\0';
+}
+
+
+
+
+int test_cw_rec_profile(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	/* Station keying at 30 wpm with long gaps. */
+	const cw_gen_parameters_t station = { .speed = 30, .gap = 2, .weighting = CW_WEIGHTING_INITIAL };
+	const char * input = "TEST PARIS ";
+
+	/* Learn the station's profile. */
+	cw_rec_t * rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, station.speed);
+	cw_rec_set_gap(rec, station.gap);
+	char text[32] = { 0 };
+	rec_profile_test_receive(rec, &station, input, text, sizeof (text));
+	cw_rec_profile_t profile;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_get_profile)(rec, &profile);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "getting profile");
+	const int unit = CW_DOT_CALIBRATION / station.speed;
+	const bool durations_valid = abs(profile.dot_duration - unit) < unit / 10
+		&& abs(profile.dash_duration - 3 * unit) < unit / 10
+		&& abs(profile.ims_duration - unit) < unit / 10
+		&& abs(profile.ics_duration - (3 + station.gap) * unit) < unit / 10;
+	cte->expect_op_int(cte, true, "==", durations_valid, "durations in profile: %d/%d/%d/%d",
+			   profile.dot_duration, profile.dash_duration, profile.ims_duration, profile.ics_duration);
+	cw_rec_delete(&rec);
+
+	/* Adaptive receiver seeded with the profile locks on the station
+	   from first character. */
+	rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, 12);
+	cw_rec_enable_adaptive_mode(rec);
+	cwret = LIBCW_TEST_FUT(cw_rec_set_profile)(rec, &profile);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting profile of adaptive receiver");
+	const bool speed_valid = fabsf(cw_rec_get_speed(rec) - (float) station.speed) < 3.0F;
+	cte->expect_op_int(cte, true, "==", speed_valid, "speed of seeded receiver: %.1f", (double) cw_rec_get_speed(rec));
+	rec_profile_test_receive(rec, &station, input, text, sizeof (text));
+	cte->expect_op_int(cte, 0, "==", strcmp(input, text), "text received by seeded adaptive receiver: '%s'", text);
+	cw_rec_delete(&rec);
+
+	/* The same for fixed speed receiver. */
+	rec = cw_rec_new();
+	cte->assert2(cte, NULL != rec, "failed to create receiver");
+	cw_rec_set_speed(rec, 12);
+	cwret = LIBCW_TEST_FUT(cw_rec_set_profile)(rec, &profile);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting profile of fixed speed receiver");
+	rec_profile_test_receive(rec, &station, input, text, sizeof (text));
+	cte->expect_op_int(cte, 0, "==", strcmp(input, text), "text received by seeded fixed speed receiver: '%s'", text);
+
+	cw_rec_profile_t invalid = profile;
+	invalid.dash_duration = invalid.dot_duration;
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_rec_set_profile)(rec, &invalid);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EINVAL == errno, "setting invalid profile");
+	cw_rec_delete(&rec);
+
+	/* Compact receiver. */
+	cw_rec_compact_t compact;
+	cw_rec_compact_init(&compact, 12, true);
+	cwret = LIBCW_TEST_FUT(cw_rec_compact_set_profile)(&compact, &profile);
+	const int compact_speed = cw_rec_compact_get_speed(&compact);
+	cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && abs(compact_speed - station.speed) < 3, "speed of seeded compact receiver: %d", compact_speed);
+
+	/* Profiles of skimmer's stations. */
+	cw_skimmer_t * skimmer = cw_skimmer_new(48000, 300, 3000, 1);
+	cte->assert2(cte, NULL != skimmer, "failed to create skimmer");
+	const int frequencies[2] = { 700, 5000 };
+	const cw_rec_profile_t profiles[2] = { profile, profile };
+	errno = 0;
+	cwret = LIBCW_TEST_FUT(cw_skimmer_set_profiles)(skimmer, frequencies, profiles, 2);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EINVAL == errno, "loading profile outside of passband");
+	cwret = LIBCW_TEST_FUT(cw_skimmer_set_profiles)(skimmer, frequencies, profiles, 1);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "loading profiles");
+	cwret = LIBCW_TEST_FUT(cw_skimmer_set_profiles)(skimmer, NULL, NULL, 0);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "removing profiles");
+	cw_skimmer_delete(&skimmer);
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+int test_cw_rec_spec(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const char * input = "CQ TEST PARIS ";
+	const char * dictionary[] = { "cq", "test", "paris" };
+	const int speeds[] = { 6, 12, 21, 33, 47 };
+	for (size_t s = 0; s < sizeof (speeds) / sizeof (speeds[0]); s++) {
+		cw_rec_spec_t * spec = LIBCW_TEST_FUT(cw_rec_spec_new)(5, 50, 11);
+		cte->assert2(cte, NULL != spec, "failed to create speculative receiver");
+		cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_spec_set_dictionary)(spec, dictionary, sizeof (dictionary) / sizeof (dictionary[0]));
+		cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting dictionary");
+
+		const cw_gen_parameters_t parameters = { .speed = speeds[s], .gap = CW_GAP_INITIAL, .weighting = CW_WEIGHTING_INITIAL };
+		rec_compact_test_events_t data = { .n_events = 0 };
+		cw_seq_t * seq = cw_seq_new();
+		cw_seq_set_parameters(seq, &parameters);
+		cw_seq_send_string(seq, input, rec_compact_test_callback, &data);
+		cw_seq_delete(&seq);
+
+		cw_rec_edge_t edges[sizeof (data.events) / sizeof (data.events[0])];
+		for (size_t e = 0; e < data.n_events; e++) {
+			edges[e].timespan = (double) data.events[e].duration;
+			edges[e].is_mark = data.events[e].is_mark;
+		}
+		cw_rec_decoded_t decoded[32];
+		size_t n_decoded = 0;
+		cwret = LIBCW_TEST_FUT(cw_rec_spec_receive_edges)(spec, 1000000, edges, data.n_events, decoded, sizeof (decoded) / sizeof (decoded[0]), &n_decoded);
+		char text[32] = { 0 };
+		for (size_t i = 0; i < n_decoded && i + 1 < sizeof (text); i++) {
+			text[i] = decoded[i].character;
+		}
+		cte->expect_op_int(cte, true, "==", CW_SUCCESS == cwret && 0 == strcmp(input, text), "text received at %d wpm: '%s'", speeds[s], text);
+
+		const int speed = LIBCW_TEST_FUT(cw_rec_spec_get_speed)(spec);
+		cte->expect_op_int(cte, true, "==", abs(speed - speeds[s]) * 100 <= speeds[s] * 30, "speed of best hypothesis at %d wpm: %d", speeds[s], speed);
+
+		cw_rec_spec_delete(&spec);
+	}
+
+	cw_rec_spec_t * spec = cw_rec_spec_new(5, 50, 11);
+	const char * invalid[] = { "cq", "" };
+	errno = 0;
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_rec_spec_set_dictionary)(spec, invalid, 2);
+	cte->expect_op_int(cte, true, "==", CW_FAILURE == cwret && EINVAL == errno, "setting dictionary with empty word");
+	cw_rec_spec_delete(&spec);
+
+	errno = 0;
+	spec = LIBCW_TEST_FUT(cw_rec_spec_new)(50, 5, 11);
+	cte->expect_op_int(cte, true, "==", NULL == spec && EINVAL == errno, "creating receiver with invalid range of speeds");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
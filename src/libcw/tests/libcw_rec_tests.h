@@ -24,6 +24,22 @@ int test_cw_rec_test_with_varying_speeds(cw_test_executor_t * cte);
 int test_cw_rec_get_receive_parameters(cw_test_executor_t * cte);
 int test_cw_rec_parameter_getters_setters_1(cw_test_executor_t * cte);
 int test_cw_rec_parameter_getters_setters_2(cw_test_executor_t * cte);
+int test_cw_rec_mark_begin_usecs(cw_test_executor_t * cte);
+int test_cw_rec_get_statistics(cw_test_executor_t * cte);
+int test_cw_rec_get_metrics(cw_test_executor_t * cte);
+int test_cw_rec_set_averaging(cw_test_executor_t * cte);
+int test_cw_rec_set_soft_decision(cw_test_executor_t * cte);
+int test_cw_rec_receive_edges(cw_test_executor_t * cte);
+int test_cw_rec_register_character_callback(cw_test_executor_t * cte);
+int test_cw_rec_tester_stress(cw_test_executor_t * cte);
+int test_cw_detector_process(cw_test_executor_t * cte);
+int test_cw_skimmer_process(cw_test_executor_t * cte);
+int test_cw_rec_compact_update(cw_test_executor_t * cte);
+int test_cw_rec_pool(cw_test_executor_t * cte);
+int test_cw_rec_poll_batch(cw_test_executor_t * cte);
+int test_cw_rec_push_mark_begin(cw_test_executor_t * cte);
+int test_cw_rec_profile(cw_test_executor_t * cte);
+int test_cw_rec_spec(cw_test_executor_t * cte);
 
 
 
@@ -1,2 +1,4 @@
 #!/bin/sh
-./libcw_tests -Q -S n -L 1 | grep "Test result: success"
+# Quick tests of Null sound system are independent of each other, so
+# they are executed in parallel worker processes.
+./libcw_tests -Q -S n -L 1 -J 4 | grep "Test result: success"
@@ -186,18 +186,18 @@ int test_cw_tq_prev_index_internal(cw_test_executor_t * cte)
 		size_t expected_prev_index;
 		bool guard;
 	} input[] = {
-		{ tq->capacity - 4, tq->capacity - 5, false },
-		{ tq->capacity - 3, tq->capacity - 4, false },
-		{ tq->capacity - 2, tq->capacity - 3, false },
-		{ tq->capacity - 1, tq->capacity - 2, false },
+		{ tq->n_slots - 4, tq->n_slots - 5, false },
+		{ tq->n_slots - 3, tq->n_slots - 4, false },
+		{ tq->n_slots - 2, tq->n_slots - 3, false },
+		{ tq->n_slots - 1, tq->n_slots - 2, false },
 
 		/* This one should never happen. We can't pass index
-		   equal "capacity" because it's out of range. */
+		   equal "n_slots" because it's out of range. */
 		/*
-		{ tq->capacity - 0, tq->capacity - 1, false },
+		{ tq->n_slots - 0, tq->n_slots - 1, false },
 		*/
 
-		{                0, tq->capacity - 1, false },
+		{                0, tq->n_slots - 1, false },
 		{                1,                0, false },
 		{                2,                1, false },
 		{                3,                2, false },
@@ -247,11 +247,11 @@ int test_cw_tq_next_index_internal(cw_test_executor_t * cte)
 		size_t expected_next_index;
 		bool guard;
 	} input[] = {
-		{ tq->capacity - 5, tq->capacity - 4, false },
-		{ tq->capacity - 4, tq->capacity - 3, false },
-		{ tq->capacity - 3, tq->capacity - 2, false },
-		{ tq->capacity - 2, tq->capacity - 1, false },
-		{ tq->capacity - 1,                0, false },
+		{ tq->n_slots - 5, tq->n_slots - 4, false },
+		{ tq->n_slots - 4, tq->n_slots - 3, false },
+		{ tq->n_slots - 3, tq->n_slots - 2, false },
+		{ tq->n_slots - 2, tq->n_slots - 1, false },
+		{ tq->n_slots - 1,                0, false },
 		{                0,                1, false },
 		{                1,                2, false },
 		{                2,                3, false },
@@ -307,8 +307,14 @@ void enqueue_tone_low_level(cw_test_executor_t * cte, cw_tone_queue_t * tq, cons
 		     "length before enqueue reached capacity: %zu / %zu",
 		     tq->len, tq->capacity);
 
+	/* Grow table of tones if necessary. */
+	if (tq->len == tq->n_slots) {
+		const cw_ret_t cwret = cw_tq_reserve_slots_internal(tq, tq->len + 1);
+		cte->assert2(cte, CW_SUCCESS == cwret, "failed to grow table of tones to %zu slots", tq->len + 1);
+	}
+
 	/* Enqueue the new tone and set the new tail index. */
-	tq->queue[tq->tail] = *tone;
+	cw_tq_tone_to_desc_internal(&tq->queue[tq->tail], tone);
 	tq->tail = cw_tq_next_index_internal(tq, tq->tail);
 	tq->len++;
 
@@ -746,7 +752,7 @@ int test_cw_tq_test_capacity_A(cw_test_executor_t * cte)
 				   frequency 'i' is at index 'i'. But with
 				   non-zero shift of head, tone with frequency
 				   'i' is at index 'shifted_i'. */
-				const size_t shifted_i = (i + current_head_shift) % (tq->capacity);
+				const size_t shifted_i = (i + current_head_shift) & tq->slots_mask;
 
 				const size_t expected_freq = i;
 				const size_t readback_freq = tq->queue[shifted_i].frequency;
@@ -974,8 +980,10 @@ cw_tone_queue_t * test_cw_tq_capacity_test_init(cw_test_executor_t * cte, size_t
 	/* Initialize *all* tones with known value. Do this manually,
 	   to be 100% sure that all tones in queue table have been
 	   initialized. */
-	for (int i = 0; i < CW_TONE_QUEUE_CAPACITY_MAX; i++) {
-		CW_TONE_INIT(&tq->queue[i], 10000 + i, 1, CW_SLOPE_MODE_STANDARD_SLOPES);
+	for (size_t i = 0; i < tq->n_slots; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, 10000 + (int) i, 1, CW_SLOPE_MODE_STANDARD_SLOPES);
+		cw_tq_tone_to_desc_internal(&tq->queue[i], &tone);
 	}
 
 	/* Move head and tail of empty queue to initial position. The
@@ -1835,3 +1843,142 @@ cwt_retv test_cw_tq_dequeue_internal_returns(cw_test_executor_t * cte)
 	return cwt_retv_ok;
 }
 
+
+
+
+
+/**
+   @brief Test growing of table of tones in tone queue
+
+   Set capacity of queue above default capacity, fill the queue, and
+   check that the table of tones grows while tones keep their order,
+   also when tones are wrapped around end of the table.
+*/
+cwt_retv test_cw_tq_grow_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cw_tone_queue_t * tq = cw_tq_new_internal();
+	cte->assert2(cte, tq, "failed to create new tone queue");
+
+	cte->expect_op_int(cte, CW_TONE_QUEUE_INITIAL_N_SLOTS, "==", tq->n_slots, "initial count of slots");
+
+
+	/* Capacity can't be larger than the limit, or smaller than
+	   current length of queue. */
+	cw_ret_t cwret = LIBCW_TEST_FUT(cw_tq_set_capacity_internal)(tq, CW_TONE_QUEUE_CAPACITY_LIMIT + 1, 100);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "setting capacity above limit");
+
+	const size_t capacity = 5000;
+	cwret = LIBCW_TEST_FUT(cw_tq_set_capacity_internal)(tq, capacity, capacity);
+	cte->expect_op_int(cte, CW_SUCCESS, "==", cwret, "setting capacity above default capacity");
+	cte->expect_op_int(cte, CW_TONE_QUEUE_INITIAL_N_SLOTS, "==", tq->n_slots, "count of slots after setting capacity");
+
+
+	/* Move head close to end of table, so that tones enqueued below
+	   are wrapped at the end of the table before it grows. */
+	cw_tone_t tone;
+	for (size_t i = 0; i < CW_TONE_QUEUE_INITIAL_N_SLOTS - 3; i++) {
+		CW_TONE_INIT(&tone, 100, 1, CW_SLOPE_MODE_NO_SLOPES);
+		cw_tq_enqueue_internal(tq, &tone);
+		cw_tq_dequeue_internal(tq, &tone);
+	}
+	cte->expect_op_int(cte, CW_TONE_QUEUE_INITIAL_N_SLOTS - 3, "==", tq->head, "head index before filling the queue");
+
+
+	/* Duration of a tone tells its position in queue. */
+	bool enqueue_failure = false;
+	for (size_t i = 0; i < capacity; i++) {
+		CW_TONE_INIT(&tone, 100, (int) i + 1, CW_SLOPE_MODE_NO_SLOPES);
+		cwret = LIBCW_TEST_FUT(cw_tq_enqueue_internal)(tq, &tone);
+		if (!cte->expect_op_int_errors_only(cte, CW_SUCCESS, "==", cwret, "enqueueing tone #%zu", i)) {
+			enqueue_failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", enqueue_failure, "filling queue");
+	cte->expect_op_int(cte, 8192, "==", tq->n_slots, "count of slots in full queue");
+
+	CW_TONE_INIT(&tone, 100, 1, CW_SLOPE_MODE_NO_SLOPES);
+	cwret = LIBCW_TEST_FUT(cw_tq_enqueue_internal)(tq, &tone);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "enqueueing tone to full queue");
+
+	cwret = LIBCW_TEST_FUT(cw_tq_set_capacity_internal)(tq, capacity - 1, capacity - 1);
+	cte->expect_op_int(cte, CW_FAILURE, "==", cwret, "setting capacity below length of queue");
+
+
+	bool dequeue_failure = false;
+	for (size_t i = 0; i < capacity; i++) {
+		LIBCW_TEST_FUT(cw_tq_dequeue_internal)(tq, &tone);
+		if (!cte->expect_op_int_errors_only(cte, (int) i + 1, "==", tone.duration, "duration of dequeued tone #%zu", i)) {
+			dequeue_failure = true;
+			break;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", dequeue_failure, "order of dequeued tones");
+	cte->expect_op_int(cte, 0, "==", cw_tq_length_internal(tq), "length of queue after dequeueing all tones");
+
+	cw_tq_delete_internal(&tq);
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
+
+
+
+
+/**
+   @brief Test storing tones in tone descriptors
+
+   Properties of a tone known at enqueueing must survive the round
+   trip through descriptor, derived properties must be reset.
+*/
+cwt_retv test_cw_tq_tone_desc_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, "%s", __func__);
+
+	cte->expect_op_int(cte, 8, ">=", (int) sizeof (cw_tone_desc_t), "size of tone descriptor");
+
+	const cw_tone_slope_mode_t slope_modes[] = {
+		CW_SLOPE_MODE_STANDARD_SLOPES,
+		CW_SLOPE_MODE_NO_SLOPES,
+		CW_SLOPE_MODE_RISING_SLOPE,
+		CW_SLOPE_MODE_FALLING_SLOPE
+	};
+	const size_t n_slope_modes = sizeof (slope_modes) / sizeof (slope_modes[0]);
+
+	bool failure = false;
+	for (size_t i = 0; i < n_slope_modes && !failure; i++) {
+		cw_tone_t tone;
+		CW_TONE_INIT(&tone, CW_FREQUENCY_MAX - (int) i, 1000000 + (int) i, slope_modes[i]);
+		tone.is_forever = i & 1;
+		tone.is_first = i & 2;
+		tone.debug_id = 'a' + (char) i;
+		tone.n_samples = 100;
+		tone.sample_iterator = 10;
+		tone.rising_slope_n_samples = 20;
+		tone.falling_slope_n_samples = 30;
+
+		cw_tone_desc_t desc;
+		LIBCW_TEST_FUT(cw_tq_tone_to_desc_internal)(&desc, &tone);
+		cw_tone_t readback;
+		LIBCW_TEST_FUT(cw_tq_desc_to_tone_internal)(&readback, &desc);
+
+		failure = !cte->expect_op_int_errors_only(cte, tone.frequency, "==", readback.frequency, "frequency #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, tone.duration, "==", readback.duration, "duration #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, tone.slope_mode, "==", readback.slope_mode, "slope mode #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, tone.is_forever, "==", readback.is_forever, "is forever #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, tone.is_first, "==", readback.is_first, "is first #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, tone.debug_id, "==", readback.debug_id, "debug id #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, 0, "==", readback.n_samples, "n samples #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, 0, "==", readback.sample_iterator, "sample iterator #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, 0, "==", readback.rising_slope_n_samples, "rising slope #%zu", i)
+			|| !cte->expect_op_int_errors_only(cte, 0, "==", readback.falling_slope_n_samples, "falling slope #%zu", i);
+	}
+	cte->expect_op_int(cte, false, "==", failure, "round trip of tone through descriptor");
+
+	cte->print_test_footer(cte, __func__);
+
+	return cwt_retv_ok;
+}
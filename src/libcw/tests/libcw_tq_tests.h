@@ -40,6 +40,8 @@ cwt_retv test_cw_tq_properties_empty(cw_test_executor_t * cte);
 cwt_retv test_cw_tq_properties_full(cw_test_executor_t * cte);
 
 cwt_retv test_cw_tq_dequeue_internal_returns(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_grow_internal(cw_test_executor_t * cte);
+cwt_retv test_cw_tq_tone_desc_internal(cw_test_executor_t * cte);
 
 
 
@@ -23,9 +23,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 
 
@@ -38,6 +41,7 @@
 
 #include "libcw_debug.h"
 #include "libcw_key.h"
+#include "libcw_scheduler.h"
 #include "libcw_utils.h"
 #include "libcw_utils_tests.h"
 #include "test_framework.h"
@@ -216,6 +220,215 @@ int test_cw_usecs_to_timespec_internal(cw_test_executor_t * cte)
 
 
 
+/**
+   Test that sleeping on absolute timeline doesn't accumulate delays
+*/
+int test_cw_sleep_on_timeline_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int interval = 10 * 1000; /* [microseconds] */
+	const int n_intervals = 20;
+
+	/* Timeline that was never set is restarted from current time. */
+	struct timespec timeline = { 0 };
+	struct timespec start = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	LIBCW_TEST_FUT(cw_sleep_on_timeline_internal)(&timeline, interval);
+	const long long first_delta = (timeline.tv_sec - start.tv_sec) * 1000000LL + (timeline.tv_nsec - start.tv_nsec) / 1000;
+	cte->expect_op_int(cte, interval, "<=", (int) first_delta, "restart of timeline (lower bound)");
+	cte->expect_op_int(cte, 2 * interval, ">", (int) first_delta, "restart of timeline (upper bound)");
+
+	/* Consecutive intervals end exactly at multiples of interval. */
+	const struct timespec origin = timeline;
+	for (int i = 0; i < n_intervals; i++) {
+		cw_sleep_on_timeline_internal(&timeline, interval);
+	}
+	const long long delta = (timeline.tv_sec - origin.tv_sec) * 1000000LL + (timeline.tv_nsec - origin.tv_nsec) / 1000;
+	cte->expect_op_int(cte, n_intervals * interval, "==", (int) delta, "advancing of timeline");
+
+	struct timespec now = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const bool reached = now.tv_sec > timeline.tv_sec || (now.tv_sec == timeline.tv_sec && now.tv_nsec >= timeline.tv_nsec);
+	cte->expect_op_int(cte, true, "==", reached, "end of timeline has been reached");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+static volatile sig_atomic_t test_sleep_n_signals = 0;
+
+
+
+
+static void test_sleep_signal_handler(__attribute__((unused)) int signal_number)
+{
+	test_sleep_n_signals++;
+}
+
+
+
+
+typedef struct {
+	pthread_t target;
+	bool do_run;
+} test_sleep_interrupter_t;
+
+
+
+
+/* Interrupt sleep of target thread with a signal every millisecond. */
+static void * test_sleep_interrupter(void * arg)
+{
+	test_sleep_interrupter_t * interrupter = (test_sleep_interrupter_t *) arg;
+	while (__atomic_load_n(&interrupter->do_run, __ATOMIC_ACQUIRE)) {
+		pthread_kill(interrupter->target, SIGUSR1);
+		usleep(1000);
+	}
+	return NULL;
+}
+
+
+
+
+/**
+   Test that sleeping is neither shortened nor restarted by signals
+*/
+int test_cw_usleep_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	const int duration = 50 * 1000; /* [microseconds] */
+
+	/* No SA_RESTART: signals interrupt sleeping. */
+	struct sigaction action = { 0 };
+	struct sigaction old_action = { 0 };
+	action.sa_handler = test_sleep_signal_handler;
+	action.sa_flags = 0;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, &old_action);
+
+	test_sleep_n_signals = 0;
+	test_sleep_interrupter_t interrupter = { .target = pthread_self(), .do_run = true };
+	pthread_t thread_id;
+	pthread_create(&thread_id, NULL, test_sleep_interrupter, &interrupter);
+
+	struct timespec start = { 0 };
+	struct timespec end = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	LIBCW_TEST_FUT(cw_usleep_internal)(duration);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	__atomic_store_n(&interrupter.do_run, false, __ATOMIC_RELEASE);
+	pthread_join(thread_id, NULL);
+	sigaction(SIGUSR1, &old_action, NULL);
+
+	const int64_t elapsed = LIBCW_TEST_FUT(cw_timespec_diff_usecs_internal)(&start, &end);
+	cte->expect_op_int(cte, 0, "<", (int) test_sleep_n_signals, "sleep has been interrupted by signals");
+	cte->expect_op_int(cte, duration, "<=", (int) elapsed, "interrupted sleep is not shortened");
+	cte->expect_op_int(cte, duration + 20 * 1000, ">", (int) elapsed, "interrupted sleep is not restarted");
+
+	/* Deadline in the past. */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	struct timespec deadline = start;
+	LIBCW_TEST_FUT(cw_timespec_add_usecs_internal)(&deadline, -duration);
+	LIBCW_TEST_FUT(cw_sleep_until_internal)(&deadline);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cte->expect_op_int(cte, 1000, ">", (int) cw_timespec_diff_usecs_internal(&start, &end), "sleeping until past deadline");
+	cte->expect_op_int(cte, -duration, "==", (int) cw_timespec_diff_usecs_internal(&start, &deadline), "moving point in time back");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
+typedef struct {
+	int id;
+	int * order;
+	int * n_calls;
+	int64_t called_at;
+} scheduler_test_data_t;
+
+
+
+
+static void test_scheduler_callback(void * arg)
+{
+	scheduler_test_data_t * data = (scheduler_test_data_t *) arg;
+	data->called_at = cw_scheduler_now_internal();
+	data->order[(*data->n_calls)++] = data->id;
+}
+
+
+
+
+/**
+   Test that deadlines are served in order of time, not in order of
+   scheduling, and that cancelled or moved deadlines are respected
+*/
+int test_cw_scheduler_schedule_internal(cw_test_executor_t * cte)
+{
+	cte->print_test_header(cte, __func__);
+
+	enum { n_entries = 5 };
+	/* Deadlines relative to start [microseconds]. Entry 3 is
+	   cancelled, entry 4 is moved before all others. */
+	const int64_t deadlines[n_entries] = { 40000, 10000, 30000, 20000, 50000 };
+	const int expected_order[] = { 4, 1, 2, 0 };
+
+	int order[n_entries] = { 0 };
+	int n_calls = 0;
+	scheduler_test_data_t data[n_entries];
+	cw_scheduler_entry_t entries[n_entries];
+
+	const int64_t start = cw_scheduler_now_internal();
+	for (int i = 0; i < n_entries; i++) {
+		data[i] = (scheduler_test_data_t) { .id = i, .order = order, .n_calls = &n_calls, .called_at = 0 };
+		cw_scheduler_entry_init_internal(&entries[i], test_scheduler_callback, &data[i]);
+		const bool scheduled = LIBCW_TEST_FUT(cw_scheduler_schedule_internal)(&entries[i], start + deadlines[i]);
+		cte->expect_op_int(cte, true, "==", scheduled, "scheduling entry %d", i);
+	}
+	LIBCW_TEST_FUT(cw_scheduler_cancel_internal)(&entries[3]);
+	LIBCW_TEST_FUT(cw_scheduler_schedule_internal)(&entries[4], start + 5000);
+
+	usleep(100 * 1000);
+	/* Make sure that the last callback has returned. */
+	for (int i = 0; i < n_entries; i++) {
+		cw_scheduler_cancel_internal(&entries[i]);
+	}
+
+	cte->expect_op_int(cte, 4, "==", n_calls, "count of calls");
+	bool order_failure = false;
+	for (int i = 0; i < 4; i++) {
+		if (expected_order[i] != order[i]) {
+			order_failure = true;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", order_failure, "order of calls");
+
+	bool early_failure = false;
+	for (int i = 0; i < 3; i++) {
+		if (data[i].called_at < start + deadlines[i]) {
+			early_failure = true;
+		}
+	}
+	cte->expect_op_int(cte, false, "==", early_failure, "no call before deadline");
+
+	cte->print_test_footer(cte, __func__);
+
+	return 0;
+}
+
+
+
+
 /**
    @reviewed on 2019-10-13
 */
@@ -17,6 +17,9 @@
 int test_cw_timestamp_compare_internal(cw_test_executor_t * cte);
 int test_cw_timestamp_validate_internal(cw_test_executor_t * cte);
 int test_cw_usecs_to_timespec_internal(cw_test_executor_t * cte);
+int test_cw_sleep_on_timeline_internal(cw_test_executor_t * cte);
+int test_cw_usleep_internal(cw_test_executor_t * cte);
+int test_cw_scheduler_schedule_internal(cw_test_executor_t * cte);
 int test_cw_version_internal(cw_test_executor_t * cte);
 int test_cw_license_internal(cw_test_executor_t * cte);
 
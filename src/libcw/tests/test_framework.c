@@ -45,6 +45,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
 #ifndef __FreeBSD__
 #include <sys/sysinfo.h>
 #endif
@@ -118,6 +122,11 @@ static bool cw_test_expect_valid_pointer_errors_only(struct cw_test_executor_t *
 
 static void cw_assert2(struct cw_test_executor_t * self, bool condition, const char * fmt, ...) __attribute__ ((format (printf, 3, 4)));
 
+static bool cw_test_record_perf(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, perf_direction_t direction, double value);
+static bool cw_test_record_perf_latencies(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, double * values, size_t n_values);
+static void cw_test_print_perf_results(cw_test_executor_t * self);
+static cwt_retv cw_test_save_perf_results(cw_test_executor_t * self);
+
 
 static void cw_test_print_test_header(cw_test_executor_t * self, const char * fmt, ...) __attribute__ ((format (printf, 2, 3)));
 static void cw_test_print_test_footer(cw_test_executor_t * self, const char * test_name);
@@ -159,6 +168,32 @@ static unsigned int cw_test_get_total_errors_count(cw_test_executor_t * cte);
 static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * test_set);
 static cwt_retv iterate_over_sound_systems(cw_test_executor_t * cte, cw_test_set_t * test_set, int topic);
 static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_object_t * test_objects, int topic, cw_sound_system sound_system);
+static bool test_object_is_selected(cw_test_executor_t * cte, const cw_test_object_t * test_obj);
+
+
+
+
+/* Test object executed for given topic and sound system by a single
+   worker process in parallel mode of test executor. */
+typedef struct {
+	cw_test_object_t * test_object;
+	int topic;
+	cw_sound_system sound_system;
+
+	pid_t pid;
+	bool is_started;
+	bool is_finished;
+	bool is_printed;
+
+	/* Output of worker and its stats of tests. */
+	FILE * output;
+	FILE * stats;
+} cw_test_job_t;
+
+static cwt_retv cw_test_main_test_loop_parallel(cw_test_executor_t * cte, cw_test_set_t * test_sets);
+static int cw_test_collect_jobs(cw_test_executor_t * cte, cw_test_set_t * test_sets, cw_test_job_t * jobs, int capacity);
+static cwt_retv cw_test_start_job(cw_test_executor_t * cte, cw_test_job_t * job);
+static cwt_retv cw_test_finish_job(cw_test_executor_t * cte, cw_test_job_t * job, int status);
 
 
 
@@ -261,6 +296,10 @@ static int select_sound_systems(cw_test_executor_t * cte)
 			break;
 		case CW_AUDIO_NONE:
 		case CW_AUDIO_SOUNDCARD:
+		case CW_AUDIO_FILE:
+		case CW_AUDIO_JACK:
+		case CW_AUDIO_PIPEWIRE:
+		case CW_AUDIO_RTP:
 		default:
 			kite_log(cte, LOG_ERR, "%s:%d: unexpected sound system %d\n", __func__, __LINE__, sound_system);
 			return -1;
@@ -320,6 +359,13 @@ int cw_test_process_args(cw_test_executor_t * cte, int argc, char * const argv[]
 		kite_log(cte, LOG_ERR, "%s:%d: failed to select topics to test\n", __func__, __LINE__);
 		return -1;
 	}
+	if ('\0' != cte->config->test_baseline_path[0]) {
+		char error[256] = { 0 };
+		if (0 != perf_results_load(&cte->perf_baseline, cte->config->test_baseline_path, error, sizeof (error))) {
+			kite_log(cte, LOG_ERR, "%s:%d: failed to load baseline of benchmarks: %s\n", __func__, __LINE__, error);
+			return -1;
+		}
+	}
 
 	return 0;
 }
@@ -821,6 +867,97 @@ void cw_assert2(struct cw_test_executor_t * self, bool condition, const char * f
 
 
 
+bool cw_test_record_perf(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, perf_direction_t direction, double value)
+{
+	perf_result_t result;
+	memset(&result, 0, sizeof (result));
+	snprintf(result.fut, sizeof (result.fut), "%s", fut);
+	snprintf(result.metric, sizeof (result.metric), "%s", metric);
+	snprintf(result.unit, sizeof (result.unit), "%s", unit);
+	result.direction = direction;
+	result.value = value;
+
+	/* Tolerance from baseline is carried over to new baseline, so
+	   that tolerances adjusted in baseline file are kept. */
+	const perf_result_t * baseline = perf_results_find(&self->perf_baseline, result.fut, result.metric);
+	if (self->config->test_tolerance >= 0.0) {
+		result.tolerance = self->config->test_tolerance;
+	} else if (NULL != baseline) {
+		result.tolerance = baseline->tolerance;
+	} else {
+		result.tolerance = LIBCW_TEST_PERF_TOLERANCE_PERCENT;
+	}
+
+	self->n_perf_records++;
+	if (0 != perf_results_add(&self->perf_results, &result)) {
+		self->log_error(self, "Failed to record result of benchmark of %s\n", result.fut);
+	}
+
+	char va_buf[sizeof (result.fut) + sizeof (result.metric) + sizeof (result.unit) + 32] = { 0 };
+	snprintf(va_buf, sizeof (va_buf), "%s: %s = %g %s", result.fut, result.metric, result.value, result.unit);
+	char msg_buf[MSG_BUF_SIZE] = { 0 };
+	const int message_len = msg_buff_prepare(self, msg_buf, sizeof (msg_buf), va_buf);
+
+	double change = 0.0;
+	const perf_comparison_t comparison = perf_result_compare(&result, baseline, result.tolerance, &change);
+	if (perf_comparison_no_baseline == comparison) {
+		self->log_info(self, "%s\n", msg_buf);
+		return true;
+	} else if (perf_comparison_regression == comparison) {
+		self->stats->failures++;
+		cw_test_append_status_string(self, msg_buf, message_len, get_test_result_string(test_result_fail));
+		self->log_error(self, "%s\n", msg_buf);
+		self->log_error(self, "   ***   regression: baseline %g %s, change %+.1f%%, tolerance %g%%   ***\n",
+				baseline->value, baseline->unit, change, result.tolerance);
+		return false;
+	} else {
+		self->stats->successes++;
+		cw_test_append_status_string(self, msg_buf, message_len, get_test_result_string(test_result_pass));
+		self->log_info(self, "%s\n", msg_buf);
+		if (perf_comparison_improvement == comparison) {
+			self->log_info(self, "   improvement: baseline %g %s, change %+.1f%%, consider updating baseline\n",
+				       baseline->value, baseline->unit, change);
+		}
+		return true;
+	}
+}
+
+
+
+
+bool cw_test_record_perf_latencies(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, double * values, size_t n_values)
+{
+	if (0 == n_values) {
+		self->log_error(self, "No latencies of %s to record\n", fut);
+		return true;
+	}
+
+	const struct {
+		const char * suffix;
+		double percentile;
+	} levels[] = {
+		{ "p50", 50.0 },
+		{ "p90", 90.0 },
+		{ "p99", 99.0 },
+		/* No maximum: a single preemption of test process
+		   would make it a regression. */
+	};
+
+	bool no_regression = true;
+	for (size_t i = 0; i < sizeof (levels) / sizeof (levels[0]); i++) {
+		char name[PERF_RESULT_NAME_SIZE] = { 0 };
+		snprintf(name, sizeof (name), "%s %s", metric, levels[i].suffix);
+		const double value = perf_percentile(values, n_values, levels[i].percentile);
+		if (!self->record_perf(self, fut, name, unit, perf_direction_lower_is_better, value)) {
+			no_regression = false;
+		}
+	}
+	return no_regression;
+}
+
+
+
+
 /**
    See whether or not a given test topic was requested from command line. By
    default, if not specified in command line, all test topics are requested.
@@ -888,6 +1025,10 @@ static bool test_topic_is_in_cmdline_options(cw_test_executor_t * self, int libc
 
 	case CW_AUDIO_NONE:
 	case CW_AUDIO_SOUNDCARD:
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_JACK:
+	case CW_AUDIO_PIPEWIRE:
+	case CW_AUDIO_RTP:
 	default:
 		kite_log(self, LOG_ERR, "%s:%d: Unexpected sound system %d\n", __func__, __LINE__, sound_system);
 		exit(EXIT_FAILURE);
@@ -1109,6 +1250,16 @@ static void cw_test_set_current_topic_and_gen_config(cw_test_executor_t * self,
 	   program config to test executor config. For now this is ad-hoc
 	   solution. */
 	self->current_gen_conf.alsa_period_size = self->config->gen_conf.alsa_period_size;
+	self->current_gen_conf.alsa_mmap = self->config->gen_conf.alsa_mmap;
+	self->current_gen_conf.alsa_low_latency = self->config->gen_conf.alsa_low_latency;
+	self->current_gen_conf.sound_nonblocking = self->config->gen_conf.sound_nonblocking;
+	self->current_gen_conf.pa_async = self->config->gen_conf.pa_async;
+	self->current_gen_conf.sample_format = self->config->gen_conf.sample_format;
+	self->current_gen_conf.n_channels = self->config->gen_conf.n_channels;
+	self->current_gen_conf.sample_rate = self->config->gen_conf.sample_rate;
+	self->current_gen_conf.device_pool = self->config->gen_conf.device_pool;
+	self->current_gen_conf.console_timeline = self->config->gen_conf.console_timeline;
+	self->current_gen_conf.null_virtual_clock = self->config->gen_conf.null_virtual_clock;
 
 	self->current_gen_conf.sound_device[0] = '\0'; /* Clear value from previous run of test. */
 	switch (self->current_gen_conf.sound_system) {
@@ -1127,6 +1278,10 @@ static void cw_test_set_current_topic_and_gen_config(cw_test_executor_t * self,
 		break;
 	case CW_AUDIO_NONE:
 	case CW_AUDIO_SOUNDCARD:
+	case CW_AUDIO_FILE:
+	case CW_AUDIO_JACK:
+	case CW_AUDIO_PIPEWIRE:
+	case CW_AUDIO_RTP:
 	default:
 		/* Technically speaking this is an error, but we shouldn't
 		   get here because test binary won't accept such sound
@@ -1231,12 +1386,100 @@ void cw_test_print_test_stats(cw_test_executor_t * self)
 		test_duration / 60, test_duration % 60);
 #endif
 
+	cw_test_print_perf_results(self);
+
 	return;
 }
 
 
 
 
+/**
+   @brief Print results of benchmarks compared with baseline
+
+   Results are grouped by function under test. Rows with regressions
+   are highlighted with arrows, like rows with errors in table of
+   statistics of tests.
+*/
+static void cw_test_print_perf_results(cw_test_executor_t * self)
+{
+	if (0 == self->perf_results.n_results) {
+		return;
+	}
+
+	fprintf(self->file_err, "\n\nlibcw tests: Results of benchmarks\n\n");
+	fprintf(self->file_err, "   %-32s %-20s %14s %14s %9s\n", "function under test", "metric", "value", "baseline", "change");
+
+	int n_regressions = 0;
+	int n_compared = 0;
+	for (size_t i = 0; i < self->perf_results.n_results; i++) {
+		const perf_result_t * first = &self->perf_results.results[i];
+		bool is_printed = false;
+		for (size_t j = 0; j < i; j++) {
+			if (0 == strcmp(self->perf_results.results[j].fut, first->fut)) {
+				is_printed = true;
+				break;
+			}
+		}
+		if (is_printed) {
+			continue;
+		}
+
+		/* All results of the function, in order of recording. */
+		for (size_t j = i; j < self->perf_results.n_results; j++) {
+			const perf_result_t * result = &self->perf_results.results[j];
+			if (0 != strcmp(result->fut, first->fut)) {
+				continue;
+			}
+			const perf_result_t * baseline = perf_results_find(&self->perf_baseline, result->fut, result->metric);
+			double change = 0.0;
+			const perf_comparison_t comparison = perf_result_compare(result, baseline, result->tolerance, &change);
+			const char * indicator = perf_comparison_regression == comparison ? "->" : "  ";
+			if (perf_comparison_regression == comparison) {
+				n_regressions++;
+			}
+
+			char value[32] = { 0 };
+			snprintf(value, sizeof (value), "%g %s", result->value, result->unit);
+			if (perf_comparison_no_baseline == comparison) {
+				fprintf(self->file_err, "%s %-32s %-20s %14s %14s %9s\n", indicator, result->fut, result->metric, value, "-", "-");
+			} else {
+				n_compared++;
+				char baseline_value[32] = { 0 };
+				snprintf(baseline_value, sizeof (baseline_value), "%g %s", baseline->value, baseline->unit);
+				fprintf(self->file_err, "%s %-32s %-20s %14s %14s %+8.1f%%\n", indicator, result->fut, result->metric, value, baseline_value, change);
+			}
+		}
+	}
+	fprintf(self->file_err, "Results compared with baseline: %d, regressions: %d\n", n_compared, n_regressions);
+}
+
+
+
+
+/**
+   @brief Write results of benchmarks as new baseline, if requested in command line
+
+   @return cwt_retv_ok on success or if baseline was not requested
+   @return cwt_retv_err on failure
+*/
+static cwt_retv cw_test_save_perf_results(cw_test_executor_t * self)
+{
+	if ('\0' == self->config->test_baseline_output_path[0]) {
+		return cwt_retv_ok;
+	}
+	if (0 != perf_results_save(&self->perf_results, self->config->test_baseline_output_path)) {
+		self->log_error(self, "Failed to write baseline of benchmarks to '%s'\n", self->config->test_baseline_output_path);
+		return cwt_retv_err;
+	}
+	kite_log(self, LOG_INFO, "Results of %zu benchmarks have been written to '%s'\n",
+		 self->perf_results.n_results, self->config->test_baseline_output_path);
+	return cwt_retv_ok;
+}
+
+
+
+
 void cw_test_init(cw_test_executor_t * self, FILE * stdout, FILE * stderr, const char * msg_prefix)
 {
 	memset(self, 0, sizeof (cw_test_executor_t));
@@ -1267,6 +1510,11 @@ void cw_test_init(cw_test_executor_t * self, FILE * stdout, FILE * stderr, const
 
 	self->assert2 = cw_assert2;
 
+	self->record_perf = cw_test_record_perf;
+	self->record_perf_latencies = cw_test_record_perf_latencies;
+	perf_results_init(&self->perf_results);
+	perf_results_init(&self->perf_baseline);
+
 	self->print_test_header = cw_test_print_test_header;
 	self->print_test_footer = cw_test_print_test_footer;
 
@@ -1301,6 +1549,8 @@ void cw_test_init(cw_test_executor_t * self, FILE * stdout, FILE * stderr, const
 
 void cw_test_deinit(cw_test_executor_t * self)
 {
+	perf_results_deinit(&self->perf_results);
+	perf_results_deinit(&self->perf_baseline);
 	cw_config_delete(&self->config);
 }
 
@@ -1483,6 +1733,10 @@ static int print_active_sound_systems(cw_test_executor_t * cte)
 			break;
 		case CW_AUDIO_NONE:
 		case CW_AUDIO_SOUNDCARD:
+		case CW_AUDIO_FILE:
+		case CW_AUDIO_JACK:
+		case CW_AUDIO_PIPEWIRE:
+		case CW_AUDIO_RTP:
 		default:
 			kite_log(cte, LOG_ERR, "%s:%d: unexpected sound system %d\n", __func__, __LINE__, s);
 			return -1;
@@ -1569,6 +1823,20 @@ void cw_test_print_test_options(cw_test_executor_t * self)
 		self->log_info(self, "Single function to be tested: '%s'\n", self->config->test_function_name);
 	}
 
+	if (self->config->test_jobs > 1) {
+		self->log_info(self, "Parallel worker processes: %d\n", self->config->test_jobs);
+	}
+	if (self->config->gen_conf.null_virtual_clock) {
+		self->log_info(self, "Null sound system uses virtual clock\n");
+	}
+	if ('\0' != self->config->test_baseline_path[0]) {
+		self->log_info(self, "Baseline of benchmarks: '%s' (%zu results)\n",
+			       self->config->test_baseline_path, self->perf_baseline.n_results);
+	}
+	if (self->config->test_tolerance >= 0.0) {
+		self->log_info(self, "Tolerance of benchmarks: %g%%\n", self->config->test_tolerance);
+	}
+
 	fflush(self->file_out);
 }
 
@@ -1626,6 +1894,13 @@ cwt_retv cw_test_main_test_loop(cw_test_executor_t * cte, cw_test_set_t * test_s
 	sysinfo(&sys_info);
 	cte->uptime_begin = sys_info.uptime;
 #endif
+	if (cte->config->test_jobs > 1) {
+		if (cwt_retv_ok != cw_test_main_test_loop_parallel(cte, test_sets)) {
+			return cwt_retv_err;
+		}
+		return cw_test_save_perf_results(cte);
+	}
+
 	int set = 0;
 	while (LIBCW_TEST_SET_VALID == test_sets[set].set_valid) {
 		cw_test_set_t * test_set = &test_sets[set];
@@ -1636,12 +1911,300 @@ cwt_retv cw_test_main_test_loop(cw_test_executor_t * cte, cw_test_set_t * test_s
 		set++;
 	}
 
+	return cw_test_save_perf_results(cte);
+}
+
+
+
+
+/**
+   @brief Execute test sets in parallel worker processes
+
+   Each test object is executed for each of its topics and sound
+   systems by a separate child process, with its own generators and
+   other libcw objects. At most cw_config_t::test_jobs processes are running at
+   the same time. Tests of sound systems other than Null use real
+   devices, so only one such process is running at a time.
+
+   Output of each process is collected in temporary file and is printed
+   when the process ends, in the same order in which the tests would be
+   executed sequentially. Stats of tests and results of benchmarks
+   from each process are added to stats and results of @p cte.
+
+   The function must be called before libcw starts any of its threads:
+   only calling thread exists in a child process after fork().
+*/
+static cwt_retv cw_test_main_test_loop_parallel(cw_test_executor_t * cte, cw_test_set_t * test_sets)
+{
+	const int capacity = cw_test_collect_jobs(cte, test_sets, NULL, 0);
+	cw_test_job_t * jobs = (cw_test_job_t *) calloc((size_t) capacity + 1, sizeof (cw_test_job_t));
+	if (NULL == jobs) {
+		cte->log_error(cte, "Failed to allocate list of test jobs\n");
+		return cwt_retv_err;
+	}
+	const int n_jobs = cw_test_collect_jobs(cte, test_sets, jobs, capacity);
+	kite_log(cte, LOG_INFO, "Executing %d test jobs in %d worker processes\n", n_jobs, cte->config->test_jobs);
+
+	cwt_retv retv = cwt_retv_ok;
+	int n_running = 0;
+	bool device_is_busy = false; /* Is a worker testing non-Null sound system running? */
+	int n_printed = 0;
+
+	while (n_printed < n_jobs) {
+
+		/* Start as many jobs as we can. */
+		for (int i = 0; i < n_jobs && n_running < cte->config->test_jobs; i++) {
+			cw_test_job_t * job = &jobs[i];
+			if (job->is_started) {
+				continue;
+			}
+			const bool needs_device = CW_AUDIO_NULL != job->sound_system;
+			if (needs_device && device_is_busy) {
+				continue;
+			}
+			if (cwt_retv_ok != cw_test_start_job(cte, job)) {
+				retv = cwt_retv_err;
+				job->is_finished = true;
+				continue;
+			}
+			n_running++;
+			if (needs_device) {
+				device_is_busy = true;
+			}
+		}
+
+		/* Wait for any job to end. */
+		if (n_running > 0) {
+			int status = 0;
+			const pid_t pid = waitpid(-1, &status, 0);
+			if (-1 == pid) {
+				if (EINTR == errno) {
+					continue;
+				}
+				cte->log_error(cte, "Failed to wait for test jobs: %s\n", strerror(errno));
+				free(jobs);
+				return cwt_retv_err;
+			}
+			for (int i = 0; i < n_jobs; i++) {
+				cw_test_job_t * job = &jobs[i];
+				if (job->is_started && !job->is_finished && job->pid == pid) {
+					if (cwt_retv_ok != cw_test_finish_job(cte, job, status)) {
+						retv = cwt_retv_err;
+					}
+					n_running--;
+					if (CW_AUDIO_NULL != job->sound_system) {
+						device_is_busy = false;
+					}
+					break;
+				}
+			}
+		}
+
+		/* Print outputs of finished jobs, in order of jobs. */
+		while (n_printed < n_jobs && jobs[n_printed].is_finished) {
+			cw_test_job_t * job = &jobs[n_printed];
+			if (NULL != job->output) {
+				rewind(job->output);
+				char buffer[4096];
+				size_t n = 0;
+				while (0 != (n = fread(buffer, 1, sizeof (buffer), job->output))) {
+					fwrite(buffer, 1, n, cte->file_out);
+				}
+				fclose(job->output);
+				job->output = NULL;
+			}
+			job->is_printed = true;
+			n_printed++;
+		}
+		fflush(cte->file_out);
+	}
+
+	free(jobs);
+	return retv;
+}
+
+
+
+
+/**
+   @brief Make list of jobs for parallel execution of test sets
+
+   Jobs are collected in the same order in which test sets, topics,
+   sound systems and test objects are iterated over in sequential
+   execution. Test objects that won't be executed (because of options
+   of test program) don't get a job.
+
+   Pass NULL @p jobs to only count the jobs.
+
+   @return count of jobs
+*/
+static int cw_test_collect_jobs(cw_test_executor_t * cte, cw_test_set_t * test_sets, cw_test_job_t * jobs, int capacity)
+{
+	int n_jobs = 0;
+	for (int set = 0; LIBCW_TEST_SET_VALID == test_sets[set].set_valid; set++) {
+		cw_test_set_t * test_set = &test_sets[set];
+		for (int i = 0; cte->configuration.topics[i] != LIBCW_TEST_TOPIC_MAX; i++) {
+			const int topic = cte->configuration.topics[i];
+			const int topics_max = sizeof (test_set->tested_areas) / sizeof (test_set->tested_areas[0]);
+			if (!cw_test_test_topic_is_member(cte, topic, test_set->tested_areas, topics_max)) {
+				continue;
+			}
+			for (cw_sound_system sound_system = CW_SOUND_SYSTEM_FIRST; sound_system <= CW_SOUND_SYSTEM_LAST; sound_system++) {
+				if (!cte->configuration.sound_systems[sound_system].active) {
+					continue;
+				}
+				const int systems_max = sizeof (test_set->tested_sound_systems) / sizeof (test_set->tested_sound_systems[0]);
+				if (!cw_test_sound_system_is_member(cte, sound_system, test_set->tested_sound_systems, systems_max)) {
+					continue;
+				}
+				for (cw_test_object_t * test_obj = test_set->test_objects; NULL != test_obj->test_function; test_obj++) {
+					if (!test_object_is_selected(cte, test_obj)) {
+						continue;
+					}
+					if (NULL != jobs && n_jobs < capacity) {
+						jobs[n_jobs].test_object = test_obj;
+						jobs[n_jobs].topic = topic;
+						jobs[n_jobs].sound_system = sound_system;
+					}
+					n_jobs++;
+				}
+			}
+		}
+	}
+
+	return NULL == jobs ? n_jobs : (n_jobs < capacity ? n_jobs : capacity);
+}
+
+
+
+
+/**
+   @brief Start worker process executing test objects of a job
+
+   @return cwt_retv_ok if worker has been started
+   @return cwt_retv_err otherwise
+*/
+static cwt_retv cw_test_start_job(cw_test_executor_t * cte, cw_test_job_t * job)
+{
+	job->output = tmpfile();
+	job->stats = tmpfile();
+	if (NULL == job->output || NULL == job->stats) {
+		cte->log_error(cte, "Failed to create temporary files for test job: %s\n", strerror(errno));
+		if (NULL != job->output) {
+			fclose(job->output);
+			job->output = NULL;
+		}
+		if (NULL != job->stats) {
+			fclose(job->stats);
+			job->stats = NULL;
+		}
+		return cwt_retv_err;
+	}
+
+	/* Don't let child process print again data buffered in parent. */
+	fflush(NULL);
+
+	const pid_t pid = fork();
+	if (-1 == pid) {
+		cte->log_error(cte, "Failed to start worker process: %s\n", strerror(errno));
+		return cwt_retv_err;
+	}
+
+	if (0 == pid) {
+		/* Worker process. */
+		dup2(fileno(job->output), STDOUT_FILENO);
+		dup2(fileno(job->output), STDERR_FILENO);
+
+		/* Parent may have already collected stats and results
+		   of other jobs. Worker reports only its own. */
+		memset(cte->all_stats, 0, sizeof (cte->all_stats));
+		perf_results_deinit(&cte->perf_results);
+
+		/* Single test object, followed by guard element. */
+		cw_test_object_t test_objects[2];
+		memset(test_objects, 0, sizeof (test_objects));
+		test_objects[0] = *job->test_object;
+		const cwt_retv retv = iterate_over_test_objects(cte, test_objects, job->topic, job->sound_system);
+
+		fwrite(cte->all_stats, sizeof (cte->all_stats), 1, job->stats);
+		fwrite(&cte->perf_results.n_results, sizeof (cte->perf_results.n_results), 1, job->stats);
+		if (0 != cte->perf_results.n_results) {
+			fwrite(cte->perf_results.results, sizeof (perf_result_t), cte->perf_results.n_results, job->stats);
+		}
+		/* _exit() skips atexit() handler of libcw that writes
+		   queued debug messages. */
+		cw_debug_flush();
+		fflush(NULL);
+		/* Don't call functions registered with atexit(), they
+		   are for main process. */
+		_exit(cwt_retv_ok == retv ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	job->pid = pid;
+	job->is_started = true;
 	return cwt_retv_ok;
 }
 
 
 
 
+/**
+   @brief Collect results of worker process that has ended
+
+   @param[in] cte test executor
+   @param[in] job job executed by the process
+   @param[in] status status of process returned by waitpid()
+
+   @return cwt_retv_ok if worker has completed its job
+   @return cwt_retv_err if test framework has failed in the worker, or the worker has crashed
+*/
+static cwt_retv cw_test_finish_job(cw_test_executor_t * cte, cw_test_job_t * job, int status)
+{
+	job->is_finished = true;
+
+	cw_test_stats_t all_stats[CW_SOUND_SYSTEM_LAST + 1][LIBCW_TEST_TOPIC_MAX];
+	rewind(job->stats);
+	const bool has_stats = 1 == fread(all_stats, sizeof (all_stats), 1, job->stats);
+	size_t n_results = 0;
+	if (has_stats && 1 == fread(&n_results, sizeof (n_results), 1, job->stats)) {
+		perf_result_t result;
+		for (size_t i = 0; i < n_results && 1 == fread(&result, sizeof (result), 1, job->stats); i++) {
+			if (0 != perf_results_add(&cte->perf_results, &result)) {
+				cte->log_error(cte, "Failed to collect result of benchmark of %s\n", result.fut);
+			}
+		}
+	}
+	fclose(job->stats);
+	job->stats = NULL;
+
+	if (has_stats) {
+		for (int sound = 0; sound <= CW_SOUND_SYSTEM_LAST; sound++) {
+			for (int topic = 0; topic < LIBCW_TEST_TOPIC_MAX; topic++) {
+				cte->all_stats[sound][topic].successes += all_stats[sound][topic].successes;
+				cte->all_stats[sound][topic].failures += all_stats[sound][topic].failures;
+			}
+		}
+	}
+
+	if (WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status) && has_stats) {
+		return cwt_retv_ok;
+	}
+
+	if (WIFSIGNALED(status)) {
+		cte->log_error(cte, "Worker process executing '%s' for topic %d, sound system %d has been killed by signal %d\n",
+			       job->test_object->name, job->topic, job->sound_system, WTERMSIG(status));
+	} else {
+		cte->log_error(cte, "Test framework failed for '%s', topic %d, sound system %d\n",
+			       job->test_object->name, job->topic, job->sound_system);
+	}
+	/* Crash of a worker is a failure of tests that it was executing. */
+	cte->all_stats[job->sound_system][job->topic].failures++;
+	return cwt_retv_err;
+}
+
+
+
+
 static cwt_retv iterate_over_topics(cw_test_executor_t * cte, cw_test_set_t * test_set)
 {
 	for (int i = 0; cte->configuration.topics[i] != LIBCW_TEST_TOPIC_MAX; i++) {
@@ -1690,17 +2253,7 @@ static cwt_retv iterate_over_sound_systems(cw_test_executor_t * cte, cw_test_set
 static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_object_t * test_objects, int topic, cw_sound_system sound_system)
 {
 	for (cw_test_object_t * test_obj = test_objects; NULL != test_obj->test_function; test_obj++) {
-		bool execute = true;
-		if (0 != strlen(cte->config->test_function_name)) {
-			if (0 != strcmp(cte->config->test_function_name, test_obj->name)) {
-				execute = false;
-			}
-		}
-		if (cte->config->test_quick_only && !test_obj->is_quick) {
-			continue;
-		}
-
-		if (!execute) {
+		if (!test_object_is_selected(cte, test_obj)) {
 			continue;
 		}
 
@@ -1717,11 +2270,19 @@ static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_obje
 				kite_log(cte, LOG_ERR, "Failed to start resource meas when starting tests of '%s'\n", cte->config->test_function_name);
 				return cwt_retv_err;
 			}
+			/* Tests may add their own threads (e.g. thread of
+			   generator) to the measurement. */
+			resource_meas_add_thread(&cte->resource_meas, pthread_self(), "test");
 		}
 
 		cw_test_set_current_topic_and_gen_config(cte, topic, sound_system);
 		//fprintf(stderr, "+++ %s +++\n", test_obj->name);
+		const unsigned int n_perf_records = cte->n_perf_records;
+		struct rusage usage_begin;
+		getrusage(RUSAGE_SELF, &usage_begin);
 		const cwt_retv retv = test_obj->test_function(cte);
+		struct rusage usage_end;
+		getrusage(RUSAGE_SELF, &usage_end);
 
 
 		if (cte->use_resource_meas) {
@@ -1745,6 +2306,34 @@ static cwt_retv iterate_over_test_objects(cw_test_executor_t * cte, cw_test_obje
 				cte->log_error(cte, "Registered high CPU usage "MEAS_CPU_FMT" during execution of '%s'\n",
 				               (double) max_cpu_usage, test_obj->name);
 			}
+
+			resource_meas_thread thread;
+			for (int t = 0; 0 == resource_meas_get_thread(&cte->resource_meas, t, &thread); t++) {
+				cte->log_info(cte, "CPU usage of thread '%s': max = "MEAS_CPU_FMT", time = %ld us\n",
+				              thread.name, (double) thread.maximal_cpu_usage, resource_meas_get_thread_cpu_time(&thread));
+			}
+			long n_voluntary = 0;
+			long n_involuntary = 0;
+			resource_meas_get_context_switches(&cte->resource_meas, &n_voluntary, &n_involuntary);
+			cte->log_info(cte, "Context switches: voluntary = %ld, involuntary = %ld\n", n_voluntary, n_involuntary);
+		}
+
+		if (cte->n_perf_records != n_perf_records) {
+			/* Test function is a benchmark. CPU used by
+			   the function (in all threads of the process)
+			   is one of its results. */
+			struct timeval cpu_begin;
+			struct timeval cpu_end;
+			struct timeval cpu_time;
+			timeradd(&usage_begin.ru_utime, &usage_begin.ru_stime, &cpu_begin);
+			timeradd(&usage_end.ru_utime, &usage_end.ru_stime, &cpu_end);
+			timersub(&cpu_end, &cpu_begin, &cpu_time);
+			cte->record_perf(cte, test_obj->name, "cpu time", "ms", perf_direction_lower_is_better,
+					 (double) cpu_time.tv_sec * 1000.0 + (double) cpu_time.tv_usec / 1000.0);
+			if (cte->use_resource_meas) {
+				cte->record_perf(cte, test_obj->name, "cpu usage max", "%", perf_direction_lower_is_better,
+						 (double) resource_meas_get_maximal_cpu_usage(&cte->resource_meas));
+			}
 		}
 
 		if (cwt_retv_ok != retv) {
@@ -1784,3 +2373,23 @@ static int msg_buff_prepare(struct cw_test_executor_t * executor, char * msg_buf
 }
 
 
+
+
+/**
+   @brief See if test object should be executed according to options of test program
+
+   @return true if test object should be executed
+   @return false otherwise
+*/
+static bool test_object_is_selected(cw_test_executor_t * cte, const cw_test_object_t * test_obj)
+{
+	if (0 != strlen(cte->config->test_function_name)) {
+		if (0 != strcmp(cte->config->test_function_name, test_obj->name)) {
+			return false;
+		}
+	}
+	if (cte->config->test_quick_only && !test_obj->is_quick) {
+		return false;
+	}
+	return true;
+}
@@ -29,6 +29,7 @@
 
 #include <test_framework/basic_utils/test_result.h>
 #include <test_framework/basic_utils/resource_meas.h>
+#include <test_framework/basic_utils/perf_baseline.h>
 
 
 
@@ -160,6 +161,14 @@ typedef struct cw_test_executor_t {
 	cw_test_stats_t all_stats[CW_SOUND_SYSTEM_LAST + 1][LIBCW_TEST_TOPIC_MAX];
 	cw_test_stats_t * stats; /* Pointer to current stats (one of fields of ::all_stats[][]). */
 
+	/* Results of benchmarks recorded with ::record_perf in current
+	   run, and baseline with which they are compared (see
+	   cw_config_t::test_baseline_path). ::n_perf_records counts
+	   calls of ::record_perf. */
+	perf_results_t perf_results;
+	perf_results_t perf_baseline;
+	unsigned int n_perf_records;
+
 
 
 	/**
@@ -265,6 +274,47 @@ typedef struct cw_test_executor_t {
 
 
 
+	/**
+	   @brief Record result of benchmark of function under test
+
+	   Use the function in benchmark tests to record a measured
+	   value of @p metric (e.g. throughput) of function @p fut. The
+	   result is compared with result of the same function and
+	   metric in baseline (if the baseline has been given in
+	   command line). Result worse than the baseline by more than
+	   tolerance is a regression, and is counted as failure of
+	   test. Result better than the baseline or within tolerance
+	   is counted as success. Result without baseline is only
+	   logged.
+
+	   Recorded results are written as new baseline at the end of
+	   tests if requested in command line. CPU time of test
+	   function that has recorded any result is recorded too, as
+	   "cpu time" metric of the test function.
+
+	   Names of @p fut and @p metric can't contain tabs.
+
+	   @return false if the result is a regression
+	   @return true otherwise
+	*/
+	bool (* record_perf)(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, perf_direction_t direction, double value);
+
+	/**
+	   @brief Record percentiles of latencies of function under test
+
+	   Record 50th, 90th and 99th percentile of @p values as
+	   separate results of ::record_perf, with metrics named
+	   "<metric> p50", "<metric> p90" and "<metric> p99". Lower
+	   values are better. @p values are sorted in place.
+
+	   @return false if any of the results is a regression
+	   @return true otherwise
+	*/
+	bool (* record_perf_latencies)(struct cw_test_executor_t * self, const char * fut, const char * metric, const char * unit, double * values, size_t n_values);
+
+
+
+
 	/**
 	   An assert - not much to explain
 	*/
@@ -565,6 +615,10 @@ typedef struct cw_test_set_t {
 /* What is the top allowed CPU usage threshold during test function's execution [percent]. */
 #define LIBCW_TEST_MEAS_CPU_OK_THRESHOLD_PERCENT 4.0F
 
+/* Tolerance of results of benchmarks that are not yet in baseline,
+   written to new baseline [percent]. */
+#define LIBCW_TEST_PERF_TOLERANCE_PERCENT 25.0
+
 
 
 
@@ -44,6 +44,61 @@
 #include "gen/cw_gen_remove_last_character.h"
 #include "gen/cw_gen_enqueue_character_no_ics.h"
 #include "gen/cw_gen_get_timing_parameters_internal.h"
+#include "gen/cw_gen_calculate_amplitudes_internal.h"
+#include "gen/cw_gen_calculate_sine_wave_internal.h"
+#include "gen/cw_gen_tone_cache_get_internal.h"
+#include "gen/cw_gen_write_to_soundcard_internal.h"
+#include "gen/cw_file_sound_system.h"
+#include "gen/cw_rtp_sound_system.h"
+#include "gen/cw_gen_render.h"
+#include "gen/cw_gen_render_string.h"
+#include "gen/cw_gen_render_benchmark.h"
+#include "gen/cw_gen_loopback_string.h"
+#include "gen/cw_gen_enqueue_memory.h"
+#include "gen/cw_gen_dsp.h"
+#include "gen/cw_gen_timing_accuracy.h"
+#include "gen/cw_gen_timing_monitor.h"
+#include "gen/cw_batch.h"
+#include "gen/cw_mixer_mix_block_internal.h"
+#include "gen/cw_gen_enqueue_tones.h"
+#include "gen/cw_gen_get_queue_n_characters.h"
+#include "gen/cw_gen_get_queue_duration.h"
+#include "gen/cw_gen_register_low_duration_callback.h"
+#include "gen/cw_gen_get_queue_event_fd.h"
+#include "gen/cw_gen_enqueue_priority_string.h"
+#include "gen/cw_gen_get_sound_latency.h"
+#include "gen/cw_gen_get_metrics.h"
+#include "gen/cw_gen_wait_for_sound_device_internal.h"
+#include "gen/cw_gen_convert_samples_internal.h"
+#include "gen/cw_gen_recalculate_slope_amplitudes_internal.h"
+#include "gen/cw_gen_close_pooled_devices.h"
+#include "gen/cw_probe_cache_internal.h"
+#include "gen/cw_gen_get_timestamp.h"
+#include "gen/cw_gen_sync_parameters_internal.h"
+#include "gen/cw_timing_acquire_internal.h"
+#include "gen/cw_gen_set_parameters.h"
+#include "gen/cw_gen_set_gain.h"
+#include "gen/cw_gen_set_chirp.h"
+#include "gen/cw_gen_standby.h"
+#include "gen/cw_gen_thread_realtime.h"
+#include "gen/cw_gen_preallocate.h"
+#include "gen/cw_gen_pipeline.h"
+#include "gen/cw_gen_add_sink.h"
+#include "gen/cw_gen_tap.h"
+#include "gen/cw_gen_quality_scaling.h"
+#include "gen/cw_shm_ring.h"
+#include "gen/cw_gen_flush_on_empty_queue.h"
+#include "gen/cw_gen_idle_timeout.h"
+#include "gen/cw_gen_timed_value_tracking.h"
+#include "gen/cw_gen_enqueue_at.h"
+#include "gen/cw_gen_drift_compensation.h"
+#include "gen/cw_gen_coalesce_spaces.h"
+#include "gen/cw_gen_multi_producer_queue.h"
+#include "gen/cw_mixer_set_n_workers.h"
+#include "gen/cw_seq_send_string.h"
+#include "gen/cw_gen_enqueue_translated_string.h"
+#include "gen/cw_gen_enqueue_string_with_token.h"
+#include "gen/cw_gen_enqueue_utf8_string.h"
 #include "legacy/cw_get_receive_parameters.h"
 #include "legacy/cw_get_send_parameters.h"
 
@@ -126,6 +181,8 @@ cw_test_set_t cw_test_sets[] = {
 		{
 			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_cw_get_send_parameters, g_is_quick),
 			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_parameter_ranges, true),
+			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_contexts, false),
+			LIBCW_TEST_FUNCTION_INSERT(legacy_api_test_context_timers, true),
 			//LIBCW_TEST_FUNCTION_INSERT(legacy_api_cw_test_delayed_release, true),
 			//LIBCW_TEST_FUNCTION_INSERT(legacy_api_cw_test_signal_handling, true), /* FIXME - not sure why this test fails :( */
 
@@ -175,11 +232,17 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_timestamp_compare_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_timestamp_validate_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_usecs_to_timespec_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_sleep_on_timeline_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_usleep_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_scheduler_schedule_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_version_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_license_internal, true),
 
 			/* cw_debug topic */
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_debug_flags_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_trace_start, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_debug_msg_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_debug_msg_fork, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -201,11 +264,15 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_data_main_table_get_contents, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_data_main_table_get_representation_len_max, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_data_main_table_lookups, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_data_precomputed_tables, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_prosign_lookups_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_phonetic_lookups_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_character_internal, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_string_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_character_get_functions, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_translate_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_alphabet_lookups, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_validate_representation_internal, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
@@ -246,6 +313,8 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_properties_full, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_dequeue_internal_returns, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_grow_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_tq_tone_desc_internal, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -262,10 +331,66 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_new_start_delete, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_new_stop_delete, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_new_start_stop_delete, false),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_start_stop_duration, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_set_tone_slope, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_tone_slope_shape_enums, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_timing_parameters_internal, g_is_quick),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_calculate_sine_wave_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_calculate_amplitudes_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_tone_cache_get_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_write_to_soundcard_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_render, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_render_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_loopback_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_memory, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_dsp, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_timing_accuracy, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_timing_monitor, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_batch, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_mixer_mix_block_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_file_sound_system, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rtp_sound_system, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_tones, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_queue_n_characters, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_queue_duration, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_register_low_duration_callback, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_queue_event_fd, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_priority_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_sound_latency, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_metrics, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_export_metrics, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_wait_for_sound_device_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_convert_samples_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_recalculate_slope_amplitudes_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_close_pooled_devices, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_probe_cache_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_get_timestamp, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_sync_parameters_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_timing_acquire_internal, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_set_parameters, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_set_gain, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_set_chirp, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_standby, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_thread_realtime, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_preallocate, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_pipeline, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_add_sink, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_tap, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_quality_scaling, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_shm_ring, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_flush_on_empty_queue, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_idle_timeout, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_timed_value_tracking, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_at, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_drift_compensation, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_coalesce_spaces, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_multi_producer_queue, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_mixer_set_n_workers, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_seq_send_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_translated_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_utf8_string, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_string_with_token, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_parameter_getters_setters, true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_volume_functions, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_enqueue_primitives, false),
@@ -297,6 +422,22 @@ cw_test_set_t cw_test_sets[] = {
 		}
 	},
 
+	/* Benchmarks. Their results are compared with baseline given
+	   with -B command line option. Rendering doesn't depend on sound
+	   system, so the benchmarks are executed only once. */
+	{
+		LIBCW_TEST_SET_VALID,
+		LIBCW_TEST_API_MODERN,
+
+		{ LIBCW_TEST_TOPIC_GEN, LIBCW_TEST_TOPIC_MAX }, /* Topics. */
+		{ CW_AUDIO_NULL, CW_AUDIO_NONE /* Guard. */ }, /* Sound systems. */
+
+		{
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_gen_render_benchmark, false),
+			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
+		}
+	},
+
 	{
 		LIBCW_TEST_SET_VALID,
 		LIBCW_TEST_API_MODERN,
@@ -307,6 +448,12 @@ cw_test_set_t cw_test_sets[] = {
 		{
 			LIBCW_TEST_FUNCTION_INSERT(test_keyer, false),
 			LIBCW_TEST_FUNCTION_INSERT(test_straight_key, false),
+			LIBCW_TEST_FUNCTION_INSERT(test_keyer_timed_mode, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_keyer_next_element, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_keyer_paddle_events, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_key_input_new, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_straight_key_direct_receiving, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_netkey, true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true),
 		}
@@ -325,6 +472,22 @@ cw_test_set_t cw_test_sets[] = {
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_identify_mark_internal,      true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_test_with_constant_speeds,   true),
 			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_test_with_varying_speeds,    true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_mark_begin_usecs, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_get_statistics, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_get_metrics, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_set_averaging, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_set_soft_decision, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_profile, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_spec, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_receive_edges, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_poll_batch, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_push_mark_begin, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_register_character_callback, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_tester_stress, true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_detector_process,                true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_skimmer_process,                 true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_compact_update,              true),
+			LIBCW_TEST_FUNCTION_INSERT(test_cw_rec_pool,                        true),
 
 			LIBCW_TEST_FUNCTION_INSERT(NULL, true) /* Guard. */
 		}
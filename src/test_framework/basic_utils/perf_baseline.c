@@ -0,0 +1,320 @@
+/*
+  Copyright (C) 2001-2006  Simon Baldwin (simon_baldwin@yahoo.com)
+  Copyright (C) 2011-2023  Kamil Ignacak (acerion@wp.pl)
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/**
+   @file perf_baseline.c
+
+   Results of benchmarks, saved to and loaded from versioned baseline
+   files, and comparison of new results with the baseline.
+*/
+
+
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perf_baseline.h"
+
+
+
+
+/* Count of fields in line with result. */
+#define PERF_BASELINE_N_FIELDS 6
+
+
+
+
+static int perf_result_parse(perf_result_t * result, char * line);
+static int perf_compare_doubles(const void * a, const void * b);
+
+
+
+
+void perf_results_init(perf_results_t * results)
+{
+	results->results = NULL;
+	results->n_results = 0;
+	results->capacity = 0;
+}
+
+
+
+
+void perf_results_deinit(perf_results_t * results)
+{
+	free(results->results);
+	perf_results_init(results);
+}
+
+
+
+
+int perf_results_add(perf_results_t * results, const perf_result_t * result)
+{
+	for (size_t i = 0; i < results->n_results; i++) {
+		if (0 == strcmp(results->results[i].fut, result->fut)
+		    && 0 == strcmp(results->results[i].metric, result->metric)) {
+			results->results[i] = *result;
+			return 0;
+		}
+	}
+
+	if (results->n_results == results->capacity) {
+		const size_t capacity = 0 == results->capacity ? 16 : 2 * results->capacity;
+		perf_result_t * new_results = (perf_result_t *) realloc(results->results, capacity * sizeof (perf_result_t));
+		if (NULL == new_results) {
+			return -1;
+		}
+		results->results = new_results;
+		results->capacity = capacity;
+	}
+	results->results[results->n_results++] = *result;
+
+	return 0;
+}
+
+
+
+
+const perf_result_t * perf_results_find(const perf_results_t * results, const char * fut, const char * metric)
+{
+	for (size_t i = 0; i < results->n_results; i++) {
+		if (0 == strcmp(results->results[i].fut, fut)
+		    && 0 == strcmp(results->results[i].metric, metric)) {
+			return &results->results[i];
+		}
+	}
+	return NULL;
+}
+
+
+
+
+int perf_results_load(perf_results_t * results, const char * path, char * error, size_t error_size)
+{
+	FILE * file = fopen(path, "r");
+	if (NULL == file) {
+		snprintf(error, error_size, "can't open '%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	char line[512];
+	int line_number = 0;
+	bool has_version = false;
+	int retv = 0;
+	while (NULL != fgets(line, sizeof (line), file)) {
+		line_number++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if ('#' == line[0] || '\0' == line[0]) {
+			continue;
+		}
+
+		if (!has_version) {
+			int version = 0;
+			if (1 != sscanf(line, "version\t%d", &version)) {
+				snprintf(error, error_size, "%s:%d: missing version of baseline", path, line_number);
+				retv = -1;
+				break;
+			}
+			if (PERF_BASELINE_VERSION != version) {
+				snprintf(error, error_size, "%s:%d: unsupported version %d of baseline, expected %d",
+					 path, line_number, version, PERF_BASELINE_VERSION);
+				retv = -1;
+				break;
+			}
+			has_version = true;
+			continue;
+		}
+
+		perf_result_t result;
+		if (0 != perf_result_parse(&result, line)) {
+			snprintf(error, error_size, "%s:%d: malformed result", path, line_number);
+			retv = -1;
+			break;
+		}
+		if (0 != perf_results_add(results, &result)) {
+			snprintf(error, error_size, "failed to allocate memory for baseline");
+			retv = -1;
+			break;
+		}
+	}
+	if (0 == retv && !has_version) {
+		snprintf(error, error_size, "%s: missing version of baseline", path);
+		retv = -1;
+	}
+
+	fclose(file);
+	return retv;
+}
+
+
+
+
+int perf_results_save(const perf_results_t * results, const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if (NULL == file) {
+		return -1;
+	}
+
+	fprintf(file, "# Baseline of results of benchmarks\n");
+	fprintf(file, "# function under test\tmetric\tunit\tdirection\tvalue\ttolerance [%%]\n");
+	fprintf(file, "version\t%d\n", PERF_BASELINE_VERSION);
+	for (size_t i = 0; i < results->n_results; i++) {
+		const perf_result_t * result = &results->results[i];
+		fprintf(file, "%s\t%s\t%s\t%s\t%.6g\t%g\n",
+			result->fut, result->metric, result->unit,
+			perf_direction_higher_is_better == result->direction ? "higher" : "lower",
+			result->value, result->tolerance);
+	}
+
+	const bool failure = 0 != ferror(file);
+	if (0 != fclose(file) || failure) {
+		return -1;
+	}
+	return 0;
+}
+
+
+
+
+perf_comparison_t perf_result_compare(const perf_result_t * result, const perf_result_t * baseline, double tolerance, double * change)
+{
+	if (NULL == baseline) {
+		return perf_comparison_no_baseline;
+	}
+	if (tolerance < 0.0) {
+		tolerance = baseline->tolerance;
+	}
+
+	double difference = 0.0;
+	if (FP_ZERO != fpclassify(baseline->value)) {
+		difference = 100.0 * (result->value - baseline->value) / fabs(baseline->value);
+	} else if (FP_ZERO != fpclassify(result->value)) {
+		difference = result->value > 0.0 ? HUGE_VAL : -HUGE_VAL;
+	}
+	if (perf_direction_lower_is_better == result->direction) {
+		difference = -difference;
+	}
+	if (NULL != change) {
+		*change = difference;
+	}
+
+	if (difference < -tolerance) {
+		return perf_comparison_regression;
+	} else if (difference > tolerance) {
+		return perf_comparison_improvement;
+	} else {
+		return perf_comparison_ok;
+	}
+}
+
+
+
+
+double perf_percentile(double * values, size_t n_values, double percentile)
+{
+	qsort(values, n_values, sizeof (values[0]), perf_compare_doubles);
+
+	size_t rank = (size_t) ceil(percentile / 100.0 * (double) n_values);
+	if (rank < 1) {
+		rank = 1;
+	}
+	if (rank > n_values) {
+		rank = n_values;
+	}
+	return values[rank - 1];
+}
+
+
+
+
+/**
+   @brief Parse line of baseline file with one result
+
+   @param[out] result parsed result
+   @param[in/out] line line without end-of-line character, modified by the function
+
+   @return 0 on success
+   @return -1 if the line is malformed
+*/
+static int perf_result_parse(perf_result_t * result, char * line)
+{
+	char * fields[PERF_BASELINE_N_FIELDS] = { 0 };
+	int n_fields = 0;
+	char * field = line;
+	while (n_fields < PERF_BASELINE_N_FIELDS) {
+		fields[n_fields++] = field;
+		char * tab = strchr(field, '\t');
+		if (NULL == tab) {
+			break;
+		}
+		*tab = '\0';
+		field = tab + 1;
+	}
+	if (PERF_BASELINE_N_FIELDS != n_fields) {
+		return -1;
+	}
+
+	memset(result, 0, sizeof (perf_result_t));
+	if (strlen(fields[0]) >= sizeof (result->fut)
+	    || strlen(fields[1]) >= sizeof (result->metric)
+	    || strlen(fields[2]) >= sizeof (result->unit)) {
+		return -1;
+	}
+	snprintf(result->fut, sizeof (result->fut), "%s", fields[0]);
+	snprintf(result->metric, sizeof (result->metric), "%s", fields[1]);
+	snprintf(result->unit, sizeof (result->unit), "%s", fields[2]);
+
+	if (0 == strcmp(fields[3], "higher")) {
+		result->direction = perf_direction_higher_is_better;
+	} else if (0 == strcmp(fields[3], "lower")) {
+		result->direction = perf_direction_lower_is_better;
+	} else {
+		return -1;
+	}
+
+	char * end = NULL;
+	result->value = strtod(fields[4], &end);
+	if (end == fields[4] || '\0' != *end) {
+		return -1;
+	}
+	result->tolerance = strtod(fields[5], &end);
+	if (end == fields[5] || '\0' != *end || result->tolerance < 0.0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+
+static int perf_compare_doubles(const void * a, const void * b)
+{
+	const double da = *(const double *) a;
+	const double db = *(const double *) b;
+	return (da > db) - (da < db);
+}
@@ -0,0 +1,196 @@
+#ifndef _TEST_FRAMEWORK_BASIC_UTILS_PERF_BASELINE_H_
+#define _TEST_FRAMEWORK_BASIC_UTILS_PERF_BASELINE_H_
+
+
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+
+
+/*
+  Results of benchmarks, and baselines with which they are compared.
+
+  A result is a value of one metric (e.g. throughput, 99th percentile
+  of latency, CPU time) of one function under test. Results are saved
+  to and loaded from a text file: a versioned baseline that can be
+  kept together with the code and compared with results of new runs.
+
+  Format of version 1 of the file: lines starting with '#' are
+  comments, first other line is "version<TAB>1", and each of remaining
+  lines is one result with these fields separated by tabs:
+  function under test, metric, unit, direction ("higher" or "lower":
+  which values are better), value, tolerance [percents].
+*/
+
+
+
+
+#define PERF_BASELINE_VERSION 1
+
+#define PERF_RESULT_NAME_SIZE 64
+#define PERF_RESULT_UNIT_SIZE 16
+
+
+
+
+typedef enum {
+	perf_direction_higher_is_better,
+	perf_direction_lower_is_better
+} perf_direction_t;
+
+
+
+
+typedef struct {
+	char fut[PERF_RESULT_NAME_SIZE];     /* Function under test. */
+	char metric[PERF_RESULT_NAME_SIZE];
+	char unit[PERF_RESULT_UNIT_SIZE];
+	perf_direction_t direction;
+	double value;
+
+	/* Allowed difference between results of new run and value in
+	   baseline [percents of value in baseline]. */
+	double tolerance;
+} perf_result_t;
+
+
+
+
+typedef struct {
+	perf_result_t * results;
+	size_t n_results;
+	size_t capacity;
+} perf_results_t;
+
+
+
+
+/* Result of comparison of new result with baseline. */
+typedef enum {
+	perf_comparison_no_baseline,  /* There is no result for the same function and metric in baseline. */
+	perf_comparison_ok,           /* Result is within tolerance of baseline. */
+	perf_comparison_improvement,  /* Result is better than baseline by more than tolerance. */
+	perf_comparison_regression    /* Result is worse than baseline by more than tolerance. */
+} perf_comparison_t;
+
+
+
+
+/**
+   @brief Initialize empty set of results
+
+   @param[out] results set of results
+*/
+void perf_results_init(perf_results_t * results);
+
+
+
+
+/**
+   @brief Free memory of set of results
+
+   The set is empty after the call, and can be used again.
+
+   @param[in/out] results set of results
+*/
+void perf_results_deinit(perf_results_t * results);
+
+
+
+
+/**
+   @brief Add result to set of results
+
+   Result with the same function under test and metric as @p result is
+   replaced.
+
+   @param[in/out] results set of results
+   @param[in] result result to add
+
+   @return 0 on success
+   @return -1 on failure to allocate memory
+*/
+int perf_results_add(perf_results_t * results, const perf_result_t * result);
+
+
+
+
+/**
+   @brief Find result of given function under test and metric
+
+   @return pointer to result in @p results
+   @return NULL if there is no such result
+*/
+const perf_result_t * perf_results_find(const perf_results_t * results, const char * fut, const char * metric);
+
+
+
+
+/**
+   @brief Load results from file
+
+   Loaded results are added to @p results.
+
+   @param[in/out] results set of results
+   @param[in] path path to file with baseline
+   @param[out] error buffer for description of error
+   @param[in] error_size size of @p error
+
+   @return 0 on success
+   @return -1 if the file can't be read, has unsupported version, or is malformed
+*/
+int perf_results_load(perf_results_t * results, const char * path, char * error, size_t error_size);
+
+
+
+
+/**
+   @brief Save results to file
+
+   @param[in] results set of results
+   @param[in] path path to file with baseline
+
+   @return 0 on success
+   @return -1 on failure
+*/
+int perf_results_save(const perf_results_t * results, const char * path);
+
+
+
+
+/**
+   @brief Compare result with baseline
+
+   @param[in] result new result
+   @param[in] baseline result from baseline, may be NULL
+   @param[in] tolerance allowed difference [percents], negative value: use tolerance of @p baseline
+   @param[out] change difference of @p result from @p baseline [percents], positive if @p result is better, may be NULL
+
+   @return result of comparison
+*/
+perf_comparison_t perf_result_compare(const perf_result_t * result, const perf_result_t * baseline, double tolerance, double * change);
+
+
+
+
+/**
+   @brief Get percentile of values
+
+   @p values are sorted in place. Nearest-rank method is used, so the
+   returned value is one of @p values.
+
+   @param[in/out] values values
+   @param[in] n_values count of @p values, larger than zero
+   @param[in] percentile percentile in range 0-100
+
+   @return value at @p percentile
+*/
+double perf_percentile(double * values, size_t n_values, double percentile);
+
+
+
+
+#endif /* #ifndef _TEST_FRAMEWORK_BASIC_UTILS_PERF_BASELINE_H_ */
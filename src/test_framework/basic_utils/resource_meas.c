@@ -46,7 +46,9 @@
 
 
 static void resource_meas_do_measurement(resource_meas * meas);
+static void resource_meas_measure_threads(resource_meas * meas, suseconds_t meas_duration);
 static void * resouce_meas_thread(void * arg);
+static suseconds_t resource_meas_timespec_diff_usecs(const struct timespec * end, const struct timespec * begin);
 
 
 
@@ -63,8 +65,10 @@ static void * resouce_meas_thread(void * arg)
 {
 	resource_meas * meas = (resource_meas *) arg;
 	while (1) {
-		resource_meas_do_measurement(meas);
+		/* Baseline for first measurement has been taken in
+		   resource_meas_start(). */
 		cw_millisleep_internal(meas->meas_interval_msecs);
+		resource_meas_do_measurement(meas);
 	}
 
 	return NULL;
@@ -88,6 +92,10 @@ int resource_meas_start(resource_meas * meas, int meas_interval_msecs)
 		return -1;
 	}
 
+	getrusage(RUSAGE_SELF, &meas->rusage_start);
+	meas->rusage_prev = meas->rusage_start;
+	clock_gettime(CLOCK_MONOTONIC, &meas->timestamp_prev);
+
 	if (0 != pthread_create(&meas->thread_id, &meas->thread_attr, resouce_meas_thread, meas)) {
 		fprintf(stderr, "[EE] Failed to start thread of resource meas: '%s'\n", strerror(errno));
 		pthread_attr_destroy(&meas->thread_attr);
@@ -137,6 +145,70 @@ float resource_meas_get_maximal_cpu_usage(resource_meas * meas)
 
 
 
+int resource_meas_add_thread(resource_meas * meas, pthread_t thread, const char * name)
+{
+	clockid_t clock_id;
+	if (0 != pthread_getcpuclockid(thread, &clock_id)) {
+		fprintf(stderr, "[EE] Failed to get CPU clock of thread '%s'\n", name);
+		return -1;
+	}
+
+	pthread_mutex_lock(&meas->mutex);
+	if (meas->n_threads == RESOURCE_MEAS_MAX_THREADS) {
+		pthread_mutex_unlock(&meas->mutex);
+		fprintf(stderr, "[EE] Can't measure more than %d threads\n", RESOURCE_MEAS_MAX_THREADS);
+		return -1;
+	}
+	resource_meas_thread * meas_thread = &meas->threads[meas->n_threads];
+	memset(meas_thread, 0, sizeof (*meas_thread));
+	snprintf(meas_thread->name, sizeof (meas_thread->name), "%s", name);
+	meas_thread->clock_id = clock_id;
+	clock_gettime(clock_id, &meas_thread->cpu_time_start);
+	meas_thread->cpu_time_prev = meas_thread->cpu_time_start;
+	meas_thread->cpu_time_curr = meas_thread->cpu_time_start;
+	meas->n_threads++;
+	pthread_mutex_unlock(&meas->mutex);
+
+	return 0;
+}
+
+
+
+
+int resource_meas_get_thread(resource_meas * meas, int index, resource_meas_thread * thread)
+{
+	int retv = -1;
+	pthread_mutex_lock(&meas->mutex);
+	if (index >= 0 && index < meas->n_threads) {
+		*thread = meas->threads[index];
+		retv = 0;
+	}
+	pthread_mutex_unlock(&meas->mutex);
+	return retv;
+}
+
+
+
+
+long resource_meas_get_thread_cpu_time(const resource_meas_thread * thread)
+{
+	return (long) resource_meas_timespec_diff_usecs(&thread->cpu_time_curr, &thread->cpu_time_start);
+}
+
+
+
+
+void resource_meas_get_context_switches(resource_meas * meas, long * n_voluntary, long * n_involuntary)
+{
+	pthread_mutex_lock(&meas->mutex);
+	*n_voluntary = meas->n_voluntary_switches;
+	*n_involuntary = meas->n_involuntary_switches;
+	pthread_mutex_unlock(&meas->mutex);
+}
+
+
+
+
 /**
    @brief Do a single measurement of system resources
 
@@ -154,13 +226,15 @@ static void resource_meas_do_measurement(resource_meas * meas)
 	timeradd(&meas->user_cpu_diff, &meas->sys_cpu_diff, &meas->summary_cpu_usage);
 
 
-	/* TODO acerion 2023.08.21 use system's monotonic clock to avoid issues due to wall clock changes. */
-	gettimeofday(&meas->timestamp_curr, NULL);
-	timersub(&meas->timestamp_curr, &meas->timestamp_prev, &meas->timestamp_diff);
+	/* Monotonic clock isn't affected by changes of wall clock. */
+	clock_gettime(CLOCK_MONOTONIC, &meas->timestamp_curr);
 
 
 	meas->resource_usage = meas->summary_cpu_usage.tv_sec * CW_USECS_PER_SEC + meas->summary_cpu_usage.tv_usec;
-	meas->meas_duration = meas->timestamp_diff.tv_sec * CW_USECS_PER_SEC + meas->timestamp_diff.tv_usec;
+	meas->meas_duration = resource_meas_timespec_diff_usecs(&meas->timestamp_curr, &meas->timestamp_prev);
+	if (meas->meas_duration <= 0) {
+		return;
+	}
 
 	meas->rusage_prev = meas->rusage_curr;
 	meas->timestamp_prev = meas->timestamp_curr;
@@ -175,6 +249,9 @@ static void resource_meas_do_measurement(resource_meas * meas)
 		if (meas->current_cpu_usage > meas->maximal_cpu_usage) {
 			meas->maximal_cpu_usage = meas->current_cpu_usage;
 		}
+		meas->n_voluntary_switches = meas->rusage_curr.ru_nvcsw - meas->rusage_start.ru_nvcsw;
+		meas->n_involuntary_switches = meas->rusage_curr.ru_nivcsw - meas->rusage_start.ru_nivcsw;
+		resource_meas_measure_threads(meas, meas->meas_duration);
 		/* Log the error "live" during test execution. This
 		   will allow to pinpoint the faulty code faster. */
 		if (meas->current_cpu_usage > LIBCW_TEST_MEAS_CPU_OK_THRESHOLD_PERCENT) {
@@ -194,3 +271,48 @@ static void resource_meas_do_measurement(resource_meas * meas)
 
 
 
+/**
+   @brief Take measurement of CPU usage of threads added to measurement
+
+   Call the function with mutex of @p meas locked.
+
+   @param[in/out] meas Resource measurement variable
+   @param[in] meas_duration Time since previous measurement [microseconds]
+*/
+static void resource_meas_measure_threads(resource_meas * meas, suseconds_t meas_duration)
+{
+	for (int i = 0; i < meas->n_threads; i++) {
+		resource_meas_thread * thread = &meas->threads[i];
+		if (thread->is_gone) {
+			continue;
+		}
+		if (0 != clock_gettime(thread->clock_id, &thread->cpu_time_curr)) {
+			/* The thread has exited. Keep its last
+			   measurement. */
+			thread->cpu_time_curr = thread->cpu_time_prev;
+			thread->is_gone = true;
+			thread->current_cpu_usage = 0.0F;
+			continue;
+		}
+
+		const suseconds_t usage = resource_meas_timespec_diff_usecs(&thread->cpu_time_curr, &thread->cpu_time_prev);
+		thread->cpu_time_prev = thread->cpu_time_curr;
+		thread->current_cpu_usage = usage * 100.0F / (meas_duration * 1.0F);
+		if (thread->current_cpu_usage > thread->maximal_cpu_usage) {
+			thread->maximal_cpu_usage = thread->current_cpu_usage;
+		}
+	}
+}
+
+
+
+
+/**
+   @brief Calculate difference between two timespecs
+
+   @return @p end - @p begin [microseconds]
+*/
+static suseconds_t resource_meas_timespec_diff_usecs(const struct timespec * end, const struct timespec * begin)
+{
+	return (suseconds_t) ((end->tv_sec - begin->tv_sec) * CW_USECS_PER_SEC + (end->tv_nsec - begin->tv_nsec) / 1000);
+}
@@ -9,6 +9,36 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
+
+
+
+
+/* Maximal count of threads whose CPU usage can be measured
+   separately, see resource_meas_add_thread(). */
+#define RESOURCE_MEAS_MAX_THREADS 8
+
+#define RESOURCE_MEAS_THREAD_NAME_SIZE 16
+
+
+
+
+/* CPU usage of a single thread. */
+typedef struct {
+	char name[RESOURCE_MEAS_THREAD_NAME_SIZE];
+	clockid_t clock_id;
+
+	/* Set when CPU clock of the thread can't be read anymore,
+	   e.g. because the thread has exited. */
+	bool is_gone;
+
+	struct timespec cpu_time_start; /* Thread's CPU time when the thread has been added to measurement. */
+	struct timespec cpu_time_prev;
+	struct timespec cpu_time_curr;
+
+	float current_cpu_usage; /* Last calculated value of CPU usage. */
+	float maximal_cpu_usage; /* Maximum detected during measurements run. */
+} resource_meas_thread;
 
 
 
@@ -21,15 +51,14 @@ typedef struct {
 	struct rusage rusage_prev;
 	struct rusage rusage_curr;
 
-	struct timeval timestamp_prev;
-	struct timeval timestamp_curr;
+	/* Timestamps on monotonic clock. */
+	struct timespec timestamp_prev;
+	struct timespec timestamp_curr;
 
 	struct timeval user_cpu_diff; /* User CPU time used. */
 	struct timeval sys_cpu_diff;  /* System CPU time used. */
 	struct timeval summary_cpu_usage; /* User + System CPU time used. */
 
-	struct timeval timestamp_diff;
-
 	suseconds_t resource_usage;
 	/* At what interval the last two measurements were really taken. */
 	suseconds_t meas_duration;
@@ -41,6 +70,15 @@ typedef struct {
 	float current_cpu_usage; /* Last calculated value of CPU usage. */
 	float maximal_cpu_usage; /* Maximum detected during measurements run. */
 
+	/* Counts of context switches of process since measurement has
+	   been started. */
+	long n_voluntary_switches;
+	long n_involuntary_switches;
+	struct rusage rusage_start;
+
+	resource_meas_thread threads[RESOURCE_MEAS_MAX_THREADS];
+	int n_threads;
+
 } resource_meas;
 
 
@@ -119,5 +157,64 @@ float resource_meas_get_maximal_cpu_usage(resource_meas * meas);
 
 
 
+/**
+   @brief Measure CPU usage of given thread separately
+
+   CPU usage of the whole process is still being measured. Call the
+   function after resource_meas_start(). CPU usage of the thread is
+   measured with the thread's CPU-time clock
+   (pthread_getcpuclockid()).
+
+   @param[in/out] meas Resource measurement variable
+   @param[in] thread Thread to measure
+   @param[in] name Name of thread used in reports
+
+   @return 0 on success
+   @return -1 if there is no room for another thread or CPU-time clock of the thread can't be obtained
+*/
+int resource_meas_add_thread(resource_meas * meas, pthread_t thread, const char * name);
+
+
+
+
+/**
+   @brief Get CPU usage of a thread added with resource_meas_add_thread()
+
+   @param[in] meas Resource measurement variable
+   @param[in] index Index of thread, in order of adding threads
+   @param[out] thread Copy of measurements of the thread
+
+   @return 0 on success
+   @return -1 if @p index is out of range
+*/
+int resource_meas_get_thread(resource_meas * meas, int index, resource_meas_thread * thread);
+
+
+
+
+/**
+   @brief Get CPU time used by thread since it has been added to measurement
+
+   @param[in] thread Measurements of thread, see resource_meas_get_thread()
+
+   @return CPU time [microseconds]
+*/
+long resource_meas_get_thread_cpu_time(const resource_meas_thread * thread);
+
+
+
+
+/**
+   @brief Get counts of context switches of process since start of measurement
+
+   @param[in] meas Resource measurement variable
+   @param[out] n_voluntary Count of voluntary context switches (e.g. waits for I/O or for a lock)
+   @param[out] n_involuntary Count of involuntary context switches (preemptions)
+*/
+void resource_meas_get_context_switches(resource_meas * meas, long * n_voluntary, long * n_involuntary);
+
+
+
+
 #endif /* #ifndef _TEST_FRAMEWORK_BASIC_UTILS_RESOURCE_MEAS_H_ */
 
@@ -53,6 +53,7 @@
 #include "modeset.h"
 
 #include <libcw.h>
+#include <libcw2.h>
 
 #include <cwutils/cw_common.h>
 #include <cwutils/i18n.h>
@@ -171,7 +172,9 @@ Application::Application() :
    determine which class instance 'owns' the CW library at the moment
    (if any), then calls that instance's receiver handler function.
 
-   This function is called in signal handler context. */
+   This function is called in libcw's thread. The receiver handler
+   only queues the event, the event is processed on next receive poll
+   in Qt's thread. */
 void Application::libcw_keying_event_static(void *arg, int key_state)
 {
 	const Application *app = libcw_user_application_instance;
@@ -324,10 +327,25 @@ void Application::start()
 
 	clear_status();
 
-	/* This program is polling a receiver for data. Polling happens at
-	   given interval. */
-	poll_timer->setSingleShot(false);
-	poll_timer->start(CW_REC_MINIMAL_POLL_PERIOD_MSECS);
+	/* Sender is fed on events in libcw's tone queue (tone
+	   dequeued, queue flushed etc.) instead of being polled. */
+	const int fd = cw_gen_get_queue_event_fd(cw_generator_get());
+	if (-1 != fd) {
+		queue_notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+		connect(queue_notifier, SIGNAL (activated(int)), SLOT (queue_event()));
+	} else {
+		/* Fall back to polling of sender. */
+		start_poll_timer();
+	}
+	sender->poll(modeset.get_current());
+
+#ifdef ENABLE_DEV_RECEIVER_TEST
+	/* Test code keys the receiver without mouse or keyboard
+	   events that would start the timer. */
+	if (current_mode()->is_receiver_test()) {
+		start_poll_timer();
+	}
+#endif
 
 	return;
 }
@@ -351,6 +369,11 @@ void Application::stop()
 	is_using_libcw = false;
 
 	poll_timer->stop();
+	if (queue_notifier) {
+		queue_notifier->setEnabled(false);
+		queue_notifier->deleteLater();
+		queue_notifier = NULL;
+	}
 	sender->clear();
 	receiver->clear();
 #ifdef ENABLE_DEV_RECEIVER_TEST
@@ -570,6 +593,12 @@ void Application::change_mode()
 	/* Keep the ModeSet synchronized to mode_combo changes. */
 	modeset.set_current(mode_combo->currentIndex());
 
+	/* New dictionary mode needs to be started: there may be no
+	   events in libcw's tone queue that would trigger sending. */
+	if (is_using_libcw) {
+		sender->poll(modeset.get_current());
+	}
+
 	return;
 }
 
@@ -678,14 +707,72 @@ void Application::colors()
 
 /**
    Handle a timer event from the QTimer we set up on initialization.
-   This timer is used for regular polling for sender tone queue low
-   and completed receive characters.
+   This timer is used for regular polling for completed receive
+   characters.
+
+   The timer is stopped when receiver has nothing more to receive, and
+   is started again on next keyboard or mouse event in receive mode,
+   so xcwcp doesn't wake up periodically when it's idle.
 */
 void Application::poll_timer_event()
 {
+	if (!is_using_libcw) {
+		poll_timer->stop();
+		return;
+	}
+
+	receiver->poll(modeset.get_current());
+
+	if (!queue_notifier) {
+		/* Polling of sender is a fallback used when libcw
+		   can't notify about events in its tone queue. */
+		sender->poll(modeset.get_current());
+		return;
+	}
+
+#ifdef ENABLE_DEV_RECEIVER_TEST
+	if (current_mode()->is_receiver_test()) {
+		return;
+	}
+#endif
+	if (!receiver->is_busy()) {
+		poll_timer->stop();
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   Handle an event in libcw's tone queue: the queue has changed, so
+   sender may need to pass more characters to libcw.
+*/
+void Application::queue_event()
+{
+	cw_gen_clear_queue_event(cw_generator_get());
+
 	if (is_using_libcw) {
 		sender->poll(modeset.get_current());
-		receiver->poll(modeset.get_current());
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   Start the poll timer, unless it is already running
+*/
+void Application::start_poll_timer(void)
+{
+	if (!poll_timer->isActive()) {
+		poll_timer->setSingleShot(false);
+		poll_timer->start(CW_REC_MINIMAL_POLL_PERIOD_MSECS);
 	}
 
 	return;
@@ -726,9 +813,12 @@ void Application::key_event(QKeyEvent *event)
 		if (modeset.get_current()->is_keyboard()) {
 			//fprintf(stderr, "---------- key event: keyboard mode\n");
 			sender->handle_key_event(event);
+			/* Sender may be idle, waiting for characters. */
+			sender->poll(modeset.get_current());
 		} else if (modeset.get_current()->is_receive()) {
 			//fprintf(stderr, "---------- key event: receiver mode mode\n");
 			receiver->handle_key_event(event, reverse_paddles_action->isChecked());
+			start_poll_timer();
 		} else {
 			;
 		}
@@ -761,6 +851,7 @@ void Application::mouse_event(QMouseEvent *event)
 		if (modeset.get_current()->is_receive()) {
 			//fprintf(stderr, "---------- mouse event: receiver mode\n");
 			receiver->handle_mouse_event(event, reverse_paddles_action->isChecked());
+			start_poll_timer();
 		}
 	}
 
@@ -1078,9 +1169,10 @@ void Application::make_auxiliaries_begin(void)
 	saved_receive_speed = cw_get_receive_speed();
 	play = false;
 
-	/* Create a timer for polling send and receive. */
+	/* Create a timer for polling receiver. */
 	poll_timer = new QTimer(this);
 	connect(poll_timer, SIGNAL (timeout()), SLOT (poll_timer_event()));
+	queue_notifier = NULL;
 
 	return;
 }
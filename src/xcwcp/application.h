@@ -27,6 +27,7 @@
 #include <QToolButton>
 #include <QComboBox>
 #include <QSpinBox>
+#include <QSocketNotifier>
 
 #include <string>
 #include <deque>
@@ -90,6 +91,7 @@ namespace cw {
 		void colors();
 		void toggle_toolbar();
 		void poll_timer_event();
+		void queue_event();
 
 		/* These Qt widget callback functions interact with
 		   libcw. */
@@ -162,9 +164,16 @@ namespace cw {
 		/* Poll timer, used to ensure that all of the
 		   application processing can be handled in the
 		   foreground, rather than in the signal handling
-		   context of a libcw tone queue low callback. */
+		   context of a libcw keying callback. The timer
+		   runs only while receiver has some work to do. */
 		QTimer *poll_timer;
 
+		/* Notifier of events in libcw's tone queue. Exists
+		   only while this instance is using libcw. Sender
+		   is polled on the events, so there is no need to
+		   poll it periodically. */
+		QSocketNotifier *queue_notifier;
+
 		/* Flag indicating if this instance is currently using
 		   the libcw. Of course xcwcp is an application that
 		   links to libcw, but this flag is for *active* use
@@ -194,6 +203,8 @@ namespace cw {
 		void make_auxiliaries_begin(void);
 		void make_auxiliaries_end(void);
 
+		void start_poll_timer(void);
+
 
 		/* Prevent unwanted operations. */
 		Application(const Application &);
@@ -122,6 +122,7 @@ int main(int argc, char **argv)
 			fprintf(stderr, _("%s: inconsistent arguments\n"), config->program_name);
 			return EXIT_FAILURE;
 		}
+		cw_startup_timing_mark(config, "arguments");
 
 		if (config->input_file) {
 			if (!cw_dictionaries_read(config->input_file)) {
@@ -144,8 +145,10 @@ int main(int argc, char **argv)
 			fprintf(stderr, "%s: failed to create generator\n", config->program_name);
 			return EXIT_FAILURE;
 		}
+		cw_startup_timing_mark(config, "generator created");
 
 		cw_generator_start();
+		cw_startup_timing_mark(config, "generator started");
 
 		/* Set up signal handlers to clean up and exit on a range of signals. */
 		struct sigaction action;
@@ -18,6 +18,7 @@
 
 #include "modeset.h"
 #include <cwutils/dictionary.h>
+#include <cwutils/lib/practice_text.h>
 
 
 
@@ -28,6 +29,15 @@ namespace cw {
 
 
 
+/* Groups of text of dictionary modes, prepared in background. Created
+   together with the singleton ModeSetHelper. */
+static cw_practice_text_t *practice_text = NULL;
+
+static int generate_group(const void *dict, cw_random_t *rng, char *group, size_t size);
+
+
+
+
 
 /**
    Return true if the mode passed in has the same type (dictionary,
@@ -51,12 +61,17 @@ bool Mode::is_same_type_as(const Mode *other) const
 */
 std::string DictionaryMode::get_random_word_group() const
 {
+	char group[4 * CW_PRACTICE_TEXT_GROUP_SIZE];
+	if (practice_text
+	    && cw_practice_text_get_group(practice_text, dictionary, group, sizeof (group)) >= 0) {
+
+		return std::string(group);
+	}
+
 	std::string random_group;
 
 	const int group_size = cw_dictionary_get_group_size(dictionary);
-	random_group.resize(group_size);
-
-	for (int group = 0; group < group_size; group++) {
+	for (int i = 0; i < group_size; i++) {
 		const char *element = cw_dictionary_get_random_word(dictionary);
 		random_group += element;
 	}
@@ -68,6 +83,20 @@ std::string DictionaryMode::get_random_word_group() const
 
 
 
+/**
+   \brief Generate group of text of dictionary mode
+
+   Generator passed to cw_practice_text_new().
+*/
+int generate_group(const void *dict, cw_random_t *rng, char *group, size_t size)
+{
+	return cw_dictionary_get_random_group_r((const cw_dictionary_t *) dict, rng, group, size);
+}
+
+
+
+
+
 /*
   The class collects and aggregates operating modes, constructing from
   all known dictionaries, then adding any local modes.  This is a
@@ -117,6 +146,10 @@ ModeSetHelper::ModeSetHelper()
 	modes.push_back(new ReceiverTestMode("== Run Receiver Test =="));
 #endif
 
+	/* On failure groups are generated by
+	   DictionaryMode::get_random_word_group() itself. */
+	practice_text = cw_practice_text_new(generate_group, 0);
+
 	return;
 }
 
@@ -135,6 +168,9 @@ ModeSetHelper::~ModeSetHelper()
 
 	modes.clear();
 
+	/* Stop the background thread before dictionaries are unloaded. */
+	cw_practice_text_delete(&practice_text);
+
 	return;
 }
 
@@ -27,6 +27,7 @@
 #include <libcw.h>
 #include <libcw_utils.h>
 #include <cwutils/i18n.h>
+#include <cwutils/dictionary.h>
 
 #ifdef ENABLE_DEV_RECEIVER_TEST
 #include <libcw_gen.h>
@@ -57,6 +58,11 @@ void Receiver::poll(const Mode *current_mode)
 		return;
 	}
 
+	/* Pass to libcw's receiver all key transitions that happened
+	   since last poll, before asking the receiver for
+	   characters. */
+	process_keying_events();
+
 	if (libcw_receive_errno != 0) {
 		poll_report_error();
 	}
@@ -306,20 +312,89 @@ void Receiver::ik_right_event(bool is_down, bool is_reverse_paddles)
    a separate task. Key and receiver are separate concepts. This
    function connects them.
 
-   This function, called on key state changes, calls receiver
-   functions to ensure that receiver does "receive" the key state
-   changes.
-
-   This function is called in signal handler context, and it takes
-   care to call only functions that are safe within that context.  In
-   particular, it goes out of its way to deliver results by setting
-   flags that are later handled by receive polling.
+   This function is called in libcw's thread, so it doesn't touch
+   receiver's state. It only copies the timestamp and the new key
+   state into a lock-free queue. The queued key state changes are
+   passed to receiver by process_keying_events(), called in Qt's
+   thread on next receive poll. libcw's thread never waits for Qt's
+   thread, and since each key state change carries its own
+   timestamp, delays in Qt's thread don't affect durations of
+   received marks and spaces.
+
+   If the queue is full, the event is dropped and counted, and the
+   drop is reported on next poll.
 */
 void Receiver::handle_libcw_keying_event(struct timeval *t, int key_state)
 {
-	/* Ignore calls where the key state matches our tracked key
-	   state.  This avoids possible problems where this event
-	   handler is redirected between application instances; we
+	const size_t tail = keying_events_tail;
+	const size_t head = __atomic_load_n(&keying_events_head, __ATOMIC_ACQUIRE);
+	if (tail - head == KEYING_EVENTS_CAPACITY) {
+		__atomic_add_fetch(&keying_events_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	keying_event_t *event = &keying_events[tail % KEYING_EVENTS_CAPACITY];
+	event->timestamp = *t;
+	event->key_state = key_state;
+	/* Publish the slot only after it has been written. */
+	__atomic_store_n(&keying_events_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Pass to libcw's receiver all queued keying events
+
+   Events are taken from the queue in batches: all events that are
+   in the queue when the function is called are processed, and slots
+   of the whole batch are given back to libcw's thread at once.
+
+   Call the function only in Qt's thread.
+*/
+void Receiver::process_keying_events()
+{
+	const size_t dropped = __atomic_load_n(&keying_events_dropped, __ATOMIC_RELAXED);
+	if (dropped != keying_events_dropped_reported) {
+		/* Some key transitions are lost, so whatever
+		   receiver has collected for current character is
+		   unreliable. */
+		keying_events_dropped_reported = dropped;
+		cw_clear_receive_buffer();
+		is_pending_inter_word_space = false;
+		app->show_status(_("Receiver can't keep up with keying"));
+	}
+
+	const size_t head = keying_events_head;
+	const size_t tail = __atomic_load_n(&keying_events_tail, __ATOMIC_ACQUIRE);
+	for (size_t i = head; i != tail; i++) {
+		process_keying_event(&keying_events[i % KEYING_EVENTS_CAPACITY]);
+	}
+	/* Give the slots back to producer only after they have been read. */
+	__atomic_store_n(&keying_events_head, tail, __ATOMIC_RELEASE);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Pass a single keying event to libcw's receiver
+
+   \param event - key state change with its timestamp
+*/
+void Receiver::process_keying_event(const keying_event_t *event)
+{
+	const int key_state = event->key_state;
+
+	/* Ignore events where the key state matches our tracked key
+	   state.  This avoids possible problems where the keying
+	   callback is redirected between application instances; we
 	   might receive an end of tone without seeing the start of
 	   tone. */
 	if (key_state == tracked_key_state) {
@@ -345,25 +420,23 @@ void Receiver::handle_libcw_keying_event(struct timeval *t, int key_state)
 		is_pending_inter_word_space = false;
 	}
 
-	//fprintf(stderr, "calling callback, stage 2\n");
-
 	/* Pass tone state on to the library.  For tone end, check to
 	   see if the library has registered any receive error. */
 	if (key_state) {
 		/* Key down. */
-		//fprintf(stderr, "start receive tone: %10ld . %10ld\n", t->tv_sec, t->tv_usec);
-		if (!cw_start_receive_tone(t)) {
+		//fprintf(stderr, "start receive tone: %10ld . %10ld\n", event->timestamp.tv_sec, event->timestamp.tv_usec);
+		if (!cw_start_receive_tone(&event->timestamp)) {
 			perror("cw_start_receive_tone");
 			return;
 		}
 	} else {
 		/* Key up. */
-		//fprintf(stderr, "end receive tone:   %10ld . %10ld\n", t->tv_sec, t->tv_usec);
-		if (!cw_end_receive_tone(t)) {
+		//fprintf(stderr, "end receive tone:   %10ld . %10ld\n", event->timestamp.tv_sec, event->timestamp.tv_usec);
+		if (!cw_end_receive_tone(&event->timestamp)) {
 			/* Handle receive error detected on tone end.
 			   For ENOMEM and ENOENT we set the error in a
 			   class flag, and display the appropriate
-			   message on the next receive poll. */
+			   message on this receive poll. */
 			switch (errno) {
 			case EAGAIN:
 				/* libcw treated the tone as noise (it
@@ -396,10 +469,17 @@ void Receiver::handle_libcw_keying_event(struct timeval *t, int key_state)
 */
 void Receiver::clear()
 {
+	/* Discard queued keying events. This is consumer's side of
+	   the queue, so it's safe to do while libcw's thread keeps
+	   adding events. */
+	__atomic_store_n(&keying_events_head, __atomic_load_n(&keying_events_tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	keying_events_dropped_reported = __atomic_load_n(&keying_events_dropped, __ATOMIC_RELAXED);
+
 	cw_clear_receive_buffer();
 	is_pending_inter_word_space = false;
 	libcw_receive_errno = 0;
 	tracked_key_state = false;
+	received_word.clear();
 
 	return;
 }
@@ -408,6 +488,34 @@ void Receiver::clear()
 
 
 
+/**
+   \brief Check if receiver needs to be polled
+
+   Receiver needs to be polled as long as there are queued keying
+   events, a key is down, a character is being received, or an
+   inter-word space may still be received after a character. When
+   none of this is true, nothing can be received until next keyboard
+   or mouse event.
+
+   \return true if receiver should be polled
+   \return false otherwise
+*/
+bool Receiver::is_busy() const
+{
+	return __atomic_load_n(&keying_events_tail, __ATOMIC_ACQUIRE) != keying_events_head
+		|| is_pending_inter_word_space
+		|| libcw_receive_errno != 0
+		|| tracked_key_state
+		|| is_left_down
+		|| is_right_down
+		|| cw_is_keyer_busy()
+		|| cw_get_receive_buffer_length() > 0;
+}
+
+
+
+
+
 /**
    \brief Handle any error registered when handling a libcw keying event
 */
@@ -465,6 +573,7 @@ void Receiver::poll_character()
 		/* Receiver stores full, well formed
 		   character. Display it. */
 		textarea->append(c);
+		received_word += c;
 
 #ifdef ENABLE_DEV_RECEIVER_TEST
 		fprintf(stderr, "[II] Character: '%c'\n", c);
@@ -516,12 +625,8 @@ void Receiver::poll_character()
 		is_pending_inter_word_space = true;
 
 		/* Update the status bar to show the character
-		   received.  Put the received char at the end of
-		   string to avoid "jumping" of whole string when
-		   width of glyph of received char changes at variable
-		   font width. */
-		QString status = _("Received at %1 WPM: '%2'");
-		app->show_status(status.arg(cw_get_receive_speed()).arg(c));
+		   received. */
+		show_received_character(c);
 		//fprintf(stderr, "Received character '%c'\n", c);
 
 	} else {
@@ -542,6 +647,7 @@ void Receiver::poll_character()
 		case ENOENT: /* Invalid character in receiver's buffer. */
 			cw_clear_receive_buffer();
 			textarea->append('?');
+			received_word += '?';
 			app->show_status(QString(_("Unknown character received at %1 WPM")).arg(cw_get_receive_speed()));
 			break;
 
@@ -549,6 +655,7 @@ void Receiver::poll_character()
 			/* Timestamp error. */
 			cw_clear_receive_buffer();
 			textarea->append('?');
+			received_word += '?';
 			app->show_status(QString(_("Internal error")));
 			break;
 
@@ -594,6 +701,7 @@ void Receiver::poll_space()
 	if (is_end_of_word) {
 		//fprintf(stderr, "End of word '%c'\n\n", c);
 		textarea->append(' ');
+		show_received_word();
 
 #ifdef ENABLE_DEV_RECEIVER_TEST
 		fprintf(stderr, "[II] Space:\n");
@@ -784,4 +892,117 @@ void Receiver::stop_test_code()
 
 
 
+/**
+   \brief Look up current word in dictionaries
+
+   Only dictionaries of multi-character words (call signs, words,
+   abbreviations) are consulted: any text is at most one edit away
+   from some word in dictionary of single characters.
+
+   \param is_complete_word - look for probable corrections of
+   complete word if true, look for words starting with the word
+   otherwise
+
+   \return space-separated list of found words, empty if there are none
+*/
+QString Receiver::find_known_words(bool is_complete_word) const
+{
+	static const int MAX_WORDS = 4;
+	const char *words[MAX_WORDS];
+	QString result;
+	int n_found = 0;
+
+	for (const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	     dict && n_found < MAX_WORDS;
+	     dict = cw_dictionaries_iterate(dict)) {
+
+		if (cw_dictionary_get_group_size(dict) != 1) {
+			continue;
+		}
+		const int n = is_complete_word
+			? cw_dictionary_get_corrections(dict, received_word.c_str(), words, MAX_WORDS - n_found)
+			: cw_dictionary_get_completions(dict, received_word.c_str(), words, MAX_WORDS - n_found);
+		for (int i = 0; i < n; i++) {
+			if (!result.isEmpty()) {
+				result += ' ';
+			}
+			result += QString(words[i]).toUpper();
+		}
+		n_found += n;
+	}
+
+	return result;
+}
+
+
+
+
+
+/**
+   \brief Show received character in status bar
+
+   Words from dictionaries that start with characters received so
+   far in current word are shown too, so that probable call signs and
+   words are visible while they are being received.
+
+   \param c - received character
+*/
+void Receiver::show_received_character(char c)
+{
+	/* Put the received char at the end of string to avoid
+	   "jumping" of whole string when width of glyph of received
+	   char changes at variable font width. */
+	QString status = _("Received at %1 WPM: '%2'");
+	status = status.arg(cw_get_receive_speed()).arg(c);
+
+	const QString known = find_known_words(false);
+	if (!known.isEmpty()) {
+		status = QString("[%1] ").arg(known) + status;
+	}
+	app->show_status(status);
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Check complete received word against dictionaries
+
+   If received word is not in dictionaries, but words differing from
+   it by one character are, the words are shown in status bar as
+   probable corrections.
+*/
+void Receiver::show_received_word()
+{
+	if (received_word.empty()) {
+		return;
+	}
+
+	bool is_known = false;
+	for (const cw_dictionary_t *dict = cw_dictionaries_iterate(NULL);
+	     dict && !is_known;
+	     dict = cw_dictionaries_iterate(dict)) {
+
+		is_known = cw_dictionary_get_group_size(dict) == 1
+			&& cw_dictionary_has_word(dict, received_word.c_str());
+	}
+
+	if (!is_known) {
+		const QString corrections = find_known_words(true);
+		if (!corrections.isEmpty()) {
+			QString status = _("Probable correction of '%1': %2");
+			app->show_status(status.arg(received_word.c_str()).arg(corrections));
+		}
+	}
+	received_word.clear();
+
+	return;
+}
+
+
+
+
 }  /* namespace cw */
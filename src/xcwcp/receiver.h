@@ -19,6 +19,11 @@
 #ifndef H_XCWCP_RECEIVER
 #define H_XCWCP_RECEIVER
 
+#include <cstddef>
+#include <string>
+
+#include <sys/time.h>
+
 #include <QMouseEvent>
 #include <QKeyEvent>
 
@@ -60,7 +65,11 @@ namespace cw {
 		libcw_receive_errno (0),
 		tracked_key_state (false),
 		is_left_down (false),
-		is_right_down (false) { }
+		is_right_down (false),
+		keying_events_head (0),
+		keying_events_tail (0),
+		keying_events_dropped (0),
+		keying_events_dropped_reported (0) { }
 
 		/* Poll timeout handler. */
 		void poll(const Mode *current_mode);
@@ -77,12 +86,18 @@ namespace cw {
 		void ik_left_event(bool is_down, bool is_reverse_paddles);
 		void ik_right_event(bool is_down, bool is_reverse_paddles);
 
-		/* CW library keying event handler. */
+		/* CW library keying event handler. Called in libcw's
+		   thread, it only queues the event for
+		   process_keying_events(). */
 		void handle_libcw_keying_event(struct timeval *t, int key_state);
 
 		/* Clear out queued data on stop, mode change, etc. */
 		void clear();
 
+		/* Is there anything that receiver may receive on
+		   next poll? */
+		bool is_busy() const;
+
 #ifdef ENABLE_DEV_RECEIVER_TEST
 		void start_test_code();
 		void stop_test_code();
@@ -108,19 +123,19 @@ namespace cw {
 		/* Flag indicating if receive polling has received a
 		   character, and may need to augment it with a word
 		   space on a later poll. */
-		volatile bool is_pending_inter_word_space;
+		bool is_pending_inter_word_space;
 
-		/* Flag indicating possible receive errno detected in
-		   signal handler context and needing to be passed to
-		   the foreground. */
-		volatile int libcw_receive_errno;
+		/* Flag indicating possible receive errno detected
+		   when processing keying events, and needing to be
+		   reported on poll. */
+		int libcw_receive_errno;
 
 		/* Safety flag to ensure that we keep the library in
 		   sync with keyer events.  Without, there's a chance
 		   that of a on-off event, one half will go to one
 		   application instance, and the other to another
 		   instance. */
-		volatile bool tracked_key_state;
+		bool tracked_key_state;
 
 		/* State of left and right paddle of iambic keyer. The
 		   flags are common for keying with keyboard keys and
@@ -133,12 +148,45 @@ namespace cw {
 		bool is_left_down;
 		bool is_right_down;
 
+		/* Key transitions reported by libcw's keying callback,
+		   waiting to be passed to libcw's receiver in Qt's
+		   thread. The queue is single-producer (libcw's
+		   thread writes only the tail) and single-consumer
+		   (Qt's thread writes only the head), so neither
+		   thread ever waits for the other. Indices grow
+		   without wrapping to the capacity, slot of an index
+		   is (index % KEYING_EVENTS_CAPACITY). */
+		struct keying_event_t {
+			struct timeval timestamp;
+			int key_state;
+		};
+		static const size_t KEYING_EVENTS_CAPACITY = 256; /* Must be a power of two. */
+		keying_event_t keying_events[KEYING_EVENTS_CAPACITY];
+		size_t keying_events_head;
+		size_t keying_events_tail;
+		size_t keying_events_dropped;           /* Count of events that didn't fit into full queue. */
+		size_t keying_events_dropped_reported;  /* Value of the count at last report. Used only by Qt's thread. */
+
+		/* Characters of current word received so far, looked
+		   up in dictionaries as they arrive. */
+		std::string received_word;
+
+		/* Pass queued keying events to libcw's receiver. */
+		void process_keying_events();
+		void process_keying_event(const keying_event_t *event);
+
 		/* Poll primitives to handle receive errors,
 		   characters, and inter-word spaces. */
 		void poll_report_error();
 		void poll_character();
 		void poll_space();
 
+		/* Look up received characters in dictionaries, show
+		   known words and probable corrections. */
+		QString find_known_words(bool is_complete_word) const;
+		void show_received_character(char c);
+		void show_received_word();
+
 		/* Prevent unwanted operations. */
 		Receiver(const Receiver &);
 		Receiver &operator=(const Receiver &);
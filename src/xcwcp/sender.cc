@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
@@ -25,6 +26,7 @@
 #include <sstream>
 
 #include <libcw.h>
+#include <libcw2.h>
 
 #include <cwutils/i18n.h>
 
@@ -42,28 +44,42 @@ namespace cw {
 
 
 
+/* How much of audio should be waiting in libcw's tone queue, so that
+   the queue doesn't run empty between calls to Sender::poll(), even if
+   the calls are made at rate of poll timer. [milliseconds] */
+static const int SENDER_LOOKAHEAD_MSECS = 2000;
+
+/* Average duration of a character, including inter-character space,
+   from PARIS calibration: 50 units per word of 5 characters. [units] */
+static const int SENDER_UNITS_PER_CHARACTER = 10;
+
+/* Duration of a unit (dot) at speed of 1 WPM, from the same PARIS
+   calibration: 60 seconds / 50 units. [milliseconds] */
+static const int SENDER_UNIT_MSECS_AT_1_WPM = 1200;
+
+
+
+
 /**
    \brief Get more characters to send
 
-   Check the CW library tone queue, and if it is getting low, arrange
-   for more data to be passed in to the sender.
+   Forget characters that libcw has already played, and pass to libcw
+   as many of pending characters as fit in lookahead time. In
+   dictionary modes, add more random data if there is nothing left to
+   send.
 */
 void Sender::poll(const Mode *current_mode)
 {
 	if (current_mode->is_dictionary() || current_mode->is_keyboard()) {
-		if (cw_get_tone_queue_length() <= 1) {
-			/* Arrange more data for the sender.  In
-			   dictionary modes, add more random data if
-			   the queue is empty.  In keyboard mode, just
-			   dequeue anything currently on the character
-			   queue. */
-			if (current_mode->is_dictionary() && queue.empty()) {
-				enqueue_string(std::string(1, ' ')
-					       + current_mode->get_dmode()->get_random_word_group());
-			}
+		update_in_flight();
 
-			dequeue_and_play_character();
+		if (current_mode->is_dictionary() && queue.empty() && in_flight.size() <= 1) {
+			enqueue_string(std::string(1, ' ')
+				       + current_mode->get_dmode()->get_random_word_group());
 		}
+
+		dequeue_and_play_characters();
+		update_in_flight();
 	}
 
 	return;
@@ -125,6 +141,7 @@ void Sender::clear()
 {
 	cw_flush_tone_queue();
 	queue.clear();
+	in_flight.clear();
 	is_queue_idle = true;
 
 	return;
@@ -135,42 +152,84 @@ void Sender::clear()
 
 
 /**
-   \brief Get next character from character queue and play it
+   \brief Move characters from character queue to libcw
 
-   Called when the CW send buffer is empty.  If the queue is not idle,
-   take the next character from the queue and play it.  If there are
-   no more queued characters, set the queue to idle.
+   Called when libcw's tone queue changes. If the queue is not idle,
+   take characters from the queue and enqueue them in libcw, until
+   lookahead time is filled with characters waiting to be played.
+   Each character gets its own token in libcw, so that sender knows
+   which character is being played.
 */
-void Sender::dequeue_and_play_character()
+void Sender::dequeue_and_play_characters()
 {
 	if (is_queue_idle) {
 		return;
 	}
 
-	if (queue.empty()) {
-		is_queue_idle = true;
-		app->clear_status();
-		return;
+	cw_gen_t *gen = cw_generator_get();
+	const int speed = cw_get_send_speed();
+	const int char_duration_msecs = SENDER_UNIT_MSECS_AT_1_WPM * SENDER_UNITS_PER_CHARACTER / speed;
+	size_t limit = (size_t) (SENDER_LOOKAHEAD_MSECS / char_duration_msecs);
+	if (limit < 2) {
+		/* Always have next character waiting in libcw. */
+		limit = 2;
 	}
 
-	/* Take the next character off the queue and play it.  We
-	   don't expect playing to fail as only valid characters are
-	   queued. */
-	const char c = queue.front();
-	queue.pop_front();
-	if (!cw_send_character(c)) {
-		perror("cw_send_character");
-		QString status = _("Failed to send character '%1'");
-		app->show_status(status.arg(c));
-		return;
+	while (!queue.empty() && in_flight.size() < limit) {
+		/* We don't expect enqueueing to fail as only valid
+		   characters are queued, but libcw's queue may be
+		   full. Then we will try again on next event in
+		   libcw's queue. */
+		const char c = queue.front();
+		const char s[2] = { c, '\0' };
+		uint64_t token = 0;
+		if (CW_SUCCESS != cw_gen_enqueue_string_with_token(gen, s, &token)) {
+			if (EAGAIN != errno) {
+				perror("cw_gen_enqueue_string_with_token");
+				QString status = _("Failed to send character '%1'");
+				app->show_status(status.arg(c));
+				queue.pop_front();
+			}
+			return;
+		}
+		queue.pop_front();
+		in_flight.push_back({ c, token });
 	}
 
-	/* Update the status bar with the character being played.  Put
-	   the played char at the end to avoid "jumping" of whole
-	   string when width of glyph of played char changes at
-	   variable font width. */
-	QString status = _("Sending at %1 WPM: '%2'");
-	app->show_status(status.arg(cw_get_send_speed()).arg(c));
+	return;
+}
+
+
+
+
+
+/**
+   \brief Forget played characters, show the one being played
+
+   Remove from front of list of characters handed off to libcw those
+   characters that libcw has already played. Update the status bar
+   with the character being played. If there are no more characters
+   to play, set the queue to idle.
+*/
+void Sender::update_in_flight()
+{
+	cw_gen_t *gen = cw_generator_get();
+	while (!in_flight.empty() && cw_gen_is_token_completed(gen, in_flight.front().token)) {
+		in_flight.pop_front();
+	}
+
+	if (!in_flight.empty()) {
+		/* Update the status bar with the character being
+		   played.  Put the played char at the end to avoid
+		   "jumping" of whole string when width of glyph of
+		   played char changes at variable font width. */
+		QString status = _("Sending at %1 WPM: '%2'");
+		app->show_status(status.arg(cw_get_send_speed()).arg(in_flight.front().c));
+
+	} else if (queue.empty() && !is_queue_idle) {
+		is_queue_idle = true;
+		app->clear_status();
+	}
 
 	return;
 }
@@ -211,15 +270,25 @@ void Sender::enqueue_string(const std::string &s)
 /**
    \brief Delete last character from queue
 
-   Remove the most recently added character from the queue, provided that
-   the dequeue hasn't yet reached it.  If there's nothing available to
-   delete, don't report errors.
+   Remove the most recently added character from the queue, or from
+   libcw's tone queue, provided that libcw hasn't yet started playing
+   it.  If there's nothing available to delete, don't report errors.
 */
 void Sender::delete_character()
 {
 	if (!queue.empty()) {
 		queue.pop_back();
 		textarea->backspace();
+		return;
+	}
+
+	/* The character may have been already handed off to libcw,
+	   but still not played. */
+	if (in_flight.size() > 1) {
+		if (CW_SUCCESS == cw_gen_remove_last_character(cw_generator_get())) {
+			in_flight.pop_back();
+			textarea->backspace();
+		}
 	}
 
 	return;
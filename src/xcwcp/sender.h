@@ -25,6 +25,7 @@
 
 #include <QKeyEvent>
 
+#include <cstdint>
 #include <string>
 #include <deque>
 
@@ -70,10 +71,19 @@ namespace cw {
 		void clear();
 
 	private:
+		/* Character handed off to libcw, together with
+		   token completed by libcw when the character has
+		   been played. */
+		struct InFlight {
+			char c;
+			uint64_t token;
+		};
+
 		/* Deque and queue manipulation functions, used to
 		   handle and maintain the buffer of characters
 		   awaiting sending through libcw. */
-		void dequeue_and_play_character();
+		void dequeue_and_play_characters();
+		void update_in_flight();
 		void enqueue_string(const std::string &word);
 		void delete_character();
 
@@ -84,6 +94,10 @@ namespace cw {
 		bool is_queue_idle;
 		std::deque<char> queue;
 
+		/* Characters already enqueued in libcw, oldest
+		   first. Front character is the one being played. */
+		std::deque<InFlight> in_flight;
+
 
 		/* Prevent unwanted operations. */
 		Sender(const Sender &);
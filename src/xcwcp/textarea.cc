@@ -51,6 +51,10 @@ const QString DISPLAY_WHATSTHIS =
 	  "The status bar shows the current character being sent, any character "
 	  "received, and other general error and Xcwcp status information.");
 
+/* Interval at which appended characters are inserted into document
+   (roughly one frame). */
+static const int FLUSH_INTERVAL_MSECS = 20;
+
 
 
 
@@ -90,6 +94,13 @@ TextArea::TextArea(Application *a, QWidget *parent) :
 	setFocus();
 	setWhatsThis("DISPLAY_WHATSTHIS");
 
+	/* Inserting characters into document one by one triggers
+	   layout and repaint for every character. Accumulate
+	   characters and insert them in batches. */
+	flush_timer.setSingleShot(true);
+	flush_timer.setInterval(FLUSH_INTERVAL_MSECS);
+	QObject::connect(&flush_timer, &QTimer::timeout, this, &TextArea::flush_pending_text);
+
 	app->setCentralWidget(this);
 	app->show_status(_("Ready"));
 }
@@ -204,10 +215,53 @@ QMenu *TextArea::createPopupMenu()
 
 /**
    \brief Append a character at the current notional cursor position.
+
+   The character is inserted into document with other characters
+   appended in the same interval, at most FLUSH_INTERVAL_MSECS later.
 */
 void TextArea::append(char c)
 {
-	this->insertPlainText(QString(QChar(c)));
+	pending_text.append(QChar(c));
+	if (!flush_timer.isActive()) {
+		flush_timer.start();
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Insert pending characters into document
+
+   All pending characters are inserted with one edit, so the document
+   is laid out and repainted once, and the cursor is moved once.
+*/
+void TextArea::flush_pending_text()
+{
+	flush_timer.stop();
+	if (!pending_text.isEmpty()) {
+		this->insertPlainText(pending_text);
+		pending_text.clear();
+	}
+
+	return;
+}
+
+
+
+
+
+/**
+   \brief Clear the document, discarding pending characters
+*/
+void TextArea::clear()
+{
+	flush_timer.stop();
+	pending_text.clear();
+	QTextEdit::clear();
 
 	return;
 }
@@ -224,6 +278,12 @@ void TextArea::append(char c)
 */
 void TextArea::backspace()
 {
+	/* The last appended character may still be pending. */
+	if (!pending_text.isEmpty()) {
+		pending_text.chop(1);
+		return;
+	}
+
 	QKeyEvent *keyEvent = new QKeyEvent(QEvent::KeyPress, Qt::Key_Backspace, Qt::NoModifier);
 	QTextEdit::keyPressEvent(keyEvent);
 
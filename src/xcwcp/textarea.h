@@ -20,6 +20,8 @@
 #include <QTextEdit>
 #include <QEvent>
 #include <QMenu>
+#include <QString>
+#include <QTimer>
 
 
 
@@ -37,6 +39,10 @@ namespace cw {
 
 		void append(char c);
 		void backspace();
+		void clear();
+
+		// Insert into document characters accumulated by append().
+		void flush_pending_text();
 
 	protected:
 		// Functions overridden to catch events from the parent class.
@@ -53,6 +59,12 @@ namespace cw {
 		// Application to forward key and mouse events to.
 		Application *app;
 
+		// Characters appended, but not inserted into document yet.
+		QString pending_text;
+
+		// Timer triggering insertion of pending characters.
+		QTimer flush_timer;
+
 		// Prevent unwanted operations.
 		TextArea(const TextArea &);
 		TextArea &operator=(const TextArea &);